@@ -0,0 +1,412 @@
+#include "bake_cache.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <system_error>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	constexpr char kMeshMagic_[8] = "cw2mesh";
+	constexpr char kStampMagic_[] = "cw2-bake-stamp";
+
+	constexpr std::size_t kReadChunk_ = 1024*1024;
+
+	std::uint64_t mix_( std::uint64_t aValue )
+	{
+		// MurmurHash3's fmix64
+		aValue ^= aValue >> 33;
+		aValue *= 0xff51afd7ed558ccdull;
+		aValue ^= aValue >> 33;
+		aValue *= 0xc4ceb9fe1a85ec53ull;
+		aValue ^= aValue >> 33;
+		return aValue;
+	}
+
+	std::string hex_( ContentHash aHash )
+	{
+		char buf[17];
+		std::snprintf( buf, sizeof(buf), "%016" PRIx64, aHash );
+		return buf;
+	}
+
+	bool parse_hex_( std::string const& aText, ContentHash& aHash )
+	{
+		char* end = nullptr;
+		aHash = std::strtoull( aText.c_str(), &end, 16 );
+		return !aText.empty() && '\0' == *end;
+	}
+
+	// Binary (de)serialization of MeshBakeResult. Vectors are stored as a
+	// uint64 element count followed by the raw elements.
+	class Writer_
+	{
+		public:
+			explicit Writer_( FILE* aFile ) : mFile( aFile ) {}
+
+			void bytes( void const* aData, std::size_t aBytes )
+			{
+				if( aBytes && 1 != std::fwrite( aData, aBytes, 1, mFile ) )
+					mOk = false;
+			}
+
+			template< typename tType >
+			void value( tType const& aValue ) { bytes( &aValue, sizeof(tType) ); }
+
+			template< typename tType >
+			void array( std::vector<tType> const& aArray )
+			{
+				value( std::uint64_t(aArray.size()) );
+				bytes( aArray.data(), aArray.size() * sizeof(tType) );
+			}
+
+			bool ok() const noexcept { return mOk; }
+
+		private:
+			FILE* mFile;
+			bool mOk = true;
+	};
+
+	class Reader_
+	{
+		public:
+			explicit Reader_( std::vector<char> const& aData ) : mData( aData ) {}
+
+			bool bytes( void* aData, std::size_t aBytes )
+			{
+				if( aBytes > mData.size() - mPos )
+					return false;
+
+				if( aBytes )
+					std::memcpy( aData, mData.data() + mPos, aBytes );
+				mPos += aBytes;
+				return true;
+			}
+
+			template< typename tType >
+			bool value( tType& aValue ) { return bytes( &aValue, sizeof(tType) ); }
+
+			template< typename tType >
+			bool array( std::vector<tType>& aArray )
+			{
+				std::uint64_t count;
+				if( !value( count ) || count > (mData.size() - mPos) / sizeof(tType) )
+					return false;
+
+				aArray.resize( std::size_t(count) );
+				return bytes( aArray.data(), aArray.size() * sizeof(tType) );
+			}
+
+			bool at_end() const noexcept { return mPos == mData.size(); }
+
+		private:
+			std::vector<char> const& mData;
+			std::size_t mPos = 0;
+	};
+
+	bool read_file_( std::filesystem::path const& aPath, std::vector<char>& aData )
+	{
+		std::ifstream in( aPath, std::ios::binary | std::ios::ate );
+		if( !in )
+			return false;
+
+		auto const size = in.tellg();
+		if( size < 0 )
+			return false;
+
+		aData.resize( std::size_t(size) );
+		in.seekg( 0 );
+		return bool(in.read( aData.data(), size ));
+	}
+
+	// Writes via a temporary file and a rename, so that readers (and
+	// interrupted bakes) never see partial files.
+	template< typename tFunc >
+	void write_file_( std::filesystem::path const& aPath, char const* aMode, tFunc&& aWrite )
+	{
+		static std::atomic<unsigned> counter{ 0 };
+
+		auto tmp = aPath;
+		tmp += "." + std::to_string( counter++ ) + ".tmp";
+
+		FILE* out = std::fopen( tmp.string().c_str(), aMode );
+		if( !out )
+			throw lut::Error( "Unable to open '%s' for writing", tmp.string().c_str() );
+
+		bool const ok = aWrite( out );
+		if( 0 != std::fclose( out ) || !ok )
+		{
+			std::error_code ec;
+			std::filesystem::remove( tmp, ec );
+			throw lut::Error( "Writing '%s' failed", tmp.string().c_str() );
+		}
+
+		std::filesystem::rename( tmp, aPath );
+	}
+}
+
+//--    ContentHasher                   ///{{{2///////////////////////////////
+void ContentHasher::add( void const* aData, std::size_t aBytes )
+{
+	auto const* bytes = static_cast<std::uint8_t const*>(aData);
+
+	std::size_t i = 0;
+	for( ; i + 8 <= aBytes; i += 8 )
+	{
+		std::uint64_t word;
+		std::memcpy( &word, bytes + i, 8 );
+		mState = (mState ^ mix_( word )) * 0x9e3779b97f4a7c15ull;
+	}
+
+	if( i < aBytes )
+	{
+		std::uint64_t word = 0;
+		std::memcpy( &word, bytes + i, aBytes - i );
+		mState = (mState ^ mix_( word ^ (aBytes - i) )) * 0x9e3779b97f4a7c15ull;
+	}
+
+	mBytes += aBytes;
+}
+
+ContentHash ContentHasher::value() const
+{
+	return mix_( mState ^ mBytes );
+}
+
+//--    BakeCache                       ///{{{2///////////////////////////////
+BakeCache::BakeCache( std::filesystem::path aDir )
+	: mDir( std::move(aDir) )
+{
+	if( mDir.empty() )
+		return;
+
+	std::filesystem::create_directories( mDir / "meshes" );
+
+	// "<hash> <size> <time> <path>" per line
+	std::ifstream in( mDir / "files" );
+	for( std::string line; std::getline( in, line ); )
+	{
+		char hash[17];
+		std::uintmax_t size;
+		std::int64_t time;
+		int pathStart = 0;
+		if( 3 != std::sscanf( line.c_str(), "%16s %ju %" SCNd64 " %n", hash, &size, &time, &pathStart ) || 0 == pathStart )
+			continue;
+
+		FileInfo_ info{ 0, size, time };
+		if( parse_hex_( hash, info.hash ) )
+			mFiles[line.substr( std::size_t(pathStart) )] = info;
+	}
+}
+
+ContentHash BakeCache::file_hash( std::filesystem::path const& aPath )
+{
+	std::error_code ec;
+	auto const size = std::filesystem::file_size( aPath, ec );
+	auto const time = std::filesystem::last_write_time( aPath, ec );
+	if( ec )
+		throw lut::Error( "Unable to stat '%s': %s", aPath.string().c_str(), ec.message().c_str() );
+
+	std::int64_t const ticks = std::int64_t(time.time_since_epoch().count());
+
+	auto const key = aPath.generic_string();
+	{
+		std::lock_guard<std::mutex> lock( mFilesMutex );
+		if( auto const it = mFiles.find( key ); it != mFiles.end() && it->second.size == size && it->second.time == ticks )
+			return it->second.hash;
+	}
+
+	std::ifstream in( aPath, std::ios::binary );
+	if( !in )
+		throw lut::Error( "Unable to open '%s' for reading", aPath.string().c_str() );
+
+	ContentHasher hasher;
+	std::vector<char> chunk( kReadChunk_ );
+	while( in )
+	{
+		in.read( chunk.data(), std::streamsize(chunk.size()) );
+		hasher.add( chunk.data(), std::size_t(in.gcount()) );
+	}
+
+	if( in.bad() )
+		throw lut::Error( "Reading '%s' failed", aPath.string().c_str() );
+
+	auto const hash = hasher.value();
+	if( enabled() )
+	{
+		std::lock_guard<std::mutex> lock( mFilesMutex );
+		mFiles[key] = FileInfo_{ hash, size, ticks };
+	}
+
+	return hash;
+}
+
+bool BakeCache::load_mesh( ContentHash aKey, MeshBakeResult& aResult ) const
+{
+	if( !enabled() )
+		return false;
+
+	std::vector<char> data;
+	if( !read_file_( mDir / "meshes" / hex_( aKey ), data ) )
+		return false;
+
+	Reader_ in( data );
+
+	char magic[sizeof(kMeshMagic_)];
+	std::uint32_t version;
+	if( !in.bytes( magic, sizeof(magic) ) || 0 != std::memcmp( magic, kMeshMagic_, sizeof(magic) ) )
+		return false;
+	if( !in.value( version ) || kBakeCacheVersion != version )
+		return false;
+
+	MeshBakeResult ret;
+	bool ok = in.array( ret.mesh.vert )
+		&& in.array( ret.mesh.norm )
+		&& in.array( ret.mesh.text )
+		&& in.array( ret.mesh.tangent )
+		&& in.array( ret.mesh.indices )
+		&& in.value( ret.mesh.aabbMin )
+		&& in.value( ret.mesh.aabbMax )
+		&& in.value( ret.cleanup )
+		&& in.value( ret.missesBefore )
+		&& in.value( ret.missesAfter )
+	;
+
+	std::uint64_t lodCount = 0;
+	ok = ok && in.value( lodCount ) && lodCount <= kLodCount;
+	ret.lods.resize( ok ? std::size_t(lodCount) : 0 );
+	for( auto& lod : ret.lods )
+		ok = ok && in.array( lod.indices ) && in.value( lod.error );
+
+	ok = ok && in.array( ret.meshlets.meshlets )
+		&& in.array( ret.meshlets.vertices )
+		&& in.array( ret.meshlets.triangles )
+		&& in.at_end()
+	;
+
+	if( ok )
+		aResult = std::move(ret);
+
+	return ok;
+}
+
+void BakeCache::store_mesh( ContentHash aKey, MeshBakeResult const& aResult ) const
+{
+	if( !enabled() )
+		return;
+
+	write_file_( mDir / "meshes" / hex_( aKey ), "wb", [&] (FILE* aOut) {
+		Writer_ out( aOut );
+		out.bytes( kMeshMagic_, sizeof(kMeshMagic_) );
+		out.value( kBakeCacheVersion );
+
+		out.array( aResult.mesh.vert );
+		out.array( aResult.mesh.norm );
+		out.array( aResult.mesh.text );
+		out.array( aResult.mesh.tangent );
+		out.array( aResult.mesh.indices );
+		out.value( aResult.mesh.aabbMin );
+		out.value( aResult.mesh.aabbMax );
+		out.value( aResult.cleanup );
+		out.value( aResult.missesBefore );
+		out.value( aResult.missesAfter );
+
+		out.value( std::uint64_t(aResult.lods.size()) );
+		for( auto const& lod : aResult.lods )
+		{
+			out.array( lod.indices );
+			out.value( lod.error );
+		}
+
+		out.array( aResult.meshlets.meshlets );
+		out.array( aResult.meshlets.vertices );
+		out.array( aResult.meshlets.triangles );
+		return out.ok();
+	} );
+}
+
+bool BakeCache::load_stamp( std::string const& aName, Stamp& aStamp ) const
+{
+	if( !enabled() )
+		return false;
+
+	// First line: magic and version; then "<keyword> <hash> [<path>]"
+	std::ifstream in( mDir / (aName + ".stamp") );
+
+	std::string line;
+	if( !std::getline( in, line ) || line != std::string(kStampMagic_) + " " + std::to_string( kBakeCacheVersion ) )
+		return false;
+
+	Stamp ret;
+	bool haveOptions = false;
+	while( std::getline( in, line ) )
+	{
+		auto const sep0 = line.find( ' ' );
+		auto const sep1 = line.find( ' ', sep0 == std::string::npos ? sep0 : sep0+1 );
+		if( sep0 == std::string::npos )
+			return false;
+
+		auto const keyword = line.substr( 0, sep0 );
+
+		ContentHash hash;
+		if( !parse_hex_( line.substr( sep0+1, sep1 == std::string::npos ? std::string::npos : sep1-sep0-1 ), hash ) )
+			return false;
+
+		if( "options" == keyword && sep1 == std::string::npos )
+		{
+			ret.options = hash;
+			haveOptions = true;
+		}
+		else if( "input" == keyword && sep1 != std::string::npos )
+			ret.inputs.emplace_back( hash, line.substr( sep1+1 ) );
+		else if( "texture" == keyword && sep1 != std::string::npos )
+			ret.textures[line.substr( sep1+1 )] = hash;
+		else
+			return false;
+	}
+
+	if( !haveOptions )
+		return false;
+
+	aStamp = std::move(ret);
+	return true;
+}
+
+void BakeCache::store_stamp( std::string const& aName, Stamp const& aStamp ) const
+{
+	if( !enabled() )
+		return;
+
+	write_file_( mDir / (aName + ".stamp"), "w", [&] (FILE* aOut) {
+		bool ok = std::fprintf( aOut, "%s %u\n", kStampMagic_, kBakeCacheVersion ) > 0;
+		ok = ok && std::fprintf( aOut, "options %s\n", hex_( aStamp.options ).c_str() ) > 0;
+		for( auto const& [hash, path] : aStamp.inputs )
+			ok = ok && std::fprintf( aOut, "input %s %s\n", hex_( hash ).c_str(), path.c_str() ) > 0;
+		for( auto const& [path, hash] : aStamp.textures )
+			ok = ok && std::fprintf( aOut, "texture %s %s\n", hex_( hash ).c_str(), path.c_str() ) > 0;
+		return ok;
+	} );
+}
+
+void BakeCache::save() const
+{
+	if( !enabled() )
+		return;
+
+	write_file_( mDir / "files", "w", [&] (FILE* aOut) {
+		bool ok = true;
+		for( auto const& [path, info] : mFiles )
+			ok = ok && std::fprintf( aOut, "%s %ju %" PRId64 " %s\n", hex_( info.hash ).c_str(), info.size, info.time, path.c_str() ) > 0;
+		return ok;
+	} );
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,121 @@
+#ifndef BAKE_CACHE_HPP_E2A94C17_6B3D_4F58_8D07_1C5F93B2A6E4
+#define BAKE_CACHE_HPP_E2A94C17_6B3D_4F58_8D07_1C5F93B2A6E4
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "meshlet.hpp"
+#include "index_mesh.hpp"
+#include "simplify_mesh.hpp"
+
+//--    constants                               ///{{{1///////////////////////
+
+// Part of every cache key and stamp. Bump whenever the output of a mesh
+// stage (index, cleanup, optimize, LODs, meshlets), the layout of MeshBakeResult or
+// the baked file format changes, so that results of older bakers are no
+// longer reused.
+constexpr std::uint32_t kBakeCacheVersion = 10;
+
+//--    types                                   ///{{{1///////////////////////
+
+using ContentHash = std::uint64_t;
+
+// Non-cryptographic 64-bit hash, 8 bytes at a time. The result depends on
+// how the data is split into add() calls.
+class ContentHasher
+{
+	public:
+		void add( void const* aData, std::size_t aBytes );
+
+		template< typename tType >
+		void add_value( tType const& aValue ) { add( &aValue, sizeof(tType) ); }
+
+		ContentHash value() const;
+
+	private:
+		std::uint64_t mState = 0x243f6a8885a308d3ull;
+		std::uint64_t mBytes = 0;
+};
+
+// Everything cw2-bake computes for one mesh before writing it
+struct MeshBakeResult
+{
+	IndexedMesh mesh;
+	MeshCleanupStats cleanup; // primitives removed after welding
+
+	// Post-transform cache misses before/after optimize_mesh() (0 if the
+	// mesh wasn't optimized)
+	std::uint64_t missesBefore = 0, missesAfter = 0;
+
+	std::vector<MeshLod> lods; // empty unless LODs were built
+	MeshletData meshlets;      // empty unless meshlets were built
+};
+
+// Incremental baking state, kept in a directory:
+//  - "files": content hashes of input files, with the size and modification
+//    time they were computed for. A file is only re-read (and re-hashed)
+//    once its size or time changes.
+//  - "meshes/<key>": one MeshBakeResult per mesh cache key.
+//  - "<name>.stamp": the options, inputs and texture outputs of the last
+//    successful bake of an output file.
+//
+// A default-constructed (or empty directory) cache is disabled: it never
+// finds anything and stores nothing. Nothing is ever removed automatically;
+// delete the directory to reset the cache.
+//
+// file_hash(), load_mesh() and store_mesh() may be called concurrently
+// (the latter two for different keys). The stamp functions may be called
+// concurrently for different names, and save() only once nothing else runs.
+class BakeCache
+{
+	public:
+		struct Stamp
+		{
+			ContentHash options = 0;
+			std::vector<std::pair<ContentHash,std::string>> inputs;   // file hash, path
+			std::unordered_map<std::string,ContentHash> textures;     // output path -> texture key
+		};
+
+	public:
+		BakeCache() = default;
+		explicit BakeCache( std::filesystem::path aDir );
+
+		bool enabled() const noexcept { return !mDir.empty(); }
+
+		// Throws labutils::Error if the file can't be read.
+		ContentHash file_hash( std::filesystem::path const& );
+
+		bool load_mesh( ContentHash aKey, MeshBakeResult& ) const;
+		void store_mesh( ContentHash aKey, MeshBakeResult const& ) const;
+
+		// False if there's no (readable) stamp for aName
+		bool load_stamp( std::string const& aName, Stamp& ) const;
+		void store_stamp( std::string const& aName, Stamp const& ) const;
+
+		// Writes the file hashes; call once done.
+		void save() const;
+
+	private:
+		struct FileInfo_
+		{
+			ContentHash hash;
+			std::uintmax_t size;
+			std::int64_t time;
+		};
+
+		std::filesystem::path mDir;
+		std::unordered_map<std::string,FileInfo_> mFiles;
+		std::mutex mFilesMutex;
+};
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // BAKE_CACHE_HPP_E2A94C17_6B3D_4F58_8D07_1C5F93B2A6E4
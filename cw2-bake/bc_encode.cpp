@@ -0,0 +1,321 @@
+#include "bc_encode.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// BC7 interpolation weights for 4-bit indices (in 1/64ths)
+	constexpr int kBc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Writes values LSB first into a 128-bit block
+	struct BitWriter_
+	{
+		std::uint8_t* out;
+		unsigned pos = 0;
+
+		void put( std::uint32_t aValue, unsigned aBits );
+	};
+
+	// Endpoint of a BC7 mode 6 block: 7 bits per channel plus a shared
+	// p-bit, i.e., 8-bit values whose lowest bit is the same for all
+	// channels.
+	struct Bc7Endpoint_
+	{
+		int c[4];
+		int p;
+
+		int value( int aChannel ) const { return (c[aChannel] << 1) | p; }
+	};
+
+	Bc7Endpoint_ quantize_bc7_endpoint_( float const* aValue );
+
+	float assign_bc7_indices_( float const (*aTexels)[4], Bc7Endpoint_ const&, Bc7Endpoint_ const&, int* aIndices );
+}
+
+//--    encode_bc4_block()              ///{{{2///////////////////////////////
+void encode_bc4_block( std::uint8_t const* aValues, std::uint8_t* aOut )
+{
+	std::uint8_t lo = 255, hi = 0;
+	for( int i = 0; i < 16; ++i )
+	{
+		lo = std::min( lo, aValues[i] );
+		hi = std::max( hi, aValues[i] );
+	}
+
+	// With r0 > r1, the palette is r0, r1 and six values in between. With
+	// r0 == r1 (a constant block), the 6-value mode results, whose first two
+	// entries are still r0 and r1; index 0 is exact either way.
+	aOut[0] = hi;
+	aOut[1] = lo;
+
+	float palette[8];
+	palette[0] = float(hi);
+	palette[1] = float(lo);
+	for( int i = 2; i < 8; ++i )
+		palette[i] = (float(8-i) * hi + float(i-1) * lo) / 7.f;
+
+	std::uint64_t bits = 0;
+	if( hi != lo )
+	{
+		for( int i = 0; i < 16; ++i )
+		{
+			int best = 0;
+			float bestErr = std::abs( palette[0] - aValues[i] );
+			for( int j = 1; j < 8; ++j )
+			{
+				float const err = std::abs( palette[j] - aValues[i] );
+				if( err < bestErr )
+				{
+					bestErr = err;
+					best = j;
+				}
+			}
+
+			bits |= std::uint64_t(best) << (3*i);
+		}
+	}
+
+	for( int i = 0; i < 6; ++i )
+		aOut[2+i] = std::uint8_t(bits >> (8*i));
+}
+
+//--    encode_bc5_block()              ///{{{2///////////////////////////////
+void encode_bc5_block( std::uint8_t const* aRed, std::uint8_t const* aGreen, std::uint8_t* aOut )
+{
+	encode_bc4_block( aRed, aOut );
+	encode_bc4_block( aGreen, aOut + 8 );
+}
+
+//--    encode_bc7_block()              ///{{{2///////////////////////////////
+void encode_bc7_block( std::uint8_t const* aRGBA, std::uint8_t* aOut )
+{
+	float texels[16][4];
+	float mean[4] = {};
+	for( int i = 0; i < 16; ++i )
+	{
+		for( int c = 0; c < 4; ++c )
+		{
+			texels[i][c] = float(aRGBA[4*i+c]);
+			mean[c] += texels[i][c] / 16.f;
+		}
+	}
+
+	// Principal axis of the block's colours (power iteration on the
+	// covariance matrix), starting from the bounding box diagonal.
+	float cov[4][4] = {};
+	float axis[4] = {};
+	float lo[4] = { 255.f, 255.f, 255.f, 255.f }, hi[4] = {};
+	for( int i = 0; i < 16; ++i )
+	{
+		float d[4];
+		for( int c = 0; c < 4; ++c )
+		{
+			d[c] = texels[i][c] - mean[c];
+			lo[c] = std::min( lo[c], texels[i][c] );
+			hi[c] = std::max( hi[c], texels[i][c] );
+		}
+
+		for( int r = 0; r < 4; ++r )
+			for( int c = 0; c < 4; ++c )
+				cov[r][c] += d[r] * d[c];
+	}
+
+	for( int c = 0; c < 4; ++c )
+		axis[c] = hi[c] - lo[c];
+
+	for( int iter = 0; iter < 8; ++iter )
+	{
+		float next[4] = {};
+		for( int r = 0; r < 4; ++r )
+			for( int c = 0; c < 4; ++c )
+				next[r] += cov[r][c] * axis[c];
+
+		float const len = std::sqrt( next[0]*next[0] + next[1]*next[1] + next[2]*next[2] + next[3]*next[3] );
+		if( len < 1e-6f )
+			break;
+
+		for( int c = 0; c < 4; ++c )
+			axis[c] = next[c] / len;
+	}
+
+	float const axisLen = std::sqrt( axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2] + axis[3]*axis[3] );
+	if( axisLen > 1e-6f )
+	{
+		for( float& a : axis )
+			a /= axisLen;
+	}
+
+	float tmin = 0.f, tmax = 0.f;
+	for( int i = 0; i < 16; ++i )
+	{
+		float t = 0.f;
+		for( int c = 0; c < 4; ++c )
+			t += (texels[i][c] - mean[c]) * axis[c];
+
+		tmin = std::min( tmin, t );
+		tmax = std::max( tmax, t );
+	}
+
+	float e0[4], e1[4];
+	for( int c = 0; c < 4; ++c )
+	{
+		e0[c] = mean[c] + axis[c] * tmin;
+		e1[c] = mean[c] + axis[c] * tmax;
+	}
+
+	Bc7Endpoint_ best0 = quantize_bc7_endpoint_( e0 );
+	Bc7Endpoint_ best1 = quantize_bc7_endpoint_( e1 );
+	int bestIndices[16];
+	float bestErr = assign_bc7_indices_( texels, best0, best1, bestIndices );
+
+	// Least-squares refit of the endpoints to the chosen indices
+	for( int iter = 0; iter < 2 && bestErr > 0.f; ++iter )
+	{
+		float a = 0.f, b = 0.f, d = 0.f;
+		float rhs0[4] = {}, rhs1[4] = {};
+		for( int i = 0; i < 16; ++i )
+		{
+			float const w = float(kBc7Weights4[bestIndices[i]]) / 64.f;
+			a += (1.f-w) * (1.f-w);
+			b += (1.f-w) * w;
+			d += w * w;
+			for( int c = 0; c < 4; ++c )
+			{
+				rhs0[c] += (1.f-w) * texels[i][c];
+				rhs1[c] += w * texels[i][c];
+			}
+		}
+
+		float const det = a*d - b*b;
+		if( std::abs( det ) < 1e-6f )
+			break;
+
+		for( int c = 0; c < 4; ++c )
+		{
+			e0[c] = (d*rhs0[c] - b*rhs1[c]) / det;
+			e1[c] = (a*rhs1[c] - b*rhs0[c]) / det;
+		}
+
+		Bc7Endpoint_ const q0 = quantize_bc7_endpoint_( e0 );
+		Bc7Endpoint_ const q1 = quantize_bc7_endpoint_( e1 );
+		int indices[16];
+		float const err = assign_bc7_indices_( texels, q0, q1, indices );
+		if( err >= bestErr )
+			break;
+
+		best0 = q0;
+		best1 = q1;
+		bestErr = err;
+		std::memcpy( bestIndices, indices, sizeof(indices) );
+	}
+
+	// The MSB of the first index is implicit (zero); swap the endpoints if
+	// necessary.
+	if( bestIndices[0] >= 8 )
+	{
+		std::swap( best0, best1 );
+		for( int& idx : bestIndices )
+			idx = 15 - idx;
+	}
+
+	std::memset( aOut, 0, 16 );
+	BitWriter_ bits{ aOut };
+
+	bits.put( 1u << 6, 7 ); // mode 6
+	for( int c = 0; c < 4; ++c )
+	{
+		bits.put( std::uint32_t(best0.c[c]), 7 );
+		bits.put( std::uint32_t(best1.c[c]), 7 );
+	}
+	bits.put( std::uint32_t(best0.p), 1 );
+	bits.put( std::uint32_t(best1.p), 1 );
+
+	bits.put( std::uint32_t(bestIndices[0]), 3 );
+	for( int i = 1; i < 16; ++i )
+		bits.put( std::uint32_t(bestIndices[i]), 4 );
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	void BitWriter_::put( std::uint32_t aValue, unsigned aBits )
+	{
+		for( unsigned i = 0; i < aBits; ++i, ++pos )
+		{
+			if( aValue & (1u << i) )
+				out[pos >> 3] |= std::uint8_t(1u << (pos & 7));
+		}
+	}
+
+	Bc7Endpoint_ quantize_bc7_endpoint_( float const* aValue )
+	{
+		// Pick the p-bit that gets all four channels closest
+		Bc7Endpoint_ best{};
+		float bestErr = -1.f;
+
+		for( int p = 0; p < 2; ++p )
+		{
+			Bc7Endpoint_ ep{};
+			ep.p = p;
+
+			float err = 0.f;
+			for( int c = 0; c < 4; ++c )
+			{
+				float const v = std::clamp( aValue[c], 0.f, 255.f );
+				ep.c[c] = std::clamp( int(std::lround( (v - float(p)) * 0.5f )), 0, 127 );
+
+				float const diff = float(ep.value( c )) - v;
+				err += diff * diff;
+			}
+
+			if( bestErr < 0.f || err < bestErr )
+			{
+				best = ep;
+				bestErr = err;
+			}
+		}
+
+		return best;
+	}
+
+	float assign_bc7_indices_( float const (*aTexels)[4], Bc7Endpoint_ const& aE0, Bc7Endpoint_ const& aE1, int* aIndices )
+	{
+		float palette[16][4];
+		for( int i = 0; i < 16; ++i )
+		{
+			int const w = kBc7Weights4[i];
+			for( int c = 0; c < 4; ++c )
+				palette[i][c] = float(((64 - w) * aE0.value( c ) + w * aE1.value( c ) + 32) >> 6);
+		}
+
+		float total = 0.f;
+		for( int i = 0; i < 16; ++i )
+		{
+			int best = 0;
+			float bestErr = -1.f;
+			for( int j = 0; j < 16; ++j )
+			{
+				float err = 0.f;
+				for( int c = 0; c < 4; ++c )
+				{
+					float const diff = palette[j][c] - aTexels[i][c];
+					err += diff * diff;
+				}
+
+				if( bestErr < 0.f || err < bestErr )
+				{
+					bestErr = err;
+					best = j;
+				}
+			}
+
+			aIndices[i] = best;
+			total += bestErr;
+		}
+
+		return total;
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef BC_ENCODE_HPP_4C1E7A92_0B6F_4D38_A5E1_93F2C07D6B15
+#define BC_ENCODE_HPP_4C1E7A92_0B6F_4D38_A5E1_93F2C07D6B15
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <cstdint>
+
+//--    functions                               ///{{{1///////////////////////
+
+// Block encoders for the formats produced by cw2-bake. Each takes the 4x4
+// texels of one block in row-major order (texel 0 is the first texel of the
+// first row) and writes one compressed block.
+
+// BC4: one channel; aValues[16] -> 8 bytes
+void encode_bc4_block( std::uint8_t const* aValues, std::uint8_t* aOut );
+
+// BC5: two channels, stored as two BC4 blocks; 16 bytes
+void encode_bc5_block( std::uint8_t const* aRed, std::uint8_t const* aGreen, std::uint8_t* aOut );
+
+// BC7: RGBA; aRGBA[64] -> 16 bytes. Only mode 6 (a single RGBA endpoint
+// pair with 4-bit indices) is used, which is fast to encode and handles
+// the alpha masks in the base colour textures.
+void encode_bc7_block( std::uint8_t const* aRGBA, std::uint8_t* aOut );
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // BC_ENCODE_HPP_4C1E7A92_0B6F_4D38_A5E1_93F2C07D6B15
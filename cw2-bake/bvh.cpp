@@ -0,0 +1,190 @@
+#include "bvh.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Tweakables
+	// Centroid bins per axis of the SAH sweep
+	constexpr std::uint32_t kSahBins = 16;
+	// Cost of visiting a node, relative to testing one primitive
+	constexpr float kTraversalCost = 1.f;
+
+	struct Box_
+	{
+		glm::vec3 min{ std::numeric_limits<float>::max() };
+		glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+		void grow( glm::vec3 const& aMin, glm::vec3 const& aMax )
+		{
+			min = glm::min( min, aMin );
+			max = glm::max( max, aMax );
+		}
+
+		float area() const
+		{
+			if( min.x > max.x )
+				return 0.f;
+
+			glm::vec3 const e = max - min;
+			return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	};
+
+	struct Builder_
+	{
+		std::vector<glm::vec3> const& mins;
+		std::vector<glm::vec3> const& maxs;
+		std::uint32_t maxLeafSize;
+
+		BakedBvh& out;
+
+		// Appends the subtree over out.primitives[aBegin, aEnd), which it
+		// reorders, depth first
+		void build( std::uint32_t aBegin, std::uint32_t aEnd );
+	};
+}
+
+BakedBvh build_bvh( std::vector<glm::vec3> const& aMins, std::vector<glm::vec3> const& aMaxs, std::uint32_t aMaxLeafSize )
+{
+	assert( aMins.size() == aMaxs.size() );
+	assert( aMaxLeafSize >= 1 );
+
+	BakedBvh ret;
+	for( std::size_t i = 0; i < aMins.size(); ++i )
+	{
+		if( glm::all( glm::lessThanEqual( aMins[i], aMaxs[i] ) ) )
+			ret.primitives.emplace_back( std::uint32_t(i) );
+	}
+
+	if( ret.primitives.empty() )
+		return ret;
+
+	// A binary tree with at least one primitive per leaf
+	ret.nodes.reserve( 2 * ret.primitives.size() - 1 );
+
+	Builder_ builder{ aMins, aMaxs, aMaxLeafSize, ret };
+	builder.build( 0, std::uint32_t(ret.primitives.size()) );
+	return ret;
+}
+
+namespace
+{
+	void Builder_::build( std::uint32_t aBegin, std::uint32_t aEnd )
+	{
+		auto const index = std::uint32_t(out.nodes.size());
+		out.nodes.emplace_back();
+
+		Box_ bounds, centres;
+		for( std::uint32_t i = aBegin; i < aEnd; ++i )
+		{
+			auto const p = out.primitives[i];
+			bounds.grow( mins[p], maxs[p] );
+			glm::vec3 const c = 0.5f * (mins[p] + maxs[p]);
+			centres.grow( c, c );
+		}
+
+		auto const finish_ = [&] {
+			auto& node = out.nodes[index];
+			node.aabbMin = bounds.min;
+			node.aabbMax = bounds.max;
+			node.first = aBegin;
+			node.skip = std::uint32_t(out.nodes.size());
+		};
+
+		std::uint32_t const count = aEnd - aBegin;
+		if( 1 == count )
+			return finish_();
+
+		// Best split over the bins of each axis
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		std::uint32_t bestBin = 0;
+
+		glm::vec3 const extent = centres.max - centres.min;
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			if( extent[axis] <= 0.f )
+				continue;
+
+			Box_ bins[kSahBins];
+			std::uint32_t counts[kSahBins]{};
+			float const scale = kSahBins / extent[axis];
+			auto const bin_ = [&] (std::uint32_t aPrimitive) {
+				float const c = 0.5f * (mins[aPrimitive][axis] + maxs[aPrimitive][axis]);
+				return std::min( std::uint32_t((c - centres.min[axis]) * scale ), kSahBins - 1 );
+			};
+
+			for( std::uint32_t i = aBegin; i < aEnd; ++i )
+			{
+				auto const p = out.primitives[i];
+				auto const b = bin_( p );
+				bins[b].grow( mins[p], maxs[p] );
+				++counts[b];
+			}
+
+			// Sweep from the right, then from the left
+			float rightCost[kSahBins];
+			{
+				Box_ box;
+				std::uint32_t n = 0;
+				for( std::uint32_t b = kSahBins - 1; b > 0; --b )
+				{
+					box.grow( bins[b].min, bins[b].max );
+					n += counts[b];
+					rightCost[b] = box.area() * float(n);
+				}
+			}
+
+			Box_ box;
+			std::uint32_t n = 0;
+			for( std::uint32_t b = 0; b + 1 < kSahBins; ++b )
+			{
+				box.grow( bins[b].min, bins[b].max );
+				n += counts[b];
+				if( 0 == n || count == n )
+					continue;
+
+				float const cost = box.area() * float(n) + rightCost[b + 1];
+				if( cost < bestCost )
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		float const area = bounds.area();
+		float const splitCost = area > 0.f ? kTraversalCost + bestCost / area : kTraversalCost + float(count);
+		if( count <= maxLeafSize && (bestAxis < 0 || float(count) <= splitCost) )
+			return finish_();
+
+		// Partition by the best bin, or by the median of the widest axis if
+		// the centres can't be told apart by any bin
+		std::uint32_t middle;
+		if( bestAxis >= 0 )
+		{
+			float const scale = kSahBins / extent[bestAxis];
+			auto const* const it = std::partition( out.primitives.data() + aBegin, out.primitives.data() + aEnd, [&] (std::uint32_t aPrimitive) {
+				float const c = 0.5f * (mins[aPrimitive][bestAxis] + maxs[aPrimitive][bestAxis]);
+				return std::min( std::uint32_t((c - centres.min[bestAxis]) * scale ), kSahBins - 1 ) <= bestBin;
+			} );
+			middle = std::uint32_t(it - out.primitives.data());
+		}
+		else
+		{
+			middle = aBegin + count / 2;
+		}
+		assert( middle > aBegin && middle < aEnd );
+
+		build( aBegin, middle );
+		build( middle, aEnd );
+		finish_();
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef BVH_HPP_3D7A0C95_E41B_4F26_B8C3_5A9E17D2F084
+#define BVH_HPP_3D7A0C95_E41B_4F26_B8C3_5A9E17D2F084
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "../cw2/baked_bvh.hpp"
+
+//--    functions                               ///{{{1///////////////////////
+
+// Builds the BVH (see baked_bvh.hpp) over the boxes aMins[i] to aMaxs[i],
+// whose indices become the primitives. Boxes with aMins[i] > aMaxs[i] (such
+// as those of empty meshes) are left out. Splits are chosen with the binned
+// surface area heuristic over the box centres; subtrees of at most
+// aMaxLeafSize boxes become leaves when that is cheaper. Returns an empty
+// BVH if there are no boxes.
+BakedBvh build_bvh(
+	std::vector<glm::vec3> const& aMins,
+	std::vector<glm::vec3> const& aMaxs,
+	std::uint32_t aMaxLeafSize = kBvhMaxLeafSize
+);
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // BVH_HPP_3D7A0C95_E41B_4F26_B8C3_5A9E17D2F084
@@ -0,0 +1,499 @@
+#include "gpu_indexing.hpp"
+
+#include <limits>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Matches the push constants of cw2-bake/shaders/indexing.glsl
+	struct Push_
+	{
+		float gridMin[3];
+		float gridScale;
+		std::uint32_t count;
+		std::uint32_t shift;
+		std::uint32_t blocks;
+		std::uint32_t corners;
+	};
+
+	// kRadixBits, kSortThreads and kSortBlock of indexing.glsl
+	constexpr unsigned kRadixBits_ = 8;
+	constexpr std::uint32_t kGroupSize_ = 256;
+	constexpr std::uint32_t kSortBlock_ = 16 * kGroupSize_;
+
+	// Work groups of the per-element shaders, which loop over the rest
+	constexpr std::uint32_t kMaxGroups_ = 4096;
+
+	// Set layout: all storage buffers; see the shaders for which use what
+	enum EBinding_ : std::uint32_t
+	{
+		inKeys, inValues,
+		outKeys, outValues,
+		counts,
+		positions, texcoords, normals, indices,
+		corners,
+		tangents,
+
+		bindingCount
+	};
+
+	enum class EPipe_ : std::size_t
+	{
+		keys,
+		histogram, scan, scatter,
+		cornerTangents, vertexTangents
+	};
+
+	constexpr char const* kPipeShaders_[] = {
+		"weld_keys.comp.spv",
+		"radix_histogram.comp.spv",
+		"radix_scan.comp.spv",
+		"radix_scatter.comp.spv",
+		"corner_tangents.comp.spv",
+		"vertex_tangents.comp.spv"
+	};
+
+	std::uint32_t groups_( std::size_t aCount )
+	{
+		return std::uint32_t(std::min<std::size_t>( (aCount + kGroupSize_-1) / kGroupSize_, kMaxGroups_ ));
+	}
+
+	void compute_barrier_( VkCommandBuffer aCmd, VkAccessFlags aSrcAccess, VkAccessFlags aDstAccess, VkPipelineStageFlags aSrcStage, VkPipelineStageFlags aDstStage )
+	{
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = aSrcAccess;
+		barrier.dstAccessMask = aDstAccess;
+
+		vkCmdPipelineBarrier( aCmd, aSrcStage, aDstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+	}
+
+	void compute_barrier_( VkCommandBuffer aCmd )
+	{
+		compute_barrier_( aCmd,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		);
+	}
+}
+
+//--    GpuMeshIndexing                 ///{{{2///////////////////////////////
+GpuMeshIndexing::GpuMeshIndexing( char const* aShaderDir )
+	: mContext( lut::make_vulkan_context() )
+{
+	// Short-lived buffers of any size; the custom pools' blocks would only
+	// be in the way
+	lut::AllocatorConfig config;
+	config.pools = false;
+	mAllocator = lut::create_allocator( mContext, config );
+
+	mCmdPool = lut::create_command_pool( mContext );
+	mCmd = lut::alloc_command_buffer( mContext, mCmdPool.handle );
+	mFence = lut::create_fence( mContext );
+
+	{
+		VkDescriptorSetLayoutBinding bindings[bindingCount]{};
+		for( std::uint32_t i = 0; i < bindingCount; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = bindingCount;
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( mContext.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create mesh indexing descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		mSetLayout = lut::DescriptorSetLayout( mContext.device, layout );
+	}
+
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		range.offset = 0;
+		range.size = sizeof(Push_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &mSetLayout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( mContext.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create mesh indexing pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		mPipeLayout = lut::PipelineLayout( mContext.device, layout );
+	}
+
+	for( auto const* shader : kPipeShaders_ )
+	{
+		auto const path = std::string(aShaderDir) + "/" + shader;
+		auto const module = lut::load_shader_module( mContext, path.c_str() );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = module.handle;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = mPipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( mContext.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create mesh indexing pipeline '%s'\n" "vkCreateComputePipelines() returned %s", path.c_str(), lut::to_string(res).c_str() );
+
+		mPipes.emplace_back( mContext.device, pipe );
+	}
+
+	mDescPool = lut::create_descriptor_pool( mContext, 2 * bindingCount, 2 );
+}
+
+void GpuMeshIndexing::sort_cells( std::vector<glm::vec3> const& aPositions, glm::vec3 aMin, float aScale, std::vector<std::uint64_t>& aKeys, std::vector<std::uint32_t>& aVertices )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	std::size_t const count = aPositions.size();
+	aKeys.resize( count );
+	aVertices.resize( count );
+	if( 0 == count )
+		return;
+
+	auto const sort = create_sort_( count );
+
+	VkDeviceSize const positionBytes = count * sizeof(glm::vec3);
+	auto const positionBuffer = create_storage_( positionBytes );
+
+	auto staging = lut::create_buffer( mAllocator, positionBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+	std::memcpy( lut::mapped_data( mAllocator, staging ), aPositions.data(), positionBytes );
+	vmaFlushAllocation( mAllocator.allocator, staging.allocation, 0, VK_WHOLE_SIZE );
+
+	VkDeviceSize const keyBytes = count * sizeof(std::uint64_t);
+	VkDeviceSize const valueBytes = count * sizeof(std::uint32_t);
+	auto readback = lut::create_buffer( mAllocator, keyBytes + valueBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+
+	VkBuffer buffers[bindingCount]{};
+	buffers[positions] = positionBuffer.buffer;
+
+	VkDescriptorSet sets[2];
+	write_sets_( sets, sort, buffers );
+
+	auto const cmd = begin_();
+
+	VkBufferCopy const upload{ 0, 0, positionBytes };
+	vkCmdCopyBuffer( cmd, staging.buffer, positionBuffer.buffer, 1, &upload );
+	compute_barrier_( cmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	// The keys go into the first pair, where the sort starts: set 1 writes
+	// to it
+	Push_ push{};
+	push.gridMin[0] = aMin.x;
+	push.gridMin[1] = aMin.y;
+	push.gridMin[2] = aMin.z;
+	push.gridScale = aScale;
+	push.count = sort.count;
+
+	vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipes[std::size_t(EPipe_::keys)].handle );
+	vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeLayout.handle, 0, 1, &sets[1], 0, nullptr );
+	vkCmdPushConstants( cmd, mPipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+	vkCmdDispatch( cmd, groups_( count ), 1, 1 );
+	compute_barrier_( cmd );
+
+	record_sort_( cmd, sets, sort, 63 );
+
+	// Read back; the uvec2 keys are little-endian 64-bit integers
+	compute_barrier_( cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	VkBufferCopy const keyCopy{ 0, 0, keyBytes };
+	vkCmdCopyBuffer( cmd, sort.keys[0].buffer, readback.buffer, 1, &keyCopy );
+	VkBufferCopy const valueCopy{ 0, keyBytes, valueBytes };
+	vkCmdCopyBuffer( cmd, sort.values[0].buffer, readback.buffer, 1, &valueCopy );
+
+	lut::buffer_barrier( cmd, readback.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT );
+
+	submit_and_wait_();
+
+	if( auto const res = vmaInvalidateAllocation( mAllocator.allocator, readback.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+		throw lut::Error( "Invalidating mesh indexing readback\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str() );
+
+	auto const* data = lut::mapped_data( mAllocator, readback );
+	std::memcpy( aKeys.data(), data, keyBytes );
+	std::memcpy( aVertices.data(), data + keyBytes, valueBytes );
+}
+
+void GpuMeshIndexing::compute_tangents( IndexedMesh& aMesh )
+{
+	// Nothing to sort; the CPU's result (NaNs, as the sums are zero) is
+	// quicker than setting up the dispatches
+	if( aMesh.norm.empty() || aMesh.indices.empty() )
+	{
+		::compute_tangents( aMesh );
+		return;
+	}
+
+	assert( aMesh.norm.size() == aMesh.vert.size() );
+	assert( aMesh.text.size() == aMesh.vert.size() );
+	assert( 0 == aMesh.indices.size() % 3 );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	std::size_t const verts = aMesh.vert.size();
+	std::size_t const cornerCount = aMesh.indices.size();
+
+	auto const sort = create_sort_( cornerCount );
+
+	VkDeviceSize const positionBytes = verts * sizeof(glm::vec3);
+	VkDeviceSize const texcoordBytes = verts * sizeof(glm::vec2);
+	VkDeviceSize const normalBytes = verts * sizeof(glm::vec3);
+	VkDeviceSize const indexBytes = cornerCount * sizeof(std::uint32_t);
+	VkDeviceSize const tangentBytes = verts * sizeof(glm::vec4);
+
+	auto const positionBuffer = create_storage_( positionBytes );
+	auto const texcoordBuffer = create_storage_( texcoordBytes );
+	auto const normalBuffer = create_storage_( normalBytes );
+	auto const indexBuffer = create_storage_( indexBytes );
+	auto const cornerBuffer = create_storage_( cornerCount * sizeof(glm::vec4) );
+	auto const tangentBuffer = create_storage_( tangentBytes );
+
+	// One staging buffer, the arrays back to back
+	VkDeviceSize const stagingBytes = positionBytes + texcoordBytes + normalBytes + indexBytes;
+	auto staging = lut::create_buffer( mAllocator, stagingBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+	{
+		auto* data = lut::mapped_data( mAllocator, staging );
+		std::memcpy( data, aMesh.vert.data(), positionBytes );
+		std::memcpy( data + positionBytes, aMesh.text.data(), texcoordBytes );
+		std::memcpy( data + positionBytes + texcoordBytes, aMesh.norm.data(), normalBytes );
+		std::memcpy( data + positionBytes + texcoordBytes + normalBytes, aMesh.indices.data(), indexBytes );
+		vmaFlushAllocation( mAllocator.allocator, staging.allocation, 0, VK_WHOLE_SIZE );
+	}
+
+	auto readback = lut::create_buffer( mAllocator, tangentBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+
+	VkBuffer buffers[bindingCount]{};
+	buffers[positions] = positionBuffer.buffer;
+	buffers[texcoords] = texcoordBuffer.buffer;
+	buffers[normals] = normalBuffer.buffer;
+	buffers[indices] = indexBuffer.buffer;
+	buffers[corners] = cornerBuffer.buffer;
+	buffers[tangents] = tangentBuffer.buffer;
+
+	VkDescriptorSet sets[2];
+	write_sets_( sets, sort, buffers );
+
+	auto const cmd = begin_();
+
+	std::pair<VkBuffer,VkDeviceSize> const uploads[] = {
+		{ positionBuffer.buffer, positionBytes },
+		{ texcoordBuffer.buffer, texcoordBytes },
+		{ normalBuffer.buffer, normalBytes },
+		{ indexBuffer.buffer, indexBytes }
+	};
+
+	VkDeviceSize offset = 0;
+	for( auto const& [dst, bytes] : uploads )
+	{
+		VkBufferCopy const copy{ offset, 0, bytes };
+		vkCmdCopyBuffer( cmd, staging.buffer, dst, 1, &copy );
+		offset += bytes;
+	}
+	compute_barrier_( cmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	// Corner tangents, and the corners keyed by vertex into the first pair
+	// (set 1 writes to it)
+	Push_ push{};
+	push.count = std::uint32_t(cornerCount / 3);
+
+	vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipes[std::size_t(EPipe_::cornerTangents)].handle );
+	vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeLayout.handle, 0, 1, &sets[1], 0, nullptr );
+	vkCmdPushConstants( cmd, mPipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+	vkCmdDispatch( cmd, groups_( cornerCount / 3 ), 1, 1 );
+	compute_barrier_( cmd );
+
+	// Only the digits that vertex indices use
+	unsigned keyBits = 1;
+	while( keyBits < 32 && (std::uint64_t(1) << keyBits) < verts )
+		++keyBits;
+
+	record_sort_( cmd, sets, sort, keyBits );
+
+	// Per-vertex sums, from the sorted first pair (set 0 reads it)
+	push.count = std::uint32_t(verts);
+	push.corners = sort.count;
+
+	vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipes[std::size_t(EPipe_::vertexTangents)].handle );
+	vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeLayout.handle, 0, 1, &sets[0], 0, nullptr );
+	vkCmdPushConstants( cmd, mPipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+	vkCmdDispatch( cmd, groups_( verts ), 1, 1 );
+
+	compute_barrier_( cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	VkBufferCopy const tangentCopy{ 0, 0, tangentBytes };
+	vkCmdCopyBuffer( cmd, tangentBuffer.buffer, readback.buffer, 1, &tangentCopy );
+
+	lut::buffer_barrier( cmd, readback.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT );
+
+	submit_and_wait_();
+
+	if( auto const res = vmaInvalidateAllocation( mAllocator.allocator, readback.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+		throw lut::Error( "Invalidating mesh indexing readback\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str() );
+
+	aMesh.tangent.resize( verts );
+	std::memcpy( aMesh.tangent.data(), lut::mapped_data( mAllocator, readback ), tangentBytes );
+}
+
+GpuMeshIndexing::Sort_ GpuMeshIndexing::create_sort_( std::size_t aCount ) const
+{
+	assert( aCount > 0 );
+	if( aCount > kMaxSortKeys )
+		throw lut::Error( "GPU mesh indexing: %zu keys, at most %zu can be sorted", aCount, kMaxSortKeys );
+
+	Sort_ ret;
+	ret.count = std::uint32_t(aCount);
+	ret.blocks = std::uint32_t((aCount + kSortBlock_-1) / kSortBlock_);
+
+	for( std::size_t i = 0; i < 2; ++i )
+	{
+		ret.keys[i] = create_storage_( aCount * sizeof(std::uint64_t) );
+		ret.values[i] = create_storage_( aCount * sizeof(std::uint32_t) );
+	}
+
+	ret.counts = create_storage_( VkDeviceSize(ret.blocks) * (1u << kRadixBits_) * sizeof(std::uint32_t) );
+	return ret;
+}
+
+lut::Buffer GpuMeshIndexing::create_storage_( VkDeviceSize aSize ) const
+{
+	return lut::create_buffer( mAllocator, aSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+}
+
+void GpuMeshIndexing::write_sets_( VkDescriptorSet (&aSets)[2], Sort_ const& aSort, VkBuffer const* aBuffers )
+{
+	// The sets of the previous call are done with
+	if( auto const res = vkResetDescriptorPool( mContext.device, mDescPool.handle, 0 ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to reset mesh indexing descriptor pool\n" "vkResetDescriptorPool() returned %s", lut::to_string(res).c_str() );
+
+	VkDescriptorBufferInfo infos[2][bindingCount]{};
+	VkWriteDescriptorSet writes[2*bindingCount]{};
+	std::uint32_t writeCount = 0;
+
+	for( std::size_t i = 0; i < 2; ++i )
+	{
+		aSets[i] = lut::alloc_desc_set( mContext, mDescPool.handle, mSetLayout.handle );
+
+		VkBuffer buffers[bindingCount];
+		std::copy( aBuffers, aBuffers + bindingCount, buffers );
+		buffers[inKeys] = aSort.keys[i].buffer;
+		buffers[inValues] = aSort.values[i].buffer;
+		buffers[outKeys] = aSort.keys[1-i].buffer;
+		buffers[outValues] = aSort.values[1-i].buffer;
+		buffers[counts] = aSort.counts.buffer;
+
+		for( std::uint32_t binding = 0; binding < bindingCount; ++binding )
+		{
+			if( VK_NULL_HANDLE == buffers[binding] )
+				continue;
+
+			infos[i][binding].buffer = buffers[binding];
+			infos[i][binding].range = VK_WHOLE_SIZE;
+
+			auto& write = writes[writeCount++];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = aSets[i];
+			write.dstBinding = binding;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &infos[i][binding];
+		}
+	}
+
+	vkUpdateDescriptorSets( mContext.device, writeCount, writes, 0, nullptr );
+}
+
+void GpuMeshIndexing::record_sort_( VkCommandBuffer aCmd, VkDescriptorSet const (&aSets)[2], Sort_ const& aSort, unsigned aKeyBits ) const
+{
+	// An even number of passes leaves the keys in the first pair
+	unsigned passes = (aKeyBits + kRadixBits_-1) / kRadixBits_;
+	passes += passes % 2;
+
+	Push_ push{};
+	push.count = aSort.count;
+	push.blocks = aSort.blocks;
+
+	for( unsigned pass = 0; pass < passes; ++pass )
+	{
+		push.shift = pass * kRadixBits_;
+
+		vkCmdBindDescriptorSets( aCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeLayout.handle, 0, 1, &aSets[pass % 2], 0, nullptr );
+		vkCmdPushConstants( aCmd, mPipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+
+		vkCmdBindPipeline( aCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipes[std::size_t(EPipe_::histogram)].handle );
+		vkCmdDispatch( aCmd, aSort.blocks, 1, 1 );
+		compute_barrier_( aCmd );
+
+		vkCmdBindPipeline( aCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipes[std::size_t(EPipe_::scan)].handle );
+		vkCmdDispatch( aCmd, 1, 1, 1 );
+		compute_barrier_( aCmd );
+
+		vkCmdBindPipeline( aCmd, VK_PIPELINE_BIND_POINT_COMPUTE, mPipes[std::size_t(EPipe_::scatter)].handle );
+		vkCmdDispatch( aCmd, aSort.blocks, 1, 1 );
+		compute_barrier_( aCmd );
+	}
+}
+
+VkCommandBuffer GpuMeshIndexing::begin_()
+{
+	if( auto const res = vkResetCommandPool( mContext.device, mCmdPool.handle, 0 ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to reset mesh indexing command pool\n" "vkResetCommandPool() returned %s", lut::to_string(res).c_str() );
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if( auto const res = vkBeginCommandBuffer( mCmd, &beginInfo ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to begin mesh indexing command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str() );
+
+	return mCmd;
+}
+
+void GpuMeshIndexing::submit_and_wait_()
+{
+	if( auto const res = vkEndCommandBuffer( mCmd ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to end mesh indexing command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str() );
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &mCmd;
+
+	if( auto const res = vkQueueSubmit( mContext.graphicsQueue, 1, &submitInfo, mFence.handle ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to submit mesh indexing commands\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str() );
+
+	if( auto const res = vkWaitForFences( mContext.device, 1, &mFence.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to wait for mesh indexing commands\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str() );
+
+	if( auto const res = vkResetFences( mContext.device, 1, &mFence.handle ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to reset mesh indexing fence\n" "vkResetFences() returned %s", lut::to_string(res).c_str() );
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,108 @@
+#ifndef GPU_INDEXING_HPP_6F5B7590_E328_4919_B564_638D475C67D0
+#define GPU_INDEXING_HPP_6F5B7590_E328_4919_B564_638D475C67D0
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <mutex>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "index_mesh.hpp"
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_context.hpp"
+
+//--    types                                   ///{{{1///////////////////////
+
+// make_indexed_mesh()'s data-parallel steps as compute shaders, on a
+// headless device (labutils::make_vulkan_context()). The SPIR-V of
+// cw2-bake/shaders is loaded from aShaderDir.
+//
+//  - sort_cells(): the cell keys (weld_keys.comp), then an LSD radix sort
+//    of them, 8 bits per pass (radix_histogram.comp, radix_scan.comp and
+//    radix_scatter.comp). The keys are computed exactly as on the CPU and
+//    the sort is stable, so the vicinity map, and hence the weld, is the
+//    CPU's; the order-dependent collapse stays on the CPU.
+//  - compute_tangents(): the corner tangents (corner_tangents.comp),
+//    sorted by vertex with the same radix sort, then summed per vertex in
+//    corner order (vertex_tangents.comp). In single precision rather than
+//    double, so they differ from the CPU's by rounding.
+//
+// Each call uploads its inputs, records the dispatches into one submission
+// and waits for it. Calls from several threads (the mesh jobs) take turns.
+// Throws labutils::Error on failure, e.g., if there is no Vulkan device, or
+// with more than kMaxSortKeys vertices or corners.
+class GpuMeshIndexing final : public MeshIndexingBackend
+{
+	public:
+		// Keys per sort; the sort's work groups (of 4096 keys) must fit
+		// into one dispatch
+		static constexpr std::size_t kMaxSortKeys = std::size_t(65535) * 4096;
+
+	public:
+		explicit GpuMeshIndexing( char const* aShaderDir );
+
+		GpuMeshIndexing( GpuMeshIndexing const& ) = delete;
+		GpuMeshIndexing& operator= (GpuMeshIndexing const&) = delete;
+
+	public:
+		void sort_cells(
+			std::vector<glm::vec3> const& aPositions,
+			glm::vec3 aMin,
+			float aScale,
+			std::vector<std::uint64_t>& aKeys,
+			std::vector<std::uint32_t>& aVertices
+		) override;
+
+		void compute_tangents( IndexedMesh& ) override;
+
+	private:
+		// Ping-pong buffers of the radix sort; the keys end up in the
+		// first pair
+		struct Sort_
+		{
+			labutils::Buffer keys[2], values[2];
+			labutils::Buffer counts;
+			std::uint32_t count = 0, blocks = 0;
+		};
+
+		Sort_ create_sort_( std::size_t aCount ) const;
+		labutils::Buffer create_storage_( VkDeviceSize ) const;
+
+		// Two sets that differ only in the direction of the sort: set i
+		// reads the keys and values of pair i, and writes those of the
+		// other pair. aBuffers: one per binding of the set layout, or
+		// VK_NULL_HANDLE for the bindings the dispatches don't use.
+		void write_sets_( VkDescriptorSet (&aSets)[2], Sort_ const&, VkBuffer const* aBuffers );
+
+		void record_sort_( VkCommandBuffer, VkDescriptorSet const (&aSets)[2], Sort_ const&, unsigned aKeyBits ) const;
+
+		VkCommandBuffer begin_();
+		void submit_and_wait_();
+
+	private:
+		std::mutex mMutex; // one call at a time
+
+		labutils::VulkanContext mContext;
+		labutils::Allocator mAllocator;
+
+		labutils::CommandPool mCmdPool;
+		VkCommandBuffer mCmd = VK_NULL_HANDLE;
+		labutils::Fence mFence;
+
+		labutils::DescriptorSetLayout mSetLayout;
+		labutils::PipelineLayout mPipeLayout;
+		std::vector<labutils::Pipeline> mPipes; // by EPipe_ (gpu_indexing.cpp)
+
+		labutils::DescriptorPool mDescPool; // reset by write_sets_()
+};
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // GPU_INDEXING_HPP_6F5B7590_E328_4919_B564_638D475C67D0
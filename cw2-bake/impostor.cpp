@@ -0,0 +1,293 @@
+#include "impostor.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <stb_image.h>
+#include <glm/glm.hpp>
+
+#include "texture_bake.hpp"
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// One tile at kImpostorSupersample times its size; depth is the distance
+	// towards the viewer, -inf where nothing was drawn
+	struct Tile_
+	{
+		std::uint32_t size;
+		std::vector<float> depth;
+		std::vector<glm::vec4> albedo;
+		std::vector<glm::vec3> normal;
+	};
+
+	float srgb_to_linear_( float aValue )
+	{
+		return aValue <= 0.04045f ? aValue / 12.92f : std::pow( (aValue + 0.055f) / 1.055f, 2.4f );
+	}
+
+	// Nearest texel, repeating
+	glm::vec4 sample_( ImpostorMaterial const& aMaterial, glm::vec2 const& aUv )
+	{
+		if( 0 == aMaterial.width )
+			return aMaterial.constant;
+
+		float const u = aUv.x - std::floor( aUv.x ), v = aUv.y - std::floor( aUv.y );
+		auto const x = std::min( std::uint32_t(u * float(aMaterial.width)), aMaterial.width - 1 );
+		auto const y = std::min( std::uint32_t(v * float(aMaterial.height)), aMaterial.height - 1 );
+
+		float const* texel = aMaterial.texels.data() + (std::size_t(y) * aMaterial.width + x) * 4;
+		return glm::vec4( texel[0], texel[1], texel[2], texel[3] );
+	}
+
+	void render_view_( Tile_&, IndexedMesh const&, ImpostorMaterial const&, glm::vec3 const& aCentre, float aRadius, glm::vec3 const& aDirection );
+
+	// Fills empty texels (alpha 0) of a aSize x aSize tile of the atlases,
+	// starting at aOrigin, with the average of their filled neighbours
+	void dilate_( ImpostorAtlases&, std::size_t aOrigin, std::uint32_t aSize );
+}
+
+ImpostorMaterial load_impostor_material( InputMaterialInfo const& aMaterial )
+{
+	ImpostorMaterial ret;
+	ret.constant = glm::vec4( aMaterial.baseColor, 1.f );
+	ret.masked = !aMaterial.alphaMaskTexturePath.empty();
+
+	auto const& path = aMaterial.baseColorTexturePath.empty() ? aMaterial.alphaMaskTexturePath : aMaterial.baseColorTexturePath;
+	if( path.empty() )
+		return ret;
+
+	// Same orientation as the baked textures
+	stbi_set_flip_vertically_on_load_thread( 1 );
+
+	int w, h, n;
+	stbi_uc* data = stbi_load( path.c_str(), &w, &h, &n, 4 );
+	if( !data )
+		throw lut::Error( "%s : Unable to load texture (%s)", path.c_str(), stbi_failure_reason() );
+
+	ret.width = std::uint32_t(w);
+	ret.height = std::uint32_t(h);
+
+	std::size_t const texels = std::size_t(w) * std::size_t(h);
+	bool const colour = !aMaterial.baseColorTexturePath.empty();
+	ret.texels.resize( texels * 4 );
+	for( std::size_t i = 0; i < texels; ++i )
+	{
+		for( std::size_t c = 0; c < 3; ++c )
+			ret.texels[4*i+c] = colour ? srgb_to_linear_( data[4*i+c] / 255.f ) : ret.constant[int(c)];
+		ret.texels[4*i+3] = data[4*i+3] / 255.f;
+	}
+
+	stbi_image_free( data );
+	return ret;
+}
+
+ImpostorAtlases render_impostor( IndexedMesh const& aMesh, ImpostorMaterial const& aMaterial, std::uint32_t aTileSize )
+{
+	assert( aTileSize > 0 );
+
+	ImpostorAtlases ret;
+	if( aMesh.indices.empty() )
+		return ret;
+
+	ret.centre = 0.5f * (aMesh.aabbMin + aMesh.aabbMax);
+	ret.radius = std::max( 0.5f * glm::length( aMesh.aabbMax - aMesh.aabbMin ), 1e-6f );
+	ret.size = kImpostorGrid * aTileSize;
+
+	std::size_t const atlasTexels = std::size_t(ret.size) * ret.size;
+	ret.albedo.assign( atlasTexels * 4, 0.f );
+	ret.normalDepth.assign( atlasTexels * 4, 0.f );
+
+	constexpr std::uint32_t ss = kImpostorSupersample;
+	Tile_ tile;
+	tile.size = aTileSize * ss;
+
+	for( std::uint32_t ty = 0; ty < kImpostorGrid; ++ty )
+	{
+		for( std::uint32_t tx = 0; tx < kImpostorGrid; ++tx )
+		{
+			render_view_( tile, aMesh, aMaterial, ret.centre, ret.radius, impostor_direction( tx, ty, kImpostorGrid ) );
+
+			// Resolve: the covered samples' average, and their share
+			for( std::uint32_t y = 0; y < aTileSize; ++y )
+			{
+				for( std::uint32_t x = 0; x < aTileSize; ++x )
+				{
+					glm::vec3 colour( 0.f ), normal( 0.f );
+					float depth = 0.f, covered = 0.f;
+					for( std::uint32_t sy = 0; sy < ss; ++sy )
+					{
+						for( std::uint32_t sx = 0; sx < ss; ++sx )
+						{
+							std::size_t const s = std::size_t(y * ss + sy) * tile.size + (x * ss + sx);
+							if( tile.depth[s] == -std::numeric_limits<float>::infinity() )
+								continue;
+
+							colour += glm::vec3( tile.albedo[s] );
+							normal += tile.normal[s];
+							depth += tile.depth[s];
+							covered += 1.f;
+						}
+					}
+
+					if( 0.f == covered )
+						continue;
+
+					float const len = glm::length( normal );
+					normal = len > 0.f ? normal / len : glm::vec3( 0.f, 1.f, 0.f );
+
+					std::size_t const texel = (std::size_t(ty * aTileSize + y) * ret.size + (tx * aTileSize + x)) * 4;
+					for( int c = 0; c < 3; ++c )
+					{
+						ret.albedo[texel+c] = colour[c] / covered;
+						ret.normalDepth[texel+c] = normal[c] * 0.5f + 0.5f;
+					}
+					ret.albedo[texel+3] = covered / float(ss * ss);
+					ret.normalDepth[texel+3] = std::clamp( 0.5f + 0.5f * depth / covered / ret.radius, 0.f, 1.f );
+				}
+			}
+
+			dilate_( ret, std::size_t(ty * aTileSize) * ret.size + tx * aTileSize, aTileSize );
+		}
+	}
+
+	return ret;
+}
+
+namespace
+{
+	void render_view_( Tile_& aTile, IndexedMesh const& aMesh, ImpostorMaterial const& aMaterial, glm::vec3 const& aCentre, float aRadius, glm::vec3 const& aDirection )
+	{
+		glm::vec3 right, up;
+		impostor_basis( aDirection, right, up );
+
+		std::size_t const samples = std::size_t(aTile.size) * aTile.size;
+		aTile.depth.assign( samples, -std::numeric_limits<float>::infinity() );
+		aTile.albedo.assign( samples, glm::vec4( 0.f ) );
+		aTile.normal.assign( samples, glm::vec3( 0.f ) );
+
+		// Sample coordinates (x, y) and the distance towards the viewer (z)
+		float const scale = 0.5f * float(aTile.size) / aRadius;
+		auto const project_ = [&] (glm::vec3 const& aPosition) {
+			glm::vec3 const q = aPosition - aCentre;
+			return glm::vec3( glm::dot( q, right ) * scale + 0.5f * float(aTile.size), glm::dot( q, up ) * scale + 0.5f * float(aTile.size), glm::dot( q, aDirection ) );
+		};
+
+		bool const normals = aMesh.norm.size() == aMesh.vert.size();
+		bool const texcoords = aMesh.text.size() == aMesh.vert.size();
+
+		for( std::size_t i = 0; i + 2 < aMesh.indices.size(); i += 3 )
+		{
+			std::uint32_t const idx[3] = { aMesh.indices[i], aMesh.indices[i+1], aMesh.indices[i+2] };
+			glm::vec3 const p[3] = { project_( aMesh.vert[idx[0]] ), project_( aMesh.vert[idx[1]] ), project_( aMesh.vert[idx[2]] ) };
+
+			float const area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+			if( std::abs( area ) < 1e-12f )
+				continue;
+
+			// Sample centres inside the triangle's box
+			float const minX = std::min( { p[0].x, p[1].x, p[2].x } ), maxX = std::max( { p[0].x, p[1].x, p[2].x } );
+			float const minY = std::min( { p[0].y, p[1].y, p[2].y } ), maxY = std::max( { p[0].y, p[1].y, p[2].y } );
+			int const x0 = std::max( int(std::ceil( minX - 0.5f )), 0 ), x1 = std::min( int(std::floor( maxX - 0.5f )), int(aTile.size) - 1 );
+			int const y0 = std::max( int(std::ceil( minY - 0.5f )), 0 ), y1 = std::min( int(std::floor( maxY - 0.5f )), int(aTile.size) - 1 );
+
+			glm::vec3 faceNormal = glm::cross( aMesh.vert[idx[1]] - aMesh.vert[idx[0]], aMesh.vert[idx[2]] - aMesh.vert[idx[0]] );
+			faceNormal = glm::length( faceNormal ) > 0.f ? glm::normalize( faceNormal ) : aDirection;
+
+			for( int y = y0; y <= y1; ++y )
+			{
+				for( int x = x0; x <= x1; ++x )
+				{
+					float const px = float(x) + 0.5f, py = float(y) + 0.5f;
+
+					// Barycentrics; either winding
+					float const w0 = ((p[1].x - px) * (p[2].y - py) - (p[2].x - px) * (p[1].y - py)) / area;
+					float const w1 = ((p[2].x - px) * (p[0].y - py) - (p[0].x - px) * (p[2].y - py)) / area;
+					float const w2 = 1.f - w0 - w1;
+					if( w0 < 0.f || w1 < 0.f || w2 < 0.f )
+						continue;
+
+					float const z = w0 * p[0].z + w1 * p[1].z + w2 * p[2].z;
+					std::size_t const s = std::size_t(y) * aTile.size + std::size_t(x);
+					if( z <= aTile.depth[s] )
+						continue;
+
+					glm::vec4 albedo = aMaterial.constant;
+					if( texcoords )
+						albedo = sample_( aMaterial, w0 * aMesh.text[idx[0]] + w1 * aMesh.text[idx[1]] + w2 * aMesh.text[idx[2]] );
+					if( aMaterial.masked && albedo.a < kAlphaCutoff )
+						continue;
+
+					glm::vec3 normal = normals ? w0 * aMesh.norm[idx[0]] + w1 * aMesh.norm[idx[1]] + w2 * aMesh.norm[idx[2]] : faceNormal;
+					if( glm::dot( normal, aDirection ) < 0.f )
+						normal = -normal;
+
+					aTile.depth[s] = z;
+					aTile.albedo[s] = albedo;
+					aTile.normal[s] = glm::length( normal ) > 0.f ? glm::normalize( normal ) : aDirection;
+				}
+			}
+		}
+	}
+
+	void dilate_( ImpostorAtlases& aAtlases, std::size_t aOrigin, std::uint32_t aSize )
+	{
+		std::vector<float> albedo, normalDepth;
+		for( std::uint32_t round = 0; round < kImpostorDilation; ++round )
+		{
+			// Reads the previous round's texels only
+			albedo = aAtlases.albedo;
+			normalDepth = aAtlases.normalDepth;
+
+			bool changed = false;
+			for( std::uint32_t y = 0; y < aSize; ++y )
+			{
+				for( std::uint32_t x = 0; x < aSize; ++x )
+				{
+					std::size_t const texel = (aOrigin + std::size_t(y) * aAtlases.size + x) * 4;
+					if( albedo[texel+3] > 0.f || normalDepth[texel+3] > 0.f )
+						continue;
+
+					float sum[8]{}, count = 0.f;
+					for( int dy = -1; dy <= 1; ++dy )
+					{
+						for( int dx = -1; dx <= 1; ++dx )
+						{
+							int const nx = int(x) + dx, ny = int(y) + dy;
+							if( nx < 0 || ny < 0 || nx >= int(aSize) || ny >= int(aSize) )
+								continue;
+
+							std::size_t const other = (aOrigin + std::size_t(ny) * aAtlases.size + std::size_t(nx)) * 4;
+							if( 0.f == normalDepth[other+3] )
+								continue;
+
+							for( int c = 0; c < 3; ++c )
+								sum[c] += albedo[other+c];
+							for( int c = 0; c < 4; ++c )
+								sum[4+c] += normalDepth[other+c];
+							count += 1.f;
+						}
+					}
+
+					if( 0.f == count )
+						continue;
+
+					// Coverage stays 0
+					for( int c = 0; c < 3; ++c )
+						aAtlases.albedo[texel+c] = sum[c] / count;
+					for( int c = 0; c < 4; ++c )
+						aAtlases.normalDepth[texel+c] = std::max( sum[4+c] / count, 1e-3f );
+					changed = true;
+				}
+			}
+
+			if( !changed )
+				break;
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef IMPOSTOR_HPP_6E0B4C93_D21A_4F87_8B5E_3A9F71C2D046
+#define IMPOSTOR_HPP_6E0B4C93_D21A_4F87_8B5E_3A9F71C2D046
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "index_mesh.hpp"
+#include "input_model.hpp"
+#include "../cw2/baked_impostors.hpp"
+
+//--    constants                               ///{{{1///////////////////////
+
+// Samples per texel and axis; the texel is their average (coverage in alpha)
+constexpr std::uint32_t kImpostorSupersample = 2;
+
+// Rounds of filling empty texels from their covered neighbours, so that
+// filtering and mip levels don't pull in the background
+constexpr std::uint32_t kImpostorDilation = 4;
+
+//--    types                                   ///{{{1///////////////////////
+
+// Albedo of a material, decoded once for all of its meshes
+struct ImpostorMaterial
+{
+	std::uint32_t width = 0, height = 0; // 0: the constant
+	std::vector<float> texels; // linear RGB and alpha, rows bottom first
+	glm::vec4 constant{ 1.f };
+	bool masked = false; // alpha tested at kAlphaCutoff
+};
+
+// The two atlases of a mesh (see cw2/baked_impostors.hpp), four floats per
+// texel, rows bottom first, as bake_texture_texels() takes them
+struct ImpostorAtlases
+{
+	std::uint32_t size = 0; // texels per side
+	std::vector<float> albedo; // linear RGB, coverage
+	std::vector<float> normalDepth;
+
+	glm::vec3 centre{ 0.f };
+	float radius = 0.f;
+};
+
+//--    functions                                ///{{{1///////////////////////
+
+// The base colour image of aMaterial (or its alpha mask, for the alpha
+// only); the constant if it has neither. Throws labutils::Error if an image
+// can't be loaded.
+ImpostorMaterial load_impostor_material( InputMaterialInfo const& );
+
+// Renders aMesh from the kImpostorGrid x kImpostorGrid directions into
+// tiles of aTileSize texels, with a software rasterizer (depth tested, no
+// culling; back faces get their normal flipped). The bounding sphere is
+// that of the mesh's box. Meshes without triangles give empty atlases.
+ImpostorAtlases render_impostor( IndexedMesh const&, ImpostorMaterial const&, std::uint32_t aTileSize );
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // IMPOSTOR_HPP_6E0B4C93_D21A_4F87_8B5E_3A9F71C2D046
@@ -1,12 +1,28 @@
 #include "index_mesh.hpp"
 
 #include <numeric>
-#include <unordered_map>
+#include <utility>
+#include <algorithm>
 
+#include <cmath>
 #include <cstddef>
+#include <cstring>
+#include <cassert>
 
 #include <glm/glm.hpp>
-#include <tgen.h>
+
+#if defined(__AVX__)
+#	define CW2_WELD_SIMD_ 8
+#	include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#	define CW2_WELD_SIMD_ 4
+#	include <xmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#	define CW2_WELD_SIMD_ 4
+#	include <arm_neon.h>
+#else
+#	define CW2_WELD_SIMD_ 0
+#endif
 
 namespace
 {
@@ -29,16 +45,42 @@ namespace
 		float scale;
 	};
 
-	// hash discretized mesh positions
-	using VicinityKey_ = std::size_t;
-	inline VicinityKey_ hash_discretized_position_( DiscretizedPosition_ const& aPos );
+	// key of a discretized mesh position's grid cell: x, y and z packed into
+	// kCellKeyBits each, z in the lowest bits. Cells that differ only in z
+	// have consecutive keys.
+	using VicinityKey_ = std::uint64_t;
+	constexpr unsigned kCellKeyBits_ = 21; // > log2(kSparseGridMaxSize+3)
+	inline VicinityKey_ cell_key_( DiscretizedPosition_ const& aPos );
+
+	// generate vicinity map: the vertices sorted by cell key, so that the
+	// vertices of a cell (and of a run of cells along z) are contiguous.
+	// With SIMD, their attributes are also gathered in that order, one
+	// array per component (position, normal, texture coordinates), so that
+	// the candidates of a run are tested for tolerance a register at a time.
+	constexpr std::size_t kComponents_ = 3+3+2;
+
+	struct VicinityMap_
+	{
+		std::vector<VicinityKey_> keys;
+		std::vector<std::uint32_t> vertices;
 
-	// generate vicinity map 
-	using VicinityMap_ = std::unordered_multimap<VicinityKey_,std::size_t>;
+		// padded by a register's worth of lanes, for the end of the last
+		// run; empty without SIMD
+		std::vector<float> components[kComponents_];
+	};
 	void build_vicinity_map_( 
 		VicinityMap_&, 
 		Discretizer_ const&,
-		std::vector<glm::vec3> const&
+		TriangleSoup const&,
+		bool aSimd,
+		MeshIndexingBackend*
+	);
+
+	// the keys and the vertices of the vicinity map, on the CPU
+	void sort_cells_(
+		VicinityMap_&,
+		Discretizer_ const&,
+		TriangleSoup const&
 	);
 
 	// is a vertex mergable?
@@ -53,14 +95,47 @@ namespace
 	using VertexMapping_ = std::vector<std::size_t>;
 	using IndexBuffer_ = std::vector<std::uint32_t>;
 
+	// weld bitwise identical vertices (position, normal and texture
+	// coordinates) with a hash table; the first of each set is kept
+	std::size_t weld_exact_(
+		IndexBuffer_&,
+		VertexMapping_&,
+		TriangleSoup const&
+	);
+
+	// weld vertices within the tolerance, component-wise, with the vicinity
+	// map and collapse_vertices_()
+	void weld_tolerant_(
+		IndexBuffer_&,
+		VertexMapping_&,
+		TriangleSoup const&,
+		float,
+		bool aSimd,
+		MeshIndexingBackend*
+	);
+
 	std::size_t collapse_vertices_( 
 		IndexBuffer_&, 
 		VertexMapping_&, 
 		VicinityMap_ const&, 
 		Discretizer_ const&, 
 		TriangleSoup const&, 
+		float,
+		bool aSimd
+	);
+
+#	if CW2_WELD_SIMD_
+	// mergable_() of the vertex with the components aSelf and the
+	// candidates [aFirst, aFirst+CW2_WELD_SIMD_) of the vicinity map, as a
+	// bit mask (bit j: candidate aFirst+j)
+	unsigned mergable_simd_(
+		VicinityMap_ const&,
+		std::size_t aFirst,
+		float const (&aSelf)[kComponents_],
+		bool aNormals,
 		float
 	);
+#	endif // ~ CW2_WELD_SIMD_
 
 }
 
@@ -70,44 +145,61 @@ IndexedMesh::IndexedMesh()
 	, aabbMax( std::numeric_limits<float>::min() )
 {}
 
+//--    MeshIndexingBackend             ///{{{2///////////////////////////////
+MeshIndexingBackend::~MeshIndexingBackend() = default;
+
 //--    make_indexed_mesh()             ///{{{2///////////////////////////////
-IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance )
+IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance, bool aTangents, bool aSimd, MeshIndexingBackend* aBackend )
 {
-	// compute bounding volume
-	glm::vec3 bmin( std::numeric_limits<float>::max() );
-	glm::vec3 bmax( std::numeric_limits<float>::min() );
+	assert( aErrorTolerance >= 0.f );
 
-	for( std::size_t vert = 0; vert < aSoup.vert.size(); ++vert )
-	{
-		bmin = min( bmin, aSoup.vert[vert] );
-		bmax = max( bmax, aSoup.vert[vert] );
-	}
+	// weld exact duplicates first. Exact duplicates always end up in the same
+	// vertex below, and their first occurrences keep their order, so the
+	// tolerant pass over them gives the same mesh as over the whole soup.
+	IndexBuffer_ exactIndices;
+	VertexMapping_ exactMapping;
+	std::size_t const unique = weld_exact_( exactIndices, exactMapping, aSoup );
 
-	auto const fmin = bmin - glm::vec3( kAABBMarginFactor * aErrorTolerance );
-	auto const fmax = bmax + glm::vec3( kAABBMarginFactor * aErrorTolerance );
+	assert( exactIndices.size() == aSoup.vert.size() );
+	assert( unique == exactMapping.size() );
 
-	// Compute grid size
-	auto const side = fmax - fmin;
-	float const maxSide = std::max( side.x, std::max( side.y, side.z ) );
+	IndexBuffer_ indices;
+	VertexMapping_ vertexMapping;
+	if( 0.f == aErrorTolerance || unique <= 1 )
+	{
+		indices = std::move(exactIndices);
+		vertexMapping = std::move(exactMapping);
+	}
+	else
+	{
+		TriangleSoup reps;
+		reps.vert.reserve( unique );
+		reps.text.reserve( unique );
+		if( !aSoup.norm.empty() )
+			reps.norm.reserve( unique );
 
-	float const numCells = maxSide / (2.f*aErrorTolerance);
-	std::size_t subdiv = std::min( kSparseGridMaxSize, std::size_t(numCells+.5f) );
+		for( auto const from : exactMapping )
+		{
+			reps.vert.emplace_back( aSoup.vert[from] );
+			reps.text.emplace_back( aSoup.text[from] );
+			if( !aSoup.norm.empty() )
+				reps.norm.emplace_back( aSoup.norm[from] );
+		}
 
-	// parameters for discretization
-	Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
+		IndexBuffer_ repIndices;
+		VertexMapping_ repMapping;
+		weld_tolerant_( repIndices, repMapping, reps, aErrorTolerance, aSimd, aBackend );
 
-	// build the vincinity map
-	VicinityMap_ vincinityMap;
-	build_vicinity_map_( vincinityMap, dis, aSoup.vert );
+		indices.resize( exactIndices.size() );
+		for( std::size_t i = 0; i < exactIndices.size(); ++i )
+			indices[i] = repIndices[exactIndices[i]];
 
-	// collapse vertices
-	IndexBuffer_ indices;
-	VertexMapping_ vertexMapping;
-
-	size_t verts = collapse_vertices_( indices, vertexMapping, vincinityMap, dis, aSoup, aErrorTolerance );
+		vertexMapping.resize( repMapping.size() );
+		for( std::size_t i = 0; i < repMapping.size(); ++i )
+			vertexMapping[i] = exactMapping[repMapping[i]];
+	}
 
-	assert( indices.size() == aSoup.vert.size() );
-	assert( verts == vertexMapping.size() );
+	std::size_t const verts = vertexMapping.size();
 
 	// shuffle vertex data
 	IndexedMesh ret;
@@ -132,45 +224,227 @@ IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance
 
 	ret.indices = std::move(indices);
 	
-	std::vector<tgen::RealT> positions, uvs, normals;
-	for (const auto& v : ret.vert) {
-		positions.push_back(v.x); 
-		positions.push_back(v.y); 
-		positions.push_back(v.z); 
+	if( aTangents && aBackend )
+		aBackend->compute_tangents( ret );
+	else if( aTangents )
+		compute_tangents( ret );
+
+	// Exact bounds of the indexed vertices. (bmax in weld_tolerant_() starts
+	// at the smallest positive float rather than the lowest one; that's
+	// harmless for the grid, but the bounds are stored in the baked file and
+	// used for culling.)
+	ret.aabbMin = glm::vec3( std::numeric_limits<float>::max() );
+	ret.aabbMax = glm::vec3( std::numeric_limits<float>::lowest() );
+	for( auto const& v : ret.vert )
+	{
+		ret.aabbMin = min( ret.aabbMin, v );
+		ret.aabbMax = max( ret.aabbMax, v );
 	}
-	for (const auto& uv : ret.text) {
-		uvs.push_back(uv.x); 
-		uvs.push_back(uv.y); 
+
+	return ret;
+}
+
+//--    clean_indexed_mesh()            ///{{{2///////////////////////////////
+MeshCleanupStats clean_indexed_mesh( IndexedMesh& aMesh, float aAreaTol )
+{
+	assert( 0 == aMesh.indices.size() % 3 );
+
+	MeshCleanupStats ret;
+	auto& indices = aMesh.indices;
+	std::size_t const triangles = indices.size() / 3;
+
+	// Degenerate triangles
+	std::vector<std::uint8_t> keep( triangles, 1 );
+	for( std::size_t t = 0; t < triangles; ++t )
+	{
+		auto const a = indices[3*t+0], b = indices[3*t+1], c = indices[3*t+2];
+		if( a == b || b == c || c == a )
+		{
+			keep[t] = 0;
+			continue;
+		}
+
+		glm::vec3 const e0 = aMesh.vert[b] - aMesh.vert[a];
+		glm::vec3 const e1 = aMesh.vert[c] - aMesh.vert[a];
+		glm::vec3 const e2 = aMesh.vert[c] - aMesh.vert[b];
+		float const longest = std::max( dot( e0, e0 ), std::max( dot( e1, e1 ), dot( e2, e2 ) ) );
+		if( !(length( cross( e0, e1 ) ) > aAreaTol * longest) )
+			keep[t] = 0;
+	}
+
+	// Duplicates: rotate each triangle to start at its smallest index (which
+	// keeps the winding), sort, and keep the first of each run
+	struct Key_
+	{
+		std::uint32_t v[3];
+		std::uint32_t triangle;
+	};
+
+	std::vector<Key_> keys;
+	keys.reserve( triangles );
+	for( std::size_t t = 0; t < triangles; ++t )
+	{
+		if( !keep[t] )
+			continue;
+
+		std::uint32_t const* tri = indices.data() + 3*t;
+		std::size_t const first = tri[0] < tri[1] ? (tri[0] < tri[2] ? 0 : 2) : (tri[1] < tri[2] ? 1 : 2);
+		keys.push_back( { { tri[first], tri[(first+1)%3], tri[(first+2)%3] }, std::uint32_t(t) } );
+	}
+
+	std::sort( keys.begin(), keys.end(), [] (Key_ const& aX, Key_ const& aY) {
+		if( aX.v[0] != aY.v[0] ) return aX.v[0] < aY.v[0];
+		if( aX.v[1] != aY.v[1] ) return aX.v[1] < aY.v[1];
+		if( aX.v[2] != aY.v[2] ) return aX.v[2] < aY.v[2];
+		return aX.triangle < aY.triangle;
+	} );
+
+	for( std::size_t i = 1; i < keys.size(); ++i )
+	{
+		auto const& prev = keys[i-1], & cur = keys[i];
+		if( prev.v[0] == cur.v[0] && prev.v[1] == cur.v[1] && prev.v[2] == cur.v[2] )
+		{
+			keep[cur.triangle] = 0;
+			++ret.duplicate;
+		}
 	}
-	for (const auto& n : ret.norm) {
-		normals.push_back(n.x); 
-		normals.push_back(n.y); 
-		normals.push_back(n.z); 
+
+	ret.degenerate = triangles - keys.size();
+
+	// Compact the triangles
+	std::size_t out = 0;
+	for( std::size_t t = 0; t < triangles; ++t )
+	{
+		if( !keep[t] )
+			continue;
+
+		for( std::size_t j = 0; j < 3; ++j )
+			indices[out+j] = indices[3*t+j];
+		out += 3;
 	}
-	std::vector<tgen::RealT> tangents4D;
+	indices.resize( out );
 
+	// Compact the vertices
+	constexpr auto kUnused = std::numeric_limits<std::uint32_t>::max();
+	std::vector<std::uint32_t> remap( aMesh.vert.size(), kUnused );
+	for( auto const index : indices )
+		remap[index] = 0;
 
+	std::uint32_t verts = 0;
+	for( std::size_t v = 0; v < remap.size(); ++v )
 	{
-		std::vector<tgen::VIndexT> tgenIndices(ret.indices.begin(), ret.indices.end());
-		std::vector<tgen::RealT> cornerTangents3D, cornerBitangents3D;
-		std::vector<tgen::RealT> vertexTangents3D, vertexBitangents3D;
-
-		tgen::computeCornerTSpace(tgenIndices, tgenIndices, positions, uvs, cornerTangents3D, cornerBitangents3D);
-		tgen::computeVertexTSpace(tgenIndices, cornerTangents3D, cornerBitangents3D, ret.text.size(), vertexTangents3D, vertexBitangents3D);
-		tgen::orthogonalizeTSpace(normals, vertexTangents3D, vertexBitangents3D);
-		tgen::computeTangent4D(normals, vertexTangents3D, vertexBitangents3D, tangents4D);
+		if( kUnused == remap[v] )
+			continue;
+
+		remap[v] = verts;
+		aMesh.vert[verts] = aMesh.vert[v];
+		aMesh.text[verts] = aMesh.text[v];
+		if( !aMesh.norm.empty() )
+			aMesh.norm[verts] = aMesh.norm[v];
+		if( !aMesh.tangent.empty() )
+			aMesh.tangent[verts] = aMesh.tangent[v];
+		++verts;
 	}
 
-	for (size_t i = 0; i < tangents4D.size(); i += 4) {
-		ret.tangent.push_back(glm::vec4(tangents4D[i], tangents4D[i+1], tangents4D[i+2], tangents4D[i+3]));
+	ret.unreferenced = aMesh.vert.size() - verts;
+	if( 0 == ret.unreferenced )
+		return ret;
+
+	aMesh.vert.resize( verts );
+	aMesh.text.resize( verts );
+	if( !aMesh.norm.empty() )
+		aMesh.norm.resize( verts );
+	if( !aMesh.tangent.empty() )
+		aMesh.tangent.resize( verts );
+
+	for( auto& index : indices )
+		index = remap[index];
+
+	aMesh.aabbMin = glm::vec3( std::numeric_limits<float>::max() );
+	aMesh.aabbMax = glm::vec3( std::numeric_limits<float>::lowest() );
+	for( auto const& v : aMesh.vert )
+	{
+		aMesh.aabbMin = min( aMesh.aabbMin, v );
+		aMesh.aabbMax = max( aMesh.aabbMax, v );
 	}
-	
-	ret.aabbMin = bmin;
-	ret.aabbMax = bmax;
 
 	return ret;
 }
 
+//--    compute_tangents()              ///{{{2///////////////////////////////
+void compute_tangents( IndexedMesh& aMesh )
+{
+	// Same method (and operation order, in double precision) as tgen's
+	// computeCornerTSpace(), computeVertexTSpace(), orthogonalizeTSpace() and
+	// computeTangent4D(), but straight from the mesh's arrays: the corner
+	// tangents are summed into the vertices as they are computed, and the
+	// bitangents are skipped, as orthogonalizeTSpace() replaces them with
+	// cross( n, t ) anyway.
+	aMesh.tangent.clear();
+	if( aMesh.norm.empty() )
+		return;
+
+	assert( aMesh.norm.size() == aMesh.vert.size() );
+	assert( aMesh.text.size() == aMesh.vert.size() );
+	assert( 0 == aMesh.indices.size() % 3 );
+
+	constexpr double kDenomEps = 1e-10;
+
+	std::vector<glm::dvec3> sums( aMesh.vert.size(), glm::dvec3( 0.0 ) );
+	for( std::size_t i = 0; i < aMesh.indices.size(); i += 3 )
+	{
+		std::uint32_t const* tri = aMesh.indices.data() + i;
+
+		// derivatives of positions and UVs along the edges
+		glm::dvec3 edge3D[3];
+		glm::dvec2 edgeUV[3];
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const v0 = tri[j], v1 = tri[(j+1)%3];
+			edge3D[j] = glm::dvec3( aMesh.vert[v1] ) - glm::dvec3( aMesh.vert[v0] );
+			edgeUV[j] = glm::dvec2( aMesh.text[v1] ) - glm::dvec2( aMesh.text[v0] );
+		}
+
+		// per-corner tangent (not normalized)
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const prev = (j+2)%3;
+			auto const& dPos0 = edge3D[j];
+			auto const& dPos1Neg = edge3D[prev];
+			auto const& dUV0 = edgeUV[j];
+			auto const& dUV1Neg = edgeUV[prev];
+
+			double const denom = dUV0[0] * -dUV1Neg[1] - dUV0[1] * -dUV1Neg[0];
+			double const r = std::abs( denom ) > kDenomEps ? 1.0 / denom : 0.0;
+
+			glm::dvec3 const tangent = dPos0 * (-dUV1Neg[1] * r) - dPos1Neg * (-dUV0[1] * r);
+			sums[tri[j]] = tangent + sums[tri[j]];
+		}
+	}
+
+	aMesh.tangent.resize( aMesh.vert.size() );
+	for( std::size_t v = 0; v < aMesh.vert.size(); ++v )
+	{
+		auto const normalize_ = [] (glm::dvec3 const& aV) {
+			double const len = std::sqrt( aV.x*aV.x + aV.y*aV.y + aV.z*aV.z );
+			return aV * (1.0 / len);
+		};
+
+		// average, then Gram-Schmidt against the normal
+		glm::dvec3 const n( aMesh.norm[v] );
+		glm::dvec3 t = normalize_( sums[v] );
+		t = normalize_( t - n * (n.x*t.x + n.y*t.y + n.z*t.z) );
+
+		// tgen's handedness test compares cross( n, t ) with the bitangent,
+		// which orthogonalizeTSpace() has set to cross( n, t ); kept as is
+		// for identical output (-1 only for degenerate frames).
+		glm::dvec3 const b = glm::cross( n, t );
+		double const sign = (b.x*b.x + b.y*b.y + b.z*b.z) > 0.0 ? 1.0 : -1.0;
+
+		aMesh.tangent[v] = glm::vec4( glm::dvec4( t, sign ) );
+	}
+}
+
 #if 0
 //--    ensure_normals()                ///{{{2///////////////////////////////
 void ensure_normals( IndexedMesh& aMesh )
@@ -237,29 +511,103 @@ namespace
 
 namespace
 {
-	std::hash<VicinityKey_> gHash_;
-
-	inline VicinityKey_ hash_discretized_position_( DiscretizedPosition_ const& aDP )
+	inline VicinityKey_ cell_key_( DiscretizedPosition_ const& aDP )
 	{
-		// Based on boost::hash_combine.
-		std::size_t hash = gHash_(aDP.x);
-		hash ^= gHash_(aDP.y) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-		hash ^= gHash_(aDP.z) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-		return hash;
+		// Coordinates are in [0, kSparseGridMaxSize]; neighbours may be one
+		// further out on either side, hence the +1.
+		assert( aDP.x >= -1 && aDP.y >= -1 && aDP.z >= -1 );
+		return (VicinityKey_(aDP.x+1) << (2*kCellKeyBits_))
+			| (VicinityKey_(aDP.y+1) << kCellKeyBits_)
+			| VicinityKey_(aDP.z+1)
+		;
 	}
 }
 
 namespace
 {
-	void build_vicinity_map_( VicinityMap_& aMap, Discretizer_ const& aD, std::vector<glm::vec3> const& aPositions )
+	void sort_cells_( VicinityMap_& aMap, Discretizer_ const& aD, TriangleSoup const& aSoup )
+	{
+		std::size_t const count = aSoup.vert.size();
+
+		aMap.keys.resize( count );
+		aMap.vertices.resize( count );
+		for( std::size_t index = 0; index < count; ++index )
+		{
+			aMap.keys[index] = cell_key_( aD.discretize( aSoup.vert[index] ) );
+			aMap.vertices[index] = std::uint32_t(index);
+		}
+
+		// LSD radix sort, 16 bits per pass. Stable, so the vertices of each
+		// cell stay in soup order. Passes where all keys share the digit
+		// (e.g., the high bits of small grids) are skipped.
+		constexpr unsigned kRadixBits = 16;
+		constexpr std::size_t kBuckets = std::size_t(1) << kRadixBits;
+
+		std::vector<VicinityKey_> keys( count );
+		std::vector<std::uint32_t> vertices( count );
+		std::vector<std::size_t> offsets( kBuckets );
+
+		for( unsigned shift = 0; shift < 3*kCellKeyBits_; shift += kRadixBits )
+		{
+			std::fill( offsets.begin(), offsets.end(), 0 );
+			for( auto const key : aMap.keys )
+				++offsets[(key >> shift) & (kBuckets-1)];
+
+			if( count > 0 && offsets[(aMap.keys[0] >> shift) & (kBuckets-1)] == count )
+				continue;
+
+			std::size_t sum = 0;
+			for( auto& offset : offsets )
+				sum += std::exchange( offset, sum );
+
+			for( std::size_t i = 0; i < count; ++i )
+			{
+				auto const to = offsets[(aMap.keys[i] >> shift) & (kBuckets-1)]++;
+				keys[to] = aMap.keys[i];
+				vertices[to] = aMap.vertices[i];
+			}
+
+			std::swap( aMap.keys, keys );
+			std::swap( aMap.vertices, vertices );
+		}
+	}
+
+	void build_vicinity_map_( VicinityMap_& aMap, Discretizer_ const& aD, TriangleSoup const& aSoup, bool aSimd, MeshIndexingBackend* aBackend )
 	{
-		for( std::size_t index = 0; index < aPositions.size(); ++index )
+		std::size_t const count = aSoup.vert.size();
+
+		if( aBackend )
 		{
-			DiscretizedPosition_ dp = aD.discretize( aPositions[index] );
-			VicinityKey_ vk = hash_discretized_position_( dp );
+			aBackend->sort_cells( aSoup.vert, aD.min, aD.scale, aMap.keys, aMap.vertices );
+			assert( aMap.keys.size() == count && aMap.vertices.size() == count );
+		}
+		else
+			sort_cells_( aMap, aD, aSoup );
+
+#		if CW2_WELD_SIMD_
+		if( !aSimd )
+			return;
+
+		for( auto& component : aMap.components )
+			component.assign( count + CW2_WELD_SIMD_, 0.f );
 
-			aMap.insert( std::make_pair(vk, index) );
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			auto const v = aMap.vertices[i];
+			for( std::size_t c = 0; c < 3; ++c )
+				aMap.components[c][i] = aSoup.vert[v][c];
+			if( !aSoup.norm.empty() )
+			{
+				for( std::size_t c = 0; c < 3; ++c )
+					aMap.components[3+c][i] = aSoup.norm[v][c];
+			}
+			for( std::size_t c = 0; c < 2; ++c )
+				aMap.components[6+c][i] = aSoup.text[v][c];
 		}
+#		else // !CW2_WELD_SIMD_
+		(void)aSimd;
+		(void)count;
+#		endif // ~ CW2_WELD_SIMD_
 	}
 }
 
@@ -298,40 +646,87 @@ namespace
 	
 		return true;
 	}
+
+#	if CW2_WELD_SIMD_
+	// The same tests as mergable_(): a candidate is rejected if any
+	// |self - candidate| > tolerance, which is false for NaNs, as above.
+	unsigned mergable_simd_( VicinityMap_ const& aVM, std::size_t aFirst, float const (&aSelf)[kComponents_], bool aNormals, float aErrorTolerance )
+	{
+#		if 8 == CW2_WELD_SIMD_
+		__m256 const tolerance = _mm256_set1_ps( aErrorTolerance );
+		__m256 const sign = _mm256_set1_ps( -0.f );
+
+		__m256 far = _mm256_setzero_ps();
+		for( std::size_t c = 0; c < kComponents_; ++c )
+		{
+			if( !aNormals && c >= 3 && c < 6 )
+				continue;
+
+			__m256 const d = _mm256_sub_ps( _mm256_set1_ps( aSelf[c] ), _mm256_loadu_ps( aVM.components[c].data() + aFirst ) );
+			far = _mm256_or_ps( far, _mm256_cmp_ps( _mm256_andnot_ps( sign, d ), tolerance, _CMP_GT_OQ ) );
+		}
+
+		return ~unsigned(_mm256_movemask_ps( far )) & 0xffu;
+#		elif defined(__ARM_NEON) && defined(__aarch64__)
+		float32x4_t const tolerance = vdupq_n_f32( aErrorTolerance );
+
+		uint32x4_t far = vdupq_n_u32( 0 );
+		for( std::size_t c = 0; c < kComponents_; ++c )
+		{
+			if( !aNormals && c >= 3 && c < 6 )
+				continue;
+
+			float32x4_t const d = vsubq_f32( vdupq_n_f32( aSelf[c] ), vld1q_f32( aVM.components[c].data() + aFirst ) );
+			far = vorrq_u32( far, vcgtq_f32( vabsq_f32( d ), tolerance ) );
+		}
+
+		static constexpr std::uint32_t kLaneBits[4] = { 1, 2, 4, 8 };
+		return ~unsigned(vaddvq_u32( vandq_u32( far, vld1q_u32( kLaneBits ) ) )) & 0xfu;
+#		else // SSE
+		__m128 const tolerance = _mm_set1_ps( aErrorTolerance );
+		__m128 const sign = _mm_set1_ps( -0.f );
+
+		__m128 far = _mm_setzero_ps();
+		for( std::size_t c = 0; c < kComponents_; ++c )
+		{
+			if( !aNormals && c >= 3 && c < 6 )
+				continue;
+
+			__m128 const d = _mm_sub_ps( _mm_set1_ps( aSelf[c] ), _mm_loadu_ps( aVM.components[c].data() + aFirst ) );
+			far = _mm_or_ps( far, _mm_cmpgt_ps( _mm_andnot_ps( sign, d ), tolerance ) );
+		}
+
+		return ~unsigned(_mm_movemask_ps( far )) & 0xfu;
+#		endif
+	}
+#	endif // ~ CW2_WELD_SIMD_
 }
 
 namespace
 {
-	// neighbours
-	const size_t kNeighbourCount_ = 27;
+	// neighbours: the 3x3x3 cells around a cell, as 9 runs of 3 cells along z
+	const size_t kNeighbourRowCount_ = 9;
 
-	DiscretizedPosition_ neighbour_( DiscretizedPosition_ const& aDP, std::size_t aJ )
+	DiscretizedPosition_ neighbour_row_( DiscretizedPosition_ const& aDP, std::size_t aJ )
 	{
-		static constexpr std::int32_t offset[kNeighbourCount_][3] = {
-			{ 0, 0, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
-			{ 0, 1, 0 }, { 0, 1, 1 }, { 0, 1, -1 },
-			{ 0, -1, 0 }, { 0, -1, 1 }, { 0, -1, -1 },
-
-			{ 1, 0, 0 }, { 1, 0, 1 }, { 1, 0, -1 },
-			{ 1, 1, 0 }, { 1, 1, 1 }, { 1, 1, -1 },
-			{ 1, -1, 0 }, { 1, -1, 1 }, { 1, -1, -1 },
-
-			{ -1, 0, 0 }, { -1, 0, 1 }, { -1, 0, -1 },
-			{ -1, 1, 0 }, { -1, 1, 1 }, { -1, 1, -1 },
-			{ -1, -1, 0 }, { -1, -1, 1 }, { -1, -1, -1 },
+		static constexpr std::int32_t offset[kNeighbourRowCount_][2] = {
+			{ 0, 0 }, { 0, 1 }, { 0, -1 },
+			{ 1, 0 }, { 1, 1 }, { 1, -1 },
+			{ -1, 0 }, { -1, 1 }, { -1, -1 },
 		};
 
-		assert( aJ < kNeighbourCount_ );
-		
+		assert( aJ < kNeighbourRowCount_ );
+
+		// first cell of the run
 		DiscretizedPosition_ ret = aDP;
 		ret.x += offset[aJ][0];
 		ret.y += offset[aJ][1];
-		ret.z += offset[aJ][2];
+		ret.z -= 1;
 		return ret;
 	}
 
 	// Merge vertices
-	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, VicinityMap_ const& aVM, Discretizer_ const& aD, TriangleSoup const& aSoup, float aMaxError )
+	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, VicinityMap_ const& aVM, Discretizer_ const& aD, TriangleSoup const& aSoup, float aMaxError, bool aSimd )
 	{
 		aVertices.clear();
 		aVertices.reserve( aSoup.vert.size() );
@@ -343,6 +738,12 @@ namespace
 		VertexMapping_ collapseMap( aSoup.vert.size() );
 		std::fill( collapseMap.begin(), collapseMap.end(), ~std::size_t(0) );
 
+#		if CW2_WELD_SIMD_
+		aSimd = aSimd && !aVM.components[0].empty();
+#		else // !CW2_WELD_SIMD_
+		aSimd = false;
+#		endif // ~ CW2_WELD_SIMD_
+
 		// process vertices
 		std::size_t nextVertex = 0;
 		for( std::size_t i = 0; i < aSoup.vert.size(); ++i )
@@ -362,42 +763,92 @@ namespace
 			bool merged = false;
 			std::size_t target = ~std::size_t(0);
 
-			for( std::size_t j = 0; j < kNeighbourCount_; ++j )
-			{
-				DiscretizedPosition_ const dq = neighbour_( dp, j );
-				VicinityKey_ const vk = hash_discretized_position_( dq );
+			// merge a mergable candidate. Whether a candidate is mergable
+			// depends only on it and on vertex i, so the candidates of a run
+			// can be tested before any of them is merged.
+			auto const merge_ = [&] (std::size_t aIdx) {
+				if( aIdx == i ) return; // don't try to merge with self
+				if( ~std::size_t(0) != collapseMap[aIdx] ) return; // don't remerge
 
-				// get vertices in this bucket
-				for( auto [it, jt] = aVM.equal_range( vk ); it != jt; ++it )
+				std::size_t toWhere;
+				
+				if( merged )
 				{
-					std::size_t const idx =  it->second;
+					toWhere = target;
+				}
+				else
+				{
+					toWhere = nextVertex++;
+					aVertices.push_back( i );
 
-					if( idx == i ) continue; // don't try to merge with self
-					if( ~std::size_t(0) != collapseMap[idx] ) continue; // don't remerge
+					collapseMap[i] = toWhere;
+					aIndices.push_back( std::uint32_t(toWhere) );
+				}
 
-					auto const other = aSoup.vert[idx];
-					if( mergable_( aSoup, i, idx, self, other, aMaxError ) )
+				collapseMap[aIdx] = toWhere;
+				
+				target = toWhere;
+				merged = true;
+			};
+
+#			if CW2_WELD_SIMD_
+			float selfComponents[kComponents_] = {
+				self.x, self.y, self.z,
+				0.f, 0.f, 0.f,
+				aSoup.text[i].x, aSoup.text[i].y
+			};
+			if( !aSoup.norm.empty() )
+			{
+				for( std::size_t c = 0; c < 3; ++c )
+					selfComponents[3+c] = aSoup.norm[i][c];
+			}
+#			endif // ~ CW2_WELD_SIMD_
+
+			for( std::size_t j = 0; j < kNeighbourRowCount_; ++j )
+			{
+				VicinityKey_ const first = cell_key_( neighbour_row_( dp, j ) );
+				VicinityKey_ const last = first + 2;
+
+				// get vertices in this run of cells
+				auto const begin = std::lower_bound( aVM.keys.begin(), aVM.keys.end(), first );
+				auto const end = std::upper_bound( begin, aVM.keys.end(), last );
+				std::size_t const runBegin = std::size_t(begin - aVM.keys.begin());
+				std::size_t const runEnd = std::size_t(end - aVM.keys.begin());
+
+#				if CW2_WELD_SIMD_
+				// short runs (the common case) are cheaper to test one by one
+				if( aSimd && runEnd - runBegin >= CW2_WELD_SIMD_ )
+				{
+					for( std::size_t k = runBegin; k < runEnd; k += CW2_WELD_SIMD_ )
 					{
-						std::size_t toWhere;
-						
-						if( merged )
-						{
-							toWhere = target;
-						}
-						else
+						unsigned mask = mergable_simd_( aVM, k, selfComponents, !aSoup.norm.empty(), aMaxError );
+						if( runEnd - k < CW2_WELD_SIMD_ )
+							mask &= (1u << (runEnd - k)) - 1u;
+
+						for( ; mask; mask &= mask - 1u )
 						{
-							toWhere = nextVertex++;
-							aVertices.push_back( i );
+							unsigned lane = 0;
+							while( !(mask & (1u << lane)) )
+								++lane;
 
-							collapseMap[i] = toWhere;
-							aIndices.push_back( std::uint32_t(toWhere) );
+							merge_( aVM.vertices[k+lane] );
 						}
-
-						collapseMap[idx] = toWhere;
-						
-						target = toWhere;
-						merged = true;
 					}
+
+					continue;
+				}
+#				endif // ~ CW2_WELD_SIMD_
+
+				for( std::size_t k = runBegin; k < runEnd; ++k )
+				{
+					std::size_t const idx = aVM.vertices[k];
+
+					if( idx == i ) continue; // don't try to merge with self
+					if( ~std::size_t(0) != collapseMap[idx] ) continue; // don't remerge
+
+					auto const other = aSoup.vert[idx];
+					if( mergable_( aSoup, i, idx, self, other, aMaxError ) )
+						merge_( idx );
 				}
 			}
 
@@ -415,4 +866,107 @@ namespace
 	}
 }
 
+namespace
+{
+	std::size_t weld_exact_( IndexBuffer_& aIndices, VertexMapping_& aVertices, TriangleSoup const& aSoup )
+	{
+		std::size_t const count = aSoup.vert.size();
+		bool const normals = !aSoup.norm.empty();
+
+		aVertices.clear();
+		aIndices.clear();
+		aIndices.reserve( count );
+
+		// the raw bits of a vertex; -0 and +0 (and NaNs with different
+		// payloads) are different vertices here
+		constexpr std::size_t kWords = 3+3+2;
+		auto const key_ = [&] (std::size_t aV, std::uint32_t (&aKey)[kWords]) {
+			std::memcpy( aKey+0, &aSoup.vert[aV], sizeof(glm::vec3) );
+			if( normals )
+				std::memcpy( aKey+3, &aSoup.norm[aV], sizeof(glm::vec3) );
+			else
+				aKey[3] = aKey[4] = aKey[5] = 0;
+			std::memcpy( aKey+6, &aSoup.text[aV], sizeof(glm::vec2) );
+		};
+
+		// open addressing with linear probing, at most half full; slots hold
+		// indices into aVertices
+		std::size_t slotCount = 16;
+		while( slotCount < 2*count )
+			slotCount *= 2;
+
+		constexpr auto kEmpty = ~std::uint32_t(0);
+		std::vector<std::uint32_t> slots( slotCount, kEmpty );
+
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			std::uint32_t key[kWords];
+			key_( i, key );
+
+			std::uint64_t hash = 0xcbf29ce484222325ull;
+			for( auto const word : key )
+				hash = (hash ^ word) * 0x100000001b3ull;
+			hash ^= hash >> 32;
+
+			for( std::size_t slot = std::size_t(hash) & (slotCount-1); ; slot = (slot+1) & (slotCount-1) )
+			{
+				if( kEmpty == slots[slot] )
+				{
+					slots[slot] = std::uint32_t(aVertices.size());
+					aIndices.push_back( slots[slot] );
+					aVertices.push_back( i );
+					break;
+				}
+
+				std::uint32_t other[kWords];
+				key_( aVertices[slots[slot]], other );
+				if( 0 == std::memcmp( key, other, sizeof(key) ) )
+				{
+					aIndices.push_back( slots[slot] );
+					break;
+				}
+			}
+		}
+
+		return aVertices.size();
+	}
+
+	void weld_tolerant_( IndexBuffer_& aIndices, VertexMapping_& aVertices, TriangleSoup const& aSoup, float aErrorTolerance, bool aSimd, MeshIndexingBackend* aBackend )
+	{
+		// compute bounding volume
+		glm::vec3 bmin( std::numeric_limits<float>::max() );
+		glm::vec3 bmax( std::numeric_limits<float>::min() );
+
+		for( std::size_t vert = 0; vert < aSoup.vert.size(); ++vert )
+		{
+			bmin = min( bmin, aSoup.vert[vert] );
+			bmax = max( bmax, aSoup.vert[vert] );
+		}
+
+		auto const fmin = bmin - glm::vec3( kAABBMarginFactor * aErrorTolerance );
+		auto const fmax = bmax + glm::vec3( kAABBMarginFactor * aErrorTolerance );
+
+		// Compute grid size
+		auto const side = fmax - fmin;
+		float const maxSide = std::max( side.x, std::max( side.y, side.z ) );
+
+		float const numCells = maxSide / (2.f*aErrorTolerance);
+		std::size_t subdiv = std::min( kSparseGridMaxSize, std::size_t(numCells+.5f) );
+
+		// parameters for discretization
+		Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
+
+		// build the vincinity map
+		VicinityMap_ vincinityMap;
+		build_vicinity_map_( vincinityMap, dis, aSoup, aSimd, aBackend );
+
+		// collapse vertices
+		std::size_t const verts = collapse_vertices_( aIndices, aVertices, vincinityMap, dis, aSoup, aErrorTolerance, aSimd );
+
+		assert( aIndices.size() == aSoup.vert.size() );
+		assert( verts == aVertices.size() );
+		(void)verts;
+	}
+}
+
 //--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab: 
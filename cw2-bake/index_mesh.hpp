@@ -6,6 +6,7 @@
 
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
 #include <glm/vec2.hpp>
@@ -34,13 +35,76 @@ struct IndexedMesh
 	IndexedMesh();
 };
 
+// Primitives removed by clean_indexed_mesh()
+struct MeshCleanupStats
+{
+	std::size_t degenerate = 0;   // triangles
+	std::size_t duplicate = 0;    // triangles
+	std::size_t unreferenced = 0; // vertices
+};
+
+// Runs the data-parallel steps of make_indexed_mesh() elsewhere, e.g., on
+// the GPU (see gpu_indexing.hpp); without one, they run on the calling
+// thread.
+class MeshIndexingBackend
+{
+	public:
+		virtual ~MeshIndexingBackend();
+
+		// The tolerant weld's vicinity map: the grid cell key of each of
+		// aPositions, and the vertex indices, both sorted by key. The sort
+		// must be stable, and the keys those of index_mesh.cpp (the cell is
+		// the truncated (aPos - aMin) * aScale; each coordinate +1, packed
+		// into 21 bits, x highest), so that the weld is the same.
+		virtual void sort_cells(
+			std::vector<glm::vec3> const& aPositions,
+			glm::vec3 aMin,
+			float aScale,
+			std::vector<std::uint64_t>& aKeys,
+			std::vector<std::uint32_t>& aVertices
+		) = 0;
+
+		// As ::compute_tangents(), to within the backend's precision
+		virtual void compute_tangents( IndexedMesh& ) = 0;
+};
+
 //--    functions                               ///{{{1///////////////////////
 
+// Welds the soup's vertices. Bitwise identical vertices are welded first by
+// a hash lookup; with aErrorTol > 0, the remaining ones are then merged if
+// all components are within aErrorTol. aErrorTol = 0 welds exact duplicates
+// only.
+//
+// With aTangents = false, the tangents are left empty; call
+// compute_tangents() on the result to get the same mesh.
+//
+// The tolerance tests use SSE, AVX or NEON where the build targets them;
+// aSimd = false uses the scalar tests instead (for comparisons, e.g., in
+// cw2-microbench; the results are the same).
+//
+// With aBackend, the vicinity map of the tolerant pass and the tangents come
+// from the backend.
 IndexedMesh make_indexed_mesh(
 	TriangleSoup const&,
-	float aErrorTol = 1e-6f
+	float aErrorTol = 1e-6f,
+	bool aTangents = true,
+	bool aSimd = true,
+	MeshIndexingBackend* aBackend = nullptr
 );
 
 void ensure_normals( IndexedMesh& );
 
+// Removes degenerate triangles (repeated vertices, or no area to within
+// aAreaTol relative to the longest edge squared) and duplicates of earlier
+// triangles (the same vertices, in any rotation; the opposite winding is
+// kept, as it is seen from the other side), then drops the vertices that are
+// no longer referenced. Keeps the order of the remaining triangles and
+// vertices, and updates the bounds. Run after welding, before the tangents.
+MeshCleanupStats clean_indexed_mesh( IndexedMesh&, float aAreaTol = 1e-7f );
+
+// Per-vertex tangents (xyz) and handedness (w) from the positions, texture
+// coordinates and normals, as tgen computes them. Leaves the tangents empty
+// for meshes without normals. Called by make_indexed_mesh().
+void compute_tangents( IndexedMesh& );
+
 #endif // INDEX_MESH_HPP_8617BC10_313B_4397_9E27_33AA16A4C308
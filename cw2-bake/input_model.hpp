@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
 #include <glm/vec2.hpp>
@@ -41,9 +42,26 @@ struct InputMeshInfo
 	std::size_t vertexCount;
 };
 
+// Indices of a corner's attributes (see InputModel::corners)
+struct InputCorner
+{
+	std::uint32_t position;
+	std::uint32_t normal;
+	std::uint32_t texcoord;
+};
+
+/* Meshes are ranges of triangle soup corners, three per triangle. Normally,
+ * the attribute arrays hold the soup itself, an entry per corner. With
+ * corners (load_wavefront_obj( path, true ); cw2-bake --low-memory), they
+ * hold the OBJ's own attribute arrays instead, and corners holds the indices
+ * of each soup corner's attributes: 12 bytes per corner rather than 32, with
+ * shared attributes stored once. Either way, corner_position() and friends
+ * return the attributes of soup corner i.
+ */
 struct InputModel
 {
 	std::string modelSourcePath;
+	std::string materialLibraryPath; // empty if none; informational (for the bake cache)
 
 	std::vector<InputMaterialInfo> materials;
 	std::vector<InputMeshInfo> meshes;
@@ -51,7 +69,22 @@ struct InputModel
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec2> texcoords;
+
+	std::vector<InputCorner> corners; // empty: the arrays above are the soup
 };
 
+inline glm::vec3 const& corner_position( InputModel const& aModel, std::size_t aCorner )
+{
+	return aModel.corners.empty() ? aModel.positions[aCorner] : aModel.positions[aModel.corners[aCorner].position];
+}
+inline glm::vec3 const& corner_normal( InputModel const& aModel, std::size_t aCorner )
+{
+	return aModel.corners.empty() ? aModel.normals[aCorner] : aModel.normals[aModel.corners[aCorner].normal];
+}
+inline glm::vec2 const& corner_texcoord( InputModel const& aModel, std::size_t aCorner )
+{
+	return aModel.corners.empty() ? aModel.texcoords[aCorner] : aModel.texcoords[aModel.corners[aCorner].texcoord];
+}
+
 #endif // INPUT_MODEL_HPP_69C371FB_85B1_4E88_B333_F31BCDF073B9
 
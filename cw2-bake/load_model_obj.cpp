@@ -1,6 +1,10 @@
 #include "load_model_obj.hpp"
 
-#include <unordered_set>
+#include <limits>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <string_view>
 
 #include <cassert>
 #include <cstring>
@@ -8,11 +12,20 @@
 #include <rapidobj/rapidobj.hpp>
 
 #include "../labutils/error.hpp"
+#include "../labutils/cpu_zones.hpp"
 #include "input_model.hpp"
 namespace lut = labutils;
 
-InputModel load_wavefront_obj( char const* aPath )
+namespace
 {
+	// Name given by the OBJ's "mtllib" statement, or empty. (rapidobj
+	// follows the statement, but doesn't report the file.)
+	std::string find_material_library_( char const* aPath );
+}
+
+InputModel load_wavefront_obj( char const* aPath, bool aCorners )
+{
+	LUT_CPU_ZONE( "load_wavefront_obj()" );
 	assert( aPath );
 	
 	// Ask rapidobj to load the requested file
@@ -41,6 +54,9 @@ InputModel load_wavefront_obj( char const* aPath )
 
 	ret.modelSourcePath = aPath;
 
+	if( auto const mtllib = find_material_library_( aPath ); !mtllib.empty() )
+		ret.materialLibraryPath = prefix + mtllib;
+
 	for( auto const& mat : result.materials )
 	{
 		InputMaterialInfo mi;
@@ -87,85 +103,195 @@ InputModel load_wavefront_obj( char const* aPath )
 	//  materials. We want to primarily group faces by material (and possibly
 	//  secondarily by other logical groupings). 
 	//
-	// Unfortunately, RapidOBJ exposes a per-face material index.
+	// Unfortunately, RapidOBJ exposes a per-face material index. Faces are
+	// therefore bucketed by material: count the faces of each material,
+	// assign each material a range of output vertices, then scatter the
+	// faces into their ranges in a single pass over the indices.
+	//
+	// Note: we still keep different "shapes" separate. For static meshes,
+	// one could merge all vertices with the same material for a bit more
+	// efficient rendering (see cw2-bake --merge-meshes).
+	//
+	// With aCorners, the soup's corners refer to the OBJ's attribute arrays
+	// instead of holding copies of the attributes.
+	std::size_t totalIndices = 0;
+	for( auto const& shape : result.shapes )
+		totalIndices += shape.mesh.indices.size();
 
-	std::unordered_set<std::size_t> activeMaterials;
+	if( aCorners )
+	{
+		auto const& attribs = result.attributes;
+		if( attribs.positions.size() / 3 > std::numeric_limits<std::uint32_t>::max() )
+			throw lut::Error( "'%s': too many positions", aPath );
+
+		ret.positions.resize( attribs.positions.size() / 3 );
+		std::memcpy( ret.positions.data(), attribs.positions.data(), ret.positions.size() * sizeof(glm::vec3) );
+		ret.texcoords.resize( attribs.texcoords.size() / 2 );
+		std::memcpy( ret.texcoords.data(), attribs.texcoords.data(), ret.texcoords.size() * sizeof(glm::vec2) );
+		ret.normals.resize( attribs.normals.size() / 3 );
+		std::memcpy( ret.normals.data(), attribs.normals.data(), ret.normals.size() * sizeof(glm::vec3) );
+
+		ret.corners.reserve( totalIndices );
+	}
+	else
+	{
+		ret.positions.reserve( totalIndices );
+		ret.texcoords.reserve( totalIndices );
+		ret.normals.reserve( totalIndices );
+	}
+
+	auto const corner_count_ = [&] { return aCorners ? ret.corners.size() : ret.positions.size(); };
+
+	std::vector<std::size_t> faceCounts( ret.materials.size() );
+	std::vector<std::size_t> nextVertex( ret.materials.size() );
 	for( auto const& shape : result.shapes )
 	{
 		auto const& shapeName = shape.name;
+		auto const faceCount = shape.mesh.indices.size() / 3; // Always triangles; see Triangulate() above
 
-		// Scan shape for materials
-		activeMaterials.clear();
+		// Count faces per material
+		std::fill( faceCounts.begin(), faceCounts.end(), 0 );
 
-		for( std::size_t i = 0; i < shape.mesh.indices.size(); ++i )
+		assert( faceCount <= shape.mesh.material_ids.size() );
+		for( std::size_t faceId = 0; faceId < faceCount; ++faceId )
 		{
-			auto const faceId = i/3; // Always triangles; see Triangulate() above
-
-			assert( faceId < shape.mesh.material_ids.size() );
 			auto const matId = shape.mesh.material_ids[faceId];
 
-			assert( matId < int(ret.materials.size()) );
-			activeMaterials.emplace( matId );
+			assert( matId >= 0 && matId < int(ret.materials.size()) );
+			++faceCounts[std::size_t(matId)];
 		}
 
-		// Process vertices for active material
-		// This does multiple passes over the vertex data, which is less than
-		// optimal...
-		//
-		// Note: we still keep different "shapes" separate. For static meshes,
-		// one could merge all vertices with the same material for a bit more
-		// efficient rendering.
-		for( auto const matId : activeMaterials )
+		std::size_t const activeMaterials = ret.materials.size() - std::size_t(std::count( faceCounts.begin(), faceCounts.end(), 0 ));
+
+		// One mesh per active material, in order of material ID
+		auto const firstVertex = corner_count_();
+
+		std::size_t vertex = firstVertex;
+		for( std::size_t matId = 0; matId < faceCounts.size(); ++matId )
 		{
+			if( 0 == faceCounts[matId] )
+				continue;
+
 			// Keep track of mesh names; this can be useful for debugging.
 			std::string meshName;
-			if( 1 == activeMaterials.size() )
+			if( 1 == activeMaterials )
 				meshName = shapeName;
 			else
 				meshName = shapeName + "::" + ret.materials[matId].materialName;
 
-			// Extract this material's vertices.
-			auto const firstVertex = ret.positions.size();
-			
-			for( std::size_t i = 0; i < shape.mesh.indices.size(); ++i )
-			{
-				auto const faceId = i/3; // Always triangles; see Triangulate() above
-				auto const faceMat = std::size_t(shape.mesh.material_ids[faceId]);
+			auto const vertexCount = 3 * faceCounts[matId];
 
-				if( faceMat != matId )
-					continue;
+			ret.meshes.emplace_back( InputMeshInfo{
+				std::move(meshName),
+				matId,
+				vertex,
+				vertexCount
+			} );
+
+			nextVertex[matId] = vertex;
+			vertex += vertexCount;
+		}
 
+		assert( vertex == firstVertex + 3 * faceCount );
+		if( aCorners )
+		{
+			ret.corners.resize( vertex );
+		}
+		else
+		{
+			ret.positions.resize( vertex );
+			ret.texcoords.resize( vertex );
+			ret.normals.resize( vertex );
+		}
+
+		// Scatter the faces' vertices into their material's range
+		for( std::size_t faceId = 0; faceId < faceCount; ++faceId )
+		{
+			auto const matId = std::size_t(shape.mesh.material_ids[faceId]);
+
+			for( std::size_t i = 3*faceId; i < 3*faceId+3; ++i )
+			{
 				auto const& idx = shape.mesh.indices[i];
+				auto const out = nextVertex[matId]++;
+
+				if( aCorners )
+				{
+					ret.corners[out] = InputCorner{
+						std::uint32_t(idx.position_index),
+						std::uint32_t(idx.normal_index),
+						std::uint32_t(idx.texcoord_index)
+					};
+					continue;
+				}
 
-				ret.positions.emplace_back( glm::vec3{
+				ret.positions[out] = glm::vec3{
 					result.attributes.positions[idx.position_index*3+0],
 					result.attributes.positions[idx.position_index*3+1],
 					result.attributes.positions[idx.position_index*3+2]
-				} );
+				};
 
-				ret.texcoords.emplace_back( glm::vec2{
+				ret.texcoords[out] = glm::vec2{
 					result.attributes.texcoords[idx.texcoord_index*2+0],
 					result.attributes.texcoords[idx.texcoord_index*2+1]
-				} );
+				};
 
-				ret.normals.emplace_back( glm::vec3{
+				ret.normals[out] = glm::vec3{
 					result.attributes.normals[idx.normal_index*3+0],
 					result.attributes.normals[idx.normal_index*3+1],
 					result.attributes.normals[idx.normal_index*3+2]
-				} );
+				};
 			}
-
-			auto const vertexCount = ret.positions.size() - firstVertex;
-
-			ret.meshes.emplace_back( InputMeshInfo{
-				std::move(meshName),
-				matId,
-				firstVertex,
-				vertexCount
-			} );
 		}
 	}
 
 	return ret;
 }
 
+namespace
+{
+	std::string find_material_library_( char const* aPath )
+	{
+		std::ifstream in( aPath, std::ios::binary );
+
+		// Scan for "mtllib" at the start of a line. Each chunk keeps the
+		// last bytes of the previous one, so matches across chunk
+		// boundaries are found.
+		constexpr std::string_view kKey = "\nmtllib";
+		constexpr std::size_t kChunk = 1024*1024;
+
+		std::string buffer( "\n" );
+		std::streamoff bufferStart = -1; // file offset of buffer[0]
+		while( in )
+		{
+			auto const keep = std::min( buffer.size(), kKey.size()-1 );
+			bufferStart += std::streamoff(buffer.size() - keep);
+			buffer.erase( 0, buffer.size() - keep );
+
+			auto const old = buffer.size();
+			buffer.resize( old + kChunk );
+			in.read( buffer.data() + old, std::streamsize(kChunk) );
+			buffer.resize( old + std::size_t(in.gcount()) );
+
+			if( auto const pos = std::string_view( buffer ).find( kKey ); std::string_view::npos != pos )
+			{
+				in.clear();
+				in.seekg( bufferStart + std::streamoff(pos + kKey.size()) );
+
+				std::string line;
+				std::getline( in, line );
+
+				auto const first = line.find_first_not_of( " \t" );
+				auto const last = line.find_last_not_of( " \t\r" );
+				if( std::string::npos == first || first == 0 )
+					return {}; // "mtllib" without a space isn't the statement
+
+				return line.substr( first, last - first + 1 );
+			}
+
+			if( 0 == in.gcount() )
+				break;
+		}
+
+		return {};
+	}
+}
@@ -3,8 +3,10 @@
 
 #include "input_model.hpp"
 
-// Load a Wavefront OBJ model
-InputModel load_wavefront_obj( char const* aPath );
+// Load a Wavefront OBJ model. With aCorners, the model keeps the OBJ's
+// attribute arrays and indexes them per corner, instead of expanding them
+// into a triangle soup (see InputModel).
+InputModel load_wavefront_obj( char const* aPath, bool aCorners = false );
 
 #endif // LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 
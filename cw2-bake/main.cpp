@@ -1,4 +1,14 @@
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <sstream>
 #include <iterator>
+#include <optional>
 #include <vector>
 #include <typeinfo>
 #include <exception>
@@ -7,16 +17,42 @@
 #include <unordered_map>
 
 #include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
 #include <cstring>
 
 #include <tgen.h>
 #include <glm/glm.hpp>
 
 #include "index_mesh.hpp"
+#include "gpu_indexing.hpp"
+#include "optimize_mesh.hpp"
+#include "meshlet.hpp"
+#include "bvh.hpp"
+#include "pvs.hpp"
+#include "occlusion.hpp"
+#include "impostor.hpp"
+#include "simplify_mesh.hpp"
+#include "bake_cache.hpp"
 #include "input_model.hpp"
+#include "texture_bake.hpp"
+
+#include "../cw2/quantized_vertex.hpp"
+#include "../cw2/interleaved_vertex.hpp"
 #include "load_model_obj.hpp"
 
 #include "../labutils/error.hpp"
+#include "../labutils/lz4_block.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/job_system.hpp"
+#include "../labutils/thread_placement.hpp"
+
+#if defined(__linux__)
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/ioctl.h>
+#	include <linux/fs.h>
+#endif
 namespace lut = labutils;
 
 namespace
@@ -34,345 +70,2630 @@ namespace
 	 */
 	 constexpr char kFileMagic[16] = "\0\0COMP5822Mmesh";
 
-	/* Note: change the file variant if you change the file format! 
-	 *
-	 * Suggestion: use 'uid-tag'. For example, I would use "scsmbil-tan" to
-	 * indicate that this is a custom format by myself (=scsmbil) with
-	 * additional tangent space information.
-	 */
-	constexpr char kFileVariant[16] = "scsmbil-tan";
+	/* Note: change the file variant if you change the file format! 
+	 *
+	 * Suggestion: use 'uid-tag'. For example, I would use "scsmbil-tan" to
+	 * indicate that this is a custom format by myself (=scsmbil) with
+	 * additional tangent space information.
+	 */
+	constexpr char kFileVariant[16] = "scsmbil-tan";
+
+	/* Interleaved variant. Identical to "scsmbil-tan", except that the vertex
+	 * data of each mesh is stored as a single array of 48-byte vertices in
+	 * exactly the layout that the cw2 graphics pipeline consumes:
+	 *
+	 *   vec3 position, vec2 texcoord, vec3 normal, vec4 tangent
+	 *
+	 * The vertex array of each mesh starts at a 16-byte aligned file offset
+	 * (zero padding is inserted after the per-mesh counts), which also leaves
+	 * the following index array 16-byte aligned.
+	 */
+	constexpr char kFileVariantInterleaved[16] = "scsmbil-ilv";
+
+	/* Interleaved variant with bounds. Identical to "scsmbil-ilv", except that
+	 * each mesh additionally stores its axis aligned bounding box (vec3 min,
+	 * vec3 max) right after the per-mesh counts, i.e., before the padding.
+	 */
+	constexpr char kFileVariantBounds[16] = "scsmbil-box";
+
+	/* Quantized variant. Identical to "scsmbil-box", except that the vertices
+	 * are 20-byte QuantizedVertex (see cw2/quantized_vertex.hpp), with
+	 * positions relative to the mesh's AABB.
+	 */
+	constexpr char kFileVariantQuantized[16] = "scsmbil-qnt";
+
+	/* Variants with per-mesh index sizes. Identical to "scsmbil-box" and
+	 * "scsmbil-qnt", respectively, except that each mesh stores the size of
+	 * its indices (2 or 4 bytes) right after the per-mesh counts. Meshes with
+	 * at most 65536 vertices use uint16_t indices.
+	 */
+	constexpr char kFileVariantBounds16[16] = "scsmbil-b16";
+	constexpr char kFileVariantQuantized16[16] = "scsmbil-q16";
+
+	constexpr std::size_t kMaxVerticesForSmallIndices = 65536;
+
+	/* Compressed variants. Identical to "scsmbil-b16" and "scsmbil-q16",
+	 * respectively, except that each mesh's vertex and index arrays are
+	 * stored as LZ4 blocks (see labutils/lz4_block.hpp) instead of the
+	 * padding and the arrays. The index size is stored even with
+	 * --32bit-indices (it's 4 then).
+	 */
+	constexpr char kFileVariantBoundsLz4[16] = "scsmbil-lzb";
+	constexpr char kFileVariantQuantizedLz4[16] = "scsmbil-lzq";
+
+	/* Table of contents variant. The header is followed by the variant of the
+	 * content (any of the above), the TOC, and then exactly the data of a
+	 * file of that variant. The TOC gives the byte range of each texture
+	 * record, material, mesh, and each mesh's meshlets and LODs, so that
+	 * loaders can go directly to any of them (see cw2/baked_model.hpp).
+	 */
+	constexpr char kFileVariantToc[16] = "scsmbil-toc";
+
+	/* As "scsmbil-toc", for scenes of several GiB: the TOC's counts, and
+	 * each mesh's vertex and index counts and (compressed variants) array
+	 * sizes are uint64_t.
+	 */
+	constexpr char kFileVariantToc64[16] = "scsmbil-t64";
+
+	/* Optional sections after the mesh data, each starting with its ID. The
+	 * meshlet section's ID is kMeshletSectionId (see cw2/baked_meshlet.hpp).
+	 */
+	constexpr char kLodSectionId[16] = "scsmbil-lod";
+
+	/* The material constants section holds each material's base colour,
+	 * roughness and metalness, for the slots that have no texture (texture
+	 * index 0xffffffff). It's only written if there are such slots.
+	 */
+	constexpr char kMaterialSectionId[16] = "scsmbil-mat";
+
+	/* The names section holds the material and mesh names of the input
+	 * model, e.g. for debug labels. It's always written, directly after the
+	 * last TOC chunk in "scsmbil-toc" files.
+	 */
+	constexpr char kNamesSectionId[16] = "scsmbil-nam";
+
+	/* The texture format section holds each texture's role and VkFormat,
+	 * so that loaders don't have to infer them from the materials. It's
+	 * always written, last, after the names.
+	 */
+	constexpr char kTextureFormatSectionId[16] = "scsmbil-txf";
+
+	/* The ambient occlusion section holds a byte per vertex of each mesh
+	 * (--bake-ao). It's written after the BVH and PVS.
+	 */
+	constexpr char kOcclusionSectionId[16] = "scsmbil-ao";
+
+	constexpr unsigned kMaxJobs = 256;
+
+	constexpr float kIndexErrorTolerance = 1e-5f;
+
+	// SPIR-V of cw2-bake/shaders, for --gpu-indexing
+	constexpr char const* kIndexingShaderDir = "assets/cw2-bake/shaders";
+
+	constexpr std::size_t kInterleavedAlign = 16;
+
+	// Model files are written in whole blocks of this size (see
+	// BlockWriter_), at block aligned offsets
+	constexpr std::size_t kOutputBlockBytes = 1024*1024;
+
+	// options
+	enum class EVertexLayout_
+	{
+		separate,     // "scsmbil-tan"
+		interleaved,  // "scsmbil-ilv"
+		bounds,       // "scsmbil-box"
+		quantized     // "scsmbil-qnt"
+	};
+
+	enum class ETextureOutput_
+	{
+		uncompressed, // 8-bit texels with all mip levels, see bake_texture()
+		compressed // BCn with all mip levels, see bake_texture()
+	};
+
+	// types
+	struct TocChunk_
+	{
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	struct TextureInfo_
+	{
+		std::uint32_t uniqueId;
+		std::uint8_t channels;
+		ETextureKind kind;
+		std::string newPath;
+		std::uint32_t format; // VkFormat, see texture_format()
+		std::uint32_t maxSize = 0; // longest side of the baked level 0; 0: as the source
+
+		// Images the texture is made from: its path, or the roughness and
+		// metalness paths of a roughnessMetalness texture (either may be
+		// empty; see packed_key_())
+		std::vector<std::string> sources;
+	};
+
+	struct BakeOptions_
+	{
+		EVertexLayout_ layout = EVertexLayout_::bounds;
+		ETextureOutput_ textures = ETextureOutput_::compressed;
+		EMipFilter mipFilter = EMipFilter::kaiser;
+		bool optimizeMeshes = true;
+		bool smallIndices = true;
+		bool mergeMeshes = false;
+		bool meshlets = false;
+		bool lods = false;
+		bool toc = false;
+		bool wideCounts = false; // "scsmbil-t64"; implies toc
+		bool compressMeshes = false;
+		bool texturePack = false;
+		float cellSize = 0.f; // 0: no split
+		float pvsCellSize = 0.f; // 0: no PVS
+		float occlusionDistance = 0.f; // 0: no ambient occlusion
+		std::uint32_t impostorSize = 0; // texels per impostor tile; 0: no impostors
+		std::uint32_t maxTextureSize[6] = {}; // per ETextureKind; 0: no cap
+		std::uint64_t textureBudget = 0; // bytes per model; 0: none
+		bool lowMemory = false; // indexed input (see InputModel::corners)
+		MeshIndexingBackend* indexing = nullptr; // null: on the CPU
+		unsigned jobs = 1;
+	};
+
+	// One model of a batch
+	struct ModelJob_
+	{
+		std::string input;  // .obj
+		std::string output; // .comp5822mesh
+		glm::mat4x4 staticTransform = glm::mat4x4( 1.f );
+	};
+
+	// Time spent in each stage, in milliseconds. The mesh stages (index to
+	// meshlets) run concurrently, so they are summed over all meshes rather
+	// than measured as wall-clock time.
+	struct StageTimes_
+	{
+		double parse = 0., index = 0., tangents = 0., optimize = 0., lods = 0., meshlets = 0., write = 0.;
+
+		StageTimes_& operator+=( StageTimes_ const& );
+	};
+
+	// Per-model state of process_models_()
+	struct ModelState_
+	{
+		ModelJob_ const* job = nullptr;
+		std::filesystem::path rootdir, texdir, mainpath;
+		std::filesystem::path packpath; // --texture-pack: rootdir/texdir.pack
+
+		std::string log;  // printed once the model is done, in batch order
+		std::string error;
+		bool failed = false;
+		bool upToDate = false;
+		StageTimes_ times;
+
+		std::string stampName;
+		BakeCache::Stamp stamp;
+		bool complete = true; // false: don't store the stamp
+
+		std::unordered_map<std::string,TextureInfo_> textures;
+		std::vector<std::pair<std::string,TextureInfo_>> staleTextures;
+		std::vector<std::string> packNames; // relative to texdir, in ID order
+	};
+
+	// A texture that one or more models need (re)done. It's baked (or copied)
+	// once, to the first destination, and copied from there to the others.
+	struct TextureWork_
+	{
+		std::vector<std::string> sources; // see TextureInfo_
+		ETextureKind kind;
+		std::uint32_t maxSize; // see TextureInfo_
+		std::vector<std::filesystem::path> destinations;
+		std::vector<std::size_t> models; // per destination
+		std::vector<bool> failed;        // per destination
+	};
+
+	using Clock_ = std::chrono::steady_clock;
+
+	// local functions:
+
+	// Bakes all models of the batch. Models are processed concurrently, and
+	// each unique texture (source and kind) is baked or copied only once for
+	// the whole batch. Returns the number of models that failed, including
+	// those with textures that failed; the others are still written.
+	std::size_t process_models_(
+		std::vector<ModelJob_> const&,
+		BakeOptions_ const&,
+		BakeCache* aCache = nullptr // null: no incremental baking
+	);
+
+	// Everything of process_models_() that's done to a single model: checks
+	// whether it's up to date, loads, bakes and writes it, and finds its
+	// out-of-date textures. Output goes to ModelState_::log.
+	void bake_model_(
+		ModelState_&,
+		BakeOptions_ const&,
+		unsigned aJobs,
+		BakeCache&
+	);
+
+	// Reads "INPUT OUTPUT" lines. Empty lines and lines starting with '#' are
+	// skipped; paths can't contain whitespace.
+	std::vector<ModelJob_> read_manifest_(
+		char const* aPath
+	);
+
+	// std::printf() to the end of a string
+	void append_( std::string&, char const* aFormat, ... );
+
+	double ms_since_( Clock_::time_point );
+
+	// True if the output of aStamp's bake exists, and neither its options
+	// nor its input files have changed since.
+	bool up_to_date_(
+		BakeCache&,
+		BakeCache::Stamp const&,
+		ContentHash aOptions,
+		std::filesystem::path const& aMainPath,
+		std::filesystem::path const& aRootDir
+	);
+
+	// Calls aFunc( i ) for each i in [0, aCount), up to aJobs at a time, on
+	// the shared job system's threads and the calling one (see
+	// lut::JobSystem::parallel_for()). Nested calls (the meshes of a model)
+	// run on the same threads; a caller that waits runs other items.
+	template< typename tFunc >
+	void parallel_for_( std::size_t aCount, unsigned aJobs, tFunc&& aFunc );
+
+
+	// Buffered output of write_model_data_(). Small writes are gathered into
+	// a block of kOutputBlockBytes; only whole blocks (and the final partial
+	// one) go to the file, so the many small fields cost a memcpy each rather
+	// than an fwrite(). The position is counted rather than asked for, and
+	// patch() rewrites earlier bytes (the TOC) in place.
+	class BlockWriter_
+	{
+		public:
+			explicit BlockWriter_( FILE* aFile );
+
+			void write( void const* aData, std::size_t aBytes );
+			void patch( std::uint64_t aOffset, void const* aData, std::size_t aBytes );
+
+			// Writes the buffered rest; call before closing the file
+			void finish();
+
+			std::uint64_t tell() const noexcept { return mPos; }
+
+		private:
+			void flush_();
+
+			FILE* mFile;
+			std::vector<std::uint8_t> mBlock;
+			std::uint64_t mPos = 0; // bytes written, including mBlock
+	};
+
+	void write_model_data_(
+		BlockWriter_&,
+		InputModel const&,
+		std::vector<IndexedMesh> const&,
+		std::unordered_map<std::string,TextureInfo_> const&,
+		EVertexLayout_,
+		bool aSmallIndices,
+		std::vector<MeshletData> const& aMeshlets, // empty: no meshlet section
+		std::vector<std::vector<MeshLod>> const& aLods, // empty: no LOD section
+		BakedBvh const&,
+		BakedPvs const&, // no bits: no PVS section
+		std::vector<std::vector<std::uint8_t>> const& aOcclusion, // empty: no AO section
+		BakedImpostors const&, // no meshes: no impostor section
+		bool aToc, // "scsmbil-toc" around the variant given by the layout
+		bool aWide, // "scsmbil-t64" instead of "scsmbil-toc"
+		bool aCompress // "scsmbil-lzb"/"-lzq"; bounds and quantized layouts only
+	);
+
+	// A LZ4 block of the data, or a copy of it if that isn't smaller
+	std::vector<std::uint8_t> pack_(
+		void const* aData,
+		std::size_t aBytes
+	);
+
+
+	// Applies aTransform to the positions and normals of all meshes (and
+	// fixes the winding of mirroring transforms).
+	void apply_static_transform_(
+		InputModel&,
+		glm::mat4x4 const& aTransform
+	);
+
+	// Concatenates all meshes with the same material into a single mesh.
+	// Only valid for static geometry (which is all we have). The merged
+	// meshes are ordered by the first appearance of their material. (Takes
+	// the model by value, so that indexed attributes can be moved along.)
+	InputModel merge_meshes_by_material_(
+		InputModel
+	);
+
+	// Splits every mesh into one mesh per cell of a grid on the xz plane
+	// (cells of aCellSize by aCellSize, aligned to the origin), by the
+	// centroid of each triangle. The result is ordered by cell, row by row,
+	// so that the meshes of a cell are stored together; within a cell, the
+	// meshes keep their order. For streaming by cell (see
+	// cw2/world_streaming.hpp).
+	InputModel split_meshes_by_cell_(
+		InputModel,
+		float aCellSize
+	);
+
+	// Appends the corners [aFirst, aFirst+aCount) of aFrom to aTo (whose
+	// attribute arrays are aFrom's if it has corners)
+	void append_corners_(
+		InputModel& aTo,
+		InputModel const& aFrom,
+		std::size_t aFirst,
+		std::size_t aCount
+	);
+
+	// The triangle soup of a mesh
+	TriangleSoup mesh_soup_(
+		InputModel const&,
+		InputMeshInfo const&
+	);
+
+	// Everything done to a single mesh before it is written: indexing (with
+	// tangents), then optionally optimization, LODs and meshlets.
+	MeshBakeResult bake_mesh_(
+		TriangleSoup const&,
+		bool aOptimize,
+		bool aLods,
+		bool aMeshlets,
+		MeshIndexingBackend*,
+		StageTimes_&
+	);
+
+	// Cache key of bake_mesh_()'s result: the mesh's soup and the options.
+	// GPU tangents differ from the CPU's by rounding, so aGpuIndexing is
+	// part of the key.
+	ContentHash mesh_key_(
+		TriangleSoup const&,
+		bool aOptimize,
+		bool aLods,
+		bool aMeshlets,
+		bool aGpuIndexing
+	);
+
+	// Replaces textures whose texels are all the same (see
+	// find_constant_texture()) by material constants, so that they are
+	// neither baked nor sampled at runtime. Base colour (unless an alpha mask
+	// remains), roughness and metalness become constant slots; flat normal
+	// maps and alpha masks that never discard are dropped. Returns the paths
+	// of the folded textures.
+	std::vector<std::string> fold_constant_textures_(
+		InputModel&,
+		unsigned aJobs
+	);
+
+	// Key of a material's packed roughness/metalness texture in the unique
+	// textures; empty if the material has neither. Paths in .mtl files can't
+	// contain line breaks, so the key can't be a path.
+	std::string packed_key_(
+		InputMaterialInfo const&
+	);
+
+	// Key of a material's alpha coverage texture; distinct from the key of
+	// the same image as a base color. Empty if the material has no mask.
+	std::string alpha_key_(
+		InputMaterialInfo const&
+	);
+
+	// Role of a texture in the texture format section; matches
+	// EBakedTextureRole in cw2/baked_model.hpp
+	std::uint32_t texture_role_(
+		ETextureKind
+	);
+
+	// Roughness and metalness of each material are packed into a single
+	// roughnessMetalness texture (see bake_packed_texture()).
+	std::unordered_map<std::string,TextureInfo_> find_unique_textures_(
+		InputModel const&
+	);
+
+	std::unordered_map<std::string,TextureInfo_> new_paths_(
+		std::unordered_map<std::string,TextureInfo_>,
+		std::filesystem::path const& aTexDir,
+		ETextureOutput_
+	);
+
+	// Sets TextureInfo_::maxSize from the per-kind caps, then, while the
+	// textures take more than aBudget bytes (if > 0), halves the largest
+	// one. Sources that can't be read count as empty. Returns the bytes
+	// the textures take on the GPU.
+	std::uint64_t fit_texture_budget_(
+		std::unordered_map<std::string,TextureInfo_>&,
+		BakeOptions_ const&
+	);
+
+	// Bakes each texture, and sets TextureWork_::failed. Returns the number
+	// of failed destinations.
+	std::size_t produce_textures_(
+		std::vector<TextureWork_>&,
+		ETextureOutput_,
+		EMipFilter,
+		unsigned aJobs
+	);
+
+	// How copy_texture_() shared a texture with another model
+	enum class ETextureCopy_
+	{
+		failed,
+		reflink, // copy-on-write clone (Linux, e.g., Btrfs and XFS)
+		hardlink,
+		copy
+	};
+
+	// Replaces aTo with a reflink of aFrom, or a hard link, or else a copy.
+	// Links are safe, as texture outputs are only ever replaced (by rename,
+	// see bake_texture()), never rewritten in place.
+	ETextureCopy_ copy_texture_(
+		std::filesystem::path const& aFrom,
+		std::filesystem::path const& aTo
+	);
+}
+
+
+int main( int aArgc, char* aArgv[] ) try
+{
+	// INPUT.obj OUTPUT.comp5822mesh: a model to bake; any number of pairs
+	//   (default: the Sponza model of cw2)
+	// --manifest=FILE: bake the models listed in FILE, one "INPUT OUTPUT"
+	//   pair per line (in addition to those on the command line)
+	// --raw-textures: bake the textures uncompressed (still in Vulkan row
+	//   order, with mip levels and at their final channel count)
+	// --mip-filter=box|kaiser: filter for the baked mip levels
+	// --max-texture-size=KIND:SIZE: bake textures of KIND (base-color,
+	//   roughness-metalness, normal-map or alpha-coverage) at most SIZE
+	//   texels on a side, dropping the larger mip levels; repeat for each
+	//   kind
+	// --texture-budget=MB: halve the largest textures of each model until
+	//   they take at most MB megabytes on the GPU (after the size caps)
+	// --quantize-vertices: write "scsmbil-qnt" instead of "scsmbil-box"
+	// --no-mesh-optimization: keep the triangle/vertex order of the indexer
+	// --32bit-indices: always store uint32_t indices ("scsmbil-box"/"-qnt"
+	//   instead of "scsmbil-b16"/"-q16")
+	// --merge-meshes: one mesh per material
+	// --meshlets: append the "scsmbil-mlt" meshlet section
+	// --lods: append the "scsmbil-lod" section with simplified index buffers
+	// --toc: write "scsmbil-toc" files, with a table of contents in front of
+	//   the data of the variant selected by the other options
+	// --64bit-counts: write "scsmbil-t64" files (implies --toc), whose mesh
+	//   counts and sizes are 64-bit; needed once a mesh's arrays exceed
+	//   4 GiB, which the other variants refuse to write
+	// --compress-meshes: store the vertex and index arrays of each mesh as
+	//   LZ4 blocks ("scsmbil-lzb"/"-lzq" instead of "scsmbil-b16"/"-q16")
+	// --texture-pack: also write each model's textures into one file,
+	//   OUTPUT-tex.pack next to the texture directory, which cw2 reads them
+	//   from instead (see labutils/texture_pack.hpp)
+	// --cell-size=SIZE: split the meshes at a grid of SIZE x SIZE cells on
+	//   the xz plane, stored cell by cell (for cw2 --stream-cells=SIZE)
+	// --pvs=SIZE: append the "scsmbil-pvs" section with the meshes
+	//   potentially visible from each view cell of about SIZE units
+	// --bake-ao=DISTANCE: append the "scsmbil-ao" section with the ambient
+	//   occlusion of each vertex, from occluders up to DISTANCE units away
+	// --impostors=SIZE: append the "scsmbil-imp" section and bake an
+	//   impostor of each mesh, with tiles of SIZE x SIZE texels
+	// -jN: process up to N models, meshes and textures at a time (default:
+	//   all cores), on the shared job system's threads (a thread per core);
+	//   the output doesn't depend on N
+	// --low-memory: keep the OBJ's attributes indexed, and expand only the
+	//   triangle soups of the meshes being baked (at most N at a time), for
+	//   models whose soup doesn't fit in memory; the output is the same
+	// --cache-dir=DIR: incremental baking state (default: .bake-cache); only
+	//   meshes and textures whose inputs changed are redone
+	// --no-cache: bake everything, don't read or write the cache
+	// --low-priority: run the job threads at a lower priority, e.g., for
+	//   baking in the background of an interactive session
+	// --numa: keep each job thread on one NUMA node, spread over the nodes
+	//   (see labutils/thread_placement.hpp)
+	// --gpu-indexing[=DIR]: sort the welding's vertices by grid cell and
+	//   compute the tangents with compute shaders, on a headless Vulkan
+	//   device, with the SPIR-V of cw2-bake/shaders from DIR (default:
+	//   assets/cw2-bake/shaders); the welds are the same, the tangents
+	//   differ by rounding (see gpu_indexing.hpp). Without a device,
+	//   indexing stays on the CPU.
+	BakeOptions_ options;
+	lut::ThreadPlacement placement;
+	options.jobs = std::max( 1u, std::thread::hardware_concurrency() );
+
+	std::vector<ModelJob_> models;
+	std::vector<char const*> positional;
+	char const* cacheDir = ".bake-cache";
+	char const* indexingShaderDir = nullptr;
+	for( int i = 1; i < aArgc; ++i )
+	{
+		if( 0 == std::strcmp( aArgv[i], "--raw-textures" ) )
+			options.textures = ETextureOutput_::uncompressed;
+		else if( 0 == std::strcmp( aArgv[i], "--quantize-vertices" ) )
+			options.layout = EVertexLayout_::quantized;
+		else if( 0 == std::strcmp( aArgv[i], "--mip-filter=box" ) )
+			options.mipFilter = EMipFilter::box;
+		else if( 0 == std::strcmp( aArgv[i], "--mip-filter=kaiser" ) )
+			options.mipFilter = EMipFilter::kaiser;
+		else if( 0 == std::strcmp( aArgv[i], "--no-mesh-optimization" ) )
+			options.optimizeMeshes = false;
+		else if( 0 == std::strcmp( aArgv[i], "--32bit-indices" ) )
+			options.smallIndices = false;
+		else if( 0 == std::strcmp( aArgv[i], "--merge-meshes" ) )
+			options.mergeMeshes = true;
+		else if( 0 == std::strcmp( aArgv[i], "--meshlets" ) )
+			options.meshlets = true;
+		else if( 0 == std::strcmp( aArgv[i], "--lods" ) )
+			options.lods = true;
+		else if( 0 == std::strcmp( aArgv[i], "--toc" ) )
+			options.toc = true;
+		else if( 0 == std::strcmp( aArgv[i], "--64bit-counts" ) )
+			options.toc = options.wideCounts = true;
+		else if( 0 == std::strcmp( aArgv[i], "--compress-meshes" ) )
+			options.compressMeshes = true;
+		else if( 0 == std::strcmp( aArgv[i], "--texture-pack" ) )
+			options.texturePack = true;
+		else if( 0 == std::strncmp( aArgv[i], "--max-texture-size=", 19 ) )
+		{
+			static constexpr std::pair<char const*, ETextureKind> kinds[] = {
+				{ "base-color:", ETextureKind::baseColor },
+				{ "roughness-metalness:", ETextureKind::roughnessMetalness },
+				{ "normal-map:", ETextureKind::normalMap },
+				{ "alpha-coverage:", ETextureKind::alphaCoverage }
+			};
+
+			char const* arg = aArgv[i] + 19;
+			auto const* kind = std::find_if( std::begin( kinds ), std::end( kinds ), [&] (auto const& aKind) {
+				return 0 == std::strncmp( arg, aKind.first, std::strlen( aKind.first ) );
+			} );
+
+			char* end = nullptr;
+			unsigned long const size = kind == std::end( kinds ) ? 0 : std::strtoul( arg + std::strlen( kind->first ), &end, 10 );
+			if( kind == std::end( kinds ) || end == arg + std::strlen( kind->first ) || '\0' != *end || size < 1 || size > 65536 )
+				throw lut::Error( "%s: expected --max-texture-size=KIND:SIZE with KIND base-color, roughness-metalness, normal-map or alpha-coverage and SIZE between 1 and 65536", aArgv[i] );
+
+			options.maxTextureSize[std::size_t(kind->second)] = std::uint32_t(size);
+		}
+		else if( 0 == std::strncmp( aArgv[i], "--texture-budget=", 17 ) )
+		{
+			char* end = nullptr;
+			float const megabytes = std::strtof( aArgv[i]+17, &end );
+			if( end == aArgv[i]+17 || '\0' != *end || !(megabytes > 0.f) )
+				throw lut::Error( "%s: expected --texture-budget=MB with MB > 0", aArgv[i] );
+
+			options.textureBudget = std::uint64_t(double(megabytes) * 1024. * 1024.);
+		}
+		else if( 0 == std::strncmp( aArgv[i], "--cell-size=", 12 ) )
+		{
+			char* end = nullptr;
+			float const size = std::strtof( aArgv[i]+12, &end );
+			if( end == aArgv[i]+12 || '\0' != *end || !(size > 0.f) )
+				throw lut::Error( "%s: expected --cell-size=SIZE with SIZE > 0", aArgv[i] );
+
+			options.cellSize = size;
+		}
+		else if( 0 == std::strncmp( aArgv[i], "--pvs=", 6 ) )
+		{
+			char* end = nullptr;
+			float const size = std::strtof( aArgv[i]+6, &end );
+			if( end == aArgv[i]+6 || '\0' != *end || !(size > 0.f) )
+				throw lut::Error( "%s: expected --pvs=SIZE with SIZE > 0", aArgv[i] );
+
+			options.pvsCellSize = size;
+		}
+		else if( 0 == std::strncmp( aArgv[i], "--bake-ao=", 10 ) )
+		{
+			char* end = nullptr;
+			float const distance = std::strtof( aArgv[i]+10, &end );
+			if( end == aArgv[i]+10 || '\0' != *end || !(distance > 0.f) )
+				throw lut::Error( "%s: expected --bake-ao=DISTANCE with DISTANCE > 0", aArgv[i] );
+
+			options.occlusionDistance = distance;
+		}
+		else if( 0 == std::strncmp( aArgv[i], "--impostors=", 12 ) )
+		{
+			char* end = nullptr;
+			unsigned long const size = std::strtoul( aArgv[i]+12, &end, 10 );
+			if( end == aArgv[i]+12 || '\0' != *end || size < 8 || size > 512 )
+				throw lut::Error( "%s: expected --impostors=SIZE with SIZE between 8 and 512", aArgv[i] );
+
+			options.impostorSize = std::uint32_t(size);
+		}
+		else if( 0 == std::strncmp( aArgv[i], "--cache-dir=", 12 ) && '\0' != aArgv[i][12] )
+			cacheDir = aArgv[i] + 12;
+		else if( 0 == std::strcmp( aArgv[i], "--no-cache" ) )
+			cacheDir = nullptr;
+		else if( 0 == std::strcmp( aArgv[i], "--low-memory" ) )
+			options.lowMemory = true;
+		else if( 0 == std::strcmp( aArgv[i], "--low-priority" ) )
+			placement.lowPriorityWorkers = true;
+		else if( 0 == std::strcmp( aArgv[i], "--numa" ) )
+			placement.numaWorkers = true;
+		else if( 0 == std::strcmp( aArgv[i], "--gpu-indexing" ) )
+			indexingShaderDir = kIndexingShaderDir;
+		else if( 0 == std::strncmp( aArgv[i], "--gpu-indexing=", 15 ) && '\0' != aArgv[i][15] )
+			indexingShaderDir = aArgv[i] + 15;
+		else if( 0 == std::strncmp( aArgv[i], "--manifest=", 11 ) && '\0' != aArgv[i][11] )
+		{
+			auto listed = read_manifest_( aArgv[i] + 11 );
+			models.insert( models.end(), std::make_move_iterator( listed.begin() ), std::make_move_iterator( listed.end() ) );
+		}
+		else if( 0 == std::strncmp( aArgv[i], "-j", 2 ) )
+		{
+			char* end = nullptr;
+			unsigned long const count = std::strtoul( aArgv[i]+2, &end, 10 );
+			if( end == aArgv[i]+2 || '\0' != *end || count < 1 || count > kMaxJobs )
+				throw lut::Error( "%s: expected -jN with N between 1 and %u", aArgv[i], kMaxJobs );
+
+			options.jobs = unsigned(count);
+		}
+		else if( '-' != aArgv[i][0] )
+			positional.emplace_back( aArgv[i] );
+		else
+			throw lut::Error( "Unknown option '%s'\nUsage: %s [--raw-textures] [--mip-filter=box|kaiser] [--max-texture-size=KIND:SIZE]... [--texture-budget=MB] [--quantize-vertices] [--no-mesh-optimization] [--32bit-indices] [--merge-meshes] [--meshlets] [--lods] [--toc] [--64bit-counts] [--compress-meshes] [--texture-pack] [--cell-size=SIZE] [--pvs=SIZE] [--bake-ao=DISTANCE] [--impostors=SIZE] [-jN] [--low-memory] [--low-priority] [--numa] [--gpu-indexing[=DIR]] [--cache-dir=DIR|--no-cache] [--manifest=FILE] [INPUT.obj OUTPUT.comp5822mesh]...", aArgv[i], aArgv[0] );
+	}
+
+	// Before the first use of shared_jobs()
+	lut::set_thread_placement( placement );
+
+	if( positional.size() % 2 )
+		throw lut::Error( "'%s': expected pairs of INPUT.obj OUTPUT.comp5822mesh", positional.back() );
+
+	for( std::size_t i = 0; i < positional.size(); i += 2 )
+		models.emplace_back( ModelJob_{ positional[i], positional[i+1] } );
+
+	if( models.empty() )
+		models.emplace_back( ModelJob_{ "assets-src/cw2/sponza-pbr.obj", "assets/cw2/sponza-pbr.comp5822mesh" } );
+
+	std::optional<BakeCache> cache;
+	if( cacheDir )
+		cache.emplace( cacheDir );
+
+	std::optional<GpuMeshIndexing> gpuIndexing;
+	if( indexingShaderDir )
+	{
+		try
+		{
+			gpuIndexing.emplace( indexingShaderDir );
+			options.indexing = &*gpuIndexing;
+		}
+		catch( lut::Error const& eErr )
+		{
+			std::fprintf( stderr, "--gpu-indexing: %s\nIndexing on the CPU instead.\n", eErr.what() );
+		}
+	}
+
+	auto const failed = process_models_( models, options, cache ? &*cache : nullptr );
+
+#	if defined(LUT_CPU_ZONES)
+	if( lut::write_cpu_zones( "cw2-bake-zones.json" ) )
+		std::printf( "CPU zones written to 'cw2-bake-zones.json'\n" );
+#	endif
+
+	return failed ? 1 : 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level exception [%s]:\n%s\nBye.\n", typeid(eErr).name(), eErr.what() );
+	return 1;
+}
+
+namespace
+{
+	template< typename tFunc >
+	void parallel_for_( std::size_t aCount, unsigned aJobs, tFunc&& aFunc )
+	{
+		lut::shared_jobs().parallel_for( aCount, std::forward<tFunc>(aFunc), aJobs );
+	}
+
+	std::size_t process_models_( std::vector<ModelJob_> const& aModels, BakeOptions_ const& aOptions, BakeCache* aCache )
+	{
+		LUT_CPU_ZONE( "process_models_()" );
+		auto const start = Clock_::now();
+
+		BakeCache noCache;
+		auto& cache = aCache ? *aCache : noCache;
+
+		// Figure out output paths. Each output may appear only once, as its
+		// stamp and texture directory would otherwise be shared.
+		std::vector<ModelState_> states( aModels.size() );
+		std::unordered_map<std::string,std::size_t> outputs;
+		for( std::size_t i = 0; i < aModels.size(); ++i )
+		{
+			auto& state = states[i];
+			state.job = &aModels[i];
+
+			std::filesystem::path const outname( aModels[i].output );
+			std::filesystem::path const basename = outname.stem();
+			state.rootdir = outname.parent_path();
+			state.texdir = basename.string() + "-tex";
+			state.packpath = state.rootdir / (state.texdir.string() + ".pack");
+
+			state.mainpath = state.rootdir / basename;
+			state.mainpath.replace_extension( "comp5822mesh" );
+
+			auto const [it, isNew] = outputs.emplace( state.mainpath.lexically_normal().generic_string(), i );
+			if( !isNew )
+				throw lut::Error( "'%s' is the output of both '%s' and '%s'", state.mainpath.string().c_str(), aModels[it->second].input.c_str(), aModels[i].input.c_str() );
+		}
+
+		// Models are independent up to (and including) writing their mesh
+		// files. The jobs are spread over the models first, and what's left
+		// over goes to each model's meshes. A model's output is printed once
+		// it and all models before it are done.
+		unsigned const modelJobs = unsigned(std::min<std::size_t>( aOptions.jobs, std::max<std::size_t>( states.size(), 1 ) ));
+		unsigned const meshJobs = std::max( 1u, aOptions.jobs / modelJobs );
+
+		std::mutex printMutex;
+		std::vector<bool> done( states.size() );
+		std::size_t printed = 0;
+
+		parallel_for_( states.size(), modelJobs, [&] (std::size_t aModel) {
+			auto& state = states[aModel];
+			try
+			{
+				bake_model_( state, aOptions, meshJobs, cache );
+			}
+			catch( std::exception const& eErr )
+			{
+				state.failed = true;
+				state.error = eErr.what();
+			}
+
+			std::lock_guard<std::mutex> lock( printMutex );
+			for( done[aModel] = true; printed < states.size() && done[printed]; ++printed )
+			{
+				auto const& ready = states[printed];
+				std::fputs( ready.log.c_str(), stdout );
+				std::fflush( stdout );
+				if( ready.failed )
+					std::fprintf( stderr, "%s: failed: %s\n", ready.job->input.c_str(), ready.error.c_str() );
+			}
+		} );
+
+		// Unique textures of the batch. Models that share a texture source
+		// (with the same kind) each get their own copy of the output, but the
+		// texture is only baked once.
+		std::vector<TextureWork_> work;
+		std::unordered_map<std::string,std::size_t> workIndex;
+		for( std::size_t i = 0; i < states.size(); ++i )
+		{
+			auto const& state = states[i];
+			if( state.failed || state.upToDate )
+				continue;
+
+			for( auto const& entry : state.staleTextures )
+			{
+				auto const& info = entry.second;
+
+				auto id = std::to_string( int(info.kind) ) + ':' + std::to_string( info.maxSize ) + ':';
+				for( auto const& source : info.sources )
+					id += std::filesystem::path( source ).lexically_normal().generic_string() + '\n';
+
+				auto const [it, isNew] = workIndex.emplace( id, work.size() );
+				if( isNew )
+					work.emplace_back( TextureWork_{ info.sources, info.kind, info.maxSize, {}, {}, {} } );
+
+				auto& item = work[it->second];
+				item.destinations.emplace_back( state.rootdir / info.newPath );
+				item.models.emplace_back( i );
+			}
+		}
+
+		// Copy or bake textures
+		auto const textureStart = Clock_::now();
+		std::size_t const textureFailures = produce_textures_( work, aOptions.textures, aOptions.mipFilter, aOptions.jobs );
+		double const textureTime = ms_since_( textureStart );
+
+		std::vector<std::size_t> textureErrors( states.size() );
+		for( auto const& item : work )
+		{
+			for( std::size_t i = 0; i < item.destinations.size(); ++i )
+			{
+				if( item.failed[i] )
+					++textureErrors[item.models[i]];
+			}
+		}
+
+		// --texture-pack: once its textures are done, each baked model's are
+		// packed. A pack left from an earlier bake would shadow the new
+		// textures, so it's removed first (and stays removed without the
+		// option, or if any of the model's textures failed).
+		auto const packStart = Clock_::now();
+		std::size_t packs = 0;
+		std::uint64_t packBytes = 0;
+		for( std::size_t i = 0; i < states.size(); ++i )
+		{
+			auto& state = states[i];
+			if( state.failed || state.upToDate )
+				continue;
+
+			std::error_code ec;
+			std::filesystem::remove( state.packpath, ec );
+			if( !aOptions.texturePack || textureErrors[i] > 0 )
+				continue;
+
+			try
+			{
+				packBytes += write_texture_pack( state.packpath.string().c_str(), (state.rootdir / state.texdir).string().c_str(), state.packNames );
+				++packs;
+			}
+			catch( std::exception const& eErr )
+			{
+				std::fprintf( stderr, "%s: texture pack failed: %s\n", state.packpath.string().c_str(), eErr.what() );
+				state.complete = false;
+			}
+		}
+
+		if( packs > 0 )
+			std::printf( "Texture packs: %zu written, %ju MiB in %.1f ms\n", packs, std::uintmax_t(packBytes >> 20), ms_since_( packStart ) );
+
+		// Without a stamp, the next run starts over (reusing cached meshes).
+		// A model whose textures failed is written, but counts as failed:
+		// its mesh refers to textures that don't exist.
+		std::size_t upToDate = 0, failed = 0;
+		StageTimes_ total;
+		for( std::size_t i = 0; i < states.size(); ++i )
+		{
+			auto const& state = states[i];
+			upToDate += state.upToDate;
+			total += state.times;
+
+			if( !state.failed && textureErrors[i] > 0 )
+				std::fprintf( stderr, "%s: failed: %zu of its textures failed\n", state.job->input.c_str(), textureErrors[i] );
+
+			if( state.failed || textureErrors[i] > 0 )
+				++failed;
+			else if( !state.upToDate && state.complete )
+				cache.store_stamp( state.stampName, state.stamp );
+		}
+
+		cache.save();
+
+		std::size_t const baked = states.size() - upToDate - failed;
+		if( baked > 1 )
+			std::printf( "All models: parse %.1f, index %.1f, tangents %.1f, optimize %.1f, LODs %.1f, meshlets %.1f, write %.1f ms\n", total.parse, total.index, total.tangents, total.optimize, total.lods, total.meshlets, total.write );
+
+		std::printf( "Textures: %zu unique, %zu failed in %.1f ms\n", work.size(), textureFailures, textureTime );
+		std::printf( "Models: %zu baked, %zu up to date, %zu failed in %.1f ms\n", baked, upToDate, failed, ms_since_( start ) );
+		return failed;
+	}
+
+	void bake_model_( ModelState_& aState, BakeOptions_ const& aOptions, unsigned aJobs, BakeCache& aCache )
+	{
+		LUT_CPU_ZONE( "bake_model_()" );
+		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
+
+		auto const& job = *aState.job;
+		auto const& mainpath = aState.mainpath;
+		auto& log = aState.log;
+		auto& times = aState.times;
+
+		// Incremental baking: everything that determines the output goes into
+		// the options hash or the stamp's list of input files.
+		ContentHash optionsHash = 0;
+		{
+			ContentHasher hasher;
+			hasher.add_value( kBakeCacheVersion );
+			hasher.add( job.output.data(), job.output.size() );
+			hasher.add( job.input.data(), job.input.size() );
+			hasher.add_value( job.staticTransform );
+			hasher.add_value( aOptions.layout );
+			hasher.add_value( aOptions.textures );
+			hasher.add_value( aOptions.mipFilter );
+			hasher.add_value( aOptions.cellSize );
+			hasher.add_value( aOptions.pvsCellSize );
+			hasher.add_value( aOptions.occlusionDistance );
+			hasher.add_value( aOptions.impostorSize );
+			hasher.add_value( aOptions.maxTextureSize );
+			hasher.add_value( aOptions.textureBudget );
+			for( bool const flag : { aOptions.optimizeMeshes, aOptions.smallIndices, aOptions.mergeMeshes, aOptions.meshlets, aOptions.lods, aOptions.toc, aOptions.wideCounts, aOptions.compressMeshes, aOptions.texturePack, nullptr != aOptions.indexing } )
+				hasher.add_value( flag );
+			optionsHash = hasher.value();
+		}
+
+		auto& stampName = aState.stampName;
+		stampName = mainpath.generic_string();
+		std::replace_if( stampName.begin(), stampName.end(), [] (char aC) { return '/' == aC || ':' == aC; }, '_' );
+
+		BakeCache::Stamp previous;
+		if( aCache.load_stamp( stampName, previous ) && up_to_date_( aCache, previous, optionsHash, mainpath, aState.rootdir ) && (!aOptions.texturePack || std::filesystem::exists( aState.packpath )) )
+		{
+			append_( log, "%s: up to date\n", mainpath.string().c_str() );
+			aState.upToDate = true;
+			return;
+		}
+
+		auto& stamp = aState.stamp;
+		stamp.options = optionsHash;
+		if( aCache.enabled() )
+			stamp.inputs.emplace_back( aCache.file_hash( job.input ), job.input );
+
+		// Load input model
+		auto const parseStart = Clock_::now();
+
+		auto model = load_wavefront_obj( job.input.c_str(), aOptions.lowMemory );
+		apply_static_transform_( model, job.staticTransform );
+
+		std::size_t inputVerts = 0;
+		for( auto const& imesh : model.meshes )
+			inputVerts += imesh.vertexCount;
+
+		std::size_t const inputMeshes = model.meshes.size();
+		if( aOptions.mergeMeshes )
+			model = merge_meshes_by_material_( std::move(model) );
+		if( aOptions.cellSize > 0.f )
+			model = split_meshes_by_cell_( std::move(model), aOptions.cellSize );
+
+		times.parse = ms_since_( parseStart );
+
+		if( aCache.enabled() && !model.materialLibraryPath.empty() )
+			stamp.inputs.emplace_back( aCache.file_hash( model.materialLibraryPath ), model.materialLibraryPath );
+
+		append_( log, "%s: %zu meshes, %zu materials\n", job.input.c_str(), inputMeshes, model.materials.size() );
+		if( aOptions.lowMemory )
+			append_( log, " - triangle soup vertices: %zu, indexed => %zu kB\n", inputVerts, (model.corners.size()*sizeof(InputCorner) + model.positions.size()*sizeof(glm::vec3) + model.normals.size()*sizeof(glm::vec3) + model.texcoords.size()*sizeof(glm::vec2))/1024 );
+		else
+			append_( log, " - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts*vertexSize/1024 );
+
+		if( aOptions.mergeMeshes )
+			append_( log, " - merged by material: %zu meshes\n", model.meshes.size() );
+		if( aOptions.cellSize > 0.f )
+			append_( log, " - split into %g unit cells: %zu meshes\n", double(aOptions.cellSize), model.meshes.size() );
+
+		// Index, optimize (for the post-transform cache, overdraw and vertex
+		// fetch), simplify and split each mesh. Meshes are independent; each
+		// job writes only its own entry, so the result is the same for any
+		// number of jobs. Results are cached per mesh, keyed by the mesh's
+		// soup and the options. With --low-memory, a mesh's soup only exists
+		// while the mesh is baked.
+		std::vector<MeshBakeResult> results( model.meshes.size() );
+		std::vector<StageTimes_> meshTimes( model.meshes.size() );
+		std::atomic<std::size_t> cacheHits{ 0 };
+		parallel_for_( model.meshes.size(), aJobs, [&] (std::size_t aMesh) {
+			auto const soup = mesh_soup_( model, model.meshes[aMesh] );
+			auto const key = mesh_key_( soup, aOptions.optimizeMeshes, aOptions.lods, aOptions.meshlets, nullptr != aOptions.indexing );
+			if( aCache.load_mesh( key, results[aMesh] ) )
+			{
+				++cacheHits;
+				return;
+			}
+
+			results[aMesh] = bake_mesh_( soup, aOptions.optimizeMeshes, aOptions.lods, aOptions.meshlets, aOptions.indexing, meshTimes[aMesh] );
+			aCache.store_mesh( key, results[aMesh] );
+		} );
+
+		for( auto const& meshTime : meshTimes )
+			times += meshTime;
+
+		if( aCache.enabled() )
+			append_( log, " - mesh cache: %zu of %zu meshes reused\n", cacheHits.load(), results.size() );
+
+		std::vector<IndexedMesh> indexed;
+		std::vector<std::vector<MeshLod>> lods;
+		std::vector<MeshletData> meshlets;
+
+		std::size_t missesBefore = 0, missesAfter = 0;
+		MeshCleanupStats cleanup;
+		std::string cleanupLog;
+		for( auto& result : results )
+		{
+			missesBefore += result.missesBefore;
+			missesAfter += result.missesAfter;
+
+			auto const& removed = result.cleanup;
+			cleanup.degenerate += removed.degenerate;
+			cleanup.duplicate += removed.duplicate;
+			cleanup.unreferenced += removed.unreferenced;
+			if( removed.degenerate || removed.duplicate || removed.unreferenced )
+			{
+				auto const mesh = std::size_t(&result - results.data());
+				append_( cleanupLog, "   - mesh %zu (%s): %zu degenerate, %zu duplicate triangles, %zu unreferenced vertices\n", mesh, model.materials[model.meshes[mesh].materialIndex].materialName.c_str(), removed.degenerate, removed.duplicate, removed.unreferenced );
+			}
+
+			indexed.emplace_back( std::move(result.mesh) );
+			if( aOptions.lods )
+				lods.emplace_back( std::move(result.lods) );
+			if( aOptions.meshlets )
+				meshlets.emplace_back( std::move(result.meshlets) );
+		}
+
+		std::size_t outputVerts = 0, outputIndices = 0, outputTangents = 0;
+		for( auto const& mesh : indexed )
+		{
+			outputVerts += mesh.vert.size();
+			outputIndices += mesh.indices.size();
+			outputTangents += mesh.tangent.size();
+		}
+
+		append_( log, " - cleanup: removed %zu degenerate and %zu duplicate triangles, %zu unreferenced vertices\n", cleanup.degenerate, cleanup.duplicate, cleanup.unreferenced );
+		log += cleanupLog;
+		append_( log, " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+		append_( log, " - tangents: %zu\n", outputTangents );
+
+		if( aOptions.optimizeMeshes )
+		{
+			std::size_t const triangles = std::max( outputIndices / 3, std::size_t(1) );
+			append_( log, " - ACMR (%u entry FIFO): %.3f => %.3f\n", kVertexCacheSize, double(missesBefore)/triangles, double(missesAfter)/triangles );
+		}
+
+		if( aOptions.smallIndices && (EVertexLayout_::bounds == aOptions.layout || EVertexLayout_::quantized == aOptions.layout) )
+		{
+			std::size_t smallMeshes = 0, smallIndices = 0;
+			for( auto const& mesh : indexed )
+			{
+				if( mesh.vert.size() <= kMaxVerticesForSmallIndices )
+				{
+					++smallMeshes;
+					smallIndices += mesh.indices.size();
+				}
+			}
+
+			append_( log, " - 16-bit indices: %zu of %zu meshes => %zu kB saved\n", smallMeshes, indexed.size(), smallIndices*sizeof(std::uint16_t)/1024 );
+		}
+
+		if( aOptions.lods )
+		{
+			std::size_t lodIndices[kLodCount] = {}, lodMeshes[kLodCount] = {};
+			float maxError[kLodCount] = {};
+
+			for( auto const& meshLods : lods )
+			{
+				for( std::size_t i = 0; i < meshLods.size(); ++i )
+				{
+					++lodMeshes[i];
+					lodIndices[i] += meshLods[i].indices.size();
+					maxError[i] = std::max( maxError[i], meshLods[i].error );
+				}
+			}
+
+			for( std::uint32_t i = 0; i < kLodCount; ++i )
+				append_( log, " - LOD %u: %zu meshes, %zu triangles, max. error %g\n", i+1, lodMeshes[i], lodIndices[i]/3, double(maxError[i]) );
+		}
+
+		if( aOptions.meshlets )
+		{
+			std::size_t meshletCount = 0, meshletVertices = 0, meshletTriangles = 0;
+			for( auto const& data : meshlets )
+			{
+				meshletCount += data.meshlets.size();
+				meshletVertices += data.vertices.size();
+				meshletTriangles += data.triangles.size() / 3;
+			}
+
+			std::size_t const denom = std::max( meshletCount, std::size_t(1) );
+			append_( log, " - meshlets: %zu, avg. %.1f vertices and %.1f triangles\n", meshletCount, double(meshletVertices)/denom, double(meshletTriangles)/denom );
+		}
+
+		// BVH over the mesh bounds; cheap enough to always build
+		BakedBvh bvh;
+		{
+			std::vector<glm::vec3> mins, maxs;
+			for( auto const& imesh : indexed )
+			{
+				bool const empty = imesh.indices.empty();
+				mins.emplace_back( empty ? glm::vec3( 1.f ) : imesh.aabbMin );
+				maxs.emplace_back( empty ? glm::vec3( 0.f ) : imesh.aabbMax );
+			}
+
+			bvh = build_bvh( mins, maxs );
+			append_( log, " - BVH: %zu nodes over %zu meshes\n", bvh.nodes.size(), bvh.primitives.size() );
+		}
+
+		// Potentially visible sets. Cells are independent; each job writes
+		// only its own bitset.
+		BakedPvs pvs;
+		if( aOptions.pvsCellSize > 0.f )
+		{
+			auto const pvsStart = Clock_::now();
+
+			auto const voxels = voxelize_for_pvs( indexed, aOptions.pvsCellSize );
+			pvs = voxels.cells;
+
+			std::size_t const cellCount = std::size_t(pvs.dims[0]) * pvs.dims[1] * pvs.dims[2];
+			pvs.bits.assign( cellCount * pvs.rowBytes, 0 );
+			parallel_for_( cellCount, aJobs, [&] (std::size_t aCell) {
+				compute_cell_pvs( voxels, aCell, pvs.bits.data() + aCell * pvs.rowBytes );
+			} );
+
+			std::size_t visible = 0;
+			for( auto byte : pvs.bits )
+			{
+				for( ; byte; byte &= std::uint8_t(byte - 1) )
+					++visible;
+			}
+
+			append_( log, " - PVS: %u x %u x %u cells of %g units, avg. %.1f of %zu meshes visible (%.0f ms)\n", pvs.dims[0], pvs.dims[1], pvs.dims[2], double(pvs.cellSize), double(visible)/double(std::max( cellCount, std::size_t(1) )), indexed.size(), ms_since_( pvsStart ) );
+		}
+
+		// Ambient occlusion of every vertex against all triangles of the
+		// model, in chunks of vertices; each job writes only its own.
+		std::vector<std::vector<std::uint8_t>> occlusion;
+		if( aOptions.occlusionDistance > 0.f )
+		{
+			auto const aoStart = Clock_::now();
+
+			auto const scene = build_occlusion_scene( indexed );
+
+			constexpr std::size_t kChunk = 1024;
+			std::vector<std::pair<std::size_t,std::size_t>> chunks; // mesh, first vertex
+			occlusion.resize( indexed.size() );
+			for( std::size_t m = 0; m < indexed.size(); ++m )
+			{
+				occlusion[m].resize( indexed[m].vert.size() );
+				for( std::size_t v = 0; v < indexed[m].vert.size(); v += kChunk )
+					chunks.emplace_back( m, v );
+			}
+
+			parallel_for_( chunks.size(), aJobs, [&] (std::size_t aChunk) {
+				auto const [mesh, first] = chunks[aChunk];
+				auto const count = std::min( kChunk, indexed[mesh].vert.size() - first );
+				bake_vertex_occlusion( scene, indexed[mesh], first, count, aOptions.occlusionDistance, occlusion[mesh].data() + first );
+			} );
+
+			double sum = 0.;
+			std::size_t vertices = 0;
+			for( auto const& values : occlusion )
+			{
+				for( auto const value : values )
+					sum += value / 255.;
+				vertices += values.size();
+			}
+
+			append_( log, " - ambient occlusion: %zu vertices, %u rays each, avg. %.2f open (%.0f ms)\n", vertices, kOcclusionRays, sum / double(std::max( vertices, std::size_t(1) )), ms_since_( aoStart ) );
+		}
+
+		// Flat textures become material constants. They're still inputs.
+		auto const folded = fold_constant_textures_( model, aJobs );
+		for( auto const& path : folded )
+		{
+			if( aCache.enabled() )
+				stamp.inputs.emplace_back( aCache.file_hash( path ), path );
+		}
+
+		if( !folded.empty() )
+			append_( log, " - constant textures: %zu folded into materials\n", folded.size() );
+
+		// Find list of unique textures
+		auto& textures = aState.textures;
+		textures = new_paths_( find_unique_textures_( model ), aState.texdir, aOptions.textures );
+
+		append_( log, " - unique textures: %zu\n", textures.size() );
+
+		std::uint64_t const textureBytes = fit_texture_budget_( textures, aOptions );
+		std::size_t capped = 0;
+		for( auto const& entry : textures )
+			capped += entry.second.maxSize > 0;
+
+		if( aOptions.textureBudget > 0 )
+			append_( log, " - texture memory: %ju kB, budget %ju kB (%zu textures capped)\n", std::uintmax_t(textureBytes/1024), std::uintmax_t(aOptions.textureBudget/1024), capped );
+		else
+			append_( log, " - texture memory: %ju kB (%zu textures capped)\n", std::uintmax_t(textureBytes/1024), capped );
+
+		// Ensure output directories exist
+		std::filesystem::create_directories( aState.rootdir / aState.texdir );
+
+		// Impostors: each mesh is rendered into its two atlases, which are
+		// baked right away (they have no source images). They're listed
+		// after the model's textures; only their existence is stamped.
+		BakedImpostors impostors;
+		std::unordered_map<std::string,TextureInfo_> allTextures = textures;
+		if( aOptions.impostorSize > 0 )
+		{
+			auto const impostorStart = Clock_::now();
+
+			// Decoded once per material
+			std::vector<ImpostorMaterial> materials( model.materials.size() );
+			std::vector<std::string> materialErrors( model.materials.size() );
+			parallel_for_( model.materials.size(), aJobs, [&] (std::size_t aMaterial) {
+				try
+				{
+					materials[aMaterial] = load_impostor_material( model.materials[aMaterial] );
+				}
+				catch( lut::Error const& eErr )
+				{
+					materials[aMaterial].constant = glm::vec4( model.materials[aMaterial].baseColor, 1.f );
+					materialErrors[aMaterial] = eErr.what();
+				}
+			} );
+
+			for( auto const& error : materialErrors )
+			{
+				if( !error.empty() )
+					append_( log, " - impostors: %s; using the base color\n", error.c_str() );
+			}
+
+			bool const compress = ETextureOutput_::compressed == aOptions.textures;
+			auto const stem = mainpath.stem().string();
+			auto const texture_ = [&] (std::size_t aMesh, char const* aName, ETextureKind aKind) {
+				TextureInfo_ info{};
+				info.uniqueId = std::uint32_t(allTextures.size());
+				info.channels = 4;
+				info.kind = aKind;
+				info.newPath = (aState.texdir / (stem + "-impostor-" + std::to_string( aMesh ) + "-" + aName + kBakedTextureExtension)).string();
+				info.format = texture_format( aKind, compress );
+				return info;
+			};
+
+			impostors.grid = kImpostorGrid;
+			impostors.meshes.resize( indexed.size() );
+
+			std::vector<TextureInfo_> albedos( indexed.size() ), normalDepths( indexed.size() );
+			for( std::size_t m = 0; m < indexed.size(); ++m )
+			{
+				if( indexed[m].indices.empty() )
+					continue;
+
+				albedos[m] = texture_( m, "albedo", ETextureKind::baseColor );
+				allTextures.emplace( "impostor\n" + std::to_string( m ) + "\nalbedo", albedos[m] );
+				normalDepths[m] = texture_( m, "normal-depth", ETextureKind::linearColor );
+				allTextures.emplace( "impostor\n" + std::to_string( m ) + "\nnormal-depth", normalDepths[m] );
+
+				impostors.meshes[m].albedo = albedos[m].uniqueId;
+				impostors.meshes[m].normalDepth = normalDepths[m].uniqueId;
+			}
+
+			parallel_for_( indexed.size(), aJobs, [&] (std::size_t aMesh) {
+				if( indexed[aMesh].indices.empty() )
+					return;
+
+				auto const atlases = render_impostor( indexed[aMesh], materials[model.meshes[aMesh].materialIndex], aOptions.impostorSize );
+				impostors.meshes[aMesh].centre = atlases.centre;
+				impostors.meshes[aMesh].radius = atlases.radius;
+
+				bake_texture_texels( atlases.albedo.data(), atlases.size, atlases.size, (aState.rootdir / albedos[aMesh].newPath).string().c_str(), ETextureKind::baseColor, compress, aOptions.mipFilter );
+				bake_texture_texels( atlases.normalDepth.data(), atlases.size, atlases.size, (aState.rootdir / normalDepths[aMesh].newPath).string().c_str(), ETextureKind::linearColor, compress, aOptions.mipFilter );
+			} );
+
+			for( std::size_t m = 0; m < indexed.size(); ++m )
+			{
+				if( indexed[m].indices.empty() )
+					continue;
+
+				stamp.textures[albedos[m].newPath] = 0;
+				stamp.textures[normalDepths[m].newPath] = 0;
+			}
+
+			std::uint32_t const atlasSize = kImpostorGrid * aOptions.impostorSize;
+			append_( log, " - impostors: %zu meshes, %u x %u views, %u x %u atlases (%.0f ms)\n", indexed.size(), kImpostorGrid, kImpostorGrid, atlasSize, atlasSize, ms_since_( impostorStart ) );
+		}
+
+		// Output mesh data. Via a temporary file and a rename, so that
+		// readers (e.g., a running cw2 that reloads it) never see a partial
+		// file, and a failed bake leaves the previous one in place.
+		auto const writeStart = Clock_::now();
+
+		auto tmppath = mainpath;
+		tmppath += ".tmp";
+
+		FILE* fof = std::fopen( tmppath.string().c_str(), "wb" );
+		if( !fof )
+			throw lut::Error( "Unable to open '%s' for writing", tmppath.string().c_str() );
+
+		std::setvbuf( fof, nullptr, _IONBF, 0 ); // BlockWriter_ buffers
+
+		try
+		{
+			BlockWriter_ writer( fof );
+			write_model_data_( writer, model, indexed, allTextures, aOptions.layout, aOptions.smallIndices, meshlets, lods, bvh, pvs, occlusion, impostors, aOptions.toc, aOptions.wideCounts, aOptions.compressMeshes );
+			writer.finish();
+
+			if( 0 != std::fclose( std::exchange( fof, nullptr ) ) )
+				throw lut::Error( "Writing '%s' failed", tmppath.string().c_str() );
+
+			std::filesystem::rename( tmppath, mainpath );
+		}
+		catch( ... )
+		{
+			if( fof )
+				std::fclose( fof );
+
+			std::error_code ec;
+			std::filesystem::remove( tmppath, ec );
+			throw;
+		}
+
+		times.write = ms_since_( writeStart );
+
+		// Pack contents, in the order the model lists them (see
+		// process_models_())
+		if( aOptions.texturePack )
+		{
+			std::vector<TextureInfo_ const*> ordered( allTextures.size() );
+			for( auto const& entry : allTextures )
+				ordered[entry.second.uniqueId] = &entry.second;
+
+			for( auto const* info : ordered )
+				aState.packNames.emplace_back( std::filesystem::path( info->newPath ).lexically_relative( aState.texdir ).generic_string() );
+		}
+
+		std::error_code ec;
+		if( auto const bytes = std::filesystem::file_size( mainpath, ec ); !ec )
+			append_( log, " - file size: %ju kB\n", std::uintmax_t(bytes/1024) );
+
+		// Only textures whose source, kind or settings changed (or whose
+		// output is missing) are redone. Sources that can't be read are
+		// passed on, so that the bake reports them.
+		auto& stale = aState.staleTextures;
+		for( auto const& entry : textures )
+		{
+			if( !aCache.enabled() )
+			{
+				stale.emplace_back( entry );
+				continue;
+			}
+
+			// Empty sources (of packed textures) hash as 0
+			ContentHasher hasher;
+			std::vector<std::pair<ContentHash,std::string>> inputs;
+			try
+			{
+				for( auto const& source : entry.second.sources )
+				{
+					ContentHash const sourceHash = source.empty() ? 0 : aCache.file_hash( source );
+					hasher.add_value( sourceHash );
+					if( !source.empty() )
+						inputs.emplace_back( sourceHash, source );
+				}
+			}
+			catch( lut::Error const& )
+			{
+				stale.emplace_back( entry );
+				aState.complete = false;
+				continue;
+			}
+
+			auto const kind = entry.second.kind;
+			hasher.add_value( kind );
+			hasher.add_value( aOptions.textures );
+			hasher.add_value( aOptions.mipFilter );
+			hasher.add_value( entry.second.maxSize );
+			auto const key = hasher.value();
+
+			stamp.inputs.insert( stamp.inputs.end(), inputs.begin(), inputs.end() );
+			stamp.textures[entry.second.newPath] = key;
+
+			auto const it = previous.textures.find( entry.second.newPath );
+			if( it == previous.textures.end() || it->second != key || !std::filesystem::exists( aState.rootdir / entry.second.newPath ) )
+				stale.emplace_back( entry );
+		}
+
+		if( aCache.enabled() )
+			append_( log, " - textures up to date: %zu of %zu\n", textures.size() - stale.size(), textures.size() );
+
+		append_( log, " - times: parse %.1f, index %.1f, tangents %.1f, optimize %.1f, LODs %.1f, meshlets %.1f, write %.1f ms\n", times.parse, times.index, times.tangents, times.optimize, times.lods, times.meshlets, times.write );
+	}
+
+	bool up_to_date_( BakeCache& aCache, BakeCache::Stamp const& aStamp, ContentHash aOptions, std::filesystem::path const& aMainPath, std::filesystem::path const& aRootDir )
+	{
+		if( aStamp.options != aOptions || !std::filesystem::exists( aMainPath ) )
+			return false;
+
+		for( auto const& [hash, path] : aStamp.inputs )
+		{
+			try
+			{
+				if( aCache.file_hash( path ) != hash )
+					return false;
+			}
+			catch( lut::Error const& )
+			{
+				return false;
+			}
+		}
+
+		for( auto const& entry : aStamp.textures )
+		{
+			if( !std::filesystem::exists( aRootDir / entry.first ) )
+				return false;
+		}
+
+		return true;
+	}
+
+	std::vector<ModelJob_> read_manifest_( char const* aPath )
+	{
+		std::ifstream in( aPath );
+		if( !in )
+			throw lut::Error( "Unable to open manifest '%s'", aPath );
+
+		std::vector<ModelJob_> ret;
+
+		std::string line;
+		for( std::size_t lineNumber = 1; std::getline( in, line ); ++lineNumber )
+		{
+			std::istringstream fields( line );
+
+			ModelJob_ job;
+			if( !(fields >> job.input) || '#' == job.input[0] )
+				continue;
+
+			std::string extra;
+			if( !(fields >> job.output) || (fields >> extra) )
+				throw lut::Error( "%s:%zu: expected 'INPUT OUTPUT'", aPath, lineNumber );
+
+			ret.emplace_back( std::move(job) );
+		}
+
+		if( in.bad() )
+			throw lut::Error( "Reading manifest '%s' failed", aPath );
+
+		return ret;
+	}
+
+	void append_( std::string& aLog, char const* aFormat, ... )
+	{
+		va_list args, copy;
+		va_start( args, aFormat );
+		va_copy( copy, args );
+
+		int const length = std::vsnprintf( nullptr, 0, aFormat, copy );
+		va_end( copy );
+
+		if( length > 0 )
+		{
+			auto const offset = aLog.size();
+			aLog.resize( offset + std::size_t(length) + 1 );
+			std::vsnprintf( aLog.data() + offset, std::size_t(length) + 1, aFormat, args );
+			aLog.resize( offset + std::size_t(length) );
+		}
+
+		va_end( args );
+	}
+
+	double ms_since_( Clock_::time_point aStart )
+	{
+		return std::chrono::duration<double,std::milli>( Clock_::now() - aStart ).count();
+	}
+
+	StageTimes_& StageTimes_::operator+=( StageTimes_ const& aOther )
+	{
+		parse += aOther.parse;
+		index += aOther.index;
+		tangents += aOther.tangents;
+		optimize += aOther.optimize;
+		lods += aOther.lods;
+		meshlets += aOther.meshlets;
+		write += aOther.write;
+		return *this;
+	}
+}
+
+namespace
+{
+	std::size_t produce_textures_( std::vector<TextureWork_>& aWork, ETextureOutput_ aOutput, EMipFilter aMipFilter, unsigned aJobs )
+	{
+		// Encoding is by far the slowest part of the bake; spread the
+		// textures over the jobs. Only out-of-date textures get here (see
+		// bake_model_()), so existing files are overwritten.
+		std::atomic<std::size_t> errors{ 0 }, linked{ 0 };
+		parallel_for_( aWork.size(), aJobs, [&] (std::size_t aItem) {
+			LUT_CPU_ZONE( "produce texture" );
+			auto& item = aWork[aItem];
+			auto const& first = item.destinations.front();
+
+			bool const compress = ETextureOutput_::compressed == aOutput;
+
+			bool ok = true;
+			try
+			{
+				if( ETextureKind::roughnessMetalness == item.kind )
+				{
+					auto const source_ = [&] (std::size_t aIndex) { return item.sources[aIndex].empty() ? nullptr : item.sources[aIndex].c_str(); };
+					bake_packed_texture( source_( 0 ), source_( 1 ), first.string().c_str(), compress, aMipFilter, item.maxSize );
+				}
+				else
+					bake_texture( item.sources.front().c_str(), first.string().c_str(), item.kind, compress, aMipFilter, item.maxSize );
+			}
+			catch( std::exception const& eErr )
+			{
+				ok = false;
+				std::fprintf( stderr, "bake_texture(): '%s' failed: %s\n", first.string().c_str(), eErr.what() );
+			}
+
+			// Other models get a copy of the first output
+			item.failed.assign( item.destinations.size(), !ok );
+			for( std::size_t i = 1; ok && i < item.destinations.size(); ++i )
+			{
+				auto const copy = copy_texture_( first, item.destinations[i] );
+				item.failed[i] = ETextureCopy_::failed == copy;
+				linked += ETextureCopy_::reflink == copy || ETextureCopy_::hardlink == copy;
+			}
+
+			for( bool const failed : item.failed )
+				errors += failed;
+		} );
+
+		std::size_t total = 0;
+		for( auto const& item : aWork )
+			total += item.destinations.size();
+
+		std::printf( "Baked %zu textures out of %zu%s", total-errors, total, ETextureOutput_::compressed == aOutput ? "" : " (uncompressed)" );
+		if( linked )
+			std::printf( ", %zu shared by links", std::size_t(linked) );
+		std::printf( ".\n" );
+		return errors;
+	}
+
+	ETextureCopy_ copy_texture_( std::filesystem::path const& aFrom, std::filesystem::path const& aTo )
+	{
+		// Each way creates a temporary and renames it over aTo, so that aTo
+		// is replaced in one step (and a link to aTo itself is left alone)
+		auto tmp = aTo;
+		tmp += ".tmp";
+
+		std::error_code ec;
+		std::filesystem::remove( tmp, ec );
+
+		auto const replace_ = [&] (ETextureCopy_ aHow) {
+			std::filesystem::rename( tmp, aTo, ec );
+			if( !ec )
+				return aHow;
+
+			std::filesystem::remove( tmp, ec );
+			return ETextureCopy_::failed;
+		};
+
+#		if defined(__linux__) && defined(FICLONE)
+		if( int const in = ::open( aFrom.c_str(), O_RDONLY | O_CLOEXEC ); in >= 0 )
+		{
+			int const out = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+			bool const cloned = out >= 0 && 0 == ::ioctl( out, FICLONE, in );
+			if( out >= 0 )
+				::close( out );
+			::close( in );
+
+			if( cloned )
+				return replace_( ETextureCopy_::reflink );
+
+			std::filesystem::remove( tmp, ec );
+		}
+#		endif // ~ __linux__ && FICLONE
+
+		std::filesystem::create_hard_link( aFrom, tmp, ec );
+		if( !ec )
+			return replace_( ETextureCopy_::hardlink );
+
+		if( std::filesystem::copy_file( aFrom, tmp, std::filesystem::copy_options::overwrite_existing, ec ) )
+		{
+			if( auto const ret = replace_( ETextureCopy_::copy ); ETextureCopy_::failed != ret )
+				return ret;
+		}
+
+		std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", aTo.string().c_str(), ec.message().c_str(), ec.category().name() );
+		return ETextureCopy_::failed;
+	}
+}
+
+namespace
+{
+	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	{
+		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+
+		if( ret != aBytes )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+	}
+	void checked_write_( BlockWriter_& aOut, std::size_t aBytes, void const* aData )
+	{
+		aOut.write( aData, aBytes );
+	}
+
+	void write_string_( BlockWriter_& aOut, char const* aString )
+	{
+		// Write a string
+		// Format:
+		//  - uint32_t : N = length of string in bytes, including terminating '\0'
+		//  - N x char : string
+		std::uint32_t const length = std::uint32_t(std::strlen(aString)+1);
+		checked_write_( aOut, sizeof(std::uint32_t), &length );
+
+		checked_write_( aOut, length, aString );
+	}
+
+	std::vector<std::uint8_t> pack_( void const* aData, std::size_t aBytes )
+	{
+		auto packed = lut::lz4_compress( aData, aBytes );
+		if( packed.size() < aBytes )
+			return packed;
+
+		auto const* bytes = static_cast<std::uint8_t const*>(aData);
+		return std::vector<std::uint8_t>( bytes, bytes + aBytes );
+	}
+
+	std::uint64_t tell_( BlockWriter_ const& aOut )
+	{
+		return aOut.tell();
+	}
+	// 64-bit positions also where long isn't (Windows)
+	bool seek_( FILE* aOut, std::int64_t aOffset, int aOrigin )
+	{
+#		if defined(_WIN32)
+		return 0 == _fseeki64( aOut, aOffset, aOrigin );
+#		else
+		return 0 == fseeko( aOut, off_t(aOffset), aOrigin );
+#		endif
+	}
+
+	void write_count_( BlockWriter_& aOut, std::uint64_t aCount, bool aWide )
+	{
+		if( aWide )
+		{
+			checked_write_( aOut, sizeof(aCount), &aCount );
+			return;
+		}
+
+		if( aCount > std::numeric_limits<std::uint32_t>::max() )
+			throw lut::Error( "count or size %llu needs 64 bits; bake with --64bit-counts", static_cast<unsigned long long>(aCount) );
+
+		std::uint32_t const count = std::uint32_t(aCount);
+		checked_write_( aOut, sizeof(count), &count );
+	}
+
+	void write_padding_( BlockWriter_& aOut, std::size_t aAlign )
+	{
+		auto const pos = tell_( aOut );
+
+		static constexpr char zeros[kInterleavedAlign] = {};
+		assert( aAlign <= sizeof(zeros) );
+
+		auto const rem = std::size_t(pos) % aAlign;
+		if( rem )
+			checked_write_( aOut, aAlign - rem, zeros );
+	}
+
+	void write_model_data_( BlockWriter_& aOut, InputModel const& aModel, std::vector<IndexedMesh> const& aIndexedMeshes, std::unordered_map<std::string,TextureInfo_> const& aTextures, EVertexLayout_ aLayout, bool aSmallIndices, std::vector<MeshletData> const& aMeshlets, std::vector<std::vector<MeshLod>> const& aLods, BakedBvh const& aBvh, BakedPvs const& aPvs, std::vector<std::vector<std::uint8_t>> const& aOcclusion, BakedImpostors const& aImpostors, bool aToc, bool aWide, bool aCompress )
+	{
+		assert( !aCompress || EVertexLayout_::bounds == aLayout || EVertexLayout_::quantized == aLayout );
+
+		// Write header
+		// Format:
+		//   - char[16] : file magic
+		//   - char[16] : file variant ID
+		//   - "scsmbil-toc" and "scsmbil-t64":
+		//     - char[16] : variant ID of the content
+		assert( aToc || !aWide );
+		checked_write_( aOut, sizeof(char)*16, kFileMagic );
+		if( aToc )
+			checked_write_( aOut, sizeof(char)*16, aWide ? kFileVariantToc64 : kFileVariantToc );
+
+		switch( aLayout )
+		{
+			case EVertexLayout_::separate: checked_write_( aOut, sizeof(char)*16, kFileVariant ); break;
+			case EVertexLayout_::interleaved: checked_write_( aOut, sizeof(char)*16, kFileVariantInterleaved ); break;
+			case EVertexLayout_::bounds: checked_write_( aOut, sizeof(char)*16, aCompress ? kFileVariantBoundsLz4 : aSmallIndices ? kFileVariantBounds16 : kFileVariantBounds ); break;
+			case EVertexLayout_::quantized: checked_write_( aOut, sizeof(char)*16, aCompress ? kFileVariantQuantizedLz4 : aSmallIndices ? kFileVariantQuantized16 : kFileVariantQuantized ); break;
+		}
+		
+		// Write list of unique textures
+		// Format:
+		//  - unit32_t : U = number of unique textures
+		//  - repeat U times:
+		//    - string : path to texture 
+		//    - uint8_t : number of channels in texture (2: roughness in R,
+		//                metalness in G)
+		std::vector<TextureInfo_ const*> orderedUnqiue( aTextures.size() );
+		for( auto const& tex : aTextures )
+		{
+			assert( !orderedUnqiue[tex.second.uniqueId] );
+			orderedUnqiue[tex.second.uniqueId] = &tex.second;
+		}
+
+		std::uint32_t const textureCount = std::uint32_t(orderedUnqiue.size());
+		std::uint32_t const materialCount = std::uint32_t(aModel.materials.size());
+		std::uint32_t const meshCount = std::uint32_t(aModel.meshes.size());
+
+		// Write table of contents ("scsmbil-toc" and "scsmbil-t64" only)
+		// Format:
+		//  - uint32_t : U = number of textures (uint64_t in "scsmbil-t64",
+		//    and so are M and N)
+		//  - uint32_t : M = number of materials
+		//  - uint32_t : N = number of meshes
+		//  - repeat U times: chunk of the texture's record (path and channels)
+		//  - repeat M times: chunk of the material
+		//  - repeat N times:
+		//    - chunk of the mesh (from its material index to its indices)
+		//    - chunk of the mesh's meshlets (counts and arrays), or 0, 0
+		//    - chunk of the mesh's LODs (count and LODs), or 0, 0
+		//  - chunk of the material constants (count and constants), or 0, 0
+		// Chunk:
+		//  - uint64_t : absolute file offset
+		//  - uint64_t : size in bytes
+		// The TOC is written with zeros first, and filled in at the end.
+		std::vector<TocChunk_> toc;
+		std::uint64_t tocOffset = 0;
+		if( aToc )
+		{
+			for( std::uint64_t const count : { textureCount, materialCount, meshCount } )
+				write_count_( aOut, count, aWide );
+
+			tocOffset = tell_( aOut );
+			toc.resize( textureCount + materialCount + 3*std::size_t(meshCount) + 1 );
+			checked_write_( aOut, sizeof(TocChunk_)*toc.size(), toc.data() );
+		}
+
+		TocChunk_* const textureChunks = toc.data();
+		TocChunk_* const materialChunks = textureChunks + (aToc ? textureCount : 0);
+		TocChunk_* const meshChunks = materialChunks + (aToc ? materialCount : 0);
+		TocChunk_* const constantsChunk = meshChunks + (aToc ? 3*std::size_t(meshCount) : 0);
+
+		auto const begin_chunk_ = [&] (TocChunk_* aChunk) {
+			if( aToc )
+				aChunk->offset = tell_( aOut );
+		};
+		auto const end_chunk_ = [&] (TocChunk_* aChunk) {
+			if( aToc )
+				aChunk->size = tell_( aOut ) - aChunk->offset;
+		};
+
+		checked_write_( aOut, sizeof(textureCount), &textureCount );
+
+		for( std::size_t i = 0; i < orderedUnqiue.size(); ++i )
+		{
+			auto const* tex = orderedUnqiue[i];
+			assert( tex );
+
+			begin_chunk_( textureChunks + i );
+			write_string_( aOut, tex->newPath.c_str() );
+
+			std::uint8_t channels = tex->channels;
+			checked_write_( aOut, sizeof(channels), &channels );
+			end_chunk_( textureChunks + i );
+		}
+
+		// Write material information
+		// Format:
+		//  - uint32_t : M = number of materials
+		//  - repeat M times:
+		//    - uin32_t : base color texture index
+		//    - uin32_t : roughness texture index
+		//    - uin32_t : metalness texture index
+		//    - uin32_t : alphaMask texture index (or 0xffffffff if none)
+		//    - uin32_t : normalMap texture index (or 0xffffffff if none)
+		// Base color, roughness and metalness may be 0xffffffff as well; see
+		// the material constants below. Roughness and metalness refer to
+		// the same, packed texture. The alpha mask is a one-channel alpha
+		// coverage texture, separate from the base color's.
+		checked_write_( aOut, sizeof(materialCount), &materialCount );
+
+		for( std::size_t i = 0; i < aModel.materials.size(); ++i )
+		{
+			auto const& mat = aModel.materials[i];
+			auto const write_tex_ = [&] (std::string const& aTexturePath ) {
+				if( aTexturePath.empty() )
+				{
+					static constexpr std::uint32_t sentinel = ~std::uint32_t(0);
+					checked_write_( aOut, sizeof(std::uint32_t), &sentinel );
+					return;
+				}
+
+				auto const it = aTextures.find( aTexturePath );
+				assert( aTextures.end() != it );
+
+				checked_write_( aOut, sizeof(std::uint32_t), &it->second.uniqueId );
+			};
+
+			auto const packed = packed_key_( mat );
+
+			begin_chunk_( materialChunks + i );
+			write_tex_( mat.baseColorTexturePath );
+			write_tex_( mat.roughnessTexturePath.empty() ? std::string() : packed );
+			write_tex_( mat.metalnessTexturePath.empty() ? std::string() : packed );
+			write_tex_( alpha_key_( mat ) );
+			write_tex_( mat.normalMapTexturePath );
+			end_chunk_( materialChunks + i );
+		}
+
+		// Write mesh data
+		// Format:
+		//  - uint32_t : M = number of meshes
+		//  - repeat M times:
+		//    - uint32_t : material index
+		//    - uint32_t : V = number of vertices (uint64_t in "scsmbil-t64")
+		//    - uint32_t : I = number of indices (uint64_t in "scsmbil-t64")
+		//    - "scsmbil-b16", "scsmbil-q16", "scsmbil-lzb" and "scsmbil-lzq":
+		//      - uint32_t : S = size of an index in bytes (2 or 4)
+		//    - "scsmbil-tan":
+		//      - repeat V times: vec3 position
+		//      - repeat V times: vec3 normal
+		//      - repeat V times: vec2 texture coordinate
+		//      - repeat V times: vec4 tangent
+		//    - all but "scsmbil-tan" and "scsmbil-ilv":
+		//      - vec3 : AABB min
+		//      - vec3 : AABB max
+		//    - "scsmbil-lzb" and "scsmbil-lzq" (instead of the rest):
+		//      - uint32_t : vertex array bytes (uncompressed)
+		//      - uint32_t : CV = stored vertex array bytes
+		//      - uint32_t : index array bytes (uncompressed)
+		//      - uint32_t : CI = stored index array bytes
+		//      (all four uint64_t in "scsmbil-t64")
+		//      - CV bytes : vertex array as in "scsmbil-b16"/"-q16"; a LZ4
+		//        block, or the array itself if CV is its uncompressed size
+		//      - CI bytes : index array, same
+		//    - all but "scsmbil-tan":
+		//      - zero padding up to the next 16-byte aligned file offset
+		//    - "scsmbil-ilv", "scsmbil-box" and "scsmbil-b16":
+		//      - repeat V times: vec3 position, vec2 texcoord, vec3 normal, vec4 tangent
+		//    - "scsmbil-qnt" and "scsmbil-q16":
+		//      - repeat V times: QuantizedVertex
+		//    - repeat I times: uint32_t index, or uint16_t if S = 2
+		checked_write_( aOut, sizeof(meshCount), &meshCount );
+
+		assert( aModel.meshes.size() == aIndexedMeshes.size() );
+		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+		{
+			auto const& mmesh = aModel.meshes[i];
+			begin_chunk_( meshChunks + 3*i );
+
+			std::uint32_t materialIndex = std::uint32_t(mmesh.materialIndex);
+			checked_write_( aOut, sizeof(materialIndex), &materialIndex );
+
+			auto const& imesh = aIndexedMeshes[i];
+
+			write_count_( aOut, imesh.vert.size(), aWide );
+			write_count_( aOut, imesh.indices.size(), aWide );
+			std::uint32_t const vertexCount = std::uint32_t(imesh.vert.size());
+			std::uint32_t const indexCount = std::uint32_t(imesh.indices.size());
+
+			bool const boundsLayout = EVertexLayout_::bounds == aLayout || EVertexLayout_::quantized == aLayout;
+			bool const withIndexSize = (aSmallIndices || aCompress) && boundsLayout;
+			bool const smallIndices = aSmallIndices && boundsLayout && vertexCount <= kMaxVerticesForSmallIndices;
+			if( withIndexSize )
+			{
+				std::uint32_t const indexSize = smallIndices ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+				checked_write_( aOut, sizeof(indexSize), &indexSize );
+			}
+
+			if( boundsLayout )
+			{
+				checked_write_( aOut, sizeof(glm::vec3), &imesh.aabbMin );
+				checked_write_( aOut, sizeof(glm::vec3), &imesh.aabbMax );
+			}
+
+			// Vertex and index arrays as stored ("scsmbil-tan" writes the
+			// attributes separately, below)
+			std::vector<QuantizedVertex> quantized;
+			std::vector<InterleavedVertex> interleaved;
+			void const* vertices = nullptr;
+			std::size_t vertexBytes = 0;
+			if( EVertexLayout_::quantized == aLayout )
+			{
+				quantized.resize( vertexCount );
+				for( std::size_t v = 0; v < vertexCount; ++v )
+					quantized[v] = quantize_vertex( imesh.vert[v], imesh.text[v], imesh.norm[v], imesh.tangent[v], imesh.aabbMin, imesh.aabbMax );
+
+				vertices = quantized.data();
+				vertexBytes = sizeof(QuantizedVertex)*quantized.size();
+			}
+			else if( EVertexLayout_::separate != aLayout )
+			{
+				interleaved.resize( vertexCount );
+				for( std::size_t v = 0; v < vertexCount; ++v )
+					interleaved[v] = InterleavedVertex{ imesh.vert[v], imesh.text[v], imesh.norm[v], imesh.tangent[v] };
+
+				vertices = interleaved.data();
+				vertexBytes = sizeof(InterleavedVertex)*interleaved.size();
+			}
+
+			std::vector<std::uint16_t> indices16;
+			void const* indices = imesh.indices.data();
+			std::size_t indexBytes = sizeof(std::uint32_t)*indexCount;
+			if( smallIndices )
+			{
+				indices16.assign( imesh.indices.begin(), imesh.indices.end() );
+				indices = indices16.data();
+				indexBytes = sizeof(std::uint16_t)*indexCount;
+			}
+
+			if( aCompress )
+			{
+				// The uncompressed sizes are implied by the counts, but
+				// loaders can size their buffers without knowing the layout.
+				auto const packedVertices = pack_( vertices, vertexBytes );
+				auto const packedIndices = pack_( indices, indexBytes );
+
+				for( std::uint64_t const size : { std::uint64_t(vertexBytes), std::uint64_t(packedVertices.size()), std::uint64_t(indexBytes), std::uint64_t(packedIndices.size()) } )
+					write_count_( aOut, size, aWide );
+
+				checked_write_( aOut, packedVertices.size(), packedVertices.data() );
+				checked_write_( aOut, packedIndices.size(), packedIndices.data() );
+			}
+			else
+			{
+				if( vertices )
+				{
+					write_padding_( aOut, kInterleavedAlign );
+					checked_write_( aOut, vertexBytes, vertices );
+				}
+				else
+				{
+					checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
+					checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.norm.data() );
+					checked_write_( aOut, sizeof(glm::vec2)*vertexCount, imesh.text.data() );
+					checked_write_( aOut, sizeof(glm::vec4)*vertexCount, imesh.tangent.data());
+				}
+
+				checked_write_( aOut, indexBytes, indices );
+			}
+
+			end_chunk_( meshChunks + 3*i );
+		}
+
+		// Write meshlets (optional)
+		// Format:
+		//  - char[16] : section ID "scsmbil-mlt"
+		//  - uint32_t : M = number of meshes (same as above)
+		//  - repeat M times:
+		//    - uint32_t : L = number of meshlets
+		//    - uint32_t : V = number of meshlet vertices
+		//    - uint32_t : T = number of local indices (3 per triangle)
+		//    - repeat L times: BakedMeshlet
+		//    - repeat V times: uint32_t mesh-relative vertex index
+		//    - repeat T times: uint8_t index into the meshlet's vertices
+		if( !aMeshlets.empty() )
+		{
+			assert( aMeshlets.size() == aIndexedMeshes.size() );
+			checked_write_( aOut, sizeof(char)*16, kMeshletSectionId );
+			checked_write_( aOut, sizeof(meshCount), &meshCount );
+
+			for( std::size_t i = 0; i < aMeshlets.size(); ++i )
+			{
+				auto const& data = aMeshlets[i];
+				begin_chunk_( meshChunks + 3*i + 1 );
+
+				std::uint32_t const counts[3] = {
+					std::uint32_t(data.meshlets.size()),
+					std::uint32_t(data.vertices.size()),
+					std::uint32_t(data.triangles.size())
+				};
+				checked_write_( aOut, sizeof(counts), counts );
+
+				checked_write_( aOut, sizeof(BakedMeshlet)*data.meshlets.size(), data.meshlets.data() );
+				checked_write_( aOut, sizeof(std::uint32_t)*data.vertices.size(), data.vertices.data() );
+				checked_write_( aOut, sizeof(std::uint8_t)*data.triangles.size(), data.triangles.data() );
+				end_chunk_( meshChunks + 3*i + 1 );
+			}
+		}
+
+		// Write LODs (optional)
+		// Format:
+		//  - char[16] : section ID "scsmbil-lod"
+		//  - uint32_t : M = number of meshes (same as above)
+		//  - repeat M times:
+		//    - uint32_t : N = number of LODs, excluding the full-detail mesh
+		//    - repeat N times (finest first):
+		//      - float : error (object space distance)
+		//      - uint32_t : I = number of indices
+		//      - repeat I times: index, same size as the mesh's indices
+		if( !aLods.empty() )
+		{
+			assert( aLods.size() == aIndexedMeshes.size() );
+			checked_write_( aOut, sizeof(char)*16, kLodSectionId );
+			checked_write_( aOut, sizeof(meshCount), &meshCount );
+
+			bool const boundsLayout = EVertexLayout_::bounds == aLayout || EVertexLayout_::quantized == aLayout;
+			for( std::size_t i = 0; i < aLods.size(); ++i )
+			{
+				bool const smallIndices = aSmallIndices && boundsLayout && aIndexedMeshes[i].vert.size() <= kMaxVerticesForSmallIndices;
+				begin_chunk_( meshChunks + 3*i + 2 );
+
+				std::uint32_t const lodCount = std::uint32_t(aLods[i].size());
+				checked_write_( aOut, sizeof(lodCount), &lodCount );
+
+				for( auto const& lod : aLods[i] )
+				{
+					checked_write_( aOut, sizeof(float), &lod.error );
+
+					std::uint32_t const indexCount = std::uint32_t(lod.indices.size());
+					checked_write_( aOut, sizeof(indexCount), &indexCount );
+
+					if( smallIndices )
+					{
+						std::vector<std::uint16_t> const indices( lod.indices.begin(), lod.indices.end() );
+						checked_write_( aOut, sizeof(std::uint16_t)*indexCount, indices.data() );
+					}
+					else
+					{
+						checked_write_( aOut, sizeof(std::uint32_t)*indexCount, lod.indices.data() );
+					}
+				}
+
+				end_chunk_( meshChunks + 3*i + 2 );
+			}
+		}
+
+		// Write material constants (optional)
+		// Format:
+		//  - char[16] : section ID "scsmbil-mat"
+		//  - uint32_t : M = number of materials (same as above)
+		//  - repeat M times:
+		//    - vec4 : base color (linear RGB, alpha)
+		//    - float : roughness
+		//    - float : metalness
+		bool const constants = std::any_of( aModel.materials.begin(), aModel.materials.end(), [] (InputMaterialInfo const& aMat) {
+			return aMat.baseColorTexturePath.empty() || aMat.roughnessTexturePath.empty() || aMat.metalnessTexturePath.empty();
+		} );
+		if( constants )
+		{
+			checked_write_( aOut, sizeof(char)*16, kMaterialSectionId );
+
+			begin_chunk_( constantsChunk );
+			checked_write_( aOut, sizeof(materialCount), &materialCount );
+
+			for( auto const& mat : aModel.materials )
+			{
+				float const values[6] = { mat.baseColor.x, mat.baseColor.y, mat.baseColor.z, 1.f, mat.baseRoughness, mat.baseMetalness };
+				checked_write_( aOut, sizeof(values), values );
+			}
+
+			end_chunk_( constantsChunk );
+		}
+
+		// Write names
+		// Format:
+		//  - char[16] : section ID "scsmbil-nam"
+		//  - uint32_t : M = number of materials (same as above)
+		//  - repeat M times: string : material name
+		//  - uint32_t : N = number of meshes (same as above)
+		//  - repeat N times: string : mesh name
+		checked_write_( aOut, sizeof(char)*16, kNamesSectionId );
+
+		checked_write_( aOut, sizeof(materialCount), &materialCount );
+		for( auto const& mat : aModel.materials )
+			write_string_( aOut, mat.materialName.c_str() );
+
+		checked_write_( aOut, sizeof(meshCount), &meshCount );
+		for( auto const& mesh : aModel.meshes )
+			write_string_( aOut, mesh.meshName.c_str() );
+
+		// Write texture formats
+		// Format:
+		//  - char[16] : section ID "scsmbil-txf"
+		//  - uint32_t : U = number of textures (same as above)
+		//  - repeat U times:
+		//    - uint32_t : role (see texture_role_())
+		//    - uint32_t : VkFormat
+		checked_write_( aOut, sizeof(char)*16, kTextureFormatSectionId );
+
+		checked_write_( aOut, sizeof(textureCount), &textureCount );
+		for( auto const* tex : orderedUnqiue )
+		{
+			std::uint32_t const values[2] = { texture_role_( tex->kind ), tex->format };
+			checked_write_( aOut, sizeof(values), values );
+		}
+
+		// Write BVH
+		// Format:
+		//  - char[16] : section ID "scsmbil-bvh"
+		//  - uint32_t : M = number of meshes (same as above)
+		//  - uint32_t : N = number of nodes
+		//  - repeat N times: BakedBvhNode
+		//  - uint32_t : P = number of primitives
+		//  - repeat P times: uint32_t mesh index
+		checked_write_( aOut, sizeof(char)*16, kBvhSectionId );
+
+		std::uint32_t const nodeCount = std::uint32_t(aBvh.nodes.size());
+		std::uint32_t const primitiveCount = std::uint32_t(aBvh.primitives.size());
+		checked_write_( aOut, sizeof(meshCount), &meshCount );
+		checked_write_( aOut, sizeof(nodeCount), &nodeCount );
+		checked_write_( aOut, sizeof(BakedBvhNode)*nodeCount, aBvh.nodes.data() );
+		checked_write_( aOut, sizeof(primitiveCount), &primitiveCount );
+		checked_write_( aOut, sizeof(std::uint32_t)*primitiveCount, aBvh.primitives.data() );
+
+		// Write PVS, if any
+		// Format:
+		//  - char[16] : section ID "scsmbil-pvs"
+		//  - uint32_t : M = number of meshes (same as above)
+		//  - float[3] : grid origin
+		//  - float    : cell size
+		//  - uint32_t[3] : cells along x, y and z
+		//  - uint32_t : R = bytes per cell, (M + 7) / 8
+		//  - uint32_t : B = bytes of the bitsets, R * cells
+		//  - uint32_t : C = bytes stored
+		//  - C bytes: the bitsets as a LZ4 block, or as is if C == B
+		if( !aPvs.bits.empty() )
+		{
+			checked_write_( aOut, sizeof(char)*16, kPvsSectionId );
+
+			auto const packed = pack_( aPvs.bits.data(), aPvs.bits.size() );
+			std::uint32_t const sizes[3] = { aPvs.rowBytes, std::uint32_t(aPvs.bits.size()), std::uint32_t(packed.size()) };
+			checked_write_( aOut, sizeof(meshCount), &meshCount );
+			checked_write_( aOut, sizeof(glm::vec3), &aPvs.origin );
+			checked_write_( aOut, sizeof(float), &aPvs.cellSize );
+			checked_write_( aOut, sizeof(aPvs.dims), aPvs.dims );
+			checked_write_( aOut, sizeof(sizes), sizes );
+			checked_write_( aOut, packed.size(), packed.data() );
+		}
+
+		// Write ambient occlusion, if any
+		// Format:
+		//  - char[16] : section ID "scsmbil-ao"
+		//  - uint32_t : M = number of meshes (same as above)
+		//  - repeat M times:
+		//    - uint32_t : V = number of vertices of the mesh
+		//    - V bytes: occlusion of each vertex (255: none)
+		if( !aOcclusion.empty() )
+		{
+			checked_write_( aOut, sizeof(char)*16, kOcclusionSectionId );
+
+			checked_write_( aOut, sizeof(meshCount), &meshCount );
+			for( auto const& values : aOcclusion )
+			{
+				std::uint32_t const vertexCount = std::uint32_t(values.size());
+				checked_write_( aOut, sizeof(vertexCount), &vertexCount );
+				checked_write_( aOut, values.size(), values.data() );
+			}
+		}
+
+		// Write impostors, if any
+		// Format:
+		//  - char[16] : section ID "scsmbil-imp"
+		//  - uint32_t : M = number of meshes (same as above)
+		//  - uint32_t : views per side of the octahedral grid
+		//  - repeat M times: BakedImpostor (texture indices refer to the
+		//    texture list above)
+		if( !aImpostors.meshes.empty() )
+		{
+			checked_write_( aOut, sizeof(char)*16, kImpostorSectionId );
+
+			checked_write_( aOut, sizeof(meshCount), &meshCount );
+			checked_write_( aOut, sizeof(aImpostors.grid), &aImpostors.grid );
+			checked_write_( aOut, sizeof(BakedImpostor)*aImpostors.meshes.size(), aImpostors.meshes.data() );
+		}
+
+		// Fill in the table of contents
+		if( aToc )
+			aOut.patch( tocOffset, toc.data(), sizeof(TocChunk_)*toc.size() );
+	}
+}
+
+namespace
+{
+	BlockWriter_::BlockWriter_( FILE* aFile )
+		: mFile( aFile )
+	{
+		mBlock.reserve( kOutputBlockBytes );
+	}
 
-	// types
-	struct TextureInfo_
+	void BlockWriter_::write( void const* aData, std::size_t aBytes )
 	{
-		std::uint32_t uniqueId;
-		std::uint8_t channels;
-		std::string newPath;
-	};
+		auto const* bytes = static_cast<std::uint8_t const*>(aData);
+		mPos += aBytes;
 
-	// local functions:
-	void process_model_(
-		char const* aOutput,
-		char const* aInputOBJ,
-		glm::mat4x4 const& aStaticTransform = glm::mat4x4( 1.f ) //TODO
-	);
+		while( aBytes > 0 )
+		{
+			// Whole blocks of large arrays go straight to the file
+			if( mBlock.empty() && aBytes >= kOutputBlockBytes )
+			{
+				std::size_t const direct = aBytes - aBytes % kOutputBlockBytes;
+				checked_write_( mFile, direct, bytes );
+				bytes += direct;
+				aBytes -= direct;
+				continue;
+			}
 
+			std::size_t const take = std::min( aBytes, kOutputBlockBytes - mBlock.size() );
+			mBlock.insert( mBlock.end(), bytes, bytes + take );
+			bytes += take;
+			aBytes -= take;
 
-	void write_model_data_(
-		FILE*,
-		InputModel const&,
-		std::vector<IndexedMesh> const&,
-		std::unordered_map<std::string,TextureInfo_> const&
-	);
+			if( kOutputBlockBytes == mBlock.size() )
+				flush_();
+		}
+	}
 
+	void BlockWriter_::patch( std::uint64_t aOffset, void const* aData, std::size_t aBytes )
+	{
+		assert( aOffset + aBytes <= mPos );
 
-	std::vector<IndexedMesh> index_meshes_(
-		InputModel const&,
-		float aErrorTolerance = 1e-5f
-	);
+		// Still buffered (small files)?
+		std::uint64_t const buffered = mPos - mBlock.size();
+		if( aOffset >= buffered )
+		{
+			std::memcpy( mBlock.data() + (aOffset - buffered), aData, aBytes );
+			return;
+		}
 
-	std::unordered_map<std::string,TextureInfo_> find_unique_textures_(
-		InputModel const&
-	);
+		flush_();
+		if( !seek_( mFile, std::int64_t(aOffset), SEEK_SET ) )
+			throw lut::Error( "fseek() failed" );
 
-	std::unordered_map<std::string,TextureInfo_> new_paths_(
-		std::unordered_map<std::string,TextureInfo_>,
-		std::filesystem::path const& aTexDir
-	);
-}
+		checked_write_( mFile, aBytes, aData );
 
+		if( !seek_( mFile, 0, SEEK_END ) )
+			throw lut::Error( "fseek() failed" );
+	}
 
-int main() try
-{
-	process_model_(
-		"assets/cw2/sponza-pbr.comp5822mesh",
-		"assets-src/cw2/sponza-pbr.obj"
-	);
+	void BlockWriter_::finish()
+	{
+		flush_();
+	}
 
-	return 0;
-}
-catch( std::exception const& eErr )
-{
-	std::fprintf( stderr, "Top-level exception [%s]:\n%s\nBye.\n", typeid(eErr).name(), eErr.what() );
-	return 1;
+	void BlockWriter_::flush_()
+	{
+		checked_write_( mFile, mBlock.size(), mBlock.data() );
+		mBlock.clear();
+	}
 }
 
 namespace
 {
-	void process_model_( char const* aOutput, char const* aInputOBJ, glm::mat4x4 const& aStaticTransform )
+	void apply_static_transform_( InputModel& aModel, glm::mat4x4 const& aTransform )
 	{
-		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
+		if( glm::mat4x4( 1.f ) == aTransform )
+			return;
 
-		// Figure out output paths
-		std::filesystem::path const outname( aOutput );
-		std::filesystem::path const rootdir = outname.parent_path();
-		std::filesystem::path const basename = outname.stem();
-		std::filesystem::path const texdir = basename.string() + "-tex";
+		glm::mat3 const normalMatrix = glm::transpose( glm::inverse( glm::mat3( aTransform ) ) );
 
-		// Load input model
-		auto const model = load_wavefront_obj( aInputOBJ );
+		for( auto& pos : aModel.positions )
+			pos = glm::vec3( aTransform * glm::vec4( pos, 1.f ) );
+		for( auto& norm : aModel.normals )
+			norm = glm::normalize( normalMatrix * norm );
 
-		std::size_t inputVerts = 0;
-		for( auto const& imesh : model.meshes )
-			inputVerts += imesh.vertexCount;
+		// Mirroring flips the winding; swap two corners of every triangle to
+		// restore it. (Meshes always consist of whole triangles.)
+		if( glm::determinant( glm::mat3( aTransform ) ) < 0.f )
+		{
+			for( std::size_t i = 0; i+2 < aModel.corners.size(); i += 3 )
+				std::swap( aModel.corners[i+1], aModel.corners[i+2] );
 
-		std::printf( "%s: %zu meshes, %zu materials\n", aInputOBJ, model.meshes.size(), model.materials.size() );
-		std::printf( " - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts*vertexSize/1024 );
+			for( std::size_t i = 0; aModel.corners.empty() && i+2 < aModel.positions.size(); i += 3 )
+			{
+				std::swap( aModel.positions[i+1], aModel.positions[i+2] );
+				std::swap( aModel.texcoords[i+1], aModel.texcoords[i+2] );
+				if( !aModel.normals.empty() )
+					std::swap( aModel.normals[i+1], aModel.normals[i+2] );
+			}
+		}
+	}
 
-		// Index meshes
-		auto const indexed = index_meshes_( model );
+	InputModel merge_meshes_by_material_( InputModel aModel )
+	{
+		InputModel ret;
+		ret.modelSourcePath = aModel.modelSourcePath;
+		ret.materials = aModel.materials;
 
-		std::size_t outputVerts = 0, outputIndices = 0, outputTangents = 0;
-		for( auto const& mesh : indexed )
+		if( !aModel.corners.empty() )
 		{
-			outputVerts += mesh.vert.size();
-			outputIndices += mesh.indices.size();
-			outputTangents += mesh.tangent.size();
+			ret.positions = std::move(aModel.positions);
+			ret.texcoords = std::move(aModel.texcoords);
+			ret.normals = std::move(aModel.normals);
+			ret.corners.reserve( aModel.corners.size() );
+		}
+		else
+		{
+			ret.positions.reserve( aModel.positions.size() );
+			ret.texcoords.reserve( aModel.texcoords.size() );
+			ret.normals.reserve( aModel.normals.size() );
 		}
 
-		std::printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
-		std::printf(" - tangents: %zu\n", outputTangents);
-
-		// Find list of unique textures
-		auto const textures = new_paths_( find_unique_textures_( model ), texdir );
+		std::vector<bool> merged( aModel.materials.size(), false );
+		for( auto const& first : aModel.meshes )
+		{
+			if( merged[first.materialIndex] )
+				continue;
 
-		std::printf( " - unique textures: %zu\n", textures.size() );
+			merged[first.materialIndex] = true;
 
-		// Ensure output directory exists
-		std::filesystem::create_directories( rootdir );
+			InputMeshInfo mesh;
+			mesh.meshName = "merged::" + aModel.materials[first.materialIndex].materialName;
+			mesh.materialIndex = first.materialIndex;
+			mesh.vertexStartIndex = ret.corners.empty() ? ret.positions.size() : ret.corners.size();
 
-		// Output mesh data
-		auto mainpath = rootdir / basename;
-		mainpath.replace_extension( "comp5822mesh" );
+			for( auto const& imesh : aModel.meshes )
+			{
+				if( imesh.materialIndex != first.materialIndex )
+					continue;
 
-		FILE* fof = std::fopen( mainpath.string().c_str(), "wb" );
-		if( !fof )
-			throw lut::Error( "Unable to open '%s' for writing", mainpath.string().c_str() );
+				append_corners_( ret, aModel, imesh.vertexStartIndex, imesh.vertexCount );
+			}
 
-		try
-		{
-			write_model_data_( fof, model, indexed, textures );
+			mesh.vertexCount = (ret.corners.empty() ? ret.positions.size() : ret.corners.size()) - mesh.vertexStartIndex;
+			ret.meshes.emplace_back( std::move(mesh) );
 		}
-		catch( ... )
+
+		return ret;
+	}
+
+	InputModel split_meshes_by_cell_( InputModel aModel, float aCellSize )
+	{
+		// First soup vertex of each triangle of each piece, by cell (z, x)
+		// and then by source mesh
+		std::map<std::pair<int,int>, std::vector<std::pair<std::size_t, std::vector<std::size_t>>>> cells;
+		for( std::size_t m = 0; m < aModel.meshes.size(); ++m )
 		{
-			std::fclose( fof );
-			throw;
+			auto const& imesh = aModel.meshes[m];
+			for( std::size_t t = 0; t + 3 <= imesh.vertexCount; t += 3 )
+			{
+				auto const v = imesh.vertexStartIndex + t;
+				auto const centroid = (corner_position( aModel, v ) + corner_position( aModel, v+1 ) + corner_position( aModel, v+2 )) / 3.f;
+				auto const key = std::make_pair( int(std::floor( centroid.z / aCellSize )), int(std::floor( centroid.x / aCellSize )) );
+
+				auto& pieces = cells[key];
+				if( pieces.empty() || m != pieces.back().first )
+					pieces.emplace_back( m, std::vector<std::size_t>{} );
+				pieces.back().second.emplace_back( v );
+			}
 		}
 
-		std::fclose( fof );
+		InputModel ret;
+		ret.modelSourcePath = aModel.modelSourcePath;
+		ret.materialLibraryPath = aModel.materialLibraryPath;
+		ret.materials = aModel.materials;
 
-		// Copy textures
-		std::filesystem::create_directories( rootdir / texdir );
+		if( !aModel.corners.empty() )
+		{
+			ret.positions = std::move(aModel.positions);
+			ret.texcoords = std::move(aModel.texcoords);
+			ret.normals = std::move(aModel.normals);
+			ret.corners.reserve( aModel.corners.size() );
+		}
+		else
+		{
+			ret.positions.reserve( aModel.positions.size() );
+			ret.texcoords.reserve( aModel.texcoords.size() );
+			ret.normals.reserve( aModel.normals.size() );
+		}
 
-		std::size_t errors = 0;
-		for( auto const& entry : textures )
+		for( auto const& [key, pieces] : cells )
 		{
-			auto const dest = rootdir / entry.second.newPath;
+			for( auto const& [m, triangles] : pieces )
+			{
+				auto const& source = aModel.meshes[m];
 
-			std::error_code ec;
-			bool ret = std::filesystem::copy_file( 
-				entry.first,
-				dest,
-				std::filesystem::copy_options::none,
-				ec
-			);
+				InputMeshInfo mesh;
+				mesh.meshName = source.meshName + " [" + std::to_string( key.second ) + "," + std::to_string( key.first ) + "]";
+				mesh.materialIndex = source.materialIndex;
+				mesh.vertexStartIndex = ret.corners.empty() ? ret.positions.size() : ret.corners.size();
 
-			if( !ret )
-			{
-				++errors;
-				std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(), ec.message().c_str(), ec.category().name() );
+				for( auto const v : triangles )
+					append_corners_( ret, aModel, v, 3 );
+
+				mesh.vertexCount = (ret.corners.empty() ? ret.positions.size() : ret.corners.size()) - mesh.vertexStartIndex;
+				ret.meshes.emplace_back( std::move(mesh) );
 			}
 		}
 
-		auto const total = textures.size();
-		std::printf( "Copied %zu textures out of %zu.\n", total-errors, total );
-		if( errors )
+		return ret;
+	}
+
+	void append_corners_( InputModel& aTo, InputModel const& aFrom, std::size_t aFirst, std::size_t aCount )
+	{
+		auto const beg = aFirst, end = aFirst + aCount;
+		if( !aFrom.corners.empty() )
 		{
-			std::fprintf( stderr, "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n" );
+			aTo.corners.insert( aTo.corners.end(), aFrom.corners.begin()+beg, aFrom.corners.begin()+end );
+			return;
 		}
+
+		aTo.positions.insert( aTo.positions.end(), aFrom.positions.begin()+beg, aFrom.positions.begin()+end );
+		aTo.texcoords.insert( aTo.texcoords.end(), aFrom.texcoords.begin()+beg, aFrom.texcoords.begin()+end );
+		if( !aFrom.normals.empty() )
+			aTo.normals.insert( aTo.normals.end(), aFrom.normals.begin()+beg, aFrom.normals.begin()+end );
 	}
 }
 
 namespace
 {
-	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	TriangleSoup mesh_soup_( InputModel const& aModel, InputMeshInfo const& aMesh )
 	{
-		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+		auto const endIndex = aMesh.vertexStartIndex + aMesh.vertexCount;
 
-		if( ret != aBytes )
-			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
-	}
+		TriangleSoup soup;
 
-	void write_string_( FILE* aOut, char const* aString )
-	{
-		// Write a string
-		// Format:
-		//  - uint32_t : N = length of string in bytes, including terminating '\0'
-		//  - N x char : string
-		std::uint32_t const length = std::uint32_t(std::strlen(aString)+1);
-		checked_write_( aOut, sizeof(std::uint32_t), &length );
+		soup.vert.reserve( aMesh.vertexCount );
+		for( std::size_t i = aMesh.vertexStartIndex; i < endIndex; ++i )
+			soup.vert.emplace_back( corner_position( aModel, i ) );
 
-		checked_write_( aOut, length, aString );
+		soup.text.reserve( aMesh.vertexCount );
+		for( std::size_t i = aMesh.vertexStartIndex; i < endIndex; ++i )
+			soup.text.emplace_back( corner_texcoord( aModel, i ) );
+
+		soup.norm.reserve( aMesh.vertexCount );
+		for( std::size_t i = aMesh.vertexStartIndex; i < endIndex; ++i )
+			soup.norm.emplace_back( corner_normal( aModel, i ) );
+
+		return soup;
 	}
 
-	void write_model_data_( FILE* aOut, InputModel const& aModel, std::vector<IndexedMesh> const& aIndexedMeshes, std::unordered_map<std::string,TextureInfo_> const& aTextures )
+	MeshBakeResult bake_mesh_( TriangleSoup const& aSoup, bool aOptimize, bool aLods, bool aMeshlets, MeshIndexingBackend* aIndexing, StageTimes_& aTimes )
 	{
-		// Write header
-		// Format:
-		//   - char[16] : file magic
-		//   - char[16] : file variant ID
-		checked_write_( aOut, sizeof(char)*16, kFileMagic );
-		checked_write_( aOut, sizeof(char)*16, kFileVariant );
-		
-		// Write list of unique textures
-		// Format:
-		//  - unit32_t : U = number of unique textures
-		//  - repeat U times:
-		//    - string : path to texture 
-		//    - uint8_t : number of channels in texture
-		std::vector<TextureInfo_ const*> orderedUnqiue( aTextures.size() );
-		for( auto const& tex : aTextures )
-		{
-			assert( !orderedUnqiue[tex.second.uniqueId] );
-			orderedUnqiue[tex.second.uniqueId] = &tex.second;
-		}
+		LUT_CPU_ZONE( "bake_mesh_()" );
+		auto stageStart = Clock_::now();
+		auto const stage_ = [&] (double& aTime) {
+			auto const now = Clock_::now();
+			aTime += std::chrono::duration<double,std::milli>( now - stageStart ).count();
+			stageStart = now;
+		};
 
-		std::uint32_t const textureCount = std::uint32_t(orderedUnqiue.size());
-		checked_write_( aOut, sizeof(textureCount), &textureCount );
+		MeshBakeResult ret;
+		ret.mesh = make_indexed_mesh( aSoup, kIndexErrorTolerance, false, true, aIndexing );
+		ret.cleanup = clean_indexed_mesh( ret.mesh );
+		stage_( aTimes.index );
 
-		for( auto const& tex : orderedUnqiue )
-		{
-			assert( tex );
-			write_string_( aOut, tex->newPath.c_str() );
+		if( aIndexing )
+			aIndexing->compute_tangents( ret.mesh );
+		else
+			compute_tangents( ret.mesh );
+		stage_( aTimes.tangents );
 
-			std::uint8_t channels = tex->channels;
-			checked_write_( aOut, sizeof(channels), &channels );
+		// Reorder for the post-transform cache, overdraw and vertex fetch
+		if( aOptimize )
+		{
+			ret.missesBefore = count_cache_misses( ret.mesh.indices, ret.mesh.vert.size() );
+			optimize_mesh( ret.mesh );
+			ret.missesAfter = count_cache_misses( ret.mesh.indices, ret.mesh.vert.size() );
+			stage_( aTimes.optimize );
 		}
 
-		// Write material information
-		// Format:
-		//  - uint32_t : M = number of materials
-		//  - repeat M times:
-		//    - uin32_t : base color texture index
-		//    - uin32_t : roughness texture index
-		//    - uin32_t : metalness texture index
-		//    - uin32_t : alphaMask texture index (or 0xffffffff if none)
-		//    - uin32_t : normalMap texture index (or 0xffffffff if none)
-		//    - TODO: base color, metalness and roughness
-		std::uint32_t const materialCount = std::uint32_t(aModel.materials.size());
-		checked_write_( aOut, sizeof(materialCount), &materialCount );
+		// Simplified index buffers into the final vertex buffer
+		if( aLods )
+		{
+			ret.lods = build_lods( ret.mesh );
+			stage_( aTimes.lods );
+		}
 
-		for( auto const& mat : aModel.materials )
+		// Meshlets last, as they refer to the final vertex and triangle order
+		if( aMeshlets )
 		{
-			auto const write_tex_ = [&] (std::string const& aTexturePath ) {
-				if( aTexturePath.empty() )
-				{
-					static constexpr std::uint32_t sentinel = ~std::uint32_t(0);
-					checked_write_( aOut, sizeof(std::uint32_t), &sentinel );
-					return;
-				}
+			ret.meshlets = build_meshlets( ret.mesh );
+			stage_( aTimes.meshlets );
+		}
 
-				auto const it = aTextures.find( aTexturePath );
-				assert( aTextures.end() != it );
+		return ret;
+	}
 
-				checked_write_( aOut, sizeof(std::uint32_t), &it->second.uniqueId );
-			};
+	ContentHash mesh_key_( TriangleSoup const& aSoup, bool aOptimize, bool aLods, bool aMeshlets, bool aGpuIndexing )
+	{
+		ContentHasher hasher;
+		hasher.add_value( kBakeCacheVersion );
+		hasher.add_value( kIndexErrorTolerance );
+		for( bool const flag : { aOptimize, aLods, aMeshlets, aGpuIndexing } )
+			hasher.add_value( flag );
+
+		auto const count = aSoup.vert.size();
+		hasher.add( aSoup.vert.data(), count * sizeof(glm::vec3) );
+		hasher.add( aSoup.text.data(), count * sizeof(glm::vec2) );
+		hasher.add( aSoup.norm.data(), count * sizeof(glm::vec3) );
+		return hasher.value();
+	}
+}
 
-			write_tex_( mat.baseColorTexturePath );
-			write_tex_( mat.roughnessTexturePath );
-			write_tex_( mat.metalnessTexturePath );
-			write_tex_( mat.alphaMaskTexturePath );
-			write_tex_( mat.normalMapTexturePath );
+namespace
+{
+	std::vector<std::string> fold_constant_textures_( InputModel& aModel, unsigned aJobs )
+	{
+		// Check every texture once per kind (base colours decode as sRGB)
+		std::vector<std::pair<std::string,ETextureKind>> sources;
+		std::unordered_map<std::string,std::size_t> sourceIds;
+		auto const source_id_ = [&] (std::string const& aPath, ETextureKind aKind) {
+			auto const [it, isNew] = sourceIds.emplace( std::to_string( int(aKind) ) + ":" + aPath, sources.size() );
+			if( isNew )
+				sources.emplace_back( aPath, aKind );
+			return it->second;
+		};
+
+		for( auto const& mat : aModel.materials )
+		{
+			for( auto const* path : { &mat.baseColorTexturePath, &mat.alphaMaskTexturePath } )
+			{
+				if( !path->empty() )
+					source_id_( *path, ETextureKind::baseColor );
+			}
+			for( auto const* path : { &mat.roughnessTexturePath, &mat.metalnessTexturePath } )
+			{
+				if( !path->empty() )
+					source_id_( *path, ETextureKind::scalar );
+			}
+			if( !mat.normalMapTexturePath.empty() )
+				source_id_( mat.normalMapTexturePath, ETextureKind::normalMap );
 		}
 
-		// Write mesh data
-		// Format:
-		//  - uint32_t : M = number of meshes
-		//  - repeat M times:
-		//    - uint32_t : material index
-		//    - uint32_t : V = number of vertices
-		//    - uint32_t : I = number of indices
-		//    - repeat V times: vec3 position
-		//    - repeat V times: vec3 normal
-		//    - repeat V times: vec2 texture coordinate
-		//    - repeat I times: uint32_t index
-		std::uint32_t const meshCount = std::uint32_t(aModel.meshes.size());
-		checked_write_( aOut, sizeof(meshCount), &meshCount );
+		// Textures that can't be read are left for the bake/copy to report
+		std::vector<std::optional<glm::vec4>> values( sources.size() );
+		parallel_for_( sources.size(), aJobs, [&] (std::size_t aIndex) {
+			glm::vec4 value;
+			try
+			{
+				if( find_constant_texture( sources[aIndex].first.c_str(), sources[aIndex].second, value ) )
+					values[aIndex] = value;
+			}
+			catch( lut::Error const& )
+			{}
+		} );
+
+		// Clears aPath and returns the texel if the texture is constant and
+		// aAccept()s it.
+		std::vector<std::string> folded;
+		auto const fold_ = [&] (std::string& aPath, ETextureKind aKind, auto&& aAccept) -> std::optional<glm::vec4> {
+			if( aPath.empty() )
+				return {};
 
-		assert( aModel.meshes.size() == aIndexedMeshes.size() );
-		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
-		{
-			auto const& mmesh = aModel.meshes[i];
+			auto const& value = values[source_id_( aPath, aKind )];
+			if( !value || !aAccept( *value ) )
+				return {};
 
-			std::uint32_t materialIndex = std::uint32_t(mmesh.materialIndex);
-			checked_write_( aOut, sizeof(materialIndex), &materialIndex );
+			if( folded.end() == std::find( folded.begin(), folded.end(), aPath ) )
+				folded.emplace_back( aPath );
 
-			auto const& imesh = aIndexedMeshes[i];
+			aPath.clear();
+			return value;
+		};
 
-			std::uint32_t vertexCount = std::uint32_t(imesh.vert.size());
-			checked_write_( aOut, sizeof(vertexCount), &vertexCount );
-			std::uint32_t indexCount = std::uint32_t(imesh.indices.size());
-			checked_write_( aOut, sizeof(indexCount), &indexCount );
+		// The shaders discard below 0.5 alpha
+		auto const opaque_ = [] (glm::vec4 const& aValue) { return aValue.w >= 0.5f; };
+		auto const any_ = [] (glm::vec4 const&) { return true; };
+		auto const flat_ = [] (glm::vec4 const& aValue) { return aValue.z >= 0.9999f; };
+
+		for( auto& mat : aModel.materials )
+		{
+			// Base colour alpha is the mask, so the base colour can only be
+			// folded without one.
+			fold_( mat.alphaMaskTexturePath, ETextureKind::baseColor, opaque_ );
+			if( mat.alphaMaskTexturePath.empty() )
+			{
+				if( auto const value = fold_( mat.baseColorTexturePath, ETextureKind::baseColor, opaque_ ) )
+					mat.baseColor = glm::vec3( *value );
+			}
 
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.norm.data() );
-			checked_write_( aOut, sizeof(glm::vec2)*vertexCount, imesh.text.data() );
-			checked_write_( aOut, sizeof(glm::vec4)*vertexCount, imesh.tangent.data());
+			if( auto const value = fold_( mat.roughnessTexturePath, ETextureKind::scalar, any_ ) )
+				mat.baseRoughness = value->x;
+			if( auto const value = fold_( mat.metalnessTexturePath, ETextureKind::scalar, any_ ) )
+				mat.baseMetalness = value->x;
 
-			checked_write_( aOut, sizeof(std::uint32_t)*indexCount, imesh.indices.data() );
+			// Only flat normal maps are the same as none
+			fold_( mat.normalMapTexturePath, ETextureKind::normalMap, flat_ );
 		}
+
+		return folded;
 	}
-}
 
-namespace
-{
-	std::vector<IndexedMesh> index_meshes_( InputModel const& aModel, float aErrorTolerance )
+	std::uint32_t texture_role_( ETextureKind aKind )
 	{
-		std::vector<IndexedMesh> indexed;
-
-		for( auto const& imesh : aModel.meshes )
+		switch( aKind )
 		{
-			auto const endIndex = imesh.vertexStartIndex + imesh.vertexCount;
-
-			TriangleSoup soup;
+			case ETextureKind::baseColor: return 1;
+			case ETextureKind::roughnessMetalness: return 2;
+			case ETextureKind::normalMap: return 3;
+			case ETextureKind::scalar: return 4;
+			case ETextureKind::alphaCoverage: return 5;
+			case ETextureKind::linearColor: return 6;
+		}
 
-			soup.vert.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.vert.emplace_back( aModel.positions[i] );
+		return 0;
+	}
 
-			soup.text.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.text.emplace_back( aModel.texcoords[i] );
+	std::string packed_key_( InputMaterialInfo const& aMaterial )
+	{
+		if( aMaterial.roughnessTexturePath.empty() && aMaterial.metalnessTexturePath.empty() )
+			return {};
 
-			soup.norm.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.norm.emplace_back( aModel.normals[i] );
-			
+		return aMaterial.roughnessTexturePath + '\n' + aMaterial.metalnessTexturePath;
+	}
 
-			indexed.emplace_back( make_indexed_mesh( soup, aErrorTolerance ) );
-		}
+	std::string alpha_key_( InputMaterialInfo const& aMaterial )
+	{
+		if( aMaterial.alphaMaskTexturePath.empty() )
+			return {};
 
-		return indexed;
+		return "alpha\n" + aMaterial.alphaMaskTexturePath;
 	}
-}
 
-namespace
-{
 	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel )
 	{
 		std::unordered_map<std::string,TextureInfo_> unique;
 
 		std::uint32_t texid = 0;
-		auto const add_unique_ = [&] (std::string const& aPath, std::uint8_t aChannels)
+		auto const add_unique_ = [&] (std::string const& aKey, std::uint8_t aChannels, ETextureKind aKind, std::vector<std::string> aSources)
 		{
-			if( aPath.empty() )
+			if( aKey.empty() )
 				return;
 
 			TextureInfo_ info{};
 			info.uniqueId = texid;
 			info.channels = aChannels;
+			info.kind = aKind;
+			info.sources = std::move(aSources);
 
-			auto const [it, isNew] = unique.emplace( std::make_pair(aPath,info) );
+			auto const [it, isNew] = unique.emplace( std::make_pair(aKey,info) );
 
 			if( isNew )
 				++texid;
@@ -380,26 +2701,51 @@ namespace
 
 		for( auto const& mat : aModel.materials )
 		{
-			add_unique_( mat.baseColorTexturePath, 4 );
-			add_unique_( mat.roughnessTexturePath, 1 ); 
-			add_unique_( mat.metalnessTexturePath, 1 ); 
-			add_unique_( mat.alphaMaskTexturePath, 4 );  // assume == baseColor
-			add_unique_( mat.normalMapTexturePath, 4 );  // eh...
+			add_unique_( mat.baseColorTexturePath, 4, ETextureKind::baseColor, { mat.baseColorTexturePath } );
+			add_unique_( packed_key_( mat ), 2, ETextureKind::roughnessMetalness, { mat.roughnessTexturePath, mat.metalnessTexturePath } );
+			add_unique_( alpha_key_( mat ), 1, ETextureKind::alphaCoverage, { mat.alphaMaskTexturePath } );
+			add_unique_( mat.normalMapTexturePath, 4, ETextureKind::normalMap, { mat.normalMapTexturePath } );  // eh...
 		}
 
 		return unique;
 	}
 
-	std::unordered_map<std::string,TextureInfo_> new_paths_( std::unordered_map<std::string,TextureInfo_> aTextures, std::filesystem::path const& aTexDir )
+	std::unordered_map<std::string,TextureInfo_> new_paths_( std::unordered_map<std::string,TextureInfo_> aTextures, std::filesystem::path const& aTexDir, ETextureOutput_ aOutput )
 	{
 		for( auto& entry : aTextures )
 		{
-			std::filesystem::path const originalPath( entry.first );
-			auto const filename = originalPath.filename();
-			auto const newpath = aTexDir / filename;
-		
 			auto& info = entry.second;
+
+			std::filesystem::path filename;
+			if( ETextureKind::roughnessMetalness == info.kind )
+			{
+				// "<roughness>+<metalness>"
+				std::string name;
+				for( auto const& source : info.sources )
+				{
+					if( !name.empty() )
+						name += '+';
+					name += source.empty() ? std::string( "none" ) : std::filesystem::path( source ).stem().string();
+				}
+
+				filename = name + kBakedTextureExtension;
+			}
+			else if( ETextureKind::alphaCoverage == info.kind )
+			{
+				// "<image>-alpha", next to the image's base color
+				filename = std::filesystem::path( info.sources.front() ).stem().string() + "-alpha" + kBakedTextureExtension;
+			}
+			else
+			{
+				std::filesystem::path const originalPath( entry.first );
+				filename = originalPath.filename();
+				filename.replace_extension( kBakedTextureExtension );
+			}
+
+			auto const newpath = aTexDir / filename;
 			info.newPath = newpath.string();
+
+			info.format = texture_format( info.kind, ETextureOutput_::compressed == aOutput );
 		}
 
 		// Note: aTextures is still local to the function, so there is no need
@@ -407,6 +2753,66 @@ namespace
 		// argument, NRVO is unlikely to occur.
 		return aTextures; 
 	}
+
+	std::uint64_t fit_texture_budget_( std::unordered_map<std::string,TextureInfo_>& aTextures, BakeOptions_ const& aOptions )
+	{
+		bool const compress = ETextureOutput_::compressed == aOptions.textures;
+
+		struct Source_
+		{
+			TextureInfo_* info;
+			std::uint32_t width, height;
+			std::uint64_t bytes;
+		};
+
+		// In a fixed order, so that ties are broken the same way every time
+		std::vector<Source_> sources;
+		for( auto& [key, info] : aTextures )
+		{
+			info.maxSize = 0;
+
+			// Packed textures: both sources have the same size
+			auto const& path = info.sources.front().empty() ? info.sources.back() : info.sources.front();
+			std::uint32_t width, height;
+			if( !texture_source_size( path.c_str(), width, height ) )
+				continue;
+
+			if( auto const cap = aOptions.maxTextureSize[std::size_t(info.kind)]; cap > 0 && std::max( width, height ) > cap )
+				info.maxSize = cap;
+
+			sources.emplace_back( Source_{ &info, width, height, texture_footprint( info.kind, compress, width, height, info.maxSize ) } );
+		}
+
+		std::sort( sources.begin(), sources.end(), [] (Source_ const& aX, Source_ const& aY) {
+			return aX.info->newPath < aY.info->newPath;
+		} );
+
+		std::uint64_t total = 0;
+		for( auto const& source : sources )
+			total += source.bytes;
+
+		while( aOptions.textureBudget > 0 && total > aOptions.textureBudget )
+		{
+			auto const largest = std::max_element( sources.begin(), sources.end(), [] (Source_ const& aX, Source_ const& aY) {
+				return aX.bytes < aY.bytes;
+			} );
+
+			// Longest side of the current level 0; 1x1 can't shrink further
+			std::uint32_t side = std::max( largest->width, largest->height );
+			while( largest->info->maxSize > 0 && side > largest->info->maxSize )
+				side = std::max( side / 2, 1u );
+
+			if( side <= 1 )
+				break;
+
+			largest->info->maxSize = side / 2;
+			total -= largest->bytes;
+			largest->bytes = texture_footprint( largest->info->kind, compress, largest->width, largest->height, largest->info->maxSize );
+			total += largest->bytes;
+		}
+
+		return total;
+	}
 }
 
 
@@ -0,0 +1,243 @@
+#include "meshlet.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Tweakables
+	// Meshlets whose normals deviate by more than acos(kMinConeSpread) from
+	// the average normal get no usable normal cone (they would hardly ever be
+	// culled, and the cone test isn't free).
+	constexpr float kMinConeSpread = 0.1f;
+
+	constexpr std::uint8_t kNoLocal_ = 0xff;
+
+	// Bounding sphere and normal cone of aMeshlet, whose vertices and
+	// triangles have been filled in.
+	void compute_bounds_(
+		IndexedMesh const&,
+		MeshletData const&,
+		BakedMeshlet& aMeshlet
+	);
+}
+
+MeshletData build_meshlets( IndexedMesh const& aMesh, std::uint32_t aMaxVertices, std::uint32_t aMaxTriangles )
+{
+	assert( aMaxVertices >= 3 && aMaxVertices <= kNoLocal_ );
+	assert( aMaxTriangles >= 1 );
+	assert( 0 == aMesh.indices.size() % 3 );
+
+	MeshletData ret;
+
+	std::size_t const triangleCount = aMesh.indices.size() / 3;
+	std::uint32_t const* const indices = aMesh.indices.data();
+
+	// Vertex-triangle adjacency: the triangles using vertex v are
+	// adjacent[offsets[v] .. offsets[v+1]).
+	std::vector<std::uint32_t> offsets( aMesh.vert.size()+1, 0 );
+	for( auto const index : aMesh.indices )
+		++offsets[index+1];
+	for( std::size_t v = 1; v < offsets.size(); ++v )
+		offsets[v] += offsets[v-1];
+
+	std::vector<std::uint32_t> adjacent( aMesh.indices.size() );
+	{
+		std::vector<std::uint32_t> fill( offsets.begin(), offsets.end()-1 );
+		for( std::size_t i = 0; i < aMesh.indices.size(); ++i )
+			adjacent[fill[indices[i]]++] = std::uint32_t(i / 3);
+	}
+
+	std::vector<std::uint8_t> emitted( triangleCount, 0 );
+
+	// Local index of each mesh vertex in the current meshlet
+	std::vector<std::uint8_t> local( aMesh.vert.size(), kNoLocal_ );
+
+	BakedMeshlet current{};
+
+	auto const flush_ = [&] {
+		if( 0 == current.triangleCount )
+			return;
+
+		for( std::uint32_t i = 0; i < current.vertexCount; ++i )
+			local[ret.vertices[current.vertexOffset+i]] = kNoLocal_;
+
+		compute_bounds_( aMesh, ret, current );
+		ret.meshlets.emplace_back( current );
+
+		current = BakedMeshlet{};
+		current.vertexOffset = std::uint32_t(ret.vertices.size());
+		current.triangleOffset = std::uint32_t(ret.triangles.size());
+	};
+
+	// Number of vertices that triangle aTri would add to the current meshlet
+	auto const extra_vertices_ = [&] (std::size_t aTri) {
+		std::uint32_t const* tri = indices + 3*aTri;
+
+		std::uint32_t extra = 0;
+		for( int j = 0; j < 3; ++j )
+		{
+			// Count repeated new vertices (degenerate triangles) once
+			bool const seen = (j > 0 && tri[j] == tri[0]) || (j > 1 && tri[j] == tri[1]);
+			if( kNoLocal_ == local[tri[j]] && !seen )
+				++extra;
+		}
+		return extra;
+	};
+
+	// Greedy: grow the current meshlet with the neighbouring triangle that
+	// adds the fewest new vertices. Once no neighbours are left, continue
+	// with the next triangle in index order (which, after optimize_mesh(),
+	// tends to be close by).
+	std::size_t cursor = 0;
+	for( std::size_t remaining = triangleCount; remaining > 0; )
+	{
+		constexpr std::size_t kNone = ~std::size_t(0);
+		std::size_t best = kNone;
+		std::uint32_t bestExtra = 4;
+
+		for( std::uint32_t i = 0; i < current.vertexCount && bestExtra > 0; ++i )
+		{
+			auto const v = ret.vertices[current.vertexOffset+i];
+			for( auto j = offsets[v]; j < offsets[v+1]; ++j )
+			{
+				auto const t = adjacent[j];
+				if( emitted[t] )
+					continue;
+
+				if( auto const extra = extra_vertices_( t ); extra < bestExtra )
+				{
+					best = t;
+					bestExtra = extra;
+				}
+			}
+		}
+
+		if( kNone == best )
+		{
+			while( emitted[cursor] )
+				++cursor;
+
+			best = cursor;
+			bestExtra = extra_vertices_( best );
+		}
+
+		if( current.vertexCount + bestExtra > aMaxVertices || current.triangleCount + 1 > aMaxTriangles )
+		{
+			flush_();
+			continue;
+		}
+
+		for( int j = 0; j < 3; ++j )
+		{
+			auto const index = indices[3*best+j];
+			if( kNoLocal_ == local[index] )
+			{
+				local[index] = std::uint8_t(current.vertexCount++);
+				ret.vertices.emplace_back( index );
+			}
+
+			ret.triangles.emplace_back( local[index] );
+		}
+
+		++current.triangleCount;
+		emitted[best] = 1;
+		--remaining;
+	}
+
+	flush_();
+
+	return ret;
+}
+
+namespace
+{
+	void compute_bounds_( IndexedMesh const& aMesh, MeshletData const& aData, BakedMeshlet& aMeshlet )
+	{
+		auto const vertex_ = [&] (std::uint32_t aLocal) {
+			return aMesh.vert[aData.vertices[aMeshlet.vertexOffset + aLocal]];
+		};
+
+		// Sphere around the center of the meshlet's AABB. Not minimal, but
+		// typically within a few percent of it for these small clusters.
+		glm::vec3 bmin( std::numeric_limits<float>::max() );
+		glm::vec3 bmax( std::numeric_limits<float>::lowest() );
+		for( std::uint32_t i = 0; i < aMeshlet.vertexCount; ++i )
+		{
+			bmin = glm::min( bmin, vertex_( i ) );
+			bmax = glm::max( bmax, vertex_( i ) );
+		}
+
+		aMeshlet.center = 0.5f * (bmin + bmax);
+		aMeshlet.radius = 0.f;
+		for( std::uint32_t i = 0; i < aMeshlet.vertexCount; ++i )
+			aMeshlet.radius = std::max( aMeshlet.radius, glm::length( vertex_( i ) - aMeshlet.center ) );
+
+		// Normal cone from the (geometric) triangle normals: the axis is their
+		// average, the opening angle follows from the normal nearest to
+		// perpendicular to it. Degenerate triangles don't contribute.
+		struct Plane_
+		{
+			glm::vec3 point;
+			glm::vec3 normal;
+		};
+
+		std::vector<Plane_> planes;
+		planes.reserve( aMeshlet.triangleCount );
+
+		glm::vec3 axis( 0.f );
+		for( std::uint32_t t = 0; t < aMeshlet.triangleCount; ++t )
+		{
+			std::uint8_t const* tri = aData.triangles.data() + aMeshlet.triangleOffset + 3*t;
+			glm::vec3 const p0 = vertex_( tri[0] ), p1 = vertex_( tri[1] ), p2 = vertex_( tri[2] );
+
+			glm::vec3 const n = glm::cross( p1 - p0, p2 - p0 );
+			float const len = glm::length( n );
+			if( len <= 0.f )
+				continue;
+
+			planes.push_back( { p0, n / len } );
+			axis += n / len;
+		}
+
+		float const axisLength = glm::length( axis );
+
+		float minDot = 1.f;
+		if( axisLength > 0.f )
+		{
+			axis /= axisLength;
+			for( auto const& plane : planes )
+				minDot = std::min( minDot, glm::dot( plane.normal, axis ) );
+		}
+
+		if( axisLength <= 0.f || minDot <= kMinConeSpread )
+		{
+			aMeshlet.coneApex = aMeshlet.center;
+			aMeshlet.coneAxis = glm::vec3( 0.f, 0.f, 1.f );
+			aMeshlet.coneCutoff = 2.f; // never culled
+			return;
+		}
+
+		// Apex: move back along the axis from the center until the apex is
+		// behind (or on) every triangle's plane. A viewer inside the
+		// resulting cone then sees all triangles from behind.
+		// (Zeux, "Meshlet culling" / meshoptimizer.)
+		float maxT = 0.f;
+		for( auto const& plane : planes )
+		{
+			float const dc = glm::dot( aMeshlet.center - plane.point, plane.normal );
+			float const dn = glm::dot( axis, plane.normal ); // >= minDot > 0
+
+			maxT = std::max( maxT, dc / dn );
+		}
+
+		aMeshlet.coneApex = aMeshlet.center - axis * maxT;
+		aMeshlet.coneAxis = axis;
+		aMeshlet.coneCutoff = std::sqrt( 1.f - minDot*minDot );
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef MESHLET_HPP_6A0E2F58_D3B1_4C97_8F24_91B5E7C03D6A
+#define MESHLET_HPP_6A0E2F58_D3B1_4C97_8F24_91B5E7C03D6A
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstdint>
+
+#include "index_mesh.hpp"
+
+#include "../cw2/baked_meshlet.hpp"
+
+//--    types                                   ///{{{1///////////////////////
+
+// Meshlets of a single mesh, in the layout of the baked meshlet section.
+struct MeshletData
+{
+	std::vector<BakedMeshlet> meshlets;
+	std::vector<std::uint32_t> vertices; // mesh-relative vertex indices
+	std::vector<std::uint8_t> triangles; // indices into the meshlet's vertices
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// Splits the mesh into meshlets with at most aMaxVertices vertices and
+// aMaxTriangles triangles each. Meshlets grow greedily across shared
+// vertices; new meshlets start at the first remaining triangle in index
+// order, so run this after optimize_mesh(). Every triangle ends up in
+// exactly one meshlet. The mesh itself is unchanged.
+MeshletData build_meshlets(
+	IndexedMesh const&,
+	std::uint32_t aMaxVertices = kMeshletMaxVertices,
+	std::uint32_t aMaxTriangles = kMeshletMaxTriangles
+);
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // MESHLET_HPP_6A0E2F58_D3B1_4C97_8F24_91B5E7C03D6A
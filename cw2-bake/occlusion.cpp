@@ -0,0 +1,159 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+
+namespace
+{
+	// Ray against box, with the reciprocal direction; true if they overlap
+	// within [0, aMax]
+	bool hits_box_( glm::vec3 const& aOrigin, glm::vec3 const& aInvDir, float aMax, glm::vec3 const& aMin, glm::vec3 const& aBoxMax )
+	{
+		glm::vec3 const t0 = (aMin - aOrigin) * aInvDir;
+		glm::vec3 const t1 = (aBoxMax - aOrigin) * aInvDir;
+		glm::vec3 const lo = glm::min( t0, t1 ), hi = glm::max( t0, t1 );
+
+		float const enter = std::max( { lo.x, lo.y, lo.z, 0.f } );
+		float const exit = std::min( { hi.x, hi.y, hi.z, aMax } );
+		return enter <= exit;
+	}
+
+	// Möller-Trumbore, either side
+	bool hits_triangle_( glm::vec3 const& aOrigin, glm::vec3 const& aDir, float aMax, glm::vec3 const* aCorners )
+	{
+		glm::vec3 const e1 = aCorners[1] - aCorners[0];
+		glm::vec3 const e2 = aCorners[2] - aCorners[0];
+		glm::vec3 const p = glm::cross( aDir, e2 );
+		float const det = glm::dot( e1, p );
+		if( std::abs( det ) < 1e-12f )
+			return false;
+
+		float const inv = 1.f / det;
+		glm::vec3 const s = aOrigin - aCorners[0];
+		float const u = glm::dot( s, p ) * inv;
+		if( u < 0.f || u > 1.f )
+			return false;
+
+		glm::vec3 const q = glm::cross( s, e1 );
+		float const v = glm::dot( aDir, q ) * inv;
+		if( v < 0.f || u + v > 1.f )
+			return false;
+
+		float const t = glm::dot( e2, q ) * inv;
+		return t > 0.f && t <= aMax;
+	}
+
+	// Any hit; walks the BVH without a stack (see baked_bvh.hpp)
+	bool occluded_( OcclusionScene const& aScene, glm::vec3 const& aOrigin, glm::vec3 const& aDir, float aMax )
+	{
+		auto const& bvh = aScene.bvh;
+		glm::vec3 const invDir = 1.f / aDir;
+
+		auto const nodeCount = std::uint32_t(bvh.nodes.size());
+		for( std::uint32_t i = 0; i < nodeCount; )
+		{
+			auto const& node = bvh.nodes[i];
+			if( !hits_box_( aOrigin, invDir, aMax, node.aabbMin, node.aabbMax ) )
+			{
+				i = node.skip;
+				continue;
+			}
+
+			if( node.skip == i + 1 )
+			{
+				for( std::uint32_t j = node.first; j < bvh.end( i ); ++j )
+				{
+					if( hits_triangle_( aOrigin, aDir, aMax, aScene.corners.data() + 3 * std::size_t(bvh.primitives[j]) ) )
+						return true;
+				}
+			}
+
+			++i;
+		}
+
+		return false;
+	}
+}
+
+OcclusionScene build_occlusion_scene( std::vector<IndexedMesh> const& aMeshes )
+{
+	OcclusionScene ret;
+
+	std::vector<glm::vec3> mins, maxs;
+	for( auto const& imesh : aMeshes )
+	{
+		for( std::size_t t = 0; t + 2 < imesh.indices.size(); t += 3 )
+		{
+			glm::vec3 const a = imesh.vert[imesh.indices[t+0]];
+			glm::vec3 const b = imesh.vert[imesh.indices[t+1]];
+			glm::vec3 const c = imesh.vert[imesh.indices[t+2]];
+			ret.corners.insert( ret.corners.end(), { a, b, c } );
+			mins.emplace_back( glm::min( a, glm::min( b, c ) ) );
+			maxs.emplace_back( glm::max( a, glm::max( b, c ) ) );
+		}
+	}
+
+	ret.bvh = build_bvh( mins, maxs );
+
+	// Relative to the model's size, against self-intersection
+	if( !ret.bvh.nodes.empty() )
+		ret.bias = 1e-4f * glm::length( ret.bvh.nodes[0].aabbMax - ret.bvh.nodes[0].aabbMin );
+
+	return ret;
+}
+
+void bake_vertex_occlusion( OcclusionScene const& aScene, IndexedMesh const& aMesh, std::size_t aFirst, std::size_t aCount, float aDistance, std::uint8_t* aOut )
+{
+	float const golden = 3.14159265f * (3.f - std::sqrt( 5.f ));
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		auto const v = aFirst + i;
+		glm::vec3 n = aMesh.norm[v];
+		float const len = glm::length( n );
+		if( !(len > 0.f) )
+		{
+			aOut[i] = 255;
+			continue;
+		}
+		n /= len;
+
+		// Frame around the normal (Frisvad)
+		glm::vec3 t, b;
+		if( n.z < -0.9999999f )
+		{
+			t = glm::vec3( 0.f, -1.f, 0.f );
+			b = glm::vec3( -1.f, 0.f, 0.f );
+		}
+		else
+		{
+			float const a = 1.f / (1.f + n.z);
+			float const c = -n.x * n.y * a;
+			t = glm::vec3( 1.f - n.x * n.x * a, c, -n.x );
+			b = glm::vec3( c, 1.f - n.y * n.y * a, -n.y );
+		}
+
+		glm::vec3 const origin = aMesh.vert[v] + n * aScene.bias;
+
+		// Cosine-distributed spiral over the disk, projected up; each vertex
+		// turns it by a different angle, so that neighbours don't band
+		float const turn = float(v) * golden;
+		std::uint32_t open = 0;
+		for( std::uint32_t r = 0; r < kOcclusionRays; ++r )
+		{
+			float const radius = std::sqrt( (float(r) + 0.5f) / float(kOcclusionRays) );
+			float const phi = float(r) * golden + turn;
+			float const x = radius * std::cos( phi ), y = radius * std::sin( phi );
+			glm::vec3 const dir = x * t + y * b + std::sqrt( std::max( 0.f, 1.f - radius * radius ) ) * n;
+
+			if( !occluded_( aScene, origin, dir, aDistance ) )
+				++open;
+		}
+
+		aOut[i] = std::uint8_t((open * 255 + kOcclusionRays / 2) / kOcclusionRays);
+	}
+}
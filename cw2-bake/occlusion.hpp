@@ -0,0 +1,51 @@
+#ifndef OCCLUSION_HPP_C71F3B08_2E94_4D5A_A6C8_93B15E0D7F42
+#define OCCLUSION_HPP_C71F3B08_2E94_4D5A_A6C8_93B15E0D7F42
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "index_mesh.hpp"
+#include "../cw2/baked_bvh.hpp"
+
+//--    constants                               ///{{{1///////////////////////
+
+// Rays per vertex, cosine-distributed over the normal's hemisphere
+constexpr std::uint32_t kOcclusionRays = 32;
+
+//--    types                                   ///{{{1///////////////////////
+
+// All triangles of a static model, with a BVH over them for ray queries
+struct OcclusionScene
+{
+	BakedBvh bvh; // primitives are triangles
+	std::vector<glm::vec3> corners; // three per triangle
+	float bias = 0.f; // ray origins move this far off the surface
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// Gathers the triangles of aMeshes and builds their BVH
+OcclusionScene build_occlusion_scene( std::vector<IndexedMesh> const& aMeshes );
+
+// Ambient occlusion of aCount vertices of aMesh, from aFirst, into aOut:
+// the cosine-weighted fraction of the hemisphere around each vertex normal
+// that is open up to aDistance, with 255 for fully open. Touches only its
+// own vertices, so different ranges may be baked concurrently.
+void bake_vertex_occlusion(
+	OcclusionScene const&,
+	IndexedMesh const& aMesh,
+	std::size_t aFirst,
+	std::size_t aCount,
+	float aDistance,
+	std::uint8_t* aOut
+);
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // OCCLUSION_HPP_C71F3B08_2E94_4D5A_A6C8_93B15E0D7F42
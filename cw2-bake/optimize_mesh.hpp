@@ -0,0 +1,52 @@
+#ifndef OPTIMIZE_MESH_HPP_4F1C8A36_92D0_4B7E_A3C5_6E08D2B71F94
+#define OPTIMIZE_MESH_HPP_4F1C8A36_92D0_4B7E_A3C5_6E08D2B71F94
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "index_mesh.hpp"
+
+//--    constants                               ///{{{1///////////////////////
+
+// Size of the simulated FIFO post-transform cache. The actual hardware
+// cache differs between GPUs (and isn't necessarily a FIFO); 16 entries is
+// a conservative middle ground.
+constexpr std::uint32_t kVertexCacheSize = 16;
+
+//--    functions                               ///{{{1///////////////////////
+
+// Reorders the triangles and vertices of an indexed mesh; the mesh itself is
+// unchanged (same triangles, same vertex data). Three passes:
+//  1. Tipsify (Sander et al. 2007): triangle order for the post-transform
+//     vertex cache.
+//  2. Overdraw: the Tipsify output is split into clusters that each keep
+//     their cache efficiency, which are then sorted front-to-back from the
+//     outside of the mesh (outward facing clusters first).
+//  3. Vertex fetch: vertices are renumbered and stored in first-use order.
+// Unreferenced vertices are dropped.
+void optimize_mesh( IndexedMesh&, std::uint32_t aCacheSize = kVertexCacheSize );
+
+// Pass 1 only: reorders the triangles of aIndices for the post-transform
+// cache and leaves the vertices alone. For additional index buffers into an
+// already optimized vertex buffer (e.g. LODs, see simplify_mesh.hpp).
+std::vector<std::uint32_t> optimize_vertex_cache(
+	std::vector<std::uint32_t> const& aIndices,
+	std::size_t aVertexCount,
+	std::uint32_t aCacheSize = kVertexCacheSize
+);
+
+// Number of vertex shader invocations for aIndices with a FIFO cache with
+// aCacheSize entries. Divide by the number of triangles to get the ACMR.
+std::size_t count_cache_misses(
+	std::vector<std::uint32_t> const& aIndices,
+	std::size_t aVertexCount,
+	std::uint32_t aCacheSize = kVertexCacheSize
+);
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // OPTIMIZE_MESH_HPP_4F1C8A36_92D0_4B7E_A3C5_6E08D2B71F94
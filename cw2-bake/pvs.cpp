@@ -0,0 +1,227 @@
+#include "pvs.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	std::size_t voxel_index_( PvsVoxels const& aVoxels, glm::uvec3 const& aVoxel )
+	{
+		return (std::size_t(aVoxel.z) * aVoxels.dims[1] + aVoxel.y) * aVoxels.dims[0] + aVoxel.x;
+	}
+
+	glm::uvec3 voxel_of_( PvsVoxels const& aVoxels, glm::vec3 const& aPoint )
+	{
+		glm::vec3 const v = (aPoint - aVoxels.cells.origin) / aVoxels.voxelSize;
+		glm::uvec3 ret;
+		for( int i = 0; i < 3; ++i )
+			ret[i] = std::uint32_t(std::clamp( v[i], 0.f, float(aVoxels.dims[i] - 1) ));
+		return ret;
+	}
+
+	void set_meshes_( PvsVoxels const& aVoxels, std::size_t aVoxel, std::uint8_t* aBits )
+	{
+		auto const voxel = std::uint32_t(aVoxel);
+		auto it = std::lower_bound( aVoxels.meshes.begin(), aVoxels.meshes.end(), std::make_pair( voxel, std::uint32_t(0) ) );
+		for( ; it != aVoxels.meshes.end() && it->first == voxel; ++it )
+			aBits[it->second / 8] |= std::uint8_t(1u << (it->second % 8));
+	}
+
+	// Walks the voxels along the ray from aStart (in voxel units) in
+	// direction aDir, and marks the meshes of the first solid one
+	void cast_( PvsVoxels const& aVoxels, glm::vec3 const& aStart, glm::vec3 const& aDir, std::uint8_t* aBits )
+	{
+		glm::ivec3 voxel = glm::ivec3( glm::floor( aStart ) );
+		glm::ivec3 step;
+		glm::vec3 tMax, tDelta;
+		for( int i = 0; i < 3; ++i )
+		{
+			if( aDir[i] > 0.f )
+			{
+				step[i] = 1;
+				tDelta[i] = 1.f / aDir[i];
+				tMax[i] = (float(voxel[i] + 1) - aStart[i]) * tDelta[i];
+			}
+			else if( aDir[i] < 0.f )
+			{
+				step[i] = -1;
+				tDelta[i] = -1.f / aDir[i];
+				tMax[i] = (aStart[i] - float(voxel[i])) * tDelta[i];
+			}
+			else
+			{
+				step[i] = 0;
+				tDelta[i] = tMax[i] = std::numeric_limits<float>::infinity();
+			}
+		}
+
+		glm::ivec3 const dims( aVoxels.dims[0], aVoxels.dims[1], aVoxels.dims[2] );
+		for( ;; )
+		{
+			int const axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+			voxel[axis] += step[axis];
+			tMax[axis] += tDelta[axis];
+
+			if( voxel[axis] < 0 || voxel[axis] >= dims[axis] )
+				return;
+
+			auto const index = voxel_index_( aVoxels, glm::uvec3( voxel ) );
+			if( aVoxels.solid[index] )
+				return set_meshes_( aVoxels, index, aBits );
+		}
+	}
+}
+
+PvsVoxels voxelize_for_pvs( std::vector<IndexedMesh> const& aMeshes, float aCellSize )
+{
+	assert( aCellSize > 0.f );
+
+	PvsVoxels ret;
+	ret.meshCount = std::uint32_t(aMeshes.size());
+
+	glm::vec3 bmin( std::numeric_limits<float>::max() ), bmax( std::numeric_limits<float>::lowest() );
+	for( auto const& imesh : aMeshes )
+	{
+		if( imesh.indices.empty() )
+			continue;
+
+		bmin = glm::min( bmin, imesh.aabbMin );
+		bmax = glm::max( bmax, imesh.aabbMax );
+	}
+
+	if( bmin.x > bmax.x )
+		return ret;
+
+	// Pad by a voxel, so that the surfaces on the bounds have free space
+	// outside of them
+	glm::vec3 const extent = bmax - bmin;
+	float const largest = std::max( { extent.x, extent.y, extent.z } );
+	float const cellSize = std::max( aCellSize, largest / float(kPvsMaxCells - 1) );
+	float const voxelSize = cellSize / kPvsVoxelsPerCell;
+
+	auto& cells = ret.cells;
+	cells.origin = bmin - voxelSize;
+	cells.cellSize = cellSize;
+	for( int i = 0; i < 3; ++i )
+	{
+		float const span = extent[i] + 2.f * voxelSize;
+		cells.dims[i] = std::clamp( std::uint32_t(std::ceil( span / cellSize )), 1u, kPvsMaxCells );
+		ret.dims[i] = cells.dims[i] * kPvsVoxelsPerCell;
+	}
+	cells.rowBytes = (ret.meshCount + 7) / 8;
+
+	ret.voxelSize = voxelSize;
+	ret.solid.assign( std::size_t(ret.dims[0]) * ret.dims[1] * ret.dims[2], 0 );
+
+	// Sample each triangle on a grid of barycentric steps that are at most
+	// half a voxel long along either edge
+	float const spacing = 0.5f * voxelSize;
+	for( std::uint32_t m = 0; m < aMeshes.size(); ++m )
+	{
+		auto const& imesh = aMeshes[m];
+		std::size_t const first = ret.meshes.size();
+		for( std::size_t t = 0; t + 2 < imesh.indices.size(); t += 3 )
+		{
+			glm::vec3 const a = imesh.vert[imesh.indices[t+0]];
+			glm::vec3 const ab = imesh.vert[imesh.indices[t+1]] - a;
+			glm::vec3 const ac = imesh.vert[imesh.indices[t+2]] - a;
+
+			float const longest = std::max( glm::length( ab ), glm::length( ac ) );
+			auto const steps = std::uint32_t(std::ceil( longest / spacing ));
+			float const inv = steps ? 1.f / float(steps) : 0.f;
+
+			for( std::uint32_t i = 0; i <= steps; ++i )
+			{
+				for( std::uint32_t j = 0; i + j <= steps; ++j )
+				{
+					glm::vec3 const p = a + ab * (float(i) * inv) + ac * (float(j) * inv);
+					auto const index = voxel_index_( ret, voxel_of_( ret, p ) );
+					ret.solid[index] = 1;
+					ret.meshes.emplace_back( std::uint32_t(index), m );
+				}
+			}
+
+			// Neighbouring samples mostly fall in the same voxels
+			if( ret.meshes.size() - first > (std::size_t(1) << 16) )
+			{
+				std::sort( ret.meshes.begin() + first, ret.meshes.end() );
+				ret.meshes.erase( std::unique( ret.meshes.begin() + first, ret.meshes.end() ), ret.meshes.end() );
+			}
+		}
+
+		std::sort( ret.meshes.begin() + first, ret.meshes.end() );
+		ret.meshes.erase( std::unique( ret.meshes.begin() + first, ret.meshes.end() ), ret.meshes.end() );
+	}
+
+	std::sort( ret.meshes.begin(), ret.meshes.end() );
+	return ret;
+}
+
+void compute_cell_pvs( PvsVoxels const& aVoxels, std::size_t aCell, std::uint8_t* aBits )
+{
+	auto const& cells = aVoxels.cells;
+	assert( aCell < std::size_t(cells.dims[0]) * cells.dims[1] * cells.dims[2] );
+
+	glm::uvec3 const cell(
+		std::uint32_t(aCell % cells.dims[0]),
+		std::uint32_t(aCell / cells.dims[0] % cells.dims[1]),
+		std::uint32_t(aCell / (std::size_t(cells.dims[0]) * cells.dims[1]))
+	);
+
+	// Near field: the meshes touching the cell and its neighbours
+	glm::uvec3 const lo = glm::uvec3( glm::max( glm::ivec3( cell ) - 1, glm::ivec3( 0 ) ) ) * kPvsVoxelsPerCell;
+	glm::uvec3 const hi = glm::min( cell + 2u, glm::uvec3( cells.dims[0], cells.dims[1], cells.dims[2] ) ) * kPvsVoxelsPerCell;
+	for( std::uint32_t z = lo.z; z < hi.z; ++z )
+	{
+		for( std::uint32_t y = lo.y; y < hi.y; ++y )
+		{
+			for( std::uint32_t x = lo.x; x < hi.x; ++x )
+			{
+				auto const index = voxel_index_( aVoxels, glm::uvec3( x, y, z ) );
+				if( aVoxels.solid[index] )
+					set_meshes_( aVoxels, index, aBits );
+			}
+		}
+	}
+
+	// Rays from the free sample points, in voxel units. Each sample point
+	// turns its spiral of directions by a different angle, so that together
+	// they cover more directions.
+	float const golden = 3.14159265f * (3.f - std::sqrt( 5.f ));
+	bool anyFree = false;
+	for( std::uint32_t s = 0; s < kPvsSamplesPerAxis * kPvsSamplesPerAxis * kPvsSamplesPerAxis; ++s )
+	{
+		glm::vec3 const frac(
+			float(s % kPvsSamplesPerAxis),
+			float(s / kPvsSamplesPerAxis % kPvsSamplesPerAxis),
+			float(s / (kPvsSamplesPerAxis * kPvsSamplesPerAxis))
+		);
+		glm::vec3 const start = (glm::vec3( cell ) + (frac + 0.5f) / float(kPvsSamplesPerAxis)) * float(kPvsVoxelsPerCell);
+
+		if( aVoxels.solid[voxel_index_( aVoxels, glm::uvec3( start ) )] )
+			continue;
+
+		anyFree = true;
+		float const turn = float(s) * golden / float(kPvsSamplesPerAxis * kPvsSamplesPerAxis * kPvsSamplesPerAxis);
+		for( std::uint32_t r = 0; r < kPvsRaysPerSample; ++r )
+		{
+			float const y = 1.f - 2.f * (float(r) + 0.5f) / float(kPvsRaysPerSample);
+			float const radius = std::sqrt( 1.f - y * y );
+			float const phi = float(r) * golden + turn;
+			cast_( aVoxels, start, glm::vec3( radius * std::cos( phi ), y, radius * std::sin( phi ) ), aBits );
+		}
+	}
+
+	// A cell inside solid geometry sees everything, so that a camera there
+	// isn't left with nothing
+	if( !anyFree )
+	{
+		for( std::uint32_t m = 0; m < aVoxels.meshCount; ++m )
+			aBits[m / 8] |= std::uint8_t(1u << (m % 8));
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef PVS_HPP_A84E2C17_6B3D_4F90_9C5E_1D7F03B28A64
+#define PVS_HPP_A84E2C17_6B3D_4F90_9C5E_1D7F03B28A64
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "index_mesh.hpp"
+#include "../cw2/baked_pvs.hpp"
+
+//--    constants                               ///{{{1///////////////////////
+
+// Voxels per view cell, along each axis
+constexpr std::uint32_t kPvsVoxelsPerCell = 4;
+
+// Most view cells along an axis; larger models get larger cells
+constexpr std::uint32_t kPvsMaxCells = 64;
+
+// Sample points per view cell, along each axis, and rays cast from each
+constexpr std::uint32_t kPvsSamplesPerAxis = 3;
+constexpr std::uint32_t kPvsRaysPerSample = 256;
+
+//--    types                                   ///{{{1///////////////////////
+
+// The meshes' triangles, voxelized on a grid that subdivides the view cells
+struct PvsVoxels
+{
+	BakedPvs cells; // the view cell grid; bits not allocated
+
+	float voxelSize = 0.f;
+	std::uint32_t dims[3]{}; // voxels along x, y and z
+	std::uint32_t meshCount = 0;
+
+	std::vector<std::uint8_t> solid; // per voxel, x fastest: 1 if any triangle touches it
+	std::vector<std::pair<std::uint32_t,std::uint32_t>> meshes; // voxel, mesh; sorted
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// Voxelizes aMeshes over their bounds, in view cells of about aCellSize
+// (larger if the grid would exceed kPvsMaxCells along an axis). Triangles are
+// sampled at half the voxel size. Returns an empty grid (no cells) if there
+// are no triangles.
+PvsVoxels voxelize_for_pvs( std::vector<IndexedMesh> const& aMeshes, float aCellSize );
+
+// Computes the PVS of view cell aCell into aBits (aVoxels.cells.rowBytes
+// bytes, cleared by the caller). Rays are cast through the voxels from
+// kPvsSamplesPerAxis^3 points in the cell, in kPvsRaysPerSample directions
+// each; the meshes of the first solid voxel that a ray enters are visible.
+// The meshes touching the cell or its neighbours are always visible, and a
+// cell without a free sample point sees everything. This is sampled, not
+// conservative: a mesh seen only through gaps that all rays miss is lost.
+void compute_cell_pvs( PvsVoxels const& aVoxels, std::size_t aCell, std::uint8_t* aBits );
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // PVS_HPP_A84E2C17_6B3D_4F90_9C5E_1D7F03B28A64
@@ -0,0 +1,27 @@
+// Shared by the mesh indexing shaders of cw2-bake (see gpu_indexing.hpp):
+// the push constants of their pipeline layout, and the sort keys. Keys are
+// 64-bit, as two words (x = low, y = high), and are sorted kRadixBits at a
+// time, from the lowest digit up.
+
+layout( push_constant ) uniform Params
+{
+	vec3 gridMin;    // weld_keys.comp
+	float gridScale;
+	uint count;      // of the dispatch's elements
+	uint shift;      // of the sorted digit
+	uint blocks;     // of kSortBlock keys
+	uint corners;    // vertex_tangents.comp
+} uParams;
+
+const uint kRadixBits = 8;
+const uint kRadix = 1u << kRadixBits;
+
+// Invocations per work group of the sort (local_size_x), and keys per work
+// group of the histogram and the scatter. Match gpu_indexing.cpp.
+const uint kSortThreads = 256;
+const uint kSortBlock = 16 * kSortThreads;
+
+uint key_digit( uvec2 aKey, uint aShift )
+{
+	return (aShift < 32 ? aKey.x >> aShift : aKey.y >> (aShift - 32)) & (kRadix - 1);
+}
@@ -0,0 +1,349 @@
+#include "simplify_mesh.hpp"
+
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+#include "optimize_mesh.hpp"
+
+namespace
+{
+	// Tweakables
+	// Each LOD targets this fraction of the previous LOD's triangles.
+	constexpr float kLodReduction = 0.5f;
+	// A LOD that keeps more than this fraction of the previous LOD's
+	// triangles isn't worth the memory; simplification stops there.
+	constexpr float kMaxLodRatio = 0.8f;
+	// Collapses with an error above this fraction of the mesh's bounding box
+	// diagonal are never performed.
+	constexpr float kMaxRelativeError = 0.05f;
+
+	// Symmetric 4x4 quadric Q(p) = p^T A p + 2 b^T p + c
+	struct Quadric_
+	{
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+	};
+
+	Quadric_ plane_quadric_( glm::dvec3 const& aNormal, double aOffset );
+	void accumulate_( Quadric_&, Quadric_ const& );
+	double evaluate_( Quadric_ const&, glm::vec3 const& );
+
+	// Simplification state. Topology is tracked per position: every vertex
+	// maps to a representative vertex with the same position, and quadrics
+	// and locks are stored for the representatives.
+	struct Simplifier_
+	{
+		explicit Simplifier_( IndexedMesh const& );
+
+		// Collapses edges until at most aTargetIndices indices remain, or no
+		// collapse below aMaxError is possible.
+		void simplify( std::size_t aTargetIndices, float aMaxError );
+
+		IndexedMesh const& mesh;
+
+		std::vector<std::uint32_t> position; // vertex -> representative
+		std::vector<std::uint8_t> locked;    // per representative
+		std::vector<Quadric_> quadrics;      // per representative
+
+		std::vector<std::uint32_t> indices;  // current triangles
+		float error = 0.f;
+	};
+}
+
+std::vector<MeshLod> build_lods( IndexedMesh const& aMesh, std::uint32_t aLodCount )
+{
+	assert( aMesh.indices.size() % 3 == 0 );
+
+	std::vector<MeshLod> ret;
+	if( aMesh.indices.empty() )
+		return ret;
+
+	Simplifier_ simplifier( aMesh );
+	float const maxError = kMaxRelativeError * glm::length( aMesh.aabbMax - aMesh.aabbMin );
+
+	std::size_t previous = aMesh.indices.size();
+	for( std::uint32_t i = 0; i < aLodCount; ++i )
+	{
+		std::size_t const target = std::size_t( float(previous/3) * kLodReduction ) * 3;
+		simplifier.simplify( target, maxError );
+
+		if( float(simplifier.indices.size()) > float(previous) * kMaxLodRatio )
+			break;
+
+		MeshLod lod;
+		lod.indices = optimize_vertex_cache( simplifier.indices, aMesh.vert.size() );
+		lod.error = simplifier.error;
+		ret.emplace_back( std::move(lod) );
+
+		previous = simplifier.indices.size();
+	}
+
+	return ret;
+}
+
+namespace
+{
+	Quadric_ plane_quadric_( glm::dvec3 const& aNormal, double aOffset )
+	{
+		auto const& n = aNormal;
+		return Quadric_{
+			n.x*n.x, n.x*n.y, n.x*n.z, n.y*n.y, n.y*n.z, n.z*n.z,
+			n.x*aOffset, n.y*aOffset, n.z*aOffset,
+			aOffset*aOffset
+		};
+	}
+
+	void accumulate_( Quadric_& aQ, Quadric_ const& aOther )
+	{
+		aQ.a00 += aOther.a00; aQ.a01 += aOther.a01; aQ.a02 += aOther.a02;
+		aQ.a11 += aOther.a11; aQ.a12 += aOther.a12; aQ.a22 += aOther.a22;
+		aQ.b0 += aOther.b0; aQ.b1 += aOther.b1; aQ.b2 += aOther.b2;
+		aQ.c += aOther.c;
+	}
+
+	double evaluate_( Quadric_ const& aQ, glm::vec3 const& aPoint )
+	{
+		double const x = aPoint.x, y = aPoint.y, z = aPoint.z;
+		double const ret = aQ.a00*x*x + aQ.a11*y*y + aQ.a22*z*z
+			+ 2.0*(aQ.a01*x*y + aQ.a02*x*z + aQ.a12*y*z)
+			+ 2.0*(aQ.b0*x + aQ.b1*y + aQ.b2*z)
+			+ aQ.c;
+		return std::max( ret, 0.0 ); // rounding
+	}
+}
+
+namespace
+{
+	Simplifier_::Simplifier_( IndexedMesh const& aMesh )
+		: mesh( aMesh )
+		, indices( aMesh.indices )
+	{
+		std::size_t const vertexCount = aMesh.vert.size();
+
+		// Weld positions: sort the vertices by position and map each run of
+		// equal positions to its first vertex. Runs of more than one vertex
+		// are attribute seams.
+		std::vector<std::uint32_t> order( vertexCount );
+		std::iota( order.begin(), order.end(), std::uint32_t(0) );
+
+		auto const less_ = [&] (std::uint32_t aA, std::uint32_t aB) {
+			auto const& a = aMesh.vert[aA];
+			auto const& b = aMesh.vert[aB];
+			if( a.x != b.x ) return a.x < b.x;
+			if( a.y != b.y ) return a.y < b.y;
+			if( a.z != b.z ) return a.z < b.z;
+			return aA < aB;
+		};
+		std::sort( order.begin(), order.end(), less_ );
+
+		position.resize( vertexCount );
+		locked.assign( vertexCount, 0 );
+		for( std::size_t i = 0; i < vertexCount; )
+		{
+			std::size_t j = i+1;
+			while( j < vertexCount && aMesh.vert[order[j]] == aMesh.vert[order[i]] )
+				++j;
+
+			std::uint32_t const rep = *std::min_element( order.begin()+i, order.begin()+j );
+			for( std::size_t k = i; k < j; ++k )
+				position[order[k]] = rep;
+
+			if( j - i > 1 )
+				locked[rep] = 1;
+
+			i = j;
+		}
+
+		// Borders and non-manifold edges: edges (between representatives)
+		// that aren't shared by exactly two triangles. Also set up the
+		// quadrics from the triangle planes.
+		quadrics.assign( vertexCount, Quadric_{} );
+
+		std::vector<std::uint64_t> edges;
+		edges.reserve( indices.size() );
+		for( std::size_t i = 0; i < indices.size(); i += 3 )
+		{
+			std::uint32_t const r[3] = { position[indices[i+0]], position[indices[i+1]], position[indices[i+2]] };
+			if( r[0] == r[1] || r[1] == r[2] || r[0] == r[2] )
+				continue;
+
+			for( int j = 0; j < 3; ++j )
+			{
+				std::uint64_t const a = std::min( r[j], r[(j+1)%3] );
+				std::uint64_t const b = std::max( r[j], r[(j+1)%3] );
+				edges.emplace_back( (a << 32) | b );
+			}
+
+			glm::dvec3 const p0 = aMesh.vert[r[0]], p1 = aMesh.vert[r[1]], p2 = aMesh.vert[r[2]];
+			glm::dvec3 const n = glm::cross( p1 - p0, p2 - p0 );
+			double const len = glm::length( n );
+			if( len <= 0.0 )
+				continue;
+
+			auto const q = plane_quadric_( n / len, -glm::dot( n / len, p0 ) );
+			for( auto const rep : r )
+				accumulate_( quadrics[rep], q );
+		}
+
+		std::sort( edges.begin(), edges.end() );
+		for( std::size_t i = 0; i < edges.size(); )
+		{
+			std::size_t j = i+1;
+			while( j < edges.size() && edges[j] == edges[i] )
+				++j;
+
+			if( 2 != j - i )
+			{
+				locked[std::uint32_t(edges[i] >> 32)] = 1;
+				locked[std::uint32_t(edges[i] & 0xffffffffu)] = 1;
+			}
+
+			i = j;
+		}
+	}
+
+	void Simplifier_::simplify( std::size_t aTargetIndices, float aMaxError )
+	{
+		std::size_t const vertexCount = mesh.vert.size();
+		double const maxCost = double(aMaxError) * double(aMaxError);
+
+		struct Collapse_
+		{
+			double cost;
+			std::uint32_t from, to; // representatives
+		};
+
+		// Each pass collapses a set of independent edges (no two collapses
+		// touch the same triangle), cheapest first, and then rebuilds the
+		// triangle list.
+		while( indices.size() > aTargetIndices )
+		{
+			std::size_t const triangleCount = indices.size() / 3;
+
+			// Triangles around each representative
+			std::vector<std::uint32_t> offsets( vertexCount+1, 0 );
+			for( auto const index : indices )
+				++offsets[position[index]+1];
+			std::partial_sum( offsets.begin(), offsets.end(), offsets.begin() );
+
+			std::vector<std::uint32_t> fan( indices.size() );
+			{
+				std::vector<std::uint32_t> fill( offsets.begin(), offsets.end()-1 );
+				for( std::size_t i = 0; i < indices.size(); ++i )
+					fan[fill[position[indices[i]]]++] = std::uint32_t(i / 3);
+			}
+
+			// Candidate collapses along all edges, in both directions
+			std::vector<Collapse_> candidates;
+			candidates.reserve( indices.size() );
+			for( std::size_t t = 0; t < triangleCount; ++t )
+			{
+				for( int j = 0; j < 3; ++j )
+				{
+					for( int k = 1; k < 3; ++k )
+					{
+						auto const from = position[indices[3*t+j]];
+						auto const to = position[indices[3*t+(j+k)%3]];
+						if( from == to || locked[from] )
+							continue;
+
+						double const cost = evaluate_( quadrics[from], mesh.vert[to] );
+						if( cost <= maxCost )
+							candidates.push_back( { cost, from, to } );
+					}
+				}
+			}
+
+			std::sort( candidates.begin(), candidates.end(), [] (Collapse_ const& aA, Collapse_ const& aB) {
+				if( aA.cost != aB.cost ) return aA.cost < aB.cost;
+				if( aA.from != aB.from ) return aA.from < aB.from;
+				return aA.to < aB.to;
+			} );
+
+			std::vector<std::uint8_t> touched( vertexCount, 0 );
+			std::vector<std::uint32_t> remap( vertexCount );
+			std::iota( remap.begin(), remap.end(), std::uint32_t(0) );
+
+			std::size_t const excess = (indices.size() - aTargetIndices + 2) / 3;
+			std::size_t removed = 0;
+
+			for( auto const& c : candidates )
+			{
+				if( removed >= excess )
+					break;
+				if( touched[c.from] || touched[c.to] )
+					continue;
+
+				// `from` is not a seam, so it is a single vertex. Find the
+				// vertex of `to` that replaces it (the one in the triangles
+				// on the collapsed edge), and reject collapses that flip a
+				// remaining triangle.
+				constexpr std::uint32_t kNone = ~std::uint32_t(0);
+				std::uint32_t replacement = kNone;
+				std::size_t shared = 0;
+				bool valid = true;
+
+				for( auto i = offsets[c.from]; i < offsets[c.from+1] && valid; ++i )
+				{
+					std::uint32_t const* tri = indices.data() + 3*fan[i];
+
+					int corner = 0;
+					while( position[tri[corner]] != c.from )
+						++corner;
+
+					auto const v1 = tri[(corner+1)%3], v2 = tri[(corner+2)%3];
+					if( position[v1] == c.to || position[v2] == c.to )
+					{
+						auto const candidate = position[v1] == c.to ? v1 : v2;
+						valid = kNone == replacement || replacement == candidate;
+						replacement = candidate;
+						++shared;
+						continue;
+					}
+
+					glm::vec3 const p1 = mesh.vert[v1], p2 = mesh.vert[v2];
+					glm::vec3 const before = glm::cross( p1 - mesh.vert[c.from], p2 - mesh.vert[c.from] );
+					glm::vec3 const after = glm::cross( p1 - mesh.vert[c.to], p2 - mesh.vert[c.to] );
+					valid = glm::dot( before, after ) > 0.f;
+				}
+
+				if( !valid || kNone == replacement )
+					continue;
+
+				remap[c.from] = replacement;
+				for( auto i = offsets[c.from]; i < offsets[c.from+1]; ++i )
+				{
+					std::uint32_t const* tri = indices.data() + 3*fan[i];
+					touched[position[tri[0]]] = touched[position[tri[1]]] = touched[position[tri[2]]] = 1;
+				}
+
+				accumulate_( quadrics[c.to], quadrics[c.from] );
+				error = std::max( error, float(std::sqrt( c.cost )) );
+				removed += shared;
+			}
+
+			if( 0 == removed )
+				break;
+
+			// Apply the collapses; drop the triangles that became degenerate
+			std::vector<std::uint32_t> next;
+			next.reserve( indices.size() - 3*removed );
+			for( std::size_t i = 0; i < indices.size(); i += 3 )
+			{
+				std::uint32_t const v[3] = { remap[indices[i+0]], remap[indices[i+1]], remap[indices[i+2]] };
+				if( position[v[0]] == position[v[1]] || position[v[1]] == position[v[2]] || position[v[0]] == position[v[2]] )
+					continue;
+
+				next.insert( next.end(), v, v+3 );
+			}
+
+			indices = std::move(next);
+		}
+	}
+}
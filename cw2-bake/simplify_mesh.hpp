@@ -0,0 +1,46 @@
+#ifndef SIMPLIFY_MESH_HPP_C5E71A2B_08F4_4D3C_B961_2A7D4F0E8B53
+#define SIMPLIFY_MESH_HPP_C5E71A2B_08F4_4D3C_B961_2A7D4F0E8B53
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstdint>
+
+#include "index_mesh.hpp"
+
+//--    constants                               ///{{{1///////////////////////
+
+// Number of LODs generated in addition to the full-detail mesh. Each one
+// aims for half the triangles of the previous one.
+constexpr std::uint32_t kLodCount = 3;
+
+//--    types                                   ///{{{1///////////////////////
+
+struct MeshLod
+{
+	std::vector<std::uint32_t> indices; // into the mesh's vertices
+	float error;                        // object space distance
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// Simplifies the mesh with quadric error metric edge collapses (Garland and
+// Heckbert 1997) and returns up to aLodCount successively coarser index
+// buffers. Only half-edge collapses are used (a vertex moves onto one of its
+// neighbours), so all LODs index the mesh's unchanged vertex buffer.
+// Vertices on open borders, non-manifold edges and attribute seams (where
+// the mesh has several vertices with the same position) stay in place.
+//
+// MeshLod::error is a conservative estimate of how far the LOD's surface
+// deviates from the original; it never decreases from one LOD to the next.
+// Simplification stops early if it would remove too little (see
+// simplify_mesh.cpp), so meshes may get fewer than aLodCount LODs.
+std::vector<MeshLod> build_lods(
+	IndexedMesh const&,
+	std::uint32_t aLodCount = kLodCount
+);
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // SIMPLIFY_MESH_HPP_C5E71A2B_08F4_4D3C_B961_2A7D4F0E8B53
@@ -0,0 +1,861 @@
+#include "texture_bake.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include <cmath>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+#include <stb_image.h>
+#include <vulkan/vulkan_core.h>
+
+#include "bc_encode.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/mapped_file.hpp"
+#include "../labutils/texture_pack.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	/* Baked texture file. Loosely modelled after KTX2: a fixed header, an
+	 * index with one entry per mip level, and the level data. All values
+	 * are little endian.
+	 *
+	 *  - char[16] : file magic (kTextureMagic)
+	 *  - char[16] : file variant ID (kTextureVariant)
+	 *  - uint32_t : VkFormat of the data
+	 *  - uint32_t : width of level 0
+	 *  - uint32_t : height of level 0
+	 *  - uint32_t : L = number of mip levels (always the chain down to 1x1;
+	 *               level 0 is the first level that fits the maximum size
+	 *               the texture was baked with)
+	 *  - repeat L times, starting with level 0:
+	 *    - uint64_t : byte offset of the level from the start of the file
+	 *                 (a multiple of 16)
+	 *    - uint64_t : size of the level in bytes
+	 *  - level data; rows of texels or blocks, bottom row first (the same
+	 *    orientation as the images that labutils::decode_image() returns)
+	 *
+	 * Read by labutils::load_texture_file().
+	 */
+	constexpr char kTextureMagic[16] = "\0\0COMP5822Mtex";
+	constexpr char kTextureVariant[16] = "scsmbil-mip";
+
+	constexpr std::size_t kLevelAlign = 16;
+
+	// One mip level, as floats. baseColor: linear RGB + alpha; scalar: one
+	// channel in [0,1]; normalMap: unit XYZ; roughnessMetalness: two
+	// channels in [0,1]; linearColor: four channels in [0,1].
+	struct Level_
+	{
+		std::uint32_t width, height;
+		std::vector<float> values;
+	};
+
+	float srgb_to_linear_( float aValue )
+	{
+		return aValue <= 0.04045f ? aValue / 12.92f : std::pow( (aValue + 0.055f) / 1.055f, 2.4f );
+	}
+	float linear_to_srgb_( float aValue )
+	{
+		return aValue <= 0.0031308f ? aValue * 12.92f : 1.055f * std::pow( aValue, 1.f/2.4f ) - 0.055f;
+	}
+
+	std::uint8_t to_unorm8_( float aValue )
+	{
+		return std::uint8_t(std::lround( std::clamp( aValue, 0.f, 1.f ) * 255.f ));
+	}
+
+	std::size_t channels_( ETextureKind );
+
+	Level_ load_level0_( char const* aPath, ETextureKind );
+
+	// Builds the mip chain from aLevel, encodes it (as the format of
+	// texture_format()) and writes the texture file. Levels with a side
+	// longer than aMaxSize (if > 0) are skipped.
+	void bake_levels_( Level_ aLevel, char const* aOutput, ETextureKind, bool aCompress, EMipFilter, std::uint32_t aMaxSize );
+
+	Level_ downsample_box_( Level_ const&, std::size_t aChannels );
+	Level_ downsample_kaiser_( Level_ const&, std::size_t aChannels );
+
+	void normalize_level_( Level_&, std::size_t aChannels, ETextureKind );
+
+	// Fraction of the texels of a one-channel level at or above aCutoff
+	float coverage_( Level_ const&, float aCutoff );
+
+	// Scales a one-channel level so that aCoverage of its texels are at or
+	// above kAlphaCutoff. Filtered alpha tends to lose coverage with every
+	// level, so alpha-tested geometry would thin out in the distance.
+	void preserve_coverage_( Level_&, float aCoverage );
+
+	std::vector<std::uint8_t> encode_level_( Level_ const&, std::size_t aChannels, ETextureKind, bool aCompress );
+
+	void checked_write_( FILE*, std::size_t aBytes, void const* aData );
+}
+
+//--    bake_texture()                  ///{{{2///////////////////////////////
+void bake_texture( char const* aInput, char const* aOutput, ETextureKind aKind, bool aCompress, EMipFilter aFilter, std::uint32_t aMaxSize )
+{
+	bake_levels_( load_level0_( aInput, aKind ), aOutput, aKind, aCompress, aFilter, aMaxSize );
+}
+
+//--    bake_texture_texels()           ///{{{2///////////////////////////////
+void bake_texture_texels( float const* aTexels, std::uint32_t aWidth, std::uint32_t aHeight, char const* aOutput, ETextureKind aKind, bool aCompress, EMipFilter aFilter )
+{
+	assert( ETextureKind::baseColor == aKind || ETextureKind::linearColor == aKind );
+
+	Level_ level;
+	level.width = aWidth;
+	level.height = aHeight;
+	level.values.assign( aTexels, aTexels + std::size_t(aWidth) * aHeight * 4 );
+
+	bake_levels_( std::move(level), aOutput, aKind, aCompress, aFilter, 0 );
+}
+
+//--    bake_packed_texture()           ///{{{2///////////////////////////////
+void bake_packed_texture( char const* aRoughness, char const* aMetalness, char const* aOutput, bool aCompress, EMipFilter aFilter, std::uint32_t aMaxSize )
+{
+	assert( aRoughness || aMetalness );
+
+	Level_ sources[2];
+	char const* const paths[2] = { aRoughness, aMetalness };
+	for( std::size_t i = 0; i < 2; ++i )
+	{
+		if( paths[i] )
+			sources[i] = load_level0_( paths[i], ETextureKind::scalar );
+	}
+
+	auto const& first = aRoughness ? sources[0] : sources[1];
+	if( aRoughness && aMetalness && (sources[0].width != sources[1].width || sources[0].height != sources[1].height) )
+		throw lut::Error( "%s (%ux%u) and %s (%ux%u) : roughness and metalness differ in size", aRoughness, sources[0].width, sources[0].height, aMetalness, sources[1].width, sources[1].height );
+
+	Level_ packed;
+	packed.width = first.width;
+	packed.height = first.height;
+
+	std::size_t const texels = std::size_t(packed.width) * packed.height;
+	packed.values.assign( texels * 2, 0.f );
+	for( std::size_t c = 0; c < 2; ++c )
+	{
+		if( !paths[c] )
+			continue;
+
+		for( std::size_t i = 0; i < texels; ++i )
+			packed.values[2*i+c] = sources[c].values[i];
+	}
+
+	bake_levels_( std::move(packed), aOutput, ETextureKind::roughnessMetalness, aCompress, aFilter, aMaxSize );
+}
+
+//--    find_constant_texture()         ///{{{2///////////////////////////////
+bool find_constant_texture( char const* aInput, ETextureKind aKind, glm::vec4& aValue )
+{
+	int w, h, n;
+	if( !stbi_info( aInput, &w, &h, &n ) )
+		return false;
+
+	std::uint64_t const texelCount = std::uint64_t(w) * std::uint64_t(h);
+	if( texelCount > kMaxConstantTextureTexels )
+	{
+		std::error_code ec;
+		auto const bytes = std::filesystem::file_size( aInput, ec );
+		if( ec || std::uint64_t(bytes) * kConstantTextureTexelsPerByte >= texelCount )
+			return false;
+	}
+
+	Level_ const level = load_level0_( aInput, aKind );
+
+	std::size_t const channels = channels_( aKind );
+	std::size_t const texels = std::size_t(level.width) * level.height;
+	if( 0 == texels )
+		return false;
+
+	// Texels that decode to the same bytes convert to the same floats
+	for( std::size_t i = 1; i < texels; ++i )
+	{
+		if( !std::equal( level.values.begin(), level.values.begin() + channels, level.values.begin() + i*channels ) )
+			return false;
+	}
+
+	aValue = glm::vec4( 0.f, 0.f, 0.f, 1.f );
+	for( std::size_t c = 0; c < channels; ++c )
+		aValue[int(c)] = level.values[c];
+
+	return true;
+}
+
+//--    texture_format()                ///{{{2///////////////////////////////
+std::uint32_t texture_format( ETextureKind aKind, bool aCompress )
+{
+	switch( aKind )
+	{
+		case ETextureKind::baseColor: return aCompress ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+		case ETextureKind::scalar: return aCompress ? VK_FORMAT_BC4_UNORM_BLOCK : VK_FORMAT_R8_UNORM;
+		case ETextureKind::normalMap: return aCompress ? VK_FORMAT_BC5_UNORM_BLOCK : VK_FORMAT_R8G8_UNORM;
+		case ETextureKind::roughnessMetalness: return aCompress ? VK_FORMAT_BC5_UNORM_BLOCK : VK_FORMAT_R8G8_UNORM;
+		case ETextureKind::alphaCoverage: return aCompress ? VK_FORMAT_BC4_UNORM_BLOCK : VK_FORMAT_R8_UNORM;
+		case ETextureKind::linearColor: return aCompress ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	return VK_FORMAT_UNDEFINED;
+}
+
+//--    texture_source_size()           ///{{{2///////////////////////////////
+bool texture_source_size( char const* aInput, std::uint32_t& aWidth, std::uint32_t& aHeight )
+{
+	int width, height, channels;
+	if( !stbi_info( aInput, &width, &height, &channels ) )
+		return false;
+
+	aWidth = std::uint32_t(width);
+	aHeight = std::uint32_t(height);
+	return true;
+}
+
+//--    texture_footprint()             ///{{{2///////////////////////////////
+std::uint64_t texture_footprint( ETextureKind aKind, bool aCompress, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aMaxSize )
+{
+	// As encode_level_(): whole 4x4 blocks, or unpadded texels
+	bool const single = ETextureKind::scalar == aKind || ETextureKind::alphaCoverage == aKind;
+	std::uint64_t const blockBytes = single ? 8 : 16;
+	std::uint64_t const texelBytes = (ETextureKind::baseColor == aKind || ETextureKind::linearColor == aKind) ? 4 : single ? 1 : 2;
+
+	std::uint64_t ret = 0;
+	for( std::uint32_t width = aWidth, height = aHeight; ; width = std::max( width / 2, 1u ), height = std::max( height / 2, 1u ) )
+	{
+		if( 0 == aMaxSize || std::max( width, height ) <= aMaxSize )
+		{
+			ret += aCompress
+				? std::uint64_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes
+				: std::uint64_t(width) * height * texelBytes
+			;
+		}
+
+		if( 1 == width && 1 == height )
+			break;
+	}
+
+	return ret;
+}
+
+//--    write_texture_pack()            ///{{{2///////////////////////////////
+std::uint64_t write_texture_pack( char const* aOutput, char const* aDirectory, std::vector<std::string> const& aNames )
+{
+	// Index: the baked files' headers give their format, extent and
+	// levels; other files are stored without
+	std::vector<lut::MappedFile> files;
+	std::vector<lut::TexturePackEntry> entries;
+	std::uint64_t indexBytes = 16 + 2*sizeof(std::uint32_t);
+	for( auto const& name : aNames )
+	{
+		auto const path = (std::filesystem::path( aDirectory ) / name).string();
+		auto& file = files.emplace_back( lut::map_file( path.c_str() ) );
+
+		lut::TexturePackEntry entry{ name, 0, file.size(), 0, 0, 0, {} };
+		std::size_t const fixed = 16 + 16 + 4*sizeof(std::uint32_t);
+		if( file.size() >= fixed && 0 == std::memcmp( file.data(), kTextureMagic, 16 ) && 0 == std::memcmp( file.data() + 16, kTextureVariant, 16 ) )
+		{
+			std::uint32_t header[4];
+			std::memcpy( header, file.data() + 32, sizeof(header) );
+			if( file.size() < fixed + std::uint64_t(header[3]) * 2*sizeof(std::uint64_t) )
+				throw lut::Error( "%s: truncated texture file", path.c_str() );
+
+			entry.format = header[0];
+			entry.width = header[1];
+			entry.height = header[2];
+			for( std::uint32_t i = 0; i < header[3]; ++i )
+			{
+				std::uint64_t level;
+				std::memcpy( &level, file.data() + fixed + i*2*sizeof(std::uint64_t), sizeof(level) );
+				entry.levelOffsets.emplace_back( level );
+			}
+		}
+
+		indexBytes += sizeof(std::uint32_t) + name.size() + 1 + 2*sizeof(std::uint64_t) + 4*sizeof(std::uint32_t) + entry.levelOffsets.size()*sizeof(std::uint64_t);
+		entries.emplace_back( std::move(entry) );
+	}
+
+	constexpr std::uint64_t align = lut::kTexturePackAlignment;
+	std::uint64_t offset = (indexBytes + align - 1) / align * align;
+	for( auto& entry : entries )
+	{
+		entry.offset = offset;
+		offset = (offset + entry.size + align - 1) / align * align;
+	}
+
+	std::string const tmppath = std::string(aOutput) + ".tmp";
+
+	FILE* fof = std::fopen( tmppath.c_str(), "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", tmppath.c_str() );
+
+	std::uint64_t pos = 0;
+	try
+	{
+		auto const write_ = [&] (void const* aData, std::size_t aBytes) {
+			checked_write_( fof, aBytes, aData );
+			pos += aBytes;
+		};
+
+		std::uint32_t const counts[2] = { std::uint32_t(entries.size()), lut::kTexturePackAlignment };
+		write_( lut::kTexturePackMagic, 16 );
+		write_( counts, sizeof(counts) );
+		for( auto const& entry : entries )
+		{
+			std::uint32_t const length = std::uint32_t(entry.name.size() + 1);
+			std::uint64_t const range[2] = { entry.offset, entry.size };
+			std::uint32_t const image[4] = { entry.format, entry.width, entry.height, std::uint32_t(entry.levelOffsets.size()) };
+			write_( &length, sizeof(length) );
+			write_( entry.name.c_str(), length );
+			write_( range, sizeof(range) );
+			write_( image, sizeof(image) );
+			write_( entry.levelOffsets.data(), entry.levelOffsets.size()*sizeof(std::uint64_t) );
+		}
+
+		static constexpr std::uint8_t zeros[lut::kTexturePackAlignment] = {};
+		for( std::size_t i = 0; i < entries.size(); ++i )
+		{
+			write_( zeros, std::size_t(entries[i].offset - pos) );
+			write_( files[i].data(), files[i].size() );
+		}
+
+		if( 0 != std::fclose( std::exchange( fof, nullptr ) ) )
+			throw lut::Error( "Writing '%s' failed", tmppath.c_str() );
+
+		std::filesystem::rename( tmppath, aOutput );
+	}
+	catch( ... )
+	{
+		if( fof )
+			std::fclose( fof );
+
+		std::error_code ec;
+		std::filesystem::remove( tmppath, ec );
+		throw;
+	}
+
+	return pos;
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	std::size_t channels_( ETextureKind aKind )
+	{
+		switch( aKind )
+		{
+			case ETextureKind::baseColor: return 4;
+			case ETextureKind::scalar: return 1;
+			case ETextureKind::normalMap: return 3;
+			case ETextureKind::roughnessMetalness: return 2;
+			case ETextureKind::alphaCoverage: return 1;
+			case ETextureKind::linearColor: return 4;
+		}
+
+		return 0;
+	}
+
+	Level_ load_level0_( char const* aPath, ETextureKind aKind )
+	{
+		// Packed textures have two sources; see bake_packed_texture()
+		if( ETextureKind::roughnessMetalness == aKind )
+			throw lut::Error( "%s : packed textures can't be loaded from a single image", aPath );
+
+		// Same orientation as at runtime (see labutils::decode_image())
+		stbi_set_flip_vertically_on_load_thread( 1 );
+
+		int const want = (ETextureKind::scalar == aKind) ? 1 : 4;
+
+		int w, h, n;
+		stbi_uc* data = stbi_load( aPath, &w, &h, &n, want );
+		if( !data )
+			throw lut::Error( "%s : Unable to load texture (%s)", aPath, stbi_failure_reason() );
+
+		Level_ ret;
+		ret.width = std::uint32_t(w);
+		ret.height = std::uint32_t(h);
+
+		std::size_t const texels = std::size_t(w) * std::size_t(h);
+		switch( aKind )
+		{
+			case ETextureKind::baseColor:
+				ret.values.resize( texels * 4 );
+				for( std::size_t i = 0; i < texels; ++i )
+				{
+					for( std::size_t c = 0; c < 3; ++c )
+						ret.values[4*i+c] = srgb_to_linear_( data[4*i+c] / 255.f );
+					ret.values[4*i+3] = data[4*i+3] / 255.f;
+				}
+				break;
+
+			case ETextureKind::linearColor:
+				ret.values.resize( texels * 4 );
+				for( std::size_t i = 0; i < texels * 4; ++i )
+					ret.values[i] = data[i] / 255.f;
+				break;
+
+			case ETextureKind::scalar:
+				ret.values.resize( texels );
+				for( std::size_t i = 0; i < texels; ++i )
+					ret.values[i] = data[i] / 255.f;
+				break;
+
+			case ETextureKind::alphaCoverage:
+				ret.values.resize( texels );
+				for( std::size_t i = 0; i < texels; ++i )
+					ret.values[i] = data[4*i+3] / 255.f;
+				break;
+
+			case ETextureKind::normalMap:
+				ret.values.resize( texels * 3 );
+				for( std::size_t i = 0; i < texels; ++i )
+				{
+					float n3[3];
+					for( std::size_t c = 0; c < 3; ++c )
+						n3[c] = data[4*i+c] / 255.f * 2.f - 1.f;
+
+					float const len = std::sqrt( n3[0]*n3[0] + n3[1]*n3[1] + n3[2]*n3[2] );
+					for( std::size_t c = 0; c < 3; ++c )
+						ret.values[3*i+c] = len > 0.f ? n3[c] / len : (2 == c ? 1.f : 0.f);
+				}
+				break;
+
+			case ETextureKind::roughnessMetalness:
+				break;
+		}
+
+		stbi_image_free( data );
+		return ret;
+	}
+
+	void bake_levels_( Level_ aLevel, char const* aOutput, ETextureKind aKind, bool aCompress, EMipFilter aFilter, std::uint32_t aMaxSize )
+	{
+		std::size_t const channels = channels_( aKind );
+
+		std::uint32_t const format = texture_format( aKind, aCompress );
+
+		// Build and encode the full mip chain
+		std::vector<std::vector<std::uint8_t>> encoded;
+
+		Level_ level = std::move(aLevel);
+		std::uint32_t width = 0, height = 0;
+
+		float const coverage = ETextureKind::alphaCoverage == aKind ? coverage_( level, kAlphaCutoff ) : 0.f;
+
+		for( ;; )
+		{
+			if( 0 == aMaxSize || std::max( level.width, level.height ) <= aMaxSize )
+			{
+				if( encoded.empty() )
+				{
+					width = level.width;
+					height = level.height;
+				}
+
+				encoded.emplace_back( encode_level_( level, channels, aKind, aCompress ) );
+			}
+
+			if( 1 == level.width && 1 == level.height )
+				break;
+
+			level = (EMipFilter::kaiser == aFilter)
+				? downsample_kaiser_( level, channels )
+				: downsample_box_( level, channels )
+			;
+			normalize_level_( level, channels, aKind );
+			if( ETextureKind::alphaCoverage == aKind )
+				preserve_coverage_( level, coverage );
+		}
+
+		// Layout
+		std::uint32_t const levelCount = std::uint32_t(encoded.size());
+		std::size_t const headerBytes = 16 + 16 + 4*sizeof(std::uint32_t) + levelCount*2*sizeof(std::uint64_t);
+
+		std::vector<std::uint64_t> index;
+		std::uint64_t offset = (headerBytes + kLevelAlign - 1) / kLevelAlign * kLevelAlign;
+		for( auto const& data : encoded )
+		{
+			index.emplace_back( offset );
+			index.emplace_back( data.size() );
+			offset = (offset + data.size() + kLevelAlign - 1) / kLevelAlign * kLevelAlign;
+		}
+
+		// Via a temporary file and a rename: readers never see partial
+		// files, and outputs that cw2-bake linked to this one (see
+		// copy_texture_() in main.cpp) keep their contents.
+		std::string const tmppath = std::string(aOutput) + ".tmp";
+
+		FILE* fof = std::fopen( tmppath.c_str(), "wb" );
+		if( !fof )
+			throw lut::Error( "Unable to open '%s' for writing", tmppath.c_str() );
+
+		try
+		{
+			checked_write_( fof, sizeof(kTextureMagic), kTextureMagic );
+			checked_write_( fof, sizeof(kTextureVariant), kTextureVariant );
+			checked_write_( fof, sizeof(format), &format );
+			checked_write_( fof, sizeof(width), &width );
+			checked_write_( fof, sizeof(height), &height );
+			checked_write_( fof, sizeof(levelCount), &levelCount );
+			checked_write_( fof, sizeof(std::uint64_t)*index.size(), index.data() );
+
+			static constexpr std::uint8_t zeros[kLevelAlign] = {};
+			std::size_t pos = headerBytes;
+			for( std::size_t i = 0; i < encoded.size(); ++i )
+			{
+				checked_write_( fof, std::size_t(index[2*i]) - pos, zeros );
+				checked_write_( fof, encoded[i].size(), encoded[i].data() );
+				pos = std::size_t(index[2*i]) + encoded[i].size();
+			}
+
+			if( 0 != std::fclose( std::exchange( fof, nullptr ) ) )
+				throw lut::Error( "Writing '%s' failed", tmppath.c_str() );
+
+			std::filesystem::rename( tmppath, aOutput );
+		}
+		catch( ... )
+		{
+			if( fof )
+				std::fclose( fof );
+
+			std::error_code ec;
+			std::filesystem::remove( tmppath, ec );
+			throw;
+		}
+	}
+
+	Level_ downsample_box_( Level_ const& aSrc, std::size_t aChannels )
+	{
+		// 2x2 box filter. For odd sizes, the last row/column of the source
+		// is dropped.
+		Level_ ret;
+		ret.width = std::max( aSrc.width / 2, 1u );
+		ret.height = std::max( aSrc.height / 2, 1u );
+		ret.values.resize( std::size_t(ret.width) * ret.height * aChannels );
+
+		for( std::uint32_t y = 0; y < ret.height; ++y )
+		{
+			for( std::uint32_t x = 0; x < ret.width; ++x )
+			{
+				float* dst = ret.values.data() + (std::size_t(y) * ret.width + x) * aChannels;
+				for( std::uint32_t sy = 0; sy < 2; ++sy )
+				{
+					for( std::uint32_t sx = 0; sx < 2; ++sx )
+					{
+						std::uint32_t const px = std::min( 2*x + sx, aSrc.width - 1 );
+						std::uint32_t const py = std::min( 2*y + sy, aSrc.height - 1 );
+						float const* src = aSrc.values.data() + (std::size_t(py) * aSrc.width + px) * aChannels;
+
+						for( std::size_t c = 0; c < aChannels; ++c )
+							dst[c] += src[c] * 0.25f;
+					}
+				}
+			}
+		}
+
+		return ret;
+	}
+
+	// Kaiser-windowed sinc, separable. The filter has a radius of
+	// kKaiserRadius destination texels (so 4*kKaiserRadius source taps per
+	// axis); this is the usual choice in texture tools (e.g. NVTT). Texels
+	// past the edges repeat the edge texel.
+	constexpr float kKaiserRadius = 3.f;
+	constexpr float kKaiserAlpha = 4.f;
+
+	float bessel_i0_( float aX )
+	{
+		// Power series; converges quickly for the arguments used here
+		float sum = 1.f, term = 1.f;
+		for( int k = 1; k < 32; ++k )
+		{
+			float const t = aX / (2.f * float(k));
+			term *= t * t;
+			sum += term;
+			if( term < sum * 1e-7f )
+				break;
+		}
+		return sum;
+	}
+
+	float kaiser_sinc_( float aX )
+	{
+		if( std::abs( aX ) >= kKaiserRadius )
+			return 0.f;
+
+		constexpr float kPi = 3.14159265358979f;
+		float const sinc = (0.f == aX) ? 1.f : std::sin( kPi * aX ) / (kPi * aX);
+
+		float const r = aX / kKaiserRadius;
+		float const window = bessel_i0_( kKaiserAlpha * std::sqrt( 1.f - r*r ) ) / bessel_i0_( kKaiserAlpha );
+		return sinc * window;
+	}
+
+	// Taps for reducing aSrcSize texels to aDstSize texels along one axis:
+	// for output i, aFirst[i] and aWeights[i*aTaps ...]. Weights are
+	// normalized to sum to one.
+	void kaiser_taps_( std::uint32_t aSrcSize, std::uint32_t aDstSize, std::size_t& aTaps, std::vector<std::int32_t>& aFirst, std::vector<float>& aWeights )
+	{
+		float const scale = float(aSrcSize) / float(aDstSize); // >= 1
+		float const support = kKaiserRadius * scale;
+
+		aTaps = std::size_t(std::ceil( 2.f * support )) + 1;
+		aFirst.resize( aDstSize );
+		aWeights.assign( aDstSize * aTaps, 0.f );
+
+		for( std::uint32_t i = 0; i < aDstSize; ++i )
+		{
+			float const center = (float(i) + 0.5f) * scale;
+			std::int32_t const first = std::int32_t(std::floor( center - support ));
+			aFirst[i] = first;
+
+			float sum = 0.f;
+			for( std::size_t t = 0; t < aTaps; ++t )
+			{
+				float const x = (float(first + std::int32_t(t)) + 0.5f - center) / scale;
+				float const w = kaiser_sinc_( x );
+				aWeights[i*aTaps + t] = w;
+				sum += w;
+			}
+
+			for( std::size_t t = 0; t < aTaps; ++t )
+				aWeights[i*aTaps + t] /= sum;
+		}
+	}
+
+	Level_ downsample_kaiser_( Level_ const& aSrc, std::size_t aChannels )
+	{
+		std::uint32_t const width = std::max( aSrc.width / 2, 1u );
+		std::uint32_t const height = std::max( aSrc.height / 2, 1u );
+
+		std::size_t taps;
+		std::vector<std::int32_t> first;
+		std::vector<float> weights;
+
+		// Horizontal pass: aSrc.height rows of width texels
+		std::vector<float> tmp( std::size_t(width) * aSrc.height * aChannels, 0.f );
+		kaiser_taps_( aSrc.width, width, taps, first, weights );
+
+		for( std::uint32_t y = 0; y < aSrc.height; ++y )
+		{
+			float const* row = aSrc.values.data() + std::size_t(y) * aSrc.width * aChannels;
+			for( std::uint32_t x = 0; x < width; ++x )
+			{
+				float* dst = tmp.data() + (std::size_t(y) * width + x) * aChannels;
+				for( std::size_t t = 0; t < taps; ++t )
+				{
+					std::int32_t const sx = std::clamp( first[x] + std::int32_t(t), 0, std::int32_t(aSrc.width) - 1 );
+					float const w = weights[x*taps + t];
+					for( std::size_t c = 0; c < aChannels; ++c )
+						dst[c] += w * row[std::size_t(sx) * aChannels + c];
+				}
+			}
+		}
+
+		// Vertical pass
+		Level_ ret;
+		ret.width = width;
+		ret.height = height;
+		ret.values.resize( std::size_t(width) * height * aChannels );
+		kaiser_taps_( aSrc.height, height, taps, first, weights );
+
+		for( std::uint32_t y = 0; y < height; ++y )
+		{
+			float* dst = ret.values.data() + std::size_t(y) * width * aChannels;
+			for( std::size_t t = 0; t < taps; ++t )
+			{
+				std::int32_t const sy = std::clamp( first[y] + std::int32_t(t), 0, std::int32_t(aSrc.height) - 1 );
+				float const w = weights[y*taps + t];
+				float const* src = tmp.data() + std::size_t(sy) * width * aChannels;
+				for( std::size_t i = 0; i < std::size_t(width) * aChannels; ++i )
+					dst[i] += w * src[i];
+			}
+		}
+
+		return ret;
+	}
+
+	void normalize_level_( Level_& aLevel, std::size_t aChannels, ETextureKind aKind )
+	{
+		std::size_t const texels = std::size_t(aLevel.width) * aLevel.height;
+		if( ETextureKind::normalMap == aKind )
+		{
+			for( std::size_t i = 0; i < texels; ++i )
+			{
+				float* n = aLevel.values.data() + i * aChannels;
+				float const len = std::sqrt( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+				if( len > 0.f )
+				{
+					for( std::size_t c = 0; c < 3; ++c )
+						n[c] /= len;
+				}
+				else
+				{
+					n[0] = n[1] = 0.f;
+					n[2] = 1.f;
+				}
+			}
+		}
+		else
+		{
+			// The negative lobes of the Kaiser filter can overshoot
+			for( auto& value : aLevel.values )
+				value = std::clamp( value, 0.f, 1.f );
+		}
+	}
+
+	float coverage_( Level_ const& aLevel, float aCutoff )
+	{
+		std::size_t covered = 0;
+		for( auto const value : aLevel.values )
+			covered += value >= aCutoff;
+
+		return float(covered) / float(std::max( aLevel.values.size(), std::size_t(1) ));
+	}
+
+	void preserve_coverage_( Level_& aLevel, float aCoverage )
+	{
+		// Scaling by s moves the cut-off to kAlphaCutoff / s; bisect for the
+		// cut-off that gives aCoverage (coverage falls as the cut-off rises)
+		float lo = 0.f, hi = 1.f;
+		for( int i = 0; i < 10; ++i )
+		{
+			float const mid = 0.5f * (lo + hi);
+			if( coverage_( aLevel, mid ) > aCoverage )
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		float const cutoff = 0.5f * (lo + hi);
+		if( cutoff <= 0.f )
+			return;
+
+		float const scale = kAlphaCutoff / cutoff;
+		for( auto& value : aLevel.values )
+			value = std::min( value * scale, 1.f );
+	}
+
+	std::vector<std::uint8_t> encode_level_( Level_ const& aLevel, std::size_t aChannels, ETextureKind aKind, bool aCompress )
+	{
+		if( !aCompress )
+		{
+			// Texels as in the block encoder below, unpadded
+			std::size_t const texels = std::size_t(aLevel.width) * aLevel.height;
+			bool const single = ETextureKind::scalar == aKind || ETextureKind::alphaCoverage == aKind;
+			std::size_t const bytes = (ETextureKind::baseColor == aKind || ETextureKind::linearColor == aKind) ? 4 : single ? 1 : 2;
+
+			std::vector<std::uint8_t> ret( texels * bytes );
+			for( std::size_t i = 0; i < texels; ++i )
+			{
+				float const* src = aLevel.values.data() + i * aChannels;
+				std::uint8_t* out = ret.data() + i * bytes;
+
+				switch( aKind )
+				{
+					case ETextureKind::baseColor:
+						for( std::size_t c = 0; c < 3; ++c )
+							out[c] = to_unorm8_( linear_to_srgb_( src[c] ) );
+						out[3] = to_unorm8_( src[3] );
+						break;
+					case ETextureKind::linearColor:
+						for( std::size_t c = 0; c < 4; ++c )
+							out[c] = to_unorm8_( src[c] );
+						break;
+					case ETextureKind::scalar:
+					case ETextureKind::alphaCoverage:
+						out[0] = to_unorm8_( src[0] );
+						break;
+					case ETextureKind::normalMap:
+						out[0] = to_unorm8_( src[0] * 0.5f + 0.5f );
+						out[1] = to_unorm8_( src[1] * 0.5f + 0.5f );
+						break;
+					case ETextureKind::roughnessMetalness:
+						out[0] = to_unorm8_( src[0] );
+						out[1] = to_unorm8_( src[1] );
+						break;
+				}
+			}
+
+			return ret;
+		}
+
+		std::uint32_t const bw = (aLevel.width + 3) / 4, bh = (aLevel.height + 3) / 4;
+		std::size_t const blockBytes = (ETextureKind::scalar == aKind || ETextureKind::alphaCoverage == aKind) ? 8 : 16;
+
+		std::vector<std::uint8_t> ret( std::size_t(bw) * bh * blockBytes );
+
+		for( std::uint32_t by = 0; by < bh; ++by )
+		{
+			for( std::uint32_t bx = 0; bx < bw; ++bx )
+			{
+				// Gather the block; texels past the edge repeat the last
+				// row/column.
+				std::uint8_t block[16*4];
+				for( std::uint32_t i = 0; i < 16; ++i )
+				{
+					std::uint32_t const x = std::min( bx*4 + i%4, aLevel.width - 1 );
+					std::uint32_t const y = std::min( by*4 + i/4, aLevel.height - 1 );
+					float const* src = aLevel.values.data() + (std::size_t(y) * aLevel.width + x) * aChannels;
+
+					switch( aKind )
+					{
+						case ETextureKind::baseColor:
+							for( std::size_t c = 0; c < 3; ++c )
+								block[4*i+c] = to_unorm8_( linear_to_srgb_( src[c] ) );
+							block[4*i+3] = to_unorm8_( src[3] );
+							break;
+						case ETextureKind::linearColor:
+							for( std::size_t c = 0; c < 4; ++c )
+								block[4*i+c] = to_unorm8_( src[c] );
+							break;
+						case ETextureKind::scalar:
+						case ETextureKind::alphaCoverage:
+							block[i] = to_unorm8_( src[0] );
+							break;
+						case ETextureKind::normalMap:
+							block[i] = to_unorm8_( src[0] * 0.5f + 0.5f );
+							block[16+i] = to_unorm8_( src[1] * 0.5f + 0.5f );
+							break;
+						case ETextureKind::roughnessMetalness:
+							block[i] = to_unorm8_( src[0] );
+							block[16+i] = to_unorm8_( src[1] );
+							break;
+					}
+				}
+
+				std::uint8_t* out = ret.data() + (std::size_t(by) * bw + bx) * blockBytes;
+				switch( aKind )
+				{
+					case ETextureKind::baseColor:
+					case ETextureKind::linearColor: encode_bc7_block( block, out ); break;
+					case ETextureKind::scalar:
+					case ETextureKind::alphaCoverage: encode_bc4_block( block, out ); break;
+					case ETextureKind::normalMap:
+					case ETextureKind::roughnessMetalness: encode_bc5_block( block, block+16, out ); break;
+				}
+			}
+		}
+
+		return ret;
+	}
+
+	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	{
+		if( 0 == aBytes )
+			return;
+
+		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+
+		if( ret != aBytes )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+	}
+}
@@ -0,0 +1,138 @@
+#ifndef TEXTURE_BAKE_HPP_9D3B5F20_6A7E_4C19_B8D4_2E51A0F7C6E3
+#define TEXTURE_BAKE_HPP_9D3B5F20_6A7E_4C19_B8D4_2E51A0F7C6E3
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec4.hpp>
+
+//--    constants                               ///{{{1///////////////////////
+
+// Extension of baked texture files (see bake_texture())
+constexpr char kBakedTextureExtension[] = ".cw2tex";
+
+// Alpha test threshold of the masked materials (see cw2/shaders)
+constexpr float kAlphaCutoff = 0.5f;
+
+// find_constant_texture() decodes images with at most this many texels, and
+// larger ones only if their file has less than one byte per
+// kConstantTextureTexelsPerByte texels (flat images compress very well).
+constexpr std::uint64_t kMaxConstantTextureTexels = 256*256;
+constexpr std::uint64_t kConstantTextureTexelsPerByte = 32;
+
+//--    types                                   ///{{{1///////////////////////
+enum class ETextureKind
+{
+	baseColor, // sRGB RGBA (alpha = mask)   => BC7
+	scalar,    // one channel                => BC4
+	normalMap, // tangent space XY(Z)        => BC5, Z is reconstructed
+	roughnessMetalness, // roughness in R, metalness in G => BC5 (see bake_packed_texture())
+	alphaCoverage, // alpha of an RGBA image     => BC4; mips keep the coverage at kAlphaCutoff
+	linearColor // linear RGBA (e.g. impostor normals and depth) => BC7 (UNORM)
+};
+
+enum class EMipFilter
+{
+	box,   // 2x2 average
+	kaiser // Kaiser-windowed sinc; sharper, less aliasing
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// Loads the image aInput, generates its full mip chain (with the given
+// filter; base colour is filtered in linear space), compresses every level
+// and writes the result to aOutput. Throws labutils::Error on failure.
+// Without aCompress, the levels are stored uncompressed instead, at the
+// channel count of the kind (see texture_format(); --raw-textures). Either
+// way, rows are in the order Vulkan expects, so loading is a plain copy.
+// The file format is documented in texture_bake.cpp and read by
+// labutils::load_texture_file().
+// With aMaxSize > 0, the levels with a side longer than aMaxSize are still
+// filtered (so the stored levels are as sharp as those of a full chain) but
+// not stored; the texture starts at the first level that fits.
+void bake_texture(
+	char const* aInput,
+	char const* aOutput,
+	ETextureKind,
+	bool aCompress = true,
+	EMipFilter = EMipFilter::kaiser,
+	std::uint32_t aMaxSize = 0
+);
+
+// Like bake_texture(), from aWidth x aHeight texels in memory instead of an
+// image file (e.g. the impostor atlases): four floats per texel, rows bottom
+// first, linear RGB and alpha for baseColor, as they are for linearColor.
+// Only for these two kinds. Throws labutils::Error on failure.
+void bake_texture_texels(
+	float const* aTexels,
+	std::uint32_t aWidth,
+	std::uint32_t aHeight,
+	char const* aOutput,
+	ETextureKind,
+	bool aCompress = true,
+	EMipFilter = EMipFilter::kaiser
+);
+
+// Packs the roughness image aRoughness into R and the metalness image
+// aMetalness into G, and writes the result like bake_texture(). Either input
+// may be null, which leaves its channel at 0; both images must have the same
+// size. Without aCompress, the levels are stored as uncompressed R8G8
+// (--raw-textures). Throws labutils::Error on failure.
+void bake_packed_texture(
+	char const* aRoughness,
+	char const* aMetalness,
+	char const* aOutput,
+	bool aCompress,
+	EMipFilter = EMipFilter::kaiser,
+	std::uint32_t aMaxSize = 0
+);
+
+// Checks whether all texels of the image aInput are the same. If so, returns
+// true and stores the texel in aValue as the shaders see it: linear RGB and
+// alpha for baseColor, the value in .x for scalar, the unit XYZ normal for
+// normalMap. Returns false without decoding for most larger images (see
+// kMaxConstantTextureTexels) and for files that aren't images; throws
+// labutils::Error if decoding fails.
+bool find_constant_texture( char const* aInput, ETextureKind, glm::vec4& aValue );
+
+// VkFormat that bake_texture() and bake_packed_texture() write for the kind:
+// its block format with aCompress, otherwise the uncompressed format with
+// the kind's channels (normal maps keep XY, as with BC5).
+std::uint32_t texture_format( ETextureKind, bool aCompress );
+
+// Reads the size of the image aInput from its header. Returns false if the
+// file can't be read or isn't an image.
+bool texture_source_size(
+	char const* aInput,
+	std::uint32_t& aWidth,
+	std::uint32_t& aHeight
+);
+
+// Bytes of the mip levels that bake_texture() stores (and the GPU holds) for
+// an aWidth x aHeight image of the kind, with the given aMaxSize.
+std::uint64_t texture_footprint(
+	ETextureKind,
+	bool aCompress,
+	std::uint32_t aWidth,
+	std::uint32_t aHeight,
+	std::uint32_t aMaxSize = 0
+);
+
+// Writes the files aNames (relative to aDirectory) into one texture pack,
+// aOutput (see labutils/texture_pack.hpp; --texture-pack), in that order;
+// baked texture files with their format, extent and mip table in the
+// index. Written via a temporary file, like bake_texture(). Returns the
+// size of the pack. Throws labutils::Error on failure.
+std::uint64_t write_texture_pack(
+	char const* aOutput,
+	char const* aDirectory,
+	std::vector<std::string> const& aNames
+);
+
+//--    <<< ~ >>>                               ///{{{1///////////////////////
+#endif // TEXTURE_BAKE_HPP_9D3B5F20_6A7E_4C19_B8D4_2E51A0F7C6E3
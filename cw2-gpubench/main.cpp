@@ -0,0 +1,896 @@
+#include <limits>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <typeinfo>
+#include <exception>
+#include <filesystem>
+
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include "../cw2/vertex_layout.hpp"
+#include "../cw2/distribution_lut.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/upload_batch.hpp"
+#include "../labutils/vulkan_window.hpp"
+namespace lut = labutils;
+
+/* GPU microbenchmarks, for choosing between formats and shader variants on
+ * each GPU: texture fetch rate by format (e.g., RGBA8 against BC7, two R8
+ * maps against one RG8 map), vertex fetch rate by vertex buffer layout
+ * (interleaved, one stream per attribute, quantized), and the ALU cost of
+ * the BRDF variants of default.frag (fp32 or fp16, analytic or tabulated D
+ * term). Each kernel is a single dispatch or draw, timed with timestamps
+ * around it, after one warm-up run; the median and the fastest run are
+ * reported. Every run appends a row per benchmark to the CSV file, with the
+ * device's name, so that devices (and revisions, see --label) can be
+ * compared.
+ *
+ * Runs headless (see lut::make_offscreen_window()), with the SPIR-V of
+ * cw2-gpubench/shaders from --shader-dir. Variants that the device doesn't
+ * support (formats, fp16 arithmetic) are skipped.
+ */
+
+namespace
+{
+	constexpr char const* kDefaultCsvPath = "cw2-gpubench.csv";
+	constexpr char const* kDefaultShaderDir = "assets/cw2-gpubench/shaders";
+
+	constexpr std::size_t kDefaultRuns = 20;
+	constexpr std::size_t kMaxRuns = 10000;
+
+	// Texture fetches: one invocation per texel of level 0, each taking
+	// kTextureFetches samples (see texture_fetch.comp)
+	constexpr std::uint32_t kTextureSize = 2048;
+	constexpr std::uint32_t kTextureFetches = 16;
+
+	// Vertex fetches: points, all clipped (see vertex_fetch.vert)
+	constexpr std::uint32_t kVertexCount = 1u << 21;
+
+	// BRDF evaluations (see brdf.glsl)
+	constexpr std::uint32_t kBrdfInvocations = 1u << 20;
+	constexpr std::uint32_t kBrdfEvaluations = 64;
+
+	// Work group sizes of the compute shaders
+	constexpr std::uint32_t kTextureGroupSize = 8; // per axis
+	constexpr std::uint32_t kBrdfGroupSize = 64;
+
+	struct Options_
+	{
+		char const* device = nullptr; // null: LUT_DEVICE, or the best-scoring device
+		char const* csvPath = kDefaultCsvPath;
+		char const* shaderDir = kDefaultShaderDir;
+		char const* label = ""; // e.g., the revision
+		char const* filter = nullptr; // null: all
+		std::size_t runs = kDefaultRuns;
+	};
+
+	struct Result_
+	{
+		std::string name;
+		std::size_t runs;
+		double medianMs, minMs;
+		std::uint64_t items; // texel fetches, vertices or BRDF evaluations, per run
+		std::uint64_t bytes; // per run, nominal; 0: no throughput
+	};
+
+	// Objects shared by the benchmarks
+	struct Context_
+	{
+		lut::VulkanWindow const& window;
+		lut::Allocator const& allocator;
+		VkCommandPool cmdPool;
+		VkDescriptorPool descPool;
+		lut::SamplerCache& samplers;
+		Options_ const& options;
+	};
+
+	// Times single submissions of recorded commands with a pair of
+	// timestamps around them
+	class GpuTimer_
+	{
+		public:
+			explicit GpuTimer_( lut::VulkanWindow const& );
+
+			// Records aRecord( VkCommandBuffer ), submits, and waits. Returns
+			// the GPU time in milliseconds.
+			template< typename tRecord >
+			double time( tRecord&& aRecord );
+
+		private:
+			lut::VulkanWindow const& mWindow;
+			lut::CommandPool mPool;
+			VkCommandBuffer mCmdBuff;
+			lut::QueryPool mQueries;
+			lut::Fence mFence;
+			double mMsPerTick;
+			std::uint64_t mTickMask;
+	};
+
+	class Bench_
+	{
+		public:
+			Bench_( Options_ const& aOptions, lut::VulkanWindow const& aWindow )
+				: mOptions( aOptions )
+				, mTimer( aWindow )
+			{}
+
+			bool wanted( std::string const& aName ) const
+			{
+				return !mOptions.filter || std::string::npos != aName.find( mOptions.filter );
+			}
+
+			template< typename tRecord >
+			void run( std::string const& aName, std::uint64_t aItems, std::uint64_t aBytes, tRecord&& aRecord )
+			{
+				if( !wanted( aName ) )
+					return;
+
+				mTimer.time( aRecord ); // warm-up
+
+				std::vector<double> times;
+				for( std::size_t i = 0; i < mOptions.runs; ++i )
+					times.emplace_back( mTimer.time( aRecord ) );
+
+				std::sort( times.begin(), times.end() );
+				Result_ result{ aName, times.size(), times[times.size()/2], times.front(), aItems, aBytes };
+
+				std::printf( "%-32s %5zu runs %9.3f ms median %9.3f ms min %9.2f G/s", aName.c_str(), result.runs, result.medianMs, result.minMs, per_s_( result.items, result ) * 1e-9 );
+				if( aBytes > 0 )
+					std::printf( " %10.1f MB/s", per_s_( result.bytes, result ) * 1e-6 );
+				std::printf( "\n" );
+
+				mResults.emplace_back( std::move(result) );
+			}
+
+			std::vector<Result_> const& results() const noexcept { return mResults; }
+
+			// Per second of the median run
+			static double per_s_( std::uint64_t aCount, Result_ const& aResult )
+			{
+				return aResult.medianMs > 0. ? double(aCount) / (aResult.medianMs * 1e-3) : 0.;
+			}
+
+		private:
+			Options_ const& mOptions;
+			GpuTimer_ mTimer;
+			std::vector<Result_> mResults;
+	};
+
+	Options_ parse_options_( int, char* [] );
+
+	void bench_textures_( Bench_&, Context_ const& );
+	void bench_vertices_( Bench_&, Context_ const& );
+	void bench_brdf_( Bench_&, Context_ const& );
+
+	void append_csv_( Options_ const&, lut::VulkanWindow const&, std::vector<Result_> const& );
+
+	// Helpers
+	lut::DescriptorSetLayout create_set_layout_( lut::VulkanWindow const&, std::vector<VkDescriptorSetLayoutBinding> const& );
+	lut::PipelineLayout create_pipe_layout_( lut::VulkanWindow const&, VkDescriptorSetLayout, VkShaderStageFlags aPushStages );
+	lut::Pipeline create_compute_pipe_( lut::VulkanWindow const&, VkPipelineLayout, VkShaderModule, std::uint32_t aConstantId, bool aConstant );
+	lut::Buffer create_sink_( lut::Allocator const&, std::uint32_t aInvocations );
+
+	// Pseudo-random values, the same in every run
+	struct Random_
+	{
+		std::uint32_t state = 0x9e3779b9u;
+
+		std::uint32_t next() noexcept
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+		float unit() noexcept { return float(next() >> 8) * (1.f / 16777216.f); }
+	};
+}
+
+int main( int aArgc, char* aArgv[] ) try
+{
+	auto const options = parse_options_( aArgc, aArgv );
+
+	auto window = lut::make_offscreen_window( VkExtent2D{ 64, 64 }, 1, options.device );
+	auto const allocator = lut::create_allocator( window );
+
+	VkPhysicalDeviceProperties props{};
+	vkGetPhysicalDeviceProperties( window.physicalDevice, &props );
+	std::printf( "Device: %s\n", props.deviceName );
+
+	auto const cmdPool = lut::create_command_pool( window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT );
+	auto const descPool = lut::create_descriptor_pool( window, 64, 64 );
+	lut::SamplerCache samplers( window );
+
+	Context_ const context{ window, allocator, cmdPool.handle, descPool.handle, samplers, options };
+
+	Bench_ bench( options, window );
+	bench_textures_( bench, context );
+	bench_vertices_( bench, context );
+	bench_brdf_( bench, context );
+
+	append_csv_( options, window, bench.results() );
+
+	vkDeviceWaitIdle( window.device );
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level exception [%s]:\n%s\nBye.\n", typeid(eErr).name(), eErr.what() );
+	return 1;
+}
+
+namespace
+{
+	Options_ parse_options_( int aArgc, char* aArgv[] )
+	{
+		// --device=NAME|UUID: as cw2's --device
+		// --csv=FILE: results are appended here (default: cw2-gpubench.csv)
+		// --shader-dir=DIR: SPIR-V of cw2-gpubench/shaders (default:
+		//   assets/cw2-gpubench/shaders)
+		// --label=TEXT: stored with the results, e.g., the revision
+		// --filter=TEXT: only run benchmarks whose name contains TEXT
+		// --runs=N: timed runs per benchmark (default: 20)
+		Options_ ret;
+		for( int i = 1; i < aArgc; ++i )
+		{
+			auto const value_ = [&] (char const* aName) -> char const* {
+				auto const len = std::strlen( aName );
+				if( 0 != std::strncmp( aArgv[i], aName, len ) || '=' != aArgv[i][len] || '\0' == aArgv[i][len+1] )
+					return nullptr;
+				return aArgv[i] + len + 1;
+			};
+
+			if( auto const* v = value_( "--device" ) )
+				ret.device = v;
+			else if( auto const* v = value_( "--csv" ) )
+				ret.csvPath = v;
+			else if( auto const* v = value_( "--shader-dir" ) )
+				ret.shaderDir = v;
+			else if( auto const* v = value_( "--label" ) )
+				ret.label = v;
+			else if( auto const* v = value_( "--filter" ) )
+				ret.filter = v;
+			else if( auto const* v = value_( "--runs" ) )
+			{
+				char* end = nullptr;
+				auto const runs = std::strtoul( v, &end, 10 );
+				if( end == v || '\0' != *end || runs < 1 || runs > kMaxRuns )
+					throw lut::Error( "%s: expected a number of runs between 1 and %zu", aArgv[i], kMaxRuns );
+				ret.runs = std::size_t(runs);
+			}
+			else
+				throw lut::Error( "Unknown option '%s'\nUsage: %s [--device=NAME|UUID] [--csv=FILE] [--shader-dir=DIR] [--label=TEXT] [--filter=TEXT] [--runs=N]", aArgv[i], aArgv[0] );
+		}
+
+		return ret;
+	}
+
+	GpuTimer_::GpuTimer_( lut::VulkanWindow const& aWindow )
+		: mWindow( aWindow )
+		, mPool( lut::create_command_pool( aWindow, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT ) )
+		, mCmdBuff( lut::alloc_command_buffer( aWindow, mPool.handle ) )
+		, mFence( lut::create_fence( aWindow ) )
+	{
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties( aWindow.physicalDevice, &props );
+
+		std::uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( aWindow.physicalDevice, &familyCount, nullptr );
+		std::vector<VkQueueFamilyProperties> families( familyCount );
+		vkGetPhysicalDeviceQueueFamilyProperties( aWindow.physicalDevice, &familyCount, families.data() );
+
+		auto const validBits = families[aWindow.graphicsFamilyIndex].timestampValidBits;
+		if( 0 == validBits )
+			throw lut::Error( "The graphics queue of '%s' has no timestamps", props.deviceName );
+
+		mMsPerTick = double(props.limits.timestampPeriod) * 1e-6;
+		mTickMask = validBits >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << validBits) - 1;
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = 2;
+
+		VkQueryPool pool = VK_NULL_HANDLE;
+		if( auto const res = vkCreateQueryPool( aWindow.device, &poolInfo, nullptr, &pool ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create timestamp query pool\n" "vkCreateQueryPool() returned %s", lut::to_string(res).c_str() );
+
+		mQueries = lut::QueryPool( aWindow.device, pool );
+	}
+
+	template< typename tRecord >
+	double GpuTimer_::time( tRecord&& aRecord )
+	{
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if( auto const res = vkBeginCommandBuffer( mCmdBuff, &beginInfo ); VK_SUCCESS != res )
+			throw lut::Error( "Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str() );
+
+		vkCmdResetQueryPool( mCmdBuff, mQueries.handle, 0, 2 );
+		vkCmdWriteTimestamp( mCmdBuff, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueries.handle, 0 );
+		aRecord( mCmdBuff );
+		vkCmdWriteTimestamp( mCmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueries.handle, 1 );
+
+		if( auto const res = vkEndCommandBuffer( mCmdBuff ); VK_SUCCESS != res )
+			throw lut::Error( "Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str() );
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &mCmdBuff;
+
+		if( auto const res = vkResetFences( mWindow.device, 1, &mFence.handle ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to reset fence\n" "vkResetFences() returned %s", lut::to_string(res).c_str() );
+
+		if( auto const res = vkQueueSubmit( mWindow.graphicsQueue, 1, &submitInfo, mFence.handle ); VK_SUCCESS != res )
+			throw lut::Error( "Submitting commands\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str() );
+
+		if( auto const res = vkWaitForFences( mWindow.device, 1, &mFence.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+			throw lut::Error( "Waiting for the benchmark kernel\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str() );
+
+		std::uint64_t ticks[2]{};
+		if( auto const res = vkGetQueryPoolResults( mWindow.device, mQueries.handle, 0, 2, sizeof(ticks), ticks, sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT ); VK_SUCCESS != res )
+			throw lut::Error( "Reading timestamps\n" "vkGetQueryPoolResults() returned %s", lut::to_string(res).c_str() );
+
+		return double((ticks[1] - ticks[0]) & mTickMask) * mMsPerTick;
+	}
+
+
+	void bench_textures_( Bench_& aBench, Context_ const& aContext )
+	{
+		struct Format_
+		{
+			char const* name;
+			VkFormat format;
+			std::uint32_t blockDim, blockBytes;
+			bool pair; // sampled from two textures
+		};
+
+		// Bits per texel: 32, 8, 16, 2x8, 8, 8, 4
+		static constexpr Format_ kFormats[] = {
+			{ "rgba8", VK_FORMAT_R8G8B8A8_UNORM, 1, 4, false },
+			{ "bc7", VK_FORMAT_BC7_UNORM_BLOCK, 4, 16, false },
+			{ "rg8", VK_FORMAT_R8G8_UNORM, 1, 2, false },
+			{ "r8-pair", VK_FORMAT_R8_UNORM, 1, 1, true },
+			{ "bc5", VK_FORMAT_BC5_UNORM_BLOCK, 4, 16, false },
+			{ "r8", VK_FORMAT_R8_UNORM, 1, 1, false },
+			{ "bc4", VK_FORMAT_BC4_UNORM_BLOCK, 4, 8, false }
+		};
+
+		auto const& window = aContext.window;
+
+		auto const setLayout = create_set_layout_( window, {
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+		} );
+		auto const pipeLayout = create_pipe_layout_( window, setLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT );
+
+		auto const shader = lut::load_shader_module( window, (std::string(aContext.options.shaderDir) + "/texture_fetch.comp.spv").c_str() );
+		lut::Pipeline const pipes[2] = {
+			create_compute_pipe_( window, pipeLayout.handle, shader.handle, 0, false ),
+			create_compute_pipe_( window, pipeLayout.handle, shader.handle, 0, true )
+		};
+
+		auto const sink = create_sink_( aContext.allocator, kTextureGroupSize * kTextureGroupSize );
+
+		// Bilinear, level 0 only (see texture_fetch.comp)
+		VkSamplerCreateInfo sampInfo = lut::default_sampler_info( window );
+		sampInfo.anisotropyEnable = VK_FALSE;
+		sampInfo.maxAnisotropy = 1.f;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		VkSampler const sampler = aContext.samplers.get( sampInfo );
+
+		Random_ random;
+		for( auto const& format : kFormats )
+		{
+			std::string const name = std::string( "texture-fetch/" ) + format.name;
+			if( !aBench.wanted( name ) )
+				continue;
+
+			if( !lut::supports_sampled_format( window, format.format ) )
+			{
+				std::printf( "%-32s skipped: format not supported\n", name.c_str() );
+				continue;
+			}
+
+			// Full mip chains of random texels (or blocks)
+			lut::MipImageData data;
+			data.format = format.format;
+			data.width = data.height = kTextureSize;
+			for( std::uint32_t extent = kTextureSize; ; extent = std::max( extent / 2, 1u ) )
+			{
+				auto const blocks = (extent + format.blockDim - 1) / format.blockDim;
+				data.levelOffsets.emplace_back( VkDeviceSize(data.bytes.size()) );
+				data.levelSizes.emplace_back( VkDeviceSize(blocks) * blocks * format.blockBytes );
+				data.bytes.resize( (data.bytes.size() + data.levelSizes.back() + 15) / 16 * 16 );
+
+				if( 1 == extent )
+					break;
+			}
+			for( auto& byte : data.bytes )
+				byte = std::uint8_t(random.next());
+
+			std::uint32_t const textures = format.pair ? 2 : 1;
+
+			std::vector<lut::Image> images;
+			std::vector<lut::ImageView> views;
+			{
+				lut::UploadBatch batch( window, aContext.cmdPool, aContext.allocator, VkDeviceSize(data.bytes.size()) * textures );
+				for( std::uint32_t i = 0; i < textures; ++i )
+				{
+					images.emplace_back( lut::create_image_texture2d( aContext.allocator, kTextureSize, kTextureSize, format.format ) );
+					views.emplace_back( lut::create_image_view_texture2d( window, images.back().image, format.format ) );
+					batch.upload_image( images.back().image, data );
+				}
+				batch.submit().wait();
+			}
+
+			VkDescriptorSet const set = lut::alloc_desc_set( window, aContext.descPool, setLayout.handle );
+			{
+				VkDescriptorImageInfo imageInfo[2]{};
+				for( std::uint32_t i = 0; i < 2; ++i )
+				{
+					imageInfo[i].sampler = sampler;
+					imageInfo[i].imageView = views[std::min( i, textures - 1 )].handle;
+					imageInfo[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				}
+
+				VkDescriptorBufferInfo bufferInfo{};
+				bufferInfo.buffer = sink.buffer;
+				bufferInfo.range = VK_WHOLE_SIZE;
+
+				VkWriteDescriptorSet desc[3]{};
+				for( std::uint32_t i = 0; i < 3; ++i )
+				{
+					desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					desc[i].dstSet = set;
+					desc[i].dstBinding = i;
+					desc[i].descriptorCount = 1;
+					desc[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					if( i < 2 )
+						desc[i].pImageInfo = &imageInfo[i];
+					else
+						desc[i].pBufferInfo = &bufferInfo;
+				}
+
+				vkUpdateDescriptorSets( window.device, 3, desc, 0, nullptr );
+			}
+
+			std::uint64_t const fetches = std::uint64_t(kTextureSize) * kTextureSize * kTextureFetches * textures;
+			std::uint64_t const bytes = fetches * format.blockBytes / (format.blockDim * format.blockDim);
+
+			aBench.run( name, fetches, bytes, [&] (VkCommandBuffer aCmdBuff) {
+				vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, pipes[format.pair ? 1 : 0].handle );
+				vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout.handle, 0, 1, &set, 0, nullptr );
+				vkCmdPushConstants( aCmdBuff, pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(std::uint32_t), &kTextureFetches );
+				vkCmdDispatch( aCmdBuff, kTextureSize / kTextureGroupSize, kTextureSize / kTextureGroupSize, 1 );
+			} );
+
+			vkFreeDescriptorSets( window.device, aContext.descPool, 1, &set );
+		}
+	}
+
+	void bench_vertices_( Bench_& aBench, Context_ const& aContext )
+	{
+		enum class ELayout_ { interleaved, split, quantized };
+		struct Layout_
+		{
+			char const* name;
+			ELayout_ layout;
+		};
+
+		static constexpr Layout_ kLayouts[] = {
+			{ "interleaved", ELayout_::interleaved }, // InterleavedVertex
+			{ "split", ELayout_::split }, // InterleavedVertex's members, a stream each
+			{ "quantized", ELayout_::quantized } // QuantizedVertex
+		};
+
+		auto const& window = aContext.window;
+		auto const& allocator = aContext.allocator;
+
+		// No attachments: every vertex is clipped (see vertex_fetch.vert)
+		lut::RenderPass renderPass;
+		{
+			VkSubpassDescription subpass{};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+			VkRenderPassCreateInfo passInfo{};
+			passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			passInfo.subpassCount = 1;
+			passInfo.pSubpasses = &subpass;
+
+			VkRenderPass pass = VK_NULL_HANDLE;
+			if( auto const res = vkCreateRenderPass( window.device, &passInfo, nullptr, &pass ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str() );
+
+			renderPass = lut::RenderPass( window.device, pass );
+		}
+
+		lut::Framebuffer framebuffer;
+		{
+			VkFramebufferCreateInfo fbInfo{};
+			fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			fbInfo.renderPass = renderPass.handle;
+			fbInfo.width = 1;
+			fbInfo.height = 1;
+			fbInfo.layers = 1;
+
+			VkFramebuffer fb = VK_NULL_HANDLE;
+			if( auto const res = vkCreateFramebuffer( window.device, &fbInfo, nullptr, &fb ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create framebuffer\n" "vkCreateFramebuffer() returned %s", lut::to_string(res).c_str() );
+
+			framebuffer = lut::Framebuffer( window.device, fb );
+		}
+
+		auto const pipeLayout = create_pipe_layout_( window, VK_NULL_HANDLE, 0 );
+		auto const shader = lut::load_shader_module( window, (std::string(aContext.options.shaderDir) + "/vertex_fetch.vert.spv").c_str() );
+
+		Random_ random;
+		for( auto const& layout : kLayouts )
+		{
+			std::string const name = std::string( "vertex-fetch/" ) + layout.name;
+			if( !aBench.wanted( name ) )
+				continue;
+
+			// Vertex input, and the contents of the streams
+			std::vector<VkVertexInputBindingDescription> bindings;
+			std::vector<VkVertexInputAttributeDescription> attributes;
+			std::vector<std::vector<std::uint8_t>> streams;
+
+			if( ELayout_::quantized == layout.layout )
+			{
+				bindings.emplace_back( vertex_binding<QuantizedVertex>( 0 ) );
+				attributes.resize( std::size( VertexLayout<QuantizedVertex>::kAttributes ) );
+				vertex_attributes<QuantizedVertex>( attributes.data(), 0 );
+
+				auto& stream = streams.emplace_back( std::size_t(kVertexCount) * sizeof(QuantizedVertex) );
+				for( std::uint32_t i = 0; i < kVertexCount; ++i )
+				{
+					QuantizedVertex v{};
+					for( auto& c : v.position )
+						c = std::uint16_t(random.next());
+					for( auto& c : v.texcoord )
+						c = glm::packHalf1x16( random.unit() );
+					for( auto& c : v.normal )
+						c = std::int16_t(random.next());
+					for( auto& c : v.tangent )
+						c = std::int16_t(random.next());
+					store_vertex( stream.data(), i, v );
+				}
+			}
+			else
+			{
+				auto const& members = VertexLayout<InterleavedVertex>::kAttributes;
+				if( ELayout_::interleaved == layout.layout )
+				{
+					bindings.emplace_back( vertex_binding<InterleavedVertex>( 0 ) );
+					attributes.resize( std::size( members ) );
+					vertex_attributes<InterleavedVertex>( attributes.data(), 0 );
+					streams.emplace_back( std::size_t(kVertexCount) * sizeof(InterleavedVertex) );
+				}
+				else
+				{
+					for( std::uint32_t i = 0; i < std::size( members ); ++i )
+					{
+						bindings.emplace_back( VkVertexInputBindingDescription{ i, members[i].size, VK_VERTEX_INPUT_RATE_VERTEX } );
+						attributes.emplace_back( VkVertexInputAttributeDescription{ members[i].location, i, members[i].format, 0 } );
+						streams.emplace_back( std::size_t(kVertexCount) * members[i].size );
+					}
+				}
+
+				// All members are floats
+				for( auto& stream : streams )
+				{
+					for( std::size_t i = 0; i < stream.size(); i += sizeof(float) )
+					{
+						float const value = random.unit();
+						std::memcpy( stream.data() + i, &value, sizeof(float) );
+					}
+				}
+			}
+
+			std::vector<lut::Buffer> buffers;
+			std::vector<VkBuffer> handles;
+			std::vector<VkDeviceSize> offsets;
+			std::uint64_t bytes = 0;
+			{
+				lut::UploadBatch batch( window, aContext.cmdPool, allocator );
+				for( auto const& stream : streams )
+				{
+					buffers.emplace_back( lut::create_buffer( allocator, stream.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::geometry ) );
+					batch.upload_buffer( buffers.back().buffer, stream.data(), stream.size(), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
+
+					handles.emplace_back( buffers.back().buffer );
+					offsets.emplace_back( 0 );
+					bytes += stream.size();
+				}
+				batch.submit().wait();
+			}
+
+			lut::Pipeline pipe;
+			{
+				VkPipelineShaderStageCreateInfo stage{};
+				stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+				stage.module = shader.handle;
+				stage.pName = "main";
+
+				VkPipelineVertexInputStateCreateInfo inputInfo{};
+				inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+				inputInfo.vertexBindingDescriptionCount = std::uint32_t(bindings.size());
+				inputInfo.pVertexBindingDescriptions = bindings.data();
+				inputInfo.vertexAttributeDescriptionCount = std::uint32_t(attributes.size());
+				inputInfo.pVertexAttributeDescriptions = attributes.data();
+
+				VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+				assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+				assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
+				VkViewport viewport{ 0.f, 0.f, 1.f, 1.f, 0.f, 1.f };
+				VkRect2D scissor{ { 0, 0 }, { 1, 1 } };
+
+				VkPipelineViewportStateCreateInfo viewportInfo{};
+				viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+				viewportInfo.viewportCount = 1;
+				viewportInfo.pViewports = &viewport;
+				viewportInfo.scissorCount = 1;
+				viewportInfo.pScissors = &scissor;
+
+				VkPipelineRasterizationStateCreateInfo rasterInfo{};
+				rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+				rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+				rasterInfo.cullMode = VK_CULL_MODE_NONE;
+				rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+				rasterInfo.lineWidth = 1.f;
+
+				VkPipelineMultisampleStateCreateInfo samplingInfo{};
+				samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+				samplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+				VkGraphicsPipelineCreateInfo pipeInfo{};
+				pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+				pipeInfo.stageCount = 1;
+				pipeInfo.pStages = &stage;
+				pipeInfo.pVertexInputState = &inputInfo;
+				pipeInfo.pInputAssemblyState = &assemblyInfo;
+				pipeInfo.pViewportState = &viewportInfo;
+				pipeInfo.pRasterizationState = &rasterInfo;
+				pipeInfo.pMultisampleState = &samplingInfo;
+				pipeInfo.layout = pipeLayout.handle;
+				pipeInfo.renderPass = renderPass.handle;
+				pipeInfo.subpass = 0;
+
+				VkPipeline handle = VK_NULL_HANDLE;
+				if( auto const res = vkCreateGraphicsPipelines( window.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &handle ); VK_SUCCESS != res )
+					throw lut::Error( "Unable to create vertex fetch pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str() );
+
+				pipe = lut::Pipeline( window.device, handle );
+			}
+
+			aBench.run( name, kVertexCount, bytes, [&] (VkCommandBuffer aCmdBuff) {
+				VkRenderPassBeginInfo passInfo{};
+				passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+				passInfo.renderPass = renderPass.handle;
+				passInfo.framebuffer = framebuffer.handle;
+				passInfo.renderArea.extent = VkExtent2D{ 1, 1 };
+
+				vkCmdBeginRenderPass( aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE );
+				vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.handle );
+				vkCmdBindVertexBuffers( aCmdBuff, 0, std::uint32_t(handles.size()), handles.data(), offsets.data() );
+				vkCmdDraw( aCmdBuff, kVertexCount, 1, 0, 0 );
+				vkCmdEndRenderPass( aCmdBuff );
+			} );
+		}
+	}
+
+	void bench_brdf_( Bench_& aBench, Context_ const& aContext )
+	{
+		auto const& window = aContext.window;
+
+		// Binding 8 is the distribution LUT, as in the scene's set 0
+		auto const setLayout = create_set_layout_( window, {
+			{ 8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+		} );
+		auto const pipeLayout = create_pipe_layout_( window, setLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT );
+
+		auto const distLut = create_distribution_lut( window, aContext.allocator, aContext.samplers, aContext.cmdPool );
+		auto const sink = create_sink_( aContext.allocator, kBrdfGroupSize );
+
+		VkDescriptorSet const set = lut::alloc_desc_set( window, aContext.descPool, setLayout.handle );
+		{
+			VkDescriptorImageInfo imageInfo{};
+			imageInfo.sampler = distLut.sampler;
+			imageInfo.imageView = distLut.view.handle;
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			VkDescriptorBufferInfo bufferInfo{};
+			bufferInfo.buffer = sink.buffer;
+			bufferInfo.range = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet desc[2]{};
+			desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[0].dstSet = set;
+			desc[0].dstBinding = 8;
+			desc[0].descriptorCount = 1;
+			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[0].pImageInfo = &imageInfo;
+
+			desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[1].dstSet = set;
+			desc[1].dstBinding = 15;
+			desc[1].descriptorCount = 1;
+			desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			desc[1].pBufferInfo = &bufferInfo;
+
+			vkUpdateDescriptorSets( window.device, 2, desc, 0, nullptr );
+		}
+
+		struct Variant_
+		{
+			char const* name;
+			char const* shader;
+			bool distributionLut;
+			bool fp16;
+		};
+
+		static constexpr Variant_ kVariants[] = {
+			{ "brdf/fp32-analytic", "brdf.comp.spv", false, false },
+			{ "brdf/fp32-lut", "brdf.comp.spv", true, false },
+			{ "brdf/fp16-analytic", "brdf_fp16.comp.spv", false, true },
+			{ "brdf/fp16-lut", "brdf_fp16.comp.spv", true, true }
+		};
+
+		std::uint64_t const evaluations = std::uint64_t(kBrdfInvocations) * kBrdfEvaluations;
+		for( auto const& variant : kVariants )
+		{
+			if( !aBench.wanted( variant.name ) )
+				continue;
+
+			if( variant.fp16 && !window.caps.shaderFloat16 )
+			{
+				std::printf( "%-32s skipped: no shaderFloat16\n", variant.name );
+				continue;
+			}
+
+			// kDistributionLut is constant_id 5 (see distribution_lut.glsl)
+			auto const shader = lut::load_shader_module( window, (std::string(aContext.options.shaderDir) + "/" + variant.shader).c_str() );
+			auto const pipe = create_compute_pipe_( window, pipeLayout.handle, shader.handle, 5, variant.distributionLut );
+
+			aBench.run( variant.name, evaluations, 0, [&] (VkCommandBuffer aCmdBuff) {
+				vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, pipe.handle );
+				vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout.handle, 0, 1, &set, 0, nullptr );
+				vkCmdPushConstants( aCmdBuff, pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(std::uint32_t), &kBrdfEvaluations );
+				vkCmdDispatch( aCmdBuff, kBrdfInvocations / kBrdfGroupSize, 1, 1 );
+			} );
+		}
+	}
+
+	void append_csv_( Options_ const& aOptions, lut::VulkanWindow const& aWindow, std::vector<Result_> const& aResults )
+	{
+		if( aResults.empty() )
+			return;
+
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties( aWindow.physicalDevice, &props );
+
+		std::error_code ec;
+		bool const fresh = !std::filesystem::exists( aOptions.csvPath, ec ) || 0 == std::filesystem::file_size( aOptions.csvPath, ec );
+
+		std::FILE* file = std::fopen( aOptions.csvPath, "a" );
+		if( !file )
+			throw lut::Error( "Unable to open '%s' for appending", aOptions.csvPath );
+
+		if( fresh )
+			std::fprintf( file, "date,label,device,driver,benchmark,runs,median_ms,min_ms,items,bytes,items_per_s,mb_per_s\n" );
+
+		char date[32];
+		std::time_t const now = std::time( nullptr );
+		std::strftime( date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime( &now ) );
+
+		// Device names may contain commas; quote them and the labels
+		for( auto const& result : aResults )
+		{
+			std::fprintf( file, "%s,\"%s\",\"%s\",%u,%s,%zu,%.4f,%.4f,%llu,%llu,%.4e,%.2f\n", date, aOptions.label, props.deviceName, props.driverVersion,
+				result.name.c_str(), result.runs, result.medianMs, result.minMs, static_cast<unsigned long long>(result.items), static_cast<unsigned long long>(result.bytes),
+				Bench_::per_s_( result.items, result ), Bench_::per_s_( result.bytes, result ) * 1e-6 );
+		}
+
+		bool const ok = !std::ferror( file );
+		if( 0 != std::fclose( file ) || !ok )
+			throw lut::Error( "Unable to write '%s'", aOptions.csvPath );
+
+		std::printf( "%zu results appended to '%s'\n", aResults.size(), aOptions.csvPath );
+	}
+
+
+	lut::DescriptorSetLayout create_set_layout_( lut::VulkanWindow const& aWindow, std::vector<VkDescriptorSetLayoutBinding> const& aBindings )
+	{
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = std::uint32_t(aBindings.size());
+		layoutInfo.pBindings = aBindings.data();
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		return lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	lut::PipelineLayout create_pipe_layout_( lut::VulkanWindow const& aWindow, VkDescriptorSetLayout aSetLayout, VkShaderStageFlags aPushStages )
+	{
+		// One uint: the fetches or evaluations per invocation
+		VkPushConstantRange pushRange{};
+		pushRange.stageFlags = aPushStages;
+		pushRange.size = sizeof(std::uint32_t);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = VK_NULL_HANDLE != aSetLayout ? 1 : 0;
+		layoutInfo.pSetLayouts = &aSetLayout;
+		layoutInfo.pushConstantRangeCount = 0 != aPushStages ? 1 : 0;
+		layoutInfo.pPushConstantRanges = &pushRange;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		return lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	lut::Pipeline create_compute_pipe_( lut::VulkanWindow const& aWindow, VkPipelineLayout aLayout, VkShaderModule aShader, std::uint32_t aConstantId, bool aConstant )
+	{
+		VkBool32 const value = aConstant ? VK_TRUE : VK_FALSE;
+		VkSpecializationMapEntry const entry{ aConstantId, 0, sizeof(VkBool32) };
+
+		VkSpecializationInfo specInfo{};
+		specInfo.mapEntryCount = 1;
+		specInfo.pMapEntries = &entry;
+		specInfo.dataSize = sizeof(VkBool32);
+		specInfo.pData = &value;
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = aShader;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.stage.pSpecializationInfo = &specInfo;
+		pipeInfo.layout = aLayout;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create compute pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		return lut::Pipeline( aWindow.device, pipe );
+	}
+
+	lut::Buffer create_sink_( lut::Allocator const& aAllocator, std::uint32_t aInvocations )
+	{
+		// A vec4 per invocation of a work group; never actually written
+		return lut::create_buffer( aAllocator, VkDeviceSize(aInvocations) * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::device );
+	}
+}
@@ -0,0 +1,60 @@
+// Body of brdf.comp and brdf_fp16.comp. Included via #include; define
+// HALF_PRECISION (with GL_EXT_shader_explicit_arithmetic_types_float16) for
+// the fp16 terms.
+//
+// ALU cost of the BRDF of default.frag (see cw2-gpubench/main.cpp): each
+// invocation evaluates reflectance() of cw2/shaders/shading.glsl
+// uParams.evaluations times, with the light direction and roughness varied
+// per evaluation. The variants are those of the forward shaders: fp32 or
+// fp16 arithmetic, and the analytic or tabulated (the kDistributionLut
+// specialization constant) D term.
+
+layout( local_size_x = 64 ) in;
+
+// Declared for shading.glsl; not used by reflectance()
+layout( std140, set = 0, binding = 0 ) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+} uScene;
+
+#include "shading.glsl"
+
+// Past the bindings of the scene's set 0 that shading.glsl declares
+layout( set = 0, binding = 15, std430 ) writeonly buffer Sink
+{
+	vec4 values[]; // per invocation of the work group
+} uSink;
+
+layout( push_constant ) uniform Params
+{
+	uint evaluations;
+} uParams;
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	float seed = float(id & 1023u) * (1.0 / 1024.0);
+
+	vec3 N = normalize( vec3( seed - 0.5, 1.0, 0.25 ) );
+	vec3 V = normalize( vec3( 0.3, 0.8, seed ) );
+	vec3 albedo = vec3( 0.8, 0.6, seed );
+	float metalness = seed;
+
+	vec3 sum = vec3( 0.0 );
+	for( uint i = 0; i < uParams.evaluations; ++i )
+	{
+		float t = float(i) * 0.618034 + seed;
+		vec3 L = normalize( vec3( cos( t ), 1.0, sin( t ) ) );
+		float roughness = fract( t );
+		sum += reflectance( albedo, roughness, metalness, N, V, L );
+	}
+
+	// Never true; keeps the evaluations alive
+	if( sum.x < -1.0 )
+		uSink.values[gl_LocalInvocationIndex] = vec4( sum, 1.0 );
+}
@@ -0,0 +1,18 @@
+#version 450
+
+// Vertex fetch rate (see cw2-gpubench/main.cpp): the attributes of
+// default.vert, from the vertex buffer layout under test. Each vertex is a
+// point far outside the clip volume, so nothing is rasterized, but the
+// position depends on every attribute.
+
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec2 iTexCoord;
+layout( location = 2 ) in vec3 iNormal;
+layout( location = 3 ) in vec4 iTangent;
+
+void main()
+{
+	vec3 sum = iPosition + iNormal + iTangent.xyz * iTangent.w + vec3( iTexCoord, 0.0 );
+	gl_Position = vec4( sum + 1e6, 1.0 );
+	gl_PointSize = 1.0;
+}
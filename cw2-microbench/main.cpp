@@ -0,0 +1,617 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <typeinfo>
+#include <exception>
+#include <filesystem>
+
+#include <cmath>
+#include <ctime>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <stb_image.h>
+#include <glm/glm.hpp>
+
+#include "../cw2-bake/index_mesh.hpp"
+#include "../cw2-bake/input_model.hpp"
+#include "../cw2-bake/load_model_obj.hpp"
+
+#include "../cw2/baked_model.hpp"
+#include "../cw2/quantized_vertex.hpp"
+#include "../cw2/interleaved_vertex.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkimage.hpp"
+#include "../labutils/texture_file.hpp"
+#include "../labutils/image_decoder.hpp"
+namespace lut = labutils;
+
+/* Microbenchmarks of the baker's and the loader's hot paths. Each benchmark
+ * is run until it has taken --min-time seconds (and at least three times),
+ * after one warm-up run; the median and the fastest run are reported. Every
+ * run appends a row per benchmark to the CSV file, so that the numbers of
+ * different revisions (see --label) can be compared over time.
+ *
+ * The mesh benchmarks use generated grids, so they run anywhere. The others
+ * need the cw2 assets (the OBJ of assets-src/cw2, the baked model of
+ * assets/cw2), and are skipped without them.
+ */
+
+namespace
+{
+	constexpr char const* kDefaultObjPath = "assets-src/cw2/sponza-pbr.obj";
+	constexpr char const* kDefaultModelPath = "assets/cw2/sponza-pbr.comp5822mesh";
+	constexpr char const* kDefaultCsvPath = "cw2-microbench.csv";
+	constexpr char const* kDefaultTextureDir = "assets/cw2/sponza-pbr-tex";
+
+	// Runs per benchmark, regardless of --min-time
+	constexpr std::size_t kMinRuns = 3;
+	constexpr std::size_t kMaxRuns = 1000;
+
+	// Grid sizes (quads per side) and error tolerances of make_indexed_mesh()
+	constexpr std::size_t kGridSizes[] = { 16, 128, 512 };
+
+	// Corners of the near-duplicate cloud, and the average number of them
+	// per 2 * 1e-3 wide cell of the welding grid
+	constexpr std::size_t kCloudCorners = 3*100000;
+	constexpr std::size_t kCloudDensity = 16;
+	constexpr float kErrorTolerances[] = { 0.f, 1e-6f, 1e-3f };
+
+	using Clock_ = std::chrono::steady_clock;
+
+	struct Options_
+	{
+		char const* objPath = kDefaultObjPath;
+		char const* modelPath = kDefaultModelPath;
+		char const* texturePath = nullptr; // null: the OBJ's largest base colour texture
+		char const* textureDir = kDefaultTextureDir;
+		char const* csvPath = kDefaultCsvPath;
+		char const* label = ""; // e.g., the revision
+		char const* filter = nullptr; // null: all
+		double minTime = 1.0; // seconds
+	};
+
+	struct Result_
+	{
+		std::string name;
+		std::size_t runs;
+		double medianMs, minMs;
+		std::uint64_t bytes; // per run; 0: no throughput
+	};
+
+	class Bench_
+	{
+		public:
+			explicit Bench_( Options_ const& aOptions )
+				: mOptions( aOptions )
+			{}
+
+			// aFn returns a value that depends on all of its work, so that
+			// none of it can be optimized away.
+			template< typename tFn >
+			void run( std::string const& aName, std::uint64_t aBytes, tFn&& aFn )
+			{
+				if( mOptions.filter && std::string::npos == aName.find( mOptions.filter ) )
+					return;
+
+				mSink += std::size_t(aFn());
+
+				std::vector<double> times;
+				auto const budget = std::chrono::duration<double>( mOptions.minTime );
+				auto const start = Clock_::now();
+				while( times.size() < kMaxRuns && (times.size() < kMinRuns || Clock_::now() - start < budget) )
+				{
+					auto const runStart = Clock_::now();
+					mSink += std::size_t(aFn());
+					times.emplace_back( std::chrono::duration<double,std::milli>( Clock_::now() - runStart ).count() );
+				}
+
+				std::sort( times.begin(), times.end() );
+				Result_ result{ aName, times.size(), times[times.size()/2], times.front(), aBytes };
+
+				std::printf( "%-48s %6zu runs %11.3f ms median %11.3f ms min", aName.c_str(), result.runs, result.medianMs, result.minMs );
+				if( aBytes > 0 )
+					std::printf( " %9.1f MB/s", mbps_( result ) );
+				std::printf( "\n" );
+
+				mResults.emplace_back( std::move(result) );
+			}
+
+			std::vector<Result_> const& results() const noexcept { return mResults; }
+
+			static double mbps_( Result_ const& aResult )
+			{
+				return aResult.bytes > 0 && aResult.medianMs > 0. ? double(aResult.bytes) / 1e6 / (aResult.medianMs * 1e-3) : 0.;
+			}
+
+		private:
+			Options_ const& mOptions;
+			std::vector<Result_> mResults;
+			std::size_t volatile mSink = 0;
+	};
+
+	Options_ parse_options_( int, char* [] );
+
+	// Two triangles per quad, with each corner repeated for every triangle
+	// that uses it (as load_wavefront_obj() delivers them). Positions are
+	// jittered by less than the smallest non-zero tolerance above.
+	TriangleSoup make_grid_( std::size_t aQuads );
+
+	// Corners at pseudo-random positions that are close, but not equal, to
+	// each other: the welding grid's cells hold many candidates each
+	TriangleSoup make_cloud_( std::size_t aCorners, std::size_t aDensity, float aTolerance );
+
+	void bench_meshes_( Bench_& );
+	void bench_models_( Bench_&, Options_ const&, std::string& aTexturePath, std::string& aBakedTexturePath );
+	void bench_decoders_( Bench_&, std::string const& aTexturePath, std::string const& aBakedTexturePath );
+	void bench_texture_set_( Bench_&, Options_ const& );
+
+	void append_csv_( Options_ const&, std::vector<Result_> const& );
+}
+
+int main( int aArgc, char* aArgv[] ) try
+{
+	auto const options = parse_options_( aArgc, aArgv );
+
+	Bench_ bench( options );
+	bench_meshes_( bench );
+
+	std::string texturePath = options.texturePath ? options.texturePath : "";
+	std::string bakedTexturePath;
+	bench_models_( bench, options, texturePath, bakedTexturePath );
+	bench_decoders_( bench, texturePath, bakedTexturePath );
+	bench_texture_set_( bench, options );
+
+	append_csv_( options, bench.results() );
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::fprintf( stderr, "Top-level exception [%s]:\n%s\nBye.\n", typeid(eErr).name(), eErr.what() );
+	return 1;
+}
+
+namespace
+{
+	Options_ parse_options_( int aArgc, char* aArgv[] )
+	{
+		// --obj=FILE: OBJ for load_wavefront_obj() (default: Sponza)
+		// --model=FILE: baked model for load_baked_model()/map_baked_model()
+		//   (default: the one cw2 loads)
+		// --texture=FILE: image for the decoders (default: the OBJ's largest
+		//   base colour texture)
+		// --texture-dir=DIR: JPEG and PNG images for the decoder throughput
+		//   (default: the textures of the baked Sponza)
+		// --csv=FILE: results are appended here (default: cw2-microbench.csv)
+		// --label=TEXT: stored with the results, e.g., the revision
+		// --filter=TEXT: only run benchmarks whose name contains TEXT
+		// --min-time=SECONDS: time spent per benchmark (default: 1)
+		Options_ ret;
+		for( int i = 1; i < aArgc; ++i )
+		{
+			auto const value_ = [&] (char const* aName) -> char const* {
+				auto const len = std::strlen( aName );
+				if( 0 != std::strncmp( aArgv[i], aName, len ) || '=' != aArgv[i][len] || '\0' == aArgv[i][len+1] )
+					return nullptr;
+				return aArgv[i] + len + 1;
+			};
+
+			if( auto const* v = value_( "--obj" ) )
+				ret.objPath = v;
+			else if( auto const* v = value_( "--model" ) )
+				ret.modelPath = v;
+			else if( auto const* v = value_( "--texture" ) )
+				ret.texturePath = v;
+			else if( auto const* v = value_( "--texture-dir" ) )
+				ret.textureDir = v;
+			else if( auto const* v = value_( "--csv" ) )
+				ret.csvPath = v;
+			else if( auto const* v = value_( "--label" ) )
+				ret.label = v;
+			else if( auto const* v = value_( "--filter" ) )
+				ret.filter = v;
+			else if( auto const* v = value_( "--min-time" ) )
+			{
+				char* end = nullptr;
+				ret.minTime = std::strtod( v, &end );
+				if( end == v || '\0' != *end || !(ret.minTime >= 0.) )
+					throw lut::Error( "%s: expected a non-negative number of seconds", aArgv[i] );
+			}
+			else
+				throw lut::Error( "Unknown option '%s'\nUsage: %s [--obj=FILE] [--model=FILE] [--texture=FILE] [--texture-dir=DIR] [--csv=FILE] [--label=TEXT] [--filter=TEXT] [--min-time=SECONDS]", aArgv[i], aArgv[0] );
+		}
+
+		return ret;
+	}
+
+	TriangleSoup make_grid_( std::size_t aQuads )
+	{
+		auto const corner_ = [&] (std::size_t aX, std::size_t aY) {
+			// Deterministic jitter, well below 1e-6
+			float const jitter = float((aX * 7919 + aY * 104729) % 97) * 1e-9f;
+			return glm::vec3( float(aX) / float(aQuads) + jitter, 0.f, float(aY) / float(aQuads) );
+		};
+
+		TriangleSoup ret;
+		for( std::size_t y = 0; y < aQuads; ++y )
+		{
+			for( std::size_t x = 0; x < aQuads; ++x )
+			{
+				std::pair<std::size_t, std::size_t> const corners[6] = { { x, y }, { x, y+1 }, { x+1, y }, { x+1, y }, { x, y+1 }, { x+1, y+1 } };
+				for( auto const& [cx, cy] : corners )
+				{
+					ret.vert.emplace_back( corner_( cx, cy ) );
+					ret.norm.emplace_back( 0.f, 1.f, 0.f );
+					ret.text.emplace_back( float(cx) / float(aQuads), float(cy) / float(aQuads) );
+				}
+			}
+		}
+
+		return ret;
+	}
+
+	TriangleSoup make_cloud_( std::size_t aCorners, std::size_t aDensity, float aTolerance )
+	{
+		float const side = std::cbrt( float(aCorners) / float(aDensity) ) * 2.f * aTolerance;
+
+		// Deterministic (LCG), so that revisions can be compared
+		std::uint32_t state = 12345u;
+		auto const next_ = [&] {
+			state = state * 1664525u + 1013904223u;
+			return float(state >> 8) / float(1u << 24);
+		};
+
+		TriangleSoup ret;
+		for( std::size_t i = 0; i < aCorners; ++i )
+		{
+			ret.vert.emplace_back( next_() * side, next_() * side, next_() * side );
+			ret.norm.emplace_back( 0.f, 1.f, 0.f );
+			ret.text.emplace_back( next_() * 4.f * aTolerance, 0.f );
+		}
+
+		return ret;
+	}
+
+	// The conversion of upload_meshes_() (cw2/load_data_to_vk.cpp) for
+	// vertices with separate attribute arrays: InterleavedVertex, or
+	// QuantizedVertex.
+	std::size_t interleave_( IndexedMesh const& aMesh, bool aQuantized, std::vector<std::uint8_t>& aOut )
+	{
+		std::size_t const vertexSize = aQuantized ? sizeof(QuantizedVertex) : sizeof(InterleavedVertex);
+		aOut.resize( aMesh.vert.size() * vertexSize );
+
+		for( std::size_t i = 0; i < aMesh.vert.size(); ++i )
+		{
+			glm::vec4 const tan = aMesh.tangent.empty() ? glm::vec4( 1.f, 0.f, 0.f, 1.f ) : aMesh.tangent[i];
+			if( aQuantized )
+				store_vertex( aOut.data(), i, quantize_vertex( aMesh.vert[i], aMesh.text[i], aMesh.norm[i], tan, aMesh.aabbMin, aMesh.aabbMax ) );
+			else
+				store_vertex( aOut.data(), i, InterleavedVertex{ aMesh.vert[i], aMesh.text[i], aMesh.norm[i], tan } );
+		}
+
+		return aOut.size() + aOut.back();
+	}
+
+	void bench_meshes_( Bench_& aBench )
+	{
+		std::vector<std::uint8_t> scratch;
+		for( auto const quads : kGridSizes )
+		{
+			auto const soup = make_grid_( quads );
+			auto const soupBytes = std::uint64_t(soup.vert.size()) * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2));
+			auto const suffix = " (" + std::to_string( soup.vert.size() ) + " corners)";
+
+			for( auto const tolerance : kErrorTolerances )
+			{
+				char name[64];
+				std::snprintf( name, sizeof(name), "make_indexed_mesh() tol=%g", double(tolerance) );
+				aBench.run( name + suffix, soupBytes, [&] {
+					return make_indexed_mesh( soup, tolerance, false ).indices.size();
+				} );
+
+				if( 0.f == tolerance )
+					continue;
+
+				// The scalar tolerance tests, for comparison; they must weld
+				// the same way as the SIMD ones
+				if( make_indexed_mesh( soup, tolerance, false, false ).indices != make_indexed_mesh( soup, tolerance, false ).indices )
+					throw lut::Error( "make_indexed_mesh() tol=%g: scalar and SIMD welds differ", double(tolerance) );
+
+				std::snprintf( name, sizeof(name), "make_indexed_mesh() tol=%g scalar", double(tolerance) );
+				aBench.run( name + suffix, soupBytes, [&] {
+					return make_indexed_mesh( soup, tolerance, false, false ).indices.size();
+				} );
+			}
+
+			aBench.run( "make_indexed_mesh() + tangents" + suffix, soupBytes, [&] {
+				return make_indexed_mesh( soup, 1e-6f, true ).indices.size();
+			} );
+
+			auto const mesh = make_indexed_mesh( soup, 1e-6f, true );
+			auto const vertexSuffix = " (" + std::to_string( mesh.vert.size() ) + " vertices)";
+			aBench.run( "interleave fp32" + vertexSuffix, mesh.vert.size() * sizeof(InterleavedVertex), [&] {
+				return interleave_( mesh, false, scratch );
+			} );
+			aBench.run( "interleave quantized" + vertexSuffix, mesh.vert.size() * sizeof(InterleavedVertex), [&] {
+				return interleave_( mesh, true, scratch );
+			} );
+		}
+
+		// Where the tolerance tests dominate
+		{
+			constexpr float kTolerance = 1e-3f;
+			auto const soup = make_cloud_( kCloudCorners, kCloudDensity, kTolerance );
+			auto const soupBytes = std::uint64_t(soup.vert.size()) * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2));
+			auto const suffix = " (" + std::to_string( soup.vert.size() ) + " cloud corners)";
+
+			if( make_indexed_mesh( soup, kTolerance, false, false ).indices != make_indexed_mesh( soup, kTolerance, false ).indices )
+				throw lut::Error( "make_indexed_mesh() cloud: scalar and SIMD welds differ" );
+
+			aBench.run( "make_indexed_mesh() tol=0.001" + suffix, soupBytes, [&] {
+				return make_indexed_mesh( soup, kTolerance, false ).indices.size();
+			} );
+			aBench.run( "make_indexed_mesh() tol=0.001 scalar" + suffix, soupBytes, [&] {
+				return make_indexed_mesh( soup, kTolerance, false, false ).indices.size();
+			} );
+		}
+	}
+
+	void bench_models_( Bench_& aBench, Options_ const& aOptions, std::string& aTexturePath, std::string& aBakedTexturePath )
+	{
+		namespace fs = std::filesystem;
+
+		std::error_code ec;
+		if( auto const bytes = fs::file_size( aOptions.objPath, ec ); !ec )
+		{
+			aBench.run( "load_wavefront_obj()", bytes, [&] {
+				return load_wavefront_obj( aOptions.objPath ).positions.size();
+			} );
+
+			// The largest base colour texture (the first ones may be
+			// placeholders, e.g., a plain white image)
+			if( aTexturePath.empty() )
+			{
+				auto const model = load_wavefront_obj( aOptions.objPath );
+
+				std::uintmax_t largest = 0;
+				for( auto const& mat : model.materials )
+				{
+					auto const size = mat.baseColorTexturePath.empty() ? 0 : fs::file_size( mat.baseColorTexturePath, ec );
+					if( !ec && size > largest )
+					{
+						aTexturePath = mat.baseColorTexturePath;
+						largest = size;
+					}
+				}
+			}
+		}
+		else
+			std::fprintf( stderr, "Info: '%s' not found, skipping load_wavefront_obj()\n", aOptions.objPath );
+
+		if( auto const bytes = fs::file_size( aOptions.modelPath, ec ); !ec )
+		{
+			aBench.run( "load_baked_model()", bytes, [&] {
+				return load_baked_model( aOptions.modelPath ).meshes.size();
+			} );
+			aBench.run( "map_baked_model()", bytes, [&] {
+				return map_baked_model( aOptions.modelPath ).meshes.size();
+			} );
+			aBench.run( "read_baked_model()", bytes, [&] {
+				return read_baked_model( aOptions.modelPath ).meshes.size();
+			} );
+
+			auto const model = load_baked_model( aOptions.modelPath );
+			for( auto const& tex : model.textures )
+			{
+				if( lut::is_texture_file( tex.path.c_str() ) )
+				{
+					aBakedTexturePath = tex.path;
+					break;
+				}
+			}
+		}
+		else
+			std::fprintf( stderr, "Info: '%s' not found, skipping load_baked_model()\n", aOptions.modelPath );
+	}
+
+	void bench_decoders_( Bench_& aBench, std::string const& aTexturePath, std::string const& aBakedTexturePath )
+	{
+		if( aTexturePath.empty() )
+		{
+			std::fprintf( stderr, "Info: no texture, skipping the decoders (see --texture)\n" );
+			return;
+		}
+
+		// The file's contents, to time the decoders without the I/O
+		std::vector<stbi_uc> encoded;
+		if( std::FILE* file = std::fopen( aTexturePath.c_str(), "rb" ) )
+		{
+			stbi_uc buffer[65536];
+			while( auto const count = std::fread( buffer, 1, sizeof(buffer), file ) )
+				encoded.insert( encoded.end(), buffer, buffer + count );
+			std::fclose( file );
+		}
+		if( encoded.empty() )
+		{
+			std::fprintf( stderr, "Info: unable to read '%s', skipping the decoders\n", aTexturePath.c_str() );
+			return;
+		}
+
+		int width = 0, height = 0, channels = 0;
+		if( !stbi_info_from_memory( encoded.data(), int(encoded.size()), &width, &height, &channels ) )
+			throw lut::Error( "'%s': %s", aTexturePath.c_str(), stbi_failure_reason() );
+
+		// Throughput in decoded (RGBA) bytes
+		auto const rgbaBytes = std::uint64_t(width) * height * 4;
+		auto const stb_ = [] (stbi_uc* aPixels) {
+			std::size_t const ret = aPixels ? aPixels[0] + 1 : 0;
+			stbi_image_free( aPixels );
+			return ret;
+		};
+
+		aBench.run( "stbi_load() RGBA", rgbaBytes, [&] {
+			int w, h, c;
+			return stb_( stbi_load( aTexturePath.c_str(), &w, &h, &c, 4 ) );
+		} );
+		aBench.run( "stbi_load_from_memory() RGBA", rgbaBytes, [&] {
+			int w, h, c;
+			return stb_( stbi_load_from_memory( encoded.data(), int(encoded.size()), &w, &h, &c, 4 ) );
+		} );
+		aBench.run( "stbi_load_from_memory() R", rgbaBytes / 4, [&] {
+			int w, h, c;
+			return stb_( stbi_load_from_memory( encoded.data(), int(encoded.size()), &w, &h, &c, 1 ) );
+		} );
+		aBench.run( "lut::decode_image() RGBA", rgbaBytes, [&] {
+			return lut::decode_image( aTexturePath.c_str(), 4 ).pixels.size();
+		} );
+
+		// The alternative to decoding: the baker's output, mip levels and all
+		if( aBakedTexturePath.empty() )
+		{
+			std::fprintf( stderr, "Info: the baked model has no baked textures, skipping lut::load_texture_file()\n" );
+			return;
+		}
+
+		auto const bakedBytes = lut::load_texture_file( aBakedTexturePath.c_str() ).bytes.size();
+		aBench.run( "lut::load_texture_file()", bakedBytes, [&] {
+			return lut::load_texture_file( aBakedTexturePath.c_str() ).bytes.size();
+		} );
+	}
+
+	void bench_texture_set_( Bench_& aBench, Options_ const& aOptions )
+	{
+		namespace fs = std::filesystem;
+
+		// The files' contents, to time the decoders without the I/O
+		struct Image_
+		{
+			std::string name;
+			std::vector<std::uint8_t> encoded;
+			std::uint64_t rgbaBytes;
+			bool jpeg;
+		};
+
+		std::vector<Image_> images;
+		std::error_code ec;
+		for( auto const& entry : fs::directory_iterator( aOptions.textureDir, ec ) )
+		{
+			auto ext = entry.path().extension().string();
+			std::transform( ext.begin(), ext.end(), ext.begin(), [] (char aChar) { return char(std::tolower( static_cast<unsigned char>(aChar) )); } );
+
+			bool const jpeg = ".jpg" == ext || ".jpeg" == ext;
+			if( !jpeg && ".png" != ext )
+				continue;
+
+			Image_ image{ entry.path().string(), {}, 0, jpeg };
+			if( std::FILE* file = std::fopen( image.name.c_str(), "rb" ) )
+			{
+				std::uint8_t buffer[65536];
+				while( auto const count = std::fread( buffer, 1, sizeof(buffer), file ) )
+					image.encoded.insert( image.encoded.end(), buffer, buffer + count );
+				std::fclose( file );
+			}
+
+			int width = 0, height = 0, channels = 0;
+			if( image.encoded.empty() || !stbi_info_from_memory( image.encoded.data(), int(image.encoded.size()), &width, &height, &channels ) )
+			{
+				std::fprintf( stderr, "Info: unable to read '%s', left out of the texture set\n", image.name.c_str() );
+				continue;
+			}
+
+			image.rgbaBytes = std::uint64_t(width) * height * 4;
+			images.emplace_back( std::move(image) );
+		}
+
+		if( images.empty() )
+		{
+			std::fprintf( stderr, "Info: no JPEG or PNG images in '%s', skipping the texture set (see --texture-dir)\n", aOptions.textureDir );
+			return;
+		}
+
+		// Directory order is unspecified
+		std::sort( images.begin(), images.end(), [] (Image_ const& aX, Image_ const& aY) { return aX.name < aY.name; } );
+
+		// Throughput in decoded (RGBA) bytes. With a decoder, only the
+		// images it accepts; a fallback would time another decoder.
+		auto const decode_set_ = [&] (lut::ImageDecoder const* aDecoder, bool aJpegOnly) {
+			std::size_t ret = 0;
+			for( auto const& image : images )
+			{
+				if( aJpegOnly && !image.jpeg )
+					continue;
+				if( aDecoder && !aDecoder->accepts( image.encoded.data(), image.encoded.size() ) )
+					continue;
+
+				ret += lut::decode_image_memory( image.encoded.data(), image.encoded.size(), 4, image.name.c_str(), aDecoder ).pixels.size();
+			}
+			return ret;
+		};
+
+		std::uint64_t allBytes = 0, jpegBytes = 0;
+		std::size_t jpegs = 0;
+		for( auto const& image : images )
+		{
+			allBytes += image.rgbaBytes;
+			if( image.jpeg )
+			{
+				jpegBytes += image.rgbaBytes;
+				++jpegs;
+			}
+		}
+
+		auto const jpegSuffix = " (" + std::to_string( jpegs ) + " JPEGs)";
+		for( auto const& decoder : lut::image_decoders() )
+		{
+			if( jpegs > 0 )
+			{
+				aBench.run( std::string( "texture set, " ) + decoder.name + jpegSuffix, jpegBytes, [&] {
+					return decode_set_( &decoder, true );
+				} );
+			}
+		}
+
+		aBench.run( "texture set, lut::decode_image_memory() (" + std::to_string( images.size() ) + " images)", allBytes, [&] {
+			return decode_set_( nullptr, false );
+		} );
+	}
+
+	void append_csv_( Options_ const& aOptions, std::vector<Result_> const& aResults )
+	{
+		if( aResults.empty() )
+			return;
+
+		std::error_code ec;
+		bool const fresh = !std::filesystem::exists( aOptions.csvPath, ec ) || 0 == std::filesystem::file_size( aOptions.csvPath, ec );
+
+		std::FILE* file = std::fopen( aOptions.csvPath, "a" );
+		if( !file )
+			throw lut::Error( "Unable to open '%s' for appending", aOptions.csvPath );
+
+		if( fresh )
+			std::fprintf( file, "date,label,benchmark,runs,median_ms,min_ms,bytes,mb_per_s\n" );
+
+		char date[32];
+		std::time_t const now = std::time( nullptr );
+		std::strftime( date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime( &now ) );
+
+		// Neither the names nor (hopefully) the labels contain commas; quote
+		// the label anyway.
+		for( auto const& result : aResults )
+		{
+			std::fprintf( file, "%s,\"%s\",%s,%zu,%.4f,%.4f,%llu,%.2f\n", date, aOptions.label, result.name.c_str(), result.runs,
+				result.medianMs, result.minMs, static_cast<unsigned long long>(result.bytes), Bench_::mbps_( result ) );
+		}
+
+		bool const ok = !std::ferror( file );
+		if( 0 != std::fclose( file ) || !ok )
+			throw lut::Error( "Unable to write '%s'", aOptions.csvPath );
+
+		std::printf( "%zu results appended to '%s'\n", aResults.size(), aOptions.csvPath );
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef BAKED_BVH_HPP_8C2F5A61_3E9D_4B07_A4D1_6F0E92B7C358
+#define BAKED_BVH_HPP_8C2F5A61_3E9D_4B07_A4D1_6F0E92B7C358
+
+// Bounding volume hierarchy over the meshes of a model, for hierarchical
+// culling and ray queries (see culling.hpp). Built by cw2-bake with the
+// surface area heuristic (see cw2-bake/bvh.hpp) and stored in the optional
+// "scsmbil-bvh" section of baked files (see baked_model.hpp).
+//
+// The nodes are stored depth first, each left child right after its parent,
+// and the primitives (mesh indices) in the order of the leaves, so that every
+// subtree covers a contiguous range of them. A node stores the first
+// primitive of its subtree and the index of the node after its subtree
+// (skip). The subtree's primitives end where the skip node's begin (or at
+// the end of the list). A node is a leaf iff its skip is its own index + 1.
+// This traverses without a stack: descend to i + 1, or skip the subtree.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+// Most primitives per leaf
+constexpr std::uint32_t kBvhMaxLeafSize = 4;
+
+// ID of the BVH section
+constexpr char kBvhSectionId[16] = "scsmbil-bvh";
+
+struct BakedBvhNode
+{
+	glm::vec3 aabbMin;
+	std::uint32_t first; // first entry of BakedBvh::primitives in the subtree
+	glm::vec3 aabbMax;
+	std::uint32_t skip;  // node after the subtree
+};
+
+static_assert( sizeof(BakedBvhNode) == 32, "BakedBvhNode must stay tightly packed" );
+
+struct BakedBvh
+{
+	std::vector<BakedBvhNode> nodes; // empty: no BVH
+	std::vector<std::uint32_t> primitives; // mesh indices, in leaf order
+
+	// End of node aNode's range in primitives
+	std::uint32_t end( std::uint32_t aNode ) const
+	{
+		auto const skip = nodes[aNode].skip;
+		return skip < nodes.size() ? nodes[skip].first : std::uint32_t(primitives.size());
+	}
+};
+
+#endif // BAKED_BVH_HPP_8C2F5A61_3E9D_4B07_A4D1_6F0E92B7C358
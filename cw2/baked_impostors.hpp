@@ -0,0 +1,78 @@
+#ifndef BAKED_IMPOSTORS_HPP_2F7C91D4_8B3E_4A65_9D10_E4A6C3B85F27
+#define BAKED_IMPOSTORS_HPP_2F7C91D4_8B3E_4A65_9D10_E4A6C3B85F27
+
+// Impostors: each mesh is rendered by cw2-bake --impostors=SIZE (see
+// cw2-bake/impostor.hpp) from grid x grid directions, orthographically over
+// its bounding sphere, into an albedo atlas and a normal and depth atlas of
+// grid x grid tiles of SIZE x SIZE texels. Tile (i, j) (column i, row j from
+// the bottom) holds the view from impostor_direction( i, j ), which is
+// spread over the whole sphere by an octahedral map around +y. Within a
+// tile, the view's right vector points to +u and its up vector to +v (see
+// impostor_basis()); the atlases store rows bottom first, like all baked
+// textures.
+//
+//  - albedo (sRGB RGB, alpha = coverage; alpha tested at kAlphaCutoff)
+//  - normal and depth (linear RGBA): the object space normal as
+//    n * 0.5 + 0.5 in RGB, and in A the distance in front of the tile's
+//    plane through the centre, as 0.5 + 0.5 * distance / radius
+//
+// At run time, a mesh whose bounding sphere covers fewer than
+// --impostor-pixels pixels is drawn as a single quad that faces the
+// nearest baked direction instead (see select_impostors() in culling.hpp
+// and impostors.hpp). The same mapping is in cw2/shaders/impostor.glsl.
+
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// ID of the impostor section
+constexpr char kImpostorSectionId[16] = "scsmbil-imp";
+
+// Views per side of the octahedral grid (fixed by the baker)
+constexpr std::uint32_t kImpostorGrid = 8;
+
+struct BakedImpostor
+{
+	std::uint32_t albedo = 0xffffffffu;      // texture index; 0xffffffff: no impostor
+	std::uint32_t normalDepth = 0xffffffffu; // texture index
+	glm::vec3 centre{ 0.f }; // object space bounding sphere
+	float radius = 0.f;
+};
+
+static_assert( sizeof(BakedImpostor) == 24, "BakedImpostor must stay tightly packed" );
+
+struct BakedImpostors
+{
+	std::uint32_t grid = 0; // views per side
+	std::vector<BakedImpostor> meshes; // one per mesh; empty: no impostors
+};
+
+// Unit direction (from the centre towards the viewer) of tile (aX, aY)
+inline glm::vec3 impostor_direction( std::uint32_t aX, std::uint32_t aY, std::uint32_t aGrid )
+{
+	glm::vec2 const e = (glm::vec2( float(aX), float(aY) ) + 0.5f) / float(aGrid) * 2.f - 1.f;
+
+	glm::vec3 d( e.x, 1.f - std::abs( e.x ) - std::abs( e.y ), e.y );
+	if( d.y < 0.f )
+	{
+		float const x = (1.f - std::abs( d.z )) * (d.x >= 0.f ? 1.f : -1.f);
+		float const z = (1.f - std::abs( d.x )) * (d.z >= 0.f ? 1.f : -1.f);
+		d.x = x;
+		d.z = z;
+	}
+
+	return glm::normalize( d );
+}
+
+// Right and up vectors of the view along aDirection
+inline void impostor_basis( glm::vec3 const& aDirection, glm::vec3& aRight, glm::vec3& aUp )
+{
+	glm::vec3 const up = std::abs( aDirection.y ) < 0.999f ? glm::vec3( 0.f, 1.f, 0.f ) : glm::vec3( 0.f, 0.f, 1.f );
+	aRight = glm::normalize( glm::cross( up, aDirection ) );
+	aUp = glm::cross( aDirection, aRight );
+}
+
+#endif // BAKED_IMPOSTORS_HPP_2F7C91D4_8B3E_4A65_9D10_E4A6C3B85F27
@@ -0,0 +1,48 @@
+#ifndef BAKED_MESHLET_HPP_1B7D3E94_5A2C_4F86_9E0B_C4D82A6F3157
+#define BAKED_MESHLET_HPP_1B7D3E94_5A2C_4F86_9E0B_C4D82A6F3157
+
+// Meshlets: small clusters of a mesh's triangles that are culled (and drawn)
+// individually. Each meshlet references up to kMeshletMaxVertices of the
+// mesh's vertices through a list of mesh-relative vertex indices, and its
+// up to kMeshletMaxTriangles triangles are stored as 8-bit indices into that
+// list (three per triangle).
+//
+// Built by cw2-bake (see cw2-bake/meshlet.hpp) and stored in the optional
+// "scsmbil-mlt" section at the end of baked files (see baked_model.hpp).
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+// 64 vertices and 124 triangles: the limits recommended for mesh shaders on
+// current hardware. 124 (rather than 126) keeps the local index data of a
+// full meshlet a multiple of 4 bytes.
+constexpr std::uint32_t kMeshletMaxVertices = 64;
+constexpr std::uint32_t kMeshletMaxTriangles = 124;
+
+// ID of the meshlet section
+constexpr char kMeshletSectionId[16] = "scsmbil-mlt";
+
+struct BakedMeshlet
+{
+	// Bounding sphere, object space
+	glm::vec3 center;
+	float radius;
+
+	// Normal cone: the meshlet is entirely back-facing for all viewers at
+	// positions p with dot( normalize(coneApex - p), coneAxis ) >= coneCutoff.
+	// coneCutoff > 1 for meshlets whose normals spread too much to ever be
+	// culled this way.
+	glm::vec3 coneApex;
+	float coneCutoff;
+	glm::vec3 coneAxis;
+
+	std::uint32_t vertexOffset;   // first entry in the mesh's meshlet vertices
+	std::uint32_t triangleOffset; // first entry in the mesh's local indices
+	std::uint32_t vertexCount;
+	std::uint32_t triangleCount;
+};
+
+static_assert( sizeof(BakedMeshlet) == 60, "BakedMeshlet must stay tightly packed" );
+
+#endif // BAKED_MESHLET_HPP_1B7D3E94_5A2C_4F86_9E0B_C4D82A6F3157
@@ -1,9 +1,23 @@
 #include "baked_model.hpp"
 
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
 #include <cstdio>
 #include <cstring>
 
+#include <glm/common.hpp>
+
+#include "quantized_vertex.hpp"
+#include "interleaved_vertex.hpp"
+
 #include "../labutils/error.hpp"
+#include "../labutils/lz4_block.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/texture_pack.hpp"
 namespace lut = labutils;
 
 namespace
@@ -11,15 +25,117 @@ namespace
 	// See cw2-bake/main.cpp for more info
 	constexpr char kFileMagic[16] = "\0\0COMP5822Mmesh";
 	constexpr char kFileVariant[16] = "scsmbil-tan";
+	constexpr char kFileVariantInterleaved[16] = "scsmbil-ilv";
+	constexpr char kFileVariantBounds[16] = "scsmbil-box";
+	constexpr char kFileVariantQuantized[16] = "scsmbil-qnt";
+	constexpr char kFileVariantBounds16[16] = "scsmbil-b16";
+	constexpr char kFileVariantQuantized16[16] = "scsmbil-q16";
+	constexpr char kFileVariantBoundsLz4[16] = "scsmbil-lzb";
+	constexpr char kFileVariantQuantizedLz4[16] = "scsmbil-lzq";
+	constexpr char kFileVariantToc[16] = "scsmbil-toc";
+	constexpr char kFileVariantToc64[16] = "scsmbil-t64";
+
+	constexpr char kLodSectionId[16] = "scsmbil-lod";
+	constexpr char kMaterialSectionId[16] = "scsmbil-mat";
+	constexpr char kNamesSectionId[16] = "scsmbil-nam";
+	constexpr char kTextureFormatSectionId[16] = "scsmbil-txf";
+	constexpr char kOcclusionSectionId[16] = "scsmbil-ao";
+
+	constexpr std::size_t kInterleavedAlign = 16;
+	constexpr std::size_t kInterleavedVertexSize = sizeof(InterleavedVertex);
 
 	constexpr std::uint32_t kMaxString = 32*1024;
 
+	// Read position in a memory mapped file
+	struct MappedCursor_
+	{
+		std::uint8_t const* pos;
+		std::uint8_t const* end;
+	};
+
+	// Properties of the supported file variants
+	struct FileVariant_
+	{
+		bool interleaved; // "scsmbil-ilv", "scsmbil-box", "scsmbil-b16" and "scsmbil-lzb"
+		bool bounds;      // all but "scsmbil-tan" and "scsmbil-ilv"
+		bool quantized;   // "scsmbil-qnt", "scsmbil-q16" and "scsmbil-lzq"
+		bool indexSize;   // "scsmbil-b16", "scsmbil-q16" and the compressed ones
+		bool compressed;  // "scsmbil-lzb" and "scsmbil-lzq"
+		bool wide;        // inside "scsmbil-t64": 64-bit counts in the meshes
+	};
+
 	// functions
+	FileVariant_ check_variant_( char const (&aVariant)[16], char const*, char const* );
+	std::uint32_t check_index_size_( std::uint32_t, char const*, char const* );
+	std::uint32_t vertex_size_( FileVariant_ const& );
+
+	// Stored sizes of the arrays of a compressed mesh, checked against the
+	// counts: uncompressed and stored vertex bytes, then the same for indices
+	// (uint32_t in the file, or uint64_t if FileVariant_::wide)
+	struct PackedSizes_
+	{
+		std::uint64_t vertexBytes, storedVertexBytes;
+		std::uint64_t indexBytes, storedIndexBytes;
+	};
+
+	void check_packed_sizes_( PackedSizes_ const&, std::uint32_t aVertices, std::uint32_t aIndices, std::uint32_t aVertexSize, std::uint32_t aIndexSize, char const*, char const* );
+
+	// A vertex or index count of a mesh, as read; throws if it doesn't fit
+	// the uint32_t that the rest of the loader (and the GPU's indices) use
+	std::uint32_t check_count_( std::uint64_t, char const* aWhat, char const*, char const* );
+
+	// Position in a file; 64-bit also where long isn't
+	std::int64_t tell_( FILE* );
+	bool seek_( FILE*, std::int64_t aOffset, int aOrigin );
+
+	void compute_bounds_( std::uint8_t const*, std::uint32_t aCount, std::size_t aStride, glm::vec3& aMin, glm::vec3& aMax );
+
+	[[maybe_unused]] bool valid_material_( BakedMaterialInfo const&, std::size_t aTextureCount );
+
+	// Throws unless aRole is a valid EBakedTextureRole and aFormat is set
+	void set_texture_format_( BakedTextureInfo&, std::uint32_t aRole, std::uint32_t aFormat, char const*, char const* );
+
+	// Throws unless the BVH only refers to existing meshes and nodes, and
+	// every traversal ends
+	void check_bvh_( BakedBvh const&, std::size_t aMeshCount, char const*, char const* );
+
+	// Section 11., after its mesh count, up to the stored bytes
+	struct PvsHeader_
+	{
+		glm::vec3 origin;
+		float cellSize;
+		std::uint32_t dims[3];
+		std::uint32_t rowBytes, bytes, storedBytes;
+	};
+
+	static_assert( sizeof(PvsHeader_) == 40, "PvsHeader_ must match the file" );
+
+	// Throws unless the header fits aMeshCount meshes and the stored bytes
+	// are no more than the bitsets'
+	void check_pvs_header_( PvsHeader_ const&, std::size_t aMeshCount, char const*, char const* );
+
+	// Fills in aPvs from a checked header and its aHeader.storedBytes bytes
+	void unpack_pvs_( BakedPvs& aPvs, PvsHeader_ const&, void const* aStored );
+
+	// Throws unless the impostors refer to existing textures and have a
+	// grid; meshes without one are allowed
+	void check_impostors_( BakedImpostors const&, std::size_t aTextureCount, char const*, char const* );
+
 	BakedModel load_baked_model_( FILE*, char const* );
+	MappedBakedModel map_baked_model_( lut::MappedFile, char const* );
+
+	void map_toc_( MappedBakedModel&, MappedCursor_&, char const* );
+	void map_toc_trailing_( MappedBakedModel&, char const* );
+
+	std::string path_prefix_( char const* );
+
+	// Mounts DIR.pack for the textures in DIR/, where there is one
+	void mount_texture_packs_( std::vector<BakedTextureInfo> const& );
 }
 
 BakedModel load_baked_model( char const* aModelPath )
 {
+	LUT_CPU_ZONE( "load_baked_model()" );
 	FILE* fin = std::fopen( aModelPath, "rb" );
 	if( !fin )
 		throw lut::Error( "load_baked_model(): unable to open '%s' for reading", aModelPath );
@@ -28,6 +144,7 @@ BakedModel load_baked_model( char const* aModelPath )
 	{
 		auto ret = load_baked_model_( fin, aModelPath );
 		std::fclose( fin );
+		mount_texture_packs_( ret.textures );
 		return ret;
 	}
 	catch( ... )
@@ -37,8 +154,355 @@ BakedModel load_baked_model( char const* aModelPath )
 	}
 }
 
+BakedModel tile_baked_model( BakedModel aModel, std::uint32_t aColumns, std::uint32_t aRows )
+{
+	if( aColumns <= 1 && aRows <= 1 )
+		return aModel;
+
+	LUT_CPU_ZONE( "tile_baked_model()" );
+	if( 0 == aColumns || 0 == aRows || aModel.meshes.empty() )
+		throw lut::Error( "tile_baked_model(): empty %ux%u grid or model", aColumns, aRows );
+
+	glm::vec3 bmin( std::numeric_limits<float>::max() ), bmax( -std::numeric_limits<float>::max() );
+	for( auto const& mesh : aModel.meshes )
+	{
+		bmin = glm::min( bmin, mesh.aabbMin );
+		bmax = glm::max( bmax, mesh.aabbMax );
+	}
+
+	auto const transforms = grid_transforms( bmin, bmax, aColumns, aRows );
+
+	std::vector<BakedMeshData> meshes;
+	meshes.reserve( aModel.meshes.size() * aColumns * aRows );
+
+	std::vector<BakedImpostor> impostors;
+	impostors.reserve( aModel.impostors.meshes.size() * aColumns * aRows );
+	for( std::uint32_t row = 0; row < aRows; ++row )
+	{
+		for( std::uint32_t col = 0; col < aColumns; ++col )
+		{
+			glm::vec3 const offset( transforms[row * aColumns + col][3] );
+			bool const last = row + 1 == aRows && col + 1 == aColumns;
+
+			for( auto& source : aModel.meshes )
+			{
+				// The last copy takes the arrays of the original
+				auto& mesh = meshes.emplace_back( last ? std::move(source) : source );
+				mesh.aabbMin += offset;
+				mesh.aabbMax += offset;
+				for( auto& p : mesh.positions )
+					p += offset;
+				for( auto& meshlet : mesh.meshlets )
+				{
+					meshlet.center += offset;
+					meshlet.coneApex += offset;
+				}
+
+				if( !mesh.name.empty() )
+					mesh.name += " [" + std::to_string( col ) + "," + std::to_string( row ) + "]";
+			}
+
+			for( auto const& source : aModel.impostors.meshes )
+				impostors.emplace_back( source ).centre += offset;
+		}
+	}
+
+	aModel.meshes = std::move(meshes);
+	aModel.impostors.meshes = std::move(impostors);
+	aModel.bvh = BakedBvh{}; // of the original meshes only
+	aModel.pvs = BakedPvs{};
+	return aModel;
+}
+
+std::vector<glm::mat4> grid_transforms( glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aColumns, std::uint32_t aRows )
+{
+	// Copies touch with a 10% gap; degenerate (flat) models still get one
+	auto const extent = aMax - aMin;
+	float const pad = 0.1f * std::max( extent.x, extent.z ) + 1e-3f;
+	float const stepX = extent.x + pad, stepZ = extent.z + pad;
+
+	std::vector<glm::mat4> ret;
+	ret.reserve( std::size_t(aColumns) * aRows );
+	for( std::uint32_t row = 0; row < aRows; ++row )
+	{
+		for( std::uint32_t col = 0; col < aColumns; ++col )
+		{
+			glm::mat4 transform( 1.f );
+			transform[3] = glm::vec4(
+				(float(col) - 0.5f * float(aColumns - 1)) * stepX,
+				0.f,
+				(float(row) - 0.5f * float(aRows - 1)) * stepZ,
+				1.f
+			);
+			ret.emplace_back( transform );
+		}
+	}
+	return ret;
+}
+
+MappedBakedModel map_baked_model( char const* aModelPath )
+{
+	LUT_CPU_ZONE( "map_baked_model()" );
+	auto ret = map_baked_model_( lut::map_file( aModelPath ), aModelPath );
+	mount_texture_packs_( ret.textures );
+	return ret;
+}
+
+MappedBakedModel read_baked_model( char const* aModelPath )
+{
+	LUT_CPU_ZONE( "read_baked_model()" );
+	auto ret = map_baked_model_( lut::read_file( aModelPath ), aModelPath );
+	mount_texture_packs_( ret.textures );
+	return ret;
+}
+
+MappedBakedModel read_baked_model( lut::MappedFile aFile, char const* aModelPath )
+{
+	LUT_CPU_ZONE( "read_baked_model()" );
+	auto ret = map_baked_model_( std::move(aFile), aModelPath );
+	mount_texture_packs_( ret.textures );
+	return ret;
+}
+
+MappedBakedModel map_baked_toc( char const* aModelPath )
+{
+	MappedBakedModel ret;
+	ret.file = lut::map_file( aModelPath );
+
+	MappedCursor_ cur{ ret.file.data(), ret.file.data() + ret.file.size() };
+	if( ret.file.size() < 32 || 0 != std::memcmp( cur.pos, kFileMagic, 16 ) )
+		throw lut::Error( "map_baked_toc(): %s: invalid file signature!", aModelPath );
+
+	ret.toc.wide = 0 == std::memcmp( cur.pos + 16, kFileVariantToc64, 16 );
+	if( !ret.toc.wide && 0 != std::memcmp( cur.pos + 16, kFileVariantToc, 16 ) )
+		throw lut::Error( "map_baked_toc(): %s: not a '%s' or '%s' file", aModelPath, kFileVariantToc, kFileVariantToc64 );
+
+	cur.pos += 32;
+	map_toc_( ret, cur, aModelPath );
+	mount_texture_packs_( ret.textures );
+	return ret;
+}
+
 namespace
 {
+	// Throws for unknown variants.
+	FileVariant_ check_variant_( char const (&aVariant)[16], char const* aInputName, char const* aCaller )
+	{
+		if( 0 == std::memcmp( aVariant, kFileVariant, 16 ) )
+			return { false, false, false, false, false, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantInterleaved, 16 ) )
+			return { true, false, false, false, false, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantBounds, 16 ) )
+			return { true, true, false, false, false, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantQuantized, 16 ) )
+			return { false, true, true, false, false, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantBounds16, 16 ) )
+			return { true, true, false, true, false, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantQuantized16, 16 ) )
+			return { false, true, true, true, false, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantBoundsLz4, 16 ) )
+			return { true, true, false, true, true, false };
+		if( 0 == std::memcmp( aVariant, kFileVariantQuantizedLz4, 16 ) )
+			return { false, true, true, true, true, false };
+
+		char variant[17]{};
+		std::memcpy( variant, aVariant, 16 );
+		throw lut::Error( "%s: %s: file variant is '%s', expected '%s', '%s', '%s', '%s', '%s', '%s', '%s' or '%s'", aCaller, aInputName, variant, kFileVariant, kFileVariantInterleaved, kFileVariantBounds, kFileVariantQuantized, kFileVariantBounds16, kFileVariantQuantized16, kFileVariantBoundsLz4, kFileVariantQuantizedLz4 );
+	}
+
+	// Per-mesh index size of "scsmbil-b16" and "scsmbil-q16"; throws unless
+	// it is 2 or 4.
+	std::uint32_t check_index_size_( std::uint32_t aIndexSize, char const* aInputName, char const* aCaller )
+	{
+		if( sizeof(std::uint16_t) != aIndexSize && sizeof(std::uint32_t) != aIndexSize )
+			throw lut::Error( "%s: %s: invalid index size %u", aCaller, aInputName, aIndexSize );
+
+		return aIndexSize;
+	}
+
+	// Bytes per vertex of the interleaved or quantized array; 0 for
+	// "scsmbil-tan".
+	std::uint32_t vertex_size_( FileVariant_ const& aVariant )
+	{
+		if( aVariant.quantized )
+			return sizeof(QuantizedVertex);
+
+		return aVariant.interleaved ? std::uint32_t(kInterleavedVertexSize) : 0;
+	}
+
+	void check_packed_sizes_( PackedSizes_ const& aSizes, std::uint32_t aVertices, std::uint32_t aIndices, std::uint32_t aVertexSize, std::uint32_t aIndexSize, char const* aInputName, char const* aCaller )
+	{
+		if( aSizes.vertexBytes != std::uint64_t(aVertices) * aVertexSize || aSizes.indexBytes != std::uint64_t(aIndices) * aIndexSize )
+			throw lut::Error( "%s: %s: compressed mesh sizes don't match its counts", aCaller, aInputName );
+
+		if( aSizes.storedVertexBytes > aSizes.vertexBytes || aSizes.storedIndexBytes > aSizes.indexBytes )
+			throw lut::Error( "%s: %s: compressed mesh arrays are larger than uncompressed", aCaller, aInputName );
+	}
+
+	std::uint32_t check_count_( std::uint64_t aCount, char const* aWhat, char const* aInputName, char const* aCaller )
+	{
+		if( aCount > std::numeric_limits<std::uint32_t>::max() )
+			throw lut::Error( "%s: %s: mesh with %llu %s, more than 32 bits can count; split it (cw2-bake --cell-size)", aCaller, aInputName, static_cast<unsigned long long>(aCount), aWhat );
+
+		return std::uint32_t(aCount);
+	}
+
+	std::int64_t tell_( FILE* aFile )
+	{
+#		if defined(_WIN32)
+		return _ftelli64( aFile );
+#		else
+		return std::int64_t(ftello( aFile ));
+#		endif
+	}
+	bool seek_( FILE* aFile, std::int64_t aOffset, int aOrigin )
+	{
+#		if defined(_WIN32)
+		return 0 == _fseeki64( aFile, aOffset, aOrigin );
+#		else
+		return 0 == fseeko( aFile, off_t(aOffset), aOrigin );
+#		endif
+	}
+
+	// Texture indices are in range, or kBakedNoTexture
+	[[maybe_unused]] bool valid_material_( BakedMaterialInfo const& aInfo, std::size_t aTextureCount )
+	{
+		for( auto const id : { aInfo.baseColorTextureId, aInfo.roughnessTextureId, aInfo.metalnessTextureId } )
+		{
+			if( kBakedNoTexture != id && id >= aTextureCount )
+				return false;
+		}
+
+		return true;
+	}
+
+	void set_texture_format_( BakedTextureInfo& aInfo, std::uint32_t aRole, std::uint32_t aFormat, char const* aInputName, char const* aCaller )
+	{
+		if( aRole < std::uint32_t(EBakedTextureRole::baseColor) || aRole > std::uint32_t(EBakedTextureRole::linearColor) )
+			throw lut::Error( "%s: %s: texture '%s' has unknown role %u", aCaller, aInputName, aInfo.path.c_str(), aRole );
+		if( 0 == aFormat )
+			throw lut::Error( "%s: %s: texture '%s' has no format", aCaller, aInputName, aInfo.path.c_str() );
+
+		aInfo.role = EBakedTextureRole(aRole);
+		aInfo.format = aFormat;
+	}
+
+	void check_bvh_( BakedBvh const& aBvh, std::size_t aMeshCount, char const* aInputName, char const* aCaller )
+	{
+		auto const nodeCount = aBvh.nodes.size();
+		auto const primitiveCount = aBvh.primitives.size();
+		if( (0 == nodeCount) != (0 == primitiveCount) )
+			throw lut::Error( "%s: %s: BVH has %zu nodes and %zu primitives", aCaller, aInputName, nodeCount, primitiveCount );
+
+		for( auto const p : aBvh.primitives )
+		{
+			if( p >= aMeshCount )
+				throw lut::Error( "%s: %s: BVH refers to mesh %u of %zu", aCaller, aInputName, p, aMeshCount );
+		}
+
+		// Skips move forward, and the ranges don't run backwards
+		for( std::size_t i = 0; i < nodeCount; ++i )
+		{
+			auto const& node = aBvh.nodes[i];
+			if( node.skip <= i || node.skip > nodeCount || node.first > primitiveCount || node.first > aBvh.end( std::uint32_t(i) ) )
+				throw lut::Error( "%s: %s: BVH node %zu is malformed", aCaller, aInputName, i );
+		}
+	}
+
+	void check_pvs_header_( PvsHeader_ const& aHeader, std::size_t aMeshCount, char const* aInputName, char const* aCaller )
+	{
+		if( aHeader.rowBytes != (aMeshCount + 7) / 8 || !(aHeader.cellSize > 0.f) || !std::isfinite( aHeader.cellSize ) )
+			throw lut::Error( "%s: %s: PVS doesn't match the meshes", aCaller, aInputName );
+
+		// Bounds the allocation before the sizes are trusted
+		std::uint64_t cells = 1;
+		for( auto const dim : aHeader.dims )
+		{
+			if( 0 == dim || dim > 4096 )
+				throw lut::Error( "%s: %s: PVS grid has %u cells along an axis", aCaller, aInputName, dim );
+			cells *= dim;
+		}
+
+		if( cells * aHeader.rowBytes != aHeader.bytes || aHeader.storedBytes > aHeader.bytes )
+			throw lut::Error( "%s: %s: PVS sizes are inconsistent", aCaller, aInputName );
+	}
+
+	void check_impostors_( BakedImpostors const& aImpostors, std::size_t aTextureCount, char const* aInputName, char const* aCaller )
+	{
+		if( 0 == aImpostors.grid || aImpostors.grid > 64 )
+			throw lut::Error( "%s: %s: impostor grid of %u views per side", aCaller, aInputName, aImpostors.grid );
+
+		for( std::size_t i = 0; i < aImpostors.meshes.size(); ++i )
+		{
+			auto const& impostor = aImpostors.meshes[i];
+			if( kBakedNoTexture == impostor.albedo && kBakedNoTexture == impostor.normalDepth )
+				continue;
+
+			if( impostor.albedo >= aTextureCount || impostor.normalDepth >= aTextureCount || !(impostor.radius > 0.f) )
+				throw lut::Error( "%s: %s: impostor of mesh %zu is malformed", aCaller, aInputName, i );
+		}
+	}
+
+	void unpack_pvs_( BakedPvs& aPvs, PvsHeader_ const& aHeader, void const* aStored )
+	{
+		aPvs.origin = aHeader.origin;
+		aPvs.cellSize = aHeader.cellSize;
+		std::memcpy( aPvs.dims, aHeader.dims, sizeof(aPvs.dims) );
+		aPvs.rowBytes = aHeader.rowBytes;
+
+		aPvs.bits.resize( aHeader.bytes );
+		if( aHeader.storedBytes == aHeader.bytes )
+			std::memcpy( aPvs.bits.data(), aStored, aHeader.bytes );
+		else
+			lut::lz4_decompress( aStored, aHeader.storedBytes, aPvs.bits.data(), aPvs.bits.size() );
+	}
+
+	// Bounds for files that don't store them. aPositions points to the first
+	// vec3 position, consecutive positions are aStride bytes apart.
+	void compute_bounds_( std::uint8_t const* aPositions, std::uint32_t aCount, std::size_t aStride, glm::vec3& aMin, glm::vec3& aMax )
+	{
+		aMin = glm::vec3( std::numeric_limits<float>::max() );
+		aMax = glm::vec3( std::numeric_limits<float>::lowest() );
+
+		for( std::uint32_t i = 0; i < aCount; ++i )
+		{
+			glm::vec3 p;
+			std::memcpy( &p, aPositions + i*aStride, sizeof(glm::vec3) );
+
+			aMin = glm::min( aMin, p );
+			aMax = glm::max( aMax, p );
+		}
+	}
+
+	void mount_texture_packs_( std::vector<BakedTextureInfo> const& aTextures )
+	{
+		std::vector<std::string> directories;
+		for( auto const& tex : aTextures )
+		{
+			auto const slash = tex.path.find_last_of( "/\\" );
+			if( std::string::npos == slash )
+				continue;
+
+			auto directory = tex.path.substr( 0, slash );
+			if( directories.end() == std::find( directories.begin(), directories.end(), directory ) )
+				directories.emplace_back( std::move(directory) );
+		}
+
+		for( auto const& directory : directories )
+			lut::mount_texture_pack( (directory + ".pack").c_str(), directory.c_str() );
+	}
+
+	std::string path_prefix_( char const* aInputName )
+	{
+		char const* pathBeg = aInputName;
+		char const* pathEnd = std::strrchr( pathBeg, '/' );
+	
+		return pathEnd
+			? std::string( pathBeg, pathEnd+1 )
+			: ""
+		;
+	}
+
 	void checked_read_( FILE* aFin, std::size_t aBytes, void* aBuffer )
 	{
 		auto ret = std::fread( aBuffer, 1, aBytes, aFin );
@@ -53,6 +517,27 @@ namespace
 		checked_read_( aFin, sizeof(std::uint32_t), &ret );
 		return ret;
 	}
+	std::uint64_t read_uint64_( FILE* aFin )
+	{
+		std::uint64_t ret;
+		checked_read_( aFin, sizeof(std::uint64_t), &ret );
+		return ret;
+	}
+
+	// A count of section 4., 64-bit in "scsmbil-t64"
+	std::uint64_t read_count_( FILE* aFin, FileVariant_ const& aVariant )
+	{
+		return aVariant.wide ? read_uint64_( aFin ) : read_uint32_( aFin );
+	}
+	PackedSizes_ read_packed_sizes_( FILE* aFin, FileVariant_ const& aVariant )
+	{
+		PackedSizes_ ret;
+		ret.vertexBytes = read_count_( aFin, aVariant );
+		ret.storedVertexBytes = read_count_( aFin, aVariant );
+		ret.indexBytes = read_count_( aFin, aVariant );
+		ret.storedIndexBytes = read_count_( aFin, aVariant );
+		return ret;
+	}
 	std::string read_string_( FILE* aFin )
 	{
 		auto const length = read_uint32_( aFin );
@@ -72,13 +557,7 @@ namespace
 		BakedModel ret;
 
 		// Figure out base path
-		char const* pathBeg = aInputName;
-		char const* pathEnd = std::strrchr( pathBeg, '/' );
-	
-		std::string const prefix = pathEnd
-			? std::string( pathBeg, pathEnd+1 )
-			: ""
-		;
+		std::string const prefix = path_prefix_( aInputName );
 
 		// Read header and verify file magic and variant
 		char magic[16];
@@ -90,8 +569,29 @@ namespace
 		char variant[16];
 		checked_read_( aFin, 16, variant );
 
-		if( 0 != std::memcmp( variant, kFileVariant, 16 ) )
-			throw lut::Error( "load_baked_model_(): %s: file variant is '%s', expected '%s'", aInputName, variant, kFileVariant );
+		// "scsmbil-toc": the data after the TOC is that of the content
+		// variant. It's read front to back here, so the TOC isn't needed.
+		bool const wide = 0 == std::memcmp( variant, kFileVariantToc64, 16 );
+		if( wide || 0 == std::memcmp( variant, kFileVariantToc, 16 ) )
+		{
+			checked_read_( aFin, 16, variant );
+
+			auto const read_toc_count_ = [&] () -> std::uint64_t {
+				return wide ? read_uint64_( aFin ) : read_uint32_( aFin );
+			};
+
+			std::uint64_t chunks = 0;
+			chunks += read_toc_count_(); // textures
+			chunks += read_toc_count_(); // materials
+			chunks += 3ull * read_toc_count_(); // meshes, meshlets, LODs
+			chunks += 1; // material constants
+
+			if( chunks > std::uint64_t(std::numeric_limits<std::int64_t>::max()) / sizeof(BakedChunk) || !seek_( aFin, std::int64_t(chunks*sizeof(BakedChunk)), SEEK_CUR ) )
+				throw lut::Error( "load_baked_model_(): %s: unable to skip the table of contents", aInputName );
+		}
+
+		auto fileVariant = check_variant_( variant, aInputName, "load_baked_model_()" );
+		fileVariant.wide = wide;
 
 		// Read texture info
 		auto const textureCount = read_uint32_( aFin );
@@ -118,49 +618,967 @@ namespace
 			info.alphaMaskTextureId = read_uint32_( aFin );
 			info.normalMapTextureId = read_uint32_( aFin );
 
-			assert( info.baseColorTextureId < ret.textures.size() );
-			assert( info.roughnessTextureId < ret.textures.size() );
-			assert( info.metalnessTextureId < ret.textures.size() );
+			assert( valid_material_( info, ret.textures.size() ) );
 
 			ret.materials.emplace_back( std::move(info) );
 		}
 
 		// Read mesh data
 		auto const meshCount = read_uint32_( aFin );
+		std::vector<std::uint32_t> indexSizes; // for the LOD section
 		for( std::uint32_t i = 0; i < meshCount; ++i )
 		{
 			BakedMeshData data;
 			data.materialId = read_uint32_( aFin );
 			assert( data.materialId < ret.materials.size() );
 
-			auto const V = read_uint32_( aFin );
-			auto const I = read_uint32_( aFin );
+			auto const V = check_count_( read_count_( aFin, fileVariant ), "vertices", aInputName, "load_baked_model_()" );
+			auto const I = check_count_( read_count_( aFin, fileVariant ), "indices", aInputName, "load_baked_model_()" );
 
-			data.positions.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
+			std::uint32_t const indexSize = fileVariant.indexSize
+				? check_index_size_( read_uint32_( aFin ), aInputName, "load_baked_model_()" )
+				: sizeof(std::uint32_t);
+			indexSizes.emplace_back( indexSize );
 
+			data.positions.resize( V );
 			data.normals.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.normals.data() );
-
 			data.texcoords.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec2), data.texcoords.data() );
-
 			data.tangents.resize(V);
-			checked_read_(aFin, V * sizeof(glm::vec4), data.tangents.data());
+
+			if( fileVariant.bounds )
+			{
+				checked_read_( aFin, sizeof(glm::vec3), &data.aabbMin );
+				checked_read_( aFin, sizeof(glm::vec3), &data.aabbMax );
+			}
+
+			// Vertex array of the interleaved and quantized variants, and the
+			// index array, as stored (after decompression)
+			std::vector<std::uint8_t> vertexData, indexData;
+			auto const vertexSize = vertex_size_( fileVariant );
+
+			if( fileVariant.compressed )
+			{
+				auto const sizes = read_packed_sizes_( aFin, fileVariant );
+				check_packed_sizes_( sizes, V, I, vertexSize, indexSize, aInputName, "load_baked_model_()" );
+
+				auto const read_packed_ = [&] (std::uint64_t aStored, std::vector<std::uint8_t>& aOut) {
+					if( aStored == aOut.size() )
+					{
+						checked_read_( aFin, aOut.size(), aOut.data() );
+						return;
+					}
+
+					std::vector<std::uint8_t> packed( static_cast<std::size_t>(aStored) );
+					checked_read_( aFin, packed.size(), packed.data() );
+					lut::lz4_decompress( packed.data(), packed.size(), aOut.data(), aOut.size() );
+				};
+
+				vertexData.resize( sizes.vertexBytes );
+				indexData.resize( sizes.indexBytes );
+				read_packed_( sizes.storedVertexBytes, vertexData );
+				read_packed_( sizes.storedIndexBytes, indexData );
+			}
+			else if( fileVariant.interleaved || fileVariant.quantized )
+			{
+				// Skip padding before the vertex array
+				auto const pos = tell_( aFin );
+				if( pos < 0 )
+					throw lut::Error( "load_baked_model_(): %s: ftell() failed", aInputName );
+
+				char padding[kInterleavedAlign];
+				if( auto const rem = std::size_t(pos) % kInterleavedAlign )
+					checked_read_( aFin, kInterleavedAlign - rem, padding );
+
+				vertexData.resize( std::size_t(V) * vertexSize );
+				checked_read_( aFin, vertexData.size(), vertexData.data() );
+			}
+
+			if( fileVariant.quantized )
+			{
+				// Decode to the separate fp32 arrays
+				for( std::size_t v = 0; v < V; ++v )
+				{
+					QuantizedVertex const vertex = load_vertex<QuantizedVertex>( vertexData.data(), v );
+					dequantize_vertex( vertex, data.aabbMin, data.aabbMax, data.positions[v], data.texcoords[v], data.normals[v], data.tangents[v] );
+				}
+			}
+			else if( fileVariant.interleaved )
+			{
+				// Split the vertices back into separate arrays.
+				for( std::size_t v = 0; v < V; ++v )
+				{
+					InterleavedVertex const vertex = load_vertex<InterleavedVertex>( vertexData.data(), v );
+					data.positions[v] = vertex.position;
+					data.texcoords[v] = vertex.texcoord;
+					data.normals[v] = vertex.normal;
+					data.tangents[v] = vertex.tangent;
+				}
+			}
+			else
+			{
+				checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
+				checked_read_( aFin, V*sizeof(glm::vec3), data.normals.data() );
+				checked_read_( aFin, V*sizeof(glm::vec2), data.texcoords.data() );
+				checked_read_(aFin, V * sizeof(glm::vec4), data.tangents.data());
+			}
+
+			if( !fileVariant.bounds )
+			{
+				compute_bounds_( reinterpret_cast<std::uint8_t const*>(data.positions.data()), V, sizeof(glm::vec3), data.aabbMin, data.aabbMax );
+			}
+
+			if( !fileVariant.compressed )
+			{
+				indexData.resize( std::size_t(I) * indexSize );
+				checked_read_( aFin, indexData.size(), indexData.data() );
+			}
 
 			data.indices.resize( I );
-			checked_read_( aFin, I*sizeof(std::uint32_t), data.indices.data() );
+			if( sizeof(std::uint16_t) == indexSize )
+			{
+				for( std::size_t j = 0; j < I; ++j )
+				{
+					std::uint16_t index;
+					std::memcpy( &index, indexData.data() + j*sizeof(std::uint16_t), sizeof(std::uint16_t) );
+					data.indices[j] = index;
+				}
+			}
+			else
+			{
+				std::memcpy( data.indices.data(), indexData.data(), indexData.size() );
+			}
 
 			ret.meshes.emplace_back( std::move(data) );
 		}
 
+		// Optional sections
+		for( ;; )
+		{
+			char section[16];
+			auto const check = std::fread( section, 1, 16, aFin );
+			if( 0 == check )
+				break;
+
+			bool const meshlets = 16 == check && 0 == std::memcmp( section, kMeshletSectionId, 16 );
+			bool const lods = 16 == check && 0 == std::memcmp( section, kLodSectionId, 16 );
+			bool const constants = 16 == check && 0 == std::memcmp( section, kMaterialSectionId, 16 );
+			bool const names = 16 == check && 0 == std::memcmp( section, kNamesSectionId, 16 );
+			bool const formats = 16 == check && 0 == std::memcmp( section, kTextureFormatSectionId, 16 );
+			bool const bvh = 16 == check && 0 == std::memcmp( section, kBvhSectionId, 16 );
+			bool const pvs = 16 == check && 0 == std::memcmp( section, kPvsSectionId, 16 );
+			bool const occlusion = 16 == check && 0 == std::memcmp( section, kOcclusionSectionId, 16 );
+			bool const impostors = 16 == check && 0 == std::memcmp( section, kImpostorSectionId, 16 );
+			if( !meshlets && !lods && !constants && !names && !formats && !bvh && !pvs && !occlusion && !impostors )
+			{
+				std::fprintf( stderr, "Note: '%s' contains trailing bytes\n", aInputName );
+				break;
+			}
+
+			if( names )
+			{
+				// Stored strings include the \0; the names don't
+				if( read_uint32_( aFin ) != materialCount )
+					throw lut::Error( "load_baked_model_(): %s: names don't match the materials", aInputName );
+				for( auto& mat : ret.materials )
+					mat.name = read_string_( aFin ).c_str();
+
+				if( read_uint32_( aFin ) != meshCount )
+					throw lut::Error( "load_baked_model_(): %s: names don't match the meshes", aInputName );
+				for( auto& data : ret.meshes )
+					data.name = read_string_( aFin ).c_str();
+
+				continue;
+			}
+
+			if( formats )
+			{
+				if( read_uint32_( aFin ) != textureCount )
+					throw lut::Error( "load_baked_model_(): %s: texture formats don't match the textures", aInputName );
+
+				for( auto& tex : ret.textures )
+				{
+					auto const role = read_uint32_( aFin );
+					set_texture_format_( tex, role, read_uint32_( aFin ), aInputName, "load_baked_model_()" );
+				}
+
+				continue;
+			}
+
+			if( bvh )
+			{
+				if( read_uint32_( aFin ) != meshCount )
+					throw lut::Error( "load_baked_model_(): %s: BVH doesn't match the meshes", aInputName );
+
+				// At most 2P - 1 nodes, with P <= meshCount
+				auto const N = read_uint32_( aFin );
+				if( N > 2 * std::uint64_t(meshCount) )
+					throw lut::Error( "load_baked_model_(): %s: BVH has %u nodes for %u meshes", aInputName, N, meshCount );
+				ret.bvh.nodes.resize( N );
+				checked_read_( aFin, N*sizeof(BakedBvhNode), ret.bvh.nodes.data() );
+
+				auto const P = read_uint32_( aFin );
+				if( P > meshCount )
+					throw lut::Error( "load_baked_model_(): %s: BVH has %u primitives for %u meshes", aInputName, P, meshCount );
+				ret.bvh.primitives.resize( P );
+				checked_read_( aFin, P*sizeof(std::uint32_t), ret.bvh.primitives.data() );
+
+				check_bvh_( ret.bvh, meshCount, aInputName, "load_baked_model_()" );
+				continue;
+			}
+
+			if( pvs )
+			{
+				if( read_uint32_( aFin ) != meshCount )
+					throw lut::Error( "load_baked_model_(): %s: PVS doesn't match the meshes", aInputName );
+
+				PvsHeader_ header;
+				checked_read_( aFin, sizeof(header), &header );
+				check_pvs_header_( header, meshCount, aInputName, "load_baked_model_()" );
+
+				std::vector<std::uint8_t> stored( header.storedBytes );
+				checked_read_( aFin, stored.size(), stored.data() );
+				unpack_pvs_( ret.pvs, header, stored.data() );
+				continue;
+			}
+
+			if( occlusion )
+			{
+				if( read_uint32_( aFin ) != meshCount )
+					throw lut::Error( "load_baked_model_(): %s: occlusion doesn't match the meshes", aInputName );
+
+				for( auto& data : ret.meshes )
+				{
+					if( read_uint32_( aFin ) != data.positions.size() )
+						throw lut::Error( "load_baked_model_(): %s: occlusion doesn't match the vertices", aInputName );
+
+					data.occlusion.resize( data.positions.size() );
+					checked_read_( aFin, data.occlusion.size(), data.occlusion.data() );
+				}
+
+				continue;
+			}
+
+			if( impostors )
+			{
+				if( read_uint32_( aFin ) != meshCount )
+					throw lut::Error( "load_baked_model_(): %s: impostors don't match the meshes", aInputName );
+
+				ret.impostors.grid = read_uint32_( aFin );
+				ret.impostors.meshes.resize( meshCount );
+				checked_read_( aFin, meshCount*sizeof(BakedImpostor), ret.impostors.meshes.data() );
+
+				check_impostors_( ret.impostors, textureCount, aInputName, "load_baked_model_()" );
+				continue;
+			}
+
+			if( constants )
+			{
+				if( read_uint32_( aFin ) != materialCount )
+					throw lut::Error( "load_baked_model_(): %s: material constants don't match the materials", aInputName );
+
+				for( auto& mat : ret.materials )
+				{
+					float values[6];
+					checked_read_( aFin, sizeof(values), values );
+					mat.baseColor = glm::vec4( values[0], values[1], values[2], values[3] );
+					mat.roughness = values[4];
+					mat.metalness = values[5];
+				}
+
+				continue;
+			}
+
+			if( read_uint32_( aFin ) != meshCount )
+				throw lut::Error( "load_baked_model_(): %s: %s section doesn't match the meshes", aInputName, meshlets ? "meshlet" : "LOD" );
+
+			for( std::uint32_t i = 0; i < meshCount && meshlets; ++i )
+			{
+				auto& data = ret.meshes[i];
+
+				auto const L = read_uint32_( aFin );
+				auto const V = read_uint32_( aFin );
+				auto const T = read_uint32_( aFin );
+
+				data.meshlets.resize( L );
+				data.meshletVertices.resize( V );
+				data.meshletTriangles.resize( T );
+
+				checked_read_( aFin, L*sizeof(BakedMeshlet), data.meshlets.data() );
+				checked_read_( aFin, V*sizeof(std::uint32_t), data.meshletVertices.data() );
+				checked_read_( aFin, T*sizeof(std::uint8_t), data.meshletTriangles.data() );
+			}
+
+			for( std::uint32_t i = 0; i < meshCount && lods; ++i )
+			{
+				auto& data = ret.meshes[i];
+
+				auto const N = read_uint32_( aFin );
+				data.lods.resize( N );
+				for( auto& lod : data.lods )
+				{
+					checked_read_( aFin, sizeof(float), &lod.error );
+
+					auto const I = read_uint32_( aFin );
+					lod.indices.resize( I );
+					if( sizeof(std::uint16_t) == indexSizes[i] )
+					{
+						std::vector<std::uint16_t> indices( I );
+						checked_read_( aFin, I*sizeof(std::uint16_t), indices.data() );
+						std::copy( indices.begin(), indices.end(), lod.indices.begin() );
+					}
+					else
+					{
+						checked_read_( aFin, I*sizeof(std::uint32_t), lod.indices.data() );
+					}
+				}
+			}
+		}
+
+		return ret;
+	}
+}
+
+namespace
+{
+	std::uint8_t const* checked_take_( MappedCursor_& aCursor, std::size_t aBytes )
+	{
+		auto const avail = std::size_t(aCursor.end - aCursor.pos);
+		if( aBytes > avail )
+			throw lut::Error( "checked_take_(): expected %zu bytes, got %zu", aBytes, avail );
+
+		auto const* ret = aCursor.pos;
+		aCursor.pos += aBytes;
+		return ret;
+	}
+
+	std::uint32_t take_uint32_( MappedCursor_& aCursor )
+	{
+		std::uint32_t ret;
+		std::memcpy( &ret, checked_take_( aCursor, sizeof(std::uint32_t) ), sizeof(std::uint32_t) );
+		return ret;
+	}
+	std::uint64_t take_uint64_( MappedCursor_& aCursor )
+	{
+		std::uint64_t ret;
+		std::memcpy( &ret, checked_take_( aCursor, sizeof(std::uint64_t) ), sizeof(std::uint64_t) );
+		return ret;
+	}
+
+	// See read_count_()
+	std::uint64_t take_count_( MappedCursor_& aCursor, FileVariant_ const& aVariant )
+	{
+		return aVariant.wide ? take_uint64_( aCursor ) : take_uint32_( aCursor );
+	}
+	std::string take_string_( MappedCursor_& aCursor )
+	{
+		auto const length = take_uint32_( aCursor );
+
+		if( length >= kMaxString )
+			throw lut::Error( "take_string_(): unexpectedly long string (%u bytes)", length );
+
+		auto const* chars = checked_take_( aCursor, length );
+
+		// Stored length includes the terminating \0, like read_string_()
+		return std::string( reinterpret_cast<char const*>(chars), length );
+	}
+
+	// Cursor over a TOC chunk; throws unless the chunk is within the file.
+	MappedCursor_ chunk_cursor_( MappedBakedModel const& aModel, BakedChunk const& aChunk, char const* aInputName )
+	{
+		auto const size = aModel.file.size();
+		if( aChunk.offset > size || aChunk.size > size - aChunk.offset )
+			throw lut::Error( "chunk_cursor_(): %s: chunk at %llu (%llu bytes) is outside of the file", aInputName, static_cast<unsigned long long>(aChunk.offset), static_cast<unsigned long long>(aChunk.size) );
+
+		auto const* begin = aModel.file.data() + aChunk.offset;
+		return MappedCursor_{ begin, begin + aChunk.size };
+	}
+
+	// Throws unless the chunk of aCursor was consumed exactly
+	void check_chunk_end_( MappedCursor_ const& aCursor, char const* aInputName, char const* aWhat )
+	{
+		if( aCursor.pos != aCursor.end )
+			throw lut::Error( "check_chunk_end_(): %s: %s chunk has %zu unexpected bytes", aInputName, aWhat, std::size_t(aCursor.end - aCursor.pos) );
+	}
+
+	BakedTextureInfo take_texture_( MappedCursor_& aCursor, std::string const& aPrefix )
+	{
+		BakedTextureInfo info;
+		info.path = aPrefix + take_string_( aCursor );
+		info.channels = *checked_take_( aCursor, sizeof(std::uint8_t) );
+		return info;
+	}
+
+	BakedMaterialInfo take_material_( MappedCursor_& aCursor )
+	{
+		BakedMaterialInfo info;
+		info.baseColorTextureId = take_uint32_( aCursor );
+		info.roughnessTextureId = take_uint32_( aCursor );
+		info.metalnessTextureId = take_uint32_( aCursor );
+		info.alphaMaskTextureId = take_uint32_( aCursor );
+		info.normalMapTextureId = take_uint32_( aCursor );
+		return info;
+	}
+
+	// Section 7., from its material count
+	void take_material_constants_( MappedCursor_& aCursor, std::vector<BakedMaterialInfo>& aMaterials, char const* aInputName )
+	{
+		if( take_uint32_( aCursor ) != aMaterials.size() )
+			throw lut::Error( "map_baked_model_(): %s: material constants don't match the materials", aInputName );
+
+		for( auto& mat : aMaterials )
+		{
+			float values[6];
+			std::memcpy( values, checked_take_( aCursor, sizeof(values) ), sizeof(values) );
+			mat.baseColor = glm::vec4( values[0], values[1], values[2], values[3] );
+			mat.roughness = values[4];
+			mat.metalness = values[5];
+		}
+	}
+
+	// Section 8., from its material count. The mesh names are returned as
+	// they are, their count is up to the caller to check.
+	void take_names_( MappedCursor_& aCursor, std::vector<BakedMaterialInfo>& aMaterials, std::vector<std::string>& aMeshNames, char const* aInputName )
+	{
+		// Stored strings include the \0; the names don't
+		if( take_uint32_( aCursor ) != aMaterials.size() )
+			throw lut::Error( "map_baked_model_(): %s: names don't match the materials", aInputName );
+		for( auto& mat : aMaterials )
+			mat.name = take_string_( aCursor ).c_str();
+
+		auto const meshCount = take_uint32_( aCursor );
+		if( std::uint64_t(meshCount) * sizeof(std::uint32_t) > std::uint64_t(aCursor.end - aCursor.pos) )
+			throw lut::Error( "map_baked_model_(): %s: names section is truncated", aInputName );
+
+		aMeshNames.resize( meshCount );
+		for( auto& name : aMeshNames )
+			name = take_string_( aCursor ).c_str();
+	}
+
+	// Section 9., from its texture count
+	void take_texture_formats_( MappedCursor_& aCursor, std::vector<BakedTextureInfo>& aTextures, char const* aInputName )
+	{
+		if( take_uint32_( aCursor ) != aTextures.size() )
+			throw lut::Error( "map_baked_model_(): %s: texture formats don't match the textures", aInputName );
+
+		for( auto& tex : aTextures )
+		{
+			auto const role = take_uint32_( aCursor );
+			set_texture_format_( tex, role, take_uint32_( aCursor ), aInputName, "map_baked_model_()" );
+		}
+	}
+
+	// Section 10., from its mesh count. The arrays are copied; they need to
+	// be aligned for traversal.
+	void take_bvh_( MappedCursor_& aCursor, BakedBvh& aBvh, std::size_t aMeshCount, char const* aInputName )
+	{
+		if( take_uint32_( aCursor ) != aMeshCount )
+			throw lut::Error( "map_baked_model_(): %s: BVH doesn't match the meshes", aInputName );
+
+		auto const N = take_uint32_( aCursor );
+		auto const* nodes = checked_take_( aCursor, N*sizeof(BakedBvhNode) );
+		aBvh.nodes.resize( N );
+		std::memcpy( aBvh.nodes.data(), nodes, N*sizeof(BakedBvhNode) );
+
+		auto const P = take_uint32_( aCursor );
+		auto const* primitives = checked_take_( aCursor, P*sizeof(std::uint32_t) );
+		aBvh.primitives.resize( P );
+		std::memcpy( aBvh.primitives.data(), primitives, P*sizeof(std::uint32_t) );
+
+		check_bvh_( aBvh, aMeshCount, aInputName, "map_baked_model_()" );
+	}
+
+	// Section 11., from its mesh count. The bitsets are decompressed.
+	void take_pvs_( MappedCursor_& aCursor, BakedPvs& aPvs, std::size_t aMeshCount, char const* aInputName )
+	{
+		if( take_uint32_( aCursor ) != aMeshCount )
+			throw lut::Error( "map_baked_model_(): %s: PVS doesn't match the meshes", aInputName );
+
+		PvsHeader_ header;
+		std::memcpy( &header, checked_take_( aCursor, sizeof(header) ), sizeof(header) );
+		check_pvs_header_( header, aMeshCount, aInputName, "map_baked_model_()" );
+
+		unpack_pvs_( aPvs, header, checked_take_( aCursor, header.storedBytes ) );
+	}
+
+	// Section 12., from its mesh count, as file ranges of aFileData
+	std::vector<BakedChunk> take_occlusion_( MappedCursor_& aCursor, std::uint8_t const* aFileData, std::size_t aMeshCount, char const* aInputName )
+	{
+		if( take_uint32_( aCursor ) != aMeshCount )
+			throw lut::Error( "map_baked_model_(): %s: occlusion doesn't match the meshes", aInputName );
+
+		std::vector<BakedChunk> ret( aMeshCount );
+		for( auto& chunk : ret )
+		{
+			chunk.size = take_uint32_( aCursor );
+			chunk.offset = std::uint64_t(checked_take_( aCursor, chunk.size ) - aFileData);
+		}
+
+		return ret;
+	}
+
+	// Section 13., from its mesh count
+	void take_impostors_( MappedCursor_& aCursor, BakedImpostors& aImpostors, std::size_t aMeshCount, std::size_t aTextureCount, char const* aInputName )
+	{
+		if( take_uint32_( aCursor ) != aMeshCount )
+			throw lut::Error( "map_baked_model_(): %s: impostors don't match the meshes", aInputName );
+
+		aImpostors.grid = take_uint32_( aCursor );
+		aImpostors.meshes.resize( aMeshCount );
+		std::memcpy( aImpostors.meshes.data(), checked_take_( aCursor, aMeshCount*sizeof(BakedImpostor) ), aMeshCount*sizeof(BakedImpostor) );
+
+		check_impostors_( aImpostors, aTextureCount, aInputName, "map_baked_model_()" );
+	}
+
+	// One mesh of section 4. aFileData is the start of the file, which the
+	// vertex array padding is relative to. Meshlets and LODs are left empty.
+	BakedMeshView take_mesh_( MappedCursor_& aCursor, std::uint8_t const* aFileData, FileVariant_ const& aVariant, char const* aInputName )
+	{
+		BakedMeshView view;
+		view.materialId = take_uint32_( aCursor );
+
+		auto const V = check_count_( take_count_( aCursor, aVariant ), "vertices", aInputName, "map_baked_model_()" );
+		auto const I = check_count_( take_count_( aCursor, aVariant ), "indices", aInputName, "map_baked_model_()" );
+		view.vertexCount = V;
+		view.indexCount = I;
+
+		view.indexSize = aVariant.indexSize
+			? check_index_size_( take_uint32_( aCursor ), aInputName, "map_baked_model_()" )
+			: sizeof(std::uint32_t);
+
+		if( aVariant.bounds )
+		{
+			std::memcpy( &view.aabbMin, checked_take_( aCursor, sizeof(glm::vec3) ), sizeof(glm::vec3) );
+			std::memcpy( &view.aabbMax, checked_take_( aCursor, sizeof(glm::vec3) ), sizeof(glm::vec3) );
+		}
+
+		view.vertexSize = vertex_size_( aVariant );
+		view.interleaved = view.quantized = nullptr;
+		view.packedVertices = view.packedIndices = nullptr;
+		view.packedVertexBytes = view.packedIndexBytes = 0;
+		if( aVariant.compressed )
+		{
+			PackedSizes_ sizes;
+			sizes.vertexBytes = take_count_( aCursor, aVariant );
+			sizes.storedVertexBytes = take_count_( aCursor, aVariant );
+			sizes.indexBytes = take_count_( aCursor, aVariant );
+			sizes.storedIndexBytes = take_count_( aCursor, aVariant );
+			check_packed_sizes_( sizes, V, I, view.vertexSize, view.indexSize, aInputName, "map_baked_model_()" );
+
+			// Arrays that are stored as-is are used like uncompressed ones
+			auto const* vertices = checked_take_( aCursor, sizes.storedVertexBytes );
+			if( sizes.storedVertexBytes == sizes.vertexBytes )
+				(aVariant.quantized ? view.quantized : view.interleaved) = vertices;
+			else
+			{
+				view.packedVertices = vertices;
+				view.packedVertexBytes = sizes.storedVertexBytes;
+			}
+
+			auto const* indices = checked_take_( aCursor, sizes.storedIndexBytes );
+			if( sizes.storedIndexBytes == sizes.indexBytes )
+				view.indices = indices;
+			else
+			{
+				view.indices = nullptr;
+				view.packedIndices = indices;
+				view.packedIndexBytes = sizes.storedIndexBytes;
+			}
+
+			view.positions = view.normals = view.texcoords = view.tangents = nullptr;
+		}
+		else if( aVariant.interleaved || aVariant.quantized )
+		{
+			auto const offset = std::size_t(aCursor.pos - aFileData);
+			if( auto const rem = offset % kInterleavedAlign )
+				checked_take_( aCursor, kInterleavedAlign - rem );
+
+			if( aVariant.quantized )
+				view.quantized = checked_take_( aCursor, std::size_t(V)*sizeof(QuantizedVertex) );
+			else
+				view.interleaved = checked_take_( aCursor, std::size_t(V)*kInterleavedVertexSize );
+
+			view.positions = view.normals = view.texcoords = view.tangents = nullptr;
+		}
+		else
+		{
+			view.positions = checked_take_( aCursor, std::size_t(V)*sizeof(glm::vec3) );
+			view.normals = checked_take_( aCursor, std::size_t(V)*sizeof(glm::vec3) );
+			view.texcoords = checked_take_( aCursor, std::size_t(V)*sizeof(glm::vec2) );
+			view.tangents = checked_take_( aCursor, std::size_t(V)*sizeof(glm::vec4) );
+		}
+
+		if( !aVariant.bounds )
+		{
+			if( view.interleaved )
+				compute_bounds_( view.interleaved, V, kInterleavedVertexSize, view.aabbMin, view.aabbMax );
+			else
+				compute_bounds_( view.positions, V, sizeof(glm::vec3), view.aabbMin, view.aabbMax );
+		}
+
+		if( !aVariant.compressed )
+			view.indices = checked_take_( aCursor, std::size_t(I)*view.indexSize );
+
+		view.meshletCount = view.meshletVertexCount = view.meshletIndexCount = 0;
+		view.meshlets = view.meshletVertices = view.meshletTriangles = nullptr;
+		view.firstLod = view.lodCount = 0;
+		view.occlusion = nullptr;
+
+		return view;
+	}
+
+	// One mesh of the meshlet section
+	void take_meshlets_( MappedCursor_& aCursor, BakedMeshView& aView )
+	{
+		aView.meshletCount = take_uint32_( aCursor );
+		aView.meshletVertexCount = take_uint32_( aCursor );
+		aView.meshletIndexCount = take_uint32_( aCursor );
+
+		aView.meshlets = checked_take_( aCursor, std::size_t(aView.meshletCount)*sizeof(BakedMeshlet) );
+		aView.meshletVertices = checked_take_( aCursor, std::size_t(aView.meshletVertexCount)*sizeof(std::uint32_t) );
+		aView.meshletTriangles = checked_take_( aCursor, std::size_t(aView.meshletIndexCount)*sizeof(std::uint8_t) );
+	}
+
+	// One mesh of the LOD section; appends the LODs to aLods
+	void take_lods_( MappedCursor_& aCursor, BakedMeshView& aView, std::vector<BakedLodView>& aLods )
+	{
+		aView.firstLod = std::uint32_t(aLods.size());
+		aView.lodCount = take_uint32_( aCursor );
+		for( std::uint32_t j = 0; j < aView.lodCount; ++j )
+		{
+			BakedLodView lod;
+			std::memcpy( &lod.error, checked_take_( aCursor, sizeof(float) ), sizeof(float) );
+			lod.indexCount = take_uint32_( aCursor );
+			lod.indices = checked_take_( aCursor, std::size_t(lod.indexCount)*aView.indexSize );
+			aLods.emplace_back( lod );
+		}
+	}
+
+	MappedBakedModel map_baked_model_( lut::MappedFile aFile, char const* aInputName )
+	{
+		MappedBakedModel ret;
+		ret.file = std::move(aFile);
+
+		MappedCursor_ cur{ ret.file.data(), ret.file.data() + ret.file.size() };
+
+		// Figure out base path
+		std::string const prefix = path_prefix_( aInputName );
+
+		// Read header and verify file magic and variant
+		if( 0 != std::memcmp( checked_take_( cur, 16 ), kFileMagic, 16 ) )
+			throw lut::Error( "map_baked_model_(): %s: invalid file signature!", aInputName );
+
+		char variant[16];
+		std::memcpy( variant, checked_take_( cur, 16 ), 16 );
+
+		// "scsmbil-toc": everything is mapped from its chunk
+		if( 0 == std::memcmp( variant, kFileVariantToc, 16 ) || 0 == std::memcmp( variant, kFileVariantToc64, 16 ) )
+		{
+			ret.toc.wide = 0 == std::memcmp( variant, kFileVariantToc64, 16 );
+			map_toc_( ret, cur, aInputName );
+
+			auto const meshCount = std::uint32_t(ret.toc.meshes.size());
+			ret.meshes.reserve( meshCount );
+			for( std::uint32_t i = 0; i < meshCount; ++i )
+			{
+				ret.meshes.emplace_back( map_baked_mesh( ret, i, ret.lods ) );
+				assert( ret.meshes.back().materialId < ret.materials.size() );
+			}
+
+			return ret;
+		}
+
+		auto const fileVariant = check_variant_( variant, aInputName, "map_baked_model_()" );
+
+		// Read texture info
+		auto const textureCount = take_uint32_( cur );
+		ret.textures.reserve( textureCount );
+		for( std::uint32_t i = 0; i < textureCount; ++i )
+			ret.textures.emplace_back( take_texture_( cur, prefix ) );
+
+		// Read material info
+		auto const materialCount = take_uint32_( cur );
+		ret.materials.reserve( materialCount );
+		for( std::uint32_t i = 0; i < materialCount; ++i )
+		{
+			auto const info = take_material_( cur );
+
+			assert( valid_material_( info, ret.textures.size() ) );
+
+			ret.materials.emplace_back( info );
+		}
+
+		// Map mesh data; no copies are made here.
+		auto const meshCount = take_uint32_( cur );
+		ret.meshes.reserve( meshCount );
+		for( std::uint32_t i = 0; i < meshCount; ++i )
+		{
+			ret.meshes.emplace_back( take_mesh_( cur, ret.file.data(), fileVariant, aInputName ) );
+			assert( ret.meshes.back().materialId < ret.materials.size() );
+		}
+
+		// Optional sections
+		while( std::size_t(cur.end - cur.pos) >= 16 )
+		{
+			bool const meshlets = 0 == std::memcmp( cur.pos, kMeshletSectionId, 16 );
+			bool const lods = 0 == std::memcmp( cur.pos, kLodSectionId, 16 );
+			bool const constants = 0 == std::memcmp( cur.pos, kMaterialSectionId, 16 );
+			bool const names = 0 == std::memcmp( cur.pos, kNamesSectionId, 16 );
+			bool const formats = 0 == std::memcmp( cur.pos, kTextureFormatSectionId, 16 );
+			bool const bvh = 0 == std::memcmp( cur.pos, kBvhSectionId, 16 );
+			bool const pvs = 0 == std::memcmp( cur.pos, kPvsSectionId, 16 );
+			bool const occlusion = 0 == std::memcmp( cur.pos, kOcclusionSectionId, 16 );
+			bool const impostors = 0 == std::memcmp( cur.pos, kImpostorSectionId, 16 );
+			if( !meshlets && !lods && !constants && !names && !formats && !bvh && !pvs && !occlusion && !impostors )
+				break;
+
+			checked_take_( cur, 16 );
+			if( constants )
+			{
+				take_material_constants_( cur, ret.materials, aInputName );
+				continue;
+			}
+
+			if( names )
+			{
+				std::vector<std::string> meshNames;
+				take_names_( cur, ret.materials, meshNames, aInputName );
+				if( meshNames.size() != meshCount )
+					throw lut::Error( "map_baked_model_(): %s: names don't match the meshes", aInputName );
+
+				for( std::uint32_t i = 0; i < meshCount; ++i )
+					ret.meshes[i].name = std::move(meshNames[i]);
+				continue;
+			}
+
+			if( formats )
+			{
+				take_texture_formats_( cur, ret.textures, aInputName );
+				continue;
+			}
+
+			if( bvh )
+			{
+				take_bvh_( cur, ret.bvh, meshCount, aInputName );
+				continue;
+			}
+
+			if( pvs )
+			{
+				take_pvs_( cur, ret.pvs, meshCount, aInputName );
+				continue;
+			}
+
+			if( occlusion )
+			{
+				auto const chunks = take_occlusion_( cur, ret.file.data(), meshCount, aInputName );
+				for( std::uint32_t i = 0; i < meshCount; ++i )
+				{
+					if( chunks[i].size != ret.meshes[i].vertexCount )
+						throw lut::Error( "map_baked_model_(): %s: occlusion doesn't match the vertices of mesh %u", aInputName, i );
+					ret.meshes[i].occlusion = ret.file.data() + chunks[i].offset;
+				}
+				continue;
+			}
+
+			if( impostors )
+			{
+				take_impostors_( cur, ret.impostors, meshCount, ret.textures.size(), aInputName );
+				continue;
+			}
+
+			if( take_uint32_( cur ) != meshCount )
+				throw lut::Error( "map_baked_model_(): %s: %s section doesn't match the meshes", aInputName, meshlets ? "meshlet" : "LOD" );
+
+			for( std::uint32_t i = 0; i < meshCount && meshlets; ++i )
+				take_meshlets_( cur, ret.meshes[i] );
+
+			for( std::uint32_t i = 0; i < meshCount && lods; ++i )
+				take_lods_( cur, ret.meshes[i], ret.lods );
+		}
+
 		// Check
-		char byte;
-		auto const check = std::fread( &byte, 1, 1, aFin );
-		
-		if( 0 != check )
+		if( cur.pos != cur.end )
 			std::fprintf( stderr, "Note: '%s' contains trailing bytes\n", aInputName );
 
 		return ret;
 	}
+
+	// Reads the TOC (aCursor is just past the "scsmbil-toc" variant) and
+	// the textures and materials it refers to.
+	void map_toc_( MappedBakedModel& aModel, MappedCursor_& aCursor, char const* aInputName )
+	{
+		auto& toc = aModel.toc;
+
+		std::memcpy( toc.variant, checked_take_( aCursor, 16 ), 16 );
+		check_variant_( toc.variant, aInputName, "map_baked_toc()" );
+
+		auto const take_toc_count_ = [&] () -> std::uint64_t {
+			return toc.wide ? take_uint64_( aCursor ) : take_uint32_( aCursor );
+		};
+		auto const textureCount = take_toc_count_();
+		auto const materialCount = take_toc_count_();
+		auto const meshCount = take_toc_count_();
+
+		// Check the size before reserving anything; the sections' own counts
+		// (and the mesh indices) are 32-bit
+		auto const limit = std::uint64_t(std::numeric_limits<std::uint32_t>::max());
+		if( textureCount > limit || materialCount > limit || meshCount > limit )
+			throw lut::Error( "map_baked_toc(): %s: table of contents has more than 2^32 entries of a kind", aInputName );
+
+		std::uint64_t const chunks = textureCount + materialCount + 3ull*meshCount + 1;
+		if( chunks * sizeof(BakedChunk) > std::uint64_t(aCursor.end - aCursor.pos) )
+			throw lut::Error( "map_baked_toc(): %s: table of contents is truncated", aInputName );
+
+		auto const take_chunk_ = [&] {
+			BakedChunk chunk;
+			std::memcpy( &chunk, checked_take_( aCursor, sizeof(BakedChunk) ), sizeof(BakedChunk) );
+			return chunk;
+		};
+
+		toc.textures.resize( textureCount );
+		for( auto& chunk : toc.textures )
+			chunk = take_chunk_();
+
+		toc.materials.resize( materialCount );
+		for( auto& chunk : toc.materials )
+			chunk = take_chunk_();
+
+		toc.meshes.resize( meshCount );
+		toc.meshlets.resize( meshCount );
+		toc.lods.resize( meshCount );
+		for( std::size_t i = 0; i < meshCount; ++i )
+		{
+			toc.meshes[i] = take_chunk_();
+			toc.meshlets[i] = take_chunk_();
+			toc.lods[i] = take_chunk_();
+		}
+
+		toc.materialConstants = take_chunk_();
+
+		// Textures and materials are small; read them all
+		std::string const prefix = path_prefix_( aInputName );
+
+		aModel.textures.reserve( textureCount );
+		for( auto const& chunk : toc.textures )
+		{
+			auto cur = chunk_cursor_( aModel, chunk, aInputName );
+			aModel.textures.emplace_back( take_texture_( cur, prefix ) );
+			check_chunk_end_( cur, aInputName, "texture" );
+		}
+
+		aModel.materials.reserve( materialCount );
+		for( auto const& chunk : toc.materials )
+		{
+			auto cur = chunk_cursor_( aModel, chunk, aInputName );
+			auto const info = take_material_( cur );
+			check_chunk_end_( cur, aInputName, "material" );
+
+			assert( valid_material_( info, aModel.textures.size() ) );
+
+			aModel.materials.emplace_back( info );
+		}
+
+		if( toc.materialConstants.size )
+		{
+			auto cur = chunk_cursor_( aModel, toc.materialConstants, aInputName );
+			take_material_constants_( cur, aModel.materials, aInputName );
+			check_chunk_end_( cur, aInputName, "material constants" );
+		}
+
+		map_toc_trailing_( aModel, aInputName );
+	}
+
+	// The names, texture formats, BVH, PVS, occlusion and impostors aren't
+	// part of the TOC; their sections, if any, follow the last chunk, in this
+	// order.
+	void map_toc_trailing_( MappedBakedModel& aModel, char const* aInputName )
+	{
+		auto const& toc = aModel.toc;
+
+		std::uint64_t end = 0;
+		for( auto const* chunks : { &toc.textures, &toc.materials, &toc.meshes, &toc.meshlets, &toc.lods } )
+		{
+			for( auto const& chunk : *chunks )
+				end = std::max( end, chunk.offset + chunk.size );
+		}
+		end = std::max( end, toc.materialConstants.offset + toc.materialConstants.size );
+
+		auto const size = aModel.file.size();
+		if( end > size )
+			return;
+
+		MappedCursor_ cur{ aModel.file.data() + end, aModel.file.data() + size };
+		auto const section_ = [&] (char const (&aId)[16]) {
+			if( std::size_t(cur.end - cur.pos) < 16 || 0 != std::memcmp( cur.pos, aId, 16 ) )
+				return false;
+
+			cur.pos += 16;
+			return true;
+		};
+
+		if( section_( kNamesSectionId ) )
+		{
+			take_names_( cur, aModel.materials, aModel.toc.meshNames, aInputName );
+			if( aModel.toc.meshNames.size() != toc.meshes.size() )
+				throw lut::Error( "map_baked_toc(): %s: names don't match the meshes", aInputName );
+		}
+
+		if( section_( kTextureFormatSectionId ) )
+			take_texture_formats_( cur, aModel.textures, aInputName );
+
+		if( section_( kBvhSectionId ) )
+			take_bvh_( cur, aModel.bvh, toc.meshes.size(), aInputName );
+
+		if( section_( kPvsSectionId ) )
+			take_pvs_( cur, aModel.pvs, toc.meshes.size(), aInputName );
+
+		if( section_( kOcclusionSectionId ) )
+			aModel.toc.occlusion = take_occlusion_( cur, aModel.file.data(), toc.meshes.size(), aInputName );
+
+		if( section_( kImpostorSectionId ) )
+			take_impostors_( cur, aModel.impostors, toc.meshes.size(), aModel.textures.size(), aInputName );
+	}
+}
+
+BakedMeshView map_baked_mesh( MappedBakedModel const& aModel, std::uint32_t aMesh, std::vector<BakedLodView>& aLods )
+{
+	auto const& toc = aModel.toc;
+	if( aMesh >= toc.meshes.size() )
+		throw lut::Error( "map_baked_mesh(): mesh %u out of range (%zu meshes in the table of contents)", aMesh, toc.meshes.size() );
+
+	char name[32];
+	std::snprintf( name, sizeof(name), "mesh %u", aMesh );
+
+	auto fileVariant = check_variant_( toc.variant, name, "map_baked_mesh()" );
+	fileVariant.wide = toc.wide;
+
+	auto cur = chunk_cursor_( aModel, toc.meshes[aMesh], name );
+	auto view = take_mesh_( cur, aModel.file.data(), fileVariant, name );
+	check_chunk_end_( cur, name, "mesh" );
+
+	if( toc.meshlets[aMesh].size )
+	{
+		cur = chunk_cursor_( aModel, toc.meshlets[aMesh], name );
+		take_meshlets_( cur, view );
+		check_chunk_end_( cur, name, "meshlet" );
+	}
+
+	if( toc.lods[aMesh].size )
+	{
+		cur = chunk_cursor_( aModel, toc.lods[aMesh], name );
+		take_lods_( cur, view, aLods );
+		check_chunk_end_( cur, name, "LOD" );
+	}
+
+	if( !toc.meshNames.empty() )
+		view.name = toc.meshNames[aMesh];
+
+	if( !toc.occlusion.empty() )
+	{
+		if( toc.occlusion[aMesh].size != view.vertexCount )
+			throw lut::Error( "map_baked_mesh(): %s: occlusion doesn't match the vertices", name );
+		view.occlusion = aModel.file.data() + toc.occlusion[aMesh].offset;
+	}
+
+	return view;
 }
@@ -9,38 +9,199 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "baked_bvh.hpp"
+#include "baked_pvs.hpp"
+#include "baked_impostors.hpp"
+#include "baked_meshlet.hpp"
+
+#include "../labutils/mapped_file.hpp"
 
 /* Baked file format:
  *
  *  1. Header:
  *    - 16*char: file magic = "\0\0COMP5822Mmesh"
- *    - 16*char: variant = "default" (changes later)
+ *    - 16*char: variant = "scsmbil-tan", "scsmbil-ilv", "scsmbil-box",
+ *      "scsmbil-qnt", "scsmbil-b16", "scsmbil-q16", "scsmbil-lzb" or
+ *      "scsmbil-lzq" (see 4.), or "scsmbil-toc" or "scsmbil-t64" (see 1b.)
+ *
+ *  1b. Table of contents (variants "scsmbil-toc" and "scsmbil-t64" only)
+ *    - 16*char: variant of the content, any of the above except
+ *      "scsmbil-toc" and "scsmbil-t64"; everything after the TOC is as in
+ *      that variant, with the 64-bit counts of "scsmbil-t64" (see below)
+ *    - 1*uint32_t: U = number of textures (same as in 2.); uint64_t in
+ *      "scsmbil-t64", and so are M and N
+ *    - 1*uint32_t: M = number of materials (same as in 3.)
+ *    - 1*uint32_t: N = number of meshes (same as in 4.)
+ *    - repeat U times: chunk of the texture's record in 2.
+ *    - repeat M times: chunk of the material in 3.
+ *    - repeat N times:
+ *      - chunk of the mesh in 4., from its material index to its indices
+ *      - chunk of the mesh in 5., from its counts to its triangles
+ *      - chunk of the mesh in 6., from its LOD count to its last LOD
+ *    - chunk of 7., from its material count to its last material
+ *    - chunk:
+ *      - uint64_t: absolute file offset
+ *      - uint64_t: size in bytes; 0 if the file has no such section
+ *
+ *    "scsmbil-t64" is for scenes of several GiB: in 4., each mesh's V and I
+ *    and the four array sizes of the compressed variants are uint64_t too.
+ *    Loaders still reject meshes with more vertices or indices than a
+ *    uint32_t counts; those have to be split (e.g. cw2-bake --cell-size).
  *
  *  2. Textures
  *    - 1*uint32_t: U = number of (unique) textures
  *    - repeat U times:
  *      - string: path to texture
- *      - 1*uint8_t: number of channels in texture
+ *      - 1*uint8_t: number of channels in texture; 2 for the packed
+ *        roughness (R) and metalness (G) textures
+ *    The loaders mount the texture pack of each directory DIR that has
+ *    one, DIR.pack (cw2-bake --texture-pack; see labutils/texture_pack.hpp),
+ *    so the textures are then read from it.
  *
  *  3. Material information
  *    - 1*uint32_t: M = number of materials
  *    - repeat M times:
- *      - uint32_t: base color texture index
- *      - uint32_t: roughness texture index
- *      - uint32_t: metalness texture index
+ *      - uint32_t: base color texture index; 0xffffffff: constant (see 7.)
+ *      - uint32_t: roughness texture index; 0xffffffff: constant
+ *      - uint32_t: metalness texture index; 0xffffffff: constant
  *      - uint32_t: alpha mask texture index; set to 0xffffffff if not available
  *      - uint32_t: normal map texture index; set to 0xffffffff if not available
+ *    Roughness and metalness refer to the same two-channel texture. Files
+ *    from older bakers have two one-channel textures instead. The alpha
+ *    mask is a one-channel alpha coverage texture; in older files, it is
+ *    the base color texture (the mask in its alpha).
  *
  *  4. Mesh data
  *    - 1*uint32_t: M = number of meshes
  *    - repeat M times:
  *      - uint32_t : material index
- *      - uint32_t : V = number of vertices
- *      - uint32_t : I = number of indices
- *      - repeat V times: vec3 position
- *      - repeat V times: vec3 normal
- *      - repeat V times: vec2 texture coordinate
- *      - repeat I times: uint32_t index
+ *      - uint32_t : V = number of vertices (uint64_t in "scsmbil-t64")
+ *      - uint32_t : I = number of indices (uint64_t in "scsmbil-t64")
+ *      - variants "scsmbil-b16", "scsmbil-q16", "scsmbil-lzb" and
+ *        "scsmbil-lzq":
+ *        - uint32_t : S = index size in bytes (2 or 4)
+ *      - variant "scsmbil-tan":
+ *        - repeat V times: vec3 position
+ *        - repeat V times: vec3 normal
+ *        - repeat V times: vec2 texture coordinate
+ *        - repeat V times: vec4 tangent
+ *      - all variants except "scsmbil-tan" and "scsmbil-ilv":
+ *        - vec3: AABB min
+ *        - vec3: AABB max
+ *      - variants "scsmbil-lzb" and "scsmbil-lzq", instead of the rest:
+ *        - uint32_t : vertex array bytes (V * 48 or V * 20)
+ *        - uint32_t : CV = stored vertex array bytes
+ *        - uint32_t : index array bytes (I * S)
+ *        - uint32_t : CI = stored index array bytes
+ *        (all four uint64_t in "scsmbil-t64")
+ *        - CV bytes : the vertex array of "scsmbil-b16" or "scsmbil-q16",
+ *          respectively, as a LZ4 block (labutils/lz4_block.hpp); stored
+ *          as-is if CV equals its size
+ *        - CI bytes : the index array, same
+ *      - all variants except "scsmbil-tan":
+ *        - zero padding up to the next 16-byte aligned file offset
+ *      - variants "scsmbil-ilv", "scsmbil-box" and "scsmbil-b16":
+ *        - repeat V times: vec3 position, vec2 texcoord, vec3 normal,
+ *          vec4 tangent (48 bytes; the default vertex input layout)
+ *      - variants "scsmbil-qnt" and "scsmbil-q16":
+ *        - repeat V times: QuantizedVertex (20 bytes, positions relative
+ *          to the AABB; see quantized_vertex.hpp)
+ *      - repeat I times: uint32_t index (uint16_t if S = 2)
+ *
+ *  5. Meshlets (optional, any variant; see baked_meshlet.hpp)
+ *    - 16*char: section ID = "scsmbil-mlt"
+ *    - 1*uint32_t: M = number of meshes (same as in 4.)
+ *    - repeat M times:
+ *      - uint32_t : L = number of meshlets
+ *      - uint32_t : V = number of meshlet vertices
+ *      - uint32_t : T = number of local indices (3 per triangle)
+ *      - repeat L times: BakedMeshlet (60 bytes)
+ *      - repeat V times: uint32_t mesh-relative vertex index
+ *      - repeat T times: uint8_t index into the meshlet's vertices
+ *
+ *  6. LODs (optional, any variant)
+ *    - 16*char: section ID = "scsmbil-lod"
+ *    - 1*uint32_t: M = number of meshes (same as in 4.)
+ *    - repeat M times:
+ *      - uint32_t : N = number of LODs, excluding the full-detail mesh
+ *      - repeat N times, finest first:
+ *        - float : error, object space distance
+ *        - uint32_t : I = number of indices
+ *        - repeat I times: index, same size as the mesh's indices in 4.
+ *
+ *  7. Material constants (optional, any variant)
+ *    - 16*char: section ID = "scsmbil-mat"
+ *    - 1*uint32_t: M = number of materials (same as in 3.)
+ *    - repeat M times:
+ *      - vec4: base color (linear RGB, alpha)
+ *      - float: roughness
+ *      - float: metalness
+ *    The constants replace the textures whose index in 3. is 0xffffffff.
+ *    Files without this section have textures in all three slots.
+ *
+ *  8. Names (optional, any variant)
+ *    - 16*char: section ID = "scsmbil-nam"
+ *    - 1*uint32_t: M = number of materials (same as in 3.)
+ *    - repeat M times: string: material name
+ *    - 1*uint32_t: N = number of meshes (same as in 4.)
+ *    - repeat N times: string: mesh name
+ *    Purely informational, e.g. for debug labels. In "scsmbil-toc" files,
+ *    it directly follows the last chunk of the TOC.
+ *
+ *  9. Texture formats (optional, any variant)
+ *    - 16*char: section ID = "scsmbil-txf"
+ *    - 1*uint32_t: U = number of textures (same as in 2.)
+ *    - repeat U times:
+ *      - uint32_t: role (EBakedTextureRole)
+ *      - uint32_t: VkFormat of the texture as the baker wrote it (the
+ *        block format of baked texture files; the upload format of copied
+ *        images)
+ *    Files without this section get the role of each texture from the
+ *    first material slot that uses it. In "scsmbil-toc" files, it follows
+ *    the names section.
+ *
+ * 10. BVH over the meshes (optional, any variant; see baked_bvh.hpp)
+ *    - 16*char: section ID = "scsmbil-bvh"
+ *    - 1*uint32_t: M = number of meshes (same as in 4.)
+ *    - 1*uint32_t: N = number of nodes
+ *    - repeat N times: BakedBvhNode (32 bytes)
+ *    - 1*uint32_t: P = number of primitives
+ *    - repeat P times: uint32_t mesh index
+ *    Meshes without triangles may be left out. In "scsmbil-toc" files, it
+ *    follows the texture formats section.
+ *
+ * 11. Potentially visible sets (optional, any variant; see baked_pvs.hpp)
+ *    - 16*char: section ID = "scsmbil-pvs"
+ *    - 1*uint32_t: M = number of meshes (same as in 4.)
+ *    - 3*float: origin of the grid
+ *    - 1*float: cell size
+ *    - 3*uint32_t: cells along x, y and z
+ *    - 1*uint32_t: R = bytes per cell = (M + 7) / 8
+ *    - 1*uint32_t: B = bytes of the bitsets = R * number of cells
+ *    - 1*uint32_t: C = bytes stored
+ *    - C bytes: the bitsets as a LZ4 block, or as they are if C == B
+ *    In "scsmbil-toc" files, it follows the BVH section.
+ *
+ * 12. Ambient occlusion per vertex (optional, any variant)
+ *    - 16*char: section ID = "scsmbil-ao"
+ *    - 1*uint32_t: M = number of meshes (same as in 4.)
+ *    - repeat M times:
+ *      - 1*uint32_t: V = number of vertices of the mesh
+ *      - V*uint8_t: open fraction of the hemisphere above each vertex,
+ *        cosine-weighted; 255: unoccluded
+ *    In "scsmbil-toc" files, it follows the PVS section (if any).
+ *
+ * 13. Impostors (optional, any variant; see baked_impostors.hpp)
+ *    - 16*char: section ID = "scsmbil-imp"
+ *    - 1*uint32_t: M = number of meshes (same as in 4.)
+ *    - 1*uint32_t: views per side of the octahedral grid
+ *    - repeat M times: BakedImpostor (24 bytes); its albedo and normalDepth
+ *      index the textures of 1., 0xffffffff for meshes without triangles
+ *    In "scsmbil-toc" files, it follows the occlusion section (if any).
+ *
+ * The optional sections may appear in any order, each at most once.
  *
  * Strings are stored as
  *   - 1*uint32_t: N = length of string in chars, including terminating \0
@@ -68,31 +229,108 @@
  *   for each mesh (one for each attribute and one for the indices).
  */
 
+// Byte range within the file; see 1b. above
+struct BakedChunk
+{
+	std::uint64_t offset;
+	std::uint64_t size;
+};
+
+// Table of contents of a "scsmbil-toc" or "scsmbil-t64" file
+struct BakedFileToc
+{
+	char variant[16]; // variant of the content
+	bool wide = false; // "scsmbil-t64": 64-bit counts in the meshes
+
+	std::vector<BakedChunk> textures;
+	std::vector<BakedChunk> materials;
+	std::vector<BakedChunk> meshes;
+	std::vector<BakedChunk> meshlets; // size 0: no meshlet section
+	std::vector<BakedChunk> lods;     // size 0: no LOD section
+	BakedChunk materialConstants;     // size 0: no material constants
+
+	// Names of the meshes (see 8. above); empty if the file has none
+	std::vector<std::string> meshNames;
+
+	// Occlusion of each mesh's vertices (see 12. above), as file ranges;
+	// empty if the file has none
+	std::vector<BakedChunk> occlusion;
+};
+
+// What a texture is used for (see 9. above)
+enum class EBakedTextureRole : std::uint32_t
+{
+	unknown = 0, // file without texture formats
+	baseColor = 1, // sRGB RGBA; also alpha masks
+	roughnessMetalness = 2, // roughness in R, metalness in G
+	normalMap = 3, // tangent space XY(Z)
+	scalar = 4, // one channel: roughness or metalness of older files
+	alphaCoverage = 5, // one channel: alpha mask, coverage preserved in the mips
+	linearColor = 6 // linear RGBA: impostor normals and depth
+};
+
 struct BakedTextureInfo
 {
 	std::string path;
 	std::uint8_t channels;
+
+	// See 9. above; unknown and 0 (VK_FORMAT_UNDEFINED) if the file has no
+	// texture formats
+	EBakedTextureRole role = EBakedTextureRole::unknown;
+	std::uint32_t format = 0;
 };
 
+// Texture index of slots that have no texture
+constexpr std::uint32_t kBakedNoTexture = 0xffffffff;
+
 struct BakedMaterialInfo
 {
-	std::uint32_t baseColorTextureId;
-	std::uint32_t roughnessTextureId;
-	std::uint32_t metalnessTextureId;
+	std::uint32_t baseColorTextureId; // kBakedNoTexture: use baseColor
+	std::uint32_t roughnessTextureId; // kBakedNoTexture: use roughness
+	std::uint32_t metalnessTextureId; // kBakedNoTexture: use metalness
 	std::uint32_t alphaMaskTextureId; // May be set to 0xffffffff if no alpha mask
 	std::uint32_t normalMapTextureId; // May be set to 0xffffffff if no normal map
+
+	// Constants of the slots without texture (see 7. above)
+	glm::vec4 baseColor{ 1.f }; // linear RGB, alpha
+	float roughness = 1.f;
+	float metalness = 0.f;
+
+	std::string name; // see 8. above; empty if the file has no names
+};
+
+// Simplified version of a mesh; the indices refer to the mesh's vertices
+struct BakedLod
+{
+	float error; // deviation from the full-detail mesh (object space)
+	std::vector<std::uint32_t> indices;
 };
 
 struct BakedMeshData
 {
 	std::uint32_t materialId;
 
+	// Object space bounds; computed from the positions for files that don't
+	// store them.
+	glm::vec3 aabbMin, aabbMax;
+
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec2> texcoords;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec4> tangents;
 
-	std::vector<std::uint32_t> indices;
+	std::vector<std::uint32_t> indices; // 16-bit indices are widened on load
+
+	// Empty unless the file has a meshlet section
+	std::vector<BakedMeshlet> meshlets;
+	std::vector<std::uint32_t> meshletVertices;
+	std::vector<std::uint8_t> meshletTriangles;
+
+	// Empty unless the file has a LOD section; finest first
+	std::vector<BakedLod> lods;
+	std::string name; // see 8. above; empty if the file has no names
+
+	std::vector<std::uint8_t> occlusion; // see 12. above; empty if the file has none
 };
 
 struct BakedModel
@@ -100,9 +338,153 @@ struct BakedModel
 	std::vector<BakedTextureInfo> textures;
 	std::vector<BakedMaterialInfo> materials;
 	std::vector<BakedMeshData> meshes;
+
+	BakedBvh bvh; // see 10. above; empty if the file has none
+	BakedPvs pvs; // see 11. above; empty if the file has none
+	BakedImpostors impostors; // see 13. above; empty if the file has none
 };
 
 BakedModel load_baked_model( char const* aModelPath );
 
+/* Synthetic scale-up for benchmarks: aColumns x aRows copies of aModel in a
+ * grid on the xz plane, centred on the original and spaced by the extent of
+ * its bounds (plus a margin). The copies' positions, bounds and meshlet
+ * bounds are translated; their mesh names get a " [column,row]" suffix.
+ * Textures and materials are shared, and so are the impostors' atlases; the
+ * BVH and PVS are dropped. A 1x1 grid returns
+ * aModel unchanged.
+ */
+BakedModel tile_baked_model( BakedModel aModel, std::uint32_t aColumns, std::uint32_t aRows );
+
+/* The translations of tile_baked_model()'s copies, row by row, for a model
+ * with the bounds aMin and aMax; to draw the grid as instances instead (see
+ * set_model_instances()).
+ */
+std::vector<glm::mat4> grid_transforms( glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aColumns, std::uint32_t aRows );
+
+
+/* Zero-copy view of a baked model. The file is memory mapped, and each mesh
+ * refers to its attribute and index arrays directly inside the mapping. The
+ * arrays are not necessarily aligned (they follow variable length strings),
+ * so they are exposed as raw bytes and should be accessed via memcpy(). The
+ * views are only valid as long as the MappedBakedModel exists.
+ *
+ * For "scsmbil-ilv", "scsmbil-box" and "scsmbil-b16" files, `interleaved`
+ * points to the GPU-ready vertex array (16-byte aligned within the file); for
+ * "scsmbil-qnt" and "scsmbil-q16" files, `quantized` does. The other pointers are then null. For
+ * "scsmbil-tan" files, only the four per-attribute pointers are set.
+ *
+ * For "scsmbil-lzb" and "scsmbil-lzq" files, `packedVertices` and
+ * `packedIndices` point to the LZ4 blocks of the vertex and index arrays,
+ * and `interleaved`/`quantized` and `indices` are null. Decompress them with
+ * labutils::lz4_decompress() to vertexCount * vertexSize and indexCount *
+ * indexSize bytes, e.g. straight into staging memory, one mesh per thread.
+ * (Arrays that didn't compress are stored as-is; the packed pointer is null
+ * then, and the usual pointer is set, without any alignment.)
+ *
+ * The bounds are always valid (read from the file, or computed for the
+ * "scsmbil-tan" and "scsmbil-ilv" variants).
+ */
+struct BakedMeshView
+{
+	std::uint32_t materialId;
+
+	glm::vec3 aabbMin, aabbMax;
+
+	std::uint32_t vertexCount;
+	std::uint32_t indexCount;
+
+	std::uint8_t const* positions; // vertexCount * vec3
+	std::uint8_t const* normals;   // vertexCount * vec3
+	std::uint8_t const* texcoords; // vertexCount * vec2
+	std::uint8_t const* tangents;  // vertexCount * vec4
+
+	std::uint8_t const* interleaved; // vertexCount * 48 bytes
+	std::uint8_t const* quantized;   // vertexCount * QuantizedVertex
+
+	std::uint8_t const* indices;   // indexCount * indexSize
+	std::uint32_t indexSize;       // 2 (uint16_t) or 4 (uint32_t)
+
+	// Bytes per vertex of interleaved, quantized or packedVertices (48 or
+	// 20); 0 for "scsmbil-tan".
+	std::uint32_t vertexSize;
+
+	std::uint8_t const* packedVertices; // packedVertexBytes, LZ4 block
+	std::uint8_t const* packedIndices;  // packedIndexBytes, LZ4 block
+	std::uint64_t packedVertexBytes;
+	std::uint64_t packedIndexBytes;
+
+	// meshletCount is 0 unless the file has a meshlet section
+	std::uint32_t meshletCount;
+	std::uint32_t meshletVertexCount;
+	std::uint32_t meshletIndexCount;
+	std::uint8_t const* meshlets;         // meshletCount * BakedMeshlet
+	std::uint8_t const* meshletVertices;  // meshletVertexCount * uint32_t
+	std::uint8_t const* meshletTriangles; // meshletIndexCount * uint8_t
+
+	std::uint8_t const* occlusion; // vertexCount bytes (see 12. above); null if the file has none
+
+	// Range in MappedBakedModel::lods; empty unless the file has LODs
+	std::uint32_t firstLod;
+	std::uint32_t lodCount;
+
+	std::string name; // empty if the file has no names
+};
+
+struct BakedLodView
+{
+	float error;
+	std::uint32_t indexCount;
+	std::uint8_t const* indices; // indexCount * the mesh's indexSize
+};
+
+struct MappedBakedModel
+{
+	labutils::MappedFile file;
+
+	std::vector<BakedTextureInfo> textures;
+	std::vector<BakedMaterialInfo> materials;
+	std::vector<BakedMeshView> meshes;
+	std::vector<BakedLodView> lods;
+
+	BakedBvh bvh; // see 10. above; empty if the file has none
+	BakedPvs pvs; // see 11. above; empty if the file has none
+	BakedImpostors impostors; // see 13. above; empty if the file has none
+
+	BakedFileToc toc; // empty unless the file is a "scsmbil-toc" file
+};
+
+MappedBakedModel map_baked_model( char const* aModelPath );
+
+/* The same views, into a heap copy of the whole file instead of a mapping:
+ * all of the model's data is one allocation, read in a few large reads, with
+ * the meshes as spans into it (rather than the separate arrays per mesh of
+ * load_baked_model()). `file` owns the copy.
+ */
+MappedBakedModel read_baked_model( char const* aModelPath );
+
+/* The same views, into a file that has been read already (e.g., by
+ * labutils::FileReader); aModelPath is for error messages.
+ */
+MappedBakedModel read_baked_model( labutils::MappedFile aFile, char const* aModelPath );
+
+/* On-demand access to "scsmbil-toc" (and "scsmbil-t64") files. map_baked_toc() maps the file and
+ * reads the header, TOC, textures and materials; `meshes` and `lods` stay
+ * empty. map_baked_mesh() then maps any single mesh directly from its
+ * chunks, without looking at the rest of the file. It appends the mesh's
+ * LODs to aLods (BakedMeshView::firstLod indexes aLods). Meshes may be mapped
+ * concurrently, as long as each thread uses its own aLods.
+ *
+ * map_baked_model() of a "scsmbil-toc" file is map_baked_toc() followed by
+ * map_baked_mesh() for each mesh. Both functions throw for other variants.
+ */
+MappedBakedModel map_baked_toc( char const* aModelPath );
+
+BakedMeshView map_baked_mesh(
+	MappedBakedModel const&,
+	std::uint32_t aMesh,
+	std::vector<BakedLodView>& aLods
+);
+
 #endif // BAKED_MODEL_HPP_7D7BFF3A_1743_43DF_8D4F_D67D80FD8282
 
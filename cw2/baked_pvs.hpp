@@ -0,0 +1,51 @@
+#ifndef BAKED_PVS_HPP_5B1E9D42_7A3C_4E60_8F15_C2D04A6B93E7
+#define BAKED_PVS_HPP_5B1E9D42_7A3C_4E60_8F15_C2D04A6B93E7
+
+// Potentially visible sets: the model's bounds are divided into a grid of
+// view cells, and each cell has a bitset of the meshes that can be seen from
+// somewhere inside it (bit m of byte m / 8 for mesh m). Computed by cw2-bake
+// --pvs=SIZE (see cw2-bake/pvs.hpp) and stored, compressed, in the optional
+// "scsmbil-pvs" section of baked files (see baked_model.hpp). At run time,
+// the meshes outside the PVS of the camera's cell are culled (apply_pvs() in
+// culling.hpp); cameras outside the grid see every mesh.
+
+#include <vector>
+
+#include <cmath>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+// ID of the PVS section
+constexpr char kPvsSectionId[16] = "scsmbil-pvs";
+
+struct BakedPvs
+{
+	glm::vec3 origin{ 0.f }; // minimum corner of the grid
+	float cellSize = 0.f;
+	std::uint32_t dims[3]{}; // cells along x, y and z
+
+	std::uint32_t rowBytes = 0; // bytes per bitset: (mesh count + 7) / 8
+	std::vector<std::uint8_t> bits; // one bitset per cell, x fastest; empty: no PVS
+
+	// Bitset of the cell containing aPoint; null outside the grid
+	std::uint8_t const* cell( glm::vec3 const& aPoint ) const
+	{
+		if( bits.empty() )
+			return nullptr;
+
+		glm::vec3 const c = (aPoint - origin) / cellSize;
+		std::uint32_t idx[3];
+		for( int i = 0; i < 3; ++i )
+		{
+			if( !(c[i] >= 0.f) || c[i] >= float(dims[i]) )
+				return nullptr;
+			idx[i] = std::uint32_t(c[i]);
+		}
+
+		std::size_t const index = (std::size_t(idx[2]) * dims[1] + idx[1]) * dims[0] + idx[0];
+		return bits.data() + index * rowBytes;
+	}
+};
+
+#endif // BAKED_PVS_HPP_5B1E9D42_7A3C_4E60_8F15_C2D04A6B93E7
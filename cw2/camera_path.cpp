@@ -0,0 +1,75 @@
+#include "camera_path.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+CameraPath load_camera_path( char const* aPath )
+{
+	std::FILE* file = std::fopen( aPath, "r" );
+	if( !file )
+		throw lut::Error( "Unable to open camera path '%s' for reading", aPath );
+
+	CameraPath ret;
+
+	char line[1024];
+	for( std::size_t lineNo = 1; std::fgets( line, sizeof(line), file ); ++lineNo )
+	{
+		char const* ptr = line;
+		while( ' ' == *ptr || '\t' == *ptr )
+			++ptr;
+
+		if( '#' == *ptr || '\n' == *ptr || '\r' == *ptr || '\0' == *ptr )
+			continue;
+
+		CameraKey key{};
+
+		char* end = nullptr;
+		key.time = std::strtof( ptr, &end );
+		bool ok = end != ptr;
+
+		for( int i = 0; ok && i < 16; ++i )
+		{
+			ptr = end;
+			key.camera2world[i/4][i%4] = std::strtof( ptr, &end );
+			ok = end != ptr;
+		}
+
+		if( !ok )
+		{
+			std::fclose( file );
+			throw lut::Error( "%s:%zu: expected a time and 16 matrix elements", aPath, lineNo );
+		}
+
+		ret.emplace_back( key );
+	}
+
+	std::fclose( file );
+
+	if( ret.empty() )
+		throw lut::Error( "Camera path '%s' has no keys", aPath );
+
+	return ret;
+}
+
+void save_camera_path( char const* aPath, CameraPath const& aPathKeys )
+{
+	std::FILE* file = std::fopen( aPath, "w" );
+	if( !file )
+		throw lut::Error( "Unable to open camera path '%s' for writing", aPath );
+
+	std::fprintf( file, "# cw2 camera path: time, then camera2world (column-major)\n" );
+	for( auto const& key : aPathKeys )
+	{
+		std::fprintf( file, "%.6f", key.time );
+		for( int i = 0; i < 16; ++i )
+			std::fprintf( file, " %.9g", key.camera2world[i/4][i%4] );
+		std::fprintf( file, "\n" );
+	}
+
+	bool const ok = !std::ferror( file );
+	if( 0 != std::fclose( file ) || !ok )
+		throw lut::Error( "Unable to write camera path '%s'", aPath );
+}
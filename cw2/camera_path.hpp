@@ -0,0 +1,30 @@
+#ifndef CAMERA_PATH_HPP_5D2B8E41_7A0C_4C93_8F16_B4E9A2D07C35
+#define CAMERA_PATH_HPP_5D2B8E41_7A0C_4C93_8F16_B4E9A2D07C35
+
+// Recorded camera paths, for repeatable benchmarks (see --capture-path and
+// --bench). A path is a text file with one key per line:
+//
+//   <time> <m00> <m01> ... <m33>
+//
+// where time is in seconds since the start of the capture, and m is the
+// camera-to-world matrix in column-major order (as glm stores it). Empty
+// lines and lines starting with '#' are ignored.
+
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+struct CameraKey
+{
+	float time;
+	glm::mat4 camera2world;
+};
+
+using CameraPath = std::vector<CameraKey>;
+
+// Both throw labutils::Error if the file cannot be read or written, or is
+// malformed.
+CameraPath load_camera_path( char const* aPath );
+void save_camera_path( char const* aPath, CameraPath const& );
+
+#endif // CAMERA_PATH_HPP_5D2B8E41_7A0C_4C93_8F16_B4E9A2D07C35
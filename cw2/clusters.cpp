@@ -0,0 +1,136 @@
+#include "clusters.hpp"
+
+#include <vector>
+
+#include <cassert>
+
+#include <glm/matrix.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	constexpr std::uint32_t kClusterWorkgroupSize = 64; // local_size_x in cluster.comp
+
+	// Matches the push constant block in cluster.comp
+	struct ClusterPush_
+	{
+		glm::mat4 invProjection;
+		float tileScale[2];
+		float near, far;
+		std::uint32_t lightCount;
+	};
+}
+
+LightClusters create_light_clusters( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkDescriptorSetLayout aSceneLayout, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, std::uint32_t aLightCount, VkPipelineCache aCache, bool aAsyncCompute )
+{
+	assert( !aAsyncCompute || VK_NULL_HANDLE != aWindow.computeQueue );
+
+	LightClusters ret;
+	ret.lightCount = aLightCount;
+	ret.async = aAsyncCompute;
+
+	std::vector<std::uint32_t> families;
+	if( aAsyncCompute )
+		families = { aWindow.graphicsFamilyIndex, aWindow.computeFamilyIndex };
+
+	ret.grid = lut::create_buffer( aAllocator, kClusterGridBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device, 0, families );
+
+	// Pipeline
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		range.offset = 0;
+		range.size = sizeof(ClusterPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &aSceneLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create light clustering pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = ret.pipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create light clustering pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipe = lut::Pipeline( aWindow.device, pipe );
+	}
+
+	return ret;
+}
+
+void record_light_clustering( VkCommandBuffer aCmdBuff, LightClusters& aClusters, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset, VkExtent2D const& aImageExtent, glm::mat4 const& aProjection, float aNear, float aFar )
+{
+	// Without lights, all counts (and the header) stay zero
+	if( 0 == aClusters.lightCount )
+	{
+		if( !aClusters.valid )
+		{
+			vkCmdFillBuffer( aCmdBuff, aClusters.grid.buffer, 0, sizeof(ClusterGrid), 0 );
+
+			if( !aClusters.async )
+			{
+				lut::buffer_barrier( aCmdBuff, aClusters.grid.buffer,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+			}
+
+			aClusters.valid = true;
+		}
+		return;
+	}
+
+	// The previous frame's shading read the grid before it is overwritten.
+	// (A compute queue has no fragment stage; its submission waits for the
+	// previous frame instead.)
+	if( !aClusters.async )
+	{
+		lut::buffer_barrier( aCmdBuff, aClusters.grid.buffer,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+	}
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aClusters.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aClusters.pipeLayout.handle, 0, 1, &aSceneDescriptors, 1, &aSceneOffset );
+
+	ClusterPush_ push{};
+	push.invProjection = glm::inverse( aProjection );
+	push.tileScale[0] = float(kClusterGridX) / float(aImageExtent.width);
+	push.tileScale[1] = float(kClusterGridY) / float(aImageExtent.height);
+	push.near = aNear;
+	push.far = aFar;
+	push.lightCount = aClusters.lightCount;
+	vkCmdPushConstants( aCmdBuff, aClusters.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+
+	vkCmdDispatch( aCmdBuff, (kClusterCount + kClusterWorkgroupSize-1) / kClusterWorkgroupSize, 1, 1 );
+
+	// With async compute, the semaphore signalled by the submission makes
+	// the writes available
+	if( !aClusters.async )
+	{
+		lut::buffer_barrier( aCmdBuff, aClusters.grid.buffer,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+	}
+
+	aClusters.valid = true;
+}
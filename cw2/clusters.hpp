@@ -0,0 +1,104 @@
+#ifndef CLUSTERS_HPP_9C394DD4_C299_4B31_883B_2EBF0F6691B8
+#define CLUSTERS_HPP_9C394DD4_C299_4B31_883B_2EBF0F6691B8
+
+// Clustered point lights (see lights.hpp). Each frame, a compute shader
+// (cw2/shaders/cluster.comp) bins the lights into a view-space grid of
+// clusters: kClusterGridX x kClusterGridY screen tiles, each split into
+// kClusterGridZ slices that are exponentially spaced in depth. The shading
+// passes, forward and deferred, then only loop over the lights of the
+// fragment's cluster (cw2/shaders/point_lights.glsl).
+//
+// The lights and the grid are bindings 1 and 2 of the scene descriptor set,
+// which the clustering pass binds as well.
+//
+// With async compute, the pass is recorded into its own command buffer and
+// submitted to VulkanContext::computeQueue; semaphores order it after the
+// previous frame's shading and before this frame's, in place of barriers.
+// The grid, the lights and the scene uniforms are then shared concurrently
+// between the graphics and compute families.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/mat4x4.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// Must match cw2/shaders/clusters.glsl
+constexpr std::uint32_t kClusterGridX = 16;
+constexpr std::uint32_t kClusterGridY = 9;
+constexpr std::uint32_t kClusterGridZ = 24;
+constexpr std::uint32_t kClusterCount = kClusterGridX * kClusterGridY * kClusterGridZ;
+
+// Further lights in a cluster are dropped
+constexpr std::uint32_t kMaxLightsPerCluster = 128;
+
+// Layout of the grid buffer (std430). The header is written by the
+// clustering pass along with the lists.
+struct ClusterGrid
+{
+	float tileScale[2];  // clusters per pixel
+	float sliceScale;    // slice = log(view depth) * sliceScale + sliceBias
+	float sliceBias;
+	std::uint32_t counts[kClusterCount];
+	// followed by kMaxLightsPerCluster light indices per cluster
+};
+
+constexpr VkDeviceSize kClusterGridBytes = sizeof(ClusterGrid) + VkDeviceSize(kClusterCount) * kMaxLightsPerCluster * sizeof(std::uint32_t);
+
+struct LightClusters
+{
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	lut::Buffer grid; // storage buffer, see ClusterGrid
+
+	std::uint32_t lightCount = 0;
+
+	// False until the grid has been initialized (without lights, it is
+	// cleared once and never written again)
+	bool valid = false;
+
+	// Recorded for the async compute queue (see above)
+	bool async = false;
+};
+
+// aSceneLayout is the scene's set layout, with the scene uniforms at binding
+// 0 (dynamic), the lights at 1 and the grid at 2, all visible to compute
+// shaders. aAsyncCompute requires VulkanContext::computeQueue.
+LightClusters create_light_clusters(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkDescriptorSetLayout aSceneLayout,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	std::uint32_t aLightCount,
+	VkPipelineCache = VK_NULL_HANDLE,
+	bool aAsyncCompute = false
+);
+
+// Records the clustering pass, including the barriers against the previous
+// frame's shading and towards this frame's (not with async compute, see
+// above). Must be recorded outside of a render pass, after the scene
+// uniforms have been written. aProjection must be that of the frame's
+// camera; [aNear, aFar] is the view depth range of the slices, the last of
+// which extends to infinity.
+void record_light_clustering(
+	VkCommandBuffer,
+	LightClusters&,
+	VkDescriptorSet aSceneDescriptors,
+	std::uint32_t aSceneOffset,
+	VkExtent2D const& aImageExtent,
+	glm::mat4 const& aProjection,
+	float aNear,
+	float aFar
+);
+
+#endif // CLUSTERS_HPP_9C394DD4_C299_4B31_883B_2EBF0F6691B8
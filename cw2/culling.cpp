@@ -0,0 +1,691 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+
+#include <cmath>
+#include <cassert>
+#include <cstring>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#	define CW2_CULL_SSE_ 1
+#	include <xmmintrin.h>
+#else
+#	define CW2_CULL_SSE_ 0
+#endif
+
+namespace
+{
+	// Matches struct CullItem in cw2/shaders/cull.comp (std430)
+	struct GpuCullItem_
+	{
+		glm::vec4 aabbMin;
+		glm::vec4 aabbMax;
+
+		// Normal cone of meshlets; w of coneAxis is the cutoff (> 1: never
+		// culled, which is the case for whole meshes)
+		glm::vec4 coneApex;
+		glm::vec4 coneAxis;
+
+		// Index ranges and errors of the LODs; LOD 0 is the command's
+		std::uint32_t lodFirstIndex[kMaxMeshLods];
+		std::uint32_t lodIndexCount[kMaxMeshLods];
+		float lodError[kMaxMeshLods];
+
+		VkDrawIndexedIndirectCommand command;
+
+		std::uint32_t group;
+		std::uint32_t outBase;
+		std::uint32_t lodCount;
+	};
+	static_assert( sizeof(GpuCullItem_) == 144, "GpuCullItem_ must match the std430 layout of CullItem" );
+	static_assert( 4 == kMaxMeshLods, "CullItem in cull.comp holds 4 LODs" );
+
+	// Matches the push constant block in cw2/shaders/cull.comp
+	struct GpuCullPush_
+	{
+		glm::mat4 prevProjCam;
+		std::uint32_t depthSize[2];
+		std::uint32_t itemCount;
+		std::uint32_t hizLevels;
+		float lodScale;
+	};
+	static_assert( sizeof(GpuCullPush_) == 84, "GpuCullPush_ must match the push constant block in cull.comp" );
+
+	constexpr std::uint32_t kCullWorkgroupSize = 64; // local_size_x in cull.comp
+
+	lut::DescriptorSetLayout create_cull_descriptor_layout_( lut::VulkanWindow const& );
+	lut::PipelineLayout create_cull_pipeline_layout_( lut::VulkanWindow const&, VkDescriptorSetLayout );
+	lut::Pipeline create_cull_pipeline_( lut::VulkanWindow const&, VkPipelineLayout, lut::ShaderModuleCache&, char const* aShaderPath, VkPipelineCache );
+
+	glm::vec4 row_( glm::mat4 const& aM, int aRow )
+	{
+		return glm::vec4( aM[0][aRow], aM[1][aRow], aM[2][aRow], aM[3][aRow] );
+	}
+
+	glm::vec4 normalize_plane_( glm::vec4 const& aPlane )
+	{
+		float const len = glm::length( glm::vec3( aPlane ) );
+		return len > 0.f ? aPlane / len : aPlane;
+	}
+}
+
+Frustum make_frustum( glm::mat4 const& aProjCam )
+{
+	// Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+	// World-View-Projection Matrix". Vulkan's clip space has 0 <= z <= w,
+	// and the projection is reverse-Z with an infinite far plane, so z >= 0
+	// is the plane at infinity (which culls nothing) and z <= w the near
+	// plane.
+	auto const r0 = row_( aProjCam, 0 );
+	auto const r1 = row_( aProjCam, 1 );
+	auto const r2 = row_( aProjCam, 2 );
+	auto const r3 = row_( aProjCam, 3 );
+
+	Frustum ret;
+	ret.planes[0] = normalize_plane_( r3 + r0 ); // left
+	ret.planes[1] = normalize_plane_( r3 - r0 ); // right
+	ret.planes[2] = normalize_plane_( r3 + r1 ); // bottom (top, with a flipped Y)
+	ret.planes[3] = normalize_plane_( r3 - r1 ); // top
+	ret.planes[4] = normalize_plane_( r2 );      // far
+	ret.planes[5] = normalize_plane_( r3 - r2 ); // near
+	return ret;
+}
+
+AabbSoA make_aabb_soa( std::vector<Mesh> const& aMeshes )
+{
+	AabbSoA ret;
+	ret.count = aMeshes.size();
+
+	// Padding boxes are degenerate boxes at the origin; their results are
+	// never read.
+	std::size_t const padded = (ret.count + kCullBatch-1) / kCullBatch * kCullBatch;
+	ret.minX.assign( padded, 0.f ); ret.minY.assign( padded, 0.f ); ret.minZ.assign( padded, 0.f );
+	ret.maxX.assign( padded, 0.f ); ret.maxY.assign( padded, 0.f ); ret.maxZ.assign( padded, 0.f );
+
+	for( std::size_t i = 0; i < ret.count; ++i )
+	{
+		auto const& mesh = aMeshes[i];
+		ret.minX[i] = mesh.aabbMin.x; ret.minY[i] = mesh.aabbMin.y; ret.minZ[i] = mesh.aabbMin.z;
+		ret.maxX[i] = mesh.aabbMax.x; ret.maxY[i] = mesh.aabbMax.y; ret.maxZ[i] = mesh.aabbMax.z;
+	}
+
+	return ret;
+}
+
+std::size_t cull_aabbs( Frustum const& aFrustum, AabbSoA const& aBoxes, std::vector<std::uint8_t>& aVisible )
+{
+	aVisible.resize( aBoxes.count );
+
+	// For each plane, only the box corner furthest along the plane normal
+	// (the "p-vertex") needs testing: if it is behind the plane, the whole box
+	// is. Which of min/max gives the p-vertex depends only on the plane, so
+	// the selection happens once per plane rather than per box.
+	struct PlaneSel_
+	{
+		float const* x;
+		float const* y;
+		float const* z;
+	} sel[6];
+
+	for( int p = 0; p < 6; ++p )
+	{
+		auto const& pl = aFrustum.planes[p];
+		sel[p].x = (pl.x >= 0.f ? aBoxes.maxX : aBoxes.minX).data();
+		sel[p].y = (pl.y >= 0.f ? aBoxes.maxY : aBoxes.minY).data();
+		sel[p].z = (pl.z >= 0.f ? aBoxes.maxZ : aBoxes.minZ).data();
+	}
+
+	std::size_t visible = 0;
+	std::size_t const padded = aBoxes.minX.size();
+	assert( 0 == padded % kCullBatch );
+
+	for( std::size_t i = 0; i < padded; i += kCullBatch )
+	{
+#		if CW2_CULL_SSE_
+		__m128 outside = _mm_setzero_ps();
+		for( int p = 0; p < 6; ++p )
+		{
+			auto const& pl = aFrustum.planes[p];
+
+			__m128 d = _mm_set1_ps( pl.w );
+			d = _mm_add_ps( d, _mm_mul_ps( _mm_set1_ps( pl.x ), _mm_loadu_ps( sel[p].x + i ) ) );
+			d = _mm_add_ps( d, _mm_mul_ps( _mm_set1_ps( pl.y ), _mm_loadu_ps( sel[p].y + i ) ) );
+			d = _mm_add_ps( d, _mm_mul_ps( _mm_set1_ps( pl.z ), _mm_loadu_ps( sel[p].z + i ) ) );
+
+			outside = _mm_or_ps( outside, _mm_cmplt_ps( d, _mm_setzero_ps() ) );
+		}
+
+		int const outMask = _mm_movemask_ps( outside );
+#		else
+		int outMask = 0;
+		for( std::size_t j = 0; j < kCullBatch; ++j )
+		{
+			for( int p = 0; p < 6; ++p )
+			{
+				auto const& pl = aFrustum.planes[p];
+				float const d = pl.x * sel[p].x[i+j] + pl.y * sel[p].y[i+j] + pl.z * sel[p].z[i+j] + pl.w;
+				if( d < 0.f )
+					outMask |= 1 << j;
+			}
+		}
+#		endif
+
+		for( std::size_t j = 0; j < kCullBatch && i+j < aBoxes.count; ++j )
+		{
+			std::uint8_t const vis = (outMask & (1 << j)) ? 0 : 1;
+			aVisible[i+j] = vis;
+			visible += vis;
+		}
+	}
+
+	return visible;
+}
+
+std::size_t cull_bvh( Frustum const& aFrustum, BakedBvh const& aBvh, AabbSoA const& aBoxes, std::vector<std::uint8_t>& aVisible )
+{
+	aVisible.assign( aBoxes.count, 0 );
+
+	// 0: outside, 1: intersecting, 2: inside. Besides the p-vertex (see
+	// cull_aabbs()), the opposite corner decides if the box is entirely in
+	// front of a plane.
+	auto const classify_ = [&] (glm::vec3 const& aMin, glm::vec3 const& aMax) {
+		int ret = 2;
+		for( auto const& pl : aFrustum.planes )
+		{
+			glm::vec3 const n( pl );
+			glm::vec3 const p( pl.x >= 0.f ? aMax.x : aMin.x, pl.y >= 0.f ? aMax.y : aMin.y, pl.z >= 0.f ? aMax.z : aMin.z );
+			if( glm::dot( n, p ) + pl.w < 0.f )
+				return 0;
+
+			glm::vec3 const q( pl.x >= 0.f ? aMin.x : aMax.x, pl.y >= 0.f ? aMin.y : aMax.y, pl.z >= 0.f ? aMin.z : aMax.z );
+			if( glm::dot( n, q ) + pl.w < 0.f )
+				ret = 1;
+		}
+		return ret;
+	};
+
+	std::size_t visible = 0;
+	auto const accept_ = [&] (std::uint32_t aBegin, std::uint32_t aEnd) {
+		for( std::uint32_t i = aBegin; i < aEnd; ++i )
+		{
+			auto const box = aBvh.primitives[i];
+			assert( box < aBoxes.count );
+			aVisible[box] = 1;
+		}
+		visible += aEnd - aBegin;
+	};
+
+	auto const nodeCount = std::uint32_t(aBvh.nodes.size());
+	for( std::uint32_t i = 0; i < nodeCount; )
+	{
+		auto const& node = aBvh.nodes[i];
+		int const state = classify_( node.aabbMin, node.aabbMax );
+		if( 2 == state )
+			accept_( node.first, aBvh.end( i ) );
+
+		if( 1 != state )
+		{
+			i = node.skip;
+			continue;
+		}
+
+		// Leaves test their boxes
+		if( node.skip == i + 1 )
+		{
+			for( std::uint32_t j = node.first; j < aBvh.end( i ); ++j )
+			{
+				auto const box = aBvh.primitives[j];
+				glm::vec3 const bmin( aBoxes.minX[box], aBoxes.minY[box], aBoxes.minZ[box] );
+				glm::vec3 const bmax( aBoxes.maxX[box], aBoxes.maxY[box], aBoxes.maxZ[box] );
+				if( 0 != classify_( bmin, bmax ) )
+				{
+					aVisible[box] = 1;
+					++visible;
+				}
+			}
+		}
+
+		++i;
+	}
+
+	return visible;
+}
+
+bool raycast_bvh( BakedBvh const& aBvh, AabbSoA const& aBoxes, glm::vec3 const& aOrigin, glm::vec3 const& aDirection, float aMaxDistance, RayHit& aHit )
+{
+	// Slabs; a zero direction component gives infinite t, which min/max
+	// sort out (unless the origin lies exactly on that slab's plane)
+	glm::vec3 const inv = 1.f / aDirection;
+	auto const enter_ = [&] (glm::vec3 const& aMin, glm::vec3 const& aMax, float aLimit, float& aT) {
+		glm::vec3 const t0 = (aMin - aOrigin) * inv;
+		glm::vec3 const t1 = (aMax - aOrigin) * inv;
+		glm::vec3 const lo = glm::min( t0, t1 ), hi = glm::max( t0, t1 );
+		float const tNear = std::max( std::max( lo.x, lo.y ), std::max( lo.z, 0.f ) );
+		float const tFar = std::min( std::min( hi.x, hi.y ), std::min( hi.z, aLimit ) );
+		aT = tNear;
+		return tNear <= tFar;
+	};
+
+	bool hit = false;
+	float best = aMaxDistance;
+
+	auto const nodeCount = std::uint32_t(aBvh.nodes.size());
+	for( std::uint32_t i = 0; i < nodeCount; )
+	{
+		auto const& node = aBvh.nodes[i];
+
+		float t;
+		if( !enter_( node.aabbMin, node.aabbMax, best, t ) )
+		{
+			i = node.skip;
+			continue;
+		}
+
+		if( node.skip == i + 1 )
+		{
+			for( std::uint32_t j = node.first; j < aBvh.end( i ); ++j )
+			{
+				auto const box = aBvh.primitives[j];
+				glm::vec3 const bmin( aBoxes.minX[box], aBoxes.minY[box], aBoxes.minZ[box] );
+				glm::vec3 const bmax( aBoxes.maxX[box], aBoxes.maxY[box], aBoxes.maxZ[box] );
+				if( enter_( bmin, bmax, best, t ) && (!hit || t < best) )
+				{
+					hit = true;
+					best = t;
+					aHit = RayHit{ box, t };
+				}
+			}
+		}
+
+		++i;
+	}
+
+	return hit;
+}
+
+std::size_t apply_pvs( BakedPvs const& aPvs, glm::vec3 const& aCamera, std::vector<std::uint8_t>& aVisible )
+{
+	auto const* bits = aPvs.cell( aCamera );
+
+	std::size_t visible = 0;
+	for( std::size_t i = 0; i < aVisible.size(); ++i )
+	{
+		if( bits && i / 8 < aPvs.rowBytes && 0 == (bits[i / 8] & (1u << (i % 8))) )
+			aVisible[i] = 0;
+		visible += aVisible[i] ? 1 : 0;
+	}
+
+	return visible;
+}
+
+float lod_scale( glm::mat4 const& aProjection, std::uint32_t aViewportHeight, float aPixelThreshold )
+{
+	// An error e at distance d covers e * proj[1][1] * height/2 / d pixels
+	return std::abs( aProjection[1][1] ) * 0.5f * float(aViewportHeight) / aPixelThreshold;
+}
+
+void select_lods( ModelPack const& aModel, glm::vec3 const& aCameraPos, float aLodScale, std::vector<std::uint8_t>& aLods )
+{
+	aLods.resize( aModel.meshes.size() );
+
+	for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+	{
+		auto const& mesh = aModel.meshes[i];
+
+		// Distance to the closest point of the box; 0 inside it
+		float const distance = glm::length( glm::clamp( aCameraPos, mesh.aabbMin, mesh.aabbMax ) - aCameraPos );
+
+		std::uint8_t lod = 0;
+		while( lod+1u < mesh.lodCount && mesh.lods[lod+1].error * aLodScale <= distance )
+			++lod;
+
+		aLods[i] = lod;
+	}
+}
+
+std::size_t select_impostors( ModelPack const& aModel, glm::vec3 const& aCameraPos, float aImpostorScale, std::vector<std::uint8_t>& aVisible, std::vector<std::uint32_t>& aMeshes )
+{
+	aMeshes.clear();
+	if( aModel.impostors.meshes.empty() || aImpostorScale <= 0.f )
+		return 0;
+
+	assert( aVisible.size() == aModel.meshes.size() );
+	assert( aModel.impostors.meshes.size() == aModel.meshes.size() );
+
+	for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+	{
+		auto const& impostor = aModel.impostors.meshes[i];
+		if( !aVisible[i] || kNoTexture == impostor.albedo )
+			continue;
+
+		// Same distance as select_lods()
+		auto const& mesh = aModel.meshes[i];
+		float const distance = glm::length( glm::clamp( aCameraPos, mesh.aabbMin, mesh.aabbMax ) - aCameraPos );
+		if( 2.f * impostor.radius * aImpostorScale <= distance )
+		{
+			aVisible[i] = 0;
+			aMeshes.emplace_back( std::uint32_t(i) );
+		}
+	}
+
+	return aMeshes.size();
+}
+
+void compact_draw_commands( ModelPack const& aModel, std::vector<std::uint8_t> const& aVisible, std::vector<std::uint8_t> const& aLods, VkDrawIndexedIndirectCommand* aOut, DrawBatchList& aOpaqueBatches, DrawBatchList& aAlphaBatches )
+{
+	assert( aVisible.size() == aModel.meshes.size() );
+	assert( aLods.empty() || aLods.size() == aModel.meshes.size() );
+	assert( aModel.drawCommandMeshes.size() == aModel.hostDrawCommands.size() );
+
+	std::uint32_t written = 0;
+	auto const compact_ = [&] (std::vector<DrawBatch> const& aIn, DrawBatchList& aBatchesOut)
+	{
+		aBatchesOut.clear();
+		aBatchesOut.reserve( aIn.size() ); // at most one allocation
+		for( auto const& batch : aIn )
+		{
+			DrawBatch out{};
+			out.indexType = batch.indexType;
+			out.matID = batch.matID;
+			out.firstCommand = written;
+
+			for( std::uint32_t i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; ++i )
+			{
+				auto const mesh = aModel.drawCommandMeshes[i];
+				if( !aVisible[mesh] )
+					continue;
+
+				auto& cmd = aOut[written++];
+				cmd = aModel.hostDrawCommands[i];
+				if( !aLods.empty() && aLods[mesh] > 0 )
+				{
+					auto const& lod = aModel.meshes[mesh].lods[aLods[mesh]];
+					cmd.firstIndex = lod.firstIndex;
+					cmd.indexCount = lod.indexCount;
+				}
+			}
+
+			out.commandCount = written - out.firstCommand;
+			if( out.commandCount > 0 )
+				aBatchesOut.emplace_back( out );
+		}
+	};
+
+	compact_( aModel.opaqueBatches, aOpaqueBatches );
+	compact_( aModel.alphaBatches, aAlphaBatches );
+}
+
+GpuCuller create_gpu_culler( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::DescriptorAllocator& aDescriptors, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, ModelPack const& aModel, bool aBindless, VkBuffer aSceneUBO, VkDeviceSize aSceneRange, VkPipelineCache aCache )
+{
+	GpuCuller ret;
+	ret.layout = create_cull_descriptor_layout_( aWindow );
+	ret.pipeLayout = create_cull_pipeline_layout_( aWindow, ret.layout.handle );
+	ret.pipe = create_cull_pipeline_( aWindow, ret.pipeLayout.handle, aShaderModules, aShaderPath, aCache );
+
+	// Groups. The batches of each pipeline are contiguous and sorted by
+	// index type, so with bindless materials they merge into a single group
+	// per index type.
+	auto const make_groups_ = [&] (std::vector<DrawBatch> const& aBatches, std::vector<DrawBatch>& aGroups)
+	{
+		if( !aBindless )
+		{
+			aGroups = aBatches;
+			return;
+		}
+
+		for( auto const& batch : aBatches )
+		{
+			if( aGroups.empty() || aGroups.back().indexType != batch.indexType )
+			{
+				DrawBatch group{};
+				group.indexType = batch.indexType;
+				group.firstCommand = batch.firstCommand;
+				aGroups.emplace_back( group );
+			}
+
+			auto& group = aGroups.back();
+			group.commandCount = batch.firstCommand + batch.commandCount - group.firstCommand;
+		}
+	};
+
+	make_groups_( aModel.opaqueBatches, ret.opaqueGroups );
+	make_groups_( aModel.alphaBatches, ret.alphaGroups );
+
+	// Items
+	std::vector<GpuCullItem_> items;
+	items.reserve( aModel.hostDrawCommands.size() );
+
+	std::uint32_t groupIndex = 0;
+	for( auto const* groups : { &ret.opaqueGroups, &ret.alphaGroups } )
+	{
+		for( auto const& group : *groups )
+		{
+			for( std::uint32_t i = group.firstCommand; i < group.firstCommand + group.commandCount; ++i )
+			{
+				auto const& mesh = aModel.meshes[aModel.drawCommandMeshes[i]];
+
+				GpuCullItem_ item{};
+				if( aModel.drawCommandMeshlets.empty() )
+				{
+					item.aabbMin = glm::vec4( mesh.aabbMin, 1.f );
+					item.aabbMax = glm::vec4( mesh.aabbMax, 1.f );
+					item.coneApex = glm::vec4( 0.f, 0.f, 0.f, 1.f );
+					item.coneAxis = glm::vec4( 0.f, 0.f, 1.f, 2.f );
+				}
+				else
+				{
+					auto const& meshlet = aModel.meshlets[aModel.drawCommandMeshlets[i]];
+					item.aabbMin = glm::vec4( meshlet.aabbMin, 1.f );
+					item.aabbMax = glm::vec4( meshlet.aabbMax, 1.f );
+					item.coneApex = glm::vec4( meshlet.coneApex, 1.f );
+					item.coneAxis = glm::vec4( meshlet.coneAxis, meshlet.coneCutoff );
+				}
+				item.command = aModel.hostDrawCommands[i];
+
+				// Meshlets only have the full-detail level (Mesh::lodCount
+				// is 1 then)
+				item.lodCount = mesh.lodCount;
+				for( std::uint32_t l = 0; l < mesh.lodCount; ++l )
+				{
+					item.lodFirstIndex[l] = mesh.lods[l].firstIndex;
+					item.lodIndexCount[l] = mesh.lods[l].indexCount;
+					item.lodError[l] = mesh.lods[l].error;
+				}
+				item.lodFirstIndex[0] = item.command.firstIndex;
+				item.lodIndexCount[0] = item.command.indexCount;
+				item.group = groupIndex;
+				item.outBase = group.firstCommand;
+				items.emplace_back( item );
+			}
+
+			++groupIndex;
+		}
+	}
+
+	ret.itemCount = std::uint32_t(items.size());
+
+	// Buffers. The items never change; they stay in host-visible memory
+	// rather than going through a staging upload.
+	VkDeviceSize const itemBytes = std::max<VkDeviceSize>( 1, items.size() ) * sizeof(GpuCullItem_);
+	VkDeviceSize const commandBytes = std::max<VkDeviceSize>( 1, items.size() ) * sizeof(VkDrawIndexedIndirectCommand);
+	VkDeviceSize const countBytes = std::max<VkDeviceSize>( 1, groupIndex ) * sizeof(std::uint32_t);
+
+	ret.items = lut::create_buffer( aAllocator, itemBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::upload );
+	ret.commands = lut::create_buffer( aAllocator, commandBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, lut::EMemoryClass::device );
+	ret.counts = lut::create_buffer( aAllocator, countBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+
+	if( !items.empty() )
+	{
+		void* ptr = nullptr;
+		if( auto const res = vmaMapMemory( aAllocator.allocator, ret.items.allocation, &ptr ); VK_SUCCESS != res )
+			throw lut::Error( "Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str() );
+
+		std::memcpy( ptr, items.data(), items.size() * sizeof(GpuCullItem_) );
+
+		vmaFlushAllocation( aAllocator.allocator, ret.items.allocation, 0, VK_WHOLE_SIZE );
+		vmaUnmapMemory( aAllocator.allocator, ret.items.allocation );
+	}
+
+	// Descriptors
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+
+	VkDescriptorBufferInfo bufferInfo[4]{};
+	bufferInfo[0].buffer = aSceneUBO;
+	bufferInfo[1].buffer = ret.items.buffer;
+	bufferInfo[2].buffer = ret.commands.buffer;
+	bufferInfo[3].buffer = ret.counts.buffer;
+
+	VkWriteDescriptorSet desc[4]{};
+	for( std::uint32_t i = 0; i < 4; ++i )
+	{
+		bufferInfo[i].range = 0 == i ? aSceneRange : VK_WHOLE_SIZE;
+
+		desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[i].dstSet = ret.descriptors;
+		desc[i].dstBinding = i;
+		desc[i].descriptorType = 0 == i ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[i].descriptorCount = 1;
+		desc[i].pBufferInfo = &bufferInfo[i];
+	}
+
+	vkUpdateDescriptorSets( aWindow.device, 4, desc, 0, nullptr );
+
+	return ret;
+}
+
+void set_gpu_cull_hiz( lut::VulkanWindow const& aWindow, GpuCuller const& aCuller, VkImageView aHizView, VkSampler aSampler )
+{
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler = aSampler;
+	imageInfo.imageView = aHizView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet desc{};
+	desc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	desc.dstSet = aCuller.descriptors;
+	desc.dstBinding = 4;
+	desc.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	desc.descriptorCount = 1;
+	desc.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets( aWindow.device, 1, &desc, 0, nullptr );
+}
+
+void record_gpu_cull( VkCommandBuffer aCmdBuff, GpuCuller const& aCuller, GpuCullParams const& aParams )
+{
+	// The previous frame's draws read both buffers; wait for that before
+	// resetting the counts and overwriting the commands.
+	lut::buffer_barrier( aCmdBuff, aCuller.counts.buffer,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	vkCmdFillBuffer( aCmdBuff, aCuller.counts.buffer, 0, VK_WHOLE_SIZE, 0 );
+
+	lut::buffer_barrier( aCmdBuff, aCuller.counts.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+	lut::buffer_barrier( aCmdBuff, aCuller.commands.buffer,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	if( aCuller.itemCount > 0 )
+	{
+		vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aCuller.pipe.handle );
+		vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aCuller.pipeLayout.handle, 0, 1, &aCuller.descriptors, 1, &aParams.sceneOffset );
+		GpuCullPush_ push{};
+		push.prevProjCam = aParams.prevProjCam;
+		push.depthSize[0] = aParams.depthWidth;
+		push.depthSize[1] = aParams.depthHeight;
+		push.itemCount = aCuller.itemCount;
+		push.hizLevels = aParams.hizLevels;
+		push.lodScale = aParams.lodScale;
+
+		vkCmdPushConstants( aCmdBuff, aCuller.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+
+		vkCmdDispatch( aCmdBuff, (aCuller.itemCount + kCullWorkgroupSize-1) / kCullWorkgroupSize, 1, 1 );
+	}
+
+	lut::buffer_barrier( aCmdBuff, aCuller.counts.buffer,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT );
+	lut::buffer_barrier( aCmdBuff, aCuller.commands.buffer,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT );
+}
+
+namespace
+{
+	lut::DescriptorSetLayout create_cull_descriptor_layout_( lut::VulkanWindow const& aWindow )
+	{
+		VkDescriptorSetLayoutBinding bindings[5]{};
+		for( std::uint32_t i = 0; i < 5; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = 0 == i ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		// Hi-Z pyramid, see set_gpu_cull_hiz()
+		bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create culling descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		return lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	lut::PipelineLayout create_cull_pipeline_layout_( lut::VulkanWindow const& aWindow, VkDescriptorSetLayout aLayout )
+	{
+		VkPushConstantRange push{};
+		push.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push.offset = 0;
+		push.size = sizeof(GpuCullPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &aLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &push;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create culling pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		return lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	lut::Pipeline create_cull_pipeline_( lut::VulkanWindow const& aWindow, VkPipelineLayout aLayout, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkPipelineCache aCache )
+	{
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = aLayout;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create culling pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		return lut::Pipeline( aWindow.device, pipe );
+	}
+}
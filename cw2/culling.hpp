@@ -0,0 +1,194 @@
+#ifndef CULLING_HPP_9B5E2D71_0C4A_4E8F_B3D6_71A2C8F04E5D
+#define CULLING_HPP_9B5E2D71_0C4A_4E8F_B3D6_71A2C8F04E5D
+
+// View frustum culling of the model's meshes against their (baked) axis
+// aligned bounding boxes, either on the CPU or in a compute shader. Models
+// set up with meshlets are culled per meshlet on the GPU (bounds and normal
+// cone), and per mesh on the CPU. Both also pick each mesh's level of detail.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/frame_arena.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "baked_bvh.hpp"
+#include "baked_pvs.hpp"
+#include "load_data_to_vk.h"
+
+// Frustum planes (xyz = normal pointing inwards, w = offset), so that a point
+// p is inside iff dot( plane.xyz, p ) + plane.w >= 0 for all planes.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Extracts the planes from a projection*view matrix. Assumes Vulkan clip
+// space (0 <= z <= w).
+Frustum make_frustum( glm::mat4 const& aProjCam );
+
+// Mesh bounds in structure-of-arrays form, padded to a multiple of
+// kCullBatch entries with empty boxes so that the SIMD test needs no scalar
+// tail.
+constexpr std::size_t kCullBatch = 4;
+
+struct AabbSoA
+{
+	std::size_t count = 0; // number of real (non-padding) boxes
+
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+};
+
+AabbSoA make_aabb_soa( std::vector<Mesh> const& );
+
+// Writes 1 to aVisible[i] if box i intersects the frustum and 0 otherwise.
+// Conservative: boxes that straddle the frustum corners may be kept. Returns
+// the number of visible boxes. aVisible is resized to aBoxes.count.
+std::size_t cull_aabbs( Frustum const&, AabbSoA const& aBoxes, std::vector<std::uint8_t>& aVisible );
+
+// Hierarchical variant of cull_aabbs() over a BVH of the boxes (see
+// baked_bvh.hpp, ModelPack::bvh): subtrees whose bounds are entirely inside
+// the frustum are accepted, and those entirely outside rejected, without
+// looking at their boxes. Boxes that the BVH leaves out are not visible.
+std::size_t cull_bvh( Frustum const&, BakedBvh const&, AabbSoA const& aBoxes, std::vector<std::uint8_t>& aVisible );
+
+// Ray queries against the boxes, through their BVH: the box that the ray
+// aOrigin + t * aDirection enters first, for 0 <= t <= aMaxDistance (a box
+// around aOrigin is entered at t = 0). E.g., to pick meshes, or to keep the
+// camera out of them.
+struct RayHit
+{
+	std::uint32_t box = 0;
+	float distance = 0.f; // t; in units of |aDirection|
+};
+
+bool raycast_bvh(
+	BakedBvh const&,
+	AabbSoA const& aBoxes,
+	glm::vec3 const& aOrigin,
+	glm::vec3 const& aDirection,
+	float aMaxDistance,
+	RayHit& aHit
+);
+
+// Clears the entries of the meshes outside the PVS of the view cell that
+// contains aCamera (see baked_pvs.hpp, ModelPack::pvs). Cameras outside the
+// grid keep every entry. Returns the number of visible meshes left.
+std::size_t apply_pvs( BakedPvs const&, glm::vec3 const& aCamera, std::vector<std::uint8_t>& aVisible );
+
+// Level of detail selection: a mesh uses the coarsest LOD whose error,
+// projected to the screen at the distance of the mesh's AABB, stays below
+// the pixel threshold. aLodScale is the distance at which an error of 1
+// (object space) projects to the threshold, see lod_scale(). A scale of 0
+// always selects the full-detail meshes.
+float lod_scale( glm::mat4 const& aProjection, std::uint32_t aViewportHeight, float aPixelThreshold );
+
+// Writes the LOD index of mesh i to aLods[i]; aLods is resized to the number
+// of meshes.
+void select_lods( ModelPack const&, glm::vec3 const& aCameraPos, float aLodScale, std::vector<std::uint8_t>& aLods );
+
+// Impostor selection (see baked_impostors.hpp, ModelPack::impostors): visible
+// meshes whose bounding sphere, at the distance of the mesh's AABB, covers
+// at most the pixel threshold of aImpostorScale (see lod_scale()) are moved
+// from aVisible to aMeshes. Returns their number; models without impostors
+// and a scale of 0 select none.
+std::size_t select_impostors( ModelPack const&, glm::vec3 const& aCameraPos, float aImpostorScale, std::vector<std::uint8_t>& aVisible, std::vector<std::uint32_t>& aMeshes );
+
+// Batches of a DrawList; per-frame lists are allocated from the frame's
+// lut::FrameArena, the static ones from the heap.
+using DrawBatchList = lut::ArenaVector<DrawBatch>;
+
+// Writes the commands of the visible meshes to aOut (which must have room for
+// all of ModelPack::drawCommands) and produces the matching batches, in the
+// same order as ModelPack::opaqueBatches and alphaBatches. Empty batches are
+// dropped. If aLods is non-empty, the commands draw the selected LODs. The
+// batch lists keep their allocators.
+void compact_draw_commands(
+	ModelPack const&,
+	std::vector<std::uint8_t> const& aVisible,
+	std::vector<std::uint8_t> const& aLods,
+	VkDrawIndexedIndirectCommand* aOut,
+	DrawBatchList& aOpaqueBatches,
+	DrawBatchList& aAlphaBatches
+);
+
+
+// GPU culling (cw2/shaders/cull.comp). Each draw command belongs to a group
+// that is drawn with a single vkCmdDrawIndexedIndirectCount(). The visible
+// commands of a group are compacted to the start of the group's range in
+// `commands`, and `counts` holds one draw count per group (opaque groups
+// first, then alpha-masked ones). With bindless materials, there is one
+// group per pipeline and index type. Otherwise each material batch is its own
+// group.
+struct GpuCuller
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	lut::Buffer items;    // per-command bounds and source command; written once
+	lut::Buffer commands; // compacted VkDrawIndexedIndirectCommands
+	lut::Buffer counts;   // uint32_t per group
+
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+
+	std::uint32_t itemCount = 0;
+
+	// DrawBatch::commandCount is the group's capacity (maxDrawCount)
+	std::vector<DrawBatch> opaqueGroups;
+	std::vector<DrawBatch> alphaGroups;
+};
+
+GpuCuller create_gpu_culler(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	lut::DescriptorAllocator&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	ModelPack const&,
+	bool aBindless,
+	VkBuffer aSceneUBO, // bound with a dynamic offset, see GpuCullParams
+	VkDeviceSize aSceneRange,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// Binds the Hi-Z pyramid (cw2/hiz.hpp) used for occlusion culling. The
+// culling shader statically uses it, so this must be called before the first
+// record_gpu_cull(), and again whenever the pyramid is re-created.
+void set_gpu_cull_hiz(
+	lut::VulkanWindow const&,
+	GpuCuller const&,
+	VkImageView aHizView,
+	VkSampler aSampler
+);
+
+struct GpuCullParams
+{
+	glm::mat4 prevProjCam;        // camera the Hi-Z pyramid was built for
+	std::uint32_t depthWidth = 0; // drawn part of the depth buffer behind the pyramid (HizPyramid::drawnExtent)
+	std::uint32_t depthHeight = 0;
+	std::uint32_t hizLevels = 0;  // 0 disables occlusion culling
+	std::uint32_t sceneOffset = 0; // dynamic offset of this frame's scene uniforms
+	float lodScale = 0.f;          // see lod_scale(); 0 disables LOD selection
+};
+
+// Records the culling dispatch, including the barriers against the previous
+// frame's indirect draws and towards this frame's. Must be recorded outside
+// of a render pass, after the scene uniforms have been written. When
+// occlusion culling is enabled, the pyramid must have been built (and made
+// visible to compute shaders) by an earlier submission.
+void record_gpu_cull( VkCommandBuffer, GpuCuller const&, GpuCullParams const& );
+
+#endif // CULLING_HPP_9B5E2D71_0C4A_4E8F_B3D6_71A2C8F04E5D
@@ -0,0 +1,336 @@
+#include "debug_views.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	constexpr VkFormat kCounterFormat = VK_FORMAT_R32_UINT;
+	constexpr std::uint32_t kCounterLayers = 4; // by the view, overdraw first
+
+	// Counts shown in red, by the view; the quad lanes share the overdraw's
+	// scale, so that the two compare directly
+	constexpr float kOverdrawRange = 8.f;
+	constexpr float kShadingCostRange = 96.f; // fetches and lights
+	constexpr float kMipLevelRange = kDebugMipLevelRange * kDebugMipLevelUnits + 1.f; // level 0
+
+	// PView in debug_view.frag
+	struct DebugViewPush_
+	{
+		float renderScale[2];
+		std::uint32_t layer;
+		float invRange;
+	};
+
+	VkImageSubresourceRange const kCounterRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, kCounterLayers };
+}
+
+char const* to_string( EDebugView aView )
+{
+	switch( aView )
+	{
+		case EDebugView::off: return "off";
+		case EDebugView::overdraw: return "overdraw";
+		case EDebugView::quadOverdraw: return "quad overdraw";
+		case EDebugView::shadingCost: return "shading cost";
+		case EDebugView::mipLevel: return "mip level";
+		case EDebugView::count: break;
+	}
+	return "?";
+}
+
+DebugViews create_debug_views( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, lut::DescriptorAllocator& aDescriptors, VkDescriptorSet aSceneDescriptors, DescriptorBufferSets const* aSceneCopies )
+{
+	DebugViews ret;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[1]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create debug view descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline layout
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		range.offset = 0;
+		range.size = sizeof(DebugViewPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create debug view pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+	ret.sceneCopies = aSceneCopies;
+	resize_debug_views( ret, aWindow, aAllocator, aCmdPool, aSceneDescriptors, VkExtent2D{ 1, 1 } );
+
+	return ret;
+}
+
+lut::Pipeline create_debug_view_pipeline( lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader )
+{
+	VkShaderModule const vert = aShaderModules.get( aVertShader );
+	VkShaderModule const frag = aShaderModules.get( aFragShader );
+
+	VkPipelineShaderStageCreateInfo stages[2]{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vert;
+	stages[0].pName = "main";
+
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = frag;
+	stages[1].pName = "main";
+
+	// Full-screen triangle from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo inputInfo{};
+	inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+	assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportInfo{};
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.scissorCount = 1;
+
+	VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo{};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+	dynamicInfo.pDynamicStates = dynamicStates;
+
+	VkPipelineRasterizationStateCreateInfo rasterInfo{};
+	rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterInfo.lineWidth = 1.f;
+
+	VkPipelineMultisampleStateCreateInfo samplingInfo{};
+	samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	samplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// The heat map replaces the image
+	VkPipelineColorBlendAttachmentState blendStates[1]{};
+	blendStates[0].blendEnable = VK_FALSE;
+	blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo blendInfo{};
+	blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blendInfo.attachmentCount = 1;
+	blendInfo.pAttachments = blendStates;
+
+	// Dynamic rendering: the attachment formats replace the render pass
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &aWindow.swapchainFormat;
+
+	VkGraphicsPipelineCreateInfo pipeInfo{};
+	pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeInfo.pNext = VK_NULL_HANDLE == aRenderPass ? &renderingInfo : nullptr;
+	pipeInfo.stageCount = 2;
+	pipeInfo.pStages = stages;
+	pipeInfo.pVertexInputState = &inputInfo;
+	pipeInfo.pInputAssemblyState = &assemblyInfo;
+	pipeInfo.pViewportState = &viewportInfo;
+	pipeInfo.pRasterizationState = &rasterInfo;
+	pipeInfo.pMultisampleState = &samplingInfo;
+	pipeInfo.pDepthStencilState = nullptr;
+	pipeInfo.pColorBlendState = &blendInfo;
+	pipeInfo.pDynamicState = &dynamicInfo;
+	pipeInfo.layout = aPipelineLayout;
+	pipeInfo.renderPass = aRenderPass;
+	pipeInfo.subpass = 0;
+
+	VkPipeline pipe = VK_NULL_HANDLE;
+	if( auto const res = vkCreateGraphicsPipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create debug view pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str() );
+
+	return lut::Pipeline( aWindow.device, pipe );
+}
+
+void resize_debug_views( DebugViews& aViews, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, VkDescriptorSet aSceneDescriptors, VkExtent2D aExtent )
+{
+	aViews.extent = aExtent;
+
+	// Image
+	aViews.countersView = lut::ImageView();
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = kCounterFormat;
+		imgInfo.extent = VkExtent3D{ aExtent.width, aExtent.height, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = kCounterLayers;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		aViews.counters = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+		lut::set_name( aWindow, aViews.counters, "debug view counters" );
+	}
+
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = aViews.counters.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.format = kCounterFormat;
+		viewInfo.subresourceRange = kCounterRange;
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create debug view counters' view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+		aViews.countersView = lut::ImageView( aWindow.device, view );
+	}
+
+	// Descriptors
+	{
+		VkDescriptorImageInfo countersInfo{};
+		countersInfo.imageView = aViews.countersView.handle;
+		countersInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet desc[2]{};
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = aSceneDescriptors;
+		desc[0].dstBinding = 14;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[0].descriptorCount = 1;
+		desc[0].pImageInfo = &countersInfo;
+
+		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[1].dstSet = aViews.descriptors;
+		desc[1].dstBinding = 0;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[1].descriptorCount = 1;
+		desc[1].pImageInfo = &countersInfo;
+
+		vkUpdateDescriptorSets( aWindow.device, 2, desc, 0, nullptr );
+		if( aViews.sceneCopies )
+			write_scene_descriptors( *aViews.sceneCopies, 1, desc );
+	}
+
+	// The counters stay in GENERAL; each frame that shows a view clears them
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	lut::image_barrier( cmd, aViews.counters.image,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		kCounterRange );
+
+	VkClearColorValue const clear{};
+	vkCmdClearColorImage( cmd, aViews.counters.image, VK_IMAGE_LAYOUT_GENERAL, &clear, 1, &kCounterRange );
+
+	lut::image_barrier( cmd, aViews.counters.image,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		kCounterRange );
+
+	batch.submit().wait();
+}
+
+void record_debug_view_clear( VkCommandBuffer aCmdBuff, DebugViews const& aViews )
+{
+	// After the previous frame's counting and heat map
+	lut::image_barrier( aCmdBuff, aViews.counters.image,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		kCounterRange );
+
+	VkClearColorValue const clear{};
+	vkCmdClearColorImage( aCmdBuff, aViews.counters.image, VK_IMAGE_LAYOUT_GENERAL, &clear, 1, &kCounterRange );
+
+	lut::image_barrier( aCmdBuff, aViews.counters.image,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		kCounterRange );
+}
+
+void record_debug_view( VkCommandBuffer aCmdBuff, DebugViews const& aViews, Hud const& aHud, std::uint32_t aImageIndex, VkExtent2D const& aImageExtent, VkExtent2D const& aRenderExtent )
+{
+	assert( EDebugView::off != aViews.view && EDebugView::count != aViews.view );
+
+	// The colour pass's atomics are complete
+	lut::image_barrier( aCmdBuff, aViews.counters.image,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		kCounterRange );
+
+	begin_hud_pass( aCmdBuff, aHud, aImageIndex, aImageExtent );
+
+	VkViewport viewport{};
+	viewport.width = float(aImageExtent.width);
+	viewport.height = float(aImageExtent.height);
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport( aCmdBuff, 0, 1, &viewport );
+
+	VkRect2D const scissor{ VkOffset2D{ 0, 0 }, aImageExtent };
+	vkCmdSetScissor( aCmdBuff, 0, 1, &scissor );
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aViews.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aViews.pipeLayout.handle, 0, 1, &aViews.descriptors, 0, nullptr );
+
+	DebugViewPush_ push{};
+	push.renderScale[0] = float(std::min( aRenderExtent.width, aViews.extent.width )) / float(aImageExtent.width);
+	push.renderScale[1] = float(std::min( aRenderExtent.height, aViews.extent.height )) / float(aImageExtent.height);
+	push.layer = std::uint32_t(aViews.view) - 1;
+	switch( aViews.view )
+	{
+		case EDebugView::quadOverdraw: push.invRange = 1.f / (kOverdrawRange * kDebugQuadLaneUnits); break;
+		case EDebugView::shadingCost: push.invRange = 1.f / kShadingCostRange; break;
+		case EDebugView::mipLevel: push.invRange = 1.f / kMipLevelRange; break;
+		default: push.invRange = 1.f / kOverdrawRange; break;
+	}
+	vkCmdPushConstants( aCmdBuff, aViews.pipeLayout.handle, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push );
+
+	vkCmdDraw( aCmdBuff, 3, 1, 0, 0 );
+
+	end_hud_pass( aCmdBuff, aHud, aImageIndex );
+}
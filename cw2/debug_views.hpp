@@ -0,0 +1,128 @@
+#ifndef DEBUG_VIEWS_HPP_3E9B6C41_0D7A_4F2E_B855_A61C27D4F093
+#define DEBUG_VIEWS_HPP_3E9B6C41_0D7A_4F2E_B855_A61C27D4F093
+
+// Debug views of where fragment cost goes, cycled with O: overdraw (the
+// fragments shaded per pixel), quad overdraw (the lanes shaded per pixel, the
+// helper lanes of partly covered 2x2 quads included), shading cost (texture
+// fetches and point lights evaluated per pixel, summed over its fragments)
+// and mip level (the finest level of the base colour textures sampled per
+// pixel: red at level 0 or magnified, cooling towards level 8, black without
+// a texture; a texel density view for texture budgets, see also
+// mip_report.hpp). The colour pipeline variants with kPipelineDebugViews
+// count them into the four layers of an R32_UINT image array (scene set 0,
+// binding 14; see cw2/shaders/debug_views.glsl), which is cleared before the
+// render pass and shown as a heat map over the presented image, in the HUD's
+// pass. Opaque fragments that fail the early depth test aren't shaded, and
+// aren't counted; the depth pre-pass, the deferred lighting and the
+// visibility buffer's shading aren't either.
+//
+// Without a view, the other variants are drawn with, and the image is a
+// 1x1 placeholder, so the views cost nothing until they are first used.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "hud.hpp"
+#include "descriptor_buffer_sets.hpp"
+
+namespace lut = labutils;
+
+enum class EDebugView : std::uint32_t
+{
+	off,
+	overdraw,
+	quadOverdraw,
+	shadingCost,
+	mipLevel,
+
+	count
+};
+
+char const* to_string( EDebugView );
+
+// Lane units of the quad overdraw layer; must match debug_views.glsl
+constexpr std::uint32_t kDebugQuadLaneUnits = 12;
+
+// Encoding of the mip level layer; must match debug_views.glsl
+constexpr float kDebugMipLevelRange = 8.f;
+constexpr float kDebugMipLevelUnits = 16.f;
+
+struct DebugViews
+{
+	EDebugView view = EDebugView::off;
+
+	lut::Image counters; // R32_UINT, 4 layers, in VK_IMAGE_LAYOUT_GENERAL
+	lut::ImageView countersView; // 2D array
+	VkExtent2D extent{}; // of counters; 1x1 until a view is first shown
+
+	// --descriptor-buffer: its copies of the scene's set get the counters too
+	DescriptorBufferSets const* sceneCopies = nullptr;
+
+	// Set 0: the counters (binding 0), for the heat map
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+};
+
+// Creates the placeholder counters, and writes them to binding 14 of
+// aSceneDescriptors (and of aSceneCopies, if any), which the colour
+// pipelines always need. The heat map's pipe is left to
+// create_debug_view_pipeline(), if there is a HUD to draw it with.
+DebugViews create_debug_views(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	lut::DescriptorAllocator&,
+	VkDescriptorSet aSceneDescriptors,
+	DescriptorBufferSets const* aSceneCopies = nullptr
+);
+
+// For the HUD's render pass (VK_NULL_HANDLE with dynamic rendering, then
+// for the swapchain's current format); see create_hud_pipeline()
+lut::Pipeline create_debug_view_pipeline(
+	lut::VulkanWindow const&,
+	VkRenderPass,
+	VkPipelineLayout,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	char const* aFragShader
+);
+
+// (Re-)creates the counters with aExtent, and writes them to both sets.
+// Neither the previous counters nor aSceneDescriptors may be in use by the
+// GPU. Uses aCmdPool for the layout transition, and waits for it.
+void resize_debug_views(
+	DebugViews&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	VkDescriptorSet aSceneDescriptors,
+	VkExtent2D aExtent
+);
+
+// Before the render pass: clears the counters for the frame's colour pass
+void record_debug_view_clear( VkCommandBuffer, DebugViews const& );
+
+// After the scene (and any upscale): draws the current view's layer over
+// swapchain image aImageIndex, in the HUD's pass. aRenderExtent is the part
+// of the counters drawn into (dynamic resolution).
+void record_debug_view(
+	VkCommandBuffer,
+	DebugViews const&,
+	Hud const&,
+	std::uint32_t aImageIndex,
+	VkExtent2D const& aImageExtent,
+	VkExtent2D const& aRenderExtent
+);
+
+#endif // DEBUG_VIEWS_HPP_3E9B6C41_0D7A_4F2E_B855_A61C27D4F093
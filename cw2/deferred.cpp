@@ -0,0 +1,250 @@
+#include "deferred.hpp"
+
+#include <glm/matrix.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+
+GBuffer create_gbuffer( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator )
+{
+	GBuffer ret;
+	create_transient_attachment( aWindow, aAllocator, kGBufferAlbedoFormat, ret.albedo, ret.albedoView );
+	create_transient_attachment( aWindow, aAllocator, kGBufferNormalFormat, ret.normal, ret.normalView );
+	lut::set_name( aWindow, ret.albedo, "gbuffer albedo" );
+	lut::set_name( aWindow, ret.normal, "gbuffer normal" );
+	return ret;
+}
+
+DeferredLighting create_deferred_lighting( lut::VulkanWindow const& aWindow, lut::DescriptorAllocator& aDescriptors, VkDescriptorSetLayout aSceneLayout )
+{
+	DeferredLighting ret;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[3]{};
+		for( std::uint32_t i = 0; i < 3; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create deferred lighting descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline layout
+	{
+		VkDescriptorSetLayout const layouts[] = { aSceneLayout, ret.layout.handle };
+
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		range.offset = 0;
+		range.size = sizeof(DeferredPushConstants);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create deferred lighting pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+
+	return ret;
+}
+
+lut::Pipeline create_deferred_pipeline( lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader, VkSpecializationInfo const* aFragSpecialization )
+{
+	VkShaderModule const vert = aShaderModules.get( aVertShader );
+	VkShaderModule const frag = aShaderModules.get( aFragShader );
+
+	VkPipelineShaderStageCreateInfo stages[2]{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vert;
+	stages[0].pName = "main";
+
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = frag;
+	stages[1].pName = "main";
+	stages[1].pSpecializationInfo = aFragSpecialization;
+
+	// The full-screen triangle is generated from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo inputInfo{};
+	inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+	assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportInfo{};
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.scissorCount = 1;
+
+	VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo{};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+	dynamicInfo.pDynamicStates = dynamicStates;
+
+	VkPipelineRasterizationStateCreateInfo rasterInfo{};
+	rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterInfo.lineWidth = 1.f;
+
+	VkPipelineMultisampleStateCreateInfo samplingInfo{};
+	samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	samplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState blendStates[1]{};
+	blendStates[0].blendEnable = VK_FALSE;
+	blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo blendInfo{};
+	blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blendInfo.attachmentCount = 1;
+	blendInfo.pAttachments = blendStates;
+
+	// The lighting subpass has no depth attachment; depth is an input
+	VkGraphicsPipelineCreateInfo pipeInfo{};
+	pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeInfo.stageCount = 2;
+	pipeInfo.pStages = stages;
+	pipeInfo.pVertexInputState = &inputInfo;
+	pipeInfo.pInputAssemblyState = &assemblyInfo;
+	pipeInfo.pViewportState = &viewportInfo;
+	pipeInfo.pRasterizationState = &rasterInfo;
+	pipeInfo.pMultisampleState = &samplingInfo;
+	pipeInfo.pDepthStencilState = nullptr;
+	pipeInfo.pColorBlendState = &blendInfo;
+	pipeInfo.pDynamicState = &dynamicInfo;
+	pipeInfo.layout = aPipelineLayout;
+	pipeInfo.renderPass = aRenderPass;
+	pipeInfo.subpass = 1;
+
+	VkPipeline pipe = VK_NULL_HANDLE;
+	if( auto const res = vkCreateGraphicsPipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create deferred lighting pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str() );
+
+	return lut::Pipeline( aWindow.device, pipe );
+}
+
+void update_deferred_descriptors( lut::VulkanWindow const& aWindow, DeferredLighting& aLighting, GBuffer const& aGBuffer, VkImageView aDepthView )
+{
+	// Layouts as in subpass 1 of the render pass
+	VkDescriptorImageInfo imageInfo[3]{};
+	imageInfo[0].imageView = aGBuffer.albedoView.handle;
+	imageInfo[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo[1].imageView = aGBuffer.normalView.handle;
+	imageInfo[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo[2].imageView = aDepthView;
+	imageInfo[2].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet desc[3]{};
+	for( std::uint32_t i = 0; i < 3; ++i )
+	{
+		desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[i].dstSet = aLighting.descriptors;
+		desc[i].dstBinding = i;
+		desc[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		desc[i].descriptorCount = 1;
+		desc[i].pImageInfo = &imageInfo[i];
+	}
+
+	vkUpdateDescriptorSets( aWindow.device, sizeof(desc) / sizeof(desc[0]), desc, 0, nullptr );
+}
+
+void record_deferred_lighting( VkCommandBuffer aCmdBuff, DeferredLighting const& aLighting, VkPipeline aPipe, VkExtent2D const& aImageExtent, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset, glm::mat4 const& aProjCam )
+{
+	VkViewport viewport{};
+	viewport.width = float(aImageExtent.width);
+	viewport.height = float(aImageExtent.height);
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport( aCmdBuff, 0, 1, &viewport );
+
+	VkRect2D const scissor{ VkOffset2D{ 0, 0 }, aImageExtent };
+	vkCmdSetScissor( aCmdBuff, 0, 1, &scissor );
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPipe );
+
+	VkDescriptorSet const sets[] = { aSceneDescriptors, aLighting.descriptors };
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aLighting.pipeLayout.handle, 0, 2, sets, 1, &aSceneOffset );
+
+	DeferredPushConstants push{};
+	push.invProjCam = glm::inverse( aProjCam );
+	push.invExtent = glm::vec2( 1.f / float(aImageExtent.width), 1.f / float(aImageExtent.height) );
+	vkCmdPushConstants( aCmdBuff, aLighting.pipeLayout.handle, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push );
+
+	vkCmdDraw( aCmdBuff, 3, 1, 0, 0 );
+}
+
+void create_transient_attachment( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkFormat aFormat, lut::Image& aImage, lut::ImageView& aView )
+{
+	// Only ever read within the render pass
+	VkImageCreateInfo imgInfo{};
+	imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imgInfo.imageType = VK_IMAGE_TYPE_2D;
+	imgInfo.format = aFormat;
+	imgInfo.extent = VkExtent3D{ aWindow.swapchainExtent.width, aWindow.swapchainExtent.height, 1 };
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = 1;
+	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imgInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// Lazily allocated memory (tilers) may never be backed at all;
+	// desktop GPUs don't have it.
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+	VkImage image = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	if( VK_SUCCESS == vmaCreateImage( aAllocator.allocator, &imgInfo, &allocInfo, &image, &allocation, nullptr ) )
+	{
+		lut::tag_allocation( aAllocator.allocator, allocation, lut::EMemoryClass::renderTargets );
+		aImage = lut::Image( aAllocator.allocator, image, allocation );
+	}
+	else
+		aImage = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = aImage.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = aFormat;
+	viewInfo.components = VkComponentMapping{};
+	viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkImageView view = VK_NULL_HANDLE;
+	if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create transient attachment image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+	aView = lut::ImageView( aWindow.device, view );
+}
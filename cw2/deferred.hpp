@@ -0,0 +1,109 @@
+#ifndef DEFERRED_HPP_F6ECEEA1_A3F1_4AF5_9676_6D0185B74713
+#define DEFERRED_HPP_F6ECEEA1_A3F1_4AF5_9676_6D0185B74713
+
+// Deferred shading (--lighting=deferred). The render pass gets two subpasses:
+// the first draws the scene into a compact G-buffer (gbuffer*.frag), the
+// second shades every pixel once from it with a full-screen triangle
+// (deferred.frag), for the scene's light and the clustered point lights (see
+// clusters.hpp). The G-buffer and depth are read as input attachments, so on
+// tiled GPUs they need not leave on-chip memory; the G-buffer images are
+// transient and lazily allocated where the device supports that.
+//
+// G-buffer layout (see cw2/shaders/gbuffer.glsl):
+//  - attachment 2, R8G8B8A8_SRGB: albedo (rgb), metalness (a)
+//  - attachment 3, A2B10G10R10_UNORM: octahedral normal (rg), roughness (b)
+// Attachment 0 is the swapchain image and 1 the depth buffer; the position
+// is reconstructed from depth.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+constexpr VkFormat kGBufferAlbedoFormat = VK_FORMAT_R8G8B8A8_SRGB;
+constexpr VkFormat kGBufferNormalFormat = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+
+constexpr std::uint32_t kGBufferColorAttachments = 2;
+
+struct GBuffer
+{
+	lut::Image albedo, normal;
+	lut::ImageView albedoView, normalView;
+};
+
+// Images for the current swapchain size
+GBuffer create_gbuffer( lut::VulkanWindow const&, lut::Allocator const& );
+
+// A colour attachment of the swapchain's size that is only read as an input
+// attachment within the render pass (transient, lazily allocated if
+// possible); also used for the visibility buffer (see visibility.hpp)
+void create_transient_attachment( lut::VulkanWindow const&, lut::Allocator const&, VkFormat, lut::Image&, lut::ImageView& );
+
+// PLighting in deferred_frag.glsl
+struct DeferredPushConstants
+{
+	glm::mat4 invProjCam;
+	glm::vec2 invExtent;
+};
+
+struct DeferredLighting
+{
+	// Set 1: G-buffer and depth input attachments (bindings 0-2). Set 0 is
+	// the scene's.
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+};
+
+DeferredLighting create_deferred_lighting(
+	lut::VulkanWindow const&,
+	lut::DescriptorAllocator&,
+	VkDescriptorSetLayout aSceneLayout
+);
+
+// Full-screen pipeline for subpass 1 of aRenderPass, with the layout of
+// DeferredLighting (or of the visibility buffer's material pass)
+lut::Pipeline create_deferred_pipeline(
+	lut::VulkanWindow const&,
+	VkRenderPass,
+	VkPipelineLayout,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	char const* aFragShader,
+	VkSpecializationInfo const* aFragSpecialization = nullptr
+);
+
+// Points the descriptors at the (current) G-buffer and depth buffer. The set
+// must not be in use by the GPU.
+void update_deferred_descriptors(
+	lut::VulkanWindow const&,
+	DeferredLighting&,
+	GBuffer const&,
+	VkImageView aDepthView
+);
+
+// Records the lighting subpass; the render pass must be in subpass 1.
+void record_deferred_lighting(
+	VkCommandBuffer,
+	DeferredLighting const&,
+	VkPipeline,
+	VkExtent2D const& aImageExtent,
+	VkDescriptorSet aSceneDescriptors,
+	std::uint32_t aSceneOffset,
+	glm::mat4 const& aProjCam
+);
+
+#endif // DEFERRED_HPP_F6ECEEA1_A3F1_4AF5_9676_6D0185B74713
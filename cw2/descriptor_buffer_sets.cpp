@@ -0,0 +1,63 @@
+#include "descriptor_buffer_sets.hpp"
+
+#include <vector>
+
+#include <cassert>
+
+void allocate_scene_sets( DescriptorBufferSets& aSets, std::uint32_t aUniformSlots, VkDeviceSize aUniformSlotSize )
+{
+	assert( aUniformSlots > 0 );
+
+	// allocate() aligns every set the same way, so the copies are evenly
+	// spaced
+	VkDeviceSize const size = aSets.buffer.set_size( aSets.sceneLayout.handle );
+	aSets.sceneSets = aSets.buffer.allocate( size );
+	aSets.sceneSetStride = 0;
+	for( std::uint32_t i = 1; i < aUniformSlots; ++i )
+	{
+		VkDeviceSize const set = aSets.buffer.allocate( size );
+		if( 1 == i )
+			aSets.sceneSetStride = set - aSets.sceneSets;
+		assert( set == aSets.sceneSets + i * aSets.sceneSetStride );
+	}
+
+	aSets.uniformSlots = aUniformSlots;
+	aSets.uniformSlotSize = aUniformSlotSize;
+}
+
+void write_scene_descriptors( DescriptorBufferSets const& aSets, std::uint32_t aCount, VkWriteDescriptorSet const* aWrites )
+{
+	std::vector<VkWriteDescriptorSet> writes( aWrites, aWrites + aCount );
+	std::vector<VkDescriptorBufferInfo> uniforms;
+
+	for( std::uint32_t i = 0; i < aSets.uniformSlots; ++i )
+	{
+		for( std::uint32_t j = 0; j < aCount; ++j )
+		{
+			if( 0 != aWrites[j].dstBinding )
+				continue;
+
+			uniforms.assign( aWrites[j].pBufferInfo, aWrites[j].pBufferInfo + aWrites[j].descriptorCount );
+			for( auto& info : uniforms )
+				info.offset += i * aSets.uniformSlotSize;
+
+			writes[j].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writes[j].pBufferInfo = uniforms.data();
+		}
+
+		aSets.buffer.write( aSets.sceneSets + i * aSets.sceneSetStride, aSets.sceneLayout.handle, aCount, writes.data() );
+	}
+}
+
+void bind_descriptor_buffer_sets( VkCommandBuffer aCmdBuff, DescriptorBufferSets const& aSets, VkPipelineLayout aLayout, std::uint32_t aSceneOffset, VkDeviceSize aBindlessSet )
+{
+	assert( aSets.uniformSlotSize > 0 && aSceneOffset % aSets.uniformSlotSize == 0 );
+
+	VkDeviceSize const sets[2] = {
+		aSets.sceneSets + (aSceneOffset / aSets.uniformSlotSize) * aSets.sceneSetStride,
+		aBindlessSet
+	};
+
+	aSets.buffer.bind( aCmdBuff );
+	aSets.buffer.bind_sets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aLayout, 0, ~VkDeviceSize(0) == aBindlessSet ? 1 : 2, sets );
+}
@@ -0,0 +1,55 @@
+#ifndef DESCRIPTOR_BUFFER_SETS_HPP_4E1B7C90_2A6D_4F35_9C8E_D3F05B61A7E2
+#define DESCRIPTOR_BUFFER_SETS_HPP_4E1B7C90_2A6D_4F35_9C8E_D3F05B61A7E2
+
+// --descriptor-buffer: the sets of the forward, depth and shadow pipelines
+// in a lut::DescriptorBuffer rather than in descriptor sets. That is the
+// scene's set (set 0) and the model's bindless set (set 1; see
+// ModelPack::bindlessSet); streaming then rewrites the descriptors of the
+// textures that changed with plain memory writes.
+//
+// The scene's set has a dynamic uniform buffer at binding 0 (the uniform
+// slot of the frame), which descriptor buffers can't have; there is a copy
+// of the set per slot instead, whose binding 0 is a plain uniform buffer
+// at the slot. write_scene_descriptors() keeps the copies in step with the
+// descriptor set, which the other passes (light clustering, deferred
+// lighting, impostors, ...) still bind.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkobject.hpp"
+#include "../labutils/descriptor_buffer.hpp"
+namespace lut = labutils;
+
+struct DescriptorBufferSets
+{
+	lut::DescriptorBuffer buffer;
+
+	// With VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT; the
+	// scene's has a plain uniform buffer at binding 0
+	lut::DescriptorSetLayout sceneLayout;
+	lut::DescriptorSetLayout bindlessLayout;
+
+	// Copy i of the scene's set is at sceneSets + i*sceneSetStride, with
+	// the uniforms at offset i*uniformSlotSize
+	VkDeviceSize sceneSets = 0, sceneSetStride = 0;
+	VkDeviceSize uniformSlotSize = 0;
+	std::uint32_t uniformSlots = 0;
+};
+
+// Reserves the copies of the scene's set; aSets.buffer and the layouts
+// must exist.
+void allocate_scene_sets( DescriptorBufferSets& aSets, std::uint32_t aUniformSlots, VkDeviceSize aUniformSlotSize );
+
+// Writes aWrites (of the scene's descriptor set; dstSet is ignored) to
+// every copy. Writes to binding 0 are rebased to each copy's slot, and
+// written as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER.
+void write_scene_descriptors( DescriptorBufferSets const&, std::uint32_t aCount, VkWriteDescriptorSet const* aWrites );
+
+// Binds the buffer and sets 0 (the copy for the uniform slot at
+// aSceneOffset) and, unless ~0, 1 (the bindless set at aBindlessSet) of
+// aLayout
+void bind_descriptor_buffer_sets( VkCommandBuffer, DescriptorBufferSets const&, VkPipelineLayout aLayout, std::uint32_t aSceneOffset, VkDeviceSize aBindlessSet );
+
+#endif // DESCRIPTOR_BUFFER_SETS_HPP_4E1B7C90_2A6D_4F35_9C8E_D3F05B61A7E2
@@ -0,0 +1,116 @@
+#include "distribution_lut.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <glm/gtc/packing.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	// As in cw2/shaders/shading.glsl
+	constexpr double kPi = 3.14159265359;
+	constexpr double kEpsilon = 0.0001;
+
+	// BlinnPhongDistribution( rough2shininess( aRoughness ), ... ), clamped
+	// to fp16's range (for N.H = 0 and roughness 1, the shininess is just
+	// below zero, and the shader's pow() is infinite)
+	float distribution_( double aNdotH, double aRoughness );
+}
+
+DistributionLut create_distribution_lut( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::SamplerCache& aSamplers, VkCommandPool aCmdPool )
+{
+	LUT_CPU_ZONE( "create_distribution_lut()" );
+
+	lut::require_sampled_format( aWindow, kDistributionLutFormat, "specular distribution LUT" );
+
+	DistributionLut ret;
+
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_LINEAR;
+		sampInfo.minFilter = VK_FILTER_LINEAR;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = 0.f;
+
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = kDistributionLutFormat;
+		imgInfo.extent = VkExtent3D{ kDistributionLutNdotH, kDistributionLutRoughness, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = 1;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		ret.image = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::textures );
+		lut::set_name( aWindow, ret.image, "specular distribution lut" );
+	}
+
+	ret.view = lut::create_image_view_texture2d( aWindow, ret.image.image, kDistributionLutFormat );
+
+	// Rows by roughness, texels by sqrt(1 - N.H)
+	VkDeviceSize const bytes = VkDeviceSize(kDistributionLutNdotH) * kDistributionLutRoughness * sizeof(std::uint16_t);
+	lut::Buffer staging = lut::create_buffer( aAllocator, bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+	{
+		auto* const halves = reinterpret_cast<std::uint16_t*>( lut::mapped_data( aAllocator, staging ) );
+		for( std::uint32_t y = 0; y < kDistributionLutRoughness; ++y )
+		{
+			double const roughness = double(y) / (kDistributionLutRoughness - 1);
+			for( std::uint32_t x = 0; x < kDistributionLutNdotH; ++x )
+			{
+				double const u = double(x) / (kDistributionLutNdotH - 1);
+				halves[y * kDistributionLutNdotH + x] = glm::packHalf1x16( distribution_( 1.0 - u * u, roughness ) );
+			}
+		}
+	}
+	vmaFlushAllocation( aAllocator.allocator, staging.allocation, 0, VK_WHOLE_SIZE );
+
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	lut::image_barrier( cmd, ret.image.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	VkBufferImageCopy copy{};
+	copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copy.imageExtent = VkExtent3D{ kDistributionLutNdotH, kDistributionLutRoughness, 1 };
+	vkCmdCopyBufferToImage( cmd, staging.buffer, ret.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+
+	lut::record_texture_ready( cmd, ret.image.image, 1 );
+
+	batch.submit().wait();
+	return ret;
+}
+
+namespace
+{
+	float distribution_( double aNdotH, double aRoughness )
+	{
+		double const r2 = aRoughness * aRoughness;
+		double const shininess = 2.0 / (r2 * r2 + kEpsilon) - 2.0;
+
+		double const d = (shininess + 2.0) / (2.0 * kPi) * std::pow( std::max( aNdotH, 0.0 ), shininess );
+		return float(std::min( d, 65504.0 ));
+	}
+}
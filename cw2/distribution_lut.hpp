@@ -0,0 +1,50 @@
+#ifndef DISTRIBUTION_LUT_HPP_4E7A1C93_B25D_4F08_9C6E_D3185A72B0F4
+#define DISTRIBUTION_LUT_HPP_4E7A1C93_B25D_4F08_9C6E_D3185A72B0F4
+
+// Tabulated specular distribution (--distribution=lut): the Blinn-Phong D
+// term of cw2/shaders/shading.glsl, including its normalization, by N.H and
+// roughness. Shaders with kDistributionLut read D from it with one bilinear
+// fetch, in place of rough2shininess() and pow(N.H, shininess) per light.
+//
+// The lobes of smooth surfaces are very narrow around N.H = 1, so the N.H
+// axis is sqrt(1 - N.H), which spends most of the texels there. Roughness is
+// linear. Both axes have their first and last texel centres on the ends of
+// the range (see distributionLut() in cw2/shaders/distribution_lut.glsl).
+// The table is computed on the CPU; it is small enough to always be created.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// D reaches about 3200 for roughness 0; within fp16's range
+constexpr VkFormat kDistributionLutFormat = VK_FORMAT_R16_SFLOAT;
+
+// Must match cw2/shaders/distribution_lut.glsl
+constexpr std::uint32_t kDistributionLutNdotH = 256; // texels along sqrt(1 - N.H)
+constexpr std::uint32_t kDistributionLutRoughness = 64;
+
+struct DistributionLut
+{
+	lut::Image image;
+	lut::ImageView view;
+
+	VkSampler sampler = VK_NULL_HANDLE; // linear, clamp; from the cache
+};
+
+// Waits for the GPU to finish the upload. Throws labutils::Error on failure.
+DistributionLut create_distribution_lut(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	lut::SamplerCache&,
+	VkCommandPool
+);
+
+#endif // DISTRIBUTION_LUT_HPP_4E7A1C93_B25D_4F08_9C6E_D3185A72B0F4
@@ -0,0 +1,194 @@
+#include "draw_trace.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	constexpr char kTraceMagic[16] = "cw2-drawtrace";
+
+	// Per-frame header, after the time
+	struct FrameHeader_
+	{
+		float camera2world[16];
+		float lightPos[3];
+		std::uint32_t width, height;
+		std::uint32_t drawCount;
+	};
+
+	static_assert( sizeof(FrameHeader_) == 88, "FrameHeader_ is written as-is" );
+
+	void checked_read_( std::FILE* aFile, std::size_t aBytes, void* aBuffer, char const* aPath )
+	{
+		if( aBytes && 1 != std::fread( aBuffer, aBytes, 1, aFile ) )
+			throw lut::Error( "Draw trace '%s': truncated", aPath );
+	}
+}
+
+DrawTraceWriter::DrawTraceWriter( char const* aPath, ModelPack const& aModel )
+	: mFile( std::fopen( aPath, "wb" ) )
+	, mPath( aPath )
+	, mModel( &aModel )
+	, mPipelines( aModel.meshes.size(), 0 )
+{
+	if( !mFile )
+		throw lut::Error( "Unable to open draw trace '%s' for writing", aPath );
+
+	// The pipeline follows from the batch a mesh's commands are in
+	for( auto const& batch : aModel.alphaBatches )
+	{
+		for( std::uint32_t c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; ++c )
+			mPipelines[aModel.drawCommandMeshes[c]] = 1;
+	}
+
+	std::uint32_t const header[2] = { kDrawTraceVersion, std::uint32_t(aModel.meshes.size()) };
+	std::fwrite( kTraceMagic, sizeof(kTraceMagic), 1, mFile );
+	std::fwrite( header, sizeof(header), 1, mFile );
+}
+
+DrawTraceWriter::~DrawTraceWriter()
+{
+	if( mFile )
+		std::fclose( mFile );
+}
+
+void DrawTraceWriter::add_frame( float aTime, glm::mat4 const& aCamera2World, glm::vec3 const& aLightPos, VkExtent2D aExtent, std::vector<std::uint8_t> const& aVisible, std::vector<std::uint8_t> const& aLods )
+{
+	auto const& meshes = mModel->meshes;
+
+	mDraws.clear();
+	for( std::uint32_t i = 0; i < meshes.size(); ++i )
+	{
+		if( !aVisible[i] )
+			continue;
+
+		std::uint8_t const lod = aLods.empty() ? 0 : aLods[i];
+		mDraws.emplace_back( TraceDraw{ i, meshes[i].matID, meshes[i].lods[lod].indexCount, mPipelines[i], lod, 0 } );
+	}
+
+	FrameHeader_ header{};
+	std::memcpy( header.camera2world, &aCamera2World[0][0], sizeof(header.camera2world) );
+	std::memcpy( header.lightPos, &aLightPos[0], sizeof(header.lightPos) );
+	header.width = aExtent.width;
+	header.height = aExtent.height;
+	header.drawCount = std::uint32_t(mDraws.size());
+
+	std::fwrite( &aTime, sizeof(aTime), 1, mFile );
+	std::fwrite( &header, sizeof(header), 1, mFile );
+	if( !mDraws.empty() )
+		std::fwrite( mDraws.data(), sizeof(TraceDraw), mDraws.size(), mFile );
+
+	++mFrames;
+}
+
+void DrawTraceWriter::close()
+{
+	if( !mFile )
+		return;
+
+	bool const ok = !std::ferror( mFile );
+	bool const closed = 0 == std::fclose( mFile );
+	mFile = nullptr;
+
+	if( !ok || !closed )
+		throw lut::Error( "Unable to write draw trace '%s'", mPath );
+}
+
+
+DrawTrace load_draw_trace( char const* aPath )
+{
+	std::FILE* file = std::fopen( aPath, "rb" );
+	if( !file )
+		throw lut::Error( "Unable to open draw trace '%s' for reading", aPath );
+
+	try
+	{
+		char magic[16];
+		std::uint32_t header[2];
+		checked_read_( file, sizeof(magic), magic, aPath );
+		checked_read_( file, sizeof(header), header, aPath );
+
+		if( 0 != std::memcmp( magic, kTraceMagic, sizeof(magic) ) )
+			throw lut::Error( "'%s' is not a draw trace", aPath );
+		if( kDrawTraceVersion != header[0] )
+			throw lut::Error( "Draw trace '%s': version %u, expected %u", aPath, header[0], kDrawTraceVersion );
+
+		DrawTrace ret;
+		ret.meshCount = header[1];
+
+		float time;
+		while( 1 == std::fread( &time, sizeof(time), 1, file ) )
+		{
+			FrameHeader_ fh;
+			checked_read_( file, sizeof(fh), &fh, aPath );
+			if( fh.drawCount > ret.meshCount )
+				throw lut::Error( "Draw trace '%s': frame %zu has %u draws, but the model only %u meshes", aPath, ret.frames.size(), fh.drawCount, ret.meshCount );
+
+			auto& frame = ret.frames.emplace_back();
+			frame.time = time;
+			std::memcpy( &frame.camera2world[0][0], fh.camera2world, sizeof(fh.camera2world) );
+			std::memcpy( &frame.lightPos[0], fh.lightPos, sizeof(fh.lightPos) );
+			frame.extent = VkExtent2D{ fh.width, fh.height };
+
+			frame.draws.resize( fh.drawCount );
+			checked_read_( file, fh.drawCount * sizeof(TraceDraw), frame.draws.data(), aPath );
+		}
+
+		if( !std::feof( file ) )
+			throw lut::Error( "Error reading draw trace '%s'", aPath );
+
+		std::fclose( file );
+
+		if( ret.frames.empty() )
+			throw lut::Error( "Draw trace '%s' has no frames", aPath );
+
+		return ret;
+	}
+	catch( ... )
+	{
+		std::fclose( file );
+		throw;
+	}
+}
+
+void check_draw_trace( DrawTrace const& aTrace, ModelPack const& aModel, char const* aPath )
+{
+	if( aTrace.meshCount != aModel.meshes.size() )
+		throw lut::Error( "Draw trace '%s' was recorded with %u meshes, the model has %zu", aPath, aTrace.meshCount, aModel.meshes.size() );
+
+	for( std::size_t f = 0; f < aTrace.frames.size(); ++f )
+	{
+		for( auto const& draw : aTrace.frames[f].draws )
+		{
+			if( draw.mesh >= aModel.meshes.size() )
+				throw lut::Error( "Draw trace '%s': frame %zu draws mesh %u of %zu", aPath, f, draw.mesh, aModel.meshes.size() );
+
+			if( draw.material != aModel.meshes[draw.mesh].matID )
+				throw lut::Error( "Draw trace '%s': frame %zu, mesh %u has material %u, not %u", aPath, f, draw.mesh, draw.material, aModel.meshes[draw.mesh].matID );
+		}
+	}
+}
+
+void trace_visibility( TraceFrame const& aFrame, ModelPack const& aModel, std::vector<std::uint8_t>& aVisible, std::vector<std::uint8_t>& aLods )
+{
+	auto const meshCount = aModel.meshes.size();
+	aVisible.assign( meshCount, 0 );
+	aLods.clear();
+
+	for( auto const& draw : aFrame.draws )
+	{
+		aVisible[draw.mesh] = 1;
+
+		auto const lod = std::min<std::uint32_t>( draw.lod, aModel.meshes[draw.mesh].lodCount - 1 );
+		if( lod > 0 )
+		{
+			if( aLods.empty() )
+				aLods.assign( meshCount, 0 );
+			aLods[draw.mesh] = std::uint8_t(lod);
+		}
+	}
+}
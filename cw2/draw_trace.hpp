@@ -0,0 +1,120 @@
+#ifndef DRAW_TRACE_HPP_E4A17C2B_93D5_4B6E_8F02_6C1D9A5B3E78
+#define DRAW_TRACE_HPP_E4A17C2B_93D5_4B6E_8F02_6C1D9A5B3E78
+
+// Draw traces (--trace, --replay): the logical draw list of every frame of
+// an interactive run, i.e., the camera and light, and which meshes were
+// drawn, with which pipeline, material, LOD and index count. A replay
+// renders the same frames headlessly (as --bench does), drawing exactly the
+// traced meshes, so that draw, material and recording modes can be compared
+// on identical work, without the noise of interactive camera movement or of
+// differences in culling.
+//
+// The draws are the meshes that pass frustum culling (on the CPU, whatever
+// the cull mode of the capture), at the LODs selected for them. Occlusion
+// culling is not traced.
+//
+// File layout (little-endian, as in memory):
+//
+//   char[16]  "cw2-drawtrace"
+//   u32       version (kDrawTraceVersion)
+//   u32       mesh count of the model
+//   per frame:
+//     f32       time (seconds since the start of the capture)
+//     f32[16]   camera2world (column-major)
+//     f32[3]    light position
+//     u32[2]    framebuffer extent
+//     u32       draw count
+//     TraceDraw draws[draw count]
+
+#include <vector>
+
+#include <cstdio>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "load_data_to_vk.h"
+
+constexpr std::uint32_t kDrawTraceVersion = 1;
+
+struct TraceDraw
+{
+	std::uint32_t mesh;       // into ModelPack::meshes
+	std::uint32_t material;   // Mesh::matID
+	std::uint32_t indexCount; // of the drawn LOD
+	std::uint8_t pipeline;    // 0: opaque, 1: alpha-masked
+	std::uint8_t lod;         // 0: full detail
+	std::uint16_t reserved;
+};
+
+static_assert( sizeof(TraceDraw) == 16, "TraceDraw is written as-is" );
+
+struct TraceFrame
+{
+	float time;
+	glm::mat4 camera2world;
+	glm::vec3 lightPos;
+	VkExtent2D extent;
+	std::vector<TraceDraw> draws;
+};
+
+struct DrawTrace
+{
+	std::uint32_t meshCount = 0;
+	std::vector<TraceFrame> frames;
+};
+
+class DrawTraceWriter
+{
+	public:
+		// Throws labutils::Error if aPath can't be opened. aModel must
+		// outlive the writer.
+		DrawTraceWriter( char const* aPath, ModelPack const& aModel );
+		~DrawTraceWriter();
+
+		DrawTraceWriter( DrawTraceWriter const& ) = delete;
+		DrawTraceWriter& operator= (DrawTraceWriter const&) = delete;
+
+	public:
+		// aVisible has one entry per mesh; aLods is empty (full detail) or
+		// has one entry per mesh as well.
+		void add_frame(
+			float aTime,
+			glm::mat4 const& aCamera2World,
+			glm::vec3 const& aLightPos,
+			VkExtent2D aExtent,
+			std::vector<std::uint8_t> const& aVisible,
+			std::vector<std::uint8_t> const& aLods
+		);
+
+		// Throws labutils::Error if the file couldn't be written
+		void close();
+
+		std::size_t frames() const noexcept { return mFrames; }
+
+	private:
+		std::FILE* mFile;
+		char const* mPath;
+		ModelPack const* mModel;
+		std::vector<std::uint8_t> mPipelines; // per mesh, see TraceDraw
+		std::vector<TraceDraw> mDraws; // scratch
+		std::size_t mFrames = 0;
+};
+
+// Throws labutils::Error if the file can't be read or is malformed
+DrawTrace load_draw_trace( char const* aPath );
+
+// Throws labutils::Error if aTrace wasn't recorded from aModel (mesh count
+// or materials differ)
+void check_draw_trace( DrawTrace const& aTrace, ModelPack const& aModel, char const* aPath );
+
+// The traced draws of aFrame as a DrawList's visibility and LODs (see
+// DrawList in main.cpp); aLods stays empty if all draws are full detail.
+// LODs that aModel wasn't set up with (e.g., with meshlets) are drawn at
+// the coarsest one it has.
+void trace_visibility( TraceFrame const&, ModelPack const& aModel, std::vector<std::uint8_t>& aVisible, std::vector<std::uint8_t>& aLods );
+
+#endif // DRAW_TRACE_HPP_E4A17C2B_93D5_4B6E_8F02_6C1D9A5B3E78
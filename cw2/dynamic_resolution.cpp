@@ -0,0 +1,143 @@
+#include "dynamic_resolution.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	// Frame times this close to the budget (relative) leave the scale alone
+	constexpr float kResolutionDeadBand = 0.05f;
+
+	// Fraction of the correction applied per frame. The measurements are a
+	// few frames old (frames in flight), so full steps would overshoot.
+	constexpr float kResolutionDamping = 0.2f;
+}
+
+RenderTarget create_render_target( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator )
+{
+	VkImageCreateInfo imgInfo{};
+	imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imgInfo.imageType = VK_IMAGE_TYPE_2D;
+	imgInfo.format = aWindow.swapchainFormat;
+	imgInfo.extent = VkExtent3D{ aWindow.swapchainExtent.width, aWindow.swapchainExtent.height, 1 };
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = 1;
+	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imgInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	RenderTarget ret;
+	ret.image = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+	lut::set_name( aWindow, ret.image, "dynamic resolution target" );
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = ret.image.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = aWindow.swapchainFormat;
+	viewInfo.components = VkComponentMapping{};
+	viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkImageView view = VK_NULL_HANDLE;
+	if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create render target image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+	ret.view = lut::ImageView( aWindow.device, view );
+	return ret;
+}
+
+void update_resolution_scale( ResolutionController& aController, double aGpuMs )
+{
+	if( aGpuMs <= 0.0 || aController.targetMs <= 0.f )
+		return;
+
+	float const ratio = aController.targetMs / float(aGpuMs);
+	if( std::abs( ratio - 1.f ) < kResolutionDeadBand )
+		return;
+
+	// The pixel count goes with the square of the scale
+	float const wanted = aController.scale * std::sqrt( ratio );
+	float const scale = aController.scale + kResolutionDamping * (wanted - aController.scale);
+	aController.scale = std::clamp( scale, aController.minScale, 1.f );
+}
+
+VkExtent2D scaled_extent( VkExtent2D const& aFull, float aScale )
+{
+	if( aScale >= 1.f )
+		return aFull;
+
+	auto const scale_ = [aScale] (std::uint32_t aSize) {
+		auto const size = std::uint32_t( float(aSize) * aScale + 0.5f );
+		auto const rounded = (size + kResolutionGranularity/2) / kResolutionGranularity * kResolutionGranularity;
+		return std::clamp( rounded, std::min( kResolutionGranularity, aSize ), aSize );
+	};
+
+	return VkExtent2D{ scale_( aFull.width ), scale_( aFull.height ) };
+}
+
+bool supports_upscale( lut::VulkanWindow const& aWindow )
+{
+	if( !(aWindow.swapchainUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) )
+		return false;
+
+	VkFormatProperties props{};
+	vkGetPhysicalDeviceFormatProperties( aWindow.physicalDevice, aWindow.swapchainFormat, &props );
+
+	VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return needed == (props.optimalTilingFeatures & needed);
+}
+
+void record_upscale( VkCommandBuffer aCmdBuff, VkImage aSrc, VkExtent2D const& aSrcExtent, VkImage aDst, VkExtent2D const& aDstExtent, bool aOffscreen )
+{
+	lut::image_barrier( aCmdBuff, aSrc,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	// The previous contents are replaced entirely
+	lut::image_barrier( aCmdBuff, aDst,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	VkImageBlit blit{};
+	blit.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.srcOffsets[1] = VkOffset3D{ std::int32_t(aSrcExtent.width), std::int32_t(aSrcExtent.height), 1 };
+	blit.dstSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.dstOffsets[1] = VkOffset3D{ std::int32_t(aDstExtent.width), std::int32_t(aDstExtent.height), 1 };
+
+	vkCmdBlitImage( aCmdBuff,
+		aSrc, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		aDst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, VK_FILTER_LINEAR
+	);
+
+	if( aOffscreen )
+	{
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+	}
+	else
+	{
+		// Presentation waits for the semaphore signalled by the submission
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT );
+	}
+
+	// The next frame's render pass overwrites the target (write-after-read)
+	lut::image_barrier( aCmdBuff, aSrc,
+		0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT );
+}
@@ -0,0 +1,75 @@
+#ifndef DYNAMIC_RESOLUTION_HPP_2F6B9D1E_48A3_4C07_B5E2_7A1C0D93F6E4
+#define DYNAMIC_RESOLUTION_HPP_2F6B9D1E_48A3_4C07_B5E2_7A1C0D93F6E4
+
+// Dynamic resolution (--dynamic-resolution=MS). The scene is drawn into the
+// top-left part of an offscreen colour target, and then upscaled (a
+// bilinear blit) to the swapchain image. The part's size follows the GPU
+// frame time, as measured by the frame's timestamps, against a budget.
+//
+// All attachments keep the swapchain's size, and only the render area (and
+// viewport) shrinks: nothing is re-created when the scale changes. Passes
+// that read the depth buffer afterwards (Hi-Z, shading rates) must only
+// rely on the drawn part.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// Render extents are multiples of this (in both axes), so that small
+// changes of the frame time don't change the extent every frame
+constexpr std::uint32_t kResolutionGranularity = 16;
+
+// Lowest scale of each axis
+constexpr float kMinResolutionScale = 0.5f;
+
+struct RenderTarget
+{
+	lut::Image image; // swapchain format and size
+	lut::ImageView view;
+};
+
+// Colour attachment, transfer source (for the upscale) and sampled (for
+// the temporal upscale, see temporal_upscale.hpp)
+RenderTarget create_render_target( lut::VulkanWindow const&, lut::Allocator const& );
+
+struct ResolutionController
+{
+	float targetMs = 0.f; // GPU frame time budget
+	float minScale = kMinResolutionScale; // of each axis
+	float scale = 1.f;
+};
+
+// Adapts the scale to aGpuMs, a measured frame time (negative: none). The
+// frame time is taken to be proportional to the number of pixels drawn.
+void update_resolution_scale( ResolutionController&, double aGpuMs );
+
+// aFull scaled by aScale, in multiples of kResolutionGranularity (but never
+// larger than aFull)
+VkExtent2D scaled_extent( VkExtent2D const& aFull, float aScale );
+
+// Whether the swapchain images can be upscaled into (blit destinations,
+// with linear filtering)
+bool supports_upscale( lut::VulkanWindow const& );
+
+// Blits aSrcExtent of aSrc, which the render pass left in
+// TRANSFER_SRC_OPTIMAL, to all of aDst (a swapchain image). aDst ends in
+// PRESENT_SRC_KHR, or with aOffscreen in TRANSFER_SRC_OPTIMAL (visible to
+// transfers). The barrier on aDst follows the acquire semaphore's wait at
+// COLOR_ATTACHMENT_OUTPUT.
+void record_upscale(
+	VkCommandBuffer,
+	VkImage aSrc,
+	VkExtent2D const& aSrcExtent,
+	VkImage aDst,
+	VkExtent2D const& aDstExtent,
+	bool aOffscreen
+);
+
+#endif // DYNAMIC_RESOLUTION_HPP_2F6B9D1E_48A3_4C07_B5E2_7A1C0D93F6E4
@@ -0,0 +1,21 @@
+#include "embedded_spirv.hpp"
+
+#include <iterator>
+
+#include <cstdint>
+
+namespace
+{
+	// Generated with the project files, lists the .spv.inc files generated
+	// by the cw2-shaders build
+#	include "shaders/embedded/spirv_table.inc"
+}
+
+lut::EmbeddedSpirv const* embedded_spirv() noexcept
+{
+	return kEmbeddedSpirv_;
+}
+std::size_t embedded_spirv_count() noexcept
+{
+	return std::size( kEmbeddedSpirv_ );
+}
@@ -0,0 +1,18 @@
+#ifndef EMBEDDED_SPIRV_HPP_2D63C49D_0FAF_4E77_B837_C5B14467EE50
+#define EMBEDDED_SPIRV_HPP_2D63C49D_0FAF_4E77_B837_C5B14467EE50
+
+// The SPIR-V of cw2/shaders/*, compiled into the executable by the
+// cw2-shaders build (see util/glslc.lua), for lut::ShaderModuleCache. The
+// executable then runs without assets/cw2/shaders/; --shader-dir loads the
+// .spv files found there instead.
+
+#include <cstddef>
+
+#include "../labutils/object_cache.hpp"
+
+namespace lut = labutils;
+
+lut::EmbeddedSpirv const* embedded_spirv() noexcept;
+std::size_t embedded_spirv_count() noexcept;
+
+#endif // EMBEDDED_SPIRV_HPP_2D63C49D_0FAF_4E77_B837_C5B14467EE50
@@ -0,0 +1,230 @@
+#include "frame_capture.hpp"
+
+#include <memory>
+#include <algorithm>
+#include <utility>
+
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+
+#include <stb_image_write.h>
+
+#include "../labutils/error.hpp"
+#include "../labutils/cpu_zones.hpp"
+
+FrameCapture::FrameCapture( lut::Allocator const& aAllocator, bool aPam )
+	: mAllocator( &aAllocator )
+	, mPam( aPam )
+	, mSlots( kCaptureBuffers )
+{
+	mEncoder = std::thread( [this] { run_(); } );
+}
+
+FrameCapture::~FrameCapture()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mQuit = true;
+	}
+
+	mWake.notify_all();
+	mEncoder.join();
+}
+
+bool FrameCapture::supports( VkFormat aFormat )
+{
+	switch( aFormat )
+	{
+		case VK_FORMAT_R8G8B8A8_UNORM: [[fallthrough]];
+		case VK_FORMAT_R8G8B8A8_SRGB: [[fallthrough]];
+		case VK_FORMAT_B8G8R8A8_UNORM: [[fallthrough]];
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			return true;
+		default:
+			return false;
+	}
+}
+
+VkBuffer FrameCapture::begin( std::string aPath, VkExtent2D const& aExtent, VkFormat aFormat )
+{
+	assert( supports( aFormat ) );
+
+	Slot_* slot = nullptr;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		for( auto& candidate : mSlots )
+		{
+			if( EState_::free == candidate.state )
+			{
+				slot = &candidate;
+				break;
+			}
+		}
+	}
+
+	if( !slot )
+	{
+		++mDropped;
+		return VK_NULL_HANDLE;
+	}
+
+	// Free slots are the render loop's; buffers grow with the swapchain
+	auto const bytes = VkDeviceSize(aExtent.width) * aExtent.height * 4;
+	if( slot->size < bytes )
+	{
+		slot->buffer = lut::create_buffer( *mAllocator, bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+		slot->data = lut::mapped_data( *mAllocator, slot->buffer );
+		slot->size = bytes;
+		assert( slot->data );
+	}
+
+	slot->path = std::move(aPath) + (mPam ? ".pam" : ".png");
+	slot->extent = aExtent;
+	slot->bgra = VK_FORMAT_B8G8R8A8_UNORM == aFormat || VK_FORMAT_B8G8R8A8_SRGB == aFormat;
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	slot->state = EState_::recorded;
+
+	return slot->buffer.buffer;
+}
+
+void FrameCapture::submitted( std::uint64_t aValue )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	for( auto& slot : mSlots )
+	{
+		if( EState_::recorded == slot.state )
+		{
+			slot.state = EState_::submitted;
+			slot.value = aValue;
+		}
+	}
+}
+
+void FrameCapture::poll( lut::Timeline& aTimeline )
+{
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( mError )
+			std::rethrow_exception( std::exchange( mError, nullptr ) );
+
+		// Oldest first, so that the frames are written in order
+		std::vector<std::size_t> done;
+		for( std::size_t i = 0; i < mSlots.size(); ++i )
+		{
+			if( EState_::submitted == mSlots[i].state && aTimeline.reached( mSlots[i].value ) )
+				done.emplace_back( i );
+		}
+		std::sort( done.begin(), done.end(), [this] (std::size_t aA, std::size_t aB) {
+			return mSlots[aA].value < mSlots[aB].value;
+		} );
+
+		for( auto const i : done )
+		{
+			mSlots[i].state = EState_::encoding;
+			mQueue.emplace_back( i );
+			queued = true;
+		}
+	}
+
+	if( queued )
+		mWake.notify_one();
+}
+
+void FrameCapture::flush( lut::Timeline& aTimeline )
+{
+	poll( aTimeline );
+
+	std::unique_lock<std::mutex> lock( mMutex );
+	mIdle.wait( lock, [this] {
+		return std::none_of( mSlots.begin(), mSlots.end(), [] (Slot_ const& aSlot) { return EState_::encoding == aSlot.state; } );
+	} );
+
+	if( mError )
+		std::rethrow_exception( std::exchange( mError, nullptr ) );
+}
+
+std::size_t FrameCapture::written() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mWritten;
+}
+
+void FrameCapture::run_()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+	while( true )
+	{
+		mWake.wait( lock, [this] { return mQuit || !mQueue.empty(); } );
+
+		// Quitting drains the queue; frames not yet polled are lost
+		if( mQueue.empty() )
+			return;
+
+		auto const index = mQueue.front();
+		mQueue.pop_front();
+
+		lock.unlock();
+		bool ok = true;
+		try
+		{
+			encode_( mSlots[index] );
+		}
+		catch( ... )
+		{
+			ok = false;
+			lock.lock();
+			if( !mError )
+				mError = std::current_exception();
+			lock.unlock();
+		}
+		lock.lock();
+
+		mSlots[index].state = EState_::free;
+		if( ok )
+			++mWritten;
+
+		if( mQueue.empty() )
+			mIdle.notify_all();
+	}
+}
+
+void FrameCapture::encode_( Slot_ const& aSlot )
+{
+	LUT_CPU_ZONE( "encode capture" );
+
+	vmaInvalidateAllocation( mAllocator->allocator, aSlot.buffer.allocation, 0, VK_WHOLE_SIZE );
+
+	// To RGBA, opaque: alpha is the masked materials' coverage, and the
+	// swapchain's alpha is ignored when presenting. The bytes are in the
+	// swapchain's encoding (sRGB normally), as PNG expects.
+	auto const pixels = std::size_t(aSlot.extent.width) * aSlot.extent.height;
+	auto image = std::make_unique<std::uint8_t[]>( pixels * 4 );
+	std::memcpy( image.get(), aSlot.data, pixels * 4 );
+
+	for( std::size_t i = 0; i < pixels * 4; i += 4 )
+	{
+		if( aSlot.bgra )
+			std::swap( image[i+0], image[i+2] );
+		image[i+3] = 0xff;
+	}
+
+	if( mPam )
+	{
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> file( std::fopen( aSlot.path.c_str(), "wb" ), &std::fclose );
+		if( !file )
+			throw lut::Error( "Unable to open '%s' for writing", aSlot.path.c_str() );
+
+		std::fprintf( file.get(), "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", aSlot.extent.width, aSlot.extent.height );
+		bool const ok = pixels == std::fwrite( image.get(), 4, pixels, file.get() );
+		if( 0 != std::fclose( file.release() ) || !ok )
+			throw lut::Error( "Unable to write image '%s'", aSlot.path.c_str() );
+	}
+	else
+	{
+		if( !stbi_write_png( aSlot.path.c_str(), int(aSlot.extent.width), int(aSlot.extent.height), 4, image.get(), int(aSlot.extent.width * 4) ) )
+			throw lut::Error( "Unable to write image '%s'", aSlot.path.c_str() );
+	}
+}
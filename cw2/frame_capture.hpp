@@ -0,0 +1,130 @@
+#ifndef FRAME_CAPTURE_HPP_4A7E1C93_B25D_4F60_8E3A_D19C6F02B857
+#define FRAME_CAPTURE_HPP_4A7E1C93_B25D_4F60_8E3A_D19C6F02B857
+
+// Asynchronous readback of the interactive run's frames: screenshots (F12,
+// into --screenshot-dir) and the capture of every frame (--capture-frames).
+// The render loop never waits for a capture:
+//  - begin() reserves one of a ring of host-cached, persistently mapped
+//    readback buffers for the frame being recorded; record_commands()
+//    copies the final image (HUD included) into it at the end of the
+//    frame's command buffer, and puts the image back into PRESENT_SRC_KHR;
+//  - submitted() tags the frame's buffers with the timeline value that
+//    the submission signals;
+//  - poll(), once per frame after the frame slot's wait, hands the buffers
+//    whose frames have completed (normally those of the frames before) to
+//    an encoder thread. It only queries the timeline, never waits on it.
+// The encoder writes each image as PNG or PAM (raw RGBA with a short text
+// header, e.g., for ffmpeg), and returns the buffer to the ring.
+//
+// If the encoder falls behind and no buffer is free, the frame is not
+// captured, and counted in dropped(); the file names carry the frame
+// numbers, which show the gaps.
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/timeline.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/allocator.hpp"
+
+namespace lut = labutils;
+
+// Readback buffers in the ring; a frame in flight holds at most one, and
+// the encoder one more
+constexpr std::size_t kCaptureBuffers = 8;
+
+class FrameCapture
+{
+	public:
+		// aPam: PAM files instead of PNG (no compression, far quicker to
+		// write at high frame rates)
+		FrameCapture( lut::Allocator const&, bool aPam );
+		~FrameCapture(); // writes the images handed to the encoder first
+
+		FrameCapture( FrameCapture const& ) = delete;
+		FrameCapture& operator= (FrameCapture const&) = delete;
+
+	public:
+		// 8-bit RGBA and BGRA images (of either encoding) can be captured
+		static bool supports( VkFormat );
+
+		// Reserves a buffer for an aExtent image of aFormat, to be written
+		// to aPath plus the extension. Returns the buffer to copy the
+		// image into (tightly packed), or VK_NULL_HANDLE if none is free.
+		// Throws lut::Error if a larger buffer can't be created.
+		VkBuffer begin( std::string aPath, VkExtent2D const& aExtent, VkFormat aFormat );
+
+		// The frame whose buffers begin() returned since the previous call
+		// signals aValue on the timeline
+		void submitted( std::uint64_t aValue );
+
+		// Hands the buffers of the completed frames to the encoder.
+		// Rethrows an error raised by the encoder (e.g., a file that can't
+		// be written).
+		void poll( lut::Timeline& );
+
+		// poll(), then waits until the encoder has written everything; for
+		// the end of the run, once the device is idle
+		void flush( lut::Timeline& );
+
+		std::size_t written() const;
+		std::size_t dropped() const noexcept { return mDropped; }
+
+	private:
+		enum class EState_
+		{
+			free,
+			recorded, // by begin(), until submitted()
+			submitted,
+			encoding
+		};
+
+		struct Slot_
+		{
+			lut::Buffer buffer;
+			std::byte const* data = nullptr; // persistently mapped
+			VkDeviceSize size = 0;
+
+			EState_ state = EState_::free;
+			std::uint64_t value = 0; // submitted: signalled when the copy is done
+
+			std::string path; // with the extension
+			VkExtent2D extent{};
+			bool bgra = false;
+		};
+
+		void run_();
+		void encode_( Slot_ const& );
+
+	private:
+		lut::Allocator const* mAllocator;
+		bool mPam;
+
+		// The encoder only touches the slots in the encoding state. States
+		// change under mMutex; the other members of free slots are the
+		// render loop's.
+		std::vector<Slot_> mSlots;
+
+		mutable std::mutex mMutex;
+		std::condition_variable mWake, mIdle;
+		std::deque<std::size_t> mQueue; // slots to encode
+		std::size_t mWritten = 0;
+		std::exception_ptr mError;
+		bool mQuit = false;
+
+		std::size_t mDropped = 0;
+
+		std::thread mEncoder;
+};
+
+#endif // FRAME_CAPTURE_HPP_4A7E1C93_B25D_4F60_8E3A_D19C6F02B857
@@ -0,0 +1,200 @@
+#include "frame_latency.hpp"
+
+#include <thread>
+#include <algorithm>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// The limiter sleeps until this long before the frame is due, and yields
+	// for the rest; sleeps may overshoot by about a scheduler tick.
+	constexpr auto kLimiterSpin = std::chrono::milliseconds(1);
+
+	double ms_( LatencyClock::duration aTime )
+	{
+		return std::chrono::duration<double, std::milli>( aTime ).count();
+	}
+}
+
+FrameLatency::FrameLatency( VkDevice aDevice, bool aPresentWait, char const* aLogPath )
+	: mDevice( aDevice )
+	, mPresentWait( aPresentWait )
+	, mLog( nullptr, &std::fclose )
+{
+	if( !aLogPath )
+		return;
+
+	mLog.reset( std::fopen( aLogPath, "w" ) );
+	if( !mLog )
+		throw lut::Error( "Unable to open latency log '%s' for writing", aLogPath );
+
+	std::fprintf( mLog.get(), "frame,present_id,had_input,sample_ms,record_ms,submit_ms,present_ms,photon_ms\n" );
+}
+
+FrameLatency::~FrameLatency() = default;
+
+std::uint64_t FrameLatency::next_present_id() noexcept
+{
+	return mPresentWait ? mNextPresentId++ : 0;
+}
+
+void FrameLatency::presented( FrameTimestamps const& aStamps, std::uint64_t aPresentId )
+{
+	if( LatencyClock::time_point{} != mLastPresent )
+	{
+		auto const interval = ms_( aStamps.present - mLastPresent );
+		mIntervalMs += interval;
+		mMaxIntervalMs = std::max( mMaxIntervalMs, interval );
+		++mIntervals;
+	}
+	mLastPresent = aStamps.present;
+
+	if( 0 == aPresentId )
+	{
+		complete_( Pending_{ aStamps, 0 }, nullptr );
+		return;
+	}
+
+	mPending.emplace_back( Pending_{ aStamps, aPresentId } );
+	while( mPending.size() > kLatencyMaxPending )
+	{
+		complete_( mPending.front(), nullptr );
+		mPending.pop_front();
+	}
+}
+
+void FrameLatency::poll_presents( VkSwapchainKHR aSwapchain )
+{
+	// IDs complete in order; a wait for an ID also returns once a later one
+	// has been presented instead (e.g., mailbox replaced it)
+	while( !mPending.empty() )
+	{
+		auto const res = vkWaitForPresentKHR( mDevice, aSwapchain, mPending.front().presentId, 0 );
+		if( VK_TIMEOUT == res )
+			break;
+
+		// Out of date and similar: the swapchain is about to be recreated
+		if( VK_SUCCESS != res && VK_SUBOPTIMAL_KHR != res )
+			break;
+
+		auto const now = LatencyClock::now();
+		complete_( mPending.front(), &now );
+		mPending.pop_front();
+	}
+}
+
+void FrameLatency::swapchain_recreated()
+{
+	for( auto const& pending : mPending )
+		complete_( pending, nullptr );
+	mPending.clear();
+}
+
+LatencyStats FrameLatency::take_stats()
+{
+	LatencyStats ret;
+	ret.frames = mFrames;
+	if( mFrames )
+	{
+		ret.submitMs = mSubmitMs / mFrames;
+		ret.presentMs = mPresentMs / mFrames;
+	}
+	if( mPhotonFrames )
+		ret.photonMs = mPhotonMs / mPhotonFrames;
+	if( mIntervals )
+	{
+		ret.intervalMs = mIntervalMs / mIntervals;
+		ret.maxIntervalMs = mMaxIntervalMs;
+	}
+
+	mSubmitMs = mPresentMs = mPhotonMs = 0.0;
+	mIntervalMs = mMaxIntervalMs = 0.0;
+	mFrames = mPhotonFrames = mIntervals = 0;
+
+	if( mLog )
+		std::fflush( mLog.get() );
+
+	return ret;
+}
+
+void FrameLatency::complete_( Pending_ const& aFrame, LatencyClock::time_point const* aPhoton )
+{
+	auto const& stamps = aFrame.stamps;
+
+	mSubmitMs += ms_( stamps.submit - stamps.input );
+	mPresentMs += ms_( stamps.present - stamps.input );
+	++mFrames;
+
+	if( aPhoton )
+	{
+		mPhotonMs += ms_( *aPhoton - stamps.input );
+		++mPhotonFrames;
+	}
+
+	if( !mLog )
+		return;
+
+	std::fprintf( mLog.get(), "%llu,%llu,%d,%.3f,%.3f,%.3f,%.3f,",
+		static_cast<unsigned long long>(mLoggedFrames++), static_cast<unsigned long long>(aFrame.presentId), stamps.hadInput ? 1 : 0,
+		ms_( stamps.sample - stamps.input ), ms_( stamps.record - stamps.input ), ms_( stamps.submit - stamps.input ), ms_( stamps.present - stamps.input ) );
+	if( aPhoton )
+		std::fprintf( mLog.get(), "%.3f", ms_( *aPhoton - stamps.input ) );
+	std::fprintf( mLog.get(), "\n" );
+}
+
+
+FrameLimiter::FrameLimiter( float aFps )
+	: mPeriod( std::chrono::duration_cast<LatencyClock::duration>( std::chrono::duration<double>( 1.0 / aFps ) ) )
+	, mNext( LatencyClock::now() )
+{}
+
+void FrameLimiter::wait()
+{
+	auto const now = LatencyClock::now();
+	if( now < mNext )
+	{
+		if( mNext - now > kLimiterSpin )
+			std::this_thread::sleep_until( mNext - kLimiterSpin );
+		while( LatencyClock::now() < mNext )
+			std::this_thread::yield();
+	}
+	else if( now - mNext > mPeriod )
+	{
+		mNext = now;
+	}
+
+	mNext += mPeriod;
+}
+
+void FrameLimiter::set_fps( float aFps )
+{
+	mPeriod = std::chrono::duration_cast<LatencyClock::duration>( std::chrono::duration<double>( 1.0 / aFps ) );
+}
+
+
+AdaptiveFrameCap::AdaptiveFrameCap( float aMinFps, float aMaxFps ) noexcept
+	: mMinFps( aMinFps )
+	, mMaxFps( aMaxFps )
+	, mFps( aMaxFps )
+{}
+
+float AdaptiveFrameCap::update( float aMotion, double aGpuMs, float aElapsedTime ) noexcept
+{
+	float const motion = std::clamp( aMotion, 0.f, 1.f );
+	float target = mMinFps + motion * (mMaxFps - mMinFps);
+
+	// Slow views also keep the GPU below its peak; at full speed, the frame
+	// rate wins
+	if( motion < 1.f && aGpuMs > 0.0 )
+		target = std::min( target, float(1000.0 * kAdaptiveGpuBusy / aGpuMs) );
+	target = std::clamp( target, mMinFps, mMaxFps );
+
+	if( target >= mFps )
+		mFps = target;
+	else
+		mFps += (target - mFps) * std::min( 1.f, aElapsedTime / kAdaptiveFallSeconds );
+
+	return mFps;
+}
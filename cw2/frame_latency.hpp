@@ -0,0 +1,161 @@
+#ifndef FRAME_LATENCY_HPP_8C3A5E17_D6B2_4F9E_A041_5B7E2C9D1F36
+#define FRAME_LATENCY_HPP_8C3A5E17_D6B2_4F9E_A041_5B7E2C9D1F36
+
+// Input-to-photon latency and frame pacing of the interactive run. Each
+// presented frame is stamped when its input arrived (the first GLFW event
+// since the previous frame), when the input was sampled (glfwPollEvents()
+// returned), when recording began, and when vkQueueSubmit() and
+// vkQueuePresentKHR() returned.
+//
+// With VK_KHR_present_id and VK_KHR_present_wait (VulkanContext::
+// havePresentWait), presents carry IDs, and poll_presents() checks which
+// have completed, i.e., reached the display. It only polls (timeout 0):
+// vkWaitForPresentKHR() would need the swapchain to itself, and
+// vkQueuePresentKHR() uses it from the render loop. The completion
+// ("photon") time is therefore the first poll that saw it, up to one loop
+// iteration late.
+//
+// FrameLimiter (--fps-limit) sleeps at the top of the loop, before the
+// events are polled, so that the input is as fresh as possible when the
+// frame is recorded; without a limit, frames start as soon as a frame slot
+// and a swapchain image are free, and the input waits in the queue.
+//
+// AdaptiveFrameCap (--fps-adaptive) moves the limiter's rate between a
+// floor and --fps-limit: while the view is still or changes slowly, fewer
+// frames are hardly visible, and running below the GPU's peak keeps its
+// clocks and temperature steady (laptops, fanless machines). The cap then
+// also leaves the GPU kAdaptiveGpuBusy of each frame at most, by the GPU
+// frame time from the profiler. It rises at once when the view moves
+// faster, and falls over about kAdaptiveFallSeconds.
+
+#include <deque>
+#include <memory>
+#include <chrono>
+
+#include <cstdio>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+using LatencyClock = std::chrono::steady_clock;
+
+struct FrameTimestamps
+{
+	LatencyClock::time_point input;  // first input event; sample if none
+	LatencyClock::time_point sample; // events polled
+	LatencyClock::time_point record; // command recording begins
+	LatencyClock::time_point submit; // vkQueueSubmit() returned
+	LatencyClock::time_point present; // vkQueuePresentKHR() returned
+	bool hadInput = false;
+};
+
+// Means over the frames completed since the last take_latency_stats(); in
+// milliseconds from the frame's input. photonMs is negative without
+// present IDs (or if no present completed in time).
+struct LatencyStats
+{
+	std::uint32_t frames = 0;
+	double submitMs = 0.0, presentMs = 0.0, photonMs = -1.0;
+
+	// Interval between consecutive presents: mean and largest
+	double intervalMs = 0.0, maxIntervalMs = 0.0;
+};
+
+class FrameLatency
+{
+	public:
+		// aLogPath: per-frame CSV, null for none. Throws lut::Error if it
+		// can't be opened.
+		FrameLatency( VkDevice, bool aPresentWait, char const* aLogPath );
+		~FrameLatency();
+
+		FrameLatency( FrameLatency const& ) = delete;
+		FrameLatency& operator= (FrameLatency const&) = delete;
+
+	public:
+		bool present_wait() const noexcept { return mPresentWait; }
+
+		// ID for the next vkQueuePresentKHR() (VkPresentIdKHR); 0 without
+		// present IDs
+		std::uint64_t next_present_id() noexcept;
+
+		// After vkQueuePresentKHR() with aPresentId (0: none)
+		void presented( FrameTimestamps const&, std::uint64_t aPresentId );
+
+		// Checks the pending presents of aSwapchain (timeout 0). Frames that
+		// don't complete within kLatencyMaxPending presents are counted
+		// without a photon time.
+		void poll_presents( VkSwapchainKHR );
+
+		// The pending presents belong to a retired swapchain; they are
+		// counted without a photon time. IDs continue (the new swapchain
+		// accepts any that increase).
+		void swapchain_recreated();
+
+		// Also flushes the log
+		LatencyStats take_stats();
+
+	private:
+		struct Pending_
+		{
+			FrameTimestamps stamps;
+			std::uint64_t presentId;
+		};
+
+		void complete_( Pending_ const&, LatencyClock::time_point const* aPhoton );
+
+		VkDevice mDevice;
+		bool mPresentWait;
+		std::uint64_t mNextPresentId = 1;
+
+		std::deque<Pending_> mPending; // oldest first
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> mLog;
+		std::uint64_t mLoggedFrames = 0;
+
+		LatencyClock::time_point mLastPresent{};
+		double mSubmitMs = 0.0, mPresentMs = 0.0, mPhotonMs = 0.0;
+		double mIntervalMs = 0.0, mMaxIntervalMs = 0.0;
+		std::uint32_t mFrames = 0, mPhotonFrames = 0, mIntervals = 0;
+};
+
+constexpr std::size_t kLatencyMaxPending = 16;
+
+// Holds the start of each frame to 1/aFps seconds after the previous one.
+// A late frame restarts the schedule rather than being followed by a burst.
+class FrameLimiter
+{
+	public:
+		explicit FrameLimiter( float aFps );
+
+		// Sleeps until the next frame is due
+		void wait();
+
+		// From the next frame on
+		void set_fps( float aFps );
+
+	private:
+		LatencyClock::duration mPeriod;
+		LatencyClock::time_point mNext;
+};
+
+constexpr float kAdaptiveGpuBusy = 0.75f; // of the frame period
+constexpr float kAdaptiveFallSeconds = 1.f;
+
+class AdaptiveFrameCap
+{
+	public:
+		AdaptiveFrameCap( float aMinFps, float aMaxFps ) noexcept;
+
+		// Once per frame. aMotion: how fast the view changes, 1 (or more)
+		// for full speed; aGpuMs: GPU time of a recent frame, negative if
+		// unknown. Returns the cap for the next frame.
+		float update( float aMotion, double aGpuMs, float aElapsedTime ) noexcept;
+
+		float fps() const noexcept { return mFps; }
+
+	private:
+		float mMinFps, mMaxFps;
+		float mFps;
+};
+
+#endif // FRAME_LATENCY_HPP_8C3A5E17_D6B2_4F9E_A041_5B7E2C9D1F36
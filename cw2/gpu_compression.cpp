@@ -0,0 +1,365 @@
+#include "gpu_compression.hpp"
+
+#include <algorithm>
+
+#include <cstddef>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	constexpr std::uint32_t kBcWorkgroupSize = 8; // local_size_x/y in bc_compress.comp, in blocks
+
+	// kFormat in bc_compress.comp, and the index into TextureCompressor::pipes
+	enum EBlockFormat_ : std::uint32_t
+	{
+		bc1_ = 0,
+		bc4_ = 1,
+		bc7_ = 2
+	};
+
+	// Matches the push constant block in cw2/shaders/bc_compress.comp
+	struct BcPush_
+	{
+		std::uint32_t blocksX, blocksY;
+		std::uint32_t level;
+		std::uint32_t firstWord;
+		std::uint32_t srgb;
+	};
+
+	// Matches the specialization constants in bc_compress.comp
+	struct BcSpec_
+	{
+		std::uint32_t format;
+		VkBool32 quality;
+	};
+
+	EBlockFormat_ block_format_( VkFormat );
+	std::uint32_t block_bytes_( VkFormat );
+
+	// Bytes of level aLevel of an image in aFormat, block compressed or one
+	// of the uncompressed formats that compress_textures() reads
+	VkDeviceSize level_bytes_( VkFormat aFormat, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aLevel );
+}
+
+TextureCompressor create_texture_compressor( lut::VulkanWindow const& aWindow, lut::SamplerCache& aSamplers, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, bool aQuality, VkPipelineCache aCache )
+{
+	TextureCompressor ret;
+	ret.quality = aQuality;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create texture compression descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipelines, one per block format
+	{
+		VkPushConstantRange pushRange{};
+		pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushRange.size = sizeof(BcPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushRange;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create texture compression pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkSpecializationMapEntry const specEntries[] = {
+			{ 0, offsetof( BcSpec_, format ), sizeof(std::uint32_t) },
+			{ 1, offsetof( BcSpec_, quality ), sizeof(VkBool32) }
+		};
+
+		for( std::uint32_t format : { bc1_, bc4_, bc7_ } )
+		{
+			BcSpec_ const spec{ format, aQuality ? VK_TRUE : VK_FALSE };
+
+			VkSpecializationInfo specInfo{};
+			specInfo.mapEntryCount = sizeof(specEntries) / sizeof(specEntries[0]);
+			specInfo.pMapEntries = specEntries;
+			specInfo.dataSize = sizeof(BcSpec_);
+			specInfo.pData = &spec;
+
+			VkComputePipelineCreateInfo pipeInfo{};
+			pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipeInfo.stage.module = comp;
+			pipeInfo.stage.pName = "main";
+			pipeInfo.stage.pSpecializationInfo = &specInfo;
+			pipeInfo.layout = ret.pipeLayout.handle;
+
+			VkPipeline pipe = VK_NULL_HANDLE;
+			if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create texture compression pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+			ret.pipes[format] = lut::Pipeline( aWindow.device, pipe );
+		}
+	}
+
+	// Sampler; the shader only uses texelFetch()
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_NEAREST;
+		sampInfo.minFilter = VK_FILTER_NEAREST;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	return ret;
+}
+
+VkFormat compressed_texture_format( TextureCompressor const& aCompressor, lut::VulkanContext const& aContext, VkFormat aFormat, bool aOpaque )
+{
+	VkFormat format = aFormat;
+	switch( aFormat )
+	{
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			format = aOpaque && !aCompressor.quality ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+			break;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			format = VK_FORMAT_BC7_UNORM_BLOCK;
+			break;
+		case VK_FORMAT_R8_UNORM:
+			format = VK_FORMAT_BC4_UNORM_BLOCK;
+			break;
+		default:
+			break;
+	}
+
+	if( format != aFormat && !lut::supports_sampled_format( aContext, format ) )
+		return aFormat;
+
+	return format;
+}
+
+std::uint64_t compress_textures( TextureCompressor const& aCompressor, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, std::vector<CompressibleTexture> const& aTextures )
+{
+	// The textures to encode, and where their levels go in the block buffer.
+	// Offsets are multiples of 16 bytes, as copies from it must start at a
+	// multiple of the block size.
+	struct Job_
+	{
+		CompressibleTexture const* texture;
+		VkFormat format;
+		std::uint32_t levels;
+		VkDeviceSize offset;
+	};
+
+	std::vector<Job_> jobs;
+	VkDeviceSize blockBytes = 0;
+	for( auto const& tex : aTextures )
+	{
+		VkFormat const format = compressed_texture_format( aCompressor, aWindow, *tex.format, tex.opaque );
+		if( format == *tex.format )
+			continue;
+
+		Job_ job{ &tex, format, lut::compute_mip_level_count( tex.width, tex.height ), blockBytes };
+		for( std::uint32_t level = 0; level < job.levels; ++level )
+			blockBytes += level_bytes_( format, tex.width, tex.height, level );
+
+		blockBytes = (blockBytes + 15) & ~VkDeviceSize(15);
+		jobs.emplace_back( job );
+	}
+
+	if( jobs.empty() )
+		return 0;
+
+	lut::Buffer blocks = lut::create_buffer( aAllocator, blockBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::device );
+
+	auto const jobCount = static_cast<std::uint32_t>(jobs.size());
+	lut::DescriptorPool pool = lut::create_descriptor_pool( aWindow, jobCount, jobCount );
+
+	std::vector<lut::ImageView> views;
+	std::vector<lut::Image> images;
+	views.reserve( jobs.size() );
+	images.reserve( jobs.size() );
+
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	// Whatever wrote the textures (uploads, mip blits) was submitted to this
+	// queue earlier
+	VkMemoryBarrier uploaded{};
+	uploaded.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	uploaded.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	uploaded.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier( cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &uploaded, 0, nullptr, 0, nullptr );
+
+	// Encode all levels of all textures into the block buffer
+	for( auto const& job : jobs )
+	{
+		auto const& tex = *job.texture;
+		views.emplace_back( lut::create_image_view_texture2d( aWindow, tex.image->image, *tex.format ) );
+
+		VkDescriptorSet const set = lut::alloc_desc_set( aWindow, pool.handle, aCompressor.layout.handle );
+		{
+			VkDescriptorImageInfo srcInfo{};
+			srcInfo.sampler = aCompressor.sampler;
+			srcInfo.imageView = views.back().handle;
+			srcInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			VkDescriptorBufferInfo dstInfo{};
+			dstInfo.buffer = blocks.buffer;
+			dstInfo.range = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet desc[2]{};
+			desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[0].dstSet = set;
+			desc[0].dstBinding = 0;
+			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[0].descriptorCount = 1;
+			desc[0].pImageInfo = &srcInfo;
+
+			desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[1].dstSet = set;
+			desc[1].dstBinding = 1;
+			desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			desc[1].descriptorCount = 1;
+			desc[1].pBufferInfo = &dstInfo;
+
+			vkUpdateDescriptorSets( aWindow.device, 2, desc, 0, nullptr );
+		}
+
+		vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, aCompressor.pipes[block_format_( job.format )].handle );
+		vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, aCompressor.pipeLayout.handle, 0, 1, &set, 0, nullptr );
+
+		VkDeviceSize offset = job.offset;
+		for( std::uint32_t level = 0; level < job.levels; ++level )
+		{
+			BcPush_ push{};
+			push.blocksX = (std::max( 1u, tex.width >> level ) + 3) / 4;
+			push.blocksY = (std::max( 1u, tex.height >> level ) + 3) / 4;
+			push.level = level;
+			push.firstWord = static_cast<std::uint32_t>(offset / 4);
+			push.srgb = VK_FORMAT_R8G8B8A8_SRGB == *tex.format;
+
+			vkCmdPushConstants( cmd, aCompressor.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BcPush_), &push );
+			vkCmdDispatch( cmd, (push.blocksX + kBcWorkgroupSize-1) / kBcWorkgroupSize, (push.blocksY + kBcWorkgroupSize-1) / kBcWorkgroupSize, 1 );
+
+			offset += level_bytes_( job.format, tex.width, tex.height, level );
+		}
+	}
+
+	lut::buffer_barrier( cmd, blocks.buffer,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	// Copy them into the compressed images
+	for( auto const& job : jobs )
+	{
+		auto const& tex = *job.texture;
+		images.emplace_back( lut::create_image_texture2d( aAllocator, tex.width, tex.height, job.format ) );
+
+		lut::image_barrier( cmd, images.back().image,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, job.levels, 0, 1 } );
+
+		std::vector<VkBufferImageCopy> copies( job.levels );
+		VkDeviceSize offset = job.offset;
+		for( std::uint32_t level = 0; level < job.levels; ++level )
+		{
+			auto& copy = copies[level];
+			copy.bufferOffset = offset;
+			copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			copy.imageExtent = VkExtent3D{ std::max( 1u, tex.width >> level ), std::max( 1u, tex.height >> level ), 1 };
+
+			offset += level_bytes_( job.format, tex.width, tex.height, level );
+		}
+
+		vkCmdCopyBufferToImage( cmd, blocks.buffer, images.back().image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, job.levels, copies.data() );
+		lut::record_texture_ready( cmd, images.back().image, job.levels );
+	}
+
+	batch.submit().wait();
+	views.clear();
+
+	std::uint64_t saved = 0;
+	for( std::size_t i = 0; i < jobs.size(); ++i )
+	{
+		auto const& job = jobs[i];
+		auto const& tex = *job.texture;
+		for( std::uint32_t level = 0; level < job.levels; ++level )
+			saved += level_bytes_( *tex.format, tex.width, tex.height, level ) - level_bytes_( job.format, tex.width, tex.height, level );
+
+		*tex.image = std::move( images[i] );
+		*tex.format = job.format;
+	}
+
+	return saved;
+}
+
+namespace
+{
+	EBlockFormat_ block_format_( VkFormat aFormat )
+	{
+		switch( aFormat )
+		{
+			case VK_FORMAT_BC1_RGB_SRGB_BLOCK: return bc1_;
+			case VK_FORMAT_BC4_UNORM_BLOCK: return bc4_;
+			default: return bc7_;
+		}
+	}
+
+	std::uint32_t block_bytes_( VkFormat aFormat )
+	{
+		return bc7_ == block_format_( aFormat ) ? 16 : 8;
+	}
+
+	VkDeviceSize level_bytes_( VkFormat aFormat, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aLevel )
+	{
+		VkDeviceSize const width = std::max( 1u, aWidth >> aLevel );
+		VkDeviceSize const height = std::max( 1u, aHeight >> aLevel );
+		switch( aFormat )
+		{
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_R8G8B8A8_UNORM:
+				return width * height * 4;
+			case VK_FORMAT_R8_UNORM:
+				return width * height;
+			default:
+				return ((width + 3) / 4) * ((height + 3) / 4) * block_bytes_( aFormat );
+		}
+	}
+}
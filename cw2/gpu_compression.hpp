@@ -0,0 +1,80 @@
+#ifndef GPU_COMPRESSION_HPP_5B43DAEF_1A2F_42BC_AB6E_845AE9114307
+#define GPU_COMPRESSION_HPP_5B43DAEF_1A2F_42BC_AB6E_845AE9114307
+
+// Block compression of decoded textures at load time, on the GPU
+// (--texture-compression). Textures that don't come from cw2-bake (PNGs and
+// the like) are uploaded as RGBA8 or R8 with their mips blitted; a compute
+// shader (cw2/shaders/bc_compress.comp) then encodes every level into a
+// buffer, from where it is copied into a block-compressed image that
+// replaces the uncompressed one:
+//
+//   R8G8B8A8_SRGB  -> BC7 (mode 6), or BC1 if opaque and fast
+//   R8G8B8A8_UNORM -> BC7 (mode 6); normal maps and packed channels
+//   R8_UNORM       -> BC4
+//
+// That is a quarter (BC7), an eighth (BC1) or half (BC4) of the memory, and
+// of the bandwidth when sampled. Fast picks its endpoints from the bounding box;
+// quality from the principal axis, refined by least squares, and tries all
+// of BC7's p-bit pairs, for a few times the GPU time. Like cw2-bake's
+// encoder (see cw2-bake/bc_encode.hpp), BC7 only uses mode 6.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+struct TextureCompressor
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipes[3]; // BC1, BC4, BC7 (kFormat in bc_compress.comp)
+
+	VkSampler sampler = VK_NULL_HANDLE; // nearest; from the cache
+
+	bool quality = false;
+};
+
+TextureCompressor create_texture_compressor(
+	lut::VulkanWindow const&,
+	lut::SamplerCache&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	bool aQuality,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// Format that compress_textures() gives a texture in aFormat; aFormat itself
+// if it has none, or if the device can't sample it.
+VkFormat compressed_texture_format( TextureCompressor const&, lut::VulkanContext const&, VkFormat aFormat, bool aOpaque );
+
+struct CompressibleTexture
+{
+	lut::Image* image;     // full mip chain, in SHADER_READ_ONLY_OPTIMAL
+	VkFormat* format;      // of image
+	std::uint32_t width, height;
+	bool opaque;           // see lut::is_opaque()
+};
+
+// Replaces the images (and formats) of the textures that have a compressed
+// format (see compressed_texture_format()) with compressed ones, also in
+// SHADER_READ_ONLY_OPTIMAL; the images must not be in use by the GPU. All
+// textures are encoded in one submission on aCmdPool's queue, which is
+// waited for. Returns the number of bytes saved.
+std::uint64_t compress_textures(
+	TextureCompressor const&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	std::vector<CompressibleTexture> const&
+);
+
+#endif // GPU_COMPRESSION_HPP_5B43DAEF_1A2F_42BC_AB6E_845AE9114307
@@ -0,0 +1,224 @@
+#include "gpu_decompression.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+#include <cstddef>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/job_system.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	// A job in the source buffer, as lz4_decompress.comp reads it
+	struct Lz4Job_
+	{
+		std::uint32_t srcOffset, srcBytes;
+		std::uint32_t dstOffset, dstBytes;
+	};
+
+	// Matches the push constant block in cw2/shaders/lz4_decompress.comp
+	struct Lz4Push_
+	{
+		std::uint32_t firstJobWord;
+	};
+
+	// Workgroups per dispatch; the minimum of maxComputeWorkGroupCount
+	constexpr std::uint32_t kMaxGroups = 65535;
+}
+
+GeometryDecompressor create_geometry_decompressor( lut::VulkanWindow const& aWindow, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkPipelineCache aCache )
+{
+	GeometryDecompressor ret;
+
+	// Descriptor set layout: source and jobs, destination, status
+	{
+		VkDescriptorSetLayoutBinding bindings[3]{};
+		for( std::uint32_t i = 0; i < 3; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create geometry decompression descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline
+	{
+		VkPushConstantRange pushRange{};
+		pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushRange.size = sizeof(Lz4Push_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushRange;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create geometry decompression pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = aShaderModules.get( aShaderPath );
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = ret.pipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create geometry decompression pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipe = lut::Pipeline( aWindow.device, pipe );
+	}
+
+	return ret;
+}
+
+std::uint64_t decompress_geometry( GeometryDecompressor const& aDecompressor, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, VkBuffer aVertices, std::vector<CompressedArray> const& aVertexArrays, VkBuffer aIndices, std::vector<CompressedArray> const& aIndexArrays )
+{
+	LUT_CPU_ZONE( "decompress_geometry()" );
+
+	// The source buffer holds the blocks (each from a multiple of 4 bytes),
+	// then the jobs of the vertex arrays and those of the index arrays
+	std::vector<CompressedArray const*> arrays;
+	for( auto const* list : { &aVertexArrays, &aIndexArrays } )
+	{
+		for( auto const& array : *list )
+			arrays.emplace_back( &array );
+	}
+
+	if( arrays.empty() )
+		return 0;
+
+	std::vector<Lz4Job_> jobs;
+	VkDeviceSize srcBytes = 0;
+	for( auto const* array : arrays )
+	{
+		assert( 0 == array->dstOffset % 4 && 0 == array->dstBytes % 4 );
+		assert( array->dstOffset + array->dstBytes <= kMaxGpuDecompressionBytes );
+
+		jobs.emplace_back( Lz4Job_{ std::uint32_t(srcBytes), std::uint32_t(array->bytes), std::uint32_t(array->dstOffset), std::uint32_t(array->dstBytes) } );
+		srcBytes += (array->bytes + 3) & ~std::size_t(3);
+	}
+
+	VkDeviceSize const jobOffset = srcBytes;
+	srcBytes += jobs.size() * sizeof(Lz4Job_);
+	if( srcBytes > kMaxGpuDecompressionBytes )
+		throw lut::Error( "decompress_geometry(): %llu MiB of compressed geometry, over the 4 GiB that the shader addresses", static_cast<unsigned long long>(srcBytes >> 20) );
+
+	lut::Buffer source = lut::create_buffer( aAllocator, srcBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+	lut::Buffer status = lut::create_buffer( aAllocator, sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator, srcBytes );
+	auto* const staged = batch.stage_buffer( source.buffer, srcBytes, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+	lut::shared_jobs().parallel_for( arrays.size(), [&] (std::size_t i) {
+		std::memcpy( staged + jobs[i].srcOffset, arrays[i]->data, arrays[i]->bytes );
+	} );
+	std::memcpy( staged + jobOffset, jobs.data(), jobs.size() * sizeof(Lz4Job_) );
+
+	// The shader ORs the bytes into cleared words
+	VkCommandBuffer const cmd = batch.commands();
+	for( auto const* list : { &aVertexArrays, &aIndexArrays } )
+	{
+		for( auto const& array : *list )
+			vkCmdFillBuffer( cmd, list == &aVertexArrays ? aVertices : aIndices, array.dstOffset, array.dstBytes, 0 );
+	}
+	vkCmdFillBuffer( cmd, status.buffer, 0, VK_WHOLE_SIZE, 0 );
+
+	VkMemoryBarrier filled{};
+	filled.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	filled.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	filled.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier( cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &filled, 0, nullptr, 0, nullptr );
+
+	lut::DescriptorPool pool = lut::create_descriptor_pool( aWindow, 6, 2 );
+	vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, aDecompressor.pipe.handle );
+
+	std::uint32_t firstJob = 0;
+	for( auto const* list : { &aVertexArrays, &aIndexArrays } )
+	{
+		if( list->empty() )
+			continue;
+
+		VkDescriptorSet const set = lut::alloc_desc_set( aWindow, pool.handle, aDecompressor.layout.handle );
+		{
+			VkDescriptorBufferInfo infos[3]{};
+			infos[0].buffer = source.buffer;
+			infos[0].range = VK_WHOLE_SIZE;
+			infos[1].buffer = list == &aVertexArrays ? aVertices : aIndices;
+			infos[1].range = VK_WHOLE_SIZE;
+			infos[2].buffer = status.buffer;
+			infos[2].range = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet desc[3]{};
+			for( std::uint32_t i = 0; i < 3; ++i )
+			{
+				desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				desc[i].dstSet = set;
+				desc[i].dstBinding = i;
+				desc[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				desc[i].descriptorCount = 1;
+				desc[i].pBufferInfo = &infos[i];
+			}
+
+			vkUpdateDescriptorSets( aWindow.device, 3, desc, 0, nullptr );
+		}
+
+		vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, aDecompressor.pipeLayout.handle, 0, 1, &set, 0, nullptr );
+
+		auto const count = static_cast<std::uint32_t>(list->size());
+		for( std::uint32_t first = 0; first < count; first += kMaxGroups )
+		{
+			Lz4Push_ push{};
+			push.firstJobWord = static_cast<std::uint32_t>((jobOffset + (firstJob + first) * sizeof(Lz4Job_)) / 4);
+
+			vkCmdPushConstants( cmd, aDecompressor.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Lz4Push_), &push );
+			vkCmdDispatch( cmd, std::min( kMaxGroups, count - first ), 1, 1 );
+		}
+
+		firstJob += count;
+	}
+
+	VkMemoryBarrier decompressed{};
+	decompressed.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	decompressed.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	decompressed.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier( cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &decompressed, 0, nullptr, 0, nullptr );
+
+	batch.submit().wait();
+
+	if( auto const res = vmaInvalidateAllocation( aAllocator.allocator, status.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+		throw lut::Error( "Invalidating geometry decompression status\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str() );
+
+	std::uint32_t errors = 0;
+	std::memcpy( &errors, lut::mapped_data( aAllocator, status ), sizeof(errors) );
+	if( 0 != errors )
+		throw lut::Error( "decompress_geometry(): %u of %zu compressed mesh arrays are malformed", errors, arrays.size() );
+
+	return srcBytes;
+}
@@ -0,0 +1,76 @@
+#ifndef GPU_DECOMPRESSION_HPP_0C3E9A52_6B4D_4F1E_9D27_8A51C2E7F3B6
+#define GPU_DECOMPRESSION_HPP_0C3E9A52_6B4D_4F1E_9D27_8A51C2E7F3B6
+
+// Decompression of compressed meshes on the GPU (--gpu-decompression), in
+// the spirit of DirectStorage. The vertex and index arrays of
+// "scsmbil-lzb"/"-lzq" files are LZ4 blocks (see baked_model.hpp); rather
+// than decompressing them into the staging memory on the CPU, the blocks
+// are uploaded as they are, and a compute shader
+// (cw2/shaders/lz4_decompress.comp) expands them straight into the vertex
+// and index buffers. That saves the CPU time, and the PCIe traffic of the
+// difference in size.
+//
+// LZ4 isn't a GPU-oriented format like GDeflate: a block's sequences must
+// be parsed in order, so each block is one workgroup, which copies the
+// bytes of each sequence in parallel. Meshes decompress in parallel.
+// Arrays that need converting (to the other vertex layout, to narrower
+// indices, or into meshlet order) are still decompressed on the CPU.
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+struct GeometryDecompressor
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+};
+
+GeometryDecompressor create_geometry_decompressor(
+	lut::VulkanWindow const&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// A LZ4 block that expands to dstBytes at dstOffset of its buffer. Both
+// must be multiples of 4, and below 4 GiB.
+struct CompressedArray
+{
+	void const* data;
+	std::size_t bytes;
+	VkDeviceSize dstOffset;
+	VkDeviceSize dstBytes;
+};
+
+constexpr VkDeviceSize kMaxGpuDecompressionBytes = VkDeviceSize(1) << 32;
+
+// Decompresses the arrays into aVertices and aIndices (device local, with
+// STORAGE_BUFFER and TRANSFER_DST usage, and not in use by the GPU), in one
+// submission on aCmdPool's queue, which is waited for; they are then ready
+// for vertex input and shader reads. Their ranges must not overlap, and
+// other uploads to the buffers must leave them alone. Throws
+// labutils::Error if any block is malformed. Returns the bytes uploaded.
+std::uint64_t decompress_geometry(
+	GeometryDecompressor const&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	VkBuffer aVertices,
+	std::vector<CompressedArray> const& aVertexArrays,
+	VkBuffer aIndices,
+	std::vector<CompressedArray> const& aIndexArrays
+);
+
+#endif // GPU_DECOMPRESSION_HPP_0C3E9A52_6B4D_4F1E_9D27_8A51C2E7F3B6
@@ -0,0 +1,325 @@
+#include "hiz.hpp"
+
+#include <algorithm>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	constexpr VkFormat kHizFormat = VK_FORMAT_R32_SFLOAT;
+	constexpr std::uint32_t kHizWorkgroupSize = 8; // local_size_x/y in hiz.comp
+
+	// Matches the push constant block in cw2/shaders/hiz.comp
+	struct HizPush_
+	{
+		std::uint32_t writeNext;
+	};
+
+	lut::ImageView create_view_( lut::VulkanWindow const&, VkImage, std::uint32_t aBaseLevel, std::uint32_t aLevelCount );
+
+	// Level 0 of the single-pass pyramid along a side of aDepth pixels:
+	// floor(size/2^L) stays at least ceil(aDepth/2^(L+1)) for all L
+	std::uint32_t padded_level0_( std::uint32_t aDepth )
+	{
+		std::uint32_t const half = std::max( 1u, (aDepth + 1) / 2 );
+		std::uint32_t const levels = lut::compute_mip_level_count( half, half );
+		std::uint32_t const top = 1u << levels;
+		return (aDepth + top - 1) / top * (top / 2);
+	}
+}
+
+HizPyramid create_hiz_pyramid( lut::VulkanWindow const& aWindow, lut::DescriptorAllocator& aDescriptors, lut::SamplerCache& aSamplers, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, bool aSubgroupReduction, VkPipelineCache aCache )
+{
+	HizPyramid ret;
+	ret.subgroupReduction = aSubgroupReduction;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[3]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[2].binding = 2;
+		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[2].descriptorCount = 1;
+		bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create Hi-Z descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline
+	{
+		VkPushConstantRange pushRange{};
+		pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushRange.size = sizeof(HizPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushRange;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create Hi-Z pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = ret.pipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create Hi-Z pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipe = lut::Pipeline( aWindow.device, pipe );
+	}
+
+	// Sampler. The shaders only use texelFetch(), but combined image
+	// samplers need one regardless.
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_NEAREST;
+		sampInfo.minFilter = VK_FILTER_NEAREST;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	// The sets are allocated up front and rewritten on resize (the
+	// allocator does not free individual sets).
+	for( auto& set : ret.descriptors )
+		set = aDescriptors.allocate( ret.layout.handle );
+
+	return ret;
+}
+
+bool enable_hiz_single_pass( HizPyramid& aPyramid, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkPipelineCache aCache )
+{
+	// Up to two dispatches (depth buffers over 4096 pixels), one counter each
+	lut::DownsampleShader const shader{ kHizFormat, aShaderPath };
+	lut::MipDownsampler downsampler( aWindow, aAllocator, aCmdPool, aShaderModules, lut::EDownsample::minimum, &shader, 1, 2, aCache );
+	if( !downsampler.supports( kHizFormat ) )
+		return false;
+
+	aPyramid.downsampler = std::move(downsampler);
+	aPyramid.singlePass = true;
+	return true;
+}
+
+void resize_hiz_pyramid( HizPyramid& aPyramid, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, VkImageView aDepthView )
+{
+	aPyramid.depthWidth = aWindow.swapchainExtent.width;
+	aPyramid.depthHeight = aWindow.swapchainExtent.height;
+
+	std::uint32_t const width = aPyramid.singlePass ? padded_level0_( aPyramid.depthWidth ) : std::max( 1u, aPyramid.depthWidth / 2 );
+	std::uint32_t const height = aPyramid.singlePass ? padded_level0_( aPyramid.depthHeight ) : std::max( 1u, aPyramid.depthHeight / 2 );
+	aPyramid.levels = std::min( kMaxHizLevels, lut::compute_mip_level_count( width, height ) );
+	aPyramid.valid = false;
+
+	// The downsampler's views are of the old image
+	if( aPyramid.singlePass )
+		aPyramid.downsampler.reset();
+
+	// Image
+	aPyramid.levelViews.clear();
+	aPyramid.view = lut::ImageView();
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = kHizFormat;
+		imgInfo.extent = VkExtent3D{ width, height, 1 };
+		imgInfo.mipLevels = aPyramid.levels;
+		imgInfo.arrayLayers = 1;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		aPyramid.image = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+		lut::set_name( aWindow, aPyramid.image, "hiz pyramid" );
+	}
+
+	aPyramid.view = create_view_( aWindow, aPyramid.image.image, 0, aPyramid.levels );
+	for( std::uint32_t level = 0; level < aPyramid.levels; ++level )
+		aPyramid.levelViews.emplace_back( create_view_( aWindow, aPyramid.image.image, level, 1 ) );
+
+	// Descriptors
+	for( std::uint32_t level = 0; level < aPyramid.levels; ++level )
+	{
+		VkDescriptorImageInfo srcInfo{};
+		srcInfo.sampler = aPyramid.sampler;
+		srcInfo.imageView = 0 == level ? aDepthView : aPyramid.levelViews[level-1].handle;
+		srcInfo.imageLayout = 0 == level ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo dstInfo{};
+		dstInfo.imageView = aPyramid.levelViews[level].handle;
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo nextInfo{};
+		nextInfo.imageView = aPyramid.levelViews[std::min( level+1, aPyramid.levels-1 )].handle;
+		nextInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet desc[3]{};
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = aPyramid.descriptors[level];
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[0].descriptorCount = 1;
+		desc[0].pImageInfo = &srcInfo;
+
+		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[1].dstSet = aPyramid.descriptors[level];
+		desc[1].dstBinding = 1;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[1].descriptorCount = 1;
+		desc[1].pImageInfo = &dstInfo;
+
+		desc[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[2].dstSet = aPyramid.descriptors[level];
+		desc[2].dstBinding = 2;
+		desc[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[2].descriptorCount = 1;
+		desc[2].pImageInfo = &nextInfo;
+
+		vkUpdateDescriptorSets( aWindow.device, 3, desc, 0, nullptr );
+	}
+
+	if( aPyramid.singlePass )
+	{
+		aPyramid.downsampleTarget = aPyramid.downsampler.add(
+			aPyramid.image.image, kHizFormat, VkExtent2D{ width, height }, 0, aPyramid.levels,
+			aDepthView, aWindow.swapchainExtent, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+		);
+	}
+
+	// Move the whole image to GENERAL once; it stays there.
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	lut::image_barrier( cmd, aPyramid.image.image,
+		0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, aPyramid.levels, 0, 1 } );
+
+	batch.submit().wait();
+}
+
+void record_hiz_build( VkCommandBuffer aCmdBuff, HizPyramid& aPyramid, VkExtent2D const& aDrawnExtent )
+{
+	VkImageSubresourceRange const all{ VK_IMAGE_ASPECT_COLOR_BIT, 0, aPyramid.levels, 0, 1 };
+
+	// This frame's culling pass read the pyramid before it is overwritten
+	lut::image_barrier( aCmdBuff, aPyramid.image.image,
+		VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		all );
+
+	if( aPyramid.singlePass )
+	{
+		aPyramid.downsampler.record( aCmdBuff, 1, &aPyramid.downsampleTarget );
+
+		// The next frame's culling pass reads these
+		lut::image_barrier( aCmdBuff, aPyramid.image.image,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			all );
+
+		aPyramid.drawnExtent = aDrawnExtent;
+		aPyramid.valid = true;
+		return;
+	}
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPyramid.pipe.handle );
+
+	std::uint32_t width = std::max( 1u, aPyramid.depthWidth / 2 );
+	std::uint32_t height = std::max( 1u, aPyramid.depthHeight / 2 );
+	for( std::uint32_t level = 0; level < aPyramid.levels; )
+	{
+		// Even sizes reduce exactly into the next level (no odd row or
+		// column to fold in), so the same dispatch can write it
+		HizPush_ push{};
+		push.writeNext = aPyramid.subgroupReduction && level+1 < aPyramid.levels && 0 == width % 2 && 0 == height % 2;
+		std::uint32_t const written = push.writeNext ? 2 : 1;
+
+		vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aPyramid.pipeLayout.handle, 0, 1, &aPyramid.descriptors[level], 0, nullptr );
+		vkCmdPushConstants( aCmdBuff, aPyramid.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HizPush_), &push );
+		vkCmdDispatch( aCmdBuff, (width + kHizWorkgroupSize-1) / kHizWorkgroupSize, (height + kHizWorkgroupSize-1) / kHizWorkgroupSize, 1 );
+
+		// The next level (and the next frame's culling pass) reads these
+		lut::image_barrier( aCmdBuff, aPyramid.image.image,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, level, written, 0, 1 } );
+
+		for( std::uint32_t i = 0; i < written; ++i )
+		{
+			width = std::max( 1u, width / 2 );
+			height = std::max( 1u, height / 2 );
+		}
+		level += written;
+	}
+
+	aPyramid.drawnExtent = aDrawnExtent;
+	aPyramid.valid = true;
+}
+
+namespace
+{
+	lut::ImageView create_view_( lut::VulkanWindow const& aWindow, VkImage aImage, std::uint32_t aBaseLevel, std::uint32_t aLevelCount )
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = aImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = kHizFormat;
+		viewInfo.components = VkComponentMapping{};
+		viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, aBaseLevel, aLevelCount, 0, 1 };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create Hi-Z image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+		return lut::ImageView( aWindow.device, view );
+	}
+}
@@ -0,0 +1,121 @@
+#ifndef HIZ_HPP_E3A0C6F2_5B8D_4A17_9C2E_0D4F6B1A73C8
+#define HIZ_HPP_E3A0C6F2_5B8D_4A17_9C2E_0D4F6B1A73C8
+
+// Hierarchical-Z pyramid for occlusion culling. Level 0 is half the
+// resolution of the depth buffer, each further level halves again; every
+// texel holds the minimum (i.e., farthest, with reverse-Z) depth of the depth
+// buffer pixels it covers. The pyramid is built in a compute shader
+// (cw2/shaders/hiz.comp) from the frame's depth buffer, and used by the next
+// frame's culling pass. With subgroup quad operations, levels of even size
+// also reduce into the next level in the same dispatch, which halves the
+// dispatches (and the barriers between them) for most of the pyramid.
+//
+// Alternatively (enable_hiz_single_pass()), a lut::MipDownsampler writes
+// all levels in one dispatch. Its levels aren't folded; level 0 is padded
+// instead, so that each level is at least ceil(depth/2^(L+1)) texels and
+// its last texel covers the remainder (the padding repeats the edge).
+
+#include <vector>
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/mip_downsampler.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+constexpr std::uint32_t kMaxHizLevels = 16;
+
+struct HizPyramid
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	VkSampler sampler = VK_NULL_HANDLE; // nearest, clamp to edge; from the cache
+
+	lut::Image image;                    // R32_SFLOAT, always in VK_IMAGE_LAYOUT_GENERAL
+	lut::ImageView view;                 // all levels
+	std::vector<lut::ImageView> levelViews;
+
+	// One set per level: binding 0 = source (the depth buffer for level 0,
+	// the previous level otherwise), binding 1 = destination level, binding
+	// 2 = the level after it (the destination itself for the last level).
+	VkDescriptorSet descriptors[kMaxHizLevels]{};
+
+	bool subgroupReduction = false; // two levels per dispatch where possible
+
+	// All levels in a single dispatch of the downsampler (see
+	// enable_hiz_single_pass()); its target is set up by resize_hiz_pyramid()
+	bool singlePass = false;
+	lut::MipDownsampler downsampler;
+	std::uint32_t downsampleTarget = 0;
+
+	std::uint32_t depthWidth = 0, depthHeight = 0; // size of the source depth buffer
+
+	// The part of the depth buffer (from the top left) that was drawn into
+	// by the frame the pyramid was last built from; smaller than the depth
+	// buffer with dynamic resolution (see dynamic_resolution.hpp). The rest
+	// holds stale depth, which can only make the culling more conservative
+	// (the pyramid keeps the maximum).
+	VkExtent2D drawnExtent{};
+	std::uint32_t levels = 0;
+
+	// False until the pyramid has been built once after (re-)creation.
+	bool valid = false;
+};
+
+// aShaderPath is cw2/shaders/hiz.comp's SPIR-V. With aSubgroupReduction, it
+// is hiz_subgroup.comp.spv instead, which needs subgroup quad operations in
+// compute shaders (lut::DeviceCapabilities), and levels of even size also
+// write the next level.
+HizPyramid create_hiz_pyramid(
+	lut::VulkanWindow const&,
+	lut::DescriptorAllocator&,
+	lut::SamplerCache&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	bool aSubgroupReduction,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// Switches the pyramid to single-pass builds with a minimum-reducing
+// lut::MipDownsampler of aShaderPath (cw2/shaders/downsample_r32f.comp),
+// before resize_hiz_pyramid(). Returns false, leaving the pyramid as it
+// is, if the device can't run it.
+bool enable_hiz_single_pass(
+	HizPyramid&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// (Re-)creates the pyramid image for the current swapchain size. The depth
+// image must have been created with VK_IMAGE_USAGE_SAMPLED_BIT. The pyramid
+// must not be in use by the GPU. Uses aCmdPool for a one-off layout
+// transition, and waits for it to complete.
+void resize_hiz_pyramid(
+	HizPyramid&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	VkImageView aDepthView
+);
+
+// Records the pyramid build. The depth buffer must be in
+// VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, with its writes made
+// visible to the compute stage (see create_render_pass()). Marks the pyramid
+// valid, built from the aDrawnExtent part of the depth buffer.
+void record_hiz_build( VkCommandBuffer, HizPyramid&, VkExtent2D const& aDrawnExtent );
+
+#endif // HIZ_HPP_E3A0C6F2_5B8D_4A17_9C2E_0D4F6B1A73C8
@@ -0,0 +1,626 @@
+#include "hud.hpp"
+
+#include <algorithm>
+
+#include <cstdio>
+#include <cassert>
+#include <cstdarg>
+#include <cstddef>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	// Atlas cells of 6x8 texels: a 5x7 glyph, and a column and a row of
+	// spacing. Must match kCell in hud.vert and hud.frag.
+	constexpr std::uint32_t kHudCellWidth = 6;
+	constexpr std::uint32_t kHudCellHeight = 8;
+	constexpr std::uint32_t kHudCellsPerRow = 16;
+
+	constexpr std::uint32_t kHudFirstChar = 32; // ' '
+	constexpr std::uint32_t kHudCharCount = 64; // up to '_'
+	constexpr std::uint32_t kHudBlockGlyph = kHudCharCount; // fully covered, for the panel
+
+	constexpr float kHudScale = 2.f; // screen pixels per font pixel
+	constexpr float kHudMargin = 8.f; // pixels, around the panel and the text
+	constexpr std::uint32_t kHudPanelColour = 0xa0000000u; // translucent black
+
+	// Rows of each glyph, top to bottom; bit 4 is the leftmost column
+	constexpr std::uint8_t kHudFont[kHudCharCount][7] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // '!'
+		{ 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+		{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a }, // '#'
+		{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 }, // '$'
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // '%'
+		{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d }, // '&'
+		{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '\''
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // '('
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // ')'
+		{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 }, // '*'
+		{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // '+'
+		{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ','
+		{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // '-'
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // '.'
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // '/'
+		{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // '0'
+		{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // '1'
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // '2'
+		{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // '3'
+		{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // '4'
+		{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // '5'
+		{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // '6'
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // '7'
+		{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // '8'
+		{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // '9'
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // ':'
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 }, // ';'
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // '<'
+		{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // '='
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // '>'
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // '?'
+		{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e }, // '@'
+		{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // 'A'
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // 'B'
+		{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // 'C'
+		{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // 'D'
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // 'E'
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // 'F'
+		{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // 'G'
+		{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // 'H'
+		{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 'I'
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // 'J'
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // 'K'
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // 'L'
+		{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // 'M'
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // 'N'
+		{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // 'O'
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // 'P'
+		{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // 'Q'
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // 'R'
+		{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // 'S'
+		{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // 'T'
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // 'U'
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // 'V'
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // 'W'
+		{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // 'X'
+		{ 0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04 }, // 'Y'
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // 'Z'
+		{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e }, // '['
+		{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // '\\'
+		{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e }, // ']'
+		{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 }, // '^'
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // '_'
+	};
+
+	struct HudPushConstants
+	{
+		glm::vec2 invExtent;
+	};
+
+	lut::ImageData make_font_atlas_();
+}
+
+void add_hud_line( HudText& aText, std::uint32_t aColour, char const* aFormat, ... )
+{
+	if( aText.count >= kHudMaxLines )
+		return;
+
+	va_list args;
+	va_start( args, aFormat );
+	int const len = std::vsnprintf( aText.lines[aText.count], kHudLineLength, aFormat, args );
+	va_end( args );
+
+	if( len < 0 )
+		aText.lines[aText.count][0] = '\0';
+
+	aText.colours[aText.count] = aColour;
+	++aText.count;
+}
+
+Hud create_hud( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, lut::DescriptorAllocator& aDescriptors, VkSampler aSampler, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader, std::size_t aFramesInFlight )
+{
+	Hud ret;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[1]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create HUD descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline layout
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		range.offset = 0;
+		range.size = sizeof(HudPushConstants);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create HUD pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	ret.dynamicRendering = aWindow.caps.dynamicRendering && aWindow.caps.synchronization2;
+	if( !ret.dynamicRendering )
+		ret.renderPass = create_hud_render_pass( aWindow );
+
+	ret.pipe = create_hud_pipeline( aWindow, ret.renderPass.handle, ret.pipeLayout.handle, aCache, aShaderModules, aVertShader, aFragShader );
+	create_hud_framebuffers( aWindow, ret );
+
+	// Font atlas
+	{
+		lut::ImageData const atlas = make_font_atlas_();
+
+		ret.atlas = lut::create_image_texture2d( aAllocator, atlas.width, atlas.height, VK_FORMAT_R8_UNORM );
+
+		lut::UploadBatch batch( aWindow, aCmdPool, aAllocator, VkDeviceSize(atlas.pixels.size()) );
+		batch.upload_image( ret.atlas.image, atlas );
+		batch.submit().wait();
+
+		ret.atlasView = lut::create_image_view_texture2d( aWindow, ret.atlas.image, VK_FORMAT_R8_UNORM );
+	}
+
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = aSampler;
+		imageInfo.imageView = ret.atlasView.handle;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkWriteDescriptorSet desc[1]{};
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = ret.descriptors;
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[0].descriptorCount = 1;
+		desc[0].pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets( aWindow.device, sizeof(desc) / sizeof(desc[0]), desc, 0, nullptr );
+	}
+
+	// Glyph buffers; written by the host every frame
+	for( std::size_t i = 0; i < aFramesInFlight; ++i )
+	{
+		ret.glyphs.emplace_back( lut::create_buffer( aAllocator, sizeof(HudGlyph) * kHudMaxGlyphs,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, lut::EMemoryClass::upload, VMA_ALLOCATION_CREATE_MAPPED_BIT ) );
+		ret.mapped.emplace_back( reinterpret_cast<HudGlyph*>( lut::mapped_data( aAllocator, ret.glyphs.back() ) ) );
+	}
+	ret.glyphCounts.assign( aFramesInFlight, 0 );
+
+	return ret;
+}
+
+lut::RenderPass create_hud_render_pass( lut::VulkanWindow const& aWindow )
+{
+	// The image is presented afterwards; its contents are kept
+	VkAttachmentDescription attachments[1]{};
+	attachments[0].format = aWindow.swapchainFormat;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference colourRef{};
+	colourRef.attachment = 0;
+	colourRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colourRef;
+
+	// After the scene's render pass or the upscale's blit; the layout
+	// transition follows the dependency
+	VkSubpassDependency deps[1]{};
+	deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	deps[0].dstSubpass = 0;
+	deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	deps[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo passInfo{};
+	passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	passInfo.attachmentCount = 1;
+	passInfo.pAttachments = attachments;
+	passInfo.subpassCount = 1;
+	passInfo.pSubpasses = &subpass;
+	passInfo.dependencyCount = sizeof(deps) / sizeof(deps[0]);
+	passInfo.pDependencies = deps;
+
+	VkRenderPass rpass = VK_NULL_HANDLE;
+	if( auto const res = vkCreateRenderPass( aWindow.device, &passInfo, nullptr, &rpass ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create HUD render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str() );
+
+	return lut::RenderPass( aWindow.device, rpass );
+}
+
+lut::Pipeline create_hud_pipeline( lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader )
+{
+	VkShaderModule const vert = aShaderModules.get( aVertShader );
+	VkShaderModule const frag = aShaderModules.get( aFragShader );
+
+	VkPipelineShaderStageCreateInfo stages[2]{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vert;
+	stages[0].pName = "main";
+
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = frag;
+	stages[1].pName = "main";
+
+	// One HudGlyph per instance; the quad's corners come from gl_VertexIndex
+	VkVertexInputBindingDescription binding{};
+	binding.binding = 0;
+	binding.stride = sizeof(HudGlyph);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	VkVertexInputAttributeDescription attributes[4]{};
+	attributes[0].location = 0;
+	attributes[0].binding = 0;
+	attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[0].offset = offsetof(HudGlyph, position);
+	attributes[1].location = 1;
+	attributes[1].binding = 0;
+	attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[1].offset = offsetof(HudGlyph, size);
+	attributes[2].location = 2;
+	attributes[2].binding = 0;
+	attributes[2].format = VK_FORMAT_R32_UINT;
+	attributes[2].offset = offsetof(HudGlyph, glyph);
+	attributes[3].location = 3;
+	attributes[3].binding = 0;
+	attributes[3].format = VK_FORMAT_R8G8B8A8_UNORM;
+	attributes[3].offset = offsetof(HudGlyph, colour);
+
+	VkPipelineVertexInputStateCreateInfo inputInfo{};
+	inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	inputInfo.vertexBindingDescriptionCount = 1;
+	inputInfo.pVertexBindingDescriptions = &binding;
+	inputInfo.vertexAttributeDescriptionCount = sizeof(attributes) / sizeof(attributes[0]);
+	inputInfo.pVertexAttributeDescriptions = attributes;
+
+	VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+	assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+	VkPipelineViewportStateCreateInfo viewportInfo{};
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.scissorCount = 1;
+
+	VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo{};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+	dynamicInfo.pDynamicStates = dynamicStates;
+
+	VkPipelineRasterizationStateCreateInfo rasterInfo{};
+	rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterInfo.lineWidth = 1.f;
+
+	VkPipelineMultisampleStateCreateInfo samplingInfo{};
+	samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	samplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Text and panel are blended over the image
+	VkPipelineColorBlendAttachmentState blendStates[1]{};
+	blendStates[0].blendEnable = VK_TRUE;
+	blendStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	blendStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendStates[0].colorBlendOp = VK_BLEND_OP_ADD;
+	blendStates[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	blendStates[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	blendStates[0].alphaBlendOp = VK_BLEND_OP_ADD;
+	blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo blendInfo{};
+	blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blendInfo.attachmentCount = 1;
+	blendInfo.pAttachments = blendStates;
+
+	// Dynamic rendering: the attachment formats replace the render pass
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &aWindow.swapchainFormat;
+
+	VkGraphicsPipelineCreateInfo pipeInfo{};
+	pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeInfo.pNext = VK_NULL_HANDLE == aRenderPass ? &renderingInfo : nullptr;
+	pipeInfo.stageCount = 2;
+	pipeInfo.pStages = stages;
+	pipeInfo.pVertexInputState = &inputInfo;
+	pipeInfo.pInputAssemblyState = &assemblyInfo;
+	pipeInfo.pViewportState = &viewportInfo;
+	pipeInfo.pRasterizationState = &rasterInfo;
+	pipeInfo.pMultisampleState = &samplingInfo;
+	pipeInfo.pDepthStencilState = nullptr;
+	pipeInfo.pColorBlendState = &blendInfo;
+	pipeInfo.pDynamicState = &dynamicInfo;
+	pipeInfo.layout = aPipelineLayout;
+	pipeInfo.renderPass = aRenderPass;
+	pipeInfo.subpass = 0;
+
+	VkPipeline pipe = VK_NULL_HANDLE;
+	if( auto const res = vkCreateGraphicsPipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create HUD pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str() );
+
+	return lut::Pipeline( aWindow.device, pipe );
+}
+
+void create_hud_framebuffers( lut::VulkanWindow const& aWindow, Hud& aHud )
+{
+	aHud.framebuffers.clear();
+
+	if( aHud.dynamicRendering )
+	{
+		aHud.images = aWindow.swapImages;
+		aHud.views = aWindow.swapViews;
+		return;
+	}
+
+	for( auto const view : aWindow.swapViews )
+	{
+		VkFramebufferCreateInfo fbInfo{};
+		fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		fbInfo.renderPass = aHud.renderPass.handle;
+		fbInfo.attachmentCount = 1;
+		fbInfo.pAttachments = &view;
+		fbInfo.width = aWindow.swapchainExtent.width;
+		fbInfo.height = aWindow.swapchainExtent.height;
+		fbInfo.layers = 1;
+
+		VkFramebuffer fb = VK_NULL_HANDLE;
+		if( auto const res = vkCreateFramebuffer( aWindow.device, &fbInfo, nullptr, &fb ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create HUD framebuffer\n" "vkCreateFramebuffer() returned %s", lut::to_string(res).c_str() );
+
+		aHud.framebuffers.emplace_back( aWindow.device, fb );
+	}
+}
+
+void update_hud( Hud& aHud, lut::Allocator const& aAllocator, std::uint32_t aFrame, HudText const& aText, VkExtent2D const& aExtent )
+{
+	assert( aFrame < aHud.mapped.size() );
+	HudGlyph* const out = aHud.mapped[aFrame];
+
+	float const advance = kHudCellWidth * kHudScale;
+	float const lineHeight = kHudCellHeight * kHudScale;
+
+	// Glyph 0 is the panel; it is sized once the text is laid out
+	std::uint32_t count = 1;
+	std::uint32_t lines = 0;
+	std::size_t columns = 0;
+	for( std::uint32_t line = 0; line < aText.count; ++line, ++lines )
+	{
+		float const y = kHudMargin * 2.f + float(line) * lineHeight;
+		if( y + lineHeight > float(aExtent.height) )
+			break;
+
+		std::size_t col = 0;
+		for( char const* ch = aText.lines[line]; *ch; ++ch, ++col )
+		{
+			std::uint32_t c = std::uint8_t(*ch);
+			if( c >= 'a' && c <= 'z' )
+				c -= 'a' - 'A';
+			if( ' ' == c || c < kHudFirstChar || c >= kHudFirstChar + kHudCharCount )
+				continue;
+			if( count >= kHudMaxGlyphs )
+				break;
+
+			HudGlyph& glyph = out[count++];
+			glyph.position = glm::vec2( kHudMargin * 2.f + float(col) * advance, y );
+			glyph.size = glm::vec2( advance, lineHeight );
+			glyph.glyph = c - kHudFirstChar;
+			glyph.colour = aText.colours[line];
+		}
+
+		columns = std::max( columns, col );
+	}
+
+	out[0].position = glm::vec2( kHudMargin, kHudMargin );
+	out[0].size = glm::vec2( float(columns) * advance + kHudMargin * 2.f, float(lines) * lineHeight + kHudMargin * 2.f );
+	out[0].glyph = kHudBlockGlyph;
+	out[0].colour = kHudPanelColour;
+
+	aHud.glyphCounts[aFrame] = 0 == lines ? 0 : count;
+
+	vmaFlushAllocation( aAllocator.allocator, aHud.glyphs[aFrame].allocation, 0, sizeof(HudGlyph) * count );
+}
+
+void record_hud( VkCommandBuffer aCmdBuff, Hud const& aHud, std::uint32_t aFrame, std::uint32_t aImageIndex, VkExtent2D const& aExtent )
+{
+	std::uint32_t const count = aHud.glyphCounts[aFrame];
+	if( 0 == count )
+		return;
+
+	begin_hud_pass( aCmdBuff, aHud, aImageIndex, aExtent );
+
+	VkViewport viewport{};
+	viewport.width = float(aExtent.width);
+	viewport.height = float(aExtent.height);
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport( aCmdBuff, 0, 1, &viewport );
+
+	VkRect2D const scissor{ VkOffset2D{ 0, 0 }, aExtent };
+	vkCmdSetScissor( aCmdBuff, 0, 1, &scissor );
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aHud.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aHud.pipeLayout.handle, 0, 1, &aHud.descriptors, 0, nullptr );
+
+	HudPushConstants push{};
+	push.invExtent = glm::vec2( 1.f / float(aExtent.width), 1.f / float(aExtent.height) );
+	vkCmdPushConstants( aCmdBuff, aHud.pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push );
+
+	VkDeviceSize const offset = 0;
+	vkCmdBindVertexBuffers( aCmdBuff, 0, 1, &aHud.glyphs[aFrame].buffer, &offset );
+
+	vkCmdDraw( aCmdBuff, 4, count, 0, 0 );
+
+	end_hud_pass( aCmdBuff, aHud, aImageIndex );
+}
+
+void begin_hud_pass( VkCommandBuffer aCmdBuff, Hud const& aHud, std::uint32_t aImageIndex, VkExtent2D const& aExtent )
+{
+	assert( aImageIndex < (aHud.dynamicRendering ? aHud.views.size() : aHud.framebuffers.size()) );
+
+	if( aHud.dynamicRendering )
+	{
+		// As the render pass's dependency and layout transitions: after
+		// the scene's render pass or the upscale's blit
+		VkImageMemoryBarrier2 barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = aHud.images[aImageIndex];
+		barrier.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		VkDependencyInfo depInfo{};
+		depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		depInfo.imageMemoryBarrierCount = 1;
+		depInfo.pImageMemoryBarriers = &barrier;
+		vkCmdPipelineBarrier2( aCmdBuff, &depInfo );
+
+		VkRenderingAttachmentInfo colour{};
+		colour.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		colour.imageView = aHud.views[aImageIndex];
+		colour.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colour.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		colour.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+		VkRenderingInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		renderingInfo.renderArea = VkRect2D{ VkOffset2D{ 0, 0 }, aExtent };
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colour;
+
+		vkCmdBeginRendering( aCmdBuff, &renderingInfo );
+	}
+	else
+	{
+		VkRenderPassBeginInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		passInfo.renderPass = aHud.renderPass.handle;
+		passInfo.framebuffer = aHud.framebuffers[aImageIndex].handle;
+		passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
+		passInfo.renderArea.extent = aExtent;
+
+		vkCmdBeginRenderPass( aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE );
+	}
+}
+
+void end_hud_pass( VkCommandBuffer aCmdBuff, Hud const& aHud, std::uint32_t aImageIndex )
+{
+	if( !aHud.dynamicRendering )
+	{
+		vkCmdEndRenderPass( aCmdBuff );
+		return;
+	}
+
+	vkCmdEndRendering( aCmdBuff );
+
+	// Back for presentation; the semaphore wait of the present orders it
+	VkImageMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = aHud.images[aImageIndex];
+	barrier.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkDependencyInfo depInfo{};
+	depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	depInfo.imageMemoryBarrierCount = 1;
+	depInfo.pImageMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2( aCmdBuff, &depInfo );
+}
+
+namespace
+{
+	lut::ImageData make_font_atlas_()
+	{
+		std::uint32_t const cells = kHudCharCount + 1; // and the block
+		std::uint32_t const rows = (cells + kHudCellsPerRow - 1) / kHudCellsPerRow;
+
+		lut::ImageData ret;
+		ret.width = kHudCellsPerRow * kHudCellWidth;
+		ret.height = rows * kHudCellHeight;
+		ret.channels = 1;
+		ret.pixels.assign( std::size_t(ret.width) * ret.height, 0 );
+
+		auto const cell_texel = [&] (std::uint32_t aCell, std::uint32_t aX, std::uint32_t aY) -> std::uint8_t&
+		{
+			std::uint32_t const x = (aCell % kHudCellsPerRow) * kHudCellWidth + aX;
+			std::uint32_t const y = (aCell / kHudCellsPerRow) * kHudCellHeight + aY;
+			return ret.pixels[std::size_t(y) * ret.width + x];
+		};
+
+		for( std::uint32_t c = 0; c < kHudCharCount; ++c )
+		{
+			for( std::uint32_t y = 0; y < 7; ++y )
+			{
+				for( std::uint32_t x = 0; x < 5; ++x )
+				{
+					if( kHudFont[c][y] & (0x10u >> x) )
+						cell_texel( c, x, y ) = 255;
+				}
+			}
+		}
+
+		for( std::uint32_t y = 0; y < kHudCellHeight; ++y )
+		{
+			for( std::uint32_t x = 0; x < kHudCellWidth; ++x )
+				cell_texel( kHudBlockGlyph, x, y ) = 255;
+		}
+
+		return ret;
+	}
+}
@@ -0,0 +1,146 @@
+#ifndef HUD_HPP_7A15D7FF_B35A_486F_8774_F38C264129D5
+#define HUD_HPP_7A15D7FF_B35A_486F_8774_F38C264129D5
+
+// On-screen performance HUD (toggled with H). A few lines of text on a
+// translucent panel are drawn over the presented image, after the scene
+// (and the upscale), in a render pass of their own that loads the
+// swapchain image. With dynamic rendering (VK_KHR_dynamic_rendering and
+// synchronization2, core in Vulkan 1.3), there is no render pass or
+// framebuffer: vkCmdBeginRendering() draws into the swapchain image's view,
+// between two VkImageMemoryBarrier2s, so resizing the swapchain only needs
+// the new views. Everything is a single instanced draw: one quad per
+// HudGlyph, textured from a 5x7 bitmap font atlas that is built at start-up
+// (ASCII 32-95; lower case is shown as upper case). The glyphs are written
+// by the host into a persistently mapped buffer per frame in flight, so the
+// HUD needs no transfers, and is cheap enough to be always available.
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec2.hpp>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+constexpr std::uint32_t kHudMaxGlyphs = 4096; // per frame, panel included
+constexpr std::uint32_t kHudMaxLines = 32;
+constexpr std::uint32_t kHudLineLength = 96; // characters, terminator included
+
+// RGBA8 colours of the text
+constexpr std::uint32_t kHudWhite = 0xffffffffu;
+constexpr std::uint32_t kHudGrey = 0xffb0b0b0u;
+constexpr std::uint32_t kHudYellow = 0xff40e0ffu;
+
+// Per-instance vertex data, see hud.vert
+struct HudGlyph
+{
+	glm::vec2 position; // pixels, top-left corner
+	glm::vec2 size; // pixels
+	std::uint32_t glyph; // atlas cell
+	std::uint32_t colour; // RGBA8, R in the low byte
+};
+
+// Lines of one frame's HUD, top to bottom
+struct HudText
+{
+	char lines[kHudMaxLines][kHudLineLength];
+	std::uint32_t colours[kHudMaxLines];
+	std::uint32_t count = 0;
+};
+
+// Appends a printf()-formatted line (truncated to kHudLineLength); lines
+// beyond kHudMaxLines are dropped.
+void add_hud_line( HudText&, std::uint32_t aColour, char const* aFormat, ... );
+
+struct Hud
+{
+	// Picked by create_hud(), if the device supports it; then renderPass
+	// and framebuffers are empty, and images and views are used instead.
+	bool dynamicRendering = false;
+
+	lut::RenderPass renderPass; // swapchain format; PRESENT_SRC_KHR in and out
+	std::vector<lut::Framebuffer> framebuffers; // per swapchain image
+
+	// Dynamic rendering: the swapchain's, per swapchain image
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+
+	// Set 0: the atlas (binding 0)
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	lut::Image atlas;
+	lut::ImageView atlasView;
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+
+	// Per frame in flight, persistently mapped HudGlyph[kHudMaxGlyphs]
+	std::vector<lut::Buffer> glyphs;
+	std::vector<HudGlyph*> mapped;
+	std::vector<std::uint32_t> glyphCounts;
+};
+
+// Needs a window with a swapchain. Uses dynamic rendering if the window's
+// caps have dynamicRendering and synchronization2. The atlas is uploaded (and
+// waited for) through aCmdPool; aSampler is only there for the combined image
+// sampler, the atlas is read with texelFetch().
+Hud create_hud(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	lut::DescriptorAllocator&,
+	VkSampler aSampler,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	char const* aFragShader,
+	std::size_t aFramesInFlight
+);
+
+// For the swapchain's (current) format: loads attachment 0, which a render
+// pass or a blit left in PRESENT_SRC_KHR, and leaves it there
+lut::RenderPass create_hud_render_pass( lut::VulkanWindow const& );
+
+// With a null VkRenderPass, for dynamic rendering into the swapchain's
+// (current) format
+lut::Pipeline create_hud_pipeline(
+	lut::VulkanWindow const&,
+	VkRenderPass,
+	VkPipelineLayout,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	char const* aFragShader
+);
+
+// One framebuffer per swapchain image, e.g., after re-creating the
+// swapchain. The previous ones must no longer be in use. With dynamic
+// rendering, this only takes over the swapchain's images and views.
+void create_hud_framebuffers( lut::VulkanWindow const&, Hud& );
+
+// Lays out aText for aFrame's slot (which the GPU must be done with) on a
+// panel in the top-left corner of an image of aExtent
+void update_hud( Hud&, lut::Allocator const&, std::uint32_t aFrame, HudText const&, VkExtent2D const& aExtent );
+
+// Draws aFrame's glyphs over swapchain image aImageIndex; records nothing
+// if there are none.
+void record_hud( VkCommandBuffer, Hud const&, std::uint32_t aFrame, std::uint32_t aImageIndex, VkExtent2D const& aExtent );
+
+// The HUD's pass over swapchain image aImageIndex, for other overlays drawn
+// with pipelines made for the HUD's render pass (or swapchain format); the
+// image is in PRESENT_SRC_KHR before and after.
+void begin_hud_pass( VkCommandBuffer, Hud const&, std::uint32_t aImageIndex, VkExtent2D const& aExtent );
+void end_hud_pass( VkCommandBuffer, Hud const&, std::uint32_t aImageIndex );
+
+#endif // HUD_HPP_7A15D7FF_B35A_486F_8774_F38C264129D5
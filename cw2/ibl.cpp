@@ -0,0 +1,665 @@
+#include "ibl.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+
+#include <stb_image.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	// Cache file layout:
+	//  - char[16] : magic (kIblMagic)
+	//  - uint32_t : kIblCacheVersion
+	//  - uint32_t : kIblSpecularSize, kIblSpecularLevels, kIblBrdfSize
+	//  - uint64_t : hash of the environment file (hash_())
+	//  - the payload (see payload_bytes_()): the IblUniform, the specular
+	//    levels from level 0, each with its six faces in order, and the
+	//    BRDF LUT; texels as in the images.
+	constexpr char kIblMagic[16] = "\0\0COMP5822Mibl";
+	constexpr char kIblExtension[] = ".cw2ibl";
+	constexpr std::size_t kIblHeaderBytes = 16 + 4 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+	constexpr std::uint32_t kMaxEnvironmentSize = 16384;
+	constexpr std::uint32_t kIblWorkgroupSize = 8; // local_size_x/y in ibl_specular.comp and ibl_brdf.comp
+	constexpr VkDeviceSize kIblTexelBytes = 8; // both formats are RGBA16F
+
+	// PIbl in the ibl_*.comp shaders
+	struct IblPush_
+	{
+		float roughness;
+		std::uint32_t lastLevel;
+	};
+
+	// Offsets into the payload
+	VkDeviceSize specular_level_offset_( std::uint32_t aLevel );
+	VkDeviceSize brdf_offset_();
+	VkDeviceSize payload_bytes_();
+
+	// FNV-1a
+	std::uint64_t hash_( std::vector<std::uint8_t> const& );
+
+	std::vector<std::uint8_t> read_file_( char const* aPath );
+
+	// Creates the uniform buffer and the images (and their views) of aIbl, of the
+	// given sizes; the images are in UNDEFINED layout
+	void create_resources_( Ibl& aIbl, lut::VulkanWindow const&, lut::Allocator const&, std::uint32_t aSpecularSize, std::uint32_t aSpecularLevels, std::uint32_t aBrdfSize );
+
+	// Records the images' (and the uniform buffer's) transition from
+	// transfer writes to their use by the fragment shaders
+	void record_ready_( VkCommandBuffer, Ibl const&, VkAccessFlags aSrcAccess, VkImageLayout aSrcLayout, VkPipelineStageFlags aSrcStage );
+
+	void upload_payload_( Ibl&, lut::VulkanWindow const&, lut::Allocator const&, VkCommandPool, std::vector<std::uint8_t> const& aPayload );
+
+	std::vector<std::uint8_t> generate_( Ibl&, lut::VulkanWindow const&, lut::Allocator const&, lut::SamplerCache&, VkCommandPool, std::vector<std::uint8_t> const& aEnvironment, char const* aPath, lut::ShaderModuleCache&, IblShaderPaths const&, VkPipelineCache );
+
+	// False if there is no usable cache file
+	bool load_cache_( std::filesystem::path const&, std::uint64_t aHash, std::vector<std::uint8_t>& aPayload );
+	void store_cache_( std::filesystem::path const&, std::uint64_t aHash, std::vector<std::uint8_t> const& aPayload );
+}
+
+Ibl create_ibl( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::SamplerCache& aSamplers, VkCommandPool aCmdPool, char const* aEnvironment, char const* aCacheDir, lut::ShaderModuleCache& aShaderModules, IblShaderPaths const& aShaders, VkPipelineCache aCache )
+{
+	LUT_CPU_ZONE( "create_ibl()" );
+
+	Ibl ret;
+
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_LINEAR;
+		sampInfo.minFilter = VK_FILTER_LINEAR;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	// Without an environment, 1x1 placeholders of zeros; params.x = 0
+	// selects the constant ambient term in ibl.glsl
+	if( !aEnvironment )
+	{
+		create_resources_( ret, aWindow, aAllocator, 1, 1, 1 );
+
+		lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+		VkCommandBuffer const cmd = batch.commands();
+
+		vkCmdFillBuffer( cmd, ret.uniform.buffer, 0, VK_WHOLE_SIZE, 0 );
+
+		VkImageSubresourceRange const cube{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 6 };
+		VkImageSubresourceRange const lut2d{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		lut::image_barrier( cmd, ret.specular.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, cube );
+		lut::image_barrier( cmd, ret.brdf.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, lut2d );
+
+		VkClearColorValue const black{};
+		vkCmdClearColorImage( cmd, ret.specular.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &cube );
+		vkCmdClearColorImage( cmd, ret.brdf.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &lut2d );
+
+		record_ready_( cmd, ret, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		batch.submit().wait();
+		return ret;
+	}
+
+	auto const environment = read_file_( aEnvironment );
+	std::uint64_t const hash = hash_( environment );
+
+	char name[32];
+	std::snprintf( name, sizeof(name), "%016" PRIx64 "%s", hash, kIblExtension );
+	std::filesystem::path const cachePath = std::filesystem::path( aCacheDir ) / name;
+
+	create_resources_( ret, aWindow, aAllocator, kIblSpecularSize, kIblSpecularLevels, kIblBrdfSize );
+
+	std::vector<std::uint8_t> payload;
+	if( load_cache_( cachePath, hash, payload ) )
+	{
+		upload_payload_( ret, aWindow, aAllocator, aCmdPool, payload );
+		ret.cached = true;
+	}
+	else
+	{
+		payload = generate_( ret, aWindow, aAllocator, aSamplers, aCmdPool, environment, aEnvironment, aShaderModules, aShaders, aCache );
+		store_cache_( cachePath, hash, payload );
+	}
+
+	ret.enabled = true;
+	return ret;
+}
+
+namespace
+{
+	VkDeviceSize specular_level_offset_( std::uint32_t aLevel )
+	{
+		VkDeviceSize offset = sizeof(IblUniform);
+		for( std::uint32_t level = 0; level < aLevel; ++level )
+		{
+			VkDeviceSize const size = std::max( kIblSpecularSize >> level, 1u );
+			offset += 6 * size * size * kIblTexelBytes;
+		}
+		return offset;
+	}
+	VkDeviceSize brdf_offset_()
+	{
+		return specular_level_offset_( kIblSpecularLevels );
+	}
+	VkDeviceSize payload_bytes_()
+	{
+		return brdf_offset_() + VkDeviceSize(kIblBrdfSize) * kIblBrdfSize * kIblTexelBytes;
+	}
+
+	std::uint64_t hash_( std::vector<std::uint8_t> const& aData )
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for( auto const byte : aData )
+		{
+			hash ^= byte;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	std::vector<std::uint8_t> read_file_( char const* aPath )
+	{
+		std::vector<std::uint8_t> ret;
+
+		FILE* fin = std::fopen( aPath, "rb" );
+		if( !fin )
+			throw lut::Error( "Unable to open environment map '%s' for reading", aPath );
+
+		std::uint8_t buffer[64*1024];
+		for( std::size_t got; (got = std::fread( buffer, 1, sizeof(buffer), fin )) > 0; )
+			ret.insert( ret.end(), buffer, buffer + got );
+
+		bool const failed = std::ferror( fin );
+		std::fclose( fin );
+
+		if( failed )
+			throw lut::Error( "Error reading environment map '%s'", aPath );
+
+		return ret;
+	}
+
+	void create_resources_( Ibl& aIbl, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, std::uint32_t aSpecularSize, std::uint32_t aSpecularLevels, std::uint32_t aBrdfSize )
+	{
+		// Written by ibl_sh.comp, or uploaded
+		aIbl.uniform = lut::create_buffer( aAllocator, sizeof(IblUniform),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			lut::EMemoryClass::device );
+		lut::set_name( aWindow, aIbl.uniform, "ibl uniform" );
+
+		VkImageUsageFlags const usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+		{
+			VkImageCreateInfo imgInfo{};
+			imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+			imgInfo.imageType = VK_IMAGE_TYPE_2D;
+			imgInfo.format = kIblSpecularFormat;
+			imgInfo.extent = VkExtent3D{ aSpecularSize, aSpecularSize, 1 };
+			imgInfo.mipLevels = aSpecularLevels;
+			imgInfo.arrayLayers = 6;
+			imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imgInfo.usage = usage;
+			imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			aIbl.specular = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::textures );
+			lut::set_name( aWindow, aIbl.specular, "ibl specular cube" );
+		}
+		{
+			VkImageCreateInfo imgInfo{};
+			imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imgInfo.imageType = VK_IMAGE_TYPE_2D;
+			imgInfo.format = kIblBrdfFormat;
+			imgInfo.extent = VkExtent3D{ aBrdfSize, aBrdfSize, 1 };
+			imgInfo.mipLevels = 1;
+			imgInfo.arrayLayers = 1;
+			imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imgInfo.usage = usage;
+			imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			aIbl.brdf = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::textures );
+			lut::set_name( aWindow, aIbl.brdf, "ibl brdf lut" );
+		}
+
+		auto const create_view_ = [&] (VkImage aImage, VkImageViewType aType, VkFormat aFormat, std::uint32_t aLevels, std::uint32_t aLayers) {
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = aImage;
+			viewInfo.viewType = aType;
+			viewInfo.format = aFormat;
+			viewInfo.components = VkComponentMapping{};
+			viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, aLevels, 0, aLayers };
+
+			VkImageView view = VK_NULL_HANDLE;
+			if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create image-based lighting image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+			return lut::ImageView( aWindow.device, view );
+		};
+
+		aIbl.specularView = create_view_( aIbl.specular.image, VK_IMAGE_VIEW_TYPE_CUBE, kIblSpecularFormat, aSpecularLevels, 6 );
+		aIbl.brdfView = create_view_( aIbl.brdf.image, VK_IMAGE_VIEW_TYPE_2D, kIblBrdfFormat, 1, 1 );
+	}
+
+	void record_ready_( VkCommandBuffer aCmdBuff, Ibl const& aIbl, VkAccessFlags aSrcAccess, VkImageLayout aSrcLayout, VkPipelineStageFlags aSrcStage )
+	{
+		lut::buffer_barrier( aCmdBuff, aIbl.uniform.buffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+
+		lut::image_barrier( aCmdBuff, aIbl.specular.image,
+			aSrcAccess, VK_ACCESS_SHADER_READ_BIT,
+			aSrcLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			aSrcStage, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 6 } );
+		lut::image_barrier( aCmdBuff, aIbl.brdf.image,
+			aSrcAccess, VK_ACCESS_SHADER_READ_BIT,
+			aSrcLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			aSrcStage, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+	}
+
+	void upload_payload_( Ibl& aIbl, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, std::vector<std::uint8_t> const& aPayload )
+	{
+		assert( aPayload.size() == payload_bytes_() );
+
+		lut::Buffer staging = lut::create_buffer( aAllocator, aPayload.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+		std::memcpy( lut::mapped_data( aAllocator, staging ), aPayload.data(), aPayload.size() );
+		vmaFlushAllocation( aAllocator.allocator, staging.allocation, 0, VK_WHOLE_SIZE );
+
+		lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+		VkCommandBuffer const cmd = batch.commands();
+
+		VkBufferCopy const uniformCopy{ 0, 0, sizeof(IblUniform) };
+		vkCmdCopyBuffer( cmd, staging.buffer, aIbl.uniform.buffer, 1, &uniformCopy );
+
+		lut::image_barrier( cmd, aIbl.specular.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, kIblSpecularLevels, 0, 6 } );
+		lut::image_barrier( cmd, aIbl.brdf.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		for( std::uint32_t level = 0; level < kIblSpecularLevels; ++level )
+		{
+			std::uint32_t const size = std::max( kIblSpecularSize >> level, 1u );
+
+			VkBufferImageCopy copy{};
+			copy.bufferOffset = specular_level_offset_( level );
+			copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 6 };
+			copy.imageExtent = VkExtent3D{ size, size, 1 };
+			vkCmdCopyBufferToImage( cmd, staging.buffer, aIbl.specular.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+		}
+
+		VkBufferImageCopy copy{};
+		copy.bufferOffset = brdf_offset_();
+		copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.imageExtent = VkExtent3D{ kIblBrdfSize, kIblBrdfSize, 1 };
+		vkCmdCopyBufferToImage( cmd, staging.buffer, aIbl.brdf.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+
+		record_ready_( cmd, aIbl, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		batch.submit().wait();
+	}
+
+	std::vector<std::uint8_t> generate_( Ibl& aIbl, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::SamplerCache& aSamplers, VkCommandPool aCmdPool, std::vector<std::uint8_t> const& aEnvironment, char const* aPath, lut::ShaderModuleCache& aShaderModules, IblShaderPaths const& aShaders, VkPipelineCache aCache )
+	{
+		LUT_CPU_ZONE( "generate IBL" );
+
+		// Decode to linear RGBA; stb_image converts LDR images from sRGB
+		int widthi = 0, heighti = 0, channelsi = 0;
+		float* texels = stbi_loadf_from_memory( aEnvironment.data(), int(aEnvironment.size()), &widthi, &heighti, &channelsi, 4 );
+		if( !texels )
+			throw lut::Error( "%s: unable to decode environment map: %s", aPath, stbi_failure_reason() );
+
+		std::uint32_t const width = std::uint32_t(widthi), height = std::uint32_t(heighti);
+		if( 0 == width || 0 == height || width > kMaxEnvironmentSize || height > kMaxEnvironmentSize )
+		{
+			stbi_image_free( texels );
+			throw lut::Error( "%s: invalid environment map size %ux%u", aPath, width, height );
+		}
+
+		// As RGBA16F, which can be both blitted (for the mips) and
+		// linearly filtered everywhere
+		VkDeviceSize const envBytes = VkDeviceSize(width) * height * kIblTexelBytes;
+		lut::Buffer staging = lut::create_buffer( aAllocator, envBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+		{
+			auto* const halves = reinterpret_cast<std::uint16_t*>( lut::mapped_data( aAllocator, staging ) );
+			for( std::size_t i = 0; i < std::size_t(width) * height * 4; ++i )
+				halves[i] = glm::packHalf1x16( std::min( texels[i], 65504.f ) );
+		}
+		stbi_image_free( texels );
+		vmaFlushAllocation( aAllocator.allocator, staging.allocation, 0, VK_WHOLE_SIZE );
+
+		lut::Image envImage = lut::create_image_texture2d( aAllocator, width, height, VK_FORMAT_R16G16B16A16_SFLOAT );
+		lut::ImageView envView = lut::create_image_view_texture2d( aWindow, envImage.image, VK_FORMAT_R16G16B16A16_SFLOAT );
+		std::uint32_t const envLevels = lut::compute_mip_level_count( width, height );
+
+		// Repeats around the vertical axis; clamps at the poles
+		VkSampler envSampler = VK_NULL_HANDLE;
+		{
+			VkSamplerCreateInfo sampInfo{};
+			sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			sampInfo.magFilter = VK_FILTER_LINEAR;
+			sampInfo.minFilter = VK_FILTER_LINEAR;
+			sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			sampInfo.minLod = 0.f;
+			sampInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+			envSampler = aSamplers.get( sampInfo );
+		}
+
+		// One set per specular level: binding 0 = environment, 1 = the
+		// uniform buffer (ibl_sh.comp), 2 = the level (ibl_specular.comp),
+		// 3 = the BRDF LUT (ibl_brdf.comp)
+		lut::DescriptorSetLayout setLayout;
+		{
+			VkDescriptorSetLayoutBinding bindings[4]{};
+			VkDescriptorType const types[4] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE };
+			for( std::uint32_t i = 0; i < 4; ++i )
+			{
+				bindings[i].binding = i;
+				bindings[i].descriptorType = types[i];
+				bindings[i].descriptorCount = 1;
+				bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			}
+
+			VkDescriptorSetLayoutCreateInfo layoutInfo{};
+			layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+			layoutInfo.pBindings = bindings;
+
+			VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+			if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create image-based lighting descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+			setLayout = lut::DescriptorSetLayout( aWindow.device, layout );
+		}
+
+		lut::PipelineLayout pipeLayout;
+		{
+			VkPushConstantRange range{};
+			range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			range.offset = 0;
+			range.size = sizeof(IblPush_);
+
+			VkPipelineLayoutCreateInfo layoutInfo{};
+			layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			layoutInfo.setLayoutCount = 1;
+			layoutInfo.pSetLayouts = &setLayout.handle;
+			layoutInfo.pushConstantRangeCount = 1;
+			layoutInfo.pPushConstantRanges = &range;
+
+			VkPipelineLayout layout = VK_NULL_HANDLE;
+			if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create image-based lighting pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+			pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+		}
+
+		auto const create_pipeline_ = [&] (char const* aShaderPath) {
+			VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+			VkComputePipelineCreateInfo pipeInfo{};
+			pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipeInfo.stage.module = comp;
+			pipeInfo.stage.pName = "main";
+			pipeInfo.layout = pipeLayout.handle;
+
+			VkPipeline pipe = VK_NULL_HANDLE;
+			if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create image-based lighting pipeline '%s'\n" "vkCreateComputePipelines() returned %s", aShaderPath, lut::to_string(res).c_str() );
+
+			return lut::Pipeline( aWindow.device, pipe );
+		};
+
+		lut::Pipeline const shPipe = create_pipeline_( aShaders.sh );
+		lut::Pipeline const specularPipe = create_pipeline_( aShaders.specular );
+		lut::Pipeline const brdfPipe = create_pipeline_( aShaders.brdf );
+
+		// Descriptors
+		lut::DescriptorPool pool = lut::create_descriptor_pool( aWindow, 4 * kIblSpecularLevels, kIblSpecularLevels );
+
+		std::vector<lut::ImageView> levelViews;
+		VkDescriptorSet sets[kIblSpecularLevels]{};
+		for( std::uint32_t level = 0; level < kIblSpecularLevels; ++level )
+		{
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = aIbl.specular.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewInfo.format = kIblSpecularFormat;
+			viewInfo.components = VkComponentMapping{};
+			viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 6 };
+
+			VkImageView view = VK_NULL_HANDLE;
+			if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+				throw lut::Error( "Unable to create image-based lighting level view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+			levelViews.emplace_back( aWindow.device, view );
+
+			sets[level] = lut::alloc_desc_set( aWindow, pool.handle, setLayout.handle );
+
+			VkDescriptorImageInfo envInfo{};
+			envInfo.sampler = envSampler;
+			envInfo.imageView = envView.handle;
+			envInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			VkDescriptorBufferInfo uniformInfo{};
+			uniformInfo.buffer = aIbl.uniform.buffer;
+			uniformInfo.range = VK_WHOLE_SIZE;
+
+			VkDescriptorImageInfo levelInfo{};
+			levelInfo.imageView = levelViews.back().handle;
+			levelInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkDescriptorImageInfo brdfInfo{};
+			brdfInfo.imageView = aIbl.brdfView.handle;
+			brdfInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkWriteDescriptorSet desc[4]{};
+			for( std::uint32_t i = 0; i < 4; ++i )
+			{
+				desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				desc[i].dstSet = sets[level];
+				desc[i].dstBinding = i;
+				desc[i].descriptorCount = 1;
+			}
+			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[0].pImageInfo = &envInfo;
+			desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			desc[1].pBufferInfo = &uniformInfo;
+			desc[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			desc[2].pImageInfo = &levelInfo;
+			desc[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			desc[3].pImageInfo = &brdfInfo;
+
+			vkUpdateDescriptorSets( aWindow.device, 4, desc, 0, nullptr );
+		}
+
+		VkDeviceSize const payloadBytes = payload_bytes_();
+		lut::Buffer readback = lut::create_buffer( aAllocator, payloadBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+
+		// Record everything into one submission
+		lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+		VkCommandBuffer const cmd = batch.commands();
+
+		// The environment and its mips; record_texture_mips() leaves them
+		// to the fragment shaders, the barrier chains on to the compute
+		// shaders
+		lut::record_texture_copy( cmd, staging.buffer, 0, envImage.image, width, height );
+		lut::record_texture_mips( cmd, envImage.image, width, height );
+		lut::image_barrier( cmd, envImage.image,
+			0, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, envLevels, 0, 1 } );
+
+		VkImageSubresourceRange const allSpecular{ VK_IMAGE_ASPECT_COLOR_BIT, 0, kIblSpecularLevels, 0, 6 };
+		lut::image_barrier( cmd, aIbl.specular.image, 0, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, allSpecular );
+		lut::image_barrier( cmd, aIbl.brdf.image, 0, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+		IblPush_ push{ 0.f, kIblSpecularLevels - 1 };
+
+		vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, shPipe.handle );
+		vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout.handle, 0, 1, &sets[0], 0, nullptr );
+		vkCmdPushConstants( cmd, pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+		vkCmdDispatch( cmd, 1, 1, 1 );
+
+		vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, specularPipe.handle );
+		for( std::uint32_t level = 0; level < kIblSpecularLevels; ++level )
+		{
+			std::uint32_t const size = std::max( kIblSpecularSize >> level, 1u );
+			std::uint32_t const groups = (size + kIblWorkgroupSize-1) / kIblWorkgroupSize;
+
+			push.roughness = float(level) / float(kIblSpecularLevels - 1);
+			vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout.handle, 0, 1, &sets[level], 0, nullptr );
+			vkCmdPushConstants( cmd, pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+			vkCmdDispatch( cmd, groups, groups, 6 );
+		}
+
+		vkCmdBindPipeline( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, brdfPipe.handle );
+		vkCmdBindDescriptorSets( cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeLayout.handle, 0, 1, &sets[0], 0, nullptr );
+		vkCmdDispatch( cmd, (kIblBrdfSize + kIblWorkgroupSize-1) / kIblWorkgroupSize, (kIblBrdfSize + kIblWorkgroupSize-1) / kIblWorkgroupSize, 1 );
+
+		// Read the results back for the cache
+		lut::buffer_barrier( cmd, aIbl.uniform.buffer,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+		lut::image_barrier( cmd, aIbl.specular.image, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, allSpecular );
+		lut::image_barrier( cmd, aIbl.brdf.image, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		VkBufferCopy const uniformCopy{ 0, 0, sizeof(IblUniform) };
+		vkCmdCopyBuffer( cmd, aIbl.uniform.buffer, readback.buffer, 1, &uniformCopy );
+
+		for( std::uint32_t level = 0; level < kIblSpecularLevels; ++level )
+		{
+			std::uint32_t const size = std::max( kIblSpecularSize >> level, 1u );
+
+			VkBufferImageCopy copy{};
+			copy.bufferOffset = specular_level_offset_( level );
+			copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 6 };
+			copy.imageExtent = VkExtent3D{ size, size, 1 };
+			vkCmdCopyImageToBuffer( cmd, aIbl.specular.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &copy );
+		}
+
+		VkBufferImageCopy copy{};
+		copy.bufferOffset = brdf_offset_();
+		copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.imageExtent = VkExtent3D{ kIblBrdfSize, kIblBrdfSize, 1 };
+		vkCmdCopyImageToBuffer( cmd, aIbl.brdf.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &copy );
+
+		lut::buffer_barrier( cmd, readback.buffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT );
+
+		// The uniform buffer was only read by the copy; its shader writes
+		// were made available by the barrier above
+		record_ready_( cmd, aIbl, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		batch.submit().wait();
+
+		if( auto const res = vmaInvalidateAllocation( aAllocator.allocator, readback.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+			throw lut::Error( "Invalidating image-based lighting readback\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str() );
+
+		auto const* const data = reinterpret_cast<std::uint8_t const*>( lut::mapped_data( aAllocator, readback ) );
+		return std::vector<std::uint8_t>( data, data + payloadBytes );
+	}
+
+	bool load_cache_( std::filesystem::path const& aPath, std::uint64_t aHash, std::vector<std::uint8_t>& aPayload )
+	{
+		FILE* fin = std::fopen( aPath.string().c_str(), "rb" );
+		if( !fin )
+			return false;
+
+		std::uint8_t header[kIblHeaderBytes];
+		bool ok = 1 == std::fread( header, sizeof(header), 1, fin );
+
+		std::uint32_t expected[4] = { kIblCacheVersion, kIblSpecularSize, kIblSpecularLevels, kIblBrdfSize };
+		ok = ok && 0 == std::memcmp( header, kIblMagic, 16 );
+		ok = ok && 0 == std::memcmp( header + 16, expected, sizeof(expected) );
+		ok = ok && 0 == std::memcmp( header + 16 + sizeof(expected), &aHash, sizeof(aHash) );
+
+		if( ok )
+		{
+			aPayload.resize( std::size_t(payload_bytes_()) );
+			ok = 1 == std::fread( aPayload.data(), aPayload.size(), 1, fin ) && EOF == std::fgetc( fin );
+		}
+
+		std::fclose( fin );
+
+		if( !ok )
+			std::fprintf( stderr, "Info: ignoring stale or damaged IBL cache '%s'\n", aPath.string().c_str() );
+
+		return ok;
+	}
+
+	void store_cache_( std::filesystem::path const& aPath, std::uint64_t aHash, std::vector<std::uint8_t> const& aPayload )
+	{
+		std::error_code ec;
+		std::filesystem::create_directories( aPath.parent_path(), ec );
+
+		std::uint8_t header[kIblHeaderBytes];
+		std::uint32_t const sizes[4] = { kIblCacheVersion, kIblSpecularSize, kIblSpecularLevels, kIblBrdfSize };
+		std::memcpy( header, kIblMagic, 16 );
+		std::memcpy( header + 16, sizes, sizeof(sizes) );
+		std::memcpy( header + 16 + sizeof(sizes), &aHash, sizeof(aHash) );
+
+		bool ok = false;
+		if( FILE* fof = std::fopen( aPath.string().c_str(), "wb" ) )
+		{
+			ok = 1 == std::fwrite( header, sizeof(header), 1, fof )
+				&& 1 == std::fwrite( aPayload.data(), aPayload.size(), 1, fof );
+			ok = 0 == std::fclose( fof ) && ok;
+
+			if( !ok )
+				std::filesystem::remove( aPath, ec );
+		}
+
+		if( ok )
+			std::fprintf( stderr, "Info: cached image-based lighting in '%s'\n", aPath.string().c_str() );
+		else
+			std::fprintf( stderr, "Info: unable to write IBL cache '%s'\n", aPath.string().c_str() );
+	}
+}
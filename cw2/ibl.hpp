@@ -0,0 +1,96 @@
+#ifndef IBL_HPP_9B2F6D41_C7E3_4A85_B1D0_3E8A5C27F914
+#define IBL_HPP_9B2F6D41_C7E3_4A85_B1D0_3E8A5C27F914
+
+// Image-based ambient lighting from an environment map (--environment):
+//  - the diffuse irradiance as 9 spherical harmonics coefficients (L2),
+//    premultiplied by the cosine lobe so that evaluating them gives the
+//    irradiance over pi;
+//  - a specular cube, prefiltered with the GGX lobe, one roughness per mip
+//    level (roughness = level / (kIblSpecularLevels-1));
+//  - the split-sum BRDF LUT (scale and bias of F0 by N.V and roughness).
+// All three are computed on the GPU (cw2/shaders/ibl_*.comp) from an
+// equirectangular image, and sampled by cw2/shaders/ibl.glsl.
+//
+// Prefiltering takes a while, so the results are cached on disk, in one
+// file per environment, named by the hash of the environment file's
+// contents. Later runs with the same environment load the file instead
+// (a plain upload, like baked textures); a missing, stale or unreadable
+// cache file is regenerated and rewritten.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec4.hpp>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// Part of the cache files' header. Bump whenever the generated data or the
+// file layout changes, so that older files are regenerated.
+constexpr std::uint32_t kIblCacheVersion = 1;
+
+constexpr VkFormat kIblSpecularFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// Only RG is used; two-channel storage images would need
+// shaderStorageImageExtendedFormats
+constexpr VkFormat kIblBrdfFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+constexpr std::uint32_t kIblSpecularSize = 128; // texels per side of level 0
+constexpr std::uint32_t kIblSpecularLevels = 6; // 128 ... 4
+constexpr std::uint32_t kIblBrdfSize = 128;
+constexpr std::uint32_t kIblShCoefficients = 9;
+
+// UIbl in cw2/shaders/ibl.glsl (std140)
+struct IblUniform
+{
+	glm::vec4 sh[kIblShCoefficients]; // rgb
+	glm::vec4 params; // x: 1 with an environment, 0 for the constant ambient; y: last specular level
+};
+
+// SPIR-V of cw2/shaders/ibl_sh.comp, ibl_specular.comp and ibl_brdf.comp
+struct IblShaderPaths
+{
+	char const* sh;
+	char const* specular;
+	char const* brdf;
+};
+
+struct Ibl
+{
+	lut::Buffer uniform; // IblUniform
+	lut::Image specular; // cube, kIblSpecularLevels levels
+	lut::ImageView specularView;
+	lut::Image brdf;
+	lut::ImageView brdfView;
+
+	VkSampler sampler = VK_NULL_HANDLE; // linear, mipmapped, clamp; from the cache
+
+	bool enabled = false; // false: no environment, the constant ambient term
+	bool cached = false; // loaded from the cache rather than generated
+};
+
+// aEnvironment: an equirectangular image (Radiance .hdr, or any format that
+// stb_image reads, taken as sRGB); null for no environment, which creates
+// 1x1 placeholders for the descriptors. aCacheDir is created if needed;
+// failing to write the cache file is not an error. Waits for the GPU to
+// finish. Throws labutils::Error on failure.
+Ibl create_ibl(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	lut::SamplerCache&,
+	VkCommandPool,
+	char const* aEnvironment,
+	char const* aCacheDir,
+	lut::ShaderModuleCache&,
+	IblShaderPaths const&,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+#endif // IBL_HPP_9B2F6D41_C7E3_4A85_B1D0_3E8A5C27F914
@@ -0,0 +1,237 @@
+#include "impostors.hpp"
+
+#include <cassert>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	// Vertices of an impostor quad (two triangles, see impostor.vert)
+	constexpr std::uint32_t kImpostorVertices = 6;
+}
+
+Impostors create_impostors( lut::VulkanWindow const& aWindow, lut::DescriptorAllocator& aDescriptors, lut::SamplerCache& aSamplers, ModelPack const& aModel, VkDescriptorSetLayout aSceneLayout, VkRenderPass aRenderPass, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader, bool aDepthPrepass, VkSampleCountFlagBits aSamples )
+{
+	assert( !aModel.impostors.meshes.empty() );
+
+	Impostors ret;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		for( std::uint32_t i = 0; i < 2; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create impostor descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline layout
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		range.offset = 0;
+		range.size = sizeof(ImpostorPushConstants);
+
+		VkDescriptorSetLayout const layouts[] = { aSceneLayout, ret.layout.handle };
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create impostor pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	// Trilinear; the tiles are clamped by their dilated borders, not by
+	// the sampler
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_LINEAR;
+		sampInfo.minFilter = VK_FILTER_LINEAR;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = VK_LOD_CLAMP_NONE;
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	// One set per mesh with an impostor
+	ret.descriptors.assign( aModel.impostors.meshes.size(), VK_NULL_HANDLE );
+	for( std::size_t i = 0; i < aModel.impostors.meshes.size(); ++i )
+	{
+		if( kNoTexture != aModel.impostors.meshes[i].albedo )
+			ret.descriptors[i] = aDescriptors.allocate( ret.layout.handle );
+	}
+	update_impostor_descriptors( aWindow, ret, aModel );
+
+	ret.pipe = create_impostor_pipeline( aWindow, ret, aRenderPass, aCache, aShaderModules, aVertShader, aFragShader, aDepthPrepass, aSamples );
+	return ret;
+}
+
+lut::Pipeline create_impostor_pipeline( lut::VulkanWindow const& aWindow, Impostors const& aImpostors, VkRenderPass aRenderPass, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader, bool aDepthPrepass, VkSampleCountFlagBits aSamples )
+{
+	VkShaderModule const vert = aShaderModules.get( aVertShader );
+	VkShaderModule const frag = aShaderModules.get( aFragShader );
+
+	VkPipelineShaderStageCreateInfo stages[2]{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vert;
+	stages[0].pName = "main";
+
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = frag;
+	stages[1].pName = "main";
+
+	// The quads are generated from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo inputInfo{};
+	inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+	assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportInfo{};
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.scissorCount = 1;
+
+	VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo{};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+	dynamicInfo.pDynamicStates = dynamicStates;
+
+	// The quads face the camera (up to the grid's spacing)
+	VkPipelineRasterizationStateCreateInfo rasterInfo{};
+	rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterInfo.lineWidth = 1.f;
+
+	VkPipelineMultisampleStateCreateInfo samplingInfo{};
+	samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	samplingInfo.rasterizationSamples = aSamples;
+
+	// The fragment shader writes the surface's depth
+	VkPipelineDepthStencilStateCreateInfo depthInfo{};
+	depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthInfo.depthTestEnable = VK_TRUE;
+	depthInfo.depthWriteEnable = VK_TRUE;
+	depthInfo.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+	depthInfo.minDepthBounds = 0.f;
+	depthInfo.maxDepthBounds = 1.f;
+
+	VkPipelineColorBlendAttachmentState blendState{};
+	blendState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo blendInfo{};
+	blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blendInfo.attachmentCount = 1;
+	blendInfo.pAttachments = &blendState;
+
+	VkGraphicsPipelineCreateInfo pipeInfo{};
+	pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeInfo.stageCount = 2;
+	pipeInfo.pStages = stages;
+	pipeInfo.pVertexInputState = &inputInfo;
+	pipeInfo.pInputAssemblyState = &assemblyInfo;
+	pipeInfo.pViewportState = &viewportInfo;
+	pipeInfo.pRasterizationState = &rasterInfo;
+	pipeInfo.pMultisampleState = &samplingInfo;
+	pipeInfo.pDepthStencilState = &depthInfo;
+	pipeInfo.pColorBlendState = &blendInfo;
+	pipeInfo.pDynamicState = &dynamicInfo;
+	pipeInfo.layout = aImpostors.pipeLayout.handle;
+	pipeInfo.renderPass = aRenderPass;
+	pipeInfo.subpass = aDepthPrepass ? 1 : 0; // the colour subpass
+
+	VkPipeline pipe = VK_NULL_HANDLE;
+	if( auto const res = vkCreateGraphicsPipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create impostor pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str() );
+
+	return lut::Pipeline( aWindow.device, pipe );
+}
+
+void update_impostor_descriptors( lut::VulkanWindow const& aWindow, Impostors const& aImpostors, ModelPack const& aModel )
+{
+	assert( aImpostors.descriptors.size() == aModel.impostors.meshes.size() );
+
+	for( std::size_t i = 0; i < aImpostors.descriptors.size(); ++i )
+	{
+		if( VK_NULL_HANDLE == aImpostors.descriptors[i] )
+			continue;
+
+		auto const& impostor = aModel.impostors.meshes[i];
+
+		VkDescriptorImageInfo imageInfo[2]{};
+		imageInfo[0].imageView = model_texture_view( aModel, impostor.albedo );
+		imageInfo[1].imageView = model_texture_view( aModel, impostor.normalDepth );
+
+		VkWriteDescriptorSet desc[2]{};
+		for( std::uint32_t j = 0; j < 2; ++j )
+		{
+			imageInfo[j].sampler = aImpostors.sampler;
+			imageInfo[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			desc[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[j].dstSet = aImpostors.descriptors[i];
+			desc[j].dstBinding = j;
+			desc[j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[j].descriptorCount = 1;
+			desc[j].pImageInfo = &imageInfo[j];
+		}
+
+		vkUpdateDescriptorSets( aWindow.device, 2, desc, 0, nullptr );
+	}
+}
+
+std::uint32_t record_impostors( VkCommandBuffer aCmdBuff, Impostors const& aImpostors, ModelPack const& aModel, std::vector<std::uint32_t> const& aMeshes, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset )
+{
+	if( aMeshes.empty() )
+		return 0;
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aImpostors.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aImpostors.pipeLayout.handle, 0, 1, &aSceneDescriptors, 1, &aSceneOffset );
+
+	for( auto const mesh : aMeshes )
+	{
+		auto const& impostor = aModel.impostors.meshes[mesh];
+		assert( VK_NULL_HANDLE != aImpostors.descriptors[mesh] );
+
+		ImpostorPushConstants const push{ impostor.centre, impostor.radius, aModel.impostors.grid };
+		vkCmdPushConstants( aCmdBuff, aImpostors.pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push );
+		vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aImpostors.pipeLayout.handle, 1, 1, &aImpostors.descriptors[mesh], 0, nullptr );
+		vkCmdDraw( aCmdBuff, kImpostorVertices, aModel.instanceCount, 0, 0 );
+	}
+
+	return std::uint32_t(aMeshes.size());
+}
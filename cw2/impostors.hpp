@@ -0,0 +1,101 @@
+#ifndef IMPOSTORS_HPP_8C3A5E17_4B9D_4F21_A6E0_D72F18B94C35
+#define IMPOSTORS_HPP_8C3A5E17_4B9D_4F21_A6E0_D72F18B94C35
+
+// Impostors of distant meshes (--impostor-pixels; see baked_impostors.hpp).
+// A mesh that select_impostors() (culling.hpp) picks is drawn as one quad
+// per copy instead of its triangles: impostor.vert turns the quad towards
+// the baked view closest to the camera, and impostor.frag alpha tests the
+// view's albedo, and shades and depth tests the surface given by its normal
+// and depth. The material is a fixed dielectric; the ambient occlusion,
+// normal maps and roughness of the mesh are lost at that distance anyway.
+//
+// Impostors are drawn in the colour pass of forward shading, after the
+// alpha-masked batches, and depth tested there: the depth pre-pass leaves
+// them out. The shadow faces still draw the meshes themselves.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec3.hpp>
+
+#include "../labutils/vkobject.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// PImpostor in cw2/shaders/impostor.vert
+struct ImpostorPushConstants
+{
+	glm::vec3 centre;
+	float radius;
+	std::uint32_t grid;
+};
+
+struct Impostors
+{
+	lut::DescriptorSetLayout layout; // set 1: the albedo and the normal and depth atlases
+	lut::PipelineLayout pipeLayout; // the scene's set 0, set 1, ImpostorPushConstants
+	lut::Pipeline pipe;
+
+	VkSampler sampler = VK_NULL_HANDLE; // trilinear, clamped; from the cache
+	std::vector<VkDescriptorSet> descriptors; // per mesh; VK_NULL_HANDLE: no impostor
+};
+
+// Sets up the impostors of aModel, which must have some (see
+// ModelPack::impostors), and creates their pipeline (see
+// create_impostor_pipeline()). aSceneLayout is set 0 of the colour pass.
+// Throws labutils::Error on failure.
+Impostors create_impostors(
+	lut::VulkanWindow const&,
+	lut::DescriptorAllocator&,
+	lut::SamplerCache&,
+	ModelPack const&,
+	VkDescriptorSetLayout aSceneLayout,
+	VkRenderPass,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	char const* aFragShader,
+	bool aDepthPrepass, // the colour pass is subpass 1
+	VkSampleCountFlagBits aSamples
+);
+
+// The pipeline against aRenderPass; for when the render pass is recreated
+lut::Pipeline create_impostor_pipeline(
+	lut::VulkanWindow const&,
+	Impostors const&,
+	VkRenderPass,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	char const* aFragShader,
+	bool aDepthPrepass,
+	VkSampleCountFlagBits aSamples
+);
+
+// Points the descriptor sets at the model's atlases (or their placeholders,
+// while they stream). Call again whenever the model's textures have been
+// swapped in or moved. The sets must not be in use by the GPU.
+void update_impostor_descriptors( lut::VulkanWindow const&, Impostors const&, ModelPack const& );
+
+// Draws the impostors of aMeshes (see select_impostors()), every copy of
+// the model, in the current colour subpass; the viewport and scissor are
+// left as they are. Binds the scene's set at aSceneOffset. Returns the
+// number of draws.
+std::uint32_t record_impostors(
+	VkCommandBuffer,
+	Impostors const&,
+	ModelPack const&,
+	std::vector<std::uint32_t> const& aMeshes,
+	VkDescriptorSet aSceneDescriptors,
+	std::uint32_t aSceneOffset
+);
+
+#endif // IMPOSTORS_HPP_8C3A5E17_4B9D_4F21_A6E0_D72F18B94C35
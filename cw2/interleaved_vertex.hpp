@@ -0,0 +1,57 @@
+#ifndef INTERLEAVED_VERTEX_HPP_A27BB101_FDE6_4D99_8B70_BFB617F36286
+#define INTERLEAVED_VERTEX_HPP_A27BB101_FDE6_4D99_8B70_BFB617F36286
+
+// Full precision vertex format; 48 bytes per vertex, the attributes one
+// after the other:
+//
+//   - position: 3x float
+//   - texcoord: 2x float
+//   - normal:   3x float
+//   - tangent:  4x float, w = sign of the bitangent
+//
+// Stored in the "scsmbil-ilv" (and later) baked files (see
+// cw2-bake/main.cpp), and used for the vertex buffers by default; the
+// Vulkan attributes are derived from the struct (see vertex_layout.hpp).
+// The pulled vertex shaders (*_pulled.vert) read the same layout.
+
+#include <type_traits>
+
+#include <cstddef>
+#include <cstring>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+struct InterleavedVertex
+{
+	glm::vec3 position;
+	glm::vec2 texcoord;
+	glm::vec3 normal;
+	glm::vec4 tangent;
+};
+
+static_assert( sizeof(InterleavedVertex) == 48, "InterleavedVertex must stay tightly packed" );
+
+// Vertex aIndex of an array of tVertex (InterleavedVertex, QuantizedVertex)
+// that may be unaligned, e.g., in a mapped file or in write-combined
+// staging memory; hence the memcpy()s.
+template< typename tVertex >
+tVertex load_vertex( void const* aArray, std::size_t aIndex )
+{
+	static_assert( std::is_trivially_copyable_v<tVertex> );
+
+	tVertex ret;
+	std::memcpy( &ret, static_cast<std::byte const*>(aArray) + aIndex*sizeof(tVertex), sizeof(tVertex) );
+	return ret;
+}
+
+template< typename tVertex >
+void store_vertex( void* aArray, std::size_t aIndex, tVertex const& aVertex )
+{
+	static_assert( std::is_trivially_copyable_v<tVertex> );
+
+	std::memcpy( static_cast<std::byte*>(aArray) + aIndex*sizeof(tVertex), &aVertex, sizeof(tVertex) );
+}
+
+#endif // INTERLEAVED_VERTEX_HPP_A27BB101_FDE6_4D99_8B70_BFB617F36286
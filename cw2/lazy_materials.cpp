@@ -0,0 +1,136 @@
+#include "lazy_materials.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Requests pending at the uploader at once; the rest wait for later
+	// frames, so that what becomes visible meanwhile can still go first
+	constexpr std::size_t kMaxLazyRequests = 8;
+
+	// The material slots that take a texture
+	template< typename tFunc >
+	void for_each_texture_( MaterialIndices const& aMaterial, tFunc&& aFunc )
+	{
+		std::uint32_t const ids[] = { aMaterial.baseColor, aMaterial.roughness, aMaterial.metalness, aMaterial.normalMap, aMaterial.alphaMask };
+		for( auto const id : ids )
+		{
+			if( kNoTexture != id )
+				aFunc( id );
+		}
+	}
+
+	// Fraction of the screen covered by the projected bounds; all of it if
+	// they reach behind the camera
+	float screen_coverage_( Mesh const& aMesh, glm::mat4 const& aProjCam )
+	{
+		glm::vec2 lo( 1.f ), hi( -1.f );
+		for( std::uint32_t i = 0; i < 8; ++i )
+		{
+			glm::vec4 const corner(
+				(i & 1) ? aMesh.aabbMax.x : aMesh.aabbMin.x,
+				(i & 2) ? aMesh.aabbMax.y : aMesh.aabbMin.y,
+				(i & 4) ? aMesh.aabbMax.z : aMesh.aabbMin.z,
+				1.f
+			);
+			glm::vec4 const clip = aProjCam * corner;
+			if( clip.w <= 0.f )
+				return 1.f;
+
+			glm::vec2 const ndc = glm::vec2( clip ) / clip.w;
+			lo = glm::min( lo, ndc );
+			hi = glm::max( hi, ndc );
+		}
+
+		lo = glm::clamp( lo, glm::vec2( -1.f ), glm::vec2( 1.f ) );
+		hi = glm::clamp( hi, glm::vec2( -1.f ), glm::vec2( 1.f ) );
+		glm::vec2 const size = glm::max( hi - lo, glm::vec2( 0.f ) );
+		return 0.25f * size.x * size.y;
+	}
+
+	void request_( LazyMaterials& aLazy, ModelPack const& aModel, lut::AsyncUploader& aUploader, TextureStreaming* aStreaming, std::uint32_t aId )
+	{
+		assert( !aLazy.requested[aId] );
+
+		stream_model_texture( aModel, aUploader, aId, aLazy.maxExtent );
+		aLazy.requested[aId] = 1;
+		--aLazy.remaining;
+
+		if( aStreaming )
+			++aStreaming->inFlight;
+	}
+}
+
+LazyMaterials create_lazy_materials( ModelPack const& aModel, lut::AsyncUploader& aUploader, std::uint32_t aMaxExtent, TextureStreaming* aStreaming )
+{
+	LazyMaterials ret;
+	ret.maxExtent = aMaxExtent;
+	ret.requested.assign( aModel.textureSources.size(), 0 );
+	ret.remaining = aModel.textureSources.size();
+	ret.coverage.assign( aModel.textureSources.size(), 0.f );
+
+	// Textures outside of the materials are never asked for by the meshes
+	std::vector<std::uint8_t> used( aModel.textureSources.size(), 0 );
+	for( auto const& material : aModel.hostMaterials )
+	{
+		for_each_texture_( material, [&] (std::uint32_t aId) {
+			if( aId < used.size() )
+				used[aId] = 1;
+		} );
+	}
+
+	for( std::size_t i = 0; i < used.size(); ++i )
+	{
+		if( !used[i] )
+			request_( ret, aModel, aUploader, aStreaming, std::uint32_t(i) );
+	}
+
+	return ret;
+}
+
+void request_visible_textures( LazyMaterials& aLazy, ModelPack const& aModel, std::vector<std::uint8_t> const& aVisible, glm::mat4 const& aProjCam, lut::AsyncUploader& aUploader, TextureStreaming* aStreaming )
+{
+	if( 0 == aLazy.remaining || aUploader.pending() >= kMaxLazyRequests )
+		return;
+
+	// Coverage of the textures that are still missing
+	aLazy.wanted.clear();
+	std::size_t const meshes = std::min( aVisible.size(), aModel.meshes.size() );
+	for( std::size_t i = 0; i < meshes; ++i )
+	{
+		if( !aVisible[i] )
+			continue;
+
+		auto const& mesh = aModel.meshes[i];
+		assert( mesh.matID < aModel.hostMaterials.size() );
+
+		float coverage = -1.f; // not projected yet
+		for_each_texture_( aModel.hostMaterials[mesh.matID], [&] (std::uint32_t aId) {
+			if( aId >= aLazy.requested.size() || aLazy.requested[aId] )
+				return;
+
+			if( coverage < 0.f )
+				coverage = screen_coverage_( mesh, aProjCam );
+
+			if( 0.f == aLazy.coverage[aId] )
+				aLazy.wanted.emplace_back( aId );
+			aLazy.coverage[aId] += std::max( coverage, 1e-6f ); // visible, if only just
+		} );
+	}
+
+	// Largest coverage first
+	std::size_t const count = std::min( aLazy.wanted.size(), kMaxLazyRequests - aUploader.pending() );
+	std::partial_sort( aLazy.wanted.begin(), aLazy.wanted.begin() + count, aLazy.wanted.end(), [&] (std::uint32_t aA, std::uint32_t aB) {
+		return aLazy.coverage[aA] > aLazy.coverage[aB];
+	} );
+
+	for( std::size_t i = 0; i < count; ++i )
+		request_( aLazy, aModel, aUploader, aStreaming, aLazy.wanted[i] );
+
+	for( auto const id : aLazy.wanted )
+		aLazy.coverage[id] = 0.f;
+}
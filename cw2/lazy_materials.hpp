@@ -0,0 +1,66 @@
+#ifndef LAZY_MATERIALS_HPP_03472FC1_20F9_499C_98CA_AB6533F50835
+#define LAZY_MATERIALS_HPP_03472FC1_20F9_499C_98CA_AB6533F50835
+
+// Lazy materials (--lazy-materials). The model is set up with an uploader
+// but requests none of its textures (see set_up_model()), so every material
+// starts out with the placeholders of its textures' formats. A texture is
+// requested once a mesh whose material uses it first passes culling; of the
+// textures that became wanted, those with the largest screen coverage (the
+// projected bounds of their visible meshes, summed) go first. Start-up then
+// loads what the camera sees rather than the whole scene. The textures that
+// no material uses (e.g., the impostors') are requested up front.
+//
+// The requests go through the same uploader as the streamed textures, and
+// are swapped in by update_model_textures(); with mip streaming, they are
+// each the texture's first version (see texture_streaming.hpp).
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/mat4x4.hpp>
+
+#include "../labutils/async_uploader.hpp"
+
+#include "load_data_to_vk.h"
+#include "texture_streaming.hpp"
+
+namespace lut = labutils;
+
+struct LazyMaterials
+{
+	std::uint32_t maxExtent = 0; // of the requests; see stream_model_texture()
+
+	std::vector<std::uint8_t> requested; // per texture of ModelPack::textureSources
+	std::size_t remaining = 0; // textures not requested yet
+
+	// Scratch: this frame's coverage per texture, and the wanted textures
+	std::vector<float> coverage;
+	std::vector<std::uint32_t> wanted;
+};
+
+// For a model set up with aLazyTextures (see set_up_model()). Requests the
+// textures that no material uses. aStreaming: counts the requests as its
+// first versions in flight; it must have been created with aLazy.
+LazyMaterials create_lazy_materials(
+	ModelPack const&,
+	lut::AsyncUploader&,
+	std::uint32_t aMaxExtent,
+	TextureStreaming* aStreaming = nullptr
+);
+
+// Once the frame's visible meshes are known (aVisible, per mesh; e.g., from
+// cull_bvh()): requests the textures of their materials that haven't been,
+// by their coverage under aProjCam, while fewer than a few of the uploader's
+// textures are pending. Cheap once every texture is requested.
+void request_visible_textures(
+	LazyMaterials&,
+	ModelPack const&,
+	std::vector<std::uint8_t> const& aVisible,
+	glm::mat4 const& aProjCam,
+	lut::AsyncUploader&,
+	TextureStreaming* aStreaming = nullptr
+);
+
+#endif // LAZY_MATERIALS_HPP_03472FC1_20F9_499C_98CA_AB6533F50835
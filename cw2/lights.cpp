@@ -0,0 +1,64 @@
+#include "lights.hpp"
+
+#include <random>
+#include <algorithm>
+
+#include <cstring>
+
+#include <glm/geometric.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/to_string.hpp"
+
+std::vector<PointLight> make_point_lights( std::uint32_t aCount, glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aSeed )
+{
+	std::mt19937 rng( aSeed );
+	std::uniform_real_distribution<float> unit( 0.f, 1.f );
+
+	float const diagonal = glm::length( aMax - aMin );
+
+	std::vector<PointLight> ret;
+	ret.reserve( aCount );
+	for( std::uint32_t i = 0; i < aCount; ++i )
+	{
+		glm::vec3 const t( unit( rng ), unit( rng ), unit( rng ) );
+		glm::vec3 const position = aMin + t * (aMax - aMin);
+
+		float const radius = diagonal * (0.02f + 0.04f * unit( rng ));
+
+		// Bright enough to be visible over most of the radius; the
+		// attenuation is inverse-square (see lights.glsl).
+		glm::vec3 const hue( unit( rng ), unit( rng ), unit( rng ) );
+		float const intensity = (radius * 0.25f) * (radius * 0.25f) + 1.f;
+
+		PointLight light{};
+		light.positionRadius = glm::vec4( position, radius );
+		light.color = glm::vec4( (0.25f + 0.75f * hue) * intensity, 0.f );
+		ret.emplace_back( light );
+	}
+
+	return ret;
+}
+
+LightBuffer create_light_buffer( lut::Allocator const& aAllocator, std::vector<PointLight> const& aLights, std::vector<std::uint32_t> const& aQueueFamilies )
+{
+	LightBuffer ret;
+	ret.count = std::uint32_t(aLights.size());
+
+	VkDeviceSize const bytes = std::max<VkDeviceSize>( 1, aLights.size() ) * sizeof(PointLight);
+	ret.buffer = lut::create_buffer( aAllocator, bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::upload, 0, aQueueFamilies );
+
+	if( !aLights.empty() )
+	{
+		void* ptr = nullptr;
+		if( auto const res = vmaMapMemory( aAllocator.allocator, ret.buffer.allocation, &ptr ); VK_SUCCESS != res )
+			throw lut::Error( "Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str() );
+
+		std::memcpy( ptr, aLights.data(), aLights.size() * sizeof(PointLight) );
+
+		vmaFlushAllocation( aAllocator.allocator, ret.buffer.allocation, 0, VK_WHOLE_SIZE );
+		vmaUnmapMemory( aAllocator.allocator, ret.buffer.allocation );
+	}
+
+	return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef LIGHTS_HPP_89F8EC63_90D2_46A0_A7DA_966AFE8A2E95
+#define LIGHTS_HPP_89F8EC63_90D2_46A0_A7DA_966AFE8A2E95
+
+// Point lights, in addition to the scene's single light. They are binned
+// into clusters each frame (see clusters.hpp), and shaded by both the
+// forward and the deferred path. The layout matches PointLight in
+// cw2/shaders/lights.glsl.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/allocator.hpp"
+
+namespace lut = labutils;
+
+struct PointLight
+{
+	glm::vec4 positionRadius; // xyz: world-space position, w: radius of influence
+	glm::vec4 color;          // rgb: intensity, a: unused
+};
+
+static_assert( sizeof(PointLight) == 32, "PointLight: must match the std430 layout in lights.glsl" );
+
+// aCount lights scattered over the box [aMin, aMax] with random colours. The
+// radii are relative to the size of the box. Deterministic for a given seed.
+std::vector<PointLight> make_point_lights( std::uint32_t aCount, glm::vec3 const& aMin, glm::vec3 const& aMax, std::uint32_t aSeed = 1 );
+
+struct LightBuffer
+{
+	lut::Buffer buffer; // storage buffer, std430 array of PointLight
+	std::uint32_t count = 0;
+};
+
+// Host-visible storage buffer with the lights. Never empty, so that it can
+// be bound even if there are no lights. Shared between aQueueFamilies (see
+// lut::create_buffer()).
+LightBuffer create_light_buffer( lut::Allocator const&, std::vector<PointLight> const&, std::vector<std::uint32_t> const& aQueueFamilies = {} );
+
+#endif // LIGHTS_HPP_89F8EC63_90D2_46A0_A7DA_966AFE8A2E95
@@ -1,338 +1,2176 @@
 #include "load_data_to_vk.h"
 
+#include <map>
+#include <array>
 #include <limits>
+#include <algorithm>
 
+#include <cstdio>
+#include <cassert>
+#include <cstddef> // for offsetof()
 #include <cstring> // for std::memcpy()
 #include <tuple>
+
+#include <glm/common.hpp>
+#include <glm/mat3x3.hpp>
+
 #include "../labutils/error.hpp"
 #include "../labutils/vkutil.hpp"
 #include "../labutils/to_string.hpp"
+#include "../labutils/texture_file.hpp"
+#include "../labutils/image_decoder.hpp"
+#include "../labutils/texture_transcode.hpp"
+#include "../labutils/lz4_block.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/startup_report.hpp"
+#include "../labutils/task.hpp"
+#include "quantized_vertex.hpp"
 namespace lut = labutils;
 
 
 
+namespace
+{
+    // Staging ring for the texture uploads of a model; batches are bounded
+    // by it (see lut::upload_image_textures2d()).
+    constexpr VkDeviceSize kTextureStagingBytes = VkDeviceSize(64) << 20;
+
+    // Vertices and indices are staged this many bytes of meshes at a time
+    // (or one mesh, if larger), see upload_meshes_()
+    constexpr VkDeviceSize kGeometryStagingBytes = VkDeviceSize(256) << 20;
+
+    // Source data for a single mesh, as raw (possibly unaligned) bytes. This
+    // is filled either from a BakedModel or directly from a mapped file.
+    struct MeshSource_
+    {
+        char const* name; // may be empty
+        std::uint32_t materialId;
+        std::uint32_t vertexCount;
+        std::uint32_t indexCount;
+
+        glm::vec3 aabbMin, aabbMax;
+
+        void const* positions; // vec3
+        void const* texcoords; // vec2
+        void const* normals;   // vec3
+        void const* tangents;  // vec4
+        void const* indices;   // uint32_t, or uint16_t if indexSize is 2
+        std::uint32_t indexSize;
+
+        // If set, fp32 vertices as in the vertex buffer (pos, tex, norm,
+        // tangent), or QuantizedVertex relative to the bounds; the separate
+        // attribute pointers are then unused.
+        void const* interleaved;
+        void const* quantized;
+
+        // If set, LZ4 blocks of the vertex array (interleaved, or quantized
+        // if packedQuantized) and of the index array; the corresponding
+        // pointers above are then null.
+        void const* packedVertices;
+        void const* packedIndices;
+        std::uint64_t packedVertexBytes;
+        std::uint64_t packedIndexBytes;
+        bool packedQuantized;
+
+        // Optional meshlets; meshletCount is 0 if there are none
+        std::uint32_t meshletCount;
+        std::uint32_t meshletIndexCount;
+        void const* meshlets;         // BakedMeshlet
+        void const* meshletVertices;  // uint32_t
+        void const* meshletTriangles; // uint8_t
+
+        // Optional simplified index buffers (indexSize each), finest first
+        struct Lod
+        {
+            float error;
+            std::uint32_t indexCount;
+            void const* indices;
+        };
+        std::uint32_t lodCount;
+        Lod lods[kMaxMeshLods - 1];
+
+        void const* occlusion; // uint8_t per vertex; null if there is none
+    };
+
+    // The buffers are ready once the returned ticket is. aStreamedGeometry:
+    // lay out the meshes, but leave the vertex and index buffers out. With
+    // aDecompressor, staged compressed arrays that need no conversion are
+    // decompressed on the GPU.
+    lut::UploadTicket upload_meshes_(lut::VulkanWindow const&, lut::Allocator const&, VkCommandPool, std::vector<MeshSource_> const&, std::vector<BakedMaterialInfo> const&,
+        bool aBindless, bool aQuantized, bool aMeshlets, bool aMeshInstances, bool aStreamedGeometry, GeometryDecompressor const*, ModelPack&);
+
+    // Writes the vertices of aMesh to aVertices, and its indices, in
+    // aMeshData's index type and LODs included, to aIndices (at its
+    // firstIndex). With aPositions (fp32 only), also the packed positions
+    // (see ModelPack::positions). aLodIndices is where the LODs go, if not
+    // right after the full-detail indices. A null aVertices or aIndices
+    // leaves those out (decompressed on the GPU instead, see
+    // gpu_decompression.hpp). Safe to call for different meshes
+    // concurrently.
+    void fill_mesh_(MeshSource_ aMesh, Mesh const& aMeshData, bool aQuantized, bool aMeshlets, std::uint8_t* aVertices, std::uint8_t* aIndices, std::uint8_t* aPositions = nullptr, std::uint8_t* aLodIndices = nullptr);
+
+    MeshSource_ mesh_source_(MappedBakedModel const&, BakedMeshView const&);
+
+    void read_vertex_(MeshSource_ const&, std::size_t, glm::vec3& aPosition, glm::vec2& aTexcoord, glm::vec3& aNormal, glm::vec4& aTangent);
+
+    // Copies aCount indices of aSrcSize bytes each to aDst, narrowing them
+    // to aDstSize bytes if necessary.
+    void write_indices_(std::uint8_t* aDst, void const* aSrc, std::size_t aCount, std::size_t aSrcSize, std::size_t aDstSize);
+
+    std::vector<VkDrawIndexedIndirectCommand> build_draw_batches_(std::vector<BakedMaterialInfo> const&, bool aMaterialAsFirstInstance, bool aMeshAsFirstInstance, ModelPack&);
+
+    std::vector<MaterialIndices> build_material_indices_(std::vector<BakedMaterialInfo> const&);
+
+    // The texture's view, or the placeholder for its role while it streams
+    VkImageView texture_view_(ModelPack const&, std::uint32_t aTextureId);
+
+    // Lists the textures to set up, and points aIndices (see
+    // build_material_indices_()) at them. Textures of the file that are only
+    // used through packed pairs are left out; otherwise, the file's order
+    // is kept. The impostors' atlases are kept too, and aImpostors points at
+    // them.
+    std::vector<TextureSource> plan_textures_(std::vector<BakedTextureInfo> const&, std::vector<BakedMaterialInfo> const&, std::vector<MaterialIndices>& aIndices, std::vector<BakedImpostor>& aImpostors);
+
+    // Role of every texture: as recorded by the baker, or, for older files,
+    // that of the first material slot using it (in one pass over the
+    // materials). Unused textures are baseColor.
+    std::vector<EBakedTextureRole> texture_roles_(std::vector<BakedTextureInfo> const&, std::vector<BakedMaterialInfo> const&);
+
+    ModelPack set_up_model_(lut::VulkanWindow const&, lut::Allocator const&, std::vector<BakedTextureInfo> const&,
+        std::vector<BakedMaterialInfo> const&, BakedImpostors const&, std::vector<MeshSource_> const&, VkCommandPool&, lut::DescriptorAllocator&, VkSampler&, VkDescriptorSetLayout&,
+        VkDescriptorSetLayout aBindlessLayout, lut::AsyncUploader*, bool aQuantizedVertices, bool aMeshlets, bool aMeshInstances, std::uint32_t aStreamExtent, bool aStreamedGeometry,
+        bool aTextureArrays, TextureCompressor const*, lut::FileReader*, GeometryDecompressor const*, DescriptorBufferSets*, TexturePrefetch*, lut::MipDownsampler*, bool aLazyTextures);
+
+    // Starts the jobs that read and decode the planned textures (see
+    // TexturePrefetch); the baked texture files aren't fitted yet
+    TexturePrefetch load_textures_(std::vector<TextureSource> const&, lut::FileReader*);
+    std::vector<std::string> texture_paths_(std::vector<TextureSource> const&);
+
+    // Size of a texture as uploaded, for grouping them into texture arrays
+    struct TextureExtent_
+    {
+        std::uint32_t width, height, levels;
+    };
+
+    // Packs the textures of the material slots (the filler for constant
+    // ones) into texture arrays by extent and format, with one copy per
+    // texture on the GPU, and releases their own images; then allocates
+    // and writes a set per combination of arrays (see
+    // ModelPack::textureArrays). The textures must be loaded.
+    void pack_texture_arrays_(lut::VulkanWindow const&, lut::Allocator const&, VkCommandPool, lut::DescriptorAllocator&, VkDescriptorSetLayout, std::vector<TextureExtent_> const&, ModelPack&);
+
+    // The descriptors of a material's set, as its update template reads
+    // them (see material_template_())
+    struct MaterialDescriptors_
+    {
+        VkDescriptorImageInfo images[4]; // bindings 0-2 and 4 (alpha mask)
+        VkDescriptorBufferInfo uniforms; // binding 3
+    };
+
+    lut::DescriptorUpdateTemplate material_template_(lut::VulkanWindow const&, VkDescriptorSetLayout);
+
+    // aTextureIds: the textures that changed; only the material sets that
+    // use them are rewritten, and in a descriptor buffer, only their
+    // bindless descriptors (null: everything)
+    void write_model_descriptors_(lut::VulkanWindow const&, ModelPack const&, VkSampler, std::vector<std::uint32_t> const* aTextureIds = nullptr);
+
+    // Debug names (see lut::set_name()) of the model's buffers, descriptor
+    // sets and textures, from ModelPack::textureNames and materialNames.
+    // Resources that are replaced later need to be named again.
+    void name_model_resources_(lut::VulkanWindow const&, ModelPack const&);
+    void name_texture_(lut::VulkanWindow const&, ModelPack const&, std::size_t aId);
+}
+
 ModelPack set_up_model(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator,BakedModel const& aModel, 
-    VkCommandPool& aLoadCmdPool, VkDescriptorPool& aDesPool, VkSampler& aSampler, VkDescriptorSetLayout& descLayout)
+    VkCommandPool& aLoadCmdPool, lut::DescriptorAllocator& aDescriptors, VkSampler& aSampler, VkDescriptorSetLayout& descLayout, VkDescriptorSetLayout aBindlessLayout,
+    lut::AsyncUploader* aUploader, bool aQuantizedVertices, bool aMeshlets, bool aMeshInstances, std::uint32_t aStreamExtent, bool aTextureArrays,
+    TextureCompressor const* aCompressor, lut::FileReader* aReader, GeometryDecompressor const* aDecompressor, DescriptorBufferSets* aDescriptorBuffer, TexturePrefetch* aPrefetched, lut::MipDownsampler* aMips, bool aLazyTextures)
 {
-    ModelPack ret;
-    //extract data from BakedModel
+    std::vector<MeshSource_> sources;
+    sources.reserve(aModel.meshes.size());
+    for (auto const& mesh : aModel.meshes)
+    {
+        MeshSource_ src{};
+        src.name = mesh.name.c_str();
+        src.materialId = mesh.materialId;
+        src.vertexCount = static_cast<std::uint32_t>(mesh.positions.size());
+        src.indexCount = static_cast<std::uint32_t>(mesh.indices.size());
+        src.aabbMin = mesh.aabbMin;
+        src.aabbMax = mesh.aabbMax;
+        src.positions = mesh.positions.data();
+        src.texcoords = mesh.texcoords.data();
+        src.normals = mesh.normals.data();
+        src.tangents = mesh.tangents.data();
+        src.indices = mesh.indices.data();
+        src.indexSize = sizeof(std::uint32_t);
+        src.meshletCount = static_cast<std::uint32_t>(mesh.meshlets.size());
+        src.meshletIndexCount = static_cast<std::uint32_t>(mesh.meshletTriangles.size());
+        src.meshlets = mesh.meshlets.data();
+        src.meshletVertices = mesh.meshletVertices.data();
+        src.meshletTriangles = mesh.meshletTriangles.data();
+        src.lodCount = static_cast<std::uint32_t>(std::min<std::size_t>(mesh.lods.size(), kMaxMeshLods - 1));
+        for (std::uint32_t i = 0; i < src.lodCount; ++i)
+            src.lods[i] = { mesh.lods[i].error, static_cast<std::uint32_t>(mesh.lods[i].indices.size()), mesh.lods[i].indices.data() };
+        src.occlusion = mesh.occlusion.empty() ? nullptr : mesh.occlusion.data();
+        sources.emplace_back(src);
+    }
+
+    ModelPack ret = set_up_model_(aWindow, aAllocator, aModel.textures, aModel.materials, aModel.impostors, sources, aLoadCmdPool, aDescriptors, aSampler, descLayout, aBindlessLayout, aUploader, aQuantizedVertices, aMeshlets, aMeshInstances, aStreamExtent, false, aTextureArrays, aCompressor, aReader, aDecompressor, aDescriptorBuffer, aPrefetched, aMips, aLazyTextures);
+    ret.bvh = aModel.bvh;
+    ret.pvs = aModel.pvs;
+    return ret;
+}
+
+ModelPack set_up_model(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, MappedBakedModel const& aModel,
+    VkCommandPool& aLoadCmdPool, lut::DescriptorAllocator& aDescriptors, VkSampler& aSampler, VkDescriptorSetLayout& descLayout, VkDescriptorSetLayout aBindlessLayout,
+    lut::AsyncUploader* aUploader, bool aQuantizedVertices, bool aMeshlets, bool aMeshInstances, std::uint32_t aStreamExtent, bool aStreamedGeometry, bool aTextureArrays,
+    TextureCompressor const* aCompressor, lut::FileReader* aReader, GeometryDecompressor const* aDecompressor, DescriptorBufferSets* aDescriptorBuffer, TexturePrefetch* aPrefetched, lut::MipDownsampler* aMips, bool aLazyTextures)
+{
+    std::vector<MeshSource_> sources;
+    sources.reserve(aModel.meshes.size());
+    for (auto const& mesh : aModel.meshes)
+        sources.emplace_back(mesh_source_(aModel, mesh));
+
+    ModelPack ret = set_up_model_(aWindow, aAllocator, aModel.textures, aModel.materials, aModel.impostors, sources, aLoadCmdPool, aDescriptors, aSampler, descLayout, aBindlessLayout, aUploader, aQuantizedVertices, aMeshlets, aMeshInstances, aStreamExtent, aStreamedGeometry, aTextureArrays, aCompressor, aReader, aDecompressor, aDescriptorBuffer, aPrefetched, aMips, aLazyTextures);
+    ret.bvh = aModel.bvh;
+    ret.pvs = aModel.pvs;
+    return ret;
+}
+
+VkImageView model_texture_view(ModelPack const& aModel, std::uint32_t aId)
+{
+    assert(kNoTexture == aId || aId < aModel.textures.size());
+    return texture_view_(aModel, aId);
+}
+
+void stream_model_texture(ModelPack const& aModel, lut::AsyncUploader& aUploader, std::uint32_t aId, std::uint32_t aMaxExtent)
+{
+    assert(aId < aModel.textureSources.size());
+
+    auto const& src = aModel.textureSources[aId];
+    if (src.packed)
+        aUploader.enqueue_packed_texture(aId, src.path, src.greenPath, aMaxExtent);
+    else
+        aUploader.enqueue_texture(aId, src.path, src.format, aMaxExtent);
+}
+
+void update_model_textures(lut::VulkanWindow const& aWindow, ModelPack& aModel, VkSampler aSampler, std::vector<lut::AsyncUploader::Completed> aTextures)
+{
+    if (aTextures.empty())
+        return;
+
+    std::vector<std::uint32_t> ids;
+    for (auto& tex : aTextures)
+    {
+        assert(tex.id < aModel.textures.size());
+        ids.emplace_back(tex.id);
+
+        Texture& dst = aModel.textures[tex.id];
+        dst.view = lut::create_image_view_texture2d(aWindow, tex.image.image, tex.format);
+        dst.image = std::move(tex.image);
+
+        // Baked textures may use a different (compressed) format
+        aModel.textureFormats[tex.id] = tex.format;
+        aModel.textureExtents[tex.id] = VkExtent2D{ tex.width, tex.height };
+
+        name_texture_(aWindow, aModel, tex.id);
+    }
+
+    write_model_descriptors_(aWindow, aModel, aSampler, &ids);
+}
+
+void set_model_texture_views(lut::VulkanWindow const& aWindow, ModelPack& aModel, VkSampler aSampler, std::vector<ModelTextureView> aViews)
+{
+    if (aViews.empty())
+        return;
+
+    std::vector<std::uint32_t> ids;
+    for (auto& tex : aViews)
+    {
+        assert(tex.id < aModel.textures.size());
+        ids.emplace_back(tex.id);
+
+        Texture& dst = aModel.textures[tex.id];
+        dst.view = std::move(tex.view);
+        dst.image = lut::Image();
+        aModel.textureFormats[tex.id] = tex.format;
+
+        name_texture_(aWindow, aModel, tex.id);
+    }
+
+    write_model_descriptors_(aWindow, aModel, aSampler, &ids);
+}
+
+void allow_model_moves(lut::Allocator const& aAllocator, ModelPack const& aModel)
+{
+    for (lut::Buffer const* buffer : { &aModel.vertices, &aModel.positions, &aModel.indices, &aModel.drawCommands, &aModel.materialIndices, &aModel.meshInstances, &aModel.materialUniforms })
+    {
+        if (VK_NULL_HANDLE != buffer->buffer)
+            lut::allow_moves(aAllocator, *buffer);
+    }
+
+    for (auto const& tex : aModel.textures)
+    {
+        if (VK_NULL_HANDLE != tex.image.image)
+            lut::allow_moves(aAllocator, tex.image);
+    }
+}
+
+bool relocate_model_resources(lut::VulkanWindow const& aWindow, ModelPack& aModel, VkSampler aSampler, std::vector<lut::Defragmenter::Move> const& aMoves)
+{
+    bool moved = false;
+    for (auto const& move : aMoves)
+    {
+        for (lut::Buffer* buffer : { &aModel.vertices, &aModel.positions, &aModel.indices, &aModel.drawCommands, &aModel.materialIndices, &aModel.meshInstances, &aModel.materialUniforms })
+        {
+            if (VK_NULL_HANDLE != buffer->allocation && buffer->allocation == move.allocation)
+            {
+                buffer->buffer = move.buffer;
+                moved = true;
+            }
+        }
+
+        for (std::size_t i = 0; i < aModel.textures.size(); ++i)
+        {
+            Texture& tex = aModel.textures[i];
+            if (VK_NULL_HANDLE != tex.image.allocation && tex.image.allocation == move.allocation)
+            {
+                tex.image.image = move.image;
+                tex.view = lut::create_image_view_texture2d(aWindow, move.image, aModel.textureFormats[i]);
+                moved = true;
+            }
+        }
+    }
+
+    if (moved)
+    {
+        write_model_descriptors_(aWindow, aModel, aSampler);
+        name_model_resources_(aWindow, aModel);
+    }
+
+    return moved;
+}
+
+void write_model_mesh(MappedBakedModel const& aSource, ModelPack const& aModel, std::uint32_t aMesh, void* aVertices, void* aIndices)
+{
+    assert(aMesh < aSource.meshes.size() && aMesh < aModel.meshes.size() && aModel.meshlets.empty());
+    fill_mesh_(mesh_source_(aSource, aSource.meshes[aMesh]), aModel.meshes[aMesh], aModel.quantizedVertices, false,
+        static_cast<std::uint8_t*>(aVertices), static_cast<std::uint8_t*>(aIndices));
+}
+
+void set_model_instances(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, ModelPack& aModel, std::vector<glm::mat4> const& aTransforms)
+{
+    LUT_CPU_ZONE("set_model_instances()");
+
+    auto const count = static_cast<std::uint32_t>(aTransforms.size());
+    if (0 == count)
+        throw lut::Error("set_model_instances(): no transforms");
+    if (VK_NULL_HANDLE != aModel.instances.buffer)
+        throw lut::Error("set_model_instances(): the model already has instances");
+    if (count > 1 && (aModel.quantizedVertices || VK_NULL_HANDLE != aModel.meshInstances.buffer || !aModel.meshlets.empty()))
+        throw lut::Error("set_model_instances(): models with quantized vertices, mesh instances or meshlets take a single transform");
+
+    std::vector<std::byte> data(sizeof(ModelInstancesHeader) + aTransforms.size() * sizeof(glm::mat4));
+    ModelInstancesHeader const header{ count, {} };
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), aTransforms.data(), aTransforms.size() * sizeof(glm::mat4));
+
+    aModel.instances = lut::create_buffer(aAllocator, data.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::geometry);
+    lut::set_name(aWindow, aModel.instances, "model instances");
+    aModel.instanceCount = count;
+
+    lut::UploadBatch batch(aWindow, aCmdPool, aAllocator);
+    batch.upload_buffer(aModel.instances.buffer, data.data(), data.size(), VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+
+    if (count > 1)
+    {
+        // Bounds of all copies: the transformed box of each is centred on
+        // the transformed centre, with the extent through |M|
+        for (auto& mesh : aModel.meshes)
+        {
+            glm::vec3 const centre = 0.5f * (mesh.aabbMin + mesh.aabbMax);
+            glm::vec3 const half = 0.5f * (mesh.aabbMax - mesh.aabbMin);
+
+            glm::vec3 bmin(std::numeric_limits<float>::max()), bmax(-std::numeric_limits<float>::max());
+            for (auto const& transform : aTransforms)
+            {
+                glm::vec3 const c = glm::vec3(transform * glm::vec4(centre, 1.f));
+                glm::mat3 const m(transform);
+                glm::vec3 const e = glm::mat3(glm::abs(m[0]), glm::abs(m[1]), glm::abs(m[2])) * half;
+                bmin = glm::min(bmin, c - e);
+                bmax = glm::max(bmax, c + e);
+            }
+
+            mesh.aabbMin = bmin;
+            mesh.aabbMax = bmax;
+        }
+
+        // Refit the BVH to the grown bounds, children before parents: a
+        // leaf covers its meshes, an inner node its two children (i + 1,
+        // and the node after the left subtree)
+        auto& bvh = aModel.bvh;
+        for (std::size_t i = bvh.nodes.size(); i-- > 0; )
+        {
+            auto& node = bvh.nodes[i];
+            if (node.skip == i + 1)
+            {
+                node.aabbMin = glm::vec3(std::numeric_limits<float>::max());
+                node.aabbMax = glm::vec3(-std::numeric_limits<float>::max());
+                for (std::uint32_t j = node.first; j < bvh.end(std::uint32_t(i)); ++j)
+                {
+                    node.aabbMin = glm::min(node.aabbMin, aModel.meshes[bvh.primitives[j]].aabbMin);
+                    node.aabbMax = glm::max(node.aabbMax, aModel.meshes[bvh.primitives[j]].aabbMax);
+                }
+            }
+            else
+            {
+                auto const& left = bvh.nodes[i + 1];
+                auto const& right = bvh.nodes[left.skip];
+                node.aabbMin = glm::min(left.aabbMin, right.aabbMin);
+                node.aabbMax = glm::max(left.aabbMax, right.aabbMax);
+            }
+        }
+
+        // The PVS holds for the original placement only
+        aModel.pvs = BakedPvs{};
+
+        for (auto& cmd : aModel.hostDrawCommands)
+        {
+            cmd.instanceCount = count;
+            cmd.firstInstance *= count;
+        }
+
+        if (!aModel.hostDrawCommands.empty())
+        {
+            batch.upload_buffer(aModel.drawCommands.buffer, aModel.hostDrawCommands.data(), aModel.hostDrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        }
+    }
+
+    batch.submit().wait();
+}
+
+namespace
+{
+std::vector<VkDrawIndexedIndirectCommand> build_draw_batches_(std::vector<BakedMaterialInfo> const& aMaterials, bool aMaterialAsFirstInstance, bool aMeshAsFirstInstance, ModelPack& aOut)
+{
+    // Commands are ordered by pipeline (opaque, then alpha masked), by index
+    // type (uint16, then uint32) and material within each pipeline, and by
+    // position in the shared geometry buffers within each material, so that
+    // each material and index type is a contiguous range of commands. Both
+    // the indirect and the direct draws follow this order. With bindless
+    // materials, the material index is passed to the shaders as
+    // firstInstance; with quantized vertices (or mesh instances), the mesh
+    // index is (and the MeshInstance holds the material).
+    std::vector<VkDrawIndexedIndirectCommand> commands;
+    commands.reserve(aOut.meshes.size());
+
+    aOut.drawCommandMeshes.clear();
+    aOut.drawCommandMeshes.reserve(aOut.meshes.size());
+    aOut.drawCommandMeshlets.clear();
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        bool const alphaMasked = (1 == pass);
+        auto& batches = alphaMasked ? aOut.alphaBatches : aOut.opaqueBatches;
+
+        for (VkIndexType const indexType : { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 })
+        {
+            for (std::uint32_t mat = 0; mat < aMaterials.size(); ++mat)
+            {
+                if (alphaMasked != (aMaterials[mat].alphaMaskTextureId != 0xffffffff))
+                    continue;
+
+                DrawBatch batch{};
+                batch.indexType = indexType;
+                batch.matID = mat;
+                batch.firstCommand = static_cast<std::uint32_t>(commands.size());
+
+                for (std::uint32_t m = 0; m < aOut.meshes.size(); ++m)
+                {
+                    auto const& mesh = aOut.meshes[m];
+                    if (mesh.matID != mat || mesh.indexType != indexType || 0 == mesh.indexCount)
+                        continue;
+
+                    VkDrawIndexedIndirectCommand cmd{};
+                    cmd.indexCount = mesh.indexCount;
+                    cmd.instanceCount = 1;
+                    cmd.firstIndex = mesh.firstIndex;
+                    cmd.vertexOffset = mesh.vertexOffset;
+                    cmd.firstInstance = aMeshAsFirstInstance ? m : (aMaterialAsFirstInstance ? mat : 0);
+
+                    if (aOut.meshlets.empty())
+                    {
+                        commands.emplace_back(cmd);
+                        aOut.drawCommandMeshes.emplace_back(m);
+                        continue;
+                    }
+
+                    // One command per meshlet
+                    for (std::uint32_t i = mesh.firstMeshlet; i < mesh.firstMeshlet + mesh.meshletCount; ++i)
+                    {
+                        cmd.indexCount = aOut.meshlets[i].indexCount;
+                        cmd.firstIndex = aOut.meshlets[i].firstIndex;
+                        commands.emplace_back(cmd);
+                        aOut.drawCommandMeshes.emplace_back(m);
+                        aOut.drawCommandMeshlets.emplace_back(i);
+                    }
+                }
+
+                batch.commandCount = static_cast<std::uint32_t>(commands.size()) - batch.firstCommand;
+                if (batch.commandCount > 0)
+                    batches.emplace_back(batch);
+            }
+        }
+    }
+
+    return commands;
+}
 
-    for (auto& mesh : aModel.meshes) {
-        std::vector<float> vertexData;
+VkImageView texture_view_(ModelPack const& aModel, std::uint32_t aTextureId)
+{
+    // Constant slots get the filler (see ModelPack::hostMaterials)
+    if (kNoTexture == aTextureId)
+        aTextureId = static_cast<std::uint32_t>(aModel.textures.size() - 1);
+
+    if (VK_NULL_HANDLE != aModel.textures[aTextureId].view.handle)
+        return aModel.textures[aTextureId].view.handle;
+
+    // Still streaming; see set_up_model_() for the placeholder order. The
+    // single-channel one gives packed textures a metalness of 0.
+    switch (aModel.textureSources[aTextureId].role)
+    {
+        case EBakedTextureRole::scalar: return aModel.placeholders[1].view.handle;
+        case EBakedTextureRole::alphaCoverage: return aModel.placeholders[1].view.handle;
+        case EBakedTextureRole::roughnessMetalness: return aModel.placeholders[1].view.handle;
+        case EBakedTextureRole::normalMap: return aModel.placeholders[2].view.handle;
+        case EBakedTextureRole::linearColor: return aModel.placeholders[2].view.handle;
+        default: return aModel.placeholders[0].view.handle;
+    }
+}
+
+std::vector<MaterialIndices> build_material_indices_(std::vector<BakedMaterialInfo> const& aMaterials)
+{
+    std::vector<MaterialIndices> ret;
+    ret.reserve(aMaterials.size());
+
+    for (auto const& mat : aMaterials)
+    {
+        MaterialIndices indices{};
+        indices.baseColor = mat.baseColorTextureId;
+        indices.roughness = mat.roughnessTextureId;
+        indices.metalness = mat.metalnessTextureId;
+        indices.normalMap = mat.normalMapTextureId;
+        indices.baseColorConstant = mat.baseColor;
+        indices.roughnessConstant = mat.roughness;
+        indices.metalnessConstant = mat.metalness;
+        indices.alphaMask = mat.alphaMaskTextureId;
+        indices.alphaChannel = 3; // see plan_textures_()
+        ret.emplace_back(indices);
+    }
+
+    return ret;
+}
 
-        for (std::size_t i = 0 ; i < mesh.positions.size(); ++i) {
-            vertexData.emplace_back(mesh.positions[i].x);
-            vertexData.emplace_back(mesh.positions[i].y);
-            vertexData.emplace_back(mesh.positions[i].z);
-            vertexData.emplace_back(mesh.texcoords[i].x);
-            vertexData.emplace_back(mesh.texcoords[i].y);
-            vertexData.emplace_back(mesh.normals[i].x);
-            vertexData.emplace_back(mesh.normals[i].y);
-            vertexData.emplace_back(mesh.normals[i].z);
-            vertexData.emplace_back(mesh.tangents[i].x);
-            vertexData.emplace_back(mesh.tangents[i].y);
-            vertexData.emplace_back(mesh.tangents[i].z);
-            vertexData.emplace_back(mesh.tangents[i].w);
+std::vector<EBakedTextureRole> texture_roles_(std::vector<BakedTextureInfo> const& aTextures, std::vector<BakedMaterialInfo> const& aMaterials)
+{
+    std::vector<EBakedTextureRole> ret(aTextures.size(), EBakedTextureRole::unknown);
+    std::size_t unknown = 0;
+    for (std::size_t i = 0; i < aTextures.size(); ++i)
+    {
+        ret[i] = aTextures[i].role;
+        unknown += EBakedTextureRole::unknown == ret[i];
+    }
+
+    // Older files: the first slot wins, base color before roughness and
+    // metalness before normal maps
+    for (auto const& mat : aMaterials)
+    {
+        if (0 == unknown)
+            break;
+
+        auto const assign_ = [&] (std::uint32_t aId, EBakedTextureRole aRole)
+        {
+            if (kNoTexture == aId || EBakedTextureRole::unknown != ret[aId])
+                return;
+
+            ret[aId] = aRole;
+            --unknown;
+        };
+
+        assign_(mat.baseColorTextureId, EBakedTextureRole::baseColor);
+        for (auto const id : { mat.roughnessTextureId, mat.metalnessTextureId })
+        {
+            if (kNoTexture != id)
+                assign_(id, 2 == aTextures[id].channels ? EBakedTextureRole::roughnessMetalness : EBakedTextureRole::scalar);
         }
+        assign_(mat.normalMapTextureId, EBakedTextureRole::normalMap);
+        assign_(mat.alphaMaskTextureId, EBakedTextureRole::baseColor);
+    }
+
+    for (auto& role : ret)
+    {
+        if (EBakedTextureRole::unknown == role)
+            role = EBakedTextureRole::baseColor;
+    }
 
-        //create buffers
-        lut::Buffer vertexGPU = lut::create_buffer(aAllocator, vertexData.size() * sizeof(float), 
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-        lut::Buffer indexGPU = lut::create_buffer(aAllocator, mesh.indices.size() * sizeof(uint32_t),
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-        lut::Buffer vertexStaging = lut::create_buffer(aAllocator, vertexData.size() * sizeof(float),
-            			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-        lut::Buffer indexStaging = lut::create_buffer(aAllocator, mesh.indices.size() * sizeof(uint32_t),
-            			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU); 
+    return ret;
+}
 
-        void* vertPtr = nullptr;
-        if (auto const res = vmaMapMemory(aAllocator.allocator, vertexStaging.allocation, &vertPtr); VK_SUCCESS != res)
+std::vector<TextureSource> plan_textures_(std::vector<BakedTextureInfo> const& aTextures, std::vector<BakedMaterialInfo> const& aMaterials, std::vector<MaterialIndices>& aIndices, std::vector<BakedImpostor>& aImpostors)
+{
+    // Older files have one-channel roughness and metalness textures
+    auto const unpacked_ = [&] (MaterialIndices const& aMat)
+    {
+        for (auto const id : { aMat.roughness, aMat.metalness })
         {
-            throw lut::Error("Mapping memory for writing\n""vmaMapMemory() returned %s" , lut::to_string(res).c_str());
+            if (kNoTexture != id && 1 == aTextures[id].channels)
+                return true;
         }
-        std::memcpy(vertPtr, vertexData.data(), vertexData.size() * sizeof(float)); 
-        vmaUnmapMemory(aAllocator.allocator, vertexStaging.allocation);
+        return false;
+    };
 
-        void* indexPtr = nullptr;
-        if (auto const res = vmaMapMemory(aAllocator.allocator, indexStaging.allocation, &indexPtr); VK_SUCCESS != res) 
+    auto const roles = texture_roles_(aTextures, aMaterials);
+
+    std::vector<bool> used(aTextures.size(), false);
+    for (auto const& mat : aIndices)
+    {
+        bool const pack = unpacked_(mat);
+        for (auto const id : { mat.baseColor, mat.normalMap, mat.alphaMask, pack ? kNoTexture : mat.roughness, pack ? kNoTexture : mat.metalness })
         {
-            throw lut::Error("Mapping memory for writing\n""vmaMapMemory() returned %s", lut::to_string(res).c_str());
+            if (kNoTexture != id)
+                used[id] = true;
         }
-        std::memcpy(indexPtr, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
-        vmaUnmapMemory(aAllocator.allocator, indexStaging.allocation);
+    }
 
-        lut::Fence uploadComplete = lut::create_fence(aWindow);
+    for (auto const& impostor : aImpostors)
+    {
+        for (auto const id : { impostor.albedo, impostor.normalDepth })
+        {
+            if (kNoTexture != id)
+                used[id] = true;
+        }
+    }
 
-        lut::CommandPool uploadPool = lut::create_command_pool(aWindow);
-        VkCommandBuffer uploadCmd = lut::alloc_command_buffer(aWindow, uploadPool.handle);
+    std::vector<TextureSource> ret;
+    std::vector<std::uint32_t> remap(aTextures.size(), kNoTexture);
+    for (std::uint32_t i = 0; i < aTextures.size(); ++i)
+    {
+        if (!used[i])
+            continue;
 
-        VkCommandBufferBeginInfo beginInfo{}; 
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO; 
-        beginInfo.flags = 0; 
-        beginInfo.pInheritanceInfo = nullptr; 
+        remap[i] = static_cast<std::uint32_t>(ret.size());
 
-        if (auto const res = vkBeginCommandBuffer(uploadCmd, &beginInfo); VK_SUCCESS != res) 
+        TextureSource src;
+        src.path = aTextures[i].path;
+        src.role = roles[i];
+        src.recordedFormat = 0 != aTextures[i].format;
+        if (src.recordedFormat)
+            src.format = VkFormat(aTextures[i].format);
+        else
         {
-            throw lut::Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str()); 
+            // Packed textures are always baked texture files
+            switch (src.role)
+            {
+                case EBakedTextureRole::roughnessMetalness: src.format = VK_FORMAT_R8G8_UNORM; break;
+                case EBakedTextureRole::scalar: src.format = VK_FORMAT_R8_UNORM; break;
+                case EBakedTextureRole::alphaCoverage: src.format = VK_FORMAT_R8_UNORM; break;
+                case EBakedTextureRole::normalMap: src.format = VK_FORMAT_R8G8B8A8_UNORM; break;
+                case EBakedTextureRole::linearColor: src.format = VK_FORMAT_R8G8B8A8_UNORM; break;
+                default: src.format = VK_FORMAT_R8G8B8A8_SRGB; break;
+            }
         }
+        ret.emplace_back(std::move(src));
+    }
 
-        VkBufferCopy vcopy{};
-        vcopy.size = vertexData.size() * sizeof(float);
+    // One packed texture per distinct pair
+    auto const remap_ = [&] (std::uint32_t& aId)
+    {
+        if (kNoTexture != aId)
+            aId = remap[aId];
+    };
 
-        vkCmdCopyBuffer(uploadCmd, vertexStaging.buffer, vertexGPU.buffer, 1, &vcopy); 
-        lut::buffer_barrier(uploadCmd, vertexGPU.buffer, 
-            VK_ACCESS_TRANSFER_WRITE_BIT, 
-            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT); 
+    for (auto& impostor : aImpostors)
+    {
+        remap_(impostor.albedo);
+        remap_(impostor.normalDepth);
+    }
 
-        VkBufferCopy icopy{}; 
-        icopy.size = mesh.indices.size() * sizeof(uint32_t); 
+    std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint32_t> pairs;
+    for (auto& mat : aIndices)
+    {
+        // Alpha coverage textures hold the mask in R; older files mask with
+        // the base color's alpha
+        if (kNoTexture != mat.alphaMask && EBakedTextureRole::alphaCoverage == roles[mat.alphaMask])
+            mat.alphaChannel = 0;
+
+        remap_(mat.baseColor);
+        remap_(mat.normalMap);
+        remap_(mat.alphaMask);
 
-        vkCmdCopyBuffer(uploadCmd, indexStaging.buffer, indexGPU.buffer, 1, &icopy); 
-         
-        lut::buffer_barrier(uploadCmd, indexGPU.buffer, 
-            VK_ACCESS_TRANSFER_WRITE_BIT, 
-            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,  
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT); 
+        if (!unpacked_(mat))
+        {
+            remap_(mat.roughness);
+            remap_(mat.metalness);
+            continue;
+        }
 
-        if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res) 
+        auto const [it, isNew] = pairs.emplace(std::make_pair(mat.roughness, mat.metalness), static_cast<std::uint32_t>(ret.size()));
+        if (isNew)
         {
-            throw lut::Error("Ennding command buffer recording\n""vkEndCommandBuffer() returned %s", lut::to_string(res).c_str()); 
+            TextureSource src;
+            src.packed = true;
+            src.role = EBakedTextureRole::roughnessMetalness;
+            src.format = VK_FORMAT_R8G8B8A8_UNORM;
+            if (kNoTexture != mat.roughness)
+                src.path = aTextures[mat.roughness].path;
+            if (kNoTexture != mat.metalness)
+                src.greenPath = aTextures[mat.metalness].path;
+
+            for (auto const* path : { &src.path, &src.greenPath })
+            {
+                if (lut::is_texture_file(path->c_str()))
+                    throw lut::Error("%s: separate baked roughness and metalness textures can't be packed at load time; bake the model again", path->c_str());
+            }
+
+            ret.emplace_back(std::move(src));
         }
 
-        // Submit transfer commands
-        VkSubmitInfo submitInfo{}; 
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO; 
-        submitInfo.commandBufferCount = 1;  
-        submitInfo.pCommandBuffers = &uploadCmd; 
+        if (kNoTexture != mat.roughness)
+            mat.roughness = it->second;
+        if (kNoTexture != mat.metalness)
+            mat.metalness = it->second;
+    }
+
+    return ret;
+}
+
+void read_vertex_(MeshSource_ const& aMesh, std::size_t aIndex, glm::vec3& aPosition, glm::vec2& aTexcoord, glm::vec3& aNormal, glm::vec4& aTangent)
+{
+    // Sources may be unaligned (mapped files), hence the memcpy()s.
+    if (aMesh.quantized)
+    {
+        QuantizedVertex const v = load_vertex<QuantizedVertex>(aMesh.quantized, aIndex);
+        dequantize_vertex(v, aMesh.aabbMin, aMesh.aabbMax, aPosition, aTexcoord, aNormal, aTangent);
+    }
+    else if (aMesh.interleaved)
+    {
+        InterleavedVertex const v = load_vertex<InterleavedVertex>(aMesh.interleaved, aIndex);
+        aPosition = v.position;
+        aTexcoord = v.texcoord;
+        aNormal = v.normal;
+        aTangent = v.tangent;
+    }
+    else
+    {
+        std::memcpy(&aPosition, static_cast<std::uint8_t const*>(aMesh.positions) + aIndex * 3 * sizeof(float), 3 * sizeof(float));
+        std::memcpy(&aTexcoord, static_cast<std::uint8_t const*>(aMesh.texcoords) + aIndex * 2 * sizeof(float), 2 * sizeof(float));
+        std::memcpy(&aNormal, static_cast<std::uint8_t const*>(aMesh.normals) + aIndex * 3 * sizeof(float), 3 * sizeof(float));
+        std::memcpy(&aTangent, static_cast<std::uint8_t const*>(aMesh.tangents) + aIndex * 4 * sizeof(float), 4 * sizeof(float));
+    }
+}
+
+void write_indices_(std::uint8_t* aDst, void const* aSrc, std::size_t aCount, std::size_t aSrcSize, std::size_t aDstSize)
+{
+    if (aSrcSize == aDstSize)
+    {
+        if (aCount > 0)
+            std::memcpy(aDst, aSrc, aCount * aDstSize);
+        return;
+    }
+
+    assert(sizeof(std::uint16_t) == aDstSize && sizeof(std::uint32_t) == aSrcSize);
+    for (std::size_t i = 0; i < aCount; ++i)
+    {
+        std::uint32_t index;
+        std::memcpy(&index, static_cast<std::uint8_t const*>(aSrc) + i * sizeof(std::uint32_t), sizeof(std::uint32_t));
+
+        std::uint16_t const index16 = static_cast<std::uint16_t>(index);
+        std::memcpy(aDst + i * sizeof(std::uint16_t), &index16, sizeof(std::uint16_t));
+    }
+}
+
+MeshSource_ mesh_source_(MappedBakedModel const& aModel, BakedMeshView const& aMesh)
+{
+    MeshSource_ src{};
+    src.name = aMesh.name.c_str();
+    src.materialId = aMesh.materialId;
+    src.vertexCount = aMesh.vertexCount;
+    src.indexCount = aMesh.indexCount;
+    src.aabbMin = aMesh.aabbMin;
+    src.aabbMax = aMesh.aabbMax;
+    src.positions = aMesh.positions;
+    src.texcoords = aMesh.texcoords;
+    src.normals = aMesh.normals;
+    src.tangents = aMesh.tangents;
+    src.indices = aMesh.indices;
+    src.indexSize = aMesh.indexSize;
+    src.interleaved = aMesh.interleaved;
+    src.quantized = aMesh.quantized;
+    src.packedVertices = aMesh.packedVertices;
+    src.packedIndices = aMesh.packedIndices;
+    src.packedVertexBytes = aMesh.packedVertexBytes;
+    src.packedIndexBytes = aMesh.packedIndexBytes;
+    src.packedQuantized = sizeof(QuantizedVertex) == aMesh.vertexSize;
+    src.meshletCount = aMesh.meshletCount;
+    src.meshletIndexCount = aMesh.meshletIndexCount;
+    src.meshlets = aMesh.meshlets;
+    src.meshletVertices = aMesh.meshletVertices;
+    src.meshletTriangles = aMesh.meshletTriangles;
+    src.lodCount = std::min(aMesh.lodCount, kMaxMeshLods - 1);
+    for (std::uint32_t i = 0; i < src.lodCount; ++i)
+    {
+        auto const& lod = aModel.lods[aMesh.firstLod + i];
+        src.lods[i] = { lod.error, lod.indexCount, lod.indices };
+    }
+    src.occlusion = aMesh.occlusion;
+    return src;
+}
+
+void fill_mesh_(MeshSource_ aMesh, Mesh const& aMeshData, bool aQuantized, bool aMeshlets, std::uint8_t* aVertices, std::uint8_t* aIndices, std::uint8_t* aPositions, std::uint8_t* aLodIndices)
+{
+    assert(!aQuantized || !aPositions);
+    MeshSource_ mesh = aMesh;
+    auto const& meshData = aMeshData;
+    std::size_t const vertexSize = aQuantized
+        ? sizeof(QuantizedVertex)
+        : sizeof(InterleavedVertex);
+
+    // Write straight into the mapped staging memory. Vertices that are
+    // already in the target format are copied (or decompressed) as-is;
+    // everything else is converted vertex by vertex. The packed positions
+    // are taken from the source rather than read back from the staging
+    // memory (which may be write-combined), so compressed vertices are then
+    // decompressed into the heap first.
+    auto* vertexData = aVertices;
+    void const* ready = aQuantized ? mesh.quantized : mesh.interleaved;
+    std::vector<std::uint8_t> unpacked;
+    auto const copy_positions_ = [&] (void const* aInterleaved)
+    {
+        for (std::size_t i = 0; i < mesh.vertexCount && aPositions; ++i)
+            store_vertex(aPositions, i, PositionVertex{ load_vertex<InterleavedVertex>(aInterleaved, i).position });
+    };
+    if (!vertexData)
+    {
+        // Decompressed on the GPU, or none
+        assert(!aPositions);
+    }
+    else if (mesh.packedVertices && mesh.packedQuantized == aQuantized && aPositions)
+    {
+        unpacked.resize(mesh.vertexCount * vertexSize);
+        lut::lz4_decompress(mesh.packedVertices, mesh.packedVertexBytes, unpacked.data(), unpacked.size());
+        if (mesh.vertexCount > 0)
+            std::memcpy(vertexData, unpacked.data(), unpacked.size());
+        copy_positions_(unpacked.data());
+    }
+    else if (mesh.packedVertices && mesh.packedQuantized == aQuantized)
+    {
+        lut::lz4_decompress(mesh.packedVertices, mesh.packedVertexBytes, vertexData, mesh.vertexCount * vertexSize);
+    }
+    else if (ready)
+    {
+        if (mesh.vertexCount > 0)
+            std::memcpy(vertexData, ready, mesh.vertexCount * vertexSize);
+        copy_positions_(ready);
+    }
+    else
+    {
+        // Compressed vertices of the other format are converted after
+        // decompressing them.
+        if (mesh.packedVertices)
+        {
+            unpacked.resize(mesh.vertexCount * (mesh.packedQuantized ? sizeof(QuantizedVertex) : sizeof(InterleavedVertex)));
+            lut::lz4_decompress(mesh.packedVertices, mesh.packedVertexBytes, unpacked.data(), unpacked.size());
+            (mesh.packedQuantized ? mesh.quantized : mesh.interleaved) = unpacked.data();
+        }
 
-        if (auto const res = vkQueueSubmit(aWindow.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res) 
+        for (std::size_t i = 0; i < mesh.vertexCount; ++i)
         {
-            throw lut::Error("Submitting commands\n" "vkQueueSubmit() returned %s", lut::to_string(res));
+            glm::vec3 pos, norm;
+            glm::vec2 tex;
+            glm::vec4 tan;
+            read_vertex_(mesh, i, pos, tex, norm, tan);
+
+            if (aQuantized)
+            {
+                store_vertex(vertexData, i, quantize_vertex(pos, tex, norm, tan, mesh.aabbMin, mesh.aabbMax));
+            }
+            else
+            {
+                if (aPositions)
+                    store_vertex(aPositions, i, PositionVertex{ pos });
+                store_vertex(vertexData, i, InterleavedVertex{ pos, tex, norm, tan });
+            }
         }
+    }
+
+    // Indices stay relative to the mesh; vertexOffset is applied at draw
+    // time. Files may store 32-bit indices for meshes that use 16-bit
+    // ones here; those are narrowed.
+    bool const small = VK_INDEX_TYPE_UINT16 == meshData.indexType;
+    std::size_t const indexSize = small ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+    auto* indexData = aIndices;
+    if (!indexData)
+    {
+        // Decompressed on the GPU, or none
+    }
+    else if (aMeshlets)
+    {
+        auto const* triangles = static_cast<std::uint8_t const*>(mesh.meshletTriangles);
+        auto const* vertices = static_cast<std::uint8_t const*>(mesh.meshletVertices);
 
-        // Wait for commands to finish before we destroy the temporary resources
-        // required for the transfers (staging buffers, command pool, ...)
-        //
-        // The code doesnt destory the resources implicitly C the resources are
-        // destroyed by the destructors of the labutils wrappers for the various
-        // objects once we leave the functions scope.
-        if (auto const res = vkWaitForFences(aWindow.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res) 
+        std::size_t written = 0;
+        for (std::uint32_t i = 0; i < mesh.meshletCount; ++i)
         {
-            throw lut::Error("Waiting for upload to complete\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str());
+            BakedMeshlet src;
+            std::memcpy(&src, static_cast<std::uint8_t const*>(mesh.meshlets) + i * sizeof(BakedMeshlet), sizeof(BakedMeshlet));
+
+            for (std::uint32_t j = 0; j < src.triangleCount * 3; ++j, ++written)
+            {
+                std::uint32_t index;
+                std::memcpy(&index, vertices + (src.vertexOffset + triangles[src.triangleOffset + j]) * sizeof(std::uint32_t), sizeof(std::uint32_t));
+
+                if (small)
+                {
+                    std::uint16_t const index16 = static_cast<std::uint16_t>(index);
+                    std::memcpy(indexData + written * sizeof(std::uint16_t), &index16, sizeof(std::uint16_t));
+                }
+                else
+                {
+                    std::memcpy(indexData + written * sizeof(std::uint32_t), &index, sizeof(std::uint32_t));
+                }
+            }
         }
 
+        assert(written == mesh.indexCount);
+    }
+    else if (mesh.packedIndices && mesh.indexSize == indexSize)
+    {
+        lut::lz4_decompress(mesh.packedIndices, mesh.packedIndexBytes, indexData, std::size_t(mesh.indexCount) * indexSize);
+    }
+    else if (mesh.packedIndices)
+    {
+        unpacked.resize(std::size_t(mesh.indexCount) * mesh.indexSize);
+        lut::lz4_decompress(mesh.packedIndices, mesh.packedIndexBytes, unpacked.data(), unpacked.size());
+        write_indices_(indexData, unpacked.data(), mesh.indexCount, mesh.indexSize, indexSize);
+    }
+    else
+    {
+        write_indices_(indexData, mesh.indices, mesh.indexCount, mesh.indexSize, indexSize);
+    }
+
+    // The LODs follow the full-detail indices
+    auto* const lodBase = aLodIndices ? aLodIndices : indexData + std::size_t(meshData.indexCount) * indexSize;
+    for (std::uint32_t i = 1; i < meshData.lodCount; ++i)
+    {
+        auto* lodData = lodBase + std::size_t(meshData.lods[i].firstIndex - meshData.lods[1].firstIndex) * indexSize;
+        write_indices_(lodData, mesh.lods[i - 1].indices, mesh.lods[i - 1].indexCount, mesh.indexSize, indexSize);
+    }
+}
+
+lut::UploadTicket upload_meshes_(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aLoadCmdPool, std::vector<MeshSource_> const& aMeshes, std::vector<BakedMaterialInfo> const& aMaterials,
+    bool aBindless, bool aQuantized, bool aMeshlets, bool aMeshInstances, bool aStreamedGeometry, GeometryDecompressor const* aDecompressor, ModelPack& aOut)
+{
+    // All meshes share one vertex buffer and one index buffer. Both are
+    // filled through a single lut::UploadBatch (vertices first, then
+    // indices), i.e., with one command buffer, one barrier batch and one
+    // submission; models over kGeometryStagingBytes take one submission per
+    // group of meshes of that size instead (see below). Meshes whose
+    // vertices can be addressed with 16 bits get uint16 indices. With
+    // meshlets, each mesh's indices are rebuilt in meshlet order from the
+    // meshlets' local indices, so that every meshlet is a range of indices.
+    // Otherwise, the LODs of each mesh follow its full-detail indices.
+    lut::StartupPhase phase("mesh upload");
+    std::size_t const meshCount = aMeshes.size();
+    bool const useMeshlets = aMeshlets && std::all_of(aMeshes.begin(), aMeshes.end(), [] (MeshSource_ const& aMesh) {
+        return aMesh.meshletCount > 0 || 0 == aMesh.indexCount;
+    });
+    std::size_t const vertexSize = aQuantized
+        ? sizeof(QuantizedVertex)
+        : sizeof(InterleavedVertex);
+
+    std::size_t totalVertices = 0, totalIndices16 = 0, totalIndices32 = 0;
+    std::vector<std::size_t> indexSpans; // per mesh, LODs included
+    indexSpans.reserve(meshCount);
+    aOut.meshes.reserve(meshCount);
+    for (auto const& mesh : aMeshes)
+    {
+        bool const small = mesh.vertexCount <= std::size_t(std::numeric_limits<std::uint16_t>::max()) + 1;
+        auto& totalIndices = small ? totalIndices16 : totalIndices32;
+
         Mesh meshData;
-        meshData.vertices = std::move(vertexGPU);
-        meshData.indexCount = static_cast<uint32_t>(mesh.indices.size());
-        meshData.indices = std::move(indexGPU);
+        meshData.indexType = small ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        meshData.firstIndex = static_cast<std::uint32_t>(totalIndices);
+        meshData.vertexOffset = static_cast<std::int32_t>(totalVertices);
+        meshData.vertexCount = mesh.vertexCount;
+        meshData.indexCount = mesh.indexCount;
         meshData.matID = mesh.materialId;
+        meshData.aabbMin = mesh.aabbMin;
+        meshData.aabbMax = mesh.aabbMax;
+        meshData.lods[0] = { meshData.firstIndex, meshData.indexCount, 0.f };
+        totalIndices += mesh.indexCount;
+
+        if (!useMeshlets)
+        {
+            for (std::uint32_t i = 0; i < mesh.lodCount; ++i)
+            {
+                meshData.lods[1 + i] = { static_cast<std::uint32_t>(totalIndices), mesh.lods[i].indexCount, mesh.lods[i].error };
+                totalIndices += mesh.lods[i].indexCount;
+            }
+            meshData.lodCount = 1 + mesh.lodCount;
+        }
+
+        if (useMeshlets)
+        {
+            if (mesh.meshletIndexCount != mesh.indexCount)
+                throw lut::Error("Meshlets of mesh %zu have %u indices, expected %u", aOut.meshes.size(), mesh.meshletIndexCount, mesh.indexCount);
+
+            meshData.firstMeshlet = static_cast<std::uint32_t>(aOut.meshlets.size());
+            meshData.meshletCount = mesh.meshletCount;
+
+            // Meshlets are stored back to back, in the order of their local
+            // indices.
+            std::uint32_t firstIndex = meshData.firstIndex;
+            for (std::uint32_t i = 0; i < mesh.meshletCount; ++i)
+            {
+                BakedMeshlet src;
+                std::memcpy(&src, static_cast<std::uint8_t const*>(mesh.meshlets) + i * sizeof(BakedMeshlet), sizeof(BakedMeshlet));
+
+                Meshlet meshlet;
+                meshlet.mesh = static_cast<std::uint32_t>(aOut.meshes.size());
+                meshlet.firstIndex = firstIndex;
+                meshlet.indexCount = src.triangleCount * 3;
+                meshlet.aabbMin = glm::max(src.center - glm::vec3(src.radius), mesh.aabbMin);
+                meshlet.aabbMax = glm::min(src.center + glm::vec3(src.radius), mesh.aabbMax);
+                meshlet.coneApex = src.coneApex;
+                meshlet.coneAxis = src.coneAxis;
+                meshlet.coneCutoff = src.coneCutoff;
+                aOut.meshlets.emplace_back(meshlet);
+
+                firstIndex += meshlet.indexCount;
+            }
+        }
+
+        aOut.meshes.emplace_back(meshData);
+        indexSpans.emplace_back(totalIndices - meshData.firstIndex);
+
+        totalVertices += mesh.vertexCount;
+    }
+
+    // The draws address the buffers with 32-bit vertexOffset and firstIndex
+    // (and Mesh has nothing wider). Streamed geometry is laid out again in
+    // pools of the budget's size, so only whole uploads are limited.
+    if (!aStreamedGeometry && (totalVertices > std::size_t(std::numeric_limits<std::int32_t>::max())
+        || totalIndices16 > std::numeric_limits<std::uint32_t>::max() || totalIndices32 > std::numeric_limits<std::uint32_t>::max()))
+    {
+        throw lut::Error("Model has %zu vertices and %zu indices, more than 32-bit draw offsets reach; stream it instead (--stream-cells)",
+            totalVertices, totalIndices16 + totalIndices32);
+    }
+
+    VkDeviceSize const vertexBytes = VkDeviceSize(totalVertices) * vertexSize;
+    // The uint32 part must start at a multiple of 4 bytes
+    VkDeviceSize const indices32Offset = (VkDeviceSize(totalIndices16) * sizeof(std::uint16_t) + 3) & ~VkDeviceSize(3);
+    VkDeviceSize const indexBytes = indices32Offset + VkDeviceSize(totalIndices32) * sizeof(std::uint32_t);
+    aOut.indices32Offset = indices32Offset;
+
+    if (0 == vertexBytes || 0 == indexBytes)
+        return {};
+
+    // Streamed geometry gets its buffers later (see world_streaming.hpp)
+    VkDeviceSize const uploadVertexBytes = aStreamedGeometry ? 0 : vertexBytes;
+    VkDeviceSize const uploadIndexBytes = aStreamedGeometry ? 0 : indexBytes;
+
+    // Packed positions of fp32 vertices, for the depth-only passes (see
+    // ModelPack::positions)
+    VkDeviceSize const positionBytes = aQuantized || aStreamedGeometry ? 0 : VkDeviceSize(totalVertices) * sizeof(PositionVertex);
+
+    // The indirect draw commands never change, so they are uploaded with the
+    // geometry.
+    auto drawCommands = build_draw_batches_(aMaterials, aBindless, aQuantized || aMeshInstances, aOut);
+    VkDeviceSize const commandBytes = drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+    // Dequantization ranges (and materials) of quantized vertices, or just
+    // the materials (visibility buffer)
+    std::vector<MeshInstance> meshInstances;
+    if (aQuantized || aMeshInstances)
+    {
+        for (auto const& mesh : aOut.meshes)
+        {
+            MeshInstance inst{};
+            inst.boundsMin = mesh.aabbMin;
+            inst.boundsExtent = mesh.aabbMax - mesh.aabbMin;
+            inst.material = mesh.matID;
+            meshInstances.emplace_back(inst);
+        }
+    }
+    VkDeviceSize const instanceBytes = meshInstances.size() * sizeof(MeshInstance);
+
+    // Same for the bindless material table (see set_up_model_()), and for
+    // the materials of the per-material sets, each at an offset that a
+    // uniform buffer descriptor can use.
+    auto const& materialIndices = aOut.hostMaterials;
+    VkDeviceSize const materialBytes = aBindless ? materialIndices.size() * sizeof(MaterialIndices) : 0;
+
+    VkPhysicalDeviceMaintenance3Properties maintenance3{};
+    maintenance3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+    VkPhysicalDeviceProperties2 props2{};
+    props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props2.pNext = &maintenance3;
+    vkGetPhysicalDeviceProperties2(aWindow.physicalDevice, &props2);
+    auto const& props = props2.properties;
+    VkDeviceSize const uniformAlign = std::max<VkDeviceSize>(props.limits.minUniformBufferOffsetAlignment, 1);
+    aOut.materialUniformStride = (sizeof(MaterialIndices) + uniformAlign - 1) / uniformAlign * uniformAlign;
+    VkDeviceSize const uniformBytes = materialIndices.size() * aOut.materialUniformStride;
+
+    // Baked ambient occlusion, a byte per vertex at its index in the vertex
+    // buffer (see vertex_occlusion.glsl). Meshes without get 255 (open).
+    // Every model gets the buffer; without occlusion (or with streamed
+    // geometry, which moves the vertices), its count is 0.
+    bool const hasOcclusion = !aStreamedGeometry && std::any_of(aMeshes.begin(), aMeshes.end(), [] (MeshSource_ const& aMesh) {
+        return nullptr != aMesh.occlusion;
+    });
+    std::size_t const occlusionCount = hasOcclusion ? totalVertices : 0;
+    VkDeviceSize const occlusionBytes = sizeof(std::uint32_t) + std::max<VkDeviceSize>((occlusionCount + 3) & ~std::size_t(3), sizeof(std::uint32_t));
+
+    //create buffers; the visibility buffer's material pass and the
+    //triangle culling (see triangle_culling.hpp) also fetch the geometry
+    //from shaders. With resizable BAR or unified memory (see
+    //lut::Allocator::directUpload), they are mapped, and written directly
+    //instead of through a staging buffer. TRANSFER_SRC lets
+    //lut::Defragmenter move them.
+    VkBufferUsageFlags const copyUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    VkBufferUsageFlags const fetchUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    //ray-query shadows build their acceleration structures from the
+    //vertices and indices, by address (see ray_shadows.hpp)
+    VkBufferUsageFlags const buildUsage = aWindow.caps.rayQuery
+        ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR
+        : 0;
+    VmaAllocationCreateFlags const directFlags = aAllocator.directUpload
+        ? VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
+        : 0;
+    // Each buffer is a single allocation; without sparse binding, that's
+    // the device's limit on the model's geometry
+    if (!aStreamedGeometry && std::max(vertexBytes, indexBytes) > maintenance3.maxMemoryAllocationSize)
+    {
+        throw lut::Error("Model geometry needs a %llu MiB buffer, over the device's %llu MiB allocation limit; stream it instead (--stream-cells)",
+            static_cast<unsigned long long>(std::max(vertexBytes, indexBytes) >> 20), static_cast<unsigned long long>(maintenance3.maxMemoryAllocationSize >> 20));
+    }
+
+    if (!aStreamedGeometry)
+    {
+        aOut.vertices = lut::create_buffer(aAllocator, vertexBytes,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copyUsage | fetchUsage | buildUsage, lut::EMemoryClass::geometry, directFlags);
+        aOut.indices = lut::create_buffer(aAllocator, indexBytes,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | copyUsage | fetchUsage | buildUsage, lut::EMemoryClass::geometry, directFlags);
+    }
+
+    if (positionBytes > 0)
+    {
+        aOut.positions = lut::create_buffer(aAllocator, positionBytes,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry, directFlags);
+    }
+
+    aOut.drawCommands = lut::create_buffer(aAllocator, commandBytes,
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry, directFlags);
+
+    if (materialBytes > 0)
+    {
+        aOut.materialIndices = lut::create_buffer(aAllocator, materialBytes,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry, directFlags);
+    }
+
+    if (instanceBytes > 0)
+    {
+        aOut.meshInstances = lut::create_buffer(aAllocator, instanceBytes,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry, directFlags);
+    }
+    aOut.quantizedVertices = aQuantized;
+
+    if (uniformBytes > 0)
+    {
+        aOut.materialUniforms = lut::create_buffer(aAllocator, uniformBytes,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry, directFlags);
+    }
+
+    aOut.occlusion = lut::create_buffer(aAllocator, occlusionBytes,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry, directFlags);
+    aOut.hasOcclusion = hasOcclusion;
+
+    // Destinations, in the order of the staging buffer
+    constexpr std::size_t kTargets = 8;
+    lut::Buffer* const targets[kTargets] = { &aOut.vertices, &aOut.indices, &aOut.positions, &aOut.drawCommands, &aOut.materialIndices, &aOut.meshInstances, &aOut.materialUniforms, &aOut.occlusion };
+    VkDeviceSize const targetBytes[kTargets] = { uploadVertexBytes, uploadIndexBytes, positionBytes, commandBytes, materialBytes, instanceBytes, uniformBytes, occlusionBytes };
+
+    // Fall back to staging if any buffer ended up outside of the mapped pool
+    bool direct = aAllocator.directUpload;
+    for (std::size_t i = 0; i < kTargets; ++i)
+    {
+        if (targetBytes[i] > 0)
+            direct = direct && lut::mapped_data(aAllocator, *targets[i]);
+    }
+
+    // Consumers of each buffer, for the barriers after the copies
+    VkAccessFlags const targetAccess[kTargets] = { VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_INDEX_READ_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_UNIFORM_READ_BIT, VK_ACCESS_SHADER_READ_BIT };
+    VkPipelineStageFlags const targetStages[kTargets] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT };
+
+    VkDeviceSize const totalBytes = uploadVertexBytes + uploadIndexBytes + positionBytes + commandBytes + materialBytes + instanceBytes + uniformBytes + occlusionBytes;
+    phase.add_bytes(totalBytes);
 
-        ret.meshes.emplace_back(std::move(meshData));
+    // The vertices, indices and positions are staged per group of meshes
+    // (below); the other buffers are small, and go with the first group
+    std::uint8_t* bases[kTargets]{};
+    lut::UploadBatch batch(aWindow, aLoadCmdPool, aAllocator, std::min(totalBytes, kGeometryStagingBytes) + kTargets * 16);
+    if (direct)
+    {
+        for (std::size_t i = 0; i < kTargets; ++i)
+        {
+            if (targetBytes[i] > 0)
+                bases[i] = reinterpret_cast<std::uint8_t*>(lut::mapped_data(aAllocator, *targets[i]));
+        }
+    }
+    else
+    {
+        for (std::size_t i = 3; i < kTargets; ++i)
+        {
+            if (targetBytes[i] > 0)
+                bases[i] = reinterpret_cast<std::uint8_t*>(batch.stage_buffer(targets[i]->buffer, targetBytes[i], targetAccess[i], targetStages[i]));
+        }
     }
 
-    for (auto& texture : aModel.textures) 
+    std::memcpy(bases[3], drawCommands.data(), commandBytes);
+    if (materialBytes > 0)
+        std::memcpy(bases[4], materialIndices.data(), materialBytes);
+    if (instanceBytes > 0)
+        std::memcpy(bases[5], meshInstances.data(), instanceBytes);
+
+    auto* const uniformBase = bases[6];
+    for (std::size_t i = 0; i < materialIndices.size(); ++i)
+        std::memcpy(uniformBase + i * aOut.materialUniformStride, &materialIndices[i], sizeof(MaterialIndices));
+
+    auto* const occlusionBase = bases[7];
+    std::uint32_t const occlusionHeader = static_cast<std::uint32_t>(occlusionCount);
+    std::memcpy(occlusionBase, &occlusionHeader, sizeof(occlusionHeader));
+    std::memset(occlusionBase + sizeof(occlusionHeader), 0xff, occlusionBytes - sizeof(occlusionHeader));
+    for (std::size_t m = 0; m < meshCount && hasOcclusion; ++m)
     {
-        
-        uint32_t textureId = static_cast<uint32_t>(&texture - &aModel.textures[0]);
+        if (aMeshes[m].occlusion)
+            std::memcpy(occlusionBase + sizeof(occlusionHeader) + std::size_t(aOut.meshes[m].vertexOffset), aMeshes[m].occlusion, aMeshes[m].vertexCount);
+    }
 
-        VkFormat format = get_texture_format(aModel, textureId); 
-        
+    // Compressed arrays that are already in the buffers' format (not
+    // narrowed, nor in meshlet order) are decompressed on the GPU when
+    // staged, with aDecompressor: they are left out of the staging ranges,
+    // and uploaded as they are (see gpu_decompression.hpp). The LODs of a
+    // mesh whose indices are aren't compressed, and stay on the CPU.
+    std::vector<char> gpuVertices(meshCount, 0), gpuIndices(meshCount, 0);
+    std::vector<CompressedArray> packedVertices, packedIndices;
+    if (aDecompressor && !direct && !aStreamedGeometry && std::max(vertexBytes, indexBytes) <= kMaxGpuDecompressionBytes)
+    {
+        for (std::size_t m = 0; m < meshCount; ++m)
+        {
+            auto const& mesh = aMeshes[m];
+            auto const& meshData = aOut.meshes[m];
+            std::size_t const indexSize = VK_INDEX_TYPE_UINT16 == meshData.indexType ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+            VkDeviceSize const indexOffset = (VK_INDEX_TYPE_UINT16 == meshData.indexType ? 0 : indices32Offset) + VkDeviceSize(meshData.firstIndex) * indexSize;
+            VkDeviceSize const indexSpan = VkDeviceSize(mesh.indexCount) * indexSize;
+
+            if (mesh.packedVertices && mesh.packedQuantized == aQuantized && 0 == positionBytes && mesh.vertexCount > 0 && 0 == vertexSize % 4)
+            {
+                gpuVertices[m] = 1;
+                packedVertices.emplace_back(CompressedArray{ mesh.packedVertices, std::size_t(mesh.packedVertexBytes),
+                    VkDeviceSize(meshData.vertexOffset) * vertexSize, VkDeviceSize(mesh.vertexCount) * vertexSize });
+            }
+            if (mesh.packedIndices && !useMeshlets && mesh.indexSize == indexSize && mesh.indexCount > 0 && 0 == indexOffset % 4 && 0 == indexSpan % 4)
+            {
+                gpuIndices[m] = 1;
+                packedIndices.emplace_back(CompressedArray{ mesh.packedIndices, std::size_t(mesh.packedIndexBytes), indexOffset, indexSpan });
+            }
+        }
+    }
 
-        Texture texData;
-        lut::Image image;
-        lut::ImageView view;
+    // Meshes write disjoint parts of the staging buffer, so they are filled
+    // in parallel. Compressed meshes are decompressed here (unless on the
+    // GPU, above). Consecutive
+    // meshes occupy one range of vertices and one range of each index part,
+    // so a group of them is staged as (up to) three ranges. Groups before
+    // the last are submitted and waited for right away, so the staging
+    // memory stays bounded by kGeometryStagingBytes for models of any size.
+    // Arrays decompressed on the GPU split the ranges around them. Mapped
+    // buffers are written in place, in the same groups.
+    auto& fillers = lut::shared_jobs();
+    auto const index_size_ = [&] (std::size_t m) -> std::size_t {
+        return VK_INDEX_TYPE_UINT16 == aOut.meshes[m].indexType ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+    };
+    for (std::size_t first = 0; first < meshCount && !aStreamedGeometry; )
+    {
+        // [first, end): at least one mesh, up to kGeometryStagingBytes
+        std::size_t end = first;
+        VkDeviceSize groupBytes = 0;
+        while (end < meshCount)
+        {
+            auto const& meshData = aOut.meshes[end];
+            VkDeviceSize const positionSize = positionBytes > 0 ? sizeof(PositionVertex) : 0;
+            VkDeviceSize const bytes = VkDeviceSize(meshData.vertexCount) * (vertexSize + positionSize) + VkDeviceSize(indexSpans[end]) * index_size_(end);
+            if (end > first && groupBytes + bytes > kGeometryStagingBytes)
+                break;
+
+            groupBytes += bytes;
+            ++end;
+        }
 
-        if (format == VK_FORMAT_R8_UNORM) 
+        // Where each mesh's vertices, full-detail indices, LOD indices and
+        // positions go
+        std::vector<std::uint8_t*> vertexPtrs(end - first), indexPtrs(end - first), lodPtrs(end - first), positionPtrs(end - first);
+        if (direct)
         {
-            image = lut::load_single_chanel_image_texture2d(texture.path.c_str(), aWindow, aLoadCmdPool, aAllocator, format);  
-            view = lut::create_image_view_texture2d(aWindow, image.image, format); 
+            for (std::size_t m = first; m < end; ++m)
+            {
+                auto const& meshData = aOut.meshes[m];
+                std::size_t const vertex = std::size_t(meshData.vertexOffset);
+                vertexPtrs[m - first] = bases[0] + vertex * vertexSize;
+                if (positionBytes > 0)
+                    positionPtrs[m - first] = bases[2] + vertex * sizeof(PositionVertex);
+                indexPtrs[m - first] = VK_INDEX_TYPE_UINT16 == meshData.indexType
+                    ? bases[1] + std::size_t(meshData.firstIndex) * sizeof(std::uint16_t)
+                    : bases[1] + std::size_t(indices32Offset) + std::size_t(meshData.firstIndex) * sizeof(std::uint32_t);
+                lodPtrs[m - first] = indexPtrs[m - first] + std::size_t(meshData.indexCount) * index_size_(m);
+            }
         }
         else
         {
-            image = lut::load_image_texture2d(texture.path.c_str(), aWindow, aLoadCmdPool, aAllocator, format); 
-            view = lut::create_image_view_texture2d(aWindow, image.image, format);  
+            auto const stage_ = [&] (std::size_t aTarget, VkDeviceSize aOffset, VkDeviceSize aBytes) -> std::uint8_t* {
+                if (0 == aBytes)
+                    return nullptr;
+                return reinterpret_cast<std::uint8_t*>(batch.stage_buffer(targets[aTarget]->buffer, aBytes, targetAccess[aTarget], targetStages[aTarget], aOffset));
+            };
+
+            // Consecutive vertices that are filled here form one range
+            for (std::size_t m = first; m < end; )
+            {
+                if (gpuVertices[m])
+                {
+                    ++m;
+                    continue;
+                }
+
+                std::size_t last = m;
+                while (last < end && !gpuVertices[last])
+                    ++last;
+
+                std::size_t const runFirst = std::size_t(aOut.meshes[m].vertexOffset);
+                std::size_t const runEnd = std::size_t(aOut.meshes[last - 1].vertexOffset) + aOut.meshes[last - 1].vertexCount;
+                auto* const vertexBase = stage_(0, VkDeviceSize(runFirst) * vertexSize, VkDeviceSize(runEnd - runFirst) * vertexSize);
+                auto* const positionBase = positionBytes > 0
+                    ? stage_(2, VkDeviceSize(runFirst) * sizeof(PositionVertex), VkDeviceSize(runEnd - runFirst) * sizeof(PositionVertex))
+                    : nullptr;
+                for (; m < last; ++m)
+                {
+                    std::size_t const vertex = std::size_t(aOut.meshes[m].vertexOffset) - runFirst;
+                    vertexPtrs[m - first] = vertexBase ? vertexBase + vertex * vertexSize : nullptr;
+                    positionPtrs[m - first] = positionBase ? positionBase + vertex * sizeof(PositionVertex) : nullptr;
+                }
+            }
+
+            // Same for the indices, per part. A mesh whose full-detail
+            // indices are decompressed on the GPU contributes its LODs.
+            for (auto const type : { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 })
+            {
+                std::size_t const indexSize = VK_INDEX_TYPE_UINT16 == type ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+                VkDeviceSize const partOffset = VK_INDEX_TYPE_UINT16 == type ? 0 : indices32Offset;
+
+                std::vector<std::size_t> runMeshes;
+                std::size_t runBegin = 0, runEnd = 0;
+                auto const flush_ = [&] {
+                    auto* const base = stage_(1, partOffset + VkDeviceSize(runBegin) * indexSize, VkDeviceSize(runEnd - runBegin) * indexSize);
+                    for (auto const m : runMeshes)
+                    {
+                        auto const& meshData = aOut.meshes[m];
+                        std::size_t const lodIndex = std::size_t(meshData.firstIndex) + meshData.indexCount;
+                        if (!gpuIndices[m])
+                            indexPtrs[m - first] = base + (std::size_t(meshData.firstIndex) - runBegin) * indexSize;
+                        lodPtrs[m - first] = base + (lodIndex - runBegin) * indexSize;
+                    }
+                    runMeshes.clear();
+                };
+
+                for (std::size_t m = first; m < end; ++m)
+                {
+                    auto const& meshData = aOut.meshes[m];
+                    if (type != meshData.indexType)
+                        continue;
+
+                    std::size_t const cpuBegin = std::size_t(meshData.firstIndex) + (gpuIndices[m] ? meshData.indexCount : 0);
+                    std::size_t const cpuEnd = std::size_t(meshData.firstIndex) + indexSpans[m];
+                    if (cpuBegin == cpuEnd)
+                        continue;
+
+                    if (!runMeshes.empty() && cpuBegin != runEnd)
+                        flush_();
+                    if (runMeshes.empty())
+                        runBegin = cpuBegin;
+                    runEnd = cpuEnd;
+                    runMeshes.emplace_back(m);
+                }
+                if (!runMeshes.empty())
+                    flush_();
+            }
         }
 
+        fillers.parallel_for(end - first, [&] (std::size_t i)
+        {
+            auto const m = first + i;
+            fill_mesh_(aMeshes[m], aOut.meshes[m], aQuantized, useMeshlets,
+                gpuVertices[m] ? nullptr : vertexPtrs[i], gpuIndices[m] ? nullptr : indexPtrs[i], positionPtrs[i], lodPtrs[i]);
+        });
+
+        first = end;
+        if (!direct && first < meshCount)
+            batch.submit().wait();
+    }
 
-        texData.image = std::move(image);
-        texData.view = std::move(view);
+    if (direct)
+    {
+        // Host writes become visible to the device with the next queue
+        // submission; nothing to copy. (Flushing is a no-op for coherent
+        // memory.)
+        for (std::size_t i = 0; i < kTargets; ++i)
+        {
+            if (targetBytes[i] > 0)
+                vmaFlushAllocation(aAllocator.allocator, targets[i]->allocation, 0, VK_WHOLE_SIZE);
+        }
 
-        ret.textures.emplace_back(std::move(texData));
+        aOut.hostDrawCommands = std::move(drawCommands);
+        return {};
     }
 
-    //create descriptor sets for every material
+    // Disjoint from the staged ranges, so in a submission of its own
+    if (!packedVertices.empty() || !packedIndices.empty())
+        decompress_geometry(*aDecompressor, aWindow, aAllocator, aLoadCmdPool, aOut.vertices.buffer, packedVertices, aOut.indices.buffer, packedIndices);
+
+    aOut.hostDrawCommands = std::move(drawCommands);
+    return batch.submit();
+}
+
+TexturePrefetch load_textures_(std::vector<TextureSource> const& aTextures, lut::FileReader* aReader)
+{
+    // The jobs copy their source, as they may outlive the caller if it
+    // throws. With aReader, all files are requested at once, and each job
+    // starts once its file has arrived.
+    TexturePrefetch ret;
+    ret.paths = texture_paths_(aTextures);
+
+    auto& jobs = lut::shared_jobs();
+    for (std::size_t i = 0; i < aTextures.size(); ++i)
+    {
+        auto const& tex = aTextures[i];
+        auto const& path = tex.path.empty() ? tex.greenPath : tex.path;
+        if (!tex.packed && lut::is_texture_file(tex.path.c_str()))
+        {
+            auto const load = [src = tex, path] (lut::MappedFile aFile) {
+                auto const start = lut::StartupClock::now();
+                auto baked = aFile.data() ? lut::load_texture_file(std::move(aFile), src.path.c_str()) : lut::load_texture_file(src.path.c_str());
+                if (src.recordedFormat && src.format != baked.format)
+                    throw lut::Error("%s: texture file has VkFormat %d, but the model lists %d; bake the model again", src.path.c_str(), int(baked.format), int(src.format));
+
+                lut::add_startup_item("texture decode", path, lut::StartupClock::now() - start, baked.bytes.size());
+                return baked;
+            };
+
+            ret.bakedIds.emplace_back(i);
+            if (aReader)
+                ret.bakedTasks.emplace_back(lut::then(aReader->read(tex.path), load));
+            else
+                ret.bakedTasks.emplace_back(lut::async(jobs, [load] { return load(lut::MappedFile()); }));
+        }
+        else
+        {
+            auto const decode = [src = tex, path] (lut::MappedFile aFile) {
+                auto const start = lut::StartupClock::now();
+                auto const path_ = [] (std::string const& aPath) { return aPath.empty() ? nullptr : aPath.c_str(); };
+                std::uint32_t const channels = VK_FORMAT_R8_UNORM == src.format ? 1 : 4;
+                auto decoded = src.packed
+                    ? lut::decode_packed_image(path_(src.path), path_(src.greenPath))
+                    : aFile.data()
+                    ? lut::decode_image_memory(aFile.data(), aFile.size(), channels, src.path.c_str())
+                    : lut::decode_image(src.path.c_str(), channels);
+                lut::add_startup_item("texture decode", path, lut::StartupClock::now() - start, decoded.pixels.size());
+                return decoded;
+            };
+
+            // Packed textures combine two files; they are mapped
+            ret.decodedIds.emplace_back(i);
+            if (aReader && !tex.packed)
+                ret.decodeTasks.emplace_back(lut::then(aReader->read(tex.path), decode));
+            else
+                ret.decodeTasks.emplace_back(lut::async(jobs, [decode] { return decode(lut::MappedFile()); }));
+        }
+    }
 
-    std::vector<VkDescriptorSet> matDescs;
-    uint32_t materialCount = static_cast<uint32_t>(aModel.materials.size());
-    matDescs.resize(materialCount);
-    std::vector<VkDescriptorSetLayout> layouts(materialCount, descLayout);
+    return ret;
+}
 
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = aDesPool;
-    allocInfo.descriptorSetCount = materialCount;
-    allocInfo.pSetLayouts = layouts.data();
+std::vector<std::string> texture_paths_(std::vector<TextureSource> const& aTextures)
+{
+    std::vector<std::string> ret;
+    ret.reserve(aTextures.size());
+    for (auto const& tex : aTextures)
+        ret.emplace_back(tex.path + '|' + tex.greenPath);
+    return ret;
+}
 
-    if (auto const res = vkAllocateDescriptorSets(aWindow.device, &allocInfo, matDescs.data()); VK_SUCCESS != res) 
+ModelPack set_up_model_(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, std::vector<BakedTextureInfo> const& aTextures,
+    std::vector<BakedMaterialInfo> const& aMaterials, BakedImpostors const& aImpostors, std::vector<MeshSource_> const& aMeshes,
+    VkCommandPool& aLoadCmdPool, lut::DescriptorAllocator& aDescriptors, VkSampler& aSampler, VkDescriptorSetLayout& descLayout,
+    VkDescriptorSetLayout aBindlessLayout, lut::AsyncUploader* aUploader, bool aQuantizedVertices, bool aMeshlets, bool aMeshInstances, std::uint32_t aStreamExtent, bool aStreamedGeometry,
+    bool aTextureArrays, TextureCompressor const* aCompressor, lut::FileReader* aReader, GeometryDecompressor const* aDecompressor, DescriptorBufferSets* aDescriptorBuffer, TexturePrefetch* aPrefetched, lut::MipDownsampler* aMips, bool aLazyTextures)
+{
+    LUT_CPU_ZONE("set_up_model()");
+    ModelPack ret;
+    bool const bindless = VK_NULL_HANDLE != aBindlessLayout;
+    if (aTextureArrays && (bindless || aUploader))
+        throw lut::Error("set_up_model(): texture arrays need the textures up front, and per-material sets");
+
+    ret.hostMaterials = build_material_indices_(aMaterials);
+    ret.impostors = aImpostors;
+    auto const textures = plan_textures_(aTextures, aMaterials, ret.hostMaterials, ret.impostors.meshes);
+
+    // Without streaming, all textures are decoded (or, for baked texture
+    // files, read) as jobs, starting now unless they were prefetched, so
+    // that the CPU work overlaps with staging the geometry below; they are
+    // collected once the textures are uploaded. Baked texture files are
+    // fitted to the device's formats once loaded.
+    TexturePrefetch loads;
+    if (!aUploader)
     {
-        throw lut::Error("Allocating descriptor sets\n" "vkAllocateDescriptorSets() returned %s", lut::to_string(res).c_str());
+        if (aPrefetched && aPrefetched->paths == texture_paths_(textures))
+            loads = std::move(*aPrefetched);
+        else
+            loads = load_textures_(textures, aReader);
+
+        for (std::size_t i = 0; i < loads.bakedIds.size(); ++i)
+        {
+            loads.bakedTasks[i] = lut::then(std::move(loads.bakedTasks[i]), [&aWindow, path = textures[loads.bakedIds[i]].path] (lut::MipImageData aBaked) {
+                auto const start = lut::StartupClock::now();
+                if (lut::fit_texture_format(aWindow, aBaked, path.c_str()))
+                    lut::add_startup_item("texture decode", path, lut::StartupClock::now() - start, aBaked.bytes.size());
+                return aBaked;
+            });
+        }
     }
+    auto const& decodedIds = loads.decodedIds;
+    auto const& bakedIds = loads.bakedIds;
+    auto& decodeTasks = loads.decodeTasks;
+    auto& bakedTasks = loads.bakedTasks;
+
+    // The geometry transfers overlap with setting up the textures
+    lut::UploadTicket geometry = upload_meshes_(aWindow, aAllocator, aLoadCmdPool, aMeshes, aMaterials, bindless, aQuantizedVertices, aMeshlets, aMeshInstances, aStreamedGeometry, aDecompressor, ret);
+
+    // Shared by all texture uploads below
+    lut::StagingRing staging(aWindow, aAllocator, kTextureStagingBytes);
+
+    // Baked textures in block formats that the device can't sample are
+    // decoded when loaded (see lut::fit_texture_format())
+    std::vector<VkFormat> transcoded;
+    std::vector<TextureExtent_> extents(textures.size());
+    ret.textureFormats.resize(textures.size());
+    for (std::size_t i = 0; i < textures.size(); ++i)
+    {
+        ret.textureFormats[i] = textures[i].format;
+        if (!textures[i].recordedFormat || lut::supports_sampled_format(aWindow, textures[i].format))
+            continue;
 
-    Texture dummyNomalMapTex = load_dummy_normal_map(aWindow, aAllocator, aLoadCmdPool);
-    ret.textures.emplace_back(std::move(dummyNomalMapTex));
+        ret.textureFormats[i] = lut::uncompressed_texture_format(textures[i].format);
+        if (transcoded.end() == std::find(transcoded.begin(), transcoded.end(), textures[i].format))
+        {
+            transcoded.emplace_back(textures[i].format);
+            std::fprintf(stderr, "Info: the device can't sample VkFormat %d; textures in it are decoded to VkFormat %d when loaded\n", int(textures[i].format), int(ret.textureFormats[i]));
+        }
+    }
 
-    for (uint32_t i = 0; i < materialCount; ++i)
+    if (aUploader)
     {
-        VkDescriptorImageInfo imageInfo[4]{};
+        // Stream the textures; until they arrive, materials sample a 1x1
+        // placeholder of the texture's format (see texture_view_()).
+        VkFormat const placeholderFormats[3] = { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8B8A8_UNORM };
+        lut::ImageData placeholders[3];
+        placeholders[0] = lut::ImageData{ 1, 1, 4, { 128, 128, 128, 255 } }; // mid grey
+        placeholders[1] = lut::ImageData{ 1, 1, 1, { 128 } };
+        placeholders[2] = lut::ImageData{ 1, 1, 4, { 128, 128, 255, 255 } }; // flat normal
+
+        std::vector<lut::Image> images = lut::upload_image_textures2d(aWindow, aLoadCmdPool, aAllocator, staging, placeholders, placeholderFormats, 3);
+        for (std::size_t i = 0; i < images.size(); ++i)
+        {
+            Texture texData;
+            texData.view = lut::create_image_view_texture2d(aWindow, images[i].image, placeholderFormats[i]);
+            texData.image = std::move(images[i]);
+            ret.placeholders.emplace_back(std::move(texData));
+        }
 
-        for (uint32_t j = 0; j < 4; ++j)
+        ret.textures.resize(textures.size());
+        ret.textureSources = textures;
+        if (!aLazyTextures)
         {
-            imageInfo[j].sampler = aSampler;
-            imageInfo[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            for (std::size_t i = 0; i < textures.size(); ++i)
+                stream_model_texture(ret, *aUploader, static_cast<std::uint32_t>(i), aStreamExtent);
+        }
+    }
+    else
+    {
+        // Collect the decoded textures (see above), then upload them in as
+        // few submissions as possible (see lut::upload_image_textures2d()).
+        // Baked textures bring their mip levels along and skip the blits.
+        std::vector<lut::ImageData> decoded;
+        std::vector<lut::MipImageData> baked;
+        {
+            // The decode time that didn't overlap with the geometry; the
+            // items are each job's own time and the decoded bytes
+            lut::StartupPhase phase("texture decode");
+            for (auto& task : decodeTasks)
+                decoded.emplace_back(task.get());
+            for (auto& task : bakedTasks)
+                baked.emplace_back(task.get());
         }
-        imageInfo[0].imageView = ret.textures[aModel.materials[i].baseColorTextureId].view.handle;
-        imageInfo[1].imageView = ret.textures[aModel.materials[i].roughnessTextureId].view.handle;
-        imageInfo[2].imageView = ret.textures[aModel.materials[i].metalnessTextureId].view.handle;
-        if (aModel.materials[i].normalMapTextureId != 0xffffffff)
-            imageInfo[3].imageView = ret.textures[aModel.materials[i].normalMapTextureId].view.handle;
-        else
-            imageInfo[3].imageView = ret.textures.back().view.handle;
 
-        VkWriteDescriptorSet desc[4]{};
-        for (uint32_t j = 0; j < 4; ++j)
+        std::vector<VkFormat> decodedFormats;
+        for (auto const id : decodedIds)
+            decodedFormats.emplace_back(ret.textureFormats[id]);
+        for (std::size_t i = 0; i < bakedIds.size(); ++i)
+            ret.textureFormats[bakedIds[i]] = baked[i].format;
+
+        for (std::size_t i = 0; i < decodedIds.size(); ++i)
+            extents[decodedIds[i]] = { decoded[i].width, decoded[i].height, lut::compute_mip_level_count(decoded[i].width, decoded[i].height) };
+        for (std::size_t i = 0; i < bakedIds.size(); ++i)
+            extents[bakedIds[i]] = { baked[i].width, baked[i].height, static_cast<std::uint32_t>(baked[i].levelOffsets.size()) };
+
+        lut::StartupPhase uploadPhase("texture upload");
+        for (auto const& image : decoded)
+            uploadPhase.add_bytes(image.pixels.size());
+        for (auto const& image : baked)
+            uploadPhase.add_bytes(image.bytes.size());
+
+        std::vector<char> opaque;
+        if (aCompressor)
         {
-            desc[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            desc[j].dstSet = matDescs[i];
-            desc[j].dstBinding = j;
-            desc[j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            desc[j].descriptorCount = 1;
-            desc[j].pImageInfo = &imageInfo[j];
+            for (auto const& image : decoded)
+                opaque.emplace_back(lut::is_opaque(image));
+        }
+
+        std::vector<lut::Image> decodedImages = lut::upload_image_textures2d(aWindow, aLoadCmdPool, aAllocator, staging, decoded.data(), decodedFormats.data(), decoded.size(), aMips);
+        decoded.clear();
+        std::vector<lut::Image> bakedImages = lut::upload_mip_textures2d(aWindow, aLoadCmdPool, aAllocator, staging, baked.data(), baked.size());
+        baked.clear();
+        uploadPhase.end();
+
+        // Block-compress the decoded textures on the GPU (see
+        // gpu_compression.hpp); the baked ones are compressed already, or
+        // were decoded because the device can't sample their format
+        if (aCompressor)
+        {
+            lut::StartupPhase compressPhase("texture compression");
+            std::vector<CompressibleTexture> compressible;
+            for (std::size_t i = 0; i < decodedIds.size(); ++i)
+            {
+                auto const& extent = extents[decodedIds[i]];
+                compressible.emplace_back(CompressibleTexture{ &decodedImages[i], &ret.textureFormats[decodedIds[i]], extent.width, extent.height, 0 != opaque[i] });
+            }
+
+            if (auto const saved = compress_textures(*aCompressor, aWindow, aAllocator, aLoadCmdPool, compressible); saved > 0)
+                std::fprintf(stderr, "Info: compressed the decoded textures on the GPU, saving %.1f MiB\n", double(saved) / (1 << 20));
         }
 
-        constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
-        vkUpdateDescriptorSets(aWindow.device, numSets, desc, 0, nullptr);
-      
+        ret.textures.resize(textures.size());
+        auto const add_view = [&] (std::size_t aId, lut::Image&& aImage)
+        {
+            Texture& texData = ret.textures[aId];
+            texData.view = lut::create_image_view_texture2d(aWindow, aImage.image, ret.textureFormats[aId]);
+            texData.image = std::move(aImage);
+        };
+
+        for (std::size_t i = 0; i < decodedImages.size(); ++i)
+            add_view(decodedIds[i], std::move(decodedImages[i]));
+        for (std::size_t i = 0; i < bakedImages.size(); ++i)
+            add_view(bakedIds[i], std::move(bakedImages[i]));
+    }
+
+    // Filler for the constant slots of the per-material sets
+    lut::UploadBatch fillerBatch(aWindow, aLoadCmdPool, aAllocator, 256);
+    Texture fillerTex = load_dummy_normal_map(aWindow, aAllocator, fillerBatch);
+    lut::UploadTicket filler = fillerBatch.submit();
+    ret.textures.emplace_back(std::move(fillerTex));
+    ret.textureFormats.emplace_back(VK_FORMAT_R8G8B8A8_UNORM);
+    extents.emplace_back(TextureExtent_{ 1, 1, 1 });
+    for (auto const& extent : extents)
+        ret.textureExtents.emplace_back(VkExtent2D{ extent.width, extent.height });
+
+    for (auto const& tex : textures)
+    {
+        auto const& path = tex.path.empty() ? tex.greenPath : tex.path;
+        ret.textureNames.emplace_back(path.substr(path.find_last_of("/\\") + 1));
+    }
+    ret.textureNames.emplace_back("filler");
+
+    for (std::size_t i = 0; i < aMaterials.size(); ++i)
+        ret.materialNames.emplace_back(aMaterials[i].name.empty() ? "material " + std::to_string(i) : aMaterials[i].name);
+    for (std::size_t i = 0; i < aMeshes.size(); ++i)
+        ret.meshNames.emplace_back(*aMeshes[i].name ? std::string(aMeshes[i].name) : "mesh " + std::to_string(i));
+
+    //create descriptor sets for every material
+    lut::StartupPhase descriptorPhase("descriptor setup");
+
+    // The allocator grows by another pool when the materials don't fit.
+    // Texture arrays have their sets written once packed.
+    if (aTextureArrays)
+    {
+        filler.wait();
+        pack_texture_arrays_(aWindow, aAllocator, aLoadCmdPool, aDescriptors, descLayout, extents, ret);
+    }
+    else
+    {
+        ret.matDecriptors = aDescriptors.allocate_sets(descLayout, aMaterials.size());
+        ret.materialTemplate = material_template_(aWindow, descLayout);
+    }
+
+    // Single descriptor set holding every texture; materials index into it
+    if (bindless && aDescriptorBuffer)
+    {
+        auto& buffer = aDescriptorBuffer->buffer;
+        ret.descriptorBuffer = aDescriptorBuffer;
+        ret.bindlessSet = buffer.allocate(buffer.set_size(aBindlessLayout, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<std::uint32_t>(ret.textures.size())));
     }
+    else if (bindless)
+        ret.bindlessDescriptors = aDescriptors.allocate(aBindlessLayout, static_cast<std::uint32_t>(ret.textures.size()));
+
+    write_model_descriptors_(aWindow, ret, aSampler);
+    name_model_resources_(aWindow, ret);
+    descriptorPhase.end();
 
-    ret.matDecriptors = std::move(matDescs);
+    // Whatever of the geometry upload did not overlap with the above
+    lut::StartupPhase waitPhase("upload wait");
+    filler.wait();
+    geometry.wait();
 
     return ret;
 
 }
 
-VkFormat get_texture_format(const BakedModel& aModel, uint32_t textureId)
+void pack_texture_arrays_(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, lut::DescriptorAllocator& aDescriptors,
+    VkDescriptorSetLayout aLayout, std::vector<TextureExtent_> const& aExtents, ModelPack& aModel)
 {
-    for (auto& material : aModel.materials) {
-        if (textureId == material.baseColorTextureId || textureId == material.roughnessTextureId ||
-            textureId == material.metalnessTextureId || textureId == material.normalMapTextureId) {
-            if (textureId == material.baseColorTextureId) { 
-                return VK_FORMAT_R8G8B8A8_SRGB; 
-            }
-            else if (textureId == material.roughnessTextureId || textureId == material.metalnessTextureId) { 
-                return VK_FORMAT_R8_UNORM; 
-            }
-            else if (textureId == material.normalMapTextureId) { 
-                return VK_FORMAT_R8G8B8A8_UNORM; 
+    LUT_CPU_ZONE("pack_texture_arrays_()");
+
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(aWindow.physicalDevice, &props);
+
+    // The textures of a material's slots, by binding (see
+    // write_model_descriptors_()); constant slots sample the filler
+    std::uint32_t const filler = static_cast<std::uint32_t>(aModel.textures.size() - 1);
+    auto const slot_textures = [&] (MaterialIndices const& aMat, std::uint32_t (&aOut)[4])
+    {
+        std::uint32_t const ids[4] = { aMat.baseColor, kNoTexture != aMat.roughness ? aMat.roughness : aMat.metalness, aMat.normalMap, aMat.alphaMask };
+        for (std::size_t i = 0; i < 4; ++i)
+            aOut[i] = kNoTexture != ids[i] ? ids[i] : filler;
+    };
+
+    // Group by extent, level count and format, in the order the materials
+    // use them; a full array starts another
+    struct Group
+    {
+        TextureExtent_ extent;
+        VkFormat format;
+        std::vector<std::uint32_t> textures; // by layer
+    };
+    std::vector<Group> groups;
+    std::vector<std::uint32_t> arrayOf(aModel.textures.size(), ~std::uint32_t(0)), layerOf(aModel.textures.size(), 0);
+    for (auto const& mat : aModel.hostMaterials)
+    {
+        std::uint32_t ids[4];
+        slot_textures(mat, ids);
+        for (auto const id : ids)
+        {
+            if (~std::uint32_t(0) != arrayOf[id])
+                continue;
+
+            auto const& extent = aExtents[id];
+            auto const format = aModel.textureFormats[id];
+            auto const group = std::find_if(groups.begin(), groups.end(), [&] (Group const& aGroup) {
+                return aGroup.extent.width == extent.width && aGroup.extent.height == extent.height && aGroup.extent.levels == extent.levels
+                    && aGroup.format == format && aGroup.textures.size() < props.limits.maxImageArrayLayers;
+            });
+
+            arrayOf[id] = static_cast<std::uint32_t>(group - groups.begin());
+            if (groups.end() == group)
+                groups.emplace_back(Group{ extent, format, {} });
+
+            layerOf[id] = static_cast<std::uint32_t>(groups[arrayOf[id]].textures.size());
+            groups[arrayOf[id]].textures.emplace_back(id);
+        }
+    }
+
+    // Copy every level of every texture into its layer
+    lut::UploadBatch batch(aWindow, aCmdPool, aAllocator, 256);
+    VkCommandBuffer const cmd = batch.commands();
+
+    for (auto const& group : groups)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = group.format;
+        imageInfo.extent = VkExtent3D{ group.extent.width, group.extent.height, 1 };
+        imageInfo.mipLevels = group.extent.levels;
+        imageInfo.arrayLayers = static_cast<std::uint32_t>(group.textures.size());
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        Texture array;
+        array.image = lut::create_image(aAllocator, imageInfo, lut::EMemoryClass::textures);
+
+        VkImageSubresourceRange const all{ VK_IMAGE_ASPECT_COLOR_BIT, 0, imageInfo.mipLevels, 0, imageInfo.arrayLayers };
+        lut::image_barrier(cmd, array.image.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, all);
+
+        std::vector<VkImageCopy> copies(imageInfo.mipLevels);
+        for (std::uint32_t layer = 0; layer < imageInfo.arrayLayers; ++layer)
+        {
+            VkImage const src = aModel.textures[group.textures[layer]].image.image;
+            lut::image_barrier(cmd, src, 0, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, imageInfo.mipLevels, 0, 1 });
+
+            for (std::uint32_t level = 0; level < imageInfo.mipLevels; ++level)
+            {
+                auto& copy = copies[level];
+                copy.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+                copy.dstSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, layer, 1 };
+                copy.extent = VkExtent3D{ std::max(1u, group.extent.width >> level), std::max(1u, group.extent.height >> level), 1 };
             }
+
+            vkCmdCopyImage(cmd, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, array.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<std::uint32_t>(copies.size()), copies.data());
+        }
+
+        lut::image_barrier(cmd, array.image.image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, all);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = array.image.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.format = group.format;
+        viewInfo.subresourceRange = all;
+
+        VkImageView view = VK_NULL_HANDLE;
+        if (auto const res = vkCreateImageView(aWindow.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
+            throw lut::Error("Unable to create texture array view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str());
+        array.view = lut::ImageView(aWindow.device, view);
+
+        aModel.textureArrays.emplace_back(std::move(array));
+    }
+
+    batch.submit().wait();
+
+    // The packed textures are only sampled through the arrays now
+    for (std::size_t i = 0; i < aModel.textures.size(); ++i)
+    {
+        if (~std::uint32_t(0) != arrayOf[i])
+            aModel.textures[i] = Texture{};
+    }
+
+    // A set per combination of arrays; the materials' layers go to their
+    // pushed MaterialIndices
+    std::vector<std::array<std::uint32_t, 4>> combinations;
+    for (auto const& mat : aModel.hostMaterials)
+    {
+        std::uint32_t ids[4];
+        slot_textures(mat, ids);
+
+        std::array<std::uint32_t, 4> const arrays{ arrayOf[ids[0]], arrayOf[ids[1]], arrayOf[ids[2]], arrayOf[ids[3]] };
+        auto const found = std::find(combinations.begin(), combinations.end(), arrays);
+        aModel.materialSets.emplace_back(static_cast<std::uint32_t>(found - combinations.begin()));
+        if (combinations.end() == found)
+            combinations.emplace_back(arrays);
+
+        MaterialIndices layers = mat;
+        auto const layer = [&] (std::uint32_t aId) { return kNoTexture != aId ? layerOf[aId] : kNoTexture; };
+        layers.baseColor = layer(mat.baseColor);
+        layers.roughness = layer(mat.roughness);
+        layers.metalness = layer(mat.metalness);
+        layers.normalMap = layer(mat.normalMap);
+        layers.alphaMask = layer(mat.alphaMask);
+        aModel.arrayMaterials.emplace_back(layers);
+    }
+
+    aModel.matDecriptors = aDescriptors.allocate_sets(aLayout, combinations.size());
+    for (std::size_t i = 0; i < combinations.size(); ++i)
+    {
+        // Bindings 0-2 and 4, as write_model_descriptors_(); the shaders
+        // don't read the uniforms at binding 3
+        VkDescriptorImageInfo imageInfo[4]{};
+        VkWriteDescriptorSet desc[4]{};
+        for (std::uint32_t j = 0; j < 4; ++j)
+        {
+            imageInfo[j].imageView = aModel.textureArrays[combinations[i][j]].view.handle;
+            imageInfo[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            desc[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            desc[j].dstSet = aModel.matDecriptors[i];
+            desc[j].dstBinding = j < 3 ? j : 4;
+            desc[j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            desc[j].descriptorCount = 1;
+            desc[j].pImageInfo = &imageInfo[j];
         }
+
+        vkUpdateDescriptorSets(aWindow.device, 4, desc, 0, nullptr);
     }
-    return VK_FORMAT_R8G8B8A8_SRGB;
 
+    std::fprintf(stderr, "Info: %zu textures packed into %zu texture arrays, %zu material sets for %zu materials\n",
+        std::size_t(std::count_if(arrayOf.begin(), arrayOf.end(), [] (std::uint32_t aArray) { return ~std::uint32_t(0) != aArray; })),
+        groups.size(), combinations.size(), aModel.hostMaterials.size());
 }
 
-Texture load_dummy_normal_map(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool& aCmdPool)
+lut::DescriptorUpdateTemplate material_template_(lut::VulkanWindow const& aWindow, VkDescriptorSetLayout aLayout)
 {
-    std::uint32_t width = 1, height = 1;
-    std::uint8_t data[4] = { 128, 128, 255, 255 };//0,0,1,1
+    // Bindings 0-2 and 4 (alpha mask) are textures, 3 the uniforms
+    VkDescriptorUpdateTemplateEntry entries[5]{};
+    for (std::uint32_t j = 0; j < 4; ++j)
+    {
+        auto& entry = entries[j];
+        entry.dstBinding = j < 3 ? j : 4;
+        entry.descriptorCount = 1;
+        entry.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        entry.offset = offsetof(MaterialDescriptors_, images) + j * sizeof(VkDescriptorImageInfo);
+    }
 
+    entries[4].dstBinding = 3;
+    entries[4].descriptorCount = 1;
+    entries[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    entries[4].offset = offsetof(MaterialDescriptors_, uniforms);
 
-    // Create staging buffer and copy image data to it
-    auto const sizeInBytes = width * height * 4;
-    auto staging = create_buffer(aAllocator, sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    return lut::create_descriptor_update_template(aWindow, aLayout, 5, entries);
+}
 
-    void* sptr = nullptr;
-    if (auto const res = vmaMapMemory(aAllocator.allocator, staging.allocation, &sptr); VK_SUCCESS != res) 
+void write_model_descriptors_(lut::VulkanWindow const& aWindow, ModelPack const& aModel, VkSampler aSampler, std::vector<std::uint32_t> const* aTextureIds)
+{
+    // Which textures changed, if only some did
+    std::vector<bool> changed;
+    if (aTextureIds)
+    {
+        changed.assign(aModel.textures.size(), false);
+        for (auto const id : *aTextureIds)
+            changed[id] = true;
+    }
+    auto const uses_changed = [&] (MaterialIndices const& aMat) {
+        for (auto const id : { aMat.baseColor, aMat.roughness, aMat.metalness, aMat.normalMap, aMat.alphaMask })
+        {
+            if (kNoTexture != id && changed[id])
+                return true;
+        }
+        return false;
+    };
+
+    // Texture arrays' sets never change (see pack_texture_arrays_()). The
+    // others are packed for the material template, and written in one go.
+    std::size_t const materialSets = aModel.arrayMaterials.empty() ? aModel.matDecriptors.size() : 0;
+    std::vector<MaterialDescriptors_> materials;
+    std::vector<VkDescriptorSet> sets;
+    materials.reserve(materialSets);
+    sets.reserve(materialSets);
+    for (std::size_t i = 0; i < materialSets; ++i)
     {
-        throw lut::Error("Mapping memory for writing\n""vmaMapMemory() returned %s", lut::to_string(res).c_str());
+        auto const& mat = aModel.hostMaterials[i];
+        if (aTextureIds && !uses_changed(mat))
+            continue;
+
+        // The material layout has the sampler built in (immutable), so only
+        // the views are written
+        MaterialDescriptors_ desc{};
+        for (auto& image : desc.images)
+            image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc.images[0].imageView = texture_view_(aModel, mat.baseColor);
+        desc.images[1].imageView = texture_view_(aModel, kNoTexture != mat.roughness ? mat.roughness : mat.metalness); // packed
+        desc.images[2].imageView = texture_view_(aModel, mat.normalMap);
+        desc.images[3].imageView = texture_view_(aModel, mat.alphaMask);
+
+        desc.uniforms.buffer = aModel.materialUniforms.buffer;
+        desc.uniforms.offset = i * aModel.materialUniformStride;
+        desc.uniforms.range = sizeof(MaterialIndices);
+
+        materials.emplace_back(desc);
+        sets.emplace_back(aModel.matDecriptors[i]);
     }
 
-    std::memcpy(sptr, data, sizeInBytes);
-    vmaUnmapMemory(aAllocator.allocator, staging.allocation); 
+    if (!sets.empty())
+        lut::update_descriptor_sets(aWindow, aModel.materialTemplate.handle, sets.size(), sets.data(), materials.data(), sizeof(MaterialDescriptors_));
 
-    lut::Image image = lut::create_image_texture2d(aAllocator, width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-    VkCommandBuffer cbuff = lut::alloc_command_buffer(aWindow, aCmdPool);
+    if (VK_NULL_HANDLE == aModel.bindlessDescriptors && !aModel.descriptorBuffer)
+        return;
 
-    VkCommandBufferBeginInfo beginInfo{}; 
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO; 
-    beginInfo.flags = 0; 
-    beginInfo.pInheritanceInfo = nullptr; 
+    std::uint32_t const textureCount = static_cast<std::uint32_t>(aModel.textures.size());
 
-    if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+    std::vector<VkDescriptorImageInfo> imageInfos(textureCount);
+    for (std::uint32_t i = 0; i < textureCount; ++i)
     {
-        throw lut::Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+        imageInfos[i].sampler = aSampler;
+        imageInfos[i].imageView = texture_view_(aModel, i);
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
-    // Transition image layout
-    lut::image_barrier(cbuff, image.image, 0,
-        VK_ACCESS_TRANSFER_WRITE_BIT, 
-        VK_IMAGE_LAYOUT_UNDEFINED, 
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
-        VK_PIPELINE_STAGE_TRANSFER_BIT, 
-        VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } 
-    );
 
-    // Upload data from staging buffer to image
-    VkBufferImageCopy copy; 
-    copy.bufferOffset = 0; 
-    copy.bufferRowLength = 0; 
-    copy.bufferImageHeight = 0; 
-    copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }; 
-    copy.imageOffset = VkOffset3D{ 0, 0, 0 }; 
-    copy.imageExtent = VkExtent3D{ width, height, 1 }; 
+    VkDescriptorBufferInfo materialInfo{};
+    materialInfo.buffer = aModel.materialIndices.buffer;
+    materialInfo.range = lut::descriptor_range(aModel.materialIndices);
 
-    vkCmdCopyBufferToImage(cbuff, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+    // In a descriptor buffer, rewriting a texture is a memory write of its
+    // descriptor; the others stay as they are
+    if (auto const* sets = aModel.descriptorBuffer)
+    {
+        auto const layout = sets->bindlessLayout.handle;
+        if (aTextureIds)
+        {
+            std::vector<VkWriteDescriptorSet> desc(aTextureIds->size());
+            for (std::size_t i = 0; i < desc.size(); ++i)
+            {
+                desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                desc[i].dstBinding = 1;
+                desc[i].dstArrayElement = (*aTextureIds)[i];
+                desc[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                desc[i].descriptorCount = 1;
+                desc[i].pImageInfo = &imageInfos[(*aTextureIds)[i]];
+            }
 
-    // Transition image layout for shader read
-    lut::image_barrier(cbuff, image.image,
-        VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_ACCESS_SHADER_READ_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
-    );
+            sets->buffer.write(aModel.bindlessSet, layout, static_cast<std::uint32_t>(desc.size()), desc.data());
+            return;
+        }
 
-    //End command recording
-    if (auto const res = vkEndCommandBuffer(cbuff); VK_SUCCESS != res)
-    {
-        throw lut::Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+        VkWriteDescriptorSet desc[2]{};
+        desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        desc[0].dstBinding = 0;
+        desc[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        desc[0].descriptorCount = 1;
+        desc[0].pBufferInfo = &materialInfo;
+
+        desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        desc[1].dstBinding = 1;
+        desc[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        desc[1].descriptorCount = textureCount;
+        desc[1].pImageInfo = imageInfos.data();
+
+        sets->buffer.write(aModel.bindlessSet, layout, 2, desc);
+        return;
     }
 
-    lut::Fence uploadComplete = lut::create_fence(aWindow);
+    VkWriteDescriptorSet desc[2]{};
+    desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    desc[0].dstSet = aModel.bindlessDescriptors;
+    desc[0].dstBinding = 0;
+    desc[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    desc[0].descriptorCount = 1;
+    desc[0].pBufferInfo = &materialInfo;
+
+    desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    desc[1].dstSet = aModel.bindlessDescriptors;
+    desc[1].dstBinding = 1;
+    desc[1].dstArrayElement = 0;
+    desc[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    desc[1].descriptorCount = textureCount;
+    desc[1].pImageInfo = imageInfos.data();
+
+    constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
+    vkUpdateDescriptorSets(aWindow.device, numSets, desc, 0, nullptr);
+}
+
+void name_model_resources_(lut::VulkanWindow const& aWindow, ModelPack const& aModel)
+{
+    if (!aWindow.haveDebugUtils)
+        return;
+
+    lut::set_name(aWindow, aModel.vertices, "model vertices");
+    lut::set_name(aWindow, aModel.positions, "model positions");
+    lut::set_name(aWindow, aModel.indices, "model indices");
+    lut::set_name(aWindow, aModel.drawCommands, "model draw commands");
+    lut::set_name(aWindow, aModel.materialIndices, "model materials (bindless)");
+    lut::set_name(aWindow, aModel.materialUniforms, "model materials");
+    lut::set_name(aWindow, aModel.meshInstances, "model mesh instances");
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cbuff;
+    if (VK_NULL_HANDLE != aModel.bindlessDescriptors)
+        lut::set_name(aWindow, aModel.bindlessDescriptors, "bindless materials");
 
-    if (auto const res = vkQueueSubmit(aWindow.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res)
+    for (std::size_t i = 0; i < aModel.matDecriptors.size(); ++i)
     {
-        throw lut::Error("Submitting command\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str());
+        auto const name = aModel.arrayMaterials.empty() ? aModel.materialNames[i] : "texture array set " + std::to_string(i);
+        lut::set_name(aWindow, aModel.matDecriptors[i], name.c_str());
     }
 
-    if (auto const res = vkWaitForFences(aWindow.device, 1, &uploadComplete.handle,
-        VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+    for (std::size_t i = 0; i < aModel.textureArrays.size(); ++i)
+    {
+        auto const name = "texture array " + std::to_string(i);
+        lut::set_name(aWindow, aModel.textureArrays[i].image, name.c_str());
+        lut::set_name(aWindow, aModel.textureArrays[i].view, name.c_str());
+    }
+
+    for (std::size_t i = 0; i < aModel.textures.size(); ++i)
+        name_texture_(aWindow, aModel, i);
+
+    for (std::size_t i = 0; i < aModel.placeholders.size(); ++i)
     {
-        throw lut::Error("waiting for upload to complete\n""vkWaitForFences() returned %s", lut::to_string(res).c_str());
+        auto const name = "placeholder " + std::to_string(i);
+        lut::set_name(aWindow, aModel.placeholders[i].image, name.c_str());
+        lut::set_name(aWindow, aModel.placeholders[i].view, name.c_str());
     }
-    // Return resulting image
-    // Most temporary resources are destroyed automatically through their
-    // destructors. However, the command buffer we must free manually.
-    vkFreeCommandBuffers(aWindow.device, aCmdPool, 1, &cbuff);
+}
+
+void name_texture_(lut::VulkanWindow const& aWindow, ModelPack const& aModel, std::size_t aId)
+{
+    assert(aId < aModel.textureNames.size());
+
+    // Streamed textures have no image until they arrive
+    auto const& tex = aModel.textures[aId];
+    lut::set_name(aWindow, tex.image, aModel.textureNames[aId].c_str());
+    lut::set_name(aWindow, tex.view, aModel.textureNames[aId].c_str());
+}
+}
+
+TexturePrefetch prefetch_model_textures(MappedBakedModel const& aModel, lut::FileReader* aReader)
+{
+    auto indices = build_material_indices_(aModel.materials);
+    auto impostors = aModel.impostors.meshes;
+    return load_textures_(plan_textures_(aModel.textures, aModel.materials, indices, impostors), aReader);
+}
+
+TexturePrefetch prefetch_model_textures(BakedModel const& aModel, lut::FileReader* aReader)
+{
+    auto indices = build_material_indices_(aModel.materials);
+    auto impostors = aModel.impostors.meshes;
+    return load_textures_(plan_textures_(aModel.textures, aModel.materials, indices, impostors), aReader);
+}
+
+std::size_t model_texture_count(MappedBakedModel const& aModel)
+{
+    auto indices = build_material_indices_(aModel.materials);
+    auto impostors = aModel.impostors.meshes;
+    return plan_textures_(aModel.textures, aModel.materials, indices, impostors).size() + 1; // + filler
+}
+
+std::size_t model_texture_count(BakedModel const& aModel)
+{
+    auto indices = build_material_indices_(aModel.materials);
+    auto impostors = aModel.impostors.meshes;
+    return plan_textures_(aModel.textures, aModel.materials, indices, impostors).size() + 1;
+}
+
+Texture load_dummy_normal_map(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::UploadBatch& aBatch)
+{
+    lut::ImageData data;
+    data.width = data.height = 1;
+    data.channels = 4;
+    data.pixels = { 128, 128, 255, 255 };//0,0,1,1
+
+    lut::Image image = lut::create_image_texture2d(aAllocator, data.width, data.height, VK_FORMAT_R8G8B8A8_UNORM);
+    aBatch.upload_image(image.image, data);
 
     lut::ImageView view = lut::create_image_view_texture2d(aWindow, image.image, VK_FORMAT_R8G8B8A8_UNORM);
 
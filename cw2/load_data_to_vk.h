@@ -1,14 +1,31 @@
 #pragma once
+#include <string>
+#include <vector>
 #include <cstdint>
 
+#include <glm/mat4x4.hpp>
+
 #include "../labutils/vulkan_context.hpp"
 
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/descriptor_template.hpp"
 #include "baked_model.hpp"
 #include "../labutils/vkimage.hpp"
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vulkan_window.hpp"
+#include "../labutils/staging_ring.hpp"
+#include "../labutils/upload_batch.hpp"
+#include "../labutils/async_uploader.hpp"
+#include "../labutils/file_reader.hpp"
+#include "../labutils/mip_downsampler.hpp"
+#include "../labutils/task.hpp"
+#include "../labutils/defragmenter.hpp"
+#include "vertex_layout.hpp"
+#include "gpu_compression.hpp"
+#include "gpu_decompression.hpp"
+#include "descriptor_buffer_sets.hpp"
 namespace lut = labutils;
 
 struct Texture {
@@ -17,24 +34,397 @@ struct Texture {
 };
 
 
+// Index range of one level of detail of a mesh. The LODs of a mesh share
+// its vertices, and are stored right after its full-detail indices.
+struct MeshLod {
+	std::uint32_t firstIndex = 0;
+	std::uint32_t indexCount = 0;
+	float error = 0.f; // object space deviation from the full-detail mesh
+};
+
+constexpr std::uint32_t kMaxMeshLods = 4; // including the full-detail mesh
+
+// Range of a single mesh within the ModelPack's shared geometry buffers.
+// firstIndex is relative to the part of ModelPack::indices for indexType.
 struct Mesh {
-	lut::Buffer vertices; // pos(3), tex(2), norm(3), tangent(4)
-	lut::Buffer indices;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	std::uint32_t firstIndex = 0;
+	std::int32_t vertexOffset = 0;
 	std::uint32_t indexCount = 0;
 	std::uint32_t matID = 0;
+	std::uint32_t vertexCount = 0;
+
+	// Object space bounds, for culling
+	glm::vec3 aabbMin{ 0.f };
+	glm::vec3 aabbMax{ 0.f };
+
+	// Range in ModelPack::meshlets; empty unless the model was set up with
+	// meshlets
+	std::uint32_t firstMeshlet = 0;
+	std::uint32_t meshletCount = 0;
+
+	// lods[0] is the full-detail mesh (firstIndex, indexCount). Files
+	// without LODs, and models set up with meshlets, only have that one.
+	std::uint32_t lodCount = 1;
+	MeshLod lods[kMaxMeshLods];
+};
+
+// A meshlet (see baked_meshlet.hpp) as drawn: a range of its mesh's indices,
+// which are stored in meshlet order. firstIndex is absolute, like
+// Mesh::firstIndex.
+struct Meshlet {
+	std::uint32_t mesh = 0;
+	std::uint32_t firstIndex = 0;
+	std::uint32_t indexCount = 0;
+
+	// Object space bounds (the bounding sphere's box, clipped to the mesh's)
+	glm::vec3 aabbMin{ 0.f };
+	glm::vec3 aabbMax{ 0.f };
+
+	// Normal cone; never culled if coneCutoff > 1
+	glm::vec3 coneApex{ 0.f };
+	glm::vec3 coneAxis{ 0.f, 0.f, 1.f };
+	float coneCutoff = 2.f;
+};
+
+// A texture as set up for the model: one of the file, or, for files baked
+// before roughness and metalness were packed, a pair of their one-channel
+// textures that is packed while decoding (see lut::decode_packed_image()).
+struct TextureSource {
+	std::string path;      // packed: roughness, may be empty
+	std::string greenPath; // packed: metalness, may be empty
+	bool packed = false;
+	EBakedTextureRole role = EBakedTextureRole::baseColor;
+
+	// Recorded by the baker (see 9. in baked_model.hpp) and final, or, for
+	// older files, the decoded format; baked texture files then bring their
+	// own.
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	bool recordedFormat = false;
+};
+
+// Texture index of material slots without a texture
+constexpr std::uint32_t kNoTexture = kBakedNoTexture;
+
+// Texture indices and constants of one material for the shaders (matches
+// struct Material in cw2/shaders/material.glsl, std140 and std430). Slots
+// whose index is kNoTexture use the constant and are never sampled; a
+// missing normal map means the flat normal.
+struct MaterialIndices {
+	std::uint32_t baseColor;
+	std::uint32_t roughness;
+	std::uint32_t metalness;
+	std::uint32_t normalMap;
+	glm::vec4 baseColorConstant; // linear RGB, alpha
+	float roughnessConstant;
+	float metalnessConstant;
+	std::uint32_t alphaMask; // kNoTexture: opaque
+	std::uint32_t alphaChannel; // of alphaMask holding the mask
+};
+
+// Offset of the MaterialIndices that the texture arrays' shaders take from
+// the push constants (see ModelPack::arrayMaterials); the pipelines' own
+// push constants come before it. Must match the shaders.
+constexpr std::uint32_t kMaterialPushOffset = 64;
+
+// Per-mesh data for quantized vertices (see quantized_vertex.hpp), one
+// entry per mesh. Fetched as per-instance vertex attributes from binding 1;
+// the draws pass the mesh index as firstInstance.
+struct MeshInstance {
+	glm::vec3 boundsMin;
+	std::uint32_t material; // used by the bindless shaders
+	glm::vec3 boundsExtent;
+	float pad;
+};
+
+template<> struct VertexLayout<MeshInstance>
+{
+	static constexpr VertexAttribute kAttributes[] = {
+		VERTEX_ATTRIBUTE( MeshInstance, boundsMin, 4 ),
+		VERTEX_ATTRIBUTE( MeshInstance, boundsExtent, 5 ),
+		VERTEX_ATTRIBUTE( MeshInstance, material, 6 )
+	};
+};
+static_assert( valid_vertex_layout<MeshInstance>() );
+
+// Start of ModelPack::instances (UInstances in cw2/shaders/instances.glsl,
+// std430); the transforms follow, as glm::mat4[count]
+struct ModelInstancesHeader {
+	std::uint32_t count;
+	std::uint32_t pad[3];
+};
+
+// Contiguous range of VkDrawIndexedIndirectCommands in ModelPack::drawCommands
+// that all use the same material and index type
+struct DrawBatch {
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	std::uint32_t matID = 0;
+	std::uint32_t firstCommand = 0;
+	std::uint32_t commandCount = 0;
 };
 
 struct ModelPack {
+	lut::Buffer vertices; // all meshes; InterleavedVertex or QuantizedVertex
+	lut::Buffer indices;  // all meshes; relative to Mesh::vertexOffset
+	// The positions of `vertices` alone, 3 floats each, for the passes that
+	// only need the position (depth pre-pass, shadows): a third of the
+	// bandwidth of the interleaved stream. fp32 vertices only (a quantized
+	// vertex is small already), and not with streamed geometry; null otherwise.
+	lut::Buffer positions;
 	std::vector<Mesh> meshes;
+
+	// BVH over the meshes' bounds (see baked_bvh.hpp), from the baked file;
+	// empty if it has none
+	BakedBvh bvh;
+
+	// Potentially visible sets of the meshes (see baked_pvs.hpp), from the
+	// baked file; empty if it has none
+	BakedPvs pvs;
+
+	// Impostors of the meshes (see baked_impostors.hpp), from the baked
+	// file, with their texture indices into `textures`; empty if it has none
+	BakedImpostors impostors;
+
+	// Meshes with at most 65536 vertices use uint16 indices, stored at the
+	// start of `indices`; the uint32 indices of the other meshes follow at
+	// indices32Offset (which is where they have to be bound).
+	VkDeviceSize indices32Offset = 0;
+
+	// Indirect draw commands for all meshes, built once at load time. The
+	// opaque batches come first, followed by the alpha-masked ones; within
+	// each, the uint16 batches come before the uint32 ones.
+	lut::Buffer drawCommands;
+	std::vector<DrawBatch> opaqueBatches;
+	std::vector<DrawBatch> alphaBatches;
+
+	// CPU copy of drawCommands, and the index (into meshes) of the mesh drawn
+	// by each command; used to compact the commands after culling.
+	std::vector<VkDrawIndexedIndirectCommand> hostDrawCommands;
+	std::vector<std::uint32_t> drawCommandMeshes;
+
+	// With meshlets, every draw command draws a single meshlet, and
+	// drawCommandMeshlets holds its index into meshlets. Both are empty
+	// otherwise.
+	std::vector<Meshlet> meshlets;
+	std::vector<std::uint32_t> drawCommandMeshlets;
+
+	// Bindless materials; only set up if a bindless layout is passed to
+	// set_up_model(). The draw commands then carry the material index in
+	// firstInstance.
+	lut::Buffer materialIndices; // MaterialIndices[]
+	VkDescriptorSet bindlessDescriptors = VK_NULL_HANDLE;
+	// --descriptor-buffer: the bindless set is at bindlessSet of
+	// descriptorBuffer instead (and bindlessDescriptors is null)
+	DescriptorBufferSets const* descriptorBuffer = nullptr;
+	VkDeviceSize bindlessSet = 0;
 	std::vector<VkDescriptorSet> matDecriptors;
-	std::vector<Texture> textures;
+	std::vector<Texture> textures; // see model_texture_count()
+
+	// Writes a per-material set from a packed struct of its descriptors
+	// (see write_model_descriptors_()); not with texture arrays
+	lut::DescriptorUpdateTemplate materialTemplate;
+
+	// The MaterialIndices of the per-material descriptor sets (binding 4),
+	// one every materialUniformStride bytes
+	lut::Buffer materialUniforms;
+	VkDeviceSize materialUniformStride = 0;
+
+	// Texture arrays (see set_up_model()): the materials' textures, packed
+	// into one 2D array image per size, level count and format. The model's
+	// Texture of a packed texture is then empty. matDecriptors holds one set
+	// per combination of arrays that a material uses, with their
+	// VK_IMAGE_VIEW_TYPE_2D_ARRAY views (and without the uniforms), and
+	// materialSets the set of every material. The shaders take the
+	// material from the push constants instead, as arrayMaterials: its
+	// MaterialIndices with the layers in place of the texture indices.
+	// All empty unless set up with texture arrays.
+	std::vector<Texture> textureArrays;
+	std::vector<std::uint32_t> materialSets;
+	std::vector<MaterialIndices> arrayMaterials;
+
+	// Texture indices and constants of every material. The last texture is
+	// a 1x1 filler that the per-material sets bind to their constant slots
+	// (descriptors must be valid even if they aren't sampled).
+	std::vector<MaterialIndices> hostMaterials;
+
+	// Format of every texture. Textures that are still streaming in (see
+	// set_up_model()) have no view yet; the descriptors use the placeholder
+	// of their format instead.
+	std::vector<VkFormat> textureFormats;
+	std::vector<Texture> placeholders;
+
+	// Size of every texture's image (its level 0); 0x0 until it has streamed
+	// in, and for virtual textures
+	std::vector<VkExtent2D> textureExtents;
+
+	// Where the streamed textures come from, to request them again (see
+	// stream_model_texture()); empty if they were loaded up front
+	std::vector<TextureSource> textureSources;
+
+	// Quantized vertices need the meshInstances bound at binding 1, and the
+	// firstInstance of every draw command is the mesh index. The same holds
+	// for fp32 vertices if meshInstances exists (see set_up_model()).
+	bool quantizedVertices = false;
+	lut::Buffer meshInstances; // MeshInstance[]
+
+	// Copies of the whole model (see set_model_instances()): every draw
+	// command draws instanceCount instances, which the fp32 vertex shaders
+	// place by their transform in instances
+	std::uint32_t instanceCount = 1;
+	lut::Buffer instances; // ModelInstancesHeader, then glm::mat4[instanceCount]
+
+	// Baked ambient occlusion (cw2-bake --bake-ao), read by the fp32 and
+	// quantized vertex shaders at gl_VertexIndex (see
+	// shaders/vertex_occlusion.glsl): a uint32_t count, then a byte per
+	// vertex of `vertices`. The count is 0 if the model has none.
+	lut::Buffer occlusion;
+	bool hasOcclusion = false;
+
+	// Names for captures (see lut::set_name() and lut::DebugLabel): the
+	// file name of every texture, and the material and mesh names of the
+	// baked file ("material N" and "mesh N" if it has none)
+	std::vector<std::string> textureNames;
+	std::vector<std::string> materialNames;
+	std::vector<std::string> meshNames;
+};
+
+
+
+// Start-up: the model's textures, read and decoded as jobs before there is a
+// device to upload them to (see prefetch_model_textures()). set_up_model()
+// takes them over if they are still the textures it plans; the baked texture
+// files are then fitted to the device's formats.
+struct TexturePrefetch {
+	std::vector<std::string> paths; // of the planned textures, in order
+	std::vector<std::size_t> decodedIds, bakedIds;
+	std::vector<lut::Task<lut::ImageData>> decodeTasks;
+	std::vector<lut::Task<lut::MipImageData>> bakedTasks;
 };
 
+// Starts reading and decoding the textures that set_up_model() would load
+// up front (no uploader), through aReader if set; needs no Vulkan objects.
+TexturePrefetch prefetch_model_textures(MappedBakedModel const&, lut::FileReader* aReader = nullptr);
+TexturePrefetch prefetch_model_textures(BakedModel const&, lut::FileReader* aReader = nullptr);
+
+// The material layout's texture bindings must have an immutable sampler; the
+// sampler argument is used for the bindless textures only.
+// aBindlessLayout: optional layout with a material SSBO at binding 0 and a
+// variable-sized sampler array at binding 1; see ModelPack::bindlessDescriptors
+// aUploader: if set, the textures are handed to it and stream in later (see
+// update_model_textures()); the model starts out with 1x1 placeholders.
+// Otherwise, all textures are loaded before returning.
+// aQuantizedVertices: upload QuantizedVertex instead of fp32 vertices. Both
+// kinds of baked files can be uploaded either way.
+// aMeshlets: draw (and cull) per meshlet rather than per mesh; ignored unless
+// every mesh of the file has meshlets (see ModelPack::meshlets).
+// aMeshInstances: set up meshInstances (and pass the mesh index as
+// firstInstance) for fp32 vertices too; for the visibility buffer (see
+// visibility.hpp). The vertex and index buffers are always readable as
+// storage buffers.
+// aStreamExtent: with aUploader, the textures first stream in with at most
+// this many texels per side (0: full size); see texture_streaming.hpp.
+// aTextureArrays: pack the materials' textures into texture arrays (see
+// ModelPack::textureArrays), for devices without descriptor indexing; not
+// with aUploader or aBindlessLayout. The textures that no material slot
+// uses (the impostors') stay as they are.
+// aCompressor: block-compress the decoded (not baked) textures on the GPU
+// once they are loaded (see gpu_compression.hpp); not for streamed
+// textures, which the caller compresses as they arrive.
+// aReader: read the textures that aren't streamed through it (see
+// file_reader.hpp), each decoded as soon as it has arrived; null: map them.
+// aDecompressor: decompress the LZ4 vertex and index arrays of compressed
+// files on the GPU where no conversion is needed (see
+// gpu_decompression.hpp); not with mapped (resizable BAR) geometry buffers.
+// aDescriptorBuffer: put the bindless set in its buffer (see
+// ModelPack::bindlessSet); aBindlessLayout must then be its bindlessLayout.
+// The model keeps a pointer to it.
+// aPrefetched: the textures, already on their way (see TexturePrefetch);
+// without aUploader only. Left empty if taken over.
+// aMips: generate the levels of the decoded textures with its single-pass
+// compute shader rather than blits, where it supports their formats (see
+// lut::upload_image_textures2d()).
+// aLazyTextures: with aUploader, request none of the textures; they are
+// requested as their materials become visible (see lazy_materials.hpp).
+ModelPack set_up_model(lut::VulkanWindow const&, lut::Allocator const&, BakedModel const&, VkCommandPool&, lut::DescriptorAllocator&, VkSampler&, VkDescriptorSetLayout&,
+	VkDescriptorSetLayout aBindlessLayout = VK_NULL_HANDLE, lut::AsyncUploader* aUploader = nullptr, bool aQuantizedVertices = false, bool aMeshlets = false, bool aMeshInstances = false, std::uint32_t aStreamExtent = 0,
+	bool aTextureArrays = false, TextureCompressor const* aCompressor = nullptr, lut::FileReader* aReader = nullptr,
+	GeometryDecompressor const* aDecompressor = nullptr, DescriptorBufferSets* aDescriptorBuffer = nullptr, TexturePrefetch* aPrefetched = nullptr, lut::MipDownsampler* aMips = nullptr, bool aLazyTextures = false);
+// Zero-copy variant: vertex and index data is copied from the mapped file
+// straight into the staging buffer.
+// aStreamedGeometry: lay out the meshes (Mesh, the draw commands), but
+// create no vertex and index buffers; the meshes are then written on demand
+// with write_model_mesh() (see world_streaming.hpp).
+ModelPack set_up_model(lut::VulkanWindow const&, lut::Allocator const&, MappedBakedModel const&, VkCommandPool&, lut::DescriptorAllocator&, VkSampler&, VkDescriptorSetLayout&,
+	VkDescriptorSetLayout aBindlessLayout = VK_NULL_HANDLE, lut::AsyncUploader* aUploader = nullptr, bool aQuantizedVertices = false, bool aMeshlets = false, bool aMeshInstances = false, std::uint32_t aStreamExtent = 0,
+	bool aStreamedGeometry = false, bool aTextureArrays = false, TextureCompressor const* aCompressor = nullptr, lut::FileReader* aReader = nullptr,
+	GeometryDecompressor const* aDecompressor = nullptr, DescriptorBufferSets* aDescriptorBuffer = nullptr, TexturePrefetch* aPrefetched = nullptr, lut::MipDownsampler* aMips = nullptr, bool aLazyTextures = false);
+
+// Writes the Mesh::vertexCount vertices of mesh aMesh to aVertices, and its
+// indices (LODs included, in its index type, starting with the one at its
+// firstIndex) to aIndices. For models set up from aSource without meshlets.
+// Thread safe.
+void write_model_mesh(MappedBakedModel const& aSource, ModelPack const&, std::uint32_t aMesh, void* aVertices, void* aIndices);
+
+// Requests texture aId of the model (again) from aUploader, with at most
+// aMaxExtent texels per side (0: full size). Only for models set up with an
+// uploader.
+void stream_model_texture(ModelPack const&, lut::AsyncUploader&, std::uint32_t aId, std::uint32_t aMaxExtent);
+
+// View of texture aId of the model; its placeholder while it's still
+// streaming (kNoTexture: the filler). Not for textures packed into texture
+// arrays. E.g., for descriptor sets of other
+// modules, which are rewritten after update_model_textures().
+VkImageView model_texture_view(ModelPack const&, std::uint32_t aId);
+
+// Swaps streamed textures in for their placeholders and rewrites the
+// model's descriptor sets. The sets must not be in use by the GPU.
+void update_model_textures(lut::VulkanWindow const&, ModelPack&, VkSampler, std::vector<lut::AsyncUploader::Completed>);
+
+// A view for texture aId of an image that the model doesn't own, e.g., a
+// sparse image of virtual_textures.hpp; the image must outlive the model's
+// use of the view. The image is in SHADER_READ_ONLY_OPTIMAL wherever it is
+// sampled.
+struct ModelTextureView {
+	std::uint32_t id = 0;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	lut::ImageView view;
+};
+
+// Installs the views in place of the textures' own images (or placeholders)
+// and rewrites the model's descriptor sets, as update_model_textures().
+void set_model_texture_views(lut::VulkanWindow const&, ModelPack&, VkSampler, std::vector<ModelTextureView>);
+
+// Lets lut::Defragmenter move the model's buffers and textures (placeholders
+// and texture arrays excepted). Call after set_up_model(), and again whenever
+// textures have been swapped in.
+void allow_model_moves(lut::Allocator const&, ModelPack const&);
+// Replaces the handles of the moved buffers and textures, recreates the
+// views of the textures and rewrites the model's descriptor sets. Returns
+// false if none of the moves belong to the model.
+bool relocate_model_resources(lut::VulkanWindow const&, ModelPack&, VkSampler, std::vector<lut::Defragmenter::Move> const&);
 
+// Draws the model aTransforms.size() times (hardware instancing): every draw
+// command gets that instanceCount, and its firstInstance becomes its key (the
+// bindless material, or 0) times the count (see instances.glsl). The
+// transforms are rigid or uniformly scaled. The meshes' bounds become the
+// union over the copies (and the BVH is refit to them; the PVS is dropped),
+// so culling and LOD selection stay conservative, per mesh rather than per
+// copy. Models with quantized vertices, meshInstances or meshlets only take a
+// single transform (their firstInstance is the mesh index, and the meshlets'
+// cones are per copy). Call once, after set_up_model() and before the
+// commands are used (e.g., by create_gpu_culler()); every model needs it for
+// the instances buffer, with the identity if nothing else. Waits for the
+// upload. Throws labutils::Error on failure.
+void set_model_instances(lut::VulkanWindow const&, lut::Allocator const&, VkCommandPool, ModelPack&, std::vector<glm::mat4> const& aTransforms);
 
-ModelPack set_up_model(lut::VulkanWindow const&, lut::Allocator const&, BakedModel const&, VkCommandPool&, VkDescriptorPool&, VkSampler&, VkDescriptorSetLayout&);
-VkFormat get_texture_format(const BakedModel& aModel, uint32_t textureId);
+// Number of textures that set_up_model() creates for the model, including
+// the filler (see ModelPack::hostMaterials). Older files with separate
+// roughness and metalness textures may need fewer or more than they list.
+std::size_t model_texture_count(MappedBakedModel const&);
+std::size_t model_texture_count(BakedModel const&);
 
-Texture load_dummy_normal_map(lut::VulkanWindow const&, lut::Allocator const&, VkCommandPool&);
+// Flat (0,0,1) normal map; recorded into aBatch, and ready once its
+// ticket is.
+Texture load_dummy_normal_map(lut::VulkanWindow const&, lut::Allocator const&, lut::UploadBatch& aBatch);
 
 
@@ -1,9 +1,21 @@
 #include <tuple>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
 #include <chrono>
 #include <limits>
+#include <memory>
 #include <vector>
+#include <optional>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
 #include <stdexcept>
 
+#include <cmath>
 #include <cstdio>
 #include <cassert>
 #include <cstddef>
@@ -15,6 +27,8 @@
 
 #include <volk/volk.h>
 
+#include <stb_image_write.h>
+
 #if !defined(GLM_FORCE_RADIANS)
 #	define GLM_FORCE_RADIANS
 #endif
@@ -35,10 +49,64 @@ using namespace labutils::literals;
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/gpu_profiler.hpp"
+#include "../labutils/pipeline_library.hpp"
+#include "../labutils/pipeline_variants.hpp"
+#include "../labutils/job_system.hpp"
+#include "../labutils/async_uploader.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/defragmenter.hpp"
+#include "../labutils/frame_arena.hpp"
+#include "../labutils/timeline.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/api_counters.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/render_graph.hpp"
+#include "../labutils/startup_report.hpp"
+#include "../labutils/thread_placement.hpp"
+#include "../labutils/texture_pack.hpp"
 namespace lut = labutils;
 
+#include "options.hpp"
 #include "baked_model.hpp"
+#include "scene.hpp"
+#include "world_streaming.hpp"
+#include "quantized_vertex.hpp"
 #include "load_data_to_vk.h"
+#include "culling.hpp"
+#include "hiz.hpp"
+#include "gpu_compression.hpp"
+#include "shading_rate.hpp"
+#include "dynamic_resolution.hpp"
+#include "temporal_upscale.hpp"
+#include "msaa.hpp"
+#include "stereo.hpp"
+#include "shadows.hpp"
+#include "ray_shadows.hpp"
+#include "ibl.hpp"
+#include "distribution_lut.hpp"
+#include "texture_streaming.hpp"
+#include "lazy_materials.hpp"
+#include "mip_report.hpp"
+#include "virtual_textures.hpp"
+#include "lights.hpp"
+#include "clusters.hpp"
+#include "deferred.hpp"
+#include "visibility.hpp"
+#include "camera_path.hpp"
+#include "hud.hpp"
+#include "debug_views.hpp"
+#include "descriptor_buffer_sets.hpp"
+#include "frame_latency.hpp"
+#include "metrics.hpp"
+#include "frame_capture.hpp"
+#include "video_stream.hpp"
+#include "embedded_spirv.hpp"
+#include "draw_trace.hpp"
+#include "impostors.hpp"
+#include "occlusion_queries.hpp"
+#include "triangle_culling.hpp"
+#include "quality_tier.hpp"
 #include <iostream>
 
 
@@ -50,30 +118,164 @@ namespace
 	namespace cfg
 	{
 		// Compiled shader code for the graphics pipeline
-		// See sources in exercise4/shaders/*. 
+		// See sources in exercise4/shaders/*. Embedded in the executable
+		// (see embedded_spirv.hpp), by the file names; the paths are those
+		// of the .spv files without an embedded copy.
 #		define SHADERDIR_ "assets/cw2/shaders/"
 		constexpr char const* kVertShaderPath = SHADERDIR_ "default.vert.spv";
 		constexpr char const* kFragShaderPath = SHADERDIR_ "default.frag.spv";
-		//constexpr char const* kAlphaFragShaderPath = SHADERDIR_ "defaultAlpha.frag.spv";
+		constexpr char const* kAlphaFragShaderPath = SHADERDIR_ "default_alpha.frag.spv";
+		constexpr char const* kRayQueryFragShaderPath = SHADERDIR_ "default_rayquery.frag.spv";
+		constexpr char const* kRayQueryAlphaFragShaderPath = SHADERDIR_ "default_alpha_rayquery.frag.spv";
+		constexpr char const* kRayQueryHalfFragShaderPath = SHADERDIR_ "default_fp16_rayquery.frag.spv";
+		constexpr char const* kRayQueryHalfAlphaFragShaderPath = SHADERDIR_ "default_alpha_fp16_rayquery.frag.spv";
+		constexpr char const* kBindlessVertShaderPath = SHADERDIR_ "bindless.vert.spv";
+		constexpr char const* kPulledVertShaderPath = SHADERDIR_ "default_pulled.vert.spv";
+		constexpr char const* kBindlessPulledVertShaderPath = SHADERDIR_ "bindless_pulled.vert.spv";
+		constexpr char const* kStereoVertShaderPath = SHADERDIR_ "default_stereo.vert.spv";
+		constexpr char const* kBindlessStereoVertShaderPath = SHADERDIR_ "bindless_stereo.vert.spv";
+		constexpr char const* kBindlessFragShaderPath = SHADERDIR_ "bindless.frag.spv";
+		constexpr char const* kBindlessAlphaFragShaderPath = SHADERDIR_ "bindless_alpha.frag.spv";
+		constexpr char const* kHalfFragShaderPath = SHADERDIR_ "default_fp16.frag.spv";
+		constexpr char const* kHalfAlphaFragShaderPath = SHADERDIR_ "default_alpha_fp16.frag.spv";
+		constexpr char const* kBindlessHalfFragShaderPath = SHADERDIR_ "bindless_fp16.frag.spv";
+		constexpr char const* kBindlessHalfAlphaFragShaderPath = SHADERDIR_ "bindless_alpha_fp16.frag.spv";
+		constexpr char const* kGBufferFragShaderPath = SHADERDIR_ "gbuffer.frag.spv";
+		constexpr char const* kGBufferAlphaFragShaderPath = SHADERDIR_ "gbuffer_alpha.frag.spv";
+		constexpr char const* kBindlessGBufferFragShaderPath = SHADERDIR_ "bindless_gbuffer.frag.spv";
+		constexpr char const* kBindlessGBufferAlphaFragShaderPath = SHADERDIR_ "bindless_gbuffer_alpha.frag.spv";
+		constexpr char const* kDeferredVertShaderPath = SHADERDIR_ "deferred.vert.spv";
+		constexpr char const* kDeferredFragShaderPath = SHADERDIR_ "deferred.frag.spv";
+		constexpr char const* kDeferredHalfFragShaderPath = SHADERDIR_ "deferred_fp16.frag.spv";
+		constexpr char const* kVisibilityVertShaderPath = SHADERDIR_ "visibility.vert.spv";
+		constexpr char const* kVisibilityFragShaderPath = SHADERDIR_ "visibility.frag.spv";
+		constexpr char const* kVisibilityAlphaFragShaderPath = SHADERDIR_ "visibility_alpha.frag.spv";
+		constexpr char const* kVisibilityShadeFragShaderPath = SHADERDIR_ "visibility_shade.frag.spv";
+		constexpr char const* kVisibilityShadeHalfFragShaderPath = SHADERDIR_ "visibility_shade_fp16.frag.spv";
+		constexpr char const* kQTangentVertShaderPath = SHADERDIR_ "default_qtangent.vert.spv";
+		constexpr char const* kQTangentQuantizedVertShaderPath = SHADERDIR_ "default_quantized_qtangent.vert.spv";
+		constexpr char const* kBindlessQTangentVertShaderPath = SHADERDIR_ "bindless_qtangent.vert.spv";
+		constexpr char const* kBindlessQTangentQuantizedVertShaderPath = SHADERDIR_ "bindless_quantized_qtangent.vert.spv";
+		constexpr char const* kQTangentFragShaderPath = SHADERDIR_ "default_qtangent.frag.spv";
+		constexpr char const* kQTangentAlphaFragShaderPath = SHADERDIR_ "default_alpha_qtangent.frag.spv";
+		constexpr char const* kQTangentHalfFragShaderPath = SHADERDIR_ "default_fp16_qtangent.frag.spv";
+		constexpr char const* kQTangentHalfAlphaFragShaderPath = SHADERDIR_ "default_alpha_fp16_qtangent.frag.spv";
+		constexpr char const* kQTangentGBufferFragShaderPath = SHADERDIR_ "gbuffer_qtangent.frag.spv";
+		constexpr char const* kQTangentGBufferAlphaFragShaderPath = SHADERDIR_ "gbuffer_alpha_qtangent.frag.spv";
+		constexpr char const* kBindlessQTangentFragShaderPath = SHADERDIR_ "bindless_qtangent.frag.spv";
+		constexpr char const* kBindlessQTangentAlphaFragShaderPath = SHADERDIR_ "bindless_alpha_qtangent.frag.spv";
+		constexpr char const* kBindlessQTangentHalfFragShaderPath = SHADERDIR_ "bindless_fp16_qtangent.frag.spv";
+		constexpr char const* kBindlessQTangentHalfAlphaFragShaderPath = SHADERDIR_ "bindless_alpha_fp16_qtangent.frag.spv";
+		constexpr char const* kBindlessQTangentGBufferFragShaderPath = SHADERDIR_ "bindless_gbuffer_qtangent.frag.spv";
+		constexpr char const* kBindlessQTangentGBufferAlphaFragShaderPath = SHADERDIR_ "bindless_gbuffer_alpha_qtangent.frag.spv";
+		constexpr char const* kDepthVertShaderPath = SHADERDIR_ "depth.vert.spv";
+		constexpr char const* kQuantizedVertShaderPath = SHADERDIR_ "default_quantized.vert.spv";
+		constexpr char const* kBindlessQuantizedVertShaderPath = SHADERDIR_ "bindless_quantized.vert.spv";
+		constexpr char const* kDepthQuantizedVertShaderPath = SHADERDIR_ "depth_quantized.vert.spv";
+		constexpr char const* kShadowVertShaderPath = SHADERDIR_ "shadow.vert.spv";
+		constexpr char const* kShadowQuantizedVertShaderPath = SHADERDIR_ "shadow_quantized.vert.spv";
+		constexpr char const* kDepthAlphaVertShaderPath = SHADERDIR_ "depth_alpha.vert.spv";
+		constexpr char const* kDepthAlphaQuantizedVertShaderPath = SHADERDIR_ "depth_alpha_quantized.vert.spv";
+		constexpr char const* kShadowAlphaVertShaderPath = SHADERDIR_ "shadow_alpha.vert.spv";
+		constexpr char const* kShadowAlphaQuantizedVertShaderPath = SHADERDIR_ "shadow_alpha_quantized.vert.spv";
+		constexpr char const* kDepthAlphaFragShaderPath = SHADERDIR_ "depth_alpha.frag.spv";
+		constexpr char const* kBindlessDepthAlphaFragShaderPath = SHADERDIR_ "bindless_depth_alpha.frag.spv";
+		constexpr char const* kArraysFragShaderPath = SHADERDIR_ "arrays.frag.spv";
+		constexpr char const* kArraysAlphaFragShaderPath = SHADERDIR_ "arrays_alpha.frag.spv";
+		constexpr char const* kArraysHalfFragShaderPath = SHADERDIR_ "arrays_fp16.frag.spv";
+		constexpr char const* kArraysHalfAlphaFragShaderPath = SHADERDIR_ "arrays_alpha_fp16.frag.spv";
+		constexpr char const* kArraysQTangentFragShaderPath = SHADERDIR_ "arrays_qtangent.frag.spv";
+		constexpr char const* kArraysQTangentAlphaFragShaderPath = SHADERDIR_ "arrays_alpha_qtangent.frag.spv";
+		constexpr char const* kArraysQTangentHalfFragShaderPath = SHADERDIR_ "arrays_fp16_qtangent.frag.spv";
+		constexpr char const* kArraysQTangentHalfAlphaFragShaderPath = SHADERDIR_ "arrays_alpha_fp16_qtangent.frag.spv";
+		constexpr char const* kArraysGBufferFragShaderPath = SHADERDIR_ "arrays_gbuffer.frag.spv";
+		constexpr char const* kArraysGBufferAlphaFragShaderPath = SHADERDIR_ "arrays_gbuffer_alpha.frag.spv";
+		constexpr char const* kArraysQTangentGBufferFragShaderPath = SHADERDIR_ "arrays_gbuffer_qtangent.frag.spv";
+		constexpr char const* kArraysQTangentGBufferAlphaFragShaderPath = SHADERDIR_ "arrays_gbuffer_alpha_qtangent.frag.spv";
+		constexpr char const* kArraysDepthAlphaFragShaderPath = SHADERDIR_ "arrays_depth_alpha.frag.spv";
+		constexpr char const* kIblShShaderPath = SHADERDIR_ "ibl_sh.comp.spv";
+		constexpr char const* kIblSpecularShaderPath = SHADERDIR_ "ibl_specular.comp.spv";
+		constexpr char const* kIblBrdfShaderPath = SHADERDIR_ "ibl_brdf.comp.spv";
+		constexpr char const* kCullShaderPath = SHADERDIR_ "cull.comp.spv";
+		constexpr char const* kCullSubgroupShaderPath = SHADERDIR_ "cull_subgroup.comp.spv";
+		constexpr char const* kTriangleCullShaderPath = SHADERDIR_ "triangle_cull.comp.spv";
+		constexpr char const* kTriangleCullSubgroupShaderPath = SHADERDIR_ "triangle_cull_subgroup.comp.spv";
+		constexpr char const* kHizShaderPath = SHADERDIR_ "hiz.comp.spv";
+		constexpr char const* kHizSubgroupShaderPath = SHADERDIR_ "hiz_subgroup.comp.spv";
+		constexpr char const* kDownsampleRgba8ShaderPath = SHADERDIR_ "downsample_rgba8.comp.spv";
+		constexpr char const* kDownsampleR8ShaderPath = SHADERDIR_ "downsample_r8.comp.spv";
+		constexpr char const* kDownsampleR32fShaderPath = SHADERDIR_ "downsample_r32f.comp.spv";
+		constexpr char const* kBcCompressShaderPath = SHADERDIR_ "bc_compress.comp.spv";
+		constexpr char const* kLz4DecompressShaderPath = SHADERDIR_ "lz4_decompress.comp.spv";
+		constexpr char const* kShadingRateShaderPath = SHADERDIR_ "shading_rate.comp.spv";
+		constexpr char const* kTemporalResolveShaderPath = SHADERDIR_ "temporal_resolve.comp.spv";
+		constexpr char const* kStreamShaderPath = SHADERDIR_ "stream_yuv.comp.spv";
+		constexpr char const* kClusterShaderPath = SHADERDIR_ "cluster.comp.spv";
+		constexpr char const* kHudVertShaderPath = SHADERDIR_ "hud.vert.spv";
+		constexpr char const* kHudFragShaderPath = SHADERDIR_ "hud.frag.spv";
+		constexpr char const* kDebugViewFragShaderPath = SHADERDIR_ "debug_view.frag.spv";
+		constexpr char const* kImpostorVertShaderPath = SHADERDIR_ "impostor.vert.spv";
+		constexpr char const* kImpostorFragShaderPath = SHADERDIR_ "impostor.frag.spv";
+		constexpr char const* kOcclusionProxyVertShaderPath = SHADERDIR_ "occlusion_proxy.vert.spv";
 #		undef SHADERDIR_
 
+		constexpr char const* kWindowTitle = "Zackery -CW2"; // as set by lut::make_vulkan_window()
+
+#		if defined(LUT_CPU_ZONES)
+		// Trace of the CPU zones and GPU scopes, written on exit
+		constexpr char const* kCpuZonesPath = "cw2-zones.json";
+#		endif
+
+		// Pipeline cache, loaded at start-up and saved on exit (relative to
+		// the working directory)
+		constexpr char const* kPipelineCachePath = "cw2-pipelines.cache";
+		constexpr char const* kIblCacheDir = "cw2-ibl-cache"; // see ibl.hpp
+		constexpr char const* kMemoryReportPath = "cw2-memory.json"; // M, without --memory-report
+
+		// --quality=auto: tiers by device, and the benchmark that calibrates
+		// them (see quality_tier.hpp); three seconds along the nave, after
+		// a second for the start-up work to settle
+		constexpr char const* kQualityRecordPath = "cw2-quality.txt";
+		constexpr char const* kQualityBenchPath = "cw2/bench/sponza.path";
+		constexpr std::uint32_t kQualityBenchFirstKey = 30;
+		constexpr std::uint32_t kQualityBenchKeys = 90;
+
 #		define ASSETDIR_ "assets/cw2/"
 		constexpr char const* kBakedModelPath = ASSETDIR_"sponza-pbr.comp5822mesh";
 #		undef ASSETDIR_
 
-		constexpr VkFormat kDepthFormat = VK_FORMAT_D32_SFLOAT;
-
-
-		// General rule: with a standard 24 bit or 32 bit float depth buffer,
-		// you can support a 1:1000 ratio between the near and far plane with
-		// minimal depth fighting. Larger ratios will introduce more depth
-		// fighting problems; smaller ratios will increase the depth buffer's
-		// resolution but will also limit the view distance.
+		// The projection is reverse-Z with an infinite far plane (see
+		// update_scene_uniforms()): depth is kCameraNear / z, 1 at the near
+		// plane and 0 at infinity. A float depth buffer's exponent then
+		// cancels the 1/z, and the relative precision is about even at all
+		// distances; the UNORM formats (--depth-format) keep the 1/z
+		// distribution, and lose precision in the distance.
 		constexpr float kCameraNear = 0.01f;
-		constexpr float kCameraFar = 100.f;
+
+		// Far end of the light clusters' depth slices (see clusters.hpp);
+		// the last slice also holds everything beyond
+		constexpr float kLightClusterFar = 100.f;
 
 		constexpr auto kCameraFov = 60.0_degf;
 
+		// --shading-rate=depth: largest second difference of depth, relative
+		// to 1/z, of a tile that is still shaded at 2x2 (see
+		// shading_rate.comp). Determined empirically: depth discontinuities
+		// and creases are well above it, curved surfaces close to it.
+		constexpr float kShadingRateThreshold = 0.002f;
+
+		// --defrag-budget: frames between checks of the pools' unused
+		// memory (see lut::Defragmenter::reclaimable())
+		constexpr std::uint32_t kDefragCheckInterval = 300;
+
+		// --redraw=on-demand: frames rendered after the last change, for
+		// what converges over several frames (the budgeted shadow faces,
+		// Hi-Z culling and shading rates from the previous frame's depth,
+		// the mip feedback of texture streaming); and the longest wait for
+		// events while idle, after which background work is checked again
+		constexpr std::uint32_t kRedrawFrames = 16;
+		constexpr double kIdleWaitSeconds = 0.25;
+
 		// Camera settings.
 		// These are determined empirically (i.e., by testing and picking something
 		// that felt OK).
@@ -86,12 +288,172 @@ namespace
 		constexpr float kCameraSlowMult = 0.05f; // speed multiplier
 
 		constexpr float kCameraMouseSensitivity = 0.01f; // radians per pixel
+
+		// --fps-adaptive: camera motion that counts as full speed, and keeps
+		// the frame rate at --fps-limit
+		constexpr float kAdaptiveFullSpeed = kCameraBaseSpeed; // units/second
+		constexpr float kAdaptiveFullTurn = 1.f; // radians/second
+
+		// Upper bound for the bindless texture array. The actual number of
+		// descriptors is set per model (variable descriptor count).
+		constexpr std::uint32_t kMaxBindlessTextures = 4096;
+
+		// --descriptor-buffer: room for the copies of the scene's set and
+		// the bindless set of kMaxBindlessTextures, with a few hundred
+		// bytes per descriptor at most
+		constexpr VkDeviceSize kDescriptorBufferBytes = 2 * 1024 * 1024;
 	}
 
+	// Per-run rendering configuration, resolved from the Options and the
+	// device's capabilities.
+	struct RenderSettings
+	{
+		EDrawMode drawMode;
+		EMaterialMode materialMode;
+		ECullMode cullMode;
+		EOcclusionMode occlusionMode;
+		EPrepassMode prepassMode;
+		ERecordMode recordMode;
+		EVertexFormat vertexFormat;
+		EShadingPrecision shadingPrecision;
+		ELightingMode lightingMode;
+		ETangentFrame tangentFrame;
+		EShadingRate shadingRate;
+		bool multiDrawIndirect;
+		bool positionStream; // the opaque depth-only pipelines read ModelPack::positions
+		bool vertexPulling; // the colour pipelines fetch their vertices (see vertex_pulling.glsl)
+		bool stereo; // both eyes in one multiview pass (see stereo.hpp)
+	};
+
+	// Features of the colour pipeline variants (see lut::PipelineVariants).
+	// Bit i is the fragment shaders' specialization constant with
+	// constant_id i.
+	enum EPipelineFeature : lut::PermutationKey
+	{
+		kPipelineAlphaMask = 1u << 0,     // *_alpha.frag (not a constant: see default.frag)
+		kPipelineNormalMaps = 1u << 1,    // kNormalMapping
+		kPipelineHalfPrecision = 1u << 2, // *_fp16.frag (the fp32 ones must not need shaderFloat16)
+		kPipelineMipFeedback = 1u << 3,   // kMipFeedback (texture streaming)
+		kPipelineAlphaToCoverage = 1u << 4, // kAlphaToCoverage (MSAA)
+		kPipelineDistributionLut = 1u << 5, // kDistributionLut (see distribution_lut.hpp)
+		kPipelineVirtualTextures = 1u << 6, // kVirtualTextures (with kMipFeedback)
+		kPipelineSubgroupLights = 1u << 7, // *_subgroup.frag (not a constant: see point_lights.glsl)
+		kPipelineDebugViews = 1u << 8, // kDebugViews (see debug_views.hpp)
+
+		kPipelineFeatureCount = 9
+	};
+
+	// GPU profiler scopes of a frame (see lut::GpuProfiler). The opaque and
+	// alpha-masked scopes are only recorded when the colour subpass is
+	// recorded as a single part; the colour scope spans all parts.
+	struct FrameScopes
+	{
+		lut::GpuProfiler* profiler = nullptr; // null: not timed
+		lut::VulkanContext const* context = nullptr; // for the debug labels (see lut::DebugLabel); always set
+		std::uint32_t frame = 0, cull = 0, clusters = 0, prepass = 0, colour = 0, opaque = 0, alpha = 0, lighting = 0, hiz = 0, shadingRate = 0, upscale = 0, hud = 0, shadows = 0;
+	};
+
+	// Commands recorded for the render pass draws of a frame. Shown in the
+	// window title, to check that sorting keeps the binds down.
+	struct DrawStats
+	{
+		std::uint32_t draws = 0; // draw commands, direct or indirect
+		std::uint32_t pipelineBinds = 0;
+		std::uint32_t materialBinds = 0; // descriptor set 1
+
+		DrawStats& operator+= (DrawStats const& aOther) noexcept
+		{
+			draws += aOther.draws;
+			pipelineBinds += aOther.pipelineBinds;
+			materialBinds += aOther.materialBinds;
+			return *this;
+		}
+	};
+
+	// Per-frame resources, one set per frame in flight (independent of the
+	// number of swapchain images). The CPU records the next frame into a
+	// free slot while the GPU still executes the previous ones.
+	// Host-visible, persistently mapped scene uniforms with one slot per
+	// frame in flight. A frame copies its uniforms into its slot after
+	// waiting for its fence, and binds the slot with a dynamic offset, so
+	// the upload needs neither transfer commands nor barriers.
+	struct SceneUniformRing
+	{
+		lut::Buffer buffer;
+		std::byte* mapped = nullptr;
+		VkDeviceSize slotSize = 0; // sizeof(glsl::SceneUniform), aligned for dynamic offsets
+	};
+
+	struct FrameResources
+	{
+		VkCommandBuffer cmdBuff = VK_NULL_HANDLE;
+		std::uint64_t done = 0; // timeline value signalled once cmdBuff has completed
+		Clock_::time_point submitted{}; // when cmdBuff was, for LUT_GPU_ZONES()
+		lut::Semaphore imageAvailable;
+
+		// Async compute: the light clustering pass, submitted to the compute
+		// queue; computeDone is waited for by cmdBuff's shading
+		VkCommandBuffer computeCmdBuff = VK_NULL_HANDLE;
+		lut::Semaphore computeDone;
+
+		// Render pass draws in secondary command buffers, with cached draws
+		// or more than one recording thread (see record_secondary_draws()).
+		// One buffer per recording job, each from the job's own pool. Cached
+		// draws are recorded once, and again after swapchain recreation.
+		std::vector<lut::CommandPool> drawPools;
+		std::vector<VkCommandBuffer> depthDraws; // only with a depth pre-pass
+		std::vector<VkCommandBuffer> colourDraws;
+		bool drawsRecorded = false;
+		VkPipeline drawsPipes[2]{}; // the colour pipelines they use (opaque, alpha masked)
+		VkExtent2D drawsExtent{}; // their viewport (dynamic resolution)
+		DrawStats drawStats; // of the recorded secondary draws
+
+		std::uint32_t shadowFaces = 0; // shadow cube faces that cmdBuff renders
+
+		// --bench-compare-*: the rendered image, copied after the render
+		// pass (host-visible)
+		lut::Buffer readback;
+
+		// CPU data of the frame (draw lists, recording), reset once done
+		// has been waited for
+		lut::FrameArena arena;
+	};
+
+	// What to draw in a frame, after culling. In indirect mode, the batches
+	// index into the commands buffer; in direct mode, meshVisible is used.
+	// With GPU culling, the draw count of batch i (opaque first, then alpha)
+	// is read from counts[i], and the batch's commandCount is the maximum.
+	// LODs are picked on the GPU from lodScale, or on the CPU into meshLod.
+	struct DrawList
+	{
+		VkBuffer commands = VK_NULL_HANDLE;
+		VkBuffer counts = VK_NULL_HANDLE;
+		DrawBatchList opaqueBatches; // from the frame's arena with CPU culling
+		DrawBatchList alphaBatches;
+
+		std::vector<std::uint8_t> meshVisible; // one entry per ModelPack::meshes
+		std::vector<std::uint8_t> meshLod;     // empty: full detail
+
+		float lodScale = 0.f; // see lod_scale(); 0: full detail
+
+		Impostors const* impostors = nullptr; // null: no impostors
+		std::vector<std::uint32_t> impostorMeshes; // see select_impostors()
+
+		// --occlusion=query: the direct draws of each mesh are gated on its
+		// predicate; null: they aren't
+		OcclusionQueries* occlusion = nullptr;
+
+		// --triangle-cull: the GPU culler's commands draw the compacted
+		// uint32 indices of triangles; null: the model's indices
+		TriangleCuller const* triangles = nullptr;
+	};
+
 	// GLFW callbacks
 	void glfw_callback_key_press(GLFWwindow*, int, int, int, int);
 	void glfw_callback_button(GLFWwindow*, int, int, int);
 	void glfw_callback_motion(GLFWwindow*, double, double);
+	void glfw_callback_refresh(GLFWwindow*);
+	void glfw_callback_resize(GLFWwindow*, int, int);
 
 	enum class EInputState
 	{
@@ -112,12 +474,27 @@ namespace
 	{
 		bool inputMap[std::size_t(EInputState::max)] = {};
 
+		bool normalMaps = true; // toggled with N
+		bool shadingRate = true; // toggled with V (--shading-rate=depth only)
+		bool hud = false; // toggled with H (windows only)
+		EDebugView debugView = EDebugView::off; // cycled with O (windows only)
+		bool pick = false; // left click; the next frame picks a mesh
+		bool screenshot = false; // F12; the next frame is written to --screenshot-dir
+		bool memoryReport = false; // M; the next frame writes the VMA statistics
+		bool redraw = false; // the window was damaged or resized since the last frame
+
+		int framebufferWidth = 0, framebufferHeight = 0; // 0: minimized
+
 		float mouseX = 0.f, mouseY = 0.f;
 		float previousX = 0.f, previousY = 0.f;
 
 		bool wasMousing = false;
 		//bool wasLightOrbiting = false;
 
+		// First input event not yet consumed by a frame (latency
+		// measurements); the epoch if there is none
+		Clock_::time_point firstInput{};
+
 		glm::mat4 camera2world = glm::identity<glm::mat4>();
 		glm::vec3 light_pos = glm::vec3(0, 2, 0);
 	};
@@ -125,6 +502,40 @@ namespace
 	//Also declare a update_user_state function to update the state based on the elapsed time:
 	void update_user_state(UserState&, float aElapsedTime);
 
+	// Notes the time of the first input event since the last frame (see
+	// FrameTimestamps::input)
+	void stamp_input(UserState&);
+
+	// --render-thread: input handed from the main thread, which processes
+	// the window's events, to the render thread. The callbacks write to the
+	// main thread's UserState; after each batch of events, its input goes
+	// to `published`, from which the render thread takes it at the start of
+	// each frame (see take_input()). Both threads hold the mutex only for
+	// those copies. The title goes the other way.
+	struct InputMailbox
+	{
+		std::mutex mutex;
+		std::condition_variable posted;
+		UserState published;
+		bool fresh = false; // input published since the render thread took it
+		std::string title; // empty: unchanged
+
+		std::atomic<bool> quit{ false }; // the window is to close
+		std::atomic<bool> stopped{ false }; // the render thread has finished
+	};
+
+	// Moves the input of aFrom (keys, toggles, the cursor and the window
+	// size) to aTo. One-shot requests (pick, screenshot, memory report,
+	// redraw) and the first input time accumulate in aTo until it takes
+	// them, and are cleared in aFrom. The camera and the light are left
+	// alone; the render thread owns them.
+	void take_input(UserState& aTo, UserState& aFrom);
+
+	// Runs aRenderFrames on a new thread, and the window's events on this
+	// one until it returns; rethrows its exceptions. aState is the render
+	// thread's; the callbacks write to a copy meanwhile.
+	void run_render_thread(GLFWwindow*, InputMailbox&, UserState& aState, std::function<void()> const& aRenderFrames);
+
 
 	// Uniform data
 	namespace glsl
@@ -140,33 +551,136 @@ namespace
 			float _pad1;
 			glm::vec3 lightColor;
 			float _pad2;
+			glm::mat4 viewProjCam[2]; // per eye, for *_stereo.vert; projCam is then the culling frustum (see stereo.hpp)
 		};
 
-		// We want to use vkCmdUpdateBuffer() to update the contents of our uniform
-		// buffers. vkCmdUpdateBuffer() has a number of requirements, including
-		// the two below. See https://www.khronos.org/registry/vulkan/specs/1.3-extensions/man/html/vkCmdUpdateBuffer.html
-		static_assert(sizeof(SceneUniform) <= 65536, "SceneUniform must be less than 65536 bytes for vkCmdUpdateBuffer");
-		static_assert(sizeof(SceneUniform) % 4 == 0, "SceneUniform size must be a multiple of 4 bytes");
-	}
+		// The uniforms are copied into a persistently mapped buffer (see
+		// SceneUniformRing). Vulkan guarantees a maxUniformBufferRange of at
+		// least 16384 bytes.
+		static_assert(sizeof(SceneUniform) <= 16384, "SceneUniform must be at most 16384 bytes to fit any uniform buffer range");
 
-	// Helpers:
-	lut::RenderPass create_render_pass(lut::VulkanWindow const&);
+		// Per-draw push constants of the scene pipeline layout (vertex
+		// stage). The bindless vertex shaders take the material from here,
+		// unless it is kMaterialFromInstance; then it comes from the draw's
+		// firstInstance, as indirect draws can't push per draw.
+		struct DrawPushConstants
+		{
+			std::uint32_t material;
+		};
+
+		constexpr std::uint32_t kMaterialFromInstance = ~std::uint32_t(0);
 
-	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const&);
+		// Vulkan guarantees a maxPushConstantsSize of at least 128 bytes.
+		static_assert(sizeof(DrawPushConstants) <= 128, "DrawPushConstants must be at most 128 bytes to fit any push constant range");
+	}
 
-	lut::DescriptorSetLayout create_material_descriptor_layout(lut::VulkanWindow const& aWindow);
+	// Helpers:
+	// With aSampledDepth, the depth attachment is stored and left in
+	// DEPTH_STENCIL_READ_ONLY_OPTIMAL for compute shaders to read after the
+	// pass (see hiz.hpp). With aDepthPrepass, a depth-only subpass precedes
+	// the colour subpass (which is then subpass 1). Deferred, subpass 0
+	// draws into the G-buffer (attachments 2 and 3) and subpass 1 shades
+	// from it (see deferred.hpp); with the visibility buffer, subpass 0
+	// writes triangle IDs (attachment 2) and subpass 1 shades them (see
+	// visibility.hpp). There is no pre-pass then. With a non-zero
+	// aShadingRateTexel, the colour subpass of the forward pass also uses a
+	// shading rate attachment (the last one; see shading_rate.hpp). With
+	// aUpscaled, attachment 0 is a RenderTarget, left in
+	// TRANSFER_SRC_OPTIMAL for the upscale (see dynamic_resolution.hpp).
+	// With aSamples > 1 (forward only), the subpasses draw into
+	// multisampled colour and depth attachments (2 and 3; see msaa.hpp),
+	// which the colour subpass resolves into attachments 0 and, with
+	// aSampledDepth, 1. With aMultiview (a single forward subpass), the
+	// subpass draws both layers of StereoTargets, and attachment 0 is left
+	// in TRANSFER_SRC_OPTIMAL for the copy to the swapchain (see stereo.hpp).
+	lut::RenderPass create_render_pass(lut::VulkanWindow const&, VkFormat aDepthFormat, bool aSampledDepth = false, bool aDepthPrepass = false, ELightingMode aLighting = ELightingMode::forward, VkExtent2D aShadingRateTexel = {}, bool aUpscaled = false, VkSampleCountFlagBits aSamples = VK_SAMPLE_COUNT_1_BIT, bool aMultiview = false);
+
+	// aRayShadows: with binding 13, the TLAS of ray-query shadows (see
+	// ray_shadows.hpp); needs VK_KHR_acceleration_structure.
+	// aDescriptorBuffer: for DescriptorBufferSets, with a plain uniform
+	// buffer at binding 0.
+	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const&, bool aRayShadows = false, bool aDescriptorBuffer = false);
+	// Points binding 12 of the scene's set at aModel's vertices (vertex
+	// pulling), and that of the copies in its descriptor buffer, if it has
+	// one; again whenever they move.
+	void update_vertex_descriptor(lut::VulkanWindow const&, VkDescriptorSet aSceneDescriptors, ModelPack const&);
+
+	// The texture bindings use aSampler as their immutable sampler
+	lut::DescriptorSetLayout create_material_descriptor_layout(lut::VulkanWindow const& aWindow, VkSampler aSampler);
+	lut::DescriptorSetLayout create_bindless_descriptor_layout(lut::VulkanWindow const&, std::uint32_t aMaxTextures, bool aDescriptorBuffer = false);
 
 	lut::PipelineLayout create_pipeline_layout(lut::VulkanContext const&, VkDescriptorSetLayout, VkDescriptorSetLayout);
-	lut::Pipeline create_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
-
-	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const&, lut::Allocator const&);
+	// Vertex input state for the model's vertex buffer: fp32 or quantized
+	// vertices at binding 0, and, for quantized vertices (or with
+	// aMeshInstances), the per-mesh MeshInstance at binding 1 (see
+	// load_data_to_vk.h). aPositionsOnly leaves out everything but the
+	// position and bounds (depth pre-pass).
+	// The info points into the struct, so it is filled in place.
+	struct VertexInputState
+	{
+		VkVertexInputBindingDescription bindings[2];
+		VkVertexInputAttributeDescription attribs[7];
+		VkPipelineVertexInputStateCreateInfo info;
+	};
+	// aPositionStream: fp32 positions only, read from ModelPack::positions
+	// (binding 0, 12 byte stride) instead of the interleaved vertices. With
+	// aPulled, there are no bindings at all (*_pulled.vert).
+	void fill_vertex_input(VertexInputState&, bool aQuantized, bool aPositionsOnly, bool aMeshInstances = false, bool aPositionStream = false, bool aPulled = false);
+
+	// With aDepthPrepass, the pipelines are for the colour subpass of a
+	// render pass with a depth pre-pass (see create_render_pass()). The
+	// opaque pipeline then only shades fragments that match the pre-pass
+	// depth, and no longer writes depth. aQuantizedVertices must match the
+	// vertex shader (*_quantized.vert). aColorAttachments is that of the
+	// subpass (kGBufferColorAttachments for the G-buffer shaders).
+	// aMeshInstances: see fill_vertex_input() (visibility.vert). With
+	// aShadingRate, the fragment size comes from the render pass's shading
+	// rate attachment. aSamples must match the render pass; multisampled,
+	// the alpha pipeline uses alpha-to-coverage (and aFragSpecialization
+	// should set kPipelineAlphaToCoverage). aVertexPulling must match the
+	// vertex shader (*_pulled.vert): the pipelines then have no vertex input.
+	// aFlags: VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT for the layouts
+	// of DescriptorBufferSets, or 0; likewise for the depth and shadow
+	// pipelines below.
+	lut::Pipeline create_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, lut::PipelineLinker&, lut::ShaderModuleCache&,
+		char const* aVertShader = cfg::kVertShaderPath, char const* aFragShader = cfg::kFragShaderPath, bool aDepthPrepass = false, bool aQuantizedVertices = false,
+		VkSpecializationInfo const* aFragSpecialization = nullptr, std::uint32_t aColorAttachments = 1, bool aMeshInstances = false, bool aShadingRate = false,
+		VkSampleCountFlagBits aSamples = VK_SAMPLE_COUNT_1_BIT, bool aVertexPulling = false, VkPipelineCreateFlags aFlags = 0);
+	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, lut::PipelineLinker&, lut::ShaderModuleCache&,
+		char const* aVertShader = cfg::kVertShaderPath, char const* aFragShader = cfg::kAlphaFragShaderPath, bool aDepthPrepass = false, bool aQuantizedVertices = false,
+		VkSpecializationInfo const* aFragSpecialization = nullptr, std::uint32_t aColorAttachments = 1, bool aMeshInstances = false, bool aShadingRate = false,
+		VkSampleCountFlagBits aSamples = VK_SAMPLE_COUNT_1_BIT, bool aVertexPulling = false, VkPipelineCreateFlags aFlags = 0);
+	// Depth-only pipeline for the pre-pass: position stream only, no
+	// fragment shader. Used for opaque meshes. With aAlphaFragShader
+	// (depth_alpha.frag or its bindless variant), the pipeline of the
+	// alpha-masked meshes instead: it also fetches the texture coordinates,
+	// and the fragment shader discards by the alpha coverage texture.
+	// aPositionStream: the opaque pipeline reads ModelPack::positions (see
+	// fill_vertex_input()).
+	lut::Pipeline create_depth_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, VkPipelineCache, lut::ShaderModuleCache&, bool aQuantizedVertices = false, VkSampleCountFlagBits aSamples = VK_SAMPLE_COUNT_1_BIT,
+		char const* aAlphaFragShader = nullptr, bool aPositionStream = false, VkPipelineCreateFlags aFlags = 0);
+	// Depth-only pipeline of the shadow cube faces (see shadows.hpp), with
+	// a depth bias against acne. aAlphaFragShader, aPositionStream: as
+	// create_depth_pipeline().
+	lut::Pipeline create_shadow_pipeline(lut::VulkanWindow const&, ShadowCache const&, VkPipelineCache, lut::ShaderModuleCache&, bool aQuantizedVertices, char const* aAlphaFragShader = nullptr, bool aPositionStream = false, VkPipelineCreateFlags aFlags = 0);
+
+	// aInputAttachment: also read by the deferred lighting subpass. Unless
+	// aSampled, the depth buffer is never stored (see create_render_pass()),
+	// so it is transient, and lazily allocated where the device supports
+	// that: tile-based GPUs then keep it in tile memory only.
+	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const&, lut::Allocator const&, VkFormat, bool aSampled = false, bool aInputAttachment = false);
 
 	void create_swapchain_framebuffers(
 		lut::VulkanWindow const&,
 		VkRenderPass,
 		std::vector<lut::Framebuffer>&,
-		VkImageView aDepthView
+		VkImageView aDepthView,
+		GBuffer const* aGBuffer = nullptr, // non-null: deferred render pass
+		VisibilityBuffer const* aVisibility = nullptr, // non-null: visibility buffer render pass
+		VkImageView aShadingRateView = VK_NULL_HANDLE, // non-null: render pass with a shading rate attachment
+		VkImageView aColourView = VK_NULL_HANDLE, // non-null: drawn into in place of the swapchain images (dynamic resolution)
+		MsaaTargets const* aMsaa = nullptr, // non-null: multisampled render pass
+		StereoTargets const* aStereo = nullptr // non-null: multiview render pass; replaces the colour and depth attachments, and the size
 	);
 
 	void update_scene_uniforms(
@@ -175,264 +689,3120 @@ namespace
 		std::uint32_t aFramebufferHeight,
 		UserState aState
 	);
+	// --stereo: after update_scene_uniforms() with an eye's size, sets the
+	// eyes' matrices, and replaces projCam by a frustum that contains both
+	// (see stereo.hpp)
+	void update_stereo_views(glsl::SceneUniform&, float aEyeSeparation);
+
+	// Records the draws of one subpass: the depth pre-pass (aDepthOnly) or
+	// the colour subpass. Binds all state that the draws use, so that they
+	// can go into a secondary command buffer. Only part aPart of aPartCount
+	// is recorded; executing the parts in order gives all draws.
+	DrawStats record_scene_draws(
+		VkCommandBuffer,
+		bool aDepthOnly,
+		std::uint32_t aPart,
+		std::uint32_t aPartCount,
+		VkExtent2D const& aImageExtent, // sets the (dynamic) viewport and scissor
+		VkPipeline aGraphicsPipe,
+		VkPipeline aSecondGraphicsPipe,
+		VkPipeline aDepthPipe, // VK_NULL_HANDLE: no depth pre-pass
+		VkPipeline aDepthAlphaPipe, // VK_NULL_HANDLE: the alpha-masked meshes aren't in the pre-pass
+		std::uint32_t aSceneOffset,
+		VkPipelineLayout,
+		VkDescriptorSet aSceneDescriptors,
+		ModelPack const&,
+		DrawList const&,
+		FrameScopes const&,
+		RenderSettings const&
+	);
+	// Records all subpasses' draws of a frame slot into its secondary command
+	// buffers, one part per job, with up to aThreads jobs at a time on the
+	// shared job system (lut::shared_jobs()). The
+	// slot's previous submission must have completed. Cached draws rely on
+	// the draw list not changing until they are recorded again. Updates the
+	// slot's drawStats.
+	void record_secondary_draws(
+		lut::VulkanContext const&,
+		FrameResources&,
+		std::uint32_t aThreads,
+		VkRenderPass,
+		VkExtent2D const& aImageExtent,
+		VkPipeline aGraphicsPipe,
+		VkPipeline aSecondGraphicsPipe,
+		VkPipeline aDepthPipe,
+		VkPipeline aDepthAlphaPipe,
+		std::uint32_t aSceneOffset,
+		VkPipelineLayout,
+		VkDescriptorSet aSceneDescriptors,
+		ModelPack const&,
+		DrawList const&,
+		FrameScopes const&,
+		RenderSettings const&
+	);
+
+	// Alternate-frame rendering: the device of the group that runs a frame's
+	// commands, or this for none (no device masks: all devices of the group)
+	constexpr std::uint32_t kNoFrameDevice = ~0u;
 
-	void record_commands(
+	// Returns the statistics of the render pass draws (recorded inline, or
+	// those of aSecondaryDraws).
+	DrawStats record_commands(
 		VkCommandBuffer,
 		VkRenderPass,
 		VkFramebuffer,
 		VkPipeline,
-		VkExtent2D const&,
-		VkBuffer aSceneUBO,
-		glsl::SceneUniform const&,
+		VkExtent2D const& aImageExtent, // of the swapchain images
+		std::uint32_t aSceneOffset, // dynamic offset of the frame's scene uniforms
 		VkPipelineLayout,
 		VkDescriptorSet aSceneDescriptors,
 		ModelPack& aModel,
 		VkPipeline aSecondGraphicsPipe, 
-		BakedModel& bakedModel
+		VkPipeline aDepthPipe, // VK_NULL_HANDLE: no depth pre-pass
+		VkPipeline aDepthAlphaPipe, // VK_NULL_HANDLE: the alpha-masked meshes aren't in the pre-pass
+		DrawList const&,
+		GpuCuller const* aGpuCull, // null: no GPU culling
+		HizPyramid* aHiz, // null: no Hi-Z; requires aGpuCull otherwise
+		ShadingRate const* aShadingRate, // null: no shading rate image
+		LightClusters&,
+		glm::mat4 const& aPrevProjCam,
+		FrameScopes const&, // its profiler's queries are reset here
+		FrameResources const* aSecondaryDraws, // null: record the draws inline
+		RenderSettings const&,
+		DeferredLighting const* aDeferred, // null: forward shading (or aVisibility)
+		VisibilityShading const* aVisibility, // null: no visibility buffer
+		VkPipeline aLightingPipe, // of aDeferred or aVisibility
+		glsl::SceneUniform const&, // the frame's scene uniforms, as written
+		RenderTarget const* aRenderTarget, // non-null: attachment 0, upscaled to aSwapImage
+		TemporalUpscale* aTemporal, // non-null: aRenderTarget is upscaled with it (not a blit)
+		StereoTargets const* aStereo, // non-null: attachment 0 (both eyes), copied side by side to aSwapImage
+		VkExtent2D const& aRenderExtent, // render area; aImageExtent without aRenderTarget
+		VkImage aSwapImage, // the framebuffer's swapchain image
+		bool aOffscreen, // aSwapImage is an offscreen image (not presented)
+		VkBuffer aReadback = VK_NULL_HANDLE, // aSwapImage is copied into it, HUD included; VK_NULL_HANDLE: no copy
+		MipFeedback* aMipFeedback = nullptr, // non-null: reset the mip feedback for the frame
+		VirtualTextures* aVirtual = nullptr, // non-null: reset the region feedback for the frame
+		WorldStreaming* aWorld = nullptr, // non-null: copy the frame's loads first
+		std::uint32_t aFrame = 0, // frame slot, for aMipFeedback and aHud
+		Hud const* aHud = nullptr, // non-null: drawn over aSwapImage (not offscreen)
+		std::uint32_t aImageIndex = 0, // of aSwapImage, for aHud and aStream
+		ShadowCache const* aShadows = nullptr, // non-null: render its planned faces first
+		VkPipeline aShadowPipe = VK_NULL_HANDLE, // of aShadows
+		VkPipeline aShadowAlphaPipe = VK_NULL_HANDLE, // of aShadows; VK_NULL_HANDLE: the alpha-masked meshes cast no shadows
+		std::uint32_t aDevice = kNoFrameDevice, // alternate-frame rendering: the device of the group that runs the commands
+		VideoStream* aStream = nullptr, // non-null: aSwapImage is converted for it, HUD included
+		DebugViews const* aDebugViews = nullptr, // non-null: its view is drawn under aHud (which must be set)
+		VkBuffer aLatchedUniforms = VK_NULL_HANDLE // --late-latch: the scene uniforms' buffer, which the host writes after submission
 	);
-	void submit_commands(
+	// --late-latch: the shader stages of a submission wait for aLatch's last
+	// value, which the host signals once it has written the frame's scene
+	// uniforms (lut::Timeline::signal_host())
+	constexpr VkPipelineStageFlags kLateLatchStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	// Returns the value of aTimeline that the submission signals
+	std::uint64_t submit_commands(
 		lut::VulkanWindow const&,
 		VkCommandBuffer,
-		VkFence,
-		VkSemaphore,
-		VkSemaphore
+		lut::Timeline& aTimeline,
+		VkSemaphore aWaitSemaphore, // VK_NULL_HANDLE: none (offscreen)
+		VkSemaphore aSignalSemaphore, // VK_NULL_HANDLE: none (offscreen)
+		VkSemaphore aComputeDone = VK_NULL_HANDLE, // waited for by the fragment shaders
+		std::uint32_t aDevice = kNoFrameDevice, // as record_commands(); waits and signals there
+		lut::Timeline const* aLatch = nullptr // --late-latch: waited for by kLateLatchStages
+	);
+
+	// Async compute: records the light clustering pass into aCmdBuff, and
+	// submits it to the compute queue. The submission waits for aTimeline's
+	// last value (the previous frame, whose shading reads the grid), and
+	// signals aComputeDone.
+	void submit_compute_commands(
+		lut::VulkanWindow const&,
+		VkCommandBuffer,
+		lut::Timeline& aTimeline,
+		VkSemaphore aComputeDone,
+		LightClusters&,
+		VkDescriptorSet aSceneDescriptors,
+		std::uint32_t aSceneOffset,
+		VkExtent2D const& aRenderExtent,
+		glsl::SceneUniform const&,
+		VkBuffer aLatchedUniforms = VK_NULL_HANDLE, // as record_commands()
+		lut::Timeline const* aLatch = nullptr // as submit_commands()
+	);
+	// vkAcquireNextImageKHR(), or with aDevice, for that device of the
+	// group (vkAcquireNextImage2KHR())
+	VkResult acquire_image(
+		lut::VulkanWindow const&,
+		VkSemaphore aImageAvailable,
+		std::uint32_t aDevice, // kNoFrameDevice: none
+		std::uint32_t& aImageIndex
 	);
 	void present_results(
 		VkQueue,
 		VkSwapchainKHR,
 		std::uint32_t aImageIndex,
 		VkSemaphore,
-		bool& aNeedToRecreateSwapchain
+		std::uint64_t aPresentId, // VkPresentIdKHR; 0: none
+		bool& aNeedToRecreateSwapchain,
+		std::uint32_t aDevice = kNoFrameDevice // presents that device's instance of the image
 	);
-}
 
+	// --bench-images: aReadback holds the R8G8B8A8 image of a frame (see
+	// record_commands()), which goes to aDir/frame-<aKey>[-<aSuffix>].png.
+	// Throws lut::Error if it can't be written.
+	void write_bench_image(
+		lut::Allocator const&,
+		lut::Buffer const& aReadback,
+		VkExtent2D const&,
+		char const* aDir,
+		std::size_t aKey,
+		char const* aSuffix = nullptr
+	);
 
-int main() try
-{
-	// Create Vulkan Window
-	auto window = lut::make_vulkan_window();
+	// Start-up: the model (one of aPaths is mapped, or read through aReader;
+	// several are merged into a scene that shares their textures and
+	// geometry buffers), and with aPrefetchTextures, its textures (see
+	// TexturePrefetch). Needs no Vulkan objects, so it runs as a job while
+	// the instance, device and pipelines are created.
+	struct LoadedModel
+	{
+		MappedBakedModel baked;
+		std::optional<BakedModel> scene;
+		TexturePrefetch textures;
+	};
+	LoadedModel load_model(std::vector<char const*> const& aPaths, lut::FileReader* aReader, bool aPrefetchTextures);
+}
 
-	// Configure the GLFW window
-	UserState state{};
 
-	glfwSetWindowUserPointer(window.window, &state);
+int main(int argc, char* argv[]) try
+{
+	Options options = parse_options(argc, argv);
+	if (options.showHelp)
+	{
+		print_usage(argv[0]);
+		return 0;
+	}
 
-	glfwSetKeyCallback(window.window, &glfw_callback_key_press);
-	glfwSetMouseButtonCallback(window.window, &glfw_callback_button);
-	glfwSetCursorPosCallback(window.window, &glfw_callback_motion);
+	// Before any thread starts (see lut::shared_jobs())
+	lut::set_thread_placement(lut::ThreadPlacement{ options.pinRenderThread, options.lowPriorityWorkers, options.numaWorkers });
 
+	// Create Vulkan Window
+	lut::SwapchainConfig swapConfig{};
+	swapConfig.imageCount = options.swapchainImages;
+	swapConfig.extraUsage = options.streamPath ? VK_IMAGE_USAGE_SAMPLED_BIT : 0; // see VideoStream::supports()
+	switch (options.presentMode)
+	{
+	case EPresentMode::fifo: swapConfig.presentMode = VK_PRESENT_MODE_FIFO_KHR; break;
+	case EPresentMode::relaxed: swapConfig.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR; break;
+	case EPresentMode::mailbox: swapConfig.presentMode = VK_PRESENT_MODE_MAILBOX_KHR; break;
+	case EPresentMode::immediate: swapConfig.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR; break;
+	}
 
-	// Create VMA allocator
-	lut::Allocator allocator = lut::create_allocator(window);
+	// Benchmarks render offscreen, one frame per key of the camera path, into
+	// one image per frame in flight. Replays take the keys from the draw
+	// trace.
+	bool const bench = nullptr != options.benchPath || nullptr != options.replayPath;
+	bool const replay = nullptr != options.replayPath;
 
-	// Intialize resources
-	lut::RenderPass renderPass = create_render_pass(window);
+	CameraPath benchKeys;
+	DrawTrace replayTrace;
+	if (replay)
+	{
+		replayTrace = load_draw_trace(options.replayPath);
+		for (auto const& frame : replayTrace.frames)
+			benchKeys.emplace_back(CameraKey{ frame.time, frame.camera2world });
+	}
+	else if (bench)
+	{
+		benchKeys = load_camera_path(options.benchPath);
+	}
 
-	//TODO- (Section 3) create scene descriptor set layout
-	lut::DescriptorSetLayout sceneLayout = create_scene_descriptor_layout(window);
-	lut::DescriptorSetLayout objectLayout = create_material_descriptor_layout(window);
+	// --bench-frames: a shard of the keys, e.g., a render farm worker's (see
+	// util/render_farm.lua). The CSV rows and images keep the keys' indices
+	// in the whole path.
+	std::size_t benchFirstKey = 0;
+	if (bench && (options.benchFirstKey > 0 || options.benchKeyCount > 0))
+	{
+		benchFirstKey = std::min<std::size_t>(options.benchFirstKey, benchKeys.size());
+		std::size_t const end = 0 == options.benchKeyCount ? benchKeys.size() : std::min<std::size_t>(benchKeys.size(), benchFirstKey + options.benchKeyCount);
 
-	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, sceneLayout.handle, objectLayout.handle);
-	lut::Pipeline pipe = create_pipeline(window, renderPass.handle, pipeLayout.handle);
-	lut::Pipeline alphaPipe = create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle);
+		benchKeys.erase(benchKeys.begin() + end, benchKeys.end());
+		benchKeys.erase(benchKeys.begin(), benchKeys.begin() + benchFirstKey);
+		if (replay)
+		{
+			replayTrace.frames.erase(replayTrace.frames.begin() + end, replayTrace.frames.end());
+			replayTrace.frames.erase(replayTrace.frames.begin(), replayTrace.frames.begin() + benchFirstKey);
+		}
 
+		std::fprintf(stderr, "Info: rendering keys %zu to %zu\n", benchFirstKey, benchFirstKey + benchKeys.size());
+	}
 
-	auto [depthBuffer, depthBufferView] = create_depth_buffer(window, allocator);
+	//--model: the model loads (and, unless they stream in, its textures
+	//decode) while the device and pipelines are created below; the set-up
+	//then waits for what remains, and uploads
+	std::vector<char const*> modelPaths = options.models;
+	if (modelPaths.empty())
+		modelPaths.emplace_back(cfg::kBakedModelPath);
+
+	//--file-io=async: the textures are read the same way (see
+	//set_up_model())
+	lut::FileReader* const reader = options.asyncFileIo ? &lut::shared_file_reader() : nullptr;
+	if (reader && !reader->asynchronous())
+		std::fprintf(stderr, "Info: asynchronous file reads are unavailable; reading one at a time\n");
+
+	// The textures are loaded up front for benchmarks and texture arrays
+	// (see set_up_model() below); the streamed ones would be loaded twice
+	bool const prefetchTextures = bench || EMaterialMode::arrays == options.materialMode;
+	auto modelLoad = lut::async(lut::shared_jobs(), [modelPaths, reader, prefetchTextures] {
+		return load_model(modelPaths, reader, prefetchTextures);
+	});
+
+	// Alternate-frame rendering may add frames in flight (see below), each
+	// with its own offscreen image
+	bool const deviceGroup = EDeviceGroupMode::afr == options.deviceGroup;
+	auto window = bench
+		? lut::make_offscreen_window(VkExtent2D{ options.benchWidth, options.benchHeight }, deviceGroup ? kMaxFramesInFlight : options.framesInFlight, options.device, deviceGroup)
+		: lut::make_vulkan_window(swapConfig, options.device, deviceGroup);
+
+	if (!bench && window.presentMode != swapConfig.presentMode)
+		std::fprintf(stderr, "Info: requested present mode not supported, using %s\n", VK_PRESENT_MODE_FIFO_KHR == window.presentMode ? "fifo" : "relaxed");
+
+	// --api-counters: wraps volk's entry points, before the allocator takes
+	// its own and before any other thread calls them
+	if (options.apiCounters)
+		lut::install_api_counters();
+
+	// --quality: the tier's settings are the defaults of the options not
+	// given. auto takes the device's recorded tier, or calibrates it with
+	// benchmark runs at the window's size; benchmarks themselves use high.
+	// None of the tier's options affect the window.
+	{
+		EQuality quality = options.quality;
+		if (EQuality::automatic == quality && bench)
+		{
+			quality = EQuality::high;
+		}
+		else if (EQuality::automatic == quality)
+		{
+			QualityCalibration calibration{};
+			calibration.executable = argv[0];
+			calibration.benchPath = cfg::kQualityBenchPath;
+			calibration.firstKey = cfg::kQualityBenchFirstKey;
+			calibration.keyCount = cfg::kQualityBenchKeys;
+			calibration.recordPath = cfg::kQualityRecordPath;
+			calibration.extent = window.swapchainExtent;
+			calibration.targetMs = options.qualityTargetMs;
+
+			quality = select_quality(window, calibration);
+			std::fprintf(stderr, "Info: quality tier '%s'\n", quality_name(quality));
+		}
 
-	std::vector<lut::Framebuffer> framebuffers;
-	create_swapchain_framebuffers(window, renderPass.handle, framebuffers, depthBufferView.handle);
+		options = parse_options(argc, argv, quality_options(quality));
+	}
 
-	lut::CommandPool cpool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	// make_vulkan_window() enables all supported core features, and the
+	// supported subset of the Vulkan 1.2/1.3 features that we use; they are
+	// in window.caps. Without multiDrawIndirect, each indirect command is
+	// issued separately.
+	RenderSettings settings{ options.drawMode, options.materialMode, options.cullMode, options.occlusionMode, options.prepassMode, options.recordMode, options.vertexFormat, options.shadingPrecision, options.lightingMode, options.tangentFrame, options.shadingRate, false, false, false, false };
+	VkDeviceSize uniformAlignment = 1;
+	VkExtent2D shadingRateTexel{};
 
-	std::vector<VkCommandBuffer> cbuffers;
-	std::vector<lut::Fence> cbfences;
+	// Replays draw the traced lists, which take the place of the CPU culling
+	if (replay && ECullMode::cpu != settings.cullMode)
+	{
+		std::fprintf(stderr, "Info: replays draw the traced meshes, culling on the CPU\n");
+		settings.cullMode = ECullMode::cpu;
+	}
 
-	for (std::size_t i = 0; i < framebuffers.size(); ++i)
+	//--stream-cells: the draw commands of the streamed meshes change on the
+	//CPU, which the GPU culling's copy of them doesn't see
+	bool worldStreaming = options.streamCellSize > 0.f;
+	if (worldStreaming && bench)
+	{
+		std::fprintf(stderr, "Info: the benchmark uploads the whole model, world streaming disabled\n");
+		worldStreaming = false;
+	}
+	if (worldStreaming && ECullMode::gpu == settings.cullMode)
 	{
-		cbuffers.emplace_back(lut::alloc_command_buffer(window, cpool.handle));
-		cbfences.emplace_back(lut::create_fence(window, VK_FENCE_CREATE_SIGNALED_BIT));
+		std::fprintf(stderr, "Info: world streaming culls on the CPU\n");
+		settings.cullMode = ECullMode::cpu;
 	}
+	std::uint32_t maxBindlessTextures = cfg::kMaxBindlessTextures;
+	bool comparePrecision = bench && options.benchComparePrecision;
+	bool const compareDistribution = bench && options.benchCompareDistribution;
+	std::uint32_t const benchInstances = bench ? options.benchGridColumns * options.benchGridRows : 1;
+	bool temporalUpscale = EUpscale::temporal == options.upscale;
+	bool dynamicResolution = options.dynamicResolutionMs > 0.f || options.resolutionScale < 1.f || temporalUpscale; // also fixed scales, and temporal upscaling at full size
+	bool mipStreaming = !bench && options.textureBudgetMib > 0; // the benchmark loads full textures
+	bool virtualTextures = mipStreaming && options.virtualTextures; // within the same budget
+	bool reportMips = nullptr != options.mipReport; // see mip_report.hpp
+	bool asyncCompute = options.asyncCompute;
+	bool shadowsOn = options.shadowBudgetMs > 0.f;
+
+	// Subgroup variants of the point light loop and of the culling and Hi-Z
+	// passes, where their stage has the operations (--subgroups=off for
+	// comparisons); without them, the shaders that don't use the operations
+	bool const subgroupLights = options.subgroups && 0 != (window.caps.subgroupFragment & VK_SUBGROUP_FEATURE_BALLOT_BIT);
+	bool const subgroupCompaction = options.subgroups && 0 != (window.caps.subgroupCompute & VK_SUBGROUP_FEATURE_BALLOT_BIT);
+	bool const subgroupReduction = options.subgroups && 0 != (window.caps.subgroupCompute & VK_SUBGROUP_FEATURE_QUAD_BIT);
+	std::uint32_t afrDevices = 1; // alternate-frame rendering over that many devices of the group
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	{
+		auto const& caps = window.caps;
 
-	lut::Semaphore imageAvailable = lut::create_semaphore(window);
-	lut::Semaphore renderFinished = lut::create_semaphore(window);
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties(window.physicalDevice, &props);
 
+		settings.multiDrawIndirect = caps.multiDrawIndirect && props.limits.maxDrawIndirectCount > 1;
 
-	ModelPack ourModel;
-	BakedModel bakedModel;
-	lut::DescriptorPool dPool = lut::create_descriptor_pool(window);
-	lut::Sampler defaultSampler = lut::create_default_sampler(window);
-	{
-		lut::CommandPool loadCmdPool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
-		bakedModel = load_baked_model(cfg::kBakedModelPath);
-		ourModel = set_up_model(window, allocator, bakedModel, loadCmdPool.handle, dPool.handle, defaultSampler.handle, objectLayout.handle);
-	}
+		uniformAlignment = props.limits.minUniformBufferOffsetAlignment;
 
-	//TODO- (Section 3) create scene uniform buffer with lut::create_buffer()
-	lut::Buffer sceneUBO = lut::create_buffer(allocator,
-		sizeof(glsl::SceneUniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		// Bindless needs descriptor indexing, and non-zero firstInstance for
+		// indirect draws (the material index is passed that way).
+		bool const bindlessOk = caps.descriptorIndexing
+			&& (EDrawMode::direct == settings.drawMode || caps.drawIndirectFirstInstance);
+
+		if (EMaterialMode::bindless == settings.materialMode && !bindlessOk)
+		{
+			std::fprintf(stderr, "Info: bindless materials not supported by device, using per-material descriptor sets\n");
+			settings.materialMode = EMaterialMode::sets;
+		}
 
+		// Quantized vertices pass the mesh index as firstInstance
+		if (EVertexFormat::quantized == settings.vertexFormat && EDrawMode::indirect == settings.drawMode && !caps.drawIndirectFirstInstance)
+		{
+			std::fprintf(stderr, "Info: quantized vertices need drawIndirectFirstInstance with indirect draws, using fp32 vertices\n");
+			settings.vertexFormat = EVertexFormat::fp32;
+		}
 
-	//TODO- (Section 3) allocate descriptor set for uniform buffer
-	VkDescriptorSet sceneDescriptors = lut::alloc_desc_set(window, dPool.handle, sceneLayout.handle);
+		if (ECullMode::gpu == settings.cullMode && (EDrawMode::indirect != settings.drawMode || !caps.drawIndirectCount))
+		{
+			std::fprintf(stderr, "Info: GPU culling needs indirect draws and drawIndirectCount, culling on the CPU\n");
+			settings.cullMode = ECullMode::cpu;
+		}
 
-	//TODO- (Section 3) initialize descriptor set with vkUpdateDescriptorSets
-	{
-		VkWriteDescriptorSet desc[1]{};
+		if (EOcclusionMode::hiz == settings.occlusionMode && ECullMode::gpu != settings.cullMode)
+		{
+			std::fprintf(stderr, "Info: occlusion culling needs GPU culling, disabled\n");
+			settings.occlusionMode = EOcclusionMode::none;
+		}
 
-		VkDescriptorBufferInfo sceneUboInfo{};
-		sceneUboInfo.buffer = sceneUBO.buffer;
-		sceneUboInfo.range = VK_WHOLE_SIZE;
+		if (EShadingPrecision::fp16 == settings.shadingPrecision && !caps.shaderFloat16)
+		{
+			std::fprintf(stderr, "Info: fp16 shading needs shaderFloat16, shading in fp32\n");
+			settings.shadingPrecision = EShadingPrecision::fp32;
+		}
 
-		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[0].dstSet = sceneDescriptors;
-		desc[0].dstBinding = 0;
-		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		desc[0].descriptorCount = 1;
-		desc[0].pBufferInfo = &sceneUboInfo;
+		if (comparePrecision && !caps.shaderFloat16)
+		{
+			std::fprintf(stderr, "Info: --bench-compare-precision needs shaderFloat16, disabled\n");
+			comparePrecision = false;
+		}
 
-		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
-		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
-	}
+		// The material pass reads the materials and fp32 vertices through
+		// descriptor indexing; the triangle IDs use gl_PrimitiveID, which
+		// fragment shaders only have with geometryShader
+		if (ELightingMode::visibility == settings.lightingMode && (EMaterialMode::bindless != settings.materialMode || !caps.geometryShader))
+		{
+			std::fprintf(stderr, "Info: the visibility buffer needs bindless materials and geometryShader, shading forward\n");
+			settings.lightingMode = ELightingMode::forward;
+		}
 
+		if (ELightingMode::visibility == settings.lightingMode && EVertexFormat::quantized == settings.vertexFormat)
+		{
+			std::fprintf(stderr, "Info: the visibility buffer fetches fp32 vertices, using fp32 vertices\n");
+			settings.vertexFormat = EVertexFormat::fp32;
+		}
 
-	// Application main loop
-	bool recreateSwapchain = false;
+		// The visibility buffer interpolates nothing
+		if (ELightingMode::visibility == settings.lightingMode && ETangentFrame::quaternion == settings.tangentFrame)
+		{
+			std::fprintf(stderr, "Info: the visibility buffer fetches the vertices' tangent frames, ignoring --tangent-frame\n");
+			settings.tangentFrame = ETangentFrame::vectors;
+		}
 
-	//timing
-	auto previousClock = Clock_::now();
+		// The G-buffer and visibility passes already shade every pixel once
+		if (ELightingMode::forward != settings.lightingMode && EPrepassMode::depth == settings.prepassMode)
+		{
+			std::fprintf(stderr, "Info: %s has no depth pre-pass, disabled\n", ELightingMode::deferred == settings.lightingMode ? "deferred lighting" : "the visibility buffer");
+			settings.prepassMode = EPrepassMode::none;
+		}
 
-	while (!glfwWindowShouldClose(window.window))
-	{
-		// Let GLFW process events.
-		// glfwPollEvents() checks for events, processes them. If there are no
-		// events, it will return immediately. Alternatively, glfwWaitEvents()
-		// will wait for any event to occur, process it, and only return at
-		// that point. The former is useful for applications where you want to
-		// render as fast as possible, whereas the latter is useful for
-		// input-driven applications, where redrawing is only needed in
-		// reaction to user input (or similar).
-		glfwPollEvents(); // or: glfwWaitEvents()
+		// The G-buffer and visibility passes' shading subpasses read their
+		// inputs per pixel
+		if (EShadingRate::depth == settings.shadingRate)
+		{
+			shadingRateTexel = query_shading_rate_texel_size(window);
+			if (0 == shadingRateTexel.width)
+			{
+				std::fprintf(stderr, "Info: variable rate shading needs VK_KHR_fragment_shading_rate attachments, disabled\n");
+				settings.shadingRate = EShadingRate::off;
+			}
+			else if (ELightingMode::forward != settings.lightingMode)
+			{
+				std::fprintf(stderr, "Info: variable rate shading is only used with forward lighting, disabled\n");
+				settings.shadingRate = EShadingRate::off;
+			}
+		}
+		if (EShadingRate::off == settings.shadingRate)
+			shadingRateTexel = VkExtent2D{ 0, 0 };
 
-		// Recreate swap chain?
-		if (recreateSwapchain)
+		// The G-buffer and visibility passes' shading subpasses read their
+		// inputs as input attachments, which would need per-sample shading
+		if (options.msaaSamples > 1)
 		{
-			//TODO: (Section 1) re-create swapchain and associated resources - see Exercise 3!
+			if (ELightingMode::forward != settings.lightingMode)
+				std::fprintf(stderr, "Info: MSAA is only used with forward lighting, disabled\n");
+			else
+			{
+				msaaSamples = query_msaa_samples(window, options.msaaSamples);
+				if (std::uint32_t(msaaSamples) < options.msaaSamples)
+					std::fprintf(stderr, "Info: %ux MSAA not supported, using %ux\n", options.msaaSamples, std::uint32_t(msaaSamples));
+			}
+		}
 
-			// We need to destroy several objects, which may still be in use by
-			// the GPU. Therefore, first wait for the GPU to finish processing
-			vkDeviceWaitIdle(window.device);
+		// The controller needs the GPU frame time (see lut::GpuProfiler);
+		// fixed scales only the upscale
+		bool const resolutionTimed = options.dynamicResolutionMs > 0.f;
+		if (dynamicResolution && ((resolutionTimed && !props.limits.timestampComputeAndGraphics) || !supports_upscale(window)))
+		{
+			std::fprintf(stderr, "Info: dynamic resolution needs GPU timestamps and blits into the swapchain images, disabled\n");
+			dynamicResolution = false;
+		}
 
-			//Recreate them
-			auto const changes = recreate_swapchain(window);
+		if (asyncCompute && VK_NULL_HANDLE == window.computeQueue)
+		{
+			std::fprintf(stderr, "Info: no async compute queue, clustering lights on the graphics queue\n");
+			asyncCompute = false;
+		}
 
-			if (changes.changedFormat)
-				renderPass = create_render_pass(window);
+		// The forward and G-buffer fragment shaders write the mip feedback;
+		// the visibility buffer's material pass doesn't
+		if (mipStreaming && (!caps.fragmentStoresAndAtomics || ELightingMode::visibility == settings.lightingMode))
+		{
+			std::fprintf(stderr, "Info: mip streaming needs fragmentStoresAndAtomics, and forward or deferred lighting; streaming full textures\n");
+			mipStreaming = false;
+			virtualTextures = false;
+		}
 
-			if (changes.changedSize)
-				std::tie(depthBuffer, depthBufferView) = create_depth_buffer(window, allocator);
+		// The clamp to the resident tiles is in the bindless shaders only
+		if (virtualTextures && (EMaterialMode::bindless != settings.materialMode || !supports_virtual_textures(window)))
+		{
+			std::fprintf(stderr, "Info: virtual textures need sparse residency on the graphics queue, and bindless materials; streaming mips instead\n");
+			virtualTextures = false;
+		}
+		if (virtualTextures)
+			mipStreaming = false;
 
-			framebuffers.clear();
-			create_swapchain_framebuffers(window, renderPass.handle, framebuffers, depthBufferView.handle);
+		// Texture arrays are packed from the full textures, once loaded
+		if (mipStreaming && EMaterialMode::arrays == settings.materialMode)
+		{
+			std::fprintf(stderr, "Info: texture arrays need the textures up front, mip streaming disabled\n");
+			mipStreaming = false;
+		}
 
-			if (changes.changedSize)
+		// Occlusion queries gate the direct draws of the meshes, one by one,
+		// in the forward colour pass; the CPU culling lists the meshes to test
+		if (EOcclusionMode::query == settings.occlusionMode)
+		{
+			if (!caps.conditionalRendering || ELightingMode::forward != settings.lightingMode)
+			{
+				std::fprintf(stderr, "Info: occlusion queries need VK_EXT_conditional_rendering and forward lighting, disabled\n");
+				settings.occlusionMode = EOcclusionMode::none;
+			}
+			else if (EDrawMode::direct != settings.drawMode || ECullMode::cpu != settings.cullMode)
 			{
-				pipe = create_pipeline(window, renderPass.handle, pipeLayout.handle);
-				alphaPipe = create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle);
+				std::fprintf(stderr, "Info: occlusion queries gate direct draws, culling on the CPU and drawing directly\n");
+				settings.drawMode = EDrawMode::direct;
+				settings.cullMode = ECullMode::cpu;
 			}
-			recreateSwapchain = false;
-			continue;
 		}
 
-		//acquire swapchain image.
-		//wait for command buffer to be available
-		//record and submit commands
-		//present rendered images (note: use the present_results() method)
-		std::uint32_t imageIndex = 0;
-		auto const acquireRes = vkAcquireNextImageKHR(window.device,
-			window.swapchain, std::numeric_limits<std::uint64_t>::max(),
-			imageAvailable.handle, VK_NULL_HANDLE, &imageIndex);
+		// Multiview repeats the draws of a single forward subpass per eye.
+		// The other passes (and resolves) that would have to follow, and the
+		// point lights' clusters and impostors, are of a single view.
+		settings.stereo = EStereoMode::multiview == options.stereoMode;
+		if (settings.stereo && (!supports_stereo(window) || ELightingMode::forward != settings.lightingMode || EPrepassMode::none != settings.prepassMode
+			|| msaaSamples > VK_SAMPLE_COUNT_1_BIT || EShadingRate::off != settings.shadingRate || dynamicResolution || options.impostorPixels > 0.f || options.pointLights > 0))
+		{
+			std::fprintf(stderr, "Info: stereo rendering needs multiview, forward lighting, and no pre-pass, MSAA, shading rates, dynamic resolution, impostors or point lights; disabled\n");
+			settings.stereo = false;
+		}
+
+		// The Hi-Z pyramid (which GPU culling always binds), the triangle
+		// culling and the occlusion queries all see a single depth buffer
+		if (settings.stereo && (ECullMode::gpu == settings.cullMode || EOcclusionMode::none != settings.occlusionMode))
+		{
+			std::fprintf(stderr, "Info: stereo rendering culls on the CPU, without occlusion culling\n");
+			if (ECullMode::gpu == settings.cullMode)
+				settings.cullMode = ECullMode::cpu;
+			settings.occlusionMode = EOcclusionMode::none;
+		}
+
+		// Only the fp32 vector-tangent vertex shaders have stereo variants
+		if (settings.stereo && (EVertexFormat::fp32 != settings.vertexFormat || ETangentFrame::vectors != settings.tangentFrame))
+		{
+			std::fprintf(stderr, "Info: stereo rendering draws fp32 vertices with vector tangent frames\n");
+			settings.vertexFormat = EVertexFormat::fp32;
+			settings.tangentFrame = ETangentFrame::vectors;
+		}
 
-		if (VK_SUBOPTIMAL_KHR == acquireRes || VK_ERROR_OUT_OF_DATE_KHR == acquireRes)
+		// Alternate frames go to the devices of the group in turn, one frame
+		// slot per device (see framesInFlight below); the frame slots must
+		// not outnumber kMaxFramesInFlight
+		if (deviceGroup)
 		{
-			//This occurs e.g., when the window has been resized. In this case we needs to recreate
-			//the swap chain match the new dimensions. Any resources that directly depend on the swap chain
-			//need to be recreated as well. While rare, re_creating the swap chain may give us a different 
-			//image format, which we should handle.
-			//In both cases, we set the falg that the swap chain has to be re-created and jump to the top of 
-			// the loop. Technically, with the VK_SUBOPTIMAL_KHR return code, we could continue rendering with the current
-			// swapchain (unlike VK_ERROR_OUT_OF_DATA_KHR, which does require us to recreate the swap chain).
-			recreateSwapchain = true;
-			continue;
+			afrDevices = std::min(window.deviceCount, kMaxFramesInFlight);
+			if (afrDevices < 2)
+				std::fprintf(stderr, "Info: alternate-frame rendering needs a device group of several GPUs, disabled\n");
+			else if (afrDevices < window.deviceCount)
+				std::fprintf(stderr, "Info: alternate-frame rendering uses %u of the group's %u GPUs\n", afrDevices, window.deviceCount);
 		}
 
-		if (VK_SUCCESS != acquireRes)
+		// Each device has its own instance of every resource, and only sees
+		// the frames it renders itself: nothing on the GPU may carry over
+		// from one frame to the next. That rules out the occlusion culling
+		// (last frame's depth or queries), the shading rates (last frame's
+		// depth), the cached shadow faces, and the streaming (last frame's
+		// feedback, and loads copied within the frame). The async compute
+		// submissions would run on every device.
+		if (afrDevices > 1 && (EOcclusionMode::none != settings.occlusionMode || EShadingRate::off != settings.shadingRate || shadowsOn || asyncCompute || mipStreaming || virtualTextures || worldStreaming))
 		{
-			throw lut::Error("Unable to acquire next swapchain image\n" "vkAcquireNextImageKHR() returned %s", lut::to_string(acquireRes).c_str());
+			std::fprintf(stderr, "Info: alternate-frame rendering keeps no state between frames on the GPU: no occlusion culling, shading rates, shadows, async compute or streaming\n");
+			settings.occlusionMode = EOcclusionMode::none;
+			settings.shadingRate = EShadingRate::off;
+			shadingRateTexel = VkExtent2D{ 0, 0 };
+			shadowsOn = false;
+			asyncCompute = false;
+			mipStreaming = false;
+			virtualTextures = false;
+			worldStreaming = false;
 		}
 
-		//Make sure that the command buffer is no loger in use
-		assert(std::size_t(imageIndex) < cbfences.size());
+		// The mip report shares the streaming's feedback binding, and needs
+		// the materials' texture indices in the shaders (not the arrays'
+		// layers)
+		if (reportMips && (!caps.fragmentStoresAndAtomics || ELightingMode::visibility == settings.lightingMode
+			|| EMaterialMode::arrays == settings.materialMode || mipStreaming || virtualTextures || afrDevices > 1))
+		{
+			std::fprintf(stderr, "Info: --mip-report needs fragmentStoresAndAtomics, forward or deferred lighting, no texture arrays, streaming or alternate-frame rendering; no report\n");
+			reportMips = false;
+		}
 
-		if (auto const res = vkWaitForFences(window.device, 1, &cbfences[imageIndex].handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+		// The temporal upscale keeps a history from frame to frame, and reads
+		// the depth of a single-sampled, single view
+		if (temporalUpscale && (!dynamicResolution || afrDevices > 1 || settings.stereo || !supports_temporal_upscale(window)))
+		{
+			std::fprintf(stderr, "Info: temporal upscaling needs the render target of dynamic resolution, a single GPU, no stereo and RGBA16F storage images; upscaling bilinearly\n");
+			temporalUpscale = false;
+		}
+		if (temporalUpscale && msaaSamples > VK_SAMPLE_COUNT_1_BIT)
 		{
-			throw lut::Error("Unable to wait for command buffer fence %u\n" "vkWaitForFences() returned %s", imageIndex, lut::to_string(res).c_str());
+			std::fprintf(stderr, "Info: temporal upscaling replaces MSAA, disabled\n");
+			msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 		}
 
-		if (auto const res = vkResetFences(window.device, 1, &cbfences[imageIndex].handle); VK_SUCCESS != res)
+		// CPU culling changes the draws every frame
+		if (ERecordMode::cached == settings.recordMode && ECullMode::cpu == settings.cullMode)
 		{
-			throw lut::Error("Unable to reset command buffer fence %u\n" "vkResetFences() returned %s", imageIndex, lut::to_string(res).c_str());
+			std::fprintf(stderr, "Info: cached recording needs a static draw list, recording every frame\n");
+			settings.recordMode = ERecordMode::immediate;
 		}
 
-		//Update state
-		auto const now = Clock_::now();
-		auto const dt = std::chrono::duration_cast<Secondsf_>(now - previousClock).count();
-		previousClock = now;
+		auto const& limits = props.limits;
+		maxBindlessTextures = std::min({ maxBindlessTextures,
+			limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+			limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages });
+	}
+	bool const bindless = EMaterialMode::bindless == settings.materialMode;
+	bool const textureArrays = EMaterialMode::arrays == settings.materialMode;
+
+	// --lazy-materials: the textures go through the uploader, as their
+	// materials become visible
+	bool const lazyMaterials = options.lazyMaterials && !bench && !textureArrays && !virtualTextures;
+	if (options.lazyMaterials && !lazyMaterials)
+		std::fprintf(stderr, "Info: --lazy-materials needs streamed textures (no benchmark, texture arrays or virtual textures), disabled\n");
+
+	bool const quantized = EVertexFormat::quantized == settings.vertexFormat;
+	bool const qtangent = ETangentFrame::quaternion == settings.tangentFrame;
+	bool const msaa = msaaSamples > VK_SAMPLE_COUNT_1_BIT;
+
+	// The models have a position stream unless their vertices are quantized
+	// or streamed (see ModelPack::positions). World streaming may still be
+	// turned off below; the pipelines then just keep the interleaved stream.
+	settings.positionStream = !quantized && !worldStreaming;
+
+	// The culling shader always has the Hi-Z pyramid bound, so it exists
+	// with GPU culling even if occlusion culling is off.
+	bool const useHiz = ECullMode::gpu == settings.cullMode;
+	bool const shadingRate = EShadingRate::depth == settings.shadingRate;
+	bool const sampledDepth = useHiz || shadingRate || temporalUpscale; // read by compute shaders after the pass
+	bool const prepass = EPrepassMode::depth == settings.prepassMode;
+	bool const deferred = ELightingMode::deferred == settings.lightingMode;
+	bool const visibility = ELightingMode::visibility == settings.lightingMode;
+	bool const cachedDraws = ERecordMode::cached == settings.recordMode;
+	bool const secondaryDraws = cachedDraws || options.recordThreads > 1;
+
+	// The pulled vertex shaders read the interleaved fp32 vertices (with a
+	// vector tangent frame) as a storage buffer; streamed geometry lives in
+	// a pool without storage usage, and the visibility buffer has its own
+	// vertex shader.
+	settings.vertexPulling = EVertexInput::pulled == options.vertexInput;
+	if (settings.vertexPulling && (quantized || qtangent || visibility || worldStreaming || settings.stereo))
+	{
+		std::fprintf(stderr, "Info: --vertex-input=pulled needs fp32 vertices with vector tangents, and no visibility buffer, world streaming or stereo, disabled\n");
+		settings.vertexPulling = false;
+	}
+
+	// Ray-query shadows build their BLASes from the fp32 vertices, which
+	// world streaming moves around; only the forward shaders with
+	// per-material sets and vector tangents have a ray-query variant. They
+	// replace the shadow cube, which then stays a single texel.
+	bool const rayShadows = shadowsOn && EShadows::rayQuery == options.shadows
+		&& supports_ray_shadows(window) && !quantized && !qtangent && !worldStreaming && !deferred && !visibility && !bindless && !textureArrays;
+	if (shadowsOn && EShadows::rayQuery == options.shadows && !rayShadows)
+		std::fprintf(stderr, "Info: ray-query shadows need VK_KHR_ray_query, fp32 vertices with vector tangents, forward shading with per-material sets and no world streaming; using the shadow cube\n");
+	if (rayShadows)
+		shadowsOn = false;
+
+	// D16_UNORM and D32_SFLOAT are supported as (sampled) depth attachments
+	// everywhere this runs; X8_D24_UNORM_PACK32 is optional
+	VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
+	if (EDepthFormat::d16 == options.depthFormat)
+		depthFormat = VK_FORMAT_D16_UNORM;
+	else if (EDepthFormat::d24 == options.depthFormat)
+	{
+		VkFormatProperties formatProps{};
+		vkGetPhysicalDeviceFormatProperties(window.physicalDevice, VK_FORMAT_X8_D24_UNORM_PACK32, &formatProps);
 
-		update_user_state(state, dt);
+		VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (sampledDepth ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0);
+		if (needed == (formatProps.optimalTilingFeatures & needed))
+			depthFormat = VK_FORMAT_X8_D24_UNORM_PACK32;
+		else
+			std::fprintf(stderr, "Info: X8_D24_UNORM_PACK32 depth is not supported, using D32_SFLOAT\n");
+	}
 
-		//prepare data for this frame(section 3)
-		glsl::SceneUniform sceneUniforms{};
-		update_scene_uniforms(sceneUniforms, window.swapchainExtent.width, window.swapchainExtent.height, state);
+	// Per-triangle culling reads fp32 positions, and rewrites the GPU
+	// culler's commands; the visibility buffer's triangle IDs count the
+	// primitives of whole meshes
+	bool triangleCull = options.triangleCull;
+	if (triangleCull && (ECullMode::gpu != settings.cullMode || quantized || visibility))
+	{
+		std::fprintf(stderr, "Info: per-triangle culling needs GPU culling, fp32 vertices and no visibility buffer, disabled\n");
+		triangleCull = false;
+	}
 
-		assert(std::size_t(imageIndex) < cbuffers.size());
-		assert(std::size_t(imageIndex) < framebuffers.size());
+	// Conditional rendering isn't inherited by secondary command buffers
+	if (EOcclusionMode::query == settings.occlusionMode && secondaryDraws)
+	{
+		std::fprintf(stderr, "Info: occlusion queries need the draws recorded inline (--record-threads=1), disabled\n");
+		settings.occlusionMode = EOcclusionMode::none;
+	}
 
-		record_commands(cbuffers[imageIndex], renderPass.handle, framebuffers[imageIndex].handle, pipe.handle,
-			window.swapchainExtent, sceneUBO.buffer, sceneUniforms, pipeLayout.handle, sceneDescriptors, ourModel, alphaPipe.handle, bakedModel);
+	// Descriptor buffers hold the sets of the forward, depth and shadow
+	// pipelines (see descriptor_buffer_sets.hpp); the visibility buffer's
+	// material pass binds the bindless set next to its own, and stays with
+	// descriptor sets
+	bool descriptorBuffer = options.descriptorBuffer;
+	if (descriptorBuffer && (!bindless || visibility || !window.caps.descriptorBuffer))
+	{
+		std::fprintf(stderr, "Info: --descriptor-buffer needs bindless materials, no visibility buffer and VK_EXT_descriptor_buffer, disabled\n");
+		descriptorBuffer = false;
+	}
 
-		submit_commands(window, cbuffers[imageIndex], cbfences[imageIndex].handle, imageAvailable.handle, renderFinished.handle);
+	// Configure the GLFW window
+	UserState state{};
 
-		present_results(window.presentQueue, window.swapchain, imageIndex, renderFinished.handle, recreateSwapchain);
+	if (window.window)
+	{
+		glfwSetWindowUserPointer(window.window, &state);
 
+		glfwSetKeyCallback(window.window, &glfw_callback_key_press);
+		glfwSetMouseButtonCallback(window.window, &glfw_callback_button);
+		glfwSetCursorPosCallback(window.window, &glfw_callback_motion);
+		glfwSetWindowRefreshCallback(window.window, &glfw_callback_refresh);
+		glfwSetFramebufferSizeCallback(window.window, &glfw_callback_resize);
 
+		glfwGetFramebufferSize(window.window, &state.framebufferWidth, &state.framebufferHeight);
 	}
 
-	// Cleanup takes place automatically in the destructors, but we sill need
-	// to ensure that all Vulkan commands have finished before that.
-	vkDeviceWaitIdle(window.device);
 
-	return 0;
-}
-catch (std::exception const& eErr)
-{
-	std::fprintf(stderr, "\n");
-	std::fprintf(stderr, "Error: %s\n", eErr.what());
-	return 1;
-}
+	// Create VMA allocator
+	lut::StartupPhase allocatorPhase("allocator creation");
+	lut::AllocatorConfig allocatorConfig;
+	allocatorConfig.deviceAddresses = descriptorBuffer;
+	lut::Allocator allocator = lut::create_allocator(window, allocatorConfig);
+	allocatorPhase.end();
 
-namespace
-{
-	void glfw_callback_key_press(GLFWwindow* aWindow, int aKey, int /*aScanCode*/, int aAction, int /*aModifierFlags*/)
+	// Intialize resources
+	lut::RenderPass renderPass = create_render_pass(window, depthFormat, sampledDepth, prepass, settings.lightingMode, shadingRateTexel, dynamicResolution, msaaSamples, settings.stereo);
+
+	// Samplers are shared by everything that asks for the same state
+	lut::SamplerCache samplers(window);
+	VkSampler defaultSampler = VK_NULL_HANDLE;
 	{
-		if (GLFW_KEY_ESCAPE == aKey && GLFW_PRESS == aAction)
+		// --mip-bias, --anisotropy (e.g., from the quality tier)
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties(window.physicalDevice, &props);
+
+		VkSamplerCreateInfo samplerInfo = lut::default_sampler_info(window);
+		samplerInfo.mipLodBias = std::clamp(options.mipBias, -props.limits.maxSamplerLodBias, props.limits.maxSamplerLodBias);
+		if (0 != options.maxAnisotropy)
+			samplerInfo.maxAnisotropy = std::min(samplerInfo.maxAnisotropy, float(options.maxAnisotropy));
+		samplerInfo.anisotropyEnable = samplerInfo.maxAnisotropy > 1.f ? VK_TRUE : VK_FALSE;
+
+		defaultSampler = samplers.get(samplerInfo);
+	}
+
+	// Likewise the shader modules, e.g., the vertex shader of every variant
+	// of the colour pipelines, and the pipelines recreated with the
+	// swapchain. The SPIR-V is embedded; see --shader-dir.
+	lut::ShaderModuleCache shaderModules(window, embedded_spirv(), embedded_spirv_count(), options.shaderDir);
+
+	//TODO- (Section 3) create scene descriptor set layout
+	lut::DescriptorSetLayout sceneLayout = create_scene_descriptor_layout(window, rayShadows);
+	lut::DescriptorSetLayout objectLayout = create_material_descriptor_layout(window, defaultSampler);
+
+	lut::DescriptorSetLayout bindlessLayout;
+	if (bindless)
+		bindlessLayout = create_bindless_descriptor_layout(window, maxBindlessTextures);
+
+	// --descriptor-buffer: the layouts of the forward, depth and shadow
+	// pipelines, whose sets then live in descriptorSets.buffer. The
+	// descriptor sets of the above layouts stay for the other passes.
+	DescriptorBufferSets descriptorSets;
+	VkPipelineCreateFlags const setFlags = descriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+	if (descriptorBuffer)
+	{
+		descriptorSets.buffer = lut::DescriptorBuffer(window, allocator, cfg::kDescriptorBufferBytes);
+		descriptorSets.sceneLayout = create_scene_descriptor_layout(window, rayShadows, true);
+		descriptorSets.bindlessLayout = create_bindless_descriptor_layout(window, maxBindlessTextures, true);
+	}
+	VkDescriptorSetLayout const drawSceneLayout = descriptorBuffer ? descriptorSets.sceneLayout.handle : sceneLayout.handle;
+	VkDescriptorSetLayout const drawBindlessLayout = descriptorBuffer ? descriptorSets.bindlessLayout.handle : bindlessLayout.handle;
+
+	// --tangent-frame=quaternion has its own vertex shaders, and fragment
+	// shaders to match (*_qtangent.*)
+	char const* const vertShaders[2][2] = {
+		{ bindless ? cfg::kBindlessVertShaderPath : cfg::kVertShaderPath, bindless ? cfg::kBindlessQuantizedVertShaderPath : cfg::kQuantizedVertShaderPath },
+		{ bindless ? cfg::kBindlessQTangentVertShaderPath : cfg::kQTangentVertShaderPath, bindless ? cfg::kBindlessQTangentQuantizedVertShaderPath : cfg::kQTangentQuantizedVertShaderPath }
+	};
+	char const* const pulledVertShader = bindless ? cfg::kBindlessPulledVertShaderPath : cfg::kPulledVertShaderPath;
+	char const* const stereoVertShader = bindless ? cfg::kBindlessStereoVertShaderPath : cfg::kStereoVertShaderPath;
+	char const* const vertShader = visibility ? cfg::kVisibilityVertShaderPath
+		: settings.vertexPulling ? pulledVertShader
+		: settings.stereo ? stereoVertShader
+		: vertShaders[qtangent][quantized];
+	// By the tangent frame, kPipelineAlphaMask and kPipelineHalfPrecision.
+	// Opaque batches use a shader without discard (and early depth tests).
+	// The G-buffer shaders do no lighting, so they have no fp16 variant.
+	// Every material mode has its own fragment shaders.
+	auto const by_materials = [&] (char const* aSets, char const* aBindless, char const* aArrays) {
+		return bindless ? aBindless : textureArrays ? aArrays : aSets;
+	};
+	// --shadows=ray-query: variants of the per-material set shaders
+	auto const by_shadows = [&] (char const* aCube, char const* aRayQuery) {
+		return rayShadows ? aRayQuery : aCube;
+	};
+	// kPipelineSubgroupLights: every lighting shader has a *_subgroup
+	// variant (see premake5.lua), "x.frag.spv" -> "x_subgroup.frag.spv"
+	auto const by_subgroups = [] (char const* aPath, lut::PermutationKey aKey) {
+		std::string path(aPath);
+		if (aKey & kPipelineSubgroupLights)
+			path.insert(path.size() - std::strlen(".frag.spv"), "_subgroup");
+		return path;
+	};
+	char const* const forwardFragShaders[2][2][2] = {
 		{
-			glfwSetWindowShouldClose(aWindow, GLFW_TRUE);
+			{ by_materials(by_shadows(cfg::kFragShaderPath, cfg::kRayQueryFragShaderPath), cfg::kBindlessFragShaderPath, cfg::kArraysFragShaderPath),
+				by_materials(by_shadows(cfg::kHalfFragShaderPath, cfg::kRayQueryHalfFragShaderPath), cfg::kBindlessHalfFragShaderPath, cfg::kArraysHalfFragShaderPath) },
+			{ by_materials(by_shadows(cfg::kAlphaFragShaderPath, cfg::kRayQueryAlphaFragShaderPath), cfg::kBindlessAlphaFragShaderPath, cfg::kArraysAlphaFragShaderPath),
+				by_materials(by_shadows(cfg::kHalfAlphaFragShaderPath, cfg::kRayQueryHalfAlphaFragShaderPath), cfg::kBindlessHalfAlphaFragShaderPath, cfg::kArraysHalfAlphaFragShaderPath) }
+		},
+		{
+			{ by_materials(cfg::kQTangentFragShaderPath, cfg::kBindlessQTangentFragShaderPath, cfg::kArraysQTangentFragShaderPath),
+				by_materials(cfg::kQTangentHalfFragShaderPath, cfg::kBindlessQTangentHalfFragShaderPath, cfg::kArraysQTangentHalfFragShaderPath) },
+			{ by_materials(cfg::kQTangentAlphaFragShaderPath, cfg::kBindlessQTangentAlphaFragShaderPath, cfg::kArraysQTangentAlphaFragShaderPath),
+				by_materials(cfg::kQTangentHalfAlphaFragShaderPath, cfg::kBindlessQTangentHalfAlphaFragShaderPath, cfg::kArraysQTangentHalfAlphaFragShaderPath) }
 		}
+	};
+	char const* const gbufferFragShaders[2] = {
+		qtangent ? by_materials(cfg::kQTangentGBufferFragShaderPath, cfg::kBindlessQTangentGBufferFragShaderPath, cfg::kArraysQTangentGBufferFragShaderPath)
+			: by_materials(cfg::kGBufferFragShaderPath, cfg::kBindlessGBufferFragShaderPath, cfg::kArraysGBufferFragShaderPath),
+		qtangent ? by_materials(cfg::kQTangentGBufferAlphaFragShaderPath, cfg::kBindlessQTangentGBufferAlphaFragShaderPath, cfg::kArraysQTangentGBufferAlphaFragShaderPath)
+			: by_materials(cfg::kGBufferAlphaFragShaderPath, cfg::kBindlessGBufferAlphaFragShaderPath, cfg::kArraysGBufferAlphaFragShaderPath)
+	};
+	char const* const visibilityFragShaders[2] = { cfg::kVisibilityFragShaderPath, cfg::kVisibilityAlphaFragShaderPath };
+	std::uint32_t const colorAttachments = deferred ? kGBufferColorAttachments : 1;
+
+	// All pipelines are created through the on-disk cache
+	// --bench-compare-*: each key is rendered twice, the second time with
+	// the compared feature, and the two images are diffed
+	bool const compareImages = comparePrecision || compareDistribution;
+	bool const benchImages = bench && nullptr != options.benchImages;
+
+	lut::StartupPhase pipelinePhase("pipeline creation");
+	lut::PipelineCache pipeCache = lut::load_pipeline_cache(window, cfg::kPipelineCachePath);
+
+	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, drawSceneLayout, bindless ? drawBindlessLayout : objectLayout.handle);
+	lut::set_name(window, pipeLayout, "scene pipeline layout");
+
+	// Colour pipelines by EPipelineFeature; variants are created when first
+	// drawn with. The default ones are created up front. With pipeline
+	// libraries, the variants are fast-linked from shared parts, and
+	// replaced by optimized links as they complete (see lut::PipelineLinker).
+	lut::PipelineLinker pipeLinker(window, pipeCache.handle, EPipelineLibrary::off != options.pipelineLibrary, EPipelineLibrary::on == options.pipelineLibrary);
+	if (EPipelineLibrary::off != options.pipelineLibrary && !pipeLinker.enabled())
+		std::fprintf(stderr, "Info: no fast-linking graphics pipeline libraries, creating monolithic pipelines\n");
+	lut::PipelineVariants colourPipes(pipeCache.handle, kPipelineFeatureCount,
+		[&] (lut::PermutationKey aKey, VkSpecializationInfo const* aSpec, VkPipelineCache) {
+			bool const alpha = aKey & kPipelineAlphaMask;
+			std::string const fragShader = deferred ? gbufferFragShaders[alpha]
+				: visibility ? visibilityFragShaders[alpha]
+				: by_subgroups(forwardFragShaders[qtangent][alpha][(aKey & kPipelineHalfPrecision) ? 1 : 0], aKey);
+
+			lut::Pipeline pipe = alpha
+				? create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle, pipeLinker, shaderModules, vertShader, fragShader.c_str(), prepass, quantized, aSpec, colorAttachments, visibility, shadingRate, msaaSamples, settings.vertexPulling, setFlags)
+				: create_pipeline(window, renderPass.handle, pipeLayout.handle, pipeLinker, shaderModules, vertShader, fragShader.c_str(), prepass, quantized, aSpec, colorAttachments, visibility, shadingRate, msaaSamples, settings.vertexPulling, setFlags);
+
+			lut::set_name(window, pipe, ("colour pipeline " + std::to_string(aKey)).c_str());
+			return pipe;
+		});
+
+	lut::PermutationKey const precisionFeatures = EShadingPrecision::fp16 == settings.shadingPrecision ? kPipelineHalfPrecision : 0;
+	lut::PermutationKey const streamingFeatures = (mipStreaming || reportMips) ? kPipelineMipFeedback
+		: virtualTextures ? kPipelineMipFeedback | kPipelineVirtualTextures : 0;
+	lut::PermutationKey const coverageFeatures = msaa ? kPipelineAlphaToCoverage : 0;
+	lut::PermutationKey const distributionFeatures = EDistribution::lut == options.distribution ? kPipelineDistributionLut : 0;
+	lut::PermutationKey const subgroupFeatures = subgroupLights ? kPipelineSubgroupLights : 0;
+
+	// Drawn with while the variant a frame asks for compiles in the
+	// background (see the frame loop)
+	lut::PermutationKey const defaultFeatures = kPipelineNormalMaps | precisionFeatures | distributionFeatures | streamingFeatures | coverageFeatures | subgroupFeatures;
+	colourPipes.get(defaultFeatures);
+	colourPipes.get(defaultFeatures | kPipelineAlphaMask);
+
+	lut::Pipeline depthPipe;
+	if (prepass)
+		depthPipe = create_depth_pipeline(window, renderPass.handle, pipeLayout.handle, pipeCache.handle, shaderModules, quantized, msaaSamples, nullptr, settings.positionStream, setFlags);
+
+	//the depth-only passes alpha test the masked meshes by their alpha
+	//coverage textures; not with fp32 vertices and mesh instances, whose
+	//firstInstance is the mesh rather than the material
+	char const* const alphaTestFrag = (visibility && !quantized) ? nullptr
+		: by_materials(cfg::kDepthAlphaFragShaderPath, cfg::kBindlessDepthAlphaFragShaderPath, cfg::kArraysDepthAlphaFragShaderPath);
+
+	//with MSAA, the colour pass masks them by alpha-to-coverage instead, so
+	//they stay out of the pre-pass
+	bool const prepassAlpha = prepass && !msaa && nullptr != alphaTestFrag;
+	lut::Pipeline depthAlphaPipe;
+	if (prepassAlpha)
+		depthAlphaPipe = create_depth_pipeline(window, renderPass.handle, pipeLayout.handle, pipeCache.handle, shaderModules, quantized, msaaSamples, alphaTestFrag, false, setFlags);
+	pipelinePhase.end();
+
+
+	// Stereo draws into its own layered depth (see StereoTargets)
+	lut::Image depthBuffer;
+	lut::ImageView depthBufferView;
+	if (!settings.stereo)
+		std::tie(depthBuffer, depthBufferView) = create_depth_buffer(window, allocator, depthFormat, sampledDepth, deferred);
+
+	// --dynamic-resolution draws into the render target, and upscales it
+	RenderTarget renderTarget;
+	if (dynamicResolution)
+		renderTarget = create_render_target(window, allocator);
+
+	// --stereo draws both eyes into layered attachments, copied side by side
+	StereoTargets stereoTargets;
+	if (settings.stereo)
+		stereoTargets = create_stereo_targets(window, allocator, depthFormat);
+
+	// --msaa draws into multisampled attachments, resolved in the pass
+	MsaaTargets msaaTargets;
+	if (msaa)
+		msaaTargets = create_msaa_targets(window, allocator, depthFormat, msaaSamples);
+
+	ResolutionController resolution{};
+	resolution.targetMs = options.dynamicResolutionMs;
+	resolution.scale = std::max(options.resolutionScale, resolution.minScale);
+
+	GBuffer gbuffer;
+	if (deferred)
+		gbuffer = create_gbuffer(window, allocator);
+
+	VisibilityBuffer visibilityBuffer;
+	if (visibility)
+		visibilityBuffer = create_visibility_buffer(window, allocator);
 
-		auto state = static_cast<UserState*>(glfwGetWindowUserPointer(aWindow));
-		assert(state);
+	lut::CommandPool cpool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-		bool const isReleased = (GLFW_RELEASE == aAction);
+	//buffers that both queues access are shared concurrently
+	lut::CommandPool computePool;
+	std::vector<std::uint32_t> sharedFamilies;
+	if (asyncCompute)
+	{
+		computePool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, window.computeFamilyIndex);
+		sharedFamilies = { window.graphicsFamilyIndex, window.computeFamilyIndex };
+	}
+
+	// Frames signal consecutive values; resources that frames in flight may
+	// still use are retired to it.
+	lut::Timeline timeline(window);
+
+	// Frame slot i renders on device i % afrDevices, so that the slot's
+	// resources (and its query range) stay on one device; a frame per
+	// device if the rounded-up count is too large
+	std::uint32_t framesInFlight = options.framesInFlight;
+	if (afrDevices > 1)
+	{
+		framesInFlight = (framesInFlight + afrDevices - 1) / afrDevices * afrDevices;
+		if (framesInFlight > kMaxFramesInFlight)
+			framesInFlight = afrDevices;
+		if (framesInFlight != options.framesInFlight)
+			std::fprintf(stderr, "Info: alternate-frame rendering over %u GPUs, %u frames in flight\n", afrDevices, framesInFlight);
+	}
+
+	std::vector<FrameResources> frames(framesInFlight);
+	for (auto& frame : frames)
+	{
+		auto const frameName = "frame " + std::to_string(&frame - frames.data());
+
+		frame.cmdBuff = lut::alloc_command_buffer(window, cpool.handle);
+		frame.imageAvailable = lut::create_semaphore(window);
+		lut::set_name(window, frame.cmdBuff, frameName.c_str());
+
+		if (asyncCompute)
+		{
+			frame.computeCmdBuff = lut::alloc_command_buffer(window, computePool.handle);
+			frame.computeDone = lut::create_semaphore(window);
+			lut::set_name(window, frame.computeCmdBuff, (frameName + " compute").c_str());
+		}
+
+		if (secondaryDraws)
+		{
+			// One job per thread; cached draws are recorded rarely, so
+			// their pools are not transient.
+			for (std::uint32_t i = 0; i < options.recordThreads; ++i)
+			{
+				auto& pool = frame.drawPools.emplace_back(lut::create_command_pool(window, cachedDraws ? 0 : VK_COMMAND_POOL_CREATE_TRANSIENT_BIT));
+				if (prepass)
+				{
+					frame.depthDraws.emplace_back(lut::alloc_command_buffer(window, pool.handle, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+					lut::set_name(window, frame.depthDraws.back(), (frameName + " depth draws " + std::to_string(i)).c_str());
+				}
+				frame.colourDraws.emplace_back(lut::alloc_command_buffer(window, pool.handle, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+				lut::set_name(window, frame.colourDraws.back(), (frameName + " colour draws " + std::to_string(i)).c_str());
+			}
+		}
+
+		// Offscreen images are R8G8B8A8
+		if (compareImages || benchImages)
+		{
+			auto const bytes = VkDeviceSize(window.swapchainExtent.width) * window.swapchainExtent.height * 4;
+			frame.readback = lut::create_buffer(allocator, bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback);
+		}
+	}
+
+	// A swapchain image's renderFinished semaphore is waited for by its
+	// presentation, so it may only be reused once the image is acquired
+	// again: one per swapchain image.
+	std::vector<lut::Semaphore> renderFinished;
+	for (std::size_t i = 0; i < window.swapImages.size(); ++i)
+		renderFinished.emplace_back(lut::create_semaphore(window));
+
+	// GPU pass timings, one query range per frame in flight
+	lut::GpuProfiler profiler(window, std::uint32_t(frames.size()), 16, 120, afrDevices);
+
+	FrameScopes scopes{};
+	scopes.profiler = &profiler;
+	scopes.context = &window;
+	scopes.frame = profiler.add_scope("frame");
+	scopes.cull = profiler.add_scope("cull");
+	scopes.clusters = profiler.add_scope("light clustering");
+	scopes.prepass = profiler.add_scope("depth pre-pass");
+	scopes.colour = profiler.add_scope("colour pass");
+	scopes.opaque = profiler.add_scope("opaque");
+	scopes.alpha = profiler.add_scope("alpha-masked");
+	scopes.lighting = profiler.add_scope(visibility ? "material pass" : "deferred lighting");
+	scopes.hiz = profiler.add_scope("hi-z");
+	scopes.shadows = profiler.add_scope("shadows");
+	scopes.shadingRate = profiler.add_scope("shading rate");
+	scopes.upscale = profiler.add_scope("upscale");
+	scopes.hud = profiler.add_scope("hud");
+
+	// Pipeline statistics of the opaque and alpha-masked draws (overdraw,
+	// culling and vertex reuse), for the benchmark output and the HUD
+	profiler.add_statistics(scopes.opaque);
+	profiler.add_statistics(scopes.alpha);
+
+
+	// Textures stream in while rendering; the benchmark loads them up front
+	// so that every frame it measures is final.
+	lut::AsyncUploader uploader(window, allocator);
+
+	// --texture-compression: the textures that aren't baked are
+	// block-compressed on the GPU, up front or as they stream in
+	std::optional<TextureCompressor> textureCompressor;
+	if (ETextureCompression::off != options.textureCompression)
+		textureCompressor = create_texture_compressor(window, samplers, shaderModules, cfg::kBcCompressShaderPath, ETextureCompression::quality == options.textureCompression, pipeCache.handle);
+	TextureCompressor const* const compressor = textureCompressor ? &*textureCompressor : nullptr;
+
+	// --gpu-decompression: compressed meshes are expanded on the GPU
+	std::optional<GeometryDecompressor> geometryDecompressor;
+	if (options.gpuDecompression)
+		geometryDecompressor = create_geometry_decompressor(window, shaderModules, cfg::kLz4DecompressShaderPath, pipeCache.handle);
+	GeometryDecompressor const* const decompressor = geometryDecompressor ? &*geometryDecompressor : nullptr;
+
+	// --mip-gen=compute: the decoded textures' levels are written by one
+	// dispatch each (formats without a shader are still blitted)
+	std::optional<lut::MipDownsampler> textureMips;
+	if (options.computeMips)
+	{
+		lut::DownsampleShader const shaders[] = {
+			{ VK_FORMAT_R8G8B8A8_UNORM, cfg::kDownsampleRgba8ShaderPath },
+			{ VK_FORMAT_R8_UNORM, cfg::kDownsampleR8ShaderPath }
+		};
+		textureMips.emplace(window, allocator, cpool.handle, shaderModules, lut::EDownsample::average, shaders, std::size(shaders), 256, pipeCache.handle);
+	}
+	lut::MipDownsampler* const mips = textureMips ? &*textureMips : nullptr;
+
+	ModelPack ourModel;
+	std::optional<WorldStreaming> world;
+	std::optional<RayShadows> rayScene; // --shadows=ray-query
+	lut::DescriptorAllocator descriptorAllocator(window);
+	{
+		lut::CommandPool loadCmdPool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		// The mapping (and with it the CPU-side geometry) goes away once the
+		// meshes are uploaded; the draws only need the sorted batches.
+		char const* const modelName = 1 == modelPaths.size() ? modelPaths.front() : "scene";
+
+		// The load's time that didn't overlap with the above; the item is
+		// the load's own time and the file's bytes
+		lut::StartupPhase modelPhase("model load");
+		LoadedModel loaded = modelLoad.get();
+		MappedBakedModel bakedModel = std::move(loaded.baked);
+		std::optional<BakedModel> sceneModel = std::move(loaded.scene);
+		TexturePrefetch* const prefetched = prefetchTextures ? &loaded.textures : nullptr;
+		modelPhase.end();
+
+		//the loaders mount the models' texture packs (cw2-bake --texture-pack)
+		std::size_t texturePacks = 0, packedTextures = 0;
+		lut::texture_pack_stats(texturePacks, packedTextures);
+		if (texturePacks > 0)
+			std::fprintf(stderr, "Info: %zu textures read from %zu texture pack(s)\n", packedTextures, texturePacks);
+
+		if (bindless)
+		{
+			auto const textureCount = sceneModel ? model_texture_count(*sceneModel) : model_texture_count(bakedModel);
+			if (textureCount > maxBindlessTextures)
+				throw lut::Error("Model uses %zu textures, bindless layout allows at most %u", textureCount, maxBindlessTextures);
+		}
+
+		// Triangle IDs count the primitives of whole meshes
+		bool meshlets = EGranularity::meshlet == options.granularity;
+		if (meshlets && visibility)
+		{
+			std::fprintf(stderr, "Info: the visibility buffer draws whole meshes\n");
+			meshlets = false;
+		}
+
+		//streamed meshes move within the geometry buffers, which the
+		//visibility buffer's mesh instances and meshlets don't follow
+		if (worldStreaming && (visibility || 1 != modelPaths.size()))
+		{
+			std::fprintf(stderr, "Info: world streaming needs a single model and no visibility buffer, disabled\n");
+			worldStreaming = false;
+		}
+		if (worldStreaming && meshlets)
+		{
+			std::fprintf(stderr, "Info: world streaming draws whole meshes\n");
+			meshlets = false;
+		}
+
+		// Instances share the draw commands, whose firstInstance is then no
+		// longer the mesh index (see set_model_instances())
+		bool instanced = benchInstances > 1 && options.benchInstanced;
+		if (instanced && (quantized || meshlets || visibility))
+		{
+			std::fprintf(stderr, "Info: --bench-instanced needs fp32 vertices and whole meshes, and no visibility buffer; tiling the grid\n");
+			instanced = false;
+		}
+
+		lut::StartupPhase setUpPhase("model set-up");
+		if (benchInstances > 1 && !instanced)
+		{
+			//--bench-grid: the copies are separate meshes, so every draw
+			//and cull mode sees a scene that many times larger
+			auto const tiled = tile_baked_model(sceneModel ? std::move(*sceneModel) : load_baked_model(modelPaths.front()), options.benchGridColumns, options.benchGridRows);
+			ourModel = set_up_model(window, allocator, tiled, loadCmdPool.handle, descriptorAllocator, defaultSampler, objectLayout.handle, drawBindlessLayout,
+				nullptr, quantized, meshlets, visibility, 0, textureArrays, compressor, reader, decompressor, descriptorBuffer ? &descriptorSets : nullptr, prefetched, mips);
+		}
+		else if (sceneModel)
+		{
+			ourModel = set_up_model(window, allocator, *sceneModel, loadCmdPool.handle, descriptorAllocator, defaultSampler, objectLayout.handle, drawBindlessLayout,
+				(bench || textureArrays) ? nullptr : &uploader, quantized, meshlets, visibility, (mipStreaming || virtualTextures) ? kStreamStartExtent : 0, textureArrays, compressor, reader, decompressor, descriptorBuffer ? &descriptorSets : nullptr, prefetched, mips, lazyMaterials);
+		}
+		else
+		{
+			ourModel = set_up_model(window, allocator, bakedModel, loadCmdPool.handle, descriptorAllocator, defaultSampler, objectLayout.handle, drawBindlessLayout,
+				(bench || textureArrays) ? nullptr : &uploader, quantized, meshlets, visibility, (mipStreaming || virtualTextures) ? kStreamStartExtent : 0, worldStreaming, textureArrays, compressor, reader, decompressor, descriptorBuffer ? &descriptorSets : nullptr, prefetched, mips, lazyMaterials);
+		}
+
+		// The geometry is in the buffers now; only the draw records (Mesh)
+		// stay on the CPU side
+		sceneModel.reset();
+		if (!worldStreaming)
+			bakedModel = MappedBakedModel{};
+
+		//--bench-instanced: the meshes once, each drawn for every copy
+		std::vector<glm::mat4> instanceTransforms{ glm::mat4(1.f) };
+		if (instanced)
+		{
+			glm::vec3 bmin(std::numeric_limits<float>::max()), bmax(-std::numeric_limits<float>::max());
+			for (auto const& mesh : ourModel.meshes)
+			{
+				bmin = glm::min(bmin, mesh.aabbMin);
+				bmax = glm::max(bmax, mesh.aabbMax);
+			}
+			instanceTransforms = grid_transforms(bmin, bmax, options.benchGridColumns, options.benchGridRows);
+		}
+		set_model_instances(window, allocator, loadCmdPool.handle, ourModel, instanceTransforms);
+		if (rayShadows)
+			rayScene.emplace(create_ray_shadows(window, allocator, loadCmdPool.handle, ourModel, instanceTransforms));
+		//the mapping stays, to read the meshes from on demand
+		if (worldStreaming)
+			world.emplace(create_world_streaming(window, allocator, ourModel, std::move(bakedModel), options.streamCellSize, VkDeviceSize(options.geometryBudgetMib) << 20, frames.size()));
+		setUpPhase.end();
+
+		if (visibility && !fits_visibility_ids(ourModel))
+			throw lut::Error("'%s' has too many meshes (or triangles per mesh) for visibility buffer triangle IDs", modelName);
+
+		if (meshlets && ourModel.meshlets.empty())
+			std::fprintf(stderr, "Info: '%s' has no meshlets (bake with --meshlets), drawing whole meshes\n", modelName);
+
+		if (replay)
+			check_draw_trace(replayTrace, ourModel, options.replayPath);
+	}
+
+	// Residency of the streamed textures' mip levels. Without it, the
+	// feedback binding gets a buffer that is never written (the shaders'
+	// kMipFeedback is off).
+	// The mip report (see mip_report.hpp) has a feedback of its own.
+	std::optional<TextureStreaming> streaming;
+	std::optional<MipReport> mipReport;
+	lut::Buffer unusedFeedback;
+	if (mipStreaming)
+		streaming.emplace(create_texture_streaming(allocator, ourModel, frames.size(), VkDeviceSize(options.textureBudgetMib) << 20, lazyMaterials));
+	else if (reportMips)
+		mipReport.emplace(create_mip_report(allocator, ourModel, frames.size()));
+	else if (!virtualTextures)
+		unusedFeedback = lut::create_buffer(allocator, sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::device);
+
+	// --lazy-materials: the first requests (of the textures outside the
+	// materials); the rest follow the culling
+	std::optional<LazyMaterials> lazy;
+	if (lazyMaterials)
+		lazy.emplace(create_lazy_materials(ourModel, uploader, mipStreaming ? kStreamStartExtent : 0, streaming ? &*streaming : nullptr));
+
+	// Or tile residency of the virtual textures. The residency binding
+	// likewise gets a buffer that is never read without them.
+	std::optional<VirtualTextures> virtualTex;
+	lut::Buffer unusedResidency;
+	if (virtualTextures)
+		virtualTex.emplace(create_virtual_textures(window, allocator, ourModel, defaultSampler, uploader, frames.size(), VkDeviceSize(options.textureBudgetMib) << 20));
+	else
+		unusedResidency = lut::create_buffer(allocator, sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::device);
+
+	// Defragmentation of the geometry and texture pools; one step per frame
+	// while it runs. The benchmark doesn't run long enough to need it.
+	std::optional<lut::Defragmenter> defragmenter;
+	if (!bench && options.defragBudgetMib > 0)
+	{
+		defragmenter.emplace(window, allocator, VkDeviceSize(options.defragBudgetMib) << 20);
+		allow_model_moves(allocator, ourModel);
+	}
+
+	bool const hasLods = std::any_of(ourModel.meshes.begin(), ourModel.meshes.end(), [] (Mesh const& aMesh) { return aMesh.lodCount > 1; });
+	bool const useLods = hasLods && options.lodPixelError > 0.f && ECullMode::none != settings.cullMode && !visibility;
+	if (hasLods && options.lodPixelError > 0.f && ECullMode::none == settings.cullMode)
+		std::fprintf(stderr, "Info: LOD selection requires culling (--cull=cpu or gpu), drawing full detail\n");
+	else if (hasLods && options.lodPixelError > 0.f && visibility)
+		std::fprintf(stderr, "Info: the visibility buffer draws full detail only\n");
+
+	if (!ourModel.pvs.bits.empty() && ECullMode::cpu != settings.cullMode)
+		std::fprintf(stderr, "Info: the baked PVS needs --cull=cpu, drawing without it\n");
+	if (ourModel.hasOcclusion && (deferred || visibility))
+		std::fprintf(stderr, "Info: baked ambient occlusion is applied by forward shading only\n");
+
+	// Culling inputs and outputs. With indirect draws, each frame in flight
+	// gets its own host-visible command buffer for the surviving commands;
+	// it is rewritten only after the frame's fence has been waited for.
+	AabbSoA const meshBounds = make_aabb_soa(ourModel.meshes);
+
+	DrawList drawList;
+	drawList.commands = ourModel.drawCommands.buffer;
+	drawList.opaqueBatches.assign(ourModel.opaqueBatches.begin(), ourModel.opaqueBatches.end());
+	drawList.alphaBatches.assign(ourModel.alphaBatches.begin(), ourModel.alphaBatches.end());
+	drawList.meshVisible.assign(ourModel.meshes.size(), 1);
+
+	std::vector<lut::Buffer> culledCommands;
+	if (ECullMode::cpu == settings.cullMode && EDrawMode::indirect == settings.drawMode && !ourModel.hostDrawCommands.empty())
+	{
+		for (std::size_t i = 0; i < frames.size(); ++i)
+		{
+			culledCommands.emplace_back(lut::create_buffer(allocator,
+				ourModel.hostDrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, lut::EMemoryClass::upload));
+		}
+	}
+
+	//TODO- (Section 3) create scene uniform buffer with lut::create_buffer()
+	SceneUniformRing sceneUBO;
+	{
+		sceneUBO.slotSize = (sizeof(glsl::SceneUniform) + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+		sceneUBO.buffer = lut::create_buffer(allocator, sceneUBO.slotSize * frames.size(),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, lut::EMemoryClass::upload, VMA_ALLOCATION_CREATE_MAPPED_BIT, sharedFamilies);
+
+		VmaAllocationInfo info{};
+		vmaGetAllocationInfo(allocator.allocator, sceneUBO.buffer.allocation, &info);
+		sceneUBO.mapped = static_cast<std::byte*>(info.pMappedData);
+	}
+
+
+	// Point lights spread over the scene, binned into clusters each frame.
+	// The (possibly empty) buffers are always bound.
+	LightBuffer lights;
+	{
+		glm::vec3 boundsMin(0.f), boundsMax(0.f);
+		if (meshBounds.count > 0)
+		{
+			boundsMin = glm::vec3(*std::min_element(meshBounds.minX.begin(), meshBounds.minX.begin() + meshBounds.count),
+				*std::min_element(meshBounds.minY.begin(), meshBounds.minY.begin() + meshBounds.count),
+				*std::min_element(meshBounds.minZ.begin(), meshBounds.minZ.begin() + meshBounds.count));
+			boundsMax = glm::vec3(*std::max_element(meshBounds.maxX.begin(), meshBounds.maxX.begin() + meshBounds.count),
+				*std::max_element(meshBounds.maxY.begin(), meshBounds.maxY.begin() + meshBounds.count),
+				*std::max_element(meshBounds.maxZ.begin(), meshBounds.maxZ.begin() + meshBounds.count));
+		}
+
+		lights = create_light_buffer(allocator, make_point_lights(options.pointLights, boundsMin, boundsMax), sharedFamilies);
+	}
+
+	LightClusters lightClusters = create_light_clusters(window, allocator, sceneLayout.handle, shaderModules, cfg::kClusterShaderPath, lights.count, pipeCache.handle, asyncCompute);
+
+	// The shadow cube is always bound; without shadows, it is a single
+	// texel at the far plane, and lights everything
+	ShadowCache shadows = create_shadow_cache(window, allocator, samplers, cpool.handle, drawSceneLayout, bindless ? drawBindlessLayout : objectLayout.handle,
+		shadowsOn ? kShadowMapSize : 1, options.shadowBudgetMs);
+
+	lut::Pipeline shadowPipe, shadowAlphaPipe;
+	if (shadowsOn)
+		shadowPipe = create_shadow_pipeline(window, shadows, pipeCache.handle, shaderModules, quantized, nullptr, settings.positionStream, setFlags);
+	if (shadowsOn && alphaTestFrag)
+		shadowAlphaPipe = create_shadow_pipeline(window, shadows, pipeCache.handle, shaderModules, quantized, alphaTestFrag, false, setFlags);
+
+	// Image-based lighting from --environment, generated once and cached
+	// on disk; without one, placeholders for the descriptors
+	Ibl const ibl = create_ibl(window, allocator, samplers, cpool.handle, options.environment, cfg::kIblCacheDir,
+		shaderModules, IblShaderPaths{ cfg::kIblShShaderPath, cfg::kIblSpecularShaderPath, cfg::kIblBrdfShaderPath }, pipeCache.handle);
+
+	// Read by the pipelines with kPipelineDistributionLut; always bound
+	DistributionLut const distributionLut = create_distribution_lut(window, allocator, samplers, cpool.handle);
+
+	//TODO- (Section 3) allocate descriptor set for uniform buffer
+	VkDescriptorSet sceneDescriptors = descriptorAllocator.allocate(sceneLayout.handle);
+
+	//TODO- (Section 3) initialize descriptor set with vkUpdateDescriptorSets
+	{
+		VkWriteDescriptorSet desc[12]{};
+
+		VkDescriptorBufferInfo sceneUboInfo{};
+		sceneUboInfo.buffer = sceneUBO.buffer.buffer;
+		sceneUboInfo.range = sizeof(glsl::SceneUniform); // one slot; the dynamic offset selects which
+
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = sceneDescriptors;
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		desc[0].descriptorCount = 1;
+		desc[0].pBufferInfo = &sceneUboInfo;
+
+		VkDescriptorBufferInfo lightsInfo{};
+		lightsInfo.buffer = lights.buffer.buffer;
+		lightsInfo.range = lut::descriptor_range(lights.buffer);
+
+		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[1].dstSet = sceneDescriptors;
+		desc[1].dstBinding = 1;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[1].descriptorCount = 1;
+		desc[1].pBufferInfo = &lightsInfo;
+
+		VkDescriptorBufferInfo clustersInfo{};
+		clustersInfo.buffer = lightClusters.grid.buffer;
+		clustersInfo.range = lut::descriptor_range(lightClusters.grid);
+
+		desc[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[2].dstSet = sceneDescriptors;
+		desc[2].dstBinding = 2;
+		desc[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[2].descriptorCount = 1;
+		desc[2].pBufferInfo = &clustersInfo;
+
+		VkDescriptorBufferInfo feedbackInfo{};
+		lut::Buffer const& feedback = streaming ? streaming->feedback.buffer : mipReport ? mipReport->feedback.buffer
+			: virtualTex ? virtualTex->feedback : unusedFeedback;
+		feedbackInfo.buffer = feedback.buffer;
+		feedbackInfo.range = lut::descriptor_range(feedback);
+
+		desc[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[3].dstSet = sceneDescriptors;
+		desc[3].dstBinding = 3;
+		desc[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[3].descriptorCount = 1;
+		desc[3].pBufferInfo = &feedbackInfo;
+
+		VkDescriptorImageInfo shadowInfo{};
+		shadowInfo.sampler = shadows.sampler;
+		shadowInfo.imageView = shadows.cubeView.handle;
+		shadowInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		desc[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[4].dstSet = sceneDescriptors;
+		desc[4].dstBinding = 4;
+		desc[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[4].descriptorCount = 1;
+		desc[4].pImageInfo = &shadowInfo;
+
+		VkDescriptorBufferInfo iblInfo{};
+		iblInfo.buffer = ibl.uniform.buffer;
+		iblInfo.range = lut::descriptor_range(ibl.uniform);
+
+		desc[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[5].dstSet = sceneDescriptors;
+		desc[5].dstBinding = 5;
+		desc[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		desc[5].descriptorCount = 1;
+		desc[5].pBufferInfo = &iblInfo;
+
+		VkDescriptorImageInfo iblSpecularInfo{};
+		iblSpecularInfo.sampler = ibl.sampler;
+		iblSpecularInfo.imageView = ibl.specularView.handle;
+		iblSpecularInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		desc[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[6].dstSet = sceneDescriptors;
+		desc[6].dstBinding = 6;
+		desc[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[6].descriptorCount = 1;
+		desc[6].pImageInfo = &iblSpecularInfo;
+
+		VkDescriptorImageInfo iblBrdfInfo{};
+		iblBrdfInfo.sampler = ibl.sampler;
+		iblBrdfInfo.imageView = ibl.brdfView.handle;
+		iblBrdfInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		desc[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[7].dstSet = sceneDescriptors;
+		desc[7].dstBinding = 7;
+		desc[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[7].descriptorCount = 1;
+		desc[7].pImageInfo = &iblBrdfInfo;
+
+		VkDescriptorImageInfo distributionInfo{};
+		distributionInfo.sampler = distributionLut.sampler;
+		distributionInfo.imageView = distributionLut.view.handle;
+		distributionInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		desc[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[8].dstSet = sceneDescriptors;
+		desc[8].dstBinding = 8;
+		desc[8].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[8].descriptorCount = 1;
+		desc[8].pImageInfo = &distributionInfo;
+
+		VkDescriptorBufferInfo instancesInfo{};
+		instancesInfo.buffer = ourModel.instances.buffer;
+		instancesInfo.range = lut::descriptor_range(ourModel.instances);
+
+		desc[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[9].dstSet = sceneDescriptors;
+		desc[9].dstBinding = 9;
+		desc[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[9].descriptorCount = 1;
+		desc[9].pBufferInfo = &instancesInfo;
+
+		VkDescriptorBufferInfo occlusionInfo{};
+		occlusionInfo.buffer = ourModel.occlusion.buffer;
+		occlusionInfo.range = lut::descriptor_range(ourModel.occlusion);
+
+		desc[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[10].dstSet = sceneDescriptors;
+		desc[10].dstBinding = 10;
+		desc[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[10].descriptorCount = 1;
+		desc[10].pBufferInfo = &occlusionInfo;
+
+		VkDescriptorBufferInfo residencyInfo{};
+		lut::Buffer const& residency = virtualTex ? virtualTex->residency : unusedResidency;
+		residencyInfo.buffer = residency.buffer;
+		residencyInfo.range = lut::descriptor_range(residency);
+
+		desc[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[11].dstSet = sceneDescriptors;
+		desc[11].dstBinding = 11;
+		desc[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[11].descriptorCount = 1;
+		desc[11].pBufferInfo = &residencyInfo;
+
+		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
+		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
+
+		if (descriptorBuffer)
+		{
+			allocate_scene_sets(descriptorSets, std::uint32_t(frames.size()), sceneUBO.slotSize);
+			write_scene_descriptors(descriptorSets, numSets, desc);
+			std::fprintf(stderr, "Info: descriptor buffer holds %u scene sets and the bindless set, %llu of %llu bytes\n",
+				descriptorSets.uniformSlots, (unsigned long long)descriptorSets.buffer.used(), (unsigned long long)descriptorSets.buffer.capacity());
+		}
+	}
+	if (rayScene)
+	{
+		VkWriteDescriptorSetAccelerationStructureKHR tlasInfo{};
+		tlasInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+		tlasInfo.accelerationStructureCount = 1;
+		tlasInfo.pAccelerationStructures = &rayScene->tlas.handle;
+
+		VkWriteDescriptorSet desc{};
+		desc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc.pNext = &tlasInfo;
+		desc.dstSet = sceneDescriptors;
+		desc.dstBinding = 13;
+		desc.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+		desc.descriptorCount = 1;
+
+		vkUpdateDescriptorSets(window.device, 1, &desc, 0, nullptr);
+	}
+	if (settings.vertexPulling)
+		update_vertex_descriptor(window, sceneDescriptors, ourModel);
+
+	GpuCuller gpuCuller;
+	if (ECullMode::gpu == settings.cullMode)
+	{
+		gpuCuller = create_gpu_culler(window, allocator, descriptorAllocator, shaderModules, subgroupCompaction ? cfg::kCullSubgroupShaderPath : cfg::kCullShaderPath, ourModel, bindless, sceneUBO.buffer.buffer, sizeof(glsl::SceneUniform), pipeCache.handle);
+
+		drawList.commands = gpuCuller.commands.buffer;
+		drawList.counts = gpuCuller.counts.buffer;
+		drawList.opaqueBatches.assign(gpuCuller.opaqueGroups.begin(), gpuCuller.opaqueGroups.end());
+		drawList.alphaBatches.assign(gpuCuller.alphaGroups.begin(), gpuCuller.alphaGroups.end());
+	}
+
+	// Per-triangle culling of the GPU culler's commands; the vertices are
+	// read untransformed, in object space
+	TriangleCuller triangleCuller;
+	if (triangleCull && 1 != ourModel.instanceCount)
+	{
+		std::fprintf(stderr, "Info: per-triangle culling needs a single copy of the model, disabled\n");
+		triangleCull = false;
+	}
+	if (triangleCull)
+	{
+		triangleCuller = create_triangle_culler(window, allocator, descriptorAllocator, shaderModules, subgroupCompaction ? cfg::kTriangleCullSubgroupShaderPath : cfg::kTriangleCullShaderPath, ourModel, gpuCuller,
+			sceneUBO.buffer.buffer, sizeof(glsl::SceneUniform), !msaa, pipeCache.handle);
+		drawList.triangles = &triangleCuller;
+	}
+
+	HizPyramid hiz;
+	if (useHiz)
+	{
+		hiz = create_hiz_pyramid(window, descriptorAllocator, samplers, shaderModules, subgroupReduction ? cfg::kHizSubgroupShaderPath : cfg::kHizShaderPath, subgroupReduction, pipeCache.handle);
+		if (options.computeMips && !enable_hiz_single_pass(hiz, window, allocator, cpool.handle, shaderModules, cfg::kDownsampleR32fShaderPath, pipeCache.handle))
+			std::fprintf(stderr, "Info: the device can't build the Hi-Z pyramid in a single pass; using a dispatch per level\n");
+		resize_hiz_pyramid(hiz, window, allocator, cpool.handle, depthBufferView.handle);
+		set_gpu_cull_hiz(window, gpuCuller, hiz.view.handle, hiz.sampler);
+	}
+
+	// Temporal upscaling resolves the render target into its history
+	TemporalUpscale temporal;
+	if (temporalUpscale)
+	{
+		temporal = create_temporal_upscale(window, descriptorAllocator, samplers, shaderModules, cfg::kTemporalResolveShaderPath, pipeCache.handle);
+		resize_temporal_upscale(temporal, window, allocator, cpool.handle, renderTarget.view.handle, depthBufferView.handle);
+	}
+
+	// Variable rate shading; the rate image is a framebuffer attachment
+	ShadingRate shadingRates;
+	if (shadingRate)
+	{
+		shadingRates = create_shading_rate(window, descriptorAllocator, samplers, shaderModules, cfg::kShadingRateShaderPath, shadingRateTexel, cfg::kShadingRateThreshold, pipeCache.handle);
+		resize_shading_rate(shadingRates, window, allocator, cpool.handle, depthBufferView.handle);
+	}
+
+	std::vector<lut::Framebuffer> framebuffers;
+	create_swapchain_framebuffers(window, renderPass.handle, framebuffers, depthBufferView.handle, deferred ? &gbuffer : nullptr, visibility ? &visibilityBuffer : nullptr, shadingRates.view.handle, renderTarget.view.handle, msaa ? &msaaTargets : nullptr, settings.stereo ? &stereoTargets : nullptr);
+
+	// Deferred lighting
+	DeferredLighting lighting;
+	if (deferred)
+	{
+		lighting = create_deferred_lighting(window, descriptorAllocator, sceneLayout.handle);
+		update_deferred_descriptors(window, lighting, gbuffer, depthBufferView.handle);
+	}
+
+	//distant meshes as impostors; their selection needs the CPU culling,
+	//and the quads are shaded like forward lighting does
+	Impostors impostors;
+	bool const useImpostors = options.impostorPixels > 0.f && !ourModel.impostors.meshes.empty()
+		&& ECullMode::cpu == settings.cullMode && ELightingMode::forward == settings.lightingMode && !replay;
+	if (useImpostors)
+	{
+		impostors = create_impostors(window, descriptorAllocator, samplers, ourModel, sceneLayout.handle, renderPass.handle, pipeCache.handle,
+			shaderModules, cfg::kImpostorVertShaderPath, cfg::kImpostorFragShaderPath, prepass, msaaSamples);
+		drawList.impostors = &impostors;
+	}
+	else if (options.impostorPixels > 0.f)
+	{
+		std::fprintf(stderr, "Info: impostors need a model baked with --impostors, CPU culling and forward lighting; drawing the meshes\n");
+	}
+
+	//--occlusion=query: the boxes are those of a single copy
+	OcclusionQueries occlusion;
+	bool const useOcclusionQueries = EOcclusionMode::query == settings.occlusionMode && 1 == ourModel.instanceCount;
+	if (useOcclusionQueries)
+	{
+		occlusion = create_occlusion_queries(window, allocator, ourModel, std::uint32_t(frames.size()), sceneLayout.handle, renderPass.handle, pipeCache.handle,
+			shaderModules, cfg::kOcclusionProxyVertShaderPath, prepass, msaaSamples);
+		drawList.occlusion = &occlusion;
+	}
+	else if (EOcclusionMode::query == settings.occlusionMode)
+	{
+		std::fprintf(stderr, "Info: occlusion queries test a single copy of the model, disabled\n");
+	}
+
+	// Visibility buffer material pass
+	VisibilityShading visibilityShading;
+	if (visibility)
+	{
+		visibilityShading = create_visibility_shading(window, allocator, descriptorAllocator, sceneLayout.handle, bindlessLayout.handle, ourModel);
+		update_visibility_descriptors(window, visibilityShading, visibilityBuffer);
+	}
+
+	// By kPipelineHalfPrecision, kPipelineDistributionLut and
+	// kPipelineSubgroupLights, and for the material pass (which samples the
+	// materials) kPipelineNormalMaps; alpha masking doesn't apply
+	lut::PipelineVariants lightingPipes(pipeCache.handle, kPipelineFeatureCount,
+		[&] (lut::PermutationKey aKey, VkSpecializationInfo const* aSpec, VkPipelineCache aCache) {
+			bool const half = aKey & kPipelineHalfPrecision;
+			if (visibility)
+			{
+				std::string const fragShader = by_subgroups(half ? cfg::kVisibilityShadeHalfFragShaderPath : cfg::kVisibilityShadeFragShaderPath, aKey);
+				return create_deferred_pipeline(window, renderPass.handle, visibilityShading.pipeLayout.handle, aCache, shaderModules, cfg::kDeferredVertShaderPath, fragShader.c_str(), aSpec);
+			}
+
+			std::string const fragShader = by_subgroups(half ? cfg::kDeferredHalfFragShaderPath : cfg::kDeferredFragShaderPath, aKey);
+			return create_deferred_pipeline(window, renderPass.handle, lighting.pipeLayout.handle, aCache, shaderModules, cfg::kDeferredVertShaderPath, fragShader.c_str(), aSpec);
+		});
+
+	lut::PermutationKey const defaultLighting = (visibility ? kPipelineNormalMaps : 0) | precisionFeatures | distributionFeatures | subgroupFeatures;
+	if (deferred || visibility)
+		lightingPipes.get(defaultLighting);
+
+	// Camera that the current Hi-Z pyramid was built with
+	glm::mat4 prevProjCam(1.f);
+
+	// Performance HUD; there is nothing to show it on offscreen
+	std::optional<Hud> hud;
+	if (VK_NULL_HANDLE != window.swapchain)
+		hud = create_hud(window, allocator, cpool.handle, descriptorAllocator, defaultSampler, pipeCache.handle, shaderModules, cfg::kHudVertShaderPath, cfg::kHudFragShaderPath, frames.size());
+
+	// Fragment cost views (O), drawn in the HUD's pass; not with multiview,
+	// whose eyes would count into the same pixels
+	DebugViews debugViews = create_debug_views(window, allocator, cpool.handle, descriptorAllocator, sceneDescriptors, descriptorBuffer ? &descriptorSets : nullptr);
+	bool const debugViewsOn = hud && !settings.stereo;
+	if (debugViewsOn)
+		debugViews.pipe = create_debug_view_pipeline(window, hud->renderPass.handle, debugViews.pipeLayout.handle, pipeCache.handle, shaderModules, cfg::kDeferredVertShaderPath, cfg::kDebugViewFragShaderPath);
+
+	// Triangles of the model at full detail, for the HUD's culling counts
+	// and the benchmark summary
+	std::uint64_t sceneTriangles = 0;
+	for (auto const& mesh : ourModel.meshes)
+		sceneTriangles += std::uint64_t(mesh.indexCount / 3) * ourModel.instanceCount;
+
+
+	// Start-up report (--startup-report), once the textures queued by
+	// set_up_model() have arrived. The benchmark loads them up front.
+	auto const streamStart = lut::StartupClock::now();
+	bool startupReported = nullptr == options.startupReport;
+	auto const report_startup = [&] (bool aStreamed)
+	{
+		if (!bench && aStreamed)
+			lut::add_startup_phase("texture streaming", lut::StartupClock::now() - streamStart);
+		else if (!bench)
+			std::fprintf(stderr, "Info: textures still streaming, start-up report is incomplete\n");
+
+		lut::print_startup_report(stdout);
+		if (lut::write_startup_report(options.startupReport))
+			std::printf("Start-up report written to '%s'\n", options.startupReport);
+		else
+			std::fprintf(stderr, "Info: unable to write start-up report '%s'\n", options.startupReport);
+		startupReported = true;
+	};
+	if (!startupReported && 0 == uploader.pending())
+		report_startup(true);
+
+	// Application main loop
+	bool recreateSwapchain = false;
+
+	//timing
+	auto previousClock = Clock_::now();
+
+	//frame and GPU pass times, averaged and shown in the window title once
+	//per second
+	struct TimingStats
+	{
+		float elapsed = 0.f;
+		std::uint32_t frames = 0;
+		DrawStats draws; // of the latest frame
+	} timing;
+
+	double cpuMs = 0.0; // recording and submission of the latest frame, for the HUD
+	lut::ApiCounters apiCounts; // --api-counters: Vulkan calls of the latest frame, on all threads
+
+	// Input-to-present/photon latency of the interactive run, and the frame
+	// limiter (--fps-limit, --fps-adaptive); see frame_latency.hpp
+	std::optional<FrameLatency> latency;
+	std::optional<FrameLimiter> limiter;
+	std::optional<AdaptiveFrameCap> adaptiveCap;
+	LatencyStats latencyStats; // of the last second, for the title and HUD
+	Clock_::time_point inputSampled{};
+	if (!bench)
+	{
+		latency.emplace(window.device, window.havePresentWait, options.latencyLog);
+		if (!window.havePresentWait)
+			std::fprintf(stderr, "Info: VK_KHR_present_wait not supported, latency is measured up to vkQueuePresentKHR()\n");
+		if (options.fpsLimit > 0.f)
+			limiter.emplace(options.fpsLimit);
+		if (options.fpsAdaptive > 0.f)
+			adaptiveCap.emplace(options.fpsAdaptive, options.fpsLimit);
+	}
+
+	// Periodic metrics export (--metrics); see metrics.hpp
+	std::optional<MetricsExporter> metrics;
+	if (options.metricsPath)
+		metrics.emplace(allocator, options.metricsPath, options.metricsInterval);
+
+	std::uint32_t frameIndex = 0; // into frames
+	std::uint32_t frameNumber = 0; // since start; VMA refreshes budgets per frame
+
+	// Camera path of the interactive run (--capture-path)
+	CameraPath capturedKeys;
+	float captureTime = 0.f;
+
+	// Draw lists of the interactive run (--trace); culled on the CPU for
+	// the trace, unless the frame culls there anyway
+	std::optional<DrawTraceWriter> traceWriter;
+	std::vector<std::uint8_t> traceVisible, traceLods;
+	float traceTime = 0.f;
+
+	// Frustum culling for --lazy-materials, when the frame culls on the GPU
+	std::vector<std::uint8_t> lazyVisible;
+	if (options.tracePath && !bench)
+		traceWriter.emplace(options.tracePath, ourModel);
+
+	// Screenshots (F12) and --capture-frames, read back without stalling
+	// the frame (see frame_capture.hpp); the swapchain images must be
+	// transfer sources
+	std::optional<FrameCapture> capture;
+	if (!bench)
+	{
+		if (!(window.swapchainUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+		{
+			std::fprintf(stderr, "Info: the swapchain images can't be copied from, screenshots disabled\n");
+		}
+		else
+		{
+			if (options.captureFrames)
+			{
+				std::error_code ec;
+				std::filesystem::create_directories(options.captureFrames, ec);
+				if (ec)
+					throw lut::Error("Unable to create capture directory '%s': %s", options.captureFrames, ec.message().c_str());
+			}
+
+			capture.emplace(allocator, ECaptureFormat::pam == options.captureFormat);
+		}
+	}
+
+	// --stream: YUV4MPEG2 frames, converted on the GPU (see
+	// video_stream.hpp); the nominal frame rate is the --fps-limit. The
+	// stream is destroyed first, passing on its last frames.
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> streamFile(nullptr, &std::fclose);
+	std::optional<VideoStream> stream;
+	if (options.streamPath)
+	{
+		if (!VideoStream::supports(window))
+		{
+			std::fprintf(stderr, "Info: the swapchain images can't be sampled, --stream disabled\n");
+		}
+		else
+		{
+			streamFile.reset(std::fopen(options.streamPath, "wb"));
+			if (!streamFile)
+				throw lut::Error("Unable to open stream '%s' for writing", options.streamPath);
+
+			stream.emplace(window, allocator, samplers, shaderModules, cfg::kStreamShaderPath, window.swapchainExtent, [file = streamFile.get()] (std::byte const* aFrame, std::size_t aBytes) {
+				if (std::fputs("FRAME\n", file) < 0 || aBytes != std::fwrite(aFrame, 1, aBytes, file))
+					throw lut::Error("Unable to write a frame to the stream");
+			}, pipeCache.handle);
+			stream->bind_images(window);
+
+			unsigned const fps = options.fpsLimit > 0.f ? unsigned(options.fpsLimit + 0.5f) : 60;
+			std::fprintf(streamFile.get(), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", stream->size().width, stream->size().height, fps);
+		}
+	}
+
+	// Benchmark output: a frame's row is written once its slot comes around
+	// again, and its GPU timings have been collected.
+	struct BenchRow
+	{
+		std::size_t frame;
+		bool compared; // the second frame of the key (--bench-compare-*)
+		double frameMs, cpuMs;
+		double vramMib; // device-local usage when recorded
+		std::uint32_t draws;
+		lut::ApiCounters api; // --api-counters
+	};
+	std::vector<std::optional<BenchRow>> benchPending(frames.size());
+	std::size_t const benchPasses = compareImages ? 2 : 1; // frames per key
+	std::size_t benchFrame = 0; // into benchKeys, times benchPasses
+
+	// --bench-compare-*: the latest reference image, and the GPU times of
+	// the reference and the compared frames
+	struct CompareStats
+	{
+		double frameMs = 0.0, colourMs = 0.0;
+		std::size_t timedFrames = 0;
+	};
+	CompareStats compareStats[2];
+	char const* const compareColumn = comparePrecision ? "precision" : "distribution";
+	char const* const compareNames[2] = {
+		comparePrecision ? "fp32" : "analytic",
+		comparePrecision ? "fp16" : "lut"
+	};
+
+	// Totals over the rows, for the summary and --bench-scaling. GPU times
+	// and triangles count the frames whose queries were available.
+	struct ScalingStats
+	{
+		double cpuMs = 0.0, gpuMs = 0.0;
+		std::uint64_t draws = 0, triangles = 0;
+		std::size_t frames = 0, timedFrames = 0, countedFrames = 0;
+	};
+	ScalingStats scalingStats;
+	std::vector<std::uint8_t> benchReference;
+	double sumRmse = 0.0, maxRmse = 0.0;
+	unsigned maxDiff = 0;
+	double peakVramMib = 0.0;
+
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> benchCsv(nullptr, &std::fclose);
+	if (bench)
+	{
+		if (benchImages)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(options.benchImages, ec);
+			if (ec)
+				throw lut::Error("Unable to create image directory '%s': %s", options.benchImages, ec.message().c_str());
+		}
+
+		benchCsv.reset(std::fopen(options.benchCsv, "w"));
+		if (!benchCsv)
+			throw lut::Error("Unable to open benchmark output '%s' for writing", options.benchCsv);
+
+		std::fprintf(benchCsv.get(), "frame,time,frame_ms,cpu_ms,vram_mib");
+		for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+			std::fprintf(benchCsv.get(), ",%s_ms", profiler.stats(i).name);
+		for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+		{
+			if (profiler.has_statistics(i))
+			{
+				char const* const name = profiler.stats(i).name;
+				std::fprintf(benchCsv.get(), ",%s_ia_vertices,%s_ia_primitives,%s_vs_invocations,%s_clip_invocations,%s_clip_primitives,%s_fs_invocations",
+					name, name, name, name, name, name);
+			}
+		}
+		if (compareImages)
+			std::fprintf(benchCsv.get(), ",%s,rmse,max_diff", compareColumn);
+		if (afrDevices > 1)
+			std::fprintf(benchCsv.get(), ",gpu");
+		if (options.apiCounters)
+		{
+			std::fprintf(benchCsv.get(), ",api_calls,api_ms");
+			for (std::size_t i = 0; i < lut::kApiCallCount; ++i)
+				std::fprintf(benchCsv.get(), ",%s", lut::api_call_name(lut::EApiCall(i)));
+		}
+		std::fprintf(benchCsv.get(), "\n");
+	}
+
+	// Call after profiler.begin_frame(aSlot). GPU timings that are not
+	// available (e.g., disabled passes) are left empty.
+	auto const write_bench_row = [&] (std::uint32_t aSlot)
+	{
+		auto& row = benchPending[aSlot];
+		if (!row)
+			return;
+
+		auto const key = row->frame / benchPasses;
+		std::fprintf(benchCsv.get(), "%zu,%.6f,%.3f,%.3f,%.1f", benchFirstKey + key, benchKeys[key].time, row->frameMs, row->cpuMs, row->vramMib);
+
+		if (benchImages)
+			write_bench_image(allocator, frames[aSlot].readback, window.swapchainExtent, options.benchImages, benchFirstKey + key, compareImages ? compareNames[row->compared ? 1 : 0] : nullptr);
+
+		scalingStats.cpuMs += row->cpuMs;
+		scalingStats.draws += row->draws;
+		++scalingStats.frames;
+		if (auto const ms = profiler.last_ms(scopes.frame); ms >= 0.0)
+		{
+			scalingStats.gpuMs += ms;
+			++scalingStats.timedFrames;
+		}
+		if (lut::GpuProfiler::PipelineStats opaque{}, alpha{}; profiler.last_statistics(scopes.opaque, opaque) && profiler.last_statistics(scopes.alpha, alpha))
+		{
+			scalingStats.triangles += opaque.inputPrimitives + alpha.inputPrimitives;
+			++scalingStats.countedFrames;
+		}
+		for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+		{
+			if (auto const ms = profiler.last_ms(i); ms >= 0.0)
+				std::fprintf(benchCsv.get(), ",%.4f", ms);
+			else
+				std::fprintf(benchCsv.get(), ",");
+		}
+		for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+		{
+			if (!profiler.has_statistics(i))
+				continue;
+
+			if (lut::GpuProfiler::PipelineStats ps; profiler.last_statistics(i, ps))
+			{
+				std::fprintf(benchCsv.get(), ",%llu,%llu,%llu,%llu,%llu,%llu",
+					static_cast<unsigned long long>(ps.inputVertices), static_cast<unsigned long long>(ps.inputPrimitives),
+					static_cast<unsigned long long>(ps.vertexInvocations), static_cast<unsigned long long>(ps.clippingInvocations),
+					static_cast<unsigned long long>(ps.clippingPrimitives), static_cast<unsigned long long>(ps.fragmentInvocations));
+			}
+			else
+			{
+				std::fprintf(benchCsv.get(), ",,,,,,");
+			}
+		}
+
+		if (compareImages)
+		{
+			auto& stats = compareStats[row->compared ? 1 : 0];
+			if (auto const frameMs = profiler.last_ms(scopes.frame), colourMs = profiler.last_ms(scopes.colour); frameMs >= 0.0 && colourMs >= 0.0)
+			{
+				stats.frameMs += frameMs;
+				stats.colourMs += colourMs;
+				++stats.timedFrames;
+			}
+
+			// Rows are written in order, so the first image of the key
+			// is the reference of the second one
+			auto const& readback = frames[aSlot].readback;
+			vmaInvalidateAllocation(allocator.allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+
+			void* ptr = nullptr;
+			if (auto const res = vmaMapMemory(allocator.allocator, readback.allocation, &ptr); VK_SUCCESS != res)
+				throw lut::Error("Mapping memory for reading\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+
+			auto const* image = static_cast<std::uint8_t const*>(ptr);
+			auto const bytes = std::size_t(window.swapchainExtent.width) * window.swapchainExtent.height * 4;
+
+			if (!row->compared)
+			{
+				benchReference.assign(image, image + bytes);
+				std::fprintf(benchCsv.get(), ",%s,,", compareNames[0]);
+			}
+			else
+			{
+				// RGB only; alpha is the masked materials' coverage
+				double sumSq = 0.0;
+				unsigned diff = 0;
+				for (std::size_t i = 0; i < bytes; i += 4)
+				{
+					for (std::size_t c = 0; c < 3; ++c)
+					{
+						int const d = int(image[i + c]) - int(benchReference[i + c]);
+						sumSq += double(d * d);
+						diff = std::max(diff, unsigned(d < 0 ? -d : d));
+					}
+				}
+
+				double const rmse = std::sqrt(sumSq / double(bytes / 4 * 3));
+				sumRmse += rmse;
+				maxRmse = std::max(maxRmse, rmse);
+				maxDiff = std::max(maxDiff, diff);
+
+				std::fprintf(benchCsv.get(), ",%s,%.4f,%u", compareNames[1], rmse, diff);
+			}
+
+			vmaUnmapMemory(allocator.allocator, readback.allocation);
+		}
+		if (afrDevices > 1)
+			std::fprintf(benchCsv.get(), ",%u", profiler.last_device());
+		if (options.apiCounters)
+		{
+			std::fprintf(benchCsv.get(), ",%llu,%.4f", static_cast<unsigned long long>(row->api.total_calls()), row->api.total_ms());
+			for (auto const calls : row->api.calls)
+				std::fprintf(benchCsv.get(), ",%llu", static_cast<unsigned long long>(calls));
+		}
+		std::fprintf(benchCsv.get(), "\n");
+
+		row.reset();
+	};
+
+	// --redraw=on-demand: frames are only rendered while something changes
+	// (input, the window, background work that the image depends on), and
+	// for kRedrawFrames after; otherwise, the loop sleeps in
+	// glfwWaitEventsTimeout(), and records and submits nothing
+	bool const onDemand = ERedrawMode::onDemand == options.redrawMode && !bench;
+	std::uint32_t redrawFrames = cfg::kRedrawFrames;
+	auto const working = [&] {
+		bool const held = std::any_of(std::begin(state.inputMap), std::end(state.inputMap), [] (bool aHeld) { return aHeld; });
+		return held || state.hud || nullptr != options.captureFrames || stream
+			|| uploader.pending() > 0 || colourPipes.compiling() > 0 || lightingPipes.compiling() > 0 || pipeLinker.pending() > 0
+			|| (defragmenter && defragmenter->active());
+	};
+
+	// --render-thread: the loop below runs on a thread of its own, and
+	// takes the input from the main thread (see run_render_thread())
+	std::unique_ptr<InputMailbox> mailbox;
+	if (options.renderThread && window.window && !bench)
+		mailbox = std::make_unique<InputMailbox>();
+
+	// --late-latch: each frame's shaders wait for a value of latchGate,
+	// which the loop signals from the host once it has written the camera
+	// (see below). The temporal resolve's reprojection is recorded into the
+	// commands, and would lag behind the latched camera.
+	std::optional<lut::Timeline> latchGate;
+	if (options.lateLatch && window.window && !bench)
+	{
+		if (temporalUpscale)
+			std::fprintf(stderr, "Info: late latching does not support temporal upscaling; latching off\n");
+		else
+			latchGate.emplace(window);
+	}
+
+	// Let GLFW process events (or, with --render-thread, take the input of
+	// the events processed meanwhile), waiting up to aTimeout seconds for
+	// one first; < 0: until one arrives, 0: don't wait.
+	auto const pump_events = [&] (double aTimeout)
+	{
+		if (mailbox)
+		{
+			std::unique_lock<std::mutex> lock(mailbox->mutex);
+			auto const ready = [&] { return mailbox->fresh || mailbox->quit; };
+			if (aTimeout < 0.0)
+				mailbox->posted.wait(lock, ready);
+			else if (aTimeout > 0.0)
+				mailbox->posted.wait_for(lock, std::chrono::duration<double>(aTimeout), ready);
+
+			take_input(state, mailbox->published);
+			mailbox->fresh = false;
+		}
+		else if (window.window)
+		{
+			if (aTimeout < 0.0)
+				glfwWaitEvents();
+			else if (aTimeout > 0.0)
+				glfwWaitEventsTimeout(aTimeout);
+			else
+				glfwPollEvents();
+		}
+	};
+	auto const set_title = [&] (char const* aTitle)
+	{
+		if (mailbox)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mailbox->mutex);
+				mailbox->title = aTitle;
+			}
+			glfwPostEmptyEvent();
+		}
+		else
+			glfwSetWindowTitle(window.window, aTitle);
+	};
+	auto const closing = [&]
+	{
+		return mailbox ? mailbox->quit.load() : GLFW_TRUE == glfwWindowShouldClose(window.window);
+	};
+
+	auto const render_frames = [&] {
+		lut::place_current_thread(lut::EThreadRole::render, "render");
+
+		while (bench ? benchFrame < benchKeys.size() * benchPasses : !closing())
+		{
+			// Minimized (or zero-sized) windows have no swapchain extent to
+			// render at; sleep until the window is restored, in any mode
+			if (window.window && (0 == state.framebufferWidth || 0 == state.framebufferHeight))
+			{
+				pump_events(-1.0);
+				previousClock = Clock_::now();
+				continue;
+			}
+
+			if (limiter)
+				limiter->wait();
+
+			pump_events(onDemand && 0 == redrawFrames && !working() ? cfg::kIdleWaitSeconds : 0.0);
+			inputSampled = Clock_::now();
+
+			if (onDemand)
+			{
+				bool const input = Clock_::time_point{} != state.firstInput;
+				if (input || state.redraw || recreateSwapchain || working())
+					redrawFrames = cfg::kRedrawFrames;
+				state.redraw = false;
+
+				//nothing changed: skip the frame; the time spent idle is not
+				//elapsed time for the camera
+				if (0 == redrawFrames)
+				{
+					previousClock = Clock_::now();
+					continue;
+				}
+
+				--redrawFrames;
+			}
+
+			if (latency)
+				latency->poll_presents(window.swapchain);
+
+			// Recreate swap chain?
+			if (recreateSwapchain)
+			{
+				//TODO: (Section 1) re-create swapchain and associated resources - see Exercise 3!
+
+				// The old objects may still be in use by the frames in flight.
+				// They are retired to the timeline, and destroyed once those
+				// frames have completed, rather than draining the GPU first.
+				// Descriptor sets and pipelines are however replaced in place;
+				// if any of those change, the frames in flight are waited for
+				// (but not the transfer queue).
+				lut::RetiredSwapchain oldSwapchain;
+				auto const changes = recreate_swapchain(window, &oldSwapchain);
+				timeline.retire(std::move(oldSwapchain));
+				if (latency)
+					latency->swapchain_recreated();
+
+				bool const debugCounters = debugViews.extent.width > 1;
+				bool const inPlace = changes.changedFormat
+					|| (changes.changedSize && (deferred || visibility || useHiz || shadingRate || temporalUpscale || debugCounters));
+				if (inPlace)
+					timeline.wait(timeline.submitted());
+
+				//the variants' factories read renderPass, also from the
+				//background compiles; those are stopped first
+				if (changes.changedFormat)
+				{
+					colourPipes.clear();
+					pipeLinker.clear();
+					lightingPipes.clear();
+
+					timeline.retire(std::move(renderPass));
+					renderPass = create_render_pass(window, depthFormat, sampledDepth, prepass, settings.lightingMode, shadingRateTexel, dynamicResolution, msaaSamples, settings.stereo);
+				}
+
+				if (changes.changedSize)
+				{
+					if (settings.stereo)
+					{
+						timeline.retire(std::move(stereoTargets));
+						stereoTargets = create_stereo_targets(window, allocator, depthFormat);
+					}
+					else
+					{
+						timeline.retire(std::move(depthBuffer));
+						timeline.retire(std::move(depthBufferView));
+						std::tie(depthBuffer, depthBufferView) = create_depth_buffer(window, allocator, depthFormat, sampledDepth, deferred);
+					}
+
+					if (dynamicResolution)
+					{
+						timeline.retire(std::move(renderTarget));
+						renderTarget = create_render_target(window, allocator);
+					}
+
+					if (deferred)
+					{
+						timeline.retire(std::move(gbuffer));
+						gbuffer = create_gbuffer(window, allocator);
+						update_deferred_descriptors(window, lighting, gbuffer, depthBufferView.handle);
+					}
+
+					if (visibility)
+					{
+						timeline.retire(std::move(visibilityBuffer));
+						visibilityBuffer = create_visibility_buffer(window, allocator);
+						update_visibility_descriptors(window, visibilityShading, visibilityBuffer);
+					}
+
+					if (useHiz)
+					{
+						resize_hiz_pyramid(hiz, window, allocator, cpool.handle, depthBufferView.handle);
+						set_gpu_cull_hiz(window, gpuCuller, hiz.view.handle, hiz.sampler);
+					}
+
+					if (shadingRate)
+						resize_shading_rate(shadingRates, window, allocator, cpool.handle, depthBufferView.handle);
+
+					if (temporalUpscale)
+						resize_temporal_upscale(temporal, window, allocator, cpool.handle, renderTarget.view.handle, depthBufferView.handle);
+
+					if (debugCounters)
+						resize_debug_views(debugViews, window, allocator, cpool.handle, sceneDescriptors, window.swapchainExtent);
+				}
+
+				if (msaa && (changes.changedSize || changes.changedFormat))
+				{
+					timeline.retire(std::move(msaaTargets));
+					msaaTargets = create_msaa_targets(window, allocator, depthFormat, msaaSamples);
+				}
+
+				timeline.retire(std::move(framebuffers));
+				framebuffers.clear();
+				create_swapchain_framebuffers(window, renderPass.handle, framebuffers, depthBufferView.handle, deferred ? &gbuffer : nullptr, visibility ? &visibilityBuffer : nullptr, shadingRates.view.handle, renderTarget.view.handle, msaa ? &msaaTargets : nullptr, settings.stereo ? &stereoTargets : nullptr);
+
+				if (hud)
+				{
+					if (changes.changedFormat)
+					{
+						if (!hud->dynamicRendering)
+						{
+							timeline.retire(std::move(hud->renderPass));
+							hud->renderPass = create_hud_render_pass(window);
+						}
+						hud->pipe = create_hud_pipeline(window, hud->renderPass.handle, hud->pipeLayout.handle, pipeCache.handle, shaderModules, cfg::kHudVertShaderPath, cfg::kHudFragShaderPath);
+						if (debugViewsOn)
+							debugViews.pipe = create_debug_view_pipeline(window, hud->renderPass.handle, debugViews.pipeLayout.handle, pipeCache.handle, shaderModules, cfg::kDeferredVertShaderPath, cfg::kDebugViewFragShaderPath);
+					}
+
+					timeline.retire(std::move(hud->framebuffers));
+					create_hud_framebuffers(window, *hud);
+				}
+
+				if (renderFinished.size() != window.swapImages.size())
+				{
+					timeline.retire(std::move(renderFinished));
+					renderFinished.clear();
+					for (std::size_t i = 0; i < window.swapImages.size(); ++i)
+						renderFinished.emplace_back(lut::create_semaphore(window));
+				}
+
+				//the stream samples the new images; the old sets stay valid for
+				//the frames in flight
+				if (stream)
+					stream->bind_images(window);
+
+				//viewport and scissor are dynamic; the pipelines only depend on
+				//the render pass
+				if (changes.changedFormat)
+				{
+					if (prepass)
+						depthPipe = create_depth_pipeline(window, renderPass.handle, pipeLayout.handle, pipeCache.handle, shaderModules, quantized, msaaSamples, nullptr, settings.positionStream, setFlags);
+					if (prepassAlpha)
+						depthAlphaPipe = create_depth_pipeline(window, renderPass.handle, pipeLayout.handle, pipeCache.handle, shaderModules, quantized, msaaSamples, alphaTestFrag, false, setFlags);
+					if (useImpostors)
+						impostors.pipe = create_impostor_pipeline(window, impostors, renderPass.handle, pipeCache.handle, shaderModules, cfg::kImpostorVertShaderPath, cfg::kImpostorFragShaderPath, prepass, msaaSamples);
+					if (useOcclusionQueries)
+						occlusion.pipe = create_occlusion_pipeline(window, occlusion, renderPass.handle, pipeCache.handle, shaderModules, cfg::kOcclusionProxyVertShaderPath, prepass, msaaSamples);
+				}
+
+				//the cached draws may refer to the old render pass and pipelines,
+				//and set the old viewport
+				for (auto& frame : frames)
+					frame.drawsRecorded = false;
+
+				recreateSwapchain = false;
+				continue;
+			}
+
+			// Swap in streamed textures. The descriptor sets are rewritten in
+			// place, so no frame may be using them, and the cached draws must
+			// pick up the new sets. Only the frames are waited for; uploads
+			// still in flight on the transfer queue carry on.
+			if (uploader.pending() > 0)
+			{
+				auto streamed = uploader.take_completed(cpool.handle);
+				if (virtualTex)
+					filter_streamed_textures(*virtualTex, streamed);
+				if (!streamed.empty())
+				{
+					if (compressor)
+					{
+						std::vector<CompressibleTexture> compressible;
+						for (auto& tex : streamed)
+							compressible.emplace_back(CompressibleTexture{ &tex.image, &tex.format, tex.width, tex.height, tex.opaque });
+						compress_textures(*compressor, window, allocator, cpool.handle, compressible);
+					}
+
+					if (streaming)
+						note_streamed_textures(*streaming, allocator, streamed);
+
+					timeline.wait(timeline.submitted());
+					update_model_textures(window, ourModel, defaultSampler, std::move(streamed));
+					if (useImpostors)
+						update_impostor_descriptors(window, impostors, ourModel);
+					if (defragmenter)
+						allow_model_moves(allocator, ourModel);
+
+					for (auto& frame : frames)
+						frame.drawsRecorded = false;
+
+					redrawFrames = cfg::kRedrawFrames;
+				}
+
+				if (!startupReported && 0 == uploader.pending())
+					report_startup(true);
+			}
+
+			// M: what the memory is used for, by allocation (see
+			// lut::write_memory_report())
+			if (state.memoryReport)
+			{
+				state.memoryReport = false;
+				char const* const path = options.memoryReport ? options.memoryReport : cfg::kMemoryReportPath;
+				lut::write_memory_report(allocator, path);
+				std::printf("Memory report: %s\n", path);
+			}
+
+			// Move allocations out of sparsely used blocks. The step waits for
+			// the frames in flight; everything that refers to the model's buffers and
+			// textures is patched before the next frame is recorded.
+			if (defragmenter)
+			{
+				if (!defragmenter->active() && 0 == frameNumber % cfg::kDefragCheckInterval)
+				{
+					for (auto const cls : { lut::EMemoryClass::geometry, lut::EMemoryClass::textures })
+					{
+						if (defragmenter->reclaimable(cls) > 0 && defragmenter->begin(cls))
+							break;
+					}
+				}
+
+				if (defragmenter->active())
+				{
+					defragmenter->step(cpool.handle, [&] (std::vector<lut::Defragmenter::Move> const& aMoves) {
+						if (!relocate_model_resources(window, ourModel, defaultSampler, aMoves))
+							return;
+						if (useImpostors)
+							update_impostor_descriptors(window, impostors, ourModel);
+
+						for (auto const& move : aMoves)
+						{
+							if (drawList.commands == move.oldBuffer)
+								drawList.commands = move.buffer;
+						}
+
+						if (visibility)
+							update_visibility_geometry(window, visibilityShading, ourModel);
+						if (triangleCull)
+							update_triangle_culler_geometry(window, triangleCuller, ourModel);
+						if (settings.vertexPulling)
+							update_vertex_descriptor(window, sceneDescriptors, ourModel);
+
+						for (auto& frame : frames)
+							frame.drawsRecorded = false;
+					}, &timeline);
+				}
+			}
+
+			//wait for this frame slot's previous use to complete
+			//acquire swapchain image.
+			//record and submit commands
+			//present rendered images (note: use the present_results() method)
+			auto& frame = frames[frameIndex];
+
+			timeline.wait(frame.done);
+			timeline.collect();
+
+			//hand the captures and stream frames of completed frames on
+			if (capture)
+				capture->poll(timeline);
+			if (stream)
+				stream->poll(timeline);
+
+			// With a single frame in flight, drawList's batches may still be
+			// in this arena; they are replaced before they are used again.
+			frame.arena.reset();
+
+			LUT_CPU_ZONE("frame");
+			auto const cpuStart = Clock_::now();
+
+			//alternate-frame rendering: the slot's device renders and presents
+			//the frame
+			std::uint32_t const frameDevice = afrDevices > 1 ? frameIndex % afrDevices : kNoFrameDevice;
+
+			//offscreen, each frame slot has its own image
+			std::uint32_t imageIndex = frameIndex;
+			auto const acquireRes = bench ? VK_SUCCESS : acquire_image(window, frame.imageAvailable.handle, frameDevice, imageIndex);
+
+			if (VK_SUBOPTIMAL_KHR == acquireRes || VK_ERROR_OUT_OF_DATE_KHR == acquireRes)
+			{
+				//This occurs e.g., when the window has been resized. In this case we needs to recreate
+				//the swap chain match the new dimensions. Any resources that directly depend on the swap chain
+				//need to be recreated as well. While rare, re_creating the swap chain may give us a different 
+				//image format, which we should handle.
+				//In both cases, we set the falg that the swap chain has to be re-created and jump to the top of 
+				// the loop. Technically, with the VK_SUBOPTIMAL_KHR return code, we could continue rendering with the current
+				// swapchain (unlike VK_ERROR_OUT_OF_DATA_KHR, which does require us to recreate the swap chain).
+				recreateSwapchain = true;
+				continue;
+			}
+
+			if (VK_SUCCESS != acquireRes)
+			{
+				throw lut::Error("Unable to acquire next swapchain image\n" "vkAcquireNextImageKHR() returned %s", lut::to_string(acquireRes).c_str());
+			}
+
+			//Update state
+			auto const now = Clock_::now();
+			auto const dt = std::chrono::duration_cast<Secondsf_>(now - previousClock).count();
+			previousClock = now;
+
+			//the input of this frame; events that arrive from now on go to the next
+			FrameTimestamps stamps;
+			stamps.sample = inputSampled;
+			stamps.hadInput = Clock_::time_point{} != state.firstInput;
+			stamps.input = stamps.hadInput ? state.firstInput : inputSampled;
+			state.firstInput = Clock_::time_point{};
+
+			glm::mat4 const previousCamera = state.camera2world;
+			update_user_state(state, dt);
+
+			//how fast the view changes sets the adaptive cap; the light counts
+			//as full speed
+			if (adaptiveCap && dt > 0.f)
+			{
+				auto const& cam = state.camera2world;
+				float const speed = glm::length(glm::vec3(cam[3] - previousCamera[3])) / dt;
+				float const turn = std::acos(std::clamp(glm::dot(glm::vec3(cam[2]), glm::vec3(previousCamera[2])), -1.f, 1.f)) / dt;
+				float motion = std::max(speed / cfg::kAdaptiveFullSpeed, turn / cfg::kAdaptiveFullTurn);
+				if (state.inputMap[std::size_t(EInputState::lightRotate)])
+					motion = 1.f;
+
+				limiter->set_fps(adaptiveCap->update(motion, profiler.last_ms(scopes.frame), dt));
+			}
+
+			if (bench)
+				state.camera2world = benchKeys[benchFrame / benchPasses].camera2world;
+			if (replay)
+				state.light_pos = replayTrace.frames[benchFrame / benchPasses].lightPos;
+
+			if (options.capturePath)
+			{
+				capturedKeys.emplace_back(CameraKey{ captureTime, state.camera2world });
+				captureTime += dt;
+			}
+
+			//this frame slot's previous timestamps are complete now (fence)
+			profiler.begin_frame(frameIndex);
+			LUT_GPU_ZONES(profiler, frame.submitted);
+			note_shadow_time(shadows, profiler.last_ms(scopes.shadows), frame.shadowFaces);
+			vmaSetCurrentFrameIndex(allocator.allocator, ++frameNumber);
+			if (streaming)
+				update_texture_streaming(*streaming, allocator, frameIndex, ourModel, uploader, frame.arena);
+			if (mipReport)
+				update_mip_report(*mipReport, allocator, frameIndex);
+			if (virtualTex)
+				update_virtual_textures(*virtualTex, window, allocator, frameIndex, frame.arena);
+			//meshes that moved invalidate the recorded draws and cached shadows
+			if (world && update_world_streaming(*world, allocator, ourModel, glm::vec3(state.camera2world[3]), dt, frameIndex))
+			{
+				for (auto& f : frames)
+					f.drawsRecorded = false;
+				invalidate_shadows(shadows);
+				redrawFrames = cfg::kRedrawFrames;
+			}
+			if (dynamicResolution)
+				update_resolution_scale(resolution, profiler.last_ms(scopes.frame));
+			if (bench)
+				write_bench_row(frameIndex);
+			if (metrics)
+			{
+				FrameMetrics sample;
+				sample.frameMs = 1000.f * dt;
+				sample.cpuMs = float(cpuMs);
+				sample.gpuMs = float(profiler.last_ms(scopes.frame));
+				sample.draws = timing.draws.draws;
+				sample.streamingPending = std::uint32_t(uploader.pending());
+
+				lut::GpuProfiler::PipelineStats opaque{}, alpha{};
+				if (profiler.last_statistics(scopes.opaque, opaque) && profiler.last_statistics(scopes.alpha, alpha))
+					sample.triangles = std::int64_t(opaque.inputPrimitives + alpha.inputPrimitives);
+
+				metrics->add_frame(sample);
+			}
+
+			timing.elapsed += dt;
+			++timing.frames;
+			if (timing.elapsed >= 1.f && window.window)
+			{
+				char title[512];
+				std::size_t len = 0;
+				auto const append = [&] (char const* aFormat, auto... aArgs)
+				{
+					if (len < sizeof(title))
+					{
+						int const n = std::snprintf(title + len, sizeof(title) - len, aFormat, aArgs...);
+						len = n > 0 ? len + std::size_t(n) : sizeof(title);
+					}
+				};
+
+				append("%s | frame %.2f ms", cfg::kWindowTitle, 1000.f * timing.elapsed / timing.frames);
+				for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+				{
+					if (auto const gpu = profiler.stats(i); gpu.samples > 0)
+						append(" | %s %.3f ms", gpu.name, gpu.avgMs);
+				}
+				append(" | %u draws, %u pipeline/%u material binds", timing.draws.draws, timing.draws.pipelineBinds, timing.draws.materialBinds);
+				if (latency)
+				{
+					latencyStats = latency->take_stats();
+					append(" | input to present %.1f ms", latencyStats.presentMs);
+					if (latencyStats.photonMs >= 0.0)
+						append(", photon %.1f ms", latencyStats.photonMs);
+				}
+				if (adaptiveCap)
+					append(" | cap %.0f fps", double(adaptiveCap->fps()));
+				if (dynamicResolution)
+				{
+					auto const extent = scaled_extent(window.swapchainExtent, resolution.scale);
+					append(" | %ux%u", extent.width, extent.height);
+				}
+				if (auto const memory = lut::query_memory_stats(allocator); memory.deviceBudget > 0)
+					append(" | VRAM %.0f/%.0f MiB", double(memory.deviceUsage) / (1 << 20), double(memory.deviceBudget) / (1 << 20));
+
+				set_title(title);
+
+				timing = TimingStats{ 0.f, 0, timing.draws };
+			}
+
+			//this frame slot's glyphs are no longer read by the GPU (fence);
+			//without text, the HUD records nothing
+			if (hud)
+			{
+				HudText text;
+				if (state.hud)
+				{
+					char const* presentMode = "other";
+					switch (window.presentMode)
+					{
+					case VK_PRESENT_MODE_FIFO_KHR: presentMode = "fifo"; break;
+					case VK_PRESENT_MODE_FIFO_RELAXED_KHR: presentMode = "fifo relaxed"; break;
+					case VK_PRESENT_MODE_MAILBOX_KHR: presentMode = "mailbox"; break;
+					case VK_PRESENT_MODE_IMMEDIATE_KHR: presentMode = "immediate"; break;
+					default: break;
+					}
+
+					VkExtent2D const extent = dynamicResolution ? scaled_extent(window.swapchainExtent, resolution.scale) : window.swapchainExtent;
+					add_hud_line(text, kHudWhite, "frame %6.2f ms  cpu %6.2f ms", 1000.0 * dt, cpuMs);
+					add_hud_line(text, kHudGrey, "%ux%u  present: %s", extent.width, extent.height, presentMode);
+
+					//input to submit/present/display, and the present intervals,
+					//over the last second
+					if (latencyStats.frames > 0)
+					{
+						if (latencyStats.photonMs >= 0.0)
+							add_hud_line(text, kHudWhite, "latency %5.1f submit %5.1f present %5.1f photon", latencyStats.submitMs, latencyStats.presentMs, latencyStats.photonMs);
+						else
+							add_hud_line(text, kHudWhite, "latency %5.1f submit %5.1f present", latencyStats.submitMs, latencyStats.presentMs);
+						add_hud_line(text, latencyStats.maxIntervalMs > 1.5 * latencyStats.intervalMs ? kHudYellow : kHudGrey, "pacing %6.2f ms mean, %6.2f ms max", latencyStats.intervalMs, latencyStats.maxIntervalMs);
+					}
+
+					//Vulkan calls of the previous frame (--api-counters)
+					if (options.apiCounters)
+					{
+						using lut::EApiCall;
+						auto const draws = apiCounts.count(EApiCall::cmdDraw) + apiCounts.count(EApiCall::cmdDrawIndexed)
+							+ apiCounts.count(EApiCall::cmdDrawIndexedIndirect) + apiCounts.count(EApiCall::cmdDrawIndexedIndirectCount);
+						auto const updates = apiCounts.count(EApiCall::updateDescriptorSets) + apiCounts.count(EApiCall::updateDescriptorSetWithTemplate);
+						add_hud_line(text, kHudWhite, "vk calls %llu in %.2f ms", static_cast<unsigned long long>(apiCounts.total_calls()), apiCounts.total_ms());
+						add_hud_line(text, kHudGrey, "draws %llu  set binds %llu  vb binds %llu  set updates %llu  allocs %llu",
+							static_cast<unsigned long long>(draws), static_cast<unsigned long long>(apiCounts.count(EApiCall::cmdBindDescriptorSets)),
+							static_cast<unsigned long long>(apiCounts.count(EApiCall::cmdBindVertexBuffers)), static_cast<unsigned long long>(updates),
+							static_cast<unsigned long long>(apiCounts.count(EApiCall::allocateMemory)));
+					}
+
+					//GPU timings of the frame that last used this slot
+					if (afrDevices > 1)
+						add_hud_line(text, kHudGrey, "gpu %u of %u (alternate frames)", profiler.last_device(), afrDevices);
+					for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+					{
+						if (auto const ms = profiler.last_ms(i); ms >= 0.0)
+							add_hud_line(text, scopes.frame == i ? kHudWhite : kHudGrey, "gpu %-18s %7.3f ms", profiler.stats(i).name, ms);
+					}
+
+					add_hud_line(text, kHudWhite, "%u draws  %u pipeline, %u material binds", timing.draws.draws, timing.draws.pipelineBinds, timing.draws.materialBinds);
+					if (EDebugView::off != debugViews.view)
+						add_hud_line(text, kHudYellow, "view: %s (O)", to_string(debugViews.view));
+
+					//the IA counts what was submitted, after culling and LODs
+					lut::GpuProfiler::PipelineStats opaque{}, alpha{};
+					if (profiler.last_statistics(scopes.opaque, opaque) && profiler.last_statistics(scopes.alpha, alpha))
+					{
+						auto const submitted = opaque.inputPrimitives + alpha.inputPrimitives;
+						auto const culled = sceneTriangles > submitted ? sceneTriangles - submitted : 0;
+						add_hud_line(text, kHudWhite, "tris %.2fM submitted, %.2fM culled of %.2fM", submitted * 1e-6, culled * 1e-6, sceneTriangles * 1e-6);
+					}
+					else
+					{
+						add_hud_line(text, kHudGrey, "tris - submitted of %.2fM", sceneTriangles * 1e-6);
+					}
+
+					if (auto const memory = lut::query_memory_stats(allocator); memory.deviceBudget > 0)
+					{
+						double const usage = double(memory.deviceUsage) / double(memory.deviceBudget);
+						add_hud_line(text, usage > 0.9 ? kHudYellow : kHudWhite, "vram %.0f/%.0f MiB (%.0f%%)%s", double(memory.deviceUsage) / (1 << 20), double(memory.deviceBudget) / (1 << 20), 100.0 * usage, memory.fromDriver ? "" : " est.");
+					}
+				}
+
+				update_hud(*hud, allocator, frameIndex, text, window.swapchainExtent);
+			}
+
+			//prepare data for this frame(section 3)
+			glsl::SceneUniform sceneUniforms{};
+			auto const update_camera = [&] (glsl::SceneUniform& aUniforms)
+			{
+				if (settings.stereo)
+				{
+					update_scene_uniforms(aUniforms, stereoTargets.extent.width, stereoTargets.extent.height, state);
+					update_stereo_views(aUniforms, kStereoEyeSeparation);
+				}
+				else
+					update_scene_uniforms(aUniforms, window.swapchainExtent.width, window.swapchainExtent.height, state);
+			};
+			update_camera(sceneUniforms);
+
+			//temporal upscaling: a sub-pixel shift of the render resolution's
+			//pixels per frame
+			if (temporalUpscale)
+			{
+				auto const jitter = begin_temporal_frame(temporal, scaled_extent(window.swapchainExtent, resolution.scale), sceneUniforms.projCam);
+				sceneUniforms.projection = jitter * sceneUniforms.projection;
+				sceneUniforms.projCam = jitter * sceneUniforms.projCam;
+			}
+
+			//this frame slot's uniforms are no longer read by the GPU (fence)
+			VkDeviceSize const sceneOffset = frameIndex * sceneUBO.slotSize;
+			std::memcpy(sceneUBO.mapped + sceneOffset, &sceneUniforms, sizeof(glsl::SceneUniform));
+			vmaFlushAllocation(allocator.allocator, sceneUBO.buffer.allocation, sceneOffset, sizeof(glsl::SceneUniform));
+
+			if (useLods)
+				drawList.lodScale = lod_scale(sceneUniforms.projection, window.swapchainExtent.height, options.lodPixelError);
+
+			//cull meshes against the view frustum
+			if (ECullMode::cpu == settings.cullMode)
+			{
+				if (replay)
+				{
+					trace_visibility(replayTrace.frames[benchFrame / benchPasses], ourModel, drawList.meshVisible, drawList.meshLod);
+				}
+				else
+				{
+					//the baked BVH accepts and rejects whole subtrees
+					if (ourModel.bvh.nodes.empty())
+						cull_aabbs(make_frustum(sceneUniforms.projCam), meshBounds, drawList.meshVisible);
+					else
+						cull_bvh(make_frustum(sceneUniforms.projCam), ourModel.bvh, meshBounds, drawList.meshVisible);
+					//and the baked PVS drops what the camera's cell can't see
+					if (!ourModel.pvs.bits.empty())
+						apply_pvs(ourModel.pvs, sceneUniforms.cameraPos, drawList.meshVisible);
+					if (useLods)
+						select_lods(ourModel, sceneUniforms.cameraPos, drawList.lodScale, drawList.meshLod);
+				}
+				if (world)
+					mask_streamed_meshes(*world, drawList.meshVisible);
+				//the distant ones of what is left become impostors
+				drawList.impostorMeshes.clear();
+				if (useImpostors)
+					select_impostors(ourModel, sceneUniforms.cameraPos, lod_scale(sceneUniforms.projection, window.swapchainExtent.height, options.impostorPixels), drawList.meshVisible, drawList.impostorMeshes);
+				//and the occlusion queries test the meshes that are drawn; the
+				//margin is the distance of the near plane's corners
+				if (useOcclusionQueries)
+				{
+					float const aspect = window.swapchainExtent.width / float(window.swapchainExtent.height);
+					float const tanHalfFov = std::tan(0.5f * lut::Radians(cfg::kCameraFov).value());
+					float const margin = cfg::kCameraNear * std::sqrt(1.f + tanHalfFov * tanHalfFov * (1.f + aspect * aspect));
+					select_occlusion_tests(occlusion, ourModel, drawList.meshVisible, sceneUniforms.cameraPos, margin);
+				}
+
+				if (!culledCommands.empty())
+				{
+					auto const& target = culledCommands[frameIndex];
+
+					void* ptr = nullptr;
+					if (auto const res = vmaMapMemory(allocator.allocator, target.allocation, &ptr); VK_SUCCESS != res)
+						throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+
+					drawList.opaqueBatches = DrawBatchList(lut::ArenaAllocator<DrawBatch>(frame.arena));
+					drawList.alphaBatches = DrawBatchList(lut::ArenaAllocator<DrawBatch>(frame.arena));
+					compact_draw_commands(ourModel, drawList.meshVisible, drawList.meshLod, static_cast<VkDrawIndexedIndirectCommand*>(ptr), drawList.opaqueBatches, drawList.alphaBatches);
+
+					vmaFlushAllocation(allocator.allocator, target.allocation, 0, VK_WHOLE_SIZE);
+					vmaUnmapMemory(allocator.allocator, target.allocation);
+
+					drawList.commands = target.buffer;
+				}
+			}
+
+			//--lazy-materials: request the textures of what passed culling
+			if (lazy && lazy->remaining > 0)
+			{
+				std::vector<std::uint8_t> const* visible = &drawList.meshVisible;
+				if (ECullMode::cpu != settings.cullMode)
+				{
+					cull_aabbs(make_frustum(sceneUniforms.projCam), meshBounds, lazyVisible);
+					visible = &lazyVisible;
+				}
+				request_visible_textures(*lazy, ourModel, *visible, sceneUniforms.projCam, uploader, streaming ? &*streaming : nullptr);
+			}
+
+			//left click: the mesh whose bounds are under the cursor (the centre
+			//of the view while mousing), through the BVH
+			if (state.pick)
+			{
+				state.pick = false;
+				if (ourModel.bvh.nodes.empty())
+				{
+					std::fprintf(stderr, "Info: picking needs the model's BVH (bake it again)\n");
+				}
+				else
+				{
+					bool const centre = state.inputMap[std::size_t(EInputState::mousing)];
+					float const x = centre ? 0.f : 2.f * state.mouseX / float(window.swapchainExtent.width) - 1.f;
+					float const y = centre ? 0.f : 2.f * state.mouseY / float(window.swapchainExtent.height) - 1.f;
+					glm::vec4 const target = glm::inverse(sceneUniforms.projCam) * glm::vec4(x, y, 0.5f, 1.f);
+					glm::vec3 const origin(state.camera2world[3]);
+
+					auto const pickStart = Clock_::now();
+					RayHit hit;
+					bool const found = raycast_bvh(ourModel.bvh, meshBounds, origin, glm::normalize(glm::vec3(target) / target.w - origin), std::numeric_limits<float>::max(), hit);
+					double const pickUs = std::chrono::duration<double, std::micro>(Clock_::now() - pickStart).count();
+
+					if (found)
+						std::fprintf(stderr, "Info: picked '%s' at %.2f (%.1f us)\n", ourModel.meshNames[hit.box].c_str(), double(hit.distance), pickUs);
+					else
+						std::fprintf(stderr, "Info: nothing picked (%.1f us)\n", pickUs);
+				}
+			}
+
+			if (traceWriter)
+			{
+				if (ECullMode::cpu == settings.cullMode)
+				{
+					traceWriter->add_frame(traceTime, state.camera2world, state.light_pos, window.swapchainExtent, drawList.meshVisible, drawList.meshLod);
+				}
+				else
+				{
+					cull_aabbs(make_frustum(sceneUniforms.projCam), meshBounds, traceVisible);
+					if (useLods)
+						select_lods(ourModel, sceneUniforms.cameraPos, drawList.lodScale, traceLods);
+					traceWriter->add_frame(traceTime, state.camera2world, state.light_pos, window.swapchainExtent, traceVisible, traceLods);
+				}
+				traceTime += dt;
+			}
+
+			assert(std::size_t(imageIndex) < framebuffers.size());
+			assert(std::size_t(imageIndex) < renderFinished.size());
+
+
+			// Comparing benchmarks render each key in fp32, then in fp16, or
+			// with the analytic D term, then with the table
+			bool const compared = compareImages && 1 == benchFrame % 2;
+			bool const halfPrecision = comparePrecision ? compared : EShadingPrecision::fp16 == settings.shadingPrecision;
+			bool const tabulatedDistribution = compareDistribution ? compared : EDistribution::lut == options.distribution;
+
+			//the counters are allocated when a debug view is first shown;
+			//the scene's set is rewritten, so the frames in flight are
+			//waited for
+			debugViews.view = debugViewsOn ? state.debugView : EDebugView::off;
+			if (EDebugView::off != debugViews.view && debugViews.extent.width <= 1)
+			{
+				timeline.wait(timeline.submitted());
+				resize_debug_views(debugViews, window, allocator, cpool.handle, sceneDescriptors, window.swapchainExtent);
+			}
+
+			lut::PermutationKey features = streamingFeatures | coverageFeatures | subgroupFeatures;
+			if (state.normalMaps)
+				features |= kPipelineNormalMaps;
+			if (EDebugView::off != debugViews.view)
+				features |= kPipelineDebugViews;
+			if (halfPrecision)
+				features |= kPipelineHalfPrecision;
+			if (tabulatedDistribution)
+				features |= kPipelineDistributionLut;
+
+			//read by the next frame's colour pass
+			shadingRates.enabled = state.shadingRate;
+
+			//optimized links that have completed replace the fast-linked
+			//variants; cached draws that use those are recorded again
+			if (colourPipes.upgrade(pipeLinker, timeline) > 0)
+			{
+				for (auto& f : frames)
+					f.drawsRecorded = false;
+			}
+
+			//variants that haven't been drawn with yet are compiled in the
+			//background, and the default ones stand in until they are ready,
+			//so that no frame waits for a compile; benchmarks do wait, so
+			//that each key renders with the features it asks for
+			auto const variant = [&] (lut::PipelineVariants& aPipes, lut::PermutationKey aKey, lut::PermutationKey aDefault) {
+				return bench ? aPipes.get(aKey) : aPipes.get_or(aKey, aDefault);
+			};
+
+			VkPipeline const pipe = variant(colourPipes, features, defaultFeatures);
+			VkPipeline const alphaPipe = variant(colourPipes, features | kPipelineAlphaMask, defaultFeatures | kPipelineAlphaMask);
+			VkPipeline const lightingPipe = deferred ? variant(lightingPipes, features & (kPipelineHalfPrecision | kPipelineDistributionLut | kPipelineSubgroupLights), defaultLighting)
+				: visibility ? variant(lightingPipes, features & ~lut::PermutationKey(kPipelineDebugViews), defaultLighting) : VK_NULL_HANDLE;
+
+			//the part of the framebuffer drawn into; the viewport maps the
+			//whole view to it
+			VkExtent2D const renderExtent = settings.stereo ? stereoTargets.extent
+				: dynamicResolution ? scaled_extent(window.swapchainExtent, resolution.scale) : window.swapchainExtent;
+
+			//the slot's secondary command buffers are no longer in use (fence);
+			//cached ones are only recorded when missing, or when they use other
+			//pipelines or another viewport
+			bool const sameExtent = frame.drawsExtent.width == renderExtent.width && frame.drawsExtent.height == renderExtent.height;
+			if (secondaryDraws && (!cachedDraws || !frame.drawsRecorded || frame.drawsPipes[0] != pipe || frame.drawsPipes[1] != alphaPipe || !sameExtent))
+			{
+				record_secondary_draws(window, frame, options.recordThreads, renderPass.handle, renderExtent, pipe, alphaPipe, depthPipe.handle, depthAlphaPipe.handle, std::uint32_t(sceneOffset),
+					pipeLayout.handle, sceneDescriptors, ourModel, drawList, scopes, settings);
+				frame.drawsPipes[0] = pipe;
+				frame.drawsPipes[1] = alphaPipe;
+				frame.drawsExtent = renderExtent;
+			}
+
+			stamps.record = Clock_::now();
+
+			//--late-latch: the value that this frame's submissions wait for
+			if (latchGate)
+				latchGate->signal();
+
+			//the clustering overlaps with this frame's culling and depth
+			//passes on the graphics queue
+			if (lightClusters.async)
+				submit_compute_commands(window, frame.computeCmdBuff, timeline, frame.computeDone.handle, lightClusters, sceneDescriptors, std::uint32_t(sceneOffset), renderExtent, sceneUniforms,
+					latchGate ? sceneUBO.buffer.buffer : VK_NULL_HANDLE, latchGate ? &*latchGate : nullptr);
+
+			frame.shadowFaces = shadowsOn ? plan_shadow_updates(shadows, state.light_pos) : 0;
+
+			//a screenshot or a captured frame is copied into a readback buffer
+			//at the end of the frame (none if the encoder is behind)
+			VkBuffer readback = frame.readback.buffer;
+			if (capture && (state.screenshot || options.captureFrames) && FrameCapture::supports(window.swapchainFormat))
+			{
+				char name[64];
+				std::snprintf(name, sizeof(name), options.captureFrames ? "frame-%06u" : "screenshot-%06u", frameNumber);
+				char const* const dir = options.captureFrames ? options.captureFrames : options.screenshotDir;
+
+				if (state.screenshot && !options.captureFrames)
+				{
+					std::error_code ec;
+					std::filesystem::create_directories(dir, ec);
+					if (ec)
+						throw lut::Error("Unable to create screenshot directory '%s': %s", dir, ec.message().c_str());
+				}
+
+				auto const path = (std::filesystem::path(dir) / name).string();
+				readback = capture->begin(path, window.swapchainExtent, window.swapchainFormat);
+				if (state.screenshot)
+					std::printf("Screenshot: %s\n", VK_NULL_HANDLE != readback ? path.c_str() : "no readback buffer free, skipped");
+				state.screenshot = false;
+			}
+
+			timing.draws = record_commands(frame.cmdBuff, renderPass.handle, framebuffers[imageIndex].handle, pipe,
+				window.swapchainExtent, std::uint32_t(sceneOffset), pipeLayout.handle, sceneDescriptors, ourModel, alphaPipe, depthPipe.handle, depthAlphaPipe.handle, drawList,
+				ECullMode::gpu == settings.cullMode ? &gpuCuller : nullptr, useHiz ? &hiz : nullptr, shadingRate ? &shadingRates : nullptr, lightClusters, prevProjCam, scopes,
+				secondaryDraws ? &frame : nullptr, settings,
+				deferred ? &lighting : nullptr, visibility ? &visibilityShading : nullptr, lightingPipe, sceneUniforms,
+				dynamicResolution ? &renderTarget : nullptr, temporalUpscale ? &temporal : nullptr, settings.stereo ? &stereoTargets : nullptr, renderExtent, window.swapImages[imageIndex], VK_NULL_HANDLE == window.swapchain, readback,
+				streaming ? &streaming->feedback : mipReport ? &mipReport->feedback : nullptr, virtualTex ? &*virtualTex : nullptr, world ? &*world : nullptr, frameIndex, hud ? &*hud : nullptr, imageIndex,
+				shadowsOn ? &shadows : nullptr, shadowPipe.handle, shadowAlphaPipe.handle, frameDevice, stream ? &*stream : nullptr,
+				EDebugView::off != debugViews.view ? &debugViews : nullptr, latchGate ? sceneUBO.buffer.buffer : VK_NULL_HANDLE);
+
+			prevProjCam = sceneUniforms.projCam;
+
+			if (bench)
+			{
+				frame.done = submit_commands(window, frame.cmdBuff, timeline, VK_NULL_HANDLE, VK_NULL_HANDLE, frame.computeDone.handle, frameDevice);
+				if (stream)
+					stream->submitted(frame.done);
+
+				frame.submitted = Clock_::now();
+				cpuMs = std::chrono::duration<double, std::milli>(frame.submitted - cpuStart).count();
+				if (options.apiCounters)
+					apiCounts = lut::take_api_counters();
+				auto const vramMib = double(lut::query_memory_stats(allocator).deviceUsage) / (1 << 20);
+				peakVramMib = std::max(peakVramMib, vramMib);
+				benchPending[frameIndex] = BenchRow{ benchFrame, compared, 1000.0 * dt, cpuMs, vramMib, timing.draws.draws, apiCounts };
+				++benchFrame;
+			}
+			else
+			{
+				//the work before this frame (see the late latch below)
+				std::uint64_t const previousWork = timeline.submitted();
+
+				frame.done = submit_commands(window, frame.cmdBuff, timeline, frame.imageAvailable.handle, renderFinished[imageIndex].handle, frame.computeDone.handle, frameDevice,
+					latchGate ? &*latchGate : nullptr);
+				frame.submitted = Clock_::now();
+				if (capture)
+					capture->submitted(frame.done);
+				if (stream)
+					stream->submitted(frame.done);
+				cpuMs = std::chrono::duration<double, std::milli>(frame.submitted - cpuStart).count();
+
+				stamps.submit = frame.submitted;
+
+				//Late latch: the frame's shaders wait for the gate. Once the
+				//GPU has finished the work before it, the input is sampled
+				//again, and the camera moved on and written into the frame's
+				//uniforms. The GPU idles for that long, less the frame's
+				//work that doesn't read the uniforms (copies, resets). The
+				//CPU culling, LOD selection and texture requests keep the
+				//earlier camera; objects that the latched view brings in at
+				//its edges appear a frame late.
+				if (latchGate)
+				{
+					LUT_CPU_ZONE("late latch");
+					timeline.wait(previousWork);
+
+					pump_events(0.0);
+					auto const latched = Clock_::now();
+					update_user_state(state, std::chrono::duration_cast<Secondsf_>(latched - previousClock).count());
+					previousClock = latched;
+
+					//the input is this frame's now
+					stamps.sample = latched;
+					if (Clock_::time_point{} != state.firstInput)
+					{
+						if (!stamps.hadInput)
+						{
+							stamps.hadInput = true;
+							stamps.input = state.firstInput;
+						}
+						state.firstInput = Clock_::time_point{};
+						if (onDemand)
+							redrawFrames = cfg::kRedrawFrames;
+					}
+					if (options.capturePath)
+						capturedKeys.back().camera2world = state.camera2world;
+
+					update_camera(sceneUniforms);
+					std::memcpy(sceneUBO.mapped + sceneOffset, &sceneUniforms, sizeof(glsl::SceneUniform));
+					vmaFlushAllocation(allocator.allocator, sceneUBO.buffer.allocation, sceneOffset, sizeof(glsl::SceneUniform));
+					latchGate->signal_host(latchGate->submitted());
+
+					prevProjCam = sceneUniforms.projCam;
+				}
+				auto const presentId = latency->next_present_id();
+				present_results(window.presentQueue, window.swapchain, imageIndex, renderFinished[imageIndex].handle, presentId, recreateSwapchain, frameDevice);
+				stamps.present = Clock_::now();
+				latency->presented(stamps, presentId);
+				if (options.apiCounters)
+					apiCounts = lut::take_api_counters();
+			}
+
+			frameIndex = (frameIndex + 1) % std::uint32_t(frames.size());
+
+
+		}
+	};
+
+	if (mailbox)
+		run_render_thread(window.window, *mailbox, state, render_frames);
+	else
+		render_frames();
+
+	// Cleanup takes place automatically in the destructors, but we sill need
+	// to ensure that all Vulkan commands have finished before that.
+	vkDeviceWaitIdle(window.device);
+
+	if (mipReport)
+	{
+		//the frames still in flight, oldest first
+		for (std::uint32_t i = 0; i < frames.size(); ++i)
+			update_mip_report(*mipReport, allocator, (frameIndex + i) % std::uint32_t(frames.size()));
+		write_mip_report(*mipReport, allocator, ourModel, options.mipReport);
+	}
+
+	if (options.memoryReport)
+	{
+		lut::write_memory_report(allocator, options.memoryReport);
+		std::printf("Memory report: %s\n", options.memoryReport);
+	}
+
+	if (virtualTex)
+		release_virtual_textures(*virtualTex, allocator);
+
+	if (!lut::save_pipeline_cache(window, pipeCache.handle, cfg::kPipelineCachePath))
+		std::fprintf(stderr, "Info: unable to write pipeline cache '%s'\n", cfg::kPipelineCachePath);
+
+	if (bench)
+	{
+		//the remaining frames, oldest first
+		for (std::uint32_t i = 0; i < frames.size(); ++i)
+		{
+			auto const slot = (frameIndex + i) % std::uint32_t(frames.size());
+			profiler.begin_frame(slot);
+			write_bench_row(slot);
+		}
+
+		bool const ok = !std::ferror(benchCsv.get());
+		if (0 != std::fclose(benchCsv.release()) || !ok)
+			throw lut::Error("Unable to write benchmark output '%s'", options.benchCsv);
+
+		std::printf("Benchmark: %zu frames at %ux%u, timings written to '%s'\n", benchKeys.size() * benchPasses, options.benchWidth, options.benchHeight, options.benchCsv);
+
+		auto const memory = lut::query_memory_stats(allocator);
+		std::printf("  VRAM: %.1f MiB peak, %.1f MiB budget (%s)\n", peakVramMib, double(memory.deviceBudget) / (1 << 20), memory.fromDriver ? "VK_EXT_memory_budget" : "estimated");
+
+		//throughput of the scene at this size (--bench-grid), with the
+		//draw and cull modes in effect after the fallbacks
+		auto const& ss = scalingStats;
+		std::string const drawName = std::string(EDrawMode::direct == settings.drawMode ? "direct" : "indirect") + (ourModel.instanceCount > 1 ? "+instanced" : "");
+		char const* const cullName = ECullMode::none == settings.cullMode ? "none" : ECullMode::cpu == settings.cullMode ? "cpu" : "gpu";
+		double const meanCpuMs = ss.frames ? ss.cpuMs / double(ss.frames) : 0.0;
+		double const meanGpuMs = ss.timedFrames ? ss.gpuMs / double(ss.timedFrames) : 0.0;
+		double const meanDraws = ss.frames ? double(ss.draws) / double(ss.frames) : 0.0;
+		double const meanTriangles = ss.countedFrames ? double(ss.triangles) / double(ss.countedFrames) : 0.0;
+		double const mtrisPerSec = meanGpuMs > 0.0 ? meanTriangles / meanGpuMs * 1e-3 : 0.0;
+
+		std::printf("  %u instances (%ux%u), %.2fM triangles, %zu meshes; draw=%s cull=%s\n", benchInstances, options.benchGridColumns, options.benchGridRows,
+			double(sceneTriangles) * 1e-6, ourModel.meshes.size(), drawName.c_str(), cullName);
+		std::printf("  %.3f ms GPU, %.3f ms CPU, %.0f draws, %.2fM triangles submitted per frame (mean); %.1f Mtri/s\n",
+			meanGpuMs, meanCpuMs, meanDraws, meanTriangles * 1e-6, mtrisPerSec);
+
+		if (options.benchScaling)
+		{
+			std::unique_ptr<std::FILE, int(*)(std::FILE*)> scaling(std::fopen(options.benchScaling, "a"), &std::fclose);
+			if (!scaling)
+				throw lut::Error("Unable to open '%s' for appending", options.benchScaling);
+
+			if (0 == std::ftell(scaling.get()))
+				std::fprintf(scaling.get(), "columns,rows,instances,meshes,scene_triangles,draw,cull,frames,gpu_ms,cpu_ms,draws,triangles,mtri_per_s\n");
+			std::fprintf(scaling.get(), "%u,%u,%u,%zu,%llu,%s,%s,%zu,%.4f,%.4f,%.1f,%.0f,%.2f\n",
+				options.benchGridColumns, options.benchGridRows, benchInstances, ourModel.meshes.size(), static_cast<unsigned long long>(sceneTriangles),
+				drawName.c_str(), cullName, ss.frames, meanGpuMs, meanCpuMs, meanDraws, meanTriangles, mtrisPerSec);
+
+			bool const scalingOk = !std::ferror(scaling.get());
+			if (0 != std::fclose(scaling.release()) || !scalingOk)
+				throw lut::Error("Unable to write '%s'", options.benchScaling);
+		}
+
+		if (compareImages)
+		{
+			for (std::size_t i = 0; i < 2; ++i)
+			{
+				auto const& stats = compareStats[i];
+				if (stats.timedFrames)
+					std::printf("  %s: %.3f ms GPU per frame, %.3f ms colour pass (mean)\n", compareNames[i], stats.frameMs / double(stats.timedFrames), stats.colourMs / double(stats.timedFrames));
+			}
+
+			if (!benchKeys.empty())
+				std::printf("  %s error: RMSE %.3f mean, %.3f max; largest difference %u/255\n", compareNames[1], sumRmse / double(benchKeys.size()), maxRmse, maxDiff);
+		}
+	}
+
+	if (!startupReported)
+		report_startup(false);
+
+#	if defined(LUT_CPU_ZONES)
+	if (lut::write_cpu_zones(cfg::kCpuZonesPath))
+		std::printf("CPU zones written to '%s'\n", cfg::kCpuZonesPath);
+#	endif
+
+	if (capture)
+	{
+		capture->flush(timeline);
+		if (options.captureFrames)
+			std::printf("Frame capture: %zu frames written to '%s', %zu dropped\n", capture->written(), options.captureFrames, capture->dropped());
+	}
+
+	if (stream)
+	{
+		stream->flush(timeline);
+		std::printf("Stream: %zu frames (%ux%u) written to '%s', %zu dropped\n", stream->sent(), stream->size().width, stream->size().height, options.streamPath, stream->dropped());
+	}
+
+	if (options.capturePath)
+	{
+		save_camera_path(options.capturePath, capturedKeys);
+		std::printf("Camera path: %zu keys written to '%s'\n", capturedKeys.size(), options.capturePath);
+	}
+
+	if (traceWriter)
+	{
+		traceWriter->close();
+		std::printf("Draw trace: %zu frames written to '%s'\n", traceWriter->frames(), options.tracePath);
+	}
+
+	{
+		std::size_t highWater = 0, capacity = 0;
+		for (auto const& frame : frames)
+		{
+			highWater = std::max(highWater, frame.arena.high_water());
+			capacity = std::max(capacity, frame.arena.capacity());
+		}
+		std::printf("Frame arenas: %.1f KiB high-water mark, %.1f KiB per frame\n", highWater / 1024.0, capacity / 1024.0);
+	}
+
+	if (profiler.enabled())
+	{
+		std::printf("GPU timings over the last frames (ms):\n");
+		std::printf("  %-16s %8s %8s %8s\n", "scope", "min", "avg", "max");
+		for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+		{
+			if (auto const gpu = profiler.stats(i); gpu.samples > 0)
+				std::printf("  %-16s %8.3f %8.3f %8.3f\n", gpu.name, gpu.minMs, gpu.avgMs, gpu.maxMs);
+		}
+
+		//alternate-frame rendering: the same per GPU
+		for (std::uint32_t device = 0; device < profiler.device_count() && profiler.device_count() > 1; ++device)
+		{
+			std::printf("GPU %u:\n", device);
+			for (std::uint32_t i = 0; i < profiler.scope_count(); ++i)
+			{
+				if (auto const gpu = profiler.stats(i, device); gpu.samples > 0)
+					std::printf("  %-16s %8.3f %8.3f %8.3f\n", gpu.name, gpu.minMs, gpu.avgMs, gpu.maxMs);
+			}
+		}
+	}
+
+	return 0;
+}
+catch (std::exception const& eErr)
+{
+	std::fprintf(stderr, "\n");
+	std::fprintf(stderr, "Error: %s\n", eErr.what());
+	return 1;
+}
+
+namespace
+{
+	void glfw_callback_key_press(GLFWwindow* aWindow, int aKey, int /*aScanCode*/, int aAction, int /*aModifierFlags*/)
+	{
+		if (GLFW_KEY_ESCAPE == aKey && GLFW_PRESS == aAction)
+		{
+			glfwSetWindowShouldClose(aWindow, GLFW_TRUE);
+		}
+
+		auto state = static_cast<UserState*>(glfwGetWindowUserPointer(aWindow));
+		assert(state);
+		stamp_input(*state);
+
+		bool const isReleased = (GLFW_RELEASE == aAction);
 
 		switch (aKey)
 		{
@@ -460,9 +3830,39 @@ namespace
 			state->inputMap[std::size_t(EInputState::fast)] = !isReleased;
 			break;
 
-		case GLFW_KEY_LEFT_CONTROL: [[fallthrough]];
-		case GLFW_KEY_RIGHT_CONTROL:
-			state->inputMap[std::size_t(EInputState::slow)] = !isReleased;
+		case GLFW_KEY_LEFT_CONTROL: [[fallthrough]];
+		case GLFW_KEY_RIGHT_CONTROL:
+			state->inputMap[std::size_t(EInputState::slow)] = !isReleased;
+			break;
+
+		case GLFW_KEY_N:
+			if (GLFW_PRESS == aAction)
+				state->normalMaps = !state->normalMaps;
+			break;
+
+		case GLFW_KEY_V:
+			if (GLFW_PRESS == aAction)
+				state->shadingRate = !state->shadingRate;
+			break;
+
+		case GLFW_KEY_H:
+			if (GLFW_PRESS == aAction)
+				state->hud = !state->hud;
+			break;
+
+		case GLFW_KEY_O:
+			if (GLFW_PRESS == aAction)
+				state->debugView = EDebugView((std::uint32_t(state->debugView) + 1) % std::uint32_t(EDebugView::count));
+			break;
+
+		case GLFW_KEY_F12:
+			if (GLFW_PRESS == aAction)
+				state->screenshot = true;
+			break;
+
+		case GLFW_KEY_M:
+			if (GLFW_PRESS == aAction)
+				state->memoryReport = true;
 			break;
 
 		case GLFW_KEY_SPACE:
@@ -482,6 +3882,10 @@ namespace
 	{
 		auto state = static_cast<UserState*>(glfwGetWindowUserPointer(aWin));
 		assert(state);
+		stamp_input(*state);
+
+		if (GLFW_MOUSE_BUTTON_LEFT == aBut && GLFW_PRESS == aAct)
+			state->pick = true;
 
 		if (GLFW_MOUSE_BUTTON_RIGHT == aBut && GLFW_PRESS == aAct)
 		{
@@ -500,9 +3904,104 @@ namespace
 		auto state = static_cast<UserState*>(glfwGetWindowUserPointer(aWin));
 		assert(state);
 
+		stamp_input(*state);
+
 		state->mouseX = float(aX);
 		state->mouseY = float(aY);
 	}
+
+	void glfw_callback_refresh(GLFWwindow* aWin)
+	{
+		auto state = static_cast<UserState*>(glfwGetWindowUserPointer(aWin));
+		assert(state);
+		state->redraw = true;
+	}
+
+	void glfw_callback_resize(GLFWwindow* aWin, int aWidth, int aHeight)
+	{
+		auto state = static_cast<UserState*>(glfwGetWindowUserPointer(aWin));
+		assert(state);
+		state->framebufferWidth = aWidth;
+		state->framebufferHeight = aHeight;
+		state->redraw = true;
+	}
+
+	void stamp_input(UserState& aState)
+	{
+		if (Clock_::time_point{} == aState.firstInput)
+			aState.firstInput = Clock_::now();
+	}
+
+	void take_input(UserState& aTo, UserState& aFrom)
+	{
+		std::copy(std::begin(aFrom.inputMap), std::end(aFrom.inputMap), aTo.inputMap);
+		aTo.normalMaps = aFrom.normalMaps;
+		aTo.shadingRate = aFrom.shadingRate;
+		aTo.hud = aFrom.hud;
+		aTo.debugView = aFrom.debugView;
+		aTo.mouseX = aFrom.mouseX;
+		aTo.mouseY = aFrom.mouseY;
+		aTo.framebufferWidth = aFrom.framebufferWidth;
+		aTo.framebufferHeight = aFrom.framebufferHeight;
+
+		aTo.pick = aTo.pick || std::exchange(aFrom.pick, false);
+		aTo.screenshot = aTo.screenshot || std::exchange(aFrom.screenshot, false);
+		aTo.memoryReport = aTo.memoryReport || std::exchange(aFrom.memoryReport, false);
+		aTo.redraw = aTo.redraw || std::exchange(aFrom.redraw, false);
+
+		auto const first = std::exchange(aFrom.firstInput, Clock_::time_point{});
+		if (Clock_::time_point{} == aTo.firstInput)
+			aTo.firstInput = first;
+	}
+
+	void run_render_thread(GLFWwindow* aWindow, InputMailbox& aMailbox, UserState& aState, std::function<void()> const& aRenderFrames)
+	{
+		UserState events = aState;
+		aMailbox.published = aState;
+		glfwSetWindowUserPointer(aWindow, &events);
+
+		std::exception_ptr error;
+		std::thread renderer([&] {
+			try
+			{
+				aRenderFrames();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			aMailbox.stopped = true;
+			glfwPostEmptyEvent();
+		});
+
+		while (!aMailbox.stopped)
+		{
+			glfwWaitEvents();
+
+			std::string title;
+			{
+				std::lock_guard<std::mutex> lock(aMailbox.mutex);
+				take_input(aMailbox.published, events);
+				aMailbox.fresh = true;
+				std::swap(title, aMailbox.title);
+
+				if (glfwWindowShouldClose(aWindow))
+					aMailbox.quit = true;
+			}
+
+			aMailbox.posted.notify_one();
+
+			if (!title.empty())
+				glfwSetWindowTitle(aWindow, title.c_str());
+		}
+
+		renderer.join();
+		glfwSetWindowUserPointer(aWindow, &aState);
+
+		if (error)
+			std::rethrow_exception(error);
+	}
 }
 
 namespace
@@ -512,9 +4011,14 @@ namespace
 		//TODO- (Section 3) initialize SceneUniform members
 		float const aspect = aFramebufferWidth / float(aFramebufferHeight);
 
-		aSceneUniforms.projection = glm::perspectiveRH_ZO(lut::Radians(cfg::kCameraFov).value(),
-			aspect, cfg::kCameraNear, cfg::kCameraFar);
-		aSceneUniforms.projection[1][1] *= -1.f;// mirror Y axis
+		//reverse-Z, infinite far plane: clip z is the near distance, and w
+		//the view depth, so window depth is kCameraNear / z
+		float const focal = 1.f / std::tan(0.5f * lut::Radians(cfg::kCameraFov).value());
+		aSceneUniforms.projection = glm::mat4(0.f);
+		aSceneUniforms.projection[0][0] = focal / aspect;
+		aSceneUniforms.projection[1][1] = -focal;// mirror Y axis
+		aSceneUniforms.projection[2][3] = -1.f;
+		aSceneUniforms.projection[3][2] = cfg::kCameraNear;
 
 		aSceneUniforms.camera = glm::inverse(aState.camera2world);
 
@@ -523,12 +4027,29 @@ namespace
 		aSceneUniforms.lightColor = glm::vec3(1,1,1);
 		aSceneUniforms.lightPos = aState.light_pos;
 	}
+
+	void update_stereo_views(glsl::SceneUniform& aSceneUniforms, float aEyeSeparation)
+	{
+		//the eyes are half the separation to either side of the camera
+		for (std::uint32_t eye = 0; eye < 2; ++eye)
+		{
+			float const offset = (0 == eye ? -0.5f : 0.5f) * aEyeSeparation;
+			aSceneUniforms.viewProjCam[eye] = aSceneUniforms.projection * glm::translate(glm::vec3(-offset, 0.f, 0.f)) * aSceneUniforms.camera;
+		}
+
+		//with the same angles, an apex this far behind the camera has both
+		//eyes' frusta inside its own (projection[0][0] is 1/tan of the
+		//horizontal half angle)
+		float const back = 0.5f * aEyeSeparation * aSceneUniforms.projection[0][0];
+		aSceneUniforms.projCam = aSceneUniforms.projection * glm::translate(glm::vec3(0.f, 0.f, -back)) * aSceneUniforms.camera;
+	}
 }
 
 namespace
 {
 	void update_user_state(UserState& aState, float aElapsedTime)
 	{
+		LUT_CPU_ZONE("update_user_state()");
 		auto& cam = aState.camera2world;
 
 		if (aState.inputMap[std::size_t(EInputState::mousing)])
@@ -584,23 +4105,80 @@ namespace
 
 	}
 
-	lut::RenderPass create_render_pass(lut::VulkanWindow const& aWindow)
+	lut::RenderPass create_render_pass(lut::VulkanWindow const& aWindow, VkFormat aDepthFormat, bool aSampledDepth, bool aDepthPrepass, ELightingMode aLighting, VkExtent2D aShadingRateTexel, bool aUpscaled, VkSampleCountFlagBits aSamples, bool aMultiview)
 	{
+		bool const aDeferred = ELightingMode::deferred == aLighting;
+		bool const visibility = ELightingMode::visibility == aLighting;
+		bool const shadingSubpass = aDeferred || visibility; //subpass 1 shades subpass 0's output
+		bool const multisampled = aSamples > VK_SAMPLE_COUNT_1_BIT;
+		assert(!(aDepthPrepass && shadingSubpass));
+		assert(!(multisampled && shadingSubpass));
+		assert(!aMultiview || (!aDepthPrepass && !shadingSubpass && !multisampled && !aSampledDepth && 0 == aShadingRateTexel.width));
+
 		//TODO- (Section 1 / Exercise 3) implement me!
-		VkAttachmentDescription attachments[2]{};
+		VkAttachmentDescription attachments[2 + kGBufferColorAttachments]{};
 		attachments[0].format = aWindow.swapchainFormat;
 		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
 		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		// Offscreen images are not presented (and PRESENT_SRC_KHR needs the
+		// swapchain extension); leave them ready to be read back instead.
+		// The render target (and the stereo layers) are blitted (copied) from.
+		attachments[0].finalLayout = VK_NULL_HANDLE != aWindow.swapchain && !aUpscaled && !aMultiview ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
-		attachments[1].format = cfg::kDepthFormat;
+		attachments[1].format = aDepthFormat;
 		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
 		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].storeOp = aSampledDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		attachments[1].finalLayout = aSampledDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		//The G-buffer only lives within the pass: every pixel that is lit
+		//was written by subpass 0, the others are skipped.
+		VkFormat const gbufferFormats[kGBufferColorAttachments] = { kGBufferAlbedoFormat, kGBufferNormalFormat };
+		for (std::uint32_t i = 0; i < kGBufferColorAttachments; ++i)
+		{
+			auto& gbuffer = attachments[2 + i];
+			gbuffer.format = gbufferFormats[i];
+			gbuffer.samples = VK_SAMPLE_COUNT_1_BIT;
+			gbuffer.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			gbuffer.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			gbuffer.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			gbuffer.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			gbuffer.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			gbuffer.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+
+		//The visibility buffer replaces the G-buffer; it is cleared to 0
+		//(no triangle), which the material pass skips.
+		if (visibility)
+		{
+			attachments[2].format = kVisibilityFormat;
+			attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		}
+
+		//Multisampled, the subpasses draw into attachments 2 and 3, which
+		//only live within the pass. Attachments 0 and 1 become their
+		//resolve targets, and are never loaded; depth is only resolved
+		//(and stored) if it is sampled after the pass.
+		if (multisampled)
+		{
+			attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+			attachments[2] = attachments[0];
+			attachments[2].samples = aSamples;
+			attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[2].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+			attachments[3] = attachments[1];
+			attachments[3].samples = aSamples;
+			attachments[3].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[3].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[3].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		}
 
 		VkAttachmentReference subpassAttachments[1]{};
 		subpassAttachments[0].attachment = 0; //this refers to attachment[0]
@@ -610,28 +4188,211 @@ namespace
 		depthAttachment.attachment = 1; //this refers to attachments[1]
 		depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-		VkSubpassDescription subpasses[1]{};
+		VkAttachmentReference resolveAttachments[1]{};
+		if (multisampled)
+		{
+			resolveAttachments[0] = subpassAttachments[0];
+			subpassAttachments[0].attachment = 2;
+			depthAttachment.attachment = 3;
+		}
+
+		VkAttachmentReference gbufferAttachments[kGBufferColorAttachments]{};
+		for (std::uint32_t i = 0; i < kGBufferColorAttachments; ++i)
+		{
+			gbufferAttachments[i].attachment = 2 + i;
+			gbufferAttachments[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+
+		//the lighting subpass's inputs, in input_attachment_index order
+		//(see deferred_frag.glsl); the material pass only reads the first
+		//(see visibility_shade_frag.glsl)
+		VkAttachmentReference lightingInputs[3]{};
+		lightingInputs[0] = { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		lightingInputs[1] = { 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		lightingInputs[2] = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+		std::uint32_t const lightingInputCount = visibility ? 1 : 3;
+
+		//With the depth pre-pass, subpass 0 only writes depth, and subpass 1
+		//shades against it. Deferred, subpass 0 draws the scene into the
+		//G-buffer (or the visibility buffer), and subpass 1 shades it into
+		//the colour attachment. Otherwise there is a single subpass.
+		std::uint32_t const colorSubpass = aDepthPrepass ? 1 : 0;
+		std::uint32_t const outputSubpass = shadingSubpass ? 1 : colorSubpass; //writes attachment 0
+		std::uint32_t const subpassCount = outputSubpass + 1;
+
+		VkSubpassDescription subpasses[2]{};
 		subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpasses[0].colorAttachmentCount = 1;
-		subpasses[0].pColorAttachments = subpassAttachments;
 		subpasses[0].pDepthStencilAttachment = &depthAttachment;
 
-		//changed: no explicit subpass dependencies
+		subpasses[colorSubpass].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[colorSubpass].colorAttachmentCount = aDeferred ? kGBufferColorAttachments : 1;
+		subpasses[colorSubpass].pColorAttachments = shadingSubpass ? gbufferAttachments : subpassAttachments;
+		subpasses[colorSubpass].pDepthStencilAttachment = &depthAttachment;
+		if (multisampled)
+			subpasses[colorSubpass].pResolveAttachments = resolveAttachments;
+
+		if (shadingSubpass)
+		{
+			subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpasses[1].inputAttachmentCount = lightingInputCount;
+			subpasses[1].pInputAttachments = lightingInputs;
+			subpasses[1].colorAttachmentCount = 1;
+			subpasses[1].pColorAttachments = subpassAttachments;
+		}
+
+		//no explicit subpass dependencies in the basic configuration. With
+		//the pre-pass or when the depth buffer is read by the Hi-Z build
+		//after the pass, the dependencies are spelled out:
+		//Multisampled, the attachments shared by the frames in flight are
+		//always synchronized (the previous frame's writes to them).
+		std::vector<VkSubpassDependency> deps;
+		if (aDepthPrepass || aSampledDepth || shadingSubpass || multisampled)
+		{
+			//the depth clear waits for the previous frame's depth writes
+			//(and the Hi-Z build or the lighting subpass reading them)
+			VkSubpassDependency depth{};
+			depth.srcSubpass = VK_SUBPASS_EXTERNAL;
+			depth.dstSubpass = 0;
+			depth.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+				| (aSampledDepth ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0)
+				| (aDeferred ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : 0);
+			depth.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			depth.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			depth.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			deps.emplace_back(depth);
+
+			//the colour attachment's layout transition waits for the
+			//swapchain image (the acquire semaphore is waited for at
+			//COLOR_ATTACHMENT_OUTPUT); the multisampled colour clear for
+			//the previous frame's writes.
+			VkSubpassDependency color{};
+			color.srcSubpass = VK_SUBPASS_EXTERNAL;
+			color.dstSubpass = outputSubpass;
+			color.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			color.srcAccessMask = multisampled ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+			color.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			color.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			deps.emplace_back(color);
+		}
+		if (aDepthPrepass)
+		{
+			VkSubpassDependency prepass{};
+			prepass.srcSubpass = 0;
+			prepass.dstSubpass = colorSubpass;
+			prepass.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			prepass.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			prepass.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			prepass.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			prepass.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			deps.emplace_back(prepass);
+		}
+		if (shadingSubpass)
+		{
+			//the G-buffer (visibility buffer) is shared by the frames in
+			//flight: the previous frame's lighting subpass must have read it
+			//before it is overwritten
+			VkSubpassDependency reuse{};
+			reuse.srcSubpass = VK_SUBPASS_EXTERNAL;
+			reuse.dstSubpass = 0;
+			reuse.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			reuse.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			reuse.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			reuse.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			deps.emplace_back(reuse);
+
+			//the lighting subpass reads the G-buffer and depth at the same
+			//pixel only
+			VkSubpassDependency gbuffer{};
+			gbuffer.srcSubpass = 0;
+			gbuffer.dstSubpass = 1;
+			gbuffer.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			gbuffer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			gbuffer.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			gbuffer.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+			gbuffer.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			deps.emplace_back(gbuffer);
+		}
+		if (aSampledDepth && multisampled)
+		{
+			//resolves execute at COLOR_ATTACHMENT_OUTPUT, depth too: the
+			//depth resolve waits for the previous frame's compute reads
+			VkSubpassDependency resolve{};
+			resolve.srcSubpass = VK_SUBPASS_EXTERNAL;
+			resolve.dstSubpass = colorSubpass;
+			resolve.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			resolve.srcAccessMask = 0;
+			resolve.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			resolve.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			deps.emplace_back(resolve);
+		}
+		if (aSampledDepth)
+		{
+			//deferred, the depth writes reach the last subpass through the
+			//dependency above (at its fragment shader stage)
+			VkSubpassDependency hiz{};
+			hiz.srcSubpass = outputSubpass;
+			hiz.dstSubpass = VK_SUBPASS_EXTERNAL;
+			hiz.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | (shadingSubpass ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : 0)
+				| (multisampled ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : 0);
+			hiz.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | (multisampled ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0);
+			hiz.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			hiz.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			deps.emplace_back(hiz);
+		}
+
 		VkRenderPassCreateInfo passInfo{};
 		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		passInfo.attachmentCount = 2;
+		passInfo.attachmentCount = aDeferred || multisampled ? 2 + kGBufferColorAttachments : (visibility ? 3 : 2);
 		passInfo.pAttachments = attachments;
-		passInfo.subpassCount = 1;
+		passInfo.subpassCount = subpassCount;
 		passInfo.pSubpasses = subpasses;
-		passInfo.dependencyCount = 0;  //changed
-		passInfo.pDependencies = nullptr;  //changed
+		passInfo.dependencyCount = std::uint32_t(deps.size());
+		passInfo.pDependencies = deps.empty() ? nullptr : deps.data();
+
+		//the depth resolve (see query_depth_resolve_mode())
+		VkAttachmentReference2 depthResolveAttachment{};
+		depthResolveAttachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+		depthResolveAttachment.attachment = 1;
+		depthResolveAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthResolveAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+		VkSubpassDescriptionDepthStencilResolve depthResolve{};
+		depthResolve.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE;
+		depthResolve.depthResolveMode = query_depth_resolve_mode(aWindow);
+		depthResolve.stencilResolveMode = VK_RESOLVE_MODE_NONE;
+		depthResolve.pDepthStencilResolveAttachment = &depthResolveAttachment;
+		void const* const colorSubpassNext = multisampled && aSampledDepth ? &depthResolve : nullptr;
+
+		//the shading rate attachment and depth resolves need
+		//VkRenderPassCreateInfo2
+		if (0 != aShadingRateTexel.width)
+		{
+			assert(!shadingSubpass);
+			return create_shading_rate_render_pass(aWindow, passInfo, colorSubpass, aShadingRateTexel, colorSubpassNext);
+		}
+		if (colorSubpassNext)
+			return lut::create_render_pass2(aWindow, passInfo, colorSubpass, colorSubpassNext);
+
+		//the subpass draws both eyes; they see mostly the same geometry
+		//(the correlation mask)
+		std::uint32_t const viewMask = kStereoViewMask;
+		VkRenderPassMultiviewCreateInfo multiviewInfo{};
+		multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+		multiviewInfo.subpassCount = 1;
+		multiviewInfo.pViewMasks = &viewMask;
+		multiviewInfo.correlationMaskCount = 1;
+		multiviewInfo.pCorrelationMasks = &viewMask;
+		if (aMultiview)
+			passInfo.pNext = &multiviewInfo;
 
 		VkRenderPass rpass = VK_NULL_HANDLE;
 		if (auto const res = vkCreateRenderPass(aWindow.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str());
 		}
-		return lut::RenderPass(aWindow.device, rpass);
+		lut::RenderPass ret(aWindow.device, rpass);
+		lut::set_name(aWindow, ret, "render pass");
+		return ret;
 	}
 
 	lut::PipelineLayout create_pipeline_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aObjectLayout)
@@ -648,8 +4409,19 @@ namespace
 		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
 		layoutInfo.pSetLayouts = layouts;
-		layoutInfo.pushConstantRangeCount = 0;
-		layoutInfo.pPushConstantRanges = nullptr;
+		// The texture arrays' fragment shaders take the material from
+		// kMaterialPushOffset on (see ModelPack::arrayMaterials)
+		static_assert(sizeof(glsl::DrawPushConstants) <= kMaterialPushOffset, "DrawPushConstants overlap the pushed material");
+		VkPushConstantRange ranges[2]{};
+		ranges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		ranges[0].offset = 0;
+		ranges[0].size = sizeof(glsl::DrawPushConstants);
+		ranges[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		ranges[1].offset = kMaterialPushOffset;
+		ranges[1].size = sizeof(MaterialIndices);
+
+		layoutInfo.pushConstantRangeCount = sizeof(ranges) / sizeof(ranges[0]);
+		layoutInfo.pPushConstantRanges = ranges;
 
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
@@ -661,101 +4433,353 @@ namespace
 	}
 
 
-	lut::Pipeline create_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	void fill_vertex_input(VertexInputState& aState, bool aQuantized, bool aPositionsOnly, bool aMeshInstances, bool aPositionStream, bool aPulled)
+	{
+		assert(!aPositionStream || (aPositionsOnly && !aQuantized));
+		assert(!aPulled || (!aQuantized && !aMeshInstances));
+
+		aState = VertexInputState{};
+
+		//the vertex shader reads the vertices itself
+		if (aPulled)
+		{
+			aState.info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			return;
+		}
+
+		//the layouts come from the vertex structs (see vertex_layout.hpp);
+		//the locations must match the shaders
+		std::uint32_t bindingCount = 0, attribCount = 0;
+		std::uint32_t const vertexLocations = aPositionsOnly ? vertex_locations(0) : kAllVertexLocations;
+
+		//interleaved vertices, or just their positions
+		if (aQuantized)
+		{
+			aState.bindings[bindingCount++] = vertex_binding<QuantizedVertex>(0);
+			attribCount += vertex_attributes<QuantizedVertex>(aState.attribs + attribCount, 0, vertexLocations);
+		}
+		else if (aPositionStream)
+		{
+			aState.bindings[bindingCount++] = vertex_binding<PositionVertex>(0);
+			attribCount += vertex_attributes<PositionVertex>(aState.attribs + attribCount, 0);
+		}
+		else
+		{
+			aState.bindings[bindingCount++] = vertex_binding<InterleavedVertex>(0);
+			attribCount += vertex_attributes<InterleavedVertex>(aState.attribs + attribCount, 0, vertexLocations);
+		}
+
+		//per-mesh bounds (and material) of the quantized vertices; just the
+		//material for visibility.vert. firstInstance selects the mesh.
+		if (aQuantized || aMeshInstances)
+		{
+			std::uint32_t const instanceLocations = !aQuantized ? vertex_locations(6)
+				: aPositionsOnly ? vertex_locations(4, 5) : vertex_locations(4, 5, 6);
+
+			aState.bindings[bindingCount++] = vertex_binding<MeshInstance>(1, VK_VERTEX_INPUT_RATE_INSTANCE);
+			attribCount += vertex_attributes<MeshInstance>(aState.attribs + attribCount, 1, instanceLocations);
+		}
+		assert(bindingCount <= std::size(aState.bindings) && attribCount <= std::size(aState.attribs));
+
+		aState.info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		aState.info.vertexBindingDescriptionCount = bindingCount;
+		aState.info.pVertexBindingDescriptions = aState.bindings;
+		aState.info.vertexAttributeDescriptionCount = attribCount;
+		aState.info.pVertexAttributeDescriptions = aState.attribs;
+	}
+
+	lut::Pipeline create_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, lut::PipelineLinker& aLinker, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader, bool aDepthPrepass, bool aQuantizedVertices, VkSpecializationInfo const* aFragSpecialization, std::uint32_t aColorAttachments, bool aMeshInstances, bool aShadingRate, VkSampleCountFlagBits aSamples, bool aVertexPulling, VkPipelineCreateFlags aFlags)
 	{
 		//TODO: implement me!
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kVertShaderPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kFragShaderPath);
+		VkShaderModule const vert = aShaderModules.get(aVertShader);
+		VkShaderModule const frag = aShaderModules.get(aFragShader);
+
+		//Define shader stages in the pipeline
+		VkPipelineShaderStageCreateInfo stages[2]{};
+		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		stages[0].module = vert;
+		stages[0].pName = "main";
+
+		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		stages[1].module = frag;
+		stages[1].pName = "main";
+		stages[1].pSpecializationInfo = aFragSpecialization;
+
+		//define depth and stencil state
+		//(after a depth pre-pass, the depth buffer already holds the nearest
+		//opaque surface; only shade that)
+		VkPipelineDepthStencilStateCreateInfo depthInfo{};
+		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthInfo.depthTestEnable = VK_TRUE;
+		depthInfo.depthWriteEnable = aDepthPrepass ? VK_FALSE : VK_TRUE;
+		depthInfo.depthCompareOp = aDepthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_GREATER_OR_EQUAL;
+		depthInfo.minDepthBounds = 0.f;
+		depthInfo.maxDepthBounds = 1.f;
+
+		VertexInputState inputState;
+		fill_vertex_input(inputState, aQuantizedVertices, false, aMeshInstances, false, aVertexPulling);
+
+		// Define which primitive (point, line, triangle, ...) the input is
+		// assembled into for rasterization. 
+		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		assemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+		//Viewport and scissor are dynamic (set by record_scene_draws()), so
+		//that the pipeline does not depend on the swapchain size
+		VkPipelineViewportStateCreateInfo viewportInfo{};
+		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportInfo.viewportCount = 1;
+		viewportInfo.scissorCount = 1;
+
+		VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicInfo{};
+		dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+		dynamicInfo.pDynamicStates = dynamicStates;
+
+		//Define rasterization options
+		VkPipelineRasterizationStateCreateInfo rasterInfo{};
+		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterInfo.depthClampEnable = VK_FALSE;
+		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rasterInfo.depthBiasEnable = VK_FALSE;
+		rasterInfo.lineWidth = 1.f;
+
+		//Define multisampling state
+		VkPipelineMultisampleStateCreateInfo samplingInfo{};
+		samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		samplingInfo.rasterizationSamples = aSamples;
+
+		// Define blend state
+		// We define one blend state per color attachment - this example uses a
+		// single color attachment, so we only need one. Right now, we dont do any
+		// blending, so we can ignore most of the members.
+		VkPipelineColorBlendAttachmentState blendStates[kGBufferColorAttachments]{};
+		assert(aColorAttachments <= kGBufferColorAttachments);
+		for (std::uint32_t i = 0; i < aColorAttachments; ++i)
+		{
+			blendStates[i].blendEnable = VK_FALSE;
+			blendStates[i].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		}
+
+		VkPipelineColorBlendStateCreateInfo blendInfo{};
+		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		blendInfo.logicOpEnable = VK_FALSE;
+		blendInfo.attachmentCount = aColorAttachments;
+		blendInfo.pAttachments = blendStates;
+
+		//Create pipeline
+		VkGraphicsPipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipeInfo.stageCount = 2; // vert + frag stages
+		pipeInfo.pStages = stages;
+		pipeInfo.pVertexInputState = &inputState.info;
+		pipeInfo.pInputAssemblyState = &assemblyInfo;
+		pipeInfo.pTessellationState = nullptr;  // no tesselation
+		pipeInfo.pViewportState = &viewportInfo;
+		pipeInfo.pRasterizationState = &rasterInfo;
+		pipeInfo.pMultisampleState = &samplingInfo;
+		pipeInfo.pDepthStencilState = &depthInfo;
+		pipeInfo.pColorBlendState = &blendInfo;
+		pipeInfo.pDynamicState = &dynamicInfo;
+
+		pipeInfo.flags = aFlags;
+		pipeInfo.layout = aPipelineLayout;
+		pipeInfo.renderPass = aRenderPass;
+		pipeInfo.subpass = aDepthPrepass ? 1 : 0;  // colour subpass of aRenderPass
+
+		//the attachment's rate replaces the pipeline's (1x1)
+		VkPipelineFragmentShadingRateStateCreateInfoKHR rateInfo{};
+		rateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR;
+		rateInfo.fragmentSize = VkExtent2D{ 1, 1 };
+		rateInfo.combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+		rateInfo.combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+		if (aShadingRate)
+			pipeInfo.pNext = &rateInfo;
+
+		//from the linker's libraries, if it has them; the vertex input,
+		//pre-rasterization and output parts are shared by the variants
+		return aLinker.create(pipeInfo);
+	}
+
+	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, lut::PipelineLinker& aLinker, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, char const* aFragShader, bool aDepthPrepass, bool aQuantizedVertices, VkSpecializationInfo const* aFragSpecialization, std::uint32_t aColorAttachments, bool aMeshInstances, bool aShadingRate, VkSampleCountFlagBits aSamples, bool aVertexPulling, VkPipelineCreateFlags aFlags)
+	{
+		VkShaderModule const vert = aShaderModules.get(aVertShader);
+		VkShaderModule const frag = aShaderModules.get(aFragShader);
 
 		//Define shader stages in the pipeline
 		VkPipelineShaderStageCreateInfo stages[2]{};
 		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
+		stages[0].module = vert;
+		stages[0].pName = "main";
+
+		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		stages[1].module = frag;
+		stages[1].pName = "main";
+		stages[1].pSpecializationInfo = aFragSpecialization;
+
+		//define depth and stencil state
+		VkPipelineDepthStencilStateCreateInfo depthInfo{};
+		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthInfo.depthTestEnable = VK_TRUE;
+		depthInfo.depthWriteEnable = VK_TRUE;
+		depthInfo.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+		depthInfo.minDepthBounds = 0.f;
+		depthInfo.maxDepthBounds = 1.f;
+
+		VertexInputState inputState;
+		fill_vertex_input(inputState, aQuantizedVertices, false, aMeshInstances, false, aVertexPulling);
+
+
+		// Define which primitive (point, line, triangle, ...) the input is
+		// assembled into for rasterization.
+		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		assemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+		//Viewport and scissor are dynamic (set by record_scene_draws()), so
+		//that the pipeline does not depend on the swapchain size
+		VkPipelineViewportStateCreateInfo viewportInfo{};
+		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportInfo.viewportCount = 1;
+		viewportInfo.scissorCount = 1;
+
+		VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicInfo{};
+		dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+		dynamicInfo.pDynamicStates = dynamicStates;
+
+		//Define rasterization options
+		VkPipelineRasterizationStateCreateInfo rasterInfo{};
+		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterInfo.depthClampEnable = VK_FALSE;
+		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		rasterInfo.depthBiasEnable = VK_FALSE;
+		rasterInfo.lineWidth = 1.f;
+
+		//Define multisampling state
+		VkPipelineMultisampleStateCreateInfo samplingInfo{};
+		samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		samplingInfo.rasterizationSamples = aSamples;
+		//the sharpened alpha (see kAlphaToCoverage) becomes the sample mask
+		samplingInfo.alphaToCoverageEnable = aSamples > VK_SAMPLE_COUNT_1_BIT ? VK_TRUE : VK_FALSE;
+
+
+		VkPipelineColorBlendAttachmentState blendStates[kGBufferColorAttachments]{};
+		assert(aColorAttachments <= kGBufferColorAttachments);
+		for (std::uint32_t i = 0; i < aColorAttachments; ++i)
+		{
+			blendStates[i].blendEnable = VK_FALSE;
+			//blendStates[i].colorBlendOp = VK_BLEND_OP_ADD;
+			//blendStates[i].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			//blendStates[i].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			blendStates[i].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		}
+
+		VkPipelineColorBlendStateCreateInfo blendInfo{};
+		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		blendInfo.logicOpEnable = VK_FALSE;
+		blendInfo.attachmentCount = aColorAttachments;
+		blendInfo.pAttachments = blendStates;
+
+		//Create pipeline
+		VkGraphicsPipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+
+		pipeInfo.stageCount = 2; // vert + frag
+		pipeInfo.pStages = stages;
+
+		pipeInfo.pVertexInputState = &inputState.info;
+		pipeInfo.pInputAssemblyState = &assemblyInfo;
+		pipeInfo.pTessellationState = nullptr;  // no tesselation
+		pipeInfo.pViewportState = &viewportInfo;
+		pipeInfo.pRasterizationState = &rasterInfo;
+		pipeInfo.pMultisampleState = &samplingInfo;
+		pipeInfo.pDepthStencilState = &depthInfo;
+		pipeInfo.pColorBlendState = &blendInfo;
+		pipeInfo.pDynamicState = &dynamicInfo;
+
+		pipeInfo.flags = aFlags;
+		pipeInfo.layout = aPipelineLayout;
+		pipeInfo.renderPass = aRenderPass;
+		pipeInfo.subpass = aDepthPrepass ? 1 : 0;  // colour subpass of aRenderPass
+
+		//the attachment's rate replaces the pipeline's (1x1)
+		VkPipelineFragmentShadingRateStateCreateInfoKHR rateInfo{};
+		rateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR;
+		rateInfo.fragmentSize = VkExtent2D{ 1, 1 };
+		rateInfo.combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+		rateInfo.combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+		if (aShadingRate)
+			pipeInfo.pNext = &rateInfo;
+
+		return aLinker.create(pipeInfo);
+	}
+
+	lut::Pipeline create_depth_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, bool aQuantizedVertices, VkSampleCountFlagBits aSamples,
+		char const* aAlphaFragShader, bool aPositionStream, VkPipelineCreateFlags aFlags)
+	{
+		bool const alpha = nullptr != aAlphaFragShader;
+		VkShaderModule const vert = aShaderModules.get(alpha
+			? (aQuantizedVertices ? cfg::kDepthAlphaQuantizedVertShaderPath : cfg::kDepthAlphaVertShaderPath)
+			: (aQuantizedVertices ? cfg::kDepthQuantizedVertShaderPath : cfg::kDepthVertShaderPath));
+		VkShaderModule const frag = alpha ? aShaderModules.get(aAlphaFragShader) : VK_NULL_HANDLE;
+
+		//Vertex stage only, unless alpha tested; depth comes from the
+		//fixed-function tests
+		VkPipelineShaderStageCreateInfo stages[2]{};
+		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		stages[0].module = vert;
 		stages[0].pName = "main";
 
 		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
+		stages[1].module = frag;
 		stages[1].pName = "main";
 
-		//define depth and stencil state
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
+		//Only the positions (and their bounds) are fetched from the vertices,
+		//and the texture coordinates (and material) for the alpha test
+		VertexInputState inputState;
+		fill_vertex_input(inputState, aQuantizedVertices, !alpha, false, aPositionStream && !alpha);
 
-
-		VkVertexInputBindingDescription vertexInputs[1]{};
-		//textured meshes
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 12;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		VkVertexInputAttributeDescription vertexAttribs[4]{};
-
-		//positions
-		vertexAttribs[0].binding = 0; // must match binding above
-		vertexAttribs[0].location = 0; // must match shader
-		vertexAttribs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttribs[0].offset = 0;
-
-		////texcoords
-		vertexAttribs[1].binding = 0;
-		vertexAttribs[1].location = 1;
-		vertexAttribs[1].format = VK_FORMAT_R32G32_SFLOAT;
-		vertexAttribs[1].offset = sizeof(float) * 3;
-
-		//normals
-		vertexAttribs[2].binding = 0;
-		vertexAttribs[2].location = 2;
-		vertexAttribs[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttribs[2].offset = sizeof(float) * 5;
-
-		//tangent
-		vertexAttribs[3].binding = 0;
-		vertexAttribs[3].location = 3;
-		vertexAttribs[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		vertexAttribs[3].offset = sizeof(float) * 8;
-
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 1;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 4;
-		inputInfo.pVertexAttributeDescriptions = vertexAttribs;
-
-		// Define which primitive (point, line, triangle, ...) the input is
-		// assembled into for rasterization. 
 		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
 		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		assemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-		//Define viewport and scissor regions
-		VkViewport viewport{};
-		viewport.x = 0.f;
-		viewport.y = 0.f;
-		viewport.width = static_cast<float>(aWindow.swapchainExtent.width);
-		viewport.height = static_cast<float>(aWindow.swapchainExtent.height);
-		viewport.minDepth = 0.f;
-		viewport.maxDepth = 1.f;
-
-		VkRect2D scissor{};
-		scissor.offset = VkOffset2D{ 0,0 };
-		scissor.extent = aWindow.swapchainExtent;
-
+		//Viewport and scissor are dynamic (set by record_scene_draws()), so
+		//that the pipeline does not depend on the swapchain size
 		VkPipelineViewportStateCreateInfo viewportInfo{};
 		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
 		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
 
-		//Define rasterization options
+		VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicInfo{};
+		dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+		dynamicInfo.pDynamicStates = dynamicStates;
+
+		//Must match create_pipeline(), so that the colour pass finds the
+		//same depths
 		VkPipelineRasterizationStateCreateInfo rasterInfo{};
 		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		rasterInfo.depthClampEnable = VK_FALSE;
@@ -766,411 +4790,1290 @@ namespace
 		rasterInfo.depthBiasEnable = VK_FALSE;
 		rasterInfo.lineWidth = 1.f;
 
-		//Define multisampling state
 		VkPipelineMultisampleStateCreateInfo samplingInfo{};
 		samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		samplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		samplingInfo.rasterizationSamples = aSamples;
 
-		// Define blend state
-		// We define one blend state per color attachment - this example uses a
-		// single color attachment, so we only need one. Right now, we dont do any
-		// blending, so we can ignore most of the members.
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkPipelineDepthStencilStateCreateInfo depthInfo{};
+		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthInfo.depthTestEnable = VK_TRUE;
+		depthInfo.depthWriteEnable = VK_TRUE;
+		depthInfo.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+		depthInfo.minDepthBounds = 0.f;
+		depthInfo.maxDepthBounds = 1.f;
 
+		//No colour attachments in the pre-pass subpass
 		VkPipelineColorBlendStateCreateInfo blendInfo{};
 		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 		blendInfo.logicOpEnable = VK_FALSE;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
+		blendInfo.attachmentCount = 0;
+		blendInfo.pAttachments = nullptr;
 
-		//Create pipeline
 		VkGraphicsPipelineCreateInfo pipeInfo{};
 		pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipeInfo.stageCount = 2; // vert + frag stages
+		pipeInfo.stageCount = alpha ? 2 : 1; // vert (and frag)
 		pipeInfo.pStages = stages;
-		pipeInfo.pVertexInputState = &inputInfo;
+		pipeInfo.pVertexInputState = &inputState.info;
 		pipeInfo.pInputAssemblyState = &assemblyInfo;
-		pipeInfo.pTessellationState = nullptr;  // no tesselation
+		pipeInfo.pTessellationState = nullptr;
 		pipeInfo.pViewportState = &viewportInfo;
 		pipeInfo.pRasterizationState = &rasterInfo;
 		pipeInfo.pMultisampleState = &samplingInfo;
 		pipeInfo.pDepthStencilState = &depthInfo;
 		pipeInfo.pColorBlendState = &blendInfo;
-		pipeInfo.pDynamicState = nullptr;   // no dynamic states
+		pipeInfo.pDynamicState = &dynamicInfo;
 
+		pipeInfo.flags = aFlags;
 		pipeInfo.layout = aPipelineLayout;
 		pipeInfo.renderPass = aRenderPass;
-		pipeInfo.subpass = 0;  // first subpass of aRenderPass
+		pipeInfo.subpass = 0;  // pre-pass subpass
 
 		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
 		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
+			throw lut::Error("Unable to create depth pre-pass pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
 		}
 
-		return lut::Pipeline(aWindow.device, pipe);
+		lut::Pipeline ret(aWindow.device, pipe);
+		lut::set_name(aWindow, ret, alpha ? "depth pre-pass alpha pipeline" : "depth pre-pass pipeline");
+		return ret;
 	}
 
-	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	lut::Pipeline create_shadow_pipeline(lut::VulkanWindow const& aWindow, ShadowCache const& aShadows, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, bool aQuantizedVertices, char const* aAlphaFragShader, bool aPositionStream, VkPipelineCreateFlags aFlags)
 	{
-		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kVertShaderPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kFragShaderPath);
+		bool const alpha = nullptr != aAlphaFragShader;
+		VkShaderModule const vert = aShaderModules.get(alpha
+			? (aQuantizedVertices ? cfg::kShadowAlphaQuantizedVertShaderPath : cfg::kShadowAlphaVertShaderPath)
+			: (aQuantizedVertices ? cfg::kShadowQuantizedVertShaderPath : cfg::kShadowVertShaderPath));
+		VkShaderModule const frag = alpha ? aShaderModules.get(aAlphaFragShader) : VK_NULL_HANDLE;
 
-		//Define shader stages in the pipeline
 		VkPipelineShaderStageCreateInfo stages[2]{};
 		stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		stages[0].module = vert.handle;
+		stages[0].module = vert;
 		stages[0].pName = "main";
 
 		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		stages[1].module = frag.handle;
+		stages[1].module = frag;
 		stages[1].pName = "main";
 
-		
-		//We are reading from two separate buffers, therefore use two VkVertexInputBindingDescription instances :
-		VkVertexInputBindingDescription vertexInputs[1]{};
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 12;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-
-		VkVertexInputAttributeDescription vertexAttribs[4]{};
-
-		//positions
-		vertexAttribs[0].binding = 0; // must match binding above
-		vertexAttribs[0].location = 0; // must match shader
-		vertexAttribs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttribs[0].offset = 0;
-
-		////texcoords
-		vertexAttribs[1].binding = 0;
-		vertexAttribs[1].location = 1;
-		vertexAttribs[1].format = VK_FORMAT_R32G32_SFLOAT;
-		vertexAttribs[1].offset = sizeof(float) * 3;
-
-		//normals
-		vertexAttribs[2].binding = 0;
-		vertexAttribs[2].location = 2;
-		vertexAttribs[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttribs[2].offset = sizeof(float) * 5;
-
-		//tangent
-		vertexAttribs[3].binding = 0;
-		vertexAttribs[3].location = 3;
-		vertexAttribs[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		vertexAttribs[3].offset = sizeof(float) * 8;
-
-		//define depth and stencil state
-		VkPipelineDepthStencilStateCreateInfo depthInfo{};
-		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthInfo.depthTestEnable = VK_TRUE;
-		depthInfo.depthWriteEnable = VK_TRUE;
-		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthInfo.minDepthBounds = 0.f;
-		depthInfo.maxDepthBounds = 1.f;
-
+		VertexInputState inputState;
+		fill_vertex_input(inputState, aQuantizedVertices, !alpha, false, aPositionStream && !alpha);
 
-		VkPipelineVertexInputStateCreateInfo inputInfo{};
-		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 1;
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 4;
-		inputInfo.pVertexAttributeDescriptions = vertexAttribs;
-
-
-		// Define which primitive (point, line, triangle, ...) the input is
-		// assembled into for rasterization.
 		VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
 		assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		assemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-		//Define viewport and scissor regions
-		VkViewport viewport{};
-		viewport.x = 0.f;
-		viewport.y = 0.f;
-		viewport.width = aWindow.swapchainExtent.width;
-		viewport.height = aWindow.swapchainExtent.height;
-		viewport.minDepth = 0.f;
-		viewport.maxDepth = 1.f;
-
-		VkRect2D scissor{};
-		scissor.offset = VkOffset2D{ 0,0 };
-		scissor.extent = aWindow.swapchainExtent;
-
 		VkPipelineViewportStateCreateInfo viewportInfo{};
 		viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportInfo.viewportCount = 1;
-		viewportInfo.pViewports = &viewport;
 		viewportInfo.scissorCount = 1;
-		viewportInfo.pScissors = &scissor;
 
-		//Define rasterization options
+		VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicInfo{};
+		dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+		dynamicInfo.pDynamicStates = dynamicStates;
+
+		//No culling: the faces' projections don't flip y, so their winding
+		//is the opposite of the camera's, and Sponza's thin walls must cast
+		//shadows from both sides. The slope-scaled bias keeps the lit
+		//surfaces from shadowing themselves.
 		VkPipelineRasterizationStateCreateInfo rasterInfo{};
 		rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		rasterInfo.depthClampEnable = VK_FALSE;
 		rasterInfo.rasterizerDiscardEnable = VK_FALSE;
 		rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+		rasterInfo.cullMode = VK_CULL_MODE_NONE;
 		rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterInfo.depthBiasEnable = VK_FALSE;
+		rasterInfo.depthBiasEnable = VK_TRUE;
+		rasterInfo.depthBiasConstantFactor = 1.f;
+		rasterInfo.depthBiasSlopeFactor = 1.5f;
 		rasterInfo.lineWidth = 1.f;
 
-		//Define multisampling state
 		VkPipelineMultisampleStateCreateInfo samplingInfo{};
 		samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 		samplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-
-		VkPipelineColorBlendAttachmentState blendStates[1]{};
-		blendStates[0].blendEnable = VK_FALSE;
-		//blendStates[0].colorBlendOp = VK_BLEND_OP_ADD;
-		//blendStates[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-		//blendStates[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-		blendStates[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkPipelineDepthStencilStateCreateInfo depthInfo{};
+		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthInfo.depthTestEnable = VK_TRUE;
+		depthInfo.depthWriteEnable = VK_TRUE;
+		depthInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		depthInfo.minDepthBounds = 0.f;
+		depthInfo.maxDepthBounds = 1.f;
 
 		VkPipelineColorBlendStateCreateInfo blendInfo{};
 		blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 		blendInfo.logicOpEnable = VK_FALSE;
-		blendInfo.attachmentCount = 1;
-		blendInfo.pAttachments = blendStates;
+		blendInfo.attachmentCount = 0;
+		blendInfo.pAttachments = nullptr;
 
-		//Create pipeline
 		VkGraphicsPipelineCreateInfo pipeInfo{};
 		pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-
-		pipeInfo.stageCount = 2; // vert + frag
+		pipeInfo.stageCount = alpha ? 2 : 1; // vert (and frag)
 		pipeInfo.pStages = stages;
-
-		pipeInfo.pVertexInputState = &inputInfo;
+		pipeInfo.pVertexInputState = &inputState.info;
 		pipeInfo.pInputAssemblyState = &assemblyInfo;
-		pipeInfo.pTessellationState = nullptr;  // no tesselation
+		pipeInfo.pTessellationState = nullptr;
 		pipeInfo.pViewportState = &viewportInfo;
 		pipeInfo.pRasterizationState = &rasterInfo;
 		pipeInfo.pMultisampleState = &samplingInfo;
 		pipeInfo.pDepthStencilState = &depthInfo;
 		pipeInfo.pColorBlendState = &blendInfo;
-		pipeInfo.pDynamicState = nullptr;   // no dynamic states
+		pipeInfo.pDynamicState = &dynamicInfo;
 
-		pipeInfo.layout = aPipelineLayout;
-		pipeInfo.renderPass = aRenderPass;
-		pipeInfo.subpass = 0;  // first subpass of aRenderPass
+		pipeInfo.flags = aFlags;
+		pipeInfo.layout = aShadows.pipeLayout.handle;
+		pipeInfo.renderPass = aShadows.renderPass.handle;
+		pipeInfo.subpass = 0;
 
 		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create shadow pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
+		}
+
+		lut::Pipeline ret(aWindow.device, pipe);
+		lut::set_name(aWindow, ret, alpha ? "shadow alpha pipeline" : "shadow pipeline");
+		return ret;
+	}
+
+
+	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkFormat aFormat, bool aSampled, bool aInputAttachment)
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = aFormat;
+		imgInfo.extent.width = aWindow.swapchainExtent.width;
+		imgInfo.extent.height = aWindow.swapchainExtent.height;
+		imgInfo.extent.depth = 1;
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = 1;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (aSampled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) | (aInputAttachment ? VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT : 0);
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		// As create_transient_attachment(): desktop GPUs have no lazily
+		// allocated memory, and get regular device memory instead
+		lut::Image depthImage;
+		if (!aSampled)
+		{
+			VmaAllocationCreateInfo allocInfo{};
+			allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+			VkImage image = VK_NULL_HANDLE;
+			VmaAllocation allocation = VK_NULL_HANDLE;
+			if (VK_SUCCESS == vmaCreateImage(aAllocator.allocator, &imgInfo, &allocInfo, &image, &allocation, nullptr))
+			{
+				lut::tag_allocation(aAllocator.allocator, allocation, lut::EMemoryClass::renderTargets);
+				depthImage = lut::Image(aAllocator.allocator, image, allocation);
+			}
+		}
+		if (VK_NULL_HANDLE == depthImage.image)
+			depthImage = lut::create_image(aAllocator, imgInfo, lut::EMemoryClass::renderTargets);
+
+		//create the image view
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = depthImage.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = aFormat;
+		viewInfo.components = VkComponentMapping{}; //identity
+		viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if (auto const res = vkCreateImageView(aWindow.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str());
+		}
+
+		lut::ImageView depthView(aWindow.device, view);
+		lut::set_name(aWindow, depthImage, "depth buffer");
+		lut::set_name(aWindow, depthView, "depth buffer");
+
+		return { std::move(depthImage), std::move(depthView) };
+	}
+
+	void create_swapchain_framebuffers(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, std::vector<lut::Framebuffer>& aFramebuffers, VkImageView aDepthView, GBuffer const* aGBuffer, VisibilityBuffer const* aVisibility, VkImageView aShadingRateView, VkImageView aColourView, MsaaTargets const* aMsaa, StereoTargets const* aStereo)
+	{
+		assert(aFramebuffers.empty());
+
+		//TODO- (Section 1/Exercise 3) implement me!
+		for (std::size_t i = 0; i < aWindow.swapViews.size(); ++i)
+		{
+			VkImageView attachments[3 + kGBufferColorAttachments] = { VK_NULL_HANDLE != aColourView ? aColourView : aWindow.swapViews[i], aDepthView };
+			if (aGBuffer)
+			{
+				attachments[2] = aGBuffer->albedoView.handle;
+				attachments[3] = aGBuffer->normalView.handle;
+			}
+			if (aVisibility)
+				attachments[2] = aVisibility->idsView.handle;
+			if (aMsaa)
+			{
+				attachments[2] = aMsaa->colourView.handle;
+				attachments[3] = aMsaa->depthView.handle;
+			}
+			if (aStereo)
+			{
+				attachments[0] = aStereo->colourView.handle;
+				attachments[1] = aStereo->depthView.handle;
+			}
+
+			VkFramebufferCreateInfo fbInfo{};
+			fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			fbInfo.flags = 0;
+			fbInfo.renderPass = aRenderPass;
+			fbInfo.attachmentCount = aGBuffer || aMsaa ? 2 + kGBufferColorAttachments : (aVisibility ? 3 : 2);
+
+			//the shading rate image is the last attachment (forward only)
+			if (VK_NULL_HANDLE != aShadingRateView)
+				attachments[fbInfo.attachmentCount++] = aShadingRateView;
+			fbInfo.pAttachments = attachments;
+			//multiview draws the layers by view index; the framebuffer has one
+			fbInfo.width = aStereo ? aStereo->extent.width : aWindow.swapchainExtent.width;
+			fbInfo.height = aStereo ? aStereo->extent.height : aWindow.swapchainExtent.height;
+			fbInfo.layers = 1;
+			VkFramebuffer fb = VK_NULL_HANDLE;
+			if (auto const res = vkCreateFramebuffer(aWindow.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to create framebuffer for swap chain image %zu\n" "vkCreateFramebuffer returned %s", i, lut::to_string(res).c_str());
+			}
+
+			aFramebuffers.emplace_back(lut::Framebuffer(aWindow.device, fb));
+			lut::set_name(aWindow, aFramebuffers.back(), ("framebuffer " + std::to_string(i)).c_str());
+		}
+		assert(aWindow.swapViews.size() == aFramebuffers.size());
+	}
+
+	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const& aWindow, bool aRayShadows, bool aDescriptorBuffer)
+	{
+		VkDescriptorSetLayoutBinding bindings[15]{};
+		bindings[0].binding = 0; // number must match the index of the corresponding binding = N declaration in the shader(s)
+
+		//descriptor buffers can't have dynamic offsets; there is a set per
+		//uniform slot instead (see DescriptorBufferSets)
+		bindings[0].descriptorCount = 1;
+		bindings[0].descriptorType = aDescriptorBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+		//point lights and their cluster grid (see clusters.hpp); the
+		//clustering pass uses the same set
+		bindings[1].binding = 1;
+		bindings[1].descriptorCount = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[2].binding = 2;
+		bindings[2].descriptorCount = 1;
+		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+		//mip feedback of the colour pass (see texture_streaming.hpp)
+		bindings[3].binding = 3;
+		bindings[3].descriptorCount = 1;
+		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//the light's shadow cube (see shadows.hpp)
+		bindings[4].binding = 4;
+		bindings[4].descriptorCount = 1;
+		bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[4].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//image-based lighting: SH irradiance, specular cube and BRDF LUT
+		//(see ibl.hpp)
+		bindings[5].binding = 5;
+		bindings[5].descriptorCount = 1;
+		bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		bindings[5].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		bindings[6].binding = 6;
+		bindings[6].descriptorCount = 1;
+		bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[6].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		bindings[7].binding = 7;
+		bindings[7].descriptorCount = 1;
+		bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[7].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//the tabulated specular distribution (see distribution_lut.hpp)
+		bindings[8].binding = 8;
+		bindings[8].descriptorCount = 1;
+		bindings[8].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[8].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//the model's instance transforms (see set_model_instances())
+		bindings[9].binding = 9;
+		bindings[9].descriptorCount = 1;
+		bindings[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[9].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		//the model's baked ambient occlusion (see ModelPack::occlusion)
+		bindings[10].binding = 10;
+		bindings[10].descriptorCount = 1;
+		bindings[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[10].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		//tile residency of the virtual textures (see virtual_textures.hpp)
+		bindings[11].binding = 11;
+		bindings[11].descriptorCount = 1;
+		bindings[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[11].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//the model's vertices, for vertex pulling (see vertex_pulling.glsl);
+		//only written with --vertex-input=pulled
+		bindings[12].binding = 12;
+		bindings[12].descriptorCount = 1;
+		bindings[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[12].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		//fragment cost counters of the debug views (see debug_views.hpp)
+		bindings[13].binding = 14;
+		bindings[13].descriptorCount = 1;
+		bindings[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[13].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//the TLAS of ray-query shadows (see ray_shadows.hpp); only with
+		//aRayShadows (the descriptor type needs the extension), and so last
+		bindings[14].binding = 13;
+		bindings[14].descriptorCount = 1;
+		bindings[14].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+		bindings[14].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.flags = aDescriptorBuffer ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]) - (aRayShadows ? 0 : 1);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
 		{
-			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
+			throw lut::Error("Unable to create decriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
 		}
+		return lut::DescriptorSetLayout(aWindow.device, layout);
 
-		return lut::Pipeline(aWindow.device, pipe);
 	}
 
+	void update_vertex_descriptor(lut::VulkanWindow const& aWindow, VkDescriptorSet aSceneDescriptors, ModelPack const& aModel)
+	{
+		VkDescriptorBufferInfo verticesInfo{};
+		verticesInfo.buffer = aModel.vertices.buffer;
+		verticesInfo.range = lut::descriptor_range(aModel.vertices);
+
+		VkWriteDescriptorSet desc{};
+		desc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc.dstSet = aSceneDescriptors;
+		desc.dstBinding = 12;
+		desc.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc.descriptorCount = 1;
+		desc.pBufferInfo = &verticesInfo;
+
+		vkUpdateDescriptorSets(aWindow.device, 1, &desc, 0, nullptr);
+		if (aModel.descriptorBuffer)
+			write_scene_descriptors(*aModel.descriptorBuffer, 1, &desc);
+	}
+
+	DrawStats record_scene_draws(VkCommandBuffer aCmdBuff, bool aDepthOnly, std::uint32_t aPart, std::uint32_t aPartCount,
+		VkExtent2D const& aImageExtent, VkPipeline aGraphicsPipe, VkPipeline aSecondGraphicsPipe, VkPipeline aDepthPipe, VkPipeline aDepthAlphaPipe,
+		std::uint32_t aSceneOffset, VkPipelineLayout aGraphicsLayout, VkDescriptorSet aSceneDescriptors, ModelPack const& aModel,
+		DrawList const& aDrawList, FrameScopes const& aScopes, RenderSettings const& aSettings)
+	{
+		DrawStats stats{};
+
+		VkViewport viewport{};
+		viewport.x = 0.f;
+		viewport.y = 0.f;
+		viewport.width = static_cast<float>(aImageExtent.width);
+		viewport.height = static_cast<float>(aImageExtent.height);
+		viewport.minDepth = 0.f;
+		viewport.maxDepth = 1.f;
+		vkCmdSetViewport(aCmdBuff, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.offset = VkOffset2D{ 0, 0 };
+		scissor.extent = aImageExtent;
+		vkCmdSetScissor(aCmdBuff, 0, 1, &scissor);
+
+		// With a descriptor buffer, the bindless set is bound with the
+		// scene's (below, as the pipelines were created for both)
+		if (!aModel.descriptorBuffer)
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 0, 1, &aSceneDescriptors, 1, &aSceneOffset);
+
+		// All meshes live in the same vertex/index buffers; bind them once.
+		// Quantized vertices (and the visibility buffer) also need the
+		// per-mesh instance data. The index
+		// buffer holds a uint16 and a uint32 part; each batch binds the one it
+		// needs (see ModelPack::indices32Offset). With vertex pulling, the
+		// colour pipelines read the vertices from binding 12 of the scene's
+		// set instead.
+		if (aDepthOnly || !aSettings.vertexPulling)
+		{
+			VkBuffer const vertexBuffers[2] = { aModel.vertices.buffer, aModel.meshInstances.buffer };
+			VkDeviceSize const offsets[2]{};
+			vkCmdBindVertexBuffers(aCmdBuff, 0, VK_NULL_HANDLE != aModel.meshInstances.buffer ? 2 : 1, vertexBuffers, offsets);
+		}
+
+		VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+		auto const bind_indices = [&] (VkIndexType aType)
+		{
+			// Culled triangles are all uint32, in a single buffer
+			if (aDrawList.triangles)
+				aType = VK_INDEX_TYPE_UINT32;
+
+			if (boundIndexType == aType)
+				return;
+
+			if (aDrawList.triangles)
+			{
+				vkCmdBindIndexBuffer(aCmdBuff, aDrawList.triangles->indices.buffer, 0, aType);
+				boundIndexType = aType;
+				return;
+			}
+
+			VkDeviceSize const offset = VK_INDEX_TYPE_UINT16 == aType ? 0 : aModel.indices32Offset;
+			vkCmdBindIndexBuffer(aCmdBuff, aModel.indices.buffer, offset, aType);
+			boundIndexType = aType;
+		};
+
+		// Bindless: all materials are reachable through a single set; the
+		// shaders pick the material from the push constants (direct draws)
+		// or via gl_InstanceIndex (= firstInstance; indirect draws).
+		bool const bindless = EMaterialMode::bindless == aSettings.materialMode;
+		if (bindless && aModel.descriptorBuffer)
+		{
+			bind_descriptor_buffer_sets(aCmdBuff, *aModel.descriptorBuffer, aGraphicsLayout, aSceneOffset, aModel.bindlessSet);
+			++stats.materialBinds;
+		}
+		else if (bindless)
+		{
+			vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aModel.bindlessDescriptors, 0, nullptr);
+			++stats.materialBinds;
+		}
+
+		// Pushed only when they change; push constants stay valid across
+		// pipeline binds with the same layout.
+		std::uint32_t pushedMaterial = 0;
+		bool pushed = false;
+		auto const push_material = [&] (std::uint32_t aMaterial)
+		{
+			if (!bindless || (pushed && pushedMaterial == aMaterial))
+				return;
+
+			glsl::DrawPushConstants const push{ aMaterial };
+			vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+			pushedMaterial = aMaterial;
+			pushed = true;
+		};
+
+		// The depth pre-pass only reads the materials of the alpha-masked
+		// meshes; skip binding them for the others.
+		bool bindMaterials = !aDepthOnly;
+
+		// The draws are sorted by pipeline and then by material (see
+		// DrawBatch), so each material is bound at most once per pipeline.
+		// Consecutive batches with the same material (e.g., after culling
+		// emptied the ones in between) do not rebind it. Texture arrays only
+		// rebind when the set changes, and push the material otherwise.
+		bool const textureArrays = EMaterialMode::arrays == aSettings.materialMode;
+		std::uint32_t boundMaterial = ~std::uint32_t(0);
+		std::uint32_t boundSet = ~std::uint32_t(0);
+		auto const bind_material = [&] (std::uint32_t aMatID)
+		{
+			if (bindless || !bindMaterials || boundMaterial == aMatID)
+				return;
+
+			std::uint32_t const set = textureArrays ? aModel.materialSets[aMatID] : aMatID;
+			if (boundSet != set)
+			{
+				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aModel.matDecriptors[set], 0, nullptr);
+				boundSet = set;
+				++stats.materialBinds;
+			}
+
+			if (textureArrays)
+				vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, kMaterialPushOffset, sizeof(MaterialIndices), &aModel.arrayMaterials[aMatID]);
+			boundMaterial = aMatID;
+		};
+
+		auto const bind_pipeline = [&] (VkPipeline aPipe)
+		{
+			vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPipe);
+			++stats.pipelineBinds;
+		};
+
+		// This part's contiguous slice [first, end) of aCount items
+		auto const slice = [&] (std::size_t aCount)
+		{
+			return std::pair<std::size_t, std::size_t>{ aCount * aPart / aPartCount, aCount * (aPart + 1) / aPartCount };
+		};
+
+		// The commands were built at load time (see set_up_model()).
+		constexpr std::uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		auto const draw_range = [&] (std::uint32_t aFirst, std::uint32_t aCount)
+		{
+			VkDeviceSize const offset = VkDeviceSize(aFirst) * stride;
+			if (aSettings.multiDrawIndirect)
+			{
+				vkCmdDrawIndexedIndirect(aCmdBuff, aDrawList.commands, offset, aCount, stride);
+				++stats.draws;
+			}
+			else
+			{
+				for (std::uint32_t i = 0; i < aCount; ++i)
+					vkCmdDrawIndexedIndirect(aCmdBuff, aDrawList.commands, offset + VkDeviceSize(i) * stride, 1, stride);
+				stats.draws += aCount;
+			}
+		};
+
+		// Direct draws use the same (sorted) batches, with the CPU copy of
+		// the commands: one vkCmdDrawIndexed() per visible mesh.
+		auto const draw_direct = [&] (DrawBatch const& aBatch)
+		{
+			for (std::uint32_t c = aBatch.firstCommand; c < aBatch.firstCommand + aBatch.commandCount; ++c)
+			{
+				if (!aDrawList.meshVisible[aModel.drawCommandMeshes[c]])
+					continue;
+
+				bind_material(aBatch.matID);
+				bind_indices(aBatch.indexType);
+				push_material(aBatch.matID);
+
+				auto cmd = aModel.hostDrawCommands[c];
+				auto const mesh = aModel.drawCommandMeshes[c];
+				if (!aDrawList.meshLod.empty() && aDrawList.meshLod[mesh] > 0)
+				{
+					auto const& lod = aModel.meshes[mesh].lods[aDrawList.meshLod[mesh]];
+					cmd.firstIndex = lod.firstIndex;
+					cmd.indexCount = lod.indexCount;
+				}
+
+				lut::DebugLabel const label(*aScopes.context, aCmdBuff, aModel.meshNames[mesh].c_str());
+				if (aDrawList.occlusion)
+				{
+					VkConditionalRenderingBeginInfoEXT condInfo{};
+					condInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+					condInfo.buffer = aDrawList.occlusion->predicates.buffer;
+					condInfo.offset = VkDeviceSize(mesh) * sizeof(std::uint32_t);
+					vkCmdBeginConditionalRenderingEXT(aCmdBuff, &condInfo);
+				}
+				vkCmdDrawIndexed(aCmdBuff, cmd.indexCount, cmd.instanceCount, cmd.firstIndex, cmd.vertexOffset, cmd.firstInstance);
+				if (aDrawList.occlusion)
+					vkCmdEndConditionalRenderingEXT(aCmdBuff);
+				++stats.draws;
+			}
+		};
+
+		auto const draw_batches = [&] (DrawBatchList const& aBatches, std::uint32_t aFirstCount)
+		{
+			if (aBatches.empty())
+				return;
+
+			auto const [firstBatch, endBatch] = slice(aBatches.size());
+
+			if (EDrawMode::indirect != aSettings.drawMode)
+			{
+				for (std::size_t i = firstBatch; i < endBatch; ++i)
+					draw_direct(aBatches[i]);
+				return;
+			}
+
+			push_material(glsl::kMaterialFromInstance);
+
+			if (VK_NULL_HANDLE != aDrawList.counts)
+			{
+				// GPU culled: one draw per batch, the count comes from the GPU
+				for (std::size_t i = firstBatch; i < endBatch; ++i)
+				{
+					auto const& batch = aBatches[i];
+					bind_material(batch.matID);
+					bind_indices(batch.indexType);
+
+					lut::DebugLabel const label(*aScopes.context, aCmdBuff, aModel.materialNames[batch.matID].c_str());
+					VkDeviceSize const countOffset = VkDeviceSize(aFirstCount + i) * sizeof(std::uint32_t);
+					vkCmdDrawIndexedIndirectCount(aCmdBuff, aDrawList.commands, VkDeviceSize(batch.firstCommand) * stride,
+						aDrawList.counts, countOffset, batch.commandCount, stride);
+					++stats.draws;
+				}
+				return;
+			}
+
+			if (bindless || !bindMaterials)
+			{
+				// Batches are contiguous and sorted by index type: a single
+				// draw covers each run of batches with the same index type.
+				std::uint32_t const first = aBatches.front().firstCommand;
+				std::uint32_t const last = aBatches.back().firstCommand + aBatches.back().commandCount;
+
+				auto const [begin, end] = slice(last - first);
+				std::uint32_t const sliceBegin = first + std::uint32_t(begin);
+				std::uint32_t const sliceEnd = first + std::uint32_t(end);
+
+				for (std::size_t i = 0; i < aBatches.size(); )
+				{
+					std::size_t j = i + 1;
+					while (j < aBatches.size() && aBatches[j].indexType == aBatches[i].indexType)
+						++j;
+
+					std::uint32_t const runBegin = std::max(aBatches[i].firstCommand, sliceBegin);
+					std::uint32_t const runEnd = std::min(aBatches[j - 1].firstCommand + aBatches[j - 1].commandCount, sliceEnd);
+					if (runBegin < runEnd)
+					{
+						bind_indices(aBatches[i].indexType);
+						draw_range(runBegin, runEnd - runBegin);
+					}
+
+					i = j;
+				}
+				return;
+			}
 
-	std::tuple<lut::Image, lut::ImageView> create_depth_buffer(lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator)
-	{
-		VkImageCreateInfo imgInfo{};
-		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imgInfo.imageType = VK_IMAGE_TYPE_2D;
-		imgInfo.format = cfg::kDepthFormat;
-		imgInfo.extent.width = aWindow.swapchainExtent.width;
-		imgInfo.extent.height = aWindow.swapchainExtent.height;
-		imgInfo.extent.depth = 1;
-		imgInfo.mipLevels = 1;
-		imgInfo.arrayLayers = 1;
-		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imgInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			// One indirect draw per material
+			for (std::size_t i = firstBatch; i < endBatch; ++i)
+			{
+				bind_material(aBatches[i].matID);
+				bind_indices(aBatches[i].indexType);
 
-		VmaAllocationCreateInfo allocInfo{};
-		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		VkImage image = VK_NULL_HANDLE;
-		VmaAllocation allocation = VK_NULL_HANDLE;
+				lut::DebugLabel const label(*aScopes.context, aCmdBuff, aModel.materialNames[aBatches[i].matID].c_str());
+				draw_range(aBatches[i].firstCommand, aBatches[i].commandCount);
+			}
+		};
 
-		if (auto const res = vmaCreateImage(aAllocator.allocator, &imgInfo, &allocInfo, &image, &allocation, nullptr); VK_SUCCESS != res)
+		//Depth pre-pass: no shading. Alpha-masked meshes are alpha tested by
+		//their alpha coverage texture (aDepthAlphaPipe); without it, they are
+		//depth tested normally in the colour pass instead.
+		//Timestamps cannot be written by the primary command buffer in a
+		//subpass of secondary command buffers; the first and last parts
+		//write them instead.
+		auto const* profiler = aScopes.profiler;
+		bool const firstPart = 0 == aPart;
+		bool const lastPart = aPart + 1 == aPartCount;
+
+		if (aDepthOnly)
 		{
-			throw lut::Error("Unable to allocate depth buffer image.\n" "vmaCreateImage() returned %s", lut::to_string(res).c_str());
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "depth pre-pass");
+			if (profiler && firstPart)
+				profiler->begin_scope(aCmdBuff, aScopes.prepass);
+
+			//the opaque meshes only fetch positions, from their own stream
+			//(see ModelPack::positions); the alpha-masked ones also need the
+			//texture coordinates of the interleaved vertices
+			VkDeviceSize const zeroOffset = 0;
+			if (aSettings.positionStream)
+				vkCmdBindVertexBuffers(aCmdBuff, 0, 1, &aModel.positions.buffer, &zeroOffset);
+			bind_pipeline(aDepthPipe);
+			draw_batches(aDrawList.opaqueBatches, 0);
+
+			if (VK_NULL_HANDLE != aDepthAlphaPipe && !aDrawList.alphaBatches.empty())
+			{
+				bindMaterials = true;
+				if (aSettings.positionStream)
+					vkCmdBindVertexBuffers(aCmdBuff, 0, 1, &aModel.vertices.buffer, &zeroOffset);
+				bind_pipeline(aDepthAlphaPipe);
+				draw_batches(aDrawList.alphaBatches, std::uint32_t(aDrawList.opaqueBatches.size()));
+			}
+
+			if (profiler && lastPart)
+				profiler->end_scope(aCmdBuff, aScopes.prepass);
+			return stats;
 		}
 
-		lut::Image depthImage(aAllocator.allocator, image, allocation);
+		//Colour pass
+		lut::DebugLabel const label(*aScopes.context, aCmdBuff, "colour pass");
+		bool const perGroup = profiler && 1 == aPartCount;
+		if (profiler && firstPart)
+			profiler->begin_scope(aCmdBuff, aScopes.colour);
 
-		//create the image view
-		VkImageViewCreateInfo viewInfo{};
-		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		viewInfo.image = depthImage.image;
-		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		viewInfo.format = cfg::kDepthFormat;
-		viewInfo.components = VkComponentMapping{}; //identity
-		viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		if (perGroup)
+			profiler->begin_scope(aCmdBuff, aScopes.opaque);
+		{
+			lut::DebugLabel const opaqueLabel(*aScopes.context, aCmdBuff, "opaque");
+			bind_pipeline(aGraphicsPipe);
+			draw_batches(aDrawList.opaqueBatches, 0);
+		}
+		if (perGroup)
+		{
+			profiler->end_scope(aCmdBuff, aScopes.opaque);
+			profiler->begin_scope(aCmdBuff, aScopes.alpha);
+		}
+		{
+			//With the alpha-masked meshes in the pre-pass, the EQUAL depth
+			//test already masks them: no second alpha test
+			lut::DebugLabel const alphaLabel(*aScopes.context, aCmdBuff, "alpha-masked");
+			bind_pipeline(VK_NULL_HANDLE != aDepthAlphaPipe ? aGraphicsPipe : aSecondGraphicsPipe);
+			draw_batches(aDrawList.alphaBatches, std::uint32_t(aDrawList.opaqueBatches.size()));
+		}
+		if (perGroup)
+			profiler->end_scope(aCmdBuff, aScopes.alpha);
 
-		VkImageView view = VK_NULL_HANDLE;
-		if (auto const res = vkCreateImageView(aWindow.device, &viewInfo, nullptr, &view); VK_SUCCESS != res)
+		//Impostors last, in one part; they bind their own pipeline and sets
+		if (aDrawList.impostors && !aDrawList.impostorMeshes.empty() && lastPart)
 		{
-			throw lut::Error("Unable to create image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str());
+			lut::DebugLabel const impostorLabel(*aScopes.context, aCmdBuff, "impostors");
+			stats.draws += record_impostors(aCmdBuff, *aDrawList.impostors, aModel, aDrawList.impostorMeshes, aSceneDescriptors, aSceneOffset);
+			++stats.pipelineBinds;
 		}
 
-		return { std::move(depthImage), lut::ImageView(aWindow.device, view) };
+		if (profiler && lastPart)
+			profiler->end_scope(aCmdBuff, aScopes.colour);
+
+		return stats;
 	}
 
-	void create_swapchain_framebuffers(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, std::vector<lut::Framebuffer>& aFramebuffers, VkImageView aDepthView)
+	void record_secondary_draws(lut::VulkanContext const& aContext, FrameResources& aFrame, std::uint32_t aThreads, VkRenderPass aRenderPass, VkExtent2D const& aImageExtent, VkPipeline aGraphicsPipe, VkPipeline aSecondGraphicsPipe,
+		VkPipeline aDepthPipe, VkPipeline aDepthAlphaPipe, std::uint32_t aSceneOffset, VkPipelineLayout aGraphicsLayout, VkDescriptorSet aSceneDescriptors,
+		ModelPack const& aModel, DrawList const& aDrawList,
+		FrameScopes const& aScopes, RenderSettings const& aSettings)
 	{
-		assert(aFramebuffers.empty());
+		auto const partCount = std::uint32_t(aFrame.colourDraws.size());
+		lut::ArenaVector<DrawStats> partStats(partCount, DrawStats{}, lut::ArenaAllocator<DrawStats>(aFrame.arena));
 
-		//TODO- (Section 1/Exercise 3) implement me!
-		for (std::size_t i = 0; i < aWindow.swapViews.size(); ++i)
+		auto const record = [&] (VkCommandBuffer aCmdBuff, std::uint32_t aSubpass, bool aDepthOnly, std::uint32_t aPart)
 		{
-			VkImageView attachments[2] = { aWindow.swapViews[i], aDepthView };
-
-			VkFramebufferCreateInfo fbInfo{};
-			fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			fbInfo.flags = 0;
-			fbInfo.renderPass = aRenderPass;
-			fbInfo.attachmentCount = 2;
-			fbInfo.pAttachments = attachments;
-			fbInfo.width = aWindow.swapchainExtent.width;
-			fbInfo.height = aWindow.swapchainExtent.height;
-			fbInfo.layers = 1;
-			VkFramebuffer fb = VK_NULL_HANDLE;
-			if (auto const res = vkCreateFramebuffer(aWindow.device, &fbInfo, nullptr, &fb); VK_SUCCESS != res)
-			{
-				throw lut::Error("Unable to create framebuffer for swap chain image %zu\n" "vkCreateFramebuffer returned %s", i, lut::to_string(res).c_str());
-			}
-
-			aFramebuffers.emplace_back(lut::Framebuffer(aWindow.device, fb));
-		}
-		assert(aWindow.swapViews.size() == aFramebuffers.size());
-	}
+			// The framebuffer is left unspecified, so that the commands can
+			// be executed with any of the swapchain framebuffers.
+			VkCommandBufferInheritanceInfo inheritInfo{};
+			inheritInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritInfo.renderPass = aRenderPass;
+			inheritInfo.subpass = aSubpass;
+			inheritInfo.framebuffer = VK_NULL_HANDLE;
+
+			VkCommandBufferBeginInfo begInfo{};
+			begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			begInfo.pInheritanceInfo = &inheritInfo;
+
+			if (auto const res = vkBeginCommandBuffer(aCmdBuff, &begInfo); VK_SUCCESS != res)
+				throw lut::Error("Unable to begin recording secondary command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+
+			partStats[aPart] += record_scene_draws(aCmdBuff, aDepthOnly, aPart, partCount, aImageExtent, aGraphicsPipe, aSecondGraphicsPipe, aDepthPipe, aDepthAlphaPipe, aSceneOffset,
+				aGraphicsLayout, aSceneDescriptors, aModel, aDrawList, aScopes, aSettings);
+
+			if (auto const res = vkEndCommandBuffer(aCmdBuff); VK_SUCCESS != res)
+				throw lut::Error("Unable to end recording secondary command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+		};
 
-	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const& aWindow)
-	{
-		VkDescriptorSetLayoutBinding bindings[1]{};
-		bindings[0].binding = 0; // number must match the index of the corresponding binding = N declaration in the shader(s)
+		// Each job only touches its own pool and command buffers
+		bool const prepass = VK_NULL_HANDLE != aDepthPipe;
+		auto const job = [&] (std::size_t aJob)
+		{
+			LUT_CPU_ZONE("record_secondary_draws() job");
+			VkCommandPool const pool = aFrame.drawPools[aJob].handle;
+			if (auto const res = vkResetCommandPool(aContext.device, pool, 0); VK_SUCCESS != res)
+				throw lut::Error("Unable to reset draw command pool\n" "vkResetCommandPool() returned %s", lut::to_string(res).c_str());
 
-		bindings[0].descriptorCount = 1;
-		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+			auto const part = std::uint32_t(aJob);
+			if (prepass)
+				record(aFrame.depthDraws[aJob], 0, true, part);
 
-		VkDescriptorSetLayoutCreateInfo layoutInfo{};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
-		layoutInfo.pBindings = bindings;
+			record(aFrame.colourDraws[aJob], prepass ? 1 : 0, false, part);
+		};
+		lut::shared_jobs().parallel_for(partCount, job, aThreads);
 
-		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
-		{
-			throw lut::Error("Unable to create decriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
-		}
-		return lut::DescriptorSetLayout(aWindow.device, layout);
+		aFrame.drawStats = DrawStats{};
+		for (auto const& stats : partStats)
+			aFrame.drawStats += stats;
 
+		aFrame.drawsRecorded = true;
 	}
 
-	void record_commands(VkCommandBuffer aCmdBuff, VkRenderPass aRenderPass, VkFramebuffer aFramebuffer,
-		VkPipeline aGraphicsPipe, VkExtent2D const& aImageExtent, VkBuffer aSceneUBO, glsl::SceneUniform const& aSceneUniform,
-		VkPipelineLayout aGraphicsLayout, VkDescriptorSet aSceneDescriptors, ModelPack& aModel, VkPipeline aSecondGraphicsPipe, BakedModel& bakedModel)
+	DrawStats record_commands(VkCommandBuffer aCmdBuff, VkRenderPass aRenderPass, VkFramebuffer aFramebuffer,
+		VkPipeline aGraphicsPipe, VkExtent2D const& aImageExtent, std::uint32_t aSceneOffset,
+		VkPipelineLayout aGraphicsLayout, VkDescriptorSet aSceneDescriptors, ModelPack& aModel, VkPipeline aSecondGraphicsPipe, VkPipeline aDepthPipe, VkPipeline aDepthAlphaPipe,
+		DrawList const& aDrawList, GpuCuller const* aGpuCull, HizPyramid* aHiz, ShadingRate const* aShadingRate, LightClusters& aClusters, glm::mat4 const& aPrevProjCam, FrameScopes const& aScopes,
+		FrameResources const* aSecondaryDraws, RenderSettings const& aSettings, DeferredLighting const* aDeferred, VisibilityShading const* aVisibility, VkPipeline aLightingPipe, glsl::SceneUniform const& aSceneUniforms,
+		RenderTarget const* aRenderTarget, TemporalUpscale* aTemporal, StereoTargets const* aStereo, VkExtent2D const& aRenderExtent, VkImage aSwapImage, bool aOffscreen, VkBuffer aReadback,
+		MipFeedback* aMipFeedback, VirtualTextures* aVirtual, WorldStreaming* aWorld, std::uint32_t aFrame, Hud const* aHud, std::uint32_t aImageIndex,
+		ShadowCache const* aShadows, VkPipeline aShadowPipe, VkPipeline aShadowAlphaPipe, std::uint32_t aDevice, VideoStream* aStream, DebugViews const* aDebugViews, VkBuffer aLatchedUniforms)
 	{
+		LUT_CPU_ZONE("record_commands()");
 		//Begin recording commands
 		VkCommandBufferBeginInfo begInfo{};
 		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 		begInfo.pInheritanceInfo = nullptr;
 
+		//without a device mask, the commands run on every device of the
+		//group; the secondary command buffers inherit the mask
+		VkDeviceGroupCommandBufferBeginInfo deviceInfo{};
+		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_COMMAND_BUFFER_BEGIN_INFO;
+		if (kNoFrameDevice != aDevice)
+		{
+			deviceInfo.deviceMask = 1u << aDevice;
+			begInfo.pNext = &deviceInfo;
+		}
+
 		if (auto const res = vkBeginCommandBuffer(aCmdBuff, &begInfo); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to begin recording command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
 		}
 
-		//Upload scene uniforms
-		lut::buffer_barrier(aCmdBuff, aSceneUBO, VK_ACCESS_UNIFORM_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		//The scene uniforms were written by the host before submission; the
+		//submission makes them visible, no barrier is needed. Late-latched
+		//ones are written after it, and need a host barrier.
+		if (VK_NULL_HANDLE != aLatchedUniforms)
+		{
+			lut::buffer_barrier(aCmdBuff, aLatchedUniforms, VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT, kLateLatchStages, sizeof(glsl::SceneUniform), aSceneOffset);
+		}
+
+		auto* const profiler = aScopes.profiler;
+		if (profiler)
+		{
+			profiler->reset_queries(aCmdBuff);
+			profiler->begin_scope(aCmdBuff, aScopes.frame);
+		}
+
+		//streamed geometry (and its draw commands) arrives before any draw
+		if (aWorld)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "world streaming");
+			record_world_streaming(aCmdBuff, *aWorld, aModel, aFrame);
+		}
+
+		//Cull on the GPU; the draws below consume the compacted commands
+		//Occlusion culling uses the pyramid built at the end of the previous
+		//frame, and so that frame's camera.
+		if (aGpuCull)
+		{
+			GpuCullParams params{};
+			params.prevProjCam = aPrevProjCam;
+			params.sceneOffset = aSceneOffset;
+			params.lodScale = aDrawList.lodScale;
+			if (aHiz && aHiz->valid && EOcclusionMode::hiz == aSettings.occlusionMode)
+			{
+				params.depthWidth = aHiz->drawnExtent.width;
+				params.depthHeight = aHiz->drawnExtent.height;
+				params.hizLevels = aHiz->levels;
+			}
+
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "cull");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.cull);
+			record_gpu_cull(aCmdBuff, *aGpuCull, params);
+			if (aDrawList.triangles)
+				record_triangle_cull(aCmdBuff, *aDrawList.triangles, *aGpuCull, aModel, aSceneOffset, aRenderExtent);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.cull);
+		}
+
+		//Bin the point lights for this frame's camera (unless on the async
+		//compute queue, see submit_compute_commands())
+		if (!aClusters.async)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "light clustering");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.clusters);
+			record_light_clustering(aCmdBuff, aClusters, aSceneDescriptors, aSceneOffset, aRenderExtent, aSceneUniforms.projection, cfg::kCameraNear, cfg::kLightClusterFar);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.clusters);
+		}
+
+		if (aMipFeedback)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "mip feedback");
+			record_mip_feedback(aCmdBuff, *aMipFeedback, aFrame);
+		}
+		if (aVirtual)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "virtual texture feedback");
+			record_virtual_feedback(aCmdBuff, *aVirtual, aFrame);
+		}
+
+		//Re-render the stale faces of the shadow cube (see shadows.hpp); the
+		//render pass's dependencies order them before the shading
+		if (aShadows && aShadows->updateCount > 0)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "shadows");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.shadows);
+			record_shadow_updates(aCmdBuff, *aShadows, aShadowPipe, aShadowAlphaPipe, aModel, aSceneDescriptors, aSceneOffset, aSettings.multiDrawIndirect, aSettings.positionStream);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.shadows);
+		}
 
-		vkCmdUpdateBuffer(aCmdBuff, aSceneUBO, 0, sizeof(glsl::SceneUniform), &aSceneUniform);
+		//This frame's occlusion queries (see occlusion_queries.hpp)
+		if (aDrawList.occlusion)
+			record_occlusion_reset(aCmdBuff, *aDrawList.occlusion, aFrame);
 
-		lut::buffer_barrier(aCmdBuff, aSceneUBO, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+		if (aDebugViews)
+			record_debug_view_clear(aCmdBuff, *aDebugViews);
 
-		//Begin render pass
-		VkClearValue clearValues[2]{};
+		//Begin render pass; attachment 2 is only cleared if it is the
+		//visibility buffer (to 0, no triangle). Forward, attachments 2 and
+		//3 are the multisampled colour and depth, if any.
+		VkClearValue clearValues[4]{};
 		clearValues[0].color.float32[0] = 0.1f;
 		clearValues[0].color.float32[1] = 0.1f;
 		clearValues[0].color.float32[2] = 0.1f;
 		clearValues[0].color.float32[3] = 1.f;
 
-		clearValues[1].depthStencil.depth = 1.f;
+		clearValues[1].depthStencil.depth = 0.f; // reverse-Z: infinitely far
+
+		if (!aDeferred && !aVisibility)
+		{
+			clearValues[2] = clearValues[0];
+			clearValues[3] = clearValues[1];
+		}
 
 		VkRenderPassBeginInfo passInfo{};
 		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		passInfo.renderPass = aRenderPass;
 		passInfo.framebuffer = aFramebuffer;
 		passInfo.renderArea.offset = VkOffset2D{ 0, 0 };
-		passInfo.renderArea.extent = aImageExtent;
-		passInfo.clearValueCount = 2;
+		passInfo.renderArea.extent = aRenderExtent;
+		passInfo.clearValueCount = 4;
 		passInfo.pClearValues = clearValues;
 
-		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		//Begin drawing with our graphics pipeline
-		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsPipe);
-		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
-		for (auto& mesh : aModel.meshes)
+		//With secondary draws, the subpasses only execute the command buffers
+		//recorded by record_secondary_draws(), in part order.
+		VkSubpassContents const contents = aSecondaryDraws ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+
+		vkCmdBeginRenderPass(aCmdBuff, &passInfo, contents);
+
+		DrawStats stats = aSecondaryDraws ? aSecondaryDraws->drawStats : DrawStats{};
+
+		if (VK_NULL_HANDLE != aDepthPipe)
 		{
-			if (bakedModel.materials[mesh.matID].alphaMaskTextureId == 0xffffffff)
+			if (aSecondaryDraws)
+				vkCmdExecuteCommands(aCmdBuff, std::uint32_t(aSecondaryDraws->depthDraws.size()), aSecondaryDraws->depthDraws.data());
+			else
 			{
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aModel.matDecriptors[mesh.matID], 0, nullptr);
-				VkDeviceSize offsets[1]{};
-				vkCmdBindVertexBuffers(aCmdBuff, 0, 1, &mesh.vertices.buffer, offsets);
-				vkCmdBindIndexBuffer(aCmdBuff, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(aCmdBuff, mesh.indexCount, 1, 0, 0, 0);
+				stats += record_scene_draws(aCmdBuff, true, 0, 1, aRenderExtent, aGraphicsPipe, aSecondGraphicsPipe, aDepthPipe, aDepthAlphaPipe, aSceneOffset,
+					aGraphicsLayout, aSceneDescriptors, aModel, aDrawList, aScopes, aSettings);
 			}
+
+			vkCmdNextSubpass(aCmdBuff, contents);
 		}
-		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aSecondGraphicsPipe);
-		for (auto& mesh : aModel.meshes)
+
+		if (aSecondaryDraws)
+			vkCmdExecuteCommands(aCmdBuff, std::uint32_t(aSecondaryDraws->colourDraws.size()), aSecondaryDraws->colourDraws.data());
+		else
 		{
-			if (bakedModel.materials[mesh.matID].alphaMaskTextureId != 0xffffffff)
-			{
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aModel.matDecriptors[mesh.matID], 0, nullptr); 
-				VkDeviceSize offsets[1]{}; 
-				vkCmdBindVertexBuffers(aCmdBuff, 0, 1, &mesh.vertices.buffer, offsets); 
-				vkCmdBindIndexBuffer(aCmdBuff, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32); 
-				vkCmdDrawIndexed(aCmdBuff, mesh.indexCount, 1, 0, 0, 0); 
-			}
+			stats += record_scene_draws(aCmdBuff, false, 0, 1, aRenderExtent, aGraphicsPipe, aSecondGraphicsPipe, aDepthPipe, aDepthAlphaPipe, aSceneOffset,
+				aGraphicsLayout, aSceneDescriptors, aModel, aDrawList, aScopes, aSettings);
+		}
+
+		//Test the drawn meshes' boxes against the finished depth buffer, for
+		//the next frame's draws
+		if (aDrawList.occlusion && !aDrawList.occlusion->tests.empty())
+		{
+			assert(!aSecondaryDraws);
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "occlusion queries");
+			stats.draws += record_occlusion_tests(aCmdBuff, *aDrawList.occlusion, aModel, aSceneDescriptors, aSceneOffset);
+			++stats.pipelineBinds;
+		}
+
+		//Shade the G-buffer (or the visibility buffer); always recorded inline
+		if (aDeferred || aVisibility)
+		{
+			vkCmdNextSubpass(aCmdBuff, VK_SUBPASS_CONTENTS_INLINE);
+
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "lighting");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.lighting);
+			if (aDeferred)
+				record_deferred_lighting(aCmdBuff, *aDeferred, aLightingPipe, aRenderExtent, aSceneDescriptors, aSceneOffset, aSceneUniforms.projCam);
+			else
+				record_visibility_shading(aCmdBuff, *aVisibility, aLightingPipe, aRenderExtent, aSceneDescriptors, aSceneOffset, aModel.bindlessDescriptors);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.lighting);
 		}
+
 		vkCmdEndRenderPass(aCmdBuff);
 
+		if (aDrawList.occlusion)
+			record_occlusion_resolve(aCmdBuff, *aDrawList.occlusion);
+
+		//Upscale the drawn part of the render target to the swapchain image
+		if (aRenderTarget)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "upscale");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.upscale);
+			if (aTemporal)
+				record_temporal_resolve(aCmdBuff, *aTemporal, aRenderTarget->image.image, aRenderExtent, aSwapImage, aImageExtent, aOffscreen);
+			else
+				record_upscale(aCmdBuff, aRenderTarget->image.image, aRenderExtent, aSwapImage, aImageExtent, aOffscreen);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.upscale);
+		}
+
+		//Or place the eyes side by side in it
+		if (aStereo)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "stereo compose");
+			record_stereo_compose(aCmdBuff, *aStereo, aSwapImage, aImageExtent, aOffscreen);
+		}
+
+		//The debug view replaces the final image, under the HUD
+		if (aDebugViews)
+		{
+			assert(aHud);
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "debug view");
+			record_debug_view(aCmdBuff, *aDebugViews, *aHud, aImageIndex, aImageExtent, aRenderExtent);
+		}
+
+		//Draw the HUD over the final image
+		if (aHud)
+		{
+			assert(!aOffscreen);
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "hud");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.hud);
+			record_hud(aCmdBuff, *aHud, aFrame, aImageIndex, aImageExtent);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.hud);
+		}
+
+		//Copy the image for the host; offscreen images end the render pass
+		//(or the upscale) in TRANSFER_SRC_OPTIMAL, presented ones in
+		//PRESENT_SRC_KHR, to which they return
+		if (VK_NULL_HANDLE != aReadback)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "readback");
+
+			//The graph derives the barriers: after the render pass, the
+			//upscale or the HUD, and before the host reads the buffer
+			VkImageLayout const finalLayout = aOffscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			lut::RenderGraph graph(*aScopes.context);
+			auto const image = graph.import_image("swapchain image", aSwapImage, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, finalLayout });
+			auto const buffer = graph.import_buffer("readback", aReadback, {});
+
+			auto const copyPass = graph.add_pass("readback", [&] (VkCommandBuffer aCmd)
+			{
+				VkBufferImageCopy copy{};
+				copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copy.imageExtent = VkExtent3D{ aImageExtent.width, aImageExtent.height, 1 };
+				vkCmdCopyImageToBuffer(aCmd, aSwapImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, aReadback, 1, &copy);
+			});
+			graph.read(copyPass, image, { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL });
+			graph.write(copyPass, buffer, { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT });
+			graph.export_resource(buffer, { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT });
+			if (!aOffscreen)
+				graph.export_resource(image, { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR });
+
+			graph.compile();
+			graph.execute(aCmdBuff);
+		}
+
+		//And convert it for the video stream (unless the sink is behind)
+		if (aStream)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "stream");
+			aStream->record(aCmdBuff, aImageIndex, aOffscreen);
+		}
+
+		//Build the Hi-Z pyramid for the next frame
+		if (aHiz && EOcclusionMode::hiz == aSettings.occlusionMode)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "hi-z");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.hiz);
+			record_hiz_build(aCmdBuff, *aHiz, aRenderExtent);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.hiz);
+		}
+
+		//And the shading rates
+		if (aShadingRate)
+		{
+			lut::DebugLabel const label(*aScopes.context, aCmdBuff, "shading rate");
+			if (profiler)
+				profiler->begin_scope(aCmdBuff, aScopes.shadingRate);
+			record_shading_rate(aCmdBuff, *aShadingRate);
+			if (profiler)
+				profiler->end_scope(aCmdBuff, aScopes.shadingRate);
+		}
+
+		if (profiler)
+			profiler->end_scope(aCmdBuff, aScopes.frame);
+
 		//End command recording
 		if (auto const res = vkEndCommandBuffer(aCmdBuff); VK_SUCCESS != res)
 			throw lut::Error("Unable to end recording command buffer\n" "vkEndCoomandBuffer{} returned %s", lut::to_string(res).c_str());
+
+		return stats;
 	}
 
-	void submit_commands(lut::VulkanWindow const& aWindow, VkCommandBuffer aCmdBuff, VkFence aFence, VkSemaphore aWaitSemaphore, VkSemaphore aSignalSemaphore)
+	std::uint64_t submit_commands(lut::VulkanWindow const& aWindow, VkCommandBuffer aCmdBuff, lut::Timeline& aTimeline, VkSemaphore aWaitSemaphore, VkSemaphore aSignalSemaphore, VkSemaphore aComputeDone, std::uint32_t aDevice, lut::Timeline const* aLatch)
 	{
+		LUT_CPU_ZONE("submit_commands()");
 		//TODO: (Section 1/Exercise 3) implement me!
-		VkPipelineStageFlags waitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		VkSemaphore waitSemaphores[3];
+		VkPipelineStageFlags waitPipelineStages[3];
+		std::uint64_t waitValues[3]{}; // binary ones are ignored
+		std::uint32_t waitCount = 0;
+
+		if (VK_NULL_HANDLE != aWaitSemaphore)
+		{
+			waitSemaphores[waitCount] = aWaitSemaphore;
+			waitPipelineStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		}
+		if (VK_NULL_HANDLE != aComputeDone)
+		{
+			waitSemaphores[waitCount] = aComputeDone;
+			waitPipelineStages[waitCount++] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		}
+		if (aLatch)
+		{
+			waitSemaphores[waitCount] = aLatch->semaphore();
+			waitValues[waitCount] = aLatch->submitted();
+			waitPipelineStages[waitCount++] = kLateLatchStages;
+		}
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &aCmdBuff;
+		submitInfo.waitSemaphoreCount = waitCount;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitPipelineStages;
 
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = &aWaitSemaphore;
-		submitInfo.pWaitDstStageMask = &waitPipelineStages;
+		if (VK_NULL_HANDLE != aSignalSemaphore)
+		{
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &aSignalSemaphore;
+		}
 
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &aSignalSemaphore;
+		std::uint64_t const value = aTimeline.signal();
+		lut::TimelineSignal signal(aTimeline, submitInfo, value);
+		if (aLatch)
+		{
+			signal.info.waitSemaphoreValueCount = waitCount;
+			signal.info.pWaitSemaphoreValues = waitValues;
+		}
 
-		if (auto const res = vkQueueSubmit(aWindow.graphicsQueue, 1, &submitInfo, aFence); VK_SUCCESS != res)
+		//the semaphores are waited for and signalled on the frame's device
+		//(including the timeline's, which TimelineSignal added)
+		bool const frameDevice = kNoFrameDevice != aDevice;
+		std::uint32_t const deviceIndex = frameDevice ? aDevice : 0;
+		std::uint32_t const deviceMask = frameDevice ? 1u << aDevice : 0;
+		std::uint32_t const waitDevices[3] = { deviceIndex, deviceIndex, deviceIndex };
+		std::uint32_t const signalDevices[2] = { deviceIndex, deviceIndex };
+		assert(submitInfo.signalSemaphoreCount <= 2);
+
+		VkDeviceGroupSubmitInfo deviceInfo{};
+		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+		deviceInfo.pNext = submitInfo.pNext;
+		deviceInfo.waitSemaphoreCount = waitCount;
+		deviceInfo.pWaitSemaphoreDeviceIndices = waitDevices;
+		deviceInfo.commandBufferCount = 1;
+		deviceInfo.pCommandBufferDeviceMasks = &deviceMask;
+		deviceInfo.signalSemaphoreCount = submitInfo.signalSemaphoreCount;
+		deviceInfo.pSignalSemaphoreDeviceIndices = signalDevices;
+		if (frameDevice)
+			submitInfo.pNext = &deviceInfo;
+
+		if (auto const res = vkQueueSubmit(aWindow.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to submit command buffer to queue\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str());
 		}
+
+		return value;
+	}
+
+	void submit_compute_commands(lut::VulkanWindow const& aWindow, VkCommandBuffer aCmdBuff, lut::Timeline& aTimeline, VkSemaphore aComputeDone, LightClusters& aClusters, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset, VkExtent2D const& aRenderExtent, glsl::SceneUniform const& aSceneUniforms, VkBuffer aLatchedUniforms, lut::Timeline const* aLatch)
+	{
+		LUT_CPU_ZONE("submit_compute_commands()");
+		assert(aClusters.async);
+
+		VkCommandBufferBeginInfo begInfo{};
+		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (auto const res = vkBeginCommandBuffer(aCmdBuff, &begInfo); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to begin recording compute command buffer\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		if (VK_NULL_HANDLE != aLatchedUniforms)
+		{
+			lut::buffer_barrier(aCmdBuff, aLatchedUniforms, VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT, kLateLatchStages, sizeof(glsl::SceneUniform), aSceneOffset);
+		}
+
+		{
+			lut::DebugLabel const label(aWindow, aCmdBuff, "light clustering");
+			record_light_clustering(aCmdBuff, aClusters, aSceneDescriptors, aSceneOffset, aRenderExtent, aSceneUniforms.projection, cfg::kCameraNear, cfg::kLightClusterFar);
+		}
+
+		if (auto const res = vkEndCommandBuffer(aCmdBuff); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to end recording compute command buffer\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
+		}
+
+		//the previous frame's shading has read the grid once the timeline
+		//reaches its value; late-latched uniforms are written once aLatch
+		//reaches its own
+		VkSemaphore waitSemaphores[2] = { aTimeline.semaphore() };
+		std::uint64_t waitValues[2] = { aTimeline.submitted() };
+		VkPipelineStageFlags waitStages[2] = { VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+		std::uint32_t waitCount = 1;
+		if (aLatch)
+		{
+			waitSemaphores[waitCount] = aLatch->semaphore();
+			waitValues[waitCount] = aLatch->submitted();
+			waitStages[waitCount++] = kLateLatchStages;
+		}
+		std::uint64_t const signalValue = 0; // binary, ignored
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = waitCount;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = waitCount;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &aCmdBuff;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &aComputeDone;
+
+		if (auto const res = vkQueueSubmit(aWindow.computeQueue, 1, &submitInfo, VK_NULL_HANDLE); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to submit command buffer to compute queue\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str());
+		}
 	}
 
-	void present_results(VkQueue aPresentQueue, VkSwapchainKHR aSwapchain, std::uint32_t aImageIndex, VkSemaphore aRenderFinished, bool& aNeedToRecreateSwapchain)
+	VkResult acquire_image(lut::VulkanWindow const& aWindow, VkSemaphore aImageAvailable, std::uint32_t aDevice, std::uint32_t& aImageIndex)
 	{
+		if (kNoFrameDevice == aDevice)
+		{
+			return vkAcquireNextImageKHR(aWindow.device, aWindow.swapchain, std::numeric_limits<std::uint64_t>::max(),
+				aImageAvailable, VK_NULL_HANDLE, &aImageIndex);
+		}
+
+		VkAcquireNextImageInfoKHR acquireInfo{};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR;
+		acquireInfo.swapchain = aWindow.swapchain;
+		acquireInfo.timeout = std::numeric_limits<std::uint64_t>::max();
+		acquireInfo.semaphore = aImageAvailable;
+		acquireInfo.deviceMask = 1u << aDevice;
+
+		return vkAcquireNextImage2KHR(aWindow.device, &acquireInfo, &aImageIndex);
+	}
+
+	void present_results(VkQueue aPresentQueue, VkSwapchainKHR aSwapchain, std::uint32_t aImageIndex, VkSemaphore aRenderFinished, std::uint64_t aPresentId, bool& aNeedToRecreateSwapchain, std::uint32_t aDevice)
+	{
+		LUT_CPU_ZONE("present_results()");
 		//TODO: (Section 1/Exercise 3) implement me!
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1180,6 +6083,27 @@ namespace
 		presentInfo.pSwapchains = &aSwapchain;
 		presentInfo.pImageIndices = &aImageIndex;
 		presentInfo.pResults = nullptr;
+
+		VkPresentIdKHR presentId{};
+		presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentId.swapchainCount = 1;
+		presentId.pPresentIds = &aPresentId;
+		if (0 != aPresentId)
+			presentInfo.pNext = &presentId;
+
+		//the frame's device presents its own instance of the image (see
+		//make_vulkan_window())
+		bool const frameDevice = kNoFrameDevice != aDevice;
+		std::uint32_t const deviceMask = frameDevice ? 1u << aDevice : 0;
+		VkDeviceGroupPresentInfoKHR deviceInfo{};
+		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR;
+		deviceInfo.pNext = presentInfo.pNext;
+		deviceInfo.swapchainCount = 1;
+		deviceInfo.pDeviceMasks = &deviceMask;
+		deviceInfo.mode = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR;
+		if (frameDevice)
+			presentInfo.pNext = &deviceInfo;
+
 		auto const presentRes = vkQueuePresentKHR(aPresentQueue, &presentInfo);
 		if (VK_SUBOPTIMAL_KHR == presentRes || VK_ERROR_OUT_OF_DATE_KHR == presentRes)
 		{
@@ -1193,35 +6117,101 @@ namespace
 		}
 	}
 
+	void write_bench_image(lut::Allocator const& aAllocator, lut::Buffer const& aReadback, VkExtent2D const& aExtent, char const* aDir, std::size_t aKey, char const* aSuffix)
+	{
+		LUT_CPU_ZONE("write_bench_image()");
+		char name[64];
+		if (aSuffix)
+			std::snprintf(name, sizeof(name), "frame-%06zu-%s.png", aKey, aSuffix);
+		else
+			std::snprintf(name, sizeof(name), "frame-%06zu.png", aKey);
+
+		auto const path = (std::filesystem::path(aDir) / name).string();
+
+		vmaInvalidateAllocation(aAllocator.allocator, aReadback.allocation, 0, VK_WHOLE_SIZE);
+
+		void* ptr = nullptr;
+		if (auto const res = vmaMapMemory(aAllocator.allocator, aReadback.allocation, &ptr); VK_SUCCESS != res)
+			throw lut::Error("Mapping memory for reading\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+
+		//alpha is the masked materials' coverage (see the comparisons in
+		//main()); the frames are opaque. The bytes are sRGB-encoded
+		//already, as PNG expects.
+		auto* const image = static_cast<std::uint8_t*>(ptr);
+		for (std::size_t i = 3; i < std::size_t(aExtent.width) * aExtent.height * 4; i += 4)
+			image[i] = 0xff;
+
+		int const ok = stbi_write_png(path.c_str(), int(aExtent.width), int(aExtent.height), 4, image, int(aExtent.width * 4));
+		vmaUnmapMemory(aAllocator.allocator, aReadback.allocation);
+
+		if (!ok)
+			throw lut::Error("Unable to write image '%s'", path.c_str());
+	}
+
+	LoadedModel load_model(std::vector<char const*> const& aPaths, lut::FileReader* aReader, bool aPrefetchTextures)
+	{
+		LUT_CPU_ZONE("load_model()");
+		LoadedModel ret;
+		if (1 == aPaths.size())
+		{
+			auto const start = lut::StartupClock::now();
+			ret.baked = aReader ? read_baked_model(aReader->read(aPaths.front()).get(), aPaths.front()) : map_baked_model(aPaths.front());
+			lut::add_startup_item("model load", aPaths.front(), lut::StartupClock::now() - start, ret.baked.file.size());
+		}
+		else
+		{
+			Scene scene;
+			for (auto const* path : aPaths)
+				scene.load(path);
+			std::fprintf(stderr, "Info: scene of %zu models, %zu textures (%zu before sharing)\n",
+				scene.model_count(), scene.texture_count(), scene.texture_references());
+			ret.scene = std::move(scene).merge();
+		}
+
+		if (aPrefetchTextures)
+			ret.textures = ret.scene ? prefetch_model_textures(*ret.scene, aReader) : prefetch_model_textures(ret.baked, aReader);
+		return ret;
+	}
+
 
-	lut::DescriptorSetLayout create_material_descriptor_layout(lut::VulkanWindow const& aWindow)
+	lut::DescriptorSetLayout create_material_descriptor_layout(lut::VulkanWindow const& aWindow, VkSampler aSampler)
 	{
-		VkDescriptorSetLayoutBinding bindings[4]{};
+		VkDescriptorSetLayoutBinding bindings[5]{};
 
 		// basecolor
 		bindings[0].binding = 0;
 		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		bindings[0].descriptorCount = 1;
 		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[0].pImmutableSamplers = &aSampler;
 
-		// roughness
+		// roughness (R) and metalness (G), packed into one texture
 		bindings[1].binding = 1;
 		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		bindings[1].descriptorCount = 1;
 		bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[1].pImmutableSamplers = &aSampler;
 
-		// metalness
+		//normal
 		bindings[2].binding = 2;
 		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		bindings[2].descriptorCount = 1;
 		bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[2].pImmutableSamplers = &aSampler;
 
-		//normal
+		// texture indices and constants (MaterialIndices)
 		bindings[3].binding = 3;
-		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		bindings[3].descriptorCount = 1;
 		bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+		// alpha mask (MaterialIndices::alphaChannel); depth_alpha.frag
+		bindings[4].binding = 4;
+		bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[4].descriptorCount = 1;
+		bindings[4].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[4].pImmutableSamplers = &aSampler;
+
 		VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
 		layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 		layoutCreateInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
@@ -1235,6 +6225,46 @@ namespace
 
 		return lut::DescriptorSetLayout(aWindow.device, layout);
 	}
+
+	lut::DescriptorSetLayout create_bindless_descriptor_layout(lut::VulkanWindow const& aWindow, std::uint32_t aMaxTextures, bool aDescriptorBuffer)
+	{
+		VkDescriptorSetLayoutBinding bindings[2]{};
+
+		// material texture indices
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		// all textures; the actual count is given when allocating the set
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[1].descriptorCount = aMaxTextures;
+		bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorBindingFlags bindingFlags[2]{};
+		bindingFlags[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+		flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flagsInfo.bindingCount = sizeof(bindingFlags) / sizeof(bindingFlags[0]);
+		flagsInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+		layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutCreateInfo.pNext = &flagsInfo;
+		layoutCreateInfo.flags = aDescriptorBuffer ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+		layoutCreateInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutCreateInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+
+		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutCreateInfo, nullptr, &layout); VK_SUCCESS != res) {
+			throw lut::Error("Unable to create bindless decriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::DescriptorSetLayout(aWindow.device, layout);
+	}
 }
 
 
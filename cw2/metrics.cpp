@@ -0,0 +1,172 @@
+#include "metrics.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+#include "../labutils/error.hpp"
+#include "../labutils/startup_report.hpp"
+#include "../labutils/thread_placement.hpp"
+
+namespace
+{
+	// How often the exporter thread empties the queue; at 1000 frames per
+	// second, this fills a tenth of it
+	constexpr auto kDrainPeriod = std::chrono::milliseconds(100);
+
+	// Nearest-rank percentile of the sorted aValues
+	float percentile_( std::vector<float> const& aValues, float aFraction )
+	{
+		auto const rank = std::size_t( aFraction * float(aValues.size()) + 0.5f );
+		return aValues[std::min( rank > 0 ? rank - 1 : 0, aValues.size() - 1 )];
+	}
+
+	// "name":{"p50":..,"p95":..,"p99":..,"max":..}, or "name":null without
+	// values; sorts aValues
+	void write_percentiles_( std::FILE* aFile, char const* aName, std::vector<float>& aValues )
+	{
+		if( aValues.empty() )
+		{
+			std::fprintf( aFile, ",\"%s\":null", aName );
+			return;
+		}
+
+		std::sort( aValues.begin(), aValues.end() );
+		std::fprintf( aFile, ",\"%s\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}", aName,
+			double(percentile_( aValues, 0.50f )), double(percentile_( aValues, 0.95f )), double(percentile_( aValues, 0.99f )), double(aValues.back()) );
+	}
+
+	double ms_( lut::StartupClock::duration aTime )
+	{
+		return std::chrono::duration<double, std::milli>( aTime ).count();
+	}
+}
+
+MetricsExporter::MetricsExporter( lut::Allocator const& aAllocator, char const* aPath, float aIntervalSeconds )
+	: mAllocator( &aAllocator )
+	, mFile( std::fopen( aPath, "a" ), &std::fclose )
+	, mInterval( aIntervalSeconds )
+{
+	if( !mFile )
+		throw lut::Error( "Unable to open metrics file '%s' for writing", aPath );
+
+	mThread = std::thread( [this] { run_(); } );
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mQuit = true;
+	}
+
+	mWake.notify_all();
+	mThread.join();
+}
+
+void MetricsExporter::add_frame( FrameMetrics const& aFrame ) noexcept
+{
+	FrameMetrics frame = aFrame;
+	if( !mQueue.try_push( std::move(frame) ) )
+		mDropped.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void MetricsExporter::run_()
+{
+	lut::place_current_thread( lut::EThreadRole::background, "metrics export" );
+
+	using Clock_ = std::chrono::steady_clock;
+	auto const interval = std::chrono::duration_cast<Clock_::duration>( std::chrono::duration<float>( mInterval ) );
+	auto next = Clock_::now() + interval;
+
+	for( bool quit = false; !quit; )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			quit = mWake.wait_for( lock, kDrainPeriod, [this] { return mQuit; } );
+		}
+
+		drain_();
+
+		// On exit, only if there is something left to report
+		if( quit ? !mFrames.empty() : Clock_::now() >= next )
+		{
+			write_line_();
+			next += interval;
+		}
+	}
+}
+
+void MetricsExporter::drain_()
+{
+	for( FrameMetrics frame; mQueue.try_pop( frame ); )
+		mFrames.emplace_back( frame );
+}
+
+void MetricsExporter::write_line_()
+{
+	auto* const file = mFile.get();
+
+	std::vector<float> frameMs, cpuMs, gpuMs;
+	frameMs.reserve( mFrames.size() );
+	cpuMs.reserve( mFrames.size() );
+	gpuMs.reserve( mFrames.size() );
+
+	double draws = 0.0, triangles = 0.0;
+	std::size_t triangleFrames = 0;
+	std::uint32_t streamingPending = 0;
+	for( auto const& frame : mFrames )
+	{
+		frameMs.emplace_back( frame.frameMs );
+		cpuMs.emplace_back( frame.cpuMs );
+		if( frame.gpuMs >= 0.f )
+			gpuMs.emplace_back( frame.gpuMs );
+
+		draws += frame.draws;
+		if( frame.triangles >= 0 )
+		{
+			triangles += double(frame.triangles);
+			++triangleFrames;
+		}
+		streamingPending = std::max( streamingPending, frame.streamingPending );
+	}
+
+	std::fprintf( file, "{\"time_s\":%.3f,\"frames\":%zu,\"dropped\":%u",
+		ms_( lut::startup_elapsed() ) * 1e-3, mFrames.size(), mDropped.exchange( 0, std::memory_order_relaxed ) );
+
+	write_percentiles_( file, "frame_ms", frameMs );
+	write_percentiles_( file, "cpu_ms", cpuMs );
+	write_percentiles_( file, "gpu_ms", gpuMs );
+
+	if( !mFrames.empty() )
+		std::fprintf( file, ",\"draws\":%.1f", draws / double(mFrames.size()) );
+	else
+		std::fprintf( file, ",\"draws\":null" );
+	if( triangleFrames > 0 )
+		std::fprintf( file, ",\"triangles\":%.0f", triangles / double(triangleFrames) );
+	else
+		std::fprintf( file, ",\"triangles\":null" );
+	std::fprintf( file, ",\"streaming_pending\":%u", streamingPending );
+
+	if( auto const memory = lut::query_memory_stats( *mAllocator ); memory.deviceBudget > 0 )
+	{
+		std::fprintf( file, ",\"vram_mib\":{\"usage\":%.1f,\"budget\":%.1f,\"from_driver\":%s}",
+			double(memory.deviceUsage) / (1 << 20), double(memory.deviceBudget) / (1 << 20), memory.fromDriver ? "true" : "false" );
+	}
+	else
+	{
+		std::fprintf( file, ",\"vram_mib\":null" );
+	}
+
+	// Phase names are string literals of the code; no escaping needed
+	auto const phases = lut::startup_phases();
+	std::fprintf( file, ",\"startup\":{\"phases\":[" );
+	for( std::size_t i = 0; i < phases.size(); ++i )
+	{
+		std::fprintf( file, "%s{\"name\":\"%s\",\"ms\":%.3f,\"bytes\":%llu}", 0 == i ? "" : ",",
+			phases[i].name, ms_( phases[i].time ), static_cast<unsigned long long>(phases[i].bytes) );
+	}
+	std::fprintf( file, "]}}\n" );
+	std::fflush( file );
+
+	mFrames.clear();
+}
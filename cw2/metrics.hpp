@@ -0,0 +1,93 @@
+#ifndef METRICS_HPP_5D0E7B23_91C4_4A6F_B8E2_3F6A1C94D075
+#define METRICS_HPP_5D0E7B23_91C4_4A6F_B8E2_3F6A1C94D075
+
+// Metrics export (--metrics=FILE), for runs on machines that nobody is
+// watching with a profiler. Every --metrics-interval seconds, one line of
+// JSON is appended to FILE (which may also be a named pipe that a log
+// shipper reads):
+//
+//   {"time_s":..,"frames":..,"dropped":..,
+//    "frame_ms":{"p50":..,"p95":..,"p99":..,"max":..},"cpu_ms":{..},"gpu_ms":{..},
+//    "draws":..,"triangles":..,"streaming_pending":..,
+//    "vram_mib":{"usage":..,"budget":..,"from_driver":..},
+//    "startup":{"phases":[{"name":..,"ms":..,"bytes":..},..]}}
+//
+// time_s counts from the start of the program.
+//
+// The percentiles are over the frames of the interval; draws and triangles
+// are means per frame, and streaming_pending is the largest queue depth.
+// Values that were never measured (e.g., GPU times without timestamps) are
+// null. The start-up phases are repeated in every line, so that each line
+// stands on its own, and phases that run on after the first frame (texture
+// streaming) show their progress.
+//
+// The render loop only pushes a FrameMetrics per frame into a lock-free
+// queue (see MpscQueue); if the queue is full, the frame is dropped and
+// counted. A thread of its own, at a low priority, drains the queue, sorts
+// for the percentiles, queries the memory budget and writes the line.
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <condition_variable>
+
+#include <cstdio>
+#include <cstdint>
+
+#include "../labutils/allocator.hpp"
+#include "../labutils/mpsc_queue.hpp"
+
+namespace lut = labutils;
+
+struct FrameMetrics
+{
+	float frameMs = 0.f; // wall-clock time since the previous frame
+	float cpuMs = 0.f; // recording and submission
+	float gpuMs = -1.f; // negative: unknown
+	std::uint32_t draws = 0;
+	std::int64_t triangles = -1; // submitted; negative: unknown
+	std::uint32_t streamingPending = 0; // textures enqueued but not yet in place
+};
+
+class MetricsExporter
+{
+	public:
+		// Throws lut::Error if aPath can't be opened. aAllocator must outlive
+		// the exporter.
+		MetricsExporter( lut::Allocator const& aAllocator, char const* aPath, float aIntervalSeconds );
+		~MetricsExporter(); // writes the partial interval, if any
+
+		MetricsExporter( MetricsExporter const& ) = delete;
+		MetricsExporter& operator= (MetricsExporter const&) = delete;
+
+	public:
+		// Render loop, once per frame; never blocks
+		void add_frame( FrameMetrics const& ) noexcept;
+
+	private:
+		void run_();
+		void drain_();
+		void write_line_();
+
+	private:
+		lut::Allocator const* mAllocator;
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> mFile;
+		float mInterval;
+
+		static constexpr std::size_t kQueueCapacity = 1024;
+		lut::MpscQueue<FrameMetrics,kQueueCapacity> mQueue;
+		std::atomic<std::uint32_t> mDropped{ 0 };
+
+		// Exporter thread only: the frames of the current interval
+		std::vector<FrameMetrics> mFrames;
+
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		bool mQuit = false;
+
+		std::thread mThread;
+};
+
+#endif // METRICS_HPP_5D0E7B23_91C4_4A6F_B8E2_3F6A1C94D075
@@ -0,0 +1,145 @@
+#include "mip_report.hpp"
+
+#include <memory>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkimage.hpp"
+
+namespace
+{
+	// Kinds of cw2-bake --max-texture-size, and the rest
+	enum class EKind_ : std::uint32_t
+	{
+		baseColor,
+		roughnessMetalness,
+		normalMap,
+		alphaCoverage,
+		other,
+
+		count
+	};
+
+	char const* const kKindNames_[] = { "base-color", "roughness-metalness", "normal-map", "alpha-coverage", "other" };
+	static_assert( sizeof(kKindNames_) / sizeof(kKindNames_[0]) == std::size_t(EKind_::count) );
+
+	// By the first material slot that uses the texture
+	std::vector<EKind_> texture_kinds_( ModelPack const& aModel )
+	{
+		std::vector<EKind_> ret( aModel.textures.size(), EKind_::other );
+		std::vector<bool> seen( aModel.textures.size(), false );
+
+		auto const note = [&] (std::uint32_t aTexture, EKind_ aKind) {
+			if( kNoTexture == aTexture || aTexture >= ret.size() || seen[aTexture] )
+				return;
+			ret[aTexture] = aKind;
+			seen[aTexture] = true;
+		};
+
+		for( auto const& mat : aModel.hostMaterials )
+		{
+			note( mat.baseColor, EKind_::baseColor );
+			note( mat.roughness, EKind_::roughnessMetalness );
+			note( mat.metalness, EKind_::roughnessMetalness );
+			note( mat.normalMap, EKind_::normalMap );
+			note( mat.alphaMask, EKind_::alphaCoverage );
+		}
+		return ret;
+	}
+}
+
+MipReport create_mip_report( lut::Allocator const& aAllocator, ModelPack const& aModel, std::size_t aFramesInFlight )
+{
+	assert( aModel.textureExtents.size() == aModel.textures.size() );
+
+	MipReport ret;
+	ret.feedback = create_mip_feedback( aAllocator, aModel.textures.size(), aFramesInFlight );
+	ret.finest.assign( aModel.textures.size(), kMipFeedbackNone );
+	return ret;
+}
+
+void update_mip_report( MipReport& aReport, lut::Allocator const& aAllocator, std::uint32_t aFrame )
+{
+	auto const* codes = read_mip_feedback( aReport.feedback, aAllocator, aFrame );
+	if( !codes )
+		return;
+
+	for( std::size_t i = 0; i < aReport.finest.size(); ++i )
+		aReport.finest[i] = std::min( aReport.finest[i], codes[i] );
+	++aReport.frames;
+}
+
+void write_mip_report( MipReport const& aReport, lut::Allocator const& aAllocator, ModelPack const& aModel, char const* aPath )
+{
+	assert( aPath );
+
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> file( std::fopen( aPath, "w" ), &std::fclose );
+	if( !file )
+		throw lut::Error( "Unable to open mip report '%s' for writing", aPath );
+
+	std::fprintf( file.get(), "texture,kind,width,height,finest_level,needed_width,needed_height,mib,needed_mib\n" );
+
+	auto const kinds = texture_kinds_( aModel );
+	std::uint32_t largest[std::size_t(EKind_::count)]{}; // loaded
+	std::uint32_t needed[std::size_t(EKind_::count)]{};
+	double totalMib = 0.0, neededMib = 0.0;
+	std::size_t sampled = 0;
+
+	// The last texture is the filler of the constant slots
+	std::size_t const count = aModel.textures.empty() ? 0 : aModel.textures.size() - 1;
+	for( std::size_t i = 0; i < count; ++i )
+	{
+		auto const extent = aModel.textureExtents[i];
+		auto const kind = std::size_t(kinds[i]);
+		auto const side = std::max( extent.width, extent.height );
+		auto const levels = lut::compute_mip_level_count( extent.width, extent.height );
+
+		double mib = 0.0;
+		if( VK_NULL_HANDLE != aModel.textures[i].image.allocation )
+		{
+			VmaAllocationInfo info{};
+			vmaGetAllocationInfo( aAllocator.allocator, aModel.textures[i].image.allocation, &info );
+			mib = double(info.size) / (1 << 20);
+		}
+		totalMib += mib;
+		largest[kind] = std::max( largest[kind], side );
+
+		std::fprintf( file.get(), "%s,%s,%u,%u,", aModel.textureNames[i].c_str(), kKindNames_[kind], extent.width, extent.height );
+
+		auto const code = aReport.finest[i];
+		if( kMipFeedbackNone == code || 0 == side )
+		{
+			std::fprintf( file.get(), ",,,%.3f,0\n", mib );
+			continue;
+		}
+
+		// Footprint in texels of the loaded texture, per pixel; see
+		// update_texture_streaming()
+		float const footprint = float(code) / kMipFeedbackScale - kMipFeedbackBias + std::log2( float(side) );
+		auto const level = std::min( std::uint32_t(std::max( 0.f, std::floor( footprint ) )), levels - 1 );
+		auto const width = std::max( 1u, extent.width >> level ), height = std::max( 1u, extent.height >> level );
+		double const levelMib = std::ldexp( mib, -2 * int(level) ); // every level is a quarter of the one above
+
+		std::fprintf( file.get(), "%u,%u,%u,%.3f,%.3f\n", level, width, height, mib, levelMib );
+
+		needed[kind] = std::max( needed[kind], std::max( width, height ) );
+		neededMib += levelMib;
+		++sampled;
+	}
+
+	bool const ok = !std::ferror( file.get() );
+	if( 0 != std::fclose( file.release() ) || !ok )
+		throw lut::Error( "Unable to write mip report '%s'", aPath );
+
+	std::printf( "Mip report: %zu of %zu textures sampled over %ju frames, %.1f of %.1f MiB needed; written to '%s'\n",
+		sampled, count, std::uintmax_t(aReport.frames), neededMib, totalMib, aPath );
+	for( std::size_t kind = 0; kind < std::size_t(EKind_::other); ++kind )
+	{
+		if( 0 != largest[kind] )
+			std::printf( "  --max-texture-size=%s:%u (loaded up to %u)\n", kKindNames_[kind], std::max( needed[kind], 1u ), largest[kind] );
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef MIP_REPORT_HPP_8C2F4D17_5B3A_4E69_A0D1_7E94B2C6F3A8
+#define MIP_REPORT_HPP_8C2F4D17_5B3A_4E69_A0D1_7E94B2C6F3A8
+
+// Mip usage report (--mip-report=FILE), for texture budgets: over the whole
+// run (e.g., a --bench camera path), the finest mip level that the colour
+// pass sampled of each texture of ModelPack::textures. The fragment shaders
+// write the same feedback as for mip streaming (see mip_feedback.glsl);
+// here, it is only kept as the minimum over all frames. On exit, FILE gets
+// one CSV row per texture:
+//
+//   texture,kind,width,height,finest_level,needed_width,needed_height,mib,needed_mib
+//
+// width and height are those of the texture as loaded (after cw2-bake's
+// size caps and the memory budget's); kind is that of cw2-bake
+// --max-texture-size (from the material slots that use the texture; "other"
+// for the impostors'), and finest_level is empty for textures that were
+// never sampled. A finest_level of 0 may mean the
+// loaded size was too small already. The needed sizes are those of the
+// finest level, and the MiB estimates count its mip chain. A summary, with
+// the --max-texture-size that would suffice per kind, is printed.
+//
+// The feedback of the last frame (still in the buffer on exit) is not
+// counted.
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../labutils/allocator.hpp"
+
+#include "texture_streaming.hpp"
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+struct MipReport
+{
+	MipFeedback feedback; // for binding 3 of the scene's set
+	std::vector<std::uint32_t> finest; // smallest footprint, kMipFeedbackNone if never sampled
+	std::uint64_t frames = 0; // whose feedback was gathered
+};
+
+// For a model without mip streaming, virtual textures or texture arrays,
+// whose textures are sampled at their full size; the report has the sizes
+// of ModelPack::textureExtents on exit.
+MipReport create_mip_report( lut::Allocator const&, ModelPack const&, std::size_t aFramesInFlight );
+
+// Once aFrame's commands have completed: gathers its readback. The
+// feedback is reset with record_mip_feedback().
+void update_mip_report( MipReport&, lut::Allocator const&, std::uint32_t aFrame );
+
+// Throws lut::Error if aPath can't be written.
+void write_mip_report( MipReport const&, lut::Allocator const&, ModelPack const&, char const* aPath );
+
+#endif // MIP_REPORT_HPP_8C2F4D17_5B3A_4E69_A0D1_7E94B2C6F3A8
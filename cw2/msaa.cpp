@@ -0,0 +1,111 @@
+#include "msaa.hpp"
+
+#include <cassert>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	void create_transient_( lut::VulkanWindow const&, lut::Allocator const&, VkFormat, VkSampleCountFlagBits, VkImageUsageFlags, VkImageAspectFlags, lut::Image&, lut::ImageView& );
+}
+
+VkSampleCountFlagBits query_msaa_samples( lut::VulkanContext const& aContext, std::uint32_t aRequested )
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties( aContext.physicalDevice, &props );
+
+	VkSampleCountFlags const supported = props.limits.framebufferColorSampleCounts
+		& props.limits.framebufferDepthSampleCounts;
+
+	// VkSampleCountFlagBits are the sample counts themselves
+	for( std::uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > 1; count >>= 1 )
+	{
+		if( count <= aRequested && (supported & count) )
+			return VkSampleCountFlagBits(count);
+	}
+
+	return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkResolveModeFlagBits query_depth_resolve_mode( lut::VulkanContext const& aContext )
+{
+	VkPhysicalDeviceDepthStencilResolveProperties resolveProps{};
+	resolveProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEPTH_STENCIL_RESOLVE_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 props{};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &resolveProps;
+	vkGetPhysicalDeviceProperties2( aContext.physicalDevice, &props );
+
+	if( resolveProps.supportedDepthResolveModes & VK_RESOLVE_MODE_MIN_BIT )
+		return VK_RESOLVE_MODE_MIN_BIT;
+
+	return VK_RESOLVE_MODE_SAMPLE_ZERO_BIT;
+}
+
+MsaaTargets create_msaa_targets( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkFormat aDepthFormat, VkSampleCountFlagBits aSamples )
+{
+	assert( aSamples > VK_SAMPLE_COUNT_1_BIT );
+
+	MsaaTargets ret;
+	ret.samples = aSamples;
+
+	create_transient_( aWindow, aAllocator, aWindow.swapchainFormat, aSamples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, ret.colour, ret.colourView );
+	create_transient_( aWindow, aAllocator, aDepthFormat, aSamples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, ret.depth, ret.depthView );
+
+	lut::set_name( aWindow, ret.colour, "msaa colour" );
+	lut::set_name( aWindow, ret.depth, "msaa depth" );
+
+	return ret;
+}
+
+namespace
+{
+	void create_transient_( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkFormat aFormat, VkSampleCountFlagBits aSamples, VkImageUsageFlags aUsage, VkImageAspectFlags aAspect, lut::Image& aImage, lut::ImageView& aView )
+	{
+		// Never stored: the samples are resolved at the end of the subpass
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = aFormat;
+		imgInfo.extent = VkExtent3D{ aWindow.swapchainExtent.width, aWindow.swapchainExtent.height, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = 1;
+		imgInfo.samples = aSamples;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = aUsage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		// As create_transient_attachment() (see deferred.hpp)
+		VmaAllocationCreateInfo allocInfo{};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		if( VK_SUCCESS == vmaCreateImage( aAllocator.allocator, &imgInfo, &allocInfo, &image, &allocation, nullptr ) )
+		{
+			lut::tag_allocation( aAllocator.allocator, allocation, lut::EMemoryClass::renderTargets );
+			aImage = lut::Image( aAllocator.allocator, image, allocation );
+		}
+		else
+			aImage = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = aImage.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = aFormat;
+		viewInfo.components = VkComponentMapping{};
+		viewInfo.subresourceRange = VkImageSubresourceRange{ aAspect, 0, 1, 0, 1 };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create multisampled attachment image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+		aView = lut::ImageView( aWindow.device, view );
+	}
+}
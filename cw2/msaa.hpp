@@ -0,0 +1,50 @@
+#ifndef MSAA_HPP_8C41E2A7_53D9_4F6B_9E0A_B2D7316C4F85
+#define MSAA_HPP_8C41E2A7_53D9_4F6B_9E0A_B2D7316C4F85
+
+// Multisample anti-aliasing (--msaa=N, forward lighting only). The scene is
+// drawn into multisampled colour and depth attachments, which only live
+// within the render pass (transient, lazily allocated if possible): the
+// colour is resolved into the swapchain image (or render target) by the
+// subpass's resolve attachment, and, if passes after the render pass read
+// the depth buffer (Hi-Z, shading rates), depth is resolved into the
+// regular single-sampled depth buffer in the same way.
+//
+// Alpha masked geometry uses alpha-to-coverage instead of the hard alpha
+// test (see kAlphaToCoverage in default_frag.glsl).
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// The highest sample count, no higher than aRequested, that colour and
+// depth framebuffer attachments both support (1 if aRequested is 1)
+VkSampleCountFlagBits query_msaa_samples( lut::VulkanContext const&, std::uint32_t aRequested );
+
+// How depth is resolved. MIN keeps the farthest sample (depth is reversed,
+// and clears to 0 at infinity), so that the Hi-Z pyramid built from the
+// resolved depth stays conservative; SAMPLE_ZERO, which every device
+// supports, otherwise.
+VkResolveModeFlagBits query_depth_resolve_mode( lut::VulkanContext const& );
+
+struct MsaaTargets
+{
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	lut::Image colour; // swapchain format and size
+	lut::ImageView colourView;
+
+	lut::Image depth; // aDepthFormat, swapchain size
+	lut::ImageView depthView;
+};
+
+// Images for the current swapchain size
+MsaaTargets create_msaa_targets( lut::VulkanWindow const&, lut::Allocator const&, VkFormat aDepthFormat, VkSampleCountFlagBits );
+
+#endif // MSAA_HPP_8C41E2A7_53D9_4F6B_9E0A_B2D7316C4F85
@@ -0,0 +1,275 @@
+#include "occlusion_queries.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	// Vertices of a box (12 triangles, see occlusion_proxy.vert)
+	constexpr std::uint32_t kProxyVertices = 36;
+
+	// The boxes grow by this fraction of their diagonal, so that the faces
+	// of a flat mesh (a wall, whose box is the wall) aren't hidden by the
+	// mesh itself through depth precision
+	constexpr float kProxyGrowth = 0.01f;
+
+	constexpr VkDeviceSize kPredicateSize = sizeof(std::uint32_t);
+
+	void grown_box_( Mesh const& aMesh, glm::vec3& aMin, glm::vec3& aMax )
+	{
+		float const growth = kProxyGrowth * glm::length( aMesh.aabbMax - aMesh.aabbMin );
+		aMin = aMesh.aabbMin - glm::vec3( growth );
+		aMax = aMesh.aabbMax + glm::vec3( growth );
+	}
+}
+
+OcclusionQueries create_occlusion_queries( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, ModelPack const& aModel, std::uint32_t aFramesInFlight, VkDescriptorSetLayout aSceneLayout, VkRenderPass aRenderPass, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, bool aDepthPrepass, VkSampleCountFlagBits aSamples )
+{
+	assert( aWindow.caps.conditionalRendering );
+
+	OcclusionQueries ret;
+	ret.meshCount = std::uint32_t(aModel.meshes.size());
+
+	// Pipeline layout
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		range.offset = 0;
+		range.size = sizeof(OcclusionProxyPushConstants);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &aSceneLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create occlusion query pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	// Queries; at least one, for models without meshes
+	{
+		VkQueryPoolCreateInfo queryInfo{};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+		queryInfo.queryCount = std::max( 1u, aFramesInFlight * ret.meshCount );
+
+		VkQueryPool pool = VK_NULL_HANDLE;
+		if( auto const res = vkCreateQueryPool( aWindow.device, &queryInfo, nullptr, &pool ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create occlusion query pool\n" "vkCreateQueryPool() returned %s", lut::to_string(res).c_str() );
+
+		ret.pool = lut::QueryPool( aWindow.device, pool );
+	}
+
+	ret.predicates = lut::create_buffer( aAllocator, std::max<VkDeviceSize>( 1, ret.meshCount ) * kPredicateSize,
+		VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+
+	ret.tests.reserve( ret.meshCount );
+
+	ret.pipe = create_occlusion_pipeline( aWindow, ret, aRenderPass, aCache, aShaderModules, aVertShader, aDepthPrepass, aSamples );
+	return ret;
+}
+
+lut::Pipeline create_occlusion_pipeline( lut::VulkanWindow const& aWindow, OcclusionQueries const& aQueries, VkRenderPass aRenderPass, VkPipelineCache aCache, lut::ShaderModuleCache& aShaderModules, char const* aVertShader, bool aDepthPrepass, VkSampleCountFlagBits aSamples )
+{
+	VkShaderModule const vert = aShaderModules.get( aVertShader );
+
+	// Depth testing only: no fragment shader
+	VkPipelineShaderStageCreateInfo stage{};
+	stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stage.module = vert;
+	stage.pName = "main";
+
+	// The boxes are generated from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo inputInfo{};
+	inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
+	assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	assemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportInfo{};
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.scissorCount = 1;
+
+	VkDynamicState const dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo{};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+	dynamicInfo.pDynamicStates = dynamicStates;
+
+	// Any visible sample counts, front or back
+	VkPipelineRasterizationStateCreateInfo rasterInfo{};
+	rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterInfo.lineWidth = 1.f;
+
+	VkPipelineMultisampleStateCreateInfo samplingInfo{};
+	samplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	samplingInfo.rasterizationSamples = aSamples;
+
+	VkPipelineDepthStencilStateCreateInfo depthInfo{};
+	depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthInfo.depthTestEnable = VK_TRUE;
+	depthInfo.depthWriteEnable = VK_FALSE;
+	depthInfo.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+	depthInfo.minDepthBounds = 0.f;
+	depthInfo.maxDepthBounds = 1.f;
+
+	// The colour attachment stays as it is
+	VkPipelineColorBlendAttachmentState blendState{};
+	blendState.colorWriteMask = 0;
+
+	VkPipelineColorBlendStateCreateInfo blendInfo{};
+	blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blendInfo.attachmentCount = 1;
+	blendInfo.pAttachments = &blendState;
+
+	VkGraphicsPipelineCreateInfo pipeInfo{};
+	pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeInfo.stageCount = 1;
+	pipeInfo.pStages = &stage;
+	pipeInfo.pVertexInputState = &inputInfo;
+	pipeInfo.pInputAssemblyState = &assemblyInfo;
+	pipeInfo.pViewportState = &viewportInfo;
+	pipeInfo.pRasterizationState = &rasterInfo;
+	pipeInfo.pMultisampleState = &samplingInfo;
+	pipeInfo.pDepthStencilState = &depthInfo;
+	pipeInfo.pColorBlendState = &blendInfo;
+	pipeInfo.pDynamicState = &dynamicInfo;
+	pipeInfo.layout = aQueries.pipeLayout.handle;
+	pipeInfo.renderPass = aRenderPass;
+	pipeInfo.subpass = aDepthPrepass ? 1 : 0; // the colour subpass
+
+	VkPipeline pipe = VK_NULL_HANDLE;
+	if( auto const res = vkCreateGraphicsPipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create occlusion query pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str() );
+
+	return lut::Pipeline( aWindow.device, pipe );
+}
+
+void select_occlusion_tests( OcclusionQueries& aQueries, ModelPack const& aModel, std::vector<std::uint8_t> const& aMeshVisible, glm::vec3 const& aCameraPos, float aMargin )
+{
+	assert( aMeshVisible.size() == aModel.meshes.size() );
+
+	aQueries.tests.clear();
+	for( std::uint32_t i = 0; i < aQueries.meshCount; ++i )
+	{
+		if( !aMeshVisible[i] )
+			continue;
+
+		glm::vec3 bmin, bmax;
+		grown_box_( aModel.meshes[i], bmin, bmax );
+
+		bool const inside = glm::all( glm::greaterThanEqual( aCameraPos, bmin - aMargin ) )
+			&& glm::all( glm::lessThanEqual( aCameraPos, bmax + aMargin ) );
+		if( !inside )
+			aQueries.tests.emplace_back( i );
+	}
+}
+
+void record_occlusion_reset( VkCommandBuffer aCmdBuff, OcclusionQueries& aQueries, std::uint32_t aFrame )
+{
+	aQueries.frame = aFrame;
+	if( aQueries.meshCount > 0 )
+		vkCmdResetQueryPool( aCmdBuff, aQueries.pool.handle, aFrame * aQueries.meshCount, aQueries.meshCount );
+
+	if( aQueries.initialised )
+		return;
+
+	// Everything is drawn until the first results are in
+	vkCmdFillBuffer( aCmdBuff, aQueries.predicates.buffer, 0, VK_WHOLE_SIZE, 1 );
+
+	lut::buffer_barrier( aCmdBuff, aQueries.predicates.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT
+	);
+
+	aQueries.initialised = true;
+}
+
+std::uint32_t record_occlusion_tests( VkCommandBuffer aCmdBuff, OcclusionQueries const& aQueries, ModelPack const& aModel, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset )
+{
+	if( aQueries.tests.empty() )
+		return 0;
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aQueries.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aQueries.pipeLayout.handle, 0, 1, &aSceneDescriptors, 1, &aSceneOffset );
+
+	std::uint32_t const firstQuery = aQueries.frame * aQueries.meshCount;
+	for( auto const mesh : aQueries.tests )
+	{
+		glm::vec3 bmin, bmax;
+		grown_box_( aModel.meshes[mesh], bmin, bmax );
+
+		OcclusionProxyPushConstants const push{ glm::vec4( bmin, 1.f ), glm::vec4( bmax, 1.f ) };
+		vkCmdPushConstants( aCmdBuff, aQueries.pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push );
+
+		vkCmdBeginQuery( aCmdBuff, aQueries.pool.handle, firstQuery + mesh, 0 );
+		vkCmdDraw( aCmdBuff, kProxyVertices, 1, 0, 0 );
+		vkCmdEndQuery( aCmdBuff, aQueries.pool.handle, firstQuery + mesh );
+	}
+
+	return std::uint32_t(aQueries.tests.size());
+}
+
+void record_occlusion_resolve( VkCommandBuffer aCmdBuff, OcclusionQueries const& aQueries )
+{
+	if( 0 == aQueries.meshCount )
+		return;
+
+	// This frame's draws read the predicates
+	lut::buffer_barrier( aCmdBuff, aQueries.predicates.buffer,
+		VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT
+	);
+
+	// Runs of tested meshes get their results (the GPU waits for them;
+	// the queries ended earlier in this command buffer), the gaps between
+	// them 1
+	std::uint32_t const firstQuery = aQueries.frame * aQueries.meshCount;
+	auto const fill_ = [&] (std::uint32_t aBegin, std::uint32_t aEnd) {
+		if( aBegin < aEnd )
+			vkCmdFillBuffer( aCmdBuff, aQueries.predicates.buffer, aBegin * kPredicateSize, (aEnd - aBegin) * kPredicateSize, 1 );
+	};
+
+	std::uint32_t next = 0; // first mesh not written yet
+	for( std::size_t i = 0; i < aQueries.tests.size(); )
+	{
+		std::uint32_t const first = aQueries.tests[i];
+		std::size_t j = i + 1;
+		while( j < aQueries.tests.size() && aQueries.tests[j] == aQueries.tests[j-1] + 1 )
+			++j;
+		std::uint32_t const count = std::uint32_t(j - i);
+
+		fill_( next, first );
+		vkCmdCopyQueryPoolResults( aCmdBuff, aQueries.pool.handle, firstQuery + first, count,
+			aQueries.predicates.buffer, first * kPredicateSize, kPredicateSize, VK_QUERY_RESULT_WAIT_BIT );
+
+		next = first + count;
+		i = j;
+	}
+	fill_( next, aQueries.meshCount );
+
+	// Read by the next frame's draws
+	lut::buffer_barrier( aCmdBuff, aQueries.predicates.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT
+	);
+}
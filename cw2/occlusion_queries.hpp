@@ -0,0 +1,125 @@
+#ifndef OCCLUSION_QUERIES_HPP_4D1B7E39_A6C2_4F08_9E53_2B8C0F71D6A4
+#define OCCLUSION_QUERIES_HPP_4D1B7E39_A6C2_4F08_9E53_2B8C0F71D6A4
+
+// Occlusion culling with occlusion queries (--occlusion=query), for GPUs
+// where the compute-based Hi-Z culling (hiz.hpp) doesn't pay off. After the
+// colour pass has drawn the visible meshes, the bounding box of each is
+// drawn inside a VK_QUERY_TYPE_OCCLUSION query, depth tested against the
+// finished depth buffer without writing it. The results are copied into a
+// buffer of predicates on the GPU, and the next frame's direct draws of the
+// mesh are gated on them with VK_EXT_conditional_rendering: no readback, and
+// no stall. A mesh that was hidden shows up a frame late.
+//
+// Meshes that weren't tested (culled on the CPU, or with the camera inside
+// their box, where the box's faces would be clipped) get a predicate of 1.
+//
+// Forward lighting, CPU culling and direct draws, recorded inline, of a
+// single copy of the model only.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// PProxy in cw2/shaders/occlusion_proxy.vert
+struct OcclusionProxyPushConstants
+{
+	glm::vec4 boxMin;
+	glm::vec4 boxMax;
+};
+
+struct OcclusionQueries
+{
+	lut::PipelineLayout pipeLayout; // the scene's set 0, OcclusionProxyPushConstants
+	lut::Pipeline pipe;
+
+	// meshCount queries per frame in flight
+	lut::QueryPool pool;
+	std::uint32_t meshCount = 0;
+
+	// One uint32_t per mesh, for vkCmdBeginConditionalRenderingEXT(): 0 if
+	// the mesh's box was hidden in the last frame
+	lut::Buffer predicates;
+
+	// This frame's tested meshes, ascending (see select_occlusion_tests()),
+	// and its queries (see record_occlusion_reset())
+	std::vector<std::uint32_t> tests;
+	std::uint32_t frame = 0;
+
+	// False until the predicates have been initialised to 1
+	bool initialised = false;
+};
+
+// Throws labutils::Error on failure. aSceneLayout is set 0 of the colour
+// pass.
+OcclusionQueries create_occlusion_queries(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	ModelPack const&,
+	std::uint32_t aFramesInFlight,
+	VkDescriptorSetLayout aSceneLayout,
+	VkRenderPass,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	bool aDepthPrepass, // the colour pass is subpass 1
+	VkSampleCountFlagBits aSamples
+);
+
+// The pipeline against aRenderPass; for when the render pass is recreated
+lut::Pipeline create_occlusion_pipeline(
+	lut::VulkanWindow const&,
+	OcclusionQueries const&,
+	VkRenderPass,
+	VkPipelineCache,
+	lut::ShaderModuleCache&,
+	char const* aVertShader,
+	bool aDepthPrepass,
+	VkSampleCountFlagBits aSamples
+);
+
+// The meshes to test this frame: the visible ones whose box, grown by
+// aMargin, doesn't contain the camera. aMargin must cover the distance of
+// the near plane's corners from the camera.
+void select_occlusion_tests(
+	OcclusionQueries&,
+	ModelPack const&,
+	std::vector<std::uint8_t> const& aMeshVisible,
+	glm::vec3 const& aCameraPos,
+	float aMargin
+);
+
+// Outside of the render pass, before the draws: resets the queries of
+// frame slot aFrame (and initialises the predicates, the first time).
+void record_occlusion_reset( VkCommandBuffer, OcclusionQueries&, std::uint32_t aFrame );
+
+// In the colour subpass, after all of the draws: the tested meshes' boxes,
+// each in its query. Binds the scene's set at aSceneOffset; the viewport
+// and scissor are left as they are. Returns the number of draws.
+std::uint32_t record_occlusion_tests(
+	VkCommandBuffer,
+	OcclusionQueries const&,
+	ModelPack const&,
+	VkDescriptorSet aSceneDescriptors,
+	std::uint32_t aSceneOffset
+);
+
+// After the render pass: writes the predicates for the next frame, the
+// query results of the tested meshes and 1 for the others.
+void record_occlusion_resolve( VkCommandBuffer, OcclusionQueries const& );
+
+#endif // OCCLUSION_QUERIES_HPP_4D1B7E39_A6C2_4F08_9E53_2B8C0F71D6A4
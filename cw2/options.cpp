@@ -0,0 +1,1023 @@
+#include "options.hpp"
+
+#include <limits>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// If aArg is "--<aName>=value", returns a pointer to the value, otherwise
+	// returns nullptr.
+	char const* match_value_( char const* aArg, char const* aName )
+	{
+		auto const len = std::strlen( aName );
+		if( 0 != std::strncmp( aArg, "--", 2 ) || 0 != std::strncmp( aArg+2, aName, len ) || '=' != aArg[2+len] )
+			return nullptr;
+
+		return aArg + 2 + len + 1;
+	}
+}
+
+Options parse_options( int aArgc, char* aArgv[], Options const& aDefaults )
+{
+	Options ret = aDefaults;
+
+	for( int i = 1; i < aArgc; ++i )
+	{
+		char const* arg = aArgv[i];
+
+		if( 0 == std::strcmp( arg, "--help" ) || 0 == std::strcmp( arg, "-h" ) )
+		{
+			ret.showHelp = true;
+		}
+		else if( auto const* value = match_value_( arg, "draw" ) )
+		{
+			if( 0 == std::strcmp( value, "direct" ) )
+				ret.drawMode = EDrawMode::direct;
+			else if( 0 == std::strcmp( value, "indirect" ) )
+				ret.drawMode = EDrawMode::indirect;
+			else
+				throw lut::Error( "--draw: unknown mode '%s' (expected 'direct' or 'indirect')", value );
+		}
+		else if( auto const* value = match_value_( arg, "materials" ) )
+		{
+			if( 0 == std::strcmp( value, "sets" ) )
+				ret.materialMode = EMaterialMode::sets;
+			else if( 0 == std::strcmp( value, "bindless" ) )
+				ret.materialMode = EMaterialMode::bindless;
+			else if( 0 == std::strcmp( value, "arrays" ) )
+				ret.materialMode = EMaterialMode::arrays;
+			else
+				throw lut::Error( "--materials: unknown mode '%s' (expected 'sets', 'bindless' or 'arrays')", value );
+		}
+		else if( auto const* value = match_value_( arg, "descriptor-buffer" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.descriptorBuffer = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.descriptorBuffer = false;
+			else
+				throw lut::Error( "--descriptor-buffer: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "cull" ) )
+		{
+			if( 0 == std::strcmp( value, "none" ) )
+				ret.cullMode = ECullMode::none;
+			else if( 0 == std::strcmp( value, "cpu" ) )
+				ret.cullMode = ECullMode::cpu;
+			else if( 0 == std::strcmp( value, "gpu" ) )
+				ret.cullMode = ECullMode::gpu;
+			else
+				throw lut::Error( "--cull: unknown mode '%s' (expected 'none', 'cpu' or 'gpu')", value );
+		}
+		else if( auto const* value = match_value_( arg, "occlusion" ) )
+		{
+			if( 0 == std::strcmp( value, "none" ) )
+				ret.occlusionMode = EOcclusionMode::none;
+			else if( 0 == std::strcmp( value, "hiz" ) )
+				ret.occlusionMode = EOcclusionMode::hiz;
+			else if( 0 == std::strcmp( value, "query" ) )
+				ret.occlusionMode = EOcclusionMode::query;
+			else
+				throw lut::Error( "--occlusion: unknown mode '%s' (expected 'none', 'hiz' or 'query')", value );
+		}
+		else if( auto const* value = match_value_( arg, "prepass" ) )
+		{
+			if( 0 == std::strcmp( value, "none" ) )
+				ret.prepassMode = EPrepassMode::none;
+			else if( 0 == std::strcmp( value, "depth" ) )
+				ret.prepassMode = EPrepassMode::depth;
+			else
+				throw lut::Error( "--prepass: unknown mode '%s' (expected 'none' or 'depth')", value );
+		}
+		else if( auto const* value = match_value_( arg, "vertices" ) )
+		{
+			if( 0 == std::strcmp( value, "float" ) )
+				ret.vertexFormat = EVertexFormat::fp32;
+			else if( 0 == std::strcmp( value, "quantized" ) )
+				ret.vertexFormat = EVertexFormat::quantized;
+			else
+				throw lut::Error( "--vertices: unknown format '%s' (expected 'float' or 'quantized')", value );
+		}
+		else if( auto const* value = match_value_( arg, "vertex-input" ) )
+		{
+			if( 0 == std::strcmp( value, "fixed" ) )
+				ret.vertexInput = EVertexInput::fixed;
+			else if( 0 == std::strcmp( value, "pulled" ) )
+				ret.vertexInput = EVertexInput::pulled;
+			else
+				throw lut::Error( "--vertex-input: unknown mode '%s' (expected 'fixed' or 'pulled')", value );
+		}
+		else if( auto const* value = match_value_( arg, "depth-format" ) )
+		{
+			if( 0 == std::strcmp( value, "d32" ) )
+				ret.depthFormat = EDepthFormat::d32;
+			else if( 0 == std::strcmp( value, "d24" ) )
+				ret.depthFormat = EDepthFormat::d24;
+			else if( 0 == std::strcmp( value, "d16" ) )
+				ret.depthFormat = EDepthFormat::d16;
+			else
+				throw lut::Error( "--depth-format: unknown format '%s' (expected 'd32', 'd24' or 'd16')", value );
+		}
+		else if( auto const* value = match_value_( arg, "precision" ) )
+		{
+			if( 0 == std::strcmp( value, "fp32" ) )
+				ret.shadingPrecision = EShadingPrecision::fp32;
+			else if( 0 == std::strcmp( value, "fp16" ) )
+				ret.shadingPrecision = EShadingPrecision::fp16;
+			else
+				throw lut::Error( "--precision: unknown precision '%s' (expected 'fp32' or 'fp16')", value );
+		}
+		else if( auto const* value = match_value_( arg, "distribution" ) )
+		{
+			if( 0 == std::strcmp( value, "analytic" ) )
+				ret.distribution = EDistribution::analytic;
+			else if( 0 == std::strcmp( value, "lut" ) )
+				ret.distribution = EDistribution::lut;
+			else
+				throw lut::Error( "--distribution: unknown distribution '%s' (expected 'analytic' or 'lut')", value );
+		}
+		else if( auto const* value = match_value_( arg, "lighting" ) )
+		{
+			if( 0 == std::strcmp( value, "forward" ) )
+				ret.lightingMode = ELightingMode::forward;
+			else if( 0 == std::strcmp( value, "deferred" ) )
+				ret.lightingMode = ELightingMode::deferred;
+			else if( 0 == std::strcmp( value, "visibility" ) )
+				ret.lightingMode = ELightingMode::visibility;
+			else
+				throw lut::Error( "--lighting: unknown mode '%s' (expected 'forward', 'deferred' or 'visibility')", value );
+		}
+		else if( auto const* value = match_value_( arg, "tangent-frame" ) )
+		{
+			if( 0 == std::strcmp( value, "vectors" ) )
+				ret.tangentFrame = ETangentFrame::vectors;
+			else if( 0 == std::strcmp( value, "quaternion" ) )
+				ret.tangentFrame = ETangentFrame::quaternion;
+			else
+				throw lut::Error( "--tangent-frame: unknown encoding '%s' (expected 'vectors' or 'quaternion')", value );
+		}
+		else if( auto const* value = match_value_( arg, "shading-rate" ) )
+		{
+			if( 0 == std::strcmp( value, "off" ) )
+				ret.shadingRate = EShadingRate::off;
+			else if( 0 == std::strcmp( value, "depth" ) )
+				ret.shadingRate = EShadingRate::depth;
+			else
+				throw lut::Error( "--shading-rate: unknown mode '%s' (expected 'off' or 'depth')", value );
+		}
+		else if( auto const* value = match_value_( arg, "stereo" ) )
+		{
+			if( 0 == std::strcmp( value, "off" ) )
+				ret.stereoMode = EStereoMode::off;
+			else if( 0 == std::strcmp( value, "multiview" ) )
+				ret.stereoMode = EStereoMode::multiview;
+			else
+				throw lut::Error( "--stereo: unknown mode '%s' (expected 'off' or 'multiview')", value );
+		}
+		else if( auto const* value = match_value_( arg, "triangle-cull" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.triangleCull = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.triangleCull = false;
+			else
+				throw lut::Error( "--triangle-cull: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "async-compute" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.asyncCompute = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.asyncCompute = false;
+			else
+				throw lut::Error( "--async-compute: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "subgroups" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.subgroups = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.subgroups = false;
+			else
+				throw lut::Error( "--subgroups: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "msaa" ) )
+		{
+			if( 0 == std::strcmp( value, "1" ) )
+				ret.msaaSamples = 1;
+			else if( 0 == std::strcmp( value, "2" ) )
+				ret.msaaSamples = 2;
+			else if( 0 == std::strcmp( value, "4" ) )
+				ret.msaaSamples = 4;
+			else if( 0 == std::strcmp( value, "8" ) )
+				ret.msaaSamples = 8;
+			else
+				throw lut::Error( "--msaa: expected 1, 2, 4 or 8 samples, got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "lights" ) )
+		{
+			char* end = nullptr;
+			unsigned long const count = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || count > kMaxPointLights )
+				throw lut::Error( "--lights: expected a number between 0 and %u, got '%s'", kMaxPointLights, value );
+
+			ret.pointLights = std::uint32_t(count);
+		}
+		else if( auto const* value = match_value_( arg, "granularity" ) )
+		{
+			if( 0 == std::strcmp( value, "mesh" ) )
+				ret.granularity = EGranularity::mesh;
+			else if( 0 == std::strcmp( value, "meshlet" ) )
+				ret.granularity = EGranularity::meshlet;
+			else
+				throw lut::Error( "--granularity: unknown value '%s' (expected 'mesh' or 'meshlet')", value );
+		}
+		else if( auto const* value = match_value_( arg, "lod-error" ) )
+		{
+			char* end = nullptr;
+			float const pixels = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(pixels >= 0.f) )
+				throw lut::Error( "--lod-error: expected a non-negative number of pixels, got '%s'", value );
+
+			ret.lodPixelError = pixels;
+		}
+		else if( auto const* value = match_value_( arg, "impostor-pixels" ) )
+		{
+			char* end = nullptr;
+			float const pixels = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(pixels >= 0.f) )
+				throw lut::Error( "--impostor-pixels: expected a non-negative number of pixels, got '%s'", value );
+
+			ret.impostorPixels = pixels;
+		}
+		else if( auto const* value = match_value_( arg, "model" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--model: expected a file name" );
+
+			ret.models.emplace_back( value );
+		}
+		else if( auto const* value = match_value_( arg, "file-io" ) )
+		{
+			if( 0 == std::strcmp( value, "async" ) )
+				ret.asyncFileIo = true;
+			else if( 0 == std::strcmp( value, "mapped" ) )
+				ret.asyncFileIo = false;
+			else
+				throw lut::Error( "--file-io: expected 'async' or 'mapped', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "environment" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--environment: expected a file name" );
+
+			ret.environment = value;
+		}
+		else if( auto const* value = match_value_( arg, "texture-compression" ) )
+		{
+			if( 0 == std::strcmp( value, "off" ) )
+				ret.textureCompression = ETextureCompression::off;
+			else if( 0 == std::strcmp( value, "fast" ) )
+				ret.textureCompression = ETextureCompression::fast;
+			else if( 0 == std::strcmp( value, "quality" ) )
+				ret.textureCompression = ETextureCompression::quality;
+			else
+				throw lut::Error( "--texture-compression: unknown mode '%s' (expected 'off', 'fast' or 'quality')", value );
+		}
+		else if( auto const* value = match_value_( arg, "gpu-decompression" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.gpuDecompression = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.gpuDecompression = false;
+			else
+				throw lut::Error( "--gpu-decompression: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "mip-gen" ) )
+		{
+			if( 0 == std::strcmp( value, "compute" ) )
+				ret.computeMips = true;
+			else if( 0 == std::strcmp( value, "blit" ) )
+				ret.computeMips = false;
+			else
+				throw lut::Error( "--mip-gen: expected 'blit' or 'compute', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "lazy-materials" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.lazyMaterials = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.lazyMaterials = false;
+			else
+				throw lut::Error( "--lazy-materials: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "shadow-budget" ) )
+		{
+			char* end = nullptr;
+			float const ms = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(ms >= 0.f) )
+				throw lut::Error( "--shadow-budget: expected a non-negative GPU time in milliseconds, got '%s'", value );
+
+			ret.shadowBudgetMs = ms;
+		}
+		else if( auto const* value = match_value_( arg, "shadows" ) )
+		{
+			if( 0 == std::strcmp( value, "cube" ) )
+				ret.shadows = EShadows::cube;
+			else if( 0 == std::strcmp( value, "ray-query" ) )
+				ret.shadows = EShadows::rayQuery;
+			else
+				throw lut::Error( "--shadows: unknown mode '%s' (expected 'cube' or 'ray-query')", value );
+		}
+		else if( auto const* value = match_value_( arg, "dynamic-resolution" ) )
+		{
+			char* end = nullptr;
+			float const ms = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(ms >= 0.f) )
+				throw lut::Error( "--dynamic-resolution: expected a non-negative GPU frame time in milliseconds, got '%s'", value );
+
+			ret.dynamicResolutionMs = ms;
+		}
+		else if( auto const* value = match_value_( arg, "resolution-scale" ) )
+		{
+			char* end = nullptr;
+			float const scale = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(scale > 0.f && scale <= 1.f) )
+				throw lut::Error( "--resolution-scale: expected a scale above 0 and up to 1, got '%s'", value );
+
+			ret.resolutionScale = scale;
+		}
+		else if( auto const* value = match_value_( arg, "upscale" ) )
+		{
+			if( 0 == std::strcmp( value, "bilinear" ) )
+				ret.upscale = EUpscale::bilinear;
+			else if( 0 == std::strcmp( value, "temporal" ) )
+				ret.upscale = EUpscale::temporal;
+			else
+				throw lut::Error( "--upscale: unknown mode '%s' (expected 'bilinear' or 'temporal')", value );
+		}
+		else if( auto const* value = match_value_( arg, "mip-bias" ) )
+		{
+			char* end = nullptr;
+			float const bias = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !std::isfinite( bias ) )
+				throw lut::Error( "--mip-bias: expected a LOD bias, got '%s'", value );
+
+			ret.mipBias = bias;
+		}
+		else if( auto const* value = match_value_( arg, "anisotropy" ) )
+		{
+			char* end = nullptr;
+			unsigned long const anisotropy = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || anisotropy > kMaxAnisotropy )
+				throw lut::Error( "--anisotropy: expected a number between 0 and %u, got '%s'", kMaxAnisotropy, value );
+
+			ret.maxAnisotropy = std::uint32_t(anisotropy);
+		}
+		else if( auto const* value = match_value_( arg, "quality" ) )
+		{
+			if( 0 == std::strcmp( value, "auto" ) )
+				ret.quality = EQuality::automatic;
+			else if( 0 == std::strcmp( value, "low" ) )
+				ret.quality = EQuality::low;
+			else if( 0 == std::strcmp( value, "medium" ) )
+				ret.quality = EQuality::medium;
+			else if( 0 == std::strcmp( value, "high" ) )
+				ret.quality = EQuality::high;
+			else if( 0 == std::strcmp( value, "ultra" ) )
+				ret.quality = EQuality::ultra;
+			else
+				throw lut::Error( "--quality: unknown tier '%s' (expected 'auto', 'low', 'medium', 'high' or 'ultra')", value );
+		}
+		else if( auto const* value = match_value_( arg, "quality-target" ) )
+		{
+			char* end = nullptr;
+			float const ms = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(ms > 0.f) )
+				throw lut::Error( "--quality-target: expected a positive GPU frame time in milliseconds, got '%s'", value );
+
+			ret.qualityTargetMs = ms;
+		}
+		else if( auto const* value = match_value_( arg, "texture-budget" ) )
+		{
+			char* end = nullptr;
+			unsigned long const mib = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || mib > kMaxTextureBudgetMib )
+				throw lut::Error( "--texture-budget: expected a number of MiB between 0 and %u, got '%s'", kMaxTextureBudgetMib, value );
+
+			ret.textureBudgetMib = std::uint32_t(mib);
+		}
+		else if( auto const* value = match_value_( arg, "virtual-textures" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.virtualTextures = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.virtualTextures = false;
+			else
+				throw lut::Error( "--virtual-textures: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "stream-cells" ) )
+		{
+			char* end = nullptr;
+			float const size = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(size >= 0.f) )
+				throw lut::Error( "--stream-cells: expected a non-negative cell size, got '%s'", value );
+
+			ret.streamCellSize = size;
+		}
+		else if( auto const* value = match_value_( arg, "geometry-budget" ) )
+		{
+			char* end = nullptr;
+			unsigned long const mib = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || mib < 1 || mib > kMaxGeometryBudgetMib )
+				throw lut::Error( "--geometry-budget: expected a number of MiB between 1 and %u, got '%s'", kMaxGeometryBudgetMib, value );
+
+			ret.geometryBudgetMib = std::uint32_t(mib);
+		}
+		else if( auto const* value = match_value_( arg, "defrag-budget" ) )
+		{
+			char* end = nullptr;
+			unsigned long const mib = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || mib > kMaxDefragBudgetMib )
+				throw lut::Error( "--defrag-budget: expected a number of MiB between 0 and %u, got '%s'", kMaxDefragBudgetMib, value );
+
+			ret.defragBudgetMib = std::uint32_t(mib);
+		}
+		else if( auto const* value = match_value_( arg, "frames-in-flight" ) )
+		{
+			char* end = nullptr;
+			unsigned long const count = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || count < 1 || count > kMaxFramesInFlight )
+				throw lut::Error( "--frames-in-flight: expected a number between 1 and %u, got '%s'", kMaxFramesInFlight, value );
+
+			ret.framesInFlight = std::uint32_t(count);
+		}
+		else if( auto const* value = match_value_( arg, "record" ) )
+		{
+			if( 0 == std::strcmp( value, "immediate" ) )
+				ret.recordMode = ERecordMode::immediate;
+			else if( 0 == std::strcmp( value, "cached" ) )
+				ret.recordMode = ERecordMode::cached;
+			else
+				throw lut::Error( "--record: unknown mode '%s' (expected 'immediate' or 'cached')", value );
+		}
+		else if( auto const* value = match_value_( arg, "record-threads" ) )
+		{
+			char* end = nullptr;
+			unsigned long const count = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || count < 1 || count > kMaxRecordThreads )
+				throw lut::Error( "--record-threads: expected a number between 1 and %u, got '%s'", kMaxRecordThreads, value );
+
+			ret.recordThreads = std::uint32_t(count);
+		}
+		else if( auto const* value = match_value_( arg, "redraw" ) )
+		{
+			if( 0 == std::strcmp( value, "always" ) )
+				ret.redrawMode = ERedrawMode::always;
+			else if( 0 == std::strcmp( value, "on-demand" ) )
+				ret.redrawMode = ERedrawMode::onDemand;
+			else
+				throw lut::Error( "--redraw: unknown mode '%s' (expected 'always' or 'on-demand')", value );
+		}
+		else if( auto const* value = match_value_( arg, "render-thread" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.renderThread = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.renderThread = false;
+			else
+				throw lut::Error( "--render-thread: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "late-latch" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.lateLatch = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.lateLatch = false;
+			else
+				throw lut::Error( "--late-latch: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "pin-render-thread" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.pinRenderThread = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.pinRenderThread = false;
+			else
+				throw lut::Error( "--pin-render-thread: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "worker-priority" ) )
+		{
+			if( 0 == std::strcmp( value, "low" ) )
+				ret.lowPriorityWorkers = true;
+			else if( 0 == std::strcmp( value, "normal" ) )
+				ret.lowPriorityWorkers = false;
+			else
+				throw lut::Error( "--worker-priority: expected 'normal' or 'low', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "numa-workers" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.numaWorkers = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.numaWorkers = false;
+			else
+				throw lut::Error( "--numa-workers: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "pipeline-library" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.pipelineLibrary = EPipelineLibrary::on;
+			else if( 0 == std::strcmp( value, "fast" ) )
+				ret.pipelineLibrary = EPipelineLibrary::fast;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.pipelineLibrary = EPipelineLibrary::off;
+			else
+				throw lut::Error( "--pipeline-library: unknown mode '%s' (expected 'on', 'fast' or 'off')", value );
+		}
+		else if( auto const* value = match_value_( arg, "present" ) )
+		{
+			if( 0 == std::strcmp( value, "fifo" ) )
+				ret.presentMode = EPresentMode::fifo;
+			else if( 0 == std::strcmp( value, "relaxed" ) )
+				ret.presentMode = EPresentMode::relaxed;
+			else if( 0 == std::strcmp( value, "mailbox" ) )
+				ret.presentMode = EPresentMode::mailbox;
+			else if( 0 == std::strcmp( value, "immediate" ) )
+				ret.presentMode = EPresentMode::immediate;
+			else
+				throw lut::Error( "--present: unknown mode '%s' (expected 'fifo', 'relaxed', 'mailbox' or 'immediate')", value );
+		}
+		else if( auto const* value = match_value_( arg, "swapchain-images" ) )
+		{
+			char* end = nullptr;
+			unsigned long const count = std::strtoul( value, &end, 10 );
+			if( end == value || '\0' != *end || count > kMaxSwapchainImages )
+				throw lut::Error( "--swapchain-images: expected a number between 0 and %u, got '%s'", kMaxSwapchainImages, value );
+
+			ret.swapchainImages = std::uint32_t(count);
+		}
+		else if( auto const* value = match_value_( arg, "fps-limit" ) )
+		{
+			char* end = nullptr;
+			float const fps = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(fps >= 0.f && fps <= kMaxFpsLimit) )
+				throw lut::Error( "--fps-limit: expected a frame rate between 0 and %.0f, got '%s'", double(kMaxFpsLimit), value );
+
+			ret.fpsLimit = fps;
+		}
+		else if( auto const* value = match_value_( arg, "fps-adaptive" ) )
+		{
+			char* end = nullptr;
+			float const fps = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(fps >= 0.f && fps <= kMaxFpsLimit) )
+				throw lut::Error( "--fps-adaptive: expected a frame rate between 0 and %.0f, got '%s'", double(kMaxFpsLimit), value );
+
+			ret.fpsAdaptive = fps;
+		}
+		else if( auto const* value = match_value_( arg, "latency-log" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--latency-log: expected a file name" );
+
+			ret.latencyLog = value;
+		}
+		else if( auto const* value = match_value_( arg, "capture-path" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--capture-path: expected a file name" );
+
+			ret.capturePath = value;
+		}
+		else if( auto const* value = match_value_( arg, "shader-dir" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--shader-dir: expected a directory" );
+
+			ret.shaderDir = value;
+		}
+		else if( auto const* value = match_value_( arg, "screenshot-dir" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--screenshot-dir: expected a directory" );
+
+			ret.screenshotDir = value;
+		}
+		else if( auto const* value = match_value_( arg, "capture-frames" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--capture-frames: expected a directory" );
+
+			ret.captureFrames = value;
+		}
+		else if( auto const* value = match_value_( arg, "capture-format" ) )
+		{
+			if( 0 == std::strcmp( value, "png" ) )
+				ret.captureFormat = ECaptureFormat::png;
+			else if( 0 == std::strcmp( value, "pam" ) )
+				ret.captureFormat = ECaptureFormat::pam;
+			else
+				throw lut::Error( "--capture-format: unknown format '%s' (expected 'png' or 'pam')", value );
+		}
+		else if( auto const* value = match_value_( arg, "stream" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--stream: expected a file name" );
+
+			ret.streamPath = value;
+		}
+		else if( auto const* value = match_value_( arg, "trace" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--trace: expected a file name" );
+
+			ret.tracePath = value;
+		}
+		else if( auto const* value = match_value_( arg, "replay" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--replay: expected a draw trace file" );
+
+			ret.replayPath = value;
+		}
+		else if( auto const* value = match_value_( arg, "bench" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--bench: expected a camera path file" );
+
+			ret.benchPath = value;
+		}
+		else if( auto const* value = match_value_( arg, "bench-size" ) )
+		{
+			char* end = nullptr;
+			unsigned long const width = std::strtoul( value, &end, 10 );
+			bool ok = end != value && 'x' == *end;
+
+			unsigned long height = 0;
+			if( ok )
+			{
+				char const* const heightStr = end + 1;
+				height = std::strtoul( heightStr, &end, 10 );
+				ok = end != heightStr && '\0' == *end;
+			}
+
+			if( !ok || width < 1 || height < 1 || width > kMaxBenchSize || height > kMaxBenchSize )
+				throw lut::Error( "--bench-size: expected WxH with sizes between 1 and %u, got '%s'", kMaxBenchSize, value );
+
+			ret.benchWidth = std::uint32_t(width);
+			ret.benchHeight = std::uint32_t(height);
+		}
+		else if( auto const* value = match_value_( arg, "bench-csv" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--bench-csv: expected a file name" );
+
+			ret.benchCsv = value;
+		}
+		else if( auto const* value = match_value_( arg, "bench-frames" ) )
+		{
+			char* end = nullptr;
+			unsigned long const first = std::strtoul( value, &end, 10 );
+			bool ok = end != value && ':' == *end;
+
+			unsigned long count = 0;
+			if( ok )
+			{
+				char const* const countStr = end + 1;
+				count = std::strtoul( countStr, &end, 10 );
+				ok = end != countStr && '\0' == *end;
+			}
+
+			if( !ok || first > std::numeric_limits<std::uint32_t>::max() || count > std::numeric_limits<std::uint32_t>::max() )
+				throw lut::Error( "--bench-frames: expected FIRST:COUNT, got '%s'", value );
+
+			ret.benchFirstKey = std::uint32_t(first);
+			ret.benchKeyCount = std::uint32_t(count);
+		}
+		else if( auto const* value = match_value_( arg, "bench-images" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--bench-images: expected a directory" );
+
+			ret.benchImages = value;
+		}
+		else if( 0 == std::strcmp( arg, "--bench-compare-precision" ) )
+		{
+			ret.benchComparePrecision = true;
+		}
+		else if( 0 == std::strcmp( arg, "--bench-compare-distribution" ) )
+		{
+			ret.benchCompareDistribution = true;
+		}
+		else if( auto const* value = match_value_( arg, "bench-grid" ) )
+		{
+			char* end = nullptr;
+			unsigned long const columns = std::strtoul( value, &end, 10 );
+			bool ok = end != value && 'x' == *end;
+
+			unsigned long rows = 0;
+			if( ok )
+			{
+				char const* const rowsStr = end + 1;
+				rows = std::strtoul( rowsStr, &end, 10 );
+				ok = end != rowsStr && '\0' == *end;
+			}
+
+			if( !ok || columns < 1 || rows < 1 || columns > kMaxBenchGrid || rows > kMaxBenchGrid )
+				throw lut::Error( "--bench-grid: expected CxR with counts between 1 and %u, got '%s'", kMaxBenchGrid, value );
+
+			ret.benchGridColumns = std::uint32_t(columns);
+			ret.benchGridRows = std::uint32_t(rows);
+		}
+		else if( 0 == std::strcmp( arg, "--bench-instanced" ) )
+		{
+			ret.benchInstanced = true;
+		}
+		else if( auto const* value = match_value_( arg, "bench-scaling" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--bench-scaling: expected a file name" );
+
+			ret.benchScaling = value;
+		}
+		else if( auto const* value = match_value_( arg, "startup-report" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--startup-report: expected a file name" );
+
+			ret.startupReport = value;
+		}
+		else if( auto const* value = match_value_( arg, "memory-report" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--memory-report: expected a file name" );
+
+			ret.memoryReport = value;
+		}
+		else if( auto const* value = match_value_( arg, "mip-report" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--mip-report: expected a file name" );
+
+			ret.mipReport = value;
+		}
+		else if( auto const* value = match_value_( arg, "metrics" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--metrics: expected a file name" );
+
+			ret.metricsPath = value;
+		}
+		else if( auto const* value = match_value_( arg, "metrics-interval" ) )
+		{
+			char* end = nullptr;
+			float const seconds = std::strtof( value, &end );
+			if( end == value || '\0' != *end || !(seconds >= 1.f && seconds <= kMaxMetricsInterval) )
+				throw lut::Error( "--metrics-interval: expected seconds between 1 and %.0f, got '%s'", double(kMaxMetricsInterval), value );
+
+			ret.metricsInterval = seconds;
+		}
+		else if( auto const* value = match_value_( arg, "api-counters" ) )
+		{
+			if( 0 == std::strcmp( value, "on" ) )
+				ret.apiCounters = true;
+			else if( 0 == std::strcmp( value, "off" ) )
+				ret.apiCounters = false;
+			else
+				throw lut::Error( "--api-counters: expected 'on' or 'off', got '%s'", value );
+		}
+		else if( auto const* value = match_value_( arg, "device" ) )
+		{
+			if( '\0' == *value )
+				throw lut::Error( "--device: expected a device name or UUID" );
+
+			ret.device = value;
+		}
+		else if( auto const* value = match_value_( arg, "device-group" ) )
+		{
+			if( 0 == std::strcmp( value, "off" ) )
+				ret.deviceGroup = EDeviceGroupMode::off;
+			else if( 0 == std::strcmp( value, "afr" ) )
+				ret.deviceGroup = EDeviceGroupMode::afr;
+			else
+				throw lut::Error( "--device-group: unknown mode '%s' (expected 'off' or 'afr')", value );
+		}
+		else
+		{
+			throw lut::Error( "Unknown option '%s' (see --help)", arg );
+		}
+	}
+
+	if( ret.replayPath && ret.benchPath )
+		throw lut::Error( "--replay and --bench: only one of them" );
+	if( ret.benchComparePrecision && ret.benchCompareDistribution )
+		throw lut::Error( "--bench-compare-precision and --bench-compare-distribution: only one of them" );
+	if( ret.fpsAdaptive > 0.f && !(ret.fpsLimit > ret.fpsAdaptive) )
+		throw lut::Error( "--fps-adaptive: needs an --fps-limit above %.0f", double(ret.fpsAdaptive) );
+
+	return ret;
+}
+
+void print_usage( char const* aProgName )
+{
+	std::printf( "Usage: %s [options]\n", aProgName );
+	std::printf( "  --draw=direct|indirect   per-mesh draws or indirect draws (default: indirect)\n" );
+	std::printf( "  --materials=sets|bindless|arrays\n" );
+	std::printf( "                           per-material descriptor sets, a bindless texture\n" );
+	std::printf( "                           array, or same-size textures packed into texture\n" );
+	std::printf( "                           arrays (default: bindless, if supported)\n" );
+	std::printf( "  --descriptor-buffer=off|on\n" );
+	std::printf( "                           bindless descriptors in a mapped buffer\n" );
+	std::printf( "                           (VK_EXT_descriptor_buffer; default: off)\n" );
+	std::printf( "  --cull=none|cpu|gpu      view frustum culling of meshes (default: gpu if\n" );
+	std::printf( "                           supported and drawing indirectly, else cpu)\n" );
+	std::printf( "  --occlusion=none|hiz|query\n" );
+	std::printf( "                           occlusion culling against the previous frame's\n" );
+	std::printf( "                           depth (default: hiz, with GPU culling only); query:\n" );
+	std::printf( "                           occlusion queries of the meshes' bounds, and\n" );
+	std::printf( "                           conditional rendering of direct draws\n" );
+	std::printf( "  --triangle-cull=off|on   cull back-facing, off-screen and sub-pixel\n" );
+	std::printf( "                           triangles in a compute pass, for vertex bound\n" );
+	std::printf( "                           frames (default: off; needs --cull=gpu)\n" );
+	std::printf( "  --prepass=none|depth     depth-only pre-pass for opaque meshes (default: none)\n" );
+	std::printf( "  --vertices=float|quantized\n" );
+	std::printf( "                           fp32 vertices, or 16-bit quantized ones (default:\n" );
+	std::printf( "                           float)\n" );
+	std::printf( "  --vertex-input=fixed|pulled\n" );
+	std::printf( "                           fixed-function vertex input, or the vertex shaders\n" );
+	std::printf( "                           fetch the vertices from a storage buffer (default:\n" );
+	std::printf( "                           fixed)\n" );
+	std::printf( "  --depth-format=d32|d24|d16\n" );
+	std::printf( "                           reversed depth buffer format; d24 and d16 halve\n" );
+	std::printf( "                           depth bandwidth but lose precision in the\n" );
+	std::printf( "                           distance (default: d32)\n" );
+	std::printf( "  --precision=fp32|fp16    shading arithmetic precision (default: fp16, if\n" );
+	std::printf( "                           supported, else fp32)\n" );
+	std::printf( "  --distribution=analytic|lut\n" );
+	std::printf( "                           specular D term computed per light, or read from\n" );
+	std::printf( "                           a table (default: analytic)\n" );
+	std::printf( "  --subgroups=on|off       subgroup operations in the light loop, culling\n" );
+	std::printf( "                           and Hi-Z passes (default: on, where supported)\n" );
+	std::printf( "  --lighting=forward|deferred|visibility\n" );
+	std::printf( "                           shade while drawing, from a G-buffer in a\n" );
+	std::printf( "                           second subpass, or from per-pixel triangle IDs\n" );
+	std::printf( "                           (default: forward)\n" );
+	std::printf( "  --tangent-frame=vectors|quaternion\n" );
+	std::printf( "                           interpolate the normal and tangent, or a single\n" );
+	std::printf( "                           tangent frame quaternion (default: vectors)\n" );
+	std::printf( "  --shading-rate=off|depth shade flat regions at a coarser rate, from the\n" );
+	std::printf( "                           previous frame's depth (default: off)\n" );
+	std::printf( "  --stereo=off|multiview   draw both eyes in one multiview render pass,\n" );
+	std::printf( "                           side by side (default: off)\n" );
+	std::printf( "  --async-compute=on|off   bin the point lights on an async compute queue,\n" );
+	std::printf( "                           overlapping rendering (default: on, if the device\n" );
+	std::printf( "                           has one)\n" );
+	std::printf( "  --msaa=1|2|4|8           samples per pixel, with alpha-to-coverage for\n" );
+	std::printf( "                           alpha masked materials; forward lighting only\n" );
+	std::printf( "                           (default: 1)\n" );
+	std::printf( "  --lights=N               extra point lights, 0 to %u (default: 0)\n", kMaxPointLights );
+	std::printf( "  --granularity=mesh|meshlet\n" );
+	std::printf( "                           draw and cull meshes, or the baked meshlets\n" );
+	std::printf( "                           (default: mesh)\n" );
+	std::printf( "  --lod-error=PIXELS       screen-space error allowed when picking baked LODs,\n" );
+	std::printf( "                           0 for full detail only (default: 1)\n" );
+	std::printf( "  --impostor-pixels=PIXELS draw meshes at most PIXELS tall on screen as their\n" );
+	std::printf( "                           baked impostors, 0 for never (default: 0)\n" );
+	std::printf( "  --model=FILE             baked model to draw; repeat to merge several into\n" );
+	std::printf( "                           one scene (default: sponza)\n" );
+	std::printf( "  --file-io=async|mapped   read the model and textures with many reads in\n" );
+	std::printf( "                           flight, or map them (default: async)\n" );
+	std::printf( "  --environment=FILE       image-based ambient light from an equirectangular\n" );
+	std::printf( "                           map, prefiltered once and cached (default: none)\n" );
+	std::printf( "  --texture-compression=off|fast|quality\n" );
+	std::printf( "                           block-compress textures that aren't baked on the\n" );
+	std::printf( "                           GPU as they load (default: off)\n" );
+	std::printf( "  --gpu-decompression=off|on\n" );
+	std::printf( "                           decompress compressed meshes on the GPU\n" );
+	std::printf( "                           (default: off)\n" );
+	std::printf( "  --mip-gen=blit|compute   make texture and Hi-Z levels with blits, or with\n" );
+	std::printf( "                           a single compute dispatch (default: blit)\n" );
+	std::printf( "  --lazy-materials=off|on  load a material's textures once it is first\n" );
+	std::printf( "                           visible, placeholders until then (default: off)\n" );
+	std::printf( "  --shadow-budget=MS       GPU time per frame for updating the cached shadow\n" );
+	std::printf( "                           cube as the light moves; 0 for no shadows\n" );
+	std::printf( "                           (default: 0.5)\n" );
+	std::printf( "  --shadows=MODE           cube or ray-query (a shadow ray per fragment)\n" );
+	std::printf( "                           (default: cube)\n" );
+	std::printf( "  --dynamic-resolution=MS  adapt the render resolution to a GPU frame time\n" );
+	std::printf( "                           budget, and upscale; 0 for off (default: 0)\n" );
+	std::printf( "  --resolution-scale=S     render at S times the window's size, and upscale\n" );
+	std::printf( "                           (default: 1)\n" );
+	std::printf( "  --upscale=MODE           bilinear or temporal (jittered, accumulated over\n" );
+	std::printf( "                           frames) (default: bilinear)\n" );
+	std::printf( "  --mip-bias=BIAS          texture LOD bias; positive is blurrier (default: 0)\n" );
+	std::printf( "  --anisotropy=N           largest texture anisotropy, 1 for none, 0 for the\n" );
+	std::printf( "                           device's maximum (default: 0)\n" );
+	std::printf( "  --quality=auto|low|medium|high|ultra\n" );
+	std::printf( "                           quality tier: defaults of the resolution scale,\n" );
+	std::printf( "                           MSAA, mip bias, anisotropy, shading and shadows;\n" );
+	std::printf( "                           auto benchmarks each device once and records its\n" );
+	std::printf( "                           tier (default: auto; high for benchmarks)\n" );
+	std::printf( "  --quality-target=MS      GPU frame time for --quality=auto (default: 16.6)\n" );
+	std::printf( "  --texture-budget=MIB     stream texture mips as they are sampled, within MIB\n" );
+	std::printf( "                           of device memory; 0 for full textures (default: 256)\n" );
+	std::printf( "  --virtual-textures=off|on\n" );
+	std::printf( "                           keep only the sampled tiles of large textures\n" );
+	std::printf( "                           resident, within --texture-budget (default: off)\n" );
+	std::printf( "  --stream-cells=SIZE      stream the geometry in grid cells of SIZE units\n" );
+	std::printf( "                           around the camera; 0 for off (default: 0)\n" );
+	std::printf( "  --geometry-budget=MIB    device memory for streamed geometry (default: 64)\n" );
+	std::printf( "  --defrag-budget=MIB      defragment the memory pools, moving at most MIB per\n" );
+	std::printf( "                           frame; 0 for off (default: 16)\n" );
+	std::printf( "  --frames-in-flight=N     frames recorded ahead of the GPU, 1 to %u (default: 2)\n", kMaxFramesInFlight );
+	std::printf( "  --record=immediate|cached\n" );
+	std::printf( "                           record draws every frame, or once into secondary\n" );
+	std::printf( "                           command buffers (default: cached, unless culling\n" );
+	std::printf( "                           on the CPU)\n" );
+	std::printf( "  --record-threads=N       threads recording the draws, 1 to %u (default: 1)\n", kMaxRecordThreads );
+	std::printf( "  --redraw=always|on-demand\n" );
+	std::printf( "                           render every frame, or only while the image\n" );
+	std::printf( "                           changes, otherwise waiting for events\n" );
+	std::printf( "                           (default: always)\n" );
+	std::printf( "  --render-thread=off|on   render on a thread of its own, apart from the\n" );
+	std::printf( "                           window's events (default: off)\n" );
+	std::printf( "  --late-latch=off|on      write the camera after submitting the frame,\n" );
+	std::printf( "                           just before the GPU reads it (default: off)\n" );
+	std::printf( "  --pin-render-thread=off|on\n" );
+	std::printf( "                           pin the rendering thread to a performance core\n" );
+	std::printf( "                           (default: off)\n" );
+	std::printf( "  --worker-priority=normal|low\n" );
+	std::printf( "                           priority of the job workers and texture decoding\n" );
+	std::printf( "                           (default: normal)\n" );
+	std::printf( "  --numa-workers=off|on    keep each job worker on one NUMA node, spread over\n" );
+	std::printf( "                           the nodes (default: off)\n" );
+	std::printf( "  --pipeline-library=on|fast|off\n" );
+	std::printf( "                           fast-link the colour pipelines from libraries;\n" );
+	std::printf( "                           on also optimizes them in the background\n" );
+	std::printf( "                           (default: on, if supported)\n" );
+	std::printf( "  --present=fifo|relaxed|mailbox|immediate\n" );
+	std::printf( "                           swapchain present mode (default: relaxed, if\n" );
+	std::printf( "                           supported, else fifo)\n" );
+	std::printf( "  --swapchain-images=N     swapchain image count, 0 to %u (default: 0, the\n", kMaxSwapchainImages );
+	std::printf( "                           surface's minimum plus one)\n" );
+	std::printf( "  --shader-dir=DIR         load the .spv files found in DIR instead of the\n" );
+	std::printf( "                           embedded SPIR-V\n" );
+	std::printf( "  --fps-limit=FPS          limit the frame rate, sleeping before the input is\n" );
+	std::printf( "                           polled; 0 for no limit (default: 0)\n" );
+	std::printf( "  --fps-adaptive=FPS       lower the limit down to FPS while the camera moves\n" );
+	std::printf( "                           slowly or the GPU is busy; 0 to keep it fixed\n" );
+	std::printf( "                           (default: 0)\n" );
+	std::printf( "  --latency-log=FILE       write each frame's input-to-present/photon times\n" );
+	std::printf( "  --capture-path=FILE      save the camera path to FILE on exit\n" );
+	std::printf( "  --screenshot-dir=DIR     where F12 saves screenshots (default: cw2-screenshots)\n" );
+	std::printf( "  --capture-frames=DIR     save every frame of the interactive run to DIR\n" );
+	std::printf( "  --capture-format=png|pam encoding of screenshots and frames (default: png)\n" );
+	std::printf( "  --stream=FILE            stream the frames to FILE (or a pipe) as YUV4MPEG2\n" );
+	std::printf( "  --trace=FILE             record each frame's draw list to FILE\n" );
+	std::printf( "  --replay=FILE            render the frames of the draw trace in FILE\n" );
+	std::printf( "                           offscreen, like --bench, drawing the traced meshes\n" );
+	std::printf( "  --bench=FILE             render the camera path in FILE offscreen, one frame\n" );
+	std::printf( "                           per key, and write per-frame CPU and GPU times\n" );
+	std::printf( "  --bench-size=WxH         offscreen resolution (default: 1920x1080)\n" );
+	std::printf( "  --bench-csv=FILE         benchmark output (default: cw2-bench.csv)\n" );
+	std::printf( "  --bench-frames=FIRST:COUNT\n" );
+	std::printf( "                           render COUNT keys from key FIRST (0: to the end)\n" );
+	std::printf( "  --bench-images=DIR       write each rendered frame to DIR as a PNG\n" );
+	std::printf( "  --bench-compare-precision\n" );
+	std::printf( "                           render each key in fp32 and fp16, and write the\n" );
+	std::printf( "                           fp16 image's error along with the timings\n" );
+	std::printf( "  --bench-compare-distribution\n" );
+	std::printf( "                           render each key with the analytic and tabulated\n" );
+	std::printf( "                           D term, and write the table's error along with\n" );
+	std::printf( "                           the timings\n" );
+	std::printf( "  --bench-grid=CxR         benchmark C x R copies of the model, up to %u per\n", kMaxBenchGrid );
+	std::printf( "                           axis (default: 1x1)\n" );
+	std::printf( "  --bench-instanced        draw the grid's copies with hardware instancing\n" );
+	std::printf( "  --bench-scaling=FILE     append the benchmark's summary (grid, modes, mean\n" );
+	std::printf( "                           times, draws, triangles per second) to FILE\n" );
+	std::printf( "  --startup-report=FILE    print the time and throughput of each start-up\n" );
+	std::printf( "                           phase, and write them to FILE (JSON)\n" );
+	std::printf( "  --memory-report=FILE     write VMA's statistics and allocations by name to\n" );
+	std::printf( "                           FILE (JSON) on exit, and when M is pressed\n" );
+	std::printf( "                           (default for M: cw2-memory.json)\n" );
+	std::printf( "  --mip-report=FILE        write the finest mip level sampled of each texture\n" );
+	std::printf( "                           over the run to FILE (CSV) on exit\n" );
+	std::printf( "  --metrics=FILE           append frame time percentiles, draws, VRAM use and\n" );
+	std::printf( "                           start-up phases to FILE as a JSON line, periodically\n" );
+	std::printf( "  --metrics-interval=S     seconds between --metrics lines (default: 10)\n" );
+	std::printf( "  --api-counters=off|on    count and time the Vulkan calls per frame, for the\n" );
+	std::printf( "                           HUD and the --bench CSV (default: off)\n" );
+	std::printf( "  --device=NAME|UUID       use the GPU whose name contains NAME, or with the\n" );
+	std::printf( "                           given UUID (default: LUT_DEVICE from the\n" );
+	std::printf( "                           environment, else the best-scoring device)\n" );
+	std::printf( "  --device-group=off|afr   render alternate frames on the GPUs of the\n" );
+	std::printf( "                           device's group (default: off)\n" );
+	std::printf( "  --help                   print this message and exit\n" );
+}
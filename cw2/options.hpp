@@ -0,0 +1,653 @@
+#ifndef OPTIONS_HPP_3C1E0B6A_52D4_4F0B_9A8E_6E2F1C7D4B19
+#define OPTIONS_HPP_3C1E0B6A_52D4_4F0B_9A8E_6E2F1C7D4B19
+
+// Runtime options for cw2, set from the command line. Every option has a
+// default, so running without arguments gives the standard renderer.
+//
+// Usage: cw2 [options]
+//   --draw=direct|indirect   per-mesh vkCmdDrawIndexed() or indirect draws
+//   --materials=sets|bindless|arrays
+//                            one descriptor set per material, a single
+//                            descriptor-indexed texture array, or the
+//                            textures packed into 2D array images by size
+//                            and format, with a set per combination of
+//                            arrays (for devices without descriptor
+//                            indexing; loads all textures up front)
+//   --descriptor-buffer=off|on
+//                            with bindless materials, keep the scene's and
+//                            the materials' descriptors in a mapped buffer
+//                            (VK_EXT_descriptor_buffer), so that streaming
+//                            rewrites them with plain memory writes; see
+//                            lut::DescriptorBuffer
+//   --cull=none|cpu|gpu      per-frame view frustum culling of meshes; gpu
+//                            requires indirect draws
+//   --occlusion=none|hiz|query
+//                            additionally cull meshes hidden behind the
+//                            previous frame's depth; hiz requires
+//                            --cull=gpu, query needs conditional rendering
+//                            (see occlusion_queries.hpp)
+//   --triangle-cull=off|on   cull the triangles of the visible meshes in a
+//                            compute pass (see triangle_culling.hpp);
+//                            requires --cull=gpu and fp32 vertices. Only
+//                            worth it if the frame is vertex bound
+//   --prepass=none|depth     depth-only pre-pass of the opaque meshes, then
+//                            shade with an EQUAL depth test
+//   --vertices=float|quantized
+//                            48-byte fp32 vertices, or 20-byte quantized
+//                            ones (see quantized_vertex.hpp); quantized
+//                            with indirect draws needs
+//                            drawIndirectFirstInstance
+//   --vertex-input=fixed|pulled
+//                            fixed-function vertex input, or the colour
+//                            pass's vertex shaders fetch the vertices from a
+//                            storage buffer by gl_VertexIndex (see
+//                            shaders/vertex_pulling.glsl); fp32 vertices
+//                            with vector tangent frames only
+//   --depth-format=d32|d24|d16
+//                            depth buffer format. Depth is reversed (1 at
+//                            the near plane, 0 at infinity), so d32's float
+//                            precision is spread evenly over distance; d24
+//                            and d16 halve the depth bandwidth, at the cost
+//                            of precision in the distance. d24
+//                            (X8_D24_UNORM_PACK32) falls back to d32
+//   --precision=fp32|fp16    shading arithmetic in fp32, or in fp16 (needs
+//                            shaderFloat16, falls back to fp32)
+//   --distribution=analytic|lut
+//                            evaluate the specular D term per light, or
+//                            read it from a table by N.H and roughness (see
+//                            distribution_lut.hpp)
+//   --subgroups=on|off       subgroup operations in the point light loop
+//                            (one cluster at a time per subgroup), the GPU
+//                            culling passes (one atomic per subgroup) and
+//                            the Hi-Z build (two levels per dispatch), where
+//                            the device has them in those stages
+//   --lighting=forward|deferred|visibility
+//                            shade while drawing, or write a G-buffer and
+//                            shade each pixel once in a second subpass (see
+//                            deferred.hpp), or write only triangle IDs and
+//                            fetch and shade the triangles in a second
+//                            subpass (see visibility.hpp). Both replace
+//                            --prepass; visibility needs bindless materials
+//                            and geometryShader, and draws full-detail fp32
+//                            meshes
+//   --tangent-frame=vectors|quaternion
+//                            pass the interpolated normal and tangent to the
+//                            fragment shader (seven floats), or the tangent
+//                            frame as a single quaternion (four; see
+//                            tangent_frame.glsl); not used by the visibility
+//                            buffer
+//   --shading-rate=off|depth
+//                            shade flat regions of the previous frame's depth
+//                            at 2x2 (see shading_rate.hpp); needs
+//                            VK_KHR_fragment_shading_rate and forward
+//                            lighting. Toggled with V
+//   --stereo=off|multiview   draw both eyes of a headset in one render pass
+//                            with VK_KHR_multiview, side by side on screen
+//                            (see stereo.hpp); needs forward lighting
+//                            without pre-pass, MSAA, shading rates, dynamic
+//                            resolution, impostors or point lights, and
+//                            culls on the CPU with fp32 vertices
+//   --lights=N               point lights scattered over the scene, in
+//                            addition to the scene light (0 to
+//                            kMaxPointLights); clustered, see clusters.hpp
+//   --granularity=mesh|meshlet
+//                            draw and cull whole meshes, or the meshlets of
+//                            the baked file (see baked_meshlet.hpp); falls
+//                            back to mesh if the file has none
+//   --lod-error=PIXELS       draw the coarsest baked LOD of each mesh whose
+//                            error stays below PIXELS on screen (0 = full
+//                            detail only); requires culling, and mesh
+//                            granularity
+//   --impostor-pixels=PIXELS draw meshes whose bounding sphere covers at most
+//                            PIXELS on screen as their baked impostors (see
+//                            impostors.hpp; 0 = never); requires culling on
+//                            the CPU and forward lighting
+//   --model=FILE             draw FILE (a baked .comp5822mesh) instead of
+//                            the default model; given several times, the
+//                            models are merged into one scene that shares
+//                            their identical textures (see scene.hpp)
+//   --file-io=async|mapped   read the model and the textures that are loaded
+//                            up front with many reads in flight (io_uring,
+//                            or overlapped reads on Windows; see
+//                            file_reader.hpp), decoding each texture as soon
+//                            as it has arrived; or map the files. Merged
+//                            scenes and streamed textures are always read
+//                            as before.
+//   --environment=FILE       light the scene with an equirectangular
+//                            environment map (diffuse SH irradiance and
+//                            prefiltered specular, see ibl.hpp), cached in
+//                            cw2-ibl-cache/; none: a constant ambient term
+//   --texture-compression=off|fast|quality
+//                            block-compress the textures that are not baked
+//                            (PNGs and the like) on the GPU as they load, to
+//                            BC7, BC1 or BC4 (see gpu_compression.hpp);
+//                            fast uses BC1 for opaque colour
+//   --gpu-decompression=off|on
+//                            decompress the LZ4 vertex and index arrays of
+//                            compressed models on the GPU, uploading the
+//                            blocks as they are (see gpu_decompression.hpp);
+//                            arrays that need converting stay on the CPU
+//   --mip-gen=blit|compute   how the levels of decoded textures and of the
+//                            Hi-Z pyramid are made: a blit (dispatch) per
+//                            level, or a single dispatch of the compute
+//                            downsampler (see lut::MipDownsampler), where
+//                            the device supports it
+//   --lazy-materials=off|on  request a material's textures when a mesh that
+//                            uses it first passes culling, largest screen
+//                            coverage first; placeholders until then (see
+//                            lazy_materials.hpp). Not with the benchmark,
+//                            texture arrays or virtual textures
+//   --shadow-budget=MS       shadow the scene light with a cached depth cube,
+//                            re-rendering the faces that the light moved
+//                            away from within MS milliseconds of GPU time
+//                            per frame (see shadows.hpp); 0 = no shadows
+//   --shadows=MODE           how the scene light's shadows are found: cube
+//                            (the cached shadow cube of --shadow-budget) or
+//                            ray-query (a ray per fragment, traced against
+//                            acceleration structures built at load, see
+//                            ray_shadows.hpp; forward shading with
+//                            per-material sets only, falls back to cube)
+//   --dynamic-resolution=MS  scale the render resolution (down to
+//                            kMinResolutionScale per axis) to keep the GPU
+//                            frame time at MS milliseconds, and upscale to
+//                            the swapchain image (see dynamic_resolution.hpp);
+//                            0 = off. Needs GPU timestamps
+//   --resolution-scale=S     render at S times the swapchain's size per axis
+//                            (up to 1, at least kMinResolutionScale), and
+//                            upscale; the starting scale with
+//                            --dynamic-resolution
+//   --upscale=MODE           how the scaled render resolution is upscaled:
+//                            bilinear (a blit) or temporal (jittered frames
+//                            accumulated in a history, see
+//                            temporal_upscale.hpp; renders through the
+//                            render target even at full size). Pair temporal
+//                            with a scale of 0.5 to 0.77
+//   --mip-bias=BIAS          texture LOD bias of the materials' sampler
+//                            (positive: blurrier, less bandwidth), clamped
+//                            to the device's maxSamplerLodBias
+//   --anisotropy=N           largest anisotropy of the materials' sampler
+//                            (1 = none, up to kMaxAnisotropy; 0 = the
+//                            device's maximum)
+//   --quality=auto|low|medium|high|ultra
+//                            defaults of the options above, of --msaa,
+//                            --precision, --distribution and
+//                            --shadow-budget, as a tier (see
+//                            quality_tier.hpp); options given keep their
+//                            values. auto calibrates the tier of each
+//                            device on its first windowed run, and records
+//                            it in cw2-quality.txt; benchmarks use high
+//   --quality-target=MS      GPU frame time that --quality=auto calibrates
+//                            for
+//   --texture-budget=MIB     stream texture mip levels as the colour pass
+//                            samples them, within MIB of device memory (see
+//                            texture_streaming.hpp); 0 = stream in full
+//                            textures. Needs fragmentStoresAndAtomics, and
+//                            forward or deferred lighting
+//   --virtual-textures=off|on
+//                            keep the large textures as sparse images of
+//                            which only the tiles that the colour pass
+//                            samples are resident, within --texture-budget
+//                            (see virtual_textures.hpp); replaces mip
+//                            streaming for them. Needs sparse residency,
+//                            bindless materials and what mip streaming
+//                            needs
+//   --stream-cells=SIZE      stream the model's geometry in cells of SIZE x
+//                            SIZE units on the xz plane, nearest to the
+//                            camera (and to where it is heading) first (see
+//                            world_streaming.hpp); 0 = upload it all up
+//                            front. Needs a single model, whole meshes and
+//                            CPU culling, not with the visibility buffer
+//   --geometry-budget=MIB    device memory for the streamed geometry
+//   --defrag-budget=MIB      defragment the geometry and texture pools once
+//                            they have a block's worth of unused memory,
+//                            moving at most MIB per frame (see
+//                            labutils/defragmenter.hpp); 0 = off
+//   --frames-in-flight=N     frames the CPU may record ahead of the GPU
+//                            (1 to kMaxFramesInFlight)
+//   --record=immediate|cached
+//                            re-record all draws every frame, or record the
+//                            render pass draws into secondary command
+//                            buffers once and replay them; cached needs a
+//                            static draw list (--cull=none or gpu)
+//   --record-threads=N       threads that record the draws into secondary
+//                            command buffers (1 to kMaxRecordThreads)
+//   --pipeline-library=on|fast|off
+//                            link the colour pipeline variants from shared
+//                            graphics pipeline libraries (see
+//                            lut::PipelineLinker), and replace them with
+//                            optimized links made in the background; fast
+//                            keeps the fast-linked ones, off creates
+//                            monolithic pipelines
+//   --redraw=always|on-demand
+//                            render a frame every iteration of the main
+//                            loop, or only while the camera, the light, the
+//                            window or background work (streaming, pipeline
+//                            compiles) change the image; the loop otherwise
+//                            waits for events. Minimized windows never
+//                            render.
+//   --render-thread=off|on   record, submit and present the frames on a
+//                            thread of their own; the main thread only
+//                            processes the window's events, so that slow
+//                            event delivery (e.g., dragging the window)
+//                            doesn't stall rendering. Windows only.
+//   --late-latch=off|on      submit each frame before its camera is known;
+//                            the GPU holds its shaders until the render
+//                            thread, once the previous frame is nearly
+//                            done, has sampled the input again and written
+//                            the camera into the frame's uniforms. The CPU
+//                            culling still uses the earlier camera.
+//                            Windows only.
+//   --pin-render-thread=off|on
+//                            pin the thread that renders (the main thread,
+//                            or --render-thread's) to a performance core;
+//                            the other threads keep off that core
+//   --worker-priority=normal|low
+//                            priority of the job workers and the texture
+//                            decode thread
+//   --numa-workers=off|on    spread the job workers over the NUMA nodes,
+//                            each kept on its node's CPUs, with its job
+//                            deque in node-local memory (see
+//                            labutils/thread_placement.hpp)
+//   --present=fifo|relaxed|mailbox|immediate
+//                            swapchain present mode; unsupported modes fall
+//                            back to relaxed, then fifo
+//   --swapchain-images=N     requested swapchain image count (0 = default,
+//                            up to kMaxSwapchainImages; clamped to what the
+//                            surface supports)
+//   --shader-dir=DIR         load the SPIR-V of each shader from DIR (e.g.,
+//                            assets/cw2/shaders) where DIR has its .spv
+//                            file, instead of the copy embedded in the
+//                            executable; for iterating on shaders without
+//                            rebuilding (see embedded_spirv.hpp)
+//   --capture-path=FILE      record the camera path of the interactive run
+//                            into FILE on exit (see camera_path.hpp)
+//   --screenshot-dir=DIR     where F12 writes screenshots of the interactive
+//                            run (default cw2-screenshots), read back
+//                            without stalling the frame (see
+//                            frame_capture.hpp)
+//   --capture-frames=DIR     write every frame of the interactive run to
+//                            DIR as frame-NNNNNN (by frame number); frames
+//                            are dropped rather than waited for if the
+//                            encoder falls behind
+//   --capture-format=png|pam encoding of screenshots and captured frames:
+//                            PNG, or uncompressed PAM (RGBA), which keeps
+//                            up with higher frame rates
+//   --stream=FILE            stream the frames to FILE as YUV4MPEG2 (4:2:0,
+//                            converted on the GPU, see video_stream.hpp) at
+//                            the initial swapchain size; FILE may be a named
+//                            pipe read by an encoder, e.g., ffmpeg. Needs
+//                            swapchain images that can be sampled
+//   --fps-limit=FPS          start frames at most FPS times per second,
+//                            sleeping before the input is polled (see
+//                            frame_latency.hpp); 0 = no limit
+//   --fps-adaptive=FPS       lower the limit down to FPS while the camera is
+//                            still or moves slowly, and while the GPU has
+//                            little headroom at the limit (see
+//                            AdaptiveFrameCap); needs a higher --fps-limit
+//   --latency-log=FILE       write the input-to-present (and, with
+//                            VK_KHR_present_wait, input-to-photon) times of
+//                            each frame of the interactive run to FILE as
+//                            CSV
+//   --trace=FILE             record the draw list of every frame of the
+//                            interactive run into FILE (see draw_trace.hpp)
+//   --replay=FILE            headless benchmark of a draw trace: render its
+//                            frames, drawing exactly the traced meshes, with
+//                            the --bench-* outputs; culls on the CPU
+//                            (with the traced results)
+//   --bench=FILE             headless benchmark: render one frame per key of
+//                            the camera path in FILE offscreen, without
+//                            a window, and write per-frame timings as CSV
+//   --bench-size=WxH         offscreen resolution of --bench (default
+//                            1920x1080)
+//   --bench-csv=FILE         CSV output of --bench (default cw2-bench.csv)
+//   --bench-frames=FIRST:COUNT
+//                            render only COUNT keys of the path (or replay),
+//                            from key FIRST; COUNT 0 = to the end. A render
+//                            farm worker's shard (see util/render_farm.lua);
+//                            the CSV rows and images keep the keys' indices
+//                            in the whole path
+//   --bench-images=DIR       write each rendered frame to DIR as
+//                            frame-NNNNNN.png (by key; with
+//                            --bench-compare-*, both images, suffixed with
+//                            the compared mode). DIR is created if needed
+//   --bench-compare-precision
+//                            render each key of --bench twice, in fp32 and
+//                            fp16, and add the difference of the fp16 image
+//                            to the fp32 one to the CSV (needs
+//                            shaderFloat16)
+//   --bench-compare-distribution
+//                            render each key of --bench twice, with the
+//                            analytic D term and with the table, and add the
+//                            difference of the table's image to the
+//                            analytic one to the CSV; not with
+//                            --bench-compare-precision
+//   --bench-grid=CxR         render C x R copies of the model in a grid with
+//                            --bench (default 1x1, up to kMaxBenchGrid per
+//                            axis), to measure how the draw and cull modes
+//                            scale with the scene's size
+//   --bench-instanced        draw the --bench-grid copies as instances of
+//                            the model's meshes (see set_model_instances()),
+//                            one draw per mesh for all copies; needs fp32
+//                            vertices and whole meshes, not with the
+//                            visibility buffer (tiles the grid otherwise)
+//   --bench-scaling=FILE     append a summary row of the run (grid, modes,
+//                            mean times, draws and triangle throughput) to
+//                            FILE as CSV; sweeps run cw2 once per grid size
+//                            and mode
+//   --memory-report=FILE     write VMA's statistics, with every allocation
+//                            by class and name (e.g., "textures: <path>"),
+//                            to FILE as JSON on exit, and when M is
+//                            pressed (default cw2-memory.json for M);
+//                            `premake5 memory-report` sums them up (see
+//                            util/memory_report.lua)
+//   --mip-report=FILE        record, per texture, the finest mip level that
+//                            the colour pass samples over the whole run
+//                            (e.g., a --bench camera path), and write it to
+//                            FILE as CSV on exit, with the texture sizes
+//                            per kind that would suffice (see
+//                            mip_report.hpp); needs the textures loaded up
+//                            front, and forward or deferred lighting
+//   --metrics=FILE           append a line of JSON with the frame time
+//                            percentiles, draws, triangles, streaming queue
+//                            depth, VRAM use and start-up phases to FILE
+//                            every --metrics-interval seconds (see
+//                            metrics.hpp)
+//   --metrics-interval=S     seconds between the --metrics lines (default
+//                            10)
+//   --api-counters=off|on    count and time the frames' calls to the main
+//                            Vulkan entry points (draws, binds, descriptor
+//                            updates, allocations, submits; see
+//                            labutils/api_counters.hpp), shown on the HUD
+//                            and added to the --bench CSV
+//   --device-group=off|afr   alternate-frame rendering over the GPUs of the
+//                            selected device's group (VK_KHR_device_group,
+//                            core in Vulkan 1.1): each frame slot renders
+//                            and presents on one GPU, with the scene
+//                            replicated on all of them; needs no occlusion
+//                            culling, shading rates, shadows, async compute
+//                            or streaming, which carry state from frame to
+//                            frame. GPU timings are kept per device
+//   --help                   print usage and exit
+
+#include <vector>
+
+#include <cstdint>
+
+constexpr std::uint32_t kMaxFramesInFlight = 4;
+constexpr std::uint32_t kMaxRecordThreads = 32;
+constexpr std::uint32_t kMaxSwapchainImages = 8;
+constexpr std::uint32_t kMaxBenchSize = 16384;
+constexpr std::uint32_t kMaxBenchGrid = 64;
+constexpr std::uint32_t kMaxPointLights = 16384;
+constexpr std::uint32_t kMaxTextureBudgetMib = 1u << 20;
+constexpr std::uint32_t kMaxDefragBudgetMib = 1024;
+constexpr std::uint32_t kMaxGeometryBudgetMib = 1u << 16;
+constexpr float kMaxFpsLimit = 1000.f;
+constexpr float kMaxMetricsInterval = 3600.f; // seconds
+constexpr std::uint32_t kMaxAnisotropy = 16;
+
+enum class EDrawMode
+{
+	direct,
+	indirect
+};
+
+enum class EMaterialMode
+{
+	sets,
+	bindless,
+	arrays
+};
+
+enum class ECullMode
+{
+	none,
+	cpu,
+	gpu
+};
+
+enum class EOcclusionMode
+{
+	none,
+	hiz,
+	query // see occlusion_queries.hpp
+};
+
+enum class EPrepassMode
+{
+	none,
+	depth
+};
+
+enum class EVertexFormat
+{
+	fp32,
+	quantized
+};
+
+enum class EVertexInput
+{
+	fixed,
+	pulled
+};
+
+enum class EDepthFormat
+{
+	d32, // D32_SFLOAT
+	d24, // X8_D24_UNORM_PACK32
+	d16  // D16_UNORM
+};
+
+enum class EShadingPrecision
+{
+	fp32,
+	fp16
+};
+
+enum class EDistribution
+{
+	analytic,
+	lut
+};
+
+enum class ELightingMode
+{
+	forward,
+	deferred,
+	visibility
+};
+
+enum class ETangentFrame
+{
+	vectors,
+	quaternion
+};
+
+enum class EShadingRate
+{
+	off,
+	depth
+};
+
+enum class ETextureCompression
+{
+	off,
+	fast,
+	quality
+};
+
+enum class EShadows
+{
+	cube, // see shadows.hpp
+	rayQuery // see ray_shadows.hpp
+};
+
+enum class EUpscale
+{
+	bilinear, // a blit, see dynamic_resolution.hpp
+	temporal // see temporal_upscale.hpp
+};
+
+enum class EStereoMode
+{
+	off,
+	multiview // see stereo.hpp
+};
+
+enum class EDeviceGroupMode
+{
+	off,
+	afr // alternate frames, see --device-group
+};
+
+enum class ECaptureFormat
+{
+	png,
+	pam // uncompressed
+};
+
+enum class EGranularity
+{
+	mesh,
+	meshlet
+};
+
+enum class ERecordMode
+{
+	immediate,
+	cached
+};
+
+enum class ERedrawMode
+{
+	always,
+	onDemand
+};
+
+enum class EPipelineLibrary
+{
+	off,
+	on, // fast-linked, then optimized in the background
+	fast // fast-linked only
+};
+
+enum class EQuality
+{
+	automatic, // calibrated per device, see quality_tier.hpp
+	low,
+	medium,
+	high, // the plain defaults
+	ultra
+};
+
+enum class EPresentMode
+{
+	fifo,
+	relaxed, // FIFO_RELAXED
+	mailbox,
+	immediate
+};
+
+struct Options
+{
+	EDrawMode drawMode = EDrawMode::indirect;
+	EMaterialMode materialMode = EMaterialMode::bindless; // falls back to sets if unsupported
+	bool descriptorBuffer = false; // bindless only; falls back to descriptor sets if unsupported
+	ECullMode cullMode = ECullMode::gpu; // falls back to cpu if unsupported
+	EOcclusionMode occlusionMode = EOcclusionMode::hiz; // only with GPU culling
+	bool triangleCull = false; // only with GPU culling
+	EPrepassMode prepassMode = EPrepassMode::none;
+	EVertexFormat vertexFormat = EVertexFormat::fp32; // quantized falls back to fp32 if unsupported
+	EVertexInput vertexInput = EVertexInput::fixed; // pulled falls back to fixed if unsupported
+	EDepthFormat depthFormat = EDepthFormat::d32; // d24 falls back to d32 if unsupported
+	EShadingPrecision shadingPrecision = EShadingPrecision::fp16; // falls back to fp32 if unsupported
+	EDistribution distribution = EDistribution::analytic;
+	ELightingMode lightingMode = ELightingMode::forward;
+	ETangentFrame tangentFrame = ETangentFrame::vectors;
+	EShadingRate shadingRate = EShadingRate::off; // falls back to off if unsupported
+	EStereoMode stereoMode = EStereoMode::off; // falls back to off if unsupported
+	bool asyncCompute = true; // light clustering on an async compute queue, if there is one
+	bool subgroups = true; // subgroup variants of the light loop and the culling passes, where supported
+	std::uint32_t msaaSamples = 1; // forward lighting only; lowered to the device's maximum
+	std::uint32_t pointLights = 0;
+	EGranularity granularity = EGranularity::mesh; // meshlet falls back to mesh without baked meshlets
+	float lodPixelError = 1.f; // 0: no LOD selection
+	float impostorPixels = 0.f; // 0: no impostors
+	float shadowBudgetMs = 0.5f; // 0: no shadows
+	EShadows shadows = EShadows::cube; // falls back to cube if unsupported
+	std::vector<char const*> models; // from argv; empty: the default model
+	bool asyncFileIo = true; // falls back to blocking reads if unsupported
+	char const* environment = nullptr; // from argv; null: constant ambient
+	ETextureCompression textureCompression = ETextureCompression::off; // formats the device can't sample stay uncompressed
+	bool gpuDecompression = false; // not with mapped geometry buffers
+	bool computeMips = false; // --mip-gen=compute; falls back to blits per format
+	bool lazyMaterials = false;
+	float dynamicResolutionMs = 0.f; // 0: render at the swapchain's size
+	float resolutionScale = 1.f; // below 1: upscaled
+	EUpscale upscale = EUpscale::bilinear;
+	float mipBias = 0.f;
+	std::uint32_t maxAnisotropy = 0; // 0: the device's maximum
+	EQuality quality = EQuality::automatic; // high for benchmarks
+	float qualityTargetMs = 16.6f;
+	std::uint32_t textureBudgetMib = 256; // 0: no mip streaming
+	bool virtualTextures = false; // falls back to mip streaming if unsupported
+	float streamCellSize = 0.f; // 0: no world streaming
+	std::uint32_t geometryBudgetMib = 64; // streamed geometry
+	std::uint32_t defragBudgetMib = 16; // per frame; 0: no defragmentation
+	std::uint32_t framesInFlight = 2;
+	ERecordMode recordMode = ERecordMode::cached; // falls back to immediate with CPU culling
+	std::uint32_t recordThreads = 1; // 1: immediate mode records inline
+	EPipelineLibrary pipelineLibrary = EPipelineLibrary::on; // falls back to off if unsupported
+	ERedrawMode redrawMode = ERedrawMode::always; // windows only
+	bool renderThread = false; // windows only
+	bool lateLatch = false; // windows only
+	bool pinRenderThread = false;
+	bool lowPriorityWorkers = false;
+	bool numaWorkers = false;
+	EPresentMode presentMode = EPresentMode::relaxed;
+	std::uint32_t swapchainImages = 0; // 0: labutils' default
+	char const* shaderDir = nullptr; // non-null: overrides the embedded SPIR-V
+
+	float fpsLimit = 0.f; // 0: no limit
+	float fpsAdaptive = 0.f; // 0: the limit is fixed
+	char const* latencyLog = nullptr; // from argv
+
+	char const* capturePath = nullptr; // from argv
+	char const* screenshotDir = "cw2-screenshots";
+	char const* captureFrames = nullptr; // non-null: write every frame there
+	ECaptureFormat captureFormat = ECaptureFormat::png;
+	char const* streamPath = nullptr; // non-null: stream the frames there
+	char const* tracePath = nullptr; // from argv
+	char const* replayPath = nullptr; // non-null: benchmark mode, of the trace
+	char const* benchPath = nullptr; // non-null: benchmark mode
+	std::uint32_t benchWidth = 1920, benchHeight = 1080;
+	char const* benchCsv = "cw2-bench.csv";
+	std::uint32_t benchFirstKey = 0, benchKeyCount = 0; // count 0: to the end of the path
+	char const* benchImages = nullptr; // non-null: write the frames there
+	bool benchComparePrecision = false;
+	bool benchCompareDistribution = false;
+	std::uint32_t benchGridColumns = 1, benchGridRows = 1;
+	bool benchInstanced = false;
+	char const* benchScaling = nullptr; // non-null: append the run's summary there
+
+	char const* startupReport = nullptr; // non-null: print the start-up report, and write it (JSON) there
+	char const* memoryReport = nullptr; // non-null: write the VMA statistics there on exit
+	char const* mipReport = nullptr; // non-null: write the sampled mip levels there on exit
+	char const* metricsPath = nullptr; // non-null: export the metrics there
+	float metricsInterval = 10.f; // seconds
+	bool apiCounters = false;
+
+	char const* device = nullptr; // from argv; null: LUT_DEVICE, or the best-scoring device
+	EDeviceGroupMode deviceGroup = EDeviceGroupMode::off; // afr falls back to off with a single device
+
+	bool showHelp = false;
+};
+
+// Throws labutils::Error on unknown or malformed options. Options not
+// given keep their values in aDefaults (e.g., a quality tier's, see
+// quality_options()).
+Options parse_options( int aArgc, char* aArgv[], Options const& aDefaults = Options{} );
+
+void print_usage( char const* aProgName );
+
+#endif // OPTIONS_HPP_3C1E0B6A_52D4_4F0B_9A8E_6E2F1C7D4B19
@@ -0,0 +1,260 @@
+#include "quality_tier.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Output of the calibration runs (relative to the working directory),
+	// removed afterwards
+	constexpr char const* kCalibrationCsv = "cw2-quality-frames.csv";
+	constexpr char const* kCalibrationSummary = "cw2-quality-summary.csv";
+
+	// Column of the mean GPU frame time in --bench-scaling's rows
+	constexpr std::size_t kGpuMsColumn = 8;
+
+	struct TierSettings_
+	{
+		EQuality tier;
+		char const* name;
+		float resolutionScale;
+		std::uint32_t msaaSamples;
+		float mipBias;
+		std::uint32_t maxAnisotropy; // 0: the device's maximum
+		EShadingPrecision precision;
+		EDistribution distribution;
+		float shadowBudgetMs;
+	};
+
+	// Highest first, the order of calibration
+	constexpr TierSettings_ kTiers[] = {
+		{ EQuality::ultra, "ultra", 1.f, 4, 0.f, 0, EShadingPrecision::fp32, EDistribution::analytic, 1.f },
+		{ EQuality::high, "high", 1.f, 1, 0.f, 0, EShadingPrecision::fp16, EDistribution::analytic, 0.5f },
+		{ EQuality::medium, "medium", 0.85f, 1, 0.5f, 8, EShadingPrecision::fp16, EDistribution::lut, 0.25f },
+		{ EQuality::low, "low", 0.7f, 1, 1.f, 2, EShadingPrecision::fp16, EDistribution::lut, 0.f }
+	};
+
+	TierSettings_ const& tier_( EQuality aTier )
+	{
+		for( auto const& tier : kTiers )
+		{
+			if( aTier == tier.tier )
+				return tier;
+		}
+
+		throw lut::Error( "Quality tier %d has no settings", int(aTier) );
+	}
+
+	std::string device_uuid_( lut::VulkanContext const& aContext )
+	{
+		VkPhysicalDeviceIDProperties ids{};
+		ids.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 props{};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &ids;
+		vkGetPhysicalDeviceProperties2( aContext.physicalDevice, &props );
+
+		// As printed with the device scores (see lut::make_vulkan_window())
+		std::string ret;
+		for( std::size_t i = 0; i < VK_UUID_SIZE; ++i )
+		{
+			if( 4 == i || 6 == i || 8 == i || 10 == i )
+				ret += '-';
+
+			char hex[3];
+			std::snprintf( hex, sizeof(hex), "%02x", ids.deviceUUID[i] );
+			ret += hex;
+		}
+		return ret;
+	}
+
+	// Lines of the record: device UUID, target (ms), tier, measured GPU time
+	// (ms). The target is compared as written, with two decimals.
+	struct RecordLine_
+	{
+		std::string device, target, tier;
+		double gpuMs;
+	};
+
+	std::vector<RecordLine_> load_record_( char const* aPath )
+	{
+		std::vector<RecordLine_> ret;
+
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> file( std::fopen( aPath, "r" ), &std::fclose );
+		if( !file )
+			return ret; // first run
+
+		char line[256];
+		while( std::fgets( line, sizeof(line), file.get() ) )
+		{
+			if( '#' == line[0] )
+				continue;
+
+			char device[64], target[32], tier[32];
+			double gpuMs = 0.0;
+			if( 4 == std::sscanf( line, "%63s %31s %31s %lf", device, target, tier, &gpuMs ) )
+				ret.emplace_back( RecordLine_{ device, target, tier, gpuMs } );
+		}
+
+		return ret;
+	}
+
+	void save_record_( char const* aPath, std::vector<RecordLine_> const& aLines )
+	{
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> file( std::fopen( aPath, "w" ), &std::fclose );
+		if( !file )
+			throw lut::Error( "Unable to open '%s' for writing", aPath );
+
+		std::fprintf( file.get(), "# cw2 quality tiers (see quality_tier.hpp): device UUID, target ms, tier, GPU ms\n" );
+		for( auto const& line : aLines )
+			std::fprintf( file.get(), "%s %s %s %.3f\n", line.device.c_str(), line.target.c_str(), line.tier.c_str(), line.gpuMs );
+
+		bool const ok = !std::ferror( file.get() );
+		if( 0 != std::fclose( file.release() ) || !ok )
+			throw lut::Error( "Unable to write '%s'", aPath );
+	}
+
+	// Mean GPU frame time of the last row of a --bench-scaling file;
+	// negative if there is none
+	double read_gpu_ms_( char const* aPath )
+	{
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> file( std::fopen( aPath, "r" ), &std::fclose );
+		if( !file )
+			return -1.0;
+
+		double ret = -1.0;
+
+		char line[1024];
+		for( bool header = true; std::fgets( line, sizeof(line), file.get() ); header = false )
+		{
+			if( header )
+				continue;
+
+			char const* field = line;
+			for( std::size_t i = 0; field && i < kGpuMsColumn; ++i )
+			{
+				field = std::strchr( field, ',' );
+				if( field )
+					++field;
+			}
+
+			if( field )
+				ret = std::strtod( field, nullptr );
+		}
+
+		// 0: the device has no timestamps
+		return ret > 0.0 ? ret : -1.0;
+	}
+
+	// Runs the calibration benchmark of aTier; returns its mean GPU frame
+	// time, negative if the run failed
+	double bench_tier_( QualityCalibration const& aCalibration, std::string const& aDevice, TierSettings_ const& aTier )
+	{
+		std::remove( kCalibrationSummary );
+
+		char command[1024];
+		std::snprintf( command, sizeof(command), "\"%s\" --quality=%s --bench=%s --bench-frames=%u:%u --bench-size=%ux%u --bench-csv=%s --bench-scaling=%s --device=%s",
+			aCalibration.executable, aTier.name, aCalibration.benchPath, aCalibration.firstKey, aCalibration.keyCount,
+			aCalibration.extent.width, aCalibration.extent.height, kCalibrationCsv, kCalibrationSummary, aDevice.c_str() );
+
+		std::fprintf( stderr, "Info: calibrating quality tier '%s': %s\n", aTier.name, command );
+		std::fflush( stdout );
+
+		int const status = std::system( command );
+		double const ret = 0 == status ? read_gpu_ms_( kCalibrationSummary ) : -1.0;
+
+		std::remove( kCalibrationCsv );
+		std::remove( kCalibrationSummary );
+
+		return ret;
+	}
+}
+
+Options quality_options( EQuality aTier )
+{
+	auto const& tier = tier_( aTier );
+
+	Options ret;
+	ret.quality = aTier;
+	ret.resolutionScale = tier.resolutionScale;
+	ret.msaaSamples = tier.msaaSamples;
+	ret.mipBias = tier.mipBias;
+	ret.maxAnisotropy = tier.maxAnisotropy;
+	ret.shadingPrecision = tier.precision;
+	ret.distribution = tier.distribution;
+	ret.shadowBudgetMs = tier.shadowBudgetMs;
+	return ret;
+}
+
+char const* quality_name( EQuality aTier )
+{
+	return EQuality::automatic == aTier ? "auto" : tier_( aTier ).name;
+}
+
+EQuality select_quality( lut::VulkanContext const& aContext, QualityCalibration const& aCalibration )
+{
+	auto const device = device_uuid_( aContext );
+
+	char target[32];
+	std::snprintf( target, sizeof(target), "%.2f", aCalibration.targetMs );
+
+	auto record = load_record_( aCalibration.recordPath );
+	for( auto const& line : record )
+	{
+		if( line.device != device || line.target != target )
+			continue;
+
+		for( auto const& tier : kTiers )
+		{
+			if( line.tier == tier.name )
+				return tier.tier;
+		}
+	}
+
+	// First run on this device (for this target): the highest tier that
+	// meets the target, else the lowest
+	std::fprintf( stderr, "Info: no quality tier recorded for device %s at %s ms, calibrating\n", device.c_str(), target );
+
+	TierSettings_ const* chosen = nullptr;
+	double chosenMs = -1.0;
+	for( auto const& tier : kTiers )
+	{
+		double const gpuMs = bench_tier_( aCalibration, device, tier );
+		if( gpuMs < 0.0 )
+		{
+			std::fprintf( stderr, "Info: quality tier '%s' gave no GPU frame time\n", tier.name );
+			continue;
+		}
+
+		std::fprintf( stderr, "Info: quality tier '%s': %.3f ms GPU per frame\n", tier.name, gpuMs );
+		chosen = &tier;
+		chosenMs = gpuMs;
+		if( gpuMs <= double(aCalibration.targetMs) )
+			break;
+	}
+
+	if( !chosen )
+	{
+		std::fprintf( stderr, "Info: quality calibration failed, using 'high'\n" );
+		return EQuality::high;
+	}
+
+	record.erase( std::remove_if( record.begin(), record.end(), [&] (RecordLine_ const& aLine) {
+		return aLine.device == device && aLine.target == target;
+	} ), record.end() );
+	record.emplace_back( RecordLine_{ device, target, chosen->name, chosenMs } );
+	save_record_( aCalibration.recordPath, record );
+
+	std::fprintf( stderr, "Info: quality tier '%s' recorded for device %s in '%s'\n", chosen->name, device.c_str(), aCalibration.recordPath );
+	return chosen->tier;
+}
@@ -0,0 +1,48 @@
+#ifndef QUALITY_TIER_HPP_5E0C2A94_7B1D_4D38_9F6A_C3E8B1047D52
+#define QUALITY_TIER_HPP_5E0C2A94_7B1D_4D38_9F6A_C3E8B1047D52
+
+// Quality tiers (--quality). A tier is a set of option defaults: resolution
+// scale, MSAA, texture mip bias and anisotropy, shader variant (shading
+// precision and D term) and shadow budget. Options given on the command
+// line keep their values; the tier only replaces the defaults of the rest
+// (see parse_options()). high is the plain defaults.
+//
+// --quality=auto picks the tier per device. The first run on a device
+// calibrates: it runs cw2 itself once per tier, from ultra down, as a
+// headless benchmark (--bench) of a part of the Sponza camera path at the
+// window's size, and takes the first tier whose mean GPU frame time meets
+// the target (--quality-target). The result is recorded in a text file by
+// device UUID and target, and later runs on that device use it; delete the
+// device's line (or the file) to calibrate again, e.g., after a driver
+// update. Benchmarks don't calibrate, and use high.
+
+#include <volk/volk.h>
+
+#include "options.hpp"
+
+#include "../labutils/vulkan_context.hpp"
+
+namespace lut = labutils;
+
+struct QualityCalibration
+{
+	char const* executable; // cw2 itself (argv[0])
+	char const* benchPath; // camera path rendered per tier
+	std::uint32_t firstKey, keyCount; // of that path
+	char const* recordPath; // tiers by device
+	VkExtent2D extent; // benchmark resolution
+	float targetMs; // GPU frame time to meet
+};
+
+// Defaults of aTier (not automatic)
+Options quality_options( EQuality aTier );
+
+char const* quality_name( EQuality );
+
+// The recorded tier of the context's device for aCalibration.targetMs, or
+// the calibrated one, which is then recorded. Falls back to high, without
+// recording it, if no benchmark run yields a GPU frame time. Throws
+// lut::Error if the record can't be written.
+EQuality select_quality( lut::VulkanContext const&, QualityCalibration const& );
+
+#endif // QUALITY_TIER_HPP_5E0C2A94_7B1D_4D38_9F6A_C3E8B1047D52
@@ -0,0 +1,120 @@
+#ifndef QUANTIZED_VERTEX_HPP_E332B1D2_CC82_4082_851A_FAFFD81864D8
+#define QUANTIZED_VERTEX_HPP_E332B1D2_CC82_4082_851A_FAFFD81864D8
+
+// Compact vertex format; 20 bytes per vertex instead of the 48 bytes of the
+// interleaved fp32 vertices:
+//
+//   - position: 4x unorm16. xyz relative to the mesh's AABB (0 = min,
+//     65535 = max); w holds the tangent sign (0 = -1, 65535 = +1)
+//   - texcoord: 2x float16
+//   - normal:   2x snorm16, octahedral encoding
+//   - tangent:  2x snorm16, octahedral encoding of xyz
+//
+// Stored in "scsmbil-qnt" baked files (see cw2-bake/main.cpp), and used for
+// the vertex buffers with --vertices=quantized; the vertex shaders decode
+// it with shaders/quantized.glsl. The attributes map directly to
+// VK_FORMAT_R16G16B16A16_UNORM, R16G16_SFLOAT and R16G16_SNORM.
+//
+// Shared between cw2 and cw2-bake, hence header-only.
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/packing.hpp>
+
+struct QuantizedVertex
+{
+	std::uint16_t position[4];
+	std::uint16_t texcoord[2];
+	std::int16_t normal[2];
+	std::int16_t tangent[2];
+};
+
+static_assert( sizeof(QuantizedVertex) == 20, "QuantizedVertex must stay tightly packed" );
+
+// Octahedral mapping of a (unit) direction to [-1,1]^2, and back.
+inline glm::vec2 octahedral_encode( glm::vec3 aDir )
+{
+	float const l1 = std::abs( aDir.x ) + std::abs( aDir.y ) + std::abs( aDir.z );
+	if( l1 <= 0.f )
+		return glm::vec2( 0.f );
+
+	glm::vec2 ret = glm::vec2( aDir.x, aDir.y ) / l1;
+	if( aDir.z < 0.f )
+	{
+		glm::vec2 const folded( 1.f - std::abs( ret.y ), 1.f - std::abs( ret.x ) );
+		ret.x = ret.x >= 0.f ? folded.x : -folded.x;
+		ret.y = ret.y >= 0.f ? folded.y : -folded.y;
+	}
+
+	return ret;
+}
+
+inline glm::vec3 octahedral_decode( glm::vec2 aEnc )
+{
+	glm::vec3 ret( aEnc.x, aEnc.y, 1.f - std::abs( aEnc.x ) - std::abs( aEnc.y ) );
+	float const t = std::max( -ret.z, 0.f );
+	ret.x += ret.x >= 0.f ? -t : t;
+	ret.y += ret.y >= 0.f ? -t : t;
+	return glm::normalize( ret );
+}
+
+inline std::int16_t to_snorm16( float aValue )
+{
+	return std::int16_t(std::lround( std::clamp( aValue, -1.f, 1.f ) * 32767.f ));
+}
+inline float from_snorm16( std::int16_t aValue )
+{
+	return std::max( float(aValue) / 32767.f, -1.f );
+}
+
+// Positions outside of [aAabbMin, aAabbMax] are clamped to it.
+inline QuantizedVertex quantize_vertex( glm::vec3 const& aPosition, glm::vec2 const& aTexcoord, glm::vec3 const& aNormal, glm::vec4 const& aTangent, glm::vec3 const& aAabbMin, glm::vec3 const& aAabbMax )
+{
+	QuantizedVertex ret{};
+
+	glm::vec3 const extent = aAabbMax - aAabbMin;
+	for( int i = 0; i < 3; ++i )
+	{
+		float const rel = extent[i] > 0.f ? (aPosition[i] - aAabbMin[i]) / extent[i] : 0.f;
+		ret.position[i] = std::uint16_t(std::lround( std::clamp( rel, 0.f, 1.f ) * 65535.f ));
+	}
+	ret.position[3] = aTangent.w < 0.f ? 0 : 65535;
+
+	std::uint32_t const tex = glm::packHalf2x16( aTexcoord );
+	ret.texcoord[0] = std::uint16_t(tex & 0xffff);
+	ret.texcoord[1] = std::uint16_t(tex >> 16);
+
+	glm::vec2 const n = octahedral_encode( aNormal );
+	ret.normal[0] = to_snorm16( n.x );
+	ret.normal[1] = to_snorm16( n.y );
+
+	glm::vec2 const t = octahedral_encode( glm::vec3( aTangent ) );
+	ret.tangent[0] = to_snorm16( t.x );
+	ret.tangent[1] = to_snorm16( t.y );
+
+	return ret;
+}
+
+// Same decode as shaders/quantized.glsl.
+inline void dequantize_vertex( QuantizedVertex const& aVertex, glm::vec3 const& aAabbMin, glm::vec3 const& aAabbMax, glm::vec3& aPosition, glm::vec2& aTexcoord, glm::vec3& aNormal, glm::vec4& aTangent )
+{
+	glm::vec3 const extent = aAabbMax - aAabbMin;
+	for( int i = 0; i < 3; ++i )
+		aPosition[i] = aAabbMin[i] + float(aVertex.position[i]) / 65535.f * extent[i];
+
+	aTexcoord = glm::unpackHalf2x16( std::uint32_t(aVertex.texcoord[0]) | (std::uint32_t(aVertex.texcoord[1]) << 16) );
+
+	aNormal = octahedral_decode( glm::vec2( from_snorm16( aVertex.normal[0] ), from_snorm16( aVertex.normal[1] ) ) );
+
+	glm::vec3 const t = octahedral_decode( glm::vec2( from_snorm16( aVertex.tangent[0] ), from_snorm16( aVertex.tangent[1] ) ) );
+	aTangent = glm::vec4( t, aVertex.position[3] >= 32768 ? 1.f : -1.f );
+}
+
+#endif // QUANTIZED_VERTEX_HPP_E332B1D2_CC82_4082_851A_FAFFD81864D8
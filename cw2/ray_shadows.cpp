@@ -0,0 +1,393 @@
+#include "ray_shadows.hpp"
+
+#include <map>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+#include "../labutils/startup_report.hpp"
+
+#include "interleaved_vertex.hpp"
+
+namespace
+{
+	// Acceleration structures must start at multiples of 256 bytes in their
+	// buffer
+	constexpr VkDeviceSize kStructureAlignment = 256;
+
+	// Start-up report phase (see lut::StartupPhase)
+	constexpr char const* kBuildPhase = "acceleration structures";
+
+	constexpr VkBufferUsageFlags kStorageUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+	// A distinct range of the model's geometry; meshes with the same one
+	// share their BLAS
+	using GeometryKey_ = std::tuple<VkIndexType, std::uint32_t, std::int32_t, std::uint32_t>;
+
+	struct Blas_
+	{
+		VkAccelerationStructureGeometryKHR geometry{};
+		VkAccelerationStructureBuildRangeInfoKHR range{};
+		VkAccelerationStructureBuildSizesInfoKHR sizes{};
+		VkDeviceSize offset = 0; // into the build storage
+		lut::AccelerationStructure build; // before compaction
+	};
+
+	VkDeviceSize align_( VkDeviceSize aValue, VkDeviceSize aAlignment )
+	{
+		return (aValue + aAlignment - 1) / aAlignment * aAlignment;
+	}
+
+	VkDeviceAddress address_( lut::VulkanWindow const& aWindow, VkBuffer aBuffer )
+	{
+		VkBufferDeviceAddressInfo info{};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		info.buffer = aBuffer;
+		return vkGetBufferDeviceAddress( aWindow.device, &info );
+	}
+
+	VkDeviceAddress address_( lut::VulkanWindow const& aWindow, VkAccelerationStructureKHR aStructure )
+	{
+		VkAccelerationStructureDeviceAddressInfoKHR info{};
+		info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+		info.accelerationStructure = aStructure;
+		return vkGetAccelerationStructureDeviceAddressKHR( aWindow.device, &info );
+	}
+
+	lut::AccelerationStructure create_structure_( lut::VulkanWindow const& aWindow, VkBuffer aBuffer, VkDeviceSize aOffset, VkDeviceSize aSize, VkAccelerationStructureTypeKHR aType )
+	{
+		VkAccelerationStructureCreateInfoKHR info{};
+		info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+		info.buffer = aBuffer;
+		info.offset = aOffset;
+		info.size = aSize;
+		info.type = aType;
+
+		VkAccelerationStructureKHR structure = VK_NULL_HANDLE;
+		if( auto const res = vkCreateAccelerationStructureKHR( aWindow.device, &info, nullptr, &structure ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create acceleration structure\n" "vkCreateAccelerationStructureKHR() returned %s", lut::to_string(res).c_str() );
+
+		return lut::AccelerationStructure( aWindow.device, structure );
+	}
+
+	// Scratch memory, aligned for the builds (the buffer itself may not be)
+	struct Scratch_
+	{
+		lut::Buffer buffer;
+		VkDeviceAddress address = 0;
+	};
+
+	Scratch_ create_scratch_( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkDeviceSize aSize, VkDeviceSize aAlignment )
+	{
+		Scratch_ ret;
+		ret.buffer = lut::create_buffer( aAllocator, aSize + aAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, lut::EMemoryClass::device );
+		lut::set_name( aWindow, ret.buffer, "ray shadows: build scratch" );
+		ret.address = align_( address_( aWindow, ret.buffer.buffer ), aAlignment );
+		return ret;
+	}
+
+	// Builds (or scratch reuse) after builds
+	void build_barrier_( VkCommandBuffer aCmdBuff, VkPipelineStageFlags aDstStage = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR )
+	{
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+		vkCmdPipelineBarrier( aCmdBuff, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, aDstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+	}
+}
+
+bool supports_ray_shadows( lut::VulkanWindow const& aWindow )
+{
+	return aWindow.caps.rayQuery;
+}
+
+RayShadows create_ray_shadows( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, ModelPack const& aModel, std::vector<glm::mat4> const& aTransforms )
+{
+	if( aModel.quantizedVertices )
+		throw lut::Error( "Ray-query shadows need fp32 vertices" );
+
+	lut::StartupPhase phase( kBuildPhase );
+
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelProps{};
+	accelProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+
+	VkPhysicalDeviceProperties2 props{};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &accelProps;
+	vkGetPhysicalDeviceProperties2( aWindow.physicalDevice, &props );
+
+	VkDeviceSize const scratchAlignment = std::max<VkDeviceSize>( 1, accelProps.minAccelerationStructureScratchOffsetAlignment );
+
+	VkDeviceAddress const vertices = address_( aWindow, aModel.vertices.buffer );
+	VkDeviceAddress const indices = address_( aWindow, aModel.indices.buffer );
+
+	// One BLAS per distinct mesh geometry
+	std::vector<Blas_> blases;
+	std::vector<std::uint32_t> meshBlas( aModel.meshes.size() );
+	{
+		std::map<GeometryKey_, std::uint32_t> known;
+		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+		{
+			auto const& mesh = aModel.meshes[i];
+			GeometryKey_ const key{ mesh.indexType, mesh.firstIndex, mesh.vertexOffset, mesh.indexCount };
+			if( auto const it = known.find( key ); known.end() != it )
+			{
+				meshBlas[i] = it->second;
+				continue;
+			}
+
+			meshBlas[i] = std::uint32_t(blases.size());
+			known.emplace( key, meshBlas[i] );
+
+			bool const short16 = VK_INDEX_TYPE_UINT16 == mesh.indexType;
+			VkDeviceSize const indexBytes = short16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+
+			Blas_ blas;
+			auto& triangles = blas.geometry.geometry.triangles;
+			triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+			triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT; // InterleavedVertex::position
+			triangles.vertexData.deviceAddress = vertices + VkDeviceSize(mesh.vertexOffset) * sizeof(InterleavedVertex);
+			triangles.vertexStride = sizeof(InterleavedVertex);
+			triangles.maxVertex = mesh.vertexCount > 0 ? mesh.vertexCount - 1 : 0;
+			triangles.indexType = mesh.indexType;
+			triangles.indexData.deviceAddress = indices + (short16 ? 0 : aModel.indices32Offset) + VkDeviceSize(mesh.firstIndex) * indexBytes;
+
+			blas.geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+			blas.geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+			blas.geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+
+			blas.range.primitiveCount = mesh.indexCount / 3;
+			blases.emplace_back( std::move(blas) );
+		}
+	}
+
+	if( blases.empty() )
+		throw lut::Error( "Ray-query shadows: the model has no meshes" );
+
+	auto const blas_info = [] (Blas_ const& aBlas) {
+		VkAccelerationStructureBuildGeometryInfoKHR info{};
+		info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+		info.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+		info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		info.geometryCount = 1;
+		info.pGeometries = &aBlas.geometry;
+		return info;
+	};
+
+	// Sizes, and the uncompacted BLASes, one after the other in a single
+	// buffer
+	VkDeviceSize buildBytes = 0, maxScratch = 0;
+	for( auto& blas : blases )
+	{
+		auto const info = blas_info( blas );
+
+		blas.sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+		vkGetAccelerationStructureBuildSizesKHR( aWindow.device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &info, &blas.range.primitiveCount, &blas.sizes );
+
+		blas.offset = buildBytes;
+		buildBytes = align_( buildBytes + blas.sizes.accelerationStructureSize, kStructureAlignment );
+		maxScratch = std::max( maxScratch, align_( blas.sizes.buildScratchSize, scratchAlignment ) );
+	}
+
+	RayShadows ret;
+	ret.buildBytes = buildBytes;
+
+	lut::Buffer buildStorage = lut::create_buffer( aAllocator, buildBytes, kStorageUsage, lut::EMemoryClass::device );
+	lut::set_name( aWindow, buildStorage, "ray shadows: uncompacted BLASes" );
+
+	for( auto& blas : blases )
+		blas.build = create_structure_( aWindow, buildStorage.buffer, blas.offset, blas.sizes.accelerationStructureSize, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR );
+
+	Scratch_ const scratch = create_scratch_( aWindow, aAllocator, std::max( maxScratch, kRayScratchBudget ), scratchAlignment );
+
+	VkQueryPoolCreateInfo queryInfo{};
+	queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+	queryInfo.queryCount = std::uint32_t(blases.size());
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	if( auto const res = vkCreateQueryPool( aWindow.device, &queryInfo, nullptr, &queryPool ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to create compacted size query pool\n" "vkCreateQueryPool() returned %s", lut::to_string(res).c_str() );
+
+	lut::QueryPool const queries( aWindow.device, queryPool );
+
+	// Build. As many BLASes at once as fit into the scratch budget, each in
+	// its own part of the scratch buffer; the next round reuses it.
+	auto const buildStart = lut::StartupClock::now();
+	{
+		lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+		VkCommandBuffer const cmd = batch.commands();
+
+		vkCmdResetQueryPool( cmd, queries.handle, 0, queryInfo.queryCount );
+
+		std::vector<VkAccelerationStructureBuildGeometryInfoKHR> infos;
+		std::vector<VkAccelerationStructureBuildRangeInfoKHR const*> ranges;
+		VkDeviceSize scratchUsed = 0;
+
+		auto const flush = [&] {
+			if( infos.empty() )
+				return;
+
+			vkCmdBuildAccelerationStructuresKHR( cmd, std::uint32_t(infos.size()), infos.data(), ranges.data() );
+			build_barrier_( cmd );
+
+			infos.clear();
+			ranges.clear();
+			scratchUsed = 0;
+		};
+
+		for( auto const& blas : blases )
+		{
+			VkDeviceSize const scratchBytes = align_( blas.sizes.buildScratchSize, scratchAlignment );
+			if( scratchUsed + scratchBytes > std::max( maxScratch, kRayScratchBudget ) )
+				flush();
+
+			auto info = blas_info( blas );
+			info.dstAccelerationStructure = blas.build.handle;
+			info.scratchData.deviceAddress = scratch.address + scratchUsed;
+			scratchUsed += scratchBytes;
+
+			infos.emplace_back( info );
+			ranges.emplace_back( &blas.range );
+		}
+		flush();
+
+		std::vector<VkAccelerationStructureKHR> handles;
+		for( auto const& blas : blases )
+			handles.emplace_back( blas.build.handle );
+
+		vkCmdWriteAccelerationStructuresPropertiesKHR( cmd, std::uint32_t(handles.size()), handles.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queries.handle, 0 );
+
+		batch.submit().wait();
+	}
+	lut::add_startup_item( kBuildPhase, "BLAS build", lut::StartupClock::now() - buildStart, buildBytes );
+
+	// Compaction, into a single buffer again
+	std::vector<VkDeviceSize> compactedSizes( blases.size() );
+	if( auto const res = vkGetQueryPoolResults( aWindow.device, queries.handle, 0, queryInfo.queryCount, compactedSizes.size() * sizeof(VkDeviceSize), compactedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT ); VK_SUCCESS != res )
+		throw lut::Error( "Unable to get compacted acceleration structure sizes\n" "vkGetQueryPoolResults() returned %s", lut::to_string(res).c_str() );
+
+	std::vector<VkDeviceSize> compactedOffsets( blases.size() );
+	VkDeviceSize compactedBytes = 0;
+	for( std::size_t i = 0; i < blases.size(); ++i )
+	{
+		compactedOffsets[i] = compactedBytes;
+		compactedBytes = align_( compactedBytes + compactedSizes[i], kStructureAlignment );
+	}
+	ret.compactedBytes = compactedBytes;
+
+	ret.blasStorage = lut::create_buffer( aAllocator, compactedBytes, kStorageUsage, lut::EMemoryClass::device );
+	lut::set_name( aWindow, ret.blasStorage, "ray shadows: BLASes" );
+
+	for( std::size_t i = 0; i < blases.size(); ++i )
+		ret.blases.emplace_back( create_structure_( aWindow, ret.blasStorage.buffer, compactedOffsets[i], compactedSizes[i], VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR ) );
+
+	// Instances: every mesh once per model instance. The model's transforms
+	// are column-major 4x4; the instances take the top three rows.
+	ret.instanceCount = std::uint32_t(aModel.meshes.size() * aTransforms.size());
+	ret.instances = lut::create_buffer( aAllocator, std::max<VkDeviceSize>( 1, ret.instanceCount ) * sizeof(VkAccelerationStructureInstanceKHR),
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+		lut::EMemoryClass::upload, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+	lut::set_name( aWindow, ret.instances, "ray shadows: TLAS instances" );
+	{
+		std::vector<VkDeviceAddress> blasAddresses;
+		for( auto const& blas : ret.blases )
+			blasAddresses.emplace_back( address_( aWindow, blas.handle ) );
+
+		auto* const dst = reinterpret_cast<VkAccelerationStructureInstanceKHR*>( lut::mapped_data( aAllocator, ret.instances ) );
+		std::size_t n = 0;
+		for( auto const& transform : aTransforms )
+		{
+			for( std::size_t i = 0; i < aModel.meshes.size(); ++i, ++n )
+			{
+				auto const& mesh = aModel.meshes[i];
+				bool const alpha = mesh.matID < aModel.hostMaterials.size() && kNoTexture != aModel.hostMaterials[mesh.matID].alphaMask;
+
+				VkAccelerationStructureInstanceKHR inst{};
+				for( int row = 0; row < 3; ++row )
+				{
+					for( int col = 0; col < 4; ++col )
+						inst.transform.matrix[row][col] = transform[col][row];
+				}
+				inst.instanceCustomIndex = std::uint32_t(i);
+				inst.mask = alpha ? kRayMaskAlpha : kRayMaskOpaque;
+				inst.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+				inst.accelerationStructureReference = blasAddresses[meshBlas[i]];
+
+				std::memcpy( dst + n, &inst, sizeof(inst) );
+			}
+		}
+		vmaFlushAllocation( aAllocator.allocator, ret.instances.allocation, 0, VK_WHOLE_SIZE );
+	}
+
+	// TLAS sizes
+	VkAccelerationStructureGeometryKHR tlasGeometry{};
+	tlasGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+	tlasGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+	tlasGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+	tlasGeometry.geometry.instances.data.deviceAddress = address_( aWindow, ret.instances.buffer );
+
+	VkAccelerationStructureBuildGeometryInfoKHR tlasInfo{};
+	tlasInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+	tlasInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+	tlasInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+	tlasInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+	tlasInfo.geometryCount = 1;
+	tlasInfo.pGeometries = &tlasGeometry;
+
+	VkAccelerationStructureBuildSizesInfoKHR tlasSizes{};
+	tlasSizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+	vkGetAccelerationStructureBuildSizesKHR( aWindow.device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &tlasInfo, &ret.instanceCount, &tlasSizes );
+
+	ret.tlasStorage = lut::create_buffer( aAllocator, tlasSizes.accelerationStructureSize, kStorageUsage, lut::EMemoryClass::device );
+	lut::set_name( aWindow, ret.tlasStorage, "ray shadows: TLAS" );
+	ret.tlas = create_structure_( aWindow, ret.tlasStorage.buffer, 0, tlasSizes.accelerationStructureSize, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR );
+	lut::set_name( aWindow, ret.tlas, "ray shadows TLAS" );
+
+	Scratch_ const tlasScratch = create_scratch_( aWindow, aAllocator, tlasSizes.buildScratchSize, scratchAlignment );
+	tlasInfo.dstAccelerationStructure = ret.tlas.handle;
+	tlasInfo.scratchData.deviceAddress = tlasScratch.address;
+
+	// Compaction and TLAS build; the fragment shaders read the TLAS after
+	// the batch has completed
+	auto const compactStart = lut::StartupClock::now();
+	{
+		lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+		VkCommandBuffer const cmd = batch.commands();
+
+		for( std::size_t i = 0; i < blases.size(); ++i )
+		{
+			VkCopyAccelerationStructureInfoKHR copyInfo{};
+			copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+			copyInfo.src = blases[i].build.handle;
+			copyInfo.dst = ret.blases[i].handle;
+			copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+			vkCmdCopyAccelerationStructureKHR( cmd, &copyInfo );
+		}
+		build_barrier_( cmd );
+
+		VkAccelerationStructureBuildRangeInfoKHR tlasRange{};
+		tlasRange.primitiveCount = ret.instanceCount;
+		VkAccelerationStructureBuildRangeInfoKHR const* tlasRanges = &tlasRange;
+		vkCmdBuildAccelerationStructuresKHR( cmd, 1, &tlasInfo, &tlasRanges );
+		build_barrier_( cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+
+		batch.submit().wait();
+	}
+	lut::add_startup_item( kBuildPhase, "BLAS compaction and TLAS build", lut::StartupClock::now() - compactStart, compactedBytes + tlasSizes.accelerationStructureSize );
+
+	std::fprintf( stderr, "Info: ray-query shadows: %zu BLASes for %zu meshes, %.1f MiB compacted from %.1f MiB; %u TLAS instances\n",
+		ret.blases.size(), aModel.meshes.size(), double(compactedBytes) / (1024.*1024.), double(buildBytes) / (1024.*1024.), ret.instanceCount );
+
+	return ret;
+}
@@ -0,0 +1,84 @@
+#ifndef RAY_SHADOWS_HPP_8E2C51F4_3B7A_4D19_A6E0_C94F12D7B835
+#define RAY_SHADOWS_HPP_8E2C51F4_3B7A_4D19_A6E0_C94F12D7B835
+
+// Ray-query shadows (--shadows=ray-query), in place of the cached shadow
+// cube of shadows.hpp. The forward fragment shaders trace one ray from the
+// shaded point towards the light (see shadows.glsl, RAY_QUERY_SHADOWS), so
+// the shadows cost the same whether the light moves or not, and there are
+// no shadow passes over the geometry at all.
+//
+// The rays are traced against acceleration structures that are built once,
+// at load time: a bottom-level structure (BLAS) per Mesh, from the model's
+// vertex and index buffers, and a top-level one (TLAS) with an instance of
+// every mesh per model instance (see set_model_instances()). The BLASes are
+// compacted after their build (to about half their size, typically), and
+// meshes that share their geometry share their BLAS. The build is timed in
+// the start-up report ("acceleration structures").
+//
+// The scene is static, so nothing is refit or rebuilt after the load. Not
+// with world streaming, whose meshes move within the geometry buffers; the
+// caller falls back to the shadow cube there.
+//
+// Note: the alpha-masked meshes cast no shadows (their TLAS instances have
+// kRayMaskAlpha, which the shadow rays skip). Alpha testing them would take
+// a candidate loop that reads the material's alpha texture per hit, which
+// the per-material descriptor sets can't offer.
+
+#include <vector>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/mat4x4.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// Instance masks; must match shadows.glsl
+constexpr std::uint32_t kRayMaskOpaque = 0x01;
+constexpr std::uint32_t kRayMaskAlpha = 0x02;
+
+// Largest scratch memory of the BLAS builds that run at once; more
+// geometry is built in several rounds that reuse the scratch buffer
+constexpr VkDeviceSize kRayScratchBudget = VkDeviceSize(128) << 20;
+
+struct RayShadows
+{
+	// The compacted BLASes, placed one after the other in blasStorage
+	lut::Buffer blasStorage;
+	std::vector<lut::AccelerationStructure> blases;
+
+	lut::Buffer tlasStorage;
+	lut::AccelerationStructure tlas; // bound to the scene's set 0 (binding 13)
+
+	// VkAccelerationStructureInstanceKHR[]; the input of the TLAS build
+	lut::Buffer instances;
+	std::uint32_t instanceCount = 0;
+
+	VkDeviceSize buildBytes = 0; // of the BLASes before compaction
+	VkDeviceSize compactedBytes = 0;
+};
+
+// Whether the device has ray queries (see lut::DeviceCapabilities::rayQuery)
+bool supports_ray_shadows( lut::VulkanWindow const& );
+
+// Builds the acceleration structures of aModel, with aTransforms as from
+// set_model_instances(). aModel must have fp32 vertices (the quantized
+// positions are not a format that the builds need to support), and its
+// geometry must be uploaded. Uses aCmdPool for the builds, and waits for
+// them to complete.
+RayShadows create_ray_shadows(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	ModelPack const& aModel,
+	std::vector<glm::mat4> const& aTransforms
+);
+
+#endif // RAY_SHADOWS_HPP_8E2C51F4_3B7A_4D19_A6E0_C94F12D7B835
@@ -0,0 +1,227 @@
+#include "scene.hpp"
+
+#include <utility>
+#include <filesystem>
+
+#include "../labutils/error.hpp"
+#include "../labutils/cpu_zones.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// The five texture slots of a material
+	template< typename tFn >
+	void for_each_texture_id_( BakedMaterialInfo& aMaterial, tFn&& aFn )
+	{
+		for( auto* id : { &aMaterial.baseColorTextureId, &aMaterial.roughnessTextureId, &aMaterial.metalnessTextureId, &aMaterial.alphaMaskTextureId, &aMaterial.normalMapTextureId } )
+		{
+			if( kBakedNoTexture != *id )
+				aFn( *id );
+		}
+	}
+}
+
+Scene::ModelId Scene::load( char const* aPath )
+{
+	LUT_CPU_ZONE( "Scene::load()" );
+
+	BakedModel model = load_baked_model( aPath );
+
+	for( auto& material : model.materials )
+	{
+		for_each_texture_id_( material, [&] (std::uint32_t aId) {
+			if( aId >= model.textures.size() )
+				throw lut::Error( "'%s': material refers to texture %u of %zu", aPath, aId, model.textures.size() );
+		} );
+	}
+
+	// Nothing below throws (other than std::bad_alloc)
+	std::vector<std::uint32_t> slots;
+	slots.reserve( model.textures.size() );
+	for( auto& texture : model.textures )
+	{
+		// Paths are relative to their model's file; normalize them, so that
+		// models in different directories find each other's textures
+		auto const key = std::filesystem::path( texture.path ).lexically_normal().generic_string();
+
+		auto const it = mTexturesByPath.find( key );
+		if( mTexturesByPath.end() != it )
+		{
+			++mTextures[it->second].refs;
+			slots.emplace_back( it->second );
+			continue;
+		}
+
+		std::uint32_t slot;
+		if( !mFreeTextures.empty() )
+		{
+			slot = mFreeTextures.back();
+			mFreeTextures.pop_back();
+		}
+		else
+		{
+			slot = std::uint32_t(mTextures.size());
+			mTextures.emplace_back();
+		}
+
+		mTextures[slot].info = std::move(texture);
+		mTextures[slot].refs = 1;
+		mTexturesByPath.emplace( key, slot );
+		slots.emplace_back( slot );
+	}
+
+	for( auto& material : model.materials )
+		for_each_texture_id_( material, [&] (std::uint32_t& aId) { aId = slots[aId]; } );
+	for( auto& impostor : model.impostors.meshes )
+	{
+		for( auto* id : { &impostor.albedo, &impostor.normalDepth } )
+		{
+			if( kBakedNoTexture != *id )
+				*id = slots[*id];
+		}
+	}
+	model.textures.clear();
+
+	auto& entry = mModels.emplace_back();
+	entry.path = aPath;
+	entry.model = std::move(model);
+	entry.textures = std::move(slots);
+	entry.loaded = true;
+	return ModelId(mModels.size() - 1);
+}
+
+void Scene::unload( ModelId aId )
+{
+	if( aId >= mModels.size() || !mModels[aId].loaded )
+		throw lut::Error( "Scene::unload(): model %u isn't loaded", aId );
+
+	auto& entry = mModels[aId];
+	for( auto const slot : entry.textures )
+	{
+		auto& texture = mTextures[slot];
+		if( 0 != --texture.refs )
+			continue;
+
+		for( auto it = mTexturesByPath.begin(); mTexturesByPath.end() != it; ++it )
+		{
+			if( slot == it->second )
+			{
+				mTexturesByPath.erase( it );
+				break;
+			}
+		}
+
+		texture.info = BakedTextureInfo{};
+		mFreeTextures.emplace_back( slot );
+	}
+
+	entry.model = BakedModel{};
+	entry.textures.clear();
+	entry.loaded = false;
+}
+
+std::size_t Scene::model_count() const noexcept
+{
+	std::size_t count = 0;
+	for( auto const& entry : mModels )
+		count += entry.loaded ? 1 : 0;
+	return count;
+}
+
+std::size_t Scene::texture_count() const noexcept
+{
+	return mTextures.size() - mFreeTextures.size();
+}
+
+std::size_t Scene::texture_references() const noexcept
+{
+	std::size_t count = 0;
+	for( auto const& texture : mTextures )
+		count += texture.refs;
+	return count;
+}
+
+BakedModel Scene::merge() const&
+{
+	return merge_( nullptr );
+}
+BakedModel Scene::merge() &&
+{
+	auto ret = merge_( &mModels );
+	*this = Scene{};
+	return ret;
+}
+
+BakedModel Scene::merge_( std::vector<Model_>* aTake ) const
+{
+	LUT_CPU_ZONE( "Scene::merge()" );
+
+	if( 0 == model_count() )
+		throw lut::Error( "Scene::merge(): no models loaded" );
+
+	BakedModel ret;
+
+	// Live slots, in slot order
+	std::vector<std::uint32_t> remap( mTextures.size(), kBakedNoTexture );
+	for( std::size_t i = 0; i < mTextures.size(); ++i )
+	{
+		if( 0 == mTextures[i].refs )
+			continue;
+
+		remap[i] = std::uint32_t(ret.textures.size());
+		ret.textures.emplace_back( mTextures[i].info );
+	}
+
+	for( std::size_t m = 0; m < mModels.size(); ++m )
+	{
+		auto const& entry = mModels[m];
+		if( !entry.loaded )
+			continue;
+
+		auto const materialBase = std::uint32_t(ret.materials.size());
+		for( auto material : entry.model.materials )
+		{
+			for_each_texture_id_( material, [&] (std::uint32_t& aId) { aId = remap[aId]; } );
+			ret.materials.emplace_back( std::move(material) );
+		}
+
+		// Impostors of one grid only; the meshes of the other models have none
+		auto const& impostors = entry.model.impostors;
+		if( !impostors.meshes.empty() && 0 == ret.impostors.grid )
+		{
+			ret.impostors.grid = impostors.grid;
+			ret.impostors.meshes.resize( ret.meshes.size() );
+		}
+		if( 0 != ret.impostors.grid )
+		{
+			for( std::size_t i = 0; i < entry.model.meshes.size(); ++i )
+			{
+				BakedImpostor impostor{};
+				if( impostors.grid == ret.impostors.grid )
+				{
+					impostor = impostors.meshes[i];
+					for( auto* id : { &impostor.albedo, &impostor.normalDepth } )
+					{
+						if( kBakedNoTexture != *id )
+							*id = remap[*id];
+					}
+				}
+				ret.impostors.meshes.emplace_back( impostor );
+			}
+		}
+
+		auto const fileName = std::filesystem::path( entry.path ).filename().string();
+		for( std::size_t i = 0; i < entry.model.meshes.size(); ++i )
+		{
+			auto& mesh = aTake
+				? ret.meshes.emplace_back( std::move( (*aTake)[m].model.meshes[i] ) )
+				: ret.meshes.emplace_back( entry.model.meshes[i] )
+			;
+			mesh.materialId += materialBase;
+			if( !mesh.name.empty() )
+				mesh.name = fileName + ": " + mesh.name;
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,80 @@
+#ifndef SCENE_HPP_5A0C3E82_D619_4B7F_8E24_C1F96B3D07A5
+#define SCENE_HPP_5A0C3E82_D619_4B7F_8E24_C1F96B3D07A5
+
+// Scenes of several baked models (--model). The models are loaded into a
+// catalogue, and merged into one BakedModel for set_up_model(): their
+// meshes and materials one after the other, so that they share the
+// ModelPack's geometry buffers, draw commands and culling, and their
+// textures deduplicated by path, so that a texture that several models
+// use is uploaded (and bound) once.
+//
+// The texture table is reference counted: each model holds one reference
+// to each of the textures it uses. Unloading a model drops its references;
+// textures stay as long as another model uses them, and keep their slot
+// (slots are only reused once free), so the remaining models' textures
+// don't move between merges.
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "baked_model.hpp"
+
+class Scene
+{
+	public:
+		using ModelId = std::uint32_t;
+
+	public:
+		// Loads aPath with load_baked_model(). Throws labutils::Error on
+		// failure; the scene is unchanged then.
+		ModelId load( char const* aPath );
+
+		// Throws labutils::Error if aId isn't loaded.
+		void unload( ModelId aId );
+
+		// Loaded models, in the order of load()
+		std::size_t model_count() const noexcept;
+		// Distinct textures of the loaded models
+		std::size_t texture_count() const noexcept;
+		// Textures of the loaded models, counting each model's own
+		std::size_t texture_references() const noexcept;
+
+		// The loaded models as one (see above); their mesh names get a
+		// "file: " prefix, and it has no BVH or PVS (the models' cover
+		// their own meshes only). Impostors are kept, those of the first
+		// model's grid. Throws labutils::Error if the scene is empty.
+		BakedModel merge() const&;
+		// As above, but moves the meshes out instead of copying them, so
+		// that the geometry isn't held twice; the scene is left empty.
+		BakedModel merge() &&;
+
+	private:
+		struct Model_
+		{
+			std::string path;
+			BakedModel model; // textures empty; the materials' IDs index mTextures
+			std::vector<std::uint32_t> textures; // one reference to each
+			bool loaded = false;
+		};
+
+		struct Texture_
+		{
+			BakedTextureInfo info;
+			std::uint32_t refs = 0; // 0: free slot
+		};
+
+		std::vector<Model_> mModels; // by ModelId
+		std::vector<Texture_> mTextures;
+		std::vector<std::uint32_t> mFreeTextures;
+		std::unordered_map<std::string, std::uint32_t> mTexturesByPath;
+
+	private:
+		// aTake: mModels, to move the meshes out of; null to copy them
+		BakedModel merge_( std::vector<Model_>* aTake ) const;
+};
+
+#endif // SCENE_HPP_5A0C3E82_D619_4B7F_8E24_C1F96B3D07A5
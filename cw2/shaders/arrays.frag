@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default.frag for texture arrays (--materials=arrays)
+layout(early_fragment_tests) in;
+
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
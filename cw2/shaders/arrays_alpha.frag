@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default_alpha.frag for texture arrays (--materials=arrays)
+#define ALPHA_MASK
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// default_alpha_fp16.frag for texture arrays (--materials=arrays)
+#define ALPHA_MASK
+#define HALF_PRECISION
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
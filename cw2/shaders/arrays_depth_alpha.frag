@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// depth_alpha.frag for texture arrays (--materials=arrays)
+#include "material.glsl"
+
+// Pushed per material, with the layers of its textures in place of their
+// indices (see ModelPack::arrayMaterials)
+layout(push_constant) uniform UMaterial
+{
+	layout(offset = 64) Material material; // kMaterialPushOffset
+}uMaterial;
+
+layout(set = 1, binding = 4) uniform sampler2DArray alphaMaskTex;
+
+layout( location = 0 ) in vec2 v2fTexCoords;
+
+void main()
+{
+    Material mat = uMaterial.material;
+    if (sampleSlot(alphaMaskTex, mat.alphaMask, v2fTexCoords)[mat.alphaChannel] < 0.5f)
+        discard;
+}
@@ -0,0 +1,10 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// default_fp16.frag for texture arrays (--materials=arrays)
+layout(early_fragment_tests) in;
+
+#define HALF_PRECISION
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// gbuffer.frag for texture arrays (--materials=arrays)
+layout(early_fragment_tests) in;
+
+#define GBUFFER
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
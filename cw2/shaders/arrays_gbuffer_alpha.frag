@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// gbuffer_alpha.frag for texture arrays (--materials=arrays)
+#define ALPHA_MASK
+#define GBUFFER
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// gbuffer_alpha_qtangent.frag for texture arrays (--materials=arrays)
+#define TANGENT_QUATERNION
+#define ALPHA_MASK
+#define GBUFFER
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
@@ -0,0 +1,10 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// gbuffer_qtangent.frag for texture arrays (--materials=arrays)
+layout(early_fragment_tests) in;
+
+#define TANGENT_QUATERNION
+#define GBUFFER
+#define TEXTURE_ARRAYS
+#include "default_frag.glsl"
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Opaque materials: never discards, so depth is always tested (and written)
+// before shading.
+layout(early_fragment_tests) in;
+
+#include "bindless_frag.glsl"
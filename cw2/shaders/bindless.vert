@@ -0,0 +1,5 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// fp32 vertices from the vertex input
+#include "bindless_vert.glsl"
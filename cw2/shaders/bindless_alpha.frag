@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// bindless.frag for alpha-masked materials
+#define ALPHA_MASK
+#include "bindless_frag.glsl"
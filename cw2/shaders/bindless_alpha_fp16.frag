@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// bindless_alpha.frag with fp16 shading (--precision=fp16)
+#define ALPHA_MASK
+#define HALF_PRECISION
+#include "bindless_frag.glsl"
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// bindless_alpha.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+#define TANGENT_QUATERNION
+#define ALPHA_MASK
+#include "bindless_frag.glsl"
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// depth_alpha.frag for bindless materials (--materials=bindless)
+#include "material.glsl"
+
+layout(std430, set = 1, binding = 0) readonly buffer UMaterials
+{
+	Material materials[];
+}uMaterials;
+
+layout(set = 1, binding = 1) uniform sampler2D uTextures[];
+
+layout( location = 0 ) in vec2 v2fTexCoords;
+layout( location = 4 ) flat in uint v2fMaterial;
+
+void main()
+{
+    Material mat = uMaterials.materials[v2fMaterial];
+    if (texture(uTextures[nonuniformEXT(mat.alphaMask)], v2fTexCoords)[mat.alphaChannel] < 0.5f)
+        discard;
+}
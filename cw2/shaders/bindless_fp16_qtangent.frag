@@ -0,0 +1,12 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// bindless_fp16.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+layout(early_fragment_tests) in;
+
+#define TANGENT_QUATERNION
+#define HALF_PRECISION
+#include "bindless_frag.glsl"
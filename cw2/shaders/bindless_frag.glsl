@@ -0,0 +1,137 @@
+// Body of bindless*.frag. Included via #include; define ALPHA_MASK first to
+// discard texels with alpha < 0.5, GBUFFER to write the G-buffer instead of
+// shading, HALF_PRECISION for fp16 shading, TANGENT_QUATERNION for
+// *_qtangent.vert's tangent frame.
+
+#include "material.glsl"
+#include "mip_feedback.glsl"
+
+layout(std430, set = 1, binding = 0) readonly buffer UMaterials
+{
+	Material materials[];
+}uMaterials;
+
+layout(set = 1, binding = 1) uniform sampler2D uTextures[];
+
+#include "virtual_textures.glsl"
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+    vec3 lightPos;
+    vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) in vec2 v2fTexCoords;
+#ifdef TANGENT_QUATERNION
+layout( location = 1 ) in vec4 v2fTangentFrame;
+#else
+layout( location = 1 ) in vec3 v2fNormal;
+layout( location = 3 ) in vec4 v2fTangent;
+#endif
+layout( location = 2 ) in vec3 v2fPosition;
+#ifndef GBUFFER
+layout( location = 5 ) in float v2fOcclusion; // see vertex_occlusion.glsl
+#endif
+layout( location = 4 ) flat in uint v2fMaterial;
+
+#ifdef GBUFFER
+#include "gbuffer.glsl"
+
+layout( location = 0 ) out vec4 oAlbedoMetalness;
+layout( location = 1 ) out vec4 oNormalRoughness;
+#else
+layout( location = 0 ) out vec4 oColor;
+#endif
+
+// Pipeline permutation features (see EPipelineFeature in main.cpp); the
+// defaults are used if the pipeline doesn't specialize them
+layout( constant_id = 1 ) const bool kNormalMapping = true;
+// MSAA: alpha masking by alpha-to-coverage, with the alpha sharpened to a
+// ramp about a pixel wide around the cut-off (ALPHA_MASK only)
+layout( constant_id = 4 ) const bool kAlphaToCoverage = false;
+
+#include "shading.glsl"
+#ifdef TANGENT_QUATERNION
+#include "tangent_frame.glsl"
+#endif
+#ifndef GBUFFER
+#include "point_lights.glsl"
+#endif
+#include "debug_views.glsl"
+
+
+void main() {
+    Material mat = uMaterials.materials[v2fMaterial];
+
+    // Before the alpha test's discard (derivatives)
+    if (kMipFeedback)
+        writeMipFeedback(mat, v2fTexCoords);
+    if (kDebugViews)
+    {
+        countDebugFragment();
+        if (kNoTexture != mat.baseColor)
+            countDebugMipLevel(textureQueryLod(uTextures[nonuniformEXT(mat.baseColor)], v2fTexCoords).y);
+    }
+
+    // A single multi-draw covers many materials, so the index is not
+    // guaranteed to be dynamically uniform. Constant slots skip their fetch
+    // (the material is the same within each primitive, and so within quads).
+    vec4 baseColor = mat.baseColorConstant;
+    if (kNoTexture != mat.baseColor)
+        baseColor = sampleMaterialTexture(mat.baseColor, v2fTexCoords);
+
+    //alpha masking
+#ifdef ALPHA_MASK
+    if (kAlphaToCoverage)
+    {
+        baseColor.a = clamp((baseColor.a - 0.5) / max(fwidth(baseColor.a), 1e-4) + 0.5, 0.0, 1.0);
+        if (baseColor.a <= 0.0) discard;
+    }
+    else if(baseColor.a < 0.5f) discard; 
+#endif
+
+    // Roughness (R) and metalness (G) share one texture; either may be
+    // constant
+    float roughness = mat.roughnessConstant;
+    float metalness = mat.metalnessConstant;
+    if (kNoTexture != mat.roughness || kNoTexture != mat.metalness)
+    {
+        uint rmIndex = kNoTexture != mat.roughness ? mat.roughness : mat.metalness;
+        vec2 rm = sampleMaterialTexture(rmIndex, v2fTexCoords).rg;
+        if (kNoTexture != mat.roughness)
+            roughness = rm.r;
+        if (kNoTexture != mat.metalness)
+            metalness = rm.g;
+    }
+
+    vec3 normalFromMap = vec3(0.0, 0.0, 1.0);
+    if (kNormalMapping && kNoTexture != mat.normalMap)
+        normalFromMap = decodeNormalMap(sampleMaterialTexture(mat.normalMap, v2fTexCoords).rg);
+
+#ifdef TANGENT_QUATERNION
+    vec3 normal;
+    vec4 tangent;
+    decodeTangentFrame(v2fTangentFrame, normal, tangent);
+#else
+    vec3 normal = v2fNormal;
+    vec4 tangent = v2fTangent;
+#endif
+    vec3 N = surfaceNormal(normalFromMap, normal, tangent);
+
+#ifdef GBUFFER
+    oAlbedoMetalness = vec4(baseColor.rgb, metalness);
+    oNormalRoughness = vec4(gbufferEncodeNormal(N), roughness, 0.0);
+#else
+    vec3 result = shadeAt(baseColor.rgb, roughness, metalness, N, v2fPosition, v2fOcclusion)
+        + shadePointLights(baseColor.rgb, roughness, metalness, N, v2fPosition, gl_FragCoord.xy);
+
+    oColor = vec4(result, baseColor.a);
+
+    if (kDebugViews)
+        countDebugShading(mat, v2fPosition);
+#endif
+}
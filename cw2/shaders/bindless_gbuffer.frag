@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// bindless.frag writing the G-buffer (--lighting=deferred)
+layout(early_fragment_tests) in;
+
+#define GBUFFER
+#include "bindless_frag.glsl"
@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// bindless_alpha.frag writing the G-buffer (--lighting=deferred)
+#define ALPHA_MASK
+#define GBUFFER
+#include "bindless_frag.glsl"
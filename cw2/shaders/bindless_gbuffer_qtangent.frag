@@ -0,0 +1,11 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// bindless_gbuffer.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+layout(early_fragment_tests) in;
+
+#define TANGENT_QUATERNION
+#define GBUFFER
+#include "bindless_frag.glsl"
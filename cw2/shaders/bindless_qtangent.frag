@@ -0,0 +1,10 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// bindless.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+layout(early_fragment_tests) in;
+
+#define TANGENT_QUATERNION
+#include "bindless_frag.glsl"
@@ -0,0 +1,54 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// bindless.vert passing the tangent frame as a quaternion (--tangent-frame=quaternion)
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec2 iTexCoord;
+layout( location = 2 ) in vec3 iNormal;
+layout( location = 3 ) in vec4 iTangent;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+// Per draw (glsl::DrawPushConstants in main.cpp)
+layout( push_constant ) uniform UDraw
+{
+	uint material;
+}uDraw;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 1 ) out vec4 v2fTangentFrame; // see tangent_frame.glsl
+layout( location = 2 ) out vec3 v2fPosition;
+layout( location = 4 ) flat out uint v2fMaterial;
+layout( location = 5 ) out float v2fOcclusion;
+
+// Must match depth.vert for the EQUAL depth test after the pre-pass
+invariant gl_Position;
+
+#include "tangent_frame.glsl"
+#include "instances.glsl"
+#include "vertex_occlusion.glsl"
+
+void main()
+{
+	mat4 instance = instanceTransform();
+	vec4 position = instance * vec4(iPosition, 1.0f);
+
+	v2fTangentFrame = encodeTangentFrame( mat3(instance) * iNormal, vec4(mat3(instance) * iTangent.xyz, iTangent.w) );
+	v2fPosition = position.xyz;
+	v2fTexCoords = iTexCoord;
+
+	// Direct draws push the material index; indirect ones pass it in the
+	// draw's firstInstance (see instanceKey()) and push ~0u.
+	v2fMaterial = 0xffffffffu != uDraw.material ? uDraw.material : instanceKey();
+
+	v2fOcclusion = vertexOcclusion();
+	gl_Position = uScene.projCam * position;
+}
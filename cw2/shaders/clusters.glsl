@@ -0,0 +1,21 @@
+// Cluster grid of the point lights (see cw2/clusters.hpp). Included via
+// #include. The view frustum is split into kClusterGridX x kClusterGridY
+// screen tiles and kClusterGridZ slices, exponentially spaced in view depth;
+// each cluster lists up to kMaxLightsPerCluster lights.
+
+const uint kClusterGridX = 16;
+const uint kClusterGridY = 9;
+const uint kClusterGridZ = 24;
+const uint kClusterCount = kClusterGridX * kClusterGridY * kClusterGridZ;
+
+const uint kMaxLightsPerCluster = 128;
+
+// aTileScale: clusters per pixel; slice = log(depth) * aSliceScale + aSliceBias
+uint clusterIndex(vec2 aFragCoord, float aViewDepth, vec2 aTileScale, float aSliceScale, float aSliceBias)
+{
+	uint x = min(uint(aFragCoord.x * aTileScale.x), kClusterGridX - 1);
+	uint y = min(uint(aFragCoord.y * aTileScale.y), kClusterGridY - 1);
+	float slice = log(max(aViewDepth, 1e-6)) * aSliceScale + aSliceBias;
+	uint z = uint(clamp(slice, 0.0, float(kClusterGridZ - 1)));
+	return (z * kClusterGridY + y) * kClusterGridX + x;
+}
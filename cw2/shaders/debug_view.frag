@@ -0,0 +1,39 @@
+#version 450
+
+// A debug view (see cw2/debug_views.hpp) over the presented image: one layer
+// of the fragment cost counters, as a heat map from black (0) through blue,
+// green and yellow to red (uView.range and above). Drawn with deferred.vert's
+// full-screen triangle.
+layout( r32ui, set = 0, binding = 0 ) uniform readonly uimage2DArray uCounters;
+
+layout( push_constant ) uniform PView
+{
+	vec2 renderScale; // render area / presented image (dynamic resolution)
+	uint layer;
+	float invRange; // 1 / the count shown in red, in the layer's units
+}uView;
+
+layout( location = 0 ) out vec4 oColor;
+
+vec3 heat( float t )
+{
+	const vec3 kStops[5] = vec3[5](
+		vec3( 0.0, 0.0, 0.0 ),
+		vec3( 0.0, 0.2, 1.0 ),
+		vec3( 0.0, 1.0, 0.2 ),
+		vec3( 1.0, 1.0, 0.0 ),
+		vec3( 1.0, 0.0, 0.0 )
+	);
+
+	float x = clamp( t, 0.0, 1.0 ) * 4.0;
+	int i = min( int( x ), 3 );
+	return mix( kStops[i], kStops[i + 1], x - float( i ) );
+}
+
+void main()
+{
+	ivec2 pixel = ivec2( gl_FragCoord.xy * uView.renderScale );
+	uint count = imageLoad( uCounters, ivec3( pixel, int( uView.layer ) ) ).r;
+
+	oColor = vec4( heat( float( count ) * uView.invRange ), 1.0 );
+}
@@ -0,0 +1,84 @@
+// Fragment cost counters of the debug views (see cw2/debug_views.hpp).
+// Included via #include after material.glsl, shading.glsl and, unless
+// GBUFFER, point_lights.glsl. Each layer of binding 14 of the scene's set 0
+// accumulates per pixel:
+//   layer 0: fragments shaded (overdraw)
+//   layer 1: lanes shaded, helper lanes included, in kQuadLaneUnits per
+//            lane: each 2x2 quad costs four lanes, shared by its live ones
+//   layer 2: shading work, as texture fetches plus point lights evaluated
+//            (not with GBUFFER; the lighting pass isn't counted)
+//   layer 3: the finest mip level of the base colour textures sampled, as
+//            (kMipLevelRange - level) * kMipLevelUnits + 1, the largest
+//            over the pixel's fragments: 0 without a texture, and the
+//            more the finer, down to magnified texels
+
+// Specialized per pipeline, see EPipelineFeature in main.cpp. The counters
+// are only touched with it; otherwise the code below is specialized away.
+layout( constant_id = 8 ) const bool kDebugViews = false;
+
+// Must match debug_views.hpp
+const uint kQuadLaneUnits = 12; // divisible by 1, 2, 3 and 4 live lanes
+const float kMipLevelRange = 8.0;
+const float kMipLevelUnits = 16.0;
+
+layout( r32ui, set = 0, binding = 14 ) uniform uimage2DArray uDebugCounters;
+
+// Live (non-helper) lanes of the fragment's 2x2 quad, from the fine
+// derivatives of a per-lane flag: the horizontal, vertical and diagonal
+// neighbours' flags are this lane's plus or minus the differences.
+float debugQuadLiveLanes()
+{
+    float live = gl_HelperInvocation ? 0.0 : 1.0;
+    vec2 side = vec2(1.0) - 2.0 * vec2(uvec2(gl_FragCoord.xy) & 1u); // +1 on even, -1 on odd
+    float across = live + side.x * dFdxFine(live);
+    float down = live + side.y * dFdyFine(live);
+    float diagonal = across + side.y * dFdyFine(across);
+    return live + across + down + diagonal;
+}
+
+// Call in uniform control flow, before any discard: the quad's lanes come
+// from derivatives. Helper lanes run it too, but their atomics have no
+// effect.
+void countDebugFragment()
+{
+    uint lanes = uint(debugQuadLiveLanes() + 0.5);
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    imageAtomicAdd(uDebugCounters, ivec3(pixel, 0), 1u);
+    imageAtomicAdd(uDebugCounters, ivec3(pixel, 1), kQuadLaneUnits / max(lanes, 1u));
+}
+
+// Before any discard: aLod is textureQueryLod().y of the base colour texture
+// at the fragment, which is relative to the level 0 of the texture's image
+// (with mip streaming, the finest level streamed in).
+void countDebugMipLevel(float aLod)
+{
+    uint code = uint((kMipLevelRange - clamp(aLod, 0.0, kMipLevelRange)) * kMipLevelUnits) + 1u;
+    imageAtomicMax(uDebugCounters, ivec3(ivec2(gl_FragCoord.xy), 3), code);
+}
+
+// Texture fetches of a material in default*.frag and bindless*.frag
+uint debugMaterialFetches(Material aMat)
+{
+    uint fetches = 0u;
+    if (kNoTexture != aMat.baseColor)
+        ++fetches;
+    if (kNoTexture != aMat.roughness || kNoTexture != aMat.metalness)
+        ++fetches;
+    if (kNormalMapping && kNoTexture != aMat.normalMap)
+        ++fetches;
+    return fetches;
+}
+
+#ifndef GBUFFER
+// After shading, for the fragments that weren't discarded; the lights are
+// those of the cluster shadePointLights() walked.
+void countDebugShading(Material aMat, vec3 aPosition)
+{
+    float viewDepth = -(uScene.camera * vec4(aPosition, 1.0)).z;
+    uint cluster = clusterIndex(gl_FragCoord.xy, viewDepth, uClusters.tileScale, uClusters.sliceScale, uClusters.sliceBias);
+
+    uint work = debugMaterialFetches(aMat) + uClusters.counts[cluster];
+    imageAtomicAdd(uDebugCounters, ivec3(ivec2(gl_FragCoord.xy), 2), work);
+}
+#endif
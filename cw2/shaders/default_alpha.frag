@@ -0,0 +1,6 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default.frag for alpha-masked materials
+#define ALPHA_MASK
+#include "default_frag.glsl"
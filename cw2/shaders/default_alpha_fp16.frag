@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// default_alpha.frag with fp16 shading (--precision=fp16)
+#define ALPHA_MASK
+#define HALF_PRECISION
+#include "default_frag.glsl"
@@ -0,0 +1,10 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// default_alpha_fp16.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+#define TANGENT_QUATERNION
+#define ALPHA_MASK
+#define HALF_PRECISION
+#include "default_frag.glsl"
@@ -0,0 +1,10 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#extension GL_EXT_ray_query : require
+
+// default_alpha_fp16.frag with ray-query shadows (--shadows=ray-query)
+#define ALPHA_MASK
+#define HALF_PRECISION
+#define RAY_QUERY_SHADOWS
+#include "default_frag.glsl"
@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default_alpha.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+#define TANGENT_QUATERNION
+#define ALPHA_MASK
+#include "default_frag.glsl"
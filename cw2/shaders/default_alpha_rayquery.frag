@@ -0,0 +1,8 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_ray_query : require
+
+// default_alpha.frag with ray-query shadows (--shadows=ray-query)
+#define ALPHA_MASK
+#define RAY_QUERY_SHADOWS
+#include "default_frag.glsl"
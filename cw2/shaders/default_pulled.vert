@@ -0,0 +1,6 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default.vert fetching its vertices itself (--vertex-input=pulled)
+#define VERTEX_PULLING
+#include "default_vert.glsl"
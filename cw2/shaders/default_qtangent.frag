@@ -0,0 +1,9 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default.frag with the tangent frame as a quaternion
+// (--tangent-frame=quaternion)
+layout(early_fragment_tests) in;
+
+#define TANGENT_QUATERNION
+#include "default_frag.glsl"
@@ -0,0 +1,45 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default_quantized.vert passing the tangent frame as a quaternion
+layout( location = 0 ) in vec4 iPosition; // unorm16, w = tangent sign
+layout( location = 1 ) in vec2 iTexCoord; // float16
+layout( location = 2 ) in vec2 iNormal;   // octahedral, snorm16
+layout( location = 3 ) in vec2 iTangent;  // octahedral, snorm16
+
+// Per mesh (MeshInstance)
+layout( location = 4 ) in vec3 iBoundsMin;
+layout( location = 5 ) in vec3 iBoundsExtent;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 1 ) out vec4 v2fTangentFrame; // see tangent_frame.glsl
+layout( location = 2 ) out vec3 v2fPosition;
+layout( location = 5 ) out float v2fOcclusion;
+
+// Must match depth_quantized.vert for the EQUAL depth test after the pre-pass
+invariant gl_Position;
+
+#include "quantized.glsl"
+#include "tangent_frame.glsl"
+#include "vertex_occlusion.glsl"
+
+void main()
+{
+	vec3 position = dequantizePosition( iPosition, iBoundsMin, iBoundsExtent );
+
+	v2fTangentFrame = encodeTangentFrame( octahedralDecode( iNormal ), decodeTangent( iTangent, iPosition.w ) );
+	v2fPosition = position;
+	v2fTexCoords = iTexCoord;
+	v2fOcclusion = vertexOcclusion();
+	gl_Position = uScene.projCam * vec4(position, 1.0f);
+}
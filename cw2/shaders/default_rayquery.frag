@@ -0,0 +1,9 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_ray_query : require
+
+// default.frag with ray-query shadows (--shadows=ray-query)
+layout(early_fragment_tests) in;
+
+#define RAY_QUERY_SHADOWS
+#include "default_frag.glsl"
@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_multiview : require
+
+// default.vert drawing both eyes in one multiview pass (--stereo=multiview)
+#define STEREO
+#include "default_vert.glsl"
@@ -0,0 +1,57 @@
+// Body of default.vert, default_pulled.vert and default_stereo.vert. Included via
+// #include; define VERTEX_PULLING to fetch the vertices from the scene's set
+// instead of the vertex input (see vertex_pulling.glsl), and STEREO (with
+// GL_EXT_multiview) to project by the view's eye (see stereo.hpp).
+#ifdef VERTEX_PULLING
+#include "vertex_pulling.glsl"
+#else
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec2 iTexCoord;
+layout( location = 2 ) in vec3 iNormal;
+layout( location = 3 ) in vec4 iTangent;
+#endif
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+#ifdef STEREO
+	mat4 viewProjCam[2]; // per eye
+#endif
+}uScene;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 1 ) out vec3 v2fNormal;
+layout( location = 2 ) out vec3 v2fPosition;
+layout( location = 3 ) out vec4 v2fTangent;
+layout( location = 5 ) out float v2fOcclusion;
+
+// Must match depth.vert for the EQUAL depth test after the pre-pass
+invariant gl_Position;
+
+#include "instances.glsl"
+#include "vertex_occlusion.glsl"
+
+void main()
+{
+#ifdef VERTEX_PULLING
+	pullVertex();
+#endif
+	mat4 instance = instanceTransform();
+	vec4 position = instance * vec4(iPosition, 1.0f);
+
+	v2fTangent = vec4(mat3(instance) * iTangent.xyz, iTangent.w);
+	v2fPosition = position.xyz;
+	v2fTexCoords = iTexCoord;
+	v2fNormal = mat3(instance) * iNormal;
+	v2fOcclusion = vertexOcclusion();
+#ifdef STEREO
+	gl_Position = uScene.viewProjCam[gl_ViewIndex] * position;
+#else
+	gl_Position = uScene.projCam * position;
+#endif
+}
\ No newline at end of file
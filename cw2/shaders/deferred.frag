@@ -0,0 +1,6 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Deferred lighting subpass (--lighting=deferred)
+
+#include "deferred_frag.glsl"
@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// deferred.frag with fp16 shading (--precision=fp16)
+#define HALF_PRECISION
+#include "deferred_frag.glsl"
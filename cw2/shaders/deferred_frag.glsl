@@ -0,0 +1,56 @@
+// Body of deferred.frag and deferred_fp16.frag: shades each pixel once from
+// the G-buffer (see cw2/deferred.hpp), for the scene's light and the point
+// lights of its cluster. Included via #include; define HALF_PRECISION first
+// for fp16 shading.
+
+#include "gbuffer.glsl"
+
+layout( input_attachment_index = 0, set = 1, binding = 0 ) uniform subpassInput gAlbedoMetalness;
+layout( input_attachment_index = 1, set = 1, binding = 1 ) uniform subpassInput gNormalRoughness;
+layout( input_attachment_index = 2, set = 1, binding = 2 ) uniform subpassInput gDepth;
+
+// DeferredPushConstants in deferred.hpp
+layout( push_constant ) uniform PLighting
+{
+	mat4 invProjCam;
+	vec2 invExtent; // 1 / framebuffer size
+}pLighting;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+    vec3 lightPos;
+    vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) out vec4 oColor;
+
+#include "shading.glsl"
+#include "point_lights.glsl"
+
+
+void main() {
+    // Nothing was drawn; keep the clear colour
+    float depth = subpassLoad(gDepth).r;
+    if (depth <= 0.0) // reverse-Z: cleared to 0
+        discard;
+
+    vec4 clip = pLighting.invProjCam * vec4(gl_FragCoord.xy * pLighting.invExtent * 2.0 - 1.0, depth, 1.0);
+    vec3 position = clip.xyz / clip.w;
+
+    vec4 albedoMetalness = subpassLoad(gAlbedoMetalness);
+    vec4 normalRoughness = subpassLoad(gNormalRoughness);
+
+    vec3 albedo = albedoMetalness.rgb;
+    float metalness = albedoMetalness.a;
+    float roughness = normalRoughness.b;
+    vec3 N = gbufferDecodeNormal(normalRoughness.rg);
+
+    vec3 result = shadeAt(albedo, roughness, metalness, N, position, 1.0)
+        + shadePointLights(albedo, roughness, metalness, N, position, gl_FragCoord.xy);
+
+    oColor = vec4(result, 1.0);
+}
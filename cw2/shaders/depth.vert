@@ -0,0 +1,25 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+layout( location = 0 ) in vec3 iPosition;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+// Depth pre-pass. The colour pass tests for EQUAL depth, so the position
+// must be computed exactly as in default.vert and bindless.vert.
+invariant gl_Position;
+
+#include "instances.glsl"
+
+void main()
+{
+	vec4 position = instanceTransform() * vec4(iPosition, 1.0f);
+	gl_Position = uScene.projCam * position;
+}
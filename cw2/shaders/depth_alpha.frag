@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Alpha test of the depth-only passes (the depth pre-pass and the shadow
+// faces) for alpha-masked materials. Reads only the material's alpha
+// coverage texture (see MaterialIndices::alphaMask), a single channel,
+// instead of the whole base color.
+#include "material.glsl"
+
+layout(std140, set = 1, binding = 3) uniform UMaterial
+{
+	Material material;
+}uMaterial;
+
+layout(set = 1, binding = 4) uniform sampler2D alphaMaskTex;
+
+layout( location = 0 ) in vec2 v2fTexCoords;
+
+void main()
+{
+    if (texture(alphaMaskTex, v2fTexCoords)[uMaterial.material.alphaChannel] < 0.5f)
+        discard;
+}
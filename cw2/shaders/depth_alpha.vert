@@ -0,0 +1,39 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec2 iTexCoord;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+// Per draw (glsl::DrawPushConstants in main.cpp)
+layout( push_constant ) uniform UDraw
+{
+	uint material;
+}uDraw;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 4 ) flat out uint v2fMaterial; // bindless only
+
+// depth.vert for alpha-masked materials: also passes what the alpha test
+// of depth_alpha.frag needs. The position must be computed exactly as in
+// default.vert and bindless.vert.
+invariant gl_Position;
+
+#include "instances.glsl"
+
+void main()
+{
+	vec4 position = instanceTransform() * vec4(iPosition, 1.0f);
+
+	v2fTexCoords = iTexCoord;
+	v2fMaterial = 0xffffffffu != uDraw.material ? uDraw.material : instanceKey();
+	gl_Position = uScene.projCam * position;
+}
@@ -0,0 +1,39 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// depth_alpha.vert for quantized vertices (--vertices=quantized)
+layout( location = 0 ) in vec4 iPosition;
+layout( location = 1 ) in vec2 iTexCoord; // float16
+
+// Per mesh (MeshInstance)
+layout( location = 4 ) in vec3 iBoundsMin;
+layout( location = 5 ) in vec3 iBoundsExtent;
+layout( location = 6 ) in uint iMaterial;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 4 ) flat out uint v2fMaterial; // bindless only
+
+// Must match default_quantized.vert and bindless_quantized.vert for the
+// EQUAL depth test of the colour pass
+invariant gl_Position;
+
+#include "quantized.glsl"
+
+void main()
+{
+	vec3 position = dequantizePosition( iPosition, iBoundsMin, iBoundsExtent );
+
+	v2fTexCoords = iTexCoord;
+	v2fMaterial = iMaterial;
+	gl_Position = uScene.projCam * vec4(position, 1.0f);
+}
@@ -0,0 +1,32 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// depth.vert for quantized vertices (--vertices=quantized)
+layout( location = 0 ) in vec4 iPosition;
+
+// Per mesh (MeshInstance)
+layout( location = 4 ) in vec3 iBoundsMin;
+layout( location = 5 ) in vec3 iBoundsExtent;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+// Depth pre-pass. The colour pass tests for EQUAL depth, so the position
+// must be computed exactly as in default_quantized.vert and
+// bindless_quantized.vert.
+invariant gl_Position;
+
+#include "quantized.glsl"
+
+void main()
+{
+	vec3 position = dequantizePosition( iPosition, iBoundsMin, iBoundsExtent );
+	gl_Position = uScene.projCam * vec4(position, 1.0f);
+}
@@ -0,0 +1,20 @@
+// Tabulated specular distribution (see cw2/distribution_lut.hpp). Included
+// via #include by shading.glsl; the table is binding 8 of the scene's set 0.
+
+// Specialized per pipeline, see EPipelineFeature in main.cpp
+layout( constant_id = 5 ) const bool kDistributionLut = false;
+
+layout( set = 0, binding = 8 ) uniform sampler2D uDistributionLut;
+
+// Must match distribution_lut.hpp
+const float kDistributionLutNdotH = 256.0;
+const float kDistributionLutRoughness = 64.0;
+
+// BlinnPhongDistribution(rough2shininess(roughness), N, H), with the clamped
+// N.H; the ends of both axes are texel centres
+float distributionLut(float NdotH, float roughness)
+{
+    vec2 size = vec2(kDistributionLutNdotH, kDistributionLutRoughness);
+    vec2 t = vec2(sqrt(1.0 - NdotH), roughness);
+    return textureLod(uDistributionLut, (t * (size - 1.0) + 0.5) / size, 0.0).r;
+}
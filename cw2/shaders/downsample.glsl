@@ -0,0 +1,159 @@
+// Single-pass mip generation, in the manner of AMD's FidelityFX SPD (see
+// labutils/mip_downsampler.hpp). Each work group reduces a 64x64 block of
+// the source to the (up to) six levels below it: every invocation reduces
+// four 2x2 quads of the source into a 2x2 quad of the first level, and
+// that into a texel of the second; the rest go through shared memory. The
+// last work group to finish a block (found with uCounters) then does the
+// same for the 64x64 texels of the sixth level, i.e., the remaining
+// levels.
+//
+// Includers define DOWNSAMPLE_FORMAT, the format qualifier of the levels'
+// storage images (e.g., rgba8).
+
+layout( local_size_x = 256 ) in;
+
+// 0: average (textures); 1: minimum (e.g., reverse-Z Hi-Z)
+layout( constant_id = 0 ) const uint kReduction = 0;
+
+layout( set = 0, binding = 0 ) uniform sampler2D uSrc;
+layout( set = 0, binding = 1, DOWNSAMPLE_FORMAT ) uniform coherent image2D uDst[12];
+layout( set = 0, binding = 2 ) coherent buffer Counters
+{
+	uint uCounters[];
+};
+
+// Matches MipDownsampler::Push_ in labutils/mip_downsampler.hpp
+layout( push_constant ) uniform Push
+{
+	ivec2 srcSize;
+	uint levels; // of uDst written by this dispatch
+	uint counter; // of uCounters
+	uint workgroups; // of this dispatch
+	uint srgb; // 1: uDst are UNORM views of sRGB levels
+} uPush;
+
+shared vec4 sTexels[16][16];
+shared uint sLast;
+
+vec4 reduce_( vec4 a, vec4 b, vec4 c, vec4 d )
+{
+	if( 1u == kReduction )
+		return min( min( a, b ), min( c, d ) );
+
+	return (a + b + c + d) * 0.25;
+}
+
+vec3 srgb_decode_( vec3 c )
+{
+	return mix( c / 12.92, pow( (c + 0.055) / 1.055, vec3( 2.4 ) ), greaterThan( c, vec3( 0.04045 ) ) );
+}
+vec3 srgb_encode_( vec3 c )
+{
+	return mix( c * 12.92, 1.055 * pow( c, vec3( 1.0 / 2.4 ) ) - 0.055, greaterThan( c, vec3( 0.0031308 ) ) );
+}
+
+// Texel s of the source of level aLevel (uSrc for the first), clamped to
+// its edges
+vec4 load_( uint aLevel, ivec2 s )
+{
+	if( 0u == aLevel )
+		return texelFetch( uSrc, min( s, uPush.srcSize - 1 ), 0 );
+
+	vec4 v = imageLoad( uDst[aLevel-1], min( s, imageSize( uDst[aLevel-1] ) - 1 ) );
+	if( 0u != uPush.srgb )
+		v.rgb = srgb_decode_( v.rgb );
+	return v;
+}
+
+void store_( uint aLevel, ivec2 p, vec4 v )
+{
+	if( any( greaterThanEqual( p, imageSize( uDst[aLevel] ) ) ) )
+		return;
+
+	if( 0u != uPush.srgb )
+		v.rgb = srgb_encode_( v.rgb );
+	imageStore( uDst[aLevel], p, v );
+}
+
+// Levels aFirst to aFirst+aCount-1 (aCount <= 6) of the 64x64 block aBlock
+// of level aFirst's source
+void downsample_block_( uint aFirst, uvec2 aBlock, uint aCount )
+{
+	ivec2 t = ivec2( gl_LocalInvocationIndex % 16u, gl_LocalInvocationIndex / 16u );
+
+	// A 2x2 quad of level aFirst, from 4x4 source texels, and the texel of
+	// level aFirst+1 that it makes
+	vec4 quad[4];
+	for( int j = 0; j < 4; ++j )
+	{
+		ivec2 p = ivec2( aBlock ) * 32 + 2 * t + ivec2( j & 1, j >> 1 );
+		ivec2 s = 2 * p;
+
+		quad[j] = reduce_(
+			load_( aFirst, s ), load_( aFirst, s + ivec2(1,0) ),
+			load_( aFirst, s + ivec2(0,1) ), load_( aFirst, s + ivec2(1,1) )
+		);
+		store_( aFirst, p, quad[j] );
+	}
+
+	if( aCount < 2u )
+		return;
+
+	vec4 v = reduce_( quad[0], quad[1], quad[2], quad[3] );
+	sTexels[t.y][t.x] = v;
+	store_( aFirst + 1u, ivec2( aBlock ) * 16 + t, v );
+
+	// The rest, halving the active invocations each level. aCount is
+	// uniform, so every invocation reaches the barriers.
+	int size = 8;
+	for( uint level = aFirst + 2u; level < aFirst + aCount; ++level, size /= 2 )
+	{
+		barrier();
+
+		bool inside = all( lessThan( t, ivec2( size ) ) );
+		if( inside )
+		{
+			ivec2 s = 2 * t;
+			v = reduce_(
+				sTexels[s.y][s.x], sTexels[s.y][s.x+1],
+				sTexels[s.y+1][s.x], sTexels[s.y+1][s.x+1]
+			);
+		}
+
+		barrier();
+
+		if( inside )
+		{
+			sTexels[t.y][t.x] = v;
+			store_( level, ivec2( aBlock ) * size + t, v );
+		}
+	}
+}
+
+void main()
+{
+	downsample_block_( 0u, gl_WorkGroupID.xy, min( uPush.levels, 6u ) );
+
+	if( uPush.levels <= 6u )
+		return;
+
+	// This work group's levels are visible to the others before it counts
+	// itself as done
+	memoryBarrierImage();
+	barrier();
+
+	if( 0u == gl_LocalInvocationIndex )
+		sLast = atomicAdd( uCounters[uPush.counter], 1u );
+
+	barrier();
+
+	if( sLast != uPush.workgroups - 1u )
+		return;
+
+	// The last work group: the sixth level is complete. The counter is
+	// ready for the next dispatch that uses it.
+	if( 0u == gl_LocalInvocationIndex )
+		uCounters[uPush.counter] = 0u;
+
+	downsample_block_( 6u, uvec2( 0 ), uPush.levels - 6u );
+}
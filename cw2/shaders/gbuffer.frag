@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default.frag writing the G-buffer (--lighting=deferred)
+layout(early_fragment_tests) in;
+
+#define GBUFFER
+#include "default_frag.glsl"
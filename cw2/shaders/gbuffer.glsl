@@ -0,0 +1,22 @@
+// G-buffer encoding of deferred shading (see cw2/deferred.hpp). Included
+// via #include.
+//   location 0: albedo (rgb; sRGB), metalness (a)
+//   location 1: octahedral world-space normal (rg), roughness (b); 10 bits
+//               each (A2B10G10R10)
+
+vec2 gbufferEncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+
+vec3 gbufferDecodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// default_alpha.frag writing the G-buffer (--lighting=deferred)
+#define ALPHA_MASK
+#define GBUFFER
+#include "default_frag.glsl"
@@ -0,0 +1,23 @@
+#version 450
+
+// Coverage of a glyph from the HUD's font atlas (one cell per glyph, 16
+// cells per row), tinted and blended over the presented image
+layout( set = 0, binding = 0 ) uniform sampler2D uAtlas;
+
+layout( location = 0 ) in vec2 v2fCell;
+layout( location = 1 ) flat in uint v2fGlyph;
+layout( location = 2 ) in vec4 v2fColour;
+
+layout( location = 0 ) out vec4 oColor;
+
+const ivec2 kCell = ivec2( 6, 8 );
+const uint kCellsPerRow = 16;
+
+void main()
+{
+	ivec2 cell = ivec2( v2fGlyph % kCellsPerRow, v2fGlyph / kCellsPerRow );
+	ivec2 texel = cell * kCell + min( ivec2( v2fCell ), kCell - 1 );
+
+	float coverage = texelFetch( uAtlas, texel, 0 ).r;
+	oColor = vec4( v2fColour.rgb, v2fColour.a * coverage );
+}
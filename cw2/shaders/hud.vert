@@ -0,0 +1,32 @@
+#version 450
+
+// Glyph quads of the performance HUD (see hud.hpp); one instance per
+// HudGlyph, the corners come from gl_VertexIndex (triangle strip)
+layout( location = 0 ) in vec2 iPosition; // pixels, top-left corner
+layout( location = 1 ) in vec2 iSize; // pixels
+layout( location = 2 ) in uint iGlyph; // atlas cell
+layout( location = 3 ) in vec4 iColour;
+
+layout( push_constant ) uniform PHud
+{
+	vec2 invExtent; // 1/framebuffer size
+} uHud;
+
+layout( location = 0 ) out vec2 v2fCell; // position in the cell, in font pixels
+layout( location = 1 ) flat out uint v2fGlyph;
+layout( location = 2 ) out vec4 v2fColour;
+
+// Font pixels per atlas cell; must match kHudCell* in hud.cpp
+const vec2 kCell = vec2( 6.0, 8.0 );
+
+void main()
+{
+	vec2 corner = vec2( gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1 );
+	vec2 pixel = iPosition + corner * iSize;
+
+	v2fCell = corner * kCell;
+	v2fGlyph = iGlyph;
+	v2fColour = iColour;
+
+	gl_Position = vec4( pixel * uHud.invExtent * 2.0 - 1.0, 0.0, 1.0 );
+}
@@ -0,0 +1,49 @@
+// Image-based ambient light (see cw2/ibl.hpp). Included via #include by
+// shading.glsl; the terms are bindings 5 to 7 of the scene's set 0.
+
+// IblUniform in cw2/ibl.hpp
+layout( std140, set = 0, binding = 5 ) uniform UIbl
+{
+    vec4 sh[9];
+    vec4 params; // x: 1 with an environment; y: last specular level
+} uIbl;
+
+layout( set = 0, binding = 6 ) uniform samplerCube uIblSpecular;
+layout( set = 0, binding = 7 ) uniform sampler2D uIblBrdf;
+
+// Irradiance over pi around the unit normal n, from the (premultiplied)
+// spherical harmonics
+vec3 iblIrradiance(vec3 n)
+{
+    return uIbl.sh[0].rgb * 0.282095
+        + uIbl.sh[1].rgb * (0.488603 * n.y)
+        + uIbl.sh[2].rgb * (0.488603 * n.z)
+        + uIbl.sh[3].rgb * (0.488603 * n.x)
+        + uIbl.sh[4].rgb * (1.092548 * n.x * n.y)
+        + uIbl.sh[5].rgb * (1.092548 * n.y * n.z)
+        + uIbl.sh[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0))
+        + uIbl.sh[7].rgb * (1.092548 * n.x * n.z)
+        + uIbl.sh[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y));
+}
+
+// Light reflected from the environment towards V; without one, a constant
+// ambient term
+vec3 ambientLight(vec3 albedo, float roughness, float metalness, vec3 N, vec3 V)
+{
+    if (uIbl.params.x == 0.0)
+        return vec3(0.02) * albedo;
+
+    float NdotV = clamp(dot(N, V), 0.0, 1.0);
+    vec3 F0 = mix(vec3(0.04), albedo, metalness);
+
+    // Fresnel with the roughness (Lagarde): rough surfaces reflect less
+    // of the environment at grazing angles
+    vec3 F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotV, 5.0);
+    vec3 diffuse = (vec3(1.0) - F) * (1.0 - metalness) * albedo * max(iblIrradiance(N), vec3(0.0));
+
+    vec3 R = reflect(-V, N);
+    vec3 prefiltered = textureLod(uIblSpecular, R, roughness * uIbl.params.y).rgb;
+    vec2 brdf = textureLod(uIblBrdf, vec2(NdotV, roughness), 0.0).rg;
+
+    return diffuse + prefiltered * (F0 * brdf.x + brdf.y);
+}
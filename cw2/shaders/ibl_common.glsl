@@ -0,0 +1,60 @@
+// Shared by the image-based lighting generation shaders (ibl_*.comp; see
+// cw2/ibl.hpp). Included via #include.
+
+const float PI = 3.14159265359;
+
+// Texture coordinates of the direction d in the equirectangular
+// environment: +Y is up, u goes around it starting (and ending) at -X
+vec2 equirectUV(vec3 d)
+{
+	return vec2(atan(d.z, d.x) / (2.0 * PI) + 0.5, acos(clamp(d.y, -1.0, 1.0)) / PI);
+}
+
+// Direction through uv (in [0,1]^2) of a cube face, in Vulkan's face order
+// and orientation (+X, -X, +Y, -Y, +Z, -Z; see "Cube Map Face Selection"
+// in the spec)
+vec3 cubeDirection(uint face, vec2 uv)
+{
+	vec2 st = uv * 2.0 - 1.0;
+
+	vec3 d;
+	switch( face )
+	{
+		case 0: d = vec3( 1.0, -st.y, -st.x ); break;
+		case 1: d = vec3( -1.0, -st.y, st.x ); break;
+		case 2: d = vec3( st.x, 1.0, st.y ); break;
+		case 3: d = vec3( st.x, -1.0, -st.y ); break;
+		case 4: d = vec3( st.x, -st.y, 1.0 ); break;
+		default: d = vec3( -st.x, -st.y, -1.0 ); break;
+	}
+	return normalize(d);
+}
+
+// Low-discrepancy point i of n in [0,1)^2
+vec2 hammersley(uint i, uint n)
+{
+	return vec2(float(i) / float(n), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+// Half vector around N, distributed as the GGX lobe of the roughness
+// (alpha = roughness^2, as in the Disney/UE4 parametrisation)
+vec3 importanceSampleGGX(vec2 xi, vec3 N, float roughness)
+{
+	float a = roughness * roughness;
+	float phi = 2.0 * PI * xi.x;
+	float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+	float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+	vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+	vec3 T = normalize(cross(up, N));
+	vec3 B = cross(N, T);
+	return normalize(T * (cos(phi) * sinTheta) + B * (sin(phi) * sinTheta) + N * cosTheta);
+}
+
+float distributionGGX(float NdotH, float roughness)
+{
+	float a = roughness * roughness;
+	float a2 = a * a;
+	float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+	return a2 / (PI * d * d);
+}
@@ -0,0 +1,57 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Impostors (see cw2/impostors.hpp): the tile's albedo is alpha tested like
+// the alpha-masked materials, and its normal and depth give the surface
+// that is shaded and depth tested in place of the mesh.
+layout(set = 1, binding = 0) uniform sampler2D albedoTex;      // sRGB, alpha = coverage
+layout(set = 1, binding = 1) uniform sampler2D normalDepthTex; // n * 0.5 + 0.5, depth
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) in vec2 v2fTexCoords;
+layout( location = 1 ) in vec2 v2fCorner;
+layout( location = 2 ) flat in vec3 v2fCentre;
+layout( location = 3 ) flat in vec3 v2fRight;
+layout( location = 4 ) flat in vec3 v2fUp;
+layout( location = 5 ) flat in vec3 v2fForward;
+layout( location = 6 ) flat in mat3 v2fNormalMatrix;
+
+layout( location = 0 ) out vec4 oColor;
+
+#include "shading.glsl"
+#include "point_lights.glsl"
+
+// The baked meshes have no material parameters but their albedo
+const float kImpostorRoughness = 0.8;
+const float kImpostorMetalness = 0.0;
+
+void main()
+{
+    vec4 albedo = texture(albedoTex, v2fTexCoords);
+    if (albedo.a < 0.5)
+        discard;
+
+    vec4 normalDepth = texture(normalDepthTex, v2fTexCoords);
+    vec3 N = normalize(v2fNormalMatrix * (normalDepth.xyz * 2.0 - 1.0));
+
+    // The view is orthographic: the surface is straight in front of the
+    // quad's point
+    vec3 position = v2fCentre + v2fCorner.x * v2fRight + v2fCorner.y * v2fUp + (normalDepth.w * 2.0 - 1.0) * v2fForward;
+
+    vec4 clip = uScene.projCam * vec4(position, 1.0);
+    gl_FragDepth = clip.z / clip.w;
+
+    vec3 result = shadeAt(albedo.rgb, kImpostorRoughness, kImpostorMetalness, N, position, 1.0)
+        + shadePointLights(albedo.rgb, kImpostorRoughness, kImpostorMetalness, N, position, gl_FragCoord.xy);
+
+    oColor = vec4(result, 1.0);
+}
@@ -0,0 +1,33 @@
+// Octahedral impostor views (see cw2/baked_impostors.hpp, which has the same
+// mapping). Included via #include by impostor.vert.
+
+// Unit direction of the view of cell (x, y)
+vec3 impostorDirection(uvec2 cell, uint grid)
+{
+	vec2 e = (vec2(cell) + 0.5) / float(grid) * 2.0 - 1.0;
+
+	vec3 d = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+	if (d.y < 0.0)
+		d.xz = (1.0 - abs(d.zx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.z >= 0.0 ? 1.0 : -1.0);
+
+	return normalize(d);
+}
+
+// The cell whose view is closest to the unit direction d
+uvec2 impostorCell(vec3 d, uint grid)
+{
+	vec3 p = d / (abs(d.x) + abs(d.y) + abs(d.z));
+	vec2 e = p.xz;
+	if (p.y < 0.0)
+		e = (1.0 - abs(p.zx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.z >= 0.0 ? 1.0 : -1.0);
+
+	return uvec2(clamp(floor((e * 0.5 + 0.5) * float(grid)), vec2(0.0), vec2(float(grid - 1))));
+}
+
+// Right and up vectors of the view along d
+void impostorBasis(vec3 d, out vec3 right, out vec3 up)
+{
+	vec3 up0 = abs(d.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+	right = normalize(cross(up0, d));
+	up = cross(d, right);
+}
@@ -0,0 +1,63 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Impostors (see cw2/impostors.hpp): one quad per copy of the mesh, without
+// vertex buffers. The quad lies in the plane of the baked view closest to
+// the direction of the camera, through the centre of the bounding sphere,
+// and covers the view's tile of the atlases.
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+// ImpostorPushConstants in cw2/impostors.hpp
+layout( push_constant ) uniform PImpostor
+{
+	vec3 centre; // object space
+	float radius;
+	uint grid;
+}pImpostor;
+
+#include "instances.glsl"
+#include "impostor.glsl"
+
+layout( location = 0 ) out vec2 v2fTexCoords; // of the atlases
+layout( location = 1 ) out vec2 v2fCorner;    // [-1,1]^2 over the tile
+layout( location = 2 ) flat out vec3 v2fCentre;  // world space
+layout( location = 3 ) flat out vec3 v2fRight;   // world space, times the radius
+layout( location = 4 ) flat out vec3 v2fUp;
+layout( location = 5 ) flat out vec3 v2fForward; // towards the view
+layout( location = 6 ) flat out mat3 v2fNormalMatrix;
+
+const vec2 kCorners[6] = vec2[]( vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0) );
+
+void main()
+{
+	mat4 transform = instanceTransform();
+	mat3 linear = mat3(transform);
+
+	vec3 centre = vec3(transform * vec4(pImpostor.centre, 1.0));
+	vec3 toCamera = inverse(linear) * (uScene.cameraPos - centre);
+
+	uvec2 cell = impostorCell(normalize(toCamera), pImpostor.grid);
+	vec3 d = impostorDirection(cell, pImpostor.grid);
+	vec3 right, up;
+	impostorBasis(d, right, up);
+
+	vec2 corner = kCorners[gl_VertexIndex];
+	v2fTexCoords = (vec2(cell) + corner * 0.5 + 0.5) / float(pImpostor.grid);
+	v2fCorner = corner;
+
+	v2fCentre = centre;
+	v2fRight = linear * right * pImpostor.radius;
+	v2fUp = linear * up * pImpostor.radius;
+	v2fForward = linear * d * pImpostor.radius;
+	v2fNormalMatrix = linear;
+
+	gl_Position = uScene.projCam * vec4(centre + corner.x * v2fRight + corner.y * v2fUp, 1.0);
+}
@@ -0,0 +1,24 @@
+// Copies of the model (see set_model_instances() in load_data_to_vk.h).
+// Included via #include by the vertex shaders of fp32 vertices; the
+// transforms are binding 9 of the scene's set 0.
+//
+// Every draw command draws all count copies. Its firstInstance is a key
+// times count (the material of bindless indirect draws, 0 otherwise), so
+// that gl_InstanceIndex holds both the key and the copy.
+layout( std430, set = 0, binding = 9 ) readonly buffer UInstances
+{
+	uint count;
+	mat4 transforms[];
+}uInstances;
+
+// Object to world transform of the copy; rigid or uniformly scaled, so that
+// its upper 3x3 also transforms the normals (up to their length)
+mat4 instanceTransform()
+{
+	return uInstances.transforms[uint(gl_InstanceIndex) % uInstances.count];
+}
+
+uint instanceKey()
+{
+	return uint(gl_InstanceIndex) / uInstances.count;
+}
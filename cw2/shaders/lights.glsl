@@ -0,0 +1,15 @@
+// Point lights (see cw2/lights.hpp). Included via #include.
+
+struct PointLight
+{
+	vec4 positionRadius; // xyz: world-space position, w: radius of influence
+	vec4 color;          // rgb: intensity, a: unused
+};
+
+// Inverse-square falloff, windowed to reach zero at the radius
+float lightAttenuation(float aDistance, float aRadius)
+{
+	float r = aDistance / aRadius;
+	float window = clamp(1.0 - r * r * r * r, 0.0, 1.0);
+	return window * window / (aDistance * aDistance + 1.0);
+}
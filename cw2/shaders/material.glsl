@@ -0,0 +1,31 @@
+// Material data shared by the fragment shaders. Included via #include.
+
+// Texture index of slots that use their constant instead of a texture
+const uint kNoTexture = 0xffffffffu;
+
+// Texture indices and constants of a single material; see MaterialIndices
+// in load_data_to_vk.h. A normalMap of kNoTexture means the flat normal.
+struct Material
+{
+	uint baseColor;
+	uint roughness;
+	uint metalness;
+	uint normalMap;
+	vec4 baseColorConstant;
+	float roughnessConstant;
+	float metalnessConstant;
+	uint alphaMask;
+	uint alphaChannel;
+};
+
+// Texture of a material slot; aLayer is the slot's value in the Material,
+// which texture arrays (--materials=arrays) replace by the layer
+vec4 sampleSlot(sampler2D aTexture, uint aLayer, vec2 aTexCoords)
+{
+	return texture(aTexture, aTexCoords);
+}
+
+vec4 sampleSlot(sampler2DArray aTexture, uint aLayer, vec2 aTexCoords)
+{
+	return texture(aTexture, vec3(aTexCoords, float(aLayer)));
+}
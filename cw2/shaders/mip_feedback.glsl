@@ -0,0 +1,59 @@
+// Mip feedback for texture streaming (see texture_streaming.hpp). Included
+// via #include after material.glsl. One fragment in every 8x8 pixels records,
+// for each texture of its material, the log2 of its texture coordinates'
+// footprint per pixel; binding 3 of the scene's set 0 keeps the minimum per
+// texture (or region, see below). The CPU adds the log2 of a texture's full
+// size to get the finest level it needs.
+
+// Specialized per pipeline, see EPipelineFeature in main.cpp
+layout( constant_id = 3 ) const bool kMipFeedback = false;
+
+// Virtual textures (see virtual_textures.hpp) keep the footprints per region
+// of a kVirtualRegionGrid x kVirtualRegionGrid grid over every texture, at
+// texture * kVirtualRegions + region; must match virtual_textures.hpp.
+layout( constant_id = 6 ) const bool kVirtualTextures = false;
+const uint kVirtualRegionGrid = 8;
+const uint kVirtualRegions = kVirtualRegionGrid * kVirtualRegionGrid;
+
+// Region of the (repeating) texture coordinates
+uint virtualRegion(vec2 aTexCoords)
+{
+    uvec2 cell = min(uvec2(fract(aTexCoords) * float(kVirtualRegionGrid)), uvec2(kVirtualRegionGrid - 1u));
+    return cell.y * kVirtualRegionGrid + cell.x;
+}
+
+// Footprints are stored as (log2 + kMipFeedbackBias) * kMipFeedbackScale;
+// must match texture_streaming.hpp. 0xffffffff: not sampled.
+const float kMipFeedbackBias = 24.0;
+const float kMipFeedbackScale = 16.0;
+
+layout( std430, set = 0, binding = 3 ) buffer UMipFeedback
+{
+	uint footprints[];
+}uMipFeedback;
+
+// Call in uniform control flow, before any discard: the footprint comes
+// from derivatives.
+void writeMipFeedback(Material aMat, vec2 aTexCoords)
+{
+    vec2 dx = dFdx(aTexCoords);
+    vec2 dy = dFdy(aTexCoords);
+    float footprint = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-14));
+
+    if (any(notEqual(uvec2(gl_FragCoord.xy) & 7u, uvec2(0u))))
+        return;
+
+    uint code = uint(clamp((footprint + kMipFeedbackBias) * kMipFeedbackScale, 0.0, 65535.0));
+    uint stride = kVirtualTextures ? kVirtualRegions : 1u;
+    uint region = kVirtualTextures ? virtualRegion(aTexCoords) : 0u;
+    if (kNoTexture != aMat.baseColor)
+        atomicMin(uMipFeedback.footprints[aMat.baseColor * stride + region], code);
+    if (kNoTexture != aMat.roughness)
+        atomicMin(uMipFeedback.footprints[aMat.roughness * stride + region], code);
+    if (kNoTexture != aMat.metalness)
+        atomicMin(uMipFeedback.footprints[aMat.metalness * stride + region], code);
+    if (kNoTexture != aMat.normalMap)
+        atomicMin(uMipFeedback.footprints[aMat.normalMap * stride + region], code);
+    if (kNoTexture != aMat.alphaMask)
+        atomicMin(uMipFeedback.footprints[aMat.alphaMask * stride + region], code);
+}
@@ -0,0 +1,41 @@
+#version 450
+
+// Bounding box of a mesh, drawn inside an occlusion query (see
+// cw2/occlusion_queries.hpp); no vertex buffers, no fragment shader. The
+// 36 corners of its 12 triangles come from gl_VertexIndex.
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+// OcclusionProxyPushConstants in cw2/occlusion_queries.hpp
+layout( push_constant ) uniform PProxy
+{
+	vec4 boxMin; // world space (xyz)
+	vec4 boxMax;
+}pProxy;
+
+// Corner of each vertex, as bits x, y, z (0: min, 1: max); two triangles
+// per face
+const uint kCorners[36] = uint[](
+	0, 2, 3,  0, 3, 1, // -z
+	4, 5, 7,  4, 7, 6, // +z
+	0, 4, 6,  0, 6, 2, // -x
+	1, 3, 7,  1, 7, 5, // +x
+	0, 1, 5,  0, 5, 4, // -y
+	2, 6, 7,  2, 7, 3  // +y
+);
+
+void main()
+{
+	uint corner = kCorners[gl_VertexIndex];
+	vec3 select = vec3( corner & 1u, (corner >> 1) & 1u, (corner >> 2) & 1u );
+	vec3 position = mix( pProxy.boxMin.xyz, pProxy.boxMax.xyz, select );
+
+	gl_Position = uScene.projCam * vec4( position, 1.0 );
+}
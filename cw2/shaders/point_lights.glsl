@@ -0,0 +1,83 @@
+// Clustered point lights for the shading passes. Included via #include after
+// shading.glsl; the lights and their cluster grid (built by cluster.comp) are
+// bindings 1 and 2 of the scene's set 0.
+
+// SUBGROUP_LIGHTS: the *_subgroup.frag.spv variants (see premake5.lua and
+// kPipelineSubgroupLights in main.cpp), only for devices whose fragment
+// stage has subgroup ballots (lut::DeviceCapabilities).
+#if defined(SUBGROUP_LIGHTS)
+#extension GL_KHR_shader_subgroup_ballot : require
+#endif
+
+#include "lights.glsl"
+#include "clusters.glsl"
+
+layout( std430, set = 0, binding = 1 ) readonly buffer ULights
+{
+	PointLight lights[];
+}uLights;
+
+// ClusterGrid in cw2/clusters.hpp
+layout( std430, set = 0, binding = 2 ) readonly buffer UClusters
+{
+	vec2 tileScale;
+	float sliceScale;
+	float sliceBias;
+	uint counts[kClusterCount];
+	uint indices[]; // kMaxLightsPerCluster per cluster
+}uClusters;
+
+// Lights of one cluster
+vec3 shadeClusterLights(uint cluster, vec3 albedo, float roughness, float metalness, vec3 N, vec3 V, vec3 position)
+{
+    uint count = uClusters.counts[cluster];
+    uint first = cluster * kMaxLightsPerCluster;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < count; ++i)
+    {
+        PointLight light = uLights.lights[uClusters.indices[first + i]];
+
+        vec3 toLight = light.positionRadius.xyz - position;
+        float dist = length(toLight);
+        if (dist >= light.positionRadius.w)
+            continue;
+
+        vec3 L = toLight / dist;
+        result += reflectance(albedo, roughness, metalness, N, V, L) * light.color.rgb * lightAttenuation(dist, light.positionRadius.w);
+    }
+
+    return result;
+}
+
+// Sum of the point lights of the cluster that contains the world-space
+// position (fragCoord: its window coordinates)
+vec3 shadePointLights(vec3 albedo, float roughness, float metalness, vec3 N, vec3 position, vec2 fragCoord)
+{
+    float viewDepth = -(uScene.camera * vec4(position, 1.0)).z;
+    uint cluster = clusterIndex(fragCoord, viewDepth, uClusters.tileScale, uClusters.sliceScale, uClusters.sliceBias);
+
+    vec3 V = normalize(uScene.cameraPos - position);
+
+    // Neighbouring pixels mostly share a cluster, so the loop is mostly
+    // coherent anyway; with SUBGROUP_LIGHTS, it is made uniform: the
+    // subgroup walks its distinct clusters one at a time (usually one or
+    // two), with the cluster's index broadcast from the first invocation
+    // that still needs it, so that the light list and light loads are
+    // scalar and the loop doesn't diverge.
+#if defined(SUBGROUP_LIGHTS)
+    vec3 result = vec3(0.0);
+    for (;;)
+    {
+        uint current = subgroupBroadcastFirst(cluster);
+        if (current == cluster)
+        {
+            result = shadeClusterLights(current, albedo, roughness, metalness, N, V, position);
+            break;
+        }
+    }
+    return result;
+#else
+    return shadeClusterLights(cluster, albedo, roughness, metalness, N, V, position);
+#endif
+}
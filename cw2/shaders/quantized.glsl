@@ -0,0 +1,26 @@
+// Decoding of QuantizedVertex (see cw2/quantized_vertex.hpp). The vertex
+// input already normalizes the attributes; positions are relative to the
+// mesh bounds, which come in as per-instance attributes (MeshInstance).
+//
+// Both the depth pre-pass and the colour pass decode positions with
+// dequantizePosition(), so that they compute identical depths.
+
+vec3 dequantizePosition( vec4 aQuantized, vec3 aBoundsMin, vec3 aBoundsExtent )
+{
+	return aBoundsMin + aQuantized.xyz * aBoundsExtent;
+}
+
+vec3 octahedralDecode( vec2 aEnc )
+{
+	vec3 n = vec3( aEnc, 1.0 - abs( aEnc.x ) - abs( aEnc.y ) );
+	float t = max( -n.z, 0.0 );
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize( n );
+}
+
+// The tangent sign is stored in the position's w (0 or 1)
+vec4 decodeTangent( vec2 aEnc, float aSign )
+{
+	return vec4( octahedralDecode( aEnc ), aSign > 0.5 ? 1.0 : -1.0 );
+}
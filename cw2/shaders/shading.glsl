@@ -0,0 +1,158 @@
+// Shared lighting code for the fragment shaders. Included via #include; the
+// including shader must declare the UScene uniform block as uScene.
+
+const float PI = 3.14159265359;
+const float epsilon = 0.0001; 
+
+float rough2shininess(float roughness) {
+  return (2.0 / (pow(roughness,4) + epsilon)) - 2.0;
+}
+
+vec3 fresnelSchlick(float HdotV, vec3 F0) // F term
+{  
+    return F0 + (1.0 - F0) * pow(1.0 - HdotV, 5.0);
+}
+
+float BlinnPhongDistribution(float shininess, vec3 N, vec3 H)  // D term
+{
+    float clampedNdotH = max(dot(N, H), 0.0);
+    return ((shininess + 2)/ (2 * PI)) * pow(clampedNdotH, shininess);
+}
+
+float CookTorranceMaskingTerm(vec3 N, vec3 H, vec3 L, vec3 V)  // G term
+{
+    float a = 2 * (max(dot(N, H), 0.0) * max(dot(N, V), 0.0)) / dot(V, H);
+    float b = 2 * (max(dot(N, H), 0.0) * max(dot(N, L), 0.0)) / dot(V, H);
+    return min(1.0, min(a, b));
+}
+
+// Tangent-space normal from a normal map texel. Only X and Y are stored in
+// two-channel (BC5) normal maps; Z is always reconstructed.
+vec3 decodeNormalMap(vec2 rg)
+{
+    vec2 xy = rg * 2.0 - 1.0;
+    return vec3(xy, sqrt(max(0.0, 1.0 - dot(xy, xy))));
+}
+
+mat3 computeTangentSpaceMatrix(vec3 N, vec4 tangent)
+{
+    vec3 T = tangent.xyz;
+    vec3 B = cross(N, T) * tangent.w;
+    return mat3(T, B, N);
+}
+
+// World-space shading normal. normalFromMap is the tangent-space normal in
+// [-1,1]. The interpolated normal and tangent are used as they are: only the
+// result is normalized, which is also what (MikkTSpace) baked normal maps
+// expect.
+vec3 surfaceNormal(vec3 normalFromMap, vec3 normal, vec4 tangent)
+{
+    mat3 TBN = computeTangentSpaceMatrix(normal, tangent);
+    return normalize(TBN * normalFromMap);
+}
+
+#include "distribution_lut.glsl"
+
+#ifndef HALF_PRECISION
+// BRDF times N.L, i.e., the reflected radiance per unit of light intensity.
+// N, V (towards the viewer) and L (towards the light) are unit vectors.
+vec3 reflectance(vec3 albedo, float roughness, float metalness, vec3 N, vec3 V, vec3 L)
+{
+    vec3 H = normalize(V + L);
+
+    vec3 F0 = mix(vec3(0.04), albedo, metalness);
+
+    vec3 F = fresnelSchlick(dot(H, V), F0);
+    float D = kDistributionLut ? distributionLut(max(dot(N, H), 0.0), roughness)
+        : BlinnPhongDistribution(rough2shininess(roughness), N, H);
+    float G = CookTorranceMaskingTerm(N, H, L, V);
+    vec3 Ldiffuse = (albedo/PI) * (vec3(1.0f) - F) * (1.0f - metalness);
+
+
+    vec3 nominator = D * G * F;
+    float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + epsilon;
+    vec3 BRDF = Ldiffuse + (nominator / denominator);
+
+    float NdotL = max(dot(N, L), 0.0);
+
+    return BRDF * NdotL;
+}
+#else // HALF_PRECISION
+// fp16 versions of the terms (--precision=fp16); the including shader enables
+// GL_EXT_shader_explicit_arithmetic_types_float16. Only the arithmetic is in
+// fp16, inputs and outputs are converted, so shaderFloat16 is all it needs.
+const float16_t PI_h = float16_t(PI);
+const float16_t epsilon_h = float16_t(epsilon);
+
+float16_t rough2shininess(float16_t roughness) {
+  float16_t r2 = roughness * roughness;
+  return (float16_t(2.0) / (r2 * r2 + epsilon_h)) - float16_t(2.0);
+}
+
+f16vec3 fresnelSchlick(float16_t HdotV, f16vec3 F0) // F term
+{
+    float16_t m = float16_t(1.0) - HdotV;
+    float16_t m2 = m * m;
+    return F0 + (float16_t(1.0) - F0) * (m2 * m2 * m);
+}
+
+float16_t BlinnPhongDistribution(float16_t shininess, f16vec3 N, f16vec3 H)  // D term
+{
+    float16_t clampedNdotH = max(dot(N, H), float16_t(0.0));
+    return ((shininess + float16_t(2.0)) / (float16_t(2.0) * PI_h)) * pow(clampedNdotH, shininess);
+}
+
+float16_t CookTorranceMaskingTerm(f16vec3 N, f16vec3 H, f16vec3 L, f16vec3 V)  // G term
+{
+    float16_t NdotH = max(dot(N, H), float16_t(0.0));
+    float16_t a = float16_t(2.0) * NdotH * max(dot(N, V), float16_t(0.0)) / dot(V, H);
+    float16_t b = float16_t(2.0) * NdotH * max(dot(N, L), float16_t(0.0)) / dot(V, H);
+    return min(float16_t(1.0), min(a, b));
+}
+
+// As the fp32 reflectance(). The directions come in as fp32 (world-space
+// positions need it), the terms are fp16. The specular divide is done in
+// fp32, since D over a near-zero denominator overflows fp16.
+vec3 reflectance(vec3 albedo, float roughness, float metalness, vec3 N_f, vec3 V_f, vec3 L_f)
+{
+    f16vec3 N = f16vec3(N_f);
+    f16vec3 V = f16vec3(V_f);
+    f16vec3 L = f16vec3(L_f);
+
+    f16vec3 H = normalize(V + L);
+    f16vec3 albedo_h = f16vec3(albedo);
+    float16_t metalness_h = float16_t(metalness);
+
+    f16vec3 F0 = mix(f16vec3(0.04), albedo_h, metalness_h);
+
+    f16vec3 F = fresnelSchlick(dot(H, V), F0);
+    float16_t D = kDistributionLut ? float16_t(distributionLut(float(max(dot(N, H), float16_t(0.0))), roughness))
+        : BlinnPhongDistribution(rough2shininess(float16_t(roughness)), N, H);
+    float16_t G = CookTorranceMaskingTerm(N, H, L, V);
+    f16vec3 Ldiffuse = (albedo_h / PI_h) * (f16vec3(1.0) - F) * (float16_t(1.0) - metalness_h);
+
+    float16_t NdotV = max(dot(N, V), float16_t(0.0));
+    float16_t NdotL = max(dot(N, L), float16_t(0.0));
+
+    vec3 nominator = vec3(D * G * F);
+    float denominator = 4.0 * float(NdotV) * float(NdotL) + epsilon;
+    vec3 BRDF = vec3(Ldiffuse) + (nominator / denominator);
+
+    return BRDF * float(NdotL);
+}
+#endif // HALF_PRECISION
+
+#include "shadows.glsl"
+#include "ibl.glsl"
+
+// Ambient light (from the environment, if any), scaled by the baked
+// occlusion (1: none; see vertex_occlusion.glsl), plus the scene's light
+// (uScene), which has no falloff, and is shadowed by the scene
+vec3 shadeAt(vec3 albedo, float roughness, float metalness, vec3 N, vec3 position, float occlusion)
+{
+    vec3 V = normalize(uScene.cameraPos - position);
+    vec3 L = normalize(uScene.lightPos - position);
+
+    vec3 Lambient = ambientLight(albedo, roughness, metalness, N, V) * occlusion;
+    return Lambient + reflectance(albedo, roughness, metalness, N, V, L) * uScene.lightColor * lightVisibility(position, N);
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Shadow cube faces (see cw2/shadows.hpp): positions only, placed by their
+// instance, and transformed by the face's projection and view
+layout( location = 0 ) in vec3 iPosition;
+
+// ShadowPushConstants in cw2/shadows.hpp
+layout( push_constant ) uniform PShadow
+{
+	mat4 lightProjView;
+}pShadow;
+
+#include "instances.glsl"
+
+void main()
+{
+	gl_Position = pShadow.lightProjView * (instanceTransform() * vec4(iPosition, 1.0f));
+}
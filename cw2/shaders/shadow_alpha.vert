@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// shadow.vert for alpha-masked materials: also passes what the alpha test
+// of depth_alpha.frag needs. The shadow pass only draws indirectly, so the
+// material always comes from instanceKey().
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec2 iTexCoord;
+
+// ShadowPushConstants in cw2/shadows.hpp
+layout( push_constant ) uniform PShadow
+{
+	mat4 lightProjView;
+}pShadow;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 4 ) flat out uint v2fMaterial; // bindless only
+
+#include "instances.glsl"
+
+void main()
+{
+	v2fTexCoords = iTexCoord;
+	v2fMaterial = instanceKey();
+	gl_Position = pShadow.lightProjView * (instanceTransform() * vec4(iPosition, 1.0f));
+}
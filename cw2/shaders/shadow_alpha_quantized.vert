@@ -0,0 +1,31 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// shadow_alpha.vert for quantized vertices (--vertices=quantized)
+layout( location = 0 ) in vec4 iPosition;
+layout( location = 1 ) in vec2 iTexCoord; // float16
+
+// Per mesh (MeshInstance)
+layout( location = 4 ) in vec3 iBoundsMin;
+layout( location = 5 ) in vec3 iBoundsExtent;
+layout( location = 6 ) in uint iMaterial;
+
+// ShadowPushConstants in cw2/shadows.hpp
+layout( push_constant ) uniform PShadow
+{
+	mat4 lightProjView;
+}pShadow;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 4 ) flat out uint v2fMaterial; // bindless only
+
+#include "quantized.glsl"
+
+void main()
+{
+	vec3 position = dequantizePosition( iPosition, iBoundsMin, iBoundsExtent );
+
+	v2fTexCoords = iTexCoord;
+	v2fMaterial = iMaterial;
+	gl_Position = pShadow.lightProjView * vec4(position, 1.0f);
+}
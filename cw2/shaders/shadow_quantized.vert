@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// shadow.vert for quantized vertices (--vertices=quantized)
+layout( location = 0 ) in vec4 iPosition;
+
+// Per mesh (MeshInstance)
+layout( location = 4 ) in vec3 iBoundsMin;
+layout( location = 5 ) in vec3 iBoundsExtent;
+
+// ShadowPushConstants in cw2/shadows.hpp
+layout( push_constant ) uniform PShadow
+{
+	mat4 lightProjView;
+}pShadow;
+
+#include "quantized.glsl"
+
+void main()
+{
+	vec3 position = dequantizePosition( iPosition, iBoundsMin, iBoundsExtent );
+	gl_Position = pShadow.lightProjView * vec4(position, 1.0f);
+}
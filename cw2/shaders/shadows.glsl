@@ -0,0 +1,59 @@
+// Shadows of the scene's light, from its cached shadow cube (see
+// cw2/shadows.hpp). Included via #include by shading.glsl; the cube is
+// binding 4 of the scene's set 0. With RAY_QUERY_SHADOWS (and
+// GL_EXT_ray_query), a ray towards the light is traced against the scene's
+// TLAS at binding 13 instead (see cw2/ray_shadows.hpp).
+
+#ifdef RAY_QUERY_SHADOWS
+layout( set = 0, binding = 13 ) uniform accelerationStructureEXT uShadowScene;
+
+// kRayMaskOpaque in cw2/ray_shadows.hpp; the alpha-masked meshes cast no
+// shadows
+const uint kRayMaskOpaque = 0x01u;
+
+// Offset of the ray's origin along the normal, against self-intersection,
+// in world units per unit of distance to the light (and at least 1 unit)
+const float kRayShadowBias = 0.002;
+
+// Fraction of the light that reaches the world-space position (N: its
+// normal): 0 or 1, as the nearest hit is not needed
+float lightVisibility(vec3 position, vec3 N)
+{
+    vec3 toLight = uScene.lightPos - position;
+    float dist = length(toLight);
+    vec3 origin = position + N * (kRayShadowBias * max(dist, 1.0));
+
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, uShadowScene, gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT,
+        kRayMaskOpaque, origin, 0.0, toLight / dist, dist);
+    while (rayQueryProceedEXT(query))
+    {
+    }
+
+    return gl_RayQueryCommittedIntersectionNoneEXT == rayQueryGetIntersectionTypeEXT(query, true) ? 1.0 : 0.0;
+}
+#else
+layout( set = 0, binding = 4 ) uniform samplerCubeShadow uShadowCube;
+
+// kShadowNear and kShadowFar in cw2/shadows.hpp
+const float kShadowNear = 0.05;
+const float kShadowFar = 100.0;
+
+// Fraction of the light that reaches the world-space position (N: its
+// normal), with the 2x2 PCF of the comparison sampler
+float lightVisibility(vec3 position, vec3 N)
+{
+    // Offset along the normal by about a texel, which grows with the
+    // distance to the light, against acne on surfaces at grazing angles
+    vec3 toPosition = position - uScene.lightPos;
+    float texel = 2.0 * max(max(abs(toPosition.x), abs(toPosition.y)), abs(toPosition.z)) / float(textureSize(uShadowCube, 0).x);
+    toPosition += N * (1.5 * texel);
+
+    // The face's depth is that of the major axis, projected as in the
+    // faces' perspectiveRH_ZO(); beyond the far plane, the position is lit
+    float major = max(max(abs(toPosition.x), abs(toPosition.y)), abs(toPosition.z));
+    float depth = (kShadowFar / (kShadowFar - kShadowNear)) * (1.0 - kShadowNear / major);
+
+    return texture(uShadowCube, vec4(toPosition, min(depth, 1.0)));
+}
+#endif
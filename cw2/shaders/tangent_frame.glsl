@@ -0,0 +1,72 @@
+// Tangent frames as a single quaternion (--tangent-frame=quaternion). The
+// vertex shader passes one vec4 instead of the normal and the tangent (seven
+// floats), and the fragment shader rebuilds both from it.
+//
+// q and -q are the same rotation; the encoded quaternion always has w > 0,
+// so that the three quaternions of a triangle interpolate within one
+// hemisphere. The sign of w is then free to store the bitangent sign
+// (negative: mirrored UVs); w is kept away from 0 so that the sign survives.
+// A triangle is assumed to have the same bitangent sign at all its vertices.
+
+const float kTangentFrameBias = 1.0 / 32767.0;
+
+// N and tangent.xyz need not be unit length or orthogonal; the frame is
+// orthonormalized around N first.
+vec4 encodeTangentFrame(vec3 aNormal, vec4 aTangent)
+{
+    vec3 n = normalize(aNormal);
+    vec3 t = normalize(aTangent.xyz - n * dot(n, aTangent.xyz));
+    vec3 b = cross(n, t);
+
+    // Rotation matrix (t, b, n) to quaternion, from its largest component
+    vec4 q;
+    float trace = t.x + b.y + n.z;
+    if (trace > 0.0)
+    {
+        float s = 0.5 / sqrt(trace + 1.0);
+        q = vec4((b.z - n.y) * s, (n.x - t.z) * s, (t.y - b.x) * s, 0.25 / s);
+    }
+    else if (t.x > b.y && t.x > n.z)
+    {
+        float s = 2.0 * sqrt(1.0 + t.x - b.y - n.z);
+        q = vec4(0.25 * s, (b.x + t.y) / s, (n.x + t.z) / s, (b.z - n.y) / s);
+    }
+    else if (b.y > n.z)
+    {
+        float s = 2.0 * sqrt(1.0 + b.y - t.x - n.z);
+        q = vec4((b.x + t.y) / s, 0.25 * s, (n.y + b.z) / s, (n.x - t.z) / s);
+    }
+    else
+    {
+        float s = 2.0 * sqrt(1.0 + n.z - t.x - b.y);
+        q = vec4((n.x + t.z) / s, (n.y + b.z) / s, 0.25 * s, (t.y - b.x) / s);
+    }
+
+    q = normalize(q);
+    if (q.w < 0.0)
+        q = -q;
+
+    if (q.w < kTangentFrameBias)
+        q = vec4(q.xyz * (sqrt(1.0 - kTangentFrameBias * kTangentFrameBias) / length(q.xyz)), kTangentFrameBias);
+
+    return aTangent.w < 0.0 ? -q : q;
+}
+
+// The (unit) normal and tangent of an interpolated encodeTangentFrame()
+// quaternion. tangent.w is the bitangent sign, as in the vertex data.
+void decodeTangentFrame(vec4 aFrame, out vec3 aNormal, out vec4 aTangent)
+{
+    vec4 q = normalize(aFrame);
+
+    aTangent = vec4(
+        1.0 - 2.0 * (q.y * q.y + q.z * q.z),
+        2.0 * (q.x * q.y + q.w * q.z),
+        2.0 * (q.x * q.z - q.w * q.y),
+        q.w < 0.0 ? -1.0 : 1.0
+    );
+    aNormal = vec3(
+        2.0 * (q.x * q.z + q.w * q.y),
+        2.0 * (q.y * q.z - q.w * q.x),
+        1.0 - 2.0 * (q.x * q.x + q.y * q.y)
+    );
+}
@@ -0,0 +1,19 @@
+// Baked ambient occlusion per vertex (cw2-bake --bake-ao; see
+// ModelPack::occlusion in load_data_to_vk.h). Included via #include by the
+// vertex shaders of the forward pass; the values are binding 10 of the
+// scene's set 0, a byte per vertex at its index in the vertex buffer.
+layout( std430, set = 0, binding = 10 ) readonly buffer UOcclusion
+{
+	uint count; // 0: the model has no baked occlusion
+	uint packed[]; // four vertices per uint, the first in the low byte
+}uOcclusion;
+
+// Open fraction of the hemisphere above the vertex; 1 without occlusion
+float vertexOcclusion()
+{
+	uint vertex = uint(gl_VertexIndex);
+	if( vertex >= uOcclusion.count )
+		return 1.0;
+
+	return float((uOcclusion.packed[vertex >> 2] >> ((vertex & 3u) * 8u)) & 0xffu) / 255.0;
+}
@@ -0,0 +1,31 @@
+// Vertex pulling (--vertex-input=pulled): the vertex shader fetches the fp32
+// vertex at gl_VertexIndex from ModelPack::vertices, bound as binding 12 of
+// the scene's set 0, instead of having the fixed-function vertex input
+// deliver it. The pipelines then have no vertex input state, and the draws
+// bind no vertex buffers. Included via #include by the *_pulled.vert
+// shaders, in place of their vertex inputs.
+
+// Interleaved pos(3), tex(2), norm(3), tangent(4): 48 bytes per vertex,
+// three vec4s
+layout( std430, set = 0, binding = 12 ) readonly buffer UVertices
+{
+	vec4 data[];
+}uVertices;
+
+vec3 iPosition;
+vec2 iTexCoord;
+vec3 iNormal;
+vec4 iTangent;
+
+// gl_VertexIndex includes the draw's vertexOffset
+void pullVertex()
+{
+	uint base = uint(gl_VertexIndex) * 3u;
+	vec4 a = uVertices.data[base];
+	vec4 b = uVertices.data[base + 1u];
+
+	iPosition = a.xyz;
+	iTexCoord = vec2(a.w, b.x);
+	iNormal = b.yzw;
+	iTangent = uVertices.data[base + 2u];
+}
@@ -0,0 +1,23 @@
+// Sampling of virtual textures (see virtual_textures.hpp). Included via
+// #include after mip_feedback.glsl and the declaration of uTextures. Binding
+// 11 of the scene's set 0 holds, for every region of every texture, the
+// finest level whose tiles are resident (0 for textures that aren't
+// virtual). Sampling is clamped to it by scaling the gradients, which needs
+// neither the MinLod capability nor residency queries.
+
+layout( std430, set = 0, binding = 11 ) readonly buffer UResidency
+{
+	uint minLevels[];
+}uResidency;
+
+// texture(uTextures[aTexture], aTexCoords), with the clamp if kVirtualTextures
+vec4 sampleMaterialTexture(uint aTexture, vec2 aTexCoords)
+{
+    if (!kVirtualTextures)
+        return texture(uTextures[nonuniformEXT(aTexture)], aTexCoords);
+
+    float minLevel = float(uResidency.minLevels[aTexture * kVirtualRegions + virtualRegion(aTexCoords)]);
+    float lod = textureQueryLod(uTextures[nonuniformEXT(aTexture)], aTexCoords).y;
+    float scale = exp2(max(minLevel - lod, 0.0));
+    return textureGrad(uTextures[nonuniformEXT(aTexture)], aTexCoords, dFdx(aTexCoords) * scale, dFdy(aTexCoords) * scale);
+}
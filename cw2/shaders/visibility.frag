@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Visibility buffer pass (--lighting=visibility) for opaque materials
+layout(early_fragment_tests) in;
+
+#include "visibility_frag.glsl"
@@ -0,0 +1,22 @@
+// Triangle IDs of the visibility buffer (see cw2/visibility.hpp). Included
+// via #include.
+
+// kVisibilityMeshBits in cw2/visibility.hpp
+const uint kVisibilityMeshBits = 12u;
+const uint kVisibilityPrimitiveBits = 32u - kVisibilityMeshBits;
+const uint kVisibilityPrimitiveMask = (1u << kVisibilityPrimitiveBits) - 1u;
+
+// 0 is empty (the clear value)
+uint visibilityEncode(uint mesh, uint primitive)
+{
+    return ((mesh + 1u) << kVisibilityPrimitiveBits) | (primitive & kVisibilityPrimitiveMask);
+}
+
+// VisibilityMesh in cw2/visibility.hpp
+struct VisibilityMesh
+{
+    uint firstIndex; // in units of the index type
+    int vertexOffset;
+    uint index16;
+    uint material;
+};
@@ -0,0 +1,31 @@
+#version 450
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec2 iTexCoord;
+
+// MeshInstance; the draws pass the mesh index as firstInstance
+layout( location = 6 ) in uint iMaterial;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+	vec3 lightPos;
+	vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) out vec2 v2fTexCoords;
+layout( location = 1 ) flat out uint v2fMesh;
+layout( location = 2 ) flat out uint v2fMaterial;
+
+// Visibility buffer pass (--lighting=visibility); the material pass
+// recomputes the positions from the same matrix
+void main()
+{
+	v2fTexCoords = iTexCoord;
+	v2fMesh = uint(gl_InstanceIndex);
+	v2fMaterial = iMaterial;
+
+	gl_Position = uScene.projCam * vec4(iPosition, 1.0f);
+}
@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// visibility.frag for alpha-masked materials
+#define ALPHA_MASK
+#include "visibility_frag.glsl"
@@ -0,0 +1,37 @@
+// Body of visibility*.frag: writes the triangle ID (see visibility.glsl).
+// Included via #include; define ALPHA_MASK first to discard texels with
+// alpha < 0.5. gl_PrimitiveID needs the geometryShader feature.
+
+#include "visibility.glsl"
+
+layout( location = 0 ) in vec2 v2fTexCoords;
+layout( location = 1 ) flat in uint v2fMesh;
+layout( location = 2 ) flat in uint v2fMaterial;
+
+layout( location = 0 ) out uint oVisibility;
+
+#ifdef ALPHA_MASK
+#include "material.glsl"
+
+layout(std430, set = 1, binding = 0) readonly buffer UMaterials
+{
+	Material materials[];
+}uMaterials;
+
+layout(set = 1, binding = 1) uniform sampler2D uTextures[];
+#endif
+
+
+void main() {
+#ifdef ALPHA_MASK
+    Material mat = uMaterials.materials[v2fMaterial];
+
+    float alpha = mat.baseColorConstant.a;
+    if (kNoTexture != mat.baseColor)
+        alpha = texture(uTextures[nonuniformEXT(mat.baseColor)], v2fTexCoords).a;
+
+    if (alpha < 0.5f) discard;
+#endif
+
+    oVisibility = visibilityEncode(v2fMesh, uint(gl_PrimitiveID));
+}
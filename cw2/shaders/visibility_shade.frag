@@ -0,0 +1,7 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Material pass of the visibility buffer (--lighting=visibility)
+
+#include "visibility_shade_frag.glsl"
@@ -0,0 +1,8 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// visibility_shade.frag with fp16 shading (--precision=fp16)
+#define HALF_PRECISION
+#include "visibility_shade_frag.glsl"
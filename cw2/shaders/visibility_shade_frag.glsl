@@ -0,0 +1,178 @@
+// Body of visibility_shade.frag and visibility_shade_fp16.frag: shades each
+// pixel once from its triangle ID (see cw2/visibility.hpp). The triangle's
+// vertices are fetched and interpolated here; textures are sampled with
+// gradients from the barycentrics' screen-space derivatives, as neighbouring
+// pixels may belong to other triangles. Included via #include; define
+// HALF_PRECISION first for fp16 shading.
+
+#include "material.glsl"
+#include "visibility.glsl"
+
+layout(std430, set = 1, binding = 0) readonly buffer UMaterials
+{
+	Material materials[];
+}uMaterials;
+
+layout(set = 1, binding = 1) uniform sampler2D uTextures[];
+
+layout( input_attachment_index = 0, set = 2, binding = 0 ) uniform usubpassInput gVisibility;
+
+layout( std430, set = 2, binding = 1 ) readonly buffer UMeshes
+{
+	VisibilityMesh meshes[];
+}uMeshes;
+
+// ModelPack::vertices: pos(3), tex(2), norm(3), tangent(4)
+layout( std430, set = 2, binding = 2 ) readonly buffer UVertices
+{
+	float vertices[];
+}uVertices;
+
+// ModelPack::indices; the uint16 part packs two indices per word
+layout( std430, set = 2, binding = 3 ) readonly buffer UIndices
+{
+	uint indices[];
+}uIndices;
+
+// VisibilityPushConstants in visibility.hpp
+layout( push_constant ) uniform PShade
+{
+	vec2 extent; // framebuffer size
+}pShade;
+
+layout(std140,set = 0, binding = 0) uniform UScene
+{
+	mat4 camera;
+	mat4 projection;
+	mat4 projCam;
+	vec3 cameraPos;
+    vec3 lightPos;
+    vec3 lightColor;
+}uScene;
+
+layout( location = 0 ) out vec4 oColor;
+
+// Pipeline permutation features (see EPipelineFeature in main.cpp); the
+// defaults are used if the pipeline doesn't specialize them
+layout( constant_id = 1 ) const bool kNormalMapping = true;
+
+#include "shading.glsl"
+#include "point_lights.glsl"
+
+const uint kVertexFloats = 12u;
+
+uint fetchIndex(VisibilityMesh mesh, uint i)
+{
+    uint element = mesh.firstIndex + i;
+    if (0u == mesh.index16)
+        return uIndices.indices[element];
+
+    uint word = uIndices.indices[element >> 1];
+    return 0u != (element & 1u) ? word >> 16 : word & 0xffffu;
+}
+
+vec3 fetchVec3(uint base)
+{
+    return vec3(uVertices.vertices[base], uVertices.vertices[base + 1u], uVertices.vertices[base + 2u]);
+}
+
+// Perspective-correct barycentrics at window position fragCoord, and their
+// change to the next pixel in x and y. c0-c2 are the clip-space vertices.
+void barycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 fragCoord, out vec3 lambda, out vec3 lambdaDx, out vec3 lambdaDy)
+{
+    vec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);
+    vec2 s0 = c0.xy * invW.x;
+    vec2 e1 = c1.xy * invW.y - s0;
+    vec2 e2 = c2.xy * invW.z - s0;
+
+    // Screen-space (affine) barycentrics b1, b2 from edge functions, and
+    // their change per pixel
+    float invArea = 1.0 / (e1.x * e2.y - e1.y * e2.x);
+    vec2 p = (fragCoord / pShade.extent) * 2.0 - 1.0 - s0;
+    vec2 b = vec2(p.x * e2.y - p.y * e2.x, e1.x * p.y - e1.y * p.x) * invArea;
+
+    vec2 pixel = 2.0 / pShade.extent;
+    vec2 bDx = vec2(e2.y, -e1.y) * (invArea * pixel.x);
+    vec2 bDy = vec2(-e2.x, e1.x) * (invArea * pixel.y);
+
+    // Weighting the affine barycentrics by 1/w, and renormalizing, gives the
+    // perspective-correct ones
+    vec3 w = vec3(1.0 - b.x - b.y, b) * invW;
+    vec3 wDx = vec3(1.0 - b.x - b.y - bDx.x - bDx.y, b + bDx) * invW;
+    vec3 wDy = vec3(1.0 - b.x - b.y - bDy.x - bDy.y, b + bDy) * invW;
+
+    lambda = w / (w.x + w.y + w.z);
+    lambdaDx = wDx / (wDx.x + wDx.y + wDx.z) - lambda;
+    lambdaDy = wDy / (wDy.x + wDy.y + wDy.z) - lambda;
+}
+
+
+void main() {
+    // Nothing was drawn; keep the clear colour
+    uint id = subpassLoad(gVisibility).r;
+    if (0u == id)
+        discard;
+
+    VisibilityMesh mesh = uMeshes.meshes[(id >> kVisibilityPrimitiveBits) - 1u];
+    uint primitive = id & kVisibilityPrimitiveMask;
+
+    uint base[3];
+    for (uint i = 0u; i < 3u; ++i)
+        base[i] = uint(int(fetchIndex(mesh, primitive * 3u + i)) + mesh.vertexOffset) * kVertexFloats;
+
+    vec3 p0 = fetchVec3(base[0]);
+    vec3 p1 = fetchVec3(base[1]);
+    vec3 p2 = fetchVec3(base[2]);
+
+    vec3 lambda, lambdaDx, lambdaDy;
+    barycentrics(uScene.projCam * vec4(p0, 1.0), uScene.projCam * vec4(p1, 1.0), uScene.projCam * vec4(p2, 1.0), gl_FragCoord.xy, lambda, lambdaDx, lambdaDy);
+
+    vec3 position = lambda.x * p0 + lambda.y * p1 + lambda.z * p2;
+
+    vec2 uv[3];
+    vec3 normal = vec3(0.0);
+    vec4 tangent = vec4(0.0);
+    for (uint i = 0u; i < 3u; ++i)
+    {
+        uint v = base[i];
+        uv[i] = vec2(uVertices.vertices[v + 3u], uVertices.vertices[v + 4u]);
+        normal += lambda[i] * fetchVec3(v + 5u);
+        tangent += lambda[i] * vec4(fetchVec3(v + 8u), uVertices.vertices[v + 11u]);
+    }
+
+    vec2 texCoords = lambda.x * uv[0] + lambda.y * uv[1] + lambda.z * uv[2];
+    vec2 texCoordsDx = lambdaDx.x * uv[0] + lambdaDx.y * uv[1] + lambdaDx.z * uv[2];
+    vec2 texCoordsDy = lambdaDy.x * uv[0] + lambdaDy.y * uv[1] + lambdaDy.z * uv[2];
+
+    // The sign is the same at all three vertices
+    tangent.w = tangent.w < 0.0 ? -1.0 : 1.0;
+
+    // As bindless_frag.glsl. Neighbouring pixels may use other materials.
+    Material mat = uMaterials.materials[mesh.material];
+
+    vec3 albedo = mat.baseColorConstant.rgb;
+    if (kNoTexture != mat.baseColor)
+        albedo = textureGrad(uTextures[nonuniformEXT(mat.baseColor)], texCoords, texCoordsDx, texCoordsDy).rgb;
+
+    float roughness = mat.roughnessConstant;
+    float metalness = mat.metalnessConstant;
+    if (kNoTexture != mat.roughness || kNoTexture != mat.metalness)
+    {
+        uint rmIndex = kNoTexture != mat.roughness ? mat.roughness : mat.metalness;
+        vec2 rm = textureGrad(uTextures[nonuniformEXT(rmIndex)], texCoords, texCoordsDx, texCoordsDy).rg;
+        if (kNoTexture != mat.roughness)
+            roughness = rm.r;
+        if (kNoTexture != mat.metalness)
+            metalness = rm.g;
+    }
+
+    vec3 normalFromMap = vec3(0.0, 0.0, 1.0);
+    if (kNormalMapping && kNoTexture != mat.normalMap)
+        normalFromMap = decodeNormalMap(textureGrad(uTextures[nonuniformEXT(mat.normalMap)], texCoords, texCoordsDx, texCoordsDy).rg);
+
+    vec3 N = surfaceNormal(normalFromMap, normal, tangent);
+    vec3 result = shadeAt(albedo, roughness, metalness, N, position, 1.0)
+        + shadePointLights(albedo, roughness, metalness, N, position, gl_FragCoord.xy);
+
+    oColor = vec4(result, 1.0);
+}
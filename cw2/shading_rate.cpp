@@ -0,0 +1,292 @@
+#include "shading_rate.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	constexpr std::uint32_t kShadingRateWorkgroupSize = 8; // local_size_x/y in shading_rate.comp
+
+	// Preferred tile size; the device's limits may force another one
+	constexpr std::uint32_t kPreferredTexelSize = 8;
+
+	// PRate in shading_rate.comp
+	struct ShadingRatePush_
+	{
+		std::uint32_t texelSize[2];
+		float threshold;
+		std::uint32_t enabled;
+	};
+}
+
+VkExtent2D query_shading_rate_texel_size( lut::VulkanContext const& aContext )
+{
+	if( !aContext.haveFragmentShadingRate )
+		return VkExtent2D{ 0, 0 };
+
+	// The rate image is written by a compute shader
+	VkFormatProperties formatProps{};
+	vkGetPhysicalDeviceFormatProperties( aContext.physicalDevice, kShadingRateFormat, &formatProps );
+
+	VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+	if( needed != (formatProps.optimalTilingFeatures & needed) )
+		return VkExtent2D{ 0, 0 };
+
+	VkPhysicalDeviceFragmentShadingRatePropertiesKHR rateProps{};
+	rateProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+
+	VkPhysicalDeviceProperties2 props{};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &rateProps;
+	vkGetPhysicalDeviceProperties2( aContext.physicalDevice, &props );
+
+	// The limits are powers of two
+	auto const& minSize = rateProps.minFragmentShadingRateAttachmentTexelSize;
+	auto const& maxSize = rateProps.maxFragmentShadingRateAttachmentTexelSize;
+	if( 0 == minSize.width || 0 == minSize.height )
+		return VkExtent2D{ 0, 0 };
+
+	return VkExtent2D{
+		std::clamp( kPreferredTexelSize, minSize.width, maxSize.width ),
+		std::clamp( kPreferredTexelSize, minSize.height, maxSize.height )
+	};
+}
+
+lut::RenderPass create_shading_rate_render_pass( lut::VulkanWindow const& aWindow, VkRenderPassCreateInfo const& aPassInfo, std::uint32_t aSubpass, VkExtent2D aTexelSize, void const* aSubpassNext )
+{
+	assert( aSubpass < aPassInfo.subpassCount );
+
+	// Attachments, plus the rate image. It is only read; the compute shader
+	// rewrites all of it after the pass.
+	std::uint32_t const rateAttachment = aPassInfo.attachmentCount;
+
+	VkAttachmentDescription2 rate{};
+	rate.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+	rate.format = kShadingRateFormat;
+	rate.samples = VK_SAMPLE_COUNT_1_BIT;
+	rate.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	rate.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	rate.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	rate.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	rate.initialLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+	rate.finalLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+	VkAttachmentReference2 rateRef{};
+	rateRef.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+	rateRef.attachment = rateAttachment;
+	rateRef.layout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+	VkFragmentShadingRateAttachmentInfoKHR rateInfo{};
+	rateInfo.sType = VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR;
+	rateInfo.pNext = aSubpassNext;
+	rateInfo.pFragmentShadingRateAttachment = &rateRef;
+	rateInfo.shadingRateAttachmentTexelSize = aTexelSize;
+
+	return lut::create_render_pass2( aWindow, aPassInfo, aSubpass, &rateInfo, &rate );
+}
+
+ShadingRate create_shading_rate( lut::VulkanWindow const& aWindow, lut::DescriptorAllocator& aDescriptors, lut::SamplerCache& aSamplers, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkExtent2D aTexelSize, float aThreshold, VkPipelineCache aCache )
+{
+	ShadingRate ret;
+	ret.texelSize = aTexelSize;
+	ret.threshold = aThreshold;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shading rate descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		range.offset = 0;
+		range.size = sizeof(ShadingRatePush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shading rate pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = ret.pipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shading rate pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipe = lut::Pipeline( aWindow.device, pipe );
+	}
+
+	// Sampler; the shader only uses texelFetch()
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_NEAREST;
+		sampInfo.minFilter = VK_FILTER_NEAREST;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = 0.f;
+
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+
+	return ret;
+}
+
+void resize_shading_rate( ShadingRate& aRate, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, VkImageView aDepthView )
+{
+	aRate.extent = VkExtent2D{
+		(aWindow.swapchainExtent.width + aRate.texelSize.width - 1) / aRate.texelSize.width,
+		(aWindow.swapchainExtent.height + aRate.texelSize.height - 1) / aRate.texelSize.height
+	};
+
+	// Image
+	aRate.view = lut::ImageView();
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = kShadingRateFormat;
+		imgInfo.extent = VkExtent3D{ aRate.extent.width, aRate.extent.height, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = 1;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		aRate.image = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+		lut::set_name( aWindow, aRate.image, "shading rate image" );
+	}
+
+	aRate.view = lut::create_image_view_texture2d( aWindow, aRate.image.image, kShadingRateFormat );
+
+	// Descriptors
+	{
+		VkDescriptorImageInfo depthInfo{};
+		depthInfo.sampler = aRate.sampler;
+		depthInfo.imageView = aDepthView;
+		depthInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		VkDescriptorImageInfo rateInfo{};
+		rateInfo.imageView = aRate.view.handle;
+		rateInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet desc[2]{};
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = aRate.descriptors;
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[0].descriptorCount = 1;
+		desc[0].pImageInfo = &depthInfo;
+
+		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[1].dstSet = aRate.descriptors;
+		desc[1].dstBinding = 1;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		desc[1].descriptorCount = 1;
+		desc[1].pImageInfo = &rateInfo;
+
+		vkUpdateDescriptorSets( aWindow.device, 2, desc, 0, nullptr );
+	}
+
+	// The first frame has no depth to go by: clear to 1x1 (0), and leave the
+	// image as the render pass expects it
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	lut::image_barrier( cmd, aRate.image.image,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	VkClearColorValue const clear{};
+	VkImageSubresourceRange const range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdClearColorImage( cmd, aRate.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear, 1, &range );
+
+	lut::image_barrier( cmd, aRate.image.image,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR );
+
+	batch.submit().wait();
+}
+
+void record_shading_rate( VkCommandBuffer aCmdBuff, ShadingRate const& aRate )
+{
+	// This frame's render pass read the rates before they are overwritten;
+	// all of the image is rewritten
+	lut::image_barrier( aCmdBuff, aRate.image.image,
+		0, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aRate.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aRate.pipeLayout.handle, 0, 1, &aRate.descriptors, 0, nullptr );
+
+	ShadingRatePush_ push{};
+	push.texelSize[0] = aRate.texelSize.width;
+	push.texelSize[1] = aRate.texelSize.height;
+	push.threshold = aRate.threshold;
+	push.enabled = aRate.enabled ? 1 : 0;
+	vkCmdPushConstants( aCmdBuff, aRate.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+
+	vkCmdDispatch( aCmdBuff,
+		(aRate.extent.width + kShadingRateWorkgroupSize-1) / kShadingRateWorkgroupSize,
+		(aRate.extent.height + kShadingRateWorkgroupSize-1) / kShadingRateWorkgroupSize,
+		1 );
+
+	// The next frame's render pass reads the rates
+	lut::image_barrier( aCmdBuff, aRate.image.image,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR );
+}
@@ -0,0 +1,103 @@
+#ifndef SHADING_RATE_HPP_7C0A4E2B_91D3_4F58_A6B1_3E5D8C27F904
+#define SHADING_RATE_HPP_7C0A4E2B_91D3_4F58_A6B1_3E5D8C27F904
+
+// Variable rate shading (--shading-rate=depth, VK_KHR_fragment_shading_rate),
+// for the forward colour subpass. A shading rate image, with one texel per
+// tile of (texelSize) pixels, selects coarser fragments where the previous
+// frame's depth buffer shows a single flat surface: window-space depth is
+// affine in x and y across a plane, so its second differences vanish, and
+// they are large at silhouettes and creases. Such tiles shade at 2x2 (or
+// 4x4 where nothing was drawn); all others at 1x1. The image is built in a
+// compute shader (cw2/shaders/shading_rate.comp) after the render pass, and
+// used by the next frame's.
+//
+// Note: limitation: the rates lag a frame behind, so geometry edges that
+// move by more than a tile may briefly be shaded coarsely.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+constexpr VkFormat kShadingRateFormat = VK_FORMAT_R8_UINT;
+
+// Tile size of the shading rate attachment, or {0,0} if the device can't use
+// shading rate attachments (or the format as a storage image).
+VkExtent2D query_shading_rate_texel_size( lut::VulkanContext const& );
+
+// aPassInfo as VkRenderPassCreateInfo2 (see lut::create_render_pass2()),
+// with the shading rate image appended as the last attachment, and used by
+// aSubpass. The attachment is in
+// VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR before and
+// after the pass. aSubpassNext is chained into aSubpass's description after
+// the shading rate attachment info.
+lut::RenderPass create_shading_rate_render_pass(
+	lut::VulkanWindow const&,
+	VkRenderPassCreateInfo const& aPassInfo,
+	std::uint32_t aSubpass,
+	VkExtent2D aTexelSize,
+	void const* aSubpassNext = nullptr
+);
+
+struct ShadingRate
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	VkSampler sampler = VK_NULL_HANDLE; // nearest, clamp to edge; from the cache
+
+	lut::Image image; // kShadingRateFormat
+	lut::ImageView view;
+
+	// binding 0 = the depth buffer, binding 1 = the rate image
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+
+	VkExtent2D texelSize{};
+	VkExtent2D extent{}; // of the rate image
+
+	float threshold = 0.f;  // see shading_rate.comp
+
+	// False: all tiles are shaded at 1x1 (toggled at runtime)
+	bool enabled = true;
+};
+
+// aThreshold is the largest relative second difference of depth (see
+// shading_rate.comp) that still counts as flat.
+ShadingRate create_shading_rate(
+	lut::VulkanWindow const&,
+	lut::DescriptorAllocator&,
+	lut::SamplerCache&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	VkExtent2D aTexelSize,
+	float aThreshold,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// (Re-)creates the rate image for the current swapchain size, all 1x1. The
+// depth image must have been created with VK_IMAGE_USAGE_SAMPLED_BIT. The
+// image must not be in use by the GPU. Uses aCmdPool for a one-off clear,
+// and waits for it to complete.
+void resize_shading_rate(
+	ShadingRate&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	VkImageView aDepthView
+);
+
+// Records the rate image build for the next frame. The depth buffer must be
+// in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, with its writes made
+// visible to the compute stage (see create_render_pass()).
+void record_shading_rate( VkCommandBuffer, ShadingRate const& );
+
+#endif // SHADING_RATE_HPP_7C0A4E2B_91D3_4F58_A6B1_3E5D8C27F904
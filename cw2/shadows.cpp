@@ -0,0 +1,410 @@
+#include "shadows.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	// Fraction of the difference applied per measurement; the face costs
+	// vary with what each face sees
+	constexpr float kShadowTimeSmoothing = 0.2f;
+
+	lut::RenderPass create_shadow_render_pass_( lut::VulkanContext const& );
+
+	// The view looks down the face's axis, with the up vectors of the cube
+	// map conventions (see "Cube Map Face Selection" in the Vulkan spec), so
+	// that the texel the face renders to is the one that the direction
+	// samples.
+	glm::mat4 face_proj_view_( std::uint32_t aFace, glm::vec3 const& aLight );
+}
+
+ShadowCache create_shadow_cache( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::SamplerCache& aSamplers, VkCommandPool aCmdPool, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aMaterialLayout, std::uint32_t aSize, float aBudgetMs )
+{
+	assert( aSize > 0 );
+
+	ShadowCache ret;
+	ret.size = aSize;
+	ret.budgetMs = aBudgetMs;
+
+	// Image and views
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = kShadowFormat;
+		imgInfo.extent = VkExtent3D{ aSize, aSize, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = kShadowFaceCount;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		ret.cube = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+		lut::set_name( aWindow, ret.cube, "shadow cube" );
+	}
+
+	auto const create_view_ = [&] (VkImageViewType aType, std::uint32_t aFirstLayer, std::uint32_t aLayers) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = ret.cube.image;
+		viewInfo.viewType = aType;
+		viewInfo.format = kShadowFormat;
+		viewInfo.components = VkComponentMapping{};
+		viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, aFirstLayer, aLayers };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shadow cube image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+		return lut::ImageView( aWindow.device, view );
+	};
+
+	ret.cubeView = create_view_( VK_IMAGE_VIEW_TYPE_CUBE, 0, kShadowFaceCount );
+	for( std::uint32_t face = 0; face < kShadowFaceCount; ++face )
+		ret.faceViews[face] = create_view_( VK_IMAGE_VIEW_TYPE_2D, face, 1 );
+
+	// Render pass and framebuffers
+	ret.renderPass = create_shadow_render_pass_( aWindow );
+
+	for( std::uint32_t face = 0; face < kShadowFaceCount; ++face )
+	{
+		VkFramebufferCreateInfo fbInfo{};
+		fbInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		fbInfo.renderPass = ret.renderPass.handle;
+		fbInfo.attachmentCount = 1;
+		fbInfo.pAttachments = &ret.faceViews[face].handle;
+		fbInfo.width = aSize;
+		fbInfo.height = aSize;
+		fbInfo.layers = 1;
+
+		VkFramebuffer fb = VK_NULL_HANDLE;
+		if( auto const res = vkCreateFramebuffer( aWindow.device, &fbInfo, nullptr, &fb ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shadow cube framebuffer %u\n" "vkCreateFramebuffer() returned %s", face, lut::to_string(res).c_str() );
+
+		ret.framebuffers[face] = lut::Framebuffer( aWindow.device, fb );
+	}
+
+	// Pipeline layout
+	{
+		// The alpha test of texture arrays takes the material from
+		// kMaterialPushOffset on, as in the colour pass
+		static_assert( sizeof(ShadowPushConstants) <= kMaterialPushOffset, "ShadowPushConstants overlap the pushed material" );
+		VkPushConstantRange ranges[2]{};
+		ranges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		ranges[0].offset = 0;
+		ranges[0].size = sizeof(ShadowPushConstants);
+		ranges[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		ranges[1].offset = kMaterialPushOffset;
+		ranges[1].size = sizeof(MaterialIndices);
+
+		VkDescriptorSetLayout const layouts[] = { aSceneLayout, aMaterialLayout };
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = sizeof(ranges) / sizeof(ranges[0]);
+		layoutInfo.pPushConstantRanges = ranges;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shadow pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	// Comparison sampler; linear filtering gives 2x2 PCF
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_LINEAR;
+		sampInfo.minFilter = VK_FILTER_LINEAR;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.compareEnable = VK_TRUE;
+		sampInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = 0.f;
+		sampInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+		ret.sampler = aSamplers.get( sampInfo );
+	}
+
+	// All faces start out at the far plane, i.e., unshadowed, and wait in
+	// SHADER_READ_ONLY_OPTIMAL for their first update
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	VkImageSubresourceRange const all{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, kShadowFaceCount };
+	lut::image_barrier( cmd, ret.cube.image,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		all );
+
+	VkClearDepthStencilValue const far{ 1.f, 0 };
+	vkCmdClearDepthStencilImage( cmd, ret.cube.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &far, 1, &all );
+
+	lut::image_barrier( cmd, ret.cube.image,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		all );
+
+	batch.submit().wait();
+
+	return ret;
+}
+
+void note_shadow_time( ShadowCache& aCache, double aMs, std::uint32_t aFaces )
+{
+	if( aMs < 0.0 || 0 == aFaces )
+		return;
+
+	float const faceMs = float(aMs) / float(aFaces);
+	if( aCache.faceMs < 0.f )
+		aCache.faceMs = faceMs;
+	else
+		aCache.faceMs += kShadowTimeSmoothing * (faceMs - aCache.faceMs);
+}
+
+void invalidate_shadows( ShadowCache& aCache )
+{
+	for( auto& valid : aCache.faceValid )
+		valid = false;
+}
+
+std::uint32_t plan_shadow_updates( ShadowCache& aCache, glm::vec3 const& aLight )
+{
+	aCache.updateCount = 0;
+	aCache.updateLight = aLight;
+
+	if( aCache.budgetMs <= 0.f )
+		return 0;
+
+	// At least one face per frame, so that a moving light is never starved
+	std::uint32_t maxFaces = kShadowUntimedFaces;
+	if( aCache.faceMs > 0.f )
+		maxFaces = std::uint32_t( std::clamp( aCache.budgetMs / aCache.faceMs, 1.f, float(kShadowFaceCount) ) );
+
+	for( std::uint32_t i = 0; i < kShadowFaceCount && aCache.updateCount < maxFaces; ++i )
+	{
+		std::uint32_t const face = (aCache.nextFace + i) % kShadowFaceCount;
+		if( aCache.faceValid[face] && aCache.faceLight[face] == aLight )
+			continue;
+
+		aCache.updateFaces[aCache.updateCount++] = face;
+		aCache.faceLight[face] = aLight;
+		aCache.faceValid[face] = true;
+		aCache.nextFace = (face + 1) % kShadowFaceCount;
+	}
+
+	return aCache.updateCount;
+}
+
+void record_shadow_updates( VkCommandBuffer aCmdBuff, ShadowCache const& aCache, VkPipeline aPipe, VkPipeline aAlphaPipe, ModelPack const& aModel, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset, bool aMultiDrawIndirect, bool aPositionStream )
+{
+	if( 0 == aCache.updateCount )
+		return;
+
+	// Bindless: one set for all materials, which the shaders find through
+	// instanceKey(). With a descriptor buffer, both sets come from it (the
+	// pipelines were created for it).
+	bool const bindless = VK_NULL_HANDLE != aModel.bindlessDescriptors || aModel.descriptorBuffer;
+	if( aModel.descriptorBuffer )
+	{
+		VkDeviceSize const bindlessSet = VK_NULL_HANDLE != aAlphaPipe ? aModel.bindlessSet : ~VkDeviceSize(0);
+		bind_descriptor_buffer_sets( aCmdBuff, *aModel.descriptorBuffer, aCache.pipeLayout.handle, aSceneOffset, bindlessSet );
+	}
+	else
+	{
+		vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aCache.pipeLayout.handle, 0, 1, &aSceneDescriptors, 1, &aSceneOffset );
+		if( VK_NULL_HANDLE != aAlphaPipe && bindless )
+			vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aCache.pipeLayout.handle, 1, 1, &aModel.bindlessDescriptors, 0, nullptr );
+	}
+
+	VkViewport viewport{};
+	viewport.width = float(aCache.size);
+	viewport.height = float(aCache.size);
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport( aCmdBuff, 0, 1, &viewport );
+
+	VkRect2D const scissor{ VkOffset2D{ 0, 0 }, VkExtent2D{ aCache.size, aCache.size } };
+	vkCmdSetScissor( aCmdBuff, 0, 1, &scissor );
+
+	// As record_scene_draws() in main.cpp
+	VkBuffer const vertexBuffers[2] = { aModel.vertices.buffer, aModel.meshInstances.buffer };
+	VkDeviceSize const offsets[2]{};
+	vkCmdBindVertexBuffers( aCmdBuff, 0, VK_NULL_HANDLE != aModel.meshInstances.buffer ? 2 : 1, vertexBuffers, offsets );
+
+	constexpr std::uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	for( std::uint32_t i = 0; i < aCache.updateCount; ++i )
+	{
+		std::uint32_t const face = aCache.updateFaces[i];
+
+		VkClearValue clear{};
+		clear.depthStencil.depth = 1.f;
+
+		VkRenderPassBeginInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		passInfo.renderPass = aCache.renderPass.handle;
+		passInfo.framebuffer = aCache.framebuffers[face].handle;
+		passInfo.renderArea = scissor;
+		passInfo.clearValueCount = 1;
+		passInfo.pClearValues = &clear;
+
+		vkCmdBeginRenderPass( aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE );
+
+		ShadowPushConstants const push{ face_proj_view_( face, aCache.updateLight ) };
+		vkCmdPushConstants( aCmdBuff, aCache.pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push );
+
+		// Every mesh at full detail; the batches are sorted by index
+		// type, so the index buffer changes at most once per group
+		VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+		auto const draw_batch_ = [&] (DrawBatch const& aBatch) {
+			if( boundIndexType != aBatch.indexType )
+			{
+				VkDeviceSize const offset = VK_INDEX_TYPE_UINT16 == aBatch.indexType ? 0 : aModel.indices32Offset;
+				vkCmdBindIndexBuffer( aCmdBuff, aModel.indices.buffer, offset, aBatch.indexType );
+				boundIndexType = aBatch.indexType;
+			}
+
+			VkDeviceSize const offset = VkDeviceSize(aBatch.firstCommand) * stride;
+			if( aMultiDrawIndirect )
+				vkCmdDrawIndexedIndirect( aCmdBuff, aModel.drawCommands.buffer, offset, aBatch.commandCount, stride );
+			else
+			{
+				for( std::uint32_t c = 0; c < aBatch.commandCount; ++c )
+					vkCmdDrawIndexedIndirect( aCmdBuff, aModel.drawCommands.buffer, offset + VkDeviceSize(c) * stride, 1, stride );
+			}
+		};
+
+		if( aPositionStream )
+			vkCmdBindVertexBuffers( aCmdBuff, 0, 1, &aModel.positions.buffer, offsets );
+		vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPipe );
+		for( auto const& batch : aModel.opaqueBatches )
+			draw_batch_( batch );
+
+		// The alpha-masked ones with their material (one per batch), from
+		// the interleaved vertices
+		if( VK_NULL_HANDLE != aAlphaPipe && !aModel.alphaBatches.empty() )
+		{
+			if( aPositionStream )
+				vkCmdBindVertexBuffers( aCmdBuff, 0, 1, &aModel.vertices.buffer, offsets );
+			vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aAlphaPipe );
+
+			// Texture arrays: the set of the arrays, and the material
+			// pushed (see ModelPack::arrayMaterials)
+			bool const textureArrays = !aModel.arrayMaterials.empty();
+			std::uint32_t boundSet = ~std::uint32_t(0);
+			for( auto const& batch : aModel.alphaBatches )
+			{
+				std::uint32_t const set = textureArrays ? aModel.materialSets[batch.matID] : batch.matID;
+				if( !bindless && boundSet != set )
+				{
+					vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aCache.pipeLayout.handle, 1, 1, &aModel.matDecriptors[set], 0, nullptr );
+					boundSet = set;
+				}
+				if( textureArrays )
+					vkCmdPushConstants( aCmdBuff, aCache.pipeLayout.handle, VK_SHADER_STAGE_FRAGMENT_BIT, kMaterialPushOffset, sizeof(MaterialIndices), &aModel.arrayMaterials[batch.matID] );
+				draw_batch_( batch );
+			}
+		}
+
+		vkCmdEndRenderPass( aCmdBuff );
+	}
+}
+
+namespace
+{
+	lut::RenderPass create_shadow_render_pass_( lut::VulkanContext const& aContext )
+	{
+		// Faces are always rendered whole, so their old contents are never
+		// loaded
+		VkAttachmentDescription attachment{};
+		attachment.format = kShadowFormat;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference depthRef{ 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depthRef;
+
+		// The previous frames' shading passes sample the face before it is
+		// overwritten; this frame's sample it afterwards
+		VkSubpassDependency deps[2]{};
+		deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		deps[0].dstSubpass = 0;
+		deps[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		deps[0].srcAccessMask = 0;
+		deps[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		deps[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		deps[1].srcSubpass = 0;
+		deps[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		deps[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		deps[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		deps[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		deps[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		passInfo.attachmentCount = 1;
+		passInfo.pAttachments = &attachment;
+		passInfo.subpassCount = 1;
+		passInfo.pSubpasses = &subpass;
+		passInfo.dependencyCount = 2;
+		passInfo.pDependencies = deps;
+
+		VkRenderPass rpass = VK_NULL_HANDLE;
+		if( auto const res = vkCreateRenderPass( aContext.device, &passInfo, nullptr, &rpass ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create shadow render pass\n" "vkCreateRenderPass() returned %s", lut::to_string(res).c_str() );
+
+		return lut::RenderPass( aContext.device, rpass );
+	}
+
+	glm::mat4 face_proj_view_( std::uint32_t aFace, glm::vec3 const& aLight )
+	{
+		// +X, -X, +Y, -Y, +Z, -Z (the layer order of cube images)
+		static glm::vec3 const kForward[kShadowFaceCount] = {
+			{ 1.f, 0.f, 0.f }, { -1.f, 0.f, 0.f },
+			{ 0.f, 1.f, 0.f }, { 0.f, -1.f, 0.f },
+			{ 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f }
+		};
+		static glm::vec3 const kUp[kShadowFaceCount] = {
+			{ 0.f, -1.f, 0.f }, { 0.f, -1.f, 0.f },
+			{ 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f },
+			{ 0.f, -1.f, 0.f }, { 0.f, -1.f, 0.f }
+		};
+
+		// Unlike the camera's projection, y is not flipped: the cube map
+		// conventions already have t pointing down
+		glm::mat4 const proj = glm::perspectiveRH_ZO( glm::half_pi<float>(), 1.f, kShadowNear, kShadowFar );
+		glm::mat4 const view = glm::lookAt( aLight, aLight + kForward[aFace], kUp[aFace] );
+		return proj * view;
+	}
+}
@@ -0,0 +1,133 @@
+#ifndef SHADOWS_HPP_4D7E1B38_A6C2_4F95_8B03_E59C27D1F6A4
+#define SHADOWS_HPP_4D7E1B38_A6C2_4F95_8B03_E59C27D1F6A4
+
+// Cached shadows of the scene's light (--shadow-budget). The light is a
+// point light, so its shadow map is a depth cube, one face per direction,
+// sampled with depth comparisons (cw2/shaders/shadows.glsl).
+//
+// The scene is static, so a face only depends on the light position: each
+// face remembers the position it was last rendered for, and is rendered
+// again only once the light has moved away from it. A static light costs no
+// shadow passes at all. While the light moves, the stale faces are updated
+// round-robin, as many per frame as fit in a GPU time budget (measured per
+// face with the frame's timestamps); the others lag behind by a few frames.
+//
+// The alpha-masked batches cast shadows through their alpha test, which only
+// reads the material's one-channel alpha coverage texture (see
+// depth_alpha.frag); the material set is bound as set 1.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+constexpr VkFormat kShadowFormat = VK_FORMAT_D32_SFLOAT;
+constexpr std::uint32_t kShadowFaceCount = 6;
+
+// Texels per side of each face
+constexpr std::uint32_t kShadowMapSize = 1024;
+
+// Depth range of the faces' projections; must match shadows.glsl
+constexpr float kShadowNear = 0.05f;
+constexpr float kShadowFar = 100.f;
+
+// Faces updated per frame before their cost has been measured (or without
+// GPU timestamps)
+constexpr std::uint32_t kShadowUntimedFaces = 1;
+
+// PShadow in cw2/shaders/shadow.vert
+struct ShadowPushConstants
+{
+	glm::mat4 lightProjView; // of the face
+};
+
+struct ShadowCache
+{
+	lut::Image cube; // kShadowFormat, 6 layers, cube compatible
+	lut::ImageView cubeView; // sampled, SHADER_READ_ONLY_OPTIMAL between updates
+	lut::ImageView faceViews[kShadowFaceCount];
+
+	lut::RenderPass renderPass; // depth only
+	lut::Framebuffer framebuffers[kShadowFaceCount];
+	lut::PipelineLayout pipeLayout; // the scene's set 0 (for the instances), the material set 1, ShadowPushConstants (and kMaterialPushOffset)
+
+	VkSampler sampler = VK_NULL_HANDLE; // comparison, linear; from the cache
+	std::uint32_t size = 0; // texels per side
+
+	float budgetMs = 0.f; // GPU time for face updates, per frame
+	float faceMs = -1.f; // measured time of one face; negative: none yet
+
+	// The light position that each face was last rendered for; faces that
+	// were never rendered hold the far plane (unshadowed)
+	glm::vec3 faceLight[kShadowFaceCount]{};
+	bool faceValid[kShadowFaceCount]{};
+	std::uint32_t nextFace = 0; // round-robin start
+
+	// Planned by plan_shadow_updates() for the frame being recorded
+	std::uint32_t updateFaces[kShadowFaceCount]{};
+	std::uint32_t updateCount = 0;
+	glm::vec3 updateLight{ 0.f };
+};
+
+// aSize: texels per side. With aBudgetMs <= 0, the cache is never updated,
+// and the faces keep their initial far-plane depth (no shadows).
+// aSceneLayout is set 0 of the pipeline layout; shadow.vert reads the model's
+// instances from it. aMaterialLayout is set 1, that of the colour pass
+// (per-material or bindless), for the alpha test; with --descriptor-buffer,
+// both are those of DescriptorBufferSets. Throws labutils::Error on failure.
+ShadowCache create_shadow_cache(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	lut::SamplerCache&,
+	VkCommandPool,
+	VkDescriptorSetLayout aSceneLayout,
+	VkDescriptorSetLayout aMaterialLayout,
+	std::uint32_t aSize,
+	float aBudgetMs
+);
+
+// aMs: the GPU time of the aFaces updates that a frame recorded (negative:
+// not measured)
+void note_shadow_time( ShadowCache&, double aMs, std::uint32_t aFaces );
+
+// The geometry changed (see world_streaming.hpp): every face is stale, and
+// rendered again within the budget, as if the light had moved.
+void invalidate_shadows( ShadowCache& );
+
+// Picks the faces to update this frame (the stale ones, within the budget)
+// and marks them as rendered for aLight. Returns their number.
+std::uint32_t plan_shadow_updates( ShadowCache&, glm::vec3 const& aLight );
+
+// Renders the planned faces with aPipe (created against aCache.renderPass
+// and aCache.pipeLayout; see shadow.vert), with the scene's set bound at
+// aSceneOffset, and the alpha-masked batches with aAlphaPipe (see
+// shadow_alpha.vert; VK_NULL_HANDLE: they cast no shadows). With
+// aPositionStream, aPipe reads ModelPack::positions (see
+// create_shadow_pipeline() in main.cpp). The sets come from the model's
+// descriptor buffer if it has one (ModelPack::descriptorBuffer). Records
+// nothing without planned faces.
+void record_shadow_updates(
+	VkCommandBuffer,
+	ShadowCache const&,
+	VkPipeline aPipe,
+	VkPipeline aAlphaPipe,
+	ModelPack const&,
+	VkDescriptorSet aSceneDescriptors,
+	std::uint32_t aSceneOffset,
+	bool aMultiDrawIndirect,
+	bool aPositionStream
+);
+
+#endif // SHADOWS_HPP_4D7E1B38_A6C2_4F95_8B03_E59C27D1F6A4
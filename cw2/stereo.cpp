@@ -0,0 +1,167 @@
+#include "stereo.hpp"
+
+#include <algorithm>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	void create_layers_( lut::VulkanWindow const&, lut::Allocator const&, VkExtent2D const&, VkFormat, VkImageUsageFlags, VkImageAspectFlags, bool aTransient, lut::Image&, lut::ImageView& );
+}
+
+bool supports_stereo( lut::VulkanWindow const& aWindow )
+{
+	if( !aWindow.caps.multiview )
+		return false;
+
+	if( !(aWindow.swapchainUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) )
+		return false;
+
+	VkFormatProperties props{};
+	vkGetPhysicalDeviceFormatProperties( aWindow.physicalDevice, aWindow.swapchainFormat, &props );
+
+	VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+	return needed == (props.optimalTilingFeatures & needed);
+}
+
+VkExtent2D stereo_eye_extent( VkExtent2D const& aSwapchainExtent )
+{
+	return VkExtent2D{ std::max( aSwapchainExtent.width / 2, 1u ), aSwapchainExtent.height };
+}
+
+StereoTargets create_stereo_targets( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkFormat aDepthFormat )
+{
+	StereoTargets ret;
+	ret.extent = stereo_eye_extent( aWindow.swapchainExtent );
+
+	create_layers_( aWindow, aAllocator, ret.extent, aWindow.swapchainFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT, false, ret.colour, ret.colourView );
+	create_layers_( aWindow, aAllocator, ret.extent, aDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, true, ret.depth, ret.depthView );
+
+	lut::set_name( aWindow, ret.colour, "stereo colour" );
+	lut::set_name( aWindow, ret.depth, "stereo depth" );
+
+	return ret;
+}
+
+void record_stereo_compose( VkCommandBuffer aCmdBuff, StereoTargets const& aTargets, VkImage aDst, VkExtent2D const& aDstExtent, bool aOffscreen )
+{
+	VkImageSubresourceRange const eyes{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 2 };
+
+	lut::image_barrier( aCmdBuff, aTargets.colour.image,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		eyes );
+
+	// The previous contents are replaced entirely (but for the odd column
+	// of an odd width, which is cleared)
+	lut::image_barrier( aCmdBuff, aDst,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	if( aDstExtent.width != 2 * aTargets.extent.width )
+	{
+		VkClearColorValue const black{};
+		VkImageSubresourceRange const range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdClearColorImage( aCmdBuff, aDst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range );
+
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+	}
+
+	// Same format and size: plain copies, left eye on the left
+	VkImageCopy copies[2]{};
+	for( std::uint32_t eye = 0; eye < 2; ++eye )
+	{
+		auto& copy = copies[eye];
+		copy.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, eye, 1 };
+		copy.dstSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.dstOffset = VkOffset3D{ std::int32_t(eye * aTargets.extent.width), 0, 0 };
+		copy.extent = VkExtent3D{ aTargets.extent.width, aTargets.extent.height, 1 };
+	}
+
+	vkCmdCopyImage( aCmdBuff,
+		aTargets.colour.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		aDst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		2, copies
+	);
+
+	if( aOffscreen )
+	{
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+	}
+	else
+	{
+		// Presentation waits for the semaphore signalled by the submission
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT );
+	}
+
+	// The next frame's render pass overwrites the layers (write-after-read)
+	lut::image_barrier( aCmdBuff, aTargets.colour.image,
+		0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		eyes );
+}
+
+namespace
+{
+	void create_layers_( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkExtent2D const& aExtent, VkFormat aFormat, VkImageUsageFlags aUsage, VkImageAspectFlags aAspect, bool aTransient, lut::Image& aImage, lut::ImageView& aView )
+	{
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = aFormat;
+		imgInfo.extent = VkExtent3D{ aExtent.width, aExtent.height, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = 2;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = aUsage | (aTransient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		// As create_transient_attachment() (see deferred.hpp)
+		if( aTransient )
+		{
+			VmaAllocationCreateInfo allocInfo{};
+			allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+			VkImage image = VK_NULL_HANDLE;
+			VmaAllocation allocation = VK_NULL_HANDLE;
+			if( VK_SUCCESS == vmaCreateImage( aAllocator.allocator, &imgInfo, &allocInfo, &image, &allocation, nullptr ) )
+			{
+				lut::tag_allocation( aAllocator.allocator, allocation, lut::EMemoryClass::renderTargets );
+				aImage = lut::Image( aAllocator.allocator, image, allocation );
+			}
+		}
+		if( VK_NULL_HANDLE == aImage.image )
+			aImage = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = aImage.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.format = aFormat;
+		viewInfo.components = VkComponentMapping{};
+		viewInfo.subresourceRange = VkImageSubresourceRange{ aAspect, 0, 1, 0, 2 };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create stereo attachment image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+		aView = lut::ImageView( aWindow.device, view );
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef STEREO_HPP_5E2A91C7_0B84_4D3F_A6E9_C71F28D4B035
+#define STEREO_HPP_5E2A91C7_0B84_4D3F_A6E9_C71F28D4B035
+
+// Single-pass stereo (--stereo=multiview), for a headset. Instead of
+// recording the frame once per eye, both eyes are drawn by one render pass
+// with multiview (VK_KHR_multiview, core in Vulkan 1.1): the colour and
+// depth attachments are two-layer arrays, the subpass's view mask covers
+// both layers, and the device repeats every draw per layer. The vertex
+// shaders (*_stereo.vert) project by SceneUniform::viewProjCam[gl_ViewIndex].
+// Culling, recording and submission happen once for both eyes.
+//
+// The eyes look the same way as the camera, kStereoEyeSeparation apart on
+// its x axis; each is half the swapchain's width. The culling frustum
+// (SceneUniform::projCam) has its apex behind the camera, so that it
+// contains both eyes' frusta. Shading uses the camera's position for both
+// eyes.
+//
+// Until the frames go to a headset's compositor, the two layers are copied
+// side by side into the swapchain image after the pass.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// Interpupillary distance, in scene units (metres)
+constexpr float kStereoEyeSeparation = 0.064f;
+
+// View mask of the stereo subpass: layers 0 (left eye) and 1 (right eye)
+constexpr std::uint32_t kStereoViewMask = 0b11;
+
+// Whether the device can draw both eyes in one pass (multiview, two views),
+// and the layers can be copied into the swapchain images
+bool supports_stereo( lut::VulkanWindow const& );
+
+// An eye's share of the swapchain image: the left or the right half
+VkExtent2D stereo_eye_extent( VkExtent2D const& aSwapchainExtent );
+
+struct StereoTargets
+{
+	VkExtent2D extent{}; // per eye, see stereo_eye_extent()
+
+	lut::Image colour; // swapchain format, a layer per eye
+	lut::ImageView colourView; // 2D array, the framebuffer's attachment 0
+
+	lut::Image depth; // aDepthFormat, a layer per eye; only lives within the pass
+	lut::ImageView depthView;
+};
+
+// Images for the current swapchain size
+StereoTargets create_stereo_targets( lut::VulkanWindow const&, lut::Allocator const&, VkFormat aDepthFormat );
+
+// Copies the eyes, which the render pass left in TRANSFER_SRC_OPTIMAL, side
+// by side into aDst (a swapchain image). aDst ends in PRESENT_SRC_KHR, or
+// with aOffscreen in TRANSFER_SRC_OPTIMAL (visible to transfers), as with
+// record_upscale().
+void record_stereo_compose(
+	VkCommandBuffer,
+	StereoTargets const&,
+	VkImage aDst,
+	VkExtent2D const& aDstExtent,
+	bool aOffscreen
+);
+
+#endif // STEREO_HPP_5E2A91C7_0B84_4D3F_A6E9_C71F28D4B035
@@ -0,0 +1,323 @@
+#include "temporal_upscale.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/upload_batch.hpp"
+
+namespace
+{
+	constexpr VkFormat kHistoryFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+	constexpr std::uint32_t kResolveWorkgroupSize = 8; // local_size_x/y in temporal_resolve.comp
+
+	// Push constants of temporal_resolve.comp
+	struct ResolveParams_
+	{
+		glm::mat4 reproject; // this frame's (unjittered) NDC to the previous frame's clip space
+		glm::vec2 jitter; // render pixels
+		std::uint32_t renderWidth, renderHeight;
+		float blend;
+		std::uint32_t historyValid;
+	};
+
+	static_assert( sizeof(ResolveParams_) <= 128, "ResolveParams_ must be at most 128 bytes to fit any push constant range" );
+
+	float halton_( std::uint32_t aIndex, std::uint32_t aBase )
+	{
+		float ret = 0.f, digit = 1.f;
+		for( ; aIndex > 0; aIndex /= aBase )
+		{
+			digit /= float(aBase);
+			ret += digit * float(aIndex % aBase);
+		}
+		return ret;
+	}
+
+	VkSampler sampler_( lut::SamplerCache& aSamplers, VkFilter aFilter )
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = aFilter;
+		sampInfo.minFilter = aFilter;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = 0.f;
+
+		return aSamplers.get( sampInfo );
+	}
+}
+
+bool supports_temporal_upscale( lut::VulkanWindow const& aWindow )
+{
+	VkFormatProperties props{};
+	vkGetPhysicalDeviceFormatProperties( aWindow.physicalDevice, kHistoryFormat, &props );
+
+	VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT;
+	return needed == (props.optimalTilingFeatures & needed);
+}
+
+TemporalUpscale create_temporal_upscale( lut::VulkanWindow const& aWindow, lut::DescriptorAllocator& aDescriptors, lut::SamplerCache& aSamplers, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkPipelineCache aCache )
+{
+	TemporalUpscale ret;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[4]{};
+		for( std::uint32_t i = 0; i < 4; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = 3 == i ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create temporal upscale descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline
+	{
+		VkPushConstantRange pushRange{};
+		pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushRange.size = sizeof(ResolveParams_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &ret.layout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushRange;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create temporal upscale pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = ret.pipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create temporal upscale pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipe = lut::Pipeline( aWindow.device, pipe );
+	}
+
+	// The render target and depth buffer are fetched per texel; the
+	// history is resampled where the pixel was in the previous frame
+	ret.nearestSampler = sampler_( aSamplers, VK_FILTER_NEAREST );
+	ret.linearSampler = sampler_( aSamplers, VK_FILTER_LINEAR );
+
+	// The sets are allocated up front and rewritten on resize (the
+	// allocator does not free individual sets).
+	for( auto& set : ret.descriptors )
+		set = aDescriptors.allocate( ret.layout.handle );
+
+	return ret;
+}
+
+void resize_temporal_upscale( TemporalUpscale& aUpscale, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, VkImageView aColourView, VkImageView aDepthView )
+{
+	aUpscale.extent = aWindow.swapchainExtent;
+	aUpscale.valid = false;
+
+	// Images
+	for( std::uint32_t i = 0; i < 2; ++i )
+	{
+		aUpscale.historyViews[i] = lut::ImageView();
+
+		VkImageCreateInfo imgInfo{};
+		imgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imgInfo.imageType = VK_IMAGE_TYPE_2D;
+		imgInfo.format = kHistoryFormat;
+		imgInfo.extent = VkExtent3D{ aUpscale.extent.width, aUpscale.extent.height, 1 };
+		imgInfo.mipLevels = 1;
+		imgInfo.arrayLayers = 1;
+		imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		aUpscale.history[i] = lut::create_image( aAllocator, imgInfo, lut::EMemoryClass::renderTargets );
+		lut::set_name( aWindow, aUpscale.history[i], "temporal history" );
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = aUpscale.history[i].image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = kHistoryFormat;
+		viewInfo.components = VkComponentMapping{};
+		viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( aWindow.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create temporal history image view\n" "vkCreateImageView() returned %s", lut::to_string(res).c_str() );
+
+		aUpscale.historyViews[i] = lut::ImageView( aWindow.device, view );
+	}
+
+	// Descriptors
+	for( std::uint32_t i = 0; i < 2; ++i )
+	{
+		VkDescriptorImageInfo imageInfos[4]{};
+		imageInfos[0].sampler = aUpscale.nearestSampler;
+		imageInfos[0].imageView = aColourView;
+		imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		imageInfos[1].sampler = aUpscale.nearestSampler;
+		imageInfos[1].imageView = aDepthView;
+		imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		imageInfos[2].sampler = aUpscale.linearSampler;
+		imageInfos[2].imageView = aUpscale.historyViews[1-i].handle;
+		imageInfos[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		imageInfos[3].imageView = aUpscale.historyViews[i].handle;
+		imageInfos[3].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet desc[4]{};
+		for( std::uint32_t binding = 0; binding < 4; ++binding )
+		{
+			desc[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[binding].dstSet = aUpscale.descriptors[i];
+			desc[binding].dstBinding = binding;
+			desc[binding].descriptorType = 3 == binding ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[binding].descriptorCount = 1;
+			desc[binding].pImageInfo = &imageInfos[binding];
+		}
+
+		vkUpdateDescriptorSets( aWindow.device, 4, desc, 0, nullptr );
+	}
+
+	// Move both images to GENERAL once; they stay there.
+	lut::UploadBatch batch( aWindow, aCmdPool, aAllocator );
+	VkCommandBuffer const cmd = batch.commands();
+
+	for( auto const& history : aUpscale.history )
+	{
+		lut::image_barrier( cmd, history.image,
+			0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+	}
+
+	batch.submit().wait();
+}
+
+glm::mat4 begin_temporal_frame( TemporalUpscale& aUpscale, VkExtent2D const& aRenderExtent, glm::mat4 const& aProjCam )
+{
+	// Halton from index 1; index 0 would be the corner of the pixel
+	aUpscale.phase = aUpscale.phase % kTemporalJitterPhases + 1;
+	aUpscale.jitter = glm::vec2( halton_( aUpscale.phase, 2 ), halton_( aUpscale.phase, 3 ) ) - 0.5f;
+	aUpscale.projCam = aProjCam;
+
+	// Clip space offsets are scaled by w, i.e., shift the NDC by 2/size
+	// per pixel
+	glm::vec3 const offset( 2.f * aUpscale.jitter.x / float(aRenderExtent.width), 2.f * aUpscale.jitter.y / float(aRenderExtent.height), 0.f );
+	return glm::translate( glm::mat4( 1.f ), offset );
+}
+
+void record_temporal_resolve( VkCommandBuffer aCmdBuff, TemporalUpscale& aUpscale, VkImage aColour, VkExtent2D const& aRenderExtent, VkImage aDst, VkExtent2D const& aDstExtent, bool aOffscreen )
+{
+	VkImage const history = aUpscale.history[aUpscale.current].image;
+
+	lut::image_barrier( aCmdBuff, aColour,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	// Two frames ago, this history was blitted from, and read by the
+	// resolve that followed
+	lut::image_barrier( aCmdBuff, history,
+		VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	ResolveParams_ params{};
+	params.reproject = aUpscale.prevProjCam * glm::inverse( aUpscale.projCam );
+	params.jitter = aUpscale.jitter;
+	params.renderWidth = aRenderExtent.width;
+	params.renderHeight = aRenderExtent.height;
+	params.blend = kTemporalBlend;
+	params.historyValid = aUpscale.valid ? 1 : 0;
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aUpscale.pipe.handle );
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aUpscale.pipeLayout.handle, 0, 1, &aUpscale.descriptors[aUpscale.current], 0, nullptr );
+	vkCmdPushConstants( aCmdBuff, aUpscale.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params );
+	vkCmdDispatch( aCmdBuff, (aUpscale.extent.width + kResolveWorkgroupSize-1) / kResolveWorkgroupSize, (aUpscale.extent.height + kResolveWorkgroupSize-1) / kResolveWorkgroupSize, 1 );
+
+	// Blitted below, and read by the next frame's resolve
+	lut::image_barrier( aCmdBuff, history,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	// The previous contents are replaced entirely
+	lut::image_barrier( aCmdBuff, aDst,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	// Same size; converts to the swapchain's format
+	VkImageBlit blit{};
+	blit.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.srcOffsets[1] = VkOffset3D{ std::int32_t(aUpscale.extent.width), std::int32_t(aUpscale.extent.height), 1 };
+	blit.dstSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.dstOffsets[1] = VkOffset3D{ std::int32_t(aDstExtent.width), std::int32_t(aDstExtent.height), 1 };
+
+	vkCmdBlitImage( aCmdBuff,
+		history, VK_IMAGE_LAYOUT_GENERAL,
+		aDst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, VK_FILTER_NEAREST
+	);
+
+	if( aOffscreen )
+	{
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+	}
+	else
+	{
+		// Presentation waits for the semaphore signalled by the submission
+		lut::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT );
+	}
+
+	// The next frame's render pass overwrites the target (write-after-read;
+	// its initial layout is UNDEFINED)
+	lut::image_barrier( aCmdBuff, aColour,
+		VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT );
+
+	aUpscale.prevProjCam = aUpscale.projCam;
+	aUpscale.current = 1 - aUpscale.current;
+	aUpscale.valid = true;
+}
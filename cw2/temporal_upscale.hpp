@@ -0,0 +1,129 @@
+#ifndef TEMPORAL_UPSCALE_HPP_43613BB5_7890_427D_9374_651117EBD2A7
+#define TEMPORAL_UPSCALE_HPP_43613BB5_7890_427D_9374_651117EBD2A7
+
+// Temporal upscaling (--upscale=temporal), in place of the bilinear blit of
+// dynamic resolution (see dynamic_resolution.hpp). The scene is drawn into
+// the top-left part of the render target as before, at --resolution-scale
+// or the scale that --dynamic-resolution picks, but with the projection
+// shifted by a sub-pixel offset that follows the Halton (2,3) sequence.
+// Over kTemporalJitterPhases frames, the render pixels thereby cover
+// different points of each swapchain pixel.
+//
+// A compute pass (cw2/shaders/temporal_resolve.comp) then reconstructs the
+// full-resolution image into a history buffer (two, used in turns): each
+// pixel finds where it was in the previous frame, by its depth and the
+// previous frame's view-projection matrix, and blends the previous history
+// there with the nearest render pixel, weighted by how close that pixel
+// falls. The previous history is clamped to the colours around the render
+// pixel first, which rejects most of what is no longer visible. The result
+// is blitted to the swapchain image.
+//
+// Note: the motion is that of the camera only, as reconstructed from the
+// depth buffer; there are no per-object motion vectors (the meshes are
+// static, apart from world streaming's, which the clamping keeps from
+// ghosting much). This needs no further attachment or shader variant.
+//
+// With --redraw=on-demand, the frames rendered after each change let the
+// history converge before the loop goes idle.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+namespace lut = labutils;
+
+// Length of the jitter sequence; the history converges over about as many
+// frames
+constexpr std::uint32_t kTemporalJitterPhases = 16;
+
+// Weight of the new frame in the history, for a render pixel that falls
+// on the swapchain pixel's centre
+constexpr float kTemporalBlend = 0.1f;
+
+struct TemporalUpscale
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	VkSampler nearestSampler = VK_NULL_HANDLE; // from the cache
+	VkSampler linearSampler = VK_NULL_HANDLE;
+
+	// R16G16B16A16_SFLOAT, swapchain size, always in VK_IMAGE_LAYOUT_GENERAL
+	lut::Image history[2];
+	lut::ImageView historyViews[2];
+
+	// Set i writes history i, and reads the other one: binding 0 = render
+	// target, 1 = depth buffer, 2 = previous history, 3 = history
+	VkDescriptorSet descriptors[2]{};
+	std::uint32_t current = 0; // history that the next resolve writes
+
+	VkExtent2D extent{}; // of the history
+
+	std::uint32_t phase = 0; // into the jitter sequence
+	glm::vec2 jitter{}; // of the frame being recorded, in render pixels
+	glm::mat4 projCam{ 1.f }, prevProjCam{ 1.f }; // unjittered
+
+	// False until a resolve has written the history after (re-)creation
+	bool valid = false;
+};
+
+// Whether the history format can be written by compute shaders, filtered,
+// and blitted from
+bool supports_temporal_upscale( lut::VulkanWindow const& );
+
+TemporalUpscale create_temporal_upscale(
+	lut::VulkanWindow const&,
+	lut::DescriptorAllocator&,
+	lut::SamplerCache&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// (Re-)creates the history for the current swapchain size, and points the
+// descriptors at the render target's and depth buffer's views (which must
+// have been created with VK_IMAGE_USAGE_SAMPLED_BIT). The history must not
+// be in use by the GPU. Uses aCmdPool for a one-off layout transition, and
+// waits for it to complete.
+void resize_temporal_upscale(
+	TemporalUpscale&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	VkCommandPool aCmdPool,
+	VkImageView aColourView,
+	VkImageView aDepthView
+);
+
+// Starts a frame drawn at aRenderExtent, with the unjittered view-
+// projection aProjCam: advances the jitter, and returns the clip space
+// translation that applies it (to be multiplied onto the projection from
+// the left)
+glm::mat4 begin_temporal_frame( TemporalUpscale&, VkExtent2D const& aRenderExtent, glm::mat4 const& aProjCam );
+
+// Records the resolve of aRenderExtent of aColour into the history, and
+// the blit of the history to all of aDst (a swapchain image). aColour was
+// left in TRANSFER_SRC_OPTIMAL by the render pass, and the depth buffer in
+// DEPTH_STENCIL_READ_ONLY_OPTIMAL, visible to the compute stage (see
+// create_render_pass()). aDst ends as with record_upscale().
+void record_temporal_resolve(
+	VkCommandBuffer,
+	TemporalUpscale&,
+	VkImage aColour,
+	VkExtent2D const& aRenderExtent,
+	VkImage aDst,
+	VkExtent2D const& aDstExtent,
+	bool aOffscreen
+);
+
+#endif // TEMPORAL_UPSCALE_HPP_43613BB5_7890_427D_9374_651117EBD2A7
@@ -0,0 +1,270 @@
+#include "texture_streaming.hpp"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include <cassert>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/vkimage.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	// Frames between streaming decisions; the feedback of the frames in
+	// between is combined
+	constexpr std::uint64_t kStreamInterval = 15;
+
+	// Textures that have not been sampled for this many frames go back to
+	// kStreamStartExtent
+	constexpr std::uint64_t kStreamIdleFrames = 600;
+
+	// Requests in flight at once; each is swapped in with a device wait
+	constexpr std::uint32_t kMaxStreamRequests = 8;
+
+	// Size of a texture's image with level aLevel as level 0, estimated from
+	// its current image; every level is a quarter of the one above
+	VkDeviceSize level_bytes_( StreamedTexture const& aTex, std::uint32_t aLevel )
+	{
+		if( aLevel <= aTex.level )
+			return aTex.bytes << (2 * (aTex.level - aLevel));
+		return aTex.bytes >> (2 * std::min( aLevel - aTex.level, 31u ));
+	}
+
+	std::uint32_t start_level_( StreamedTexture const& aTex )
+	{
+		return lut::levels_above( aTex.fullWidth, aTex.fullHeight, kStreamStartExtent );
+	}
+
+	void request_( TextureStreaming& aStreaming, ModelPack const& aModel, lut::AsyncUploader& aUploader, std::uint32_t aId, std::uint32_t aLevel )
+	{
+		auto& tex = aStreaming.textures[aId];
+		assert( !tex.pending && aLevel != tex.level );
+
+		auto const extent = std::max( 1u, std::max( tex.fullWidth, tex.fullHeight ) >> aLevel );
+		stream_model_texture( aModel, aUploader, aId, extent );
+
+		tex.target = aLevel;
+		tex.pending = true;
+		++aStreaming.inFlight;
+	}
+}
+
+MipFeedback create_mip_feedback( lut::Allocator const& aAllocator, std::size_t aCount, std::size_t aFramesInFlight )
+{
+	assert( aCount > 0 );
+
+	MipFeedback ret;
+	ret.count = aCount;
+
+	auto const bytes = VkDeviceSize( aCount * sizeof(std::uint32_t) );
+	ret.buffer = lut::create_buffer( aAllocator, bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+
+	for( std::size_t i = 0; i < aFramesInFlight; ++i )
+		ret.readbacks.emplace_back( lut::create_buffer( aAllocator, bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT ) );
+	ret.readbackValid.assign( aFramesInFlight, false );
+
+	return ret;
+}
+
+void record_mip_feedback( VkCommandBuffer aCmdBuff, MipFeedback& aFeedback, std::uint32_t aFrame )
+{
+	assert( aFrame < aFeedback.readbacks.size() );
+
+	// The first frame starts from a buffer that was never reset
+	bool const valid = aFeedback.reset;
+	if( valid )
+	{
+		// The previous frame's fragment shaders wrote the footprints
+		lut::buffer_barrier( aCmdBuff, aFeedback.buffer.buffer,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		VkBufferCopy copy{};
+		copy.size = aFeedback.count * sizeof(std::uint32_t);
+		vkCmdCopyBuffer( aCmdBuff, aFeedback.buffer.buffer, aFeedback.readbacks[aFrame].buffer, 1, &copy );
+
+		lut::buffer_barrier( aCmdBuff, aFeedback.readbacks[aFrame].buffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT );
+
+		lut::buffer_barrier( aCmdBuff, aFeedback.buffer.buffer,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+	}
+	aFeedback.readbackValid[aFrame] = valid;
+	aFeedback.reset = true;
+
+	vkCmdFillBuffer( aCmdBuff, aFeedback.buffer.buffer, 0, VK_WHOLE_SIZE, kMipFeedbackNone );
+
+	lut::buffer_barrier( aCmdBuff, aFeedback.buffer.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+}
+
+std::uint32_t const* read_mip_feedback( MipFeedback const& aFeedback, lut::Allocator const& aAllocator, std::uint32_t aFrame )
+{
+	assert( aFrame < aFeedback.readbacks.size() );
+	if( !aFeedback.readbackValid[aFrame] )
+		return nullptr;
+
+	auto const& readback = aFeedback.readbacks[aFrame];
+	if( auto const res = vmaInvalidateAllocation( aAllocator.allocator, readback.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+		throw lut::Error( "Invalidating mip feedback\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str() );
+
+	auto const* data = reinterpret_cast<std::uint32_t const*>( lut::mapped_data( aAllocator, readback ) );
+	assert( data );
+	return data;
+}
+
+TextureStreaming create_texture_streaming( lut::Allocator const& aAllocator, ModelPack const& aModel, std::size_t aFramesInFlight, VkDeviceSize aBudget, bool aLazy )
+{
+	assert( !aModel.textureSources.empty() );
+
+	TextureStreaming ret;
+	ret.budget = aBudget;
+
+	// The filler (the last texture) is never sampled, but the materials'
+	// indices cover all of ModelPack::textures
+	ret.feedback = create_mip_feedback( aAllocator, aModel.textures.size(), aFramesInFlight );
+
+	// The first versions are in flight already (see set_up_model()), or
+	// will be (all textures are pending until then)
+	ret.textures.resize( aModel.textureSources.size() );
+	ret.inFlight = aLazy ? 0 : std::uint32_t(ret.textures.size());
+
+	return ret;
+}
+
+void update_texture_streaming( TextureStreaming& aStreaming, lut::Allocator const& aAllocator, std::uint32_t aFrame, ModelPack const& aModel, lut::AsyncUploader& aUploader, lut::FrameArena& aArena )
+{
+	assert( aFrame < aStreaming.feedback.readbacks.size() );
+
+	++aStreaming.frame;
+
+	// Finest level sampled by the frame. Textures whose first version is
+	// not there yet only count as sampled.
+	if( auto const* codes = read_mip_feedback( aStreaming.feedback, aAllocator, aFrame ) )
+	{
+		for( std::size_t i = 0; i < aStreaming.textures.size(); ++i )
+		{
+			auto const code = codes[i];
+			if( kMipFeedbackNone == code )
+				continue;
+
+			auto& tex = aStreaming.textures[i];
+			tex.lastSampled = aStreaming.frame;
+			if( 0 == tex.fullWidth )
+				continue;
+
+			// Footprint in texels of the full texture, per pixel
+			float const footprint = float(code) / kMipFeedbackScale - kMipFeedbackBias + std::log2( float(std::max( tex.fullWidth, tex.fullHeight )) );
+			auto const levels = lut::compute_mip_level_count( tex.fullWidth, tex.fullHeight );
+			auto const level = std::min( std::uint32_t(std::max( 0.f, std::floor( footprint ) )), levels - 1 );
+			tex.wanted = std::min( tex.wanted, level );
+		}
+	}
+
+	if( 0 != aStreaming.frame % kStreamInterval )
+		return;
+
+	// Where every texture should be. Unsampled ones stay where they are
+	// until they have been idle for a while.
+	lut::ArenaVector<std::uint32_t> goals( aStreaming.textures.size(), 0u, lut::ArenaAllocator<std::uint32_t>( aArena ) );
+	VkDeviceSize committed = 0; // once all requests have arrived
+	for( std::size_t i = 0; i < aStreaming.textures.size(); ++i )
+	{
+		auto& tex = aStreaming.textures[i];
+		if( 0 == tex.fullWidth )
+			continue;
+
+		if( kMipFeedbackNone != tex.wanted )
+			goals[i] = std::max( tex.wanted, tex.minLevel );
+		else if( aStreaming.frame - tex.lastSampled > kStreamIdleFrames )
+			goals[i] = std::max( tex.level, start_level_( tex ) );
+		else
+			goals[i] = tex.level;
+
+		tex.wanted = kMipFeedbackNone;
+		committed += level_bytes_( tex, tex.pending ? tex.target : tex.level );
+	}
+
+	// Shrink first: that makes room for the others. A texture is only
+	// shrunk when it is sampled two levels coarser (or not at all), so
+	// that small camera motions don't stream it back and forth.
+	for( std::size_t i = 0; i < aStreaming.textures.size() && aStreaming.inFlight < kMaxStreamRequests; ++i )
+	{
+		auto const& tex = aStreaming.textures[i];
+		if( 0 == tex.fullWidth || tex.pending )
+			continue;
+
+		bool const idle = aStreaming.frame - tex.lastSampled > kStreamIdleFrames;
+		if( goals[i] > tex.level + 1 || (idle && goals[i] > tex.level) )
+		{
+			committed -= level_bytes_( tex, tex.level ) - level_bytes_( tex, goals[i] );
+			request_( aStreaming, aModel, aUploader, std::uint32_t(i), goals[i] );
+		}
+	}
+
+	// Then grow, the textures that are farthest from their goal first, by
+	// as many levels as fit into the budget
+	lut::ArenaVector<std::uint32_t> order( aStreaming.textures.size(), 0u, lut::ArenaAllocator<std::uint32_t>( aArena ) );
+	std::iota( order.begin(), order.end(), 0u );
+	auto const deficit = [&] (std::uint32_t aId) {
+		auto const& tex = aStreaming.textures[aId];
+		return 0 == tex.fullWidth || tex.pending || goals[aId] >= tex.level ? 0u : tex.level - goals[aId];
+	};
+	// Ties by index, as a stable sort would (which needs a heap buffer)
+	std::sort( order.begin(), order.end(), [&] (std::uint32_t aA, std::uint32_t aB) {
+		auto const a = deficit( aA ), b = deficit( aB );
+		return a != b ? a > b : aA < aB;
+	} );
+
+	for( auto const id : order )
+	{
+		if( 0 == deficit( id ) || aStreaming.inFlight >= kMaxStreamRequests )
+			break;
+
+		auto const& tex = aStreaming.textures[id];
+		auto const current = level_bytes_( tex, tex.level );
+		for( auto level = goals[id]; level < tex.level; ++level )
+		{
+			if( committed - current + level_bytes_( tex, level ) <= aStreaming.budget )
+			{
+				committed += level_bytes_( tex, level ) - current;
+				request_( aStreaming, aModel, aUploader, id, level );
+				break;
+			}
+		}
+	}
+}
+
+void note_streamed_textures( TextureStreaming& aStreaming, lut::Allocator const& aAllocator, std::vector<lut::AsyncUploader::Completed> const& aTextures )
+{
+	for( auto const& done : aTextures )
+	{
+		assert( done.id < aStreaming.textures.size() );
+		auto& tex = aStreaming.textures[done.id];
+		bool const first = 0 == tex.fullWidth;
+
+		tex.fullWidth = done.fullWidth;
+		tex.fullHeight = done.fullHeight;
+		tex.level = lut::levels_above( done.fullWidth, done.fullHeight, std::max( done.width, done.height ) );
+
+		// The memory budget may have dropped more levels than requested
+		// (see lut::fit_texture_budget()); don't ask for them again.
+		if( tex.pending && !first && tex.level > tex.target )
+			tex.minLevel = tex.level;
+		tex.target = tex.level;
+
+		VmaAllocationInfo info{};
+		vmaGetAllocationInfo( aAllocator.allocator, done.image.allocation, &info );
+		tex.bytes = info.size;
+
+		if( tex.pending && aStreaming.inFlight > 0 )
+			--aStreaming.inFlight;
+		tex.pending = false;
+	}
+}
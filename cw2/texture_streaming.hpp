@@ -0,0 +1,117 @@
+#ifndef TEXTURE_STREAMING_HPP_40CCDE28_A70F_45AD_834F_19F58EC0225C
+#define TEXTURE_STREAMING_HPP_40CCDE28_A70F_45AD_834F_19F58EC0225C
+
+// Mip streaming (--texture-budget=MIB). Textures first stream in (see
+// lut::AsyncUploader) with at most kStreamStartExtent texels per side. The
+// colour pass then records, per texture, how finely it is sampled (see
+// mip_feedback.glsl). From that, textures are requested again with more
+// levels, or with fewer once they are no longer needed, such that the
+// streamed textures stay within the budget.
+//
+// A texture is always replaced as a whole: the new image, with its own mip
+// chain, is swapped in (update_model_textures()) once its upload has
+// completed. Levels that are still in flight are thus never sampled, and
+// views need no LOD clamp.
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/frame_arena.hpp"
+#include "../labutils/async_uploader.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// Longest side of a texture's first version, and of textures that have not
+// been sampled for a while
+constexpr std::uint32_t kStreamStartExtent = 128;
+
+// Encoding of the feedback; must match mip_feedback.glsl
+constexpr float kMipFeedbackBias = 24.f;
+constexpr float kMipFeedbackScale = 16.f;
+constexpr std::uint32_t kMipFeedbackNone = 0xffffffffu; // not sampled
+
+struct StreamedTexture
+{
+	std::uint32_t fullWidth = 0, fullHeight = 0; // 0: first version not there yet
+	std::uint32_t level = 0;    // level of the full texture that is the image's level 0
+	std::uint32_t target = 0;   // level of the latest request (level if none)
+	std::uint32_t minLevel = 0; // finest level the memory budget allowed so far
+	VkDeviceSize bytes = 0;     // of the image
+	bool pending = true;        // a request is in flight
+
+	std::uint32_t wanted = kMipFeedbackNone; // finest level sampled since the last update
+	std::uint64_t lastSampled = 0; // frame
+};
+
+// The footprints of the colour pass, one per texture of ModelPack::textures,
+// and their copies for the host; also used by the mip report (see
+// mip_report.hpp)
+struct MipFeedback
+{
+	lut::Buffer buffer; // see mip_feedback.glsl
+	std::vector<lut::Buffer> readbacks; // per frame in flight, host visible
+	std::vector<bool> readbackValid;
+	bool reset = false; // the buffer has been reset once
+	std::size_t count = 0; // footprints
+};
+
+MipFeedback create_mip_feedback( lut::Allocator const&, std::size_t aCount, std::size_t aFramesInFlight );
+
+// Before the colour pass: moves the feedback of the previously submitted
+// frame to aFrame's readback, and resets it for this frame.
+void record_mip_feedback( VkCommandBuffer, MipFeedback&, std::uint32_t aFrame );
+
+// Once aFrame's commands have completed: its footprints (count of them), or
+// null if its readback holds none
+std::uint32_t const* read_mip_feedback( MipFeedback const&, lut::Allocator const&, std::uint32_t aFrame );
+
+struct TextureStreaming
+{
+	VkDeviceSize budget = 0; // bytes, for all streamed textures
+
+	MipFeedback feedback;
+
+	std::vector<StreamedTexture> textures; // ModelPack::textureSources
+	std::uint64_t frame = 0;
+	std::uint32_t inFlight = 0; // requests
+};
+
+// For a model whose textures set_up_model() has requested with
+// kStreamStartExtent. The feedback buffer goes to binding 3 of the scene's
+// set. aLazy: set up with aLazyTextures instead; the first versions are
+// counted in flight as lazy_materials.hpp requests them.
+TextureStreaming create_texture_streaming(
+	lut::Allocator const&,
+	ModelPack const&,
+	std::size_t aFramesInFlight,
+	VkDeviceSize aBudget,
+	bool aLazy = false
+);
+
+// Once aFrame's commands have completed: gathers its readback, and every few
+// frames requests the textures whose sampled level differs from the one they
+// have, finest first, as far as the budget allows. Textures that have not
+// been sampled for a while go back to kStreamStartExtent. Scratch data comes
+// from aArena (the frame's).
+void update_texture_streaming(
+	TextureStreaming&,
+	lut::Allocator const&,
+	std::uint32_t aFrame,
+	ModelPack const&,
+	lut::AsyncUploader&,
+	lut::FrameArena& aArena
+);
+
+// Call with the textures taken from the uploader, before passing them on to
+// update_model_textures().
+void note_streamed_textures( TextureStreaming&, lut::Allocator const&, std::vector<lut::AsyncUploader::Completed> const& );
+
+#endif // TEXTURE_STREAMING_HPP_40CCDE28_A70F_45AD_834F_19F58EC0225C
@@ -0,0 +1,273 @@
+#include "triangle_culling.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+
+#include <cassert>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+
+namespace
+{
+	// Matches the push constant block in cw2/shaders/triangle_cull.comp
+	struct TriangleCullPush_
+	{
+		float viewport[2];
+		std::uint32_t slotCount;
+		std::uint32_t indices32Offset;
+		std::uint32_t smallPrimitives;
+	};
+	static_assert( sizeof(TriangleCullPush_) == 20, "TriangleCullPush_ must match the push constant block in triangle_cull.comp" );
+	static_assert( sizeof(TriangleCullSlot) == 16, "TriangleCullSlot must match the std430 layout of Slot" );
+
+	// A workgroup per slot; the workgroups past the first dimension's
+	// guaranteed limit go into the second
+	constexpr std::uint32_t kMaxWorkgroupsX = 65535;
+
+	constexpr std::uint32_t kBindingCount = 8;
+
+	lut::DescriptorSetLayout create_triangle_cull_descriptor_layout_( lut::VulkanWindow const& );
+	lut::PipelineLayout create_triangle_cull_pipeline_layout_( lut::VulkanWindow const&, VkDescriptorSetLayout );
+	lut::Pipeline create_triangle_cull_pipeline_( lut::VulkanWindow const&, VkPipelineLayout, lut::ShaderModuleCache&, char const* aShaderPath, VkPipelineCache );
+}
+
+TriangleCuller create_triangle_culler( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::DescriptorAllocator& aDescriptors, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, ModelPack const& aModel, GpuCuller const& aCuller, VkBuffer aSceneUBO, VkDeviceSize aSceneRange, bool aSmallPrimitives, VkPipelineCache aCache )
+{
+	assert( !aModel.quantizedVertices );
+	assert( 1 == aModel.instanceCount );
+
+	TriangleCuller ret;
+	ret.layout = create_triangle_cull_descriptor_layout_( aWindow );
+	ret.pipeLayout = create_triangle_cull_pipeline_layout_( aWindow, ret.layout.handle );
+	ret.pipe = create_triangle_cull_pipeline_( aWindow, ret.pipeLayout.handle, aShaderModules, aShaderPath, aCache );
+	ret.smallPrimitives = aSmallPrimitives;
+
+	// Slots, in the order of the culler's groups (see create_gpu_culler()).
+	// The output needs room for the largest range that each command may
+	// draw, i.e., its largest LOD.
+	std::vector<TriangleCullSlot> slots( aModel.hostDrawCommands.size() );
+	VkDeviceSize maxIndices = 0;
+
+	std::uint32_t groupIndex = 0;
+	for( auto const* groups : { &aCuller.opaqueGroups, &aCuller.alphaGroups } )
+	{
+		for( auto const& group : *groups )
+		{
+			for( std::uint32_t i = group.firstCommand; i < group.firstCommand + group.commandCount; ++i )
+			{
+				auto& slot = slots[i];
+				slot.group = groupIndex;
+				slot.firstSlot = group.firstCommand;
+				slot.index16 = VK_INDEX_TYPE_UINT16 == group.indexType ? 1 : 0;
+
+				// Meshlets only have the full-detail level
+				auto const& mesh = aModel.meshes[aModel.drawCommandMeshes[i]];
+				std::uint32_t indexCount = aModel.hostDrawCommands[i].indexCount;
+				for( std::uint32_t l = 1; l < mesh.lodCount; ++l )
+					indexCount = std::max( indexCount, mesh.lods[l].indexCount );
+				maxIndices += indexCount;
+			}
+
+			++groupIndex;
+		}
+	}
+
+	ret.slotCount = std::uint32_t(slots.size());
+
+	// Buffers. Like the culler's items, the slots never change and stay in
+	// host-visible memory.
+	VkDeviceSize const slotBytes = std::max<VkDeviceSize>( 1, slots.size() ) * sizeof(TriangleCullSlot);
+	VkDeviceSize const indexBytes = std::max<VkDeviceSize>( 1, maxIndices ) * sizeof(std::uint32_t);
+
+	ret.slots = lut::create_buffer( aAllocator, slotBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::upload );
+	ret.indices = lut::create_buffer( aAllocator, indexBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, lut::EMemoryClass::device );
+	ret.cursor = lut::create_buffer( aAllocator, sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+
+	if( !slots.empty() )
+	{
+		void* ptr = nullptr;
+		if( auto const res = vmaMapMemory( aAllocator.allocator, ret.slots.allocation, &ptr ); VK_SUCCESS != res )
+			throw lut::Error( "Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str() );
+
+		std::memcpy( ptr, slots.data(), slots.size() * sizeof(TriangleCullSlot) );
+
+		vmaFlushAllocation( aAllocator.allocator, ret.slots.allocation, 0, VK_WHOLE_SIZE );
+		vmaUnmapMemory( aAllocator.allocator, ret.slots.allocation );
+	}
+
+	// Descriptors; the model's geometry is written by
+	// update_triangle_culler_geometry()
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+
+	VkDescriptorBufferInfo bufferInfo[6]{};
+	bufferInfo[0].buffer = aSceneUBO;
+	bufferInfo[1].buffer = ret.slots.buffer;
+	bufferInfo[2].buffer = aCuller.commands.buffer;
+	bufferInfo[3].buffer = aCuller.counts.buffer;
+	bufferInfo[4].buffer = ret.indices.buffer;
+	bufferInfo[5].buffer = ret.cursor.buffer;
+
+	std::uint32_t const bindings[6] = { 0, 1, 2, 3, 6, 7 };
+
+	VkWriteDescriptorSet desc[6]{};
+	for( std::uint32_t i = 0; i < 6; ++i )
+	{
+		bufferInfo[i].range = 0 == i ? aSceneRange : VK_WHOLE_SIZE;
+
+		desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[i].dstSet = ret.descriptors;
+		desc[i].dstBinding = bindings[i];
+		desc[i].descriptorType = 0 == i ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[i].descriptorCount = 1;
+		desc[i].pBufferInfo = &bufferInfo[i];
+	}
+
+	vkUpdateDescriptorSets( aWindow.device, 6, desc, 0, nullptr );
+
+	update_triangle_culler_geometry( aWindow, ret, aModel );
+
+	return ret;
+}
+
+void update_triangle_culler_geometry( lut::VulkanWindow const& aWindow, TriangleCuller const& aTriangles, ModelPack const& aModel )
+{
+	VkDescriptorBufferInfo bufferInfo[2]{};
+	bufferInfo[0].buffer = aModel.vertices.buffer;
+	bufferInfo[0].range = VK_WHOLE_SIZE;
+	bufferInfo[1].buffer = aModel.indices.buffer;
+	bufferInfo[1].range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet desc[2]{};
+	for( std::uint32_t i = 0; i < 2; ++i )
+	{
+		desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[i].dstSet = aTriangles.descriptors;
+		desc[i].dstBinding = 4 + i;
+		desc[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[i].descriptorCount = 1;
+		desc[i].pBufferInfo = &bufferInfo[i];
+	}
+
+	vkUpdateDescriptorSets( aWindow.device, 2, desc, 0, nullptr );
+}
+
+void record_triangle_cull( VkCommandBuffer aCmdBuff, TriangleCuller const& aTriangles, GpuCuller const& aCuller, ModelPack const& aModel, std::uint32_t aSceneOffset, VkExtent2D const& aExtent )
+{
+	// The previous frame's draws read the compacted indices; the cursor is
+	// reset before the dispatch
+	lut::buffer_barrier( aCmdBuff, aTriangles.cursor.buffer,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+	vkCmdFillBuffer( aCmdBuff, aTriangles.cursor.buffer, 0, VK_WHOLE_SIZE, 0 );
+
+	lut::buffer_barrier( aCmdBuff, aTriangles.cursor.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+	lut::buffer_barrier( aCmdBuff, aTriangles.indices.buffer,
+		VK_ACCESS_INDEX_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	// The mesh culling's output, which record_gpu_cull() only made visible
+	// to the indirect draws
+	lut::buffer_barrier( aCmdBuff, aCuller.counts.buffer,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+	lut::buffer_barrier( aCmdBuff, aCuller.commands.buffer,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	if( aTriangles.slotCount > 0 )
+	{
+		vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aTriangles.pipe.handle );
+		vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, aTriangles.pipeLayout.handle, 0, 1, &aTriangles.descriptors, 1, &aSceneOffset );
+
+		TriangleCullPush_ push{};
+		push.viewport[0] = float(aExtent.width);
+		push.viewport[1] = float(aExtent.height);
+		push.slotCount = aTriangles.slotCount;
+		push.indices32Offset = std::uint32_t(aModel.indices32Offset / sizeof(std::uint32_t));
+		push.smallPrimitives = aTriangles.smallPrimitives ? 1 : 0;
+
+		vkCmdPushConstants( aCmdBuff, aTriangles.pipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+
+		std::uint32_t const groupsX = std::min( aTriangles.slotCount, kMaxWorkgroupsX );
+		vkCmdDispatch( aCmdBuff, groupsX, (aTriangles.slotCount + groupsX-1) / groupsX, 1 );
+	}
+
+	lut::buffer_barrier( aCmdBuff, aCuller.commands.buffer,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT );
+	lut::buffer_barrier( aCmdBuff, aTriangles.indices.buffer,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDEX_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT );
+}
+
+namespace
+{
+	lut::DescriptorSetLayout create_triangle_cull_descriptor_layout_( lut::VulkanWindow const& aWindow )
+	{
+		VkDescriptorSetLayoutBinding bindings[kBindingCount]{};
+		for( std::uint32_t i = 0; i < kBindingCount; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = 0 == i ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = kBindingCount;
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create triangle culling descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		return lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	lut::PipelineLayout create_triangle_cull_pipeline_layout_( lut::VulkanWindow const& aWindow, VkDescriptorSetLayout aLayout )
+	{
+		VkPushConstantRange push{};
+		push.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push.offset = 0;
+		push.size = sizeof(TriangleCullPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &aLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &push;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create triangle culling pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		return lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	lut::Pipeline create_triangle_cull_pipeline_( lut::VulkanWindow const& aWindow, VkPipelineLayout aLayout, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkPipelineCache aCache )
+	{
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = aLayout;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create triangle culling pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		return lut::Pipeline( aWindow.device, pipe );
+	}
+}
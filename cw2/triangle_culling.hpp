@@ -0,0 +1,96 @@
+#ifndef TRIANGLE_CULLING_HPP_6A2F0C84_91D3_4B7E_A5C8_3E7D1F2B09A6
+#define TRIANGLE_CULLING_HPP_6A2F0C84_91D3_4B7E_A5C8_3E7D1F2B09A6
+
+// Per-triangle culling (--triangle-cull=on), a compute pass after the mesh
+// culling of the GPU culler (culling.hpp). Each visible command's triangles
+// are tested against the frame's camera (cw2/shaders/triangle_cull.comp):
+// back faces, triangles outside the frustum and triangles that cover no
+// pixel centre are dropped, and the others' indices are compacted into a
+// uint32 index buffer, which the commands are rewritten to draw from.
+//
+// The draws then fetch fewer vertices and set up fewer primitives, at the
+// cost of reading every visible triangle in the compute pass. That only pays
+// off when the frame is bound by vertex processing or primitive assembly
+// (dense meshes, many small triangles); the "cull", "prepass" and "colour"
+// GPU scopes show whether it is. Hence off by default.
+//
+// Reads fp32 vertices (see set_up_model()), of a single copy of the model.
+// The small primitive test assumes one sample per pixel, and is skipped with
+// MSAA.
+
+#include <vector>
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "culling.hpp"
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// Slot in cw2/shaders/triangle_cull.comp: the group of one slot of
+// GpuCuller::commands
+struct TriangleCullSlot
+{
+	std::uint32_t group;
+	std::uint32_t firstSlot;
+	std::uint32_t index16;
+	std::uint32_t pad;
+};
+
+struct TriangleCuller
+{
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+	lut::Pipeline pipe;
+
+	lut::Buffer slots;      // TriangleCullSlot per command slot; written once
+	lut::Buffer indices;    // compacted uint32 indices; bound at offset 0 by the draws
+	lut::Buffer cursor;     // uint32_t, the next free index of `indices`
+
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+
+	std::uint32_t slotCount = 0;
+	bool smallPrimitives = true;
+};
+
+// The culler of aCuller's commands. Throws labutils::Error on failure.
+TriangleCuller create_triangle_culler(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	lut::DescriptorAllocator&,
+	lut::ShaderModuleCache&,
+	char const* aShaderPath,
+	ModelPack const&,
+	GpuCuller const&,
+	VkBuffer aSceneUBO, // bound with a dynamic offset
+	VkDeviceSize aSceneRange,
+	bool aSmallPrimitives, // false with MSAA
+	VkPipelineCache = VK_NULL_HANDLE
+);
+
+// Rebinds the model's vertex and index buffers, e.g., after they have been
+// moved by lut::Defragmenter.
+void update_triangle_culler_geometry( lut::VulkanWindow const&, TriangleCuller const&, ModelPack const& );
+
+// Records the culling dispatch, right after record_gpu_cull(), including the
+// barriers against the previous frame's draws and towards this frame's.
+// Must be recorded outside of a render pass. aExtent is the viewport.
+void record_triangle_cull(
+	VkCommandBuffer,
+	TriangleCuller const&,
+	GpuCuller const&,
+	ModelPack const&,
+	std::uint32_t aSceneOffset,
+	VkExtent2D const& aExtent
+);
+
+#endif // TRIANGLE_CULLING_HPP_6A2F0C84_91D3_4B7E_A5C8_3E7D1F2B09A6
@@ -0,0 +1,187 @@
+#ifndef VERTEX_LAYOUT_HPP_1877D5F9_737A_4B09_A282_378669FFC31E
+#define VERTEX_LAYOUT_HPP_1877D5F9_737A_4B09_A282_378669FFC31E
+
+// Vertex input layouts derived from the vertex structs. Each struct that a
+// vertex buffer binding reads gets a VertexLayout specialization next to
+// it, which lists its members with their shader locations:
+//
+//   template<> struct VertexLayout<InterleavedVertex>
+//   {
+//   	static constexpr VertexAttribute kAttributes[] = {
+//   		VERTEX_ATTRIBUTE( InterleavedVertex, position, 0 ),
+//   		...
+//   	};
+//   };
+//   static_assert( valid_vertex_layout<InterleavedVertex>() );
+//
+// Offsets and the binding stride come from the struct, the formats from the
+// member types (VertexFormat), unless given explicitly (e.g., normalized
+// integers); valid_vertex_layout() checks at compile time that every
+// format has the size of its member, and that no location is used twice.
+// The code that fills the buffers writes the same structs (see
+// load_vertex() and store_vertex() in interleaved_vertex.hpp), so the
+// pipelines and the buffers can't disagree.
+
+#include <iterator>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "quantized_vertex.hpp"
+#include "interleaved_vertex.hpp"
+
+struct VertexAttribute
+{
+	std::uint32_t location; // must match the shaders
+	VkFormat format;
+	std::uint32_t offset;
+	std::uint32_t size; // of the member
+};
+
+// Format of the members of each type; a member of a type without one needs
+// VERTEX_ATTRIBUTE_AS().
+template< typename tMember > struct VertexFormat;
+
+template<> struct VertexFormat<float> { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+template<> struct VertexFormat<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template<> struct VertexFormat<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template<> struct VertexFormat<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template<> struct VertexFormat<std::uint32_t> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+
+#define VERTEX_ATTRIBUTE( tVertex, member, location ) \
+	VertexAttribute{ location, VertexFormat<decltype(tVertex::member)>::value, std::uint32_t(offsetof(tVertex, member)), std::uint32_t(sizeof(tVertex::member)) }
+#define VERTEX_ATTRIBUTE_AS( tVertex, member, location, format ) \
+	VertexAttribute{ location, format, std::uint32_t(offsetof(tVertex, member)), std::uint32_t(sizeof(tVertex::member)) }
+
+template< typename tVertex > struct VertexLayout;
+
+// Bytes per element of the formats used for vertex attributes; 0 for any
+// other format
+constexpr std::uint32_t vertex_format_size( VkFormat aFormat ) noexcept
+{
+	switch( aFormat )
+	{
+		case VK_FORMAT_R32_SFLOAT: [[fallthrough]];
+		case VK_FORMAT_R32_UINT: [[fallthrough]];
+		case VK_FORMAT_R16G16_SFLOAT: [[fallthrough]];
+		case VK_FORMAT_R16G16_SNORM: [[fallthrough]];
+		case VK_FORMAT_R16G16_UNORM:
+			return 4;
+		case VK_FORMAT_R32G32_SFLOAT: [[fallthrough]];
+		case VK_FORMAT_R16G16B16A16_UNORM: [[fallthrough]];
+		case VK_FORMAT_R16G16B16A16_SNORM: [[fallthrough]];
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 8;
+		case VK_FORMAT_R32G32B32_SFLOAT:
+			return 12;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			return 0;
+	}
+}
+
+template< typename tVertex >
+constexpr bool valid_vertex_layout() noexcept
+{
+	auto const& attribs = VertexLayout<tVertex>::kAttributes;
+	for( std::size_t i = 0; i < std::size(attribs); ++i )
+	{
+		auto const size = vertex_format_size( attribs[i].format );
+		if( 0 == size || size != attribs[i].size || attribs[i].offset + size > sizeof(tVertex) )
+			return false;
+
+		if( attribs[i].location >= 32 )
+			return false;
+
+		for( std::size_t j = 0; j < i; ++j )
+		{
+			if( attribs[j].location == attribs[i].location )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// Location masks for vertex_attributes()
+constexpr std::uint32_t vertex_locations( std::uint32_t aLocation ) noexcept
+{
+	return 1u << aLocation;
+}
+template< typename... tLocations >
+constexpr std::uint32_t vertex_locations( std::uint32_t aLocation, tLocations... aOthers ) noexcept
+{
+	return vertex_locations( aLocation ) | vertex_locations( aOthers... );
+}
+
+constexpr std::uint32_t kAllVertexLocations = ~std::uint32_t(0);
+
+template< typename tVertex >
+constexpr VkVertexInputBindingDescription vertex_binding( std::uint32_t aBinding, VkVertexInputRate aRate = VK_VERTEX_INPUT_RATE_VERTEX ) noexcept
+{
+	return VkVertexInputBindingDescription{ aBinding, std::uint32_t(sizeof(tVertex)), aRate };
+}
+
+// Writes the attributes of tVertex's layout that are in aLocations to aOut,
+// reading from binding aBinding. Returns their count.
+template< typename tVertex >
+std::uint32_t vertex_attributes( VkVertexInputAttributeDescription* aOut, std::uint32_t aBinding, std::uint32_t aLocations = kAllVertexLocations ) noexcept
+{
+	std::uint32_t count = 0;
+	for( auto const& attrib : VertexLayout<tVertex>::kAttributes )
+	{
+		if( vertex_locations( attrib.location ) & aLocations )
+			aOut[count++] = VkVertexInputAttributeDescription{ attrib.location, aBinding, attrib.format, attrib.offset };
+	}
+	return count;
+}
+
+
+// Layouts of the vertex buffer formats, as read by the vertex shaders
+
+template<> struct VertexLayout<InterleavedVertex>
+{
+	static constexpr VertexAttribute kAttributes[] = {
+		VERTEX_ATTRIBUTE( InterleavedVertex, position, 0 ),
+		VERTEX_ATTRIBUTE( InterleavedVertex, texcoord, 1 ),
+		VERTEX_ATTRIBUTE( InterleavedVertex, normal, 2 ),
+		VERTEX_ATTRIBUTE( InterleavedVertex, tangent, 3 )
+	};
+};
+static_assert( valid_vertex_layout<InterleavedVertex>() );
+
+// Position w is the tangent sign; all of these are mandatory vertex buffer
+// formats. Decoded by shaders/quantized.glsl.
+template<> struct VertexLayout<QuantizedVertex>
+{
+	static constexpr VertexAttribute kAttributes[] = {
+		VERTEX_ATTRIBUTE_AS( QuantizedVertex, position, 0, VK_FORMAT_R16G16B16A16_UNORM ),
+		VERTEX_ATTRIBUTE_AS( QuantizedVertex, texcoord, 1, VK_FORMAT_R16G16_SFLOAT ),
+		VERTEX_ATTRIBUTE_AS( QuantizedVertex, normal, 2, VK_FORMAT_R16G16_SNORM ),
+		VERTEX_ATTRIBUTE_AS( QuantizedVertex, tangent, 3, VK_FORMAT_R16G16_SNORM )
+	};
+};
+static_assert( valid_vertex_layout<QuantizedVertex>() );
+
+// Element of the position stream (ModelPack::positions)
+struct PositionVertex
+{
+	glm::vec3 position;
+};
+
+template<> struct VertexLayout<PositionVertex>
+{
+	static constexpr VertexAttribute kAttributes[] = {
+		VERTEX_ATTRIBUTE( PositionVertex, position, 0 )
+	};
+};
+static_assert( valid_vertex_layout<PositionVertex>() );
+
+#endif // VERTEX_LAYOUT_HPP_1877D5F9_737A_4B09_A282_378669FFC31E
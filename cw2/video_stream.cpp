@@ -0,0 +1,381 @@
+#include "video_stream.hpp"
+
+#include <utility>
+#include <algorithm>
+
+#include <cassert>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/debug_utils.hpp"
+
+namespace
+{
+	constexpr std::uint32_t kStreamWorkgroupSize = 8; // local_size_x/y in stream_yuv.comp
+	constexpr std::uint32_t kStreamBlockWidth = 8, kStreamBlockHeight = 2; // pixels per invocation
+
+	// PStream in stream_yuv.comp
+	struct StreamPush_
+	{
+		std::uint32_t size[2];
+		std::uint32_t encodeSrgb;
+	};
+
+	bool is_srgb_( VkFormat aFormat )
+	{
+		return VK_FORMAT_R8G8B8A8_SRGB == aFormat || VK_FORMAT_B8G8R8A8_SRGB == aFormat
+			|| VK_FORMAT_A8B8G8R8_SRGB_PACK32 == aFormat;
+	}
+}
+
+VideoStream::VideoStream( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::SamplerCache& aSamplers, lut::ShaderModuleCache& aShaderModules, char const* aShaderPath, VkExtent2D aSize, StreamSink aSink, VkPipelineCache aCache )
+	: mDevice( aWindow.device )
+	, mAllocator( &aAllocator )
+	, mDescriptors( aWindow, 16, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f }, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.f } } )
+	, mSink( std::move(aSink) )
+	, mSlots( kStreamSlots )
+{
+	mSize = VkExtent2D{
+		std::max( aSize.width / kStreamBlockWidth * kStreamBlockWidth, kStreamBlockWidth ),
+		std::max( aSize.height / kStreamBlockHeight * kStreamBlockHeight, kStreamBlockHeight )
+	};
+
+	// Descriptor set layout: the swapchain image, and the ring (at the
+	// slot's dynamic offset)
+	{
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create stream descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		mLayout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline
+	{
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		range.offset = 0;
+		range.size = sizeof(StreamPush_);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &mLayout.handle;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create stream pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		mPipeLayout = lut::PipelineLayout( aWindow.device, layout );
+
+		VkShaderModule const comp = aShaderModules.get( aShaderPath );
+
+		VkComputePipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeInfo.stage.module = comp;
+		pipeInfo.stage.pName = "main";
+		pipeInfo.layout = mPipeLayout.handle;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateComputePipelines( aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create stream pipeline\n" "vkCreateComputePipelines() returned %s", lut::to_string(res).c_str() );
+
+		mPipe = lut::Pipeline( aWindow.device, pipe );
+	}
+
+	// Sampler; bilinear, in case the swapchain's size differs
+	{
+		VkSamplerCreateInfo sampInfo{};
+		sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampInfo.magFilter = VK_FILTER_LINEAR;
+		sampInfo.minFilter = VK_FILTER_LINEAR;
+		sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampInfo.minLod = 0.f;
+		sampInfo.maxLod = 0.f;
+
+		mSampler = aSamplers.get( sampInfo );
+	}
+
+	// Ring; the shader writes it directly, so it is a storage buffer in
+	// host memory
+	{
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties( aWindow.physicalDevice, &props );
+
+		auto const align = std::max<VkDeviceSize>( props.limits.minStorageBufferOffsetAlignment, 4 );
+		mSlotStride = (VkDeviceSize(frame_bytes()) + align - 1) / align * align;
+
+		mRing = lut::create_buffer( aAllocator, mSlotStride * kStreamSlots, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+		mRingData = lut::mapped_data( aAllocator, mRing );
+		assert( mRingData );
+
+		lut::set_name( aWindow, mRing, "stream ring" );
+	}
+
+	mWriter = std::thread( [this] { run_(); } );
+}
+
+VideoStream::~VideoStream()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mQuit = true;
+	}
+
+	mWake.notify_all();
+	mWriter.join();
+}
+
+bool VideoStream::supports( lut::VulkanWindow const& aWindow )
+{
+	if( !(aWindow.swapchainUsage & VK_IMAGE_USAGE_SAMPLED_BIT) )
+		return false;
+
+	VkFormatProperties props{};
+	vkGetPhysicalDeviceFormatProperties( aWindow.physicalDevice, aWindow.swapchainFormat, &props );
+
+	VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return needed == (props.optimalTilingFeatures & needed);
+}
+
+std::size_t VideoStream::frame_bytes() const noexcept
+{
+	// Y at full size, Cb and Cr at a quarter each
+	return std::size_t(mSize.width) * mSize.height * 3 / 2;
+}
+
+void VideoStream::bind_images( lut::VulkanWindow const& aWindow )
+{
+	mImages = aWindow.swapImages;
+	mImageSets = mDescriptors.allocate_sets( mLayout.handle, aWindow.swapViews.size() );
+	mEncodeSrgb = is_srgb_( aWindow.swapchainFormat );
+
+	for( std::size_t i = 0; i < mImageSets.size(); ++i )
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = mSampler;
+		imageInfo.imageView = aWindow.swapViews[i];
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkDescriptorBufferInfo ringInfo{};
+		ringInfo.buffer = mRing.buffer;
+		ringInfo.offset = 0;
+		ringInfo.range = VkDeviceSize(frame_bytes());
+
+		VkWriteDescriptorSet desc[2]{};
+		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[0].dstSet = mImageSets[i];
+		desc[0].dstBinding = 0;
+		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		desc[0].descriptorCount = 1;
+		desc[0].pImageInfo = &imageInfo;
+
+		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[1].dstSet = mImageSets[i];
+		desc[1].dstBinding = 1;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		desc[1].descriptorCount = 1;
+		desc[1].pBufferInfo = &ringInfo;
+
+		vkUpdateDescriptorSets( mDevice, 2, desc, 0, nullptr );
+	}
+}
+
+bool VideoStream::record( VkCommandBuffer aCmdBuff, std::uint32_t aImageIndex, bool aOffscreen )
+{
+	assert( aImageIndex < mImageSets.size() );
+
+	std::size_t slot = kStreamSlots;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		for( std::size_t i = 0; i < mSlots.size(); ++i )
+		{
+			if( EState_::free == mSlots[i].state )
+			{
+				slot = i;
+				mSlots[i].state = EState_::recorded;
+				break;
+			}
+		}
+	}
+
+	if( kStreamSlots == slot )
+	{
+		++mDropped;
+		return false;
+	}
+
+	VkImage const image = mImages[aImageIndex];
+	VkImageLayout const layout = aOffscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	// After the image's final writes (attachment or transfer)
+	lut::image_barrier( aCmdBuff, image,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		layout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, mPipe.handle );
+
+	auto const offset = std::uint32_t(mSlotStride * slot);
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeLayout.handle, 0, 1, &mImageSets[aImageIndex], 1, &offset );
+
+	StreamPush_ push{};
+	push.size[0] = mSize.width;
+	push.size[1] = mSize.height;
+	push.encodeSrgb = mEncodeSrgb ? 1 : 0;
+	vkCmdPushConstants( aCmdBuff, mPipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push );
+
+	auto const blocksX = mSize.width / kStreamBlockWidth, blocksY = mSize.height / kStreamBlockHeight;
+	vkCmdDispatch( aCmdBuff,
+		(blocksX + kStreamWorkgroupSize-1) / kStreamWorkgroupSize,
+		(blocksY + kStreamWorkgroupSize-1) / kStreamWorkgroupSize,
+		1 );
+
+	// Back for presentation (which waits for the submission's semaphore),
+	// or for the offscreen readback
+	lut::image_barrier( aCmdBuff, image,
+		VK_ACCESS_SHADER_READ_BIT, aOffscreen ? VK_ACCESS_TRANSFER_READ_BIT : 0,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, layout,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, aOffscreen ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT );
+
+	lut::buffer_barrier( aCmdBuff, mRing.buffer,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		mSlotStride, mSlotStride * slot );
+
+	return true;
+}
+
+void VideoStream::submitted( std::uint64_t aValue )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	for( auto& slot : mSlots )
+	{
+		if( EState_::recorded == slot.state )
+		{
+			slot.state = EState_::submitted;
+			slot.value = aValue;
+		}
+	}
+}
+
+void VideoStream::poll( lut::Timeline& aTimeline )
+{
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( mError )
+			std::rethrow_exception( std::exchange( mError, nullptr ) );
+
+		// Oldest first: the sink gets the frames in order
+		std::vector<std::size_t> done;
+		for( std::size_t i = 0; i < mSlots.size(); ++i )
+		{
+			if( EState_::submitted == mSlots[i].state && aTimeline.reached( mSlots[i].value ) )
+				done.emplace_back( i );
+		}
+		std::sort( done.begin(), done.end(), [this] (std::size_t aA, std::size_t aB) {
+			return mSlots[aA].value < mSlots[aB].value;
+		} );
+
+		for( auto const i : done )
+		{
+			mSlots[i].state = EState_::writing;
+			mQueue.emplace_back( i );
+			queued = true;
+		}
+	}
+
+	if( queued )
+		mWake.notify_one();
+}
+
+void VideoStream::flush( lut::Timeline& aTimeline )
+{
+	poll( aTimeline );
+
+	std::unique_lock<std::mutex> lock( mMutex );
+	mIdle.wait( lock, [this] {
+		return std::none_of( mSlots.begin(), mSlots.end(), [] (Slot_ const& aSlot) { return EState_::writing == aSlot.state; } );
+	} );
+
+	if( mError )
+		std::rethrow_exception( std::exchange( mError, nullptr ) );
+}
+
+std::size_t VideoStream::sent() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mSent;
+}
+
+void VideoStream::run_()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+	while( true )
+	{
+		mWake.wait( lock, [this] { return mQuit || !mQueue.empty(); } );
+
+		// Quitting drains the queue; frames not yet polled are lost
+		if( mQueue.empty() )
+			return;
+
+		auto const index = mQueue.front();
+		mQueue.pop_front();
+
+		// After an error, the remaining frames are dropped
+		bool const failed = nullptr != mError;
+
+		lock.unlock();
+		bool ok = false;
+		if( !failed )
+		{
+			LUT_CPU_ZONE( "stream sink" );
+			try
+			{
+				vmaInvalidateAllocation( mAllocator->allocator, mRing.allocation, mSlotStride * index, mSlotStride );
+				mSink( mRingData + mSlotStride * index, frame_bytes() );
+				ok = true;
+			}
+			catch( ... )
+			{
+				lock.lock();
+				mError = std::current_exception();
+				lock.unlock();
+			}
+		}
+		lock.lock();
+
+		mSlots[index].state = EState_::free;
+		if( ok )
+			++mSent;
+
+		if( mQueue.empty() )
+			mIdle.notify_all();
+	}
+}
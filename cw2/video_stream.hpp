@@ -0,0 +1,167 @@
+#ifndef VIDEO_STREAM_HPP_C81F4A26_9D3B_4E07_B5A2_6E0D17F93C48
+#define VIDEO_STREAM_HPP_C81F4A26_9D3B_4E07_B5A2_6E0D17F93C48
+
+// Video stream of the rendered frames (--stream=FILE), e.g., for a remote
+// viewer. The colour conversion happens on the GPU, and the CPU only moves
+// finished YUV frames:
+//  - record() converts the final image (HUD included) to YUV 4:2:0 in a
+//    compute shader (cw2/shaders/stream_yuv.comp), which samples the
+//    swapchain image in place and writes straight into a slot of a
+//    host-cached ring buffer; no copy of the RGBA image is made;
+//  - submitted() and poll() work as with FrameCapture (see
+//    frame_capture.hpp): poll() only queries the timeline, and passes the
+//    slots of completed frames to a writer thread;
+//  - the writer hands each frame to the StreamSink, oldest first, and
+//    returns the slot to the ring.
+// A frame is half the bytes of the RGBA image's 4 bytes per pixel and
+// needs no conversion on the CPU. If the sink falls behind and no slot is
+// free, the frame is dropped.
+//
+// The frames keep the stream's size, set at creation; the image is scaled
+// to it if the swapchain is resized.
+//
+// Note: the YUV frames are what a GPU encoder takes as input (e.g., with
+// VK_KHR_video_encode_h264), but the Vulkan headers in third_party only
+// have the provisional video extensions, so the frames leave uncompressed.
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "../labutils/timeline.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/object_cache.hpp"
+#include "../labutils/vulkan_window.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+
+namespace lut = labutils;
+
+// Slots in the ring; as kCaptureBuffers
+constexpr std::size_t kStreamSlots = 8;
+
+// Called on the writer thread, once per frame, in order: the Y, Cb and Cr
+// planes of a VideoStream::size() frame (I420, e.g., a YUV4MPEG2 frame's
+// payload). Exceptions are rethrown by VideoStream::poll().
+using StreamSink = std::function<void (std::byte const* aFrame, std::size_t aBytes)>;
+
+class VideoStream
+{
+	public:
+		// aSize is rounded down to a multiple of 8x2 (at least 8x2)
+		VideoStream(
+			lut::VulkanWindow const&,
+			lut::Allocator const&,
+			lut::SamplerCache&,
+			lut::ShaderModuleCache&,
+			char const* aShaderPath,
+			VkExtent2D aSize,
+			StreamSink,
+			VkPipelineCache = VK_NULL_HANDLE
+		);
+		~VideoStream(); // passes the frames handed to the writer to the sink first
+
+		VideoStream( VideoStream const& ) = delete;
+		VideoStream& operator= (VideoStream const&) = delete;
+
+	public:
+		// The swapchain images can be sampled (see
+		// VulkanWindow::swapchainUsage), in their format
+		static bool supports( lut::VulkanWindow const& );
+
+		VkExtent2D size() const noexcept { return mSize; }
+		std::size_t frame_bytes() const noexcept; // Y, Cb and Cr
+
+		// Descriptors for the window's swapchain images; call after
+		// creation and after every recreate_swapchain(). Sets from before
+		// stay valid for the frames in flight.
+		void bind_images( lut::VulkanWindow const& );
+
+		// Records the conversion of swapchain image aImageIndex, after its
+		// final writes (the render pass, upscale, stereo copies or HUD). The
+		// image is in PRESENT_SRC_KHR, or with aOffscreen in
+		// TRANSFER_SRC_OPTIMAL, and returns there. Returns false (and
+		// records nothing) if no slot is free.
+		bool record( VkCommandBuffer, std::uint32_t aImageIndex, bool aOffscreen );
+
+		// The frame that record() converted since the previous call
+		// signals aValue on the timeline
+		void submitted( std::uint64_t aValue );
+
+		// Hands the completed frames to the writer. Rethrows an error raised
+		// by the sink.
+		void poll( lut::Timeline& );
+
+		// poll(), then waits until the sink has taken everything; for the
+		// end of the run, once the device is idle
+		void flush( lut::Timeline& );
+
+		std::size_t sent() const;
+		std::size_t dropped() const noexcept { return mDropped; }
+
+	private:
+		enum class EState_
+		{
+			free,
+			recorded,
+			submitted,
+			writing
+		};
+
+		struct Slot_
+		{
+			EState_ state = EState_::free;
+			std::uint64_t value = 0;
+		};
+
+		void run_();
+
+	private:
+		VkDevice mDevice;
+		lut::Allocator const* mAllocator;
+
+		VkExtent2D mSize{};
+		VkDeviceSize mSlotStride = 0; // of the ring; storage buffer offset aligned
+
+		lut::DescriptorSetLayout mLayout;
+		lut::PipelineLayout mPipeLayout;
+		lut::Pipeline mPipe;
+		VkSampler mSampler = VK_NULL_HANDLE; // linear, clamp to edge; from the cache
+
+		lut::DescriptorAllocator mDescriptors;
+		std::vector<VkDescriptorSet> mImageSets; // per swapchain image
+		std::vector<VkImage> mImages;
+		bool mEncodeSrgb = false;
+
+		lut::Buffer mRing; // kStreamSlots frames, persistently mapped
+		std::byte const* mRingData = nullptr;
+
+		StreamSink mSink;
+
+		// States change under mMutex; the writer only reads the ring in
+		// its slots in the writing state.
+		std::vector<Slot_> mSlots;
+
+		mutable std::mutex mMutex;
+		std::condition_variable mWake, mIdle;
+		std::deque<std::size_t> mQueue; // slots to write
+		std::size_t mSent = 0;
+		std::exception_ptr mError;
+		bool mQuit = false;
+
+		std::size_t mDropped = 0;
+
+		std::thread mWriter;
+};
+
+#endif // VIDEO_STREAM_HPP_C81F4A26_9D3B_4E07_B5A2_6E0D17F93C48
@@ -0,0 +1,879 @@
+#include "virtual_textures.hpp"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring> // for std::memcpy()
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/to_string.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/texture_file.hpp"
+
+#include "texture_streaming.hpp" // kMipFeedback*
+
+namespace
+{
+	// Frames between residency decisions; the feedback of the frames in
+	// between is combined
+	constexpr std::uint64_t kVirtualInterval = 8;
+
+	// Regions that have not been sampled for this many frames go back to
+	// the mip tail
+	constexpr std::uint64_t kVirtualIdleFrames = 600;
+
+	// Tiles copied per decision (4 MiB of 64 KiB tiles), to bound the
+	// hitch; the rest follow in the next ones
+	constexpr std::uint32_t kMaxTileUploads = 64;
+
+	constexpr VkDeviceSize kVirtualStagingBytes = VkDeviceSize(8) << 20;
+
+	constexpr std::uint32_t kNotVirtual = ~0u;
+	constexpr std::uint8_t kNotWanted = 0xff;
+
+	constexpr VkImageUsageFlags kVirtualUsage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	constexpr VkImageCreateFlags kVirtualFlags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+
+	// Size in bytes of one texel (block dimension 1) or one 4x4 block, for
+	// the formats of baked texture files (see lut::load_texture_file())
+	std::uint32_t block_bytes_( VkFormat aFormat, std::uint32_t& aBlockDim )
+	{
+		aBlockDim = 4;
+		switch( aFormat )
+		{
+			case VK_FORMAT_BC4_UNORM_BLOCK: return 8;
+			case VK_FORMAT_BC5_UNORM_BLOCK: return 16;
+			case VK_FORMAT_BC7_UNORM_BLOCK: return 16;
+			case VK_FORMAT_BC7_SRGB_BLOCK: return 16;
+			default: break;
+		}
+
+		aBlockDim = 1;
+		switch( aFormat )
+		{
+			case VK_FORMAT_R8_UNORM: return 1;
+			case VK_FORMAT_R8G8_UNORM: return 2;
+			case VK_FORMAT_R8G8B8A8_UNORM: return 4;
+			case VK_FORMAT_R8G8B8A8_SRGB: return 4;
+			default: return 0;
+		}
+	}
+
+	// Sparse residency of aFormat's colour aspect, with images of aData's size
+	bool sparse_format_( lut::VulkanWindow const& aWindow, lut::MipImageData const& aData, VkSparseImageFormatProperties& aProps )
+	{
+		VkImageFormatProperties imageProps{};
+		if( VK_SUCCESS != vkGetPhysicalDeviceImageFormatProperties( aWindow.physicalDevice, aData.format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL, kVirtualUsage, kVirtualFlags, &imageProps ) )
+			return false;
+		if( aData.width > imageProps.maxExtent.width || aData.height > imageProps.maxExtent.height || aData.levelOffsets.size() > imageProps.maxMipLevels )
+			return false;
+
+		std::uint32_t count = 0;
+		vkGetPhysicalDeviceSparseImageFormatProperties( aWindow.physicalDevice, aData.format, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, kVirtualUsage, VK_IMAGE_TILING_OPTIMAL, &count, nullptr );
+
+		std::vector<VkSparseImageFormatProperties> props( count );
+		vkGetPhysicalDeviceSparseImageFormatProperties( aWindow.physicalDevice, aData.format, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, kVirtualUsage, VK_IMAGE_TILING_OPTIMAL, &count, props.data() );
+
+		for( auto const& prop : props )
+		{
+			if( prop.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT )
+			{
+				aProps = prop;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	VmaAllocation allocate_( lut::Allocator const& aAllocator, VkMemoryRequirements const& aReqs, VmaAllocationInfo& aInfo )
+	{
+		VmaAllocationCreateInfo allocInfo{};
+		allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		VmaAllocation ret = VK_NULL_HANDLE;
+		if( auto const res = vmaAllocateMemory( aAllocator.allocator, &aReqs, &allocInfo, &ret, &aInfo ); VK_SUCCESS != res )
+			throw lut::Error( "Allocating virtual texture memory\n" "vmaAllocateMemory() returned %s", lut::to_string(res).c_str() );
+
+		lut::tag_allocation( aAllocator.allocator, ret, lut::EMemoryClass::textures );
+		lut::name_allocation( aAllocator.allocator, ret, "virtual texture tiles" );
+		return ret;
+	}
+
+	void bind_sparse_( lut::VulkanWindow const& aWindow, VkBindSparseInfo const& aInfo )
+	{
+		lut::Fence fence = lut::create_fence( aWindow );
+		if( auto const res = vkQueueBindSparse( aWindow.graphicsQueue, 1, &aInfo, fence.handle ); VK_SUCCESS != res )
+			throw lut::Error( "Binding virtual texture tiles\n" "vkQueueBindSparse() returned %s", lut::to_string(res).c_str() );
+
+		if( auto const res = vkWaitForFences( aWindow.device, 1, &fence.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+			throw lut::Error( "Waiting for virtual texture tiles\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str() );
+	}
+
+	void begin_upload_( lut::VulkanWindow const& aWindow, VirtualTextures& aVirtual )
+	{
+		// The previous upload was submitted kVirtualInterval frames ago
+		if( VK_NULL_HANDLE != aVirtual.lastUpload )
+		{
+			if( auto const res = vkWaitForFences( aWindow.device, 1, &aVirtual.lastUpload, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+				throw lut::Error( "Waiting for virtual texture upload\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str() );
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if( auto const res = vkBeginCommandBuffer( aVirtual.cmdBuff, &beginInfo ); VK_SUCCESS != res )
+			throw lut::Error( "Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str() );
+	}
+
+	void submit_upload_( lut::VulkanWindow const& aWindow, VirtualTextures& aVirtual )
+	{
+		if( auto const res = vkEndCommandBuffer( aVirtual.cmdBuff ); VK_SUCCESS != res )
+			throw lut::Error( "Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str() );
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &aVirtual.cmdBuff;
+
+		aVirtual.lastUpload = aVirtual.staging->submit_fence();
+		if( auto const res = vkQueueSubmit( aWindow.graphicsQueue, 1, &submitInfo, aVirtual.lastUpload ); VK_SUCCESS != res )
+			throw lut::Error( "Submitting commands\n" "vkQueueSubmit() returned %s", lut::to_string(res).c_str() );
+	}
+
+	// The residency table, after the frames that read it and before those
+	// that will
+	void record_residency_( VkCommandBuffer aCmdBuff, VirtualTextures& aVirtual )
+	{
+		auto const bytes = VkDeviceSize( aVirtual.hostResidency.size() * sizeof(std::uint32_t) );
+		auto const staging = aVirtual.staging->allocate( bytes );
+		std::memcpy( staging.data, aVirtual.hostResidency.data(), bytes );
+
+		lut::buffer_barrier( aCmdBuff, aVirtual.residency.buffer,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		VkBufferCopy copy{};
+		copy.srcOffset = staging.offset;
+		copy.size = bytes;
+		vkCmdCopyBuffer( aCmdBuff, staging.buffer, aVirtual.residency.buffer, 1, &copy );
+
+		lut::buffer_barrier( aCmdBuff, aVirtual.residency.buffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+	}
+
+	// Texel rectangle of tile aTile of aLevel
+	VkOffset3D tile_offset_( VirtualTexture const& aTex, VirtualLevel const& aLevel, std::uint32_t aTile )
+	{
+		return VkOffset3D{
+			std::int32_t( (aTile % aLevel.tilesX) * aTex.granularity.width ),
+			std::int32_t( (aTile / aLevel.tilesX) * aTex.granularity.height ),
+			0
+		};
+	}
+	VkExtent3D tile_extent_( VirtualTexture const& aTex, VirtualLevel const& aLevel, VkOffset3D const& aOffset )
+	{
+		return VkExtent3D{
+			std::min( aTex.granularity.width, aLevel.width - std::uint32_t(aOffset.x) ),
+			std::min( aTex.granularity.height, aLevel.height - std::uint32_t(aOffset.y) ),
+			1
+		};
+	}
+
+	// Calls aFunc with the index of every tile of aLevel that region
+	// aRegion needs: those under its texels, and a texel around them for
+	// the bilinear filter.
+	template< typename tFunc >
+	void for_region_tiles_( VirtualTexture const& aTex, std::uint32_t aLevel, std::uint32_t aRegion, tFunc&& aFunc )
+	{
+		assert( aLevel < aTex.levels.size() );
+		auto const& level = aTex.levels[aLevel];
+
+		auto const rx = aRegion % kVirtualRegionGrid, ry = aRegion / kVirtualRegionGrid;
+		auto const x0 = std::uint32_t( std::uint64_t(rx) * level.width / kVirtualRegionGrid );
+		auto const x1 = std::uint32_t( (std::uint64_t(rx+1) * level.width + kVirtualRegionGrid - 1) / kVirtualRegionGrid );
+		auto const y0 = std::uint32_t( std::uint64_t(ry) * level.height / kVirtualRegionGrid );
+		auto const y1 = std::uint32_t( (std::uint64_t(ry+1) * level.height + kVirtualRegionGrid - 1) / kVirtualRegionGrid );
+
+		auto const tx0 = (x0 > 0 ? x0 - 1 : 0) / aTex.granularity.width;
+		auto const tx1 = (std::min( x1 + 1, level.width ) - 1) / aTex.granularity.width;
+		auto const ty0 = (y0 > 0 ? y0 - 1 : 0) / aTex.granularity.height;
+		auto const ty1 = (std::min( y1 + 1, level.height ) - 1) / aTex.granularity.height;
+
+		for( auto ty = ty0; ty <= ty1; ++ty )
+		{
+			for( auto tx = tx0; tx <= tx1; ++tx )
+				aFunc( ty * level.tilesX + tx );
+		}
+	}
+
+	// A tile of the file's level, packed into aDst
+	void copy_tile_( VirtualTexture const& aTex, std::uint32_t aLevel, VkOffset3D const& aOffset, VkExtent3D const& aExtent, std::byte* aDst )
+	{
+		std::uint32_t blockDim = 1;
+		auto const blockBytes = block_bytes_( aTex.data.format, blockDim );
+
+		auto const& level = aTex.levels[aLevel];
+		auto const pitch = std::size_t( (level.width + blockDim - 1) / blockDim ) * blockBytes;
+		auto const rowBytes = std::size_t( (aExtent.width + blockDim - 1) / blockDim ) * blockBytes;
+		auto const rows = (aExtent.height + blockDim - 1) / blockDim;
+
+		std::uint8_t const* src = aTex.data.bytes.data() + aTex.data.levelOffsets[aLevel]
+			+ std::size_t( std::uint32_t(aOffset.y) / blockDim ) * pitch
+			+ std::size_t( std::uint32_t(aOffset.x) / blockDim ) * blockBytes;
+
+		for( std::uint32_t row = 0; row < rows; ++row )
+			std::memcpy( aDst + row * rowBytes, src + row * pitch, rowBytes );
+	}
+
+	VkDeviceSize tile_bytes_( VirtualTexture const& aTex, VkExtent3D const& aExtent )
+	{
+		std::uint32_t blockDim = 1;
+		auto const blockBytes = block_bytes_( aTex.data.format, blockDim );
+		return VkDeviceSize( (aExtent.width + blockDim - 1) / blockDim ) * ((aExtent.height + blockDim - 1) / blockDim) * blockBytes;
+	}
+
+	// Tile bind (or unbind, with a null aAllocation), for vkQueueBindSparse()
+	VkSparseImageMemoryBind tile_bind_( VirtualTexture const& aTex, std::uint32_t aLevel, std::uint32_t aTile, VmaAllocationInfo const* aAllocation )
+	{
+		auto const& level = aTex.levels[aLevel];
+
+		VkSparseImageMemoryBind bind{};
+		bind.subresource = VkImageSubresource{ VK_IMAGE_ASPECT_COLOR_BIT, aLevel, 0 };
+		bind.offset = tile_offset_( aTex, level, aTile );
+		bind.extent = tile_extent_( aTex, level, bind.offset );
+		if( aAllocation )
+		{
+			bind.memory = aAllocation->deviceMemory;
+			bind.memoryOffset = aAllocation->offset;
+		}
+		return bind;
+	}
+
+	// Pending work of an update
+	struct TileUpload_
+	{
+		std::uint32_t texture, level, tile;
+	};
+}
+
+bool supports_virtual_textures( lut::VulkanWindow const& aWindow )
+{
+	if( !aWindow.caps.sparseBinding || !aWindow.caps.sparseResidencyImage2D )
+		return false;
+
+	// The tiles are bound on the graphics queue, in order with the uploads
+	std::uint32_t count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties( aWindow.physicalDevice, &count, nullptr );
+	std::vector<VkQueueFamilyProperties> families( count );
+	vkGetPhysicalDeviceQueueFamilyProperties( aWindow.physicalDevice, &count, families.data() );
+
+	return aWindow.graphicsFamilyIndex < count
+		&& (families[aWindow.graphicsFamilyIndex].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT);
+}
+
+VirtualTextures create_virtual_textures( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, ModelPack& aModel, VkSampler aSampler, lut::AsyncUploader& aUploader, std::size_t aFramesInFlight, VkDeviceSize aBudget )
+{
+	assert( !aModel.textureSources.empty() );
+
+	VirtualTextures ret;
+	ret.budget = aBudget;
+	ret.framesInFlight = std::uint32_t(aFramesInFlight);
+
+	auto const textureCount = aModel.textures.size();
+	ret.virtualIndex.assign( textureCount, kNotVirtual );
+	ret.installedExtent.assign( textureCount, 0 );
+
+	// The slots that the colour pass samples with the clamp. Alpha masks are
+	// also sampled by the depth-only passes.
+	std::vector<bool> candidates( textureCount, false ), masks( textureCount, false );
+	for( auto const& mat : aModel.hostMaterials )
+	{
+		for( auto const id : { mat.baseColor, mat.roughness, mat.metalness, mat.normalMap } )
+		{
+			if( kNoTexture != id && id < textureCount )
+				candidates[id] = true;
+		}
+		if( kNoTexture != mat.alphaMask && mat.alphaMask < textureCount )
+			masks[mat.alphaMask] = true;
+	}
+
+	std::vector<VkSparseMemoryBind> tailBinds; // per texture: tail, metadata (either may be missing)
+	std::vector<std::uint32_t> tailBindCounts; // per texture
+	for( std::uint32_t id = 0; id < aModel.textureSources.size(); ++id )
+	{
+		auto const& src = aModel.textureSources[id];
+		if( !candidates[id] || masks[id] || src.packed || !lut::is_texture_file( src.path.c_str() ) )
+			continue;
+
+		auto data = lut::load_texture_file( src.path.c_str() );
+		std::uint32_t blockDim = 1;
+		VkSparseImageFormatProperties format{};
+		if( 0 == block_bytes_( data.format, blockDim ) || !sparse_format_( aWindow, data, format ) )
+			continue;
+
+		auto const levels = std::uint32_t(data.levelOffsets.size());
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.flags = kVirtualFlags;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = data.format;
+		imageInfo.extent = VkExtent3D{ data.width, data.height, 1 };
+		imageInfo.mipLevels = levels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = kVirtualUsage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkImage image = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImage( aWindow.device, &imageInfo, nullptr, &image ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create sparse image for '%s'\n" "vkCreateImage() returned %s", src.path.c_str(), lut::to_string(res).c_str() );
+
+		VirtualTexture tex;
+		tex.id = id;
+		tex.image = SparseImage( aWindow.device, image );
+		tex.granularity = format.imageGranularity;
+
+		VkMemoryRequirements memReqs{};
+		vkGetImageMemoryRequirements( aWindow.device, image, &memReqs );
+
+		std::uint32_t reqCount = 0;
+		vkGetImageSparseMemoryRequirements( aWindow.device, image, &reqCount, nullptr );
+		std::vector<VkSparseImageMemoryRequirements> reqs( reqCount );
+		vkGetImageSparseMemoryRequirements( aWindow.device, image, &reqCount, reqs.data() );
+
+		VkSparseImageMemoryRequirements const* colour = nullptr;
+		VkSparseImageMemoryRequirements const* metadata = nullptr;
+		for( auto const& req : reqs )
+		{
+			if( req.formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT )
+				colour = &req;
+			if( req.formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT )
+				metadata = &req;
+		}
+
+		// Textures that fit into their mip tail gain nothing
+		if( !colour || 0 == colour->imageMipTailFirstLod )
+			continue;
+
+		tex.tailLevel = std::min( colour->imageMipTailFirstLod, levels );
+		tex.pageReqs = memReqs;
+		tex.pageReqs.size = memReqs.alignment;
+		ret.pageBytes = std::max( ret.pageBytes, memReqs.alignment );
+
+		for( std::uint32_t level = 0; level < tex.tailLevel; ++level )
+		{
+			VirtualLevel lvl;
+			lvl.width = std::max( 1u, data.width >> level );
+			lvl.height = std::max( 1u, data.height >> level );
+			lvl.tilesX = (lvl.width + tex.granularity.width - 1) / tex.granularity.width;
+			lvl.tilesY = (lvl.height + tex.granularity.height - 1) / tex.granularity.height;
+			lvl.refs.assign( std::size_t(lvl.tilesX) * lvl.tilesY, 0 );
+			lvl.pages.assign( std::size_t(lvl.tilesX) * lvl.tilesY, VK_NULL_HANDLE );
+			tex.levels.emplace_back( std::move(lvl) );
+		}
+
+		// The tail (if the texture has levels in it) and the metadata stay
+		// bound for the texture's lifetime
+		VkDeviceSize const tailBytes = tex.tailLevel < levels ? colour->imageMipTailSize : 0;
+		VkDeviceSize const metadataBytes = metadata ? metadata->imageMipTailSize : 0;
+		auto const firstBind = tailBinds.size();
+		if( tailBytes + metadataBytes > 0 )
+		{
+			VkMemoryRequirements tailReqs = memReqs;
+			tailReqs.size = tailBytes + metadataBytes;
+
+			VmaAllocationInfo info{};
+			tex.tail = allocate_( aAllocator, tailReqs, info );
+
+			if( tailBytes > 0 )
+			{
+				VkSparseMemoryBind bind{};
+				bind.resourceOffset = colour->imageMipTailOffset;
+				bind.size = tailBytes;
+				bind.memory = info.deviceMemory;
+				bind.memoryOffset = info.offset;
+				tailBinds.emplace_back( bind );
+			}
+			if( metadataBytes > 0 )
+			{
+				VkSparseMemoryBind bind{};
+				bind.resourceOffset = metadata->imageMipTailOffset;
+				bind.size = metadataBytes;
+				bind.memory = info.deviceMemory;
+				bind.memoryOffset = info.offset + tailBytes;
+				bind.flags = VK_SPARSE_MEMORY_BIND_METADATA_BIT;
+				tailBinds.emplace_back( bind );
+			}
+		}
+		tailBindCounts.emplace_back( std::uint32_t(tailBinds.size() - firstBind) );
+
+		std::fill( std::begin(tex.resident), std::end(tex.resident), std::uint8_t(tex.tailLevel) );
+		std::fill( std::begin(tex.wanted), std::end(tex.wanted), kNotWanted );
+		std::fill( std::begin(tex.lastSampled), std::end(tex.lastSampled), std::uint64_t(0) );
+
+		lut::set_name( aWindow, tex.image, aModel.textureNames[id].c_str() );
+
+		tex.data = std::move(data);
+		ret.virtualIndex[id] = std::uint32_t(ret.textures.size());
+		ret.textures.emplace_back( std::move(tex) );
+	}
+
+	// Tails, in one batch
+	{
+		std::vector<VkSparseImageOpaqueMemoryBindInfo> tailInfos;
+		std::size_t next = 0;
+		for( std::size_t i = 0; i < ret.textures.size(); ++i )
+		{
+			if( 0 == tailBindCounts[i] )
+				continue;
+
+			VkSparseImageOpaqueMemoryBindInfo info{};
+			info.image = ret.textures[i].image.handle;
+			info.bindCount = tailBindCounts[i];
+			info.pBinds = tailBinds.data() + next;
+			next += info.bindCount;
+			tailInfos.emplace_back( info );
+		}
+		assert( next == tailBinds.size() );
+
+		if( !tailInfos.empty() )
+		{
+			VkBindSparseInfo bindInfo{};
+			bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+			bindInfo.imageOpaqueBindCount = std::uint32_t(tailInfos.size());
+			bindInfo.pImageOpaqueBinds = tailInfos.data();
+			bind_sparse_( aWindow, bindInfo );
+		}
+	}
+
+	ret.feedback = lut::create_buffer( aAllocator, textureCount * kVirtualRegions * sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+	for( std::size_t i = 0; i < aFramesInFlight; ++i )
+		ret.readbacks.emplace_back( lut::create_buffer( aAllocator, textureCount * kVirtualRegions * sizeof(std::uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::readback, VMA_ALLOCATION_CREATE_MAPPED_BIT ) );
+	ret.readbackValid.assign( aFramesInFlight, false );
+
+	// Textures that aren't virtual are never clamped
+	ret.hostResidency.assign( textureCount * kVirtualRegions, 0 );
+	for( auto const& tex : ret.textures )
+		std::fill_n( ret.hostResidency.begin() + std::size_t(tex.id) * kVirtualRegions, kVirtualRegions, tex.tailLevel );
+	ret.residency = lut::create_buffer( aAllocator, ret.hostResidency.size() * sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, lut::EMemoryClass::device );
+
+	lut::set_name( aWindow, ret.feedback, "virtual texture feedback" );
+	lut::set_name( aWindow, ret.residency, "virtual texture residency" );
+
+	ret.pool = lut::create_command_pool( aWindow, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT );
+	ret.cmdBuff = lut::alloc_command_buffer( aWindow, ret.pool.handle );
+	ret.staging = std::make_unique<lut::StagingRing>( aWindow, aAllocator, kVirtualStagingBytes );
+
+	// Mip tails and the residency table, submitted whenever half of the
+	// staging ring is used. All levels end up in SHADER_READ_ONLY_OPTIMAL,
+	// bound or not.
+	begin_upload_( aWindow, ret );
+	VkDeviceSize staged = 0;
+	for( auto const& tex : ret.textures )
+	{
+		auto const levels = std::uint32_t(tex.data.levelOffsets.size());
+		lut::image_barrier( ret.cmdBuff, tex.image.handle,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 } );
+
+		if( tex.tailLevel < levels )
+		{
+			auto const first = tex.data.levelOffsets[tex.tailLevel];
+			auto const bytes = VkDeviceSize( tex.data.bytes.size() - first );
+			if( bytes > ret.staging->capacity() / 2 )
+				throw lut::Error( "'%s': mip tail of %llu bytes exceeds the staging ring", aModel.textureNames[tex.id].c_str(), static_cast<unsigned long long>(bytes) );
+
+			if( staged + bytes > ret.staging->capacity() / 2 )
+			{
+				submit_upload_( aWindow, ret );
+				begin_upload_( aWindow, ret );
+				staged = 0;
+			}
+			staged += bytes;
+
+			auto const staging = ret.staging->allocate( bytes );
+			std::memcpy( staging.data, tex.data.bytes.data() + first, bytes );
+
+			std::vector<VkBufferImageCopy> copies;
+			for( auto level = tex.tailLevel; level < levels; ++level )
+			{
+				VkBufferImageCopy copy{};
+				copy.bufferOffset = staging.offset + (tex.data.levelOffsets[level] - first);
+				copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+				copy.imageExtent = VkExtent3D{ std::max( 1u, tex.data.width >> level ), std::max( 1u, tex.data.height >> level ), 1 };
+				copies.emplace_back( copy );
+			}
+			vkCmdCopyBufferToImage( ret.cmdBuff, staging.buffer, tex.image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, std::uint32_t(copies.size()), copies.data() );
+		}
+
+		lut::image_barrier( ret.cmdBuff, tex.image.handle,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 } );
+	}
+	record_residency_( ret.cmdBuff, ret );
+	submit_upload_( aWindow, ret );
+
+	// Swap the sparse images in, and request the other textures in full
+	std::vector<ModelTextureView> views;
+	for( auto const& tex : ret.textures )
+	{
+		ModelTextureView view;
+		view.id = tex.id;
+		view.format = tex.data.format;
+		view.view = lut::create_image_view_texture2d( aWindow, tex.image.handle, tex.data.format );
+		views.emplace_back( std::move(view) );
+	}
+
+	if( auto const res = vkWaitForFences( aWindow.device, 1, &ret.lastUpload, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+		throw lut::Error( "Waiting for virtual texture upload\n" "vkWaitForFences() returned %s", lut::to_string(res).c_str() );
+
+	set_model_texture_views( aWindow, aModel, aSampler, std::move(views) );
+
+	for( std::uint32_t id = 0; id < aModel.textureSources.size(); ++id )
+	{
+		if( kNotVirtual == ret.virtualIndex[id] )
+			stream_model_texture( aModel, aUploader, id, 0 );
+	}
+
+	return ret;
+}
+
+void record_virtual_feedback( VkCommandBuffer aCmdBuff, VirtualTextures& aVirtual, std::uint32_t aFrame )
+{
+	assert( aFrame < aVirtual.readbacks.size() );
+
+	// As record_mip_feedback(); the first frame starts from a buffer that
+	// was never reset
+	bool const valid = aVirtual.reset;
+	if( valid )
+	{
+		lut::buffer_barrier( aCmdBuff, aVirtual.feedback.buffer,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+
+		VkBufferCopy copy{};
+		copy.size = aVirtual.hostResidency.size() * sizeof(std::uint32_t);
+		vkCmdCopyBuffer( aCmdBuff, aVirtual.feedback.buffer, aVirtual.readbacks[aFrame].buffer, 1, &copy );
+
+		lut::buffer_barrier( aCmdBuff, aVirtual.readbacks[aFrame].buffer,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT );
+
+		lut::buffer_barrier( aCmdBuff, aVirtual.feedback.buffer,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+	}
+	aVirtual.readbackValid[aFrame] = valid;
+	aVirtual.reset = true;
+
+	vkCmdFillBuffer( aCmdBuff, aVirtual.feedback.buffer, 0, VK_WHOLE_SIZE, kMipFeedbackNone );
+
+	lut::buffer_barrier( aCmdBuff, aVirtual.feedback.buffer,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+}
+
+void update_virtual_textures( VirtualTextures& aVirtual, lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, std::uint32_t aFrame, lut::FrameArena& aArena )
+{
+	assert( aFrame < aVirtual.readbacks.size() );
+
+	++aVirtual.frame;
+
+	// Finest level sampled per region
+	if( aVirtual.readbackValid[aFrame] )
+	{
+		auto const& readback = aVirtual.readbacks[aFrame];
+		if( auto const res = vmaInvalidateAllocation( aAllocator.allocator, readback.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+			throw lut::Error( "Invalidating virtual texture feedback\n" "vmaInvalidateAllocation() returned %s", lut::to_string(res).c_str() );
+
+		std::byte const* data = lut::mapped_data( aAllocator, readback );
+		assert( data );
+
+		for( auto& tex : aVirtual.textures )
+		{
+			// Footprint in texels of the full texture, per pixel
+			float const size = std::log2( float(std::max( tex.data.width, tex.data.height )) );
+			for( std::uint32_t region = 0; region < kVirtualRegions; ++region )
+			{
+				std::uint32_t code;
+				std::memcpy( &code, data + (std::size_t(tex.id) * kVirtualRegions + region) * sizeof(std::uint32_t), sizeof(code) );
+				if( kMipFeedbackNone == code )
+					continue;
+
+				tex.lastSampled[region] = aVirtual.frame;
+
+				float const footprint = float(code) / kMipFeedbackScale - kMipFeedbackBias + size;
+				auto const level = std::min( std::uint32_t(std::max( 0.f, std::floor( footprint ) )), tex.tailLevel );
+				tex.wanted[region] = std::min( tex.wanted[region], std::uint8_t(level) );
+			}
+		}
+	}
+
+	if( 0 != aVirtual.frame % kVirtualInterval )
+		return;
+
+	bool tableChanged = false;
+	lut::ArenaVector<VmaAllocation> freed{ lut::ArenaAllocator<VmaAllocation>( aArena ) };
+
+	// Coarsen the regions that are sampled two levels coarser than they are
+	// resident (so that small camera motions don't move them back and forth),
+	// or not at all for a while. The clamp goes up now, the tiles follow
+	// once no frame in flight can sample them.
+	for( std::uint32_t t = 0; t < aVirtual.textures.size(); ++t )
+	{
+		auto& tex = aVirtual.textures[t];
+		for( std::uint32_t region = 0; region < kVirtualRegions; ++region )
+		{
+			std::uint32_t const resident = tex.resident[region];
+			bool const idle = aVirtual.frame - tex.lastSampled[region] > kVirtualIdleFrames;
+			std::uint32_t const goal = kNotWanted != tex.wanted[region] ? tex.wanted[region] : idle ? tex.tailLevel : resident;
+			if( resident >= tex.tailLevel || !(goal > resident + 1 || (idle && goal > resident)) )
+				continue;
+
+			for_region_tiles_( tex, resident, region, [&] (std::uint32_t aTile) {
+				auto& refs = tex.levels[resident].refs[aTile];
+				assert( refs > 0 );
+				if( 0 == --refs )
+					aVirtual.retired.emplace_back( VirtualTextures::Retired{ t, resident, aTile, aVirtual.frame } );
+			} );
+
+			tex.resident[region] = std::uint8_t(resident + 1);
+			aVirtual.hostResidency[std::size_t(tex.id) * kVirtualRegions + region] = resident + 1;
+			tableChanged = true;
+		}
+	}
+
+	// Then refine, the regions that are farthest from their goal first, by a
+	// level each, as far as the budget and kMaxTileUploads allow
+	struct Refine_
+	{
+		std::uint32_t texture, region, deficit;
+	};
+	lut::ArenaVector<Refine_> refines{ lut::ArenaAllocator<Refine_>( aArena ) };
+	for( std::uint32_t t = 0; t < aVirtual.textures.size(); ++t )
+	{
+		auto const& tex = aVirtual.textures[t];
+		for( std::uint32_t region = 0; region < kVirtualRegions; ++region )
+		{
+			if( kNotWanted != tex.wanted[region] && tex.wanted[region] < tex.resident[region] )
+				refines.emplace_back( Refine_{ t, region, std::uint32_t(tex.resident[region] - tex.wanted[region]) } );
+		}
+	}
+	// Ties by index, as a stable sort would (which needs a heap buffer)
+	std::sort( refines.begin(), refines.end(), [] (Refine_ const& aA, Refine_ const& aB) {
+		if( aA.deficit != aB.deficit )
+			return aA.deficit > aB.deficit;
+		return aA.texture != aB.texture ? aA.texture < aB.texture : aA.region < aB.region;
+	} );
+
+	auto const maxPages = aVirtual.pageBytes > 0 ? std::size_t(aVirtual.budget / aVirtual.pageBytes) : 0;
+	lut::ArenaVector<TileUpload_> uploads{ lut::ArenaAllocator<TileUpload_>( aArena ) };
+	for( auto const& refine : refines )
+	{
+		auto& tex = aVirtual.textures[refine.texture];
+		std::uint32_t const level = tex.resident[refine.region] - 1u;
+
+		std::uint32_t missing = 0;
+		for_region_tiles_( tex, level, refine.region, [&] (std::uint32_t aTile) {
+			if( VK_NULL_HANDLE == tex.levels[level].pages[aTile] )
+				++missing;
+		} );
+
+		if( aVirtual.pages + missing > maxPages || uploads.size() + missing > kMaxTileUploads )
+			continue;
+
+		for_region_tiles_( tex, level, refine.region, [&] (std::uint32_t aTile) {
+			auto& lvl = tex.levels[level];
+			if( VK_NULL_HANDLE == lvl.pages[aTile] )
+			{
+				VmaAllocationInfo info{};
+				lvl.pages[aTile] = allocate_( aAllocator, tex.pageReqs, info );
+				++aVirtual.pages;
+				uploads.emplace_back( TileUpload_{ refine.texture, level, aTile } );
+			}
+			++lvl.refs[aTile];
+		} );
+
+		tex.resident[refine.region] = std::uint8_t(level);
+		aVirtual.hostResidency[std::size_t(tex.id) * kVirtualRegions + refine.region] = level;
+		tableChanged = true;
+	}
+
+	for( auto& tex : aVirtual.textures )
+		std::fill( std::begin(tex.wanted), std::end(tex.wanted), kNotWanted );
+
+	// Tiles that have been let go of before the frames in flight, and that
+	// no region has taken up again since
+	lut::ArenaVector<TileUpload_> unbinds{ lut::ArenaAllocator<TileUpload_>( aArena ) };
+	while( !aVirtual.retired.empty() && aVirtual.frame >= aVirtual.retired.front().frame + aVirtual.framesInFlight + 1 )
+	{
+		auto const retired = aVirtual.retired.front();
+		aVirtual.retired.pop_front();
+
+		auto& lvl = aVirtual.textures[retired.texture].levels[retired.level];
+		if( 0 == lvl.refs[retired.tile] && VK_NULL_HANDLE != lvl.pages[retired.tile] )
+			unbinds.emplace_back( TileUpload_{ retired.texture, retired.level, retired.tile } );
+	}
+
+	if( uploads.empty() && unbinds.empty() && !tableChanged )
+		return;
+
+	// Binds, grouped by image
+	lut::ArenaVector<TileUpload_> changes( uploads.begin(), uploads.end(), lut::ArenaAllocator<TileUpload_>( aArena ) );
+	changes.insert( changes.end(), unbinds.begin(), unbinds.end() );
+	std::sort( changes.begin(), changes.end(), [] (TileUpload_ const& aA, TileUpload_ const& aB) {
+		return aA.texture < aB.texture;
+	} );
+
+	lut::ArenaVector<VkSparseImageMemoryBind> binds{ lut::ArenaAllocator<VkSparseImageMemoryBind>( aArena ) };
+	binds.reserve( changes.size() );
+	for( auto const& change : changes )
+	{
+		auto& tex = aVirtual.textures[change.texture];
+		auto& page = tex.levels[change.level].pages[change.tile];
+		if( 0 == tex.levels[change.level].refs[change.tile] )
+		{
+			binds.emplace_back( tile_bind_( tex, change.level, change.tile, nullptr ) );
+			freed.emplace_back( page );
+			page = VK_NULL_HANDLE;
+			--aVirtual.pages;
+		}
+		else
+		{
+			VmaAllocationInfo info{};
+			vmaGetAllocationInfo( aAllocator.allocator, page, &info );
+			binds.emplace_back( tile_bind_( tex, change.level, change.tile, &info ) );
+		}
+	}
+
+	lut::ArenaVector<VkSparseImageMemoryBindInfo> imageBinds{ lut::ArenaAllocator<VkSparseImageMemoryBindInfo>( aArena ) };
+	for( std::size_t i = 0; i < changes.size(); )
+	{
+		auto const texture = changes[i].texture;
+
+		VkSparseImageMemoryBindInfo info{};
+		info.image = aVirtual.textures[texture].image.handle;
+		info.pBinds = binds.data() + i;
+		for( ; i < changes.size() && changes[i].texture == texture; ++i )
+			++info.bindCount;
+		imageBinds.emplace_back( info );
+	}
+
+	if( !imageBinds.empty() )
+	{
+		VkBindSparseInfo bindInfo{};
+		bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+		bindInfo.imageBindCount = std::uint32_t(imageBinds.size());
+		bindInfo.pImageBinds = imageBinds.data();
+		bind_sparse_( aWindow, bindInfo );
+	}
+
+	for( auto const alloc : freed )
+		vmaFreeMemory( aAllocator.allocator, alloc );
+
+	if( uploads.empty() && !tableChanged )
+		return;
+
+	// Tile copies, then the table, ahead of the frame's commands (same
+	// queue, so the barriers order them against the frames on either side)
+	std::sort( uploads.begin(), uploads.end(), [] (TileUpload_ const& aA, TileUpload_ const& aB) {
+		return aA.texture < aB.texture;
+	} );
+
+	begin_upload_( aWindow, aVirtual );
+	for( std::size_t i = 0; i < uploads.size(); )
+	{
+		auto const texture = uploads[i].texture;
+		auto const& tex = aVirtual.textures[texture];
+		auto const range = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, tex.tailLevel, 0, 1 };
+
+		lut::image_barrier( aVirtual.cmdBuff, tex.image.handle,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			range );
+
+		for( ; i < uploads.size() && uploads[i].texture == texture; ++i )
+		{
+			auto const& upload = uploads[i];
+			auto const& lvl = tex.levels[upload.level];
+
+			VkBufferImageCopy copy{};
+			copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, upload.level, 0, 1 };
+			copy.imageOffset = tile_offset_( tex, lvl, upload.tile );
+			copy.imageExtent = tile_extent_( tex, lvl, copy.imageOffset );
+
+			auto const staging = aVirtual.staging->allocate( tile_bytes_( tex, copy.imageExtent ) );
+			copy_tile_( tex, upload.level, copy.imageOffset, copy.imageExtent, staging.data );
+			copy.bufferOffset = staging.offset;
+
+			vkCmdCopyBufferToImage( aVirtual.cmdBuff, staging.buffer, tex.image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy );
+		}
+
+		lut::image_barrier( aVirtual.cmdBuff, tex.image.handle,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			range );
+	}
+	if( tableChanged )
+		record_residency_( aVirtual.cmdBuff, aVirtual );
+	submit_upload_( aWindow, aVirtual );
+}
+
+void filter_streamed_textures( VirtualTextures& aVirtual, std::vector<lut::AsyncUploader::Completed>& aTextures )
+{
+	auto const keep = std::remove_if( aTextures.begin(), aTextures.end(), [&] (lut::AsyncUploader::Completed const& aDone) {
+		assert( aDone.id < aVirtual.virtualIndex.size() );
+		if( kNotVirtual != aVirtual.virtualIndex[aDone.id] )
+			return true;
+
+		auto const extent = std::max( aDone.width, aDone.height );
+		if( extent < aVirtual.installedExtent[aDone.id] )
+			return true;
+
+		aVirtual.installedExtent[aDone.id] = extent;
+		return false;
+	} );
+	aTextures.erase( keep, aTextures.end() );
+}
+
+void release_virtual_textures( VirtualTextures& aVirtual, lut::Allocator const& aAllocator )
+{
+	if( aVirtual.staging )
+		aVirtual.staging->wait_idle();
+
+	for( auto& tex : aVirtual.textures )
+	{
+		tex.image = SparseImage();
+
+		for( auto& level : tex.levels )
+		{
+			for( auto& page : level.pages )
+			{
+				if( VK_NULL_HANDLE != page )
+					vmaFreeMemory( aAllocator.allocator, std::exchange( page, VK_NULL_HANDLE ) );
+			}
+		}
+
+		if( VK_NULL_HANDLE != tex.tail )
+			vmaFreeMemory( aAllocator.allocator, std::exchange( tex.tail, VK_NULL_HANDLE ) );
+	}
+
+	aVirtual.textures.clear();
+	aVirtual.retired.clear();
+	aVirtual.pages = 0;
+}
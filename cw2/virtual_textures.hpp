@@ -0,0 +1,174 @@
+#ifndef VIRTUAL_TEXTURES_HPP_8D3B6E12_4C7A_4F95_B0E1_72A9C5D84F36
+#define VIRTUAL_TEXTURES_HPP_8D3B6E12_4C7A_4F95_B0E1_72A9C5D84F36
+
+// Virtual textures (--virtual-textures=on). Mip streaming (see
+// texture_streaming.hpp) keeps whole levels resident, so a texture that is
+// seen up close costs its full size even if only a corner of it is on
+// screen. Here, the large textures are sparse images instead
+// (VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT), whose mip tail is always resident
+// and whose other levels are bound tile by tile (one sparse block, typically
+// 64 KiB) from a pool of --texture-budget.
+//
+// Every texture is split into a grid of kVirtualRegions regions. The colour
+// pass records the finest footprint per region (see mip_feedback.glsl), and
+// from that the regions are refined or coarsened by a level at a time; a
+// region at level L has the tiles that cover it (plus a texel, for the
+// filter) bound on levels L and coarser. The tiles are copied from the
+// texture files through a staging ring, and the finest level of each region
+// goes to a residency table (binding 11 of the scene's set) that the shaders
+// clamp their sampling to (see virtual_textures.glsl). The device memory of
+// the textures thus follows what is on screen rather than the size of the
+// texture set.
+//
+// Tiles are bound with vkQueueBindSparse() on the graphics queue, and waited
+// for on the CPU before the copies are submitted. A region is coarsened by
+// raising its clamp first; its tiles are unbound once the frames that may
+// still sample them have completed.
+//
+// Only the baked texture files (see lut::load_texture_file()) of the
+// materials' colour, roughness/metalness and normal slots are virtual, in
+// formats that the device supports sparse residency for; alpha masks are
+// also read by the depth-only passes, which don't clamp. The files stay in
+// host memory, for the tile copies. The other textures are streamed in
+// whole.
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+#include <vk_mem_alloc.h>
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/frame_arena.hpp"
+#include "../labutils/staging_ring.hpp"
+#include "../labutils/async_uploader.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// Regions per texture; must match mip_feedback.glsl
+constexpr std::uint32_t kVirtualRegionGrid = 8;
+constexpr std::uint32_t kVirtualRegions = kVirtualRegionGrid * kVirtualRegionGrid;
+
+using SparseImage = lut::UniqueHandle< VkImage, VkDevice, vkDestroyImage >;
+
+// The tiles (sparse blocks) of one level below the mip tail
+struct VirtualLevel
+{
+	std::uint32_t width = 0, height = 0; // texels
+	std::uint32_t tilesX = 0, tilesY = 0;
+	std::vector<std::uint16_t> refs; // per tile: regions whose coverage includes it
+	std::vector<VmaAllocation> pages; // per tile: bound memory, null if not resident
+};
+
+struct VirtualTexture
+{
+	std::uint32_t id = 0; // into ModelPack::textures
+	SparseImage image; // SHADER_READ_ONLY_OPTIMAL between updates
+
+	VkExtent3D granularity{}; // of a tile, in texels
+	VkMemoryRequirements pageReqs{}; // of a tile's memory
+	std::uint32_t tailLevel = 0; // first level of the mip tail, always resident
+	VmaAllocation tail = VK_NULL_HANDLE; // mip tail (and metadata, if any)
+
+	lut::MipImageData data; // the file's levels
+	std::vector<VirtualLevel> levels; // [0, tailLevel)
+
+	std::uint8_t resident[kVirtualRegions]; // finest level bound, per region
+	std::uint8_t wanted[kVirtualRegions]; // finest level sampled since the last update
+	std::uint64_t lastSampled[kVirtualRegions]; // frame
+};
+
+struct VirtualTextures
+{
+	VkDeviceSize budget = 0; // bytes, for the tiles (tails excluded)
+	VkDeviceSize pageBytes = 0; // of a tile
+	std::size_t pages = 0; // bound tiles
+
+	lut::Buffer feedback; // kVirtualRegions footprints per texture of the model
+	std::vector<lut::Buffer> readbacks; // per frame in flight, host visible
+	std::vector<bool> readbackValid;
+	bool reset = false; // the feedback buffer has been reset once
+
+	lut::Buffer residency; // kVirtualRegions levels (uint32_t) per texture of the model
+	std::vector<std::uint32_t> hostResidency;
+
+	std::vector<VirtualTexture> textures;
+	std::vector<std::uint32_t> virtualIndex; // per texture of the model: into textures, or ~0u
+	std::vector<std::uint32_t> installedExtent; // per texture of the model: of the streamed image
+
+	// Tiles whose last region has let go of them, with the frame; unbound
+	// once the frames in flight then have completed
+	struct Retired
+	{
+		std::uint32_t texture, level, tile;
+		std::uint64_t frame;
+	};
+	std::deque<Retired> retired;
+
+	lut::CommandPool pool;
+	VkCommandBuffer cmdBuff = VK_NULL_HANDLE; // re-recorded by every update that uploads
+	std::unique_ptr<lut::StagingRing> staging; // tile copies and residency updates
+	VkFence lastUpload = VK_NULL_HANDLE; // the staging ring's, of cmdBuff's last submit
+
+	std::uint64_t frame = 0;
+	std::uint32_t framesInFlight = 0;
+};
+
+// True if the device can bind sparse 2D images on the graphics queue.
+bool supports_virtual_textures( lut::VulkanWindow const& );
+
+// For a model set up with an uploader: turns the textures described above
+// into sparse images (with their mip tails uploaded), and installs them into
+// the model's descriptors (see set_model_texture_views()). The other
+// textures are requested again in full. The feedback buffer goes to binding
+// 3 and the residency table to binding 11 of the scene's set. Throws
+// labutils::Error on failure.
+VirtualTextures create_virtual_textures(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	ModelPack&,
+	VkSampler,
+	lut::AsyncUploader&,
+	std::size_t aFramesInFlight,
+	VkDeviceSize aBudget
+);
+
+// Before the colour pass: moves the feedback of the previously submitted
+// frame to aFrame's readback, and resets it for this frame.
+void record_virtual_feedback( VkCommandBuffer, VirtualTextures&, std::uint32_t aFrame );
+
+// Once aFrame's commands have completed: gathers its readback, unbinds the
+// tiles that no frame in flight can sample any more, and every few frames
+// refines the regions that are sampled more finely than they are resident,
+// farthest first, as far as the budget allows, and coarsens the others.
+// Submits the tile copies and the residency table to the graphics queue,
+// ahead of the frame's commands. Scratch data comes from aArena.
+void update_virtual_textures(
+	VirtualTextures&,
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	std::uint32_t aFrame,
+	lut::FrameArena& aArena
+);
+
+// Call with the textures taken from the uploader, before passing them on to
+// update_model_textures(): drops the virtual ones (whose first versions were
+// requested by set_up_model()), and versions that are coarser than the one
+// already installed.
+void filter_streamed_textures( VirtualTextures&, std::vector<lut::AsyncUploader::Completed>& );
+
+// Waits for the uploads, and destroys the images and frees their memory;
+// call once the device is idle.
+void release_virtual_textures( VirtualTextures&, lut::Allocator const& );
+
+#endif // VIRTUAL_TEXTURES_HPP_8D3B6E12_4C7A_4F95_B0E1_72A9C5D84F36
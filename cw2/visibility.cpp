@@ -0,0 +1,190 @@
+#include "visibility.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#include <cstring>
+
+#include "deferred.hpp"
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/debug_utils.hpp"
+#include "../labutils/to_string.hpp"
+
+VisibilityBuffer create_visibility_buffer( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator )
+{
+	VisibilityBuffer ret;
+	create_transient_attachment( aWindow, aAllocator, kVisibilityFormat, ret.ids, ret.idsView );
+	lut::set_name( aWindow, ret.ids, "visibility ids" );
+	return ret;
+}
+
+bool fits_visibility_ids( ModelPack const& aModel )
+{
+	// Mesh index + 1 must fit; 0 is empty
+	if( aModel.meshes.size() >= (std::size_t(1) << kVisibilityMeshBits) )
+		return false;
+
+	return std::all_of( aModel.meshes.begin(), aModel.meshes.end(), [] (Mesh const& aMesh) {
+		return aMesh.indexCount / 3 <= (std::uint32_t(1) << kVisibilityPrimitiveBits);
+	} );
+}
+
+VisibilityShading create_visibility_shading( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, lut::DescriptorAllocator& aDescriptors, VkDescriptorSetLayout aSceneLayout, VkDescriptorSetLayout aBindlessLayout, ModelPack const& aModel )
+{
+	VisibilityShading ret;
+
+	// Descriptor set layout
+	{
+		VkDescriptorSetLayoutBinding bindings[4]{};
+		for( std::uint32_t i = 0; i < 4; ++i )
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = 0 == i ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorSetLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create visibility descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.layout = lut::DescriptorSetLayout( aWindow.device, layout );
+	}
+
+	// Pipeline layout
+	{
+		VkDescriptorSetLayout const layouts[] = { aSceneLayout, aBindlessLayout, ret.layout.handle };
+
+		VkPushConstantRange range{};
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		range.offset = 0;
+		range.size = sizeof(VisibilityPushConstants);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
+		layoutInfo.pSetLayouts = layouts;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &range;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineLayout( aWindow.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+			throw lut::Error( "Unable to create visibility pipeline layout\n" "vkCreatePipelineLayout() returned %s", lut::to_string(res).c_str() );
+
+		ret.pipeLayout = lut::PipelineLayout( aWindow.device, layout );
+	}
+
+	// Mesh table; written once, so it stays in host-visible memory
+	{
+		std::uint32_t const indices32Base = std::uint32_t(aModel.indices32Offset / sizeof(std::uint32_t));
+
+		std::vector<VisibilityMesh> meshes;
+		meshes.reserve( aModel.meshes.size() );
+		for( auto const& mesh : aModel.meshes )
+		{
+			bool const index16 = VK_INDEX_TYPE_UINT16 == mesh.indexType;
+
+			VisibilityMesh entry{};
+			entry.firstIndex = index16 ? mesh.firstIndex : indices32Base + mesh.firstIndex;
+			entry.vertexOffset = mesh.vertexOffset;
+			entry.index16 = index16 ? 1 : 0;
+			entry.material = mesh.matID;
+			meshes.emplace_back( entry );
+		}
+
+		VkDeviceSize const bytes = std::max<VkDeviceSize>( 1, meshes.size() ) * sizeof(VisibilityMesh);
+		ret.meshes = lut::create_buffer( aAllocator, bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lut::EMemoryClass::upload );
+
+		if( !meshes.empty() )
+		{
+			void* ptr = nullptr;
+			if( auto const res = vmaMapMemory( aAllocator.allocator, ret.meshes.allocation, &ptr ); VK_SUCCESS != res )
+				throw lut::Error( "Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str() );
+
+			std::memcpy( ptr, meshes.data(), meshes.size() * sizeof(VisibilityMesh) );
+
+			vmaFlushAllocation( aAllocator.allocator, ret.meshes.allocation, 0, VK_WHOLE_SIZE );
+			vmaUnmapMemory( aAllocator.allocator, ret.meshes.allocation );
+		}
+	}
+
+	ret.descriptors = aDescriptors.allocate( ret.layout.handle );
+
+	// The visibility buffer is written by update_visibility_descriptors()
+	update_visibility_geometry( aWindow, ret, aModel );
+
+	return ret;
+}
+
+void update_visibility_geometry( lut::VulkanWindow const& aWindow, VisibilityShading& aShading, ModelPack const& aModel )
+{
+	VkDescriptorBufferInfo bufferInfo[3]{};
+	bufferInfo[0].buffer = aShading.meshes.buffer;
+	bufferInfo[0].range = VK_WHOLE_SIZE;
+	bufferInfo[1].buffer = aModel.vertices.buffer;
+	bufferInfo[1].range = VK_WHOLE_SIZE;
+	bufferInfo[2].buffer = aModel.indices.buffer;
+	bufferInfo[2].range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet desc[3]{};
+	for( std::uint32_t i = 0; i < 3; ++i )
+	{
+		desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[i].dstSet = aShading.descriptors;
+		desc[i].dstBinding = 1 + i;
+		desc[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		desc[i].descriptorCount = 1;
+		desc[i].pBufferInfo = &bufferInfo[i];
+	}
+
+	vkUpdateDescriptorSets( aWindow.device, sizeof(desc) / sizeof(desc[0]), desc, 0, nullptr );
+}
+
+void update_visibility_descriptors( lut::VulkanWindow const& aWindow, VisibilityShading& aShading, VisibilityBuffer const& aBuffer )
+{
+	// Layout as in subpass 1 of the render pass
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageView = aBuffer.idsView.handle;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet desc{};
+	desc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	desc.dstSet = aShading.descriptors;
+	desc.dstBinding = 0;
+	desc.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	desc.descriptorCount = 1;
+	desc.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets( aWindow.device, 1, &desc, 0, nullptr );
+}
+
+void record_visibility_shading( VkCommandBuffer aCmdBuff, VisibilityShading const& aShading, VkPipeline aPipe, VkExtent2D const& aImageExtent, VkDescriptorSet aSceneDescriptors, std::uint32_t aSceneOffset, VkDescriptorSet aBindlessDescriptors )
+{
+	VkViewport viewport{};
+	viewport.width = float(aImageExtent.width);
+	viewport.height = float(aImageExtent.height);
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+	vkCmdSetViewport( aCmdBuff, 0, 1, &viewport );
+
+	VkRect2D const scissor{ VkOffset2D{ 0, 0 }, aImageExtent };
+	vkCmdSetScissor( aCmdBuff, 0, 1, &scissor );
+
+	vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aPipe );
+
+	VkDescriptorSet const sets[] = { aSceneDescriptors, aBindlessDescriptors, aShading.descriptors };
+	vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aShading.pipeLayout.handle, 0, 3, sets, 1, &aSceneOffset );
+
+	VisibilityPushConstants push{};
+	push.extent = glm::vec2( float(aImageExtent.width), float(aImageExtent.height) );
+	vkCmdPushConstants( aCmdBuff, aShading.pipeLayout.handle, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push );
+
+	vkCmdDraw( aCmdBuff, 3, 1, 0, 0 );
+}
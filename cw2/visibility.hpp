@@ -0,0 +1,126 @@
+#ifndef VISIBILITY_HPP_F8187D61_F5A5_43A1_B279_2A67DDB302FD
+#define VISIBILITY_HPP_F8187D61_F5A5_43A1_B279_2A67DDB302FD
+
+// Visibility buffer rendering (--lighting=visibility). Like deferred shading
+// (see deferred.hpp), the render pass has two subpasses. The first draws the
+// scene, but only writes a 32-bit triangle ID per pixel (visibility*.frag).
+// The second, the material pass (visibility_shade*.frag), runs once per
+// pixel: it fetches the triangle's indices and vertices from the model's
+// buffers, computes the pixel's barycentrics (and their screen-space
+// derivatives, for texture filtering), and then samples the bindless material
+// and shades. The expensive shader thus never runs for hidden fragments, and
+// never for the helper lanes of partially covered quads.
+//
+// Triangle IDs (see cw2/shaders/visibility.glsl): the mesh index plus one in
+// the upper kVisibilityMeshBits, the triangle within the mesh
+// (gl_PrimitiveID) in the rest; 0 is empty. The draws pass the mesh index as
+// firstInstance (see set_up_model()'s aMeshInstances), and draw whole meshes
+// at full detail, so that gl_PrimitiveID counts from the mesh's first index.
+//
+// Attachment 2 is the visibility buffer; 0 is the swapchain image and 1 the
+// depth buffer. Needs bindless materials and fp32 vertices.
+
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec2.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/descriptor_allocator.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+constexpr VkFormat kVisibilityFormat = VK_FORMAT_R32_UINT;
+
+// Must match cw2/shaders/visibility.glsl
+constexpr std::uint32_t kVisibilityMeshBits = 12;
+constexpr std::uint32_t kVisibilityPrimitiveBits = 32 - kVisibilityMeshBits;
+
+struct VisibilityBuffer
+{
+	lut::Image ids;
+	lut::ImageView idsView;
+};
+
+// Image for the current swapchain size
+VisibilityBuffer create_visibility_buffer( lut::VulkanWindow const&, lut::Allocator const& );
+
+// True if the model's meshes (and their triangles) fit the triangle IDs
+bool fits_visibility_ids( ModelPack const& );
+
+// VisibilityMesh in cw2/shaders/visibility.glsl, one per mesh. firstIndex is
+// in units of the mesh's index type, from the start of ModelPack::indices.
+struct VisibilityMesh
+{
+	std::uint32_t firstIndex;
+	std::int32_t vertexOffset;
+	std::uint32_t index16; // 1: uint16 indices
+	std::uint32_t material;
+};
+
+// PShade in visibility_shade_frag.glsl
+struct VisibilityPushConstants
+{
+	glm::vec2 extent; // framebuffer size
+};
+
+struct VisibilityShading
+{
+	// Set 2: the visibility buffer (input attachment, binding 0), and the
+	// VisibilityMesh table, vertices and indices (storage buffers, bindings
+	// 1-3). Set 0 is the scene's, set 1 the bindless materials.
+	lut::DescriptorSetLayout layout;
+	lut::PipelineLayout pipeLayout;
+
+	lut::Buffer meshes; // VisibilityMesh[]
+
+	VkDescriptorSet descriptors = VK_NULL_HANDLE;
+};
+
+// aModel must have been set up with aMeshInstances and fp32 vertices
+VisibilityShading create_visibility_shading(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	lut::DescriptorAllocator&,
+	VkDescriptorSetLayout aSceneLayout,
+	VkDescriptorSetLayout aBindlessLayout,
+	ModelPack const& aModel
+);
+
+// Points the set at the model's vertex and index buffers again, after they
+// have been moved (see lut::Defragmenter). The set must not be in use by the
+// GPU.
+void update_visibility_geometry(
+	lut::VulkanWindow const&,
+	VisibilityShading&,
+	ModelPack const&
+);
+
+// Points the input attachment at the (current) visibility buffer. The set
+// must not be in use by the GPU.
+void update_visibility_descriptors(
+	lut::VulkanWindow const&,
+	VisibilityShading&,
+	VisibilityBuffer const&
+);
+
+// Records the material pass; the render pass must be in subpass 1. The
+// pipeline is create_deferred_pipeline()'s, with VisibilityShading's layout.
+void record_visibility_shading(
+	VkCommandBuffer,
+	VisibilityShading const&,
+	VkPipeline,
+	VkExtent2D const& aImageExtent,
+	VkDescriptorSet aSceneDescriptors,
+	std::uint32_t aSceneOffset,
+	VkDescriptorSet aBindlessDescriptors
+);
+
+#endif // VISIBILITY_HPP_F8187D61_F5A5_43A1_B279_2A67DDB302FD
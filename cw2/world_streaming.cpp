@@ -0,0 +1,440 @@
+#include "world_streaming.hpp"
+
+#include <map>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/cpu_zones.hpp"
+#include "../labutils/debug_utils.hpp"
+
+#include "quantized_vertex.hpp"
+#include "interleaved_vertex.hpp"
+
+namespace
+{
+	constexpr std::uint32_t kNoRange_ = std::numeric_limits<std::uint32_t>::max();
+
+	// Staging offsets are kept at this alignment
+	constexpr VkDeviceSize kStagingAlign_ = 16;
+
+	StreamPool make_pool_( std::uint32_t aCapacity );
+
+	// First fit; kNoRange_ if no free range is large enough
+	std::uint32_t pool_allocate_( StreamPool&, std::uint32_t aCount );
+	void pool_release_( StreamPool&, std::uint32_t aOffset, std::uint32_t aCount );
+
+	VkDeviceSize align_( VkDeviceSize aValue )
+	{
+		return (aValue + kStagingAlign_ - 1) & ~(kStagingAlign_ - 1);
+	}
+
+	float distance_( glm::vec3 const& aPoint, StreamCell const& aCell )
+	{
+		glm::vec3 const d = glm::max( glm::max( aCell.aabbMin - aPoint, aPoint - aCell.aabbMax ), glm::vec3( 0.f ) );
+		return glm::length( d );
+	}
+
+	bool small_( Mesh const& aMesh )
+	{
+		return VK_INDEX_TYPE_UINT16 == aMesh.indexType;
+	}
+
+	// Bytes of a mesh in the staging buffer
+	VkDeviceSize staging_bytes_( WorldStreaming const&, Mesh const&, StreamedMesh const& );
+}
+
+WorldStreaming create_world_streaming( lut::VulkanWindow const& aWindow, lut::Allocator const& aAllocator, ModelPack& aModel, MappedBakedModel aSource, float aCellSize, VkDeviceSize aBudget, std::size_t aFramesInFlight )
+{
+	LUT_CPU_ZONE( "create_world_streaming()" );
+
+	if( aCellSize <= 0.f )
+		throw lut::Error( "create_world_streaming(): cell size must be positive" );
+	if( aSource.meshes.size() != aModel.meshes.size() )
+		throw lut::Error( "create_world_streaming(): the model has %zu meshes, its file %zu", aModel.meshes.size(), aSource.meshes.size() );
+	if( !aModel.meshlets.empty() )
+		throw lut::Error( "create_world_streaming(): models with meshlets can't be streamed" );
+	if( VK_NULL_HANDLE != aModel.vertices.buffer || VK_NULL_HANDLE != aModel.indices.buffer )
+		throw lut::Error( "create_world_streaming(): the model's geometry is already uploaded" );
+	if( aModel.hostDrawCommands.empty() )
+		throw lut::Error( "create_world_streaming(): the model has no geometry" );
+
+	WorldStreaming ret;
+	ret.source = std::move(aSource);
+	ret.cellSize = aCellSize;
+	ret.vertexSize = aModel.quantizedVertices ? sizeof(QuantizedVertex) : sizeof(InterleavedVertex);
+
+	// Cells, by the centre of each mesh's bounds (x and z)
+	std::map<std::pair<std::int64_t, std::int64_t>, std::uint32_t> cellIds;
+	std::uint64_t totalVertices = 0, totalIndices16 = 0, totalIndices32 = 0;
+	VkDeviceSize largestMesh = 0;
+
+	ret.meshes.resize( aModel.meshes.size() );
+	for( std::size_t m = 0; m < aModel.meshes.size(); ++m )
+	{
+		auto const& mesh = aModel.meshes[m];
+		auto& streamed = ret.meshes[m];
+
+		glm::vec3 const centre = 0.5f * (mesh.aabbMin + mesh.aabbMax);
+		auto const key = std::make_pair( std::int64_t(std::floor( centre.x / aCellSize )), std::int64_t(std::floor( centre.z / aCellSize )) );
+		auto const [it, added] = cellIds.emplace( key, std::uint32_t(ret.cells.size()) );
+		if( added )
+		{
+			auto& cell = ret.cells.emplace_back();
+			cell.aabbMin = mesh.aabbMin;
+			cell.aabbMax = mesh.aabbMax;
+		}
+
+		auto& cell = ret.cells[it->second];
+		cell.aabbMin = glm::min( cell.aabbMin, mesh.aabbMin );
+		cell.aabbMax = glm::max( cell.aabbMax, mesh.aabbMax );
+		cell.meshes.emplace_back( std::uint32_t(m) );
+		streamed.cell = it->second;
+
+		// The LODs follow the full-detail indices (see set_up_model())
+		streamed.indexSpan = mesh.indexCount;
+		for( std::uint32_t i = 0; i < mesh.lodCount; ++i )
+		{
+			streamed.lodOffsets[i] = mesh.lods[i].firstIndex - mesh.firstIndex;
+			streamed.indexSpan = std::max( streamed.indexSpan, streamed.lodOffsets[i] + mesh.lods[i].indexCount );
+		}
+
+		cell.vertices += mesh.vertexCount;
+		(small_( mesh ) ? cell.indices16 : cell.indices32) += streamed.indexSpan;
+		totalVertices += mesh.vertexCount;
+		(small_( mesh ) ? totalIndices16 : totalIndices32) += streamed.indexSpan;
+
+		largestMesh = std::max( largestMesh, staging_bytes_( ret, mesh, streamed ) );
+	}
+
+	// Pools: the whole model if it fits the budget; otherwise, the budget in
+	// the proportions of the model
+	VkDeviceSize const vertexBytes = totalVertices * ret.vertexSize;
+	VkDeviceSize const index16Bytes = totalIndices16 * sizeof(std::uint16_t);
+	VkDeviceSize const index32Bytes = totalIndices32 * sizeof(std::uint32_t);
+	VkDeviceSize const totalBytes = vertexBytes + index16Bytes + index32Bytes;
+
+	double const scale = totalBytes > aBudget ? double(aBudget) / double(totalBytes) : 1.0;
+	auto const capacity_ = [&] (std::uint64_t aElements) {
+		return std::uint32_t(std::min<double>( std::floor( double(aElements) * scale ), std::numeric_limits<std::uint32_t>::max() ));
+	};
+
+	ret.vertexPool = make_pool_( capacity_( totalVertices ) );
+	ret.index16Pool = make_pool_( capacity_( totalIndices16 ) );
+	ret.index32Pool = make_pool_( capacity_( totalIndices32 ) );
+
+	// The uint32 part must start at a multiple of 4 bytes. Buffers can't be
+	// empty.
+	aModel.indices32Offset = (VkDeviceSize(ret.index16Pool.capacity) * sizeof(std::uint16_t) + 3) & ~VkDeviceSize(3);
+	VkDeviceSize const vertexPoolBytes = std::max<VkDeviceSize>( VkDeviceSize(ret.vertexPool.capacity) * ret.vertexSize, 4 );
+	VkDeviceSize const indexPoolBytes = std::max<VkDeviceSize>( aModel.indices32Offset + VkDeviceSize(ret.index32Pool.capacity) * sizeof(std::uint32_t), 4 );
+
+	// TRANSFER_SRC lets lut::Defragmenter move them
+	VkBufferUsageFlags const copyUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	aModel.vertices = lut::create_buffer( aAllocator, vertexPoolBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry );
+	aModel.indices = lut::create_buffer( aAllocator, indexPoolBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | copyUsage, lut::EMemoryClass::geometry );
+	lut::set_name( aWindow, aModel.vertices, "model vertices (streamed)" );
+	lut::set_name( aWindow, aModel.indices, "model indices (streamed)" );
+
+	// Loads, then the draw commands
+	VkDeviceSize const commandBytes = aModel.hostDrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+	ret.commandsOffset = align_( std::max( kWorldStreamBytesPerFrame, largestMesh ) );
+	ret.stagingSize = ret.commandsOffset + commandBytes;
+	for( std::size_t i = 0; i < aFramesInFlight; ++i )
+	{
+		ret.staging.emplace_back( lut::create_buffer( aAllocator, ret.stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, lut::EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT ) );
+		lut::set_name( aWindow, ret.staging.back(), "world streaming staging" );
+	}
+
+	// Nothing is resident yet
+	for( auto& cmd : aModel.hostDrawCommands )
+		cmd.instanceCount = 0;
+
+	std::fprintf( stderr, "Info: streaming %zu meshes in %zu cells of %g units; %.1f of %.1f MiB of geometry resident at most\n",
+		ret.meshes.size(), ret.cells.size(), double(aCellSize),
+		double(vertexPoolBytes + indexPoolBytes) / (1024.0 * 1024.0), double(totalBytes) / (1024.0 * 1024.0) );
+
+	return ret;
+}
+
+bool update_world_streaming( WorldStreaming& aWorld, lut::Allocator const& aAllocator, ModelPack& aModel, glm::vec3 const& aCamera, float aDt, std::uint32_t aFrame )
+{
+	LUT_CPU_ZONE( "update_world_streaming()" );
+
+	assert( aFrame < aWorld.staging.size() );
+	aWorld.vertexCopies.clear();
+	aWorld.indexCopies.clear();
+
+	// Smoothed velocity, and where it leads
+	if( aWorld.haveCamera && aDt > 0.f )
+		aWorld.velocity = glm::mix( aWorld.velocity, (aCamera - aWorld.camera) / aDt, 0.25f );
+	aWorld.camera = aCamera;
+	aWorld.haveCamera = true;
+	glm::vec3 const ahead = aCamera + aWorld.velocity * kWorldStreamLookahead;
+
+	// Cells by priority
+	std::vector<float> priority( aWorld.cells.size() );
+	for( std::size_t c = 0; c < aWorld.cells.size(); ++c )
+		priority[c] = std::min( distance_( aCamera, aWorld.cells[c] ), distance_( ahead, aWorld.cells[c] ) );
+
+	std::vector<std::uint32_t> order( aWorld.cells.size() );
+	std::iota( order.begin(), order.end(), 0u );
+	std::stable_sort( order.begin(), order.end(), [&] (std::uint32_t aA, std::uint32_t aB) {
+		return priority[aA] < priority[aB];
+	} );
+
+	// The nearest cells that fit the pools together
+	std::vector<std::uint8_t> wanted( aWorld.cells.size(), 0 );
+	std::size_t wantedCount = 0;
+	{
+		std::uint64_t vertices = 0, indices16 = 0, indices32 = 0;
+		for( auto const c : order )
+		{
+			auto const& cell = aWorld.cells[c];
+			vertices += cell.vertices;
+			indices16 += cell.indices16;
+			indices32 += cell.indices32;
+			if( vertices > aWorld.vertexPool.capacity || indices16 > aWorld.index16Pool.capacity || indices32 > aWorld.index32Pool.capacity )
+				break;
+
+			wanted[c] = 1;
+			++wantedCount;
+		}
+	}
+
+	bool changed = false;
+
+	// Evict first, so that the loads can reuse the ranges
+	for( std::size_t c = 0; c < aWorld.cells.size(); ++c )
+	{
+		auto& cell = aWorld.cells[c];
+		if( wanted[c] || 0 == cell.loaded )
+			continue;
+
+		for( auto const m : cell.meshes )
+		{
+			auto& streamed = aWorld.meshes[m];
+			if( !streamed.resident )
+				continue;
+
+			// A resident mesh's offsets are its ranges
+			auto const& mesh = aModel.meshes[m];
+			if( mesh.vertexCount > 0 && streamed.indexSpan > 0 )
+			{
+				pool_release_( aWorld.vertexPool, std::uint32_t(mesh.vertexOffset), mesh.vertexCount );
+				pool_release_( small_( mesh ) ? aWorld.index16Pool : aWorld.index32Pool, mesh.firstIndex, streamed.indexSpan );
+				aWorld.residentBytes -= VkDeviceSize(mesh.vertexCount) * aWorld.vertexSize + VkDeviceSize(streamed.indexSpan) * (small_( mesh ) ? 2 : 4);
+			}
+			streamed.resident = false;
+		}
+
+		cell.loaded = 0;
+		++aWorld.cellEvictions;
+		changed = true;
+	}
+
+	// Load, nearest first, within the frame's bandwidth
+	auto* const staging = reinterpret_cast<std::uint8_t*>( lut::mapped_data( aAllocator, aWorld.staging[aFrame] ) );
+	VkDeviceSize cursor = 0;
+	bool full = false;
+	for( std::size_t i = 0; i < wantedCount && !full; ++i )
+	{
+		auto& cell = aWorld.cells[order[i]];
+		if( cell.loaded == cell.meshes.size() )
+			continue;
+
+		for( auto const m : cell.meshes )
+		{
+			auto& streamed = aWorld.meshes[m];
+			if( streamed.resident )
+				continue;
+
+			auto& mesh = aModel.meshes[m];
+			if( 0 == mesh.vertexCount || 0 == streamed.indexSpan )
+			{
+				streamed.resident = true;
+				++cell.loaded;
+				continue;
+			}
+
+			VkDeviceSize const bytes = staging_bytes_( aWorld, mesh, streamed );
+			if( cursor > 0 && cursor + bytes > kWorldStreamBytesPerFrame )
+			{
+				full = true;
+				break;
+			}
+
+			// A fragmented pool may be out of ranges even though the cell
+			// fits; the next eviction may free some
+			auto& indexPool = small_( mesh ) ? aWorld.index16Pool : aWorld.index32Pool;
+			std::uint32_t const vertex = pool_allocate_( aWorld.vertexPool, mesh.vertexCount );
+			std::uint32_t const index = kNoRange_ != vertex ? pool_allocate_( indexPool, streamed.indexSpan ) : kNoRange_;
+			if( kNoRange_ == index )
+			{
+				if( kNoRange_ != vertex )
+					pool_release_( aWorld.vertexPool, vertex, mesh.vertexCount );
+				full = true;
+				break;
+			}
+
+			VkDeviceSize const vertexBytes = VkDeviceSize(mesh.vertexCount) * aWorld.vertexSize;
+			VkDeviceSize const indexSize = small_( mesh ) ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+			VkDeviceSize const indexStart = cursor + align_( vertexBytes );
+			write_model_mesh( aWorld.source, aModel, m, staging + cursor, staging + indexStart );
+
+			aWorld.vertexCopies.emplace_back( VkBufferCopy{ cursor, VkDeviceSize(vertex) * aWorld.vertexSize, vertexBytes } );
+			aWorld.indexCopies.emplace_back( VkBufferCopy{ indexStart,
+				(small_( mesh ) ? 0 : aModel.indices32Offset) + VkDeviceSize(index) * indexSize,
+				VkDeviceSize(streamed.indexSpan) * indexSize } );
+			cursor += bytes;
+
+			// Point the mesh (and its LODs) at its ranges
+			mesh.firstIndex = index;
+			mesh.vertexOffset = std::int32_t(vertex);
+			for( std::uint32_t l = 0; l < mesh.lodCount; ++l )
+				mesh.lods[l].firstIndex = index + streamed.lodOffsets[l];
+
+			streamed.resident = true;
+			aWorld.residentBytes += vertexBytes + VkDeviceSize(streamed.indexSpan) * indexSize;
+			changed = true;
+
+			if( ++cell.loaded == cell.meshes.size() )
+				++aWorld.cellLoads;
+		}
+	}
+
+	// The commands of resident meshes draw them, the others nothing
+	if( changed || aWorld.commandsChanged )
+	{
+		for( std::size_t c = 0; c < aModel.hostDrawCommands.size(); ++c )
+		{
+			auto const m = aModel.drawCommandMeshes[c];
+			auto const& mesh = aModel.meshes[m];
+			auto& cmd = aModel.hostDrawCommands[c];
+			cmd.firstIndex = mesh.firstIndex;
+			cmd.vertexOffset = mesh.vertexOffset;
+			cmd.instanceCount = aWorld.meshes[m].resident ? aModel.instanceCount : 0;
+		}
+
+		std::memcpy( staging + aWorld.commandsOffset, aModel.hostDrawCommands.data(), aModel.hostDrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand) );
+		aWorld.commandsChanged = true;
+	}
+
+	vmaFlushAllocation( aAllocator.allocator, aWorld.staging[aFrame].allocation, 0, VK_WHOLE_SIZE );
+	return changed;
+}
+
+void record_world_streaming( VkCommandBuffer aCmdBuff, WorldStreaming& aWorld, ModelPack const& aModel, std::uint32_t aFrame )
+{
+	if( aWorld.vertexCopies.empty() && aWorld.indexCopies.empty() && !aWorld.commandsChanged )
+		return;
+
+	assert( aFrame < aWorld.staging.size() );
+	VkBuffer const staging = aWorld.staging[aFrame].buffer;
+
+	// The ranges (and commands) may have been in use by earlier frames
+	VkMemoryBarrier before{};
+	before.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	before.srcAccessMask = 0;
+	before.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier( aCmdBuff, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &before, 0, nullptr, 0, nullptr );
+
+	if( !aWorld.vertexCopies.empty() )
+		vkCmdCopyBuffer( aCmdBuff, staging, aModel.vertices.buffer, std::uint32_t(aWorld.vertexCopies.size()), aWorld.vertexCopies.data() );
+	if( !aWorld.indexCopies.empty() )
+		vkCmdCopyBuffer( aCmdBuff, staging, aModel.indices.buffer, std::uint32_t(aWorld.indexCopies.size()), aWorld.indexCopies.data() );
+	if( aWorld.commandsChanged )
+	{
+		VkBufferCopy const copy{ aWorld.commandsOffset, 0, aModel.hostDrawCommands.size() * sizeof(VkDrawIndexedIndirectCommand) };
+		vkCmdCopyBuffer( aCmdBuff, staging, aModel.drawCommands.buffer, 1, &copy );
+	}
+
+	VkMemoryBarrier after{};
+	after.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	after.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	after.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier( aCmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &after, 0, nullptr, 0, nullptr );
+
+	aWorld.vertexCopies.clear();
+	aWorld.indexCopies.clear();
+	aWorld.commandsChanged = false;
+}
+
+void mask_streamed_meshes( WorldStreaming const& aWorld, std::vector<std::uint8_t>& aVisible )
+{
+	assert( aVisible.size() == aWorld.meshes.size() );
+	for( std::size_t m = 0; m < aWorld.meshes.size(); ++m )
+	{
+		if( !aWorld.meshes[m].resident )
+			aVisible[m] = 0;
+	}
+}
+
+namespace
+{
+	StreamPool make_pool_( std::uint32_t aCapacity )
+	{
+		StreamPool ret;
+		ret.capacity = aCapacity;
+		if( aCapacity > 0 )
+			ret.free.emplace_back( 0u, aCapacity );
+		return ret;
+	}
+
+	std::uint32_t pool_allocate_( StreamPool& aPool, std::uint32_t aCount )
+	{
+		for( auto it = aPool.free.begin(); aPool.free.end() != it; ++it )
+		{
+			if( it->second < aCount )
+				continue;
+
+			std::uint32_t const offset = it->first;
+			it->first += aCount;
+			it->second -= aCount;
+			if( 0 == it->second )
+				aPool.free.erase( it );
+			return offset;
+		}
+
+		return kNoRange_;
+	}
+
+	void pool_release_( StreamPool& aPool, std::uint32_t aOffset, std::uint32_t aCount )
+	{
+		auto it = std::lower_bound( aPool.free.begin(), aPool.free.end(), std::make_pair( aOffset, 0u ) );
+		it = aPool.free.insert( it, std::make_pair( aOffset, aCount ) );
+
+		// Coalesce with the next range, then with the previous one
+		if( auto next = it + 1; aPool.free.end() != next && it->first + it->second == next->first )
+		{
+			it->second += next->second;
+			aPool.free.erase( next );
+		}
+		if( aPool.free.begin() != it )
+		{
+			auto prev = it - 1;
+			if( prev->first + prev->second == it->first )
+			{
+				prev->second += it->second;
+				aPool.free.erase( it );
+			}
+		}
+	}
+
+	VkDeviceSize staging_bytes_( WorldStreaming const& aWorld, Mesh const& aMesh, StreamedMesh const& aStreamed )
+	{
+		VkDeviceSize const indexSize = small_( aMesh ) ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+		return align_( VkDeviceSize(aMesh.vertexCount) * aWorld.vertexSize ) + align_( VkDeviceSize(aStreamed.indexSpan) * indexSize );
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef WORLD_STREAMING_HPP_E63B0A97_41D2_4C8F_9A15_7F2C8D04B6E1
+#define WORLD_STREAMING_HPP_E63B0A97_41D2_4C8F_9A15_7F2C8D04B6E1
+
+// World-space streaming of the model's geometry (--stream-cells=SIZE), for
+// scenes too large to upload up front. The meshes are binned into the cells
+// of a grid on the xz plane, by the centres of their bounds; cw2-bake
+// --cell-size=SIZE splits the meshes at the same grid, and stores each
+// cell's meshes together. Only the cells around the camera are resident.
+//
+// The model is set up with aStreamedGeometry (see set_up_model()): Mesh and
+// the draw commands are laid out for the whole model, but there are no
+// vertex and index buffers. Here, ModelPack::vertices and indices become
+// pools of a fixed size (the budget). A mesh that is loaded gets a range of
+// each pool, and its Mesh (LODs included) and draw commands are pointed at
+// them. The commands of the other meshes draw nothing (instanceCount 0).
+//
+// Each frame, the cells are ranked by their distance to the camera, or to
+// where the camera will be in kWorldStreamLookahead seconds at its current
+// velocity, whichever is closer. The nearest cells that fit the pools are
+// wanted. Resident cells that are no longer wanted are evicted; wanted
+// cells are loaded nearest first, mesh by mesh, at most
+// kWorldStreamBytesPerFrame per frame. Meshes are read from the mapped file
+// (and decompressed) into the frame's staging buffer, and copied at the
+// start of the frame. The copies wait for the draws of earlier frames, so
+// the ranges of evicted meshes can be reused at once.
+
+#include <vector>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include <glm/vec3.hpp>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/vulkan_window.hpp"
+
+#include "baked_model.hpp"
+#include "load_data_to_vk.h"
+
+namespace lut = labutils;
+
+// Upload bandwidth: bytes of geometry loaded per frame (a single mesh may
+// exceed it)
+constexpr VkDeviceSize kWorldStreamBytesPerFrame = VkDeviceSize(8) << 20;
+
+// Seconds of camera motion that the ranking looks ahead
+constexpr float kWorldStreamLookahead = 1.f;
+
+// First-fit sub-allocator of a pool, in elements (vertices or indices)
+struct StreamPool
+{
+	std::uint32_t capacity = 0;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> free; // offset, count; sorted and coalesced
+};
+
+struct StreamCell
+{
+	glm::vec3 aabbMin{ 0.f }, aabbMax{ 0.f }; // of its meshes
+	std::vector<std::uint32_t> meshes;
+
+	// Elements of the cell in each pool
+	std::uint64_t vertices = 0, indices16 = 0, indices32 = 0;
+
+	std::uint32_t loaded = 0; // meshes resident
+};
+
+struct StreamedMesh
+{
+	std::uint32_t cell = 0;
+	std::uint32_t indexSpan = 0; // indices, LODs included
+	std::uint32_t lodOffsets[kMaxMeshLods]{}; // of Mesh::lods, from firstIndex
+	bool resident = false;
+};
+
+struct WorldStreaming
+{
+	MappedBakedModel source; // the meshes are read on demand
+	float cellSize = 0.f;
+
+	std::vector<StreamCell> cells;
+	std::vector<StreamedMesh> meshes; // ModelPack::meshes
+
+	VkDeviceSize vertexSize = 0;
+	StreamPool vertexPool, index16Pool, index32Pool;
+
+	// Per frame in flight, host visible; the loads and commands of the
+	// frame's update
+	std::vector<lut::Buffer> staging;
+	VkDeviceSize stagingSize = 0;
+
+	// Of the last update, for record_world_streaming()
+	std::vector<VkBufferCopy> vertexCopies, indexCopies;
+	bool commandsChanged = true; // the initial commands draw nothing
+	VkDeviceSize commandsOffset = 0; // in the staging buffer
+
+	glm::vec3 camera{ 0.f }, velocity{ 0.f };
+	bool haveCamera = false;
+
+	VkDeviceSize residentBytes = 0;
+	std::uint64_t cellLoads = 0, cellEvictions = 0;
+};
+
+// Takes over aSource, the file that aModel was set up from with
+// aStreamedGeometry, and creates aModel's vertex and index buffers as pools
+// of at most aBudget bytes. Meshes that don't fit the pools on their own are
+// never loaded. Throws labutils::Error on failure.
+WorldStreaming create_world_streaming(
+	lut::VulkanWindow const&,
+	lut::Allocator const&,
+	ModelPack& aModel,
+	MappedBakedModel aSource,
+	float aCellSize,
+	VkDeviceSize aBudget,
+	std::size_t aFramesInFlight
+);
+
+// Once aFrame's previous use has completed: ranks the cells for the camera
+// at aCamera, evicts and loads meshes into aFrame's staging buffer, and
+// updates aModel's meshes and host draw commands. Returns true if meshes
+// were loaded or evicted; draws recorded earlier are then out of date.
+bool update_world_streaming(
+	WorldStreaming&,
+	lut::Allocator const&,
+	ModelPack& aModel,
+	glm::vec3 const& aCamera,
+	float aDt,
+	std::uint32_t aFrame
+);
+
+// Records the copies of aFrame's update, with their barriers. Must be
+// recorded outside of a render pass, before the frame's draws.
+void record_world_streaming( VkCommandBuffer, WorldStreaming&, ModelPack const&, std::uint32_t aFrame );
+
+// Clears the entries of the meshes that aren't resident
+void mask_streamed_meshes( WorldStreaming const&, std::vector<std::uint8_t>& aVisible );
+
+#endif // WORLD_STREAMING_HPP_E63B0A97_41D2_4C8F_9A15_7F2C8D04B6E1
@@ -1,7 +1,11 @@
 #include "allocator.hpp"
 
+#include <memory>
+#include <string>
 #include <utility>
+#include <algorithm>
 
+#include <cstdio>
 #include <cassert>
 
 #include "error.hpp"
@@ -15,6 +19,12 @@ namespace labutils
 	{
 		if( VK_NULL_HANDLE != allocator )
 		{
+			for( auto const pool : pools )
+			{
+				if( VK_NULL_HANDLE != pool )
+					vmaDestroyPool( allocator, pool );
+			}
+
 			vmaDestroyAllocator( allocator );
 		}
 	}
@@ -25,17 +35,122 @@ namespace labutils
 
 	Allocator::Allocator( Allocator&& aOther ) noexcept
 		: allocator( std::exchange( aOther.allocator, VK_NULL_HANDLE ) )
-	{}
+		, directUpload( aOther.directUpload )
+		, mappableTypes( aOther.mappableTypes )
+		, memoryBudget( aOther.memoryBudget )
+		, deviceAddresses( aOther.deviceAddresses )
+	{
+		for( std::size_t i = 0; i < kMemoryPoolCount; ++i )
+		{
+			pools[i] = std::exchange( aOther.pools[i], VK_NULL_HANDLE );
+			poolMemoryTypes[i] = aOther.poolMemoryTypes[i];
+		}
+	}
 	Allocator& Allocator::operator=( Allocator&& aOther ) noexcept
 	{
 		std::swap( allocator, aOther.allocator );
+		std::swap( pools, aOther.pools );
+		std::swap( poolMemoryTypes, aOther.poolMemoryTypes );
+		std::swap( directUpload, aOther.directUpload );
+		std::swap( mappableTypes, aOther.mappableTypes );
+		std::swap( memoryBudget, aOther.memoryBudget );
+		std::swap( deviceAddresses, aOther.deviceAddresses );
 		return *this;
 	}
 }
 
+namespace
+{
+	// True if the largest device-local heap has a host-visible memory type
+	// among aMappable; see Allocator::directUpload. Without resizable BAR,
+	// discrete GPUs only expose a small (256 MiB) window of their memory as a
+	// separate heap.
+	bool has_direct_upload_( VmaAllocator aAllocator, std::uint32_t aMappable )
+	{
+		VkPhysicalDeviceMemoryProperties const* props = nullptr;
+		vmaGetMemoryProperties( aAllocator, &props );
+
+		std::uint32_t heap = props->memoryHeapCount;
+		for( std::uint32_t i = 0; i < props->memoryHeapCount; ++i )
+		{
+			if( !(props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) )
+				continue;
+
+			if( heap == props->memoryHeapCount || props->memoryHeaps[i].size > props->memoryHeaps[heap].size )
+				heap = i;
+		}
+
+		VkMemoryPropertyFlags const wanted = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		for( std::uint32_t i = 0; i < props->memoryTypeCount; ++i )
+		{
+			if( heap == props->memoryTypes[i].heapIndex && wanted == (props->memoryTypes[i].propertyFlags & wanted) && (aMappable & (1u << i)) )
+				return true;
+		}
+
+		return false;
+	}
+
+	// Memory type for a custom pool, found with a representative buffer or
+	// image of the pool's class. Resources that can't use it fall back to
+	// the default pools (see allocation_info()).
+	bool find_pool_memory_type_( labutils::Allocator const& aAllocator, labutils::EMemoryClass aClass, std::uint32_t& aType )
+	{
+		using labutils::EMemoryClass;
+
+		VmaAllocationCreateInfo info = labutils::allocation_info( aAllocator, aClass );
+		info.pool = VK_NULL_HANDLE;
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = 65536;
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = VkExtent3D{ 1024, 1024, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkResult res = VK_ERROR_FEATURE_NOT_PRESENT;
+		switch( aClass )
+		{
+			case EMemoryClass::geometry:
+				bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+				if( aAllocator.directUpload )
+				{
+					info.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+					info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+				}
+				res = vmaFindMemoryTypeIndexForBufferInfo( aAllocator.allocator, &bufferInfo, &info, &aType );
+				break;
+			case EMemoryClass::staging:
+				bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+				res = vmaFindMemoryTypeIndexForBufferInfo( aAllocator.allocator, &bufferInfo, &info, &aType );
+				break;
+			case EMemoryClass::textures:
+				imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+				res = vmaFindMemoryTypeIndexForImageInfo( aAllocator.allocator, &imageInfo, &info, &aType );
+				break;
+			case EMemoryClass::renderTargets:
+				imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+				res = vmaFindMemoryTypeIndexForImageInfo( aAllocator.allocator, &imageInfo, &info, &aType );
+				break;
+			default:
+				assert( false );
+		}
+
+		return VK_SUCCESS == res;
+	}
+}
+
 namespace labutils
 {
-	Allocator create_allocator( VulkanContext const& aContext )
+	Allocator create_allocator( VulkanContext const& aContext, AllocatorConfig const& aConfig )
 	{
 		VkPhysicalDeviceProperties props{};
 		vkGetPhysicalDeviceProperties( aContext.physicalDevice, &props );
@@ -43,6 +158,9 @@ namespace labutils
 		VmaVulkanFunctions functions{};
 		functions.vkGetInstanceProcAddr   = vkGetInstanceProcAddr;
 		functions.vkGetDeviceProcAddr     = vkGetDeviceProcAddr;
+		// volk's, so that install_api_counters() sees the allocations
+		functions.vkAllocateMemory        = vkAllocateMemory;
+		functions.vkFreeMemory            = vkFreeMemory;
 
 		VmaAllocatorCreateInfo allocInfo{};
 		allocInfo.vulkanApiVersion  = props.apiVersion;
@@ -50,7 +168,15 @@ namespace labutils
 		allocInfo.device            = aContext.device;
 		allocInfo.instance          = aContext.instance;
 		allocInfo.pVulkanFunctions  = &functions;
-		
+
+		if( aContext.haveMemoryBudget )
+			allocInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
+		// Acceleration structure builds take their inputs by address, as
+		// do the buffer descriptors of descriptor buffers
+		if( aContext.caps.rayQuery || (aConfig.deviceAddresses && aContext.caps.descriptorBuffer) )
+			allocInfo.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+
 		VmaAllocator allocator = VK_NULL_HANDLE;
 		if( auto const res = vmaCreateAllocator( &allocInfo, &allocator ); VK_SUCCESS != res )
 		{
@@ -59,7 +185,189 @@ namespace labutils
 			);
 		}
 
-		return Allocator( allocator );
+		Allocator ret( allocator );
+
+		if( aContext.deviceCount > 1 )
+		{
+			VkPhysicalDeviceMemoryProperties const* memProps = nullptr;
+			vmaGetMemoryProperties( allocator, &memProps );
+
+			ret.mappableTypes = 0;
+			for( std::uint32_t i = 0; i < memProps->memoryTypeCount; ++i )
+			{
+				if( !(memProps->memoryHeaps[memProps->memoryTypes[i].heapIndex].flags & VK_MEMORY_HEAP_MULTI_INSTANCE_BIT) )
+					ret.mappableTypes |= 1u << i;
+			}
+		}
+
+		ret.directUpload = has_direct_upload_( allocator, ret.mappableTypes );
+		ret.memoryBudget = aContext.haveMemoryBudget;
+		ret.deviceAddresses = aConfig.deviceAddresses && aContext.caps.descriptorBuffer;
+
+		if( aConfig.pools )
+		{
+			for( std::size_t i = 0; i < kMemoryPoolCount; ++i )
+			{
+				auto const cls = EMemoryClass( std::size_t(EMemoryClass::geometry) + i );
+
+				std::uint32_t type = 0;
+				if( !find_pool_memory_type_( ret, cls, type ) )
+					continue;
+
+				VmaPoolCreateInfo poolInfo{};
+				poolInfo.memoryTypeIndex = type;
+				poolInfo.blockSize = aConfig.blockSizes[i];
+
+				if( auto const res = vmaCreatePool( allocator, &poolInfo, &ret.pools[i] ); VK_SUCCESS != res )
+				{
+					throw Error( "Unable to create memory pool\n"
+						"vmaCreatePool() returned %s", to_string(res).c_str()
+					);
+				}
+
+				vmaSetPoolName( allocator, ret.pools[i], memory_class_name( cls ) );
+				ret.poolMemoryTypes[i] = type;
+			}
+		}
+
+		// The geometry pool is only host visible if it was created that way
+		if( VK_NULL_HANDLE == ret.pools[0] )
+			ret.directUpload = false;
+
+		return ret;
+	}
+
+	VmaAllocationCreateInfo allocation_info( Allocator const& aAllocator, EMemoryClass aClass, VmaAllocationCreateFlags aFlags, std::uint32_t aMemoryTypeBits )
+	{
+		VmaAllocationCreateInfo ret{};
+		ret.flags = aFlags;
+
+		switch( aClass )
+		{
+			case EMemoryClass::device:
+			case EMemoryClass::geometry:
+			case EMemoryClass::textures:
+			case EMemoryClass::renderTargets:
+				ret.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+				break;
+			case EMemoryClass::upload:
+			case EMemoryClass::staging:
+				ret.usage = VMA_MEMORY_USAGE_AUTO;
+				ret.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+				ret.memoryTypeBits = aAllocator.mappableTypes;
+				break;
+			case EMemoryClass::readback:
+				ret.usage = VMA_MEMORY_USAGE_AUTO;
+				ret.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+				ret.memoryTypeBits = aAllocator.mappableTypes;
+				break;
+		}
+
+		if( aClass >= EMemoryClass::geometry )
+		{
+			auto const pool = std::size_t(aClass) - std::size_t(EMemoryClass::geometry);
+			if( aMemoryTypeBits & (1u << aAllocator.poolMemoryTypes[pool]) )
+				ret.pool = aAllocator.pools[pool];
+		}
+
+		return ret;
+	}
+
+	MemoryStats query_memory_stats( Allocator const& aAllocator )
+	{
+		VkPhysicalDeviceMemoryProperties const* props = nullptr;
+		vmaGetMemoryProperties( aAllocator.allocator, &props );
+
+		VmaBudget budgets[VK_MAX_MEMORY_HEAPS]{};
+		vmaGetHeapBudgets( aAllocator.allocator, budgets );
+
+		MemoryStats ret;
+		ret.fromDriver = aAllocator.memoryBudget;
+		ret.heaps.resize( props->memoryHeapCount );
+		for( std::uint32_t i = 0; i < props->memoryHeapCount; ++i )
+		{
+			auto& heap = ret.heaps[i];
+			heap.usage = budgets[i].usage;
+			heap.budget = budgets[i].budget;
+			heap.allocated = budgets[i].statistics.blockBytes;
+			heap.deviceLocal = 0 != (props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+
+			if( heap.deviceLocal )
+			{
+				ret.deviceUsage += heap.usage;
+				ret.deviceBudget += heap.budget;
+			}
+		}
+
+		return ret;
+	}
+
+	VkDeviceSize device_headroom( Allocator const& aAllocator, float aFraction )
+	{
+		auto const stats = query_memory_stats( aAllocator );
+		auto const limit = VkDeviceSize( double(stats.deviceBudget) * aFraction );
+		return limit > stats.deviceUsage ? limit - stats.deviceUsage : 0;
 	}
 }
 
+namespace labutils
+{
+	char const* memory_class_name( EMemoryClass aClass )
+	{
+		switch( aClass )
+		{
+			case EMemoryClass::device: return "device";
+			case EMemoryClass::upload: return "upload";
+			case EMemoryClass::readback: return "readback";
+			case EMemoryClass::geometry: return "geometry";
+			case EMemoryClass::textures: return "textures";
+			case EMemoryClass::renderTargets: return "render targets";
+			case EMemoryClass::staging: return "staging";
+		}
+
+		return "unknown";
+	}
+
+	void tag_allocation( VmaAllocator aAllocator, VmaAllocation aAllocation, EMemoryClass aClass )
+	{
+		vmaSetAllocationName( aAllocator, aAllocation, memory_class_name( aClass ) );
+	}
+
+	void name_allocation( VmaAllocator aAllocator, VmaAllocation aAllocation, char const* aName )
+	{
+		VmaAllocationInfo info{};
+		vmaGetAllocationInfo( aAllocator, aAllocation, &info );
+
+		// The class is the part of the previous name up to the first ": "
+		std::string name;
+		if( info.pName )
+		{
+			name = info.pName;
+			name.resize( std::min( name.size(), name.find( ": " ) ) );
+			name += ": ";
+		}
+		name += aName;
+
+		vmaSetAllocationName( aAllocator, aAllocation, name.c_str() );
+	}
+
+	void write_memory_report( Allocator const& aAllocator, char const* aPath )
+	{
+		char* stats = nullptr;
+		vmaBuildStatsString( aAllocator.allocator, &stats, VK_TRUE );
+
+		std::unique_ptr<std::FILE, int(*)(std::FILE*)> file( std::fopen( aPath, "w" ), &std::fclose );
+		bool ok = !!file;
+		if( ok )
+		{
+			std::fputs( stats, file.get() );
+			ok = !std::ferror( file.get() );
+			ok = 0 == std::fclose( file.release() ) && ok;
+		}
+
+		vmaFreeStatsString( aAllocator.allocator, stats );
+
+		if( !ok )
+			throw Error( "Unable to write memory report '%s'", aPath );
+	}
+}
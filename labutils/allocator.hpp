@@ -3,14 +3,50 @@
 #include <volk/volk.h>
 #include <vk_mem_alloc.h>
 
+#include <vector>
 #include <utility>
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 #include "vulkan_context.hpp"
 
 namespace labutils
 {
+	// What an allocation is for; selects the VMA usage and host access
+	// flags, and the custom pool (see AllocatorConfig) if there is one.
+	enum class EMemoryClass
+	{
+		// VMA's default pools
+		device,   // GPU only
+		upload,   // written (sequentially) by the CPU, read by the GPU
+		readback, // written by the GPU, read by the CPU
+
+		// Custom pools; device local, except for staging
+		geometry,      // vertex, index, indirect and material buffers
+		textures,      // sampled images
+		renderTargets, // attachments and other per-resolution images
+		staging        // transfer sources, written by the CPU
+	};
+
+	constexpr std::size_t kMemoryPoolCount = 4; // geometry ... staging
+
+	struct AllocatorConfig
+	{
+		// False: everything comes from VMA's default pools.
+		bool pools = true;
+
+		// Block size of each custom pool, in the order of EMemoryClass;
+		// 0 = VMA's default.
+		VkDeviceSize blockSizes[kMemoryPoolCount] = {};
+
+		// Uniform and storage buffers get SHADER_DEVICE_ADDRESS usage (see
+		// create_buffer()), as descriptor buffers address them. Needs
+		// DeviceCapabilities::descriptorBuffer.
+		bool deviceAddresses = false;
+	};
+
 	class Allocator
 	{
 		public:
@@ -26,7 +62,82 @@ namespace labutils
 
 		public:
 			VmaAllocator allocator = VK_NULL_HANDLE;
+
+			// Custom pools, in the order of EMemoryClass; VK_NULL_HANDLE if
+			// disabled or if there is no suitable memory type.
+			VmaPool pools[kMemoryPoolCount]{};
+			std::uint32_t poolMemoryTypes[kMemoryPoolCount]{};
+
+			// The largest device-local heap is host visible (resizable BAR,
+			// or unified memory). The geometry pool is then host visible,
+			// and uploads can write to it directly rather than staging.
+			bool directUpload = false;
+
+			// Memory types that can be mapped. With a device group (see
+			// VulkanContext::deviceCount), memory of a multi-instance heap
+			// can't be; host-accessed classes (upload, readback and
+			// staging) avoid those types, and directUpload is off if the
+			// geometry pool would be among them.
+			std::uint32_t mappableTypes = ~0u;
+
+			// Budgets come from VK_EXT_memory_budget (see
+			// query_memory_stats()).
+			bool memoryBudget = false;
+
+			// AllocatorConfig::deviceAddresses
+			bool deviceAddresses = false;
+	};
+
+	Allocator create_allocator( VulkanContext const&, AllocatorConfig const& = {} );
+
+	// aFlags are added to the class's own. The pool is only set if its
+	// memory type is in aMemoryTypeBits (pass ~0u if not yet known; see
+	// create_buffer() and create_image_texture2d() for how they check).
+	VmaAllocationCreateInfo allocation_info( Allocator const&, EMemoryClass, VmaAllocationCreateFlags aFlags = 0, std::uint32_t aMemoryTypeBits = ~0u );
+
+	struct HeapStats
+	{
+		VkDeviceSize usage = 0;     // by this process
+		VkDeviceSize budget = 0;    // usage beyond this may fail or evict
+		VkDeviceSize allocated = 0; // through VMA (blocks)
+		bool deviceLocal = false;
+	};
+
+	struct MemoryStats
+	{
+		std::vector<HeapStats> heaps;
+
+		// Summed over the device-local heaps
+		VkDeviceSize deviceUsage = 0;
+		VkDeviceSize deviceBudget = 0;
+
+		// False: usage and budget are VMA's estimates (its own allocations,
+		// and 80% of the heap size); other processes aren't accounted for.
+		bool fromDriver = false;
 	};
 
-	Allocator create_allocator( VulkanContext const& );
+	// With VK_EXT_memory_budget, VMA refreshes the numbers from the driver
+	// every few allocations and on vmaSetCurrentFrameIndex(); call that once
+	// per frame. Cheap enough to call every frame.
+	MemoryStats query_memory_stats( Allocator const& );
+
+	// Bytes of device-local memory that can still be allocated before the
+	// usage exceeds aFraction of the budget (0 if it already does).
+	VkDeviceSize device_headroom( Allocator const&, float aFraction = 0.9f );
+
+	// Allocation names, as listed by VMA's statistics (see
+	// write_memory_report()): "<class>: <name>". create_buffer() and
+	// create_image() tag their allocations with the class, and set_name()
+	// (see debug_utils.hpp) adds the name of the buffer or image; code that
+	// allocates through VMA directly tags its allocations itself. Names are
+	// copied.
+	char const* memory_class_name( EMemoryClass ); // e.g., "render targets"
+	void tag_allocation( VmaAllocator, VmaAllocation, EMemoryClass );
+	void name_allocation( VmaAllocator, VmaAllocation, char const* aName ); // keeps the class
+
+	// Writes vmaBuildStatsString()'s JSON, with the map of every block and
+	// allocation by name, to aPath (summed up by `premake5 memory-report`).
+	// The pools are named by class. Throws labutils::Error if the file
+	// can't be written.
+	void write_memory_report( Allocator const&, char const* aPath );
 }
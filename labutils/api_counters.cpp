@@ -0,0 +1,171 @@
+#include "api_counters.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iterator>
+
+namespace
+{
+	using Clock_ = std::chrono::steady_clock;
+
+	std::atomic<std::uint64_t> gCalls[labutils::kApiCallCount]{};
+	std::atomic<std::uint64_t> gNanoseconds[labutils::kApiCallCount]{};
+	std::atomic<bool> gInstalled{ false };
+
+	char const* const kNames_[] = {
+		"vkCmdBindPipeline",
+		"vkCmdBindDescriptorSets",
+		"vkCmdBindVertexBuffers",
+		"vkCmdBindIndexBuffer",
+		"vkCmdPushConstants",
+		"vkCmdDraw",
+		"vkCmdDrawIndexed",
+		"vkCmdDrawIndexedIndirect",
+		"vkCmdDrawIndexedIndirectCount",
+		"vkCmdDispatch",
+		"vkCmdPipelineBarrier",
+		"vkCmdCopyBuffer",
+		"vkCmdBeginRenderPass",
+		"vkCmdExecuteCommands",
+		"vkUpdateDescriptorSets",
+		"vkUpdateDescriptorSetWithTemplate",
+		"vkAllocateDescriptorSets",
+		"vkAllocateMemory",
+		"vkFreeMemory",
+		"vkCreateBuffer",
+		"vkCreateImage",
+		"vkBeginCommandBuffer",
+		"vkEndCommandBuffer",
+		"vkQueueSubmit",
+		"vkQueuePresentKHR"
+	};
+	static_assert( std::size(kNames_) == labutils::kApiCallCount, "one name per EApiCall" );
+
+	// Counts and times one call, until the end of the scope
+	class Timer_
+	{
+		public:
+			explicit Timer_( std::size_t aIndex ) noexcept
+				: mIndex( aIndex )
+				, mStart( Clock_::now() )
+			{}
+
+			~Timer_()
+			{
+				auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock_::now() - mStart ).count();
+				gCalls[mIndex].fetch_add( 1, std::memory_order_relaxed );
+				gNanoseconds[mIndex].fetch_add( std::uint64_t(ns), std::memory_order_relaxed );
+			}
+
+			Timer_( Timer_ const& ) = delete;
+			Timer_& operator= (Timer_ const&) = delete;
+
+		private:
+			std::size_t mIndex;
+			Clock_::time_point mStart;
+	};
+
+	// The wrapper of one entry point; `next` is the replaced pointer
+	template< labutils::EApiCall tCall, typename tFn >
+	struct Hook_;
+
+	template< labutils::EApiCall tCall, typename tRet, typename... tArgs >
+	struct Hook_< tCall, tRet (VKAPI_PTR*)(tArgs...) >
+	{
+		using Fn = tRet (VKAPI_PTR*)(tArgs...);
+
+		static inline Fn next = nullptr;
+
+		static tRet VKAPI_PTR call( tArgs... aArgs )
+		{
+			Timer_ const timer{ std::size_t(tCall) };
+			return next( aArgs... );
+		}
+
+		static void install( Fn& aEntry ) noexcept
+		{
+			if( !aEntry || &call == aEntry )
+				return;
+
+			next = aEntry;
+			aEntry = &call;
+		}
+	};
+
+	template< labutils::EApiCall tCall, typename tFn >
+	void hook_( tFn& aEntry ) noexcept
+	{
+		Hook_<tCall, tFn>::install( aEntry );
+	}
+}
+
+namespace labutils
+{
+	char const* api_call_name( EApiCall aCall ) noexcept
+	{
+		return std::size_t(aCall) < kApiCallCount ? kNames_[std::size_t(aCall)] : "?";
+	}
+
+	std::uint64_t ApiCounters::total_calls() const noexcept
+	{
+		std::uint64_t ret = 0;
+		for( auto const n : calls )
+			ret += n;
+		return ret;
+	}
+
+	double ApiCounters::total_ms() const noexcept
+	{
+		std::uint64_t ns = 0;
+		for( auto const n : nanoseconds )
+			ns += n;
+		return double(ns) * 1e-6;
+	}
+
+	void install_api_counters()
+	{
+		hook_<EApiCall::cmdBindPipeline>( vkCmdBindPipeline );
+		hook_<EApiCall::cmdBindDescriptorSets>( vkCmdBindDescriptorSets );
+		hook_<EApiCall::cmdBindVertexBuffers>( vkCmdBindVertexBuffers );
+		hook_<EApiCall::cmdBindIndexBuffer>( vkCmdBindIndexBuffer );
+		hook_<EApiCall::cmdPushConstants>( vkCmdPushConstants );
+		hook_<EApiCall::cmdDraw>( vkCmdDraw );
+		hook_<EApiCall::cmdDrawIndexed>( vkCmdDrawIndexed );
+		hook_<EApiCall::cmdDrawIndexedIndirect>( vkCmdDrawIndexedIndirect );
+		hook_<EApiCall::cmdDrawIndexedIndirectCount>( vkCmdDrawIndexedIndirectCount );
+		hook_<EApiCall::cmdDispatch>( vkCmdDispatch );
+		hook_<EApiCall::cmdPipelineBarrier>( vkCmdPipelineBarrier );
+		hook_<EApiCall::cmdCopyBuffer>( vkCmdCopyBuffer );
+		hook_<EApiCall::cmdBeginRenderPass>( vkCmdBeginRenderPass );
+		hook_<EApiCall::cmdExecuteCommands>( vkCmdExecuteCommands );
+		hook_<EApiCall::updateDescriptorSets>( vkUpdateDescriptorSets );
+		hook_<EApiCall::updateDescriptorSetWithTemplate>( vkUpdateDescriptorSetWithTemplate );
+		hook_<EApiCall::allocateDescriptorSets>( vkAllocateDescriptorSets );
+		hook_<EApiCall::allocateMemory>( vkAllocateMemory );
+		hook_<EApiCall::freeMemory>( vkFreeMemory );
+		hook_<EApiCall::createBuffer>( vkCreateBuffer );
+		hook_<EApiCall::createImage>( vkCreateImage );
+		hook_<EApiCall::beginCommandBuffer>( vkBeginCommandBuffer );
+		hook_<EApiCall::endCommandBuffer>( vkEndCommandBuffer );
+		hook_<EApiCall::queueSubmit>( vkQueueSubmit );
+		hook_<EApiCall::queuePresent>( vkQueuePresentKHR );
+
+		gInstalled = true;
+	}
+
+	bool api_counters_installed() noexcept
+	{
+		return gInstalled;
+	}
+
+	ApiCounters take_api_counters() noexcept
+	{
+		ApiCounters ret;
+		for( std::size_t i = 0; i < kApiCallCount; ++i )
+		{
+			ret.calls[i] = gCalls[i].exchange( 0, std::memory_order_relaxed );
+			ret.nanoseconds[i] = gNanoseconds[i].exchange( 0, std::memory_order_relaxed );
+		}
+		return ret;
+	}
+}
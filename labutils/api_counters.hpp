@@ -0,0 +1,78 @@
+#pragma once
+
+// Optional Vulkan call counting, for CPU (driver) overhead analysis. Once
+// install_api_counters() has run, the EApiCall entry points go through
+// wrappers that count each call and time it (the driver's work included),
+// on any thread; take_api_counters() returns the totals, e.g., per frame.
+// Without install_api_counters(), nothing is wrapped and nothing counted.
+
+#include <volk/volk.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	enum class EApiCall : std::uint32_t
+	{
+		cmdBindPipeline,
+		cmdBindDescriptorSets,
+		cmdBindVertexBuffers,
+		cmdBindIndexBuffer,
+		cmdPushConstants,
+		cmdDraw,
+		cmdDrawIndexed,
+		cmdDrawIndexedIndirect,
+		cmdDrawIndexedIndirectCount,
+		cmdDispatch,
+		cmdPipelineBarrier,
+		cmdCopyBuffer,
+		cmdBeginRenderPass,
+		cmdExecuteCommands,
+		updateDescriptorSets,
+		updateDescriptorSetWithTemplate,
+		allocateDescriptorSets,
+		allocateMemory,
+		freeMemory,
+		createBuffer,
+		createImage,
+		beginCommandBuffer,
+		endCommandBuffer,
+		queueSubmit,
+		queuePresent,
+
+		count
+	};
+
+	constexpr std::size_t kApiCallCount = std::size_t(EApiCall::count);
+
+	// The Vulkan function's name, e.g., "vkCmdDrawIndexed"
+	char const* api_call_name( EApiCall ) noexcept;
+
+	// Calls and the time spent in them, per entry point, since the last
+	// take_api_counters()
+	struct ApiCounters
+	{
+		std::uint64_t calls[kApiCallCount]{};
+		std::uint64_t nanoseconds[kApiCallCount]{};
+
+		std::uint64_t count( EApiCall aCall ) const noexcept { return calls[std::size_t(aCall)]; }
+
+		std::uint64_t total_calls() const noexcept;
+		double total_ms() const noexcept;
+	};
+
+	// Replaces volk's pointers to the EApiCall entry points with the
+	// counting wrappers, which call the replaced ones. Call once the
+	// device's entry points are loaded (volkLoadInstance() or
+	// volkLoadDevice()), before other threads use them, and before
+	// create_allocator() so that the allocator's vkAllocateMemory() and
+	// vkFreeMemory() are counted. Entry points that aren't loaded are left
+	// alone. Loading volk's pointers again removes the wrappers.
+	void install_api_counters();
+	bool api_counters_installed() noexcept;
+
+	// Returns the counts since the last call, and starts anew. Calls that
+	// are in progress on other threads count towards the next.
+	ApiCounters take_api_counters() noexcept;
+}
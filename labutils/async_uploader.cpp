@@ -0,0 +1,441 @@
+#include "async_uploader.hpp"
+
+#include <chrono>
+#include <limits>
+#include <utility>
+#include <optional>
+
+#include <cstdio>
+#include <cassert>
+#include <cstring> // for std::memcpy()
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+#include "texture_file.hpp"
+#include "texture_transcode.hpp"
+#include "startup_report.hpp"
+#include "thread_placement.hpp"
+
+namespace
+{
+	// Per ring; larger textures get a temporary ring of their own.
+	constexpr VkDeviceSize kStagingRingSize = VkDeviceSize(64) << 20;
+}
+
+namespace labutils
+{
+	AsyncUploader::AsyncUploader( VulkanContext const& aContext, Allocator const& aAllocator )
+		: mContext( &aContext )
+		, mAllocator( &aAllocator )
+	{
+		if( VK_NULL_HANDLE != aContext.transferQueue )
+		{
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = aContext.transferFamilyIndex;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			VkCommandPool pool = VK_NULL_HANDLE;
+			if( auto const res = vkCreateCommandPool( aContext.device, &poolInfo, nullptr, &pool ); VK_SUCCESS != res )
+			{
+				throw Error( "Unable to create transfer command pool\n" "vkCreateCommandPool() returned %s", to_string(res).c_str() );
+			}
+
+			mTransferPool = CommandPool( aContext.device, pool );
+			mTransferStaging.emplace( aContext, aAllocator, kStagingRingSize );
+		}
+		else
+		{
+			mStaging.emplace( aContext, aAllocator, kStagingRingSize );
+		}
+
+		mWorker = std::thread( [this] { run_(); } );
+	}
+
+	AsyncUploader::~AsyncUploader()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+
+		mWake.notify_all();
+		mWorker.join();
+	}
+
+	bool AsyncUploader::uses_transfer_queue() const noexcept
+	{
+		return VK_NULL_HANDLE != mTransferPool.handle;
+	}
+
+	void AsyncUploader::enqueue_texture( std::uint32_t aId, std::string aPath, VkFormat aFormat, std::uint32_t aMaxExtent )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mJobs.emplace_back( Job_{ aId, std::move(aPath), aFormat, std::string(), false, aMaxExtent } );
+			++mPending;
+		}
+
+		mWake.notify_one();
+	}
+
+	void AsyncUploader::enqueue_packed_texture( std::uint32_t aId, std::string aRedPath, std::string aGreenPath, std::uint32_t aMaxExtent )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mJobs.emplace_back( Job_{ aId, std::move(aRedPath), VK_FORMAT_R8G8B8A8_UNORM, std::move(aGreenPath), true, aMaxExtent } );
+			++mPending;
+		}
+
+		mWake.notify_one();
+	}
+
+	std::size_t AsyncUploader::pending() const noexcept
+	{
+		return mPending.load( std::memory_order_acquire );
+	}
+
+	std::vector<AsyncUploader::Completed> AsyncUploader::take_completed( VkCommandPool aGraphicsPool )
+	{
+		if( mFailed.load( std::memory_order_acquire ) )
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mFailed.store( false, std::memory_order_relaxed );
+			std::rethrow_exception( std::exchange( mError, nullptr ) );
+		}
+
+		std::vector<Done_> done;
+		for( Done_ item; mDone.try_pop( item ); )
+			done.emplace_back( std::move(item) );
+
+		std::vector<Completed> ret;
+		if( done.empty() )
+			return ret;
+
+		// Without a transfer queue, the decoded pixels still need to be
+		// staged. All of them go into one range of the staging ring (see
+		// upload_image_textures2d() for the alignment).
+		constexpr VkDeviceSize kStagingAlign = 16;
+
+		std::vector<VkDeviceSize> offsets( done.size(), 0 );
+		VkDeviceSize stagingSize = 0;
+		auto const staged_bytes = [] (Done_ const& aDone) -> std::vector<std::uint8_t> const&
+		{
+			return aDone.baked ? aDone.mips.bytes : aDone.data.pixels;
+		};
+
+		for( std::size_t i = 0; i < done.size(); ++i )
+		{
+			offsets[i] = stagingSize;
+			stagingSize += (VkDeviceSize(staged_bytes( done[i] ).size()) + kStagingAlign - 1) / kStagingAlign * kStagingAlign;
+		}
+
+		std::optional<StagingRing> overflow;
+		StagingRing* ring = nullptr;
+		StagingRing::Allocation staging;
+		if( stagingSize > 0 )
+		{
+			assert( mStaging );
+			ring = stagingSize <= mStaging->capacity() ? &*mStaging : &overflow.emplace( *mContext, *mAllocator, stagingSize );
+			staging = ring->allocate( stagingSize, kStagingAlign );
+
+			for( std::size_t i = 0; i < done.size(); ++i )
+			{
+				auto const& bytes = staged_bytes( done[i] );
+				if( !bytes.empty() )
+					std::memcpy( staging.data + offsets[i], bytes.data(), bytes.size() );
+
+				offsets[i] += staging.offset;
+			}
+		}
+
+		VkCommandBuffer cbuff = alloc_command_buffer( *mContext, aGraphicsPool );
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if( auto const res = vkBeginCommandBuffer( cbuff, &beginInfo ); VK_SUCCESS != res )
+		{
+			throw Error( "Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		for( std::size_t i = 0; i < done.size(); ++i )
+		{
+			auto& result = done[i].result;
+			auto const mipLevels = compute_mip_level_count( result.width, result.height );
+
+			if( VK_NULL_HANDLE != result.image.image )
+			{
+				// Acquire; matches the release in process_().
+				image_barrier( cbuff, result.image.image,
+					0,
+					VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 },
+					mContext->transferFamilyIndex,
+					mContext->graphicsFamilyIndex
+				);
+			}
+			else if( done[i].baked )
+			{
+				result.image = create_image_texture2d( *mAllocator, result.width, result.height, result.format );
+				record_texture_levels_copy( cbuff, staging.buffer, offsets[i], result.image.image, done[i].mips );
+			}
+			else
+			{
+				result.image = create_image_texture2d( *mAllocator, result.width, result.height, result.format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT );
+				record_texture_copy( cbuff, staging.buffer, offsets[i], result.image.image, result.width, result.height );
+			}
+
+			if( done[i].baked )
+				record_texture_ready( cbuff, result.image.image, mipLevels );
+			else
+				record_texture_mips( cbuff, result.image.image, result.width, result.height );
+		}
+
+		if( auto const res = vkEndCommandBuffer( cbuff ); VK_SUCCESS != res )
+		{
+			throw Error( "Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		Fence uploadComplete;
+		VkFence fence = VK_NULL_HANDLE;
+		if( ring )
+		{
+			fence = ring->submit_fence();
+		}
+		else
+		{
+			uploadComplete = create_fence( *mContext );
+			fence = uploadComplete.handle;
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cbuff;
+
+		if( auto const res = vkQueueSubmit( mContext->graphicsQueue, 1, &submitInfo, fence ); VK_SUCCESS != res )
+		{
+			throw Error( "Submitting commands\n" "vkQueueSubmit() returned %s", to_string(res).c_str() );
+		}
+
+		if( auto const res = vkWaitForFences( mContext->device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+		{
+			throw Error( "Waiting for texture upload to complete\n" "vkWaitForFences() returned %s", to_string(res).c_str() );
+		}
+
+		vkFreeCommandBuffers( mContext->device, aGraphicsPool, 1, &cbuff );
+
+		ret.reserve( done.size() );
+		for( auto& item : done )
+			ret.emplace_back( std::move(item.result) );
+
+		assert( mPending >= ret.size() );
+		mPending.fetch_sub( ret.size(), std::memory_order_release );
+
+		return ret;
+	}
+
+	void AsyncUploader::run_()
+	{
+		place_current_thread( EThreadRole::worker, "texture decode" );
+
+		for( ;; )
+		{
+			Job_ job;
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mWake.wait( lock, [this] { return mQuit || !mJobs.empty(); } );
+
+				if( mQuit )
+					return;
+
+				job = std::move(mJobs.front());
+				mJobs.pop_front();
+			}
+
+			try
+			{
+				Done_ done = process_( job );
+
+				// Full: the render loop is behind on take_completed()
+				while( !mDone.try_push( std::move(done) ) )
+				{
+					std::unique_lock<std::mutex> lock( mMutex );
+					if( mWake.wait_for( lock, std::chrono::milliseconds(1), [this] { return mQuit; } ) )
+						return;
+				}
+			}
+			catch( ... )
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				if( !mError )
+					mError = std::current_exception();
+				mFailed.store( true, std::memory_order_release );
+
+				assert( mPending > 0 );
+				--mPending;
+			}
+		}
+	}
+
+	AsyncUploader::Done_ AsyncUploader::process_( Job_ const& aJob )
+	{
+		auto const start = StartupClock::now();
+
+		Done_ ret;
+		ret.result.id = aJob.id;
+		ret.baked = !aJob.packed && is_texture_file( aJob.path.c_str() );
+
+		// With a transfer queue, the levels of baked textures go from the
+		// mapped file straight into the staging ring, rather than through a
+		// copy on the heap first (unless they need transcoding)
+		MappedTextureFile mapped;
+		bool direct = false;
+
+		if( ret.baked )
+		{
+			mapped = map_texture_file( aJob.path.c_str() );
+			ret.mips = mapped.levels;
+
+			direct = uses_transfer_queue() && supports_sampled_format( *mContext, ret.mips.format );
+			if( !direct )
+			{
+				ret.mips.bytes.assign( mapped.data, mapped.file.data() + mapped.file.size() );
+				mapped = MappedTextureFile{};
+
+				fit_texture_format( *mContext, ret.mips, aJob.path.c_str() );
+			}
+
+			ret.result.format = ret.mips.format;
+		}
+		else
+		{
+			auto const path_ = [] (std::string const& aPath) { return aPath.empty() ? nullptr : aPath.c_str(); };
+			ret.data = aJob.packed
+				? decode_packed_image( path_( aJob.path ), path_( aJob.greenPath ) )
+				: decode_image( aJob.path.c_str(), VK_FORMAT_R8_UNORM == aJob.format ? 1 : 4 )
+			;
+			ret.result.format = aJob.format;
+			ret.result.opaque = is_opaque( ret.data );
+		}
+
+		ret.result.fullWidth = ret.baked ? ret.mips.width : ret.data.width;
+		ret.result.fullHeight = ret.baked ? ret.mips.height : ret.data.height;
+
+		if( aJob.maxExtent > 0 )
+		{
+			auto const levels = levels_above( ret.result.fullWidth, ret.result.fullHeight, aJob.maxExtent );
+			if( ret.baked )
+				drop_mip_levels( ret.mips, levels );
+			else
+				drop_mip_levels( ret.data, levels );
+		}
+
+		// Near the memory budget, stream in a smaller version instead.
+		VkDeviceSize headroom = device_headroom( *mAllocator );
+		if( auto const dropped = ret.baked ? fit_texture_budget( ret.mips, headroom ) : fit_texture_budget( ret.data, headroom ); dropped > 0 )
+			std::fprintf( stderr, "Info: %s: near the GPU memory budget; dropped %u mip level(s)\n", aJob.path.c_str(), dropped );
+
+		ret.result.width = ret.baked ? ret.mips.width : ret.data.width;
+		ret.result.height = ret.baked ? ret.mips.height : ret.data.height;
+
+		auto const& bytes = ret.baked ? ret.mips.bytes : ret.data.pixels;
+		std::size_t const byteCount = direct ? std::size_t(ret.mips.levelOffsets.back() + ret.mips.levelSizes.back()) : bytes.size();
+
+		auto const report = [&] {
+			add_startup_item( "texture streaming", aJob.path.empty() ? aJob.greenPath : aJob.path, StartupClock::now() - start, byteCount );
+		};
+
+		if( !uses_transfer_queue() )
+		{
+			report();
+			return ret;
+		}
+
+		std::optional<StagingRing> overflow;
+		StagingRing& ring = byteCount <= mTransferStaging->capacity() ? *mTransferStaging : overflow.emplace( *mContext, *mAllocator, byteCount );
+
+		auto const staging = ring.allocate( byteCount );
+		if( direct )
+		{
+			// First level that survived drop_mip_levels()
+			auto const first = mapped.levels.levelOffsets.size() - ret.mips.levelOffsets.size();
+			std::memcpy( staging.data, mapped.data + mapped.levels.levelOffsets[first], byteCount );
+			mapped = MappedTextureFile{};
+		}
+		else
+		{
+			std::memcpy( staging.data, bytes.data(), bytes.size() );
+		}
+
+		report();
+
+		Image image = create_image_texture2d( *mAllocator, ret.result.width, ret.result.height, ret.result.format );
+		auto const mipLevels = compute_mip_level_count( ret.result.width, ret.result.height );
+
+		VkCommandBuffer cbuff = alloc_command_buffer( *mContext, mTransferPool.handle );
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if( auto const res = vkBeginCommandBuffer( cbuff, &beginInfo ); VK_SUCCESS != res )
+		{
+			throw Error( "Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		if( ret.baked )
+			record_texture_levels_copy( cbuff, staging.buffer, staging.offset, image.image, ret.mips );
+		else
+			record_texture_copy( cbuff, staging.buffer, staging.offset, image.image, ret.result.width, ret.result.height );
+
+		// Release to the graphics family. The layout stays the same; the
+		// mip generation in take_completed() continues from it.
+		image_barrier( cbuff, image.image,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			0,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 },
+			mContext->transferFamilyIndex,
+			mContext->graphicsFamilyIndex
+		);
+
+		if( auto const res = vkEndCommandBuffer( cbuff ); VK_SUCCESS != res )
+		{
+			throw Error( "Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cbuff;
+
+		VkFence const fence = ring.submit_fence();
+		if( auto const res = vkQueueSubmit( mContext->transferQueue, 1, &submitInfo, fence ); VK_SUCCESS != res )
+		{
+			throw Error( "Submitting transfer commands\n" "vkQueueSubmit() returned %s", to_string(res).c_str() );
+		}
+
+		if( auto const res = vkWaitForFences( mContext->device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+		{
+			throw Error( "Waiting for transfer to complete\n" "vkWaitForFences() returned %s", to_string(res).c_str() );
+		}
+
+		vkFreeCommandBuffers( mContext->device, mTransferPool.handle, 1, &cbuff );
+
+		ret.data = ImageData{};
+		ret.mips = MipImageData{};
+		ret.result.image = std::move(image);
+		return ret;
+	}
+}
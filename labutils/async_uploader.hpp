@@ -0,0 +1,140 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <exception>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkimage.hpp"
+#include "vkobject.hpp"
+#include "allocator.hpp"
+#include "mpsc_queue.hpp"
+#include "staging_ring.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Background texture streaming. Textures are decoded (or, for baked
+	// texture files, see texture_file.hpp, read) on a worker thread.
+	// If the context has a transfer-only queue, the worker also uploads the
+	// base level there, and releases the image to the graphics queue family;
+	// take_completed() then acquires it on the graphics queue and generates
+	// the mip chain (blits need a graphics queue); baked textures bring all
+	// their levels along, copied from the mapped file straight into staging
+	// memory (see map_texture_file()). Without a transfer queue, only the
+	// decode is done in the background, and take_completed() does the whole
+	// upload.
+	//
+	// take_completed() must be called from the thread that owns the graphics
+	// queue, and waits for its upload to complete. The worker hands the
+	// decoded textures over through a lock-free queue (see MpscQueue), so
+	// neither it nor pending() locks on the frame path. The caller swaps the
+	// returned images in for whatever placeholder it used meanwhile.
+	//
+	// Each decode is an item of the "texture streaming" start-up phase (see
+	// startup_report.hpp).
+	class AsyncUploader
+	{
+		public:
+			struct Completed
+			{
+				std::uint32_t id = 0; // as passed to enqueue_texture()
+				VkFormat format = VK_FORMAT_UNDEFINED;
+				Image image; // in SHADER_READ_ONLY_OPTIMAL, owned by the graphics family
+				std::uint32_t width = 0, height = 0;
+				std::uint32_t fullWidth = 0, fullHeight = 0; // before dropping levels
+				bool opaque = false; // decoded, without alpha (see is_opaque()); false if baked
+			};
+
+		public:
+			AsyncUploader( VulkanContext const&, Allocator const& );
+			~AsyncUploader();
+
+			AsyncUploader( AsyncUploader const& ) = delete;
+			AsyncUploader& operator= (AsyncUploader const&) = delete;
+
+		public:
+			// True if the copies run on VulkanContext::transferQueue.
+			bool uses_transfer_queue() const noexcept;
+
+			// aFormat is VK_FORMAT_R8_UNORM (decoded with one channel) or an
+			// 8-bit RGBA format. Baked texture files use the format stored
+			// in the file instead; see Completed::format. A non-zero
+			// aMaxExtent drops the top mip levels until neither side exceeds
+			// it (see levels_above()); the budget may drop more (see
+			// fit_texture_budget()).
+			void enqueue_texture( std::uint32_t aId, std::string aPath, VkFormat aFormat, std::uint32_t aMaxExtent = 0 );
+
+			// Decodes with decode_packed_image(); an empty path leaves its
+			// channel at 0. The format is VK_FORMAT_R8G8B8A8_UNORM.
+			void enqueue_packed_texture( std::uint32_t aId, std::string aRedPath, std::string aGreenPath, std::uint32_t aMaxExtent = 0 );
+
+			// Number of textures enqueued but not yet returned by
+			// take_completed().
+			std::size_t pending() const noexcept;
+
+			// Returns the textures that are done so far (possibly none).
+			// Rethrows any error raised by the worker.
+			std::vector<Completed> take_completed( VkCommandPool aGraphicsPool );
+
+		private:
+			struct Job_
+			{
+				std::uint32_t id;
+				std::string path;
+				VkFormat format;
+				std::string greenPath; // packed only
+				bool packed = false;
+				std::uint32_t maxExtent = 0; // 0: full size
+			};
+
+			struct Done_
+			{
+				Completed result;
+				bool baked = false; // all levels present; no mip generation
+
+				// Only without a transfer queue
+				ImageData data;
+				MipImageData mips;
+			};
+
+			void run_();
+			Done_ process_( Job_ const& );
+
+		private:
+			VulkanContext const* mContext;
+			Allocator const* mAllocator;
+
+			CommandPool mTransferPool; // on the transfer family; worker only
+
+			// Staging for the worker (with a transfer queue), or for
+			// take_completed() (without one).
+			std::optional<StagingRing> mTransferStaging;
+			std::optional<StagingRing> mStaging;
+
+			// Done_s waiting for take_completed(); the worker waits while
+			// all are taken
+			static constexpr std::size_t kDoneCapacity = 64;
+			MpscQueue<Done_,kDoneCapacity> mDone;
+			std::atomic<std::size_t> mPending{ 0 };
+			std::atomic<bool> mFailed{ false }; // mError is set
+
+			mutable std::mutex mMutex;
+			std::condition_variable mWake;
+			std::deque<Job_> mJobs;
+			std::exception_ptr mError;
+			bool mQuit = false;
+
+			std::thread mWorker;
+	};
+}
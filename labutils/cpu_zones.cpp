@@ -0,0 +1,175 @@
+#include "cpu_zones.hpp"
+
+#if defined(LUT_CPU_ZONES)
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include <cstdio>
+
+namespace
+{
+	constexpr std::size_t kMaxZones = std::size_t(4) << 20; // all threads
+	constexpr std::uint32_t kGpuTrack = 0; // threads count from 1
+
+	struct Zone_
+	{
+		char const* name;
+		std::int64_t beginNs, lengthNs; // since the registry's epoch
+	};
+
+	// One per thread (and the GPU). Only its thread appends, but
+	// write_cpu_zones() may read it at the same time.
+	struct Track_
+	{
+		std::uint32_t id;
+		std::mutex mutex;
+		std::vector<Zone_> zones;
+	};
+
+	struct Registry_
+	{
+		labutils::ZoneClock::time_point const epoch = labutils::ZoneClock::now();
+
+		std::mutex mutex; // tracks, names
+		std::vector<std::unique_ptr<Track_>> tracks;
+		std::unordered_set<std::string> names; // of GPU zones; nodes are stable
+
+		std::atomic<std::size_t> zoneCount{ 0 };
+	};
+
+	Registry_& registry_();
+	Track_& new_track_();
+
+	Track_& this_thread_track_()
+	{
+		thread_local Track_* track = &new_track_();
+		return *track;
+	}
+
+	std::int64_t since_epoch_( labutils::ZoneClock::time_point aTime )
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( aTime - registry_().epoch ).count();
+	}
+
+	void add_( Track_& aTrack, char const* aName, std::int64_t aBeginNs, std::int64_t aLengthNs )
+	{
+		if( registry_().zoneCount++ >= kMaxZones )
+			return;
+
+		std::lock_guard<std::mutex> lock( aTrack.mutex );
+		aTrack.zones.emplace_back( Zone_{ aName, aBeginNs, aLengthNs } );
+	}
+
+	void write_json_string_( std::FILE* aFile, char const* aString )
+	{
+		std::fputc( '"', aFile );
+		for( char const* ch = aString; *ch; ++ch )
+		{
+			if( '"' == *ch || '\\' == *ch )
+				std::fputc( '\\', aFile );
+			if( std::uint8_t(*ch) >= 0x20 )
+				std::fputc( *ch, aFile );
+		}
+		std::fputc( '"', aFile );
+	}
+}
+
+namespace labutils
+{
+	CpuZone::CpuZone( char const* aName ) noexcept
+		: mName( aName )
+		, mStart( ZoneClock::now() )
+	{}
+
+	CpuZone::~CpuZone()
+	{
+		auto const end = ZoneClock::now();
+		auto const beginNs = since_epoch_( mStart );
+		add_( this_thread_track_(), mName, beginNs, since_epoch_( end ) - beginNs );
+	}
+
+	void add_gpu_zone( char const* aName, ZoneClock::time_point aBegin, ZoneClock::duration aLength )
+	{
+		auto& reg = registry_();
+
+		char const* name = nullptr;
+		Track_* gpu = nullptr;
+		{
+			std::lock_guard<std::mutex> lock( reg.mutex );
+			name = reg.names.emplace( aName ).first->c_str();
+			gpu = reg.tracks[kGpuTrack].get();
+		}
+
+		add_( *gpu, name, since_epoch_( aBegin ), std::chrono::duration_cast<std::chrono::nanoseconds>( aLength ).count() );
+	}
+
+	bool write_cpu_zones( char const* aPath )
+	{
+		std::FILE* file = std::fopen( aPath, "w" );
+		if( !file )
+			return false;
+
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		// Complete events ("X") in microseconds, and a name per track
+		std::fprintf( file, "{\"traceEvents\":[\n" );
+		bool first = true;
+		for( auto const& track : reg.tracks )
+		{
+			std::fprintf( file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", track->id );
+			if( kGpuTrack == track->id )
+				write_json_string_( file, "GPU" );
+			else
+				std::fprintf( file, "\"thread %u\"", track->id );
+			std::fprintf( file, "}}" );
+			first = false;
+
+			std::lock_guard<std::mutex> trackLock( track->mutex );
+			for( auto const& zone : track->zones )
+			{
+				std::fprintf( file, ",\n{\"name\":" );
+				write_json_string_( file, zone.name );
+				std::fprintf( file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", track->id, double(zone.beginNs) * 1e-3, double(zone.lengthNs) * 1e-3 );
+			}
+		}
+		std::fprintf( file, "\n]}\n" );
+
+		bool const ok = !std::ferror( file );
+		return 0 == std::fclose( file ) && ok;
+	}
+}
+
+namespace
+{
+	Registry_& registry_()
+	{
+		// Never destroyed: threads may still record while the program exits
+		static Registry_* const reg = [] {
+			auto* ret = new Registry_;
+			auto gpu = std::make_unique<Track_>();
+			gpu->id = kGpuTrack;
+			ret->tracks.emplace_back( std::move(gpu) );
+			return ret;
+		}();
+		return *reg;
+	}
+
+	Track_& new_track_()
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		auto track = std::make_unique<Track_>();
+		track->id = std::uint32_t(reg.tracks.size());
+		reg.tracks.emplace_back( std::move(track) );
+		return *reg.tracks.back();
+	}
+}
+
+#endif // ~ LUT_CPU_ZONES
@@ -0,0 +1,64 @@
+#pragma once
+
+// Optional CPU instrumentation. LUT_CPU_ZONE( "name" ) times the rest of the
+// enclosing scope on the calling thread; the zones of all threads, plus the
+// GPU scopes of a GpuProfiler (LUT_GPU_ZONES()), are written as a Chrome
+// trace (JSON, for chrome://tracing or https://ui.perfetto.dev) by
+// write_cpu_zones().
+//
+// Only compiled with LUT_CPU_ZONES defined (premake5 --cpu-zones). Without
+// it, the macros expand to nothing, and none of the functions exist.
+// Zone names must be string literals (they are kept as pointers).
+
+#if defined(LUT_CPU_ZONES)
+
+#include <chrono>
+
+#include <cstdint>
+
+namespace labutils
+{
+	class GpuProfiler;
+
+	using ZoneClock = std::chrono::steady_clock;
+
+	class CpuZone
+	{
+		public:
+			explicit CpuZone( char const* aName ) noexcept;
+			~CpuZone();
+
+			CpuZone( CpuZone const& ) = delete;
+			CpuZone& operator= (CpuZone const&) = delete;
+
+		private:
+			char const* mName;
+			ZoneClock::time_point mStart;
+	};
+
+	// Adds a zone to the "GPU" track; aName is copied.
+	void add_gpu_zone( char const* aName, ZoneClock::time_point aBegin, ZoneClock::duration aLength );
+
+	// Adds each scope of aProfiler's latest samples (see last_ms()) to the
+	// "GPU" track. There are no calibrated timestamps: the frame's earliest
+	// scope is placed at aSubmitted, the time the frame was submitted, so
+	// only the GPU zones' lengths and offsets among each other are exact.
+	// (Defined in gpu_profiler.cpp, so that the zones don't need Vulkan.)
+	void add_gpu_zones( GpuProfiler const& aProfiler, ZoneClock::time_point aSubmitted );
+
+	// Writes all zones recorded so far; false if aPath can't be written.
+	// Recording stops at a few million zones.
+	bool write_cpu_zones( char const* aPath );
+}
+
+#	define LUT_CPU_ZONE_NAME2_( aLine ) lutCpuZone##aLine##_
+#	define LUT_CPU_ZONE_NAME_( aLine ) LUT_CPU_ZONE_NAME2_( aLine )
+#	define LUT_CPU_ZONE( aName ) ::labutils::CpuZone LUT_CPU_ZONE_NAME_(__LINE__)( aName )
+#	define LUT_GPU_ZONES( aProfiler, aSubmitted ) ::labutils::add_gpu_zones( aProfiler, aSubmitted )
+
+#else // !LUT_CPU_ZONES
+
+#	define LUT_CPU_ZONE( aName ) static_cast<void>(0)
+#	define LUT_GPU_ZONES( aProfiler, aSubmitted ) static_cast<void>(0)
+
+#endif // ~ LUT_CPU_ZONES
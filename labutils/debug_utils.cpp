@@ -0,0 +1,74 @@
+#include "debug_utils.hpp"
+
+#include <cassert>
+
+namespace
+{
+	void set_color_( float (&aOut)[4], std::uint32_t aColor )
+	{
+		// All zero: no colour
+		if( 0 == aColor )
+			return;
+
+		aOut[0] = float((aColor >> 16) & 0xff) / 255.f;
+		aOut[1] = float((aColor >> 8) & 0xff) / 255.f;
+		aOut[2] = float(aColor & 0xff) / 255.f;
+		aOut[3] = 1.f;
+	}
+}
+
+namespace labutils
+{
+	void set_object_name( VulkanContext const& aContext, VkObjectType aType, std::uint64_t aHandle, char const* aName )
+	{
+		assert( aName );
+		if( !aContext.haveDebugUtils || 0 == aHandle )
+			return;
+
+		VkDebugUtilsObjectNameInfoEXT nameInfo{};
+		nameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+		nameInfo.objectType = aType;
+		nameInfo.objectHandle = aHandle;
+		nameInfo.pObjectName = aName;
+
+		// Only fails if out of host memory; the name is not worth an error
+		vkSetDebugUtilsObjectNameEXT( aContext.device, &nameInfo );
+	}
+
+
+	DebugLabel::DebugLabel( VulkanContext const& aContext, VkCommandBuffer aCmdBuff, char const* aName, std::uint32_t aColor )
+		: mCmdBuff( aContext.haveDebugUtils ? aCmdBuff : VK_NULL_HANDLE )
+	{
+		assert( aName );
+		if( VK_NULL_HANDLE == mCmdBuff )
+			return;
+
+		VkDebugUtilsLabelEXT label{};
+		label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+		label.pLabelName = aName;
+		set_color_( label.color, aColor );
+
+		vkCmdBeginDebugUtilsLabelEXT( mCmdBuff, &label );
+	}
+
+	DebugLabel::~DebugLabel()
+	{
+		if( VK_NULL_HANDLE != mCmdBuff )
+			vkCmdEndDebugUtilsLabelEXT( mCmdBuff );
+	}
+
+
+	void insert_label( VulkanContext const& aContext, VkCommandBuffer aCmdBuff, char const* aName, std::uint32_t aColor )
+	{
+		assert( aName );
+		if( !aContext.haveDebugUtils )
+			return;
+
+		VkDebugUtilsLabelEXT label{};
+		label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+		label.pLabelName = aName;
+		set_color_( label.color, aColor );
+
+		vkCmdInsertDebugUtilsLabelEXT( aCmdBuff, &label );
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <type_traits>
+
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vkimage.hpp"
+#include "vkbuffer.hpp"
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// VK_EXT_debug_utils object names and command buffer labels, as shown by
+	// RenderDoc, Nsight and the validation layers. Everything does nothing
+	// unless the extension is enabled (VulkanContext::haveDebugUtils); it is
+	// whenever the instance supports it, which includes running under a
+	// capture tool. Names are copied by the driver.
+	//
+	// Naming a Buffer or Image also names its allocation in VMA's statistics
+	// (see name_allocation()), with or without the extension.
+
+	void set_object_name( VulkanContext const&, VkObjectType, std::uint64_t aHandle, char const* aName );
+
+	// Typed handles: the object type follows from the handle type (see
+	// object_type() below).
+	template< typename tHandle >
+	void set_name( VulkanContext const&, tHandle, char const* aName );
+
+	template< typename tHandle, typename tParent, DestroyFn<tParent,tHandle>& tDestroyFn >
+	void set_name( VulkanContext const&, UniqueHandle<tHandle,tParent,tDestroyFn> const&, char const* aName );
+
+	void set_name( VulkanContext const&, Buffer const&, char const* aName );
+	void set_name( VulkanContext const&, Image const&, char const* aName );
+
+
+	// Labelled region of a command buffer, from construction to destruction.
+	// Regions nest. A region must end in the command buffer that it began in
+	// (the spec only requires this of secondary command buffers, but the
+	// captures are easier to read). aColor is 0xRRGGBB; 0 leaves it to the
+	// tool.
+	class DebugLabel
+	{
+		public:
+			DebugLabel( VulkanContext const&, VkCommandBuffer, char const* aName, std::uint32_t aColor = 0 );
+			~DebugLabel();
+
+			DebugLabel( DebugLabel const& ) = delete;
+			DebugLabel& operator= (DebugLabel const&) = delete;
+
+		private:
+			VkCommandBuffer mCmdBuff; // VK_NULL_HANDLE: no region was begun
+	};
+
+	// Single label, e.g. in front of a draw
+	void insert_label( VulkanContext const&, VkCommandBuffer, char const* aName, std::uint32_t aColor = 0 );
+
+
+	// VkObjectType of the handle types that set_name() accepts
+	constexpr VkObjectType object_type( VkBuffer ) noexcept { return VK_OBJECT_TYPE_BUFFER; }
+	constexpr VkObjectType object_type( VkImage ) noexcept { return VK_OBJECT_TYPE_IMAGE; }
+	constexpr VkObjectType object_type( VkImageView ) noexcept { return VK_OBJECT_TYPE_IMAGE_VIEW; }
+	constexpr VkObjectType object_type( VkSampler ) noexcept { return VK_OBJECT_TYPE_SAMPLER; }
+	constexpr VkObjectType object_type( VkRenderPass ) noexcept { return VK_OBJECT_TYPE_RENDER_PASS; }
+	constexpr VkObjectType object_type( VkFramebuffer ) noexcept { return VK_OBJECT_TYPE_FRAMEBUFFER; }
+	constexpr VkObjectType object_type( VkPipeline ) noexcept { return VK_OBJECT_TYPE_PIPELINE; }
+	constexpr VkObjectType object_type( VkPipelineLayout ) noexcept { return VK_OBJECT_TYPE_PIPELINE_LAYOUT; }
+	constexpr VkObjectType object_type( VkPipelineCache ) noexcept { return VK_OBJECT_TYPE_PIPELINE_CACHE; }
+	constexpr VkObjectType object_type( VkShaderModule ) noexcept { return VK_OBJECT_TYPE_SHADER_MODULE; }
+	constexpr VkObjectType object_type( VkDescriptorPool ) noexcept { return VK_OBJECT_TYPE_DESCRIPTOR_POOL; }
+	constexpr VkObjectType object_type( VkDescriptorSetLayout ) noexcept { return VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT; }
+	constexpr VkObjectType object_type( VkDescriptorSet ) noexcept { return VK_OBJECT_TYPE_DESCRIPTOR_SET; }
+	constexpr VkObjectType object_type( VkCommandPool ) noexcept { return VK_OBJECT_TYPE_COMMAND_POOL; }
+	constexpr VkObjectType object_type( VkCommandBuffer ) noexcept { return VK_OBJECT_TYPE_COMMAND_BUFFER; }
+	constexpr VkObjectType object_type( VkFence ) noexcept { return VK_OBJECT_TYPE_FENCE; }
+	constexpr VkObjectType object_type( VkSemaphore ) noexcept { return VK_OBJECT_TYPE_SEMAPHORE; }
+	constexpr VkObjectType object_type( VkQueryPool ) noexcept { return VK_OBJECT_TYPE_QUERY_POOL; }
+	constexpr VkObjectType object_type( VkQueue ) noexcept { return VK_OBJECT_TYPE_QUEUE; }
+	constexpr VkObjectType object_type( VkAccelerationStructureKHR ) noexcept { return VK_OBJECT_TYPE_ACCELERATION_STRUCTURE_KHR; }
+}
+
+namespace labutils
+{
+	template< typename tHandle >
+	inline
+	void set_name( VulkanContext const& aContext, tHandle aHandle, char const* aName )
+	{
+		// All handles are pointers on 64-bit platforms (the only ones the
+		// workspace builds for); object_type() couldn't tell them apart
+		// otherwise.
+		static_assert( std::is_pointer_v<tHandle>, "64-bit handles expected" );
+		set_object_name( aContext, object_type( aHandle ), std::uint64_t(reinterpret_cast<std::uintptr_t>(aHandle)), aName );
+	}
+
+	template< typename tHandle, typename tParent, DestroyFn<tParent,tHandle>& tDestroyFn >
+	inline
+	void set_name( VulkanContext const& aContext, UniqueHandle<tHandle,tParent,tDestroyFn> const& aHandle, char const* aName )
+	{
+		set_name( aContext, aHandle.handle, aName );
+	}
+
+	inline
+	void set_name( VulkanContext const& aContext, Buffer const& aBuffer, char const* aName )
+	{
+		set_name( aContext, aBuffer.buffer, aName );
+		if( VK_NULL_HANDLE != aBuffer.allocation )
+			name_allocation( aBuffer.allocator(), aBuffer.allocation, aName );
+	}
+
+	inline
+	void set_name( VulkanContext const& aContext, Image const& aImage, char const* aName )
+	{
+		set_name( aContext, aImage.image, aName );
+		if( VK_NULL_HANDLE != aImage.allocation )
+			name_allocation( aImage.allocator(), aImage.allocation, aName );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,365 @@
+#include "defragmenter.hpp"
+
+#include <optional>
+#include <algorithm>
+
+#include <cstdio>
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// Kept as the allocation's user data
+	struct Relocatable_
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkBufferCreateInfo bufferInfo{};
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageCreateInfo imageInfo{};
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		bool movable = false; // see allow_moves()
+	};
+
+	Relocatable_* relocatable_( VmaAllocator aAllocator, VmaAllocation aAllocation ) noexcept
+	{
+		VmaAllocationInfo info{};
+		vmaGetAllocationInfo( aAllocator, aAllocation, &info );
+		return static_cast<Relocatable_*>(info.pUserData);
+	}
+
+	constexpr VkBufferUsageFlags kBufferCopyUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	constexpr VkImageUsageFlags kImageCopyUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	bool can_move_( Relocatable_ const* aRecord ) noexcept
+	{
+		if( !aRecord || !aRecord->movable )
+			return false;
+
+		if( VK_NULL_HANDLE != aRecord->buffer )
+			return kBufferCopyUsage == (aRecord->bufferInfo.usage & kBufferCopyUsage);
+
+		return kImageCopyUsage == (aRecord->imageInfo.usage & kImageCopyUsage);
+	}
+
+	void record_image_move_( VkCommandBuffer aCmdBuff, Relocatable_ const& aRecord, VkImage aDst )
+	{
+		auto const& info = aRecord.imageInfo;
+		VkImageSubresourceRange const range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, info.mipLevels, 0, info.arrayLayers };
+
+		// Earlier frames may still sample the source
+		labutils::image_barrier( aCmdBuff, aRecord.image,
+			0, VK_ACCESS_TRANSFER_READ_BIT,
+			aRecord.layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			range
+		);
+		labutils::image_barrier( aCmdBuff, aDst,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			range
+		);
+
+		std::vector<VkImageCopy> copies( info.mipLevels );
+		for( std::uint32_t level = 0; level < info.mipLevels; ++level )
+		{
+			auto& copy = copies[level];
+			copy.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, info.arrayLayers };
+			copy.dstSubresource = copy.srcSubresource;
+			copy.extent = VkExtent3D{
+				std::max( 1u, info.extent.width >> level ),
+				std::max( 1u, info.extent.height >> level ),
+				std::max( 1u, info.extent.depth >> level )
+			};
+		}
+
+		vkCmdCopyImage( aCmdBuff, aRecord.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, aDst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, std::uint32_t(copies.size()), copies.data() );
+
+		labutils::image_barrier( aCmdBuff, aDst,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, aRecord.layout,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			range
+		);
+	}
+}
+
+namespace labutils
+{
+	void allow_moves( Allocator const& aAllocator, Buffer const& aBuffer )
+	{
+		if( auto* record = relocatable_( aAllocator.allocator, aBuffer.allocation ) )
+			record->movable = true;
+	}
+	void allow_moves( Allocator const& aAllocator, Image const& aImage, VkImageLayout aLayout )
+	{
+		if( auto* record = relocatable_( aAllocator.allocator, aImage.allocation ) )
+		{
+			record->layout = aLayout;
+			record->movable = true;
+		}
+	}
+
+	void track_relocatable( VmaAllocator aAllocator, VmaAllocation aAllocation, VkBuffer aBuffer, VkBufferCreateInfo const& aInfo )
+	{
+		auto* record = new Relocatable_{};
+		record->buffer = aBuffer;
+		record->bufferInfo = aInfo;
+		record->bufferInfo.pNext = nullptr;
+		record->bufferInfo.queueFamilyIndexCount = 0;
+		record->bufferInfo.pQueueFamilyIndices = nullptr;
+
+		vmaSetAllocationUserData( aAllocator, aAllocation, record );
+	}
+	void track_relocatable( VmaAllocator aAllocator, VmaAllocation aAllocation, VkImage aImage, VkImageCreateInfo const& aInfo )
+	{
+		auto* record = new Relocatable_{};
+		record->image = aImage;
+		record->imageInfo = aInfo;
+		record->imageInfo.pNext = nullptr;
+		record->imageInfo.queueFamilyIndexCount = 0;
+		record->imageInfo.pQueueFamilyIndices = nullptr;
+
+		vmaSetAllocationUserData( aAllocator, aAllocation, record );
+	}
+
+	void release_relocatable( VmaAllocator aAllocator, VmaAllocation aAllocation ) noexcept
+	{
+		if( auto* record = relocatable_( aAllocator, aAllocation ) )
+		{
+			vmaSetAllocationUserData( aAllocator, aAllocation, nullptr );
+			delete record;
+		}
+	}
+}
+
+namespace labutils
+{
+	Defragmenter::Defragmenter( VulkanContext const& aContext, Allocator const& aAllocator, VkDeviceSize aBytesPerStep )
+		: mContext( &aContext )
+		, mAllocator( &aAllocator )
+		, mBytesPerStep( aBytesPerStep )
+	{
+		assert( aBytesPerStep > 0 );
+	}
+
+	Defragmenter::~Defragmenter()
+	{
+		if( VK_NULL_HANDLE != mDefrag )
+			vmaEndDefragmentation( mAllocator->allocator, mDefrag, nullptr );
+	}
+
+	VkDeviceSize Defragmenter::reclaimable( EMemoryClass aClass ) const
+	{
+		if( aClass < EMemoryClass::geometry )
+			return 0;
+
+		auto const pool = mAllocator->pools[std::size_t(aClass) - std::size_t(EMemoryClass::geometry)];
+		if( VK_NULL_HANDLE == pool )
+			return 0;
+
+		VmaStatistics stats{};
+		vmaGetPoolStatistics( mAllocator->allocator, pool, &stats );
+
+		// Only worth it if the allocations fit into fewer blocks
+		if( stats.blockCount < 2 )
+			return 0;
+
+		auto const unused = stats.blockBytes - stats.allocationBytes;
+		return unused >= stats.blockBytes / stats.blockCount ? unused : 0;
+	}
+
+	bool Defragmenter::begin( EMemoryClass aClass )
+	{
+		if( VK_NULL_HANDLE != mDefrag || aClass < EMemoryClass::geometry )
+			return false;
+
+		auto const pool = mAllocator->pools[std::size_t(aClass) - std::size_t(EMemoryClass::geometry)];
+		if( VK_NULL_HANDLE == pool )
+			return false;
+
+		VmaDefragmentationInfo info{};
+		info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+		info.pool = pool;
+		info.maxBytesPerPass = mBytesPerStep;
+
+		if( auto const res = vmaBeginDefragmentation( mAllocator->allocator, &info, &mDefrag ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to begin defragmentation\n" "vmaBeginDefragmentation() returned %s", to_string(res).c_str() );
+		}
+
+		mClass = aClass;
+		mSteps = 0;
+		return true;
+	}
+
+	bool Defragmenter::active() const noexcept
+	{
+		return VK_NULL_HANDLE != mDefrag;
+	}
+
+	void Defragmenter::step( VkCommandPool aCmdPool, Patch const& aPatch, Timeline* aTimeline )
+	{
+		assert( active() );
+
+		VmaAllocator const allocator = mAllocator->allocator;
+
+		VmaDefragmentationPassMoveInfo pass{};
+		if( auto const res = vmaBeginDefragmentationPass( allocator, mDefrag, &pass ); VK_SUCCESS == res )
+		{
+			end_();
+			return;
+		}
+		else if( VK_INCOMPLETE != res )
+		{
+			throw Error( "Unable to begin defragmentation pass\n" "vmaBeginDefragmentationPass() returned %s", to_string(res).c_str() );
+		}
+
+		VkCommandBuffer cbuff = alloc_command_buffer( *mContext, aCmdPool );
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if( auto const res = vkBeginCommandBuffer( cbuff, &beginInfo ); VK_SUCCESS != res )
+		{
+			throw Error( "Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		// Recreate each moved resource in its new place, and copy it there
+		std::vector<Move> moves;
+		moves.reserve( pass.moveCount );
+
+		bool copiedBuffers = false;
+		for( std::uint32_t i = 0; i < pass.moveCount; ++i )
+		{
+			auto& move = pass.pMoves[i];
+			auto* record = relocatable_( allocator, move.srcAllocation );
+			if( !can_move_( record ) )
+			{
+				move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+				continue;
+			}
+
+			auto& done = moves.emplace_back();
+			done.allocation = move.srcAllocation;
+
+			if( VK_NULL_HANDLE != record->buffer )
+			{
+				if( auto const res = vkCreateBuffer( mContext->device, &record->bufferInfo, nullptr, &done.buffer ); VK_SUCCESS != res )
+					throw Error( "Unable to create buffer\n" "vkCreateBuffer() returned %s", to_string(res).c_str() );
+				if( auto const res = vmaBindBufferMemory( allocator, move.dstTmpAllocation, done.buffer ); VK_SUCCESS != res )
+					throw Error( "Unable to bind buffer memory\n" "vmaBindBufferMemory() returned %s", to_string(res).c_str() );
+
+				VkBufferCopy copy{};
+				copy.size = record->bufferInfo.size;
+				vkCmdCopyBuffer( cbuff, record->buffer, done.buffer, 1, &copy );
+
+				done.oldBuffer = record->buffer;
+				copiedBuffers = true;
+			}
+			else
+			{
+				if( auto const res = vkCreateImage( mContext->device, &record->imageInfo, nullptr, &done.image ); VK_SUCCESS != res )
+					throw Error( "Unable to create image\n" "vkCreateImage() returned %s", to_string(res).c_str() );
+				if( auto const res = vmaBindImageMemory( allocator, move.dstTmpAllocation, done.image ); VK_SUCCESS != res )
+					throw Error( "Unable to bind image memory\n" "vmaBindImageMemory() returned %s", to_string(res).c_str() );
+
+				record_image_move_( cbuff, *record, done.image );
+
+				done.oldImage = record->image;
+			}
+		}
+
+		if( copiedBuffers )
+		{
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+			vkCmdPipelineBarrier( cbuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+		}
+
+		if( auto const res = vkEndCommandBuffer( cbuff ); VK_SUCCESS != res )
+		{
+			throw Error( "Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cbuff;
+
+		std::uint64_t const copied = aTimeline ? aTimeline->signal() : 0;
+		std::optional<TimelineSignal> signal;
+		if( aTimeline )
+			signal.emplace( *aTimeline, submitInfo, copied );
+
+		if( auto const res = vkQueueSubmit( mContext->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE ); VK_SUCCESS != res )
+		{
+			throw Error( "Submitting defragmentation copies\n" "vkQueueSubmit() returned %s", to_string(res).c_str() );
+		}
+
+		// The old resources may be referenced by any frame in flight. The
+		// copies' value is signalled after everything submitted before them.
+		if( aTimeline )
+		{
+			aTimeline->wait( copied );
+		}
+		else if( auto const res = vkDeviceWaitIdle( mContext->device ); VK_SUCCESS != res )
+		{
+			throw Error( "Waiting for defragmentation copies\n" "vkDeviceWaitIdle() returned %s", to_string(res).c_str() );
+		}
+
+		vkFreeCommandBuffers( mContext->device, aCmdPool, 1, &cbuff );
+
+		// The allocations now refer to the new places
+		auto const passRes = vmaEndDefragmentationPass( allocator, mDefrag, &pass );
+		++mSteps;
+
+		if( !moves.empty() )
+			aPatch( moves );
+
+		for( auto const& move : moves )
+		{
+			auto* record = relocatable_( allocator, move.allocation );
+			assert( record );
+
+			if( VK_NULL_HANDLE != move.buffer )
+			{
+				vkDestroyBuffer( mContext->device, move.oldBuffer, nullptr );
+				record->buffer = move.buffer;
+			}
+			else
+			{
+				vkDestroyImage( mContext->device, move.oldImage, nullptr );
+				record->image = move.image;
+			}
+		}
+
+		if( VK_SUCCESS == passRes )
+			end_();
+		else if( VK_INCOMPLETE != passRes )
+			throw Error( "Unable to end defragmentation pass\n" "vmaEndDefragmentationPass() returned %s", to_string(passRes).c_str() );
+	}
+
+	void Defragmenter::end_()
+	{
+		VmaDefragmentationStats stats{};
+		vmaEndDefragmentation( mAllocator->allocator, mDefrag, &stats );
+		mDefrag = VK_NULL_HANDLE;
+
+		char const* const names[kMemoryPoolCount] = { "geometry", "textures", "render target", "staging" };
+		std::fprintf( stderr, "Info: defragmented the %s pool in %u steps: moved %u allocations (%.1f MiB), freed %u blocks (%.1f MiB)\n",
+			names[std::size_t(mClass) - std::size_t(EMemoryClass::geometry)], mSteps,
+			stats.allocationsMoved, stats.bytesMoved / (1024.0 * 1024.0),
+			stats.deviceMemoryBlocksFreed, stats.bytesFreed / (1024.0 * 1024.0)
+		);
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <volk/volk.h>
+#include <vk_mem_alloc.h>
+
+#include <vector>
+#include <functional>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkimage.hpp"
+#include "vkbuffer.hpp"
+#include "timeline.hpp"
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Buffers and images that create_buffer() and create_image() place in a
+	// custom pool remember how they were created (as their allocation's user
+	// data), so that they can be recreated elsewhere. They are only moved
+	// once their owner allows it, i.e., once their contents are final and no
+	// other thread records commands for them. Moving needs the
+	// TRANSFER_SRC and TRANSFER_DST usages; resources without them stay
+	// where they are.
+	void allow_moves( Allocator const&, Buffer const& );
+	void allow_moves( Allocator const&, Image const&, VkImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+
+	// Incremental defragmentation of the custom pools (see EMemoryClass),
+	// one pool at a time. Each step() moves at most the given number of
+	// bytes: it recreates the moved resources in their new place, copies
+	// their contents on the graphics queue, and hands the new handles to the
+	// caller, which must replace every use of the old ones (views,
+	// descriptors, recorded command buffers).
+	class Defragmenter
+	{
+		public:
+			// A moved resource; allocation stays the same, and now refers to
+			// the new buffer or image.
+			struct Move
+			{
+				VmaAllocation allocation = VK_NULL_HANDLE;
+				VkBuffer oldBuffer = VK_NULL_HANDLE, buffer = VK_NULL_HANDLE;
+				VkImage oldImage = VK_NULL_HANDLE, image = VK_NULL_HANDLE;
+			};
+
+			using Patch = std::function<void(std::vector<Move> const&)>;
+
+		public:
+			Defragmenter( VulkanContext const&, Allocator const&, VkDeviceSize aBytesPerStep );
+			~Defragmenter(); // ends a defragmentation in progress
+
+			Defragmenter( Defragmenter const& ) = delete;
+			Defragmenter& operator= (Defragmenter const&) = delete;
+
+		public:
+			// Unused bytes of aClass's pool, if it has blocks that could be
+			// freed by defragmenting it (0 otherwise).
+			VkDeviceSize reclaimable( EMemoryClass ) const;
+
+			// Starts defragmenting aClass's pool. Returns false if it has no
+			// pool, or if a defragmentation is running already.
+			bool begin( EMemoryClass );
+			bool active() const noexcept;
+
+			// One pass. Waits for the copies, and for the device to go idle,
+			// so that nothing uses the old resources any more; aPatch is then
+			// called with the moves, and the old handles are destroyed once
+			// it returns. Ends the defragmentation when there is nothing
+			// left to move, and prints what it achieved. With aTimeline (of
+			// the graphics queue), the copies signal its next value, and
+			// only that is waited for rather than the whole device.
+			void step( VkCommandPool, Patch const& aPatch, Timeline* aTimeline = nullptr );
+
+		private:
+			void end_();
+
+		private:
+			VulkanContext const* mContext;
+			Allocator const* mAllocator;
+			VkDeviceSize mBytesPerStep;
+
+			VmaDefragmentationContext mDefrag = VK_NULL_HANDLE;
+			EMemoryClass mClass = EMemoryClass::device;
+			std::uint32_t mSteps = 0;
+	};
+
+	// Used by create_buffer() and create_image(), and by the destructors of
+	// Buffer and Image.
+	void track_relocatable( VmaAllocator, VmaAllocation, VkBuffer, VkBufferCreateInfo const& );
+	void track_relocatable( VmaAllocator, VmaAllocation, VkImage, VkImageCreateInfo const& );
+	void release_relocatable( VmaAllocator, VmaAllocation ) noexcept;
+}
@@ -0,0 +1,170 @@
+#include "descriptor_allocator.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	namespace lut = labutils;
+
+	std::vector<lut::DescriptorAllocator::PoolRatio> const kDefaultRatios = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f },
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1.f }
+	};
+
+	// Devices with ray queries get a few acceleration structures too (the
+	// scene set's TLAS); one per pool covers them
+	std::vector<lut::DescriptorAllocator::PoolRatio> default_ratios_( lut::VulkanContext const& aContext )
+	{
+		auto ret = kDefaultRatios;
+		if( aContext.caps.rayQuery )
+			ret.emplace_back( lut::DescriptorAllocator::PoolRatio{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 0.f } );
+		return ret;
+	}
+
+	bool pool_exhausted_( VkResult aResult )
+	{
+		return VK_ERROR_OUT_OF_POOL_MEMORY == aResult || VK_ERROR_FRAGMENTED_POOL == aResult;
+	}
+}
+
+namespace labutils
+{
+	DescriptorAllocator::DescriptorAllocator( VulkanContext const& aContext, std::uint32_t aFirstPoolSets, std::vector<PoolRatio> aRatios )
+		: mContext( &aContext )
+		, mRatios( aRatios.empty() ? default_ratios_( aContext ) : std::move(aRatios) )
+		, mNextPoolSets( std::clamp( aFirstPoolSets, 1u, kMaxSetsPerPool ) )
+	{}
+
+	VkDescriptorSet DescriptorAllocator::allocate( VkDescriptorSetLayout aLayout, std::uint32_t aVariableCount )
+	{
+		if( mPools.empty() )
+			next_pool_( 0 );
+
+		VkDescriptorSet ret = VK_NULL_HANDLE;
+		auto res = try_allocate_( mPools.back().handle, aLayout, aVariableCount, 1, &ret );
+
+		// A fresh pool of the usual size, then one with room for the variable
+		// size binding
+		if( pool_exhausted_( res ) )
+		{
+			next_pool_( 0 );
+			res = try_allocate_( mPools.back().handle, aLayout, aVariableCount, 1, &ret );
+		}
+		if( pool_exhausted_( res ) && aVariableCount )
+		{
+			next_pool_( aVariableCount );
+			res = try_allocate_( mPools.back().handle, aLayout, aVariableCount, 1, &ret );
+		}
+
+		if( VK_SUCCESS != res )
+			throw Error( "Unable to allocate descriptor set\n" "vkAllocateDescriptorSets() returned %s", to_string(res).c_str() );
+
+		return ret;
+	}
+
+	std::vector<VkDescriptorSet> DescriptorAllocator::allocate_sets( VkDescriptorSetLayout aLayout, std::size_t aCount )
+	{
+		std::vector<VkDescriptorSet> ret( aCount, VK_NULL_HANDLE );
+		if( 0 == aCount )
+			return ret;
+
+		if( mPools.empty() )
+			next_pool_( 0 );
+
+		auto const res = try_allocate_( mPools.back().handle, aLayout, 0, std::uint32_t(aCount), ret.data() );
+		if( VK_SUCCESS == res )
+			return ret;
+
+		if( !pool_exhausted_( res ) )
+			throw Error( "Unable to allocate descriptor sets\n" "vkAllocateDescriptorSets() returned %s", to_string(res).c_str() );
+
+		// Spread over several pools
+		for( auto& set : ret )
+			set = allocate( aLayout );
+
+		return ret;
+	}
+
+	void DescriptorAllocator::reset()
+	{
+		for( auto& pool : mPools )
+		{
+			vkResetDescriptorPool( mContext->device, pool.handle, 0 );
+			mFree.emplace_back( std::move(pool) );
+		}
+
+		mPools.clear();
+	}
+
+	std::size_t DescriptorAllocator::pool_count() const noexcept
+	{
+		return mPools.size() + mFree.size();
+	}
+
+	VkResult DescriptorAllocator::try_allocate_( VkDescriptorPool aPool, VkDescriptorSetLayout aLayout, std::uint32_t aVariableCount, std::uint32_t aCount, VkDescriptorSet* aOut )
+	{
+		assert( 1 == aCount || 0 == aVariableCount );
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{};
+		countInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+		countInfo.descriptorSetCount = 1;
+		countInfo.pDescriptorCounts = &aVariableCount;
+
+		std::vector<VkDescriptorSetLayout> const layouts( aCount, aLayout );
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = aVariableCount ? &countInfo : nullptr;
+		allocInfo.descriptorPool = aPool;
+		allocInfo.descriptorSetCount = aCount;
+		allocInfo.pSetLayouts = layouts.data();
+
+		return vkAllocateDescriptorSets( mContext->device, &allocInfo, aOut );
+	}
+
+	void DescriptorAllocator::next_pool_( std::uint32_t aExtraDescriptors )
+	{
+		if( 0 == aExtraDescriptors && !mFree.empty() )
+		{
+			mPools.emplace_back( std::move(mFree.back()) );
+			mFree.pop_back();
+			return;
+		}
+
+		std::uint32_t const sets = mNextPoolSets;
+		mNextPoolSets = std::min( mNextPoolSets * 2, kMaxSetsPerPool );
+
+		// The variable size binding may share its type with other bindings
+		std::vector<VkDescriptorPoolSize> sizes;
+		for( auto const& ratio : mRatios )
+		{
+			auto const count = std::max( 1u, std::uint32_t(ratio.perSet * float(sets)) );
+			sizes.emplace_back( VkDescriptorPoolSize{ ratio.type, count + aExtraDescriptors } );
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = sets;
+		poolInfo.poolSizeCount = std::uint32_t(sizes.size());
+		poolInfo.pPoolSizes = sizes.data();
+
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorPool( mContext->device, &poolInfo, nullptr, &pool ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create descriptor pool\n" "vkCreateDescriptorPool() returned %s", to_string(res).c_str() );
+		}
+
+		mPools.emplace_back( DescriptorPool( mContext->device, pool ) );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Descriptor sets from a growing list of pools. allocate() takes sets
+	// from the current pool; when that one runs out
+	// (VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL), it moves on
+	// to a new pool, each twice the size of the previous one (up to
+	// kMaxSetsPerPool sets). So there is no fixed limit on the number of
+	// sets, as with a single create_descriptor_pool().
+	//
+	// Pools are sized by the descriptors a typical set needs: per set, each
+	// PoolRatio's count of descriptors of its type. Sets are never freed
+	// individually. reset() returns all sets at once and keeps the pools
+	// for reuse, e.g., for transient sets with one allocator per frame in
+	// flight, reset once that frame's fence has signalled.
+	//
+	// Not thread safe.
+	class DescriptorAllocator
+	{
+		public:
+			struct PoolRatio
+			{
+				VkDescriptorType type;
+				float perSet;
+			};
+
+			static constexpr std::uint32_t kMaxSetsPerPool = 4096;
+
+		public:
+			// An empty aRatios uses the defaults, for a mix of textures,
+			// uniform and storage buffers, storage images and input
+			// attachments. No pool is created until the first allocate().
+			explicit DescriptorAllocator( VulkanContext const&, std::uint32_t aFirstPoolSets = 256, std::vector<PoolRatio> aRatios = {} );
+
+			DescriptorAllocator( DescriptorAllocator&& ) noexcept = default;
+			DescriptorAllocator& operator= (DescriptorAllocator&&) noexcept = default;
+
+		public:
+			// aVariableCount is the descriptor count of the set's variable
+			// size binding (VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT),
+			// if it has one. Sets that don't fit into a pool of the usual size
+			// get a larger pool. Throws labutils::Error on other failures.
+			VkDescriptorSet allocate( VkDescriptorSetLayout, std::uint32_t aVariableCount = 0 );
+
+			// aCount sets with the same layout (without a variable size
+			// binding); one vkAllocateDescriptorSets() if they fit into the
+			// current pool.
+			std::vector<VkDescriptorSet> allocate_sets( VkDescriptorSetLayout, std::size_t aCount );
+
+			// Invalidates all sets allocated so far.
+			void reset();
+
+			std::size_t pool_count() const noexcept;
+
+		private:
+			VkResult try_allocate_( VkDescriptorPool, VkDescriptorSetLayout, std::uint32_t aVariableCount, std::uint32_t aCount, VkDescriptorSet* aOut );
+
+			// Makes a pool current: a free one if there is any, otherwise a
+			// new one. aExtraDescriptors of each type are added to its usual
+			// size (and free pools are then skipped).
+			void next_pool_( std::uint32_t aExtraDescriptors );
+
+		private:
+			VulkanContext const* mContext;
+			std::vector<PoolRatio> mRatios;
+
+			std::uint32_t mNextPoolSets;
+			std::vector<DescriptorPool> mPools; // the last one is current
+			std::vector<DescriptorPool> mFree;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
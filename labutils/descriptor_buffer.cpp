@@ -0,0 +1,235 @@
+#include "descriptor_buffer.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+
+namespace labutils
+{
+	DescriptorBuffer::DescriptorBuffer() noexcept = default;
+
+	DescriptorBuffer::DescriptorBuffer( VulkanContext const& aContext, Allocator const& aAllocator, VkDeviceSize aBytes )
+		: mDevice( aContext.device )
+	{
+		if( !aContext.caps.descriptorBuffer )
+			throw Error( "DescriptorBuffer: the device doesn't support descriptor buffers" );
+		if( !aAllocator.deviceAddresses )
+			throw Error( "DescriptorBuffer: the allocator must be created with AllocatorConfig::deviceAddresses" );
+
+		mProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 props{};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &mProps;
+		vkGetPhysicalDeviceProperties2( aContext.physicalDevice, &props );
+		mProps.pNext = nullptr;
+
+		// create_device() enables all supported core features
+		VkPhysicalDeviceFeatures features{};
+		vkGetPhysicalDeviceFeatures( aContext.physicalDevice, &features );
+		mRobust = VK_TRUE == features.robustBufferAccess;
+
+		// The buffer holds samplers (of combined image samplers) and
+		// resources alike, so both ranges apply
+		VkDeviceSize const limit = std::min( {
+			mProps.maxSamplerDescriptorBufferRange, mProps.maxResourceDescriptorBufferRange,
+			mProps.samplerDescriptorBufferAddressSpaceSize, mProps.resourceDescriptorBufferAddressSpaceSize,
+			mProps.descriptorBufferAddressSpaceSize
+		} );
+		if( aBytes > limit )
+			throw Error( "DescriptorBuffer: %llu bytes exceed the device's limit of %llu", (unsigned long long)aBytes, (unsigned long long)limit );
+
+		mUsage = VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+		mBuffer = create_buffer( aAllocator, std::max( aBytes, VkDeviceSize(1) ), mUsage, EMemoryClass::upload, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+		mMapped = mapped_data( aAllocator, mBuffer );
+
+		VkBufferDeviceAddressInfo addressInfo{};
+		addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		addressInfo.buffer = mBuffer.buffer;
+		mAddress = vkGetBufferDeviceAddress( mDevice, &addressInfo );
+	}
+
+	VkDeviceSize DescriptorBuffer::set_size( VkDescriptorSetLayout aLayout ) const
+	{
+		VkDeviceSize ret = 0;
+		vkGetDescriptorSetLayoutSizeEXT( mDevice, aLayout, &ret );
+		return ret;
+	}
+	VkDeviceSize DescriptorBuffer::set_size( VkDescriptorSetLayout aLayout, std::uint32_t aLastBinding, VkDescriptorType aType, std::uint32_t aCount ) const
+	{
+		VkDeviceSize offset = 0;
+		vkGetDescriptorSetLayoutBindingOffsetEXT( mDevice, aLayout, aLastBinding, &offset );
+		return offset + VkDeviceSize(aCount) * descriptor_size_( aType );
+	}
+
+	VkDeviceSize DescriptorBuffer::allocate( VkDeviceSize aBytes )
+	{
+		VkDeviceSize const alignment = mProps.descriptorBufferOffsetAlignment;
+		VkDeviceSize const start = (mUsed + alignment - 1) / alignment * alignment;
+		if( start + aBytes > mBuffer.size )
+		{
+			throw Error( "DescriptorBuffer: no room for a set of %llu bytes (%llu of %llu used)",
+				(unsigned long long)aBytes, (unsigned long long)mUsed, (unsigned long long)mBuffer.size );
+		}
+
+		mUsed = start + aBytes;
+		return start;
+	}
+
+	void DescriptorBuffer::write( VkDeviceSize aSet, VkDescriptorSetLayout aLayout, std::uint32_t aCount, VkWriteDescriptorSet const* aWrites ) const
+	{
+		assert( mMapped );
+
+		VkDeviceSize begin = ~VkDeviceSize(0), end = 0;
+		for( std::uint32_t i = 0; i < aCount; ++i )
+		{
+			auto const& write = aWrites[i];
+			std::size_t const size = descriptor_size_( write.descriptorType );
+
+			VkDeviceSize binding = 0;
+			vkGetDescriptorSetLayoutBindingOffsetEXT( mDevice, aLayout, write.dstBinding, &binding );
+			VkDeviceSize const first = aSet + binding + write.dstArrayElement * size;
+
+			VkWriteDescriptorSetAccelerationStructureKHR const* structures = nullptr;
+			for( auto const* next = static_cast<VkBaseInStructure const*>(write.pNext); next; next = next->pNext )
+			{
+				if( VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR == next->sType )
+					structures = reinterpret_cast<VkWriteDescriptorSetAccelerationStructureKHR const*>(next);
+			}
+
+			for( std::uint32_t j = 0; j < write.descriptorCount; ++j )
+			{
+				VkDescriptorGetInfoEXT info{};
+				info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+				info.type = write.descriptorType;
+
+				VkDescriptorAddressInfoEXT address{};
+				address.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+
+				switch( write.descriptorType )
+				{
+					case VK_DESCRIPTOR_TYPE_SAMPLER:
+						info.data.pSampler = &write.pImageInfo[j].sampler;
+						break;
+					case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+						info.data.pCombinedImageSampler = &write.pImageInfo[j];
+						break;
+					case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+						info.data.pSampledImage = &write.pImageInfo[j];
+						break;
+					case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+						info.data.pStorageImage = &write.pImageInfo[j];
+						break;
+					case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+						info.data.pInputAttachmentImage = &write.pImageInfo[j];
+						break;
+
+					case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+					case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+					{
+						auto const& buffer = write.pBufferInfo[j];
+						if( VK_WHOLE_SIZE == buffer.range )
+							throw Error( "DescriptorBuffer: binding %u needs an explicit buffer range", write.dstBinding );
+
+						VkBufferDeviceAddressInfo addressInfo{};
+						addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+						addressInfo.buffer = buffer.buffer;
+						address.address = vkGetBufferDeviceAddress( mDevice, &addressInfo ) + buffer.offset;
+						address.range = buffer.range;
+
+						if( VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER == write.descriptorType )
+							info.data.pUniformBuffer = &address;
+						else
+							info.data.pStorageBuffer = &address;
+					} break;
+
+					case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+					{
+						if( !structures || j >= structures->accelerationStructureCount )
+							throw Error( "DescriptorBuffer: binding %u lacks its acceleration structures", write.dstBinding );
+
+						VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
+						addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+						addressInfo.accelerationStructure = structures->pAccelerationStructures[j];
+						info.data.accelerationStructure = vkGetAccelerationStructureDeviceAddressKHR( mDevice, &addressInfo );
+					} break;
+
+					default:
+						throw Error( "DescriptorBuffer: can't write descriptors of type %d", int(write.descriptorType) );
+				}
+
+				VkDeviceSize const at = first + j * size;
+				assert( at + size <= mUsed );
+				vkGetDescriptorEXT( mDevice, &info, size, mMapped + at );
+
+				begin = std::min( begin, at );
+				end = std::max( end, at + size );
+			}
+		}
+
+		// The upload class may not be host coherent
+		if( end > begin )
+			vmaFlushAllocation( mBuffer.allocator(), mBuffer.allocation, begin, end - begin );
+	}
+
+	void DescriptorBuffer::bind( VkCommandBuffer aCmdBuff ) const
+	{
+		VkDescriptorBufferBindingInfoEXT info{};
+		info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+		info.address = mAddress;
+		info.usage = mUsage;
+		vkCmdBindDescriptorBuffersEXT( aCmdBuff, 1, &info );
+	}
+
+	void DescriptorBuffer::bind_sets( VkCommandBuffer aCmdBuff, VkPipelineBindPoint aBindPoint, VkPipelineLayout aLayout, std::uint32_t aFirstSet, std::uint32_t aCount, VkDeviceSize const* aSets ) const
+	{
+		// All sets are in the one buffer, bound at index 0
+		constexpr std::uint32_t kMaxSets = 8;
+		assert( aCount <= kMaxSets );
+		std::uint32_t const indices[kMaxSets]{};
+		vkCmdSetDescriptorBufferOffsetsEXT( aCmdBuff, aBindPoint, aLayout, aFirstSet, aCount, indices, aSets );
+	}
+
+	VkDeviceSize DescriptorBuffer::used() const noexcept
+	{
+		return mUsed;
+	}
+	VkDeviceSize DescriptorBuffer::capacity() const noexcept
+	{
+		return mBuffer.size;
+	}
+
+	std::size_t DescriptorBuffer::descriptor_size_( VkDescriptorType aType ) const
+	{
+		switch( aType )
+		{
+			case VK_DESCRIPTOR_TYPE_SAMPLER:
+				return mProps.samplerDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+				return mProps.combinedImageSamplerDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+				return mProps.sampledImageDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+				return mProps.storageImageDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+				return mProps.inputAttachmentDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+				return mRobust ? mProps.robustUniformBufferDescriptorSize : mProps.uniformBufferDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+				return mRobust ? mProps.robustStorageBufferDescriptorSize : mProps.storageBufferDescriptorSize;
+			case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+				return mProps.accelerationStructureDescriptorSize;
+			default:
+				throw Error( "DescriptorBuffer: descriptors of type %d aren't supported", int(aType) );
+		}
+	}
+
+	VkDeviceSize descriptor_range( Buffer const& aBuffer ) noexcept
+	{
+		return 0 != aBuffer.size ? aBuffer.size : VK_WHOLE_SIZE;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
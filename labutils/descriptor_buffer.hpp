@@ -0,0 +1,103 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkbuffer.hpp"
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Descriptor sets kept in a buffer (VK_EXT_descriptor_buffer; see
+	// DeviceCapabilities::descriptorBuffer). A set is a range of a
+	// persistently mapped buffer, and writing its descriptors is a memory
+	// write: vkGetDescriptorEXT() puts them straight into the mapping. There
+	// are no pools to allocate sets from, and rewriting a few descriptors of
+	// a large set (e.g., as textures stream in) costs just those. As with
+	// descriptor sets, descriptors must not be rewritten while the GPU may
+	// read them.
+	//
+	// The layouts of the sets must be created with
+	// VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, and the
+	// pipelines that use them with VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT.
+	// Such pipelines take all of their sets from descriptor buffers, and
+	// their layouts can't have dynamic uniform or storage buffers (use a set
+	// per offset instead). Buffer descriptors address their buffers, which
+	// need SHADER_DEVICE_ADDRESS usage (see AllocatorConfig::deviceAddresses).
+	//
+	// Sets are allocated linearly and live as long as the buffer. Not
+	// thread safe.
+	class DescriptorBuffer
+	{
+		public:
+			DescriptorBuffer() noexcept;
+
+			// Throws labutils::Error if the device doesn't support
+			// descriptor buffers, if the allocator can't address buffers,
+			// or if aBytes exceeds the device's limits.
+			DescriptorBuffer( VulkanContext const&, Allocator const&, VkDeviceSize aBytes );
+
+			DescriptorBuffer( DescriptorBuffer const& ) = delete;
+			DescriptorBuffer& operator= (DescriptorBuffer const&) = delete;
+
+			DescriptorBuffer( DescriptorBuffer&& ) noexcept = default;
+			DescriptorBuffer& operator= (DescriptorBuffer&&) noexcept = default;
+
+		public:
+			// Bytes of a set of aLayout. The second form is for layouts
+			// whose last binding, aLastBinding, has a variable descriptor
+			// count: the size of a set with aCount descriptors of aType
+			// there.
+			VkDeviceSize set_size( VkDescriptorSetLayout ) const;
+			VkDeviceSize set_size( VkDescriptorSetLayout, std::uint32_t aLastBinding, VkDescriptorType aType, std::uint32_t aCount ) const;
+
+			// Reserves aBytes for a set, and returns its offset. Throws
+			// labutils::Error if the buffer is full.
+			VkDeviceSize allocate( VkDeviceSize aBytes );
+
+			// Writes descriptors of the set at aSet as vkUpdateDescriptorSets()
+			// would (dstSet is ignored). Buffer descriptors must have explicit
+			// ranges (not VK_WHOLE_SIZE). Throws labutils::Error for
+			// descriptor types other than samplers, images, input
+			// attachments, uniform and storage buffers and acceleration
+			// structures.
+			void write( VkDeviceSize aSet, VkDescriptorSetLayout, std::uint32_t aCount, VkWriteDescriptorSet const* ) const;
+
+			// Binds the buffer to aCmdBuff; needed once per command buffer
+			// (secondary ones included), before bind_sets()
+			void bind( VkCommandBuffer ) const;
+
+			// Binds the sets at aSets[0..aCount) to set numbers aFirstSet
+			// onwards of aLayout, as vkCmdBindDescriptorSets()
+			void bind_sets( VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, std::uint32_t aFirstSet, std::uint32_t aCount, VkDeviceSize const* aSets ) const;
+
+			VkDeviceSize used() const noexcept;
+			VkDeviceSize capacity() const noexcept;
+
+		private:
+			std::size_t descriptor_size_( VkDescriptorType ) const;
+
+		private:
+			VkDevice mDevice = VK_NULL_HANDLE;
+			Buffer mBuffer;
+			std::byte* mMapped = nullptr;
+			VkDeviceAddress mAddress = 0;
+			VkBufferUsageFlags mUsage = 0;
+			VkDeviceSize mUsed = 0;
+
+			// Of the device; buffer descriptors are larger with
+			// robustBufferAccess
+			VkPhysicalDeviceDescriptorBufferPropertiesEXT mProps{};
+			bool mRobust = false;
+	};
+
+	// The range of all of aBuffer for a buffer descriptor: its size if
+	// known (see Buffer::size), VK_WHOLE_SIZE otherwise. Descriptor buffers
+	// need the former; for descriptor sets the two are the same.
+	VkDeviceSize descriptor_range( Buffer const& ) noexcept;
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,36 @@
+#include "descriptor_template.hpp"
+
+#include <cstddef>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	DescriptorUpdateTemplate create_descriptor_update_template( VulkanContext const& aContext, VkDescriptorSetLayout aLayout, std::uint32_t aEntryCount, VkDescriptorUpdateTemplateEntry const* aEntries )
+	{
+		VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+		templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateInfo.descriptorUpdateEntryCount = aEntryCount;
+		templateInfo.pDescriptorUpdateEntries = aEntries;
+		templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateInfo.descriptorSetLayout = aLayout;
+
+		VkDescriptorUpdateTemplate handle = VK_NULL_HANDLE;
+		if( auto const res = vkCreateDescriptorUpdateTemplate( aContext.device, &templateInfo, nullptr, &handle ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create descriptor update template\n" "vkCreateDescriptorUpdateTemplate() returned %s", to_string(res).c_str() );
+		}
+
+		return DescriptorUpdateTemplate( aContext.device, handle );
+	}
+
+	void update_descriptor_sets( VulkanContext const& aContext, VkDescriptorUpdateTemplate aTemplate, std::size_t aCount, VkDescriptorSet const* aSets, void const* aData, std::size_t aStride )
+	{
+		auto const* data = static_cast<std::byte const*>(aData);
+		for( std::size_t i = 0; i < aCount; ++i )
+			vkUpdateDescriptorSetWithTemplate( aContext.device, aSets[i], aTemplate, data + i * aStride );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
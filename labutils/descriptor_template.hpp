@@ -0,0 +1,31 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Descriptor update templates (Vulkan 1.1): the writes to a set of a
+	// layout, described once by where each binding's VkDescriptorImageInfo
+	// or VkDescriptorBufferInfo lives in a struct of the caller's. Updating
+	// a set then reads the struct as it is, rather than an array of
+	// VkWriteDescriptorSet built (and validated) anew for every update. For
+	// many sets of a layout (e.g., one per material), keep one such struct
+	// per set in an array, and update them with update_descriptor_sets().
+	//
+	// The entries' offset and stride are in bytes, relative to the struct.
+
+	DescriptorUpdateTemplate create_descriptor_update_template( VulkanContext const&, VkDescriptorSetLayout, std::uint32_t aEntryCount, VkDescriptorUpdateTemplateEntry const* );
+
+	// Writes aSets[i] from the struct at aData + i*aStride, for i in
+	// [0, aCount). The sets must not be in use by the GPU, as with
+	// vkUpdateDescriptorSets().
+	void update_descriptor_sets( VulkanContext const&, VkDescriptorUpdateTemplate, std::size_t aCount, VkDescriptorSet const* aSets, void const* aData, std::size_t aStride );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
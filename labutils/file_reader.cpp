@@ -0,0 +1,637 @@
+#include "file_reader.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/uio.h>
+#	include <sys/stat.h>
+#	if defined(__linux__)
+#		include <sys/mman.h>
+#		include <sys/syscall.h>
+#		include <linux/io_uring.h>
+#	endif
+#endif
+
+#include "error.hpp"
+#include "texture_pack.hpp"
+#include "cpu_zones.hpp"
+
+namespace labutils
+{
+	namespace
+	{
+		struct File_
+		{
+			std::string path;
+			TaskSource<MappedFile> result;
+
+#			if defined(_WIN32)
+			HANDLE handle = INVALID_HANDLE_VALUE;
+#			else
+			int fd = -1;
+#			endif
+
+			// In a mounted texture pack: the file's offset in it; the handle
+			// is then the pack's, which the backend keeps open
+			bool packed = false;
+			std::uint64_t base = 0;
+
+			std::unique_ptr<std::uint8_t[]> data;
+			std::size_t size = 0;
+
+			std::size_t submitted = 0; // bytes
+			std::size_t arrived = 0; // bytes
+			std::size_t inFlight = 0; // reads
+			std::string error; // non-empty: failed; no further reads
+		};
+
+		struct Slot_
+		{
+#			if defined(_WIN32)
+			OVERLAPPED overlapped; // first, see Backend_::wait()
+#			else
+			iovec iov;
+#			endif
+
+			File_* file = nullptr;
+			std::size_t offset = 0, bytes = 0;
+		};
+
+		struct Completion_
+		{
+			std::size_t slot;
+			std::int64_t result; // bytes, or -error code
+		};
+
+		std::string error_string_( std::int64_t aCode )
+		{
+#			if defined(_WIN32)
+			char buffer[32];
+			std::snprintf( buffer, sizeof(buffer), "error %lld", static_cast<long long>(aCode) );
+			return buffer;
+#			else
+			return std::strerror( int(aCode) );
+#			endif
+		}
+	}
+
+	struct FileReader::Backend_
+	{
+		explicit Backend_( EFileIo, std::size_t aQueueDepth );
+		~Backend_();
+
+		char const* name() const noexcept;
+
+		// Throws on failure
+		void open( File_& );
+		void close( File_& );
+
+		void submit( std::vector<Slot_>&, std::size_t aSlot );
+
+		// Returns once at least one submitted read has completed
+		void wait( std::vector<Slot_>&, std::vector<Completion_>& );
+
+		bool asynchronous = false;
+		std::vector<Completion_> immediate; // blocking reads, failed submissions
+
+		// Open packs, by path (see texture_pack.hpp); until destruction
+#		if defined(_WIN32)
+		std::unordered_map<std::string,HANDLE> packs;
+		HANDLE open_file_( std::string const& aPath, std::size_t& aSize );
+#		else
+		std::unordered_map<std::string,int> packs;
+		int open_file_( std::string const& aPath, std::size_t& aSize );
+#		endif
+
+#		if defined(__linux__)
+		int ring = -1;
+		void* sqMap = MAP_FAILED;
+		void* cqMap = MAP_FAILED;
+		void* sqeMap = MAP_FAILED;
+		std::size_t sqBytes = 0, cqBytes = 0, sqeBytes = 0;
+
+		unsigned* sqTail = nullptr;
+		unsigned* sqMask = nullptr;
+		unsigned* sqArray = nullptr;
+		unsigned* cqHead = nullptr;
+		unsigned* cqTail = nullptr;
+		unsigned* cqMask = nullptr;
+		io_uring_sqe* sqes = nullptr;
+		io_uring_cqe* cqes = nullptr;
+		unsigned toSubmit = 0;
+#		elif defined(_WIN32)
+		HANDLE port = nullptr;
+#		endif
+	};
+
+	FileReader::Backend_::Backend_( EFileIo aIo, std::size_t aQueueDepth )
+	{
+		if( EFileIo::blocking == aIo )
+			return;
+
+#		if defined(__linux__)
+		io_uring_params params{};
+		int const fd = int(syscall( __NR_io_uring_setup, unsigned(aQueueDepth), &params ));
+		if( fd < 0 )
+			return; // ENOSYS, EPERM (seccomp), ...
+
+		ring = fd;
+		sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+
+		sqMap = mmap( nullptr, sqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING );
+		cqMap = mmap( nullptr, cqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING );
+		sqeMap = mmap( nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES );
+		if( MAP_FAILED == sqMap || MAP_FAILED == cqMap || MAP_FAILED == sqeMap )
+			return; // the destructor cleans up
+
+		auto* const sq = static_cast<std::uint8_t*>(sqMap);
+		auto* const cq = static_cast<std::uint8_t*>(cqMap);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		sqes = static_cast<io_uring_sqe*>(sqeMap);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		asynchronous = true;
+#		elif defined(_WIN32)
+		port = CreateIoCompletionPort( INVALID_HANDLE_VALUE, nullptr, 0, 1 );
+		asynchronous = nullptr != port;
+#		else
+		(void)aQueueDepth;
+#		endif
+	}
+
+	FileReader::Backend_::~Backend_()
+	{
+		for( auto const& pack : packs )
+		{
+#			if defined(_WIN32)
+			CloseHandle( pack.second );
+#			else
+			::close( pack.second );
+#			endif
+		}
+
+#		if defined(__linux__)
+		if( MAP_FAILED != sqeMap )
+			munmap( sqeMap, sqeBytes );
+		if( MAP_FAILED != cqMap )
+			munmap( cqMap, cqBytes );
+		if( MAP_FAILED != sqMap )
+			munmap( sqMap, sqBytes );
+		if( -1 != ring )
+			::close( ring );
+#		elif defined(_WIN32)
+		if( port )
+			CloseHandle( port );
+#		endif
+	}
+
+	char const* FileReader::Backend_::name() const noexcept
+	{
+		if( !asynchronous )
+			return "blocking";
+
+#		if defined(_WIN32)
+		return "overlapped";
+#		else
+		return "io_uring";
+#		endif
+	}
+
+	void FileReader::Backend_::open( File_& aFile )
+	{
+		if( PackedFile packed; find_packed_file( aFile.path.c_str(), packed ) )
+		{
+			auto it = packs.find( packed.packPath );
+			if( packs.end() == it )
+			{
+				std::size_t packSize = 0;
+				it = packs.emplace( packed.packPath, open_file_( packed.packPath, packSize ) ).first;
+			}
+
+#			if defined(_WIN32)
+			aFile.handle = it->second;
+#			else
+			aFile.fd = it->second;
+#			endif
+			aFile.packed = true;
+			aFile.base = packed.offset;
+			aFile.size = std::size_t(packed.size);
+		}
+		else
+		{
+#			if defined(_WIN32)
+			aFile.handle = open_file_( aFile.path, aFile.size );
+#			else
+			aFile.fd = open_file_( aFile.path, aFile.size );
+#			endif
+		}
+
+		aFile.data.reset( new std::uint8_t[aFile.size ? aFile.size : 1] );
+	}
+
+#	if defined(_WIN32)
+	HANDLE FileReader::Backend_::open_file_( std::string const& aPath, std::size_t& aSize )
+	{
+		DWORD const flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | (asynchronous ? FILE_FLAG_OVERLAPPED : 0);
+		HANDLE const handle = CreateFileA( aPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr );
+		if( INVALID_HANDLE_VALUE == handle )
+			throw Error( "FileReader: unable to open '%s' for reading (error %lu)", aPath.c_str(), GetLastError() );
+
+		LARGE_INTEGER size;
+		if( !GetFileSizeEx( handle, &size ) )
+		{
+			auto const err = GetLastError();
+			CloseHandle( handle );
+			throw Error( "FileReader: unable to query size of '%s' (error %lu)", aPath.c_str(), err );
+		}
+
+		if( asynchronous && !CreateIoCompletionPort( handle, port, 0, 0 ) )
+		{
+			auto const err = GetLastError();
+			CloseHandle( handle );
+			throw Error( "FileReader: unable to associate '%s' with the completion port (error %lu)", aPath.c_str(), err );
+		}
+
+		aSize = std::size_t(size.QuadPart);
+		return handle;
+	}
+#	else
+	int FileReader::Backend_::open_file_( std::string const& aPath, std::size_t& aSize )
+	{
+		int const fd = ::open( aPath.c_str(), O_RDONLY | O_CLOEXEC );
+		if( -1 == fd )
+			throw Error( "FileReader: unable to open '%s' for reading: %s", aPath.c_str(), std::strerror(errno) );
+
+		struct stat st;
+		if( -1 == fstat( fd, &st ) )
+		{
+			int const err = errno;
+			::close( fd );
+			throw Error( "FileReader: unable to stat '%s': %s", aPath.c_str(), std::strerror(err) );
+		}
+
+#		if defined(POSIX_FADV_SEQUENTIAL)
+		posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#		endif
+
+		aSize = std::size_t(st.st_size);
+		return fd;
+	}
+#	endif
+
+	void FileReader::Backend_::close( File_& aFile )
+	{
+		if( aFile.packed )
+		{
+#			if defined(_WIN32)
+			aFile.handle = INVALID_HANDLE_VALUE;
+#			else
+			aFile.fd = -1;
+#			endif
+			return;
+		}
+
+#		if defined(_WIN32)
+		if( INVALID_HANDLE_VALUE != aFile.handle )
+			CloseHandle( std::exchange( aFile.handle, INVALID_HANDLE_VALUE ) );
+#		else
+		if( -1 != aFile.fd )
+			::close( std::exchange( aFile.fd, -1 ) );
+#		endif
+	}
+
+	void FileReader::Backend_::submit( std::vector<Slot_>& aSlots, std::size_t aSlot )
+	{
+		auto& slot = aSlots[aSlot];
+		auto* const dest = slot.file->data.get() + slot.offset;
+		std::uint64_t const at = slot.file->base + slot.offset; // in the file
+
+		if( !asynchronous )
+		{
+#			if defined(_WIN32)
+			OVERLAPPED position{};
+			position.Offset = DWORD(at);
+			position.OffsetHigh = DWORD(at >> 32);
+
+			DWORD got = 0;
+			if( !ReadFile( slot.file->handle, dest, DWORD(slot.bytes), &got, &position ) )
+				immediate.emplace_back( Completion_{ aSlot, -std::int64_t(GetLastError()) } );
+			else
+				immediate.emplace_back( Completion_{ aSlot, std::int64_t(got) } );
+#			else
+			ssize_t got;
+			do
+				got = pread( slot.file->fd, dest, slot.bytes, off_t(at) );
+			while( -1 == got && EINTR == errno );
+
+			immediate.emplace_back( Completion_{ aSlot, -1 == got ? -std::int64_t(errno) : std::int64_t(got) } );
+#			endif
+			return;
+		}
+
+#		if defined(__linux__)
+		slot.iov.iov_base = dest;
+		slot.iov.iov_len = slot.bytes;
+
+		unsigned const tail = *sqTail;
+		unsigned const index = tail & *sqMask;
+
+		auto& sqe = sqes[index];
+		std::memset( &sqe, 0, sizeof(sqe) );
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd = slot.file->fd;
+		sqe.off = at;
+		sqe.addr = reinterpret_cast<std::uint64_t>(&slot.iov);
+		sqe.len = 1;
+		sqe.user_data = aSlot;
+
+		sqArray[index] = index;
+		__atomic_store_n( sqTail, tail + 1, __ATOMIC_RELEASE );
+		++toSubmit;
+#		elif defined(_WIN32)
+		std::memset( &slot.overlapped, 0, sizeof(slot.overlapped) );
+		slot.overlapped.Offset = DWORD(at);
+		slot.overlapped.OffsetHigh = DWORD(at >> 32);
+
+		// Reads that complete right away still post their completion
+		if( !ReadFile( slot.file->handle, dest, DWORD(slot.bytes), nullptr, &slot.overlapped ) && ERROR_IO_PENDING != GetLastError() )
+			immediate.emplace_back( Completion_{ aSlot, -std::int64_t(GetLastError()) } );
+#		endif
+	}
+
+	void FileReader::Backend_::wait( std::vector<Slot_>& aSlots, std::vector<Completion_>& aOut )
+	{
+		aOut.clear();
+		std::swap( aOut, immediate );
+		if( !aOut.empty() || !asynchronous )
+			return;
+
+#		if defined(__linux__)
+		(void)aSlots;
+		for( ;; )
+		{
+			int const res = int(syscall( __NR_io_uring_enter, ring, toSubmit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0 ));
+			if( res >= 0 )
+			{
+				toSubmit -= std::min( toSubmit, unsigned(res) );
+				break;
+			}
+
+			if( EINTR == errno || EAGAIN == errno || EBUSY == errno )
+				continue;
+
+			// Nothing was submitted; fail the reads that were waiting
+			int const err = errno;
+			for( unsigned i = 0; i < toSubmit; ++i )
+			{
+				unsigned const index = (*sqTail - toSubmit + i) & *sqMask;
+				aOut.emplace_back( Completion_{ std::size_t(sqes[index].user_data), -std::int64_t(err) } );
+			}
+			*sqTail -= toSubmit;
+			toSubmit = 0;
+			return;
+		}
+
+		unsigned head = *cqHead;
+		unsigned const tail = __atomic_load_n( cqTail, __ATOMIC_ACQUIRE );
+		for( ; head != tail; ++head )
+		{
+			auto const& cqe = cqes[head & *cqMask];
+			aOut.emplace_back( Completion_{ std::size_t(cqe.user_data), std::int64_t(cqe.res) } );
+		}
+		__atomic_store_n( cqHead, head, __ATOMIC_RELEASE );
+#		elif defined(_WIN32)
+		OVERLAPPED_ENTRY entries[64];
+		ULONG count = 0;
+		if( !GetQueuedCompletionStatusEx( port, entries, ULONG(sizeof(entries) / sizeof(entries[0])), &count, INFINITE, FALSE ) )
+			return; // nothing dequeued; the caller waits again
+
+		for( ULONG i = 0; i < count; ++i )
+		{
+			auto* const slot = reinterpret_cast<Slot_*>(entries[i].lpOverlapped);
+			std::size_t const index = std::size_t(slot - aSlots.data());
+
+			DWORD got = 0;
+			if( GetOverlappedResult( slot->file->handle, &slot->overlapped, &got, FALSE ) )
+				aOut.emplace_back( Completion_{ index, std::int64_t(got) } );
+			else
+				aOut.emplace_back( Completion_{ index, -std::int64_t(GetLastError()) } );
+		}
+#		else
+		(void)aSlots;
+#		endif
+	}
+}
+
+namespace labutils
+{
+	FileReader::FileReader( JobSystem& aJobs, EFileIo aIo, std::size_t aQueueDepth )
+		: mJobs( &aJobs )
+		, mDepth( std::max( std::size_t(1), aQueueDepth ) )
+		, mBackend( std::make_unique<Backend_>( aIo, mDepth ) )
+	{
+		mThread = std::thread( [this] { run_(); } );
+	}
+
+	FileReader::~FileReader()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+
+		mWake.notify_one();
+		mThread.join();
+	}
+
+	Task<MappedFile> FileReader::read( std::string aPath )
+	{
+		TaskSource<MappedFile> result( *mJobs );
+		auto task = result.task();
+
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mRequests.emplace_back( Request_{ std::move(aPath), std::move(result) } );
+		}
+
+		mWake.notify_one();
+		return task;
+	}
+
+	char const* FileReader::backend() const noexcept
+	{
+		return mBackend->name();
+	}
+
+	bool FileReader::asynchronous() const noexcept
+	{
+		return mBackend->asynchronous;
+	}
+
+	void FileReader::run_()
+	{
+		auto& backend = *mBackend;
+
+		std::vector<Slot_> slots( mDepth );
+		std::vector<std::size_t> freeSlots;
+		for( std::size_t i = slots.size(); i > 0; --i )
+			freeSlots.emplace_back( i - 1 );
+
+		std::deque<Request_> pending;
+		std::vector<std::unique_ptr<File_>> active; // opened, in order
+		std::vector<Completion_> completions;
+
+		auto const finish = [&] (File_& aFile) {
+			backend.close( aFile );
+			if( !aFile.error.empty() )
+			{
+				aFile.result.set_error( std::make_exception_ptr( Error( "FileReader: '%s': %s", aFile.path.c_str(), aFile.error.c_str() ) ) );
+				return;
+			}
+
+			MappedFile file;
+			file.mSize = aFile.size;
+			file.mCopy = std::move(aFile.data);
+			file.mData = file.mCopy.get();
+			aFile.result.set_value( std::move(file) );
+		};
+
+		for( ;; )
+		{
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				if( freeSlots.size() == slots.size() && pending.empty() )
+				{
+					mWake.wait( lock, [&] { return mQuit || !mRequests.empty(); } );
+					if( mRequests.empty() )
+						break; // mQuit, and nothing left
+				}
+
+				for( auto& request : mRequests )
+					pending.emplace_back( std::move(request) );
+				mRequests.clear();
+			}
+
+			// Keep the queue full: the remaining chunks of the files already
+			// open first, then the next files
+			while( !freeSlots.empty() )
+			{
+				auto const it = std::find_if( active.begin(), active.end(), [] (auto const& aFile) {
+					return aFile->error.empty() && aFile->submitted < aFile->size;
+				} );
+
+				if( active.end() == it )
+				{
+					if( pending.empty() )
+						break;
+
+					auto file = std::make_unique<File_>( File_{ std::move(pending.front().path), std::move(pending.front().result) } );
+					pending.pop_front();
+
+					try
+					{
+						backend.open( *file );
+					}
+					catch( ... )
+					{
+						backend.close( *file );
+						file->result.set_error( std::current_exception() );
+						continue;
+					}
+
+					if( 0 == file->size )
+						finish( *file );
+					else
+						active.emplace_back( std::move(file) );
+					continue;
+				}
+
+				auto& file = **it;
+				std::size_t const index = freeSlots.back();
+				freeSlots.pop_back();
+
+				auto& slot = slots[index];
+				slot.file = &file;
+				slot.offset = file.submitted;
+				slot.bytes = std::min( kChunkBytes, file.size - file.submitted );
+
+				file.submitted += slot.bytes;
+				++file.inFlight;
+				backend.submit( slots, index );
+			}
+
+			if( freeSlots.size() == slots.size() )
+				continue;
+
+			LUT_CPU_ZONE( "FileReader wait" );
+			backend.wait( slots, completions );
+			for( auto const& done : completions )
+			{
+				auto& slot = slots[done.slot];
+				auto& file = *slot.file;
+
+				if( done.result > 0 && std::size_t(done.result) < slot.bytes && file.error.empty() )
+				{
+					// Short read; ask for the rest
+					file.arrived += std::size_t(done.result);
+					slot.offset += std::size_t(done.result);
+					slot.bytes -= std::size_t(done.result);
+					backend.submit( slots, done.slot );
+					continue;
+				}
+
+				if( done.result < 0 && file.error.empty() )
+					file.error = error_string_( -done.result );
+				else if( 0 == done.result && file.error.empty() )
+					file.error = "unexpected end of file";
+				else
+					file.arrived += slot.bytes;
+
+				--file.inFlight;
+				slot.file = nullptr;
+				freeSlots.emplace_back( done.slot );
+
+				if( 0 == file.inFlight && (!file.error.empty() || file.arrived == file.size) )
+				{
+					finish( file );
+
+					auto const it = std::find_if( active.begin(), active.end(), [&] (auto const& aFile) { return aFile.get() == &file; } );
+					assert( active.end() != it );
+					active.erase( it );
+				}
+			}
+		}
+	}
+}
+
+namespace labutils
+{
+	FileReader& shared_file_reader()
+	{
+		static FileReader reader( shared_jobs() );
+		return reader;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "task.hpp"
+#include "mapped_file.hpp"
+
+namespace labutils
+{
+	enum class EFileIo
+	{
+		automatic, // the platform's asynchronous API, else blocking
+		blocking
+	};
+
+	// Asynchronous whole-file reads, to keep many reads in flight (on NVMe
+	// and network storage, a single blocking read at a time leaves most of
+	// the bandwidth unused). read() returns a task with the file's contents
+	// (as read_file() would); tasks chained to it with then() are spawned as
+	// soon as the last byte arrives, so that, e.g., a directory of textures
+	// is decoded while the rest of it is still being read:
+	//
+	//   auto image = then( reader.read( path ), [] (MappedFile aFile) { return decode( aFile ); } );
+	//
+	// Files are read in chunks of kChunkBytes, up to the queue depth at a
+	// time, by a thread that only submits and collects reads. Backends:
+	//
+	//  - "io_uring" (Linux): one ring, readv requests; through the raw
+	//    system calls (no liburing);
+	//  - "overlapped" (Windows): overlapped ReadFile()s, collected from an
+	//    I/O completion port. (IoRing would save the per-read calls, but
+	//    needs Windows 11.)
+	//  - "blocking": one read at a time with read_file()'s calls; elsewhere,
+	//    or if the asynchronous API isn't available (e.g., io_uring disabled
+	//    by a container's seccomp profile).
+	//
+	// Files of a mounted texture pack (texture_pack.hpp) are read from the
+	// pack, through a handle opened on the first of them and kept open.
+	//
+	// read() may be called from any thread. Errors (missing files, short
+	// reads) are thrown by the task as labutils::Error. The destructor
+	// waits for the reads in flight.
+	class FileReader
+	{
+		public:
+			static constexpr std::size_t kChunkBytes = std::size_t(1) << 20;
+
+		public:
+			explicit FileReader( JobSystem&, EFileIo = EFileIo::automatic, std::size_t aQueueDepth = 64 );
+			~FileReader();
+
+			FileReader( FileReader const& ) = delete;
+			FileReader& operator= (FileReader const&) = delete;
+
+		public:
+			Task<MappedFile> read( std::string aPath );
+
+			char const* backend() const noexcept;
+			bool asynchronous() const noexcept; // false: "blocking"
+
+		private:
+			struct Request_
+			{
+				std::string path;
+				TaskSource<MappedFile> result;
+			};
+
+			struct Backend_;
+
+			void run_();
+
+		private:
+			JobSystem* mJobs;
+			std::size_t mDepth;
+			std::unique_ptr<Backend_> mBackend;
+
+			std::mutex mMutex;
+			std::condition_variable mWake;
+			std::deque<Request_> mRequests;
+			bool mQuit = false;
+
+			std::thread mThread;
+	};
+
+	// Process-wide FileReader on shared_jobs(), with the automatic backend;
+	// created on first use.
+	FileReader& shared_file_reader();
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
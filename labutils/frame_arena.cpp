@@ -0,0 +1,72 @@
+#include "frame_arena.hpp"
+
+#include <algorithm>
+
+namespace labutils
+{
+	FrameArena::FrameArena( std::size_t aCapacity )
+	{
+		assert( aCapacity > 0 );
+
+		auto& block = mBlocks.emplace_back();
+		block.data = std::make_unique<std::byte[]>( aCapacity );
+		block.size = aCapacity;
+	}
+
+	void* FrameArena::allocate( std::size_t aSize, std::size_t aAlignment )
+	{
+		assert( aAlignment > 0 && 0 == (aAlignment & (aAlignment-1)) );
+		assert( aAlignment <= alignof(std::max_align_t) ); // of the heap blocks
+
+		auto const& current = mBlocks.back();
+		std::size_t start = (mOffset + aAlignment - 1) & ~(aAlignment - 1);
+
+		if( start + aSize > current.size )
+		{
+			// Overflow: a block for at least this allocation, and at least as
+			// large as the previous one
+			auto& block = mBlocks.emplace_back();
+			block.size = std::max( aSize, mBlocks[mBlocks.size() - 2].size );
+			block.data = std::make_unique<std::byte[]>( block.size );
+
+			mUsed += mBlocks[mBlocks.size() - 2].size - mOffset; // the rest of the old block is lost
+			mOffset = 0;
+			start = 0;
+		}
+
+		mUsed += start + aSize - mOffset;
+		mOffset = start + aSize;
+		mHighWater = std::max( mHighWater, mUsed );
+
+		return mBlocks.back().data.get() + start;
+	}
+
+	void FrameArena::reset()
+	{
+		if( mBlocks.size() > 1 )
+		{
+			// One block large enough for the busiest frame so far
+			mBlocks.clear();
+
+			auto& block = mBlocks.emplace_back();
+			block.data = std::make_unique<std::byte[]>( mHighWater );
+			block.size = mHighWater;
+		}
+
+		mOffset = 0;
+		mUsed = 0;
+	}
+
+	std::size_t FrameArena::used() const noexcept
+	{
+		return mUsed;
+	}
+	std::size_t FrameArena::capacity() const noexcept
+	{
+		return mBlocks.front().size;
+	}
+	std::size_t FrameArena::high_water() const noexcept
+	{
+		return mHighWater;
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include <cassert>
+#include <cstddef>
+
+namespace labutils
+{
+	// Linear (bump) allocator for CPU data that lives for one frame. Use one
+	// per frame in flight, and reset() it once the frame's fence has been
+	// waited for; deallocation is a no-op. If a frame needs more than the
+	// capacity, the arena takes further blocks from the heap, and the next
+	// reset() replaces them all with a single block of the frame's high-water
+	// mark, so that steady-state frames make no heap allocations.
+	//
+	// Not thread safe; allocate from the thread that owns the frame.
+	class FrameArena
+	{
+		public:
+			explicit FrameArena( std::size_t aCapacity = 64 * 1024 );
+
+			FrameArena( FrameArena const& ) = delete;
+			FrameArena& operator= (FrameArena const&) = delete;
+
+			FrameArena( FrameArena&& ) noexcept = default;
+			FrameArena& operator= (FrameArena&&) noexcept = default;
+
+		public:
+			// aAlignment: a power of two
+			void* allocate( std::size_t aSize, std::size_t aAlignment );
+
+			// Invalidates everything allocated since the previous reset()
+			void reset();
+
+			std::size_t used() const noexcept;       // since the last reset()
+			std::size_t capacity() const noexcept;   // of the first block
+			std::size_t high_water() const noexcept; // largest used() so far
+
+		private:
+			struct Block_
+			{
+				std::unique_ptr<std::byte[]> data;
+				std::size_t size = 0;
+			};
+
+			std::vector<Block_> mBlocks; // the first is kept across reset()s
+			std::size_t mOffset = 0;     // into mBlocks.back()
+			std::size_t mUsed = 0;       // in earlier blocks plus mOffset
+			std::size_t mHighWater = 0;
+	};
+
+	// Standard allocator on top of a FrameArena, e.g., for per-frame
+	// containers. Default constructed, it uses the heap instead, so that the
+	// same container type also serves lists that outlive a frame. Moving a
+	// container moves its allocator along.
+	template< typename tType >
+	class ArenaAllocator
+	{
+		public:
+			using value_type = tType;
+
+			using propagate_on_container_move_assignment = std::true_type;
+			using propagate_on_container_swap = std::true_type;
+
+		public:
+			ArenaAllocator() noexcept = default;
+			explicit ArenaAllocator( FrameArena& aArena ) noexcept
+				: mArena( &aArena )
+			{}
+
+			template< typename tOther >
+			ArenaAllocator( ArenaAllocator<tOther> const& aOther ) noexcept
+				: mArena( aOther.arena() )
+			{}
+
+		public:
+			tType* allocate( std::size_t aCount )
+			{
+				if( !mArena )
+					return std::allocator<tType>{}.allocate( aCount );
+
+				return static_cast<tType*>(mArena->allocate( aCount * sizeof(tType), alignof(tType) ));
+			}
+			void deallocate( tType* aPtr, std::size_t aCount ) noexcept
+			{
+				if( !mArena )
+					std::allocator<tType>{}.deallocate( aPtr, aCount );
+			}
+
+			FrameArena* arena() const noexcept
+			{
+				return mArena;
+			}
+
+		private:
+			FrameArena* mArena = nullptr;
+	};
+
+	template< typename tType, typename tOther >
+	bool operator==( ArenaAllocator<tType> const& aA, ArenaAllocator<tOther> const& aB ) noexcept
+	{
+		return aA.arena() == aB.arena();
+	}
+	template< typename tType, typename tOther >
+	bool operator!=( ArenaAllocator<tType> const& aA, ArenaAllocator<tOther> const& aB ) noexcept
+	{
+		return aA.arena() != aB.arena();
+	}
+
+	template< typename tType >
+	using ArenaVector = std::vector<tType, ArenaAllocator<tType>>;
+}
@@ -0,0 +1,343 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "cpu_zones.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// In the order of their bits, which is the order of the results
+	constexpr VkQueryPipelineStatisticFlags kStatistics
+		= VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+		| VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+		| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+		| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT
+		| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+		| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	constexpr std::size_t kStatisticCount = 6;
+}
+
+namespace labutils
+{
+	GpuProfiler::GpuProfiler() noexcept = default;
+
+	GpuProfiler::GpuProfiler( VulkanContext const& aContext, std::uint32_t aFramesInFlight, std::uint32_t aMaxScopes, std::size_t aHistory, std::uint32_t aFrameDevices )
+		: mDevice( aContext.device )
+		, mStatsSupported( aContext.havePipelineStatistics )
+		, mMaxScopes( aMaxScopes )
+		, mDeviceCount( std::max( aFrameDevices, 1u ) )
+		, mFrameRecorded( aFramesInFlight, false )
+		, mHistory( std::max<std::size_t>( aHistory, 1 ) )
+	{
+		assert( aFramesInFlight > 0 && aMaxScopes > 0 );
+		assert( aFrameDevices <= aContext.deviceCount && 0 == aFramesInFlight % mDeviceCount );
+
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties( aContext.physicalDevice, &props );
+
+		std::uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( aContext.physicalDevice, &familyCount, nullptr );
+		std::vector<VkQueueFamilyProperties> families( familyCount );
+		vkGetPhysicalDeviceQueueFamilyProperties( aContext.physicalDevice, &familyCount, families.data() );
+
+		std::uint32_t const validBits = aContext.graphicsFamilyIndex < familyCount ? families[aContext.graphicsFamilyIndex].timestampValidBits : 0;
+		if( !props.limits.timestampComputeAndGraphics || 0 == validBits )
+			return; // disabled
+
+		mMsPerTick = double(props.limits.timestampPeriod) * 1e-6;
+		if( validBits < 64 )
+			mTimestampMask = (std::uint64_t(1) << validBits) - 1;
+
+		VkQueryPoolCreateInfo queryInfo{};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryInfo.queryCount = aFramesInFlight * aMaxScopes * 2;
+
+		VkQueryPool pool = VK_NULL_HANDLE;
+		if( auto const res = vkCreateQueryPool( aContext.device, &queryInfo, nullptr, &pool ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create timestamp query pool\n" "vkCreateQueryPool() returned %s", to_string(res).c_str() );
+		}
+
+		mPool = QueryPool( aContext.device, pool );
+	}
+
+	GpuProfiler::GpuProfiler( GpuProfiler&& ) noexcept = default;
+	GpuProfiler& GpuProfiler::operator=( GpuProfiler&& ) noexcept = default;
+
+	bool GpuProfiler::enabled() const noexcept
+	{
+		return VK_NULL_HANDLE != mPool.handle;
+	}
+
+	std::uint32_t GpuProfiler::add_scope( char const* aName )
+	{
+		assert( aName );
+		if( mScopes.size() >= std::max<std::uint32_t>( mMaxScopes, 1 ) )
+			throw Error( "GpuProfiler: too many scopes (at most %u); cannot add '%s'", mMaxScopes, aName );
+
+		auto& scope = mScopes.emplace_back();
+		scope.name = aName;
+		scope.history.resize( mHistory );
+		scope.historyDevice.resize( mHistory );
+
+		return std::uint32_t(mScopes.size() - 1);
+	}
+
+	bool GpuProfiler::add_statistics( std::uint32_t aScope )
+	{
+		assert( aScope < mScopes.size() );
+		if( !enabled() || !mStatsSupported )
+			return false;
+
+		if( VK_NULL_HANDLE == mStatsPool.handle )
+		{
+			VkQueryPoolCreateInfo queryInfo{};
+			queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryInfo.queryCount = std::uint32_t(mFrameRecorded.size()) * mMaxScopes;
+			queryInfo.pipelineStatistics = kStatistics;
+
+			VkQueryPool pool = VK_NULL_HANDLE;
+			if( auto const res = vkCreateQueryPool( mDevice, &queryInfo, nullptr, &pool ); VK_SUCCESS != res )
+			{
+				throw Error( "Unable to create pipeline statistics query pool\n" "vkCreateQueryPool() returned %s", to_string(res).c_str() );
+			}
+
+			mStatsPool = QueryPool( mDevice, pool );
+		}
+
+		mScopes[aScope].statistics = true;
+		return true;
+	}
+
+	bool GpuProfiler::has_statistics( std::uint32_t aScope ) const noexcept
+	{
+		assert( aScope < mScopes.size() );
+		return mScopes[aScope].statistics;
+	}
+
+	void GpuProfiler::begin_frame( std::uint32_t aFrameIndex )
+	{
+		if( !enabled() )
+			return;
+
+		assert( aFrameIndex < mFrameRecorded.size() );
+		collect_( aFrameIndex );
+		mCurrentFrame = aFrameIndex;
+	}
+
+	void GpuProfiler::reset_queries( VkCommandBuffer aCmdBuff )
+	{
+		if( !enabled() )
+			return;
+
+		vkCmdResetQueryPool( aCmdBuff, mPool.handle, mCurrentFrame * mMaxScopes * 2, mMaxScopes * 2 );
+		if( VK_NULL_HANDLE != mStatsPool.handle )
+			vkCmdResetQueryPool( aCmdBuff, mStatsPool.handle, mCurrentFrame * mMaxScopes, mMaxScopes );
+		mFrameRecorded[mCurrentFrame] = true;
+	}
+
+	void GpuProfiler::begin_scope( VkCommandBuffer aCmdBuff, std::uint32_t aScope ) const
+	{
+		if( !enabled() )
+			return;
+
+		assert( aScope < mScopes.size() );
+		vkCmdWriteTimestamp( aCmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mPool.handle, (mCurrentFrame * mMaxScopes + aScope) * 2 + 0 );
+
+		if( mScopes[aScope].statistics )
+			vkCmdBeginQuery( aCmdBuff, mStatsPool.handle, mCurrentFrame * mMaxScopes + aScope, 0 );
+	}
+	void GpuProfiler::end_scope( VkCommandBuffer aCmdBuff, std::uint32_t aScope ) const
+	{
+		if( !enabled() )
+			return;
+
+		assert( aScope < mScopes.size() );
+		if( mScopes[aScope].statistics )
+			vkCmdEndQuery( aCmdBuff, mStatsPool.handle, mCurrentFrame * mMaxScopes + aScope );
+
+		vkCmdWriteTimestamp( aCmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mPool.handle, (mCurrentFrame * mMaxScopes + aScope) * 2 + 1 );
+	}
+
+	std::uint32_t GpuProfiler::scope_count() const noexcept
+	{
+		return std::uint32_t(mScopes.size());
+	}
+
+	GpuProfiler::ScopeStats GpuProfiler::stats( std::uint32_t aScope ) const
+	{
+		return stats_( aScope, 0, true );
+	}
+
+	std::uint32_t GpuProfiler::device_count() const noexcept
+	{
+		return mDeviceCount;
+	}
+	GpuProfiler::ScopeStats GpuProfiler::stats( std::uint32_t aScope, std::uint32_t aDevice ) const
+	{
+		assert( aDevice < mDeviceCount );
+		return stats_( aScope, aDevice, false );
+	}
+
+	double GpuProfiler::last_ms( std::uint32_t aScope ) const noexcept
+	{
+		assert( aScope < mScopes.size() );
+		return mScopes[aScope].last;
+	}
+
+	double GpuProfiler::last_start_ms( std::uint32_t aScope ) const noexcept
+	{
+		assert( aScope < mScopes.size() );
+		return mScopes[aScope].lastStart;
+	}
+
+	bool GpuProfiler::last_statistics( std::uint32_t aScope, PipelineStats& aOut ) const noexcept
+	{
+		assert( aScope < mScopes.size() );
+		if( !mScopes[aScope].lastStatsValid )
+			return false;
+
+		aOut = mScopes[aScope].lastStats;
+		return true;
+	}
+
+	std::uint32_t GpuProfiler::last_device() const noexcept
+	{
+		return mLastDevice;
+	}
+
+	GpuProfiler::ScopeStats GpuProfiler::stats_( std::uint32_t aScope, std::uint32_t aDevice, bool aAnyDevice ) const
+	{
+		assert( aScope < mScopes.size() );
+		auto const& scope = mScopes[aScope];
+
+		ScopeStats ret{};
+		ret.name = scope.name.c_str();
+
+		double sum = 0.0;
+		for( std::size_t i = 0; i < scope.count; ++i )
+		{
+			if( !aAnyDevice && aDevice != scope.historyDevice[i] )
+				continue;
+
+			auto const ms = scope.history[i];
+			ret.minMs = 0 == ret.samples ? ms : std::min( ret.minMs, ms );
+			ret.maxMs = 0 == ret.samples ? ms : std::max( ret.maxMs, ms );
+			sum += ms;
+			++ret.samples;
+		}
+
+		if( ret.samples > 0 )
+			ret.avgMs = sum / double(ret.samples);
+		return ret;
+	}
+
+	void GpuProfiler::collect_( std::uint32_t aFrameIndex )
+	{
+		for( auto& scope : mScopes )
+		{
+			scope.last = -1.0;
+			scope.lastStart = 0.0;
+			scope.lastStatsValid = false;
+		}
+
+		mLastDevice = aFrameIndex % mDeviceCount;
+
+		if( !mFrameRecorded[aFrameIndex] || mScopes.empty() )
+			return;
+
+		// Scopes that were not written in the frame (e.g., a disabled pass)
+		// stay unavailable, and are skipped.
+		struct Result_
+		{
+			std::uint64_t value, available;
+		};
+		std::vector<Result_> results( mScopes.size() * 2 );
+
+		auto const res = vkGetQueryPoolResults( mDevice, mPool.handle, aFrameIndex * mMaxScopes * 2, std::uint32_t(results.size()),
+			results.size() * sizeof(Result_), results.data(), sizeof(Result_),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+
+		if( VK_SUCCESS != res && VK_NOT_READY != res )
+			throw Error( "Unable to get timestamp results\n" "vkGetQueryPoolResults() returned %s", to_string(res).c_str() );
+
+		std::uint64_t first = ~std::uint64_t(0);
+		for( std::size_t i = 0; i < mScopes.size(); ++i )
+		{
+			if( results[2*i+0].available && results[2*i+1].available )
+				first = std::min( first, results[2*i+0].value );
+		}
+
+		for( std::size_t i = 0; i < mScopes.size(); ++i )
+		{
+			auto const& begin = results[2*i+0];
+			auto const& end = results[2*i+1];
+			if( !begin.available || !end.available )
+				continue;
+
+			auto const ticks = (end.value - begin.value) & mTimestampMask;
+
+			auto& scope = mScopes[i];
+			scope.last = double(ticks) * mMsPerTick;
+			scope.lastStart = double((begin.value - first) & mTimestampMask) * mMsPerTick;
+			scope.history[scope.next] = scope.last;
+			scope.historyDevice[scope.next] = mLastDevice;
+			scope.next = (scope.next + 1) % scope.history.size();
+			scope.count = std::min( scope.count + 1, scope.history.size() );
+		}
+
+		if( VK_NULL_HANDLE == mStatsPool.handle )
+			return;
+
+		// One query per scope; the counters, then the availability
+		std::vector<std::uint64_t> counters( mScopes.size() * (kStatisticCount + 1) );
+
+		auto const statsRes = vkGetQueryPoolResults( mDevice, mStatsPool.handle, aFrameIndex * mMaxScopes, std::uint32_t(mScopes.size()),
+			counters.size() * sizeof(std::uint64_t), counters.data(), (kStatisticCount + 1) * sizeof(std::uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+
+		if( VK_SUCCESS != statsRes && VK_NOT_READY != statsRes )
+			throw Error( "Unable to get pipeline statistics\n" "vkGetQueryPoolResults() returned %s", to_string(statsRes).c_str() );
+
+		for( std::size_t i = 0; i < mScopes.size(); ++i )
+		{
+			auto& scope = mScopes[i];
+			auto const* values = counters.data() + i * (kStatisticCount + 1);
+			if( !scope.statistics || !values[kStatisticCount] )
+				continue;
+
+			scope.lastStats.inputVertices = values[0];
+			scope.lastStats.inputPrimitives = values[1];
+			scope.lastStats.vertexInvocations = values[2];
+			scope.lastStats.clippingInvocations = values[3];
+			scope.lastStats.clippingPrimitives = values[4];
+			scope.lastStats.fragmentInvocations = values[5];
+			scope.lastStatsValid = true;
+		}
+	}
+}
+
+#if defined(LUT_CPU_ZONES)
+namespace labutils
+{
+	void add_gpu_zones( GpuProfiler const& aProfiler, ZoneClock::time_point aSubmitted )
+	{
+		for( std::uint32_t i = 0; i < aProfiler.scope_count(); ++i )
+		{
+			double const ms = aProfiler.last_ms( i );
+			if( ms < 0.0 )
+				continue;
+
+			auto const start = std::chrono::duration_cast<ZoneClock::duration>( std::chrono::duration<double,std::milli>( aProfiler.last_start_ms( i ) ) );
+			auto const length = std::chrono::duration_cast<ZoneClock::duration>( std::chrono::duration<double,std::milli>( ms ) );
+			add_gpu_zone( aProfiler.stats( i ).name, aSubmitted + start, length );
+		}
+	}
+}
+#endif // ~ LUT_CPU_ZONES
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// GPU timestamp profiler with named scopes. Each frame in flight has its
+	// own range of a query pool; each scope owns a fixed pair of queries in
+	// every range, so that scopes may be recorded into cached (secondary)
+	// command buffers. Results are read back without waiting when the frame
+	// slot comes around again, i.e., once its fence has been waited for, and
+	// kept as a rolling window of samples per scope.
+	//
+	// Per frame:
+	//   begin_frame( slot )       after waiting for the slot's fence
+	//   reset_queries( cmd )      outside of a render pass, before any scope
+	//   begin_scope()/end_scope() around the work to time
+	//
+	// If the device does not support timestamps on the graphics queue, the
+	// profiler is disabled, and all calls do nothing.
+	//
+	// Scopes may also count pipeline statistics (add_statistics()), with a
+	// second pool of one query per scope and frame slot: the vertices and
+	// primitives assembled, the vertex shader invocations, the primitives
+	// entering and leaving clipping, and the fragment shader invocations.
+	//
+	// With alternate-frame rendering over a device group, frame slot i runs
+	// on device i % aFrameDevices; each sample remembers its device, for
+	// per-device statistics.
+	class GpuProfiler
+	{
+		public:
+			struct ScopeStats
+			{
+				char const* name = nullptr;
+				double minMs = 0.0, avgMs = 0.0, maxMs = 0.0;
+				std::size_t samples = 0; // in the rolling window
+			};
+
+			struct PipelineStats
+			{
+				std::uint64_t inputVertices = 0, inputPrimitives = 0;
+				std::uint64_t vertexInvocations = 0;
+				std::uint64_t clippingInvocations = 0, clippingPrimitives = 0;
+				std::uint64_t fragmentInvocations = 0;
+			};
+
+		public:
+			GpuProfiler() noexcept;
+			GpuProfiler( VulkanContext const&, std::uint32_t aFramesInFlight, std::uint32_t aMaxScopes = 16, std::size_t aHistory = 120, std::uint32_t aFrameDevices = 1 );
+
+			GpuProfiler( GpuProfiler const& ) = delete;
+			GpuProfiler& operator= (GpuProfiler const&) = delete;
+
+			GpuProfiler( GpuProfiler&& ) noexcept;
+			GpuProfiler& operator= (GpuProfiler&&) noexcept;
+
+		public:
+			bool enabled() const noexcept;
+
+			// Scopes are added up front, before the first frame. Throws
+			// labutils::Error if more than aMaxScopes are added.
+			std::uint32_t add_scope( char const* aName );
+
+			// aScope also counts pipeline statistics. Its begin_scope() and
+			// end_scope() must then be recorded into the same command
+			// buffer, and must not overlap another statistics scope. Returns
+			// false (and does nothing) if the profiler is disabled, or if
+			// the device lacks the pipelineStatisticsQuery feature. Call up
+			// front, like add_scope().
+			bool add_statistics( std::uint32_t aScope );
+			bool has_statistics( std::uint32_t aScope ) const noexcept;
+
+			void begin_frame( std::uint32_t aFrameIndex );
+			void reset_queries( VkCommandBuffer );
+
+			// Both use VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT: a scope measures
+			// from the completion of the preceding work to the completion of
+			// the work inside it. Safe to call from several threads.
+			void begin_scope( VkCommandBuffer, std::uint32_t aScope ) const;
+			void end_scope( VkCommandBuffer, std::uint32_t aScope ) const;
+
+			std::uint32_t scope_count() const noexcept;
+			ScopeStats stats( std::uint32_t aScope ) const;
+
+			// Over the samples of aDevice only (see above)
+			std::uint32_t device_count() const noexcept;
+			ScopeStats stats( std::uint32_t aScope, std::uint32_t aDevice ) const;
+
+			// The scope's sample collected by the latest begin_frame(), i.e.,
+			// from the frame that last used the slot; negative if there is
+			// none.
+			double last_ms( std::uint32_t aScope ) const noexcept;
+
+			// Start of that sample, relative to the earliest scope of the
+			// same frame (ms); 0 if there is none.
+			double last_start_ms( std::uint32_t aScope ) const noexcept;
+
+			// Same for the statistics; false if there are none.
+			bool last_statistics( std::uint32_t aScope, PipelineStats& aOut ) const noexcept;
+
+			// Device of the frame collected by the latest begin_frame()
+			std::uint32_t last_device() const noexcept;
+
+		private:
+			void collect_( std::uint32_t aFrameIndex );
+			ScopeStats stats_( std::uint32_t aScope, std::uint32_t aDevice, bool aAnyDevice ) const;
+
+			QueryPool mPool;
+			QueryPool mStatsPool; // created by the first add_statistics()
+			VkDevice mDevice = VK_NULL_HANDLE;
+			bool mStatsSupported = false;
+
+			std::uint32_t mMaxScopes = 0;
+			std::uint32_t mCurrentFrame = 0;
+			std::uint32_t mDeviceCount = 1;
+			std::uint32_t mLastDevice = 0;
+			double mMsPerTick = 0.0;
+			std::uint64_t mTimestampMask = ~std::uint64_t(0);
+
+			std::vector<bool> mFrameRecorded; // queries of the slot were reset
+
+			struct Scope_
+			{
+				std::string name;
+				std::vector<double> history; // ring buffer, ms
+				std::vector<std::uint32_t> historyDevice; // of each sample
+				std::size_t next = 0, count = 0;
+				double last = -1.0;
+				double lastStart = 0.0;
+
+				bool statistics = false;
+				bool lastStatsValid = false;
+				PipelineStats lastStats;
+			};
+			std::vector<Scope_> mScopes;
+			std::size_t mHistory = 0;
+	};
+}
@@ -0,0 +1,217 @@
+#include "image_decoder.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <stb_image.h>
+
+#if defined(LUT_LIBJPEG_TURBO)
+#	include <csetjmp>
+#	include <jpeglib.h>
+#	if !defined(JCS_EXTENSIONS)
+#		error "LUT_LIBJPEG_TURBO needs libjpeg-turbo's jpeglib.h (JCS_EXT_RGBA)"
+#	endif
+#endif // ~ LUT_LIBJPEG_TURBO
+
+#include "error.hpp"
+#include "cpu_zones.hpp"
+
+namespace
+{
+	namespace lut = labutils;
+
+	bool stb_accepts_( std::uint8_t const*, std::size_t );
+	bool stb_decode_( std::uint8_t const*, std::size_t, std::uint32_t, char const*, lut::ImageData& );
+
+#	if defined(LUT_LIBJPEG_TURBO)
+	// Larger images are left to stb, which reports them as too large
+	constexpr std::uint32_t kMaxJpegSize = 16384;
+
+	bool jpeg_accepts_( std::uint8_t const*, std::size_t );
+	bool jpeg_decode_( std::uint8_t const*, std::size_t, std::uint32_t, char const*, lut::ImageData& );
+#	endif // ~ LUT_LIBJPEG_TURBO
+
+	std::vector<lut::ImageDecoder>& decoders_()
+	{
+		static std::vector<lut::ImageDecoder> decoders = {
+#			if defined(LUT_LIBJPEG_TURBO)
+			lut::ImageDecoder{ "libjpeg-turbo", &jpeg_accepts_, &jpeg_decode_ },
+#			endif // ~ LUT_LIBJPEG_TURBO
+			lut::ImageDecoder{ "stb", &stb_accepts_, &stb_decode_ }
+		};
+		return decoders;
+	}
+}
+
+namespace labutils
+{
+	std::vector<ImageDecoder> const& image_decoders()
+	{
+		return decoders_();
+	}
+
+	ImageDecoder const* find_image_decoder( char const* aName )
+	{
+		for( auto const& decoder : decoders_() )
+		{
+			if( 0 == std::strcmp( decoder.name, aName ) )
+				return &decoder;
+		}
+
+		return nullptr;
+	}
+
+	void add_image_decoder( ImageDecoder const& aDecoder )
+	{
+		assert( aDecoder.name && aDecoder.accepts && aDecoder.decode );
+		auto& decoders = decoders_();
+		decoders.insert( decoders.begin(), aDecoder );
+	}
+
+	ImageData decode_image_memory( std::uint8_t const* aData, std::size_t aBytes, std::uint32_t aChannels, char const* aName, ImageDecoder const* aDecoder )
+	{
+		LUT_CPU_ZONE( "decode_image_memory()" );
+		assert( 1 == aChannels || 4 == aChannels );
+
+		ImageData ret;
+		if( aDecoder )
+		{
+			if( !aDecoder->decode( aData, aBytes, aChannels, aName, ret ) )
+				throw Error( "%s : the %s decoder can't decode this image", aName, aDecoder->name );
+			return ret;
+		}
+
+		for( auto const& decoder : decoders_() )
+		{
+			if( decoder.accepts( aData, aBytes ) && decoder.decode( aData, aBytes, aChannels, aName, ret ) )
+				return ret;
+		}
+
+		throw Error( "%s : no decoder for this image", aName );
+	}
+}
+
+namespace
+{
+	bool stb_accepts_( std::uint8_t const*, std::size_t )
+	{
+		return true;
+	}
+
+	bool stb_decode_( std::uint8_t const* aData, std::size_t aBytes, std::uint32_t aChannels, char const* aName, lut::ImageData& aImage )
+	{
+		if( aBytes > std::size_t(std::numeric_limits<int>::max()) )
+			throw lut::Error( "%s : Unable to load texture base image (file too large)", aName );
+
+		// Flip images vertically by default.
+		// Vulkan expects the first scanline to be the bottom-most scanline. PNG et
+		// al. instead define the first scanline to be the top-most one.
+		// The per-thread setting keeps concurrent decodes independent.
+		stbi_set_flip_vertically_on_load_thread(1);
+
+		//load base image
+		int baseWidthi, baseHeighti, baseChannelsi;
+		stbi_uc* data = stbi_load_from_memory(aData, int(aBytes), &baseWidthi, &baseHeighti, &baseChannelsi, int(aChannels));
+
+		if (!data)
+		{
+			throw lut::Error("%s : Unable to load texture base image (%s)", aName, stbi_failure_reason());
+		}
+
+		aImage.width = std::uint32_t(baseWidthi);
+		aImage.height = std::uint32_t(baseHeighti);
+		aImage.channels = aChannels;
+		aImage.pixels.assign(data, data + std::size_t(aImage.width) * aImage.height * aChannels);
+
+		//Free image data
+		stbi_image_free(data);
+
+		return true;
+	}
+
+#	if defined(LUT_LIBJPEG_TURBO)
+	struct JpegError_
+	{
+		jpeg_error_mgr mgr; // first, see jpeg_error_exit_()
+		std::jmp_buf jump;
+		char message[JMSG_LENGTH_MAX];
+	};
+
+	// libjpeg's default error_exit() calls exit()
+	[[noreturn]] void jpeg_error_exit_( j_common_ptr aInfo )
+	{
+		auto* err = reinterpret_cast<JpegError_*>(aInfo->err);
+		(*aInfo->err->format_message)( aInfo, err->message );
+		std::longjmp( err->jump, 1 );
+	}
+
+	// Corrupt data warnings; the image is decoded anyway
+	void jpeg_output_message_( j_common_ptr )
+	{}
+
+	bool jpeg_accepts_( std::uint8_t const* aData, std::size_t aBytes )
+	{
+		return aBytes >= 3 && 0xff == aData[0] && 0xd8 == aData[1] && 0xff == aData[2];
+	}
+
+	bool jpeg_decode_( std::uint8_t const* aData, std::size_t aBytes, std::uint32_t aChannels, char const* aName, lut::ImageData& aImage )
+	{
+		// Nothing with a destructor may be created between the setjmp() and
+		// the jpeg_destroy_decompress() below; longjmp() would skip it.
+		jpeg_decompress_struct info;
+		JpegError_ err;
+		info.err = jpeg_std_error( &err.mgr );
+		err.mgr.error_exit = &jpeg_error_exit_;
+		err.mgr.output_message = &jpeg_output_message_;
+
+		if( setjmp( err.jump ) )
+		{
+			jpeg_destroy_decompress( &info );
+			throw lut::Error( "%s : Unable to load texture base image (%s)", aName, err.message );
+		}
+
+		jpeg_create_decompress( &info );
+		jpeg_mem_src( &info, aData, static_cast<unsigned long>(aBytes) );
+		jpeg_read_header( &info, TRUE );
+
+		// CMYK and YCCK, and anything this large, go to stb
+		bool const colorSpace = JCS_GRAYSCALE == info.jpeg_color_space || JCS_YCbCr == info.jpeg_color_space || JCS_RGB == info.jpeg_color_space;
+		if( !colorSpace || info.image_width > kMaxJpegSize || info.image_height > kMaxJpegSize )
+		{
+			jpeg_destroy_decompress( &info );
+			return false;
+		}
+
+		info.out_color_space = (1 == aChannels) ? JCS_GRAYSCALE : JCS_EXT_RGBA;
+		jpeg_start_decompress( &info );
+
+		aImage.width = info.output_width;
+		aImage.height = info.output_height;
+		aImage.channels = aChannels;
+		aImage.pixels.resize( std::size_t(aImage.width) * aImage.height * aChannels );
+
+		// Scanlines arrive top first; write them bottom up
+		std::size_t const stride = std::size_t(aImage.width) * aChannels;
+		std::uint8_t* const last = aImage.pixels.data() + (aImage.height - 1) * stride;
+		while( info.output_scanline < info.output_height )
+		{
+			JSAMPROW rows[4];
+			JDIMENSION const count = std::min<JDIMENSION>( 4, info.output_height - info.output_scanline );
+			for( JDIMENSION i = 0; i < count; ++i )
+				rows[i] = last - (info.output_scanline + i) * stride;
+
+			jpeg_read_scanlines( &info, rows, count );
+		}
+
+		jpeg_finish_decompress( &info );
+		jpeg_destroy_decompress( &info );
+		return true;
+	}
+#	endif // ~ LUT_LIBJPEG_TURBO
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkimage.hpp"
+
+namespace labutils
+{
+	// Image decoders behind decode_image(). An encoded image (the bytes of a
+	// JPEG, PNG, ... file) goes to the first decoder that accepts it; if that
+	// one can't handle the image after all (e.g., a CMYK JPEG), the next is
+	// tried. The built-in decoders are, in this order:
+	//
+	//  - "libjpeg-turbo": JPEG via libjpeg-turbo's SIMD code paths. Only
+	//    with LUT_LIBJPEG_TURBO (premake5 --libjpeg-turbo), which links
+	//    libjpeg (the turbo variant provides the RGBA output used here).
+	//  - "stb": anything stb_image reads; accepts every image.
+	//
+	// Decoders produce 8-bit texels with 1 (R) or 4 (RGBA) channels, first
+	// scanline at the bottom (as Vulkan expects it), i.e., ImageData. One
+	// channel is the image's luminance.
+	struct ImageDecoder
+	{
+		char const* name;
+
+		// True if the decoder handles images of this kind, typically by
+		// their signature.
+		bool (*accepts)( std::uint8_t const* aData, std::size_t aBytes );
+
+		// Decodes into aImage. Returns false if the image uses a feature
+		// that the decoder lacks; throws labutils::Error if it's corrupt.
+		// Must be safe to call from several threads at once.
+		bool (*decode)( std::uint8_t const* aData, std::size_t aBytes, std::uint32_t aChannels, char const* aName, ImageData& aImage );
+	};
+
+	// All decoders, in the order they're tried
+	std::vector<ImageDecoder> const& image_decoders();
+
+	// Null if there is no decoder with that name (e.g., "libjpeg-turbo"
+	// without LUT_LIBJPEG_TURBO).
+	ImageDecoder const* find_image_decoder( char const* aName );
+
+	// Adds a decoder in front of the others. Not thread safe: call it before
+	// anything is decoded.
+	void add_image_decoder( ImageDecoder const& );
+
+	// Decodes aBytes bytes of an encoded image with aChannels (1 or 4)
+	// channels. aName is for error messages. With aDecoder, only that one is
+	// used. Throws labutils::Error if no decoder can decode the image. Only
+	// touches the CPU, and may be called from several threads at once.
+	ImageData decode_image_memory( std::uint8_t const* aData, std::size_t aBytes, std::uint32_t aChannels, char const* aName, ImageDecoder const* aDecoder = nullptr );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
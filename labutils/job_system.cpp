@@ -0,0 +1,336 @@
+#include "job_system.hpp"
+
+#include <chrono>
+
+#include <cassert>
+
+#include "thread_placement.hpp"
+
+namespace
+{
+	// Jobs per worker deque; further jobs go to the shared queue
+	constexpr std::int64_t kDequeCapacity = 1024;
+
+	// take_() attempts before an idle worker goes to sleep
+	constexpr unsigned kIdleSpins = 64;
+
+	// The worker that the current thread is, if any
+	struct WorkerSlot_
+	{
+		void const* system = nullptr;
+		std::size_t index = 0;
+	};
+
+	thread_local WorkerSlot_ tWorker;
+}
+
+namespace labutils
+{
+	// Chase-Lev deque, with a fixed capacity. Only the owning worker
+	// push()es and pop()s, at the bottom; anyone steal()s, from the top.
+	struct JobSystem::Deque_
+	{
+		std::atomic<std::int64_t> top{ 0 }, bottom{ 0 };
+		std::atomic<Job_*> items[kDequeCapacity];
+
+		bool push( Job_* aJob ) noexcept
+		{
+			auto const b = bottom.load( std::memory_order_relaxed );
+			auto const t = top.load( std::memory_order_acquire );
+			if( b - t >= kDequeCapacity )
+				return false;
+
+			items[b % kDequeCapacity].store( aJob, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+			bottom.store( b+1, std::memory_order_relaxed );
+			return true;
+		}
+
+		Job_* pop() noexcept
+		{
+			auto const b = bottom.load( std::memory_order_relaxed ) - 1;
+			bottom.store( b, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			auto t = top.load( std::memory_order_relaxed );
+
+			if( t > b )
+			{
+				bottom.store( b+1, std::memory_order_relaxed );
+				return nullptr;
+			}
+
+			auto* job = items[b % kDequeCapacity].load( std::memory_order_relaxed );
+			if( t == b )
+			{
+				// Last item; race the thieves for it
+				if( !top.compare_exchange_strong( t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+					job = nullptr;
+				bottom.store( b+1, std::memory_order_relaxed );
+			}
+			return job;
+		}
+
+		Job_* steal() noexcept
+		{
+			auto t = top.load( std::memory_order_acquire );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			auto const b = bottom.load( std::memory_order_acquire );
+			if( t >= b )
+				return nullptr;
+
+			auto* job = items[t % kDequeCapacity].load( std::memory_order_relaxed );
+			if( !top.compare_exchange_strong( t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+				return nullptr;
+			return job;
+		}
+	};
+
+
+	JobSystem::JobSystem( std::size_t aWorkers )
+		: mDeques( aWorkers )
+	{
+		for( std::size_t i = 0; i < aWorkers; ++i )
+			mWorkers.emplace_back( [this, i] { worker_( i ); } );
+
+		// The workers allocate their deques (see worker_())
+		std::unique_lock<std::mutex> lock( mMutex );
+		mWake.wait( lock, [&] { return mReady == aWorkers; } );
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+		mWake.notify_all();
+
+		for( auto& worker : mWorkers )
+			worker.join();
+
+		// Without workers, queued jobs that nobody waited for are left
+		while( auto* job = take_() )
+			run_( job );
+	}
+
+	std::size_t JobSystem::worker_count() const noexcept
+	{
+		return mWorkers.size();
+	}
+
+	void JobSystem::spawn( Job aJob, JobCounter* aDone, JobCounter* aAfter )
+	{
+		auto* job = new Job_{ std::move(aJob), aDone };
+
+		if( aDone )
+			hold( *aDone );
+
+		if( aAfter )
+		{
+			std::lock_guard<std::mutex> lock( aAfter->mMutex );
+			if( 0 != aAfter->mPending )
+			{
+				aAfter->mHeld.emplace_back( job );
+				return;
+			}
+		}
+
+		push_( job );
+	}
+
+	void JobSystem::wait( JobCounter& aCounter )
+	{
+		while( 0 != aCounter.mPending.load( std::memory_order_acquire ) )
+		{
+			if( auto* job = take_() )
+			{
+				run_( job );
+				continue;
+			}
+
+			// Nothing to help with; the counted jobs are running elsewhere.
+			// Check for new jobs every now and then.
+			std::unique_lock<std::mutex> lock( aCounter.mMutex );
+			aCounter.mZero.wait_for( lock, std::chrono::milliseconds(1), [&] { return 0 == aCounter.mPending; } );
+		}
+
+		std::exception_ptr error;
+		{
+			std::lock_guard<std::mutex> lock( aCounter.mMutex );
+			std::swap( error, aCounter.mError );
+		}
+
+		if( error )
+			std::rethrow_exception( error );
+	}
+
+	void JobSystem::push_( Job_* aJob )
+	{
+		mQueued.fetch_add( 1 );
+
+		bool const ownDeque = this == tWorker.system && mDeques[tWorker.index]->push( aJob );
+		if( !ownDeque )
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mShared.emplace_back( aJob );
+		}
+
+		// Under mMutex: a worker going to sleep either sees mQueued, or is
+		// waiting by the time this notifies
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( 0 != mSleeping )
+			mWake.notify_one();
+	}
+
+	JobSystem::Job_* JobSystem::take_()
+	{
+		if( 0 == mQueued.load( std::memory_order_acquire ) )
+			return nullptr;
+
+		Job_* job = nullptr;
+
+		std::size_t first = 0;
+		if( this == tWorker.system )
+		{
+			job = mDeques[tWorker.index]->pop();
+			first = tWorker.index + 1;
+		}
+
+		if( !job )
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			if( mSharedFirst != mShared.size() )
+			{
+				job = mShared[mSharedFirst++];
+				if( mSharedFirst == mShared.size() )
+				{
+					mShared.clear();
+					mSharedFirst = 0;
+				}
+			}
+		}
+
+		// Steal from the others, starting at the next worker, so that thieves
+		// spread over the victims
+		for( std::size_t i = 0; !job && i < mDeques.size(); ++i )
+			job = mDeques[(first + i) % mDeques.size()]->steal();
+
+		if( job )
+			mQueued.fetch_sub( 1 );
+
+		return job;
+	}
+
+	void JobSystem::run_( Job_* aJob )
+	{
+		std::exception_ptr error;
+		try
+		{
+			aJob->func();
+		}
+		catch( ... )
+		{
+			error = std::current_exception();
+		}
+
+		// The job may own its counter (see Task), so it is destroyed last
+		if( aJob->done )
+			release_( *aJob->done, error );
+
+		delete aJob;
+	}
+
+	void JobSystem::hold( JobCounter& aCounter )
+	{
+		std::lock_guard<std::mutex> lock( aCounter.mMutex );
+		++aCounter.mPending;
+	}
+
+	void JobSystem::release( JobCounter& aCounter )
+	{
+		release_( aCounter, nullptr );
+	}
+
+	void JobSystem::release_( JobCounter& aCounter, std::exception_ptr aError )
+	{
+		std::vector<Job_*> held;
+		{
+			std::lock_guard<std::mutex> lock( aCounter.mMutex );
+			if( aError && !aCounter.mError )
+				aCounter.mError = aError;
+
+			assert( 0 != aCounter.mPending );
+			if( 0 == --aCounter.mPending )
+			{
+				std::swap( held, aCounter.mHeld );
+				aCounter.mZero.notify_all();
+			}
+		}
+
+		for( auto* job : held )
+			push_( job );
+	}
+
+	void JobSystem::worker_( std::size_t aIndex )
+	{
+		// Placed first, so that its deque is allocated (first touched) on
+		// the worker's NUMA node, if it is restricted to one. Nobody steals
+		// before all deques exist.
+		place_current_thread( EThreadRole::worker, "job worker", aIndex );
+		{
+			auto deque = std::make_unique<Deque_>();
+			std::unique_lock<std::mutex> lock( mMutex );
+			mDeques[aIndex] = std::move(deque);
+			++mReady;
+			mWake.notify_all();
+			mWake.wait( lock, [this] { return mReady == mDeques.size(); } );
+		}
+
+		tWorker.system = this;
+		tWorker.index = aIndex;
+
+		for( unsigned spins = 0;; )
+		{
+			if( auto* job = take_() )
+			{
+				run_( job );
+				spins = 0;
+				continue;
+			}
+
+			if( ++spins < kIdleSpins )
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock( mMutex );
+			++mSleeping;
+			mWake.wait( lock, [this] { return mQuit || 0 != mQueued.load(); } );
+			--mSleeping;
+
+			if( mQuit && 0 == mQueued.load() )
+				return;
+
+			spins = 0;
+		}
+	}
+
+
+	JobCounter::~JobCounter()
+	{
+		assert( 0 == mPending && mHeld.empty() );
+	}
+
+	bool JobCounter::done() const noexcept
+	{
+		return 0 == mPending.load( std::memory_order_acquire );
+	}
+
+
+	JobSystem& shared_jobs()
+	{
+		static JobSystem jobs( std::max( 1u, std::thread::hardware_concurrency() ) - 1 );
+		return jobs;
+	}
+}
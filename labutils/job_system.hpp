@@ -0,0 +1,186 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	class JobCounter;
+
+	// Work-stealing job scheduler, shared by the parallel parts of cw2 and
+	// cw2-bake (see shared_jobs()) instead of each of them starting its own
+	// threads.
+	//
+	// Each worker thread has a deque of jobs. Jobs spawned by a job go to the
+	// bottom of its worker's deque, which the worker pops from (most recent
+	// first, while the data is still in cache); idle workers steal from the
+	// top of the others' deques, without locks (Chase-Lev). Jobs spawned
+	// from other threads, and those that don't fit a full deque, go to a
+	// shared queue.
+	//
+	// Workers place themselves as EThreadRole::worker (see
+	// thread_placement.hpp) before allocating their deques.
+	//
+	// Completion is tracked with JobCounter: spawn() counts the job into
+	// aDone, and the job is counted out once it has run. Jobs spawned with
+	// aAfter are held until that counter reaches zero, which chains
+	// dependent work without blocking a thread. wait() runs jobs until the
+	// counter reaches zero, so waiting from inside a job (nested
+	// parallel_for()s) doesn't deadlock or idle the thread.
+	class JobSystem
+	{
+		public:
+			using Job = std::function<void()>;
+
+		public:
+			// aWorkers threads besides the ones that call wait(); 0: all
+			// work is done by wait()
+			explicit JobSystem( std::size_t aWorkers );
+			~JobSystem(); // runs the queued jobs, then joins the workers
+
+			JobSystem( JobSystem const& ) = delete;
+			JobSystem& operator= (JobSystem const&) = delete;
+
+		public:
+			std::size_t worker_count() const noexcept;
+
+			// aDone, if any, counts the job until it has run; exceptions that
+			// it throws go to aDone (and are rethrown by wait()), or are
+			// dropped without one. aAfter, if any, holds the job until that
+			// counter is zero. Counters must outlive the jobs counted.
+			void spawn( Job, JobCounter* aDone = nullptr, JobCounter* aAfter = nullptr );
+
+			// Runs jobs until aCounter is zero. Rethrows the first exception
+			// thrown by the jobs counted (and forgets it).
+			void wait( JobCounter& aCounter );
+
+			// Count work that isn't a job into aCounter, e.g., a coroutine
+			// (see Task); release() counts it out, and pushes the jobs held
+			// by aCounter once it reaches zero.
+			void hold( JobCounter& aCounter );
+			void release( JobCounter& aCounter );
+
+			// Calls aFunc( i ) for each i in [0, aCount), on up to
+			// aMaxParallel threads at a time (including the calling one; 0:
+			// all workers). Items are handed out in order; results must go
+			// to per-item storage. If any calls throw, the exception of the
+			// lowest i is rethrown once all items are done.
+			template< typename tFunc >
+			void parallel_for( std::size_t aCount, tFunc&& aFunc, std::size_t aMaxParallel = 0 );
+
+		private:
+			friend class JobCounter;
+
+			struct Job_
+			{
+				Job func;
+				JobCounter* done;
+			};
+
+			struct Deque_;
+
+			void push_( Job_* );
+			Job_* take_();
+			void run_( Job_* );
+			void release_( JobCounter&, std::exception_ptr );
+			void worker_( std::size_t aIndex );
+
+		private:
+			std::vector<std::unique_ptr<Deque_>> mDeques; // one per worker
+
+			std::mutex mMutex; // shared queue, sleeping workers
+			std::condition_variable mWake;
+			std::vector<Job_*> mShared; // FIFO, from mSharedFirst
+			std::size_t mSharedFirst = 0;
+			std::size_t mSleeping = 0;
+			std::size_t mReady = 0; // workers whose deque exists
+			bool mQuit = false;
+
+			std::atomic<std::size_t> mQueued{ 0 }; // jobs in the deques and the shared queue
+
+			std::vector<std::thread> mWorkers;
+	};
+
+	// Number of jobs that haven't completed yet, plus the jobs held until
+	// it reaches zero (see JobSystem::spawn()). Reusable once zero.
+	class JobCounter
+	{
+		public:
+			JobCounter() = default;
+			~JobCounter(); // must be zero
+
+			JobCounter( JobCounter const& ) = delete;
+			JobCounter& operator= (JobCounter const&) = delete;
+
+		public:
+			bool done() const noexcept;
+
+		private:
+			friend class JobSystem;
+
+			// Decrements under mMutex, so that a wait() that sees zero and
+			// then locks mMutex knows that the counter is no longer touched.
+			std::atomic<std::size_t> mPending{ 0 };
+
+			std::mutex mMutex;
+			std::condition_variable mZero;
+			std::vector<JobSystem::Job_*> mHeld; // spawned with this as aAfter
+			std::exception_ptr mError;
+	};
+
+	// Process-wide JobSystem with a worker for each core but the calling
+	// one; created on first use.
+	JobSystem& shared_jobs();
+
+
+	template< typename tFunc >
+	void JobSystem::parallel_for( std::size_t aCount, tFunc&& aFunc, std::size_t aMaxParallel )
+	{
+		if( 0 == aCount )
+			return;
+
+		std::size_t threads = worker_count() + 1;
+		if( 0 != aMaxParallel )
+			threads = std::min( threads, aMaxParallel );
+
+		std::vector<std::exception_ptr> errors( aCount );
+
+		std::atomic<std::size_t> next{ 0 };
+		auto const runner = [&] {
+			for( std::size_t i; (i = next++) < aCount; )
+			{
+				try
+				{
+					aFunc( i );
+				}
+				catch( ... )
+				{
+					errors[i] = std::current_exception();
+				}
+			}
+		};
+
+		JobCounter done;
+		for( std::size_t i = 1; i < std::min( threads, aCount ); ++i )
+			spawn( std::cref( runner ), &done );
+
+		runner();
+		wait( done );
+
+		for( auto const& error : errors )
+		{
+			if( error )
+				std::rethrow_exception( error );
+		}
+	}
+}
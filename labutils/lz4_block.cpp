@@ -0,0 +1,251 @@
+#include "lz4_block.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+
+#include "error.hpp"
+
+namespace
+{
+	// See the LZ4 block format description (lz4_Block_format.md)
+	constexpr std::size_t kMinMatch = 4;
+	constexpr std::size_t kLastLiterals = 5; // the last 5 bytes are literals
+	constexpr std::size_t kMatchLimit = 12;  // no match starts in the last 12 bytes
+	constexpr std::size_t kMaxOffset = 65535;
+
+	constexpr std::size_t kWildCopy = 16; // see lz4_decompress()
+
+	constexpr unsigned kHashBits = 16;
+	constexpr unsigned kChainDepth = 16;
+	constexpr std::size_t kWindowMask = 0xffff;
+
+	std::uint32_t read32_( std::uint8_t const* aPtr )
+	{
+		std::uint32_t ret;
+		std::memcpy( &ret, aPtr, sizeof(ret) );
+		return ret;
+	}
+
+	std::uint32_t hash_( std::uint32_t aValue )
+	{
+		return (aValue * 2654435761u) >> (32 - kHashBits);
+	}
+
+	// Extra length bytes of a literal or match length field that is >= 15
+	void write_length_( std::vector<std::uint8_t>& aOut, std::size_t aLength )
+	{
+		for( ; aLength >= 255; aLength -= 255 )
+			aOut.push_back( 255 );
+
+		aOut.push_back( std::uint8_t(aLength) );
+	}
+
+	// aMatch = 0: last sequence (literals only)
+	void write_sequence_( std::vector<std::uint8_t>& aOut, std::uint8_t const* aLiterals, std::size_t aLiteralCount, std::size_t aMatch, std::size_t aOffset )
+	{
+		auto const tokenPos = aOut.size();
+		aOut.push_back( 0 );
+
+		std::uint8_t token = std::uint8_t(std::min<std::size_t>( aLiteralCount, 15 ) << 4);
+		if( aLiteralCount >= 15 )
+			write_length_( aOut, aLiteralCount - 15 );
+
+		aOut.insert( aOut.end(), aLiterals, aLiterals + aLiteralCount );
+
+		if( aMatch )
+		{
+			aOut.push_back( std::uint8_t(aOffset & 0xff) );
+			aOut.push_back( std::uint8_t(aOffset >> 8) );
+
+			auto const length = aMatch - kMinMatch;
+			token |= std::uint8_t(std::min<std::size_t>( length, 15 ));
+			if( length >= 15 )
+				write_length_( aOut, length - 15 );
+		}
+
+		aOut[tokenPos] = token;
+	}
+}
+
+namespace labutils
+{
+	std::vector<std::uint8_t> lz4_compress( void const* aData, std::size_t aBytes )
+	{
+		auto const* src = static_cast<std::uint8_t const*>(aData);
+
+		std::vector<std::uint8_t> out;
+		out.reserve( aBytes + aBytes/255 + 16 );
+
+		std::size_t anchor = 0;
+		if( aBytes > kMatchLimit )
+		{
+			// head: most recent position per hash; chain: previous position
+			// with the same hash, for the positions in the 64k window.
+			std::vector<std::int64_t> head( std::size_t(1) << kHashBits, -1 );
+			std::vector<std::int64_t> chain( kWindowMask + 1, -1 );
+
+			auto const insert_ = [&] (std::size_t aPos) {
+				auto& first = head[hash_( read32_( src + aPos ) )];
+				chain[aPos & kWindowMask] = first;
+				first = std::int64_t(aPos);
+			};
+
+			std::size_t const matchEnd = aBytes - kLastLiterals;
+			std::size_t pos = 0;
+			while( pos + kMatchLimit <= aBytes )
+			{
+				auto const value = read32_( src + pos );
+
+				std::size_t bestLength = 0, bestOffset = 0;
+				auto candidate = head[hash_( value )];
+				for( unsigned depth = 0; depth < kChainDepth && candidate >= 0 && pos - std::size_t(candidate) <= kMaxOffset; ++depth )
+				{
+					auto const cand = std::size_t(candidate);
+					if( read32_( src + cand ) == value )
+					{
+						std::size_t length = kMinMatch;
+						while( pos + length < matchEnd && src[cand + length] == src[pos + length] )
+							++length;
+
+						if( length > bestLength )
+						{
+							bestLength = length;
+							bestOffset = pos - cand;
+						}
+					}
+
+					// Entries are overwritten once they leave the window;
+					// stop at anything that isn't older.
+					auto const next = chain[cand & kWindowMask];
+					if( next >= candidate )
+						break;
+
+					candidate = next;
+				}
+
+				insert_( pos );
+
+				if( bestLength < kMinMatch )
+				{
+					++pos;
+					continue;
+				}
+
+				write_sequence_( out, src + anchor, pos - anchor, bestLength, bestOffset );
+
+				for( std::size_t i = pos + 1; i < pos + bestLength && i + kMatchLimit <= aBytes; ++i )
+					insert_( i );
+
+				pos += bestLength;
+				anchor = pos;
+			}
+		}
+
+		write_sequence_( out, src + anchor, aBytes - anchor, 0, 0 );
+		return out;
+	}
+
+	void lz4_decompress( void const* aSrc, std::size_t aSrcBytes, void* aDst, std::size_t aDstBytes )
+	{
+		auto const* const src = static_cast<std::uint8_t const*>(aSrc);
+		auto* const dst = static_cast<std::uint8_t*>(aDst);
+
+		auto const* ip = src;
+		auto const* const iend = src + aSrcBytes;
+		auto* op = dst;
+		auto* const oend = dst + aDstBytes;
+
+		auto const fail_ = [&] (char const* aWhat) {
+			throw Error( "lz4_decompress(): %s at input byte %zu", aWhat, std::size_t(ip - src) );
+		};
+
+		auto const read_length_ = [&] (std::size_t aLength) {
+			if( 15 == aLength )
+			{
+				std::uint8_t byte;
+				do
+				{
+					if( ip == iend )
+						fail_( "truncated length" );
+
+					byte = *ip++;
+					aLength += byte;
+				} while( 255 == byte );
+			}
+
+			return aLength;
+		};
+
+		for( ;; )
+		{
+			if( ip == iend )
+				fail_( "truncated block" );
+
+			auto const token = *ip++;
+
+			auto const literals = read_length_( token >> 4 );
+			if( literals > std::size_t(iend - ip) )
+				fail_( "truncated literals" );
+			if( literals > std::size_t(oend - op) )
+				fail_( "output overrun" );
+
+			// Short runs are copied as a fixed 16 bytes where there's room;
+			// the bytes past the end are overwritten later (or are past the
+			// literals, but still within the buffers).
+			if( literals <= kWildCopy && std::size_t(iend - ip) >= kWildCopy && std::size_t(oend - op) >= kWildCopy )
+				std::memcpy( op, ip, kWildCopy );
+			else
+				std::memcpy( op, ip, literals );
+
+			op += literals;
+			ip += literals;
+
+			// The last sequence has no match
+			if( ip == iend )
+				break;
+
+			if( std::size_t(iend - ip) < 2 )
+				fail_( "truncated offset" );
+
+			std::size_t const offset = std::size_t(ip[0]) | std::size_t(ip[1]) << 8;
+			ip += 2;
+
+			if( 0 == offset || offset > std::size_t(op - dst) )
+				fail_( "invalid offset" );
+
+			auto const length = read_length_( token & 15 ) + kMinMatch;
+			if( length > std::size_t(oend - op) )
+				fail_( "output overrun" );
+
+			// Matches may overlap their own output (offset < length)
+			std::uint8_t const* match = op - offset;
+			auto* const end = op + length;
+			if( offset >= kWildCopy && std::size_t(oend - end) >= kWildCopy )
+			{
+				for( ; op < end; op += kWildCopy, match += kWildCopy )
+					std::memcpy( op, match, kWildCopy );
+
+				op = end;
+			}
+			else if( offset >= length )
+			{
+				std::memcpy( op, match, length );
+				op = end;
+			}
+			else
+			{
+				for( ; offset >= 8 && end - op >= 8; op += 8, match += 8 )
+					std::memcpy( op, match, 8 );
+
+				while( op < end )
+					*op++ = *match++;
+			}
+		}
+
+		if( op != oend )
+			throw Error( "lz4_decompress(): block has %zu bytes, expected %zu", std::size_t(op - dst), aDstBytes );
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
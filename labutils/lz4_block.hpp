@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	// Blocks in the LZ4 block format (the format of LZ4_compress_default()
+	// and LZ4_decompress_safe(), without the frame around it), as used for
+	// the compressed mesh data of baked models. Blocks carry no sizes; the
+	// compressed and decompressed sizes must be stored alongside.
+
+	// Compresses aBytes bytes. Greedy parsing with a short hash chain; the
+	// result is not byte-identical to lz4's, but any LZ4 decoder accepts it.
+	std::vector<std::uint8_t> lz4_compress( void const* aData, std::size_t aBytes );
+
+	// Decompresses a block that must expand to exactly aDstBytes bytes.
+	// Never reads or writes out of bounds, also for malformed blocks. Throws
+	// labutils::Error if the block is malformed or has a different size.
+	// Touches only the given memory, so it may be called from several threads
+	// at once.
+	void lz4_decompress( void const* aSrc, std::size_t aSrcBytes, void* aDst, std::size_t aDstBytes );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
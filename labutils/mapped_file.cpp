@@ -0,0 +1,198 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#include "error.hpp"
+#include "texture_pack.hpp"
+
+namespace labutils
+{
+	MappedFile::MappedFile() noexcept = default;
+
+	MappedFile::~MappedFile()
+	{
+		if( mCopy || mPack )
+			return;
+
+#		if defined(_WIN32)
+		if( mData )
+			UnmapViewOfFile( mData );
+		if( mMapping )
+			CloseHandle( mMapping );
+		if( mFile )
+			CloseHandle( mFile );
+#		else
+		if( mData )
+			munmap( const_cast<std::uint8_t*>(mData), mSize );
+#		endif
+	}
+
+	MappedFile::MappedFile( MappedFile&& aOther ) noexcept
+		: mData( std::exchange( aOther.mData, nullptr ) )
+		, mSize( std::exchange( aOther.mSize, 0 ) )
+		, mCopy( std::move(aOther.mCopy) )
+		, mPack( std::move(aOther.mPack) )
+#		if defined(_WIN32)
+		, mFile( std::exchange( aOther.mFile, nullptr ) )
+		, mMapping( std::exchange( aOther.mMapping, nullptr ) )
+#		endif
+	{}
+	MappedFile& MappedFile::operator=( MappedFile&& aOther ) noexcept
+	{
+		std::swap( mData, aOther.mData );
+		std::swap( mSize, aOther.mSize );
+		std::swap( mCopy, aOther.mCopy );
+		std::swap( mPack, aOther.mPack );
+#		if defined(_WIN32)
+		std::swap( mFile, aOther.mFile );
+		std::swap( mMapping, aOther.mMapping );
+#		endif
+		return *this;
+	}
+}
+
+namespace labutils
+{
+	MappedFile map_file( char const* aPath )
+	{
+		MappedFile ret;
+
+		if( PackedFile packed; find_packed_file( aPath, packed ) )
+		{
+			ret.mData = packed.pack->data() + packed.offset;
+			ret.mSize = std::size_t(packed.size);
+			ret.mPack = std::move(packed.pack);
+			return ret;
+		}
+
+#		if defined(_WIN32)
+		HANDLE file = CreateFileA( aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+		if( INVALID_HANDLE_VALUE == file )
+			throw Error( "map_file(): unable to open '%s' for reading (error %lu)", aPath, GetLastError() );
+
+		ret.mFile = file;
+
+		LARGE_INTEGER size;
+		if( !GetFileSizeEx( file, &size ) )
+			throw Error( "map_file(): unable to query size of '%s' (error %lu)", aPath, GetLastError() );
+
+		ret.mSize = std::size_t(size.QuadPart);
+		if( 0 == ret.mSize )
+			return ret; // CreateFileMapping() refuses empty files
+
+		HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if( !mapping )
+			throw Error( "map_file(): CreateFileMapping() failed for '%s' (error %lu)", aPath, GetLastError() );
+
+		ret.mMapping = mapping;
+
+		void* ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+		if( !ptr )
+			throw Error( "map_file(): MapViewOfFile() failed for '%s' (error %lu)", aPath, GetLastError() );
+
+		ret.mData = static_cast<std::uint8_t const*>(ptr);
+#		else
+		int const fd = open( aPath, O_RDONLY );
+		if( -1 == fd )
+			throw Error( "map_file(): unable to open '%s' for reading: %s", aPath, std::strerror(errno) );
+
+		struct stat st;
+		if( -1 == fstat( fd, &st ) )
+		{
+			int const err = errno;
+			close( fd );
+			throw Error( "map_file(): unable to stat '%s': %s", aPath, std::strerror(err) );
+		}
+
+		ret.mSize = std::size_t(st.st_size);
+		if( 0 == ret.mSize )
+		{
+			close( fd );
+			return ret; // mmap() refuses zero-length mappings
+		}
+
+		void* ptr = mmap( nullptr, ret.mSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+		int const err = errno;
+
+		// The mapping keeps its own reference to the file.
+		close( fd );
+
+		if( MAP_FAILED == ptr )
+			throw Error( "map_file(): mmap() failed for '%s': %s", aPath, std::strerror(err) );
+
+		// The whole file is consumed front to back by the loaders.
+		madvise( ptr, ret.mSize, MADV_SEQUENTIAL );
+
+		ret.mData = static_cast<std::uint8_t const*>(ptr);
+#		endif
+
+		return ret;
+	}
+
+	MappedFile read_file( char const* aPath )
+	{
+		// Reads of at most this many bytes; large enough that a file is a
+		// handful of them
+		constexpr std::size_t kReadBytes = std::size_t(64) << 20;
+
+		if( PackedFile packed; find_packed_file( aPath, packed ) )
+		{
+			MappedFile ret;
+			ret.mSize = std::size_t(packed.size);
+			ret.mCopy.reset( new std::uint8_t[ret.mSize ? ret.mSize : 1] );
+			ret.mData = ret.mCopy.get();
+			std::memcpy( ret.mCopy.get(), packed.pack->data() + packed.offset, ret.mSize );
+			return ret;
+		}
+
+		std::error_code ec;
+		auto const size = std::filesystem::file_size( aPath, ec );
+		if( ec )
+			throw Error( "read_file(): unable to query size of '%s': %s", aPath, ec.message().c_str() );
+
+		std::FILE* fin = std::fopen( aPath, "rb" );
+		if( !fin )
+			throw Error( "read_file(): unable to open '%s' for reading: %s", aPath, std::strerror(errno) );
+
+		// The block is the only buffer; stdio's would just be copied through.
+		std::setvbuf( fin, nullptr, _IONBF, 0 );
+
+		MappedFile ret;
+		ret.mSize = std::size_t(size);
+		ret.mCopy.reset( new std::uint8_t[ret.mSize ? ret.mSize : 1] );
+		ret.mData = ret.mCopy.get();
+
+		for( std::size_t offset = 0; offset < ret.mSize; )
+		{
+			auto const bytes = std::min( kReadBytes, ret.mSize - offset );
+			if( std::fread( ret.mCopy.get() + offset, 1, bytes, fin ) != bytes )
+			{
+				std::fclose( fin );
+				throw Error( "read_file(): unable to read %zu bytes from '%s'", ret.mSize, aPath );
+			}
+			offset += bytes;
+		}
+
+		std::fclose( fin );
+		return ret;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	// Read-only memory mapping of a whole file. Uses mmap() on POSIX systems
+	// and CreateFileMapping()/MapViewOfFile() on Windows. The mapping stays
+	// valid for as long as the MappedFile object is alive.
+	//
+	// read_file() instead reads the whole file into a single heap block that
+	// the object owns; for media where mapping is slow or unavailable, or to
+	// have all of the data resident up front. FileReader (file_reader.hpp)
+	// makes the same, asynchronously.
+	//
+	// Paths in a mounted texture pack (see texture_pack.hpp) are served from
+	// the pack: map_file() returns a range of its mapping, and read_file() a
+	// copy of the range.
+	class MappedFile
+	{
+		public:
+			MappedFile() noexcept, ~MappedFile();
+
+			MappedFile( MappedFile const& ) = delete;
+			MappedFile& operator= (MappedFile const&) = delete;
+
+			MappedFile( MappedFile&& ) noexcept;
+			MappedFile& operator = (MappedFile&&) noexcept;
+
+		public:
+			std::uint8_t const* data() const noexcept { return mData; }
+			std::size_t size() const noexcept { return mSize; }
+
+		private:
+			friend MappedFile map_file( char const* );
+			friend MappedFile read_file( char const* );
+			friend class FileReader;
+
+			std::uint8_t const* mData = nullptr;
+			std::size_t mSize = 0;
+
+			std::unique_ptr<std::uint8_t[]> mCopy; // read_file(): mData
+			std::shared_ptr<MappedFile const> mPack; // map_file() of a packed file: holds mData
+
+#			if defined(_WIN32)
+			void* mFile = nullptr;
+			void* mMapping = nullptr;
+#			endif
+	};
+
+	MappedFile map_file( char const* aPath );
+	MappedFile read_file( char const* aPath );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
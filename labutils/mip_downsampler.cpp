@@ -0,0 +1,417 @@
+#include "mip_downsampler.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+#include "vkimage.hpp"
+#include "upload_batch.hpp"
+
+namespace labutils
+{
+	namespace
+	{
+		constexpr std::uint32_t kBlockSize = 64; // source texels per work group and side
+		constexpr std::uint32_t kBlockLevels = 6; // levels of a block
+		constexpr std::uint32_t kMaxPassSource = kBlockSize << kBlockLevels; // for all kMaxPassLevels in one dispatch
+
+		ImageView create_view_( VulkanContext const& aContext, VkImage aImage, VkFormat aFormat, std::uint32_t aLevel )
+		{
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = aImage;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = aFormat;
+			viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, aLevel, 1, 0, 1 };
+
+			VkImageView view = VK_NULL_HANDLE;
+			if( auto const res = vkCreateImageView( aContext.device, &viewInfo, nullptr, &view ); VK_SUCCESS != res )
+				throw Error( "Unable to create downsampler image view\n" "vkCreateImageView() returned %s", to_string(res).c_str() );
+
+			return ImageView( aContext.device, view );
+		}
+
+		// Formats that storage images have without shaderStorageImageExtendedFormats
+		bool base_storage_format_( VkFormat aFormat )
+		{
+			switch( aFormat )
+			{
+				case VK_FORMAT_R8G8B8A8_UNORM:
+				case VK_FORMAT_R16G16B16A16_SFLOAT:
+				case VK_FORMAT_R32_SFLOAT:
+				case VK_FORMAT_R32G32B32A32_SFLOAT:
+					return true;
+				default:
+					return false;
+			}
+		}
+	}
+
+	MipDownsampler::MipDownsampler() noexcept = default;
+
+	MipDownsampler::MipDownsampler( VulkanContext const& aContext, Allocator const& aAllocator, VkCommandPool aCmdPool, ShaderModuleCache& aShaderModules, EDownsample aReduction, DownsampleShader const* aShaders, std::size_t aShaderCount, std::uint32_t aCounters, VkPipelineCache aCache )
+		: mContext( &aContext )
+		, mCounterCount( aCounters )
+	{
+		assert( aCounters > 0 );
+
+		// Sampler. The shader only uses texelFetch(), but combined image
+		// samplers need one regardless.
+		{
+			VkSamplerCreateInfo samplerInfo{};
+			samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			samplerInfo.magFilter = VK_FILTER_NEAREST;
+			samplerInfo.minFilter = VK_FILTER_NEAREST;
+			samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+			VkSampler sampler = VK_NULL_HANDLE;
+			if( auto const res = vkCreateSampler( aContext.device, &samplerInfo, nullptr, &sampler ); VK_SUCCESS != res )
+				throw Error( "Unable to create downsampler sampler\n" "vkCreateSampler() returned %s", to_string(res).c_str() );
+
+			mSampler = Sampler( aContext.device, sampler );
+		}
+
+		// Binding 0: the source; 1: the levels; 2: the counters
+		{
+			VkDescriptorSetLayoutBinding bindings[3]{};
+			bindings[0].binding = 0;
+			bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			bindings[0].descriptorCount = 1;
+			bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			bindings[0].pImmutableSamplers = &mSampler.handle;
+
+			bindings[1].binding = 1;
+			bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			bindings[1].descriptorCount = kMaxPassLevels;
+			bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+			bindings[2].binding = 2;
+			bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[2].descriptorCount = 1;
+			bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+			VkDescriptorSetLayoutCreateInfo layoutInfo{};
+			layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+			layoutInfo.pBindings = bindings;
+
+			VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+			if( auto const res = vkCreateDescriptorSetLayout( aContext.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+				throw Error( "Unable to create downsampler descriptor set layout\n" "vkCreateDescriptorSetLayout() returned %s", to_string(res).c_str() );
+
+			mLayout = DescriptorSetLayout( aContext.device, layout );
+		}
+
+		{
+			VkPushConstantRange pushRange{};
+			pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			pushRange.size = sizeof(Push_);
+
+			VkPipelineLayoutCreateInfo layoutInfo{};
+			layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			layoutInfo.setLayoutCount = 1;
+			layoutInfo.pSetLayouts = &mLayout.handle;
+			layoutInfo.pushConstantRangeCount = 1;
+			layoutInfo.pPushConstantRanges = &pushRange;
+
+			VkPipelineLayout layout = VK_NULL_HANDLE;
+			if( auto const res = vkCreatePipelineLayout( aContext.device, &layoutInfo, nullptr, &layout ); VK_SUCCESS != res )
+				throw Error( "Unable to create downsampler pipeline layout\n" "vkCreatePipelineLayout() returned %s", to_string(res).c_str() );
+
+			mPipeLayout = PipelineLayout( aContext.device, layout );
+		}
+
+		// A pipeline per shader whose storage format the device has. The
+		// shaders index the levels dynamically (uniformly).
+		VkPhysicalDeviceFeatures features{};
+		vkGetPhysicalDeviceFeatures( aContext.physicalDevice, &features );
+
+		for( std::size_t i = 0; i < aShaderCount && VK_TRUE == features.shaderStorageImageArrayDynamicIndexing; ++i )
+		{
+			auto const& shader = aShaders[i];
+
+			VkFormatProperties props{};
+			vkGetPhysicalDeviceFormatProperties( aContext.physicalDevice, shader.format, &props );
+			if( !(props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) )
+				continue;
+			if( !base_storage_format_( shader.format ) && VK_TRUE != features.shaderStorageImageExtendedFormats )
+				continue;
+
+			// kReduction (constant_id 0)
+			std::uint32_t const reduction = EDownsample::minimum == aReduction ? 1 : 0;
+			VkSpecializationMapEntry const specEntry{ 0, 0, sizeof(std::uint32_t) };
+
+			VkSpecializationInfo specInfo{};
+			specInfo.mapEntryCount = 1;
+			specInfo.pMapEntries = &specEntry;
+			specInfo.dataSize = sizeof(std::uint32_t);
+			specInfo.pData = &reduction;
+
+			VkComputePipelineCreateInfo pipeInfo{};
+			pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipeInfo.stage.module = aShaderModules.get( shader.spirvPath );
+			pipeInfo.stage.pName = "main";
+			pipeInfo.stage.pSpecializationInfo = &specInfo;
+			pipeInfo.layout = mPipeLayout.handle;
+
+			VkPipeline pipe = VK_NULL_HANDLE;
+			if( auto const res = vkCreateComputePipelines( aContext.device, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+				throw Error( "Unable to create downsampler pipeline\n" "vkCreateComputePipelines() returned %s", to_string(res).c_str() );
+
+			mPipes.emplace_back( shader.format, Pipeline( aContext.device, pipe ) );
+		}
+
+		// The counters start at zero; the last work group of a dispatch
+		// sets its counter back
+		mCounters = create_buffer( aAllocator, VkDeviceSize(aCounters) * sizeof(std::uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, EMemoryClass::device );
+		{
+			std::vector<std::uint32_t> const zeros( aCounters, 0 );
+
+			UploadBatch batch( aContext, aCmdPool, aAllocator );
+			batch.upload_buffer( mCounters.buffer, zeros.data(), zeros.size() * sizeof(std::uint32_t), VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT );
+			batch.submit().wait();
+		}
+
+		mDescriptors.emplace( aContext, 16, std::vector<DescriptorAllocator::PoolRatio>{
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, float(kMaxPassLevels) },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.f }
+		} );
+	}
+
+	bool MipDownsampler::supports( VkFormat aFormat ) const noexcept
+	{
+		return VK_NULL_HANDLE != pipeline_( downsample_storage_format( aFormat ) );
+	}
+
+	bool MipDownsampler::full( std::uint32_t aLevels ) const noexcept
+	{
+		// At most two dispatches per target (see add())
+		std::uint32_t const passes = aLevels > kBlockLevels ? 2 : 1;
+		return mCountersUsed + passes > mCounterCount;
+	}
+
+	std::uint32_t MipDownsampler::add( VkImage aImage, VkFormat aFormat, VkExtent2D aExtent, std::uint32_t aFirstLevel, std::uint32_t aLevels, VkImageView aSource, VkExtent2D aSourceExtent, VkImageLayout aSourceLayout )
+	{
+		assert( mContext );
+		assert( aLevels > 0 );
+		assert( VK_NULL_HANDLE != aSource || aFirstLevel > 0 );
+
+		VkFormat const storageFormat = downsample_storage_format( aFormat );
+		VkPipeline const pipe = pipeline_( storageFormat );
+		if( VK_NULL_HANDLE == pipe )
+			throw Error( "MipDownsampler: no downsampling of images of VkFormat %d", int(aFormat) );
+		if( full( aLevels ) )
+			throw Error( "MipDownsampler: all %u counters are in use", mCounterCount );
+
+		if( VK_NULL_HANDLE == aSource )
+		{
+			mViews.emplace_back( create_view_( *mContext, aImage, aFormat, aFirstLevel-1 ) );
+			aSource = mViews.back().handle;
+			aSourceExtent = VkExtent2D{ std::max( 1u, aExtent.width >> (aFirstLevel-1) ), std::max( 1u, aExtent.height >> (aFirstLevel-1) ) };
+		}
+
+		std::uint32_t const firstView = std::uint32_t(mViews.size());
+		for( std::uint32_t i = 0; i < aLevels; ++i )
+			mViews.emplace_back( create_view_( *mContext, aImage, storageFormat, aFirstLevel + i ) );
+
+		Target_ target;
+		for( std::uint32_t done = 0; done < aLevels; )
+		{
+			// The work groups cover the source and the first level, which
+			// may be more than half the source (e.g., padded, see
+			// cw2/hiz.hpp); reads past the source are clamped
+			std::uint32_t const coverX = std::max( aSourceExtent.width, 2 * std::max( 1u, aExtent.width >> (aFirstLevel + done) ) );
+			std::uint32_t const coverY = std::max( aSourceExtent.height, 2 * std::max( 1u, aExtent.height >> (aFirstLevel + done) ) );
+
+			// All levels from up to kMaxPassSource texels per side; larger
+			// sources leave the second half to another dispatch, from the
+			// last level of the first
+			std::uint32_t const fits = std::max( coverX, coverY ) <= kMaxPassSource ? kMaxPassLevels : kBlockLevels;
+			std::uint32_t const levels = std::min( aLevels - done, fits );
+
+			Pass_ pass{};
+			pass.pipe = pipe;
+			pass.set = mDescriptors->allocate( mLayout.handle );
+			pass.push.srcWidth = std::int32_t(aSourceExtent.width);
+			pass.push.srcHeight = std::int32_t(aSourceExtent.height);
+			pass.push.levels = levels;
+			pass.push.counter = mCountersUsed++;
+			pass.groupsX = (coverX + kBlockSize-1) / kBlockSize;
+			pass.groupsY = (coverY + kBlockSize-1) / kBlockSize;
+			pass.push.workgroups = pass.groupsX * pass.groupsY;
+			pass.push.srgb = storageFormat != aFormat ? 1 : 0;
+
+			VkDescriptorImageInfo srcInfo{};
+			srcInfo.imageView = aSource;
+			srcInfo.imageLayout = aSourceLayout;
+
+			// Unused array elements repeat the last level
+			VkDescriptorImageInfo levelInfos[kMaxPassLevels]{};
+			for( std::uint32_t i = 0; i < kMaxPassLevels; ++i )
+			{
+				levelInfos[i].imageView = mViews[firstView + done + std::min( i, levels-1 )].handle;
+				levelInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			}
+
+			VkDescriptorBufferInfo counterInfo{};
+			counterInfo.buffer = mCounters.buffer;
+			counterInfo.range = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet desc[3]{};
+			for( auto& write : desc )
+			{
+				write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				write.dstSet = pass.set;
+			}
+
+			desc[0].dstBinding = 0;
+			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[0].descriptorCount = 1;
+			desc[0].pImageInfo = &srcInfo;
+
+			desc[1].dstBinding = 1;
+			desc[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			desc[1].descriptorCount = kMaxPassLevels;
+			desc[1].pImageInfo = levelInfos;
+
+			desc[2].dstBinding = 2;
+			desc[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			desc[2].descriptorCount = 1;
+			desc[2].pBufferInfo = &counterInfo;
+
+			vkUpdateDescriptorSets( mContext->device, 3, desc, 0, nullptr );
+			target.passes.emplace_back( pass );
+
+			// The next pass samples the last level in GENERAL, through a
+			// view of the image's own format (decoding sRGB)
+			done += levels;
+			if( done < aLevels )
+			{
+				mViews.emplace_back( create_view_( *mContext, aImage, aFormat, aFirstLevel + done - 1 ) );
+				aSource = mViews.back().handle;
+				aSourceExtent = VkExtent2D{ std::max( 1u, aExtent.width >> (aFirstLevel + done - 1) ), std::max( 1u, aExtent.height >> (aFirstLevel + done - 1) ) };
+				aSourceLayout = VK_IMAGE_LAYOUT_GENERAL;
+			}
+		}
+
+		mTargets.emplace_back( std::move(target) );
+		return std::uint32_t(mTargets.size() - 1);
+	}
+
+	void MipDownsampler::record( VkCommandBuffer aCmdBuff, std::uint32_t aCount, std::uint32_t const* aIds ) const
+	{
+		VkPipeline bound = VK_NULL_HANDLE;
+		for( std::size_t round = 0; ; ++round )
+		{
+			bool any = false;
+			for( std::uint32_t i = 0; i < aCount; ++i )
+			{
+				assert( aIds[i] < mTargets.size() );
+				auto const& target = mTargets[aIds[i]];
+				if( round >= target.passes.size() )
+					continue;
+
+				// The second round reads the levels of the first
+				if( !any && round > 0 )
+				{
+					VkMemoryBarrier barrier{};
+					barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+					barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+					barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+					vkCmdPipelineBarrier( aCmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+				}
+				any = true;
+
+				auto const& pass = target.passes[round];
+				if( pass.pipe != bound )
+				{
+					vkCmdBindPipeline( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipe );
+					bound = pass.pipe;
+				}
+
+				vkCmdBindDescriptorSets( aCmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeLayout.handle, 0, 1, &pass.set, 0, nullptr );
+				vkCmdPushConstants( aCmdBuff, mPipeLayout.handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Push_), &pass.push );
+				vkCmdDispatch( aCmdBuff, pass.groupsX, pass.groupsY, 1 );
+			}
+
+			if( !any )
+				break;
+		}
+	}
+
+	void MipDownsampler::reset()
+	{
+		mTargets.clear();
+		mViews.clear();
+		mCountersUsed = 0;
+		if( mDescriptors )
+			mDescriptors->reset();
+	}
+
+	VkPipeline MipDownsampler::pipeline_( VkFormat aStorageFormat ) const noexcept
+	{
+		for( auto const& [format, pipe] : mPipes )
+		{
+			if( format == aStorageFormat )
+				return pipe.handle;
+		}
+		return VK_NULL_HANDLE;
+	}
+
+	VkFormat downsample_storage_format( VkFormat aFormat ) noexcept
+	{
+		switch( aFormat )
+		{
+			case VK_FORMAT_R8_SRGB: return VK_FORMAT_R8_UNORM;
+			case VK_FORMAT_R8G8_SRGB: return VK_FORMAT_R8G8_UNORM;
+			case VK_FORMAT_R8G8B8A8_SRGB: return VK_FORMAT_R8G8B8A8_UNORM;
+			case VK_FORMAT_B8G8R8A8_SRGB: return VK_FORMAT_B8G8R8A8_UNORM;
+			default: return aFormat;
+		}
+	}
+
+	void record_texture_mips( VkCommandBuffer aCmdBuff, MipDownsampler& aMips, VkImage aImage, VkFormat aFormat, std::uint32_t aWidth, std::uint32_t aHeight )
+	{
+		auto const mipLevels = compute_mip_level_count( aWidth, aHeight );
+
+		// Level 0 is sampled; the rest are written as storage images (their
+		// contents are undefined until then)
+		image_barrier( aCmdBuff, aImage,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+		);
+		if( mipLevels < 2 )
+			return;
+
+		image_barrier( aCmdBuff, aImage,
+			0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 1, mipLevels - 1, 0, 1 }
+		);
+
+		auto const id = aMips.add( aImage, aFormat, VkExtent2D{ aWidth, aHeight }, 1, mipLevels - 1 );
+		aMips.record( aCmdBuff, 1, &id );
+
+		image_barrier( aCmdBuff, aImage,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 1, mipLevels - 1, 0, 1 }
+		);
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
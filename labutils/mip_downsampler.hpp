@@ -0,0 +1,181 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+#include <optional>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vkbuffer.hpp"
+#include "allocator.hpp"
+#include "object_cache.hpp"
+#include "vulkan_context.hpp"
+#include "descriptor_allocator.hpp"
+
+namespace labutils
+{
+	// How a level's texels combine into the next level's: the average of
+	// 2x2 texels (textures), or their minimum (e.g., a Hi-Z pyramid of
+	// reverse-Z depth)
+	enum class EDownsample
+	{
+		average,
+		minimum
+	};
+
+	// A build of the downsampling compute shader for one storage image
+	// format (e.g., VK_FORMAT_R8G8B8A8_UNORM and cw2/shaders/downsample_rgba8.comp)
+	struct DownsampleShader
+	{
+		VkFormat format;
+		char const* spirvPath;
+	};
+
+	// Single-pass mip generation in the manner of AMD's FidelityFX SPD: one
+	// dispatch writes up to kMaxPassLevels levels of an image, where a blit
+	// chain (see record_texture_mips()) takes a blit and a barrier per level.
+	// Each work group of 256 invocations reduces a 64x64 block of the source
+	// to the (up to) six levels below it, through shared memory; the last
+	// work group to finish, found with an atomic counter, goes on to the
+	// remaining levels from the sixth. The source is sampled (texelFetch()),
+	// and the levels are storage images, so they must be in
+	// VK_IMAGE_LAYOUT_GENERAL while the dispatch runs. Level k's texel t
+	// covers the source texels [t, t+1) * 2^(k+1) of its first level;
+	// reads past the edges are clamped.
+	//
+	// Images whose format is sRGB are written through UNORM views (storage
+	// images can't be sRGB), encoding in the shader; they must be created
+	// with VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT (see downsample_storage_format()).
+	//
+	// Targets (add()) are the levels of one image; their views and
+	// descriptor sets live until reset(). Needs
+	// shaderStorageImageArrayDynamicIndexing, and for one-channel 8-bit
+	// formats, shaderStorageImageExtendedFormats (see supports()).
+	class MipDownsampler
+	{
+		public:
+			// Levels per dispatch; with sources of up to 4096 texels per
+			// side (larger ones take two dispatches)
+			static constexpr std::uint32_t kMaxPassLevels = 12;
+
+		public:
+			MipDownsampler() noexcept;
+
+			// aCounters: one per dispatch of the targets added between
+			// resets (see full()). The counters are cleared through
+			// aCmdPool, waiting for it; the shader leaves them at zero.
+			// Throws labutils::Error on failure.
+			MipDownsampler(
+				VulkanContext const&,
+				Allocator const&,
+				VkCommandPool aCmdPool,
+				ShaderModuleCache&,
+				EDownsample,
+				DownsampleShader const* aShaders,
+				std::size_t aShaderCount,
+				std::uint32_t aCounters = 256,
+				VkPipelineCache = VK_NULL_HANDLE
+			);
+
+			MipDownsampler( MipDownsampler const& ) = delete;
+			MipDownsampler& operator= (MipDownsampler const&) = delete;
+
+			MipDownsampler( MipDownsampler&& ) noexcept = default;
+			MipDownsampler& operator= (MipDownsampler&&) noexcept = default;
+
+		public:
+			// Whether add() takes images of aFormat: there is a shader for
+			// its storage format, which the device supports as a storage
+			// image
+			bool supports( VkFormat ) const noexcept;
+
+			// Whether a target of aLevels levels would run out of
+			// counters; reset() to reuse them
+			bool full( std::uint32_t aLevels ) const noexcept;
+
+			// Levels aFirstLevel to aFirstLevel+aLevels-1 of aImage (of
+			// aFormat, aExtent at level 0), from aSource: a view of
+			// aSourceExtent texels, in aSourceLayout when the dispatch runs.
+			// Without aSource, it is level aFirstLevel-1 of aImage.
+			// Returns the target's id. Throws labutils::Error if the format
+			// isn't supported, or the counters are used up.
+			std::uint32_t add(
+				VkImage aImage,
+				VkFormat aFormat,
+				VkExtent2D aExtent,
+				std::uint32_t aFirstLevel,
+				std::uint32_t aLevels,
+				VkImageView aSource = VK_NULL_HANDLE,
+				VkExtent2D aSourceExtent = {},
+				VkImageLayout aSourceLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+			);
+
+			// Records the dispatches of aCount targets; their levels are
+			// written by the compute stage once it has run. Targets of more
+			// than kMaxPassLevels levels (or with larger sources) take two
+			// rounds of dispatches, with a barrier in between.
+			void record( VkCommandBuffer, std::uint32_t aCount, std::uint32_t const* aIds ) const;
+
+			// Drops all targets; none may still be in use by the GPU
+			void reset();
+
+		private:
+			// Matches the push constant block of cw2/shaders/downsample.glsl
+			struct Push_
+			{
+				std::int32_t srcWidth, srcHeight;
+				std::uint32_t levels;
+				std::uint32_t counter;
+				std::uint32_t workgroups;
+				std::uint32_t srgb;
+			};
+
+			struct Pass_
+			{
+				VkPipeline pipe;
+				VkDescriptorSet set;
+				Push_ push;
+				std::uint32_t groupsX, groupsY;
+			};
+
+			struct Target_
+			{
+				std::vector<Pass_> passes;
+			};
+
+			VkPipeline pipeline_( VkFormat aStorageFormat ) const noexcept;
+
+		private:
+			VulkanContext const* mContext = nullptr;
+
+			Sampler mSampler; // nearest; immutable in the layout
+			DescriptorSetLayout mLayout;
+			PipelineLayout mPipeLayout;
+			std::vector<std::pair<VkFormat,Pipeline>> mPipes; // by storage format
+
+			Buffer mCounters;
+			std::uint32_t mCounterCount = 0, mCountersUsed = 0;
+
+			std::optional<DescriptorAllocator> mDescriptors;
+			std::vector<ImageView> mViews;
+			std::vector<Target_> mTargets;
+	};
+
+	// The format of storage views of images of aFormat: the UNORM format
+	// for sRGB ones (whose images then need VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT),
+	// aFormat otherwise
+	VkFormat downsample_storage_format( VkFormat aFormat ) noexcept;
+
+	// As record_texture_mips() (see vkimage.hpp), with aMips rather than
+	// blits: from the level 0 copied by record_texture_copy(), the image
+	// ends up in SHADER_READ_ONLY_OPTIMAL, with one dispatch and two
+	// barriers in between. aImage needs VK_IMAGE_USAGE_STORAGE_BIT (and its
+	// format must be supported by aMips). The target lives until
+	// aMips.reset().
+	void record_texture_mips( VkCommandBuffer, MipDownsampler& aMips, VkImage, VkFormat, std::uint32_t aWidth, std::uint32_t aHeight );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	// Bounded lock-free queue for any number of producer threads and one
+	// consumer, for handing finished work (e.g., texture uploads, see
+	// AsyncUploader) to the render loop without a mutex on the frame path.
+	//
+	// Each cell carries a sequence number that says whose turn it is:
+	// producers claim a cell by advancing the tail with a CAS, fill it, and
+	// publish it by bumping its sequence; the consumer takes cells in order
+	// once published, and hands them back to the producers a lap later.
+	// (Vyukov's bounded queue, with the consumer side simplified for a
+	// single thread.)
+	//
+	// try_push() fails if the queue is full; producers then retry later (or
+	// wait for the consumer). tItem must be default constructible and move
+	// assignable.
+	template< typename tItem, std::size_t tCapacity >
+	class MpscQueue
+	{
+		static_assert( tCapacity >= 2 && 0 == (tCapacity & (tCapacity-1)), "tCapacity must be a power of two" );
+
+		public:
+			MpscQueue() noexcept;
+
+			MpscQueue( MpscQueue const& ) = delete;
+			MpscQueue& operator= (MpscQueue const&) = delete;
+
+		public:
+			// Any thread. Leaves aItem untouched if full.
+			bool try_push( tItem&& aItem );
+
+			// Consumer thread only
+			bool try_pop( tItem& aOut );
+
+			static constexpr std::size_t capacity() noexcept { return tCapacity; }
+
+		private:
+			struct Cell_
+			{
+				std::atomic<std::size_t> sequence;
+				tItem item;
+			};
+
+			static constexpr std::size_t kMask = tCapacity - 1;
+
+			// On separate cache lines; producers and the consumer don't
+			// share writes except through the cells
+			alignas(64) std::atomic<std::size_t> mTail{ 0 };
+			alignas(64) std::size_t mHead = 0;
+
+			Cell_ mCells[tCapacity];
+	};
+}
+
+namespace labutils
+{
+	template< typename tItem, std::size_t tCapacity >
+	MpscQueue<tItem,tCapacity>::MpscQueue() noexcept
+	{
+		for( std::size_t i = 0; i < tCapacity; ++i )
+			mCells[i].sequence.store( i, std::memory_order_relaxed );
+	}
+
+	template< typename tItem, std::size_t tCapacity >
+	bool MpscQueue<tItem,tCapacity>::try_push( tItem&& aItem )
+	{
+		auto pos = mTail.load( std::memory_order_relaxed );
+		for( ;; )
+		{
+			auto& cell = mCells[pos & kMask];
+			auto const seq = cell.sequence.load( std::memory_order_acquire );
+			auto const diff = std::intptr_t(seq) - std::intptr_t(pos);
+
+			if( 0 == diff )
+			{
+				// The cell is free for this lap; claim it
+				if( mTail.compare_exchange_weak( pos, pos+1, std::memory_order_relaxed ) )
+				{
+					cell.item = std::move(aItem);
+					cell.sequence.store( pos+1, std::memory_order_release );
+					return true;
+				}
+			}
+			else if( diff < 0 )
+			{
+				// The consumer hasn't taken the previous lap's item yet
+				return false;
+			}
+			else
+			{
+				// Another producer claimed the cell first
+				pos = mTail.load( std::memory_order_relaxed );
+			}
+		}
+	}
+
+	template< typename tItem, std::size_t tCapacity >
+	bool MpscQueue<tItem,tCapacity>::try_pop( tItem& aOut )
+	{
+		auto& cell = mCells[mHead & kMask];
+		if( cell.sequence.load( std::memory_order_acquire ) != mHead+1 )
+			return false;
+
+		aOut = std::move(cell.item);
+		cell.sequence.store( mHead + tCapacity, std::memory_order_release );
+		++mHead;
+		return true;
+	}
+}
@@ -0,0 +1,232 @@
+#include "object_cache.hpp"
+
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	std::uint32_t bits_( float aValue ) noexcept
+	{
+		std::uint32_t ret;
+		std::memcpy( &ret, &aValue, sizeof(ret) );
+		return ret;
+	}
+
+	// The handle as two words (VkImage is a 64-bit handle, or a pointer)
+	void image_words_( VkImage aImage, std::uint32_t (&aWords)[2] ) noexcept
+	{
+		static_assert( sizeof(aWords) >= sizeof(VkImage), "VkImage is at most 64 bits" );
+		std::memset( aWords, 0, sizeof(aWords) );
+		std::memcpy( aWords, &aImage, sizeof(VkImage) );
+	}
+
+	// FNV-1a
+	template< std::size_t tSize >
+	std::size_t hash_( std::array<std::uint32_t,tSize> const& aKey ) noexcept
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for( auto const word : aKey )
+		{
+			hash ^= word;
+			hash *= 1099511628211ull;
+		}
+		return std::size_t(hash);
+	}
+}
+
+namespace labutils
+{
+	SamplerCache::SamplerCache( VulkanContext const& aContext )
+		: mContext( &aContext )
+	{}
+
+	VkSampler SamplerCache::get( VkSamplerCreateInfo const& aInfo )
+	{
+		assert( VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO == aInfo.sType );
+		assert( !aInfo.pNext );
+
+		// Field by field; the padding in the struct is undefined
+		Key_ const key = {
+			aInfo.flags,
+			std::uint32_t(aInfo.magFilter),
+			std::uint32_t(aInfo.minFilter),
+			std::uint32_t(aInfo.mipmapMode),
+			std::uint32_t(aInfo.addressModeU),
+			std::uint32_t(aInfo.addressModeV),
+			std::uint32_t(aInfo.addressModeW),
+			bits_( aInfo.mipLodBias ),
+			aInfo.anisotropyEnable,
+			bits_( aInfo.maxAnisotropy ),
+			aInfo.compareEnable,
+			std::uint32_t(aInfo.compareOp),
+			bits_( aInfo.minLod ),
+			bits_( aInfo.maxLod ),
+			std::uint32_t(aInfo.borderColor),
+			aInfo.unnormalizedCoordinates
+		};
+
+		if( auto const it = mSamplers.find( key ); mSamplers.end() != it )
+			return it->second.handle;
+
+		VkSampler sampler = VK_NULL_HANDLE;
+		if( auto const res = vkCreateSampler( mContext->device, &aInfo, nullptr, &sampler ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create sampler\n" "vkCreateSampler() returned %s", to_string(res).c_str() );
+		}
+
+		return mSamplers.emplace( key, Sampler( mContext->device, sampler ) ).first->second.handle;
+	}
+
+	std::size_t SamplerCache::Hash_::operator() ( Key_ const& aKey ) const noexcept
+	{
+		return hash_( aKey );
+	}
+
+
+	ImageViewCache::ImageViewCache( VulkanContext const& aContext )
+		: mContext( &aContext )
+	{}
+
+	VkImageView ImageViewCache::get( VkImageViewCreateInfo const& aInfo )
+	{
+		assert( VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO == aInfo.sType );
+		assert( !aInfo.pNext );
+
+		std::uint32_t image[2];
+		image_words_( aInfo.image, image );
+
+		Key_ const key = {
+			image[0],
+			image[1],
+			aInfo.flags,
+			std::uint32_t(aInfo.viewType),
+			std::uint32_t(aInfo.format),
+			std::uint32_t(aInfo.components.r),
+			std::uint32_t(aInfo.components.g),
+			std::uint32_t(aInfo.components.b),
+			std::uint32_t(aInfo.components.a),
+			aInfo.subresourceRange.aspectMask,
+			aInfo.subresourceRange.baseMipLevel,
+			aInfo.subresourceRange.levelCount,
+			aInfo.subresourceRange.baseArrayLayer,
+			aInfo.subresourceRange.layerCount
+		};
+
+		if( auto const it = mViews.find( key ); mViews.end() != it )
+			return it->second.handle;
+
+		VkImageView view = VK_NULL_HANDLE;
+		if( auto const res = vkCreateImageView( mContext->device, &aInfo, nullptr, &view ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create image view\n" "vkCreateImageView() returned %s", to_string(res).c_str() );
+		}
+
+		return mViews.emplace( key, ImageView( mContext->device, view ) ).first->second.handle;
+	}
+
+	VkImageView ImageViewCache::get_texture2d( VkImage aImage, VkFormat aFormat )
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = aImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = aFormat;
+		viewInfo.components = VkComponentMapping{};  // == identity
+		viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+		return get( viewInfo );
+	}
+
+	void ImageViewCache::release_image( VkImage aImage )
+	{
+		std::uint32_t image[2];
+		image_words_( aImage, image );
+
+		for( auto it = mViews.begin(); mViews.end() != it; )
+		{
+			if( it->first[0] == image[0] && it->first[1] == image[1] )
+				it = mViews.erase( it );
+			else
+				++it;
+		}
+	}
+
+	std::size_t ImageViewCache::Hash_::operator() ( Key_ const& aKey ) const noexcept
+	{
+		return hash_( aKey );
+	}
+
+
+	ShaderModuleCache::ShaderModuleCache( VulkanContext const& aContext, EmbeddedSpirv const* aEmbedded, std::size_t aEmbeddedCount, char const* aOverrideDir )
+		: mContext( &aContext )
+		, mOverrideDir( aOverrideDir ? aOverrideDir : "" )
+	{
+		assert( aEmbedded || 0 == aEmbeddedCount );
+		for( std::size_t i = 0; i < aEmbeddedCount; ++i )
+			mEmbedded.emplace( aEmbedded[i].name, &aEmbedded[i] );
+
+		if( !mOverrideDir.empty() && '/' != mOverrideDir.back() )
+			mOverrideDir += '/';
+	}
+
+	VkShaderModule ShaderModuleCache::get( char const* aSpirvPath )
+	{
+		assert( aSpirvPath );
+
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		std::string path( aSpirvPath );
+		if( auto const it = mModules.find( path ); mModules.end() != it )
+			return it->second.handle;
+
+		auto const slash = path.find_last_of( '/' );
+		std::string const name = std::string::npos == slash ? path : path.substr( slash+1 );
+
+		// The override, if there is a file to override with
+		ShaderModule module;
+		if( !mOverrideDir.empty() )
+		{
+			std::string const file = mOverrideDir + name;
+			if( std::FILE* fin = std::fopen( file.c_str(), "rb" ) )
+			{
+				std::fclose( fin );
+				module = load_shader_module( *mContext, file.c_str() );
+				++mFiles;
+			}
+		}
+
+		if( VK_NULL_HANDLE == module.handle )
+		{
+			if( auto const it = mEmbedded.find( name ); mEmbedded.end() != it )
+			{
+				module = create_shader_module( *mContext, it->second->code, it->second->words, it->second->name );
+			}
+			else
+			{
+				module = load_shader_module( *mContext, aSpirvPath );
+				++mFiles;
+			}
+		}
+
+		return mModules.emplace( std::move(path), std::move(module) ).first->second.handle;
+	}
+
+	std::size_t ShaderModuleCache::size() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mModules.size();
+	}
+
+	std::size_t ShaderModuleCache::files() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mFiles;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
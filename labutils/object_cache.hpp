@@ -0,0 +1,130 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Samplers by the contents of their VkSamplerCreateInfo: get() creates a
+	// sampler the first time it sees a create info, and returns the same
+	// handle for every identical one after that. The cache owns the samplers;
+	// they live until the cache is destroyed. Create infos with a pNext chain
+	// aren't supported. Not thread safe.
+	class SamplerCache
+	{
+		public:
+			explicit SamplerCache( VulkanContext const& );
+
+			SamplerCache( SamplerCache const& ) = delete;
+			SamplerCache& operator= (SamplerCache const&) = delete;
+
+		public:
+			// Throws labutils::Error if the sampler can't be created.
+			VkSampler get( VkSamplerCreateInfo const& );
+
+			std::size_t size() const noexcept { return mSamplers.size(); }
+
+		private:
+			using Key_ = std::array<std::uint32_t,16>;
+			struct Hash_ { std::size_t operator() (Key_ const&) const noexcept; };
+
+		private:
+			VulkanContext const* mContext;
+			std::unordered_map<Key_, Sampler, Hash_> mSamplers;
+	};
+
+	// Image views by the contents of their VkImageViewCreateInfo, as
+	// SamplerCache. Views must not outlive their image: release_image()
+	// destroys all views of an image, and must be called before the image
+	// is destroyed (or moved, e.g., by the Defragmenter).
+	class ImageViewCache
+	{
+		public:
+			explicit ImageViewCache( VulkanContext const& );
+
+			ImageViewCache( ImageViewCache const& ) = delete;
+			ImageViewCache& operator= (ImageViewCache const&) = delete;
+
+		public:
+			// Throws labutils::Error if the view can't be created.
+			VkImageView get( VkImageViewCreateInfo const& );
+
+			// Same view as create_image_view_texture2d() (see vkutil.hpp)
+			VkImageView get_texture2d( VkImage, VkFormat );
+
+			void release_image( VkImage );
+
+			std::size_t size() const noexcept { return mViews.size(); }
+
+		private:
+			using Key_ = std::array<std::uint32_t,14>;
+			struct Hash_ { std::size_t operator() (Key_ const&) const noexcept; };
+
+		private:
+			VulkanContext const* mContext;
+			std::unordered_map<Key_, ImageView, Hash_> mViews;
+	};
+
+	// SPIR-V compiled into the executable, under the file name of its .spv
+	// (e.g., "default.vert.spv")
+	struct EmbeddedSpirv
+	{
+		char const* name;
+		std::uint32_t const* code;
+		std::size_t words;
+	};
+
+	// Shader modules by SPIR-V path, as SamplerCache: get() creates the
+	// module the first time it sees a path, and returns the same handle
+	// after that (e.g., when the pipelines are recreated with the
+	// swapchain). The code is the embedded SPIR-V with the path's file name,
+	// if any, unless aOverrideDir holds a file of that name (for development:
+	// shaders recompiled without rebuilding the executable); other paths are
+	// loaded as with load_shader_module() (see vkutil.hpp).
+	//
+	// Thread safe, unlike the other caches: pipelines are also created by
+	// the background compiles of PipelineVariants::get_or().
+	class ShaderModuleCache
+	{
+		public:
+			ShaderModuleCache(
+				VulkanContext const&,
+				EmbeddedSpirv const* aEmbedded = nullptr,
+				std::size_t aEmbeddedCount = 0,
+				char const* aOverrideDir = nullptr
+			);
+
+			ShaderModuleCache( ShaderModuleCache const& ) = delete;
+			ShaderModuleCache& operator= (ShaderModuleCache const&) = delete;
+
+		public:
+			// Throws labutils::Error if the file can't be read, or the
+			// module can't be created.
+			VkShaderModule get( char const* aSpirvPath );
+
+			std::size_t size() const;
+			std::size_t files() const; // modules not from embedded SPIR-V
+
+		private:
+			VulkanContext const* mContext;
+			std::unordered_map<std::string, EmbeddedSpirv const*> mEmbedded; // by name
+			std::string mOverrideDir;
+
+			mutable std::mutex mMutex;
+			std::unordered_map<std::string, ShaderModule> mModules; // by path
+			std::size_t mFiles = 0;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
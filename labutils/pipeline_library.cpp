@@ -0,0 +1,485 @@
+#include "pipeline_library.hpp"
+
+#include <utility>
+#include <iterator>
+#include <type_traits>
+
+#include <cassert>
+#include <cstring>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// The parts of a graphics pipeline, in the order they are linked
+	constexpr VkGraphicsPipelineLibraryFlagsEXT kParts_[] = {
+		VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+	};
+
+	constexpr std::uint32_t kVertexInput_ = 0, kPreRaster_ = 1, kFragment_ = 2, kOutput_ = 3;
+
+	constexpr std::uint32_t kMaxStages_ = 8;
+
+	// The serialized state of a part. Structs are written field by field
+	// (their padding is undefined), except for arrays of structs without
+	// padding.
+	class StateKey_
+	{
+		public:
+			template< typename tValue >
+			void value( tValue const& aValue )
+			{
+				static_assert( std::is_trivially_copyable_v<tValue> );
+				bytes_( &aValue, sizeof(tValue) );
+			}
+
+			template< typename tValue >
+			void array( tValue const* aValues, std::uint32_t aCount )
+			{
+				static_assert( std::is_trivially_copyable_v<tValue> );
+				value( aCount );
+				if( aValues )
+					bytes_( aValues, aCount * sizeof(tValue) );
+			}
+
+			void string( char const* aString )
+			{
+				bytes_( aString, std::strlen( aString ) + 1 );
+			}
+
+			std::string take() noexcept { return std::move(mBytes); }
+
+		private:
+			void bytes_( void const* aData, std::size_t aSize )
+			{
+				mBytes.append( static_cast<char const*>(aData), aSize );
+			}
+
+		private:
+			std::string mBytes;
+	};
+
+	VkPipelineFragmentShadingRateStateCreateInfoKHR const* shading_rate_( VkGraphicsPipelineCreateInfo const& aInfo ) noexcept
+	{
+		auto const* next = static_cast<VkBaseInStructure const*>(aInfo.pNext);
+		for( ; next; next = next->pNext )
+		{
+			if( VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR == next->sType )
+				return reinterpret_cast<VkPipelineFragmentShadingRateStateCreateInfoKHR const*>(next);
+		}
+		return nullptr;
+	}
+
+	// The only creation flag that the linker passes on (to every part, and
+	// the links): pipelines that take their sets from descriptor buffers
+	// (see DescriptorBuffer)
+	constexpr VkPipelineCreateFlags kLinkedFlags_ = VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+
+	// True if the linker knows all of aInfo's state, i.e., can tell which
+	// part it belongs to and compare it
+	bool linkable_( VkGraphicsPipelineCreateInfo const& aInfo ) noexcept
+	{
+		if( 0 != (aInfo.flags & ~kLinkedFlags_) || aInfo.stageCount > kMaxStages_ || aInfo.pTessellationState )
+			return false;
+
+		if( VK_NULL_HANDLE == aInfo.renderPass || VK_NULL_HANDLE == aInfo.layout )
+			return false;
+
+		auto const* rate = shading_rate_( aInfo );
+		if( aInfo.pNext && (aInfo.pNext != rate || rate->pNext) )
+			return false;
+
+		for( std::uint32_t i = 0; i < aInfo.stageCount; ++i )
+		{
+			if( aInfo.pStages[i].pNext || 0 != aInfo.pStages[i].flags )
+				return false;
+		}
+
+		if( !aInfo.pVertexInputState || aInfo.pVertexInputState->pNext )
+			return false;
+		if( !aInfo.pInputAssemblyState || aInfo.pInputAssemblyState->pNext )
+			return false;
+		if( !aInfo.pViewportState || aInfo.pViewportState->pNext )
+			return false;
+		if( !aInfo.pRasterizationState || aInfo.pRasterizationState->pNext )
+			return false;
+		if( !aInfo.pMultisampleState || aInfo.pMultisampleState->pNext || aInfo.pMultisampleState->pSampleMask )
+			return false;
+		if( !aInfo.pColorBlendState || aInfo.pColorBlendState->pNext )
+			return false;
+		if( aInfo.pDepthStencilState && aInfo.pDepthStencilState->pNext )
+			return false;
+		if( aInfo.pDynamicState && aInfo.pDynamicState->pNext )
+			return false;
+
+		return true;
+	}
+
+	void stage_key_( StateKey_& aKey, VkPipelineShaderStageCreateInfo const& aStage )
+	{
+		aKey.value( aStage.stage );
+		aKey.value( aStage.module );
+		aKey.string( aStage.pName );
+
+		auto const* spec = aStage.pSpecializationInfo;
+		aKey.value( nullptr != spec );
+		if( spec )
+		{
+			aKey.array( spec->pMapEntries, spec->mapEntryCount );
+			aKey.array( static_cast<std::uint8_t const*>(spec->pData), std::uint32_t(spec->dataSize) );
+		}
+	}
+
+	void multisample_key_( StateKey_& aKey, VkPipelineMultisampleStateCreateInfo const& aState )
+	{
+		aKey.value( aState.rasterizationSamples );
+		aKey.value( aState.sampleShadingEnable );
+		aKey.value( aState.minSampleShading );
+		aKey.value( aState.alphaToCoverageEnable );
+		aKey.value( aState.alphaToOneEnable );
+	}
+
+	std::string part_key_( VkGraphicsPipelineCreateInfo const& aInfo, std::uint32_t aPart )
+	{
+		StateKey_ key;
+		key.value( aPart );
+		key.value( aInfo.flags );
+
+		// Dynamic state that belongs to another part is ignored by it
+		if( aInfo.pDynamicState )
+			key.array( aInfo.pDynamicState->pDynamicStates, aInfo.pDynamicState->dynamicStateCount );
+		else
+			key.value( std::uint32_t(0) );
+
+		if( kVertexInput_ != aPart )
+		{
+			key.value( aInfo.renderPass );
+			key.value( aInfo.subpass );
+		}
+		if( kPreRaster_ == aPart || kFragment_ == aPart )
+		{
+			key.value( aInfo.layout );
+
+			auto const* rate = shading_rate_( aInfo );
+			key.value( nullptr != rate );
+			if( rate )
+			{
+				key.value( rate->fragmentSize );
+				key.value( rate->combinerOps );
+			}
+		}
+
+		switch( aPart )
+		{
+			case kVertexInput_:
+			{
+				auto const& input = *aInfo.pVertexInputState;
+				key.value( input.flags );
+				key.array( input.pVertexBindingDescriptions, input.vertexBindingDescriptionCount );
+				key.array( input.pVertexAttributeDescriptions, input.vertexAttributeDescriptionCount );
+
+				key.value( aInfo.pInputAssemblyState->topology );
+				key.value( aInfo.pInputAssemblyState->primitiveRestartEnable );
+			} break;
+
+			case kPreRaster_:
+			{
+				for( std::uint32_t i = 0; i < aInfo.stageCount; ++i )
+				{
+					if( VK_SHADER_STAGE_FRAGMENT_BIT != aInfo.pStages[i].stage )
+						stage_key_( key, aInfo.pStages[i] );
+				}
+
+				auto const& viewport = *aInfo.pViewportState;
+				key.value( viewport.viewportCount );
+				key.value( viewport.scissorCount );
+				key.array( viewport.pViewports, viewport.pViewports ? viewport.viewportCount : 0 );
+				key.array( viewport.pScissors, viewport.pScissors ? viewport.scissorCount : 0 );
+
+				auto const& raster = *aInfo.pRasterizationState;
+				key.value( raster.depthClampEnable );
+				key.value( raster.rasterizerDiscardEnable );
+				key.value( raster.polygonMode );
+				key.value( raster.cullMode );
+				key.value( raster.frontFace );
+				key.value( raster.depthBiasEnable );
+				key.value( raster.depthBiasConstantFactor );
+				key.value( raster.depthBiasClamp );
+				key.value( raster.depthBiasSlopeFactor );
+				key.value( raster.lineWidth );
+			} break;
+
+			case kFragment_:
+			{
+				for( std::uint32_t i = 0; i < aInfo.stageCount; ++i )
+				{
+					if( VK_SHADER_STAGE_FRAGMENT_BIT == aInfo.pStages[i].stage )
+						stage_key_( key, aInfo.pStages[i] );
+				}
+
+				multisample_key_( key, *aInfo.pMultisampleState );
+
+				key.value( nullptr != aInfo.pDepthStencilState );
+				if( auto const* depth = aInfo.pDepthStencilState )
+				{
+					key.value( depth->depthTestEnable );
+					key.value( depth->depthWriteEnable );
+					key.value( depth->depthCompareOp );
+					key.value( depth->depthBoundsTestEnable );
+					key.value( depth->stencilTestEnable );
+					key.value( depth->front );
+					key.value( depth->back );
+					key.value( depth->minDepthBounds );
+					key.value( depth->maxDepthBounds );
+				}
+			} break;
+
+			case kOutput_:
+			{
+				auto const& blend = *aInfo.pColorBlendState;
+				key.value( blend.logicOpEnable );
+				key.value( blend.logicOp );
+				key.array( blend.pAttachments, blend.attachmentCount );
+				key.value( blend.blendConstants );
+
+				multisample_key_( key, *aInfo.pMultisampleState );
+			} break;
+		}
+
+		return key.take();
+	}
+
+	VkPipeline link_( VkDevice aDevice, VkPipelineCache aCache, VkPipeline const (&aParts)[4], VkPipelineLayout aLayout, VkPipelineCreateFlags aFlags, bool aOptimize )
+	{
+		VkPipelineLibraryCreateInfoKHR libraryInfo{};
+		libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		libraryInfo.libraryCount = std::uint32_t(std::size(aParts));
+		libraryInfo.pLibraries = aParts;
+
+		VkGraphicsPipelineCreateInfo pipeInfo{};
+		pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipeInfo.pNext = &libraryInfo;
+		pipeInfo.flags = aFlags | (aOptimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0);
+		pipeInfo.layout = aLayout;
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateGraphicsPipelines( aDevice, aCache, 1, &pipeInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		{
+			throw labutils::Error( "Unable to link graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", labutils::to_string(res).c_str() );
+		}
+
+		return pipe;
+	}
+}
+
+namespace labutils
+{
+	PipelineLinker::PipelineLinker( VulkanContext const& aContext, VkPipelineCache aCache, bool aLibraries, bool aBackground )
+		: mContext( &aContext )
+		, mCache( aCache )
+		, mEnabled( aLibraries && aContext.caps.graphicsPipelineLibrary )
+	{
+		if( mEnabled && aBackground )
+			mWorker = std::thread( [this] { run_(); } );
+	}
+
+	PipelineLinker::~PipelineLinker()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+
+		mWake.notify_all();
+		if( mWorker.joinable() )
+			mWorker.join();
+	}
+
+	bool PipelineLinker::enabled() const noexcept
+	{
+		return mEnabled;
+	}
+
+	Pipeline PipelineLinker::create( VkGraphicsPipelineCreateInfo const& aInfo )
+	{
+		assert( VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO == aInfo.sType );
+
+		if( !mEnabled || !linkable_( aInfo ) )
+		{
+			VkPipeline pipe = VK_NULL_HANDLE;
+			if( auto const res = vkCreateGraphicsPipelines( mContext->device, mCache, 1, &aInfo, nullptr, &pipe ); VK_SUCCESS != res )
+			{
+				throw Error( "Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", to_string(res).c_str() );
+			}
+
+			return Pipeline( mContext->device, pipe );
+		}
+
+		VkPipeline parts[std::size(kParts_)];
+		for( std::uint32_t i = 0; i < std::size(kParts_); ++i )
+			parts[i] = library_( aInfo, i );
+
+		Pipeline pipe( mContext->device, link_( mContext->device, mCache, parts, aInfo.layout, aInfo.flags, false ) );
+
+		if( mWorker.joinable() )
+		{
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				mJobs.emplace_back( Job_{ pipe.handle, { parts[0], parts[1], parts[2], parts[3] }, aInfo.layout, aInfo.flags } );
+			}
+
+			mWake.notify_one();
+		}
+
+		return pipe;
+	}
+
+	bool PipelineLinker::take_optimized( VkPipeline aPipeline, Pipeline& aOut )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( mError )
+			std::rethrow_exception( std::exchange( mError, nullptr ) );
+
+		auto const it = mDone.find( aPipeline );
+		if( mDone.end() == it )
+			return false;
+
+		aOut = std::move(it->second);
+		mDone.erase( it );
+		return true;
+	}
+
+	void PipelineLinker::clear() noexcept
+	{
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mJobs.clear();
+			mIdle.wait( lock, [this] { return !mBusy; } );
+			mDone.clear();
+		}
+
+		mLibraries.clear();
+	}
+
+	std::size_t PipelineLinker::libraries() const noexcept
+	{
+		return mLibraries.size();
+	}
+
+	std::size_t PipelineLinker::pending() const noexcept
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mJobs.size() + (mBusy ? 1 : 0);
+	}
+
+	VkPipeline PipelineLinker::library_( VkGraphicsPipelineCreateInfo const& aInfo, std::uint32_t aPart )
+	{
+		auto key = part_key_( aInfo, aPart );
+		if( auto const it = mLibraries.find( key ); mLibraries.end() != it )
+			return it->second.handle;
+
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+		libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+		libraryInfo.flags = kParts_[aPart];
+
+		// Retained, so that the background link can optimize across parts
+		VkGraphicsPipelineCreateInfo partInfo{};
+		partInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		partInfo.pNext = &libraryInfo;
+		partInfo.flags = aInfo.flags | VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		partInfo.pDynamicState = aInfo.pDynamicState;
+
+		VkPipelineShaderStageCreateInfo stages[kMaxStages_];
+		for( std::uint32_t i = 0; i < aInfo.stageCount; ++i )
+		{
+			bool const fragment = VK_SHADER_STAGE_FRAGMENT_BIT == aInfo.pStages[i].stage;
+			if( (kPreRaster_ == aPart && !fragment) || (kFragment_ == aPart && fragment) )
+				stages[partInfo.stageCount++] = aInfo.pStages[i];
+		}
+		partInfo.pStages = stages;
+
+		if( kVertexInput_ != aPart )
+		{
+			partInfo.renderPass = aInfo.renderPass;
+			partInfo.subpass = aInfo.subpass;
+		}
+		if( kPreRaster_ == aPart || kFragment_ == aPart )
+		{
+			partInfo.layout = aInfo.layout;
+			// (the header declares this pNext non-const)
+			libraryInfo.pNext = const_cast<VkPipelineFragmentShadingRateStateCreateInfoKHR*>(shading_rate_( aInfo ));
+		}
+
+		switch( aPart )
+		{
+			case kVertexInput_:
+				partInfo.pVertexInputState = aInfo.pVertexInputState;
+				partInfo.pInputAssemblyState = aInfo.pInputAssemblyState;
+				break;
+			case kPreRaster_:
+				partInfo.pViewportState = aInfo.pViewportState;
+				partInfo.pRasterizationState = aInfo.pRasterizationState;
+				break;
+			case kFragment_:
+				partInfo.pMultisampleState = aInfo.pMultisampleState;
+				partInfo.pDepthStencilState = aInfo.pDepthStencilState;
+				break;
+			case kOutput_:
+				partInfo.pMultisampleState = aInfo.pMultisampleState;
+				partInfo.pColorBlendState = aInfo.pColorBlendState;
+				break;
+		}
+
+		VkPipeline pipe = VK_NULL_HANDLE;
+		if( auto const res = vkCreateGraphicsPipelines( mContext->device, mCache, 1, &partInfo, nullptr, &pipe ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create pipeline library (part %u)\n" "vkCreateGraphicsPipelines() returned %s", aPart, to_string(res).c_str() );
+		}
+
+		mLibraries.emplace( std::move(key), Pipeline( mContext->device, pipe ) );
+		return pipe;
+	}
+
+	void PipelineLinker::run_()
+	{
+		for( ;; )
+		{
+			Job_ job;
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mWake.wait( lock, [this] { return mQuit || !mJobs.empty(); } );
+
+				if( mQuit )
+					return;
+
+				job = mJobs.front();
+				mJobs.pop_front();
+				mBusy = true;
+			}
+
+			try
+			{
+				Pipeline pipe( mContext->device, link_( mContext->device, mCache, job.parts, job.layout, job.flags, true ) );
+
+				std::lock_guard<std::mutex> lock( mMutex );
+				mDone.emplace( job.fast, std::move(pipe) );
+			}
+			catch( ... )
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				if( !mError )
+					mError = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock( mMutex );
+				mBusy = false;
+			}
+			mIdle.notify_all();
+		}
+	}
+}
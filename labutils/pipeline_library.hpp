@@ -0,0 +1,110 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Graphics pipelines linked from VK_EXT_graphics_pipeline_library parts.
+	//
+	// create() splits a complete VkGraphicsPipelineCreateInfo into its four
+	// parts: vertex input, pre-rasterization shaders, fragment shader and
+	// fragment output. Each part is compiled into a library once per
+	// distinct state, and shared by all pipelines with that state; e.g., the
+	// permutations of a fragment shader reuse one vertex input, one
+	// pre-rasterization and (mostly) one output library. The libraries are
+	// then fast-linked into the returned pipeline, which costs far less
+	// than compiling a monolithic one.
+	//
+	// Fast-linked pipelines may run slower than monolithic ones. Each is
+	// therefore linked again on a worker thread, with link time
+	// optimization; take_optimized() hands out the result, which the caller
+	// swaps in for the fast-linked pipeline (see PipelineVariants::upgrade()).
+	//
+	// Without the extension (see DeviceCapabilities::graphicsPipelineLibrary),
+	// or for create infos with state that the linker doesn't know how to
+	// compare (tessellation, extension structures other than the fragment
+	// shading rate, flags other than DESCRIPTOR_BUFFER), create() creates
+	// monolithic pipelines instead.
+	//
+	// Calls to create() and clear() must not overlap (they may come from
+	// different threads, e.g., PipelineVariants' background compiles);
+	// take_optimized() and pending() may be called at any time.
+	class PipelineLinker
+	{
+		public:
+			// !aLibraries: always create monolithic pipelines. aBackground:
+			// link optimized pipelines on a worker thread; otherwise, the
+			// fast-linked pipelines are kept.
+			PipelineLinker( VulkanContext const&, VkPipelineCache, bool aLibraries = true, bool aBackground = true );
+			~PipelineLinker(); // waits for the link in progress, if any
+
+			PipelineLinker( PipelineLinker const& ) = delete;
+			PipelineLinker& operator= (PipelineLinker const&) = delete;
+
+		public:
+			// True if pipelines are linked from libraries
+			bool enabled() const noexcept;
+
+			// Throws labutils::Error if creating a library or the pipeline
+			// fails. aInfo's pNext chain is read, and must not have
+			// VK_PIPELINE_CREATE_LIBRARY_BIT_KHR or derivatives.
+			Pipeline create( VkGraphicsPipelineCreateInfo const& aInfo );
+
+			// Moves the optimized link of the fast-linked aPipeline to aOut,
+			// if it has completed. Rethrows any error raised by the worker.
+			bool take_optimized( VkPipeline aPipeline, Pipeline& aOut );
+
+			// Drops the queued links, waits for the one in progress, and
+			// destroys the libraries and the optimized pipelines not taken
+			// yet. Call when the state the pipelines refer to (e.g., the
+			// render pass) is destroyed, along with the pipelines.
+			void clear() noexcept;
+
+			std::size_t libraries() const noexcept; // not during create()
+			std::size_t pending() const noexcept; // links queued or in progress
+
+		private:
+			struct Job_
+			{
+				VkPipeline fast;
+				VkPipeline parts[4];
+				VkPipelineLayout layout;
+				VkPipelineCreateFlags flags;
+			};
+
+			VkPipeline library_( VkGraphicsPipelineCreateInfo const&, std::uint32_t aPart );
+			void run_();
+
+		private:
+			VulkanContext const* mContext;
+			VkPipelineCache mCache;
+			bool mEnabled;
+
+			// By the serialized state of each part
+			std::unordered_map<std::string,Pipeline> mLibraries;
+
+			mutable std::mutex mMutex;
+			std::condition_variable mWake, mIdle;
+			std::deque<Job_> mJobs;
+			std::unordered_map<VkPipeline,Pipeline> mDone; // by fast-linked pipeline
+			std::exception_ptr mError;
+			bool mBusy = false;
+			bool mQuit = false;
+
+			std::thread mWorker;
+	};
+}
@@ -0,0 +1,260 @@
+#include "pipeline_variants.hpp"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <unordered_set>
+#include <condition_variable>
+
+#include <cassert>
+
+#include "error.hpp"
+
+namespace labutils
+{
+	ShaderSpecialization::ShaderSpecialization( PermutationKey aKey, std::uint32_t aFeatureCount ) noexcept
+	{
+		assert( aFeatureCount <= kMaxPermutationFeatures );
+
+		for( std::uint32_t i = 0; i < aFeatureCount; ++i )
+		{
+			mValues[i] = (aKey >> i) & 1u ? VK_TRUE : VK_FALSE;
+
+			mEntries[i].constantID = i;
+			mEntries[i].offset = std::uint32_t(i * sizeof(VkBool32));
+			mEntries[i].size = sizeof(VkBool32);
+		}
+
+		mInfo.mapEntryCount = aFeatureCount;
+		mInfo.pMapEntries = mEntries;
+		mInfo.dataSize = aFeatureCount * sizeof(VkBool32);
+		mInfo.pData = mValues;
+	}
+
+
+	struct PipelineVariants::Compiler_
+	{
+		Compiler_( VkPipelineCache aCache, std::uint32_t aFeatureCount, Factory aFactory )
+			: cache( aCache )
+			, featureCount( aFeatureCount )
+			, factory( std::move(aFactory) )
+		{}
+
+		~Compiler_()
+		{
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				quit = true;
+			}
+
+			wake.notify_all();
+			if( worker.joinable() )
+				worker.join();
+		}
+
+		// Serialized, whether called from get() or from the worker
+		Pipeline create( PermutationKey aKey )
+		{
+			std::lock_guard<std::mutex> lock( factoryMutex );
+
+			ShaderSpecialization const spec( aKey, featureCount );
+			return factory( aKey, spec.info(), cache );
+		}
+
+		void run()
+		{
+			for( ;; )
+			{
+				PermutationKey key;
+				{
+					std::unique_lock<std::mutex> lock( mutex );
+					wake.wait( lock, [this] { return quit || !queue.empty(); } );
+
+					if( quit )
+						return;
+
+					key = queue.front();
+					queue.pop_front();
+				}
+
+				Pipeline pipe;
+				std::exception_ptr failed;
+				try
+				{
+					pipe = create( key );
+				}
+				catch( ... )
+				{
+					failed = std::current_exception();
+				}
+
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					if( failed && !error )
+						error = failed;
+					else if( !failed )
+						compiled.emplace_back( key, std::move(pipe) );
+
+					pending.erase( key );
+				}
+				done.notify_all();
+			}
+		}
+
+		VkPipelineCache const cache;
+		std::uint32_t const featureCount;
+		Factory const factory;
+
+		std::mutex factoryMutex;
+
+		std::mutex mutex;
+		std::condition_variable wake, done;
+		std::deque<PermutationKey> queue;
+		std::unordered_set<PermutationKey> pending; // queued or in progress
+		std::vector<std::pair<PermutationKey,Pipeline>> compiled;
+		std::exception_ptr error;
+		bool quit = false;
+
+		std::thread worker; // started by the first get_or() that queues
+	};
+
+
+	PipelineVariants::PipelineVariants() noexcept = default;
+
+	PipelineVariants::PipelineVariants( VkPipelineCache aCache, std::uint32_t aFeatureCount, Factory aFactory )
+	{
+		if( aFeatureCount > kMaxPermutationFeatures )
+			throw Error( "PipelineVariants: %u features, at most %u are supported", aFeatureCount, kMaxPermutationFeatures );
+		if( !aFactory )
+			throw Error( "PipelineVariants: no factory" );
+
+		mCompiler = std::make_unique<Compiler_>( aCache, aFeatureCount, std::move(aFactory) );
+	}
+
+	PipelineVariants::PipelineVariants( PipelineVariants&& ) noexcept = default;
+	PipelineVariants& PipelineVariants::operator=( PipelineVariants&& ) noexcept = default;
+
+	PipelineVariants::~PipelineVariants() = default;
+
+	VkPipeline PipelineVariants::get( PermutationKey aKey )
+	{
+		collect_();
+		if( auto const it = mVariants.find( aKey ); mVariants.end() != it )
+			return it->second.handle;
+
+		check_key_( aKey );
+
+		// Compiling in the background already?
+		{
+			std::unique_lock<std::mutex> lock( mCompiler->mutex );
+			mCompiler->done.wait( lock, [&] { return !mCompiler->pending.count( aKey ); } );
+		}
+
+		collect_();
+		if( auto const it = mVariants.find( aKey ); mVariants.end() != it )
+			return it->second.handle;
+
+		auto pipe = mCompiler->create( aKey );
+
+		auto const handle = pipe.handle;
+		mVariants.emplace( aKey, std::move(pipe) );
+		return handle;
+	}
+
+	VkPipeline PipelineVariants::get_or( PermutationKey aKey, PermutationKey aFallback )
+	{
+		collect_();
+		if( auto const it = mVariants.find( aKey ); mVariants.end() != it )
+			return it->second.handle;
+
+		check_key_( aKey );
+
+		{
+			std::lock_guard<std::mutex> lock( mCompiler->mutex );
+			if( mCompiler->pending.insert( aKey ).second )
+			{
+				mCompiler->queue.emplace_back( aKey );
+				if( !mCompiler->worker.joinable() )
+					mCompiler->worker = std::thread( [compiler = mCompiler.get()] { compiler->run(); } );
+			}
+		}
+		mCompiler->wake.notify_one();
+
+		return get( aFallback );
+	}
+
+	std::size_t PipelineVariants::compiling() const
+	{
+		if( !mCompiler )
+			return 0;
+
+		std::lock_guard<std::mutex> lock( mCompiler->mutex );
+		return mCompiler->pending.size();
+	}
+
+	std::size_t PipelineVariants::upgrade( PipelineLinker& aLinker, Timeline& aRetire )
+	{
+		if( !aLinker.enabled() )
+			return 0;
+
+		std::size_t ret = 0;
+		for( auto& [key, pipe] : mVariants )
+		{
+			Pipeline optimized;
+			if( aLinker.take_optimized( pipe.handle, optimized ) )
+			{
+				aRetire.retire( std::exchange( pipe, std::move(optimized) ) );
+				++ret;
+			}
+		}
+
+		return ret;
+	}
+
+	void PipelineVariants::clear() noexcept
+	{
+		if( mCompiler )
+		{
+			std::unique_lock<std::mutex> lock( mCompiler->mutex );
+			for( auto const key : mCompiler->queue )
+				mCompiler->pending.erase( key );
+			mCompiler->queue.clear();
+
+			mCompiler->done.wait( lock, [this] { return mCompiler->pending.empty(); } );
+			mCompiler->compiled.clear();
+		}
+
+		mVariants.clear();
+	}
+
+	std::size_t PipelineVariants::size() const noexcept
+	{
+		return mVariants.size();
+	}
+
+	void PipelineVariants::check_key_( PermutationKey aKey ) const
+	{
+		assert( mCompiler );
+
+		auto const features = mCompiler->featureCount;
+		if( features < kMaxPermutationFeatures && (aKey >> features) )
+			throw Error( "PipelineVariants: key %#x has bits outside of the %u features", aKey, features );
+	}
+
+	void PipelineVariants::collect_()
+	{
+		if( !mCompiler )
+			return;
+
+		std::lock_guard<std::mutex> lock( mCompiler->mutex );
+		if( mCompiler->error )
+			std::rethrow_exception( std::exchange( mCompiler->error, nullptr ) );
+
+		for( auto& [key, pipe] : mCompiler->compiled )
+			mVariants.emplace( key, std::move(pipe) );
+		mCompiler->compiled.clear();
+	}
+}
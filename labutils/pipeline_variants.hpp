@@ -0,0 +1,121 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "timeline.hpp"
+#include "pipeline_library.hpp"
+
+namespace labutils
+{
+	// Feature bitmask of a shader permutation. Bit i is passed to the shaders
+	// as the VkBool32 specialization constant with constant_id i. Constants
+	// that a shader doesn't declare are ignored, so callers may also use bits
+	// that only select between shader files or fixed-function state.
+	using PermutationKey = std::uint32_t;
+
+	constexpr std::uint32_t kMaxPermutationFeatures = 32;
+
+	// VkSpecializationInfo for the first aFeatureCount bits of a key. info()
+	// points into the object, which is therefore neither copied nor moved.
+	class ShaderSpecialization
+	{
+		public:
+			ShaderSpecialization( PermutationKey, std::uint32_t aFeatureCount ) noexcept;
+
+			ShaderSpecialization( ShaderSpecialization const& ) = delete;
+			ShaderSpecialization& operator= (ShaderSpecialization const&) = delete;
+
+		public:
+			VkSpecializationInfo const* info() const noexcept { return &mInfo; }
+
+		private:
+			VkSpecializationMapEntry mEntries[kMaxPermutationFeatures];
+			VkBool32 mValues[kMaxPermutationFeatures];
+			VkSpecializationInfo mInfo;
+	};
+
+	// Pipelines by permutation key, created on first use. All variants are
+	// created through the same pipeline cache (see load_pipeline_cache()), so
+	// variants that share shader code compile quickly, and the cache file
+	// keeps them across runs. Only the variants that are actually drawn with
+	// are ever created.
+	//
+	// The factory receives the key, the specialization for it, and the cache.
+	// It may refer to state that changes (e.g. the render pass); clear() the
+	// variants when it does.
+	//
+	// Factories that create their pipelines with a PipelineLinker get
+	// fast-linked variants first; upgrade() swaps in the optimized ones as
+	// the linker completes them.
+	//
+	// get_or() doesn't wait for a missing variant: it is compiled on a
+	// worker thread meanwhile, and a fallback variant (created up front) is
+	// drawn with instead. The factory is then also called from the worker,
+	// though never concurrently with itself; what it uses must be safe to
+	// use from there (e.g., ShaderModuleCache is).
+	class PipelineVariants
+	{
+		public:
+			using Factory = std::function<Pipeline(PermutationKey, VkSpecializationInfo const*, VkPipelineCache)>;
+
+		public:
+			PipelineVariants() noexcept;
+			PipelineVariants( VkPipelineCache, std::uint32_t aFeatureCount, Factory );
+
+			PipelineVariants( PipelineVariants const& ) = delete;
+			PipelineVariants& operator= (PipelineVariants const&) = delete;
+
+			PipelineVariants( PipelineVariants&& ) noexcept;
+			PipelineVariants& operator= (PipelineVariants&&) noexcept;
+
+			~PipelineVariants(); // waits for the compile in progress, if any
+
+		public:
+			// Creates the variant if necessary, or waits for its background
+			// compile. The handle stays valid until clear() or destruction.
+			// Throws labutils::Error if aKey has bits outside of the
+			// features, or if the factory does.
+			VkPipeline get( PermutationKey aKey );
+
+			// aKey's variant if it exists. Otherwise, queues its compile on
+			// the worker thread (if it isn't queued yet), and returns
+			// aFallback's variant, as get(). Also rethrows errors of the
+			// background compiles.
+			VkPipeline get_or( PermutationKey aKey, PermutationKey aFallback );
+
+			// Variants queued or being compiled in the background
+			std::size_t compiling() const;
+
+			// Replaces the variants whose optimized link has completed (see
+			// PipelineLinker::take_optimized()), and retires the fast-linked
+			// ones to aRetire. Returns the number replaced; handles returned
+			// by get() before then change. Call once per frame, before get().
+			std::size_t upgrade( PipelineLinker&, Timeline& aRetire );
+
+			// Drops the queued compiles, waits for the one in progress, and
+			// destroys all variants; the caller ensures that none are in
+			// use. Call before the state the factory refers to changes.
+			void clear() noexcept;
+
+			std::size_t size() const noexcept;
+
+		private:
+			struct Compiler_;
+
+			void check_key_( PermutationKey ) const;
+			void collect_(); // moves the compiled variants to mVariants
+
+		private:
+			std::unique_ptr<Compiler_> mCompiler; // factory and worker thread
+
+			std::unordered_map<PermutationKey,Pipeline> mVariants;
+	};
+}
@@ -0,0 +1,472 @@
+#include "render_graph.hpp"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	RenderGraph::RenderGraph( VulkanContext const& aContext, Allocator const* aAllocator )
+		: mContext( &aContext )
+		, mAllocator( aAllocator )
+	{}
+
+	RenderGraph::~RenderGraph()
+	{
+		for( auto const& res : mResources )
+		{
+			if( res.transient && VK_NULL_HANDLE != res.image )
+				vkDestroyImage( mContext->device, res.image, nullptr );
+		}
+
+		for( auto const memory : mMemory )
+			vmaFreeMemory( mAllocator->allocator, memory );
+	}
+
+	RenderGraph::ResourceId RenderGraph::import_image( char const* aName, VkImage aImage, ResourceUsage const& aInitial, VkImageSubresourceRange const& aRange )
+	{
+		assert( !mCompiled );
+
+		Resource_ res;
+		res.name = aName;
+		res.image = aImage;
+		res.range = aRange;
+		res.initial = aInitial;
+
+		mResources.emplace_back( std::move(res) );
+		return ResourceId(mResources.size() - 1);
+	}
+
+	RenderGraph::ResourceId RenderGraph::import_buffer( char const* aName, VkBuffer aBuffer, ResourceUsage const& aInitial, VkDeviceSize aSize, VkDeviceSize aOffset )
+	{
+		assert( !mCompiled );
+
+		Resource_ res;
+		res.name = aName;
+		res.isImage = false;
+		res.buffer = aBuffer;
+		res.size = aSize;
+		res.offset = aOffset;
+		res.initial = aInitial;
+		res.initial.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		mResources.emplace_back( std::move(res) );
+		return ResourceId(mResources.size() - 1);
+	}
+
+	RenderGraph::ResourceId RenderGraph::create_image( char const* aName, VkImageCreateInfo const& aInfo )
+	{
+		assert( !mCompiled );
+		assert( VK_IMAGE_LAYOUT_UNDEFINED == aInfo.initialLayout );
+
+		Resource_ res;
+		res.name = aName;
+		res.transient = true;
+		res.createInfo = aInfo;
+		res.createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		res.createInfo.queueFamilyIndexCount = 0;
+		res.createInfo.pQueueFamilyIndices = nullptr;
+
+		// All aspects of all levels and layers
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		if( aInfo.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT )
+		{
+			bool const stencil = VK_FORMAT_D16_UNORM_S8_UINT == aInfo.format || VK_FORMAT_D24_UNORM_S8_UINT == aInfo.format || VK_FORMAT_D32_SFLOAT_S8_UINT == aInfo.format;
+			aspect = VK_IMAGE_ASPECT_DEPTH_BIT | (stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+		}
+		res.range = VkImageSubresourceRange{ aspect, 0, aInfo.mipLevels, 0, aInfo.arrayLayers };
+
+		mResources.emplace_back( std::move(res) );
+		return ResourceId(mResources.size() - 1);
+	}
+
+	void RenderGraph::export_resource( ResourceId aResource, ResourceUsage const& aFinal )
+	{
+		assert( !mCompiled );
+		assert( aResource < mResources.size() );
+
+		mResources[aResource].exported = true;
+		mResources[aResource].final = aFinal;
+	}
+
+	RenderGraph::PassId RenderGraph::add_pass( char const* aName, RecordFn aRecord, bool aSideEffects )
+	{
+		assert( !mCompiled );
+
+		Pass_ pass;
+		pass.name = aName;
+		pass.record = std::move(aRecord);
+		pass.sideEffects = aSideEffects;
+
+		mPasses.emplace_back( std::move(pass) );
+		return PassId(mPasses.size() - 1);
+	}
+
+	void RenderGraph::read( PassId aPass, ResourceId aResource, ResourceUsage const& aUsage )
+	{
+		add_access_( aPass, aResource, aUsage, false );
+	}
+	void RenderGraph::write( PassId aPass, ResourceId aResource, ResourceUsage const& aUsage )
+	{
+		add_access_( aPass, aResource, aUsage, true );
+	}
+
+	void RenderGraph::compile()
+	{
+		assert( !mCompiled );
+
+		cull_();
+		place_transients_();
+
+		// Walk the live passes in order, tracking the state of every resource
+		std::vector<State_> states( mResources.size() );
+		for( std::size_t i = 0; i < mResources.size(); ++i )
+		{
+			auto const& res = mResources[i];
+			if( res.transient )
+				continue; // undefined, see below
+
+			// Whatever the initial usage did may still be in flight
+			states[i].writeStages = res.initial.stages;
+			states[i].writeAccess = res.initial.access;
+			states[i].layout = res.initial.layout;
+		}
+
+		// Transients that alias the same memory must wait for the previous
+		// occupant's last use
+		std::vector<VkPipelineStageFlags> slotStages( mMemory.size(), 0 );
+		std::vector<VkAccessFlags> slotAccess( mMemory.size(), 0 );
+		std::vector<bool> started( mResources.size(), false );
+
+		mBarriers.assign( mPasses.size(), Barrier_{} );
+		for( std::size_t p = 0; p < mPasses.size(); ++p )
+		{
+			if( !mPasses[p].live )
+				continue;
+
+			for( auto const& access : mPasses[p].accesses )
+			{
+				auto const& res = mResources[access.resource];
+				auto& state = states[access.resource];
+
+				if( res.transient && !started[access.resource] )
+				{
+					state.writeStages = slotStages[res.slot];
+					state.writeAccess = slotAccess[res.slot];
+					started[access.resource] = true;
+				}
+
+				add_barrier_( mBarriers[p], access.resource, state, access.usage, access.write );
+
+				if( res.transient )
+				{
+					slotStages[res.slot] = state.writeStages | state.readStages;
+					slotAccess[res.slot] = state.writeAccess;
+				}
+			}
+		}
+
+		mFinalBarrier = Barrier_{};
+		for( std::size_t i = 0; i < mResources.size(); ++i )
+		{
+			if( mResources[i].exported )
+				add_barrier_( mFinalBarrier, ResourceId(i), states[i], mResources[i].final, false );
+		}
+
+		mCompiled = true;
+	}
+
+	void RenderGraph::execute( VkCommandBuffer aCmdBuff ) const
+	{
+		assert( mCompiled );
+
+		auto const record_barrier = [&] (Barrier_ const& aBarrier)
+		{
+			if( aBarrier.images.empty() && aBarrier.buffers.empty() )
+				return;
+
+			vkCmdPipelineBarrier( aCmdBuff,
+				aBarrier.srcStages ? aBarrier.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				aBarrier.dstStages ? aBarrier.dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				0,
+				0, nullptr,
+				std::uint32_t(aBarrier.buffers.size()), aBarrier.buffers.data(),
+				std::uint32_t(aBarrier.images.size()), aBarrier.images.data()
+			);
+		};
+
+		for( std::size_t p = 0; p < mPasses.size(); ++p )
+		{
+			if( !mPasses[p].live )
+				continue;
+
+			record_barrier( mBarriers[p] );
+			if( mPasses[p].record )
+				mPasses[p].record( aCmdBuff );
+		}
+
+		record_barrier( mFinalBarrier );
+	}
+
+	VkImage RenderGraph::image( ResourceId aResource ) const
+	{
+		assert( aResource < mResources.size() && mResources[aResource].isImage );
+		return mResources[aResource].image;
+	}
+
+	std::size_t RenderGraph::live_pass_count() const noexcept
+	{
+		return std::size_t(std::count_if( mPasses.begin(), mPasses.end(), [] (Pass_ const& aPass) { return aPass.live; } ));
+	}
+
+	std::size_t RenderGraph::barrier_count() const noexcept
+	{
+		std::size_t ret = mFinalBarrier.images.size() + mFinalBarrier.buffers.size();
+		for( auto const& barrier : mBarriers )
+			ret += barrier.images.size() + barrier.buffers.size();
+		return ret;
+	}
+
+	VkDeviceSize RenderGraph::transient_bytes() const noexcept
+	{
+		return mTransientBytes;
+	}
+	VkDeviceSize RenderGraph::transient_unaliased_bytes() const noexcept
+	{
+		return mUnaliasedBytes;
+	}
+
+	void RenderGraph::add_access_( PassId aPass, ResourceId aResource, ResourceUsage const& aUsage, bool aWrite )
+	{
+		assert( !mCompiled );
+		assert( aPass < mPasses.size() && aResource < mResources.size() );
+
+		ResourceUsage usage = aUsage;
+		if( !mResources[aResource].isImage )
+			usage.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		mPasses[aPass].accesses.emplace_back( Access_{ aResource, usage, aWrite } );
+	}
+
+	void RenderGraph::cull_()
+	{
+		// Backwards: a pass is needed if it writes something that is needed
+		// later. Earlier writers of a resource that a pass only overwrites
+		// are kept as well (conservatively; the pass may write part of it).
+		std::vector<bool> needed( mResources.size(), false );
+		for( std::size_t i = 0; i < mResources.size(); ++i )
+			needed[i] = mResources[i].exported;
+
+		for( std::size_t p = mPasses.size(); p-- > 0; )
+		{
+			auto& pass = mPasses[p];
+
+			pass.live = pass.sideEffects || std::any_of( pass.accesses.begin(), pass.accesses.end(), [&] (Access_ const& aAccess) {
+				return aAccess.write && needed[aAccess.resource];
+			} );
+
+			if( !pass.live )
+				continue;
+
+			for( auto const& access : pass.accesses )
+				needed[access.resource] = true;
+		}
+	}
+
+	void RenderGraph::place_transients_()
+	{
+		// Lifetimes, in pass indices, of the transients that live passes use
+		constexpr std::size_t kUnused = std::numeric_limits<std::size_t>::max();
+		std::vector<std::size_t> first( mResources.size(), kUnused ), last( mResources.size(), 0 );
+		for( std::size_t p = 0; p < mPasses.size(); ++p )
+		{
+			if( !mPasses[p].live )
+				continue;
+
+			for( auto const& access : mPasses[p].accesses )
+			{
+				first[access.resource] = std::min( first[access.resource], p );
+				last[access.resource] = std::max( last[access.resource], p );
+			}
+		}
+
+		std::vector<ResourceId> transients;
+		assert( mAllocator || std::none_of( mResources.begin(), mResources.end(), [] (Resource_ const& aRes) { return aRes.transient; } ) );
+
+		std::vector<VkMemoryRequirements> reqs( mResources.size() );
+		for( std::size_t i = 0; i < mResources.size(); ++i )
+		{
+			auto& res = mResources[i];
+			if( !res.transient || kUnused == first[i] )
+				continue;
+
+			// Created without memory; bound to the slot's below
+			if( auto const res2 = vkCreateImage( mContext->device, &res.createInfo, nullptr, &res.image ); VK_SUCCESS != res2 )
+			{
+				throw Error( "Unable to create transient image '%s'\n" "vkCreateImage() returned %s", res.name.c_str(), to_string(res2).c_str() );
+			}
+
+			vkGetImageMemoryRequirements( mContext->device, res.image, &reqs[i] );
+			mUnaliasedBytes += reqs[i].size;
+			transients.emplace_back( ResourceId(i) );
+		}
+
+		// Largest first, each into the first slot whose occupants' lifetimes
+		// it doesn't overlap
+		std::sort( transients.begin(), transients.end(), [&] (ResourceId aA, ResourceId aB) {
+			return reqs[aA].size > reqs[aB].size;
+		} );
+
+		struct Slot
+		{
+			VkMemoryRequirements reqs;
+			std::vector<ResourceId> occupants;
+		};
+		std::vector<Slot> slots;
+
+		for( auto const id : transients )
+		{
+			auto const fits = [&] (Slot const& aSlot) {
+				if( 0 == (aSlot.reqs.memoryTypeBits & reqs[id].memoryTypeBits) )
+					return false;
+
+				return std::none_of( aSlot.occupants.begin(), aSlot.occupants.end(), [&] (ResourceId aOther) {
+					return first[id] <= last[aOther] && first[aOther] <= last[id];
+				} );
+			};
+
+			auto const it = std::find_if( slots.begin(), slots.end(), fits );
+			if( slots.end() == it )
+			{
+				slots.emplace_back( Slot{ reqs[id], { id } } );
+				mResources[id].slot = std::uint32_t(slots.size() - 1);
+				continue;
+			}
+
+			it->reqs.size = std::max( it->reqs.size, reqs[id].size );
+			it->reqs.alignment = std::max( it->reqs.alignment, reqs[id].alignment );
+			it->reqs.memoryTypeBits &= reqs[id].memoryTypeBits;
+			it->occupants.emplace_back( id );
+			mResources[id].slot = std::uint32_t(it - slots.begin());
+		}
+
+		for( auto const& slot : slots )
+		{
+			VmaAllocationCreateInfo allocInfo{};
+			allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+			VmaAllocation memory = VK_NULL_HANDLE;
+			if( auto const res = vmaAllocateMemory( mAllocator->allocator, &slot.reqs, &allocInfo, &memory, nullptr ); VK_SUCCESS != res )
+			{
+				throw Error( "Unable to allocate transient image memory (%llu bytes)\n" "vmaAllocateMemory() returned %s", static_cast<unsigned long long>(slot.reqs.size), to_string(res).c_str() );
+			}
+			tag_allocation( mAllocator->allocator, memory, EMemoryClass::renderTargets );
+			name_allocation( mAllocator->allocator, memory, "render graph transients" );
+			mMemory.emplace_back( memory );
+			mTransientBytes += slot.reqs.size;
+
+			for( auto const id : slot.occupants )
+			{
+				if( auto const res = vmaBindImageMemory( mAllocator->allocator, memory, mResources[id].image ); VK_SUCCESS != res )
+				{
+					throw Error( "Unable to bind transient image '%s'\n" "vmaBindImageMemory() returned %s", mResources[id].name.c_str(), to_string(res).c_str() );
+				}
+			}
+		}
+	}
+
+	void RenderGraph::add_barrier_( Barrier_& aBarrier, ResourceId aResource, State_& aState, ResourceUsage const& aUsage, bool aWrite ) const
+	{
+		auto const& res = mResources[aResource];
+		bool const transition = res.isImage && aState.layout != aUsage.layout && VK_IMAGE_LAYOUT_UNDEFINED != aUsage.layout;
+
+		VkPipelineStageFlags srcStages = 0;
+		VkAccessFlags srcAccess = 0;
+		if( aWrite || transition )
+		{
+			// After all reads since the last write (execution dependency),
+			// and after the last write (memory dependency). A layout
+			// transition counts as a write.
+			srcStages = aState.writeStages | aState.readStages;
+			srcAccess = aState.writeAccess;
+		}
+		else
+		{
+			// Read after read in the same layout, or after a write that was
+			// already made visible to these stages and accesses
+			bool const visible = (aState.readStages & aUsage.stages) == aUsage.stages
+				&& (aState.readAccess & aUsage.access) == aUsage.access;
+			if( 0 == aState.writeStages || visible )
+			{
+				aState.readStages |= aUsage.stages;
+				return;
+			}
+
+			srcStages = aState.writeStages;
+			srcAccess = aState.writeAccess;
+		}
+
+		if( 0 != srcStages || transition )
+		{
+			aBarrier.srcStages |= srcStages;
+			aBarrier.dstStages |= aUsage.stages;
+
+			if( res.isImage )
+			{
+				VkImageMemoryBarrier ibarrier{};
+				ibarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				ibarrier.srcAccessMask = srcAccess;
+				ibarrier.dstAccessMask = aUsage.access;
+				ibarrier.oldLayout = aState.layout;
+				ibarrier.newLayout = transition ? aUsage.layout : aState.layout;
+				ibarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				ibarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				ibarrier.image = res.image;
+				ibarrier.subresourceRange = res.range;
+				aBarrier.images.emplace_back( ibarrier );
+			}
+			else
+			{
+				VkBufferMemoryBarrier bbarrier{};
+				bbarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				bbarrier.srcAccessMask = srcAccess;
+				bbarrier.dstAccessMask = aUsage.access;
+				bbarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bbarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bbarrier.buffer = res.buffer;
+				bbarrier.offset = res.offset;
+				bbarrier.size = res.size;
+				aBarrier.buffers.emplace_back( bbarrier );
+			}
+		}
+
+		if( transition )
+			aState.layout = aUsage.layout;
+
+		if( aWrite )
+		{
+			aState.writeStages = aUsage.stages;
+			aState.writeAccess = aUsage.access;
+			aState.readStages = 0;
+			aState.readAccess = 0;
+		}
+		else
+		{
+			// Reads (and the transition) are now ordered after the write
+			if( transition )
+			{
+				aState.writeStages = aUsage.stages;
+				aState.writeAccess = 0;
+			}
+			aState.readStages |= aUsage.stages;
+			aState.readAccess |= aUsage.access;
+		}
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <volk/volk.h>
+#include <vk_mem_alloc.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// How a pass uses a resource: the stages and accesses of the use, and,
+	// for images, the layout the image must be in.
+	struct ResourceUsage
+	{
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags access = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED; // images only
+	};
+
+	// A small render graph. Passes are added in execution order, with the
+	// resources they read and write; compile() then
+	//  - culls the passes whose writes nothing needs: passes are kept if
+	//    they have side effects, or write a resource that is exported or
+	//    read by a later pass that is kept;
+	//  - works out the barriers between the passes that are left, batched
+	//    into one vkCmdPipelineBarrier() before each pass (read after read
+	//    in the same layout needs none);
+	//  - places the transient images into shared memory: images whose
+	//    lifetimes (first to last use) don't overlap alias the same
+	//    VmaAllocation.
+	// execute() records the passes with their barriers, and finally moves
+	// the exported resources into their final usage.
+	//
+	// Imported resources are owned elsewhere, and start in the usage given
+	// on import. Transient images are owned by the graph, and undefined at
+	// the start of their first pass (so that the first pass must write or
+	// clear them). A graph can be executed any number of times after
+	// compile(), e.g., built once and recorded every frame, as long as the
+	// imported resources start in the same state each time.
+	//
+	// Not thread safe.
+	class RenderGraph
+	{
+		public:
+			using ResourceId = std::uint32_t;
+			using PassId = std::uint32_t;
+			using RecordFn = std::function<void (VkCommandBuffer)>;
+
+		public:
+			// aAllocator is only needed for transient images
+			explicit RenderGraph( VulkanContext const&, Allocator const* aAllocator = nullptr );
+			~RenderGraph();
+
+			RenderGraph( RenderGraph const& ) = delete;
+			RenderGraph& operator= (RenderGraph const&) = delete;
+
+		public:
+			ResourceId import_image( char const* aName, VkImage, ResourceUsage const& aInitial, VkImageSubresourceRange const& = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } );
+			ResourceId import_buffer( char const* aName, VkBuffer, ResourceUsage const& aInitial, VkDeviceSize aSize = VK_WHOLE_SIZE, VkDeviceSize aOffset = 0 );
+
+			// The image is created in compile(), with an UNDEFINED initial
+			// layout and exclusive sharing; it is device local.
+			ResourceId create_image( char const* aName, VkImageCreateInfo const& );
+
+			// Keeps the passes writing aResource, and leaves it in aFinal
+			// after execute().
+			void export_resource( ResourceId, ResourceUsage const& aFinal );
+
+			// aSideEffects: never culled (e.g., writes the graph doesn't
+			// know about, or timestamps)
+			PassId add_pass( char const* aName, RecordFn, bool aSideEffects = false );
+			void read( PassId, ResourceId, ResourceUsage const& );
+			void write( PassId, ResourceId, ResourceUsage const& );
+
+			// Throws labutils::Error if a transient image can't be created.
+			void compile();
+
+			// Requires compile()
+			void execute( VkCommandBuffer ) const;
+
+			// Of imported or transient (after compile()) images
+			VkImage image( ResourceId ) const;
+
+			std::size_t live_pass_count() const noexcept;
+			std::size_t barrier_count() const noexcept; // per execute()
+			VkDeviceSize transient_bytes() const noexcept; // allocated
+			VkDeviceSize transient_unaliased_bytes() const noexcept; // without aliasing
+
+		private:
+			struct Resource_
+			{
+				std::string name;
+				bool isImage = true;
+				bool transient = false;
+
+				VkImage image = VK_NULL_HANDLE;
+				VkImageSubresourceRange range{};
+				VkImageCreateInfo createInfo{};
+
+				VkBuffer buffer = VK_NULL_HANDLE;
+				VkDeviceSize size = VK_WHOLE_SIZE, offset = 0;
+
+				ResourceUsage initial;
+				bool exported = false;
+				ResourceUsage final;
+
+				std::uint32_t slot = ~std::uint32_t(0); // transients: index into mMemory
+			};
+
+			struct Access_
+			{
+				ResourceId resource;
+				ResourceUsage usage;
+				bool write;
+			};
+
+			struct Pass_
+			{
+				std::string name;
+				RecordFn record;
+				bool sideEffects = false;
+				std::vector<Access_> accesses;
+
+				bool live = false;
+			};
+
+			struct Barrier_
+			{
+				VkPipelineStageFlags srcStages = 0, dstStages = 0;
+				std::vector<VkImageMemoryBarrier> images;
+				std::vector<VkBufferMemoryBarrier> buffers;
+			};
+
+			// Per resource, while working out the barriers
+			struct State_
+			{
+				VkPipelineStageFlags writeStages = 0;
+				VkAccessFlags writeAccess = 0;
+				VkPipelineStageFlags readStages = 0; // since the last write
+				VkAccessFlags readAccess = 0; // made visible since the last write
+				VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			};
+
+			void add_access_( PassId, ResourceId, ResourceUsage const&, bool aWrite );
+			void cull_();
+			void place_transients_();
+			void add_barrier_( Barrier_&, ResourceId, State_&, ResourceUsage const&, bool aWrite ) const;
+
+		private:
+			VulkanContext const* mContext;
+			Allocator const* mAllocator;
+
+			std::vector<Resource_> mResources;
+			std::vector<Pass_> mPasses;
+
+			bool mCompiled = false;
+			std::vector<Barrier_> mBarriers; // before each pass
+			Barrier_ mFinalBarrier;
+
+			std::vector<VmaAllocation> mMemory;
+			VkDeviceSize mTransientBytes = 0, mUnaliasedBytes = 0;
+	};
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,141 @@
+#include "staging_ring.hpp"
+
+#include <limits>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	StagingRing::StagingRing( VulkanContext const& aContext, Allocator const& aAllocator, VkDeviceSize aCapacity )
+		: mContext( &aContext )
+		, mAllocator( aAllocator.allocator )
+		, mCapacity( (aCapacity + kMaxAlignment - 1) / kMaxAlignment * kMaxAlignment )
+	{
+		assert( aCapacity > 0 );
+
+		mBuffer = create_buffer( aAllocator, mCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT );
+
+		mData = mapped_data( aAllocator, mBuffer );
+
+		if( !mData )
+			throw Error( "Staging ring: buffer of %llu bytes is not host visible", static_cast<unsigned long long>(mCapacity) );
+	}
+
+	StagingRing::~StagingRing()
+	{
+		// The buffer and fences must not be destroyed while in use.
+		for( auto const& flight : mInFlight )
+			vkWaitForFences( mContext->device, 1, &mFences[flight.fence].handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max() );
+	}
+
+	VkDeviceSize StagingRing::capacity() const noexcept
+	{
+		return mCapacity;
+	}
+
+	StagingRing::Allocation StagingRing::allocate( VkDeviceSize aSize, VkDeviceSize aAlignment )
+	{
+		assert( aAlignment > 0 && aAlignment <= kMaxAlignment && 0 == (aAlignment & (aAlignment-1)) );
+
+		if( aSize > mCapacity )
+		{
+			throw Error( "Staging ring: allocation of %llu bytes exceeds the capacity of %llu bytes",
+				static_cast<unsigned long long>(aSize), static_cast<unsigned long long>(mCapacity) );
+		}
+
+		while( !mInFlight.empty() && retire_oldest_( false ) )
+			;
+
+		// mCapacity is a multiple of any supported alignment, so aligning the
+		// position also aligns the offset. Ranges don't wrap around the end
+		// of the buffer; the rest of the buffer is skipped instead.
+		std::uint64_t start = (mHead + aAlignment - 1) / aAlignment * aAlignment;
+		if( start % mCapacity + aSize > mCapacity )
+			start = (start / mCapacity + 1) * mCapacity;
+
+		while( start + aSize - mTail > mCapacity )
+		{
+			if( mInFlight.empty() )
+			{
+				throw Error( "Staging ring: %llu bytes requested, but %llu bytes of the %llu byte ring are allocated and not yet submitted",
+					static_cast<unsigned long long>(aSize), static_cast<unsigned long long>(mHead - mSubmitted), static_cast<unsigned long long>(mCapacity) );
+			}
+
+			retire_oldest_( true );
+		}
+
+		mHead = start + aSize;
+
+		auto const offset = VkDeviceSize(start % mCapacity);
+		return Allocation{ mBuffer.buffer, offset, mData + offset };
+	}
+
+	VkFence StagingRing::submit_fence()
+	{
+		if( mHead != mSubmitted )
+		{
+			// No-op for host-coherent memory.
+			if( auto const res = vmaFlushAllocation( mAllocator, mBuffer.allocation, 0, VK_WHOLE_SIZE ); VK_SUCCESS != res )
+			{
+				throw Error( "Flushing staging memory\n" "vmaFlushAllocation() returned %s", to_string(res).c_str() );
+			}
+		}
+
+		if( mIdleFences.empty() )
+		{
+			mIdleFences.emplace_back( mFences.size() );
+			mFences.emplace_back( create_fence( *mContext ) );
+		}
+
+		auto const fence = mIdleFences.back();
+		mIdleFences.pop_back();
+
+		mInFlight.emplace_back( InFlight_{ fence, mHead } );
+		mSubmitted = mHead;
+
+		return mFences[fence].handle;
+	}
+
+	void StagingRing::wait_idle()
+	{
+		while( !mInFlight.empty() )
+			retire_oldest_( true );
+	}
+
+	bool StagingRing::retire_oldest_( bool aWait )
+	{
+		assert( !mInFlight.empty() );
+		auto const flight = mInFlight.front();
+		VkFence const fence = mFences[flight.fence].handle;
+
+		if( aWait )
+		{
+			if( auto const res = vkWaitForFences( mContext->device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+			{
+				throw Error( "Waiting for staging ring submission\n" "vkWaitForFences() returned %s", to_string(res).c_str() );
+			}
+		}
+		else if( auto const res = vkGetFenceStatus( mContext->device, fence ); VK_NOT_READY == res )
+		{
+			return false;
+		}
+		else if( VK_SUCCESS != res )
+		{
+			throw Error( "Querying staging ring submission\n" "vkGetFenceStatus() returned %s", to_string(res).c_str() );
+		}
+
+		if( auto const res = vkResetFences( mContext->device, 1, &fence ); VK_SUCCESS != res )
+		{
+			throw Error( "Resetting staging ring fence\n" "vkResetFences() returned %s", to_string(res).c_str() );
+		}
+
+		mTail = flight.end;
+		mIdleFences.emplace_back( flight.fence );
+		mInFlight.pop_front();
+		return true;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <deque>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkbuffer.hpp"
+#include "vkobject.hpp"
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Persistently mapped upload buffer of a fixed size, sub-allocated
+	// linearly and reused in a ring. allocate() hands out ranges of the
+	// buffer; submit_fence() returns the fence for the submission that reads
+	// the ranges allocated since its previous call. The space is reused once
+	// that fence has signalled. allocate() waits for the oldest submissions
+	// if the ring is full.
+	//
+	// Replaces creating, mapping, unmapping and destroying a staging buffer
+	// for each upload. A ring is not thread safe; use one per thread.
+	class StagingRing
+	{
+		public:
+			struct Allocation
+			{
+				VkBuffer buffer = VK_NULL_HANDLE;
+				VkDeviceSize offset = 0; // into buffer
+				std::byte* data = nullptr; // mapped, at offset
+			};
+
+			// Largest supported alignment. Image copies need multiples of the
+			// texel (block) size; 16 also satisfies the usual
+			// optimalBufferCopyOffsetAlignment.
+			static constexpr VkDeviceSize kMaxAlignment = 256;
+
+		public:
+			// aCapacity is rounded up to a multiple of kMaxAlignment.
+			StagingRing( VulkanContext const&, Allocator const&, VkDeviceSize aCapacity );
+			~StagingRing(); // waits for outstanding submissions
+
+			StagingRing( StagingRing const& ) = delete;
+			StagingRing& operator= (StagingRing const&) = delete;
+
+		public:
+			VkDeviceSize capacity() const noexcept;
+
+			// aSize bytes, at an offset that is a multiple of aAlignment (a
+			// power of two, at most kMaxAlignment). Throws if aSize exceeds
+			// the capacity, or if the ring is full of ranges that have not
+			// been submitted yet.
+			Allocation allocate( VkDeviceSize aSize, VkDeviceSize aAlignment = 16 );
+
+			// Fence to pass to the vkQueueSubmit() that reads the ranges
+			// allocated since the previous call. Flushes them first (for
+			// non-coherent memory). The fence is owned by the ring; callers
+			// may wait for it, but must not reset or destroy it.
+			VkFence submit_fence();
+
+			// Waits for all submissions made with submit_fence().
+			void wait_idle();
+
+		private:
+			struct InFlight_
+			{
+				std::size_t fence; // into mFences
+				std::uint64_t end; // mHead when submitted
+			};
+
+			bool retire_oldest_( bool aWait );
+
+		private:
+			VulkanContext const* mContext;
+			VmaAllocator mAllocator;
+
+			Buffer mBuffer;
+			std::byte* mData = nullptr;
+			VkDeviceSize mCapacity = 0;
+
+			// Positions count bytes since creation; the offset into the
+			// buffer is position % mCapacity.
+			std::uint64_t mHead = 0;      // end of the last allocation
+			std::uint64_t mSubmitted = 0; // end of the last submitted allocation
+			std::uint64_t mTail = 0;      // start of the oldest range in use
+
+			std::vector<Fence> mFences;
+			std::vector<std::size_t> mIdleFences;
+			std::deque<InFlight_> mInFlight;
+	};
+}
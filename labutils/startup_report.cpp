@@ -0,0 +1,237 @@
+#include "startup_report.hpp"
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include <cstring>
+
+#include "thread_placement.hpp"
+
+namespace
+{
+	struct Item_
+	{
+		std::string name;
+		std::int64_t ns;
+		std::uint64_t bytes;
+	};
+
+	struct Phase_
+	{
+		char const* name;
+		std::int64_t ns = 0; // wall-clock, summed over the calls
+		std::uint64_t bytes = 0;
+		std::uint32_t calls = 0;
+		std::vector<Item_> items;
+	};
+
+	struct Registry_
+	{
+		labutils::StartupClock::time_point const epoch = labutils::StartupClock::now();
+
+		std::mutex mutex;
+		std::vector<Phase_> phases; // in order of first use
+	};
+
+	Registry_& registry_()
+	{
+		// Never destroyed: threads may still record while the program exits
+		static Registry_* const reg = new Registry_;
+		return *reg;
+	}
+
+	// Requires the registry's mutex
+	Phase_& phase_( Registry_& aReg, char const* aName )
+	{
+		auto const it = std::find_if( aReg.phases.begin(), aReg.phases.end(), [&] (Phase_ const& aPhase) {
+			return aPhase.name == aName || 0 == std::strcmp( aPhase.name, aName );
+		} );
+		if( aReg.phases.end() != it )
+			return *it;
+
+		return aReg.phases.emplace_back( Phase_{ aName } );
+	}
+
+	std::int64_t ns_( labutils::StartupClock::duration aTime )
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( aTime ).count();
+	}
+
+	// MB/s over aNs; 0 without a time
+	double mbps_( std::uint64_t aBytes, std::int64_t aNs )
+	{
+		return aNs > 0 ? double(aBytes) / 1e6 / (double(aNs) * 1e-9) : 0.;
+	}
+
+	void write_json_string_( std::FILE* aFile, char const* aString )
+	{
+		std::fputc( '"', aFile );
+		for( char const* ch = aString; *ch; ++ch )
+		{
+			if( '"' == *ch || '\\' == *ch )
+				std::fputc( '\\', aFile );
+			if( std::uint8_t(*ch) >= 0x20 )
+				std::fputc( *ch, aFile );
+		}
+		std::fputc( '"', aFile );
+	}
+}
+
+namespace labutils
+{
+	StartupPhase::StartupPhase( char const* aName ) noexcept
+		: mName( aName )
+		, mStart( StartupClock::now() )
+	{
+		registry_(); // starts the clock, if nothing else has yet
+	}
+
+	StartupPhase::~StartupPhase()
+	{
+		end();
+	}
+
+	void StartupPhase::add_bytes( std::uint64_t aBytes ) noexcept
+	{
+		mBytes += aBytes;
+	}
+
+	void StartupPhase::end()
+	{
+		if( !mName )
+			return;
+
+		add_startup_phase( mName, StartupClock::now() - mStart, mBytes );
+		mName = nullptr;
+	}
+
+
+	void add_startup_phase( char const* aName, StartupClock::duration aTime, std::uint64_t aBytes )
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		auto& phase = phase_( reg, aName );
+		phase.ns += ns_( aTime );
+		phase.bytes += aBytes;
+		++phase.calls;
+	}
+
+	void add_startup_item( char const* aPhase, std::string aItem, StartupClock::duration aTime, std::uint64_t aBytes )
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		auto& phase = phase_( reg, aPhase );
+		phase.bytes += aBytes;
+		phase.items.emplace_back( Item_{ std::move(aItem), ns_( aTime ), aBytes } );
+	}
+
+	StartupClock::duration startup_elapsed()
+	{
+		return StartupClock::now() - registry_().epoch;
+	}
+
+	std::vector<StartupPhaseTotal> startup_phases()
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		std::vector<StartupPhaseTotal> ret;
+		ret.reserve( reg.phases.size() );
+		for( auto const& phase : reg.phases )
+			ret.emplace_back( StartupPhaseTotal{ phase.name, std::chrono::duration_cast<StartupClock::duration>( std::chrono::nanoseconds( phase.ns ) ), phase.bytes } );
+
+		return ret;
+	}
+
+
+	void print_startup_report( std::FILE* aFile )
+	{
+		auto const totalNs = ns_( startup_elapsed() );
+
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		// Phases may nest (e.g., the uploads within the model set-up), so the
+		// times don't add up to the total.
+		std::fprintf( aFile, "Start-up: %.1f ms\n", double(totalNs) * 1e-6 );
+		for( auto const& phase : reg.phases )
+		{
+			std::fprintf( aFile, "  %-26s %9.1f ms", phase.name, double(phase.ns) * 1e-6 );
+			if( phase.bytes > 0 )
+				std::fprintf( aFile, " %10.1f MB %9.1f MB/s", double(phase.bytes) * 1e-6, mbps_( phase.bytes, phase.ns ) );
+			if( !phase.items.empty() )
+				std::fprintf( aFile, "  (%zu items)", phase.items.size() );
+			std::fprintf( aFile, "\n" );
+		}
+
+		auto const& topology = cpu_topology();
+		std::fprintf( aFile, "Threads: %zu CPUs, %u cores (%u performance), %u NUMA node%s\n",
+			topology.cpus.size(), topology.cores, topology.performanceCores, topology.nodes, 1 == topology.nodes ? "" : "s" );
+		for( auto const& placed : placed_threads() )
+		{
+			std::fprintf( aFile, "  %-26s %9u x  CPUs %s%s\n", placed.name, placed.count,
+				placed.cpus.empty() ? "any" : placed.cpus.c_str(), placed.lowPriority ? ", low priority" : "" );
+		}
+	}
+
+	bool write_startup_report( char const* aPath )
+	{
+		std::FILE* file = std::fopen( aPath, "w" );
+		if( !file )
+			return false;
+
+		auto const totalNs = ns_( startup_elapsed() );
+
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		std::fprintf( file, "{\"total_ms\":%.3f,\"phases\":[", double(totalNs) * 1e-6 );
+		bool first = true;
+		for( auto const& phase : reg.phases )
+		{
+			std::fprintf( file, "%s\n{\"name\":", first ? "" : "," );
+			write_json_string_( file, phase.name );
+			std::fprintf( file, ",\"ms\":%.3f,\"calls\":%u,\"bytes\":%llu,\"mb_per_s\":%.3f",
+				double(phase.ns) * 1e-6, phase.calls, static_cast<unsigned long long>(phase.bytes), mbps_( phase.bytes, phase.ns ) );
+			first = false;
+
+			if( phase.items.empty() )
+			{
+				std::fprintf( file, "}" );
+				continue;
+			}
+
+			std::fprintf( file, ",\"items\":[" );
+			for( std::size_t i = 0; i < phase.items.size(); ++i )
+			{
+				auto const& item = phase.items[i];
+				std::fprintf( file, "%s\n  {\"name\":", 0 == i ? "" : "," );
+				write_json_string_( file, item.name.c_str() );
+				std::fprintf( file, ",\"ms\":%.3f,\"bytes\":%llu,\"mb_per_s\":%.3f}",
+					double(item.ns) * 1e-6, static_cast<unsigned long long>(item.bytes), mbps_( item.bytes, item.ns ) );
+			}
+			std::fprintf( file, "]}" );
+		}
+
+		auto const& topology = cpu_topology();
+		std::fprintf( file, "\n],\"threads\":{\"cpus\":%zu,\"cores\":%u,\"performance_cores\":%u,\"numa_nodes\":%u,\"placed\":[",
+			topology.cpus.size(), topology.cores, topology.performanceCores, topology.nodes );
+		first = true;
+		for( auto const& placed : placed_threads() )
+		{
+			std::fprintf( file, "%s\n{\"name\":", first ? "" : "," );
+			write_json_string_( file, placed.name );
+			std::fprintf( file, ",\"count\":%u,\"cpus\":", placed.count );
+			write_json_string_( file, placed.cpus.c_str() );
+			std::fprintf( file, ",\"low_priority\":%s}", placed.lowPriority ? "true" : "false" );
+			first = false;
+		}
+		std::fprintf( file, "\n]}}\n" );
+
+		bool const ok = !std::ferror( file );
+		return 0 == std::fclose( file ) && ok;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Start-up timing report. The phases of the start-up (instance and device
+// creation, model loading, uploads, ...) are timed with StartupPhase, and
+// listed with their wall-clock time, the bytes they processed and the
+// resulting throughput by print_startup_report() (text) and
+// write_startup_report() (JSON).
+//
+// Phases with the same name accumulate. Items (add_startup_item(), e.g.,
+// one per texture) are listed under their phase in the JSON; their bytes
+// count towards the phase, their times do not (items may run concurrently;
+// the phase's time is the wall-clock time around them). Both reports end
+// with the CPU topology, and the threads placed so far (see
+// thread_placement.hpp). All functions are thread-safe. Phase names must
+// be string literals (they are kept as pointers).
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdint>
+
+namespace labutils
+{
+	using StartupClock = std::chrono::steady_clock;
+
+	class StartupPhase
+	{
+		public:
+			explicit StartupPhase( char const* aName ) noexcept;
+			~StartupPhase();
+
+			StartupPhase( StartupPhase const& ) = delete;
+			StartupPhase& operator= (StartupPhase const&) = delete;
+
+		public:
+			void add_bytes( std::uint64_t ) noexcept;
+
+			// Ends the phase before the end of the scope; later calls and
+			// the destructor do nothing.
+			void end();
+
+		private:
+			char const* mName; // null: ended
+			std::uint64_t mBytes = 0;
+			StartupClock::time_point mStart;
+	};
+
+	void add_startup_phase( char const* aName, StartupClock::duration, std::uint64_t aBytes = 0 );
+	void add_startup_item( char const* aPhase, std::string aItem, StartupClock::duration, std::uint64_t aBytes );
+
+	// Time since the first use of any of the above (in practice, since the
+	// start of main())
+	StartupClock::duration startup_elapsed();
+
+	// The phases so far, in order of first use, without their items; e.g.,
+	// for exporting them along with other metrics (cw2's --metrics).
+	struct StartupPhaseTotal
+	{
+		char const* name;
+		StartupClock::duration time;
+		std::uint64_t bytes;
+	};
+
+	std::vector<StartupPhaseTotal> startup_phases();
+
+	// Total is startup_elapsed() at the time of the call. write_startup_report()
+	// returns false if aPath can't be written.
+	void print_startup_report( std::FILE* );
+	bool write_startup_report( char const* aPath );
+}
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <functional>
+#include <type_traits>
+
+#include <cassert>
+
+#if LUT_COROUTINES
+#	include <coroutine>
+#endif
+
+#include "job_system.hpp"
+
+namespace labutils
+{
+	// Result of work running on a JobSystem, so that loading code can read
+	// as a sequence of steps while the steps overlap:
+	//
+	//   auto bytes = async( jobs, [&] { return read_file( path ); } );
+	//   auto image = then( std::move(bytes), [] (auto aBytes) { return decode( aBytes ); } );
+	//   ... // other work, e.g., the geometry upload
+	//   auto pixels = image.get();
+	//
+	// async() runs a function as a job; then() runs one on the result of a
+	// task once it is ready, as a job that is held until then (no thread
+	// blocks in between); get() runs other jobs until the task is ready
+	// (JobSystem::wait()), and returns its result or rethrows its exception.
+	// Timeline::when_reached() is a task that is ready once the GPU has
+	// passed a value.
+	//
+	// Built with --coroutines (LUT_COROUTINES, C++20), a Task is also a
+	// coroutine: functions that return one may co_await other tasks, and
+	// are resumed on a worker of the awaited task's JobSystem once it is
+	// ready; the same sequence then reads
+	//
+	//   Task<Image> load( JobSystem& aJobs, char const* aPath )
+	//   {
+	//   	auto bytes = co_await async( aJobs, [=] { return read_file( aPath ); } );
+	//   	co_return co_await async( aJobs, [&] { return decode( bytes ); } );
+	//   }
+	//
+	// Coroutines run on the calling thread up to their first co_await.
+	//
+	// TaskSource makes a task that other code completes, e.g., once a read
+	// of FileReader has arrived (see file_reader.hpp).
+	//
+	// Like std::future, tasks are move-only, and get() may be called once.
+	template< typename tValue >
+	class Task
+	{
+		public:
+			Task() = default;
+
+			Task( Task&& ) = default;
+			Task& operator= (Task&&) = default;
+
+		public:
+			bool valid() const noexcept; // false once get() has been called
+			bool ready() const noexcept;
+
+			tValue get();
+
+#			if LUT_COROUTINES
+			struct promise_type;
+			auto operator co_await() &&;
+#			endif
+
+		private:
+#			if LUT_COROUTINES
+			struct PromiseBase_;
+#			endif
+
+			struct Empty_ {};
+			using Stored_ = std::conditional_t<std::is_void_v<tValue>, Empty_, tValue>;
+
+			struct State_
+			{
+				explicit State_( JobSystem& aJobs ) : jobs( &aJobs ) {}
+
+				JobSystem* jobs;
+				JobCounter done; // one while the work runs
+				std::optional<Stored_> value;
+				std::exception_ptr error;
+
+				template< typename tFunc, typename... tArgs >
+				void run( tFunc&, tArgs&&... ) noexcept;
+				tValue take();
+			};
+
+			explicit Task( std::shared_ptr<State_> aState ) noexcept
+				: mState( std::move(aState) )
+			{}
+
+			template< typename tFunc >
+			friend auto async( JobSystem&, tFunc&& ) -> Task<std::invoke_result_t<std::decay_t<tFunc>&>>;
+			template< typename tOther, typename tFunc >
+			friend auto then( Task<tOther>&&, tFunc&& );
+			template< typename > friend class Task;
+			template< typename > friend class TaskSource;
+
+		private:
+			std::shared_ptr<State_> mState;
+	};
+
+	// A task that is ready once set_value() or set_error() is called, from
+	// any thread; exactly one of them must be called, once. Until then, the
+	// task's get() runs other jobs, and its then()s are held.
+	template< typename tValue >
+	class TaskSource
+	{
+		public:
+			explicit TaskSource( JobSystem& );
+
+		public:
+			Task<tValue> task() const;
+
+			template< typename... tArgs >
+			void set_value( tArgs&&... );
+			void set_error( std::exception_ptr );
+
+		private:
+			std::shared_ptr<typename Task<tValue>::State_> mState;
+	};
+
+	// Runs aFunc() as a job of aJobs
+	template< typename tFunc >
+	auto async( JobSystem& aJobs, tFunc&& aFunc ) -> Task<std::invoke_result_t<std::decay_t<tFunc>&>>;
+
+	// Runs aFunc( value of aTask ), or aFunc() for Task<void>, as a job once
+	// aTask is ready. Exceptions of aTask pass on to the returned task
+	// without calling aFunc.
+	template< typename tValue, typename tFunc >
+	auto then( Task<tValue>&& aTask, tFunc&& aFunc );
+}
+
+namespace labutils
+{
+	namespace detail
+	{
+		template< typename tFunc, typename tValue >
+		struct ThenResult
+		{
+			using type = std::invoke_result_t<tFunc&, tValue&&>;
+		};
+		template< typename tFunc >
+		struct ThenResult<tFunc,void>
+		{
+			using type = std::invoke_result_t<tFunc&>;
+		};
+	}
+
+	template< typename tValue >
+	bool Task<tValue>::valid() const noexcept
+	{
+		return !!mState;
+	}
+
+	template< typename tValue >
+	bool Task<tValue>::ready() const noexcept
+	{
+		assert( mState );
+		return mState->done.done();
+	}
+
+	template< typename tValue >
+	tValue Task<tValue>::get()
+	{
+		assert( mState );
+		auto state = std::move(mState);
+		state->jobs->wait( state->done );
+		return state->take();
+	}
+
+	template< typename tValue > template< typename tFunc, typename... tArgs >
+	void Task<tValue>::State_::run( tFunc& aFunc, tArgs&&... aArgs ) noexcept
+	{
+		try
+		{
+			if constexpr( std::is_void_v<tValue> )
+			{
+				std::invoke( aFunc, std::forward<tArgs>(aArgs)... );
+				value.emplace();
+			}
+			else
+				value.emplace( std::invoke( aFunc, std::forward<tArgs>(aArgs)... ) );
+		}
+		catch( ... )
+		{
+			error = std::current_exception();
+		}
+	}
+
+	template< typename tValue >
+	tValue Task<tValue>::State_::take()
+	{
+		if( error )
+			std::rethrow_exception( error );
+
+		assert( value );
+		if constexpr( !std::is_void_v<tValue> )
+			return std::move(*value);
+	}
+
+	template< typename tValue >
+	TaskSource<tValue>::TaskSource( JobSystem& aJobs )
+		: mState( std::make_shared<typename Task<tValue>::State_>( aJobs ) )
+	{
+		aJobs.hold( mState->done );
+	}
+
+	template< typename tValue >
+	Task<tValue> TaskSource<tValue>::task() const
+	{
+		return Task<tValue>( mState );
+	}
+
+	template< typename tValue > template< typename... tArgs >
+	void TaskSource<tValue>::set_value( tArgs&&... aArgs )
+	{
+		mState->value.emplace( std::forward<tArgs>(aArgs)... );
+		mState->jobs->release( mState->done );
+	}
+
+	template< typename tValue >
+	void TaskSource<tValue>::set_error( std::exception_ptr aError )
+	{
+		mState->error = std::move(aError);
+		mState->jobs->release( mState->done );
+	}
+
+	template< typename tFunc >
+	auto async( JobSystem& aJobs, tFunc&& aFunc ) -> Task<std::invoke_result_t<std::decay_t<tFunc>&>>
+	{
+		using Task_ = Task<std::invoke_result_t<std::decay_t<tFunc>&>>;
+
+		auto state = std::make_shared<typename Task_::State_>( aJobs );
+		aJobs.spawn( [state, func = std::forward<tFunc>(aFunc)] () mutable {
+			state->run( func );
+		}, &state->done );
+
+		return Task_( std::move(state) );
+	}
+
+	template< typename tValue, typename tFunc >
+	auto then( Task<tValue>&& aTask, tFunc&& aFunc )
+	{
+		assert( aTask.mState );
+
+		using Task_ = Task<typename detail::ThenResult<std::decay_t<tFunc>,tValue>::type>;
+
+		auto prev = std::move(aTask.mState);
+		auto& jobs = *prev->jobs;
+		auto state = std::make_shared<typename Task_::State_>( jobs );
+
+		auto* const after = &prev->done;
+		jobs.spawn( [state, prev = std::move(prev), func = std::forward<tFunc>(aFunc)] () mutable {
+			if( prev->error )
+				state->error = prev->error;
+			else if constexpr( std::is_void_v<tValue> )
+				state->run( func );
+			else
+				state->run( func, std::move(*prev->value) );
+		}, &state->done, after );
+
+		return Task_( std::move(state) );
+	}
+}
+
+#if LUT_COROUTINES
+namespace labutils
+{
+	// The coroutine counts as the work of its task until it returns. Its
+	// task uses shared_jobs() for get(), and for the continuations of
+	// anything that co_awaits it.
+	template< typename tValue >
+	struct Task<tValue>::PromiseBase_
+	{
+		std::shared_ptr<State_> state = std::make_shared<State_>( shared_jobs() );
+
+		PromiseBase_()
+		{
+			state->jobs->hold( state->done );
+		}
+		~PromiseBase_()
+		{
+			state->jobs->release( state->done );
+		}
+
+		Task get_return_object() noexcept
+		{
+			return Task( state );
+		}
+
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+
+		void unhandled_exception() noexcept
+		{
+			state->error = std::current_exception();
+		}
+	};
+
+	template< typename tValue >
+	struct Task<tValue>::promise_type : PromiseBase_
+	{
+		template< typename tReturn >
+		void return_value( tReturn&& aValue )
+		{
+			this->state->value.emplace( std::forward<tReturn>(aValue) );
+		}
+	};
+
+	template<>
+	struct Task<void>::promise_type : PromiseBase_
+	{
+		void return_void() noexcept
+		{
+			state->value.emplace();
+		}
+	};
+
+	template< typename tValue >
+	auto Task<tValue>::operator co_await() &&
+	{
+		struct Awaiter_
+		{
+			std::shared_ptr<State_> state;
+
+			bool await_ready() const noexcept
+			{
+				return state->done.done();
+			}
+			void await_suspend( std::coroutine_handle<> aCoroutine )
+			{
+				state->jobs->spawn( [aCoroutine] { aCoroutine.resume(); }, nullptr, &state->done );
+			}
+			tValue await_resume()
+			{
+				return state->take();
+			}
+		};
+
+		assert( mState );
+		return Awaiter_{ std::move(mState) };
+	}
+}
+#endif
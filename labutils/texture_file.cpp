@@ -0,0 +1,151 @@
+#include "texture_file.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <cstring>
+#include <cstdint>
+
+#include "error.hpp"
+#include "cpu_zones.hpp"
+#include "mapped_file.hpp"
+
+namespace
+{
+	// Must match cw2-bake/texture_bake.cpp
+	constexpr char kTextureMagic[16] = "\0\0COMP5822Mtex";
+	constexpr char kTextureVariant[16] = "scsmbil-mip";
+	constexpr char kTextureExtension[] = ".cw2tex";
+
+	constexpr std::uint32_t kMaxTextureSize = 16384;
+
+	// Size in bytes of one texel (block dimension 1) or one 4x4 block; 0 for
+	// formats that baked texture files don't use.
+	std::uint32_t block_bytes_( VkFormat aFormat, std::uint32_t& aBlockDim )
+	{
+		aBlockDim = 4;
+		switch( aFormat )
+		{
+			case VK_FORMAT_BC4_UNORM_BLOCK: return 8;
+			case VK_FORMAT_BC5_UNORM_BLOCK: return 16;
+			case VK_FORMAT_BC7_UNORM_BLOCK: return 16;
+			case VK_FORMAT_BC7_SRGB_BLOCK: return 16;
+			default: break;
+		}
+
+		aBlockDim = 1;
+		switch( aFormat )
+		{
+			case VK_FORMAT_R8_UNORM: return 1;
+			case VK_FORMAT_R8G8_UNORM: return 2;
+			case VK_FORMAT_R8G8B8A8_UNORM: return 4;
+			case VK_FORMAT_R8G8B8A8_SRGB: return 4;
+			default: return 0;
+		}
+	}
+
+	template< typename tType >
+	tType read_( labutils::MappedFile const& aFile, std::size_t& aPos, char const* aPath )
+	{
+		if( aFile.size() - aPos < sizeof(tType) )
+			throw labutils::Error( "%s: truncated texture file", aPath );
+
+		tType ret;
+		std::memcpy( &ret, aFile.data() + aPos, sizeof(tType) );
+		aPos += sizeof(tType);
+		return ret;
+	}
+}
+
+namespace labutils
+{
+	bool is_texture_file( char const* aPath )
+	{
+		std::size_t const len = std::strlen( aPath );
+		std::size_t const extLen = sizeof(kTextureExtension) - 1;
+		return len >= extLen && 0 == std::strcmp( aPath + len - extLen, kTextureExtension );
+	}
+
+	MappedTextureFile map_texture_file( char const* aPath )
+	{
+		LUT_CPU_ZONE( "map_texture_file()" );
+		return map_texture_file( map_file( aPath ), aPath );
+	}
+
+	MappedTextureFile map_texture_file( MappedFile aFile, char const* aPath )
+	{
+		MappedTextureFile mapped;
+		mapped.file = std::move(aFile);
+
+		auto const& file = mapped.file;
+		auto& ret = mapped.levels;
+
+		if( file.size() < 32 || 0 != std::memcmp( file.data(), kTextureMagic, 16 ) )
+			throw Error( "%s: not a baked texture file", aPath );
+		if( 0 != std::memcmp( file.data() + 16, kTextureVariant, 16 ) )
+			throw Error( "%s: unsupported texture file variant '%.16s'", aPath, reinterpret_cast<char const*>(file.data() + 16) );
+
+		std::size_t pos = 32;
+
+		ret.format = VkFormat(read_<std::uint32_t>( file, pos, aPath ));
+		ret.width = read_<std::uint32_t>( file, pos, aPath );
+		ret.height = read_<std::uint32_t>( file, pos, aPath );
+		std::uint32_t const levels = read_<std::uint32_t>( file, pos, aPath );
+
+		std::uint32_t blockDim = 1;
+		std::uint32_t const blockBytes = block_bytes_( ret.format, blockDim );
+		if( 0 == blockBytes )
+			throw Error( "%s: unsupported texture format %u", aPath, unsigned(ret.format) );
+
+		if( 0 == ret.width || 0 == ret.height || ret.width > kMaxTextureSize || ret.height > kMaxTextureSize )
+			throw Error( "%s: invalid texture size %ux%u", aPath, ret.width, ret.height );
+
+		if( levels != compute_mip_level_count( ret.width, ret.height ) )
+			throw Error( "%s: expected a full mip chain (%u levels), got %u", aPath, compute_mip_level_count( ret.width, ret.height ), levels );
+
+		// Level index; the data is kept from the first level onwards
+		std::vector<std::uint64_t> offsets( levels ), sizes( levels );
+		for( std::uint32_t i = 0; i < levels; ++i )
+		{
+			offsets[i] = read_<std::uint64_t>( file, pos, aPath );
+			sizes[i] = read_<std::uint64_t>( file, pos, aPath );
+		}
+
+		std::uint64_t const base = offsets[0];
+		std::uint32_t width = ret.width, height = ret.height;
+		for( std::uint32_t i = 0; i < levels; ++i )
+		{
+			std::uint64_t const expected = std::uint64_t((width + blockDim - 1) / blockDim) * ((height + blockDim - 1) / blockDim) * blockBytes;
+			if( sizes[i] != expected )
+				throw Error( "%s: level %u has %llu bytes, expected %llu", aPath, i, (unsigned long long)sizes[i], (unsigned long long)expected );
+
+			if( offsets[i] < pos || offsets[i] < base || 0 != (offsets[i] - base) % 16 || offsets[i] > file.size() || file.size() - offsets[i] < sizes[i] )
+				throw Error( "%s: level %u is out of bounds or misaligned", aPath, i );
+
+			ret.levelOffsets.emplace_back( VkDeviceSize(offsets[i] - base) );
+			ret.levelSizes.emplace_back( VkDeviceSize(sizes[i]) );
+
+			width = std::max( width >> 1, 1u );
+			height = std::max( height >> 1, 1u );
+		}
+
+		mapped.data = file.data() + base;
+		return mapped;
+	}
+
+	MipImageData load_texture_file( char const* aPath )
+	{
+		return load_texture_file( map_file( aPath ), aPath );
+	}
+
+	MipImageData load_texture_file( MappedFile aFile, char const* aPath )
+	{
+		auto mapped = map_texture_file( std::move(aFile), aPath );
+
+		MipImageData ret = std::move(mapped.levels);
+		ret.bytes.assign( mapped.data, mapped.file.data() + mapped.file.size() );
+		return ret;
+	}
+}
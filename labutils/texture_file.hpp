@@ -0,0 +1,46 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <cstdint>
+
+#include "vkimage.hpp"
+#include "mapped_file.hpp"
+
+namespace labutils
+{
+	// Baked texture files, as written by cw2-bake (see bake_texture() in
+	// cw2-bake/texture_bake.cpp for the layout): a KTX2-like header with
+	// the VkFormat and size, an index of mip levels, and the precomputed
+	// (typically block-compressed) level data.
+
+	// True if aPath names a baked texture file (by its extension).
+	bool is_texture_file( char const* aPath );
+
+	// Reads and validates a baked texture file. The returned levelOffsets
+	// are relative to bytes, which holds the level data only. Only touches
+	// the CPU, and may be called from several threads at once. Throws
+	// labutils::Error on failure.
+	MipImageData load_texture_file( char const* aPath );
+
+	// As load_texture_file(), but leaves the level data in the mapped file
+	// (see map_file()), for copying it straight to where it goes (such as a
+	// staging buffer) rather than to the heap first. levels.bytes is empty;
+	// level i starts at data + levels.levelOffsets[i]. data stays valid for
+	// as long as file is alive.
+	struct MappedTextureFile
+	{
+		MipImageData levels;
+		MappedFile file;
+		std::uint8_t const* data = nullptr;
+	};
+
+	MappedTextureFile map_texture_file( char const* aPath );
+
+	// The same, for a file already in memory (e.g., from FileReader; see
+	// file_reader.hpp). aName is for error messages.
+	MappedTextureFile map_texture_file( MappedFile aFile, char const* aName );
+	MipImageData load_texture_file( MappedFile aFile, char const* aName );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,172 @@
+#include "texture_pack.hpp"
+
+#include <mutex>
+#include <filesystem>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <cstring>
+
+#include "error.hpp"
+#include "cpu_zones.hpp"
+
+namespace labutils
+{
+	namespace
+	{
+		constexpr std::uint32_t kMaxName = 32*1024;
+		constexpr std::uint32_t kMaxLevels = 32;
+
+		struct Mounted_
+		{
+			std::shared_ptr<MappedFile const> pack;
+			std::string packPath;
+			std::uint64_t offset, size;
+		};
+
+		// Mounted files by normalized path, and the packs by directory
+		struct Mounts_
+		{
+			std::shared_mutex mutex;
+			std::unordered_map<std::string,Mounted_> files;
+			std::unordered_map<std::string,std::size_t> packs; // files per pack
+		};
+
+		Mounts_& mounts_()
+		{
+			static Mounts_ mounts;
+			return mounts;
+		}
+
+		std::string normal_( char const* aPath )
+		{
+			return std::filesystem::path( aPath ).lexically_normal().generic_string();
+		}
+
+		struct Cursor_
+		{
+			std::uint8_t const* pos;
+			std::uint8_t const* end;
+			char const* name;
+
+			template< typename tType >
+			tType take()
+			{
+				if( std::size_t(end - pos) < sizeof(tType) )
+					throw Error( "%s: truncated texture pack index", name );
+
+				tType ret;
+				std::memcpy( &ret, pos, sizeof(tType) );
+				pos += sizeof(tType);
+				return ret;
+			}
+		};
+	}
+
+	std::vector<TexturePackEntry> read_texture_pack_index( std::uint8_t const* aData, std::size_t aBytes, char const* aName )
+	{
+		if( aBytes < 24 || 0 != std::memcmp( aData, kTexturePackMagic, 16 ) )
+			throw Error( "%s: not a texture pack", aName );
+
+		Cursor_ cur{ aData + 16, aData + aBytes, aName };
+		auto const count = cur.take<std::uint32_t>();
+		auto const alignment = cur.take<std::uint32_t>();
+		if( 0 == alignment || 0 != (alignment & (alignment - 1)) )
+			throw Error( "%s: texture pack alignment %u isn't a power of two", aName, alignment );
+
+		std::vector<TexturePackEntry> ret;
+		for( std::uint32_t i = 0; i < count; ++i )
+		{
+			TexturePackEntry entry;
+
+			auto const length = cur.take<std::uint32_t>();
+			if( 0 == length || length > kMaxName || std::size_t(cur.end - cur.pos) < length || '\0' != cur.pos[length-1] )
+				throw Error( "%s: bad name of file %u of the texture pack", aName, i );
+			entry.name.assign( reinterpret_cast<char const*>(cur.pos), length - 1 );
+			cur.pos += length;
+
+			entry.offset = cur.take<std::uint64_t>();
+			entry.size = cur.take<std::uint64_t>();
+			entry.format = cur.take<std::uint32_t>();
+			entry.width = cur.take<std::uint32_t>();
+			entry.height = cur.take<std::uint32_t>();
+
+			auto const levels = cur.take<std::uint32_t>();
+			if( levels > kMaxLevels )
+				throw Error( "%s: '%s' has %u mip levels in the texture pack", aName, entry.name.c_str(), levels );
+			for( std::uint32_t j = 0; j < levels; ++j )
+				entry.levelOffsets.emplace_back( cur.take<std::uint64_t>() );
+
+			if( entry.offset % alignment || entry.offset > aBytes || entry.size > aBytes - entry.offset )
+				throw Error( "%s: '%s' lies outside of the texture pack", aName, entry.name.c_str() );
+			for( auto const level : entry.levelOffsets )
+			{
+				if( level >= entry.size )
+					throw Error( "%s: a mip level of '%s' lies outside of the file", aName, entry.name.c_str() );
+			}
+
+			ret.emplace_back( std::move(entry) );
+		}
+
+		return ret;
+	}
+
+	bool mount_texture_pack( char const* aPackPath, char const* aDirectory )
+	{
+		LUT_CPU_ZONE( "mount_texture_pack()" );
+
+		std::error_code ec;
+		if( !std::filesystem::is_regular_file( aPackPath, ec ) )
+			return false;
+
+		auto pack = std::make_shared<MappedFile const>( map_file( aPackPath ) );
+		auto const entries = read_texture_pack_index( pack->data(), pack->size(), aPackPath );
+
+		auto const directory = normal_( aDirectory );
+		auto const packPath = normal_( aPackPath );
+
+		auto& mounts = mounts_();
+		std::unique_lock<std::shared_mutex> lock( mounts.mutex );
+
+		// Mounting again replaces the pack's files (e.g., after a rebake)
+		if( mounts.packs.count( packPath ) )
+		{
+			for( auto it = mounts.files.begin(); it != mounts.files.end(); )
+				it = it->second.packPath == packPath ? mounts.files.erase( it ) : std::next( it );
+		}
+
+		for( auto const& entry : entries )
+		{
+			auto const path = normal_( (directory + '/' + entry.name).c_str() );
+			mounts.files[path] = Mounted_{ pack, packPath, entry.offset, entry.size };
+		}
+
+		mounts.packs[packPath] = entries.size();
+		return true;
+	}
+
+	bool find_packed_file( char const* aPath, PackedFile& aOut )
+	{
+		auto& mounts = mounts_();
+		std::shared_lock<std::shared_mutex> lock( mounts.mutex );
+		if( mounts.files.empty() )
+			return false;
+
+		auto const it = mounts.files.find( normal_( aPath ) );
+		if( mounts.files.end() == it )
+			return false;
+
+		aOut = PackedFile{ it->second.pack, it->second.packPath, it->second.offset, it->second.size };
+		return true;
+	}
+
+	void texture_pack_stats( std::size_t& aPacks, std::size_t& aFiles )
+	{
+		auto& mounts = mounts_();
+		std::shared_lock<std::shared_mutex> lock( mounts.mutex );
+		aPacks = mounts.packs.size();
+		aFiles = mounts.files.size();
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
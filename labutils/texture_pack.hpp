@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mapped_file.hpp"
+
+namespace labutils
+{
+	// Texture packs, as written by cw2-bake --texture-pack: the files of a
+	// model's texture directory in one file, so that loading them takes one
+	// open and large sequential reads rather than a round trip per file
+	// (which adds up on network shares and container file systems).
+	//
+	// Layout:
+	//  - 16*char: magic = "\0\0COMP5822Mpack"
+	//  - uint32_t: N = number of files
+	//  - uint32_t: A = alignment of the files' data (a power of two)
+	//  - repeat N times:
+	//    - string: file name, relative to the directory
+	//    - uint64_t: absolute offset of the file's data, a multiple of A
+	//    - uint64_t: size of the file in bytes
+	//    - uint32_t: VkFormat of a baked texture file (see texture_file.hpp);
+	//      0 for other files, which have no extent or levels
+	//    - uint32_t: width, uint32_t: height
+	//    - uint32_t: L = number of mip levels
+	//    - repeat L times: uint64_t offset of the level's data, relative to
+	//      the file's
+	//  - the files' data, in the order of the index
+	// Strings are stored as in the baked model files (see
+	// cw2/baked_model.hpp).
+	//
+	// Mounting a pack (mount_texture_pack()) makes map_file(), read_file()
+	// and FileReader (file_reader.hpp) serve the paths of its files from it,
+	// so that the loaders need no changes: map_file() returns a range of the
+	// pack's mapping, and FileReader reads the range through a handle that
+	// it keeps open for all files of the pack.
+
+	constexpr char kTexturePackMagic[16] = "\0\0COMP5822Mpack";
+	constexpr std::uint32_t kTexturePackAlignment = 4096;
+
+	struct TexturePackEntry
+	{
+		std::string name;
+		std::uint64_t offset, size;
+
+		std::uint32_t format; // VkFormat; 0: not a baked texture file
+		std::uint32_t width, height;
+		std::vector<std::uint64_t> levelOffsets;
+	};
+
+	// Parses and checks the index of a pack (aName is for error messages).
+	// Throws labutils::Error if it's malformed, or if a file lies outside of
+	// aBytes.
+	std::vector<TexturePackEntry> read_texture_pack_index( std::uint8_t const* aData, std::size_t aBytes, char const* aName );
+
+	// Serves the files under aDirectory from the pack at aPackPath, which is
+	// mapped for as long as the process runs (or until the directory is
+	// mounted again). Returns false if there is no such pack; throws
+	// labutils::Error if it's malformed. Paths are compared after
+	// normalization (see std::filesystem::path::lexically_normal()), so
+	// "a/b/../c.cw2tex" finds "a/c.cw2tex". Thread safe.
+	bool mount_texture_pack( char const* aPackPath, char const* aDirectory );
+
+	// The pack and range of a path, if it's in a mounted pack
+	struct PackedFile
+	{
+		std::shared_ptr<MappedFile const> pack;
+		std::string packPath;
+		std::uint64_t offset, size;
+	};
+
+	bool find_packed_file( char const* aPath, PackedFile& aOut );
+
+	// Number of packs mounted, and of files in them; for reports
+	void texture_pack_stats( std::size_t& aPacks, std::size_t& aFiles );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
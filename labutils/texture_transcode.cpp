@@ -0,0 +1,277 @@
+#include "texture_transcode.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+#include <cstdint>
+
+#include "error.hpp"
+#include "cpu_zones.hpp"
+
+namespace
+{
+	// BC7 interpolation weights (in 1/64ths) for 2-, 3- and 4-bit indices
+	constexpr int kBc7Weights2[4] = { 0, 21, 43, 64 };
+	constexpr int kBc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	constexpr int kBc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Reads values LSB first from a 128-bit block
+	struct BitReader_
+	{
+		std::uint8_t const* in;
+		unsigned pos = 0;
+
+		std::uint32_t get( unsigned aBits );
+	};
+
+	void decode_bc4_block_( std::uint8_t const* aIn, std::uint8_t* aOut, std::size_t aStride );
+	bool decode_bc7_block_( std::uint8_t const* aIn, std::uint8_t (*aOut)[4] );
+}
+
+namespace labutils
+{
+	VkFormat uncompressed_texture_format( VkFormat aFormat )
+	{
+		switch( aFormat )
+		{
+			case VK_FORMAT_BC4_UNORM_BLOCK: return VK_FORMAT_R8_UNORM;
+			case VK_FORMAT_BC5_UNORM_BLOCK: return VK_FORMAT_R8G8_UNORM;
+			case VK_FORMAT_BC7_UNORM_BLOCK: return VK_FORMAT_R8G8B8A8_UNORM;
+			case VK_FORMAT_BC7_SRGB_BLOCK: return VK_FORMAT_R8G8B8A8_SRGB;
+			default: return aFormat;
+		}
+	}
+
+	MipImageData transcode_texture( MipImageData const& aData, char const* aWhat )
+	{
+		LUT_CPU_ZONE( "transcode_texture()" );
+
+		VkFormat const format = uncompressed_texture_format( aData.format );
+		if( format == aData.format )
+			return aData;
+
+		std::size_t const texelBytes = VK_FORMAT_R8_UNORM == format ? 1 : (VK_FORMAT_R8G8_UNORM == format ? 2 : 4);
+		std::size_t const blockBytes = VK_FORMAT_BC4_UNORM_BLOCK == aData.format ? 8 : 16;
+
+		MipImageData ret;
+		ret.format = format;
+		ret.width = aData.width;
+		ret.height = aData.height;
+
+		// Same layout as in the files: levels start at multiples of 16 bytes
+		std::uint32_t width = aData.width, height = aData.height;
+		VkDeviceSize offset = 0;
+		for( std::size_t level = 0; level < aData.levelSizes.size(); ++level )
+		{
+			ret.levelOffsets.emplace_back( offset );
+			ret.levelSizes.emplace_back( VkDeviceSize(width) * height * texelBytes );
+			offset = (offset + ret.levelSizes.back() + 15) & ~VkDeviceSize(15);
+
+			width = std::max( width >> 1, 1u );
+			height = std::max( height >> 1, 1u );
+		}
+		ret.bytes.resize( std::size_t(offset) );
+
+		width = aData.width;
+		height = aData.height;
+		for( std::size_t level = 0; level < aData.levelSizes.size(); ++level )
+		{
+			std::uint8_t const* src = aData.bytes.data() + aData.levelOffsets[level];
+			std::uint8_t* const dst = ret.bytes.data() + ret.levelOffsets[level];
+			std::size_t const stride = width * texelBytes;
+
+			for( std::uint32_t by = 0; by < height; by += 4 )
+			{
+				for( std::uint32_t bx = 0; bx < width; bx += 4, src += blockBytes )
+				{
+					// Decode the whole block, then keep the texels inside the
+					// level (levels below 4x4 are partially covered).
+					std::uint8_t block[16][4];
+					switch( aData.format )
+					{
+						case VK_FORMAT_BC4_UNORM_BLOCK:
+							decode_bc4_block_( src, &block[0][0], 4 );
+							break;
+						case VK_FORMAT_BC5_UNORM_BLOCK:
+							decode_bc4_block_( src, &block[0][0], 4 );
+							decode_bc4_block_( src + 8, &block[0][1], 4 );
+							break;
+						default:
+							if( !decode_bc7_block_( src, block ) )
+								throw Error( "%s: BC7 blocks with several subsets can't be transcoded", aWhat );
+							break;
+					}
+
+					std::uint32_t const bw = std::min( 4u, width - bx ), bh = std::min( 4u, height - by );
+					for( std::uint32_t y = 0; y < bh; ++y )
+					{
+						for( std::uint32_t x = 0; x < bw; ++x )
+							std::memcpy( dst + (by + y) * stride + (bx + x) * texelBytes, block[4*y+x], texelBytes );
+					}
+				}
+			}
+
+			width = std::max( width >> 1, 1u );
+			height = std::max( height >> 1, 1u );
+		}
+
+		return ret;
+	}
+
+	bool fit_texture_format( VulkanContext const& aContext, MipImageData& aData, char const* aWhat )
+	{
+		if( supports_sampled_format( aContext, aData.format ) )
+			return false;
+
+		// Throws if there is nothing to fall back to (including when aData
+		// is uncompressed already)
+		require_sampled_format( aContext, uncompressed_texture_format( aData.format ), aWhat );
+
+		aData = transcode_texture( aData, aWhat );
+		return true;
+	}
+}
+
+namespace
+{
+	std::uint32_t BitReader_::get( unsigned aBits )
+	{
+		std::uint32_t ret = 0;
+		for( unsigned i = 0; i < aBits; ++i, ++pos )
+		{
+			if( in[pos >> 3] & (1u << (pos & 7)) )
+				ret |= 1u << i;
+		}
+		return ret;
+	}
+
+	void decode_bc4_block_( std::uint8_t const* aIn, std::uint8_t* aOut, std::size_t aStride )
+	{
+		int const r0 = aIn[0], r1 = aIn[1];
+
+		// Eight values if r0 > r1, else six plus 0 and 255
+		int palette[8] = { r0, r1 };
+		if( r0 > r1 )
+		{
+			for( int i = 1; i < 7; ++i )
+				palette[i+1] = ((7-i) * r0 + i * r1 + 3) / 7;
+		}
+		else
+		{
+			for( int i = 1; i < 5; ++i )
+				palette[i+1] = ((5-i) * r0 + i * r1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		std::uint64_t bits = 0;
+		for( int i = 0; i < 6; ++i )
+			bits |= std::uint64_t(aIn[2+i]) << (8*i);
+
+		for( int i = 0; i < 16; ++i )
+			aOut[i*aStride] = std::uint8_t(palette[(bits >> (3*i)) & 7]);
+	}
+
+	// Endpoint of aBits bits to 8 bits, replicating the top bits
+	int expand_( std::uint32_t aValue, unsigned aBits )
+	{
+		return int((aValue << (8 - aBits)) | (aValue >> (2*aBits - 8)));
+	}
+
+	bool decode_bc7_block_( std::uint8_t const* aIn, std::uint8_t (*aOut)[4] )
+	{
+		unsigned mode = 0;
+		while( mode < 8 && !(aIn[0] & (1u << mode)) )
+			++mode;
+
+		// Reserved; decodes to transparent black
+		if( 8 == mode )
+		{
+			std::memset( aOut, 0, 16*4 );
+			return true;
+		}
+
+		// Modes 0-3 and 7 have two or three subsets
+		if( mode < 4 || 7 == mode )
+			return false;
+
+		BitReader_ bits{ aIn, mode + 1 };
+		unsigned const rotation = 6 == mode ? 0 : bits.get( 2 );
+		unsigned const indexSelection = 4 == mode ? bits.get( 1 ) : 0;
+
+		unsigned const colorBits = 4 == mode ? 5 : 7;
+		unsigned const alphaBits = 4 == mode ? 6 : (5 == mode ? 8 : 7);
+
+		int ep[2][4];
+		for( int c = 0; c < 3; ++c )
+		{
+			ep[0][c] = int(bits.get( colorBits ));
+			ep[1][c] = int(bits.get( colorBits ));
+		}
+		ep[0][3] = int(bits.get( alphaBits ));
+		ep[1][3] = int(bits.get( alphaBits ));
+
+		if( 6 == mode )
+		{
+			// One p-bit per endpoint, as the lowest bit of every channel
+			for( int e = 0; e < 2; ++e )
+			{
+				int const p = int(bits.get( 1 ));
+				for( int c = 0; c < 4; ++c )
+					ep[e][c] = (ep[e][c] << 1) | p;
+			}
+		}
+		else
+		{
+			for( int e = 0; e < 2; ++e )
+			{
+				for( int c = 0; c < 3; ++c )
+					ep[e][c] = expand_( std::uint32_t(ep[e][c]), colorBits );
+				ep[e][3] = expand_( std::uint32_t(ep[e][3]), alphaBits );
+			}
+		}
+
+		// The first index of each set has its MSB implicitly zero. Mode 6
+		// has one set for all channels; modes 4 and 5 a second one for
+		// alpha, which mode 4's index selection bit swaps.
+		unsigned const primaryBits = 6 == mode ? 4 : 2;
+		unsigned const secondaryBits = 4 == mode ? 3 : (5 == mode ? 2 : 0);
+
+		int primary[16], secondary[16];
+		for( int i = 0; i < 16; ++i )
+			primary[i] = int(bits.get( primaryBits - (0 == i) ));
+		for( int i = 0; i < 16 && secondaryBits; ++i )
+			secondary[i] = int(bits.get( secondaryBits - (0 == i) ));
+
+		auto const weights_ = [] (unsigned aBits) {
+			return 2 == aBits ? kBc7Weights2 : (3 == aBits ? kBc7Weights3 : kBc7Weights4);
+		};
+
+		int const* colorIndices = primary;
+		int const* alphaIndices = secondaryBits ? secondary : primary;
+		int const* colorWeights = weights_( primaryBits );
+		int const* alphaWeights = weights_( secondaryBits ? secondaryBits : primaryBits );
+		if( indexSelection )
+		{
+			std::swap( colorIndices, alphaIndices );
+			std::swap( colorWeights, alphaWeights );
+		}
+
+		for( int i = 0; i < 16; ++i )
+		{
+			int const cw = colorWeights[colorIndices[i]];
+			int const aw = alphaWeights[alphaIndices[i]];
+			for( int c = 0; c < 3; ++c )
+				aOut[i][c] = std::uint8_t(((64 - cw) * ep[0][c] + cw * ep[1][c] + 32) >> 6);
+			aOut[i][3] = std::uint8_t(((64 - aw) * ep[0][3] + aw * ep[1][3] + 32) >> 6);
+
+			// Rotation swaps alpha with one of the colour channels
+			if( rotation )
+				std::swap( aOut[i][3], aOut[i][rotation - 1] );
+		}
+
+		return true;
+	}
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include "vkimage.hpp"
+
+namespace labutils
+{
+	// Baked texture files are block compressed (BC4, BC5, BC7), which not
+	// every device can sample; texture compression is optional in Vulkan,
+	// and most mobile GPUs only offer ETC2 and ASTC. For those, the levels
+	// are decoded on the CPU when the file is loaded and uploaded
+	// uncompressed instead. That costs four (BC7) or two (BC4, BC5) times
+	// the memory, but the file still loads.
+
+	// The format that aFormat's blocks decode to: R8 for BC4, R8G8 for BC5,
+	// R8G8B8A8 (sRGB or not) for BC7. Uncompressed formats map to themselves.
+	VkFormat uncompressed_texture_format( VkFormat );
+
+	// Decodes all levels of aData into uncompressed_texture_format(). Only
+	// touches the CPU, and may be called from several threads at once.
+	// Throws labutils::Error (with aWhat naming the texture) if the data
+	// uses a BC7 mode that isn't supported; only the single-subset modes 4,
+	// 5 and 6 are, and cw2-bake writes mode 6 only.
+	MipImageData transcode_texture( MipImageData const& aData, char const* aWhat );
+
+	// Transcodes aData in place if the device can't sample its format (see
+	// supports_sampled_format()). Returns true if it did; throws as
+	// require_sampled_format() if the uncompressed format isn't supported
+	// either.
+	bool fit_texture_format( VulkanContext const&, MipImageData& aData, char const* aWhat );
+}
+
+//EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
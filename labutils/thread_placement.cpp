@@ -0,0 +1,416 @@
+#include "thread_placement.hpp"
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <sched.h>
+#	include <dirent.h>
+#	include <sys/resource.h>
+#endif
+
+namespace
+{
+	// Nice values (Linux) of the lowered roles
+	constexpr int kWorkerNice = 5;
+	constexpr int kBackgroundNice = 10;
+
+	struct Registry_
+	{
+		std::mutex mutex;
+		labutils::ThreadPlacement placement;
+		std::vector<labutils::PlacedThreads> placed;
+	};
+
+	Registry_& registry_()
+	{
+		// Never destroyed: workers may still place themselves while the
+		// program exits
+		static Registry_* const reg = new Registry_;
+		return *reg;
+	}
+
+	// Dense indices, in order of first appearance
+	template< typename tKey >
+	std::uint32_t index_of_( std::map<tKey, std::uint32_t>& aIndices, tKey const& aKey )
+	{
+		return aIndices.emplace( aKey, std::uint32_t(aIndices.size()) ).first->second;
+	}
+
+	void finish_topology_( labutils::CpuTopology& aTopology, std::vector<std::uint64_t> const& aCapacities )
+	{
+		auto const best = aCapacities.empty() ? 0 : *std::max_element( aCapacities.begin(), aCapacities.end() );
+
+		std::vector<bool> performanceCore( aTopology.cores, false );
+		std::uint32_t nodes = 0;
+		for( std::size_t i = 0; i < aTopology.cpus.size(); ++i )
+		{
+			auto& cpu = aTopology.cpus[i];
+			cpu.performance = 0 == best || aCapacities[i] == best;
+			if( cpu.performance )
+				performanceCore[cpu.core] = true;
+			nodes = std::max( nodes, cpu.node + 1 );
+		}
+
+		aTopology.performanceCores = std::uint32_t(std::count( performanceCore.begin(), performanceCore.end(), true ));
+		aTopology.nodes = std::max( nodes, 1u );
+	}
+
+#	if defined(__linux__)
+	bool read_uint_( char const* aPath, std::uint64_t& aValue )
+	{
+		std::FILE* file = std::fopen( aPath, "r" );
+		if( !file )
+			return false;
+
+		unsigned long long value = 0;
+		bool const ok = 1 == std::fscanf( file, "%llu", &value );
+		std::fclose( file );
+
+		aValue = value;
+		return ok;
+	}
+
+	// The nodeN entry of the CPU's sysfs directory; 0 without NUMA
+	std::uint32_t numa_node_( std::uint32_t aCpu )
+	{
+		char path[64];
+		std::snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%u", aCpu );
+
+		DIR* dir = opendir( path );
+		if( !dir )
+			return 0;
+
+		unsigned node = 0;
+		while( dirent const* entry = readdir( dir ) )
+		{
+			if( 1 == std::sscanf( entry->d_name, "node%u", &node ) )
+				break;
+		}
+		closedir( dir );
+		return node;
+	}
+
+	labutils::CpuTopology detect_topology_()
+	{
+		labutils::CpuTopology ret;
+
+		cpu_set_t allowed;
+		CPU_ZERO( &allowed );
+		if( 0 != sched_getaffinity( 0, sizeof(allowed), &allowed ) )
+		{
+			for( unsigned i = 0; i < std::max( 1u, std::thread::hardware_concurrency() ); ++i )
+				CPU_SET( i, &allowed );
+		}
+
+		std::map<std::pair<std::uint64_t, std::uint64_t>, std::uint32_t> cores; // by package and core id
+		std::map<std::uint32_t, std::uint32_t> nodes;
+		std::vector<std::uint64_t> capacities;
+		for( std::uint32_t id = 0; id < CPU_SETSIZE; ++id )
+		{
+			if( !CPU_ISSET( id, &allowed ) )
+				continue;
+
+			char path[96];
+			std::uint64_t package = 0, core = id;
+			std::snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", id );
+			read_uint_( path, package );
+			std::snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", id );
+			read_uint_( path, core );
+
+			// Hybrid ARM cores have a capacity; x86 ones differ in their
+			// maximum frequency
+			std::uint64_t capacity = 0;
+			std::snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", id );
+			if( !read_uint_( path, capacity ) )
+			{
+				std::snprintf( path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", id );
+				read_uint_( path, capacity );
+			}
+
+			labutils::LogicalCpu cpu;
+			cpu.id = id;
+			cpu.core = index_of_( cores, std::make_pair( package, core ) );
+			cpu.node = index_of_( nodes, numa_node_( id ) );
+			ret.cpus.emplace_back( cpu );
+			capacities.emplace_back( capacity );
+		}
+
+		ret.cores = std::uint32_t(cores.size());
+		finish_topology_( ret, capacities );
+		return ret;
+	}
+
+	void set_affinity_( std::vector<std::uint32_t> const& aCpus )
+	{
+		cpu_set_t set;
+		CPU_ZERO( &set );
+		for( auto const id : aCpus )
+			CPU_SET( id, &set );
+
+		// 0: the calling thread
+		sched_setaffinity( 0, sizeof(set), &set );
+	}
+
+	void lower_priority_( labutils::EThreadRole aRole )
+	{
+		// Linux keeps a nice value per thread (which 0 names)
+		setpriority( PRIO_PROCESS, 0, labutils::EThreadRole::background == aRole ? kBackgroundNice : kWorkerNice );
+	}
+#	elif defined(_WIN32)
+	labutils::CpuTopology detect_topology_()
+	{
+		labutils::CpuTopology ret;
+
+		DWORD_PTR processMask = 0, systemMask = 0;
+		if( !GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask ) )
+			processMask = ~DWORD_PTR(0);
+
+		DWORD bytes = 0;
+		GetLogicalProcessorInformationEx( RelationAll, nullptr, &bytes );
+		std::vector<std::byte> buffer( bytes );
+		if( 0 == bytes || !GetLogicalProcessorInformationEx( RelationAll, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &bytes ) )
+			bytes = 0;
+
+		// Processor group 0
+		std::vector<std::uint32_t> coreOf( 64, ~0u ), nodeOf( 64, 0 );
+		std::vector<std::uint64_t> classOf( 64, 0 );
+		std::map<DWORD, std::uint32_t> nodes;
+		std::uint32_t cores = 0;
+		for( DWORD offset = 0; offset < bytes; )
+		{
+			auto const* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX const*>(buffer.data() + offset);
+			if( RelationProcessorCore == info->Relationship && 0 == info->Processor.GroupMask[0].Group )
+			{
+				auto const mask = info->Processor.GroupMask[0].Mask;
+				for( std::uint32_t id = 0; id < 64; ++id )
+				{
+					if( mask & (KAFFINITY(1) << id) )
+					{
+						coreOf[id] = cores;
+						classOf[id] = info->Processor.EfficiencyClass;
+					}
+				}
+				++cores;
+			}
+			else if( RelationNumaNode == info->Relationship && 0 == info->NumaNode.GroupMask.Group )
+			{
+				auto const node = index_of_( nodes, info->NumaNode.NodeNumber );
+				for( std::uint32_t id = 0; id < 64; ++id )
+				{
+					if( info->NumaNode.GroupMask.Mask & (KAFFINITY(1) << id) )
+						nodeOf[id] = node;
+				}
+			}
+			offset += info->Size;
+		}
+
+		// Dense core indices of the allowed CPUs
+		std::map<std::uint32_t, std::uint32_t> allowedCores;
+		std::vector<std::uint64_t> capacities;
+		for( std::uint32_t id = 0; id < 64 && id < 8 * sizeof(DWORD_PTR); ++id )
+		{
+			if( !(processMask & (DWORD_PTR(1) << id)) || ~0u == coreOf[id] )
+				continue;
+
+			labutils::LogicalCpu cpu;
+			cpu.id = id;
+			cpu.core = index_of_( allowedCores, coreOf[id] );
+			cpu.node = nodeOf[id];
+			ret.cpus.emplace_back( cpu );
+			capacities.emplace_back( classOf[id] );
+		}
+
+		if( ret.cpus.empty() )
+		{
+			// No information; one core per CPU
+			for( std::uint32_t id = 0; id < std::max( 1u, std::thread::hardware_concurrency() ); ++id )
+			{
+				ret.cpus.emplace_back( labutils::LogicalCpu{ id, id, 0, true } );
+				capacities.emplace_back( 0 );
+				allowedCores.emplace( id, id );
+			}
+		}
+
+		ret.cores = std::uint32_t(allowedCores.size());
+		finish_topology_( ret, capacities );
+		return ret;
+	}
+
+	void set_affinity_( std::vector<std::uint32_t> const& aCpus )
+	{
+		DWORD_PTR mask = 0;
+		for( auto const id : aCpus )
+			mask |= DWORD_PTR(1) << id;
+
+		SetThreadAffinityMask( GetCurrentThread(), mask );
+	}
+
+	void lower_priority_( labutils::EThreadRole aRole )
+	{
+		SetThreadPriority( GetCurrentThread(), labutils::EThreadRole::background == aRole ? THREAD_PRIORITY_LOWEST : THREAD_PRIORITY_BELOW_NORMAL );
+	}
+#	else
+	labutils::CpuTopology detect_topology_()
+	{
+		labutils::CpuTopology ret;
+		for( std::uint32_t id = 0; id < std::max( 1u, std::thread::hardware_concurrency() ); ++id )
+			ret.cpus.emplace_back( labutils::LogicalCpu{ id, id, 0, true } );
+
+		ret.cores = std::uint32_t(ret.cpus.size());
+		ret.performanceCores = ret.cores;
+		return ret;
+	}
+
+	void set_affinity_( std::vector<std::uint32_t> const& )
+	{}
+
+	void lower_priority_( labutils::EThreadRole )
+	{
+		// Elsewhere, setpriority() lowers the whole process, so leave it
+	}
+#	endif
+
+	// The core of the render thread: a performance core other than CPU 0's,
+	// if there is one
+	std::uint32_t render_core_( labutils::CpuTopology const& aTopology )
+	{
+		auto const& cpus = aTopology.cpus;
+		std::uint32_t const firstCore = cpus.empty() ? 0 : cpus.front().core;
+
+		auto const it = std::find_if( cpus.begin(), cpus.end(), [&] (labutils::LogicalCpu const& aCpu) {
+			return aCpu.performance && aCpu.core != firstCore;
+		} );
+		if( cpus.end() != it )
+			return it->core;
+
+		return firstCore;
+	}
+
+	// "0-3,8,10-11"
+	std::string format_cpus_( std::vector<std::uint32_t> const& aCpus )
+	{
+		std::string ret;
+		for( std::size_t i = 0; i < aCpus.size(); )
+		{
+			std::size_t last = i;
+			while( last + 1 < aCpus.size() && aCpus[last + 1] == aCpus[last] + 1 )
+				++last;
+
+			char range[32];
+			if( last == i )
+				std::snprintf( range, sizeof(range), "%s%u", ret.empty() ? "" : ",", aCpus[i] );
+			else
+				std::snprintf( range, sizeof(range), "%s%u-%u", ret.empty() ? "" : ",", aCpus[i], aCpus[last] );
+			ret += range;
+			i = last + 1;
+		}
+		return ret;
+	}
+}
+
+namespace labutils
+{
+	CpuTopology const& cpu_topology()
+	{
+		static CpuTopology const topology = detect_topology_();
+		return topology;
+	}
+
+	void set_thread_placement( ThreadPlacement const& aPlacement )
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+		reg.placement = aPlacement;
+	}
+
+	ThreadPlacement thread_placement()
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+		return reg.placement;
+	}
+
+	void place_current_thread( EThreadRole aRole, char const* aName, std::size_t aIndex )
+	{
+		auto const placement = thread_placement();
+		auto const& topology = cpu_topology();
+		auto const renderCore = render_core_( topology );
+
+		std::vector<std::uint32_t> cpus;
+		bool lowPriority = false;
+		switch( aRole )
+		{
+			case EThreadRole::render:
+				if( placement.pinRenderThread )
+				{
+					for( auto const& cpu : topology.cpus )
+					{
+						if( cpu.core == renderCore )
+						{
+							cpus.emplace_back( cpu.id );
+							break;
+						}
+					}
+				}
+				break;
+
+			case EThreadRole::worker:
+			case EThreadRole::background:
+			{
+				lowPriority = EThreadRole::background == aRole || placement.lowPriorityWorkers;
+
+				auto const node = std::uint32_t(aIndex % topology.nodes);
+				bool const byNode = EThreadRole::worker == aRole && placement.numaWorkers && topology.nodes > 1;
+				for( auto const& cpu : topology.cpus )
+				{
+					if( byNode && cpu.node != node )
+						continue;
+					if( placement.pinRenderThread && cpu.core == renderCore )
+						continue;
+					cpus.emplace_back( cpu.id );
+				}
+
+				// Anywhere, rather than nowhere; and without a restriction,
+				// the OS keeps its own
+				if( cpus.empty() || cpus.size() == topology.cpus.size() )
+					cpus.clear();
+				break;
+			}
+		}
+
+		if( !cpus.empty() )
+			set_affinity_( cpus );
+		if( lowPriority )
+			lower_priority_( aRole );
+
+		auto const desc = format_cpus_( cpus );
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+
+		auto const it = std::find_if( reg.placed.begin(), reg.placed.end(), [&] (PlacedThreads const& aPlaced) {
+			return 0 == std::strcmp( aPlaced.name, aName ) && aPlaced.cpus == desc && aPlaced.lowPriority == lowPriority;
+		} );
+		if( reg.placed.end() != it )
+			++it->count;
+		else
+			reg.placed.emplace_back( PlacedThreads{ aName, desc, lowPriority, 1 } );
+	}
+
+	std::vector<PlacedThreads> placed_threads()
+	{
+		auto& reg = registry_();
+		std::lock_guard<std::mutex> lock( reg.mutex );
+		return reg.placed;
+	}
+}
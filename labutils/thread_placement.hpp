@@ -0,0 +1,92 @@
+#pragma once
+
+// Thread placement on many-core NUMA servers and hybrid (performance and
+// efficiency core) desktops. cpu_topology() detects, for the CPUs that the
+// process may run on, their cores, NUMA nodes and which of them are
+// performance cores (the fastest class; all of them on uniform machines).
+// Threads then place themselves by their role (place_current_thread()),
+// following the process-wide ThreadPlacement:
+//
+//  - the render thread is pinned to a performance core, one other than
+//    CPU 0's (which tends to take the interrupts) if there is a choice;
+//  - the workers (the JobSystem's, and texture decoding) run at a lower
+//    priority, and are spread over the NUMA nodes, each restricted to the
+//    CPUs of its node, so that what they allocate first-touch (e.g., their
+//    job deques) is node-local. They keep off the render thread's core;
+//  - background threads (e.g., metrics export) always run at the lowest
+//    priority, and also keep off the render thread's core.
+//
+// Everything is off by default, and placement that the system refuses is
+// skipped silently. The topology and the threads placed so far are listed
+// in the start-up report (see startup_report.hpp).
+//
+// Linux reads the topology from sysfs (performance cores are those with the
+// highest cpu_capacity or maximum frequency); Windows from
+// GetLogicalProcessorInformationEx() (the highest EfficiencyClass; processor
+// group 0 only). Elsewhere, the topology is a single node of performance
+// cores, and threads aren't pinned.
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	struct LogicalCpu
+	{
+		std::uint32_t id = 0; // OS index
+		std::uint32_t core = 0; // index into the physical cores
+		std::uint32_t node = 0; // NUMA node
+		bool performance = true;
+	};
+
+	struct CpuTopology
+	{
+		std::vector<LogicalCpu> cpus; // that the process may run on, by id
+		std::uint32_t cores = 0;
+		std::uint32_t performanceCores = 0;
+		std::uint32_t nodes = 1;
+	};
+
+	// Detected on first use
+	CpuTopology const& cpu_topology();
+
+
+	struct ThreadPlacement
+	{
+		bool pinRenderThread = false;
+		bool lowPriorityWorkers = false;
+		bool numaWorkers = false;
+	};
+
+	// Before the threads place themselves; in particular, before the first
+	// use of shared_jobs()
+	void set_thread_placement( ThreadPlacement const& );
+	ThreadPlacement thread_placement();
+
+	enum class EThreadRole
+	{
+		render,
+		worker,
+		background
+	};
+
+	// Applies the placement of aRole to the calling thread. aIndex numbers
+	// the workers, for spreading them over the NUMA nodes. aName is listed
+	// in the start-up report, and must be a string literal.
+	void place_current_thread( EThreadRole, char const* aName, std::size_t aIndex = 0 );
+
+	// Threads placed so far; threads with the same name and placement are
+	// listed once, with their count.
+	struct PlacedThreads
+	{
+		char const* name;
+		std::string cpus; // e.g., "0-7,16-23"; empty: wherever the OS runs it
+		bool lowPriority;
+		std::uint32_t count;
+	};
+
+	std::vector<PlacedThreads> placed_threads();
+}
@@ -0,0 +1,168 @@
+#include "timeline.hpp"
+
+#include <limits>
+
+#include <cassert>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	Timeline::Timeline( VulkanContext const& aContext )
+		: mContext( &aContext )
+	{
+		if( !aContext.haveTimelineSemaphore )
+			throw Error( "Timeline: the device does not support timeline semaphores" );
+
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaInfo{};
+		semaInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaInfo.pNext = &typeInfo;
+
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		if( auto const res = vkCreateSemaphore( aContext.device, &semaInfo, nullptr, &semaphore ); VK_SUCCESS != res )
+			throw Error( "Unable to create timeline semaphore\n" "vkCreateSemaphore() returned %s", to_string(res).c_str() );
+
+		mSemaphore = Semaphore( aContext.device, semaphore );
+	}
+
+	Timeline::~Timeline()
+	{
+		// Retired resources must outlive their last use
+		if( !mRetired.empty() )
+		{
+			try
+			{
+				wait( mSubmitted );
+			}
+			catch( ... )
+			{
+				vkDeviceWaitIdle( mContext->device );
+			}
+		}
+	}
+
+	VkSemaphore Timeline::semaphore() const noexcept
+	{
+		return mSemaphore.handle;
+	}
+
+	std::uint64_t Timeline::signal() noexcept
+	{
+		return ++mSubmitted;
+	}
+
+	void Timeline::signal_host( std::uint64_t aValue )
+	{
+		assert( aValue <= mSubmitted );
+
+		VkSemaphoreSignalInfo signalInfo{};
+		signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+		signalInfo.semaphore = mSemaphore.handle;
+		signalInfo.value = aValue;
+
+		if( auto const res = vkSignalSemaphore( mContext->device, &signalInfo ); VK_SUCCESS != res )
+			throw Error( "Signalling timeline value %llu\n" "vkSignalSemaphore() returned %s", static_cast<unsigned long long>(aValue), to_string(res).c_str() );
+
+		if( aValue > mCompleted )
+			mCompleted = aValue;
+	}
+
+	std::uint64_t Timeline::submitted() const noexcept
+	{
+		return mSubmitted;
+	}
+
+	std::uint64_t Timeline::completed()
+	{
+		std::uint64_t value = 0;
+		if( auto const res = vkGetSemaphoreCounterValue( mContext->device, mSemaphore.handle, &value ); VK_SUCCESS != res )
+			throw Error( "Querying timeline\n" "vkGetSemaphoreCounterValue() returned %s", to_string(res).c_str() );
+
+		mCompleted = value;
+		return value;
+	}
+
+	bool Timeline::reached( std::uint64_t aValue )
+	{
+		return aValue <= mCompleted || aValue <= completed();
+	}
+
+	void Timeline::wait( std::uint64_t aValue )
+	{
+		assert( aValue <= mSubmitted );
+
+		if( aValue <= mCompleted )
+			return;
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &mSemaphore.handle;
+		waitInfo.pValues = &aValue;
+
+		if( auto const res = vkWaitSemaphores( mContext->device, &waitInfo, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+			throw Error( "Waiting for timeline value %llu\n" "vkWaitSemaphores() returned %s", static_cast<unsigned long long>(aValue), to_string(res).c_str() );
+
+		mCompleted = aValue;
+	}
+
+	Task<void> Timeline::when_reached( JobSystem& aJobs, std::uint64_t aValue ) const
+	{
+		return async( aJobs, [device = mContext->device, semaphore = mSemaphore.handle, aValue] {
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &semaphore;
+			waitInfo.pValues = &aValue;
+
+			if( auto const res = vkWaitSemaphores( device, &waitInfo, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+				throw Error( "Waiting for timeline value %llu\n" "vkWaitSemaphores() returned %s", static_cast<unsigned long long>(aValue), to_string(res).c_str() );
+		} );
+	}
+
+	void Timeline::collect()
+	{
+		if( mRetired.empty() )
+			return;
+
+		completed();
+		while( !mRetired.empty() && mRetired.front().value <= mCompleted )
+			mRetired.pop_front();
+	}
+
+	std::size_t Timeline::retired() const noexcept
+	{
+		return mRetired.size();
+	}
+}
+
+namespace labutils
+{
+	TimelineSignal::TimelineSignal( Timeline& aTimeline, VkSubmitInfo& aSubmit, std::uint64_t aValue )
+	{
+		assert( aSubmit.signalSemaphoreCount < 2 );
+
+		std::uint32_t count = 0;
+		for( ; count < aSubmit.signalSemaphoreCount; ++count )
+			semaphores[count] = aSubmit.pSignalSemaphores[count];
+
+		semaphores[count] = aTimeline.semaphore();
+		values[count] = aValue;
+		++count;
+
+		info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		info.pNext = aSubmit.pNext;
+		info.signalSemaphoreValueCount = count;
+		info.pSignalSemaphoreValues = values;
+
+		aSubmit.pNext = &info;
+		aSubmit.signalSemaphoreCount = count;
+		aSubmit.pSignalSemaphores = semaphores;
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <deque>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include <cstdint>
+
+#include "task.hpp"
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Timeline semaphore with a monotonically increasing counter for the
+	// submissions to one queue (frames and uploads alike). Each submission
+	// signals the value that signal() hands out; the CPU then waits for or
+	// polls values instead of per-submission fences.
+	//
+	// Resources that the GPU may still use are retire()d rather than
+	// destroyed. They are destroyed by collect() once the counter has
+	// reached the last value signalled before they were retired, without
+	// waiting for the device. Needs the timelineSemaphore feature (core in
+	// Vulkan 1.2, see VulkanContext::haveTimelineSemaphore). Not thread safe.
+	class Timeline
+	{
+		public:
+			explicit Timeline( VulkanContext const& );
+			~Timeline(); // waits for signalled values, then destroys retired resources
+
+			Timeline( Timeline const& ) = delete;
+			Timeline& operator= (Timeline const&) = delete;
+
+		public:
+			VkSemaphore semaphore() const noexcept;
+
+			// The value for the next submission to signal (see
+			// TimelineSignal); values are never reused.
+			std::uint64_t signal() noexcept;
+
+			// Signals aValue (handed out by signal()) from the host, with
+			// vkSignalSemaphore(), for submissions that wait for it rather
+			// than signal it.
+			void signal_host( std::uint64_t aValue );
+
+			// Last value handed out by signal()
+			std::uint64_t submitted() const noexcept;
+
+			// Queries the counter. reached() only queries if the cached value
+			// is too low.
+			std::uint64_t completed();
+			bool reached( std::uint64_t aValue );
+
+			void wait( std::uint64_t aValue );
+
+			// Task that is ready once the counter has reached aValue (see
+			// task.hpp); a worker of aJobs sleeps in vkWaitSemaphores() until
+			// then. Unlike the rest, may be called from any thread; the
+			// Timeline must outlive the task.
+			Task<void> when_reached( JobSystem& aJobs, std::uint64_t aValue ) const;
+
+			// Destroys aResource (any movable RAII object, e.g., a Buffer or
+			// an Image) once the GPU has passed aValue; by default, once
+			// everything submitted so far has completed.
+			template< typename tResource >
+			void retire( tResource&& aResource );
+			template< typename tResource >
+			void retire( tResource&& aResource, std::uint64_t aValue );
+
+			// Destroys the retired resources whose value has been reached.
+			// Call once per frame, e.g., after waiting for a frame slot.
+			void collect();
+
+			std::size_t retired() const noexcept; // not yet destroyed
+
+		private:
+			struct Retired_
+			{
+				virtual ~Retired_() = default;
+			};
+
+			template< typename tResource >
+			struct RetiredOf_ final : Retired_
+			{
+				explicit RetiredOf_( tResource&& aResource )
+					: resource( std::move(aResource) )
+				{}
+
+				tResource resource;
+			};
+
+			struct Entry_
+			{
+				std::uint64_t value;
+				std::unique_ptr<Retired_> resource;
+			};
+
+		private:
+			VulkanContext const* mContext;
+			Semaphore mSemaphore;
+
+			std::uint64_t mSubmitted = 0;
+			std::uint64_t mCompleted = 0; // cached
+
+			std::deque<Entry_> mRetired; // in order of value
+	};
+
+	// Chains into a VkSubmitInfo to signal aValue on aTimeline, in addition
+	// to the submission's binary semaphores (whose values are ignored).
+	// Keep it alive until vkQueueSubmit() returns.
+	struct TimelineSignal
+	{
+		TimelineSignal( Timeline&, VkSubmitInfo&, std::uint64_t aValue );
+
+		TimelineSignal( TimelineSignal const& ) = delete;
+		TimelineSignal& operator= (TimelineSignal const&) = delete;
+
+		VkTimelineSemaphoreSubmitInfo info{};
+		VkSemaphore semaphores[2]{};
+		std::uint64_t values[2]{};
+	};
+}
+
+namespace labutils
+{
+	template< typename tResource >
+	void Timeline::retire( tResource&& aResource )
+	{
+		retire( std::forward<tResource>(aResource), mSubmitted );
+	}
+
+	template< typename tResource >
+	void Timeline::retire( tResource&& aResource, std::uint64_t aValue )
+	{
+		static_assert( !std::is_lvalue_reference_v<tResource>, "retire() takes ownership; std::move() the resource" );
+
+		// Values are retired in order (at most mSubmitted), so the oldest
+		// entries are always the first to be collected
+		if( !mRetired.empty() && aValue < mRetired.back().value )
+			aValue = mRetired.back().value;
+
+		mRetired.emplace_back( Entry_{ aValue, std::make_unique<RetiredOf_<tResource>>( std::move(aResource) ) } );
+	}
+}
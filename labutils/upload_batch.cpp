@@ -0,0 +1,370 @@
+#include "upload_batch.hpp"
+
+#include <limits>
+#include <utility>
+#include <optional>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// Image copies need multiples of the texel (block) size; 16 also
+	// satisfies the usual optimalBufferCopyOffsetAlignment.
+	constexpr VkDeviceSize kStagingAlign = 16;
+
+	// Frees the command buffer once it is destroyed, for Timeline::retire()
+	struct RetiredCommands_
+	{
+		VkDevice device;
+		VkCommandPool pool;
+		VkCommandBuffer cmdBuff;
+
+		RetiredCommands_( VkDevice aDevice, VkCommandPool aPool, VkCommandBuffer aCmdBuff ) noexcept
+			: device( aDevice ), pool( aPool ), cmdBuff( aCmdBuff )
+		{}
+		~RetiredCommands_()
+		{
+			if( VK_NULL_HANDLE != cmdBuff )
+				vkFreeCommandBuffers( device, pool, 1, &cmdBuff );
+		}
+
+		RetiredCommands_( RetiredCommands_&& aOther ) noexcept
+			: device( aOther.device ), pool( aOther.pool ), cmdBuff( std::exchange( aOther.cmdBuff, VK_NULL_HANDLE ) )
+		{}
+		RetiredCommands_& operator= (RetiredCommands_&&) = delete;
+	};
+}
+
+namespace labutils
+{
+	UploadTicket::~UploadTicket()
+	{
+		if( !mDone && !mShared )
+		{
+			// The staging memory must not be freed while the GPU reads it
+			try
+			{
+				wait();
+			}
+			catch( ... )
+			{
+				vkDeviceWaitIdle( mContext->device );
+			}
+		}
+
+		release_();
+	}
+
+	UploadTicket::UploadTicket( UploadTicket&& aOther ) noexcept
+		: mContext( aOther.mContext )
+		, mShared( aOther.mShared )
+		, mValue( aOther.mValue )
+		, mPool( aOther.mPool )
+		, mCmdBuff( std::exchange( aOther.mCmdBuff, VK_NULL_HANDLE ) )
+		, mTimeline( std::move(aOther.mTimeline) )
+		, mFence( std::move(aOther.mFence) )
+		, mStaging( std::move(aOther.mStaging) )
+		, mDone( std::exchange( aOther.mDone, true ) )
+	{}
+
+	UploadTicket& UploadTicket::operator=( UploadTicket&& aOther ) noexcept
+	{
+		std::swap( mContext, aOther.mContext );
+		std::swap( mShared, aOther.mShared );
+		std::swap( mValue, aOther.mValue );
+		std::swap( mPool, aOther.mPool );
+		std::swap( mCmdBuff, aOther.mCmdBuff );
+		std::swap( mTimeline, aOther.mTimeline );
+		std::swap( mFence, aOther.mFence );
+		std::swap( mStaging, aOther.mStaging );
+		std::swap( mDone, aOther.mDone );
+		return *this;
+	}
+
+	bool UploadTicket::ready() const
+	{
+		if( mDone )
+			return true;
+
+		if( mShared )
+			return mShared->reached( mValue );
+
+		if( VK_NULL_HANDLE != mTimeline.handle )
+		{
+			std::uint64_t value = 0;
+			if( auto const res = vkGetSemaphoreCounterValue( mContext->device, mTimeline.handle, &value ); VK_SUCCESS != res )
+				throw Error( "Querying upload progress\n" "vkGetSemaphoreCounterValue() returned %s", to_string(res).c_str() );
+
+			return value >= 1;
+		}
+
+		auto const res = vkGetFenceStatus( mContext->device, mFence.handle );
+		if( VK_SUCCESS != res && VK_NOT_READY != res )
+			throw Error( "Querying upload progress\n" "vkGetFenceStatus() returned %s", to_string(res).c_str() );
+
+		return VK_SUCCESS == res;
+	}
+
+	void UploadTicket::wait()
+	{
+		if( mDone )
+			return;
+
+		if( mShared )
+		{
+			mShared->wait( mValue );
+		}
+		else if( VK_NULL_HANDLE != mTimeline.handle )
+		{
+			std::uint64_t const value = mValue;
+
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &mTimeline.handle;
+			waitInfo.pValues = &value;
+
+			if( auto const res = vkWaitSemaphores( mContext->device, &waitInfo, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+				throw Error( "Waiting for uploads to complete\n" "vkWaitSemaphores() returned %s", to_string(res).c_str() );
+		}
+		else
+		{
+			if( auto const res = vkWaitForFences( mContext->device, 1, &mFence.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max() ); VK_SUCCESS != res )
+				throw Error( "Waiting for uploads to complete\n" "vkWaitForFences() returned %s", to_string(res).c_str() );
+		}
+
+		mDone = true;
+		release_();
+	}
+
+	VkSemaphore UploadTicket::semaphore() const noexcept
+	{
+		return mShared ? mShared->semaphore() : mTimeline.handle;
+	}
+	std::uint64_t UploadTicket::value() const noexcept
+	{
+		return mValue;
+	}
+
+	void UploadTicket::release_() noexcept
+	{
+		if( VK_NULL_HANDLE != mCmdBuff )
+			vkFreeCommandBuffers( mContext->device, mPool, 1, &mCmdBuff );
+
+		mCmdBuff = VK_NULL_HANDLE;
+		mStaging.clear();
+	}
+}
+
+namespace labutils
+{
+	UploadBatch::UploadBatch( VulkanContext const& aContext, VkCommandPool aPool, Allocator const& aAllocator, VkDeviceSize aChunkBytes )
+		: mContext( &aContext )
+		, mPool( aPool )
+		, mAllocator( &aAllocator )
+		, mChunkBytes( aChunkBytes )
+	{}
+
+	UploadBatch::~UploadBatch()
+	{
+		// Nothing was submitted, so nothing is in flight
+		if( VK_NULL_HANDLE != mCmdBuff )
+			vkFreeCommandBuffers( mContext->device, mPool, 1, &mCmdBuff );
+	}
+
+	void UploadBatch::upload_buffer( VkBuffer aDst, void const* aData, VkDeviceSize aSize, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage, VkDeviceSize aDstOffset )
+	{
+		std::memcpy( stage_buffer( aDst, aSize, aDstAccess, aDstStage, aDstOffset ), aData, std::size_t(aSize) );
+	}
+
+	std::byte* UploadBatch::stage_buffer( VkBuffer aDst, VkDeviceSize aSize, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage, VkDeviceSize aDstOffset )
+	{
+		assert( aSize > 0 );
+
+		auto const staged = stage_( aSize );
+
+		VkBufferCopy copy{};
+		copy.srcOffset = staged.offset;
+		copy.dstOffset = aDstOffset;
+		copy.size = aSize;
+		vkCmdCopyBuffer( commands(), staged.buffer, aDst, 1, &copy );
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = aDstAccess;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = aDst;
+		barrier.offset = aDstOffset;
+		barrier.size = aSize;
+		mBarriers.emplace_back( barrier );
+
+		mDstStages |= aDstStage;
+		return staged.data;
+	}
+
+	void UploadBatch::upload_image( VkImage aImage, ImageData const& aData )
+	{
+		auto const staged = stage_( aData.pixels.size() );
+		std::memcpy( staged.data, aData.pixels.data(), aData.pixels.size() );
+
+		record_texture_copy( commands(), staged.buffer, staged.offset, aImage, aData.width, aData.height );
+		record_texture_mips( commands(), aImage, aData.width, aData.height );
+	}
+	void UploadBatch::upload_image( VkImage aImage, MipImageData const& aData )
+	{
+		auto const staged = stage_( aData.bytes.size() );
+		std::memcpy( staged.data, aData.bytes.data(), aData.bytes.size() );
+
+		record_texture_levels_copy( commands(), staged.buffer, staged.offset, aImage, aData );
+		record_texture_ready( commands(), aImage, std::uint32_t(aData.levelOffsets.size()) );
+	}
+
+	VkCommandBuffer UploadBatch::commands()
+	{
+		if( VK_NULL_HANDLE == mCmdBuff )
+		{
+			mCmdBuff = alloc_command_buffer( *mContext, mPool );
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+			if( auto const res = vkBeginCommandBuffer( mCmdBuff, &beginInfo ); VK_SUCCESS != res )
+				throw Error( "Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str() );
+		}
+
+		return mCmdBuff;
+	}
+
+	UploadTicket UploadBatch::submit()
+	{
+		return submit_( nullptr );
+	}
+	UploadTicket UploadBatch::submit( Timeline& aTimeline )
+	{
+		return submit_( &aTimeline );
+	}
+
+	UploadTicket UploadBatch::submit_( Timeline* aTimeline )
+	{
+		UploadTicket ret;
+		if( VK_NULL_HANDLE == mCmdBuff )
+			return ret;
+
+		if( !mBarriers.empty() )
+		{
+			vkCmdPipelineBarrier( mCmdBuff,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, mDstStages,
+				0, 0, nullptr,
+				std::uint32_t(mBarriers.size()), mBarriers.data(),
+				0, nullptr
+			);
+		}
+
+		if( auto const res = vkEndCommandBuffer( mCmdBuff ); VK_SUCCESS != res )
+			throw Error( "Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str() );
+
+		// Host writes become visible with the submission; flushing is a
+		// no-op for coherent memory.
+		for( auto const& chunk : mStaging )
+			vmaFlushAllocation( mAllocator->allocator, chunk.allocation, 0, VK_WHOLE_SIZE );
+
+		ret.mContext = mContext;
+		ret.mPool = mPool;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &mCmdBuff;
+
+		std::uint64_t const signalValue = 1;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+		std::optional<TimelineSignal> shared;
+		if( aTimeline )
+		{
+			ret.mShared = aTimeline;
+			ret.mValue = aTimeline->signal();
+			shared.emplace( *aTimeline, submitInfo, ret.mValue );
+		}
+		else if( mContext->haveTimelineSemaphore )
+		{
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0;
+
+			VkSemaphoreCreateInfo semaInfo{};
+			semaInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaInfo.pNext = &typeInfo;
+
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			if( auto const res = vkCreateSemaphore( mContext->device, &semaInfo, nullptr, &semaphore ); VK_SUCCESS != res )
+				throw Error( "Unable to create timeline semaphore\n" "vkCreateSemaphore() returned %s", to_string(res).c_str() );
+
+			ret.mTimeline = Semaphore( mContext->device, semaphore );
+
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &ret.mTimeline.handle;
+		}
+		else
+		{
+			ret.mFence = create_fence( *mContext );
+		}
+
+		if( auto const res = vkQueueSubmit( mContext->graphicsQueue, 1, &submitInfo, ret.mFence.handle ); VK_SUCCESS != res )
+			throw Error( "Submitting uploads\n" "vkQueueSubmit() returned %s", to_string(res).c_str() );
+
+		// The ticket (or the timeline) owns everything that is in flight now
+		if( aTimeline )
+		{
+			aTimeline->retire( RetiredCommands_( mContext->device, mPool, std::exchange( mCmdBuff, VK_NULL_HANDLE ) ), ret.mValue );
+			for( auto& chunk : mStaging )
+				aTimeline->retire( std::move(chunk), ret.mValue );
+		}
+		else
+		{
+			ret.mCmdBuff = std::exchange( mCmdBuff, VK_NULL_HANDLE );
+			ret.mStaging = std::move(mStaging);
+		}
+		ret.mDone = false;
+
+		mStaging.clear();
+		mChunkSize = mChunkUsed = 0;
+		mBarriers.clear();
+		mDstStages = 0;
+
+		return ret;
+	}
+
+	UploadBatch::Staged_ UploadBatch::stage_( VkDeviceSize aSize )
+	{
+		VkDeviceSize start = (mChunkUsed + kStagingAlign - 1) / kStagingAlign * kStagingAlign;
+		if( mStaging.empty() || start + aSize > mChunkSize )
+		{
+			auto const size = std::max( aSize, mChunkBytes );
+			mStaging.emplace_back( create_buffer( *mAllocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, EMemoryClass::staging, VMA_ALLOCATION_CREATE_MAPPED_BIT ) );
+			mChunkSize = size;
+			start = 0;
+
+			if( !mapped_data( *mAllocator, mStaging.back() ) )
+				throw Error( "Upload batch: staging buffer of %llu bytes is not host visible", static_cast<unsigned long long>(size) );
+		}
+
+		mChunkUsed = start + aSize;
+		return Staged_{ mStaging.back().buffer, start, mapped_data( *mAllocator, mStaging.back() ) + start };
+	}
+}
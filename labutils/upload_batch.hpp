@@ -0,0 +1,145 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkimage.hpp"
+#include "vkbuffer.hpp"
+#include "vkobject.hpp"
+#include "timeline.hpp"
+#include "allocator.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Completion of an UploadBatch's submission. Keeps the batch's staging
+	// memory and command buffer alive until the GPU is done with them; the
+	// destructor waits for that if nobody did. (Batches submitted to a
+	// Timeline retire those to it instead, and the ticket only refers to
+	// the signalled value.) A default constructed ticket is complete.
+	class UploadTicket
+	{
+		public:
+			UploadTicket() noexcept = default;
+			~UploadTicket();
+
+			UploadTicket( UploadTicket const& ) = delete;
+			UploadTicket& operator= (UploadTicket const&) = delete;
+
+			UploadTicket( UploadTicket&& ) noexcept;
+			UploadTicket& operator= (UploadTicket&&) noexcept;
+
+		public:
+			// Non-blocking
+			bool ready() const;
+
+			// Blocks until the uploads have completed, then releases the
+			// staging memory and the command buffer.
+			void wait();
+
+			// Timeline semaphore that reaches value() once the uploads have
+			// completed, for the GPU to wait on instead (e.g., in the first
+			// frame's submission). VK_NULL_HANDLE without the
+			// timelineSemaphore feature, where a fence is used instead.
+			VkSemaphore semaphore() const noexcept;
+			std::uint64_t value() const noexcept;
+
+		private:
+			friend class UploadBatch;
+
+			void release_() noexcept;
+
+		private:
+			VulkanContext const* mContext = nullptr;
+			Timeline* mShared = nullptr;
+			std::uint64_t mValue = 1;
+
+			VkCommandPool mPool = VK_NULL_HANDLE;
+			VkCommandBuffer mCmdBuff = VK_NULL_HANDLE;
+
+			Semaphore mTimeline;
+			Fence mFence;
+			std::vector<Buffer> mStaging;
+
+			bool mDone = true;
+	};
+
+	// Collects buffer and image uploads, and records them into a single
+	// command buffer with one submission (to the graphics queue, which the
+	// mip blits need), rather than a submit and wait per resource. Data is
+	// staged into host-visible chunks as it is added; the copies land in
+	// the destinations once the ticket that submit() returns is ready.
+	//
+	// Destinations must be unused by the GPU, and images be in
+	// VK_IMAGE_LAYOUT_UNDEFINED; images end up in SHADER_READ_ONLY_OPTIMAL.
+	// Not thread safe: the command pool is used from the calling thread.
+	class UploadBatch
+	{
+		public:
+			// Staging memory comes in chunks of at least aChunkBytes (or
+			// of the largest upload); pass the total if it is known.
+			UploadBatch( VulkanContext const&, VkCommandPool, Allocator const&, VkDeviceSize aChunkBytes = VkDeviceSize(4) << 20 );
+			~UploadBatch(); // discards the batch unless it was submitted
+
+			UploadBatch( UploadBatch const& ) = delete;
+			UploadBatch& operator= (UploadBatch const&) = delete;
+
+		public:
+			// Copies aSize bytes to aDst at aDstOffset. A barrier then makes
+			// them available to aDstAccess in aDstStage.
+			void upload_buffer( VkBuffer aDst, void const* aData, VkDeviceSize aSize, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage, VkDeviceSize aDstOffset = 0 );
+
+			// As upload_buffer(), but returns the mapped staging memory for
+			// the caller to fill (from any thread) before submit().
+			std::byte* stage_buffer( VkBuffer aDst, VkDeviceSize aSize, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage, VkDeviceSize aDstOffset = 0 );
+
+			// aImage from create_image_texture2d() with aData's size. Decoded
+			// images get their mip chain blitted; baked ones have all of
+			// their levels copied.
+			void upload_image( VkImage, ImageData const& aData );
+			void upload_image( VkImage, MipImageData const& aData );
+
+			// For other commands that belong with the uploads, e.g., initial
+			// layout transitions. They run before the buffer barriers.
+			VkCommandBuffer commands();
+
+			// Submits the batch; it is empty again afterwards. Submitting an
+			// empty batch returns a complete ticket.
+			UploadTicket submit();
+
+			// As above, but signals the next value of aTimeline, and retires
+			// the staging memory and the command buffer to it; nothing needs
+			// to wait for the ticket. aTimeline's queue must be the graphics
+			// queue, and collect() be called on the command pool's thread.
+			UploadTicket submit( Timeline& aTimeline );
+
+		private:
+			struct Staged_
+			{
+				VkBuffer buffer;
+				VkDeviceSize offset;
+				std::byte* data;
+			};
+
+			Staged_ stage_( VkDeviceSize aSize );
+			UploadTicket submit_( Timeline* );
+
+		private:
+			VulkanContext const* mContext;
+			VkCommandPool mPool;
+			Allocator const* mAllocator;
+			VkDeviceSize mChunkBytes;
+
+			VkCommandBuffer mCmdBuff = VK_NULL_HANDLE;
+
+			std::vector<Buffer> mStaging;
+			VkDeviceSize mChunkSize = 0, mChunkUsed = 0; // of mStaging.back()
+
+			std::vector<VkBufferMemoryBarrier> mBarriers;
+			VkPipelineStageFlags mDstStages = 0;
+	};
+}
@@ -1,10 +1,12 @@
 #include "vkbuffer.hpp"
 
 #include <utility>
+#include <algorithm>
 
 #include <cassert>
 
 #include "error.hpp"
+#include "defragmenter.hpp"
 #include "to_string.hpp"
 
 
@@ -19,6 +21,7 @@ namespace labutils
 		{
 			assert( VK_NULL_HANDLE != mAllocator );
 			assert( VK_NULL_HANDLE != allocation );
+			release_relocatable( mAllocator, allocation );
 			vmaDestroyBuffer( mAllocator, buffer, allocation );
 		}
 	}
@@ -32,38 +35,107 @@ namespace labutils
 	Buffer::Buffer( Buffer&& aOther ) noexcept
 		: buffer( std::exchange( aOther.buffer, VK_NULL_HANDLE ) )
 		, allocation( std::exchange( aOther.allocation, VK_NULL_HANDLE ) )
+		, size( std::exchange( aOther.size, 0 ) )
 		, mAllocator( std::exchange( aOther.mAllocator, VK_NULL_HANDLE ) )
 	{}
 	Buffer& Buffer::operator=( Buffer&& aOther ) noexcept
 	{
 		std::swap( buffer, aOther.buffer );
 		std::swap( allocation, aOther.allocation );
+		std::swap( size, aOther.size );
 		std::swap( mAllocator, aOther.mAllocator );
 		return *this;
 	}
+
+	VmaAllocator Buffer::allocator() const noexcept
+	{
+		return mAllocator;
+	}
 }
 
 namespace labutils
 {
-	Buffer create_buffer( Allocator const& aAllocator, VkDeviceSize aSize, VkBufferUsageFlags aBufferUsage, VmaMemoryUsage aMemoryUsage )
+	Buffer create_buffer( Allocator const& aAllocator, VkDeviceSize aSize, VkBufferUsageFlags aBufferUsage, EMemoryClass aClass, VmaAllocationCreateFlags aFlags, std::vector<std::uint32_t> const& aQueueFamilies )
 	{
-		//TODO- (Section 2) implement me!
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = aSize;
 		bufferInfo.usage = aBufferUsage;
 
-		VmaAllocationCreateInfo allocInfo{};
-		allocInfo.usage = aMemoryUsage;
+		VkBufferUsageFlags const addressed = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		if (aAllocator.deviceAddresses && (aBufferUsage & addressed))
+			bufferInfo.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+		std::vector<std::uint32_t> families = aQueueFamilies;
+		std::sort(families.begin(), families.end());
+		families.erase(std::unique(families.begin(), families.end()), families.end());
+		if (families.size() >= 2)
+		{
+			bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferInfo.queueFamilyIndexCount = std::uint32_t(families.size());
+			bufferInfo.pQueueFamilyIndices = families.data();
+		}
+
+		VmaAllocationCreateInfo allocInfo = allocation_info(aAllocator, aClass, aFlags);
 
 		VkBuffer buffer = VK_NULL_HANDLE;
 		VmaAllocation allocation = VK_NULL_HANDLE;
 
+		// VMA doesn't check that a custom pool's memory type suits the
+		// buffer. Create the buffer first, and fall back to the default
+		// pools if it doesn't.
+		if (VK_NULL_HANDLE != allocInfo.pool)
+		{
+			VmaAllocatorInfo info{};
+			vmaGetAllocatorInfo(aAllocator.allocator, &info);
+
+			if (auto const res = vkCreateBuffer(info.device, &bufferInfo, nullptr, &buffer); VK_SUCCESS != res)
+			{
+				throw Error("Unable to create buffer\n" "vkCreateBuffer() returned %s", to_string(res).c_str());
+			}
+
+			VkMemoryRequirements memReq{};
+			vkGetBufferMemoryRequirements(info.device, buffer, &memReq);
+
+			allocInfo = allocation_info(aAllocator, aClass, aFlags, memReq.memoryTypeBits);
+			if (VK_NULL_HANDLE != allocInfo.pool && VK_SUCCESS == vmaAllocateMemoryForBuffer(aAllocator.allocator, buffer, &allocInfo, &allocation, nullptr))
+			{
+				if (auto const res = vmaBindBufferMemory(aAllocator.allocator, allocation, buffer); VK_SUCCESS != res)
+				{
+					vmaDestroyBuffer(aAllocator.allocator, buffer, allocation);
+					throw Error("Unable to bind buffer memory\n" "vmaBindBufferMemory() returned %s", to_string(res).c_str());
+				}
+
+				// Pooled buffers can be moved (see Defragmenter), unless they
+				// are shared: the record would keep pQueueFamilyIndices
+				if (VK_SHARING_MODE_EXCLUSIVE == bufferInfo.sharingMode)
+					track_relocatable(aAllocator.allocator, allocation, buffer, bufferInfo);
+				tag_allocation(aAllocator.allocator, allocation, aClass);
+				Buffer ret(aAllocator.allocator, buffer, allocation);
+				ret.size = aSize;
+				return ret;
+			}
+
+			vkDestroyBuffer(info.device, buffer, nullptr);
+			buffer = VK_NULL_HANDLE;
+			allocInfo.pool = VK_NULL_HANDLE;
+		}
+
 		if (auto const res = vmaCreateBuffer(aAllocator.allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr); VK_SUCCESS != res)
 		{
 			throw Error("Unable to allocate buffer\n" "vmaCreateBuffer() returned %s", to_string(res).c_str());
 		}
 
-		return Buffer(aAllocator.allocator, buffer, allocation);
+		tag_allocation(aAllocator.allocator, allocation, aClass);
+		Buffer ret(aAllocator.allocator, buffer, allocation);
+		ret.size = aSize;
+		return ret;
+	}
+
+	std::byte* mapped_data( Allocator const& aAllocator, Buffer const& aBuffer )
+	{
+		VmaAllocationInfo info{};
+		vmaGetAllocationInfo(aAllocator.allocator, aBuffer.allocation, &info);
+		return static_cast<std::byte*>(info.pMappedData);
 	}
 }
@@ -3,9 +3,12 @@
 #include <volk/volk.h>
 #include <vk_mem_alloc.h>
 
+#include <vector>
 #include <utility>
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 #include "allocator.hpp"
 
@@ -27,10 +30,23 @@ namespace labutils
 		public:
 			VkBuffer buffer = VK_NULL_HANDLE;
 			VmaAllocation allocation = VK_NULL_HANDLE;
+			VkDeviceSize size = 0; // as created by create_buffer(); 0 if unknown
+
+			VmaAllocator allocator() const noexcept; // that owns allocation
 
 		private:
 			VmaAllocator mAllocator = VK_NULL_HANDLE;
 	};
 
-	Buffer create_buffer( Allocator const&, VkDeviceSize, VkBufferUsageFlags, VmaMemoryUsage );
+	// Pass VMA_ALLOCATION_CREATE_MAPPED_BIT in aFlags for a persistently
+	// mapped buffer (see mapped_data()). Buffers of the pooled classes come
+	// from the pool if its memory type suits them, and from VMA's default
+	// pools otherwise. With two or more distinct aQueueFamilies, the
+	// buffer is shared concurrently between them (no ownership transfers).
+	// With Allocator::deviceAddresses, uniform and storage buffers also get
+	// SHADER_DEVICE_ADDRESS usage.
+	Buffer create_buffer( Allocator const&, VkDeviceSize, VkBufferUsageFlags, EMemoryClass, VmaAllocationCreateFlags aFlags = 0, std::vector<std::uint32_t> const& aQueueFamilies = {} );
+
+	// Null unless the buffer is persistently mapped.
+	std::byte* mapped_data( Allocator const&, Buffer const& );
 }
@@ -2,19 +2,27 @@
 
 #include <limits>
 #include <vector>
+#include <optional>
 #include <utility>
+#include <type_traits>
 #include <algorithm>
 
 #include <cstdio>
 #include <cassert>
 #include <cstring> // for std::memcpy()
 
-#include <stb_image.h>
-
 #include "error.hpp"
 #include "vkutil.hpp"
 #include "vkbuffer.hpp"
+#include "defragmenter.hpp"
 #include "to_string.hpp"
+#include "staging_ring.hpp"
+#include "texture_file.hpp"
+#include "texture_transcode.hpp"
+#include "mapped_file.hpp"
+#include "image_decoder.hpp"
+#include "cpu_zones.hpp"
+#include "mip_downsampler.hpp"
 
 
 
@@ -45,6 +53,238 @@ namespace
 
 		return res;
 	}
+
+	// Uploads aCount images to the GPU, batched so that each batch fits into
+	// aStagingBudget bytes of staging memory (but holds at least one image).
+	// Each batch is one range of the staging ring, one command buffer and
+	// one submission; the next batch is staged while the GPU copies the
+	// previous one. Without aRing (or for an image larger than it), a
+	// ring just large enough is created for the call. aSize(i) is the
+	// number of bytes staged for image i, aWrite(i, ptr) stages them, and
+	// aRecord(i, cmd, buffer, offset) creates image i and records its upload
+	// from the staged bytes.
+	template< typename tSize, typename tWrite, typename tRecord >
+	void upload_batched_( labutils::VulkanContext const& aContext, VkCommandPool aCmdPool, labutils::Allocator const& aAllocator, labutils::StagingRing* aRing, std::size_t aCount, VkDeviceSize aStagingBudget, tSize&& aSize, tWrite&& aWrite, tRecord&& aRecord )
+	{
+		using namespace labutils;
+
+		// Staging offsets must be multiples of the texel (block) size; 16
+		// also satisfies the usual optimalBufferCopyOffsetAlignment.
+		constexpr VkDeviceSize kStagingAlign = 16;
+		auto const staged_size = [&] (std::size_t aIndex)
+		{
+			return (VkDeviceSize(aSize(aIndex)) + kStagingAlign - 1) / kStagingAlign * kStagingAlign;
+		};
+
+		if (aRing)
+			aStagingBudget = std::min(aStagingBudget, aRing->capacity());
+
+		// Batch as many images as fit in the staging budget (at least one)
+		struct Batch_ { std::size_t first, end; VkDeviceSize size; };
+		std::vector<Batch_> batches;
+		VkDeviceSize overflowSize = 0;
+		for (std::size_t first = 0; first < aCount; )
+		{
+			std::size_t end = first + 1;
+			VkDeviceSize stagingSize = staged_size(first);
+			while (end < aCount && stagingSize + staged_size(end) <= aStagingBudget)
+				stagingSize += staged_size(end++);
+
+			if (!aRing || stagingSize > aRing->capacity())
+				overflowSize = std::max(overflowSize, stagingSize);
+
+			batches.emplace_back(Batch_{ first, end, stagingSize });
+			first = end;
+		}
+
+		std::optional<StagingRing> overflow;
+		if (overflowSize > 0)
+			overflow.emplace(aContext, aAllocator, overflowSize);
+
+		std::vector<VkCommandBuffer> cbuffs;
+		for (auto const& batch : batches)
+		{
+			StagingRing& ring = aRing && batch.size <= aRing->capacity() ? *aRing : *overflow;
+
+			// Copy image data to the staging ring
+			auto const staging = ring.allocate(batch.size, kStagingAlign);
+
+			std::vector<VkDeviceSize> offsets;
+			VkDeviceSize offset = staging.offset;
+			for (std::size_t i = batch.first; i < batch.end; ++i)
+			{
+				aWrite(i, staging.data + (offset - staging.offset));
+				offsets.emplace_back(offset);
+				offset += staged_size(i);
+			}
+
+			//Create command buffer for data upload and begin recording
+			VkCommandBuffer cbuff = alloc_command_buffer(aContext, aCmdPool);
+			cbuffs.emplace_back(cbuff);
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			beginInfo.pInheritanceInfo = nullptr;
+
+			if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+			{
+				throw Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str());
+			}
+
+			for (std::size_t i = batch.first; i < batch.end; ++i)
+				aRecord(i, cbuff, staging.buffer, offsets[i - batch.first]);
+
+			//End command recording
+			if (auto const res = vkEndCommandBuffer(cbuff); VK_SUCCESS != res)
+			{
+				throw Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str());
+			}
+
+			// Submit command buffer. The ring's fence keeps the staged range
+			// alive until the copies have completed.
+			VkSubmitInfo submitInfo{};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &cbuff;
+
+			if (auto const res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, ring.submit_fence()); VK_SUCCESS != res)
+			{
+				throw Error("Submitting command\n" "vkQueueSubmit() returned %s", to_string(res).c_str());
+			}
+		}
+
+		// Wait for all uploads to complete; the images are ready once this
+		// returns. The command buffers we must free manually.
+		if (aRing)
+			aRing->wait_idle();
+		if (overflow)
+			overflow->wait_idle();
+
+		if (!cbuffs.empty())
+			vkFreeCommandBuffers(aContext.device, aCmdPool, std::uint32_t(cbuffs.size()), cbuffs.data());
+	}
+
+	// Applies fit_texture_budget() to the images that don't fit into the
+	// remaining device memory. Returns reduced copies of those; the other
+	// entries are empty, and the original images are used as they are.
+	template< typename tImage >
+	std::vector<std::optional<tImage>> fit_budget_( labutils::Allocator const& aAllocator, tImage const* aImages, std::size_t aCount )
+	{
+		auto const texture_bytes = [] (tImage const& aImage) -> VkDeviceSize {
+			if constexpr (std::is_same_v<tImage, labutils::MipImageData>)
+				return aImage.bytes.size();
+			else
+				return VkDeviceSize(aImage.pixels.size()) * 4 / 3;
+		};
+
+		std::vector<std::optional<tImage>> ret(aCount);
+		VkDeviceSize headroom = labutils::device_headroom(aAllocator);
+
+		std::size_t reduced = 0;
+		for (std::size_t i = 0; i < aCount; ++i)
+		{
+			if (auto const bytes = texture_bytes(aImages[i]); bytes <= headroom)
+			{
+				headroom -= bytes;
+				continue;
+			}
+
+			auto& copy = ret[i].emplace(aImages[i]);
+			if (labutils::fit_texture_budget(copy, headroom) > 0)
+				++reduced;
+		}
+
+		if (reduced > 0)
+			std::fprintf(stderr, "Info: near the GPU memory budget; dropped top mip levels of %zu of %zu textures\n", reduced, aCount);
+
+		return ret;
+	}
+
+	std::vector<labutils::Image> upload_images_( labutils::VulkanContext const& aContext, VkCommandPool aCmdPool, labutils::Allocator const& aAllocator, labutils::StagingRing* aRing, labutils::ImageData const* aImages, VkFormat const* aFormats, std::size_t aCount, VkDeviceSize aStagingBudget, labutils::MipDownsampler* aMips )
+	{
+		using namespace labutils;
+
+		auto const reduced = fit_budget_(aAllocator, aImages, aCount);
+		auto const image_at = [&] (std::size_t aIndex) -> ImageData const& {
+			return reduced[aIndex] ? *reduced[aIndex] : aImages[aIndex];
+		};
+
+		std::vector<Image> ret;
+		ret.reserve(aCount);
+
+		upload_batched_(aContext, aCmdPool, aAllocator, aRing, aCount, aStagingBudget,
+			[&] (std::size_t aIndex) { return VkDeviceSize(image_at(aIndex).pixels.size()); },
+			[&] (std::size_t aIndex, void* aDst) { std::memcpy(aDst, image_at(aIndex).pixels.data(), image_at(aIndex).pixels.size()); },
+			[&] (std::size_t aIndex, VkCommandBuffer aCmdBuff, VkBuffer aStaging, VkDeviceSize aOffset)
+			{
+				auto const& image = image_at(aIndex);
+				assert( image.pixels.size() == std::size_t(image.width) * image.height * image.channels );
+
+				// The levels are written by aMips where it can (as storage
+				// images, through UNORM views for sRGB formats), and blitted
+				// otherwise
+				auto const format = aFormats[aIndex];
+				auto const levels = compute_mip_level_count(image.width, image.height);
+				bool const compute = aMips && levels > 1 && aMips->supports(format) && !aMips->full(levels - 1);
+
+				VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+				VkImageCreateFlags flags = 0;
+				if (compute)
+				{
+					usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+					if (downsample_storage_format(format) != format)
+						flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+				}
+
+				//Create image
+				auto& dst = ret.emplace_back(create_image_texture2d(aAllocator, image.width, image.height, format, usage, flags));
+
+				record_texture_copy(aCmdBuff, aStaging, aOffset, dst.image, image.width, image.height);
+				if (compute)
+					record_texture_mips(aCmdBuff, *aMips, dst.image, format, image.width, image.height);
+				else
+					record_texture_mips(aCmdBuff, dst.image, image.width, image.height);
+			}
+		);
+
+		// upload_batched_() has waited for the dispatches
+		if (aMips)
+			aMips->reset();
+
+		return ret;
+	}
+
+	std::vector<labutils::Image> upload_mips_( labutils::VulkanContext const& aContext, VkCommandPool aCmdPool, labutils::Allocator const& aAllocator, labutils::StagingRing* aRing, labutils::MipImageData const* aImages, std::size_t aCount, VkDeviceSize aStagingBudget )
+	{
+		using namespace labutils;
+
+		for (std::size_t i = 0; i < aCount; ++i)
+			require_sampled_format(aContext, aImages[i].format, "baked texture");
+
+		auto const reduced = fit_budget_(aAllocator, aImages, aCount);
+		auto const image_at = [&] (std::size_t aIndex) -> MipImageData const& {
+			return reduced[aIndex] ? *reduced[aIndex] : aImages[aIndex];
+		};
+
+		std::vector<Image> ret;
+		ret.reserve(aCount);
+
+		upload_batched_(aContext, aCmdPool, aAllocator, aRing, aCount, aStagingBudget,
+			[&] (std::size_t aIndex) { return VkDeviceSize(image_at(aIndex).bytes.size()); },
+			[&] (std::size_t aIndex, void* aDst) { std::memcpy(aDst, image_at(aIndex).bytes.data(), image_at(aIndex).bytes.size()); },
+			[&] (std::size_t aIndex, VkCommandBuffer aCmdBuff, VkBuffer aStaging, VkDeviceSize aOffset)
+			{
+				auto const& image = image_at(aIndex);
+				auto& dst = ret.emplace_back(create_image_texture2d(aAllocator, image.width, image.height, image.format));
+
+				record_texture_levels_copy(aCmdBuff, aStaging, aOffset, dst.image, image);
+				record_texture_ready(aCmdBuff, dst.image, std::uint32_t(image.levelOffsets.size()));
+			}
+		);
+
+		return ret;
+	}
 }
 
 namespace labutils
@@ -57,6 +297,7 @@ namespace labutils
 		{
 			assert( VK_NULL_HANDLE != mAllocator );
 			assert( VK_NULL_HANDLE != allocation );
+			release_relocatable( mAllocator, allocation );
 			vmaDestroyImage( mAllocator, image, allocation );
 		}
 	}
@@ -79,70 +320,229 @@ namespace labutils
 		std::swap( mAllocator, aOther.mAllocator );
 		return *this;
 	}
+
+	VmaAllocator Image::allocator() const noexcept
+	{
+		return mAllocator;
+	}
 }
 
 namespace labutils
 {
-	Image load_image_texture2d( char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat )
+	ImageData decode_image( char const* aPath, std::uint32_t aChannels )
 	{
-		// Flip images vertically by default.
-		// Vulkan expects the first scanline to be the bottom-most scanline. PNG et
-		// al. instead define the first scanline to be the top-most one.
+		LUT_CPU_ZONE( "decode_image()" );
+		assert( 1 == aChannels || 4 == aChannels );
 
-		stbi_set_flip_vertically_on_load(1);
+		// See image_decoder.hpp for the decoders, and the orientation
+		auto const file = map_file( aPath );
+		return decode_image_memory( file.data(), file.size(), aChannels, aPath );
+	}
 
-		//load base image
-		int baseWidthi, baseHeighti, baseChannelsi;
-		stbi_uc* data = stbi_load(aPath, &baseWidthi, &baseHeighti, &baseChannelsi, 4 /*want 4 channels = RGBA*/); 
+	ImageData decode_packed_image( char const* aRedPath, char const* aGreenPath )
+	{
+		assert( aRedPath || aGreenPath );
 
-		if (!data)
+		ImageData sources[2];
+		char const* const paths[2] = { aRedPath, aGreenPath };
+		for (std::size_t i = 0; i < 2; ++i)
 		{
-			throw Error("%s : Unable to load texture base image (%s)", aPath, 0, stbi_failure_reason());
+			if (paths[i])
+				sources[i] = decode_image(paths[i], 1);
 		}
 
-		auto const baseWidth = std::uint32_t(baseWidthi);
-		auto const baseHeight = std::uint32_t(baseHeighti);
+		auto const& first = aRedPath ? sources[0] : sources[1];
+		if (aRedPath && aGreenPath && (sources[0].width != sources[1].width || sources[0].height != sources[1].height))
+			throw Error("%s (%ux%u) and %s (%ux%u) : can't pack images of different sizes", aRedPath, sources[0].width, sources[0].height, aGreenPath, sources[1].width, sources[1].height);
+
+		ImageData ret;
+		ret.width = first.width;
+		ret.height = first.height;
+		ret.channels = 4;
 
-		// Create staging buffer and copy image data to it
-		auto const sizeInBytes = baseWidth * baseHeight * 4;
+		std::size_t const texels = std::size_t(ret.width) * ret.height;
+		ret.pixels.assign(texels * 4, 0);
+		for (std::size_t i = 0; i < texels; ++i)
+		{
+			for (std::size_t c = 0; c < 2; ++c)
+			{
+				if (paths[c])
+					ret.pixels[4*i+c] = sources[c].pixels[i];
+			}
+			ret.pixels[4*i+3] = 255;
+		}
+
+		return ret;
+	}
+
+	bool is_opaque( ImageData const& aData )
+	{
+		if( 4 != aData.channels )
+			return false;
 
-		auto staging = create_buffer(aAllocator, sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		for( std::size_t i = 3; i < aData.pixels.size(); i += 4 )
+		{
+			if( 255 != aData.pixels[i] )
+				return false;
+		}
+		return true;
+	}
 
-		void* sptr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, staging.allocation, &sptr); VK_SUCCESS != res)
+	std::uint32_t drop_mip_levels( ImageData& aData, std::uint32_t aLevels )
+	{
+		std::uint32_t dropped = 0;
+		for (; dropped < aLevels && aData.width >= 2 && aData.height >= 2; ++dropped)
 		{
-			throw Error("Mapping memory for writing\n""vmaMapMemory() returned %s", to_string(res).c_str());
+			std::uint32_t const width = aData.width / 2, height = aData.height / 2;
+			std::uint32_t const channels = aData.channels;
+			std::vector<std::uint8_t> pixels(std::size_t(width) * height * channels);
+			for (std::uint32_t y = 0; y < height; ++y)
+			{
+				std::uint8_t const* row0 = aData.pixels.data() + std::size_t(2*y) * aData.width * channels;
+				std::uint8_t const* row1 = row0 + std::size_t(aData.width) * channels;
+				for (std::uint32_t x = 0; x < width; ++x)
+				{
+					for (std::uint32_t c = 0; c < channels; ++c)
+					{
+						unsigned const sum = row0[2*x*channels+c] + row0[(2*x+1)*channels+c] + row1[2*x*channels+c] + row1[(2*x+1)*channels+c];
+						pixels[(std::size_t(y)*width + x)*channels + c] = std::uint8_t((sum + 2) / 4);
+					}
+				}
+			}
+
+			aData.width = width;
+			aData.height = height;
+			aData.pixels = std::move(pixels);
 		}
 
-		std::memcpy(sptr, data, sizeInBytes);
-		vmaUnmapMemory(aAllocator.allocator, staging.allocation);
+		return dropped;
+	}
 
-		//Free image data
-		stbi_image_free(data);
+	std::uint32_t drop_mip_levels( MipImageData& aData, std::uint32_t aLevels )
+	{
+		assert( !aData.levelOffsets.empty() && aData.levelOffsets.size() == aData.levelSizes.size() );
+
+		auto const drop = std::min<std::size_t>(aLevels, aData.levelOffsets.size() - 1);
+		if (0 == drop)
+			return 0;
+
+		// Offsets are multiples of 16 and stay that way after rebasing.
+		VkDeviceSize const base = aData.levelOffsets[drop];
+		if (!aData.bytes.empty())
+			aData.bytes.erase(aData.bytes.begin(), aData.bytes.begin() + std::ptrdiff_t(base));
+		aData.levelOffsets.erase(aData.levelOffsets.begin(), aData.levelOffsets.begin() + std::ptrdiff_t(drop));
+		aData.levelSizes.erase(aData.levelSizes.begin(), aData.levelSizes.begin() + std::ptrdiff_t(drop));
+		for (auto& offset : aData.levelOffsets)
+			offset -= base;
+
+		aData.width = std::max(1u, aData.width >> drop);
+		aData.height = std::max(1u, aData.height >> drop);
+		return std::uint32_t(drop);
+	}
+
+	std::uint32_t levels_above( std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aMaxExtent )
+	{
+		std::uint32_t ret = 0;
+		for (auto extent = std::max(aWidth, aHeight); extent > std::max(1u, aMaxExtent); extent /= 2)
+			++ret;
+		return ret;
+	}
+
+	std::uint32_t fit_texture_budget( ImageData& aData, VkDeviceSize& aHeadroom )
+	{
+		auto const chain_bytes = [&] (std::uint32_t aLevel) {
+			// A full mip chain is about a third larger than its top level.
+			return (VkDeviceSize(aData.width >> aLevel) * (aData.height >> aLevel) * aData.channels * 4 / 3);
+		};
+
+		std::uint32_t drop = 0;
+		while (chain_bytes(drop) > aHeadroom && std::min(aData.width, aData.height) >> (drop+1) >= kMinBudgetTextureSize)
+			++drop;
+
+		drop = drop_mip_levels(aData, drop);
+		aHeadroom -= std::min(aHeadroom, chain_bytes(0));
+		return drop;
+	}
 
-		//Create image
-		Image ret = create_image_texture2d(aAllocator, baseWidth, baseHeight, aFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT); 
+	std::uint32_t fit_texture_budget( MipImageData& aData, VkDeviceSize& aHeadroom )
+	{
+		assert( !aData.levelOffsets.empty() && aData.levelOffsets.size() == aData.levelSizes.size() );
+
+		auto const chain_bytes = [&] (std::size_t aFirst) {
+			VkDeviceSize ret = 0;
+			for (std::size_t i = aFirst; i < aData.levelSizes.size(); ++i)
+				ret += aData.levelSizes[i];
+			return ret;
+		};
+
+		std::uint32_t drop = 0;
+		while (drop+1 < aData.levelSizes.size() && chain_bytes(drop) > aHeadroom && std::min(aData.width, aData.height) >> (drop+1) >= kMinBudgetTextureSize)
+			++drop;
+
+		drop = drop_mip_levels(aData, drop);
+		aHeadroom -= std::min(aHeadroom, chain_bytes(0));
+		return drop;
+	}
 
-		//Create command buffer for data upload and begin recording
-		VkCommandBuffer cbuff = alloc_command_buffer(aContext, aCmdPool);
+	std::vector<Image> upload_image_textures2d( VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, ImageData const* aImages, VkFormat const* aFormats, std::size_t aCount, VkDeviceSize aStagingBudget, MipDownsampler* aMips )
+	{
+		return upload_images_(aContext, aCmdPool, aAllocator, nullptr, aImages, aFormats, aCount, aStagingBudget, aMips);
+	}
+	std::vector<Image> upload_image_textures2d( VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, StagingRing& aStaging, ImageData const* aImages, VkFormat const* aFormats, std::size_t aCount, MipDownsampler* aMips )
+	{
+		return upload_images_(aContext, aCmdPool, aAllocator, &aStaging, aImages, aFormats, aCount, aStaging.capacity(), aMips);
+	}
 
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr;
+	std::vector<Image> upload_mip_textures2d( VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, MipImageData const* aImages, std::size_t aCount, VkDeviceSize aStagingBudget )
+	{
+		return upload_mips_(aContext, aCmdPool, aAllocator, nullptr, aImages, aCount, aStagingBudget);
+	}
+	std::vector<Image> upload_mip_textures2d( VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, StagingRing& aStaging, MipImageData const* aImages, std::size_t aCount )
+	{
+		return upload_mips_(aContext, aCmdPool, aAllocator, &aStaging, aImages, aCount, aStaging.capacity());
+	}
 
-		if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+	Image load_image_texture2d( char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat, StagingRing* aStaging )
+	{
+		if (is_texture_file(aPath))
 		{
-			throw Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str());
+			auto mips = load_texture_file(aPath);
+			fit_texture_format(aContext, mips, aPath);
+			auto images = aStaging
+				? upload_mip_textures2d(aContext, aCmdPool, aAllocator, *aStaging, &mips, 1)
+				: upload_mip_textures2d(aContext, aCmdPool, aAllocator, &mips, 1);
+			return std::move(images.front());
 		}
 
+		auto const data = decode_image(aPath, 4 /*want 4 channels = RGBA*/);
+		auto images = aStaging
+			? upload_image_textures2d(aContext, aCmdPool, aAllocator, *aStaging, &data, &aFormat, 1)
+			: upload_image_textures2d(aContext, aCmdPool, aAllocator, &data, &aFormat, 1);
+		return std::move(images.front());
+	}
+
+	Image load_single_chanel_image_texture2d(char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat, StagingRing* aStaging)
+	{
+		if (is_texture_file(aPath))
+			return load_image_texture2d(aPath, aContext, aCmdPool, aAllocator, aFormat, aStaging);
+
+		auto const data = decode_image(aPath, 1 /*want 1 channel = R*/);
+		auto images = aStaging
+			? upload_image_textures2d(aContext, aCmdPool, aAllocator, *aStaging, &data, &aFormat, 1)
+			: upload_image_textures2d(aContext, aCmdPool, aAllocator, &data, &aFormat, 1);
+		return std::move(images.front());
+	}
+
+
+	void record_texture_copy( VkCommandBuffer aCmdBuff, VkBuffer aStaging, VkDeviceSize aOffset, VkImage aImage, std::uint32_t aWidth, std::uint32_t aHeight )
+	{
 		// Transition whole image layout
 		// When copying data to the image, the images layout must be
 		// TRANSFER_DST_OPTIMAL. The current image layout is UNDEFINED (which is
 		// the initial layout the image was created in).
-		auto const mipLevels = compute_mip_level_count(baseWidth, baseHeight);
+		auto const mipLevels = compute_mip_level_count(aWidth, aHeight);
 
-		image_barrier(cbuff, ret.image, 0,
+		image_barrier(aCmdBuff, aImage, 0,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -153,17 +553,22 @@ namespace labutils
 
 		//Upload data from staging buffer to image
 		VkBufferImageCopy copy;
-		copy.bufferOffset = 0;
+		copy.bufferOffset = aOffset;
 		copy.bufferRowLength = 0;
 		copy.bufferImageHeight = 0;
 		copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
 		copy.imageOffset = VkOffset3D{ 0,0,0 };
-		copy.imageExtent = VkExtent3D{ baseWidth, baseHeight, 1 };
+		copy.imageExtent = VkExtent3D{ aWidth, aHeight, 1 };
 
-		vkCmdCopyBufferToImage(cbuff, staging.buffer, ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+		vkCmdCopyBufferToImage(aCmdBuff, aStaging, aImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+	}
+
+	void record_texture_mips( VkCommandBuffer aCmdBuff, VkImage aImage, std::uint32_t aWidth, std::uint32_t aHeight )
+	{
+		auto const mipLevels = compute_mip_level_count(aWidth, aHeight);
 
 		// Transition base level to TRANSFER_SRC_OPTIMAL
-		image_barrier(cbuff, ret.image,
+		image_barrier(aCmdBuff, aImage,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_ACCESS_TRANSFER_READ_BIT,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -174,7 +579,7 @@ namespace labutils
 		);
 
 		//Process all mipmap levels
-		uint32_t width = baseWidth, height = baseHeight;
+		uint32_t width = aWidth, height = aHeight;
 
 		for (std::uint32_t level = 1; level < mipLevels; ++level)
 		{
@@ -194,9 +599,9 @@ namespace labutils
 			blit.dstOffsets[0] = { 0,0,0 };
 			blit.dstOffsets[1] = { std::int32_t(width), std::int32_t(height), 1 };
 
-			vkCmdBlitImage(cbuff,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			vkCmdBlitImage(aCmdBuff,
+				aImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				aImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				1, &blit, VK_FILTER_LINEAR
 			);
 
@@ -205,7 +610,7 @@ namespace labutils
 			// transitioning it as well simplifes the final barrier following the
 			// loop).
 
-			image_barrier(cbuff, ret.image,
+			image_barrier(aCmdBuff, aImage,
 				VK_ACCESS_TRANSFER_WRITE_BIT,
 				VK_ACCESS_TRANSFER_READ_BIT,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -218,7 +623,7 @@ namespace labutils
 		// Whole image is currently in the TRANSFER SRC OPTIMAL layout. To use the
 		// image as a texture from which we sample, it must be in the
 		// SHADER READ ONLY OPTIMAL layout.
-		image_barrier(cbuff, ret.image,
+		image_barrier(aCmdBuff, aImage,
 			VK_ACCESS_TRANSFER_READ_BIT,
 			VK_ACCESS_SHADER_READ_BIT,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
@@ -227,101 +632,14 @@ namespace labutils
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 }
 		);
-		//End command recording
-		if (auto const res = vkEndCommandBuffer(cbuff); VK_SUCCESS != res)
-		{
-			throw Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str());
-		}
-
-		// Submit command buffer and wait for commands to complete
-		// Commands must have completed before we can destroy the temporary
-		// resources, such as the staging buffers.
-		Fence uploadComplete = create_fence(aContext);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cbuff;
-
-		if (auto const res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res)
-		{
-			throw Error("Submitting command\n" "vkQueueSubmit() returned %s", to_string(res).c_str());
-		}
-
-		if (auto const res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle,
-			VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
-		{
-			throw Error("waiting for upload to complete\n""vkWaitForFences() returned %s", to_string(res).c_str());
-		}
-		// Return resulting image
-		// Most temporary resources are destroyed automatically through their
-		// destructors. However, the command buffer we must free manually.
-		vkFreeCommandBuffers(aContext.device, aCmdPool, 1, &cbuff);
-
-		return ret;
 	}
 
-	Image load_single_chanel_image_texture2d(char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat)
+	void record_texture_levels_copy( VkCommandBuffer aCmdBuff, VkBuffer aStaging, VkDeviceSize aOffset, VkImage aImage, MipImageData const& aData )
 	{
+		auto const mipLevels = std::uint32_t(aData.levelOffsets.size());
+		assert( aData.levelSizes.size() == mipLevels );
 
-		// Flip images vertically by default.
-		// Vulkan expects the first scanline to be the bottom-most scanline. PNG et
-		// al. instead define the first scanline to be the top-most one.
-
-		stbi_set_flip_vertically_on_load(1);
-
-		//load base image
-		int baseWidthi, baseHeighti, baseChannelsi;
-		stbi_uc* data = stbi_load(aPath, &baseWidthi, &baseHeighti, &baseChannelsi, 1/*want 1 channel = R*/); 
-
-		if (!data)
-		{
-			throw Error("%s : Unable to load texture base image (%s)", aPath, 0, stbi_failure_reason());
-		}
-
-		auto const baseWidth = std::uint32_t(baseWidthi);
-		auto const baseHeight = std::uint32_t(baseHeighti);
-
-		// Create staging buffer and copy image data to it
-		auto const sizeInBytes = baseWidth * baseHeight * 1;
-
-		auto staging = create_buffer(aAllocator, sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-		void* sptr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, staging.allocation, &sptr); VK_SUCCESS != res)
-		{
-			throw Error("Mapping memory for writing\n""vmaMapMemory() returned %s", to_string(res).c_str());
-		}
-
-		std::memcpy(sptr, data, sizeInBytes);
-		vmaUnmapMemory(aAllocator.allocator, staging.allocation);
-
-		//Free image data
-		stbi_image_free(data);
-
-		//Create image
-		Image ret = create_image_texture2d(aAllocator, baseWidth, baseHeight, aFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-
-		//Create command buffer for data upload and begin recording
-		VkCommandBuffer cbuff = alloc_command_buffer(aContext, aCmdPool);
-
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr;
-
-		if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
-		{
-			throw Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str());
-		}
-
-		// Transition whole image layout
-		// When copying data to the image, the images layout must be
-		// TRANSFER_DST_OPTIMAL. The current image layout is UNDEFINED (which is
-		// the initial layout the image was created in).
-		auto const mipLevels = compute_mip_level_count(baseWidth, baseHeight);
-
-		image_barrier(cbuff, ret.image, 0,
+		image_barrier(aCmdBuff, aImage, 0,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -330,124 +648,64 @@ namespace labutils
 			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 }
 		);
 
-		//Upload data from staging buffer to image
-		VkBufferImageCopy copy;
-		copy.bufferOffset = 0;
-		copy.bufferRowLength = 0;
-		copy.bufferImageHeight = 0;
-		copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-		copy.imageOffset = VkOffset3D{ 0,0,0 };
-		copy.imageExtent = VkExtent3D{ baseWidth, baseHeight, 1 };
-
-		vkCmdCopyBufferToImage(cbuff, staging.buffer, ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
-
-		// Transition base level to TRANSFER_SRC_OPTIMAL
-		image_barrier(cbuff, ret.image,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
-		);
-
-		//Process all mipmap levels
-		uint32_t width = baseWidth, height = baseHeight;
-
-		for (std::uint32_t level = 1; level < mipLevels; ++level)
+		// One region per level; rows are tightly packed (texels or blocks)
+		std::vector<VkBufferImageCopy> copies(mipLevels);
+		std::uint32_t width = aData.width, height = aData.height;
+		for (std::uint32_t level = 0; level < mipLevels; ++level)
 		{
-			// Blit previous mipmap level (=level-1) to the current level. Note
-			// that the loop starts at level = 1. Level = 0 is the base level that
-			// we initialied before the loop.
-			VkImageBlit blit{};
-			blit.srcSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
-			blit.srcOffsets[0] = { 0,0,0 };
-			blit.srcOffsets[1] = { std::int32_t(width), std::int32_t(height), 1 };
-
-			//Next mip level
-			width >>= 1; if (width == 0) width = 1;
-			height >>= 1; if (height == 0) height = 1;
-
-			blit.dstSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
-			blit.dstOffsets[0] = { 0,0,0 };
-			blit.dstOffsets[1] = { std::int32_t(width), std::int32_t(height), 1 };
-
-			vkCmdBlitImage(cbuff,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1, &blit, VK_FILTER_LINEAR
-			);
+			auto& copy = copies[level];
+			copy.bufferOffset = aOffset + aData.levelOffsets[level];
+			copy.bufferRowLength = 0;
+			copy.bufferImageHeight = 0;
+			copy.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			copy.imageOffset = VkOffset3D{ 0,0,0 };
+			copy.imageExtent = VkExtent3D{ width, height, 1 };
+
+			width = std::max(width >> 1, 1u);
+			height = std::max(height >> 1, 1u);
+		}
 
-			// Transition mip level to TRANSFER_SRC_OPTIMAL for the next iteration.
-			// (Technically this is unnecessary for the last mip level, but
-			// transitioning it as well simplifes the final barrier following the
-			// loop).
+		vkCmdCopyBufferToImage(aCmdBuff, aStaging, aImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, copies.data());
+	}
 
-			image_barrier(cbuff, ret.image,
-				VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_ACCESS_TRANSFER_READ_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 }
-			);
-		}
-		// Whole image is currently in the TRANSFER SRC OPTIMAL layout. To use the
-		// image as a texture from which we sample, it must be in the
-		// SHADER READ ONLY OPTIMAL layout.
-		image_barrier(cbuff, ret.image,
-			VK_ACCESS_TRANSFER_READ_BIT,
+	void record_texture_ready( VkCommandBuffer aCmdBuff, VkImage aImage, std::uint32_t aLevels )
+	{
+		image_barrier(aCmdBuff, aImage,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_ACCESS_SHADER_READ_BIT,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 }
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, aLevels, 0, 1 }
 		);
-		//End command recording
-		if (auto const res = vkEndCommandBuffer(cbuff); VK_SUCCESS != res)
-		{
-			throw Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str());
-		}
-
-		// Submit command buffer and wait for commands to complete
-		// Commands must have completed before we can destroy the temporary
-		// resources, such as the staging buffers.
-		Fence uploadComplete = create_fence(aContext);
+	}
 
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cbuff;
+	bool supports_sampled_format( VulkanContext const& aContext, VkFormat aFormat )
+	{
+		VkFormatProperties props{};
+		vkGetPhysicalDeviceFormatProperties(aContext.physicalDevice, aFormat, &props);
 
-		if (auto const res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res)
-		{
-			throw Error("Submitting command\n" "vkQueueSubmit() returned %s", to_string(res).c_str());
-		}
+		VkFormatFeatureFlags const needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+		return (props.optimalTilingFeatures & needed) == needed;
+	}
 
-		if (auto const res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle,
-			VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+	void require_sampled_format( VulkanContext const& aContext, VkFormat aFormat, char const* aWhat )
+	{
+		if (!supports_sampled_format(aContext, aFormat))
 		{
-			throw Error("waiting for upload to complete\n""vkWaitForFences() returned %s", to_string(res).c_str());
+			throw Error("%s: the device cannot sample images of VkFormat %d", aWhat, int(aFormat));
 		}
-		// Return resulting image
-		// Most temporary resources are destroyed automatically through their
-		// destructors. However, the command buffer we must free manually.
-		vkFreeCommandBuffers(aContext.device, aCmdPool, 1, &cbuff);
-
-		return ret;
 	}
 
-
-	Image create_image_texture2d( Allocator const& aAllocator, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat aFormat, VkImageUsageFlags aUsage )
+	Image create_image_texture2d( Allocator const& aAllocator, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat aFormat, VkImageUsageFlags aUsage, VkImageCreateFlags aFlags )
 	{
 		//TODO- (Section 4) implement me!
 		auto const mipLevels = compute_mip_level_count(aWidth, aHeight);
 
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.flags = aFlags;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
 		imageInfo.format = aFormat;
 		imageInfo.extent.width = aWidth;
@@ -461,17 +719,57 @@ namespace labutils
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-		VmaAllocationCreateInfo allocInfo{};
-		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		return create_image(aAllocator, imageInfo, EMemoryClass::textures);
+	}
+
+	Image create_image( Allocator const& aAllocator, VkImageCreateInfo const& aImageInfo, EMemoryClass aClass, VmaAllocationCreateFlags aFlags )
+	{
+		VmaAllocationCreateInfo allocInfo = allocation_info(aAllocator, aClass, aFlags);
 
 		VkImage image = VK_NULL_HANDLE;
 		VmaAllocation allocation = VK_NULL_HANDLE;
 
-		if (auto const res = vmaCreateImage(aAllocator.allocator, &imageInfo, &allocInfo, &image, &allocation, nullptr); VK_SUCCESS != res)
+		// As in create_buffer(): only use the pool if its memory type suits
+		// the image.
+		if (VK_NULL_HANDLE != allocInfo.pool)
+		{
+			VmaAllocatorInfo info{};
+			vmaGetAllocatorInfo(aAllocator.allocator, &info);
+
+			if (auto const res = vkCreateImage(info.device, &aImageInfo, nullptr, &image); VK_SUCCESS != res)
+			{
+				throw Error("Unable to create image\n" "vkCreateImage() returned %s", to_string(res).c_str());
+			}
+
+			VkMemoryRequirements memReq{};
+			vkGetImageMemoryRequirements(info.device, image, &memReq);
+
+			allocInfo = allocation_info(aAllocator, aClass, aFlags, memReq.memoryTypeBits);
+			if (VK_NULL_HANDLE != allocInfo.pool && VK_SUCCESS == vmaAllocateMemoryForImage(aAllocator.allocator, image, &allocInfo, &allocation, nullptr))
+			{
+				if (auto const res = vmaBindImageMemory(aAllocator.allocator, allocation, image); VK_SUCCESS != res)
+				{
+					vmaDestroyImage(aAllocator.allocator, image, allocation);
+					throw Error("Unable to bind image memory\n" "vmaBindImageMemory() returned %s", to_string(res).c_str());
+				}
+
+				// Pooled images can be moved (see Defragmenter)
+				track_relocatable(aAllocator.allocator, allocation, image, aImageInfo);
+				tag_allocation(aAllocator.allocator, allocation, aClass);
+				return Image(aAllocator.allocator, image, allocation);
+			}
+
+			vkDestroyImage(info.device, image, nullptr);
+			image = VK_NULL_HANDLE;
+			allocInfo.pool = VK_NULL_HANDLE;
+		}
+
+		if (auto const res = vmaCreateImage(aAllocator.allocator, &aImageInfo, &allocInfo, &image, &allocation, nullptr); VK_SUCCESS != res)
 		{
 			throw Error("Unable to allocate image.\n" "vmaCreateImage() returned %s", to_string(res).c_str());
 		}
 
+		tag_allocation(aAllocator.allocator, allocation, aClass);
 		return Image(aAllocator.allocator, image, allocation);
 	}
 
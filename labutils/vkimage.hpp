@@ -3,14 +3,20 @@
 #include <volk/volk.h>
 #include <vk_mem_alloc.h>
 
+#include <vector>
 #include <utility>
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 #include "allocator.hpp"
 
 namespace labutils
 {
+	class StagingRing; // see staging_ring.hpp
+	class MipDownsampler; // see mip_downsampler.hpp
+
 	class Image
 	{
 		public:
@@ -28,15 +34,126 @@ namespace labutils
 			VkImage image = VK_NULL_HANDLE;
 			VmaAllocation allocation = VK_NULL_HANDLE;
 
+			VmaAllocator allocator() const noexcept; // that owns allocation
+
 		private:
 			VmaAllocator mAllocator = VK_NULL_HANDLE;
 	};
 
 
-	Image load_image_texture2d( char const* aPath, VulkanContext const&, VkCommandPool, Allocator const&, VkFormat = VK_FORMAT_R8G8B8A8_SRGB );
-	Image load_single_chanel_image_texture2d(char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat);
+	// Decoded 8-bit image, with the first scanline at the bottom (as Vulkan
+	// expects it).
+	struct ImageData
+	{
+		std::uint32_t width = 0, height = 0;
+		std::uint32_t channels = 0; // 1 (R) or 4 (RGBA)
+		std::vector<std::uint8_t> pixels; // width*height*channels bytes
+	};
+
+	// Texture with all of its mip levels precomputed, e.g., from a baked
+	// texture file (see texture_file.hpp). The format may be block
+	// compressed. Level i occupies bytes [levelOffsets[i], levelOffsets[i]
+	// + levelSizes[i]); offsets are multiples of 16.
+	struct MipImageData
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		std::uint32_t width = 0, height = 0; // of level 0
+		std::vector<VkDeviceSize> levelOffsets, levelSizes;
+		std::vector<std::uint8_t> bytes;
+	};
+
+	// Loads aPath with aChannels (1 or 4) channels, with the first decoder
+	// that can (see image_decoder.hpp). Only touches the CPU, and may be
+	// called from several threads at once.
+	ImageData decode_image( char const* aPath, std::uint32_t aChannels );
+
+	// Packs the first channel of aRedPath into R and that of aGreenPath into
+	// G of an RGBA image (B = 0, A = 255). Either path may be null, which
+	// leaves its channel at 0; both images must have the same size. For the
+	// separate roughness and metalness textures of older baked files. Like
+	// decode_image(), only touches the CPU.
+	ImageData decode_packed_image( char const* aRedPath, char const* aGreenPath );
+
+	// True if no pixel's alpha is below 255; false for one channel.
+	bool is_opaque( ImageData const& );
+
+	// Drop the top aLevels mip levels, so that level aLevels becomes level 0.
+	// Decoded images are downsampled with a 2x2 box filter (odd trailing
+	// rows and columns are discarded) and keep at least one texel per side;
+	// baked ones keep at least their last level (those without bytes, such
+	// as map_texture_file()'s index, only have the index rebased). Return
+	// the number of levels dropped. levels_above() is the number of levels
+	// to drop so that neither side exceeds aMaxExtent.
+	std::uint32_t drop_mip_levels( ImageData&, std::uint32_t aLevels );
+	std::uint32_t drop_mip_levels( MipImageData&, std::uint32_t aLevels );
+	std::uint32_t levels_above( std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aMaxExtent );
+
+	// Near the GPU memory budget, textures lose their top mip levels rather
+	// than fail to allocate. fit_texture_budget() drops levels of aData until
+	// its whole mip chain fits into aHeadroom bytes (see device_headroom()),
+	// but keeps at least kMinBudgetTextureSize texels along the shorter side;
+	// then subtracts the remaining size from aHeadroom. Returns the number of
+	// levels dropped.
+	constexpr std::uint32_t kMinBudgetTextureSize = 64;
+	std::uint32_t fit_texture_budget( ImageData&, VkDeviceSize& aHeadroom );
+	std::uint32_t fit_texture_budget( MipImageData&, VkDeviceSize& aHeadroom );
+
+	// Creates one mipmapped texture per image, with aFormats[i], and uploads
+	// it; the textures end up in SHADER_READ_ONLY_OPTIMAL. The copies and mip
+	// blits of all images that fit into aStagingBudget bytes of staging
+	// memory are recorded into a single command buffer, so that there is one
+	// submission per batch rather than per image. Returns once all batches
+	// have completed.
+	//
+	// With aMips, the levels of images whose format it supports are written
+	// by its single dispatch per image rather than blitted; those images
+	// also get STORAGE usage (and MUTABLE_FORMAT if sRGB). aMips is reset()
+	// before returning.
+	std::vector<Image> upload_image_textures2d( VulkanContext const&, VkCommandPool, Allocator const&, ImageData const* aImages, VkFormat const* aFormats, std::size_t aCount, VkDeviceSize aStagingBudget = VkDeviceSize(512) << 20, MipDownsampler* aMips = nullptr );
+	// Stages through aStaging, with batches of up to its capacity. (Images
+	// that are larger still get a temporary staging buffer.)
+	std::vector<Image> upload_image_textures2d( VulkanContext const&, VkCommandPool, Allocator const&, StagingRing& aStaging, ImageData const* aImages, VkFormat const* aFormats, std::size_t aCount, MipDownsampler* aMips = nullptr );
+
+	// As above, but all levels are copied as they are; there are no blits.
+	// Throws labutils::Error if the device cannot sample an image's format.
+	std::vector<Image> upload_mip_textures2d( VulkanContext const&, VkCommandPool, Allocator const&, MipImageData const* aImages, std::size_t aCount, VkDeviceSize aStagingBudget = VkDeviceSize(512) << 20 );
+	std::vector<Image> upload_mip_textures2d( VulkanContext const&, VkCommandPool, Allocator const&, StagingRing& aStaging, MipImageData const* aImages, std::size_t aCount );
+
+	// The two halves of a texture upload, for when they run on different
+	// queues (see AsyncUploader). record_texture_copy() moves all levels of
+	// aImage to TRANSFER_DST_OPTIMAL and copies the base level from aStaging;
+	// it works on transfer-only queues. record_texture_mips() then blits the
+	// remaining levels, which needs a graphics queue, and leaves all levels
+	// in SHADER_READ_ONLY_OPTIMAL.
+	void record_texture_copy( VkCommandBuffer, VkBuffer aStaging, VkDeviceSize aOffset, VkImage, std::uint32_t aWidth, std::uint32_t aHeight );
+	void record_texture_mips( VkCommandBuffer, VkImage, std::uint32_t aWidth, std::uint32_t aHeight );
+
+	// Same split for precomputed levels: record_texture_levels_copy() copies
+	// all of aData's levels, staged at aOffset, with one
+	// vkCmdCopyBufferToImage(), and leaves them in TRANSFER_DST_OPTIMAL;
+	// record_texture_ready() moves them to SHADER_READ_ONLY_OPTIMAL.
+	void record_texture_levels_copy( VkCommandBuffer, VkBuffer aStaging, VkDeviceSize aOffset, VkImage, MipImageData const& aData );
+	void record_texture_ready( VkCommandBuffer, VkImage, std::uint32_t aLevels );
+
+	// True if the device can sample (with linear filtering) and upload to
+	// aFormat. require_sampled_format() throws labutils::Error if it can't;
+	// aWhat names the texture in the message.
+	bool supports_sampled_format( VulkanContext const&, VkFormat );
+	void require_sampled_format( VulkanContext const&, VkFormat, char const* aWhat );
+
+	// Baked texture files (see texture_file.hpp) are uploaded with their
+	// precomputed levels and format, and aFormat is ignored; other images
+	// are decoded and get their mip chain blitted on the GPU.
+	// Stages through aStaging if given.
+	Image load_image_texture2d( char const* aPath, VulkanContext const&, VkCommandPool, Allocator const&, VkFormat = VK_FORMAT_R8G8B8A8_SRGB, StagingRing* aStaging = nullptr );
+	Image load_single_chanel_image_texture2d(char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat, StagingRing* aStaging = nullptr);
+
+	// TRANSFER_SRC lets the Defragmenter move the image (see defragmenter.hpp).
+	Image create_image_texture2d( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VkImageCreateFlags = 0 );
 
-	Image create_image_texture2d( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
+	// Allocates from aClass's pool if its memory type suits the image (see
+	// create_buffer()), and from VMA's default pools otherwise.
+	Image create_image( Allocator const&, VkImageCreateInfo const&, EMemoryClass, VmaAllocationCreateFlags = 0 );
 
 	std::uint32_t compute_mip_level_count( std::uint32_t aWidth, std::uint32_t aHeight );
 }
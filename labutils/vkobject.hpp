@@ -93,9 +93,11 @@ namespace labutils
 
 	using DescriptorPool = UniqueHandle< VkDescriptorPool, VkDevice, vkDestroyDescriptorPool >;
 	using DescriptorSetLayout = UniqueHandle< VkDescriptorSetLayout, VkDevice, vkDestroyDescriptorSetLayout >;
+	using DescriptorUpdateTemplate = UniqueHandle< VkDescriptorUpdateTemplate, VkDevice, vkDestroyDescriptorUpdateTemplate >;
 
 	using Pipeline = UniqueHandle< VkPipeline, VkDevice, vkDestroyPipeline >;
 	using PipelineLayout = UniqueHandle< VkPipelineLayout, VkDevice, vkDestroyPipelineLayout >;
+	using PipelineCache = UniqueHandle< VkPipelineCache, VkDevice, vkDestroyPipelineCache >;
 
 	using ShaderModule = UniqueHandle< VkShaderModule, VkDevice, vkDestroyShaderModule >;
 
@@ -106,6 +108,12 @@ namespace labutils
 
 	using ImageView = UniqueHandle< VkImageView, VkDevice, vkDestroyImageView >;
 	using Sampler = UniqueHandle< VkSampler, VkDevice, vkDestroySampler >;
+
+	using QueryPool = UniqueHandle< VkQueryPool, VkDevice, vkDestroyQueryPool >;
+
+	// VK_KHR_acceleration_structure; the structure's storage is a separate
+	// buffer, which must outlive it
+	using AccelerationStructure = UniqueHandle< VkAccelerationStructureKHR, VkDevice, vkDestroyAccelerationStructureKHR >;
 }
 
 #include "vkobject.inl"
@@ -4,9 +4,60 @@
 
 #include <cstdio>
 #include <cassert>
+#include <cstring>
 
 #include "error.hpp"
 #include "to_string.hpp"
+#include "object_cache.hpp"
+
+namespace
+{
+	// Header of a pipeline cache file, followed by the cache data.
+	struct PipelineCacheFileHeader_
+	{
+		char magic[8];
+		std::uint32_t vendorID;
+		std::uint32_t deviceID;
+		std::uint32_t driverVersion;
+		std::uint8_t cacheUUID[VK_UUID_SIZE];
+		std::uint64_t dataSize;
+	};
+
+	constexpr char kPipelineCacheMagic_[8] = { 'L', 'U', 'T', 'P', 'C', 'A', 'C', '1' };
+
+	bool is_depth_format_( VkFormat );
+
+	VkAttachmentReference2 convert_reference_( VkAttachmentReference const&, VkAttachmentDescription const* aAttachments, bool aInput );
+
+	PipelineCacheFileHeader_ make_pipeline_cache_header_( VkPhysicalDevice aPhysicalDev )
+	{
+		VkPhysicalDeviceProperties props{};
+		vkGetPhysicalDeviceProperties( aPhysicalDev, &props );
+
+		PipelineCacheFileHeader_ ret{};
+		std::memcpy( ret.magic, kPipelineCacheMagic_, sizeof(ret.magic) );
+		ret.vendorID = props.vendorID;
+		ret.deviceID = props.deviceID;
+		ret.driverVersion = props.driverVersion;
+		std::memcpy( ret.cacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE );
+		return ret;
+	}
+
+	// Bytes left in aFile after its current position, which is kept; 0 if
+	// that can't be told
+	std::uint64_t remaining_bytes_( std::FILE* aFile )
+	{
+		long const pos = std::ftell( aFile );
+		if( pos < 0 || 0 != std::fseek( aFile, 0, SEEK_END ) )
+			return 0;
+
+		long const end = std::ftell( aFile );
+		if( 0 != std::fseek( aFile, pos, SEEK_SET ) || end < pos )
+			return 0;
+
+		return std::uint64_t(end - pos);
+	}
+}
 
 namespace labutils
 {
@@ -40,28 +91,111 @@ namespace labutils
 
 			std::fclose(fin);
 
-			VkShaderModuleCreateInfo moduleInfo{};
-			moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			moduleInfo.codeSize = bytes;
-			moduleInfo.pCode = code.data();
+			return create_shader_module(aContext, code.data(), words, aSpirvPath);
+		}
+		throw Error("Cannot open '%s' for reading", aSpirvPath);
+	}
+
+	ShaderModule create_shader_module( VulkanContext const& aContext, std::uint32_t const* aCode, std::size_t aWords, char const* aName )
+	{
+		assert( aCode && aName );
+
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = aWords * sizeof(std::uint32_t);
+		moduleInfo.pCode = aCode;
+
+		VkShaderModule smode = VK_NULL_HANDLE;
+		if( auto const res = vkCreateShaderModule( aContext.device, &moduleInfo, nullptr, &smode ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create shader module from %s\n" "vkCreateShaderModule() returned %s", aName, to_string(res).c_str() );
+		}
+
+		return ShaderModule( aContext.device, smode );
+	}
+
+	PipelineCache load_pipeline_cache( VulkanContext const& aContext, char const* aPath )
+	{
+		assert( aPath );
 
-			VkShaderModule smode = VK_NULL_HANDLE;
-			if (auto const res = vkCreateShaderModule(aContext.device, &moduleInfo, nullptr, &smode); VK_SUCCESS != res)
+		auto const expected = make_pipeline_cache_header_( aContext.physicalDevice );
+
+		// Any problem with the file just means starting with an empty cache
+		std::vector<std::uint8_t> data;
+		if( std::FILE* fin = std::fopen( aPath, "rb" ) )
+		{
+			PipelineCacheFileHeader_ header{};
+			bool const match = 1 == std::fread( &header, sizeof(header), 1, fin )
+				&& 0 == std::memcmp( header.magic, expected.magic, sizeof(header.magic) )
+				&& header.vendorID == expected.vendorID
+				&& header.deviceID == expected.deviceID
+				&& header.driverVersion == expected.driverVersion
+				&& 0 == std::memcmp( header.cacheUUID, expected.cacheUUID, VK_UUID_SIZE );
+
+			// A corrupt size could ask for more than can be allocated
+			if( match && header.dataSize <= remaining_bytes_( fin ) )
 			{
-				throw Error("Unable to create shader module from %s\n" "vkCreateShaderModule() returned %s", aSpirvPath, to_string(res).c_str());
+				data.resize( std::size_t(header.dataSize) );
+				if( !data.empty() && 1 != std::fread( data.data(), data.size(), 1, fin ) )
+					data.clear();
 			}
 
-			return ShaderModule(aContext.device, smode);
+			std::fclose( fin );
 		}
-		throw Error("Cannot open '%s' for reading", aSpirvPath);
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		VkPipelineCache cache = VK_NULL_HANDLE;
+		if( auto const res = vkCreatePipelineCache( aContext.device, &cacheInfo, nullptr, &cache ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to create pipeline cache\n" "vkCreatePipelineCache() returned %s", to_string(res).c_str() );
+		}
+
+		return PipelineCache( aContext.device, cache );
+	}
+
+	bool save_pipeline_cache( VulkanContext const& aContext, VkPipelineCache aCache, char const* aPath )
+	{
+		assert( aPath );
+
+		std::size_t size = 0;
+		if( auto const res = vkGetPipelineCacheData( aContext.device, aCache, &size, nullptr ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to query pipeline cache size\n" "vkGetPipelineCacheData() returned %s", to_string(res).c_str() );
+		}
+
+		std::vector<std::uint8_t> data( size );
+		if( auto const res = vkGetPipelineCacheData( aContext.device, aCache, &size, data.data() ); VK_SUCCESS != res )
+		{
+			throw Error( "Unable to get pipeline cache data\n" "vkGetPipelineCacheData() returned %s", to_string(res).c_str() );
+		}
+
+		auto header = make_pipeline_cache_header_( aContext.physicalDevice );
+		header.dataSize = size;
+
+		std::FILE* fout = std::fopen( aPath, "wb" );
+		if( !fout )
+			return false;
+
+		bool const ok = 1 == std::fwrite( &header, sizeof(header), 1, fout )
+			&& (0 == size || 1 == std::fwrite( data.data(), size, 1, fout ));
+
+		return 0 == std::fclose( fout ) && ok;
 	}
 
 
 	CommandPool create_command_pool( VulkanContext const& aContext, VkCommandPoolCreateFlags aFlags )
+	{
+		return create_command_pool(aContext, aFlags, aContext.graphicsFamilyIndex);
+	}
+	CommandPool create_command_pool( VulkanContext const& aContext, VkCommandPoolCreateFlags aFlags, std::uint32_t aQueueFamily )
 	{
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.queueFamilyIndex = aContext.graphicsFamilyIndex;
+		poolInfo.queueFamilyIndex = aQueueFamily;
 		poolInfo.flags = aFlags;
 
 		VkCommandPool pool = VK_NULL_HANDLE;
@@ -74,12 +208,12 @@ namespace labutils
 
 	}
 
-	VkCommandBuffer alloc_command_buffer( VulkanContext const& aContext, VkCommandPool aCmdPool )
+	VkCommandBuffer alloc_command_buffer( VulkanContext const& aContext, VkCommandPool aCmdPool, VkCommandBufferLevel aLevel )
 	{
 		VkCommandBufferAllocateInfo cbufInfo{};
 		cbufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		cbufInfo.commandPool = aCmdPool;
-		cbufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbufInfo.level = aLevel;
 		cbufInfo.commandBufferCount = 1;
 
 		VkCommandBuffer cbuff = VK_NULL_HANDLE;
@@ -143,7 +277,11 @@ namespace labutils
 	{
 		VkDescriptorPoolSize const pools[] = {
 			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, aMaxDescriptors},
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, aMaxDescriptors}
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, aMaxDescriptors},
+			{VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, aMaxDescriptors}
 		};
 
 		VkDescriptorPoolCreateInfo poolInfo{};
@@ -220,7 +358,7 @@ namespace labutils
 
 	}
 
-	Sampler create_default_sampler(VulkanContext const& aContext)
+	VkSamplerCreateInfo default_sampler_info(VulkanContext const& aContext)
 	{
 		VkPhysicalDeviceProperties props{};
 		vkGetPhysicalDeviceProperties(aContext.physicalDevice, &props);
@@ -240,6 +378,13 @@ namespace labutils
 
 		//fprintf(stderr, "creating default sampler, the max sampler anisotropy is %f\n", props.limits.maxSamplerAnisotropy);// print value
 
+		return sampInfo;
+	}
+
+	Sampler create_default_sampler(VulkanContext const& aContext)
+	{
+		VkSamplerCreateInfo const sampInfo = default_sampler_info(aContext);
+
 		VkSampler sampler = VK_NULL_HANDLE;
 		if (auto const res = vkCreateSampler(aContext.device, &sampInfo, nullptr, &sampler); VK_SUCCESS != res)
 		{
@@ -250,6 +395,145 @@ namespace labutils
 
 	}
 
+	VkSampler create_default_sampler(VulkanContext const& aContext, SamplerCache& aCache)
+	{
+		return aCache.get(default_sampler_info(aContext));
+	}
+
+	RenderPass create_render_pass2( VulkanContext const& aContext, VkRenderPassCreateInfo const& aPassInfo, std::uint32_t aSubpass, void const* aSubpassNext, VkAttachmentDescription2 const* aExtraAttachment )
+	{
+		assert( aSubpass < aPassInfo.subpassCount );
 
+		std::vector<VkAttachmentDescription2> attachments( aPassInfo.attachmentCount );
+		for( std::uint32_t i = 0; i < aPassInfo.attachmentCount; ++i )
+		{
+			auto const& src = aPassInfo.pAttachments[i];
+
+			auto& dst = attachments[i];
+			dst.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+			dst.flags = src.flags;
+			dst.format = src.format;
+			dst.samples = src.samples;
+			dst.loadOp = src.loadOp;
+			dst.storeOp = src.storeOp;
+			dst.stencilLoadOp = src.stencilLoadOp;
+			dst.stencilStoreOp = src.stencilStoreOp;
+			dst.initialLayout = src.initialLayout;
+			dst.finalLayout = src.finalLayout;
+		}
 
+		if( aExtraAttachment )
+			attachments.emplace_back( *aExtraAttachment );
+
+		// Subpasses; the references are stored per subpass, in order input,
+		// colour, resolve, depth
+		std::vector<std::vector<VkAttachmentReference2>> refs( aPassInfo.subpassCount );
+		std::vector<VkSubpassDescription2> subpasses( aPassInfo.subpassCount );
+		for( std::uint32_t i = 0; i < aPassInfo.subpassCount; ++i )
+		{
+			auto const& src = aPassInfo.pSubpasses[i];
+
+			auto& subpassRefs = refs[i];
+			for( std::uint32_t j = 0; j < src.inputAttachmentCount; ++j )
+				subpassRefs.emplace_back( convert_reference_( src.pInputAttachments[j], aPassInfo.pAttachments, true ) );
+			for( std::uint32_t j = 0; j < src.colorAttachmentCount; ++j )
+				subpassRefs.emplace_back( convert_reference_( src.pColorAttachments[j], aPassInfo.pAttachments, false ) );
+			if( src.pResolveAttachments )
+			{
+				for( std::uint32_t j = 0; j < src.colorAttachmentCount; ++j )
+					subpassRefs.emplace_back( convert_reference_( src.pResolveAttachments[j], aPassInfo.pAttachments, false ) );
+			}
+			if( src.pDepthStencilAttachment )
+				subpassRefs.emplace_back( convert_reference_( *src.pDepthStencilAttachment, aPassInfo.pAttachments, false ) );
+
+			VkAttachmentReference2 const* next = subpassRefs.data();
+			auto const take_ = [&next] (std::uint32_t aCount) {
+				auto const* ret = aCount ? next : nullptr;
+				next += aCount;
+				return ret;
+			};
+
+			auto& dst = subpasses[i];
+			dst.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+			dst.pNext = aSubpass == i ? aSubpassNext : nullptr;
+			dst.flags = src.flags;
+			dst.pipelineBindPoint = src.pipelineBindPoint;
+			dst.inputAttachmentCount = src.inputAttachmentCount;
+			dst.pInputAttachments = take_( src.inputAttachmentCount );
+			dst.colorAttachmentCount = src.colorAttachmentCount;
+			dst.pColorAttachments = take_( src.colorAttachmentCount );
+			dst.pResolveAttachments = take_( src.pResolveAttachments ? src.colorAttachmentCount : 0 );
+			dst.pDepthStencilAttachment = take_( src.pDepthStencilAttachment ? 1 : 0 );
+			dst.preserveAttachmentCount = src.preserveAttachmentCount;
+			dst.pPreserveAttachments = src.pPreserveAttachments;
+		}
+
+		std::vector<VkSubpassDependency2> deps( aPassInfo.dependencyCount );
+		for( std::uint32_t i = 0; i < aPassInfo.dependencyCount; ++i )
+		{
+			auto const& src = aPassInfo.pDependencies[i];
+
+			auto& dst = deps[i];
+			dst.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+			dst.srcSubpass = src.srcSubpass;
+			dst.dstSubpass = src.dstSubpass;
+			dst.srcStageMask = src.srcStageMask;
+			dst.dstStageMask = src.dstStageMask;
+			dst.srcAccessMask = src.srcAccessMask;
+			dst.dstAccessMask = src.dstAccessMask;
+			dst.dependencyFlags = src.dependencyFlags;
+		}
+
+		VkRenderPassCreateInfo2 passInfo{};
+		passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+		passInfo.attachmentCount = std::uint32_t(attachments.size());
+		passInfo.pAttachments = attachments.data();
+		passInfo.subpassCount = std::uint32_t(subpasses.size());
+		passInfo.pSubpasses = subpasses.data();
+		passInfo.dependencyCount = std::uint32_t(deps.size());
+		passInfo.pDependencies = deps.empty() ? nullptr : deps.data();
+
+		VkRenderPass rpass = VK_NULL_HANDLE;
+		if( auto const res = vkCreateRenderPass2( aContext.device, &passInfo, nullptr, &rpass ); VK_SUCCESS != res )
+			throw Error( "Unable to create render pass\n" "vkCreateRenderPass2() returned %s", to_string(res).c_str() );
+
+		return RenderPass( aContext.device, rpass );
+	}
+
+
+
+}
+
+namespace
+{
+	bool is_depth_format_( VkFormat aFormat )
+	{
+		switch( aFormat )
+		{
+			case VK_FORMAT_D16_UNORM: [[fallthrough]];
+			case VK_FORMAT_X8_D24_UNORM_PACK32: [[fallthrough]];
+			case VK_FORMAT_D32_SFLOAT: [[fallthrough]];
+			case VK_FORMAT_D16_UNORM_S8_UINT: [[fallthrough]];
+			case VK_FORMAT_D24_UNORM_S8_UINT: [[fallthrough]];
+			case VK_FORMAT_D32_SFLOAT_S8_UINT:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	VkAttachmentReference2 convert_reference_( VkAttachmentReference const& aRef, VkAttachmentDescription const* aAttachments, bool aInput )
+	{
+		VkAttachmentReference2 ret{};
+		ret.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+		ret.attachment = aRef.attachment;
+		ret.layout = aRef.layout;
+
+		// Only input attachments need the aspect (implied by
+		// VkAttachmentReference)
+		if( aInput && VK_ATTACHMENT_UNUSED != aRef.attachment )
+			ret.aspectMask = is_depth_format_( aAttachments[aRef.attachment].format ) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+
+		return ret;
+	}
 }
@@ -9,10 +9,24 @@
 
 namespace labutils
 {
+	class SamplerCache; // see object_cache.hpp
+
 	ShaderModule load_shader_module( VulkanContext const&, char const* aSpirvPath );
+	// From SPIR-V in memory (e.g., embedded in the executable); aName is for
+	// the error message only
+	ShaderModule create_shader_module( VulkanContext const&, std::uint32_t const* aCode, std::size_t aWords, char const* aName );
+
+	// Pipeline cache persisted in aPath. The file records the vendor, device
+	// and driver version and the pipeline cache UUID of the physical device
+	// it was saved from; if any of these differ, or the file is missing or
+	// damaged, an empty cache is created instead.
+	PipelineCache load_pipeline_cache( VulkanContext const&, char const* aPath );
+	// Returns false if aPath cannot be written.
+	bool save_pipeline_cache( VulkanContext const&, VkPipelineCache, char const* aPath );
 
 	CommandPool create_command_pool( VulkanContext const&, VkCommandPoolCreateFlags = 0 );
-	VkCommandBuffer alloc_command_buffer( VulkanContext const&, VkCommandPool );
+	CommandPool create_command_pool( VulkanContext const&, VkCommandPoolCreateFlags, std::uint32_t aQueueFamily ); // e.g., computeFamilyIndex
+	VkCommandBuffer alloc_command_buffer( VulkanContext const&, VkCommandPool, VkCommandBufferLevel = VK_COMMAND_BUFFER_LEVEL_PRIMARY );
 
 	Fence create_fence( VulkanContext const&, VkFenceCreateFlags = 0 );
 	Semaphore create_semaphore( VulkanContext const& );
@@ -50,7 +64,19 @@ namespace labutils
 		uint32_t aDstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
 	);
 
+	// Linear filtering with mipmaps, repeat, maximum anisotropy. The
+	// SamplerCache overload returns the cache's sampler (see
+	// object_cache.hpp), so all users share one.
+	VkSamplerCreateInfo default_sampler_info(VulkanContext const&);
 	Sampler create_default_sampler(VulkanContext const&);
+	VkSampler create_default_sampler(VulkanContext const&, SamplerCache&);
+
+	// aPassInfo as VkRenderPassCreateInfo2, for the render pass features
+	// that need it: aSubpassNext is chained into the description of subpass
+	// aSubpass (e.g., a VkSubpassDescriptionDepthStencilResolve), and
+	// aExtraAttachment, if any, is appended as the last attachment. Throws
+	// labutils::Error if the render pass can't be created.
+	RenderPass create_render_pass2( VulkanContext const&, VkRenderPassCreateInfo const& aPassInfo, std::uint32_t aSubpass, void const* aSubpassNext, VkAttachmentDescription2 const* aExtraAttachment = nullptr );
 
 
 }
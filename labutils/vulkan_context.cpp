@@ -49,8 +49,20 @@ namespace labutils
 		: instance( std::exchange( aOther.instance, VK_NULL_HANDLE ) )
 		, physicalDevice( std::exchange( aOther.physicalDevice, VK_NULL_HANDLE ) )
 		, device( std::exchange( aOther.device, VK_NULL_HANDLE ) )
+		, caps( aOther.caps )
 		, graphicsFamilyIndex( aOther.graphicsFamilyIndex )
 		, graphicsQueue( std::exchange( aOther.graphicsQueue, VK_NULL_HANDLE ) )
+		, transferFamilyIndex( aOther.transferFamilyIndex )
+		, transferQueue( std::exchange( aOther.transferQueue, VK_NULL_HANDLE ) )
+		, computeFamilyIndex( aOther.computeFamilyIndex )
+		, computeQueue( std::exchange( aOther.computeQueue, VK_NULL_HANDLE ) )
+		, deviceCount( aOther.deviceCount )
+		, haveFragmentShadingRate( aOther.haveFragmentShadingRate )
+		, haveMemoryBudget( aOther.haveMemoryBudget )
+		, haveTimelineSemaphore( aOther.haveTimelineSemaphore )
+		, havePipelineStatistics( aOther.havePipelineStatistics )
+		, havePresentWait( aOther.havePresentWait )
+		, haveDebugUtils( aOther.haveDebugUtils )
 		, debugMessenger( std::exchange( aOther.debugMessenger, VK_NULL_HANDLE ) )
 	{}
 
@@ -70,8 +82,20 @@ namespace labutils
 		std::swap( instance, aOther.instance );
 		std::swap( physicalDevice, aOther.physicalDevice );
 		std::swap( device, aOther.device );
+		std::swap( caps, aOther.caps );
 		std::swap( graphicsFamilyIndex, aOther.graphicsFamilyIndex );
 		std::swap( graphicsQueue, aOther.graphicsQueue );
+		std::swap( transferFamilyIndex, aOther.transferFamilyIndex );
+		std::swap( transferQueue, aOther.transferQueue );
+		std::swap( computeFamilyIndex, aOther.computeFamilyIndex );
+		std::swap( computeQueue, aOther.computeQueue );
+		std::swap( deviceCount, aOther.deviceCount );
+		std::swap( haveFragmentShadingRate, aOther.haveFragmentShadingRate );
+		std::swap( haveMemoryBudget, aOther.haveMemoryBudget );
+		std::swap( haveTimelineSemaphore, aOther.haveTimelineSemaphore );
+		std::swap( havePipelineStatistics, aOther.havePipelineStatistics );
+		std::swap( havePresentWait, aOther.havePresentWait );
+		std::swap( haveDebugUtils, aOther.haveDebugUtils );
 		std::swap( debugMessenger, aOther.debugMessenger );
 		return *this;
 	}
@@ -103,13 +127,18 @@ namespace labutils
 		{
 			enabledLayers.emplace_back( "VK_LAYER_KHRONOS_validation" );
 		}
+#		endif // ~ debug builds
 
+		// Object names and labels in all builds, for GPU captures; the
+		// messenger in debug builds only
 		if( supportedExtensions.count( "VK_EXT_debug_utils" ) )
 		{
-			enableDebugUtils = true;
+			ret.haveDebugUtils = true;
 			enabledExensions.emplace_back( "VK_EXT_debug_utils" );
+#			if !defined(NDEBUG)
+			enableDebugUtils = true;
+#			endif
 		}
-#		endif // ~ debug builds
 
 		for( auto const& layer : enabledLayers )
 			std::fprintf( stderr, "Enabling layer: %s\n", layer );
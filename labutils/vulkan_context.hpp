@@ -6,6 +6,55 @@
 
 namespace labutils
 {
+	// The optional device features that are enabled, i.e., that the device
+	// supports (see create_device() in vulkan_window.cpp). Renderer paths
+	// check these at runtime, and fall back to something slower without.
+	struct DeviceCapabilities
+	{
+		std::uint32_t apiVersion = 0; // of the physical device
+
+		// Core features
+		bool samplerAnisotropy = false;
+		bool multiDrawIndirect = false;
+		bool drawIndirectFirstInstance = false;
+		bool geometryShader = false;
+		bool fragmentStoresAndAtomics = false;
+		bool pipelineStatisticsQuery = false;
+		bool sparseBinding = false;
+		bool sparseResidencyImage2D = false;
+
+		// Vulkan 1.1
+		bool multiview = false;
+
+		// Subgroup operations (GL_KHR_shader_subgroup_*) available to
+		// compute and fragment shaders; 0 if the stage has none. Shaders
+		// that use them are separate SPIR-V modules, loaded only where the
+		// stage supports their operations.
+		VkSubgroupFeatureFlags subgroupCompute = 0;
+		VkSubgroupFeatureFlags subgroupFragment = 0;
+		std::uint32_t subgroupSize = 0; // default
+
+		// Vulkan 1.2. descriptorIndexing covers what bindless texture arrays
+		// need: runtime arrays, partially bound and variable size bindings,
+		// and non-uniform indexing of sampled images.
+		bool descriptorIndexing = false;
+		bool drawIndirectCount = false;
+		bool shaderFloat16 = false;
+		bool timelineSemaphore = false;
+
+		// Vulkan 1.3 (devices that support it)
+		bool dynamicRendering = false;
+		bool synchronization2 = false;
+
+		// Extensions (with their features)
+		bool fragmentShadingRate = false;
+		bool presentWait = false;
+		bool conditionalRendering = false;
+		bool graphicsPipelineLibrary = false; // and fast linking (see PipelineLinker)
+		bool rayQuery = false; // and VK_KHR_acceleration_structure, with bufferDeviceAddress
+		bool descriptorBuffer = false; // with bufferDeviceAddress (see DescriptorBuffer)
+	};
+
 	class VulkanContext
 	{
 		public:
@@ -25,11 +74,59 @@ namespace labutils
 
 			VkDevice device = VK_NULL_HANDLE;
 
+			// Of the device; make_vulkan_context() leaves these at their
+			// defaults (all false).
+			DeviceCapabilities caps;
+
 			std::uint32_t graphicsFamilyIndex = 0;
 			VkQueue graphicsQueue = VK_NULL_HANDLE;
 
-			
-			//bool haveDebugUtils = false;
+			// Queue of a transfer-only family (no graphics or compute), e.g.
+			// for background uploads; VK_NULL_HANDLE if there is none.
+			// Resources passed between it and graphicsQueue need queue
+			// family ownership transfers.
+			std::uint32_t transferFamilyIndex = 0;
+			VkQueue transferQueue = VK_NULL_HANDLE;
+
+			// Queue of an async compute family (compute, no graphics), for
+			// compute work that overlaps with rendering; VK_NULL_HANDLE if
+			// there is none. As with transferQueue, resources used by both
+			// queues need ownership transfers or concurrent sharing.
+			std::uint32_t computeFamilyIndex = 0;
+			VkQueue computeQueue = VK_NULL_HANDLE;
+
+			// Physical devices that the device spans, i.e., the size of its
+			// device group (see make_vulkan_window()'s aDeviceGroup); 1
+			// without. Device index 0 is physicalDevice. Memory from
+			// multi-instance heaps then has an instance per physical device,
+			// and command buffers run on all of them unless given a device
+			// mask (VkDeviceGroupCommandBufferBeginInfo).
+			std::uint32_t deviceCount = 1;
+
+			// VK_KHR_fragment_shading_rate is enabled, with the
+			// attachmentFragmentShadingRate feature (see create_device()).
+			bool haveFragmentShadingRate = false;
+
+			// VK_EXT_memory_budget is enabled (see create_allocator()).
+			bool haveMemoryBudget = false;
+
+			// The Vulkan 1.2 timelineSemaphore feature is enabled (see
+			// create_device()).
+			bool haveTimelineSemaphore = false;
+
+			// The pipelineStatisticsQuery feature is enabled (see
+			// create_device()).
+			bool havePipelineStatistics = false;
+
+			// VK_KHR_present_id and VK_KHR_present_wait are enabled, with
+			// their presentId and presentWait features (see
+			// create_device()); windows only.
+			bool havePresentWait = false;
+
+			// VK_EXT_debug_utils is enabled, in all builds (see
+			// debug_utils.hpp); debugMessenger is only created in debug
+			// builds.
+			bool haveDebugUtils = false;
 			VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
 	};
 
@@ -2,18 +2,23 @@
 
 #include <tuple>
 #include <limits>
+#include <string>
 #include <vector>
 #include <utility>
 #include <optional>
 #include <algorithm>
 #include <unordered_set>
 
+#include <cctype>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cassert>
 #include <vulkan/vulkan_core.h>
 
 #include "error.hpp"
 #include "to_string.hpp"
+#include "startup_report.hpp"
 #include "context_helpers.hxx"
 namespace lut = labutils;
 
@@ -22,25 +27,66 @@ namespace
 {
 	// The device selection process has changed somewhat w.r.t. the one used 
 	// earlier (e.g., with VulkanContext.
-	VkPhysicalDevice select_device( VkInstance, VkSurfaceKHR );
+	// aOverride is a device name substring or UUID (see
+	// make_vulkan_window()); null or empty picks the best-scoring device.
+	VkPhysicalDevice select_device( VkInstance, VkSurfaceKHR, char const* aOverride );
 	float score_device( VkPhysicalDevice, VkSurfaceKHR );
 
+	// The device override: aDevice, else LUT_DEVICE (or null)
+	char const* device_override( char const* aDevice );
+
+	std::string format_uuid( std::uint8_t const (&aUuid)[VK_UUID_SIZE] );
+	bool matches_device( VkPhysicalDeviceProperties const&, VkPhysicalDeviceIDProperties const&, char const* aOverride );
+
 	std::optional<std::uint32_t> find_queue_family( VkPhysicalDevice, VkQueueFlags, VkSurfaceKHR = VK_NULL_HANDLE );
 
+	// A family that supports transfers, but neither graphics nor compute
+	// (typically a DMA engine).
+	std::optional<std::uint32_t> find_transfer_only_family( VkPhysicalDevice );
+
+	// A family that supports compute, but not graphics
+	std::optional<std::uint32_t> find_async_compute_family( VkPhysicalDevice );
+
+	// The physical devices of aPhysicalDev's device group, aPhysicalDev
+	// first (device index 0); just aPhysicalDev if it is alone in its group
+	std::vector<VkPhysicalDevice> find_device_group( VkInstance, VkPhysicalDevice aPhysicalDev );
+
+	// Whether every device of the group can present the swapchain images it
+	// renders itself (VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR)
+	bool presents_locally( VkDevice, VkSurfaceKHR, std::uint32_t aDeviceCount );
+
+	// Probes the device's features (core, Vulkan 1.1-1.3, and those of the
+	// extensions among aEnabledDeviceExtensions) and enables the ones the
+	// renderer can use that are supported; aCaps receives what was enabled.
+	// VK_KHR_fragment_shading_rate's attachment rates and the presentId and
+	// presentWait features (VK_KHR_present_id and VK_KHR_present_wait, both
+	// needed) are only probed with their extensions. With more than one
+	// device in aGroup (see find_device_group()), the device spans them all.
 	VkDevice create_device( 
 		VkPhysicalDevice,
 		std::vector<std::uint32_t> const& aQueueFamilies,
-		std::vector<char const*> const& aEnabledDeviceExtensions = {}
+		std::vector<char const*> const& aEnabledDeviceExtensions,
+		lut::DeviceCapabilities& aCaps,
+		std::vector<VkPhysicalDevice> const& aGroup = {}
 	);
 
+	// Makes the have* flags of aContext agree with its caps
+	void copy_capability_flags( lut::VulkanContext& aContext );
+
+	// Adds the optional device extensions that the device supports;
+	// aPresentation adds the ones that only matter with a swapchain
+	void add_optional_device_extensions( VkPhysicalDevice, std::vector<char const*>&, bool aPresentation = false );
+	bool has_extension( std::vector<char const*> const&, char const* aName );
+
 	std::vector<VkSurfaceFormatKHR> get_surface_formats( VkPhysicalDevice, VkSurfaceKHR );
 	std::unordered_set<VkPresentModeKHR> get_present_modes( VkPhysicalDevice, VkSurfaceKHR );
 
-	std::tuple<VkSwapchainKHR,VkFormat,VkExtent2D> create_swapchain(
+	std::tuple<VkSwapchainKHR,VkFormat,VkExtent2D,VkPresentModeKHR,VkImageUsageFlags> create_swapchain(
 		VkPhysicalDevice,
 		VkSurfaceKHR,
 		VkDevice,
 		GLFWwindow*,
+		lut::SwapchainConfig const&,
 		std::vector<std::uint32_t> const& aQueueFamilyIndices = {},
 		VkSwapchainKHR aOldSwapchain = VK_NULL_HANDLE
 	);
@@ -61,7 +107,18 @@ namespace labutils
 			vkDestroyImageView( device, view, nullptr );
 
 		if( VK_NULL_HANDLE != swapchain )
+		{
 			vkDestroySwapchainKHR( device, swapchain, nullptr );
+		}
+		else
+		{
+			// Without a swapchain, any images are offscreen ones that we own
+			for( auto const image : swapImages )
+				vkDestroyImage( device, image, nullptr );
+		}
+
+		for( auto const memory : offscreenMemory )
+			vkFreeMemory( device, memory, nullptr );
 
 		// Window and related objects
 		if( VK_NULL_HANDLE != surface )
@@ -92,6 +149,10 @@ namespace labutils
 		, swapViews( std::move( aOther.swapViews ) )
 		, swapchainFormat( aOther.swapchainFormat )
 		, swapchainExtent( aOther.swapchainExtent )
+		, swapchainConfig( aOther.swapchainConfig )
+		, presentMode( aOther.presentMode )
+		, swapchainUsage( aOther.swapchainUsage )
+		, offscreenMemory( std::move( aOther.offscreenMemory ) )
 	{}
 
 	VulkanWindow& VulkanWindow::operator=( VulkanWindow&& aOther ) noexcept
@@ -106,13 +167,18 @@ namespace labutils
 		std::swap( swapViews, aOther.swapViews );
 		std::swap( swapchainFormat, aOther.swapchainFormat );
 		std::swap( swapchainExtent, aOther.swapchainExtent );
+		std::swap( swapchainConfig, aOther.swapchainConfig );
+		std::swap( presentMode, aOther.presentMode );
+		std::swap( swapchainUsage, aOther.swapchainUsage );
+		std::swap( offscreenMemory, aOther.offscreenMemory );
 		return *this;
 	}
 
 	// make_vulkan_window()
-	VulkanWindow make_vulkan_window()
+	VulkanWindow make_vulkan_window( SwapchainConfig const& aSwapchainConfig, char const* aDevice, bool aDeviceGroup )
 	{
 		VulkanWindow ret;
+		ret.swapchainConfig = aSwapchainConfig;
 
 		// Initialize Volk
 		if (auto const res = volkInitialize(); VK_SUCCESS != res)
@@ -174,13 +240,18 @@ namespace labutils
 		{
 			enabledLayers.emplace_back("VK_LAYER_KHRONOS_validation");
 		}
+#		endif // ~ debug builds
 
+		// Object names and labels in all builds, for GPU captures; the
+		// messenger in debug builds only
 		if (supportedExtensions.count("VK_EXT_debug_utils"))
 		{
-			enableDebugUtils = true;
+			ret.haveDebugUtils = true;
 			enabledExensions.emplace_back("VK_EXT_debug_utils");
+#			if !defined(NDEBUG)
+			enableDebugUtils = true;
+#			endif
 		}
-#		endif // ~ debug builds
 
 		for (auto const& layer : enabledLayers)
 			std::fprintf(stderr, "Enabling layer: %s\n", layer);
@@ -189,6 +260,7 @@ namespace labutils
 			std::fprintf(stderr, "Enabling instance extension: %s\n", extension);
 
 		// Create Vulkan instance
+		lut::StartupPhase instancePhase("instance creation");
 		ret.instance = detail::create_instance(enabledLayers, enabledExensions, enableDebugUtils);
 
 		// Load rest of the Vulkan API
@@ -197,9 +269,11 @@ namespace labutils
 		// Setup debug messenger
 		if (enableDebugUtils)
 			ret.debugMessenger = detail::create_debug_messenger(ret.instance);
+		instancePhase.end();
 
 		//TODO: create GLFW window
 		//Create GLFW window and the Vulkan surface
+		lut::StartupPhase windowPhase("window creation");
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
 		ret.window = glfwCreateWindow(1280, 720, "Zackery -CW2", nullptr, nullptr);
@@ -215,9 +289,11 @@ namespace labutils
 		{
 			throw lut::Error("Unable to create VkSurfaceKHR\n""glfwCreateWindowSurface() returned %s", lut::to_string(res).c_str());
 		}
+		windowPhase.end();
 
 		// Select appropriate Vulkan device
-		ret.physicalDevice = select_device(ret.instance, ret.surface);
+		lut::StartupPhase devicePhase("device creation");
+		ret.physicalDevice = select_device(ret.instance, ret.surface, device_override(aDevice));
 		if (VK_NULL_HANDLE == ret.physicalDevice)
 			throw lut::Error("No suitable physical device found!");
 
@@ -227,6 +303,10 @@ namespace labutils
 			std::fprintf(stderr, "Selected device: %s (%d.%d.%d)\n", props.deviceName, VK_API_VERSION_MAJOR(props.apiVersion), VK_API_VERSION_MINOR(props.apiVersion), VK_API_VERSION_PATCH(props.apiVersion));
 		}
 
+		auto const group = aDeviceGroup ? find_device_group(ret.instance, ret.physicalDevice) : std::vector<VkPhysicalDevice>{ ret.physicalDevice };
+		if (aDeviceGroup)
+			std::fprintf(stderr, "Device group: %zu physical device(s)\n", group.size());
+
 		// Create a logical device
 		// Enable required extensions. The device selection method ensures that
 		// the VK_KHR_swapchain extension is present, so we can safely just
@@ -235,9 +315,12 @@ namespace labutils
 
 		//TODO: list necessary extensions here
 		enabledDevExtensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		add_optional_device_extensions(ret.physicalDevice, enabledDevExtensions, true);
 		for (auto const& ext : enabledDevExtensions)
 			std::fprintf(stderr, "Enabling device extension: %s\n", ext);
 
+		ret.haveMemoryBudget = has_extension(enabledDevExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
 		// We need one or two queues:
 		// - best case: one GRAPHICS queue that can present
 		// - otherwise: one GRAPHICS queue and any queue that can present
@@ -263,7 +346,32 @@ namespace labutils
 			queueFamilyIndices.emplace_back(*present);
 		}
 
-		ret.device = create_device(ret.physicalDevice, queueFamilyIndices, enabledDevExtensions);
+		// Optional dedicated transfer and async compute queues, for
+		// background uploads and compute passes. They are not part of
+		// queueFamilyIndices, which also sets up the swapchain's sharing
+		// mode.
+		auto const transfer = find_transfer_only_family(ret.physicalDevice);
+		auto const compute = find_async_compute_family(ret.physicalDevice);
+
+		auto deviceFamilies = queueFamilyIndices;
+		if (transfer)
+			deviceFamilies.emplace_back(*transfer);
+		if (compute && deviceFamilies.end() == std::find(deviceFamilies.begin(), deviceFamilies.end(), *compute))
+			deviceFamilies.emplace_back(*compute); // unless it presents
+
+		ret.device = create_device(ret.physicalDevice, deviceFamilies, enabledDevExtensions, ret.caps, group);
+		ret.deviceCount = std::uint32_t(group.size());
+
+		// Each device presents the frames that it renders; others would
+		// need to send them to a presenting device first
+		if (ret.deviceCount > 1 && !presents_locally(ret.device, ret.surface, ret.deviceCount))
+		{
+			std::fprintf(stderr, "Info: not every device of the group can present, using a single device\n");
+			vkDestroyDevice(ret.device, nullptr);
+			ret.device = create_device(ret.physicalDevice, deviceFamilies, enabledDevExtensions, ret.caps);
+			ret.deviceCount = 1;
+		}
+		copy_capability_flags(ret);
 
 		// Retrieve VkQueues
 		vkGetDeviceQueue(ret.device, ret.graphicsFamilyIndex, 0, &ret.graphicsQueue);
@@ -278,8 +386,21 @@ namespace labutils
 			ret.presentQueue = ret.graphicsQueue;
 		}
 
+		if (transfer)
+		{
+			ret.transferFamilyIndex = *transfer;
+			vkGetDeviceQueue(ret.device, ret.transferFamilyIndex, 0, &ret.transferQueue);
+		}
+		if (compute)
+		{
+			ret.computeFamilyIndex = *compute;
+			vkGetDeviceQueue(ret.device, ret.computeFamilyIndex, 0, &ret.computeQueue);
+		}
+		devicePhase.end();
+
 		// Create swap chain
-		std::tie(ret.swapchain, ret.swapchainFormat, ret.swapchainExtent) = create_swapchain(ret.physicalDevice, ret.surface, ret.device, ret.window, queueFamilyIndices);
+		lut::StartupPhase swapchainPhase("swapchain creation");
+		std::tie(ret.swapchain, ret.swapchainFormat, ret.swapchainExtent, ret.presentMode, ret.swapchainUsage) = create_swapchain(ret.physicalDevice, ret.surface, ret.device, ret.window, ret.swapchainConfig, queueFamilyIndices);
 
 		// Get swap chain images & create associated image views
 		get_swapchain_images(ret.device, ret.swapchain, ret.swapImages);
@@ -289,8 +410,226 @@ namespace labutils
 		return ret;
 	}
 
-	SwapChanges recreate_swapchain( VulkanWindow& aWindow )
+	// make_offscreen_window()
+	VulkanWindow make_offscreen_window( VkExtent2D aExtent, std::uint32_t aImageCount, char const* aDevice, bool aDeviceGroup )
+	{
+		assert( aExtent.width > 0 && aExtent.height > 0 && aImageCount > 0 );
+
+		VulkanWindow ret;
+		ret.swapchainConfig.imageCount = aImageCount;
+
+		// Initialize Volk
+		if (auto const res = volkInitialize(); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to load Vulkan API\n"
+				"Volk returned error %s", lut::to_string(res).c_str()
+			);
+		}
+
+		// No surface, so no GLFW and no surface extensions
+		auto const supportedLayers = detail::get_instance_layers();
+		auto const supportedExtensions = detail::get_instance_extensions();
+
+		bool enableDebugUtils = false;
+
+		std::vector<char const*> enabledLayers, enabledExensions;
+
+#		if !defined(NDEBUG) // debug builds only
+		if (supportedLayers.count("VK_LAYER_KHRONOS_validation"))
+		{
+			enabledLayers.emplace_back("VK_LAYER_KHRONOS_validation");
+		}
+#		endif // ~ debug builds
+
+		// Object names and labels in all builds, for GPU captures; the
+		// messenger in debug builds only
+		if (supportedExtensions.count("VK_EXT_debug_utils"))
+		{
+			ret.haveDebugUtils = true;
+			enabledExensions.emplace_back("VK_EXT_debug_utils");
+#			if !defined(NDEBUG)
+			enableDebugUtils = true;
+#			endif
+		}
+
+		for (auto const& layer : enabledLayers)
+			std::fprintf(stderr, "Enabling layer: %s\n", layer);
+
+		for (auto const& extension : enabledExensions)
+			std::fprintf(stderr, "Enabling instance extension: %s\n", extension);
+
+		lut::StartupPhase instancePhase("instance creation");
+		ret.instance = detail::create_instance(enabledLayers, enabledExensions, enableDebugUtils);
+
+		volkLoadInstance(ret.instance);
+
+		if (enableDebugUtils)
+			ret.debugMessenger = detail::create_debug_messenger(ret.instance);
+		instancePhase.end();
+
+		// Select device; without a surface, presentation is not required
+		lut::StartupPhase devicePhase("device creation");
+		ret.physicalDevice = select_device(ret.instance, VK_NULL_HANDLE, device_override(aDevice));
+		if (VK_NULL_HANDLE == ret.physicalDevice)
+			throw lut::Error("No suitable physical device found!");
+
+		{
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(ret.physicalDevice, &props);
+			std::fprintf(stderr, "Selected device: %s (%d.%d.%d), offscreen\n", props.deviceName, VK_API_VERSION_MAJOR(props.apiVersion), VK_API_VERSION_MINOR(props.apiVersion), VK_API_VERSION_PATCH(props.apiVersion));
+		}
+
+		auto const group = aDeviceGroup ? find_device_group(ret.instance, ret.physicalDevice) : std::vector<VkPhysicalDevice>{ ret.physicalDevice };
+		if (aDeviceGroup)
+			std::fprintf(stderr, "Device group: %zu physical device(s)\n", group.size());
+
+		auto const graphics = find_queue_family(ret.physicalDevice, VK_QUEUE_GRAPHICS_BIT);
+		assert(graphics); // see score_device()
+
+		ret.graphicsFamilyIndex = *graphics;
+		ret.presentFamilyIndex = *graphics;
+
+		auto const transfer = find_transfer_only_family(ret.physicalDevice);
+		auto const compute = find_async_compute_family(ret.physicalDevice);
+
+		std::vector<std::uint32_t> deviceFamilies{ *graphics };
+		if (transfer)
+			deviceFamilies.emplace_back(*transfer);
+		if (compute)
+			deviceFamilies.emplace_back(*compute);
+
+		std::vector<char const*> enabledDevExtensions;
+		add_optional_device_extensions(ret.physicalDevice, enabledDevExtensions);
+		for (auto const& ext : enabledDevExtensions)
+			std::fprintf(stderr, "Enabling device extension: %s\n", ext);
+
+		ret.haveMemoryBudget = has_extension(enabledDevExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		ret.device = create_device(ret.physicalDevice, deviceFamilies, enabledDevExtensions, ret.caps, group);
+		ret.deviceCount = std::uint32_t(group.size());
+		copy_capability_flags(ret);
+
+		vkGetDeviceQueue(ret.device, ret.graphicsFamilyIndex, 0, &ret.graphicsQueue);
+		assert(VK_NULL_HANDLE != ret.graphicsQueue);
+
+		ret.presentQueue = ret.graphicsQueue;
+
+		if (transfer)
+		{
+			ret.transferFamilyIndex = *transfer;
+			vkGetDeviceQueue(ret.device, ret.transferFamilyIndex, 0, &ret.transferQueue);
+		}
+		if (compute)
+		{
+			ret.computeFamilyIndex = *compute;
+			vkGetDeviceQueue(ret.device, ret.computeFamilyIndex, 0, &ret.computeQueue);
+		}
+		devicePhase.end();
+
+		// Offscreen images in place of the swapchain images. The format
+		// matches the preferred swapchain format; colour attachment support
+		// is mandatory for it.
+		lut::StartupPhase swapchainPhase("swapchain creation");
+		ret.swapchainFormat = VK_FORMAT_R8G8B8A8_SRGB;
+		ret.swapchainExtent = aExtent;
+		ret.swapchainUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+		VkPhysicalDeviceMemoryProperties memProps{};
+		vkGetPhysicalDeviceMemoryProperties(ret.physicalDevice, &memProps);
+
+		for (std::uint32_t i = 0; i < aImageCount; ++i)
+		{
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = ret.swapchainFormat;
+			imageInfo.extent = VkExtent3D{ aExtent.width, aExtent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = ret.swapchainUsage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			VkImage image = VK_NULL_HANDLE;
+			if (auto const res = vkCreateImage(ret.device, &imageInfo, nullptr, &image); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to create offscreen image %u\n" "vkCreateImage() returned %s", i, lut::to_string(res).c_str());
+			}
+
+			// Ensure the image is destroyed if the allocation fails
+			ret.swapImages.emplace_back(image);
+
+			VkMemoryRequirements memReqs{};
+			vkGetImageMemoryRequirements(ret.device, image, &memReqs);
+
+			std::uint32_t memType = memProps.memoryTypeCount;
+			for (std::uint32_t j = 0; j < memProps.memoryTypeCount; ++j)
+			{
+				if ((memReqs.memoryTypeBits & (1u << j)) && (memProps.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+				{
+					memType = j;
+					break;
+				}
+			}
+			if (memType == memProps.memoryTypeCount)
+				throw lut::Error("No device-local memory type for offscreen image %u", i);
+
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = memReqs.size;
+			allocInfo.memoryTypeIndex = memType;
+
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			if (auto const res = vkAllocateMemory(ret.device, &allocInfo, nullptr, &memory); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to allocate memory for offscreen image %u\n" "vkAllocateMemory() returned %s", i, lut::to_string(res).c_str());
+			}
+
+			ret.offscreenMemory.emplace_back(memory);
+
+			if (auto const res = vkBindImageMemory(ret.device, image, memory, 0); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to bind memory to offscreen image %u\n" "vkBindImageMemory() returned %s", i, lut::to_string(res).c_str());
+			}
+		}
+
+		create_swapchain_image_views(ret.device, ret.swapchainFormat, ret.swapImages, ret.swapViews);
+
+		// Done
+		return ret;
+	}
+
+	RetiredSwapchain::~RetiredSwapchain()
+	{
+		for (auto view : views)
+			vkDestroyImageView(device, view, nullptr);
+
+		if (VK_NULL_HANDLE != swapchain)
+			vkDestroySwapchainKHR(device, swapchain, nullptr);
+	}
+
+	RetiredSwapchain::RetiredSwapchain( RetiredSwapchain&& aOther ) noexcept
+		: device( aOther.device )
+		, swapchain( std::exchange( aOther.swapchain, VK_NULL_HANDLE ) )
+		, views( std::move( aOther.views ) )
+	{
+		aOther.views.clear();
+	}
+
+	RetiredSwapchain& RetiredSwapchain::operator=( RetiredSwapchain&& aOther ) noexcept
+	{
+		std::swap( device, aOther.device );
+		std::swap( swapchain, aOther.swapchain );
+		std::swap( views, aOther.views );
+		return *this;
+	}
+
+	SwapChanges recreate_swapchain( VulkanWindow& aWindow, RetiredSwapchain* aRetired )
 	{
+		assert(VK_NULL_HANDLE != aWindow.surface); // not for offscreen windows
+
 		//TODO: implement me!
 		//Remember old format extents
 		//These are two of the properties that may change. Typically only the extent changes(e.g., window resized),
@@ -303,8 +642,18 @@ namespace labutils
 		//oldSwapchain member of VkSwapchainCreateInfoKHR.
 		VkSwapchainKHR oldSwapchain = aWindow.swapchain;
 
-		for (auto view : aWindow.swapViews)
-			vkDestroyImageView(aWindow.device, view, nullptr);
+		if (aRetired)
+		{
+			RetiredSwapchain retired;
+			retired.device = aWindow.device;
+			retired.views = std::move(aWindow.swapViews);
+			*aRetired = std::move(retired);
+		}
+		else
+		{
+			for (auto view : aWindow.swapViews)
+				vkDestroyImageView(aWindow.device, view, nullptr);
+		}
 
 		aWindow.swapViews.clear();
 		aWindow.swapImages.clear();
@@ -318,9 +667,9 @@ namespace labutils
 		}
 		try
 		{
-			std::tie(aWindow.swapchain, aWindow.swapchainFormat, aWindow.swapchainExtent)
+			std::tie(aWindow.swapchain, aWindow.swapchainFormat, aWindow.swapchainExtent, aWindow.presentMode, aWindow.swapchainUsage)
 				= create_swapchain(aWindow.physicalDevice, aWindow.surface, aWindow.device,
-					aWindow.window, queueFamilyIndices, oldSwapchain);
+					aWindow.window, aWindow.swapchainConfig, queueFamilyIndices, oldSwapchain);
 		}
 		catch (...)
 		{
@@ -331,8 +680,12 @@ namespace labutils
 			throw;
 		}
 
-		//Destroy old swap chain
-		vkDestroySwapchainKHR(aWindow.device, oldSwapchain, nullptr);
+		//Destroy old swap chain, or pass it on. (It is retired either way;
+		//its images that are not acquired yet can no longer be.)
+		if (aRetired)
+			aRetired->swapchain = oldSwapchain;
+		else
+			vkDestroySwapchainKHR(aWindow.device, oldSwapchain, nullptr);
 
 		//Get new swap chain images create associated image views
 		get_swapchain_images(aWindow.device, aWindow.swapchain, aWindow.swapImages);
@@ -385,7 +738,7 @@ namespace
 		return res;
 	}
 
-	std::tuple<VkSwapchainKHR,VkFormat,VkExtent2D> create_swapchain( VkPhysicalDevice aPhysicalDev, VkSurfaceKHR aSurface, VkDevice aDevice, GLFWwindow* aWindow, std::vector<std::uint32_t> const& aQueueFamilyIndices, VkSwapchainKHR aOldSwapchain )
+	std::tuple<VkSwapchainKHR,VkFormat,VkExtent2D,VkPresentModeKHR,VkImageUsageFlags> create_swapchain( VkPhysicalDevice aPhysicalDev, VkSurfaceKHR aSurface, VkDevice aDevice, GLFWwindow* aWindow, lut::SwapchainConfig const& aConfig, std::vector<std::uint32_t> const& aQueueFamilyIndices, VkSwapchainKHR aOldSwapchain )
 	{
 		auto const formats = get_surface_formats(aPhysicalDev, aSurface);
 		auto const modes = get_present_modes(aPhysicalDev, aSurface);
@@ -416,9 +769,13 @@ namespace
 		}
 
 		//TODO: pick appropriate VkPresentModeKHR
+		// The configured mode if available; otherwise fall back to
+		// FIFO_RELAXED, and finally FIFO, which is always supported.
 		VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 
-		if (modes.count(VK_PRESENT_MODE_FIFO_RELAXED_KHR))
+		if (modes.count(aConfig.presentMode))
+			presentMode = aConfig.presentMode;
+		else if (modes.count(VK_PRESENT_MODE_FIFO_RELAXED_KHR))
 			presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
 
 		//TODO: pick image count
@@ -427,10 +784,12 @@ namespace
 		{
 			throw lut::Error("Unable to get surface capabilities\n" "vkGetPhysicalDeviceSurfaceCapabilitiesKHR() returned %s", lut::to_string(res).c_str());
 		}
-		std::uint32_t imageCount = 2;
+		std::uint32_t imageCount = aConfig.imageCount;
 
-		if (imageCount < caps.minImageCount + 1)
-			imageCount = caps.minImageCount + 1;
+		if (0 == imageCount)
+			imageCount = std::max(2u, caps.minImageCount + 1);
+		if (imageCount < caps.minImageCount)
+			imageCount = caps.minImageCount;
 		if (caps.maxImageCount > 0 && imageCount > caps.maxImageCount)
 			imageCount = caps.maxImageCount;
 
@@ -460,7 +819,7 @@ namespace
 		chainInfo.imageColorSpace = format.colorSpace;
 		chainInfo.imageExtent = extent;
 		chainInfo.imageArrayLayers = 1;
-		chainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		chainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (caps.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | aConfig.extraUsage));
 		chainInfo.preTransform = caps.currentTransform;
 		chainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		chainInfo.presentMode = presentMode;
@@ -490,7 +849,7 @@ namespace
 			throw lut::Error("Unable to create swap chain\n" "vkCreateSwapchainKHR() returned %s", lut::to_string(res).c_str());
 		}
 
-		return { chain, format.format, extent };
+		return { chain, format.format, extent, presentMode, chainInfo.imageUsage };
 	}
 
 
@@ -588,7 +947,154 @@ namespace
 		return {};
 	}
 
-	VkDevice create_device( VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueues, std::vector<char const*> const& aEnabledExtensions )
+	std::optional<std::uint32_t> find_transfer_only_family( VkPhysicalDevice aPhysicalDev )
+	{
+		std::uint32_t numQueues = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(aPhysicalDev, &numQueues, nullptr);
+
+		std::vector<VkQueueFamilyProperties> families(numQueues);
+		vkGetPhysicalDeviceQueueFamilyProperties(aPhysicalDev, &numQueues, families.data());
+
+		for (std::uint32_t i = 0; i < numQueues; ++i)
+		{
+			auto const flags = families[i].queueFlags;
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && families[i].queueCount > 0)
+				return i;
+		}
+		return {};
+	}
+
+	std::optional<std::uint32_t> find_async_compute_family( VkPhysicalDevice aPhysicalDev )
+	{
+		std::uint32_t numQueues = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(aPhysicalDev, &numQueues, nullptr);
+
+		std::vector<VkQueueFamilyProperties> families(numQueues);
+		vkGetPhysicalDeviceQueueFamilyProperties(aPhysicalDev, &numQueues, families.data());
+
+		for (std::uint32_t i = 0; i < numQueues; ++i)
+		{
+			auto const flags = families[i].queueFlags;
+			if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && families[i].queueCount > 0)
+				return i;
+		}
+		return {};
+	}
+
+	std::vector<VkPhysicalDevice> find_device_group( VkInstance aInstance, VkPhysicalDevice aPhysicalDev )
+	{
+		std::uint32_t numGroups = 0;
+		if (auto const res = vkEnumeratePhysicalDeviceGroups(aInstance, &numGroups, nullptr); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to get physical device group count\n" "vkEnumeratePhysicalDeviceGroups() returned %s", lut::to_string(res).c_str());
+		}
+
+		std::vector<VkPhysicalDeviceGroupProperties> groups(numGroups);
+		for (auto& group : groups)
+			group.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES;
+
+		if (auto const res = vkEnumeratePhysicalDeviceGroups(aInstance, &numGroups, groups.data()); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to get physical device groups\n" "vkEnumeratePhysicalDeviceGroups() returned %s", lut::to_string(res).c_str());
+		}
+
+		for (auto const& group : groups)
+		{
+			auto const* const begin = group.physicalDevices;
+			auto const* const end = begin + group.physicalDeviceCount;
+			if (end == std::find(begin, end, aPhysicalDev))
+				continue;
+
+			std::vector<VkPhysicalDevice> ret{ aPhysicalDev };
+			for (auto const* it = begin; it != end; ++it)
+			{
+				if (aPhysicalDev != *it)
+					ret.emplace_back(*it);
+			}
+			return ret;
+		}
+
+		return { aPhysicalDev };
+	}
+
+	bool presents_locally( VkDevice aDevice, VkSurfaceKHR aSurface, std::uint32_t aDeviceCount )
+	{
+		VkDeviceGroupPresentCapabilitiesKHR caps{};
+		caps.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_CAPABILITIES_KHR;
+		if (VK_SUCCESS != vkGetDeviceGroupPresentCapabilitiesKHR(aDevice, &caps))
+			return false;
+
+		VkDeviceGroupPresentModeFlagsKHR surfaceModes = 0;
+		if (VK_SUCCESS != vkGetDeviceGroupSurfacePresentModesKHR(aDevice, aSurface, &surfaceModes))
+			return false;
+
+		if (!(caps.modes & surfaceModes & VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR))
+			return false;
+
+		for (std::uint32_t i = 0; i < aDeviceCount; ++i)
+		{
+			if (!(caps.presentMask[i] & (1u << i)))
+				return false;
+		}
+
+		return true;
+	}
+
+	void add_optional_device_extensions( VkPhysicalDevice aPhysicalDev, std::vector<char const*>& aExtensions, bool aPresentation )
+	{
+		auto const exts = lut::detail::get_device_extensions(aPhysicalDev);
+
+		// Variable rate shading (its render pass requirements are core in
+		// Vulkan 1.2)
+		if (exts.count(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME))
+			aExtensions.emplace_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+
+		// Per-heap usage and budget (see lut::query_memory_stats())
+		if (exts.count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+			aExtensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		// Draws predicated on a buffer value (occlusion query results)
+		if (exts.count(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME))
+			aExtensions.emplace_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+
+		// Pipelines linked from separately compiled parts (see
+		// lut::PipelineLinker)
+		if (exts.count(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && exts.count(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+		{
+			aExtensions.emplace_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			aExtensions.emplace_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		}
+
+		// Ray queries against acceleration structures from any shader
+		// stage (ray-query shadows); the structures need deferred host
+		// operations, even if they are built on the device
+		if (exts.count(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) && exts.count(VK_KHR_RAY_QUERY_EXTENSION_NAME) && exts.count(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME))
+		{
+			aExtensions.emplace_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+			aExtensions.emplace_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+			aExtensions.emplace_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+		}
+
+		// Descriptors written straight into buffers (see
+		// lut::DescriptorBuffer)
+		if (exts.count(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME))
+			aExtensions.emplace_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+
+		// Present IDs, and waiting for their presentation (latency
+		// measurements); one is of no use without the other
+		if (aPresentation && exts.count(VK_KHR_PRESENT_ID_EXTENSION_NAME) && exts.count(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+		{
+			aExtensions.emplace_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			aExtensions.emplace_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		}
+	}
+
+	bool has_extension( std::vector<char const*> const& aExtensions, char const* aName )
+	{
+		return std::any_of(aExtensions.begin(), aExtensions.end(), [&] (char const* aExt) { return 0 == std::strcmp(aExt, aName); });
+	}
+
+	VkDevice create_device( VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueues, std::vector<char const*> const& aEnabledExtensions, lut::DeviceCapabilities& aCaps, std::vector<VkPhysicalDevice> const& aGroup )
 	{
 		if (aQueues.empty())
 			throw lut::Error("create_device(): no queues requested");
@@ -605,18 +1111,309 @@ namespace
 			queueInfo.pQueuePriorities = queuePriorities;
 		}
 
-		VkPhysicalDeviceFeatures deviceFeatures{};
-		vkGetPhysicalDeviceFeatures(aPhysicalDev, &deviceFeatures);
-		
-				//enable anisotropic filtering and show respect
-				if (deviceFeatures.samplerAnisotropy)
-					deviceFeatures.samplerAnisotropy = VK_TRUE;
-				else
-					fprintf(stderr, "Device does not support anisotropic filtering\n");
-					// No extra features for now.
-		
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(aPhysicalDev, &props);
+
+		// The instance asks for 1.3 (see detail::create_instance()); the
+		// device is at least 1.2 (see score_device())
+		bool const vulkan13 = props.apiVersion >= VK_API_VERSION_1_3;
+
+		// Query everything in one chain: 1.1/1.2 (and 1.3) always, the
+		// extensions' features only if they are enabled
+		VkPhysicalDeviceVulkan11Features supported11{};
+		supported11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+
+		VkPhysicalDeviceVulkan12Features supported12{};
+		supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		supported12.pNext = &supported11;
+
+		void* supportedChain = &supported12;
+
+		VkPhysicalDeviceVulkan13Features supported13{};
+		supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+		if (vulkan13)
+		{
+			supported13.pNext = supportedChain;
+			supportedChain = &supported13;
+		}
+
+		bool const shadingRateExt = has_extension(aEnabledExtensions, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+		bool const presentWaitExt = has_extension(aEnabledExtensions, VK_KHR_PRESENT_ID_EXTENSION_NAME)
+			&& has_extension(aEnabledExtensions, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		bool const conditionalExt = has_extension(aEnabledExtensions, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+		bool const libraryExt = has_extension(aEnabledExtensions, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		bool const rayQueryExt = has_extension(aEnabledExtensions, VK_KHR_RAY_QUERY_EXTENSION_NAME);
+		bool const descriptorBufferExt = has_extension(aEnabledExtensions, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR supportedRate{};
+		supportedRate.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		if (shadingRateExt)
+		{
+			supportedRate.pNext = supportedChain;
+			supportedChain = &supportedRate;
+		}
+
+		VkPhysicalDevicePresentIdFeaturesKHR supportedPresentId{};
+		supportedPresentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{};
+		supportedPresentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		if (presentWaitExt)
+		{
+			supportedPresentId.pNext = supportedChain;
+			supportedPresentWait.pNext = &supportedPresentId;
+			supportedChain = &supportedPresentWait;
+		}
+
+		VkPhysicalDeviceConditionalRenderingFeaturesEXT supportedConditional{};
+		supportedConditional.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+		if (conditionalExt)
+		{
+			supportedConditional.pNext = supportedChain;
+			supportedChain = &supportedConditional;
+		}
+
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedLibrary{};
+		supportedLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+		if (libraryExt)
+		{
+			supportedLibrary.pNext = supportedChain;
+			supportedChain = &supportedLibrary;
+		}
+
+		VkPhysicalDeviceAccelerationStructureFeaturesKHR supportedAccel{};
+		supportedAccel.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+		VkPhysicalDeviceRayQueryFeaturesKHR supportedRayQuery{};
+		supportedRayQuery.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+		if (rayQueryExt)
+		{
+			supportedAccel.pNext = supportedChain;
+			supportedRayQuery.pNext = &supportedAccel;
+			supportedChain = &supportedRayQuery;
+		}
+
+		VkPhysicalDeviceDescriptorBufferFeaturesEXT supportedDescriptorBuffer{};
+		supportedDescriptorBuffer.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+		if (descriptorBufferExt)
+		{
+			supportedDescriptorBuffer.pNext = supportedChain;
+			supportedChain = &supportedDescriptorBuffer;
+		}
+
+		VkPhysicalDeviceFeatures2 supported{};
+		supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported.pNext = supportedChain;
+		vkGetPhysicalDeviceFeatures2(aPhysicalDev, &supported);
+
+		// All supported core features are enabled, among them
+		// samplerAnisotropy, pipelineStatisticsQuery
+		// (lut::GpuProfiler::add_statistics()) and the sparse residency of
+		// virtual textures
+		VkPhysicalDeviceFeatures const& deviceFeatures = supported.features;
+		if (!deviceFeatures.samplerAnisotropy)
+			std::fprintf(stderr, "Info: Device does not support anisotropic filtering\n");
+
+		// Of the 1.1-1.3 features, only the ones used by the renderer are
+		// enabled, and only if they are supported; the application checks
+		// aCaps before use.
+		VkPhysicalDeviceVulkan11Features enabled11{};
+		enabled11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+		enabled11.shaderDrawParameters = supported11.shaderDrawParameters;
+
+		// Render passes that draw to several array layers at once (stereo)
+		enabled11.multiview = supported11.multiview;
+
+		// Descriptor indexing (bindless materials)
+		VkPhysicalDeviceVulkan12Features enabled12{};
+		enabled12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		enabled12.pNext = &enabled11;
+		enabled12.descriptorIndexing = supported12.descriptorIndexing;
+		enabled12.shaderSampledImageArrayNonUniformIndexing = supported12.shaderSampledImageArrayNonUniformIndexing;
+		enabled12.runtimeDescriptorArray = supported12.runtimeDescriptorArray;
+		enabled12.descriptorBindingPartiallyBound = supported12.descriptorBindingPartiallyBound;
+		enabled12.descriptorBindingVariableDescriptorCount = supported12.descriptorBindingVariableDescriptorCount;
+
+		// vkCmdDrawIndexedIndirectCount() (GPU culling)
+		enabled12.drawIndirectCount = supported12.drawIndirectCount;
+
+		// float16_t arithmetic in shaders (fp16 shading)
+		enabled12.shaderFloat16 = supported12.shaderFloat16;
+
+		// Signalling and waiting for counter values (lut::UploadBatch)
+		enabled12.timelineSemaphore = supported12.timelineSemaphore;
+
+		// Acceleration structures and ray queries (ray-query shadows); their
+		// build inputs are passed by buffer device address
+		bool const rayQuery = rayQueryExt && supportedAccel.accelerationStructure && supportedRayQuery.rayQuery && supported12.bufferDeviceAddress;
+
+		// Descriptor buffers, which address the buffers of buffer
+		// descriptors. lut::DescriptorBuffer writes combined image samplers
+		// one after the other, which not every implementation allows.
+		VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProps{};
+		descriptorBufferProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+		if (descriptorBufferExt)
+		{
+			VkPhysicalDeviceProperties2 props2{};
+			props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			props2.pNext = &descriptorBufferProps;
+			vkGetPhysicalDeviceProperties2(aPhysicalDev, &props2);
+		}
+		bool const descriptorBuffer = descriptorBufferExt && supportedDescriptorBuffer.descriptorBuffer && supported12.bufferDeviceAddress
+			&& descriptorBufferProps.combinedImageSamplerDescriptorSingleArray;
+
+		enabled12.bufferDeviceAddress = rayQuery || descriptorBuffer;
+
+		void* enabledChain = &enabled12;
+
+		// Rendering without VkRenderPass objects, and the simpler barriers
+		// and submits of synchronization2
+		VkPhysicalDeviceVulkan13Features enabled13{};
+		enabled13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+		enabled13.dynamicRendering = supported13.dynamicRendering;
+		enabled13.synchronization2 = supported13.synchronization2;
+		if (vulkan13)
+		{
+			enabled13.pNext = enabledChain;
+			enabledChain = &enabled13;
+		}
+
+		// Shading rate attachments (variable rate shading); the per-draw and
+		// per-primitive rates are not used
+		VkPhysicalDeviceFragmentShadingRateFeaturesKHR enabledRate{};
+		enabledRate.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+		enabledRate.attachmentFragmentShadingRate = supportedRate.attachmentFragmentShadingRate;
+		if (shadingRateExt)
+		{
+			enabledRate.pNext = enabledChain;
+			enabledChain = &enabledRate;
+		}
+
+		// Present IDs and vkWaitForPresentKHR() (latency measurements)
+		VkPhysicalDevicePresentIdFeaturesKHR enabledPresentId{};
+		enabledPresentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		enabledPresentId.presentId = supportedPresentId.presentId;
+		VkPhysicalDevicePresentWaitFeaturesKHR enabledPresentWait{};
+		enabledPresentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		enabledPresentWait.presentWait = supportedPresentWait.presentWait;
+		if (presentWaitExt)
+		{
+			enabledPresentId.pNext = enabledChain;
+			enabledPresentWait.pNext = &enabledPresentId;
+			enabledChain = &enabledPresentWait;
+		}
+
+		// vkCmdBeginConditionalRenderingEXT() in primary command buffers
+		// (--occlusion=query); not inherited by secondary ones
+		VkPhysicalDeviceConditionalRenderingFeaturesEXT enabledConditional{};
+		enabledConditional.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+		enabledConditional.conditionalRendering = supportedConditional.conditionalRendering;
+		if (conditionalExt)
+		{
+			enabledConditional.pNext = enabledChain;
+			enabledChain = &enabledConditional;
+		}
+
+		// Graphics pipeline libraries; only used if linking them is fast,
+		// otherwise monolithic pipelines are as quick to create
+		VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProps{};
+		libraryProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+		if (libraryExt)
+		{
+			VkPhysicalDeviceProperties2 props2{};
+			props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			props2.pNext = &libraryProps;
+			vkGetPhysicalDeviceProperties2(aPhysicalDev, &props2);
+		}
+
+		// Subgroups (core in 1.1)
+		VkPhysicalDeviceSubgroupProperties subgroupProps{};
+		subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		{
+			VkPhysicalDeviceProperties2 props2{};
+			props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			props2.pNext = &subgroupProps;
+			vkGetPhysicalDeviceProperties2(aPhysicalDev, &props2);
+		}
+
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT enabledLibrary{};
+		enabledLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+		enabledLibrary.graphicsPipelineLibrary = supportedLibrary.graphicsPipelineLibrary;
+		if (libraryExt)
+		{
+			enabledLibrary.pNext = enabledChain;
+			enabledChain = &enabledLibrary;
+		}
+
+		VkPhysicalDeviceAccelerationStructureFeaturesKHR enabledAccel{};
+		enabledAccel.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+		enabledAccel.accelerationStructure = rayQuery;
+		VkPhysicalDeviceRayQueryFeaturesKHR enabledRayQuery{};
+		enabledRayQuery.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+		enabledRayQuery.rayQuery = rayQuery;
+		if (rayQueryExt)
+		{
+			enabledAccel.pNext = enabledChain;
+			enabledRayQuery.pNext = &enabledAccel;
+			enabledChain = &enabledRayQuery;
+		}
+
+		VkPhysicalDeviceDescriptorBufferFeaturesEXT enabledDescriptorBuffer{};
+		enabledDescriptorBuffer.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+		enabledDescriptorBuffer.descriptorBuffer = descriptorBuffer;
+		if (descriptorBufferExt)
+		{
+			enabledDescriptorBuffer.pNext = enabledChain;
+			enabledChain = &enabledDescriptorBuffer;
+		}
+
+		VkPhysicalDeviceFeatures2 enabledFeatures{};
+		enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		enabledFeatures.pNext = enabledChain;
+		enabledFeatures.features = deviceFeatures;
+
+		aCaps = lut::DeviceCapabilities{};
+		aCaps.apiVersion = props.apiVersion;
+		aCaps.samplerAnisotropy = VK_TRUE == deviceFeatures.samplerAnisotropy;
+		aCaps.multiDrawIndirect = VK_TRUE == deviceFeatures.multiDrawIndirect;
+		aCaps.drawIndirectFirstInstance = VK_TRUE == deviceFeatures.drawIndirectFirstInstance;
+		aCaps.geometryShader = VK_TRUE == deviceFeatures.geometryShader;
+		aCaps.fragmentStoresAndAtomics = VK_TRUE == deviceFeatures.fragmentStoresAndAtomics;
+		aCaps.pipelineStatisticsQuery = VK_TRUE == deviceFeatures.pipelineStatisticsQuery;
+		aCaps.sparseBinding = VK_TRUE == deviceFeatures.sparseBinding;
+		aCaps.sparseResidencyImage2D = VK_TRUE == deviceFeatures.sparseResidencyImage2D;
+		aCaps.multiview = VK_TRUE == supported11.multiview;
+		if (subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+			aCaps.subgroupCompute = subgroupProps.supportedOperations;
+		if (subgroupProps.supportedStages & VK_SHADER_STAGE_FRAGMENT_BIT)
+			aCaps.subgroupFragment = subgroupProps.supportedOperations;
+		aCaps.subgroupSize = subgroupProps.subgroupSize;
+		aCaps.descriptorIndexing = supported12.runtimeDescriptorArray
+			&& supported12.descriptorBindingPartiallyBound
+			&& supported12.descriptorBindingVariableDescriptorCount
+			&& supported12.shaderSampledImageArrayNonUniformIndexing;
+		aCaps.drawIndirectCount = VK_TRUE == supported12.drawIndirectCount;
+		aCaps.shaderFloat16 = VK_TRUE == supported12.shaderFloat16;
+		aCaps.timelineSemaphore = VK_TRUE == supported12.timelineSemaphore;
+		aCaps.dynamicRendering = vulkan13 && supported13.dynamicRendering;
+		aCaps.synchronization2 = vulkan13 && supported13.synchronization2;
+		aCaps.fragmentShadingRate = shadingRateExt && supportedRate.attachmentFragmentShadingRate;
+		aCaps.presentWait = presentWaitExt && supportedPresentId.presentId && supportedPresentWait.presentWait;
+		aCaps.conditionalRendering = conditionalExt && supportedConditional.conditionalRendering;
+		aCaps.graphicsPipelineLibrary = libraryExt && supportedLibrary.graphicsPipelineLibrary && libraryProps.graphicsPipelineLibraryFastLinking;
+		aCaps.rayQuery = rayQuery;
+		aCaps.descriptorBuffer = descriptorBuffer;
+
 		VkDeviceCreateInfo deviceInfo{};
 		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceInfo.pNext = &enabledFeatures;
+
+		// Core in Vulkan 1.1 (VK_KHR_device_group_creation)
+		VkDeviceGroupDeviceCreateInfo groupInfo{};
+		groupInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO;
+		groupInfo.pNext = &enabledFeatures;
+		groupInfo.physicalDeviceCount = std::uint32_t(aGroup.size());
+		groupInfo.pPhysicalDevices = aGroup.data();
+		if (aGroup.size() > 1)
+			deviceInfo.pNext = &groupInfo;
 
 		deviceInfo.queueCreateInfoCount = std::uint32_t(queueInfos.size());
 		deviceInfo.pQueueCreateInfos = queueInfos.data();
@@ -624,7 +1421,7 @@ namespace
 		deviceInfo.enabledExtensionCount = std::uint32_t(aEnabledExtensions.size());
 		deviceInfo.ppEnabledExtensionNames = aEnabledExtensions.data();
 
-		deviceInfo.pEnabledFeatures = &deviceFeatures;
+		deviceInfo.pEnabledFeatures = nullptr; // see enabledFeatures
 
 		VkDevice device = VK_NULL_HANDLE;
 		if (auto const res = vkCreateDevice(aPhysicalDev, &deviceInfo, nullptr, &device); VK_SUCCESS != res)
@@ -636,6 +1433,14 @@ namespace
 
 		return device;
 	}
+
+	void copy_capability_flags( lut::VulkanContext& aContext )
+	{
+		aContext.haveFragmentShadingRate = aContext.caps.fragmentShadingRate;
+		aContext.haveTimelineSemaphore = aContext.caps.timelineSemaphore;
+		aContext.havePipelineStatistics = aContext.caps.pipelineStatisticsQuery;
+		aContext.havePresentWait = aContext.caps.presentWait;
+	}
 }
 
 namespace
@@ -662,20 +1467,24 @@ namespace
 		//TODO:  - check that there is a queue family that supports graphics
 		//TODO:    commands
 
-		// Check that the device supports the VK_KHR_swapchain extension
-		auto const exts = lut::detail::get_device_extensions(aPhysicalDev);
-
-		if (!exts.count(VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+		// Without a surface (offscreen), presentation is not needed
+		if (VK_NULL_HANDLE != aSurface)
 		{
-			std::fprintf(stderr, "Info: Discarding device '%s': extension %s missing \n", props.deviceName, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-			return -1.f;
-		}
+			// Check that the device supports the VK_KHR_swapchain extension
+			auto const exts = lut::detail::get_device_extensions(aPhysicalDev);
 
-		//Ensure there is a queue family that can present to the given surface
-		if (!find_queue_family(aPhysicalDev, 0, aSurface))
-		{
-			std::fprintf(stderr, "Info: Discarding device'%s': can't present to surface\n", props.deviceName);
-			return -1.f;
+			if (!exts.count(VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+			{
+				std::fprintf(stderr, "Info: Discarding device '%s': extension %s missing \n", props.deviceName, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+				return -1.f;
+			}
+
+			//Ensure there is a queue family that can present to the given surface
+			if (!find_queue_family(aPhysicalDev, 0, aSurface))
+			{
+				std::fprintf(stderr, "Info: Discarding device'%s': can't present to surface\n", props.deviceName);
+				return -1.f;
+			}
 		}
 
 		//Also ensure there is a queue family that supports graphics commands
@@ -685,18 +1494,107 @@ namespace
 			return -1.f;
 		}
 
-		// Discrete GPU > Integrated GPU > others
+		// Discrete GPU > Integrated GPU > others. The type dominates: the
+		// other terms add at most 400 together, so an integrated GPU never
+		// wins over a discrete one.
 		float score = 0.f;
 
 		if (VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU == props.deviceType)
-			score += 500.f;
+			score += 1000.f;
 		else if (VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU == props.deviceType)
+			score += 500.f;
+		else if (VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU == props.deviceType)
 			score += 100.f;
 
+		// Largest device-local heap, 10 per GiB up to 24 GiB. (Integrated
+		// GPUs typically report part of system memory here.)
+		VkPhysicalDeviceMemoryProperties memory;
+		vkGetPhysicalDeviceMemoryProperties(aPhysicalDev, &memory);
+
+		VkDeviceSize localHeap = 0;
+		for (std::uint32_t i = 0; i < memory.memoryHeapCount; ++i)
+		{
+			if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+				localHeap = std::max(localHeap, memory.memoryHeaps[i].size);
+		}
+
+		float const localGib = float(localHeap) / (1024.f * 1024.f * 1024.f);
+		score += 10.f * std::min(localGib, 24.f);
+
+		// Features the renderer uses if they are there (see create_device())
+		VkPhysicalDeviceVulkan12Features features12{};
+		features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &features12;
+		vkGetPhysicalDeviceFeatures2(aPhysicalDev, &features);
+
+		if (features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound
+			&& features12.descriptorBindingVariableDescriptorCount && features12.shaderSampledImageArrayNonUniformIndexing)
+			score += 50.f;
+		if (features12.timelineSemaphore)
+			score += 40.f;
+		if (lut::detail::get_device_extensions(aPhysicalDev).count(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+			score += 30.f;
+
+		// A transfer-only family (DMA engine) for uploads, and an async
+		// compute family
+		if (find_transfer_only_family(aPhysicalDev))
+			score += 20.f;
+		if (find_async_compute_family(aPhysicalDev))
+			score += 20.f;
+
 		return score;
 	}
+
+	char const* device_override( char const* aDevice )
+	{
+		if (aDevice && *aDevice)
+			return aDevice;
+
+		char const* const env = std::getenv("LUT_DEVICE");
+		return env && *env ? env : nullptr;
+	}
+
+	std::string format_uuid( std::uint8_t const (&aUuid)[VK_UUID_SIZE] )
+	{
+		// 8-4-4-4-12 hex digits
+		std::string ret;
+		for (std::size_t i = 0; i < VK_UUID_SIZE; ++i)
+		{
+			if (4 == i || 6 == i || 8 == i || 10 == i)
+				ret += '-';
+
+			char hex[3];
+			std::snprintf(hex, sizeof(hex), "%02x", aUuid[i]);
+			ret += hex;
+		}
+		return ret;
+	}
+
+	bool matches_device( VkPhysicalDeviceProperties const& aProps, VkPhysicalDeviceIDProperties const& aIds, char const* aOverride )
+	{
+		auto const lower = [] (char const* aStr) {
+			std::string ret;
+			for (; *aStr; ++aStr)
+			{
+				if ('-' != *aStr)
+					ret += char(std::tolower(static_cast<unsigned char>(*aStr)));
+			}
+			return ret;
+		};
+
+		// The UUID without dashes, or a part of the name (also without
+		// dashes, so that both are compared alike)
+		std::string const wanted = lower(aOverride);
+		if (wanted == lower(format_uuid(aIds.deviceUUID).c_str()))
+			return true;
+
+		return !wanted.empty() && std::string::npos != lower(aProps.deviceName).find(wanted);
+	}
 	
-	VkPhysicalDevice select_device( VkInstance aInstance, VkSurfaceKHR aSurface )
+	VkPhysicalDevice select_device( VkInstance aInstance, VkSurfaceKHR aSurface, char const* aOverride )
 	{
 		std::uint32_t numDevices = 0;
 		if( auto const res = vkEnumeratePhysicalDevices( aInstance, &numDevices, nullptr ); VK_SUCCESS != res )
@@ -719,14 +1617,31 @@ namespace
 
 		for( auto const device : devices )
 		{
+			VkPhysicalDeviceIDProperties ids{};
+			ids.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+			VkPhysicalDeviceProperties2 props{};
+			props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			props.pNext = &ids;
+			vkGetPhysicalDeviceProperties2( device, &props );
+
 			auto const score = score_device( device, aSurface );
-			if( score > bestScore )
+			if( score < 0.f )
+				continue;
+
+			bool const matches = !aOverride || matches_device( props.properties, ids, aOverride );
+			std::fprintf( stderr, "Info: Device '%s' (%s): score %.0f%s\n", props.properties.deviceName, format_uuid( ids.deviceUUID ).c_str(), score, matches ? "" : ", not selected by override" );
+
+			if( matches && score > bestScore )
 			{
 				bestScore = score;
 				bestDevice = device;
 			}
 		}
 
+		if( aOverride && VK_NULL_HANDLE == bestDevice )
+			throw lut::Error( "No suitable physical device matches '%s'", aOverride );
+
 		return bestDevice;
 	}
 }
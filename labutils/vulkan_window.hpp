@@ -14,6 +14,18 @@
 
 namespace labutils
 {
+	// Swapchain preferences, kept by the VulkanWindow and reapplied by
+	// recreate_swapchain(). If presentMode is not supported, FIFO_RELAXED or
+	// FIFO (which is always supported) is used instead. An imageCount of 0
+	// picks the surface's minimum plus one; any count is clamped to the
+	// surface's limits.
+	struct SwapchainConfig
+	{
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+		std::uint32_t imageCount = 0;
+		VkImageUsageFlags extraUsage = 0; // requested in addition, where the surface supports it
+	};
+
 	class VulkanWindow final : public VulkanContext
 	{
 		public:
@@ -39,9 +51,44 @@ namespace labutils
 
 			VkFormat swapchainFormat;
 			VkExtent2D swapchainExtent;
+
+			SwapchainConfig swapchainConfig;
+			VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // in use
+
+			// Of the swapImages: always COLOR_ATTACHMENT, plus TRANSFER_DST
+			// and TRANSFER_SRC (e.g., to blit into them, or read them back)
+			// and SwapchainConfig::extraUsage where the surface supports
+			// them
+			VkImageUsageFlags swapchainUsage = 0;
+
+			// Offscreen windows only: the memory of the swapImages, which
+			// are then owned by the VulkanWindow.
+			std::vector<VkDeviceMemory> offscreenMemory;
 	};
 
-	VulkanWindow make_vulkan_window();
+	// Physical devices are scored by type (discrete first), device-local
+	// memory, features (descriptor indexing, timeline semaphores, mesh
+	// shaders) and queue families; the best suitable one is used.
+	// aDevice, or the LUT_DEVICE environment variable if aDevice is null,
+	// overrides that: a case-insensitive substring of the device name, or the
+	// device's UUID (as printed with the scores, dashes optional). Throws
+	// labutils::Error if no suitable device matches.
+	//
+	// aDeviceGroup makes the device span all physical devices of the
+	// selected device's group (e.g., linked GPUs); see
+	// VulkanContext::deviceCount. Windows fall back to a single device unless
+	// every device of the group can present the images that it renders.
+	VulkanWindow make_vulkan_window( SwapchainConfig const& = SwapchainConfig{}, char const* aDevice = nullptr, bool aDeviceGroup = false );
+
+	// Headless VulkanWindow for offscreen rendering, e.g. benchmarks without
+	// a display. There is no GLFW window, surface or swapchain (all null);
+	// swapImages holds aImageCount device-local R8G8B8A8_SRGB images of size
+	// aExtent, usable as colour attachments, transfer sources and
+	// destinations, and sampled images. The device is selected (see aDevice) and
+	// has the same features enabled as with make_vulkan_window(), as does
+	// aDeviceGroup; the images then have an instance per device.
+	// recreate_swapchain() must not be called on it.
+	VulkanWindow make_offscreen_window( VkExtent2D aExtent, std::uint32_t aImageCount = 1, char const* aDevice = nullptr, bool aDeviceGroup = false );
 
 
 	struct SwapChanges
@@ -50,7 +97,31 @@ namespace labutils
 		bool changedFormat: 1;
 	};
 
-	SwapChanges recreate_swapchain( VulkanWindow& );
+	// A swapchain replaced by recreate_swapchain(), with its image views;
+	// both are destroyed with this object. Frames in flight may still use
+	// them, so keep it until they have completed (e.g., with
+	// Timeline::retire()).
+	class RetiredSwapchain
+	{
+		public:
+			RetiredSwapchain() noexcept = default;
+			~RetiredSwapchain();
+
+			RetiredSwapchain( RetiredSwapchain const& ) = delete;
+			RetiredSwapchain& operator= (RetiredSwapchain const&) = delete;
+
+			RetiredSwapchain( RetiredSwapchain&& ) noexcept;
+			RetiredSwapchain& operator= (RetiredSwapchain&&) noexcept;
+
+		public:
+			VkDevice device = VK_NULL_HANDLE;
+			VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+			std::vector<VkImageView> views;
+	};
+
+	// Without aRetired, the old swapchain is destroyed right away, and no
+	// frame may be using it.
+	SwapChanges recreate_swapchain( VulkanWindow&, RetiredSwapchain* aRetired = nullptr );
 }
 
 //EOF vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab: 
@@ -1,3 +1,18 @@
+newoption {
+	trigger = "cpu-zones",
+	description = "Compile the CPU profiling zones (labutils/cpu_zones.hpp)"
+}
+
+newoption {
+	trigger = "coroutines",
+	description = "Build as C++20, with coroutine support in labutils/task.hpp"
+}
+
+newoption {
+	trigger = "libjpeg-turbo",
+	description = "Decode JPEGs with the system's libjpeg-turbo (labutils/image_decoder.hpp)"
+}
+
 workspace "COMP5822M-cw2"
 	language "C++"
 	cppdialect "C++17"
@@ -53,6 +68,19 @@ workspace "COMP5822M-cw2"
 		optimize "On"
 		defines { "NDEBUG=1" }
 
+	filter "options:cpu-zones"
+		defines { "LUT_CPU_ZONES=1" }
+
+	filter "options:coroutines"
+		cppdialect "C++20"
+		defines { "LUT_COROUTINES=1" }
+
+	filter { "options:libjpeg-turbo", "kind:ConsoleApp" }
+		links "jpeg"
+
+	filter "options:libjpeg-turbo"
+		defines { "LUT_LIBJPEG_TURBO=1" }
+
 	filter "*"
 
 -- Third party dependencies
@@ -61,6 +89,18 @@ include "third_party"
 -- GLSLC helpers
 dofile( "util/glslc.lua" )
 
+-- Shader audit (`premake5 shader-stats`)
+dofile( "util/shader_stats.lua" )
+
+-- Benchmark regression gate (`premake5 perf-gate`)
+dofile( "util/perf_gate.lua" )
+
+-- Sharded offline rendering of a camera path (`premake5 render-farm`)
+dofile( "util/render_farm.lua" )
+
+-- VMA memory report (`premake5 memory-report`)
+dofile( "util/memory_report.lua" )
+
 -- Projects
 project "cw2"
 	local sources = { 
@@ -100,7 +140,38 @@ project "cw2-shaders"
 
 	files( shaders )
 
-	handle_glsl_files( "-O", "assets/cw2/shaders", {} )
+	-- The subgroup variants, for devices with the subgroup operations (see
+	-- lut::DeviceCapabilities); the shaders without them need none. The
+	-- lighting ones are those that include point_lights.glsl, less the
+	-- G-buffer and depth-only ones.
+	local subgroupVariants = {
+		{
+			suffix = "_subgroup", define = "SUBGROUP_LIGHTS",
+			files = {
+				"cw2/shaders/default*.frag",
+				"cw2/shaders/bindless*.frag",
+				"cw2/shaders/arrays*.frag",
+				"cw2/shaders/deferred*.frag",
+				"cw2/shaders/visibility_shade*.frag"
+			},
+			exclude = { "*gbuffer*", "*depth*" }
+		},
+		{
+			suffix = "_subgroup", define = "SUBGROUP_COMPACTION",
+			files = { "cw2/shaders/cull.comp", "cw2/shaders/triangle_cull.comp" }
+		},
+		{
+			suffix = "_subgroup", define = "SUBGROUP_REDUCTION",
+			files = { "cw2/shaders/hiz.comp" }
+		}
+	}
+
+	-- The SPIR-V is also embedded in cw2 (see cw2/embedded_spirv.cpp); the
+	-- .spv files in assets/ override it with --shader-dir
+	-- SPIR-V 1.3 for the subgroup operations (see lut::DeviceCapabilities)
+	handle_glsl_files( "-O --target-env=vulkan1.1", "assets/cw2/shaders", {}, "cw2/shaders/embedded" )
+	handle_glsl_variants( subgroupVariants, "-O --target-env=vulkan1.1", "assets/cw2/shaders", {}, "cw2/shaders/embedded" )
+	embed_spirv_table( shaders, "cw2/shaders/embedded", subgroupVariants )
 
 project "cw2-bake"
 	local sources = { 
@@ -114,12 +185,92 @@ project "cw2-bake"
 
 	files( sources )
 
+	dependson "cw2-bake-shaders"
+
 	links "labutils" -- for lut::Error
 	links "x-tgen" -- Task 1.4
+	links "x-stb" -- texture baking
+	links "x-volk" -- --gpu-indexing
+	links "x-vma"
+
+	dependson "x-glm" 
+	dependson "x-rapidobj"
+
+project "cw2-bake-shaders"
+	local shaders = { 
+		"cw2-bake/shaders/*.comp"
+	}
+
+	kind "Utility"
+	location "cw2-bake/shaders"
+
+	files( shaders )
+
+	-- loaded from --gpu-indexing=DIR
+	handle_glsl_files( "-O", "assets/cw2-bake/shaders", {} )
+
+project "cw2-microbench"
+	local sources = { 
+		"cw2-microbench/**.cpp",
+		"cw2-microbench/**.hpp",
+		-- the code under test
+		"cw2-bake/index_mesh.cpp",
+		"cw2-bake/load_model_obj.cpp",
+		"cw2/baked_model.cpp"
+	}
+
+	kind "ConsoleApp"
+	location "cw2-microbench"
+
+	files( sources )
+
+	links "labutils"
+	links "x-tgen" -- make_indexed_mesh()
+	links "x-stb" -- decoders
+	links "x-volk" -- lut::decode_image() lives with the Vulkan images
+	links "x-vma"
 
 	dependson "x-glm" 
 	dependson "x-rapidobj"
 
+project "cw2-gpubench"
+	local sources = { 
+		"cw2-gpubench/**.cpp",
+		"cw2-gpubench/**.hpp",
+		-- the distribution LUT of the BRDF variants
+		"cw2/distribution_lut.cpp"
+	}
+
+	kind "ConsoleApp"
+	location "cw2-gpubench"
+
+	files( sources )
+
+	dependson "cw2-gpubench-shaders"
+
+	links "labutils"
+	links "x-volk"
+	links "x-stb"
+	links "x-glfw"
+	links "x-vma"
+
+	dependson "x-glm" 
+
+project "cw2-gpubench-shaders"
+	local shaders = { 
+		"cw2-gpubench/shaders/*.vert",
+		"cw2-gpubench/shaders/*.comp"
+	}
+
+	kind "Utility"
+	location "cw2-gpubench/shaders"
+
+	files( shaders )
+
+	-- brdf.glsl includes cw2's shading.glsl; not embedded, the SPIR-V is
+	-- loaded from --shader-dir
+	handle_glsl_files( "-O", "assets/cw2-gpubench/shaders", { "cw2/shaders" } )
+
 project "labutils"
 	local sources = { 
 		"labutils/**.cpp",
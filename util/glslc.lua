@@ -25,7 +25,11 @@ end
 
 local glslc = path.join( shaderc, binname );
 
-local glslc_build_command_ = function( kind, ext, opt, opath, ipaths )
+-- The rule for the files that match the filter, each compiled to
+-- opath/<name>.spv. With a suffix, adds to the rule of a single file that
+-- already has one (see handle_glsl_variants()): it is compiled again, to
+-- opath/<base><suffix>.<ext>.spv.
+local glslc_build_command_ = function( kind, files, opt, opath, ipaths, epath, suffix )
 	local istr = "";
 	for _,ipath in ipairs(ipaths) do
 		if "/" == ipath:sub(1,1) then
@@ -44,11 +48,25 @@ local glslc_build_command_ = function( kind, ext, opt, opath, ipaths )
 		odir = "%{wks.location}/" .. opath;
 		ofile = ofile .. "%{wks.location}/" .. opath;
 	end
-	ofile = ofile .. "/%{file.name}.spv";
+	local oname = "%{file.name}";
+	if suffix then
+		oname = "%{file.basename}" .. suffix .. "%{file.extension}";
+	end
+	ofile = ofile .. "/" .. oname .. ".spv";
+
+	-- The same SPIR-V as a C initializer list, to embed in the executable
+	local efile = nil;
+	if epath then
+		efile = "%{wks.location}/" .. epath .. "/" .. oname .. ".spv.inc";
+	end
 
-	filter( "files:**." .. ext )
-		buildmessage( "GLSLC: [" .. kind .. "] '%{file.name}'" );
-		buildcommands( "{mkdir} \"" .. odir .. "\"" );
+	-- premake drops repeated commands, so the variants leave the mkdirs
+	-- (and the message) to the file's own rule
+	filter( "files:" .. files )
+		if not suffix then
+			buildmessage( "GLSLC: [" .. kind .. "] '%{file.name}'" );
+			buildcommands( "{mkdir} \"" .. odir .. "\"" );
+		end
 		buildcommands(
 			 "\"%{wks.location}/" .. glslc ..  "\" "
 			 .. opt .. " "
@@ -56,11 +74,92 @@ local glslc_build_command_ = function( kind, ext, opt, opath, ipaths )
 			 .. "-o \"" .. ofile .. "\" "
 			 .. "\"%{file.relpath}\""
 		)
-		buildoutputs( ofile )
+		if efile then
+			if not suffix then
+				buildcommands( "{mkdir} \"%{wks.location}/" .. epath .. "\"" );
+			end
+			buildcommands(
+				 "\"%{wks.location}/" .. glslc ..  "\" "
+				 .. opt .. " "
+				 .. istr 
+				 .. "-mfmt=c -o \"" .. efile .. "\" "
+				 .. "\"%{file.relpath}\""
+			)
+			buildoutputs( { ofile, efile } )
+		else
+			buildoutputs( ofile )
+		end
 	filter "*"
 end
 
-handle_glsl_files = function( opt, opath, ipaths )
+-- The source files of a variant (see handle_glsl_variants())
+local glsl_variant_files_ = function( variant )
+	local sources = {};
+	for _,pattern in ipairs(variant.files) do
+		for _,source in ipairs(os.matchfiles( pattern )) do
+			local skip = false;
+			for _,exclude in ipairs(variant.exclude or {}) do
+				if path.getname( source ):match( path.wildcards( exclude ) ) then
+					skip = true;
+				end
+			end
+
+			if not skip then
+				table.insert( sources, source );
+			end
+		end
+	end
+	return sources;
+end
+
+-- Table of the SPIR-V embedded with handle_glsl_files()'s epath, written to
+-- epath/spirv_table.inc when the project files are generated (so, as with
+-- the build rules, new shaders need premake to run again). Each entry is a
+-- labutils::EmbeddedSpirv named after the .spv file; the table is included
+-- by one source file, which must include labutils/object_cache.hpp and
+-- <iterator> first. The variants are those of handle_glsl_variants().
+embed_spirv_table = function( patterns, epath, variants )
+	if not _ACTION then
+		return
+	end
+
+	local sources = {};
+	for _,pattern in ipairs(patterns) do
+		for _,source in ipairs(os.matchfiles( pattern )) do
+			table.insert( sources, path.getname( source ) );
+		end
+	end
+	for _,variant in ipairs(variants or {}) do
+		for _,source in ipairs(glsl_variant_files_( variant )) do
+			table.insert( sources, path.getbasename( source ) .. variant.suffix .. path.getextension( source ) );
+		end
+	end
+	table.sort( sources );
+
+	local arrays, entries = "", "";
+	for i,name in ipairs(sources) do
+		arrays = arrays .. "constexpr std::uint32_t kSpirv" .. i .. "_[] =\n"
+			.. "#include \"" .. name .. ".spv.inc\"\n"
+			.. ";\n";
+		entries = entries .. "\t{ \"" .. name .. ".spv\", kSpirv" .. i .. "_, std::size(kSpirv" .. i .. "_) },\n";
+	end
+
+	local contents = "// Generated by util/glslc.lua (embed_spirv_table()); do not edit.\n\n"
+		.. arrays .. "\n"
+		.. "constexpr labutils::EmbeddedSpirv kEmbeddedSpirv_[] = {\n"
+		.. entries
+		.. "};\n";
+
+	-- Only rewritten when the list changes, so that it doesn't trigger a
+	-- rebuild of the executable every time premake runs
+	local tfile = path.join( _MAIN_SCRIPT_DIR, epath, "spirv_table.inc" );
+	if io.readfile( tfile ) ~= contents then
+		os.mkdir( path.join( _MAIN_SCRIPT_DIR, epath ) );
+		io.writefile( tfile, contents );
+	end
+end
+
+handle_glsl_files = function( opt, opath, ipaths, epath )
 	local types = {
 		{ "VERT", "vert" },
 		{ "FRAG", "frag" },
@@ -71,7 +170,20 @@ handle_glsl_files = function( opt, opath, ipaths )
 	};
 
 	for _,ty in ipairs(types) do
-		glslc_build_command_( ty[1], ty[2], opt, opath, ipaths )
+		glslc_build_command_( ty[1], "**." .. ty[2], opt, opath, ipaths, epath )
+	end
+end
+
+-- Variants of some of the shaders: each of a variant's files (its patterns,
+-- minus the exclude ones, matched against the file names) is compiled a
+-- second time with -D<define>, to <base><suffix>.<ext>.spv; e.g.,
+--   { suffix = "_subgroup", define = "SUBGROUP_LIGHTS", files = { "a/*.frag" } }
+-- Takes the same arguments as handle_glsl_files() otherwise.
+handle_glsl_variants = function( variants, opt, opath, ipaths, epath )
+	for _,variant in ipairs(variants) do
+		for _,source in ipairs(glsl_variant_files_( variant )) do
+			glslc_build_command_( nil, "**/" .. path.getname( source ), opt .. " -D" .. variant.define, opath, ipaths, epath, variant.suffix )
+		end
 	end
 end
 
@@ -0,0 +1,114 @@
+-- VMA memory report: `premake5 memory-report` summarizes a statistics dump
+-- of cw2 (--memory-report=FILE, or the M key; default cw2-memory.json). It
+-- lists the bytes allocated per class (geometry, textures, render targets,
+-- ...) and the largest allocations by name, so that a change in the memory
+-- footprint can be traced to what grew.
+--
+-- Allocations are named "class: name" (see lut::set_name() and
+-- lut::name_allocation()); unnamed ones fall back to the class of their
+-- pool, or to their VMA type.
+
+local kTopAllocations = 20;
+
+newoption {
+	trigger = "memory-file",
+	value = "FILE",
+	description = "memory-report: VMA statistics dump (default: cw2-memory.json)"
+}
+
+local mebibytes_ = function( bytes )
+	return string.format( "%10.2f MiB", bytes / (1024*1024) );
+end
+
+-- The class part of a pool name ("N - class")
+local pool_class_ = function( name )
+	return name and name:match( "^%d+ %- (.+)$" );
+end
+
+-- Calls visit( allocation, pool class ) for each allocation object in the
+-- dump, whatever the nesting
+local walk_;
+walk_ = function( node, poolClass, visit )
+	if type( node ) ~= "table" then
+		return;
+	end
+
+	if node.Blocks then
+		poolClass = pool_class_( node.Name ) or poolClass;
+	end
+
+	if type( node.Type ) == "string" and type( node.Size ) == "number" then
+		if "FREE" ~= node.Type then
+			visit( node, poolClass );
+		end
+		return;
+	end
+
+	for _,child in pairs(node) do
+		walk_( child, poolClass, visit );
+	end
+end
+
+newaction {
+	trigger = "memory-report",
+	description = "Summarize a cw2 VMA statistics dump by allocation class",
+
+	execute = function()
+		local fname = _OPTIONS["memory-file"] or "cw2-memory.json";
+
+		local file = io.open( fname, "r" );
+		if not file then
+			error( "No '" .. fname .. "'; run cw2 with --memory-report=" .. fname .. ", or press M" );
+		end
+
+		local text = file:read( "a" );
+		file:close();
+
+		local dump, err = json.decode( text );
+		if not dump then
+			error( "'" .. fname .. "': " .. tostring( err ) );
+		end
+
+		local classes, allocations = {}, {};
+		local total, count = 0, 0;
+
+		walk_( dump, nil, function( alloc, poolClass )
+			local name = alloc.Name;
+			local class = name and name:match( "^(.-): " ) or name or poolClass or ("unnamed " .. alloc.Type);
+
+			local entry = classes[class] or { bytes = 0, count = 0 };
+			entry.bytes = entry.bytes + alloc.Size;
+			entry.count = entry.count + 1;
+			classes[class] = entry;
+
+			table.insert( allocations, { name = name or class, type = alloc.Type, size = alloc.Size } );
+			total = total + alloc.Size;
+			count = count + 1;
+		end );
+
+		local order = {};
+		for class in pairs(classes) do
+			table.insert( order, class );
+		end
+		table.sort( order, function( a, b ) return classes[a].bytes > classes[b].bytes; end );
+
+		print( string.format( "%s: %d allocations, %s", fname, count, mebibytes_( total ) ) );
+		print( "" );
+		print( string.format( "%-32s %14s %8s %6s", "class", "size", "count", "share" ) );
+		for _,class in ipairs(order) do
+			local entry = classes[class];
+			print( string.format( "%-32s %s %8d %5.1f%%", class, mebibytes_( entry.bytes ), entry.count, total > 0 and 100 * entry.bytes / total or 0 ) );
+		end
+
+		table.sort( allocations, function( a, b ) return a.size > b.size; end );
+
+		print( "" );
+		print( string.format( "Largest allocations (up to %d):", kTopAllocations ) );
+		for i = 1, math.min( kTopAllocations, #allocations ) do
+			local alloc = allocations[i];
+			print( string.format( "  %-48s %-14s %s", alloc.name, alloc.type, mebibytes_( alloc.size ) ) );
+		end
+	end
+}
+
+--EOF vim:syntax=lua:foldmethod=marker:ts=4:noexpandtab:
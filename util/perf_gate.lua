@@ -0,0 +1,233 @@
+-- Performance gate: `premake5 perf-gate` runs the headless benchmark
+-- (cw2 --bench) over the fixed camera path cw2/bench/sponza.path, and
+-- compares the p50/p95/p99 GPU and CPU frame times and the start-up time
+-- against a stored baseline (--perf-baseline, default cw2-perf-baseline.json).
+-- Any value that grew by more than --perf-threshold percent (default 10) is
+-- listed as a regression, and the action then fails. Pass --update-baseline
+-- to accept the current numbers; the first run (without a baseline) writes
+-- one.
+--
+-- Timings depend on the machine, driver and clocks, so the baseline is not
+-- checked in: record one per machine, from the same build configuration.
+-- Build cw2 (release) and bake the model first.
+
+local camerapath = "cw2/bench/sponza.path";
+local csvout = "_build_/perf-gate.csv";
+local startupout = "_build_/perf-gate-startup.json";
+
+-- The first frames include pipeline and cache warm-up
+local kWarmupFrames = 10;
+
+-- Differences below this are noise, whatever their percentage
+local kMinDeltaMs = 0.05;
+
+local metrics = { "gpu_ms", "cpu_ms" };
+local percentiles = { 50, 95, 99 };
+
+newoption {
+	trigger = "perf-exe",
+	value = "PATH",
+	description = "perf-gate: cw2 executable (default: bin/cw2-release-*)"
+}
+
+newoption {
+	trigger = "perf-baseline",
+	value = "FILE",
+	description = "perf-gate: baseline timings (default: cw2-perf-baseline.json)"
+}
+
+newoption {
+	trigger = "perf-threshold",
+	value = "PERCENT",
+	description = "perf-gate: allowed growth of each timing (default: 10)"
+}
+
+local find_exe_ = function()
+	if _OPTIONS["perf-exe"] then
+		return _OPTIONS["perf-exe"];
+	end
+
+	local names = os.matchfiles( "bin/cw2-release-*" );
+	table.sort( names );
+	if 0 == #names then
+		error( "No release build of cw2 in bin/; build it, or pass --perf-exe" );
+	end
+	return names[1];
+end
+
+local split_ = function( line )
+	local ret = {};
+	for field in (line .. ","):gmatch( "([^,]*)," ) do
+		table.insert( ret, field );
+	end
+	return ret;
+end
+
+-- Nearest rank
+local percentile_ = function( sorted, p )
+	local rank = math.max( 1, math.ceil( p / 100 * #sorted ) );
+	return sorted[rank];
+end
+
+-- Columns: frame,time,frame_ms,cpu_ms,vram_mib, then one <scope>_ms per GPU
+-- scope. The first scope is the whole frame (so its column is also named
+-- frame_ms; the earlier one is the wall-clock frame time).
+local read_bench_csv_ = function( fname )
+	local file = assert( io.open( fname, "r" ) );
+	local header = split_( file:read( "l" ) or "" );
+
+	local cpuCol, gpuCol;
+	for i,name in ipairs(header) do
+		if "cpu_ms" == name and not cpuCol then
+			cpuCol = i;
+		elseif "frame_ms" == name and i > 5 and not gpuCol then
+			gpuCol = i;
+		end
+	end
+	if not cpuCol or not gpuCol then
+		error( "'" .. fname .. "': unexpected benchmark columns" );
+	end
+
+	local samples = { gpu_ms = {}, cpu_ms = {} };
+	local row = 0;
+	for line in file:lines() do
+		row = row + 1;
+		if row > kWarmupFrames then
+			local fields = split_( line );
+			table.insert( samples.cpu_ms, tonumber( fields[cpuCol] ) );
+
+			-- Empty if the frame's timestamps weren't available
+			local gpu = tonumber( fields[gpuCol] );
+			if gpu then
+				table.insert( samples.gpu_ms, gpu );
+			end
+		end
+	end
+	file:close();
+
+	local ret = { frames = row - math.min( row, kWarmupFrames ) };
+	for _,metric in ipairs(metrics) do
+		local sorted = samples[metric];
+		if 0 == #sorted then
+			error( "'" .. fname .. "': no " .. metric .. " samples (GPU timestamps unsupported?)" );
+		end
+
+		table.sort( sorted );
+		ret[metric] = {};
+		for _,p in ipairs(percentiles) do
+			ret[metric]["p" .. p] = percentile_( sorted, p );
+		end
+	end
+
+	return ret;
+end
+
+local read_json_ = function( fname )
+	local file = io.open( fname, "r" );
+	if not file then
+		return nil;
+	end
+
+	local text = file:read( "a" );
+	file:close();
+
+	local ret, err = json.decode( text );
+	if not ret then
+		error( "'" .. fname .. "': " .. tostring( err ) );
+	end
+	return ret;
+end
+
+local write_baseline_ = function( fname, result )
+	local lines = { "{" };
+	table.insert( lines, string.format( "  \"camera_path\": \"%s\",", camerapath ) );
+	table.insert( lines, string.format( "  \"frames\": %d,", result.frames ) );
+	for _,metric in ipairs(metrics) do
+		local values = {};
+		for _,p in ipairs(percentiles) do
+			table.insert( values, string.format( "\"p%d\": %.4f", p, result[metric]["p" .. p] ) );
+		end
+		table.insert( lines, string.format( "  \"%s\": { %s },", metric, table.concat( values, ", " ) ) );
+	end
+	table.insert( lines, string.format( "  \"startup_ms\": %.3f", result.startup_ms ) );
+	table.insert( lines, "}" );
+
+	local file = assert( io.open( fname, "w" ) );
+	file:write( table.concat( lines, "\n" ) .. "\n" );
+	file:close();
+end
+
+newaction {
+	trigger = "perf-gate",
+	description = "Run the headless benchmark and flag timing regressions",
+
+	execute = function()
+		local exe = find_exe_();
+		local baseline = _OPTIONS["perf-baseline"] or "cw2-perf-baseline.json";
+		local threshold = tonumber( _OPTIONS["perf-threshold"] or "10" );
+		if not threshold or threshold < 0 then
+			error( "--perf-threshold: expected a non-negative percentage" );
+		end
+
+		os.mkdir( "_build_" );
+		local command = string.format( "\"%s\" --bench=%s --bench-csv=%s --startup-report=%s", exe, camerapath, csvout, startupout );
+		print( command );
+		if not os.execute( command ) then
+			error( "Benchmark failed: " .. command );
+		end
+
+		local result = read_bench_csv_( csvout );
+		local startup = read_json_( startupout );
+		if not startup or not startup.total_ms then
+			error( "'" .. startupout .. "': no start-up time" );
+		end
+		result.startup_ms = startup.total_ms;
+
+		local old = read_json_( baseline );
+		local rows = {};
+		for _,metric in ipairs(metrics) do
+			for _,p in ipairs(percentiles) do
+				table.insert( rows, {
+					name = metric .. " p" .. p,
+					value = result[metric]["p" .. p],
+					prev = old and old[metric] and old[metric]["p" .. p]
+				} );
+			end
+		end
+		table.insert( rows, { name = "startup_ms", value = result.startup_ms, prev = old and old.startup_ms } );
+
+		local regressions = {};
+		print( string.format( "%-16s %10s %10s %8s", "metric", "baseline", "current", "change" ) );
+		for _,row in ipairs(rows) do
+			if row.prev and row.prev > 0 then
+				local change = 100 * (row.value - row.prev) / row.prev;
+				local line = string.format( "%-16s %10.3f %10.3f %+7.1f%%", row.name, row.prev, row.value, change );
+				if change > threshold and row.value - row.prev > kMinDeltaMs then
+					table.insert( regressions, string.format( "%s %.3f -> %.3f ms (%+.1f%%)", row.name, row.prev, row.value, change ) );
+					print( line .. "  <-- regression" );
+				else
+					print( line );
+				end
+			else
+				print( string.format( "%-16s %10s %10.3f", row.name, "-", row.value ) );
+			end
+		end
+
+		if _OPTIONS["update-baseline"] or not old then
+			write_baseline_( baseline, result );
+			print( "Wrote " .. baseline );
+			return;
+		end
+
+		if #regressions > 0 then
+			print( "" );
+			print( #regressions .. " timing(s) grew by more than " .. threshold .. "% since " .. baseline .. ":" );
+			for _,reg in ipairs(regressions) do
+				print( "  " .. reg );
+			end
+			os.exit( 1 );
+		end
+	end
+}
+
+--EOF vim:syntax=lua:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,207 @@
+-- Render farm: `premake5 render-farm --farm-path=FILE` renders every key of
+-- a camera path offscreen and writes the frames as images, sharded over
+-- several cw2 processes. Each worker is a headless benchmark run (cw2
+-- --bench) over a contiguous range of the keys (--bench-frames), writing
+-- its images (--bench-images) and per-frame timings into --farm-out
+-- (default _build_/farm). The workers' CSVs are merged into farm.csv,
+-- ordered by key.
+--
+-- --farm-workers processes run on this machine. --farm-hosts adds as many
+-- on each listed machine, started over ssh in the same directory; the
+-- hosts need the same tree (build, baked model, camera path) at the same
+-- path, and --farm-out on a shared file system. Each worker loads the
+-- model once; the shards are equal, so hosts should be alike.
+--
+-- Extra cw2 options (e.g. "--bench-size=3840x2160") go in --farm-args.
+
+newoption {
+	trigger = "farm-path",
+	value = "FILE",
+	description = "render-farm: camera path to render"
+}
+
+newoption {
+	trigger = "farm-out",
+	value = "DIR",
+	description = "render-farm: output directory (default: _build_/farm)"
+}
+
+newoption {
+	trigger = "farm-workers",
+	value = "N",
+	description = "render-farm: worker processes per machine (default: 1)"
+}
+
+newoption {
+	trigger = "farm-hosts",
+	value = "HOSTS",
+	description = "render-farm: comma-separated ssh hosts that also run workers"
+}
+
+newoption {
+	trigger = "farm-args",
+	value = "ARGS",
+	description = "render-farm: extra options passed to each worker"
+}
+
+newoption {
+	trigger = "farm-exe",
+	value = "PATH",
+	description = "render-farm: cw2 executable (default: bin/cw2-release-*)"
+}
+
+local find_exe_ = function()
+	if _OPTIONS["farm-exe"] then
+		return _OPTIONS["farm-exe"];
+	end
+
+	local names = os.matchfiles( "bin/cw2-release-*" );
+	table.sort( names );
+	if 0 == #names then
+		error( "No release build of cw2 in bin/; build it, or pass --farm-exe" );
+	end
+	return names[1];
+end
+
+-- As load_camera_path() (cw2/camera_path.hpp): one key per line, without
+-- empty lines and comments
+local count_keys_ = function( fname )
+	local file = assert( io.open( fname, "r" ) );
+	local ret = 0;
+	for line in file:lines() do
+		if line:match( "%S" ) and not line:match( "^%s*#" ) then
+			ret = ret + 1;
+		end
+	end
+	file:close();
+	return ret;
+end
+
+local split_hosts_ = function( hosts )
+	local ret = {};
+	for host in (hosts or ""):gmatch( "[^,%s]+" ) do
+		table.insert( ret, host );
+	end
+	return ret;
+end
+
+-- Rows of a worker's CSV, keyed by their first column (the key); returns
+-- the header too
+local read_rows_ = function( fname, rows )
+	local file = io.open( fname, "r" );
+	if not file then
+		return nil;
+	end
+
+	local header = file:read( "l" );
+	for line in file:lines() do
+		local key = tonumber( line:match( "^([^,]*)," ) );
+		if key then
+			rows[key] = line;
+		end
+	end
+	file:close();
+	return header;
+end
+
+newaction {
+	trigger = "render-farm",
+	description = "Render a camera path offscreen, sharded over worker processes and hosts",
+
+	execute = function()
+		local path = _OPTIONS["farm-path"];
+		if not path then
+			error( "render-farm: pass the camera path with --farm-path" );
+		end
+
+		local exe = find_exe_();
+		local outdir = _OPTIONS["farm-out"] or "_build_/farm";
+		local extra = _OPTIONS["farm-args"] or "";
+
+		local perMachine = tonumber( _OPTIONS["farm-workers"] or "1" );
+		if not perMachine or perMachine < 1 then
+			error( "--farm-workers: expected a positive number" );
+		end
+
+		-- false: this machine
+		local machines = { false };
+		for _,host in ipairs(split_hosts_( _OPTIONS["farm-hosts"] )) do
+			table.insert( machines, host );
+		end
+
+		local keys = count_keys_( path );
+		local workers = math.min( keys, perMachine * #machines );
+		if 0 == workers then
+			error( "'" .. path .. "': no keys" );
+		end
+
+		os.mkdir( outdir );
+		local cwd = os.getcwd();
+
+		-- Contiguous shards; the first (keys % workers) get a key more
+		local jobs = {};
+		local first = 0;
+		for i = 0, workers-1 do
+			local count = math.floor( keys / workers ) + ((i < keys % workers) and 1 or 0);
+			local csv = string.format( "%s/worker-%03d.csv", outdir, i );
+			local command = string.format( "\"%s\" --bench=%s --bench-frames=%d:%d --bench-images=%s --bench-csv=%s %s",
+				exe, path, first, count, outdir, csv, extra );
+
+			local host = machines[1 + i % #machines];
+			if host then
+				command = string.format( "ssh %s 'cd \"%s\" && %s'", host, cwd, command:gsub( "'", "'\\''" ) );
+			end
+
+			print( command );
+			table.insert( jobs, { csv = csv, command = command, host = host or "localhost", count = count } );
+			first = first + count;
+		end
+
+		-- The workers run concurrently; closing a pipe waits for its
+		-- process
+		local started = os.time();
+		for _,job in ipairs(jobs) do
+			job.pipe = assert( io.popen( job.command .. " 2>&1", "r" ) );
+		end
+
+		local failed = {};
+		for i,job in ipairs(jobs) do
+			local output = job.pipe:read( "a" );
+			local ok = job.pipe:close();
+			if not ok then
+				table.insert( failed, string.format( "worker %d (%s)", i-1, job.host ) );
+				io.write( output );
+			end
+		end
+		local seconds = math.max( os.difftime( os.time(), started ), 1 );
+
+		-- Merge the timings, ordered by key
+		local rows, header = {}, nil;
+		for _,job in ipairs(jobs) do
+			header = read_rows_( job.csv, rows ) or header;
+		end
+
+		local merged = outdir .. "/farm.csv";
+		local file = assert( io.open( merged, "w" ) );
+		file:write( (header or "frame") .. "\n" );
+		local frames = 0;
+		for key = 0, keys-1 do
+			if rows[key] then
+				file:write( rows[key] .. "\n" );
+				frames = frames + 1;
+			end
+		end
+		file:close();
+
+		print( string.format( "%d of %d frames by %d worker(s) on %d machine(s) in %d s: %.2f frames/s",
+			frames, keys, workers, math.min( workers, #machines ), seconds, frames / seconds ) );
+		print( "Wrote " .. merged );
+
+		if #failed > 0 then
+			print( #failed .. " worker(s) failed: " .. table.concat( failed, ", " ) );
+			os.exit( 1 );
+		end
+	end
+}
+
+--EOF vim:syntax=lua:foldmethod=marker:ts=4:noexpandtab:
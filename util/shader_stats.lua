@@ -0,0 +1,213 @@
+-- Shader audit: `premake5 shader-stats` lists per-shader instruction counts
+-- of the compiled SPIR-V (assets/cw2/shaders/*.spv, so build cw2-shaders
+-- first) and compares them against the checked-in baseline,
+-- cw2/shaders/shader-stats.txt. Any shader whose code, ALU, texture or branch
+-- count grew is listed as a regression, and the action then fails. Pass
+-- --update-baseline to accept the current numbers.
+--
+-- Note: limitation: register counts are only known to the driver's backend
+-- compiler, and are not part of SPIR-V. The id bound is listed as a (rough)
+-- proxy. Vendor tools (e.g., RGA, the Mali Offline Compiler) report the real
+-- numbers; run them on the .spv files as needed.
+
+local spvdir = "assets/cw2/shaders";
+local baseline = "cw2/shaders/shader-stats.txt";
+local columns = { "code", "alu", "tex", "mem", "branch", "ids" };
+
+-- Opcode classes; see the SPIR-V specification, section 3.52.
+local class_ = {};
+local classify_ = function( name, first, last )
+	for op = first, last or first do
+		class_[op] = name;
+	end
+end
+
+classify_( "alu", 12 ); -- OpExtInst (GLSL.std.450)
+classify_( "alu", 109, 124 ); -- conversions
+classify_( "alu", 126, 152 ); -- arithmetic
+classify_( "alu", 164, 191 ); -- relational and logical
+classify_( "alu", 194, 205 ); -- bit operations
+classify_( "tex", 87, 98 ); -- OpImageSample*, OpImageFetch, OpImageGather, OpImageRead
+classify_( "tex", 305, 315 ); -- OpImageSparse*
+classify_( "mem", 61, 62 ); -- OpLoad, OpStore
+classify_( "mem", 227, 242 ); -- atomics
+classify_( "branch", 250, 252 ); -- OpBranchConditional, OpSwitch, OpKill
+classify_( "branch", 4416 ); -- OpTerminateInvocation
+
+-- Not counted as code: these are (typically) free once the backend has
+-- compiled the shader, and only add noise to the counts.
+classify_( "free", 8 ); -- OpLine
+classify_( "free", 54, 56 ); -- OpFunction, OpFunctionParameter, OpFunctionEnd
+classify_( "free", 59 ); -- OpVariable
+classify_( "free", 65 ); -- OpAccessChain
+classify_( "free", 79, 81 ); -- OpVectorShuffle, OpCompositeConstruct, OpCompositeExtract
+classify_( "free", 246, 249 ); -- OpLoopMerge, OpSelectionMerge, OpLabel, OpBranch
+classify_( "free", 317 ); -- OpNoLine
+
+local kOpFunction = 54;
+local kMagic = 0x07230203;
+
+local stats_ = function( fname )
+	local file = assert( io.open( fname, "rb" ) );
+	local data = file:read( "a" );
+	file:close();
+
+	if #data < 20 or #data % 4 ~= 0 then
+		return nil;
+	end
+
+	local fmt = "<I4";
+	if kMagic ~= string.unpack( fmt, data ) then
+		fmt = ">I4";
+		if kMagic ~= string.unpack( fmt, data ) then
+			return nil;
+		end
+	end
+
+	local ret = { code = 0, alu = 0, tex = 0, mem = 0, branch = 0 };
+	ret.ids = string.unpack( fmt, data, 13 );
+
+	-- Only instructions in function bodies are code; the rest are types,
+	-- constants, decorations and debug info. Swizzles and the like are not
+	-- counted either (see "free" above).
+	local inFunction = false;
+	local pos = 21;
+	while pos <= #data do
+		local word = string.unpack( fmt, data, pos );
+		local count, op = word >> 16, word & 0xffff;
+		if 0 == count then
+			return nil;
+		end
+
+		if kOpFunction == op then
+			inFunction = true;
+		end
+
+		local class = class_[op];
+		if inFunction and "free" ~= class then
+			ret.code = ret.code + 1;
+			if class then
+				ret[class] = ret[class] + 1;
+			end
+		end
+
+		pos = pos + 4 * count;
+	end
+
+	return ret;
+end
+
+local read_baseline_ = function()
+	local ret = {};
+	local file = io.open( baseline, "r" );
+	if not file then
+		return ret;
+	end
+
+	for line in file:lines() do
+		if "#" ~= line:sub(1,1) then
+			local fields = {};
+			for field in line:gmatch( "%S+" ) do
+				table.insert( fields, field );
+			end
+
+			if #fields == 1 + #columns then
+				local entry = {};
+				for i,col in ipairs(columns) do
+					entry[col] = tonumber( fields[1+i] );
+				end
+				ret[fields[1]] = entry;
+			end
+		end
+	end
+
+	file:close();
+	return ret;
+end
+
+local format_ = function( name, row )
+	local ret = string.format( "%-40s", name );
+	for _,col in ipairs(columns) do
+		ret = ret .. string.format( " %7s", tostring( row[col] ) );
+	end
+	return ret;
+end
+
+newoption {
+	trigger = "update-baseline",
+	description = "shader-stats, perf-gate: accept the current numbers as the baseline"
+}
+
+newaction {
+	trigger = "shader-stats",
+	description = "List compiled shader instruction counts and flag regressions",
+
+	execute = function()
+		local names = os.matchfiles( path.join( spvdir, "*.spv" ) );
+		table.sort( names );
+
+		if 0 == #names then
+			error( "No shaders in '" .. spvdir .. "'; build cw2-shaders first" );
+		end
+
+		local old = read_baseline_();
+		local header = {};
+		for _,col in ipairs(columns) do
+			header[col] = col;
+		end
+		header = format_( "shader", header );
+
+		local lines = { "# " .. header };
+		local regressions = {};
+
+		print( header );
+		for _,fname in ipairs(names) do
+			local name = path.getname( fname );
+			local row = stats_( fname );
+			if not row then
+				error( "'" .. fname .. "' is not a SPIR-V module" );
+			end
+
+			local line = format_( name, row );
+			table.insert( lines, line );
+
+			local prev = old[name];
+			local grew = {};
+			if prev then
+				for _,col in ipairs({ "code", "alu", "tex", "branch" }) do
+					if row[col] > prev[col] then
+						table.insert( grew, string.format( "%s %d -> %d", col, prev[col], row[col] ) );
+					end
+				end
+			end
+
+			if #grew > 0 then
+				table.insert( regressions, name .. ": " .. table.concat( grew, ", " ) );
+				print( line .. "  <-- regression" );
+			elseif not prev then
+				print( line .. "  (new)" );
+			else
+				print( line );
+			end
+		end
+
+		if _OPTIONS["update-baseline"] then
+			local file = assert( io.open( baseline, "w" ) );
+			file:write( table.concat( lines, "\n" ) .. "\n" );
+			file:close();
+			print( "Wrote " .. baseline );
+			return;
+		end
+
+		if #regressions > 0 then
+			print( "" );
+			print( #regressions .. " shader(s) grew since " .. baseline .. ":" );
+			for _,reg in ipairs(regressions) do
+				print( "  " .. reg );
+			end
+			os.exit( 1 );
+		end
+	end
+}
+
+--EOF vim:syntax=lua:foldmethod=marker:ts=4:noexpandtab: